@@ -48,6 +48,7 @@
 
 #include "logging_levels.h"
 #define LOG_LEVEL    LOG_INFO
+#define LOG_MODULE    LOG_MODULE_DEFENDER
 #include "logging.h"
 
 
@@ -77,27 +78,51 @@
 
 #include "cbor.h"
 
+/* TLS connect profile, reported as custom metrics when enabled. */
+#include "mbedtls_transport.h"
+
+/* Agent statistics includes. */
+#include "mqtt_agent_task.h"
+#include "mqtt_reconnect.h"
+#include "mqtt_publish_async.h"
+
+#include "work_queue.h"
+
+#if TLS_TRANSPORT_PROFILE == 1
+#include "stm32u5xx.h"
+#include "heap_classes.h"
+#endif /* TLS_TRANSPORT_PROFILE == 1 */
+
+/* Stack depth of each task, for the stack usage metrics. */
+#include "task_stats.h"
+
+#if DEFENDER_LWIP_METRICS == 1
+#include "net_stats.h"
+#endif
+
+/* Power state residency and energy estimates. */
+#include "power_stats.h"
+
 #define TCP_PORTS_MAX                      10
 #define UDP_PORTS_MAX                      10
 #define CONNECTIONS_MAX                    10
-#define TASKS_MAX                          10
-#define REPORT_BUFFER_SIZE                 1024
+#define TASKS_MAX                          16
 
 #define REPORT_MAJOR_VERSION               1
 #define REPORT_MINOR_VERSION               0
 
 #define MS_BETWEEN_REPORTS                 ( 5 * 60 * 1000U )      /* 5 Minute reporting interval */
 #define RESPONSE_TIMEOUT_MS                ( 30 * 1000U )
-#define MQTT_BLOCK_TIME_MS                 ( 10 * 1000U )
+#define MS_BETWEEN_RETRIES                 ( 5 * 1000U )           /* While the agent is not connected */
+
+/* Short, the report job shares the worker, the heap is used when the publish pool is empty */
+#define MQTT_BLOCK_TIME_MS                 ( 100U )
 
 #define RESPONSE_REPORT_ID_FIELD           "reportId"
 #define RESPONSE_REPORT_ID_FIELD_LENGTH    ( sizeof( RESPONSE_REPORT_ID_FIELD ) - 1 )
 
 #define NUM_TOPIC_STRINGS                  3
 
-#define NOTIFY_IDX_ACCEPTED_REJECTED       1
-#define NOTIFY_IDX_PUBACK                  2
-
 /*-----------------------------------------------------------*/
 
 typedef enum
@@ -108,39 +133,106 @@ typedef enum
     ReportStatusInvalid = 3
 } ReportStatus_t;
 
+typedef enum
+{
+    DefenderStateSubscribe = 0, /* Waiting for the agent to subscribe to the response topics */
+    DefenderStateSubscribing,   /* Waiting for the SUBACK */
+    DefenderStateReport,        /* Next run publishes a report */
+    DefenderStateResponse,      /* Waiting for the PUBACK and the response, or RESPONSE_TIMEOUT_MS */
+    DefenderStateStopped
+} DefenderState_t;
+
 struct MQTTAgentCommandContext
 {
-    TaskHandle_t xAgentTask;
+    WorkJob_t xJob;
+    DefenderState_t xState;
     size_t uxDeviceIdLen;
     char * pcDeviceId;
     char * pcPublishTopic;
     const char * pcAcceptedTopic;
     const char * pcRejectedTopic;
     uint16_t usPublishTopicLen;
-    BaseType_t xWaitingForCallback;
+    volatile BaseType_t xWaitingForCallback;
     MQTTAgentHandle_t xAgentHandle;
+    uint8_t * volatile pucHeapReport; /* Report too large for the publish pool, freed on completion */
+    TickType_t xReportStart;
+    volatile BaseType_t xSubscribeDone;
+    volatile MQTTStatus_t xSubscribeStatus;
+    volatile BaseType_t xPublishDone;
+    volatile MQTTStatus_t xPublishStatus;
+    volatile ReportStatus_t xReportStatus;
 };
 
 typedef struct MQTTAgentCommandContext DefenderAgentCtx_t;
 
-BaseType_t xExitFlag = pdFALSE;
+/* Custom metric values of one report, sampled once and encoded by every pass */
+typedef struct
+{
+    uint32_t ulHeapFree;
+    uint32_t ulHeapMinFree;
+    uint32_t ulNumTasks;
+    char pcTaskName[ TASKS_MAX ][ configMAX_TASK_NAME_LEN ];
+    uint32_t pulCpuPct[ TASKS_MAX ];
+    uint32_t pulStackHwm[ TASKS_MAX ];
+    uint32_t pulStackUsedPct[ TASKS_MAX ];
+    uint32_t ulCpuLoad;
+    uint32_t ulStackHwmMin;
+    uint32_t ulStackSlack;
+    BaseType_t xHasRtt;
+    uint32_t ulRttMeanMs;
+    BaseType_t xHasReconnect;
+    uint32_t ulConnects;
+    uint32_t ulTlsFailures;
+#if TLS_TRANSPORT_PROFILE == 1
+    BaseType_t xHasTlsProfile;
+    uint32_t pulTlsPhaseUs[ TLS_PROFILE_NUM_PHASES ];
+    uint32_t ulTlsHeapPeak;
+#endif /* TLS_TRANSPORT_PROFILE == 1 */
+    BaseType_t xHasHeapTags;
+    HeapTagStats_t xHeapTags;
+#if DEFENDER_LWIP_METRICS == 1
+    const NetStats_t * pxLwip; /* Too large for the stack of the task, see xLwipStats */
+    uint32_t ulLwipRexmit;
+    uint32_t ulLwipAlarms;
+#endif /* DEFENDER_LWIP_METRICS == 1 */
+#if POWER_STATS_ENABLED == 1
+    uint32_t pulPowerStateMs[ POWER_STATE_COUNT ];
+    uint32_t pulRadioMs[ POWER_RADIO_COUNT ];
+    uint32_t ulPowerWakes;
+    uint32_t ulEnergyUj;
+    uint32_t pulOpCount[ POWER_OP_COUNT ];
+    uint32_t pulOpWakes[ POWER_OP_COUNT ];
+    uint32_t pulOpEnergyUj[ POWER_OP_COUNT ];
+#endif /* POWER_STATS_ENABLED == 1 */
+} CustomMetricsSample_t;
+
+/* Used by the callbacks of the agent, which outlive any one report */
+static DefenderAgentCtx_t xDefenderCtx = { 0 };
 
 /*-----------------------------------------------------------*/
 
 /**
- * @brief Subscribe to the device defender topics.
+ * @brief Queue the subscription to the device defender topics.
  *
- * @return true if the subscribe is successful;
+ * @return true if the subscribe request was queued;
  * false otherwise.
  */
 static bool prvSubscribeToDefenderTopics( DefenderAgentCtx_t * pxCtx );
 
 
 /**
+ * @brief Completion callback of a report published from the heap.
+ * Frees the report buffer and wakes the defender task.
  */
 static void prvPublishOpCb( MQTTAgentCommandContext_t * pxCommandContext,
                             MQTTAgentReturnInfo_t * pxReturnInfo );
 
+/**
+ * @brief Completion callback of a report published from a publish pool buffer.
+ */
+static void prvPublishCompleteCb( void * pvCtx,
+                                  MQTTStatus_t xStatus );
+
 /**
  * @brief The callback to execute when there is an incoming publish on the
  * topic for accepted report responses. It verifies the response and sets the
@@ -171,17 +263,59 @@ static void prvReportRejectedCallback( void * pxSubscriptionContext,
  */
 static CborError prvCollectDeviceMetrics( CborEncoder * pxEncoder );
 
+/**
+ * @brief Add device health to the report as custom metrics.
+ *
+ * Each metric has to be created with CreateCustomMetric in the account before
+ * Defender accepts it:
+ * - heap_free, heap_min_free: free heap and its low-water mark in bytes.
+ * - cpu_load_pct: percentage of time not spent in the idle task since the last report.
+ * - task_cpu_pct: string list of "<task>:<percent>" since the last report.
+ * - stack_hwm_min: smallest stack high-water mark of any task in bytes.
+ * - task_stack_hwm: string list of "<task>:<bytes>" stack high-water marks.
+ * - task_stack_used_pct: string list of "<task>:<percent>" of the stack used since boot.
+ * - stack_slack_bytes: stack bytes of all tasks beyond their peak use plus
+ *   TASK_STATS_STACK_MARGIN_PCT, i.e. what right-sizing the stacks would free.
+ * - mqtt_pub_rtt_ms: mean acknowledgement time of QoS1 publishes since the last report.
+ * - mqtt_connects, tls_failures: connections made and TLS failures since the last report.
+ * - tls_connect_us, tls_connect_heap: profile of the last TLS connect when
+ *   TLS_TRANSPORT_PROFILE is set. tls_connect_us is a number list with the time
+ *   in microseconds of each TlsProfilePhase_t, tls_connect_heap is the heap peak in bytes.
+ * - heap_tag_bytes: string list of "<tag>:<current>:<peak>" heap bytes per
+ *   subsystem when HEAP_ACCOUNTING is set.
+ * - lwip_pools, lwip_tcp_rexmit, lwip_tcp_ooseq_max, lwip_mbox_max_depth,
+ *   lwip_pool_alarms: lwIP memory use when DEFENDER_LWIP_METRICS is set.
+ *   lwip_pools is a string list of "<pool>:<used>:<max>:<avail>:<err>" for the
+ *   heap and each pool that has been used, with the high-water mark since boot.
+ *   lwip_tcp_rexmit and lwip_pool_alarms count retransmitted segments and pool
+ *   exhaustion alarms since the last report. The other two are high-water marks
+ *   since boot.
+ * - power_state_ms, wifi_state_ms, power_wakes, energy_uj: time in each
+ *   PowerState_t and PowerRadioState_t, tickless idle wakes and estimated energy
+ *   since the last report, when POWER_STATS_ENABLED is set.
+ * - op_count, op_wakes, op_energy_uj: number lists indexed by PowerOp_t with the
+ *   operations completed, the wakes while they were in flight and the estimated
+ *   energy per operation since the last report.
+ */
+static CborError prvCollectCustomMetrics( CborEncoder * pxEncoder,
+                                          const CustomMetricsSample_t * pxSample );
+
 /**
  * @brief Publish the generated device defender report.
  *
+ * The report buffer is handed over and released once the publish completes.
+ *
  * @param[in] ulReportLength Length of the device defender report.
+ * @param[in] xFromPool pdTRUE if pucReportBuf is a publish pool buffer,
+ * pdFALSE if it was allocated from the heap.
  *
  * @return true if the report is published successfully;
  * false otherwise.
  */
 static bool prvPublishDeviceMetricsReport( DefenderAgentCtx_t * pxCtx,
                                            uint8_t * pucReportBuf,
-                                           uint32_t ulReportLength );
+                                           uint32_t ulReportLength,
+                                           BaseType_t xFromPool );
 
 /**
  * @brief Validate the response received from the AWS IoT Device Defender Service.
@@ -199,22 +333,40 @@ static bool prvValidateDefenderResponse( const char * pcDefenderResponse,
                                          uint32_t ulDefenderResponseLength );
 
 /**
- * @brief The task used to demonstrate the Defender API.
+ * @brief Start the job used to demonstrate the Defender API.
  *
- * This task collects metrics from the device using the functions in
+ * This job collects metrics from the device using the functions in
  * metrics_collector.h and uses them to build a defender report using functions
  * in report_builder.h. Metrics include the number for bytes written and read
  * over the network, open TCP and UDP ports, and open TCP sockets. The
  * generated report is then published to the AWS IoT Device Defender service.
  *
- * @param[in] pvParameters Parameters as passed at the time of task creation.
- * Not used in this example.
+ * The job runs on the worker of work_queue.h, call once from a task.
  */
-void vDefenderAgentTask( void * pvParameters );
+void vDefenderAgentStart( void );
 
 /*-----------------------------------------------------------*/
 
 
+/* Called from the MQTT agent task */
+static void prvPublishDone( DefenderAgentCtx_t * pxCtx,
+                            MQTTStatus_t xStatus )
+{
+    if( pxCtx->xWaitingForCallback == pdTRUE )
+    {
+        pxCtx->xPublishStatus = xStatus;
+        pxCtx->xPublishDone = pdTRUE;
+
+        /* A failed publish gets no response, do not wait for it */
+        if( xStatus != MQTTSuccess )
+        {
+            vWorkJobSchedule( &( pxCtx->xJob ), 0 );
+        }
+    }
+}
+
+/*-----------------------------------------------------------*/
+
 static void prvPublishOpCb( MQTTAgentCommandContext_t * pxCommandContext,
                             MQTTAgentReturnInfo_t * pxReturnInfo )
 {
@@ -222,13 +374,29 @@ static void prvPublishOpCb( MQTTAgentCommandContext_t * pxCommandContext,
     configASSERT_CONTINUE( pxReturnInfo );
 
     if( ( pxCommandContext != NULL ) &&
-        ( pxReturnInfo != NULL ) &&
-        ( pxCommandContext->xWaitingForCallback == pdTRUE ) )
+        ( pxCommandContext->pucHeapReport != NULL ) )
     {
-        ( void ) xTaskNotifyIndexed( pxCommandContext->xAgentTask,
-                                     NOTIFY_IDX_PUBACK,
-                                     pxReturnInfo->returnCode,
-                                     eSetValueWithOverwrite );
+        vPortFree( pxCommandContext->pucHeapReport );
+        pxCommandContext->pucHeapReport = NULL;
+    }
+
+    if( ( pxCommandContext != NULL ) &&
+        ( pxReturnInfo != NULL ) )
+    {
+        prvPublishDone( pxCommandContext, pxReturnInfo->returnCode );
+    }
+}
+
+static void prvPublishCompleteCb( void * pvCtx,
+                                  MQTTStatus_t xStatus )
+{
+    DefenderAgentCtx_t * pxCtx = ( DefenderAgentCtx_t * ) pvCtx;
+
+    configASSERT_CONTINUE( pxCtx );
+
+    if( pxCtx != NULL )
+    {
+        prvPublishDone( pxCtx, xStatus );
     }
 }
 
@@ -244,7 +412,11 @@ static void prvClearCtx( DefenderAgentCtx_t * pxCtx )
         vPortFree( pxCtx->pcPublishTopic );
     }
 
-    memset( pxCtx, 0, sizeof( DefenderAgentCtx_t ) );
+    /* The job stays linked in the work queue, only the strings are released */
+    pxCtx->pcDeviceId = NULL;
+    pxCtx->uxDeviceIdLen = 0;
+    pxCtx->pcPublishTopic = NULL;
+    pxCtx->usPublishTopicLen = 0;
 }
 
 static bool prvBuildDefenderTopicStrings( DefenderAgentCtx_t * pxCtx )
@@ -293,59 +465,42 @@ static bool prvBuildDefenderTopicStrings( DefenderAgentCtx_t * pxCtx )
     return( xRslt == DefenderSuccess );
 }
 
-static bool prvSubscribeToDefenderTopics( DefenderAgentCtx_t * pxCtx )
+/* Called from the MQTT agent task, or from the job when nothing needed subscribing */
+static void prvSubscribeCompleteCb( void * pvCtx,
+                                    MQTTStatus_t xStatus )
 {
-    MQTTStatus_t xStatus = MQTTSuccess;
-
-    xStatus = MqttAgent_SubscribeSync( pxCtx->xAgentHandle,
-                                       pxCtx->pcAcceptedTopic,
-                                       MQTTQoS1,
-                                       prvReportAcceptedCallback,
-                                       pxCtx );
-
-    configASSERT_CONTINUE( xStatus == MQTTSuccess );
-
-    if( xStatus != MQTTSuccess )
-    {
-        LogError( "Failed to subscribe to topic: %s", pxCtx->pcAcceptedTopic );
-    }
-    else
-    {
-        xStatus = MqttAgent_SubscribeSync( pxCtx->xAgentHandle,
-                                           pxCtx->pcRejectedTopic,
-                                           MQTTQoS1,
-                                           prvReportRejectedCallback,
-                                           pxCtx );
-
-        configASSERT_CONTINUE( xStatus == MQTTSuccess );
+    DefenderAgentCtx_t * pxCtx = ( DefenderAgentCtx_t * ) pvCtx;
 
-        if( xStatus != MQTTSuccess )
-        {
-            LogError( "Failed to subscribe to topic: %s", pxCtx->pcRejectedTopic );
-        }
-    }
+    pxCtx->xSubscribeStatus = xStatus;
+    pxCtx->xSubscribeDone = pdTRUE;
 
-    return( xStatus == MQTTSuccess );
+    vWorkJobSchedule( &( pxCtx->xJob ), 0 );
 }
 
-static void prvUnsubscribeFromDefenderTopics( DefenderAgentCtx_t * pxCtx )
+static bool prvSubscribeToDefenderTopics( DefenderAgentCtx_t * pxCtx )
 {
     MQTTStatus_t xStatus = MQTTSuccess;
 
-    xStatus = MqttAgent_UnSubscribeSync( pxCtx->xAgentHandle,
-                                         pxCtx->pcAcceptedTopic,
-                                         prvReportAcceptedCallback,
-                                         pxCtx );
+    const SubscribeRequest_t xRequests[] =
+    {
+        { pxCtx->pcAcceptedTopic, MQTTQoS1, prvReportAcceptedCallback, pxCtx },
+        { pxCtx->pcRejectedTopic, MQTTQoS1, prvReportRejectedCallback, pxCtx },
+    };
 
-    configASSERT_CONTINUE( xStatus == MQTTSuccess );
+    pxCtx->xSubscribeDone = pdFALSE;
 
+    xStatus = MqttAgent_SubscribeAsync( pxCtx->xAgentHandle,
+                                        xRequests,
+                                        sizeof( xRequests ) / sizeof( xRequests[ 0 ] ),
+                                        prvSubscribeCompleteCb,
+                                        pxCtx );
 
-    xStatus = MqttAgent_UnSubscribeSync( pxCtx->xAgentHandle,
-                                         pxCtx->pcRejectedTopic,
-                                         prvReportRejectedCallback,
-                                         pxCtx );
+    if( xStatus != MQTTSuccess )
+    {
+        LogError( "Failed to subscribe to topics: %s, %s", pxCtx->pcAcceptedTopic, pxCtx->pcRejectedTopic );
+    }
 
-    configASSERT_CONTINUE( xStatus == MQTTSuccess );
+    return( xStatus == MQTTSuccess );
 }
 
 /*-----------------------------------------------------------*/
@@ -395,12 +550,9 @@ static void prvReportAcceptedCallback( void * pvCtx,
 
         prvPrintHex( ( uint8_t * ) ( pxPublishInfo->pPayload ), pxPublishInfo->payloadLength );
 
-        /* Send a notification to the task in case it is waiting for this incoming
-         * message. */
-        ( void ) xTaskNotifyIndexed( pxCtx->xAgentTask,
-                                     NOTIFY_IDX_ACCEPTED_REJECTED,
-                                     ulResponseStatus,
-                                     eSetValueWithOverwrite );
+        /* Let the report job handle the response */
+        pxCtx->xReportStatus = ( ReportStatus_t ) ulResponseStatus;
+        vWorkJobSchedule( &( pxCtx->xJob ), 0 );
     }
 }
 
@@ -433,12 +585,9 @@ static void prvReportRejectedCallback( void * pvCtx,
 
         prvPrintHex( ( uint8_t * ) ( pxPublishInfo->pPayload ), pxPublishInfo->payloadLength );
 
-        /* Send a notification to the task in case it is waiting for this incoming
-         * message. */
-        ( void ) xTaskNotifyIndexed( pxCtx->xAgentTask,
-                                     NOTIFY_IDX_ACCEPTED_REJECTED,
-                                     ulResponseStatus,
-                                     eSetValueWithOverwrite );
+        /* Let the report job handle the response */
+        pxCtx->xReportStatus = ( ReportStatus_t ) ulResponseStatus;
+        vWorkJobSchedule( &( pxCtx->xJob ), 0 );
     }
 }
 
@@ -452,312 +601,1221 @@ static CborError prvCollectDeviceMetrics( CborEncoder * pxEncoder )
     configASSERT( pxEncoder != NULL );
 
     xError = cbor_encode_text_stringz( pxEncoder, "met" );
-    configASSERT_CONTINUE( xError == CborNoError );
+    configASSERT_CONTINUE( CBOR_ENCODE_OK( xError ) );
 
-    if( xError == CborNoError )
+    if( CBOR_ENCODE_OK( xError ) )
     {
         xError = cbor_encoder_create_map( pxEncoder, &xMetricsEncoder, CborIndefiniteLength );
-        configASSERT_CONTINUE( xError == CborNoError );
+        configASSERT_CONTINUE( CBOR_ENCODE_OK( xError ) );
     }
 
-    if( xError == CborNoError )
+    if( CBOR_ENCODE_OK( xError ) )
     {
         xError = xGetNetworkStats( &xMetricsEncoder );
-        configASSERT_CONTINUE( xError == CborNoError );
+        configASSERT_CONTINUE( CBOR_ENCODE_OK( xError ) );
     }
 
-    if( xError == CborNoError )
+    if( CBOR_ENCODE_OK( xError ) )
     {
         xError = xGetListeningTcpPorts( &xMetricsEncoder );
-        configASSERT_CONTINUE( xError == CborNoError );
+        configASSERT_CONTINUE( CBOR_ENCODE_OK( xError ) );
     }
 
-    if( xError == CborNoError )
+    if( CBOR_ENCODE_OK( xError ) )
     {
         xError = xGetListeningUdpPorts( &xMetricsEncoder );
-        configASSERT_CONTINUE( xError == CborNoError );
+        configASSERT_CONTINUE( CBOR_ENCODE_OK( xError ) );
     }
 
-    if( xError == CborNoError )
+    if( CBOR_ENCODE_OK( xError ) )
     {
         xError = xGetEstablishedConnections( &xMetricsEncoder );
-        configASSERT_CONTINUE( xError == CborNoError );
+        configASSERT_CONTINUE( CBOR_ENCODE_OK( xError ) );
     }
 
-    if( xError == CborNoError )
+    if( CBOR_ENCODE_OK( xError ) )
     {
         xError = cbor_encoder_close_container( pxEncoder, &xMetricsEncoder );
-        configASSERT_CONTINUE( xError == CborNoError );
+        configASSERT_CONTINUE( CBOR_ENCODE_OK( xError ) );
     }
 
     return xError;
 }
 
+/*-----------------------------------------------------------*/
 
+/* Counters of the previous report, custom metrics are reported per interval */
+typedef struct
+{
+    uint32_t ulTotalRunTime;
+    uint32_t ulIdleRunTime;
+    uint32_t ulNumTasks;
+    UBaseType_t uxTaskNumber[ TASKS_MAX ];
+    uint32_t ulTaskRunTime[ TASKS_MAX ];
+    uint32_t ulPublishAcked;
+    uint32_t ulPublishRttTotalMs;
+    uint32_t ulConnects;
+    uint32_t ulTlsFailures;
+    uint32_t ulLwipRexmit;
+    uint32_t ulLwipAlarms;
+#if POWER_STATS_ENABLED == 1
+    PowerStats_t xPower;
+#endif /* POWER_STATS_ENABLED == 1 */
+} CustomMetricsSnapshot_t;
+
+static CustomMetricsSnapshot_t xLastSnapshot = { 0 };
+
+#if DEFENDER_LWIP_METRICS == 1
+static NetStats_t xLwipStats;
+#endif
 
 /*-----------------------------------------------------------*/
 
-static bool prvPublishDeviceMetricsReport( DefenderAgentCtx_t * pxCtx,
-                                           uint8_t * pucReportBuf,
-                                           uint32_t ulReportLength )
+static inline uint32_t prvCounterDelta( uint32_t ulNow,
+                                        uint32_t ulLast )
 {
-    static MQTTPublishInfo_t xPublishInfo = { 0 };
-    MQTTAgentCommandInfo_t xCommandParams = { 0 };
-    uint32_t ulStatus = MQTTSuccess;
+    /* Treat a counter that went backwards as reset rather than wrapped */
+    return( ( ulNow >= ulLast ) ? ( ulNow - ulLast ) : ulNow );
+}
 
-    xPublishInfo.qos = MQTTQoS1;
-    xPublishInfo.pTopicName = pxCtx->pcPublishTopic;
-    xPublishInfo.topicNameLength = pxCtx->usPublishTopicLen;
-    xPublishInfo.pPayload = pucReportBuf;
-    xPublishInfo.payloadLength = ulReportLength;
+/*-----------------------------------------------------------*/
+
+/*
+ * @brief Start a custom metric, i.e. <pcName>: [ { <pcType>: ... } ].
+ * The value is then encoded into pxValueEncoder.
+ */
+static CborError prvBeginCustomMetric( CborEncoder * pxEncoder,
+                                       const char * pcName,
+                                       const char * pcType,
+                                       CborEncoder * pxListEncoder,
+                                       CborEncoder * pxValueEncoder )
+{
+    CborError xError = CborNoError;
 
-    xCommandParams.blockTimeMs = MQTT_BLOCK_TIME_MS;
-    xCommandParams.cmdCompleteCallback = prvPublishOpCb;
-    xCommandParams.pCmdCompleteCallbackContext = pxCtx;
+    xError = cbor_encode_text_stringz( pxEncoder, pcName );
+    configASSERT_CONTINUE( CBOR_ENCODE_OK( xError ) );
 
-    pxCtx->xWaitingForCallback = pdTRUE;
+    /* Each custom metric is an array holding a single { type: value } map */
+    if( CBOR_ENCODE_OK( xError ) )
+    {
+        xError = cbor_encoder_create_array( pxEncoder, pxListEncoder, 1 );
+        configASSERT_CONTINUE( CBOR_ENCODE_OK( xError ) );
+    }
+
+    if( CBOR_ENCODE_OK( xError ) )
+    {
+        xError = cbor_encoder_create_map( pxListEncoder, pxValueEncoder, 1 );
+        configASSERT_CONTINUE( CBOR_ENCODE_OK( xError ) );
+    }
+
+    if( CBOR_ENCODE_OK( xError ) )
+    {
+        xError = cbor_encode_text_stringz( pxValueEncoder, pcType );
+        configASSERT_CONTINUE( CBOR_ENCODE_OK( xError ) );
+    }
+
+    return xError;
+}
+
+/*-----------------------------------------------------------*/
+
+static CborError prvEndCustomMetric( CborEncoder * pxEncoder,
+                                     CborEncoder * pxListEncoder,
+                                     CborEncoder * pxValueEncoder )
+{
+    CborError xError = CborNoError;
+
+    xError = cbor_encoder_close_container( pxListEncoder, pxValueEncoder );
+    configASSERT_CONTINUE( CBOR_ENCODE_OK( xError ) );
+
+    if( CBOR_ENCODE_OK( xError ) )
+    {
+        xError = cbor_encoder_close_container( pxEncoder, pxListEncoder );
+        configASSERT_CONTINUE( CBOR_ENCODE_OK( xError ) );
+    }
 
-    ulStatus = MQTTAgent_Publish( pxCtx->xAgentHandle,
-                                  &xPublishInfo,
-                                  &xCommandParams );
+    return xError;
+}
+
+/*-----------------------------------------------------------*/
+
+static CborError prvEncodeCustomMetric( CborEncoder * pxEncoder,
+                                        const char * pcName,
+                                        const char * pcType,
+                                        const uint32_t * pulValues,
+                                        size_t uxNumValues )
+{
+    CborEncoder xListEncoder;
+    CborEncoder xValueEncoder;
+    CborEncoder xNumberEncoder;
+    CborError xError = CborNoError;
+    BaseType_t xIsList = ( strcmp( pcType, "number_list" ) == 0 ) ? pdTRUE : pdFALSE;
+
+    xError = prvBeginCustomMetric( pxEncoder, pcName, pcType, &xListEncoder, &xValueEncoder );
 
-    if( ulStatus == MQTTSuccess )
+    if( CBOR_ENCODE_OK( xError ) && ( xIsList == pdTRUE ) )
     {
-        ulStatus = MQTTIllegalState;
-        BaseType_t xNotifyResult;
+        xError = cbor_encoder_create_array( &xValueEncoder, &xNumberEncoder, uxNumValues );
+        configASSERT_CONTINUE( CBOR_ENCODE_OK( xError ) );
 
-        /* Wait for callback */
-        xNotifyResult = xTaskNotifyWaitIndexed( NOTIFY_IDX_PUBACK,
-                                                0,
-                                                0xFFFFFFFF,
-                                                &ulStatus,
-                                                RESPONSE_TIMEOUT_MS );
+        for( size_t i = 0; ( i < uxNumValues ) && CBOR_ENCODE_OK( xError ); i++ )
+        {
+            xError = cbor_encode_uint( &xNumberEncoder, pulValues[ i ] );
+            configASSERT_CONTINUE( CBOR_ENCODE_OK( xError ) );
+        }
 
-        if( xNotifyResult == pdFALSE )
+        if( CBOR_ENCODE_OK( xError ) )
         {
-            LogError( "Failed to publish report." );
+            xError = cbor_encoder_close_container( &xValueEncoder, &xNumberEncoder );
+            configASSERT_CONTINUE( CBOR_ENCODE_OK( xError ) );
         }
     }
+    else if( CBOR_ENCODE_OK( xError ) )
+    {
+        xError = cbor_encode_uint( &xValueEncoder, pulValues[ 0 ] );
+        configASSERT_CONTINUE( CBOR_ENCODE_OK( xError ) );
+    }
 
-    LogDebug( "Printing sent payload Len: %ld.", ulReportLength );
-
-    prvPrintHex( pucReportBuf, ulReportLength );
+    if( CBOR_ENCODE_OK( xError ) )
+    {
+        xError = prvEndCustomMetric( pxEncoder, &xListEncoder, &xValueEncoder );
+    }
 
-    return( ulStatus == MQTTSuccess );
+    return xError;
 }
 
 /*-----------------------------------------------------------*/
 
-static bool prvValidateDefenderResponse( const char * pcDefenderResponse,
-                                         uint32_t ulDefenderResponseLength )
+/*
+ * @brief Encode a string_list metric with one "<task>:<value>" entry per task.
+ */
+static CborError prvEncodeTaskListMetric( CborEncoder * pxEncoder,
+                                          const char * pcName,
+                                          const CustomMetricsSample_t * pxSample,
+                                          const uint32_t * pulValues )
 {
-    bool xStatus = true;
+    CborEncoder xListEncoder;
+    CborEncoder xValueEncoder;
+    CborEncoder xStringEncoder;
+    CborError xError = CborNoError;
+    char pcEntry[ configMAX_TASK_NAME_LEN + 12 ];
 
-    ( void ) pcDefenderResponse;
-    ( void ) ulDefenderResponseLength;
+    xError = prvBeginCustomMetric( pxEncoder, pcName, "string_list", &xListEncoder, &xValueEncoder );
 
-    /* TODO: validate that report_id / reportId field matches last sent report */
-    return xStatus;
+    if( CBOR_ENCODE_OK( xError ) )
+    {
+        xError = cbor_encoder_create_array( &xValueEncoder, &xStringEncoder, pxSample->ulNumTasks );
+        configASSERT_CONTINUE( CBOR_ENCODE_OK( xError ) );
+    }
+
+    for( uint32_t i = 0; ( i < pxSample->ulNumTasks ) && CBOR_ENCODE_OK( xError ); i++ )
+    {
+        ( void ) snprintf( pcEntry, sizeof( pcEntry ), "%s:%lu",
+                           pxSample->pcTaskName[ i ], ( unsigned long ) pulValues[ i ] );
+
+        xError = cbor_encode_text_stringz( &xStringEncoder, pcEntry );
+        configASSERT_CONTINUE( CBOR_ENCODE_OK( xError ) );
+    }
+
+    if( CBOR_ENCODE_OK( xError ) )
+    {
+        xError = cbor_encoder_close_container( &xValueEncoder, &xStringEncoder );
+        configASSERT_CONTINUE( CBOR_ENCODE_OK( xError ) );
+    }
+
+    if( CBOR_ENCODE_OK( xError ) )
+    {
+        xError = prvEndCustomMetric( pxEncoder, &xListEncoder, &xValueEncoder );
+    }
+
+    return xError;
 }
 
 /*-----------------------------------------------------------*/
 
-void vDefenderAgentTask( void * pvParameters )
+/*
+ * @brief Encode the heap_tag_bytes string_list metric.
+ */
+static CborError prvEncodeHeapTagMetric( CborEncoder * pxEncoder,
+                                         const HeapTagStats_t * pxStats )
 {
-    DefenderAgentCtx_t xCtx = { 0 };
-    bool xSuccess = false;
+    CborEncoder xListEncoder;
+    CborEncoder xValueEncoder;
+    CborEncoder xStringEncoder;
+    CborError xError = CborNoError;
+    char pcEntry[ 32 ];
 
-    xExitFlag = pdFALSE;
+    xError = prvBeginCustomMetric( pxEncoder, "heap_tag_bytes", "string_list", &xListEncoder, &xValueEncoder );
 
-    uint8_t pucReportBuffer[ REPORT_BUFFER_SIZE ] = { 0 };
+    if( CBOR_ENCODE_OK( xError ) )
+    {
+        xError = cbor_encoder_create_array( &xValueEncoder, &xStringEncoder, HEAP_TAG_COUNT );
+        configASSERT_CONTINUE( CBOR_ENCODE_OK( xError ) );
+    }
 
-    /* Remove compiler warnings about unused parameters. */
-    ( void ) pvParameters;
+    for( uint32_t i = 0; ( i < HEAP_TAG_COUNT ) && CBOR_ENCODE_OK( xError ); i++ )
+    {
+        ( void ) snprintf( pcEntry, sizeof( pcEntry ), "%s:%lu:%lu",
+                           pcHeapTagName( ( HeapTag_t ) i ),
+                           ( unsigned long ) pxStats->uxCurrentBytes[ i ],
+                           ( unsigned long ) pxStats->uxPeakBytes[ i ] );
 
-    xCtx.pcDeviceId = KVStore_getStringHeap( CS_CORE_THING_NAME, &( xCtx.uxDeviceIdLen ) );
-    xCtx.xWaitingForCallback = pdFALSE;
-    xCtx.xAgentTask = xTaskGetCurrentTaskHandle();
+        xError = cbor_encode_text_stringz( &xStringEncoder, pcEntry );
+        configASSERT_CONTINUE( CBOR_ENCODE_OK( xError ) );
+    }
 
-    xSuccess = ( xCtx.pcDeviceId != NULL &&
-                 xCtx.uxDeviceIdLen > 0 &&
-                 xCtx.uxDeviceIdLen < UINT16_MAX );
+    if( CBOR_ENCODE_OK( xError ) )
+    {
+        xError = cbor_encoder_close_container( &xValueEncoder, &xStringEncoder );
+        configASSERT_CONTINUE( CBOR_ENCODE_OK( xError ) );
+    }
 
-    /* Build strings */
-    if( xSuccess )
+    if( CBOR_ENCODE_OK( xError ) )
     {
-        xSuccess = prvBuildDefenderTopicStrings( &xCtx );
-        configASSERT_CONTINUE( xSuccess );
+        xError = prvEndCustomMetric( pxEncoder, &xListEncoder, &xValueEncoder );
+    }
 
-        if( xSuccess )
-        {
-            LogDebug( "Built Defender MQTT Topic strings successfully." );
-        }
-        else
+    return xError;
+}
+
+/*-----------------------------------------------------------*/
+
+#if DEFENDER_LWIP_METRICS == 1
+
+static BaseType_t prvLwipPoolUsed( const NetPoolStats_t * pxPool )
+{
+    return( ( pxPool->ulMax > 0 ) || ( pxPool->ulErr > 0 ) );
+}
+
+/*
+ * @brief Encode the lwip_pools string_list metric.
+ */
+static CborError prvEncodeLwipPoolMetric( CborEncoder * pxEncoder,
+                                          const NetStats_t * pxStats )
+{
+    CborEncoder xListEncoder;
+    CborEncoder xValueEncoder;
+    CborEncoder xStringEncoder;
+    CborError xError = CborNoError;
+    size_t uxNumPools = 1;
+    char pcEntry[ 64 ];
+
+    for( uint32_t i = 0; i < MEMP_MAX; i++ )
+    {
+        if( prvLwipPoolUsed( &( pxStats->xPools[ i ] ) ) )
         {
-            LogError( "Failed to build MQTT Topic strings." );
+            uxNumPools++;
         }
     }
 
-    /* Wait for MqttAgent to be ready. */
+    xError = prvBeginCustomMetric( pxEncoder, "lwip_pools", "string_list", &xListEncoder, &xValueEncoder );
 
-    vSleepUntilMQTTAgentReady();
-
-    xCtx.xAgentHandle = xGetMqttAgentHandle();
+    if( CBOR_ENCODE_OK( xError ) )
+    {
+        xError = cbor_encoder_create_array( &xValueEncoder, &xStringEncoder, uxNumPools );
+        configASSERT_CONTINUE( CBOR_ENCODE_OK( xError ) );
+    }
 
-    /* Subscribe to relevant topics */
-    if( xSuccess )
+    /* The heap first, then the pools that have been used */
+    for( int32_t i = -1; ( i < ( int32_t ) MEMP_MAX ) && CBOR_ENCODE_OK( xError ); i++ )
     {
-        xSuccess = prvSubscribeToDefenderTopics( &xCtx );
-        configASSERT_CONTINUE( xSuccess );
+        const NetPoolStats_t * pxPool = ( i < 0 ) ? &( pxStats->xHeap ) : &( pxStats->xPools[ i ] );
 
-        if( xSuccess )
+        if( ( i < 0 ) || prvLwipPoolUsed( pxPool ) )
         {
-            LogInfo( "Subscribed to defender MQTT topics successfully." );
-        }
-        else
-        {
-            LogError( "Failed to subscribe to defender MQTT topics." );
+            ( void ) snprintf( pcEntry, sizeof( pcEntry ), "%s:%lu:%lu:%lu:%lu",
+                               pxPool->pcName,
+                               ( unsigned long ) pxPool->ulUsed,
+                               ( unsigned long ) pxPool->ulMax,
+                               ( unsigned long ) pxPool->ulAvail,
+                               ( unsigned long ) pxPool->ulErr );
+
+            xError = cbor_encode_text_stringz( &xStringEncoder, pcEntry );
+            configASSERT_CONTINUE( CBOR_ENCODE_OK( xError ) );
         }
     }
 
-    /* Exit on failure */
-    if( xSuccess == false )
+    if( CBOR_ENCODE_OK( xError ) )
     {
-        xExitFlag = pdTRUE;
+        xError = cbor_encoder_close_container( &xValueEncoder, &xStringEncoder );
+        configASSERT_CONTINUE( CBOR_ENCODE_OK( xError ) );
     }
 
-    while( xExitFlag == pdFALSE )
+    if( CBOR_ENCODE_OK( xError ) )
     {
-        uint64_t ulReportId = ( uint32_t ) xTaskGetTickCount(); /* TODO: Use a proper timestamp */
-        uint32_t ulNotificationValue = 0;
-        ReportStatus_t xReportStatus = ReportStatusNotReceived;
-
-        CborEncoder xEncoder;
-        CborEncoder xMapEncoder;
-        CborEncoder xHeaderEncoder;
+        xError = prvEndCustomMetric( pxEncoder, &xListEncoder, &xValueEncoder );
+    }
 
-        CborError xError = CborNoError;
+    return xError;
+}
 
-        cbor_encoder_init( &xEncoder, pucReportBuffer, REPORT_BUFFER_SIZE, 0 );
+#endif /* DEFENDER_LWIP_METRICS == 1 */
 
-        xError = cbor_encoder_create_map( &xEncoder, &xMapEncoder, CborIndefiniteLength );
-        configASSERT_CONTINUE( xError == CborNoError );
+/*-----------------------------------------------------------*/
 
-        if( xError == CborNoError )
-        {
-            xError = cbor_encode_text_stringz( &xMapEncoder, "hed" );
-            configASSERT_CONTINUE( xError == CborNoError );
-        }
+static void prvSampleTaskMetrics( CustomMetricsSample_t * pxSample )
+{
+    TaskStatus_t * pxTasks = NULL;
+    UBaseType_t uxNumTasks = 0;
+    uint32_t ulTotalRunTime = 0;
+    uint32_t ulIdleRunTime = xLastSnapshot.ulIdleRunTime;
+    uint32_t ulTotalDelta = 0;
 
-        /* Add Header */
-        if( xError == CborNoError )
-        {
-            xError = cbor_encoder_create_map( &xMapEncoder, &xHeaderEncoder, 2 );
-            configASSERT_CONTINUE( xError == CborNoError );
-        }
+    pxSample->ulStackHwmMin = UINT32_MAX;
 
-        /* Report ID */
-        if( xError == CborNoError )
-        {
-            xError = cbor_encode_text_stringz( &xHeaderEncoder, "rid" );
-            configASSERT_CONTINUE( xError == CborNoError );
+    /* Leave room for tasks created while the array is allocated */
+    uxNumTasks = uxTaskGetNumberOfTasks() + 2;
+    pxTasks = pvPortMalloc( uxNumTasks * sizeof( TaskStatus_t ) );
 
-            xError |= cbor_encode_uint( &xHeaderEncoder, ulReportId );
-            configASSERT_CONTINUE( xError == CborNoError );
-        }
+    if( pxTasks == NULL )
+    {
+        LogError( "Failed to allocate the task status array." );
+        uxNumTasks = 0;
+    }
+    else
+    {
+        configRUN_TIME_COUNTER_TYPE xTotalRunTime = 0;
 
-        /* Version */
-        if( xError == CborNoError )
-        {
-            xError = cbor_encode_text_stringz( &xHeaderEncoder, "v" );
-            configASSERT_CONTINUE( xError == CborNoError );
+        uxNumTasks = uxTaskGetSystemState( pxTasks, uxNumTasks, &xTotalRunTime );
+        ulTotalRunTime = ( uint32_t ) xTotalRunTime;
+    }
 
-            xError = cbor_encode_text_stringz( &xHeaderEncoder, "1.0" );
-            configASSERT_CONTINUE( xError == CborNoError );
-        }
+    ulTotalDelta = ulTotalRunTime - xLastSnapshot.ulTotalRunTime;
 
-        if( xError == CborNoError )
+    for( UBaseType_t i = 0; i < uxNumTasks; i++ )
+    {
+        uint32_t ulRunTime = ( uint32_t ) pxTasks[ i ].ulRunTimeCounter;
+        uint32_t ulLastRunTime = 0;
+        uint32_t ulStackBytes = ( uint32_t ) pxTasks[ i ].usStackHighWaterMark * sizeof( StackType_t );
+        uint32_t ulDepthBytes = ulTaskStatsStackDepth( pxTasks[ i ].xHandle ) * sizeof( StackType_t );
+        uint32_t ulUsedBytes = ( ulDepthBytes > ulStackBytes ) ? ( ulDepthBytes - ulStackBytes ) : 0;
+        uint32_t ulNeededBytes = ulUsedBytes + ( ( ulUsedBytes * TASK_STATS_STACK_MARGIN_PCT ) / 100U );
+
+        for( uint32_t j = 0; j < xLastSnapshot.ulNumTasks; j++ )
         {
-            xError = cbor_encoder_close_container( &xMapEncoder, &xHeaderEncoder );
-            configASSERT_CONTINUE( xError == CborNoError );
+            if( xLastSnapshot.uxTaskNumber[ j ] == pxTasks[ i ].xTaskNumber )
+            {
+                ulLastRunTime = xLastSnapshot.ulTaskRunTime[ j ];
+            }
         }
 
-        if( xError == CborNoError )
+        if( strcmp( pxTasks[ i ].pcTaskName, configIDLE_TASK_NAME ) == 0 )
         {
-            /* Collect device metrics. */
-            LogInfo( "Collecting device metrics..." );
-            xError = prvCollectDeviceMetrics( &xMapEncoder );
-            configASSERT_CONTINUE( xError == CborNoError );
+            ulIdleRunTime = ulRunTime;
         }
 
-        if( xError == CborNoError )
+        if( ulStackBytes < pxSample->ulStackHwmMin )
         {
-            xError = cbor_encoder_close_container( &xEncoder, &xMapEncoder );
-            configASSERT_CONTINUE( xError == CborNoError );
+            pxSample->ulStackHwmMin = ulStackBytes;
         }
 
-        if( xError != CborNoError )
+        if( ulDepthBytes > ulNeededBytes )
         {
-            LogError( "Failed to collect device metrics." );
+            pxSample->ulStackSlack += ulDepthBytes - ulNeededBytes;
         }
 
-        /* Format defined here:
-         * https://docs.aws.amazon.com/iot/latest/developerguide/detect-device-side-metrics.html
-         */
-        if( xError == CborNoError )
+        /* Tasks beyond TASKS_MAX only count towards the totals */
+        if( i < TASKS_MAX )
         {
-            size_t xLen = cbor_encoder_get_buffer_size( &xEncoder, pucReportBuffer );
-            LogInfo( "Publishing defender metrics report." );
-
-            xSuccess = prvPublishDeviceMetricsReport( &xCtx, pucReportBuffer, xLen );
-
-            if( xSuccess != true )
+            if( ulTotalDelta > 0 )
             {
-                LogError( "Failed to publish device defender report." );
+                pxSample->pulCpuPct[ i ] = ( uint32_t ) ( ( ( uint64_t ) ( ulRunTime - ulLastRunTime ) * 100 ) / ulTotalDelta );
             }
-        }
 
-        /* Wait for the response to our report */
-        if( xTaskNotifyWaitIndexed( NOTIFY_IDX_ACCEPTED_REJECTED,
-                                    0,
-                                    0xFFFFFFFF,
-                                    &ulNotificationValue,
-                                    pdMS_TO_TICKS( RESPONSE_TIMEOUT_MS ) ) == pdTRUE )
-        {
-            xReportStatus = ulNotificationValue;
+            ( void ) strncpy( pxSample->pcTaskName[ i ], pxTasks[ i ].pcTaskName, configMAX_TASK_NAME_LEN - 1 );
+            pxSample->pulStackHwm[ i ] = ulStackBytes;
+            pxSample->pulStackUsedPct[ i ] = ( ulDepthBytes > 0 ) ? ( ( ulUsedBytes * 100U ) / ulDepthBytes ) : 0;
+            xLastSnapshot.uxTaskNumber[ i ] = pxTasks[ i ].xTaskNumber;
+            xLastSnapshot.ulTaskRunTime[ i ] = ulRunTime;
         }
+    }
+
+    if( ulTotalDelta > 0 )
+    {
+        uint32_t ulIdlePct = ( uint32_t ) ( ( ( uint64_t ) ( ulIdleRunTime - xLastSnapshot.ulIdleRunTime ) * 100 ) / ulTotalDelta );
+
+        pxSample->ulCpuLoad = ( ulIdlePct < 100 ) ? ( 100 - ulIdlePct ) : 0;
+    }
 
-        xCtx.xWaitingForCallback = pdFALSE;
+    xLastSnapshot.ulTotalRunTime = ulTotalRunTime;
+    xLastSnapshot.ulIdleRunTime = ulIdleRunTime;
+    xLastSnapshot.ulNumTasks = ( uxNumTasks < TASKS_MAX ) ? uxNumTasks : TASKS_MAX;
+    pxSample->ulNumTasks = xLastSnapshot.ulNumTasks;
 
-        switch( xReportStatus )
-        {
-            case ReportStatusAccepted:
-                LogInfo( "Defender report accepted." );
-                break;
+    if( pxTasks != NULL )
+    {
+        vPortFree( pxTasks );
+    }
+}
+
+/*-----------------------------------------------------------*/
+
+static void prvSampleConnectionMetrics( CustomMetricsSample_t * pxSample )
+{
+    ReconnectScheduler_t xReconnect = { 0 };
+
+#if MQTT_AGENT_STATS_ENABLED == 1
+    MqttAgentStats_t xAgentStats = { 0 };
 
-            case ReportStatusRejected:
-                LogError( "Defender report rejected." );
-                break;
+    if( xMqttAgentGetStats( &xAgentStats ) == pdTRUE )
+    {
+        uint32_t ulAcked = prvCounterDelta( xAgentStats.ulPublishAcked, xLastSnapshot.ulPublishAcked );
+        uint32_t ulRttTotalMs = prvCounterDelta( xAgentStats.ulPublishRttTotalMs, xLastSnapshot.ulPublishRttTotalMs );
 
-            case ReportStatusInvalid:
-            case ReportStatusNotReceived:
-            default:
-                LogError( "Defender report response not received." );
-                break;
+        /* No point reporting a mean of nothing */
+        if( ulAcked > 0 )
+        {
+            pxSample->xHasRtt = pdTRUE;
+            pxSample->ulRttMeanMs = ulRttTotalMs / ulAcked;
         }
 
-        LogDebug( "Sleeping until next report." );
-        vTaskDelay( pdMS_TO_TICKS( MS_BETWEEN_REPORTS ) );
+        xLastSnapshot.ulPublishAcked = xAgentStats.ulPublishAcked;
+        xLastSnapshot.ulPublishRttTotalMs = xAgentStats.ulPublishRttTotalMs;
+    }
+#endif /* MQTT_AGENT_STATS_ENABLED == 1 */
+
+    if( xReconnectGetStats( &xReconnect ) == pdTRUE )
+    {
+        pxSample->xHasReconnect = pdTRUE;
+        pxSample->ulConnects = prvCounterDelta( xReconnect.ulConnects, xLastSnapshot.ulConnects );
+        pxSample->ulTlsFailures = prvCounterDelta( xReconnect.pulFailures[ RECONNECT_CLASS_TLS ], xLastSnapshot.ulTlsFailures );
+
+        xLastSnapshot.ulConnects = xReconnect.ulConnects;
+        xLastSnapshot.ulTlsFailures = xReconnect.pulFailures[ RECONNECT_CLASS_TLS ];
     }
+}
+
+/*-----------------------------------------------------------*/
+
+#if DEFENDER_LWIP_METRICS == 1
+
+static void prvSampleLwipMetrics( CustomMetricsSample_t * pxSample )
+{
+    /* Not cleared, so that the lwipstats CLI command keeps its view */
+    vNetStatsGet( &xLwipStats, pdFALSE );
 
-    LogSys( "Exiting..." );
+    pxSample->pxLwip = &xLwipStats;
+    pxSample->ulLwipRexmit = prvCounterDelta( xLwipStats.ulTcpRexmit, xLastSnapshot.ulLwipRexmit );
+    pxSample->ulLwipAlarms = prvCounterDelta( xLwipStats.ulExhaustedAlarms, xLastSnapshot.ulLwipAlarms );
 
-    prvUnsubscribeFromDefenderTopics( &xCtx );
+    xLastSnapshot.ulLwipRexmit = xLwipStats.ulTcpRexmit;
+    xLastSnapshot.ulLwipAlarms = xLwipStats.ulExhaustedAlarms;
+}
+
+#endif /* DEFENDER_LWIP_METRICS == 1 */
 
-    prvClearCtx( &xCtx );
+/*-----------------------------------------------------------*/
 
+#if TLS_TRANSPORT_PROFILE == 1
 
-    vTaskDelete( NULL );
+static void prvSampleTlsProfileMetrics( CustomMetricsSample_t * pxSample )
+{
+    TlsConnectProfile_t xProfile = { 0 };
+
+    /* Nothing to report until the first connect has completed */
+    if( mbedtls_transport_getprofile( &xProfile ) == pdTRUE )
+    {
+        uint32_t ulCyclesPerUs = SystemCoreClock / 1000000;
+
+        for( uint32_t i = 0; i < TLS_PROFILE_NUM_PHASES; i++ )
+        {
+            pxSample->pulTlsPhaseUs[ i ] = xProfile.ulCycles[ i ] / ulCyclesPerUs;
+        }
+
+        pxSample->ulTlsHeapPeak = ( uint32_t ) xProfile.uxHeapPeakBytes;
+        pxSample->xHasTlsProfile = pdTRUE;
+    }
+}
+
+#endif /* TLS_TRANSPORT_PROFILE == 1 */
+
+/*-----------------------------------------------------------*/
+
+#if POWER_STATS_ENABLED == 1
+
+static void prvSamplePowerMetrics( CustomMetricsSample_t * pxSample )
+{
+    PowerStats_t xPower;
+    const PowerStats_t * pxLast = &( xLastSnapshot.xPower );
+
+    vPowerStatsGet( &xPower );
+
+    for( uint32_t i = 0; i < POWER_STATE_COUNT; i++ )
+    {
+        pxSample->pulPowerStateMs[ i ] = prvCounterDelta( xPower.pulStateMs[ i ], pxLast->pulStateMs[ i ] );
+    }
+
+    for( uint32_t i = 0; i < POWER_RADIO_COUNT; i++ )
+    {
+        pxSample->pulRadioMs[ i ] = prvCounterDelta( xPower.pulRadioMs[ i ], pxLast->pulRadioMs[ i ] );
+    }
+
+    pxSample->ulPowerWakes = prvCounterDelta( xPower.ulWakes, pxLast->ulWakes );
+    pxSample->ulEnergyUj = ( uint32_t ) ( xPower.ullEnergyUj - pxLast->ullEnergyUj );
+
+    for( uint32_t i = 0; i < POWER_OP_COUNT; i++ )
+    {
+        const PowerOpStats_t * pxOp = &( xPower.pxOps[ i ] );
+        const PowerOpStats_t * pxLastOp = &( pxLast->pxOps[ i ] );
+
+        pxSample->pulOpCount[ i ] = prvCounterDelta( pxOp->ulCount, pxLastOp->ulCount );
+        pxSample->pulOpWakes[ i ] = prvCounterDelta( pxOp->ulWakes, pxLastOp->ulWakes );
+
+        if( pxSample->pulOpCount[ i ] > 0 )
+        {
+            pxSample->pulOpEnergyUj[ i ] = ( uint32_t ) ( ( pxOp->ullEnergyUj - pxLastOp->ullEnergyUj ) /
+                                                          pxSample->pulOpCount[ i ] );
+        }
+    }
+
+    xLastSnapshot.xPower = xPower;
+}
+
+#endif /* POWER_STATS_ENABLED == 1 */
+
+/*-----------------------------------------------------------*/
+
+static void prvSampleCustomMetrics( CustomMetricsSample_t * pxSample )
+{
+    configASSERT( pxSample != NULL );
+
+    ( void ) memset( pxSample, 0, sizeof( CustomMetricsSample_t ) );
+
+    pxSample->ulHeapFree = ( uint32_t ) xPortGetFreeHeapSize();
+    pxSample->ulHeapMinFree = ( uint32_t ) xPortGetMinimumEverFreeHeapSize();
+
+    prvSampleTaskMetrics( pxSample );
+    prvSampleConnectionMetrics( pxSample );
+
+    pxSample->xHasHeapTags = xHeapTagGetStats( &( pxSample->xHeapTags ) );
+
+#if DEFENDER_LWIP_METRICS == 1
+    prvSampleLwipMetrics( pxSample );
+#endif /* DEFENDER_LWIP_METRICS == 1 */
+
+#if TLS_TRANSPORT_PROFILE == 1
+    prvSampleTlsProfileMetrics( pxSample );
+#endif /* TLS_TRANSPORT_PROFILE == 1 */
+
+#if POWER_STATS_ENABLED == 1
+    prvSamplePowerMetrics( pxSample );
+#endif /* POWER_STATS_ENABLED == 1 */
+}
+
+/*-----------------------------------------------------------*/
+
+static CborError prvCollectCustomMetrics( CborEncoder * pxEncoder,
+                                          const CustomMetricsSample_t * pxSample )
+{
+    CborEncoder xMetricsEncoder;
+    CborError xError = CborNoError;
+
+    configASSERT( pxEncoder != NULL );
+    configASSERT( pxSample != NULL );
+
+    xError = cbor_encode_text_stringz( pxEncoder, "cmet" );
+    configASSERT_CONTINUE( CBOR_ENCODE_OK( xError ) );
+
+    if( CBOR_ENCODE_OK( xError ) )
+    {
+        xError = cbor_encoder_create_map( pxEncoder, &xMetricsEncoder, CborIndefiniteLength );
+        configASSERT_CONTINUE( CBOR_ENCODE_OK( xError ) );
+    }
+
+    if( CBOR_ENCODE_OK( xError ) )
+    {
+        xError = prvEncodeCustomMetric( &xMetricsEncoder, "heap_free", "number", &pxSample->ulHeapFree, 1 );
+    }
+
+    if( CBOR_ENCODE_OK( xError ) )
+    {
+        xError = prvEncodeCustomMetric( &xMetricsEncoder, "heap_min_free", "number", &pxSample->ulHeapMinFree, 1 );
+    }
+
+    if( CBOR_ENCODE_OK( xError ) && ( pxSample->ulNumTasks > 0 ) )
+    {
+        xError = prvEncodeCustomMetric( &xMetricsEncoder, "cpu_load_pct", "number", &pxSample->ulCpuLoad, 1 );
+
+        if( CBOR_ENCODE_OK( xError ) )
+        {
+            xError = prvEncodeTaskListMetric( &xMetricsEncoder, "task_cpu_pct", pxSample, pxSample->pulCpuPct );
+        }
+
+        if( CBOR_ENCODE_OK( xError ) )
+        {
+            xError = prvEncodeCustomMetric( &xMetricsEncoder, "stack_hwm_min", "number", &pxSample->ulStackHwmMin, 1 );
+        }
+
+        if( CBOR_ENCODE_OK( xError ) )
+        {
+            xError = prvEncodeTaskListMetric( &xMetricsEncoder, "task_stack_hwm", pxSample, pxSample->pulStackHwm );
+        }
+
+        if( CBOR_ENCODE_OK( xError ) )
+        {
+            xError = prvEncodeTaskListMetric( &xMetricsEncoder, "task_stack_used_pct", pxSample, pxSample->pulStackUsedPct );
+        }
+
+        if( CBOR_ENCODE_OK( xError ) )
+        {
+            xError = prvEncodeCustomMetric( &xMetricsEncoder, "stack_slack_bytes", "number", &pxSample->ulStackSlack, 1 );
+        }
+    }
+
+    if( CBOR_ENCODE_OK( xError ) && ( pxSample->xHasRtt == pdTRUE ) )
+    {
+        xError = prvEncodeCustomMetric( &xMetricsEncoder, "mqtt_pub_rtt_ms", "number", &pxSample->ulRttMeanMs, 1 );
+    }
+
+    if( CBOR_ENCODE_OK( xError ) && ( pxSample->xHasReconnect == pdTRUE ) )
+    {
+        xError = prvEncodeCustomMetric( &xMetricsEncoder, "mqtt_connects", "number", &pxSample->ulConnects, 1 );
+
+        if( CBOR_ENCODE_OK( xError ) )
+        {
+            xError = prvEncodeCustomMetric( &xMetricsEncoder, "tls_failures", "number", &pxSample->ulTlsFailures, 1 );
+        }
+    }
+
+#if TLS_TRANSPORT_PROFILE == 1
+    if( CBOR_ENCODE_OK( xError ) && ( pxSample->xHasTlsProfile == pdTRUE ) )
+    {
+        xError = prvEncodeCustomMetric( &xMetricsEncoder, "tls_connect_us", "number_list",
+                                        pxSample->pulTlsPhaseUs, TLS_PROFILE_NUM_PHASES );
+
+        if( CBOR_ENCODE_OK( xError ) )
+        {
+            xError = prvEncodeCustomMetric( &xMetricsEncoder, "tls_connect_heap", "number",
+                                            &pxSample->ulTlsHeapPeak, 1 );
+        }
+    }
+#endif /* TLS_TRANSPORT_PROFILE == 1 */
+
+    if( CBOR_ENCODE_OK( xError ) && ( pxSample->xHasHeapTags == pdTRUE ) )
+    {
+        xError = prvEncodeHeapTagMetric( &xMetricsEncoder, &pxSample->xHeapTags );
+    }
+
+#if DEFENDER_LWIP_METRICS == 1
+    if( CBOR_ENCODE_OK( xError ) && ( pxSample->pxLwip != NULL ) )
+    {
+        xError = prvEncodeLwipPoolMetric( &xMetricsEncoder, pxSample->pxLwip );
+
+        if( CBOR_ENCODE_OK( xError ) )
+        {
+            xError = prvEncodeCustomMetric( &xMetricsEncoder, "lwip_tcp_rexmit", "number", &pxSample->ulLwipRexmit, 1 );
+        }
+
+        if( CBOR_ENCODE_OK( xError ) )
+        {
+            xError = prvEncodeCustomMetric( &xMetricsEncoder, "lwip_tcp_ooseq_max", "number",
+                                            &pxSample->pxLwip->ulTcpOoseqMax, 1 );
+        }
+
+        if( CBOR_ENCODE_OK( xError ) )
+        {
+            xError = prvEncodeCustomMetric( &xMetricsEncoder, "lwip_mbox_max_depth", "number",
+                                            &pxSample->pxLwip->ulMboxMaxDepth, 1 );
+        }
+
+        if( CBOR_ENCODE_OK( xError ) )
+        {
+            xError = prvEncodeCustomMetric( &xMetricsEncoder, "lwip_pool_alarms", "number", &pxSample->ulLwipAlarms, 1 );
+        }
+    }
+#endif /* DEFENDER_LWIP_METRICS == 1 */
+
+#if POWER_STATS_ENABLED == 1
+    if( CBOR_ENCODE_OK( xError ) )
+    {
+        xError = prvEncodeCustomMetric( &xMetricsEncoder, "power_state_ms", "number_list",
+                                        pxSample->pulPowerStateMs, POWER_STATE_COUNT );
+    }
+
+    if( CBOR_ENCODE_OK( xError ) )
+    {
+        xError = prvEncodeCustomMetric( &xMetricsEncoder, "wifi_state_ms", "number_list",
+                                        pxSample->pulRadioMs, POWER_RADIO_COUNT );
+    }
+
+    if( CBOR_ENCODE_OK( xError ) )
+    {
+        xError = prvEncodeCustomMetric( &xMetricsEncoder, "power_wakes", "number", &pxSample->ulPowerWakes, 1 );
+    }
+
+    if( CBOR_ENCODE_OK( xError ) )
+    {
+        xError = prvEncodeCustomMetric( &xMetricsEncoder, "energy_uj", "number", &pxSample->ulEnergyUj, 1 );
+    }
+
+    if( CBOR_ENCODE_OK( xError ) )
+    {
+        xError = prvEncodeCustomMetric( &xMetricsEncoder, "op_count", "number_list",
+                                        pxSample->pulOpCount, POWER_OP_COUNT );
+    }
+
+    if( CBOR_ENCODE_OK( xError ) )
+    {
+        xError = prvEncodeCustomMetric( &xMetricsEncoder, "op_wakes", "number_list",
+                                        pxSample->pulOpWakes, POWER_OP_COUNT );
+    }
+
+    if( CBOR_ENCODE_OK( xError ) )
+    {
+        xError = prvEncodeCustomMetric( &xMetricsEncoder, "op_energy_uj", "number_list",
+                                        pxSample->pulOpEnergyUj, POWER_OP_COUNT );
+    }
+#endif /* POWER_STATS_ENABLED == 1 */
+
+    if( CBOR_ENCODE_OK( xError ) )
+    {
+        xError = cbor_encoder_close_container( pxEncoder, &xMetricsEncoder );
+        configASSERT_CONTINUE( CBOR_ENCODE_OK( xError ) );
+    }
+
+    return xError;
+}
+
+/*-----------------------------------------------------------*/
+
+/* Format defined here:
+ * https://docs.aws.amazon.com/iot/latest/developerguide/detect-device-side-metrics.html
+ */
+static CborError prvEncodeReport( CborEncoder * pxEncoder,
+                                  uint64_t ulReportId,
+                                  const CustomMetricsSample_t * pxSample )
+{
+    CborEncoder xMapEncoder;
+    CborEncoder xHeaderEncoder;
+    CborError xError = CborNoError;
+
+    xError = cbor_encoder_create_map( pxEncoder, &xMapEncoder, CborIndefiniteLength );
+    configASSERT_CONTINUE( CBOR_ENCODE_OK( xError ) );
+
+    if( CBOR_ENCODE_OK( xError ) )
+    {
+        xError = cbor_encode_text_stringz( &xMapEncoder, "hed" );
+        configASSERT_CONTINUE( CBOR_ENCODE_OK( xError ) );
+    }
+
+    /* Add Header */
+    if( CBOR_ENCODE_OK( xError ) )
+    {
+        xError = cbor_encoder_create_map( &xMapEncoder, &xHeaderEncoder, 2 );
+        configASSERT_CONTINUE( CBOR_ENCODE_OK( xError ) );
+    }
+
+    /* Report ID */
+    if( CBOR_ENCODE_OK( xError ) )
+    {
+        xError = cbor_encode_text_stringz( &xHeaderEncoder, "rid" );
+        configASSERT_CONTINUE( CBOR_ENCODE_OK( xError ) );
+
+        xError |= cbor_encode_uint( &xHeaderEncoder, ulReportId );
+        configASSERT_CONTINUE( CBOR_ENCODE_OK( xError ) );
+    }
+
+    /* Version */
+    if( CBOR_ENCODE_OK( xError ) )
+    {
+        xError = cbor_encode_text_stringz( &xHeaderEncoder, "v" );
+        configASSERT_CONTINUE( CBOR_ENCODE_OK( xError ) );
+
+        xError = cbor_encode_text_stringz( &xHeaderEncoder, "1.0" );
+        configASSERT_CONTINUE( CBOR_ENCODE_OK( xError ) );
+    }
+
+    if( CBOR_ENCODE_OK( xError ) )
+    {
+        xError = cbor_encoder_close_container( &xMapEncoder, &xHeaderEncoder );
+        configASSERT_CONTINUE( CBOR_ENCODE_OK( xError ) );
+    }
+
+    if( CBOR_ENCODE_OK( xError ) )
+    {
+        xError = prvCollectDeviceMetrics( &xMapEncoder );
+        configASSERT_CONTINUE( CBOR_ENCODE_OK( xError ) );
+    }
+
+    if( CBOR_ENCODE_OK( xError ) )
+    {
+        xError = prvCollectCustomMetrics( &xMapEncoder, pxSample );
+        configASSERT_CONTINUE( CBOR_ENCODE_OK( xError ) );
+    }
+
+    if( CBOR_ENCODE_OK( xError ) )
+    {
+        xError = cbor_encoder_close_container( pxEncoder, &xMapEncoder );
+        configASSERT_CONTINUE( CBOR_ENCODE_OK( xError ) );
+    }
+
+    return xError;
+}
+
+/*-----------------------------------------------------------*/
+
+/*
+ * @brief Allocate a buffer for a report of uxReportLen bytes.
+ * A publish pool buffer is preferred, the heap is used for larger reports.
+ */
+static uint8_t * prvAllocReportBuffer( DefenderAgentCtx_t * pxCtx,
+                                       size_t uxReportLen,
+                                       BaseType_t * pxFromPool )
+{
+    uint8_t * pucBuffer = NULL;
+
+    *pxFromPool = pdFALSE;
+
+    if( uxReportLen <= MQTT_PUBLISH_POOL_BUFFER_LEN )
+    {
+        pucBuffer = MqttAgent_GetPublishBuffer( pdMS_TO_TICKS( MQTT_BLOCK_TIME_MS ) );
+        *pxFromPool = ( pucBuffer != NULL ) ? pdTRUE : pdFALSE;
+    }
+
+    /* A timed out publish still owns the previous heap buffer */
+    if( ( pucBuffer == NULL ) &&
+        ( pxCtx->pucHeapReport != NULL ) )
+    {
+        LogWarn( "Previous report is still in flight." );
+    }
+    else if( pucBuffer == NULL )
+    {
+        pucBuffer = pvPortMalloc( uxReportLen );
+    }
+
+    if( pucBuffer == NULL )
+    {
+        LogError( "Failed to allocate a %lu byte report buffer.", ( unsigned long ) uxReportLen );
+    }
+
+    return pucBuffer;
+}
+
+/*-----------------------------------------------------------*/
+
+static bool prvPublishDeviceMetricsReport( DefenderAgentCtx_t * pxCtx,
+                                           uint8_t * pucReportBuf,
+                                           uint32_t ulReportLength,
+                                           BaseType_t xFromPool )
+{
+    static MQTTPublishInfo_t xPublishInfo = { 0 };
+    uint32_t ulStatus = MQTTSuccess;
+
+    xPublishInfo.qos = MQTTQoS1;
+    xPublishInfo.pTopicName = pxCtx->pcPublishTopic;
+    xPublishInfo.topicNameLength = pxCtx->usPublishTopicLen;
+    xPublishInfo.pPayload = pucReportBuf;
+    xPublishInfo.payloadLength = ulReportLength;
+
+    /* Print first, the buffer belongs to the agent once the publish is queued */
+    LogDebug( "Printing sent payload Len: %ld.", ulReportLength );
+
+    prvPrintHex( pucReportBuf, ulReportLength );
+
+    pxCtx->xWaitingForCallback = pdTRUE;
+
+    if( xFromPool == pdTRUE )
+    {
+        ulStatus = MqttAgent_PublishAsync( pxCtx->xAgentHandle,
+                                           &xPublishInfo,
+                                           prvPublishCompleteCb,
+                                           pxCtx,
+                                           MQTT_BLOCK_TIME_MS );
+    }
+    else
+    {
+        MQTTAgentCommandInfo_t xCommandParams = { 0 };
+
+        xCommandParams.blockTimeMs = MQTT_BLOCK_TIME_MS;
+        xCommandParams.cmdCompleteCallback = prvPublishOpCb;
+        xCommandParams.pCmdCompleteCallbackContext = pxCtx;
+
+        /* Freed by prvPublishOpCb */
+        pxCtx->pucHeapReport = pucReportBuf;
+
+        ulStatus = MQTTAgent_Publish( pxCtx->xAgentHandle,
+                                      &xPublishInfo,
+                                      &xCommandParams );
+
+        if( ulStatus != MQTTSuccess )
+        {
+            pxCtx->pucHeapReport = NULL;
+            vPortFree( pucReportBuf );
+        }
+    }
+
+    if( ulStatus != MQTTSuccess )
+    {
+        pxCtx->xWaitingForCallback = pdFALSE;
+    }
+
+    /* The PUBACK and the response are handled by prvDefenderJob */
+    return( ulStatus == MQTTSuccess );
+}
+
+/*-----------------------------------------------------------*/
+
+static bool prvValidateDefenderResponse( const char * pcDefenderResponse,
+                                         uint32_t ulDefenderResponseLength )
+{
+    bool xStatus = true;
+
+    ( void ) pcDefenderResponse;
+    ( void ) ulDefenderResponseLength;
+
+    /* TODO: validate that report_id / reportId field matches last sent report */
+    return xStatus;
+}
+
+/*-----------------------------------------------------------*/
+
+/* Sample, encode and publish one report, the response is waited for by the job */
+static void prvPublishReport( DefenderAgentCtx_t * pxCtx )
+{
+    /* Too large for the stack of the worker, the job never runs concurrently with itself */
+    static CustomMetricsSample_t xSample;
+    uint64_t ulReportId = ( uint32_t ) xTaskGetTickCount(); /* TODO: Use a proper timestamp */
+    CborEncoder xEncoder;
+    CborError xError = CborNoError;
+    uint8_t * pucReport = NULL;
+    size_t uxReportLen = 0;
+    BaseType_t xFromPool = pdFALSE;
+    bool xSuccess = false;
+
+    /* Nothing received yet for this report */
+    pxCtx->xPublishDone = pdFALSE;
+    pxCtx->xReportStatus = ReportStatusNotReceived;
+
+    /* Sample once, both encoding passes below must see the same values */
+    LogInfo( "Collecting device metrics..." );
+    vMetricsCollectorSnapshot();
+    prvSampleCustomMetrics( &xSample );
+
+    /* Measure the report without a buffer */
+    cbor_encoder_init( &xEncoder, NULL, 0, 0 );
+    xError = prvEncodeReport( &xEncoder, ulReportId, &xSample );
+
+    if( CBOR_ENCODE_OK( xError ) )
+    {
+        uxReportLen = cbor_encoder_get_extra_bytes_needed( &xEncoder );
+        pucReport = prvAllocReportBuffer( pxCtx, uxReportLen, &xFromPool );
+    }
+
+    /* Encode straight into the buffer that is published */
+    if( pucReport != NULL )
+    {
+        cbor_encoder_init( &xEncoder, pucReport, uxReportLen, 0 );
+        xError = prvEncodeReport( &xEncoder, ulReportId, &xSample );
+        configASSERT_CONTINUE( xError == CborNoError );
+    }
+
+    if( xError != CborNoError )
+    {
+        LogError( "Failed to collect device metrics." );
+
+        if( xFromPool == pdTRUE )
+        {
+            MqttAgent_ReleasePublishBuffer( pucReport );
+        }
+        else if( pucReport != NULL )
+        {
+            vPortFree( pucReport );
+        }
+    }
+    else
+    {
+        LogInfo( "Publishing defender metrics report." );
+
+        xSuccess = prvPublishDeviceMetricsReport( pxCtx, pucReport,
+                                                  cbor_encoder_get_buffer_size( &xEncoder, pucReport ),
+                                                  xFromPool );
+
+        if( xSuccess != true )
+        {
+            LogError( "Failed to publish device defender report." );
+        }
+    }
+}
+
+/*-----------------------------------------------------------*/
+
+static void prvHandleResponse( DefenderAgentCtx_t * pxCtx )
+{
+    pxCtx->xWaitingForCallback = pdFALSE;
+
+    if( ( pxCtx->xPublishDone != pdTRUE ) ||
+        ( pxCtx->xPublishStatus != MQTTSuccess ) )
+    {
+        LogError( "Failed to publish report." );
+    }
+
+    switch( pxCtx->xReportStatus )
+    {
+        case ReportStatusAccepted:
+            LogInfo( "Defender report accepted." );
+
+            /* The next report is relative to this one */
+            vMetricsCollectorCommit();
+            break;
+
+        case ReportStatusRejected:
+            LogError( "Defender report rejected." );
+            break;
+
+        case ReportStatusInvalid:
+        case ReportStatusNotReceived:
+        default:
+            LogError( "Defender report response not received." );
+            break;
+    }
+}
+
+/*-----------------------------------------------------------*/
+
+/*
+ * Runs on the worker. Rescheduled by itself for the next step, and by the
+ * subscribe, publish and response callbacks of the agent while it waits.
+ */
+static void prvDefenderJob( void * pvCtx )
+{
+    DefenderAgentCtx_t * pxCtx = ( DefenderAgentCtx_t * ) pvCtx;
+
+    switch( pxCtx->xState )
+    {
+        case DefenderStateSubscribe:
+            pxCtx->xAgentHandle = xGetMqttAgentHandle();
+
+            if( pxCtx->xAgentHandle == NULL )
+            {
+                vWorkJobSchedule( &( pxCtx->xJob ), MS_BETWEEN_RETRIES );
+            }
+            else if( prvSubscribeToDefenderTopics( pxCtx ) )
+            {
+                /* The callback may already have run and rescheduled the job */
+                pxCtx->xState = DefenderStateSubscribing;
+            }
+            else
+            {
+                LogError( "Failed to subscribe to defender MQTT topics." );
+                pxCtx->xState = DefenderStateStopped;
+            }
+
+            break;
+
+        case DefenderStateSubscribing:
+
+            if( pxCtx->xSubscribeDone != pdTRUE )
+            {
+                /* Not for us */
+            }
+            else if( pxCtx->xSubscribeStatus == MQTTSuccess )
+            {
+                LogInfo( "Subscribed to defender MQTT topics successfully." );
+                pxCtx->xState = DefenderStateReport;
+                vWorkJobSchedule( &( pxCtx->xJob ), 0 );
+            }
+            else
+            {
+                LogError( "Failed to subscribe to defender MQTT topics." );
+                pxCtx->xState = DefenderStateStopped;
+            }
+
+            break;
+
+        case DefenderStateReport:
+
+            /* Wait through disconnections rather than failing a report every interval */
+            if( xIsMqttAgentConnected() != true )
+            {
+                vWorkJobSchedule( &( pxCtx->xJob ), MS_BETWEEN_RETRIES );
+            }
+            else
+            {
+                pxCtx->xReportStart = xTaskGetTickCount();
+                pxCtx->xState = DefenderStateResponse;
+
+                prvPublishReport( pxCtx );
+
+                /* Timeout, brought forward by the callbacks */
+                vWorkJobSchedule( &( pxCtx->xJob ),
+                                  ( pxCtx->xWaitingForCallback == pdTRUE ) ? RESPONSE_TIMEOUT_MS : 0 );
+            }
+
+            break;
+
+        case DefenderStateResponse:
+           {
+               TickType_t xElapsed = xTaskGetTickCount() - pxCtx->xReportStart;
+
+               if( ( pxCtx->xWaitingForCallback == pdTRUE ) &&
+                   ( pxCtx->xReportStatus == ReportStatusNotReceived ) &&
+                   ( ( pxCtx->xPublishDone != pdTRUE ) || ( pxCtx->xPublishStatus == MQTTSuccess ) ) &&
+                   ( xElapsed < pdMS_TO_TICKS( RESPONSE_TIMEOUT_MS ) ) )
+               {
+                   /* Woken up by the PUBACK, keep waiting for the response */
+                   vWorkJobSchedule( &( pxCtx->xJob ),
+                                     ( pdMS_TO_TICKS( RESPONSE_TIMEOUT_MS ) - xElapsed ) * portTICK_PERIOD_MS );
+               }
+               else
+               {
+                   prvHandleResponse( pxCtx );
+
+                   LogDebug( "Sleeping until next report." );
+                   pxCtx->xState = DefenderStateReport;
+                   vWorkJobSchedule( &( pxCtx->xJob ), MS_BETWEEN_REPORTS );
+               }
+           }
+           break;
+
+        case DefenderStateStopped:
+        default:
+            break;
+    }
+}
+
+/*-----------------------------------------------------------*/
+
+void vDefenderAgentStart( void )
+{
+    DefenderAgentCtx_t * pxCtx = &xDefenderCtx;
+    bool xSuccess = false;
+
+    pxCtx->pcDeviceId = KVStore_getStringHeap( CS_CORE_THING_NAME, &( pxCtx->uxDeviceIdLen ) );
+    pxCtx->xWaitingForCallback = pdFALSE;
+    pxCtx->pucHeapReport = NULL;
+    pxCtx->xState = DefenderStateSubscribe;
+
+    vWorkJobInit( &( pxCtx->xJob ), "Defender", prvDefenderJob, pxCtx );
+
+    xSuccess = ( pxCtx->pcDeviceId != NULL &&
+                 pxCtx->uxDeviceIdLen > 0 &&
+                 pxCtx->uxDeviceIdLen < UINT16_MAX );
+
+    /* Build strings */
+    if( xSuccess )
+    {
+        xSuccess = prvBuildDefenderTopicStrings( pxCtx );
+        configASSERT_CONTINUE( xSuccess );
+
+        if( xSuccess )
+        {
+            LogDebug( "Built Defender MQTT Topic strings successfully." );
+        }
+        else
+        {
+            LogError( "Failed to build MQTT Topic strings." );
+        }
+    }
+
+    if( xSuccess )
+    {
+        /* Subscribes once the agent is ready */
+        vWorkJobSchedule( &( pxCtx->xJob ), 0 );
+    }
+    else
+    {
+        prvClearCtx( pxCtx );
+    }
 }
 
 /*-----------------------------------------------------------*/
@@ -31,6 +31,53 @@
 #include <stddef.h>
 #include "cbor.h"
 
+/*
+ * Set to 1 to report network stats as deltas since the last accepted report and
+ * to leave out socket lists that did not change since then.
+ */
+#ifndef METRICS_COLLECTOR_DELTA_MODE
+#define METRICS_COLLECTOR_DELTA_MODE          1
+#endif
+
+/* In delta mode, every Nth report carries all socket lists whether or not they changed. */
+#ifndef METRICS_COLLECTOR_FULL_EVERY
+#define METRICS_COLLECTOR_FULL_EVERY          12
+#endif
+
+/* Longest socket lists copied into a report. */
+#ifndef METRICS_COLLECTOR_MAX_TCP_PORTS
+#define METRICS_COLLECTOR_MAX_TCP_PORTS       10
+#endif
+
+#ifndef METRICS_COLLECTOR_MAX_UDP_PORTS
+#define METRICS_COLLECTOR_MAX_UDP_PORTS       10
+#endif
+
+#ifndef METRICS_COLLECTOR_MAX_CONNECTIONS
+#define METRICS_COLLECTOR_MAX_CONNECTIONS     10
+#endif
+
+/*
+ * True unless encoding failed for a reason other than running out of buffer.
+ * tinycbor keeps counting the bytes it could not write, which is how the report
+ * length is measured before its buffer is allocated.
+ */
+#define CBOR_ENCODE_OK( xError )    ( ( ( xError ) & ~CborErrorOutOfMemory ) == CborNoError )
+
+/**
+ * @brief Copy the lwIP counters and socket lists while holding the core lock once.
+ *
+ * The xGet functions below encode from this snapshot, so it must be taken
+ * before each report.
+ */
+void vMetricsCollectorSnapshot( void );
+
+/**
+ * @brief Make the last snapshot the baseline for deltas. Call once the report
+ * built from it has been accepted.
+ */
+void vMetricsCollectorCommit( void );
+
 /**
  * @brief Get network stats.
  *
@@ -44,6 +91,9 @@ CborError xGetNetworkStats( CborEncoder * pxEncoder );
 
 /**
  * @brief Get a list of the open TCP ports.
+ *
+ * In delta mode, nothing is encoded when the list is unchanged. The same
+ * applies to the UDP ports and the established connections.
  */
 CborError xGetListeningTcpPorts( CborEncoder * pxMetricsEncoder );
 
@@ -25,7 +25,9 @@
  */
 
 /* Standard includes. */
+#include <stdbool.h>
 #include <stdint.h>
+#include <string.h>
 
 /* Interface includes. */
 #include "metrics_collector.h"
@@ -65,6 +67,60 @@ extern struct tcp_pcb * tcp_active_pcbs;        /* List of all TCP PCBs that are
 extern union tcp_listen_pcbs_t tcp_listen_pcbs; /* List of all TCP PCBs in LISTEN state. */
 extern struct udp_pcb * udp_pcbs;               /* List of UDP PCBs. */
 extern struct netif * netif_default;
+
+typedef struct
+{
+    char pcNetif[ NETIF_NAMESIZE ]; /* Empty if the interface could not be named */
+    uint16_t usPort;
+} MetricsPort_t;
+
+typedef struct
+{
+    char pcNetif[ NETIF_NAMESIZE ];
+    ip_addr_t xRemoteIp;
+    uint16_t usRemotePort;
+    uint16_t usLocalPort;
+} MetricsConnection_t;
+
+typedef struct
+{
+    uint32_t ulTotal;   /* Entries in the lwIP list */
+    uint32_t ulEntries; /* Entries copied, at most the length of the table */
+    uint32_t ulHash;    /* Hash of the whole list, including entries beyond the table */
+    uint32_t ulGeneration;
+} MetricsListInfo_t;
+
+/*
+ * Copy of everything a report needs, taken with a single hold of the core lock
+ * so that formatting and encoding happen with lwIP running.
+ */
+typedef struct
+{
+    uint32_t ulBytesIn;
+    uint32_t ulBytesOut;
+    uint32_t ulPktsIn;
+    uint32_t ulPktsOut;
+
+    MetricsListInfo_t xTcpPortsInfo;
+    MetricsPort_t xTcpPorts[ METRICS_COLLECTOR_MAX_TCP_PORTS ];
+
+    MetricsListInfo_t xUdpPortsInfo;
+    MetricsPort_t xUdpPorts[ METRICS_COLLECTOR_MAX_UDP_PORTS ];
+
+    MetricsListInfo_t xConnectionsInfo;
+    MetricsConnection_t xConnections[ METRICS_COLLECTOR_MAX_CONNECTIONS ];
+} MetricsSnapshot_t;
+
+static MetricsSnapshot_t xSnapshot = { 0 };
+
+/* The snapshot of the last accepted report */
+static MetricsSnapshot_t xBaseline = { 0 };
+static bool xHaveBaseline = false;
+static uint32_t ulReportsSinceFull = 0;
+
+/* Set by vMetricsCollectorSnapshot when every list goes into the report */
+static bool xFullReport = true;
+
 /*-----------------------------------------------------------*/
 
 static inline CborError cbor_add_kv_uint( CborEncoder * pxEncoder,
@@ -91,309 +147,329 @@ static inline CborError cbor_add_kv_str( CborEncoder * pxEncoder,
     return xError;
 }
 
-CborError xGetNetworkStats( CborEncoder * pxEncoder )
-{
-    CborError xError = CborNoError;
+/*-----------------------------------------------------------*/
 
-    if( pxEncoder == NULL )
+/* FNV-1a, only used to notice that a socket list changed */
+static inline uint32_t ulHashUpdate( uint32_t ulHash,
+                                     uint32_t ulValue )
+{
+    for( uint32_t i = 0; i < sizeof( ulValue ); i++ )
     {
-        LogError( "Invalid parameter: pxEncoder: %p", pxEncoder );
-        xError = CborErrorImproperValue;
+        ulHash ^= ( ulValue >> ( 8 * i ) ) & 0xFF;
+        ulHash *= 16777619UL;
     }
-    else
-    {
-        struct netif * pxNetif = NULL;
 
-        uint64_t xBytesIn = 0;
-        uint64_t xBytesOut = 0;
-        uint64_t xPktsIn = 0;
-        uint64_t xPktsOut = 0;
+    return ulHash;
+}
 
-        CborEncoder xNSEncoder;
+#define METRICS_HASH_INIT    2166136261UL
 
-        xError = cbor_encode_text_stringz( pxEncoder, "ns" );
-        configASSERT_CONTINUE( xError == CborNoError );
+/*-----------------------------------------------------------*/
+
+static void vGetNetifName( uint8_t ucNetifIdx,
+                           char * pcNetifBuf )
+{
+    char * pcNetifNameFound = NULL;
 
-        if( xError == CborNoError )
+    /* netif_idx == 0 means no specific interface or the default interface */
+    if( ucNetifIdx == 0 )
+    {
+        if( netif_default != NULL )
         {
-            xError = cbor_encoder_create_map( pxEncoder, &xNSEncoder, 4 );
-            configASSERT_CONTINUE( xError == CborNoError );
+            pcNetifNameFound = netif_index_to_name( netif_default->num, pcNetifBuf );
         }
-
-        LOCK_TCPIP_CORE();
-
-#if LWIP_SINGLE_NETIF
-        pxNetif = netif_default;
-#else
-        NETIF_FOREACH( pxNetif )
-#endif /* LWIP_SINGLE_NETIF */
+        else
         {
-            xBytesIn += pxNetif->mib2_counters.ifinoctets;
-            xBytesOut += pxNetif->mib2_counters.ifoutoctets;
+            strcpy( pcNetifBuf, "any" );
+            pcNetifNameFound = pcNetifBuf;
+        }
+    }
+    else
+    {
+        pcNetifNameFound = netif_index_to_name( ucNetifIdx, pcNetifBuf );
+    }
 
-            xPktsIn += pxNetif->mib2_counters.ifinnucastpkts;
-            xPktsIn += pxNetif->mib2_counters.ifinucastpkts;
+    if( pcNetifNameFound == NULL )
+    {
+        pcNetifBuf[ 0 ] = '\0';
+    }
+}
 
-            xPktsOut += pxNetif->mib2_counters.ifoutucastpkts;
-            xPktsOut += pxNetif->mib2_counters.ifoutnucastpkts;
-        }
+/*-----------------------------------------------------------*/
 
-        UNLOCK_TCPIP_CORE();
+/* Called with the core lock held */
+static void vSnapshotTcpPorts( MetricsListInfo_t * pxInfo,
+                               MetricsPort_t * pxPorts )
+{
+    pxInfo->ulTotal = 0;
+    pxInfo->ulEntries = 0;
+    pxInfo->ulHash = METRICS_HASH_INIT;
 
-        if( xError == CborNoError )
+    for( struct tcp_pcb_listen * pxCurPcb = tcp_listen_pcbs.listen_pcbs; pxCurPcb != NULL; pxCurPcb = pxCurPcb->next )
+    {
+        if( pxCurPcb->state == LISTEN )
         {
-            xError |= cbor_add_kv_uint( &xNSEncoder, "pi", xPktsIn );
-            configASSERT_CONTINUE( xError == CborNoError );
+            pxInfo->ulHash = ulHashUpdate( pxInfo->ulHash, ( ( uint32_t ) pxCurPcb->netif_idx << 16 ) | pxCurPcb->local_port );
+            pxInfo->ulTotal++;
 
-            xError |= cbor_add_kv_uint( &xNSEncoder, "po", xPktsOut );
-            configASSERT_CONTINUE( xError == CborNoError );
+            if( pxInfo->ulEntries < METRICS_COLLECTOR_MAX_TCP_PORTS )
+            {
+                vGetNetifName( pxCurPcb->netif_idx, pxPorts[ pxInfo->ulEntries ].pcNetif );
+                pxPorts[ pxInfo->ulEntries ].usPort = pxCurPcb->local_port;
+                pxInfo->ulEntries++;
+            }
+        }
+    }
+}
 
-            xError = cbor_add_kv_uint( &xNSEncoder, "bi", xBytesIn );
-            configASSERT_CONTINUE( xError == CborNoError );
+/*-----------------------------------------------------------*/
 
-            xError |= cbor_add_kv_uint( &xNSEncoder, "bo", xBytesOut );
-            configASSERT_CONTINUE( xError == CborNoError );
-        }
+/* Called with the core lock held */
+static void vSnapshotUdpPorts( MetricsListInfo_t * pxInfo,
+                               MetricsPort_t * pxPorts )
+{
+    pxInfo->ulTotal = 0;
+    pxInfo->ulEntries = 0;
+    pxInfo->ulHash = METRICS_HASH_INIT;
 
-        if( xError == CborNoError )
+    for( struct udp_pcb * pxCurPcb = udp_pcbs; pxCurPcb != NULL; pxCurPcb = pxCurPcb->next )
+    {
+        pxInfo->ulHash = ulHashUpdate( pxInfo->ulHash, ( ( uint32_t ) pxCurPcb->netif_idx << 16 ) | pxCurPcb->local_port );
+        pxInfo->ulTotal++;
+
+        if( pxInfo->ulEntries < METRICS_COLLECTOR_MAX_UDP_PORTS )
         {
-            xError = cbor_encoder_close_container( pxEncoder, &xNSEncoder );
+            vGetNetifName( pxCurPcb->netif_idx, pxPorts[ pxInfo->ulEntries ].pcNetif );
+            pxPorts[ pxInfo->ulEntries ].usPort = pxCurPcb->local_port;
+            pxInfo->ulEntries++;
         }
     }
-
-    return xError;
 }
 
 /*-----------------------------------------------------------*/
 
-static size_t xCountListeningTcpPorts( void )
+/* Called with the core lock held */
+static void vSnapshotConnections( MetricsListInfo_t * pxInfo,
+                                  MetricsConnection_t * pxConnections )
 {
-    size_t xPortCount = 0;
+    pxInfo->ulTotal = 0;
+    pxInfo->ulEntries = 0;
+    pxInfo->ulHash = METRICS_HASH_INIT;
 
-    for( struct tcp_pcb_listen * pxCurPcb = tcp_listen_pcbs.listen_pcbs; pxCurPcb != NULL; pxCurPcb = pxCurPcb->next )
+    for( struct tcp_pcb * pxCurPcb = tcp_active_pcbs; pxCurPcb != NULL; pxCurPcb = pxCurPcb->next )
     {
-        if( pxCurPcb->state == LISTEN )
+        pxInfo->ulHash = ulHashUpdate( pxInfo->ulHash, ( ( uint32_t ) pxCurPcb->local_port << 16 ) | pxCurPcb->remote_port );
+        pxInfo->ulHash = ulHashUpdate( pxInfo->ulHash, ip_addr_get_ip4_u32( &( pxCurPcb->remote_ip ) ) );
+        pxInfo->ulTotal++;
+
+        if( pxInfo->ulEntries < METRICS_COLLECTOR_MAX_CONNECTIONS )
         {
-            xPortCount++;
+            MetricsConnection_t * pxConnection = &( pxConnections[ pxInfo->ulEntries ] );
+
+            vGetNetifName( pxCurPcb->netif_idx, pxConnection->pcNetif );
+            ip_addr_copy( pxConnection->xRemoteIp, pxCurPcb->remote_ip );
+            pxConnection->usRemotePort = pxCurPcb->remote_port;
+            pxConnection->usLocalPort = pxCurPcb->local_port;
+            pxInfo->ulEntries++;
         }
     }
+}
 
-    return xPortCount;
+/*-----------------------------------------------------------*/
+
+/*
+ * The list goes into the report if it changed since the last accepted report
+ * or if this is a full report.
+ */
+static bool xListIncluded( const MetricsListInfo_t * pxInfo,
+                           const MetricsListInfo_t * pxBaselineInfo )
+{
+    return( ( xFullReport == true ) ||
+            ( pxInfo->ulGeneration != pxBaselineInfo->ulGeneration ) );
 }
 
 /*-----------------------------------------------------------*/
 
-static char * pcGetNetifName( uint8_t ucNetifIdx,
-                              char * pcNetifBuf )
+static void vUpdateGeneration( MetricsListInfo_t * pxInfo,
+                               const MetricsListInfo_t * pxPrevInfo )
 {
-    char * pcNetifNameFound = NULL;
+    pxInfo->ulGeneration = pxPrevInfo->ulGeneration;
 
-    /* netif_idx == 0 means no specific interface or the default interface */
-    if( ucNetifIdx == 0 )
+    if( pxInfo->ulHash != pxPrevInfo->ulHash )
     {
-        if( netif_default != NULL )
-        {
-            pcNetifNameFound = netif_index_to_name( netif_default->num, pcNetifBuf );
-        }
-        else
-        {
-            strcpy( pcNetifBuf, "any" );
-            pcNetifBuf[ 3 ] = '\0';
-            pcNetifNameFound = pcNetifBuf;
-        }
-    }
-    else
-    {
-        pcNetifNameFound = netif_index_to_name( ucNetifIdx, pcNetifBuf );
+        pxInfo->ulGeneration++;
     }
-
-    return pcNetifNameFound;
 }
 
 /*-----------------------------------------------------------*/
 
-static CborError xAppendTcpPtsToList( CborEncoder * pxPTSEncoder )
+void vMetricsCollectorSnapshot( void )
 {
-    CborError xError = CborNoError;
+    struct netif * pxNetif = NULL;
+    MetricsListInfo_t xPrevTcp = xSnapshot.xTcpPortsInfo;
+    MetricsListInfo_t xPrevUdp = xSnapshot.xUdpPortsInfo;
+    MetricsListInfo_t xPrevConnections = xSnapshot.xConnectionsInfo;
 
-    configASSERT( pxPTSEncoder != NULL );
+    xSnapshot.ulBytesIn = 0;
+    xSnapshot.ulBytesOut = 0;
+    xSnapshot.ulPktsIn = 0;
+    xSnapshot.ulPktsOut = 0;
 
-    for( struct tcp_pcb_listen * pxCurPcb = tcp_listen_pcbs.listen_pcbs; pxCurPcb != NULL; pxCurPcb = pxCurPcb->next )
+    LOCK_TCPIP_CORE();
+
+#if LWIP_SINGLE_NETIF
+    pxNetif = netif_default;
+#else
+    NETIF_FOREACH( pxNetif )
+#endif /* LWIP_SINGLE_NETIF */
     {
-        CborEncoder xPTEncoder;
-        char pcNetifBuf[ NETIF_NAMESIZE ] = { 0 };
-        char * pcNetifNameFound = NULL;
+        xSnapshot.ulBytesIn += pxNetif->mib2_counters.ifinoctets;
+        xSnapshot.ulBytesOut += pxNetif->mib2_counters.ifoutoctets;
 
-        pcNetifNameFound = pcGetNetifName( pxCurPcb->netif_idx, pcNetifBuf );
+        xSnapshot.ulPktsIn += pxNetif->mib2_counters.ifinnucastpkts;
+        xSnapshot.ulPktsIn += pxNetif->mib2_counters.ifinucastpkts;
 
-        if( pcNetifNameFound != NULL )
-        {
-            xError = cbor_encoder_create_map( pxPTSEncoder, &xPTEncoder, 2 );
-            configASSERT_CONTINUE( xError == CborNoError );
+        xSnapshot.ulPktsOut += pxNetif->mib2_counters.ifoutucastpkts;
+        xSnapshot.ulPktsOut += pxNetif->mib2_counters.ifoutnucastpkts;
+    }
 
-            if( xError == CborNoError )
-            {
-                xError = cbor_add_kv_str( &xPTEncoder, "if", pcNetifNameFound );
-                configASSERT_CONTINUE( xError == CborNoError );
-            }
-        }
-        else
-        {
-            xError = cbor_encoder_create_map( pxPTSEncoder, &xPTEncoder, 1 );
-            configASSERT_CONTINUE( xError == CborNoError );
-        }
+    vSnapshotTcpPorts( &( xSnapshot.xTcpPortsInfo ), xSnapshot.xTcpPorts );
+    vSnapshotUdpPorts( &( xSnapshot.xUdpPortsInfo ), xSnapshot.xUdpPorts );
+    vSnapshotConnections( &( xSnapshot.xConnectionsInfo ), xSnapshot.xConnections );
 
-        if( xError == CborNoError )
-        {
-            xError = cbor_add_kv_uint( &xPTEncoder, "pt", pxCurPcb->local_port );
-            configASSERT_CONTINUE( xError == CborNoError );
-        }
+    UNLOCK_TCPIP_CORE();
 
-        if( xError == CborNoError )
-        {
-            xError = cbor_encoder_close_container( pxPTSEncoder, &xPTEncoder );
-        }
-    }
+    vUpdateGeneration( &( xSnapshot.xTcpPortsInfo ), &xPrevTcp );
+    vUpdateGeneration( &( xSnapshot.xUdpPortsInfo ), &xPrevUdp );
+    vUpdateGeneration( &( xSnapshot.xConnectionsInfo ), &xPrevConnections );
 
-    return xError;
+#if METRICS_COLLECTOR_DELTA_MODE == 1
+    xFullReport = ( xHaveBaseline == false ) ||
+                  ( ulReportsSinceFull + 1 >= METRICS_COLLECTOR_FULL_EVERY );
+#else
+    xFullReport = true;
+#endif
 }
 
 /*-----------------------------------------------------------*/
 
-CborError xGetListeningTcpPorts( CborEncoder * pxMetricsEncoder )
+void vMetricsCollectorCommit( void )
+{
+    xBaseline = xSnapshot;
+    xHaveBaseline = true;
+
+    if( xFullReport == true )
+    {
+        ulReportsSinceFull = 0;
+    }
+    else
+    {
+        ulReportsSinceFull++;
+    }
+}
+
+/*-----------------------------------------------------------*/
+
+CborError xGetNetworkStats( CborEncoder * pxEncoder )
 {
     CborError xError = CborNoError;
-    uint32_t ulPortCount = 0;
 
-    if( pxMetricsEncoder == NULL )
+    if( pxEncoder == NULL )
     {
-        LogError( "Invalid parameter: pxMetricsEncoder: %p", pxMetricsEncoder );
+        LogError( "Invalid parameter: pxEncoder: %p", pxEncoder );
         xError = CborErrorImproperValue;
     }
     else
     {
-        CborEncoder xTPEncoder;
-        CborEncoder xPTSEncoder;
-
-        LOCK_TCPIP_CORE();
-        ulPortCount = xCountListeningTcpPorts();
+        uint32_t ulBytesIn = xSnapshot.ulBytesIn;
+        uint32_t ulBytesOut = xSnapshot.ulBytesOut;
+        uint32_t ulPktsIn = xSnapshot.ulPktsIn;
+        uint32_t ulPktsOut = xSnapshot.ulPktsOut;
 
-        xError = cbor_encode_text_stringz( pxMetricsEncoder, "tp" );
-        configASSERT_CONTINUE( xError == CborNoError );
+        CborEncoder xNSEncoder;
 
-        if( xError == CborNoError )
+#if METRICS_COLLECTOR_DELTA_MODE == 1
+        /* Counters since the last accepted report. Unsigned arithmetic handles a wrap. */
+        if( xHaveBaseline == true )
         {
-            /* Create listening_tcp_ports / tp object */
-            if( ulPortCount > 0 )
-            {
-                xError = cbor_encoder_create_map( pxMetricsEncoder, &xTPEncoder, 2 );
-                configASSERT_CONTINUE( xError == CborNoError );
-            }
-            else
-            {
-                xError = cbor_encoder_create_map( pxMetricsEncoder, &xTPEncoder, 1 );
-                configASSERT_CONTINUE( xError == CborNoError );
-            }
+            ulBytesIn -= xBaseline.ulBytesIn;
+            ulBytesOut -= xBaseline.ulBytesOut;
+            ulPktsIn -= xBaseline.ulPktsIn;
+            ulPktsOut -= xBaseline.ulPktsOut;
         }
+#endif /* METRICS_COLLECTOR_DELTA_MODE == 1 */
 
-        /* Encode number of ports parameter */
-        if( xError == CborNoError )
+        xError = cbor_encode_text_stringz( pxEncoder, "ns" );
+        configASSERT_CONTINUE( CBOR_ENCODE_OK( xError ) );
+
+        if( CBOR_ENCODE_OK( xError ) )
         {
-            xError = cbor_add_kv_uint( &xTPEncoder, "t", ulPortCount );
-            configASSERT_CONTINUE( xError == CborNoError );
+            xError = cbor_encoder_create_map( pxEncoder, &xNSEncoder, 4 );
+            configASSERT_CONTINUE( CBOR_ENCODE_OK( xError ) );
         }
 
-        /* Construct ports list / pts if any tcp ports are listening */
-        if( ulPortCount > 0 )
+        if( CBOR_ENCODE_OK( xError ) )
         {
-            if( xError == CborNoError )
-            {
-                xError = cbor_encode_text_stringz( &xTPEncoder, "pts" );
-                configASSERT_CONTINUE( xError == CborNoError );
-            }
+            xError |= cbor_add_kv_uint( &xNSEncoder, "pi", ulPktsIn );
+            configASSERT_CONTINUE( CBOR_ENCODE_OK( xError ) );
 
-            if( xError == CborNoError )
-            {
-                xError = cbor_encoder_create_array( &xTPEncoder, &xPTSEncoder, ulPortCount );
-                configASSERT_CONTINUE( xError == CborNoError );
-            }
+            xError |= cbor_add_kv_uint( &xNSEncoder, "po", ulPktsOut );
+            configASSERT_CONTINUE( CBOR_ENCODE_OK( xError ) );
 
-            if( xError == CborNoError )
-            {
-                xError = xAppendTcpPtsToList( &xPTSEncoder );
-                configASSERT_CONTINUE( xError == CborNoError );
-            }
+            xError = cbor_add_kv_uint( &xNSEncoder, "bi", ulBytesIn );
+            configASSERT_CONTINUE( CBOR_ENCODE_OK( xError ) );
 
-            if( xError == CborNoError )
-            {
-                xError = cbor_encoder_close_container( &xTPEncoder, &xPTSEncoder );
-                configASSERT_CONTINUE( xError == CborNoError );
-            }
+            xError |= cbor_add_kv_uint( &xNSEncoder, "bo", ulBytesOut );
+            configASSERT_CONTINUE( CBOR_ENCODE_OK( xError ) );
         }
 
-        if( xError == CborNoError )
+        if( CBOR_ENCODE_OK( xError ) )
         {
-            xError = cbor_encoder_close_container( pxMetricsEncoder, &xTPEncoder );
-            configASSERT_CONTINUE( xError == CborNoError );
+            xError = cbor_encoder_close_container( pxEncoder, &xNSEncoder );
         }
-
-        UNLOCK_TCPIP_CORE();
     }
 
     return xError;
 }
-/*-----------------------------------------------------------*/
-
-static size_t xCountListeningUdpPorts( void )
-{
-    size_t xPortCount = 0;
-
-    for( struct udp_pcb * pxCurPcb = udp_pcbs; pxCurPcb != NULL; pxCurPcb = pxCurPcb->next )
-    {
-        xPortCount++;
-    }
 
-    return xPortCount;
-}
+/*-----------------------------------------------------------*/
 
-static CborError xAppendUdpPtsToList( CborEncoder * pxPTSEncoder )
+static CborError xAppendPtsToList( CborEncoder * pxPTSEncoder,
+                                   const MetricsPort_t * pxPorts,
+                                   uint32_t ulNumPorts )
 {
     CborError xError = CborNoError;
 
     configASSERT( pxPTSEncoder != NULL );
 
-    for( struct udp_pcb * pxCurPcb = udp_pcbs; pxCurPcb != NULL; pxCurPcb = pxCurPcb->next )
+    for( uint32_t i = 0; ( i < ulNumPorts ) && ( CBOR_ENCODE_OK( xError ) ); i++ )
     {
         CborEncoder xPTEncoder;
-        char pcNetifBuf[ NETIF_NAMESIZE ] = { 0 };
-        char * pcNetifName = NULL;
 
-        pcNetifName = pcGetNetifName( pxCurPcb->netif_idx, pcNetifBuf );
-
-        if( pcNetifName != NULL )
+        if( pxPorts[ i ].pcNetif[ 0 ] != '\0' )
         {
             xError = cbor_encoder_create_map( pxPTSEncoder, &xPTEncoder, 2 );
-            configASSERT_CONTINUE( xError == CborNoError );
+            configASSERT_CONTINUE( CBOR_ENCODE_OK( xError ) );
 
-            if( xError == CborNoError )
+            if( CBOR_ENCODE_OK( xError ) )
             {
-                xError = cbor_add_kv_str( &xPTEncoder, "if", pcNetifName );
-                configASSERT_CONTINUE( xError == CborNoError );
+                xError = cbor_add_kv_str( &xPTEncoder, "if", pxPorts[ i ].pcNetif );
+                configASSERT_CONTINUE( CBOR_ENCODE_OK( xError ) );
             }
         }
         else
         {
             xError = cbor_encoder_create_map( pxPTSEncoder, &xPTEncoder, 1 );
-            configASSERT_CONTINUE( xError == CborNoError );
+            configASSERT_CONTINUE( CBOR_ENCODE_OK( xError ) );
         }
 
-        if( xError == CborNoError )
+        if( CBOR_ENCODE_OK( xError ) )
         {
-            xError = cbor_add_kv_uint( &xPTEncoder, "pt", pxCurPcb->local_port );
-            configASSERT_CONTINUE( xError == CborNoError );
+            xError = cbor_add_kv_uint( &xPTEncoder, "pt", pxPorts[ i ].usPort );
+            configASSERT_CONTINUE( CBOR_ENCODE_OK( xError ) );
         }
 
-        if( xError == CborNoError )
+        if( CBOR_ENCODE_OK( xError ) )
         {
             xError = cbor_encoder_close_container( pxPTSEncoder, &xPTEncoder );
         }
@@ -402,108 +478,133 @@ static CborError xAppendUdpPtsToList( CborEncoder * pxPTSEncoder )
     return xError;
 }
 
+/*-----------------------------------------------------------*/
 
-
-CborError xGetListeningUdpPorts( CborEncoder * pxMetricsEncoder )
+/*
+ * @brief Encode a listening_tcp_ports / listening_udp_ports object.
+ */
+static CborError xEncodePorts( CborEncoder * pxMetricsEncoder,
+                               const char * pcKey,
+                               const MetricsListInfo_t * pxInfo,
+                               const MetricsPort_t * pxPorts )
 {
     CborError xError = CborNoError;
-    uint32_t ulPortCount = 0;
+    uint32_t ulPortCount = pxInfo->ulEntries;
+    CborEncoder xPortsEncoder;
+    CborEncoder xPTSEncoder;
 
-    if( pxMetricsEncoder == NULL )
+    xError = cbor_encode_text_stringz( pxMetricsEncoder, pcKey );
+    configASSERT_CONTINUE( CBOR_ENCODE_OK( xError ) );
+
+    if( CBOR_ENCODE_OK( xError ) )
     {
-        LogError( "Invalid parameter: pxMetricsEncoder: %p", pxMetricsEncoder );
-        xError = CborErrorImproperValue;
+        if( ulPortCount > 0 )
+        {
+            xError = cbor_encoder_create_map( pxMetricsEncoder, &xPortsEncoder, 2 );
+            configASSERT_CONTINUE( CBOR_ENCODE_OK( xError ) );
+        }
+        else
+        {
+            xError = cbor_encoder_create_map( pxMetricsEncoder, &xPortsEncoder, 1 );
+            configASSERT_CONTINUE( CBOR_ENCODE_OK( xError ) );
+        }
     }
-    else
-    {
-        CborEncoder xUPEncoder;
-        CborEncoder xPTSEncoder;
-
-        LOCK_TCPIP_CORE();
-        ulPortCount = xCountListeningUdpPorts();
 
-        xError = cbor_encode_text_stringz( pxMetricsEncoder, "up" );
-        configASSERT_CONTINUE( xError == CborNoError );
+    /* Encode number of ports parameter */
+    if( CBOR_ENCODE_OK( xError ) )
+    {
+        xError = cbor_add_kv_uint( &xPortsEncoder, "t", pxInfo->ulTotal );
+        configASSERT_CONTINUE( CBOR_ENCODE_OK( xError ) );
+    }
 
-        if( xError == CborNoError )
+    /* Construct ports list / pts if any ports are listening */
+    if( ulPortCount > 0 )
+    {
+        if( CBOR_ENCODE_OK( xError ) )
         {
-            /* Create listening_udp_ports / up object */
-            if( ulPortCount > 0 )
-            {
-                xError = cbor_encoder_create_map( pxMetricsEncoder, &xUPEncoder, 2 );
-                configASSERT_CONTINUE( xError == CborNoError );
-            }
-            else
-            {
-                xError = cbor_encoder_create_map( pxMetricsEncoder, &xUPEncoder, 1 );
-                configASSERT_CONTINUE( xError == CborNoError );
-            }
+            xError = cbor_encode_text_stringz( &xPortsEncoder, "pts" );
+            configASSERT_CONTINUE( CBOR_ENCODE_OK( xError ) );
         }
 
-        /* Encode number of ports parameter */
-        if( xError == CborNoError )
+        if( CBOR_ENCODE_OK( xError ) )
         {
-            xError = cbor_add_kv_uint( &xUPEncoder, "t", ulPortCount );
-            configASSERT_CONTINUE( xError == CborNoError );
+            xError = cbor_encoder_create_array( &xPortsEncoder, &xPTSEncoder, ulPortCount );
+            configASSERT_CONTINUE( CBOR_ENCODE_OK( xError ) );
         }
 
-        /* Construct ports list / pts if any udp ports are listening */
-        if( ulPortCount > 0 )
+        if( CBOR_ENCODE_OK( xError ) )
         {
-            if( xError == CborNoError )
-            {
-                xError = cbor_encode_text_stringz( &xUPEncoder, "pts" );
-                configASSERT_CONTINUE( xError == CborNoError );
-            }
-
-            if( xError == CborNoError )
-            {
-                xError = cbor_encoder_create_array( &xUPEncoder, &xPTSEncoder, ulPortCount );
-                configASSERT_CONTINUE( xError == CborNoError );
-            }
-
-            if( xError == CborNoError )
-            {
-                xError = xAppendUdpPtsToList( &xPTSEncoder );
-                configASSERT_CONTINUE( xError == CborNoError );
-            }
-
-            if( xError == CborNoError )
-            {
-                xError = cbor_encoder_close_container( &xUPEncoder, &xPTSEncoder );
-                configASSERT_CONTINUE( xError == CborNoError );
-            }
+            xError = xAppendPtsToList( &xPTSEncoder, pxPorts, ulPortCount );
+            configASSERT_CONTINUE( CBOR_ENCODE_OK( xError ) );
         }
 
-        if( xError == CborNoError )
+        if( CBOR_ENCODE_OK( xError ) )
         {
-            xError = cbor_encoder_close_container( pxMetricsEncoder, &xUPEncoder );
-            configASSERT_CONTINUE( xError == CborNoError );
+            xError = cbor_encoder_close_container( &xPortsEncoder, &xPTSEncoder );
+            configASSERT_CONTINUE( CBOR_ENCODE_OK( xError ) );
         }
+    }
 
-        UNLOCK_TCPIP_CORE();
+    if( CBOR_ENCODE_OK( xError ) )
+    {
+        xError = cbor_encoder_close_container( pxMetricsEncoder, &xPortsEncoder );
+        configASSERT_CONTINUE( CBOR_ENCODE_OK( xError ) );
     }
 
     return xError;
 }
+
 /*-----------------------------------------------------------*/
 
+CborError xGetListeningTcpPorts( CborEncoder * pxMetricsEncoder )
+{
+    CborError xError = CborNoError;
 
-static size_t xCountTcpConnections( void )
+    if( pxMetricsEncoder == NULL )
+    {
+        LogError( "Invalid parameter: pxMetricsEncoder: %p", pxMetricsEncoder );
+        xError = CborErrorImproperValue;
+    }
+    else if( xListIncluded( &( xSnapshot.xTcpPortsInfo ), &( xBaseline.xTcpPortsInfo ) ) == true )
+    {
+        xError = xEncodePorts( pxMetricsEncoder, "tp", &( xSnapshot.xTcpPortsInfo ), xSnapshot.xTcpPorts );
+    }
+    else
+    {
+        LogDebug( "Listening TCP ports unchanged since the last report." );
+    }
+
+    return xError;
+}
+
+/*-----------------------------------------------------------*/
+
+CborError xGetListeningUdpPorts( CborEncoder * pxMetricsEncoder )
 {
-    size_t xConnectionCount = 0;
+    CborError xError = CborNoError;
 
-    for( struct tcp_pcb * pxCurPcb = tcp_active_pcbs; pxCurPcb != NULL; pxCurPcb = pxCurPcb->next )
+    if( pxMetricsEncoder == NULL )
     {
-        xConnectionCount++;
+        LogError( "Invalid parameter: pxMetricsEncoder: %p", pxMetricsEncoder );
+        xError = CborErrorImproperValue;
+    }
+    else if( xListIncluded( &( xSnapshot.xUdpPortsInfo ), &( xBaseline.xUdpPortsInfo ) ) == true )
+    {
+        xError = xEncodePorts( pxMetricsEncoder, "up", &( xSnapshot.xUdpPortsInfo ), xSnapshot.xUdpPorts );
+    }
+    else
+    {
+        LogDebug( "Listening UDP ports unchanged since the last report." );
     }
 
-    return xConnectionCount;
+    return xError;
 }
 
+/*-----------------------------------------------------------*/
+
 static bool xIpAddrPortToString( char * pcBuffer,
                                  size_t xBuffLen,
-                                 ip_addr_t * pxIpAddr,
+                                 const ip_addr_t * pxIpAddr,
                                  uint16_t usPort )
 {
     bool xReturn = false;
@@ -523,29 +624,30 @@ static bool xIpAddrPortToString( char * pcBuffer,
     return xReturn;
 }
 
-static CborError xAppendTcpConnectionsToList( CborEncoder * pxCSEncoder )
+static CborError xAppendTcpConnectionsToList( CborEncoder * pxCSEncoder,
+                                              const MetricsConnection_t * pxConnections,
+                                              uint32_t ulNumConnections )
 {
     CborError xError = CborNoError;
 
     configASSERT( pxCSEncoder != NULL );
 
-    for( struct tcp_pcb * pxCurPcb = tcp_active_pcbs; pxCurPcb != NULL; pxCurPcb = pxCurPcb->next )
+    for( uint32_t i = 0; ( i < ulNumConnections ) && ( CBOR_ENCODE_OK( xError ) ); i++ )
     {
+        const MetricsConnection_t * pxConnection = &( pxConnections[ i ] );
         CborEncoder xCEncoder;
         char pcRemoteIpBuf[ IPADDR_PORT_STR_LEN ] = { 0 };
-        char pcNetifBuf[ NETIF_NAMESIZE ] = { 0 };
-        char * pcNetifName = NULL;
 
         xError = cbor_encoder_create_map( pxCSEncoder, &xCEncoder, 3 );
-        configASSERT_CONTINUE( xError == CborNoError );
+        configASSERT_CONTINUE( CBOR_ENCODE_OK( xError ) );
 
         /* Add remote ip / port attribute */
-        if( xError == CborNoError )
+        if( CBOR_ENCODE_OK( xError ) )
         {
-            if( xIpAddrPortToString( pcRemoteIpBuf, IPADDR_PORT_STR_LEN, &( pxCurPcb->remote_ip ), pxCurPcb->remote_port ) )
+            if( xIpAddrPortToString( pcRemoteIpBuf, IPADDR_PORT_STR_LEN, &( pxConnection->xRemoteIp ), pxConnection->usRemotePort ) )
             {
                 xError = cbor_add_kv_str( &xCEncoder, "rad", pcRemoteIpBuf );
-                configASSERT_CONTINUE( xError == CborNoError );
+                configASSERT_CONTINUE( CBOR_ENCODE_OK( xError ) );
             }
             else
             {
@@ -553,31 +655,29 @@ static CborError xAppendTcpConnectionsToList( CborEncoder * pxCSEncoder )
             }
         }
 
-        pcNetifName = pcGetNetifName( pxCurPcb->netif_idx, pcNetifBuf );
-
         /* add local interface attribute */
-        if( pcNetifName != NULL )
+        if( pxConnection->pcNetif[ 0 ] != '\0' )
         {
-            if( xError == CborNoError )
+            if( CBOR_ENCODE_OK( xError ) )
             {
-                xError = cbor_add_kv_str( &xCEncoder, "li", pcNetifName );
-                configASSERT_CONTINUE( xError == CborNoError );
+                xError = cbor_add_kv_str( &xCEncoder, "li", pxConnection->pcNetif );
+                configASSERT_CONTINUE( CBOR_ENCODE_OK( xError ) );
             }
         }
         else
         {
             xError = CborUnknownError;
-            configASSERT_CONTINUE( xError == CborNoError );
+            configASSERT_CONTINUE( CBOR_ENCODE_OK( xError ) );
         }
 
         /* Add local port attribute */
-        if( xError == CborNoError )
+        if( CBOR_ENCODE_OK( xError ) )
         {
-            xError = cbor_add_kv_uint( &xCEncoder, "lp", pxCurPcb->local_port );
-            configASSERT_CONTINUE( xError == CborNoError );
+            xError = cbor_add_kv_uint( &xCEncoder, "lp", pxConnection->usLocalPort );
+            configASSERT_CONTINUE( CBOR_ENCODE_OK( xError ) );
         }
 
-        if( xError == CborNoError )
+        if( CBOR_ENCODE_OK( xError ) )
         {
             xError = cbor_encoder_close_container( pxCSEncoder, &xCEncoder );
         }
@@ -590,101 +690,100 @@ static CborError xAppendTcpConnectionsToList( CborEncoder * pxCSEncoder )
 CborError xGetEstablishedConnections( CborEncoder * pxMetricsEncoder )
 {
     CborError xError = CborNoError;
-    uint32_t ulConnCount = 0;
+    uint32_t ulConnCount = xSnapshot.xConnectionsInfo.ulEntries;
 
     if( pxMetricsEncoder == NULL )
     {
         LogError( "Invalid parameter: pxMetricsEncoder: %p", pxMetricsEncoder );
         xError = CborErrorImproperValue;
     }
+    else if( xListIncluded( &( xSnapshot.xConnectionsInfo ), &( xBaseline.xConnectionsInfo ) ) == false )
+    {
+        LogDebug( "Established connections unchanged since the last report." );
+    }
     else
     {
         CborEncoder xTCEncoder; /* tc object */
         CborEncoder xECEncoder; /* ec object */
         CborEncoder xCSEncoder; /* cs list */
 
-        LOCK_TCPIP_CORE();
-        ulConnCount = xCountTcpConnections();
-
         xError = cbor_encode_text_stringz( pxMetricsEncoder, "tc" );
-        configASSERT_CONTINUE( xError == CborNoError );
+        configASSERT_CONTINUE( CBOR_ENCODE_OK( xError ) );
 
-        if( xError == CborNoError )
+        if( CBOR_ENCODE_OK( xError ) )
         {
             /* Create tcp_connections / tc object */
             xError = cbor_encoder_create_map( pxMetricsEncoder, &xTCEncoder, 1 );
-            configASSERT_CONTINUE( xError == CborNoError );
+            configASSERT_CONTINUE( CBOR_ENCODE_OK( xError ) );
         }
 
-        if( xError == CborNoError )
+        if( CBOR_ENCODE_OK( xError ) )
         {
             xError = cbor_encode_text_stringz( &xTCEncoder, "ec" );
-            configASSERT_CONTINUE( xError == CborNoError );
+            configASSERT_CONTINUE( CBOR_ENCODE_OK( xError ) );
         }
 
-        if( xError == CborNoError )
+        if( CBOR_ENCODE_OK( xError ) )
         {
             /* Create established_connections / ec object */
             if( ulConnCount > 0 )
             {
                 xError = cbor_encoder_create_map( &xTCEncoder, &xECEncoder, 2 );
-                configASSERT_CONTINUE( xError == CborNoError );
+                configASSERT_CONTINUE( CBOR_ENCODE_OK( xError ) );
             }
             else
             {
                 xError = cbor_encoder_create_map( &xTCEncoder, &xECEncoder, 1 );
-                configASSERT_CONTINUE( xError == CborNoError );
+                configASSERT_CONTINUE( CBOR_ENCODE_OK( xError ) );
             }
         }
 
         /* Encode number of connections parameter */
-        if( xError == CborNoError )
+        if( CBOR_ENCODE_OK( xError ) )
         {
-            xError = cbor_add_kv_uint( &xECEncoder, "t", ulConnCount );
-            configASSERT_CONTINUE( xError == CborNoError );
+            xError = cbor_add_kv_uint( &xECEncoder, "t", xSnapshot.xConnectionsInfo.ulTotal );
+            configASSERT_CONTINUE( CBOR_ENCODE_OK( xError ) );
         }
 
         /* Construct connections_list / cs if any tcp ports are connected */
         if( ulConnCount > 0 )
         {
-            if( xError == CborNoError )
+            if( CBOR_ENCODE_OK( xError ) )
             {
                 xError = cbor_encode_text_stringz( &xECEncoder, "cs" );
-                configASSERT_CONTINUE( xError == CborNoError );
+                configASSERT_CONTINUE( CBOR_ENCODE_OK( xError ) );
             }
 
-            if( xError == CborNoError )
+            if( CBOR_ENCODE_OK( xError ) )
             {
                 xError = cbor_encoder_create_array( &xECEncoder, &xCSEncoder, ulConnCount );
-                configASSERT_CONTINUE( xError == CborNoError );
+                configASSERT_CONTINUE( CBOR_ENCODE_OK( xError ) );
             }
 
-            if( xError == CborNoError )
+            if( CBOR_ENCODE_OK( xError ) )
             {
-                xError = xAppendTcpConnectionsToList( &xCSEncoder );
-                configASSERT_CONTINUE( xError == CborNoError );
+                xError = xAppendTcpConnectionsToList( &xCSEncoder, xSnapshot.xConnections, ulConnCount );
+                configASSERT_CONTINUE( CBOR_ENCODE_OK( xError ) );
             }
 
-            if( xError == CborNoError )
+            if( CBOR_ENCODE_OK( xError ) )
             {
                 xError = cbor_encoder_close_container( &xECEncoder, &xCSEncoder );
-                configASSERT_CONTINUE( xError == CborNoError );
+                configASSERT_CONTINUE( CBOR_ENCODE_OK( xError ) );
             }
         }
 
-        if( xError == CborNoError )
+        if( CBOR_ENCODE_OK( xError ) )
         {
             xError = cbor_encoder_close_container( &xTCEncoder, &xECEncoder );
-            configASSERT_CONTINUE( xError == CborNoError );
+            configASSERT_CONTINUE( CBOR_ENCODE_OK( xError ) );
         }
 
-        if( xError == CborNoError )
+        if( CBOR_ENCODE_OK( xError ) )
         {
             xError = cbor_encoder_close_container( pxMetricsEncoder, &xTCEncoder );
-            configASSERT_CONTINUE( xError == CborNoError );
+            configASSERT_CONTINUE( CBOR_ENCODE_OK( xError ) );
         }
-
-        UNLOCK_TCPIP_CORE();
     }
 
     return xError;
@@ -29,20 +29,20 @@
 /* define LOG_LEVEL here if you want to modify the logging level from the default */
 
 #define LOG_LEVEL    LOG_ERROR
+#define LOG_MODULE    LOG_MODULE_SENSOR
 
 #include "logging.h"
 
 /* Standard includes. */
 #include <string.h>
 #include <stdio.h>
+#include <math.h>
 
 /* Kernel includes. */
 #include "FreeRTOS.h"
 #include "task.h"
 #include "queue.h"
 
-#include "kvstore.h"
-
 /* MQTT library includes. */
 #include "core_mqtt.h"
 #include "core_mqtt_agent.h"
@@ -50,33 +50,69 @@
 
 /* Subscription manager header include. */
 #include "subscription_manager.h"
+#include "mqtt_publish_async.h"
 
 /* Sensor includes */
 #include "b_u585i_iot02a_env_sensors.h"
+#include "sensor_hub.h"
+#include "time_base.h"
+#include "telemetry_trace.h"
+#include "work_queue.h"
+
+
+/* Set to 1 to publish CBOR encoded readings on the ".../cbor" topic instead of JSON. */
+#ifndef ENV_SENSOR_PUBLISH_CBOR
+#define ENV_SENSOR_PUBLISH_CBOR              0
+#endif
 
+#if ENV_SENSOR_PUBLISH_CBOR == 1
+#include "cbor.h"
+#endif
 
-#define MQTT_PUBLISH_MAX_LEN                 ( 512 )
 #define MQTT_PUBLISH_TIME_BETWEEN_MS         ( 1000 )
+
+/*
+ * A reading is only published when a channel moved by at least its deadband since
+ * the last published reading, or when nothing was published for
+ * ENV_SENSOR_MAX_SILENCE_MS. Set a deadband to 0 to publish every reading.
+ */
+#ifndef ENV_SENSOR_DEADBAND_TEMP_C
+#define ENV_SENSOR_DEADBAND_TEMP_C           ( 0.2f )
+#endif
+
+#ifndef ENV_SENSOR_DEADBAND_RH_PCT
+#define ENV_SENSOR_DEADBAND_RH_PCT           ( 1.0f )
+#endif
+
+#ifndef ENV_SENSOR_DEADBAND_BARO_MBAR
+#define ENV_SENSOR_DEADBAND_BARO_MBAR        ( 0.5f )
+#endif
+
+#ifndef ENV_SENSOR_MAX_SILENCE_MS
+#define ENV_SENSOR_MAX_SILENCE_MS            ( 60 * 1000 )
+#endif
+
+#if ENV_SENSOR_PUBLISH_CBOR == 1
+#define MQTT_PUBLISH_TOPIC                   "env_sensor_data/cbor"
+#else
 #define MQTT_PUBLISH_TOPIC                   "env_sensor_data"
+#endif
 #define MQTT_PUBLICH_TOPIC_STR_LEN           ( 256 )
-#define MQTT_PUBLISH_BLOCK_TIME_MS           ( 1000 )
-#define MQTT_PUBLISH_NOTIFICATION_WAIT_MS    ( 1000 )
 
-#define MQTT_NOTIFY_IDX                      ( 1 )
+/* Short, the job shares the worker, a reading is dropped when the agent is backed up */
+#define MQTT_PUBLISH_BLOCK_TIME_MS           ( 10 )
+
 #define MQTT_PUBLISH_QOS                     ( MQTTQoS0 )
 
 /*-----------------------------------------------------------*/
 
-/**
- * @brief Defines the structure to use as the command callback context in this
- * demo.
- */
-struct MQTTAgentCommandContext
-{
-    MQTTStatus_t xReturnStatus;
-    TaskHandle_t xTaskToNotify;
-};
+#if TELEMETRY_TRACE_ENABLED == 1
+static TelemetryTraceStream_t xEnvTrace = { 0 };
+#endif
 
+#if SENSOR_HUB_ENABLED == 1
+typedef SensorHubEnvData_t EnvironmentalSensorData_t;
+#else
 typedef struct
 {
     float_t fTemperature0;
@@ -84,35 +120,43 @@ typedef struct
     float_t fHumidity;
     float_t fBarometricPressure;
 } EnvironmentalSensorData_t;
+#endif
+
+static WorkJob_t xPublishJob = { 0 };
+static char pcTopicString[ MQTT_PUBLICH_TOPIC_STR_LEN ] = { 0 };
+static EnvironmentalSensorData_t xLastPublished = { 0 };
+static TickType_t xLastPublishTime = 0;
+static BaseType_t xHavePublished = pdFALSE;
 
 /*-----------------------------------------------------------*/
 
-static void prvPublishCommandCallback( MQTTAgentCommandContext_t * pxCommandContext,
-                                       MQTTAgentReturnInfo_t * pxReturnInfo )
+static void prvPublishCompleteCallback( void * pvCtx,
+                                        MQTTStatus_t xStatus )
 {
-    configASSERT( pxCommandContext != NULL );
-    configASSERT( pxReturnInfo != NULL );
-
-    pxCommandContext->xReturnStatus = pxReturnInfo->returnCode;
+#if TELEMETRY_TRACE_ENABLED == 1
+    if( pvCtx != NULL )
+    {
+        vTelemetryTraceComplete( ( TelemetryTraceRecord_t * ) pvCtx, xStatus );
+    }
+#else
+    ( void ) pvCtx;
+#endif
 
-    if( pxCommandContext->xTaskToNotify != NULL )
+    if( xStatus != MQTTSuccess )
     {
-        /* Send the context's ulNotificationValue as the notification value so
-         * the receiving task can check the value it set in the context matches
-         * the value it receives in the notification. */
-        ( void ) xTaskNotifyGiveIndexed( pxCommandContext->xTaskToNotify,
-                                         MQTT_NOTIFY_IDX );
+        LogError( "MQTT Agent returned error code: %d during publish operation.",
+                  xStatus );
     }
 }
 
 /*-----------------------------------------------------------*/
 
-static BaseType_t prvPublishAndWaitForAck( MQTTAgentHandle_t xAgentHandle,
-                                           const char * pcTopic,
-                                           const void * pvPublishData,
-                                           size_t xPublishDataLen )
+static BaseType_t prvPublishAsync( MQTTAgentHandle_t xAgentHandle,
+                                   const char * pcTopic,
+                                   void * pvPublishData,
+                                   size_t xPublishDataLen,
+                                   void * pvCtx )
 {
-    BaseType_t xResult = pdFALSE;
     MQTTStatus_t xStatus;
 
     configASSERT( pcTopic != NULL );
@@ -130,53 +174,14 @@ static BaseType_t prvPublishAndWaitForAck( MQTTAgentHandle_t xAgentHandle,
         .payloadLength   = xPublishDataLen
     };
 
-    MQTTAgentCommandContext_t xCommandContext =
-    {
-        .xTaskToNotify = xTaskGetCurrentTaskHandle(),
-        .xReturnStatus = MQTTIllegalState,
-    };
-
-    MQTTAgentCommandInfo_t xCommandParams =
-    {
-        .blockTimeMs                 = MQTT_PUBLISH_BLOCK_TIME_MS,
-        .cmdCompleteCallback         = prvPublishCommandCallback,
-        .pCmdCompleteCallbackContext = &xCommandContext,
-    };
-
-    /* Clear the notification index */
-    xTaskNotifyStateClearIndexed( NULL, MQTT_NOTIFY_IDX );
+    /* The payload buffer is released by the agent once the publish completes */
+    xStatus = MqttAgent_PublishAsync( xAgentHandle,
+                                      &xPublishInfo,
+                                      prvPublishCompleteCallback,
+                                      pvCtx,
+                                      MQTT_PUBLISH_BLOCK_TIME_MS );
 
-
-    xStatus = MQTTAgent_Publish( xAgentHandle,
-                                 &xPublishInfo,
-                                 &xCommandParams );
-
-    if( xStatus == MQTTSuccess )
-    {
-        xResult = ulTaskNotifyTakeIndexed( MQTT_NOTIFY_IDX,
-                                           pdTRUE,
-                                           pdMS_TO_TICKS( MQTT_PUBLISH_NOTIFICATION_WAIT_MS ) );
-
-        if( xResult == 0 )
-        {
-            LogError( "Timed out while waiting for publish ACK or Sent event. xTimeout = %d",
-                      pdMS_TO_TICKS( MQTT_PUBLISH_NOTIFICATION_WAIT_MS ) );
-            xResult = pdFALSE;
-        }
-        else if( xCommandContext.xReturnStatus != MQTTSuccess )
-        {
-            LogError( "MQTT Agent returned error code: %d during publish operation.",
-                      xCommandContext.xReturnStatus );
-            xResult = pdFALSE;
-        }
-    }
-    else
-    {
-        LogError( "MQTTAgent_Publish returned error code: %d.",
-                  xStatus );
-    }
-
-    return xResult;
+    return( xStatus == MQTTSuccess ? pdTRUE : pdFALSE );
 }
 
 static BaseType_t xIsMqttConnected( void )
@@ -193,6 +198,37 @@ static BaseType_t xIsMqttConnected( void )
 
 /*-----------------------------------------------------------*/
 
+#if SENSOR_HUB_ENABLED == 1
+
+static QueueHandle_t xSampleQueue = NULL;
+
+static BaseType_t xInitSensors( void )
+{
+    xSampleQueue = xSensorHubSubscribeJob( SENSOR_HUB_ENV, &xPublishJob );
+
+    return( xSampleQueue != NULL ? pdTRUE : pdFALSE );
+}
+
+/* Takes the reading the sensor hub delivered before scheduling the job */
+static BaseType_t xUpdateSensorData( EnvironmentalSensorData_t * pxData,
+                                     uint64_t * pullTimestampUs )
+{
+    SensorHubSample_t xSample;
+    BaseType_t xResult;
+
+    xResult = xQueueReceive( xSampleQueue, &xSample, 0 );
+
+    if( xResult == pdTRUE )
+    {
+        *pxData = xSample.u.xEnv;
+        *pullTimestampUs = xSample.ullTimestampUs;
+    }
+
+    return xResult;
+}
+
+#else /* SENSOR_HUB_ENABLED == 1 */
+
 static BaseType_t xInitSensors( void )
 {
     int32_t lBspError = BSP_ERROR_NONE;
@@ -224,10 +260,13 @@ static BaseType_t xInitSensors( void )
     return( lBspError == BSP_ERROR_NONE ? pdTRUE : pdFALSE );
 }
 
-static BaseType_t xUpdateSensorData( EnvironmentalSensorData_t * pxData )
+static BaseType_t xUpdateSensorData( EnvironmentalSensorData_t * pxData,
+                                     uint64_t * pullTimestampUs )
 {
     int32_t lBspError = BSP_ERROR_NONE;
 
+    *pullTimestampUs = ullTimeBaseGetUs();
+
     lBspError = BSP_ENV_SENSOR_GetValue( 0, ENV_TEMPERATURE, &pxData->fTemperature0 );
     lBspError |= BSP_ENV_SENSOR_GetValue( 0, ENV_HUMIDITY, &pxData->fHumidity );
     lBspError |= BSP_ENV_SENSOR_GetValue( 1, ENV_TEMPERATURE, &pxData->fTemperature1 );
@@ -236,100 +275,257 @@ static BaseType_t xUpdateSensorData( EnvironmentalSensorData_t * pxData )
     return( lBspError == BSP_ERROR_NONE ? pdTRUE : pdFALSE );
 }
 
+#endif /* SENSOR_HUB_ENABLED == 1 */
+
 /*-----------------------------------------------------------*/
 
-extern UBaseType_t uxRand( void );
+static BaseType_t prvHasChanged( const EnvironmentalSensorData_t * pxData,
+                                 const EnvironmentalSensorData_t * pxLast )
+{
+    return( ( fabsf( pxData->fTemperature0 - pxLast->fTemperature0 ) >= ENV_SENSOR_DEADBAND_TEMP_C ) ||
+            ( fabsf( pxData->fTemperature1 - pxLast->fTemperature1 ) >= ENV_SENSOR_DEADBAND_TEMP_C ) ||
+            ( fabsf( pxData->fHumidity - pxLast->fHumidity ) >= ENV_SENSOR_DEADBAND_RH_PCT ) ||
+            ( fabsf( pxData->fBarometricPressure - pxLast->fBarometricPressure ) >= ENV_SENSOR_DEADBAND_BARO_MBAR ) );
+}
+
+/*-----------------------------------------------------------*/
+
+#if ENV_SENSOR_PUBLISH_CBOR == 1
 
-void vEnvironmentSensorPublishTask( void * pvParameters )
+static CborError prvEncodeReading( CborEncoder * pxMapEncoder,
+                                   const char * pcKey,
+                                   float_t fValue )
 {
-    BaseType_t xResult = pdFALSE;
-    BaseType_t xExitFlag = pdFALSE;
-    char payloadBuf[ MQTT_PUBLISH_MAX_LEN ];
-    MQTTAgentHandle_t xAgentHandle = NULL;
-    char pcTopicString[ MQTT_PUBLICH_TOPIC_STR_LEN ] = { 0 };
-    size_t uxTopicLen = 0;
+    CborError xError = cbor_encode_text_stringz( pxMapEncoder, pcKey );
 
-    ( void ) pvParameters;
+    if( xError == CborNoError )
+    {
+        xError = cbor_encode_float( pxMapEncoder, fValue );
+    }
 
-    xResult = xInitSensors();
+    return xError;
+}
 
-    if( xResult != pdTRUE )
+/*-----------------------------------------------------------*/
+
+/* Same keys as the JSON payload, with the values as single precision floats */
+static size_t prvEncodeCbor( uint8_t * pucBuffer,
+                             size_t uxBufferLen,
+                             const EnvironmentalSensorData_t * pxData,
+                             uint64_t ullTimestampUs )
+{
+    CborEncoder xEncoder;
+    CborEncoder xMapEncoder;
+    CborError xError;
+    size_t uxLen = 0;
+    uint64_t ullUnixMs = 0;
+    BaseType_t xHaveTime = ( xTimeBaseToUnixMs( ullTimestampUs, &ullUnixMs ) != TIME_BASE_SRC_NONE );
+
+    cbor_encoder_init( &xEncoder, pucBuffer, uxBufferLen, 0 );
+
+    xError = cbor_encoder_create_map( &xEncoder, &xMapEncoder, xHaveTime ? 5 : 4 );
+
+    if( ( xError == CborNoError ) && xHaveTime )
     {
-        LogError( "Error while initializing environmental sensors." );
-        vTaskDelete( NULL );
+        xError = cbor_encode_text_stringz( &xMapEncoder, "ts_ms" );
+        xError |= cbor_encode_uint( &xMapEncoder, ullUnixMs );
     }
 
-    uxTopicLen = KVStore_getString( CS_CORE_THING_NAME, pcTopicString, MQTT_PUBLICH_TOPIC_STR_LEN );
+    if( xError == CborNoError )
+    {
+        xError = prvEncodeReading( &xMapEncoder, "temp_0_c", pxData->fTemperature0 );
+    }
 
-    if( uxTopicLen > 0 )
+    if( xError == CborNoError )
     {
-        uxTopicLen = strlcat( pcTopicString, "/" MQTT_PUBLISH_TOPIC, MQTT_PUBLICH_TOPIC_STR_LEN );
+        xError = prvEncodeReading( &xMapEncoder, "rh_pct", pxData->fHumidity );
     }
 
-    if( ( uxTopicLen == 0 ) || ( uxTopicLen >= MQTT_PUBLICH_TOPIC_STR_LEN ) )
+    if( xError == CborNoError )
     {
-        LogError( "Failed to construct topic string." );
-        xExitFlag = pdTRUE;
+        xError = prvEncodeReading( &xMapEncoder, "temp_1_c", pxData->fTemperature1 );
     }
 
-    vSleepUntilMQTTAgentReady();
+    if( xError == CborNoError )
+    {
+        xError = prvEncodeReading( &xMapEncoder, "baro_mbar", pxData->fBarometricPressure );
+    }
 
-    xAgentHandle = xGetMqttAgentHandle();
+    if( xError == CborNoError )
+    {
+        xError = cbor_encoder_close_container( &xEncoder, &xMapEncoder );
+    }
 
-    while( xExitFlag == pdFALSE )
+    if( xError == CborNoError )
     {
-        TickType_t xTicksToWait = pdMS_TO_TICKS( MQTT_PUBLISH_TIME_BETWEEN_MS );
-        TimeOut_t xTimeOut;
+        uxLen = cbor_encoder_get_buffer_size( &xEncoder, pucBuffer );
+    }
+
+    return uxLen;
+}
+
+#endif /* ENV_SENSOR_PUBLISH_CBOR == 1 */
+
+/*-----------------------------------------------------------*/
+
+extern UBaseType_t uxRand( void );
+
+/* Runs on the worker after each sample of the hub, or every MQTT_PUBLISH_TIME_BETWEEN_MS without it */
+static void prvPublishJob( void * pvCtx )
+{
+    BaseType_t xResult = pdFALSE;
+    MQTTAgentHandle_t xAgentHandle = xGetMqttAgentHandle();
+    EnvironmentalSensorData_t xEnvData;
+    uint64_t ullTimestampUs = 0;
 
-        vTaskSetTimeOutState( &xTimeOut );
+    ( void ) pvCtx;
 
-        EnvironmentalSensorData_t xEnvData;
-        xResult = xUpdateSensorData( &xEnvData );
+    xResult = xUpdateSensorData( &xEnvData, &ullTimestampUs );
 
-        if( xResult != pdTRUE )
+#if ( TELEMETRY_TRACE_ENABLED == 1 ) && ( ENV_SENSOR_PUBLISH_CBOR == 0 )
+    uint64_t ullReadUs = ullTimeBaseGetUs();
+#endif
+
+    if( xResult != pdTRUE )
+    {
+        LogError( "Error while reading sensor data." );
+    }
+    else if( ( xHavePublished == pdTRUE ) &&
+             ( ( xTaskGetTickCount() - xLastPublishTime ) < pdMS_TO_TICKS( ENV_SENSOR_MAX_SILENCE_MS ) ) &&
+             ( prvHasChanged( &xEnvData, &xLastPublished ) == pdFALSE ) )
+    {
+        LogDebug( "Sensor readings within deadband, not publishing." );
+    }
+    else if( ( xAgentHandle != NULL ) &&
+             ( xIsMqttConnected() == pdTRUE ) )
+    {
+        int bytesWritten = 0;
+        TelemetryTraceRecord_t * pxTrace = NULL;
+        char * pcPayload = MqttAgent_GetPublishBuffer( pdMS_TO_TICKS( MQTT_PUBLISH_BLOCK_TIME_MS ) );
+
+        if( pcPayload == NULL )
         {
-            LogError( "Error while reading sensor data." );
+            LogError( "Failed to obtain a publish buffer." );
         }
-        else if( xIsMqttConnected() == pdTRUE )
+        else
         {
-            int bytesWritten = 0;
-
-            /* Write to */
-            bytesWritten = snprintf( payloadBuf,
-                                     MQTT_PUBLISH_MAX_LEN,
-                                     "{ \"temp_0_c\": %f, \"rh_pct\": %f, \"temp_1_c\": %f, \"baro_mbar\": %f }",
+#if ENV_SENSOR_PUBLISH_CBOR == 1
+            bytesWritten = ( int ) prvEncodeCbor( ( uint8_t * ) pcPayload,
+                                                  MQTT_PUBLISH_POOL_BUFFER_LEN,
+                                                  &xEnvData,
+                                                  ullTimestampUs );
+#else
+            char pcTimestamp[ 24 ] = "null";
+
+            /* Seconds since 1970 at acquisition, null while the wall clock time is unknown */
+            ( void ) uxTimeBaseFormatUnix( ullTimestampUs, pcTimestamp, sizeof( pcTimestamp ) );
+
+            /* Write to, the closing brace comes after the optional trace fields */
+            bytesWritten = snprintf( pcPayload,
+                                     MQTT_PUBLISH_POOL_BUFFER_LEN,
+                                     "{ \"ts\": %s, \"temp_0_c\": %f, \"rh_pct\": %f, \"temp_1_c\": %f, \"baro_mbar\": %f",
+                                     pcTimestamp,
                                      xEnvData.fTemperature0,
                                      xEnvData.fHumidity,
                                      xEnvData.fTemperature1,
                                      xEnvData.fBarometricPressure );
 
-            if( bytesWritten < MQTT_PUBLISH_MAX_LEN )
+#if TELEMETRY_TRACE_ENABLED == 1
+            pxTrace = pxTelemetryTraceBegin( &xEnvTrace, ullTimestampUs );
+            bytesWritten = lTelemetryTraceAppend( &xEnvTrace, pxTrace, ullReadUs, pcPayload,
+                                                  MQTT_PUBLISH_POOL_BUFFER_LEN, bytesWritten );
+#endif
+
+            if( ( bytesWritten > 0 ) &&
+                ( bytesWritten < MQTT_PUBLISH_POOL_BUFFER_LEN ) )
             {
-                xResult = prvPublishAndWaitForAck( xAgentHandle,
-                                                   pcTopicString,
-                                                   payloadBuf,
-                                                   bytesWritten );
+                bytesWritten += snprintf( &( pcPayload[ bytesWritten ] ),
+                                          MQTT_PUBLISH_POOL_BUFFER_LEN - bytesWritten, " }" );
             }
-            else if( bytesWritten > 0 )
+#endif
+
+            if( ( bytesWritten > 0 ) &&
+                ( bytesWritten < MQTT_PUBLISH_POOL_BUFFER_LEN ) )
             {
-                LogError( "Not enough buffer space." );
+#if ENV_SENSOR_PUBLISH_CBOR == 0
+                LogDebug( pcPayload );
+#endif
+
+#if TELEMETRY_TRACE_ENABLED == 1
+                if( pxTrace != NULL )
+                {
+                    vTelemetryTraceQueued( pxTrace );
+                }
+#endif
+
+                xResult = prvPublishAsync( xAgentHandle,
+                                           pcTopicString,
+                                           pcPayload,
+                                           bytesWritten,
+                                           pxTrace );
+
+#if TELEMETRY_TRACE_ENABLED == 1
+                if( ( xResult != pdTRUE ) && ( pxTrace != NULL ) )
+                {
+                    vTelemetryTraceFailed( pxTrace );
+                }
+#endif
+
+                if( xResult == pdTRUE )
+                {
+                    xLastPublished = xEnvData;
+                    xLastPublishTime = xTaskGetTickCount();
+                    xHavePublished = pdTRUE;
+                }
             }
             else
             {
-                LogError( "Printf call failed." );
-            }
-
-            if( xResult == pdTRUE )
-            {
-                LogDebug( payloadBuf );
+                if( bytesWritten > 0 )
+                {
+                    LogError( "Not enough buffer space." );
+                }
+                else
+                {
+                    LogError( "Failed to encode the sensor readings." );
+                }
+
+#if TELEMETRY_TRACE_ENABLED == 1
+                if( pxTrace != NULL )
+                {
+                    vTelemetryTraceFailed( pxTrace );
+                }
+#endif
+
+                MqttAgent_ReleasePublishBuffer( pcPayload );
             }
         }
+    }
+}
 
-        /* Adjust remaining tick count */
-        if( xTaskCheckForTimeOut( &xTimeOut, &xTicksToWait ) == pdFALSE )
-        {
-            /* Wait until its time to poll the sensors again */
-            vTaskDelay( xTicksToWait );
-        }
+/*-----------------------------------------------------------*/
+
+void vEnvironmentSensorPublishStart( void )
+{
+    size_t uxTopicLen = 0;
+
+    vWorkJobInit( &xPublishJob, "EnvSense", prvPublishJob, NULL );
+
+    uxTopicLen = MqttAgent_BuildTelemetryTopic( MQTT_PUBLISH_TOPIC, pcTopicString, MQTT_PUBLICH_TOPIC_STR_LEN );
+
+    if( uxTopicLen == 0 )
+    {
+        LogError( "Failed to construct topic string." );
+    }
+    else if( xInitSensors() != pdTRUE )
+    {
+        LogError( "Error while initializing environmental sensors." );
+    }
+
+    /* With the sensor hub, each sample schedules the job instead */
+#if SENSOR_HUB_ENABLED == 0
+    else
+    {
+        vWorkJobSchedulePeriodic( &xPublishJob, 0, MQTT_PUBLISH_TIME_BETWEEN_MS );
     }
+#endif
 }
@@ -0,0 +1,299 @@
+/*
+ * FreeRTOS STM32 Reference Integration
+ *
+ * Copyright (c) 2022 Amazon.com, Inc. or its affiliates. All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#define LOG_MODULE    LOG_MODULE_APP
+#include "logging.h"
+
+#include <string.h>
+
+#include "FreeRTOS.h"
+#include "task.h"
+
+#if defined( LOGGING_OUTPUT_FLASH ) && !defined( TFM_PSA_API )
+
+#include "kvstore.h"
+
+#include "core_mqtt.h"
+#include "core_mqtt_agent.h"
+#include "sys_evt.h"
+
+#include "subscription_manager.h"
+#include "mqtt_publish_async.h"
+
+#include "fs/log_store.h"
+#include "log_upload.h"
+#include "net/mxchip/mx_netconn.h"
+
+#define LOG_UPLOAD_TOPIC            "/logs"
+#define LOG_UPLOAD_REQUEST_TOPIC    LOG_UPLOAD_TOPIC "/request"
+#define LOG_UPLOAD_TOPIC_STR_LEN    ( 256 )
+#define LOG_UPLOAD_BLOCK_TIME_MS    ( 5000 )
+#define LOG_UPLOAD_RETRY_MS         ( 10 * 1000 )
+
+static TaskHandle_t xUploadTask = NULL;
+static volatile uint32_t ulPublishErrors = 0;
+
+/*-----------------------------------------------------------*/
+
+BaseType_t xLogUploadRequest( void )
+{
+    BaseType_t xResult = pdFALSE;
+
+    if( xUploadTask != NULL )
+    {
+        ( void ) xTaskNotifyGive( xUploadTask );
+        xResult = pdTRUE;
+    }
+
+    return xResult;
+}
+
+static void prvRequestCallback( void * pvCtx,
+                                MQTTPublishInfo_t * pxPublishInfo )
+{
+    ( void ) pvCtx;
+    ( void ) pxPublishInfo;
+
+    ( void ) xLogUploadRequest();
+}
+
+static void prvPublishCompleteCallback( void * pvCtx,
+                                        MQTTStatus_t xStatus )
+{
+    ( void ) pvCtx;
+
+    if( xStatus != MQTTSuccess )
+    {
+        ulPublishErrors++;
+    }
+}
+
+static BaseType_t prvPublish( MQTTAgentHandle_t xAgentHandle,
+                              const char * pcTopic,
+                              char * pcPayload,
+                              size_t uxPayloadLen )
+{
+    MQTTStatus_t xStatus;
+
+    MQTTPublishInfo_t xPublishInfo =
+    {
+        .qos             = MQTTQoS1,
+        .retain          = 0,
+        .dup             = 0,
+        .pTopicName      = pcTopic,
+        .topicNameLength = strlen( pcTopic ),
+        .pPayload        = pcPayload,
+        .payloadLength   = uxPayloadLen
+    };
+
+    /* The payload buffer is released by the agent once the publish is acknowledged */
+    xStatus = MqttAgent_PublishAsync( xAgentHandle,
+                                      &xPublishInfo,
+                                      prvPublishCompleteCallback,
+                                      NULL,
+                                      LOG_UPLOAD_BLOCK_TIME_MS );
+
+    return( xStatus == MQTTSuccess ? pdTRUE : pdFALSE );
+}
+
+/*
+ * Pack the stored lines into pool buffers and publish them.
+ * Waiting for a free pool buffer paces the upload to the rate of PUBACKs.
+ */
+static void prvUpload( MQTTAgentHandle_t xAgentHandle,
+                       const char * pcTopic )
+{
+    LogStoreCursor_t * pxCursor = pvPortMalloc( sizeof( LogStoreCursor_t ) );
+    char * pcLine = pvPortMalloc( MQTT_PUBLISH_POOL_BUFFER_LEN );
+    char * pcPayload = NULL;
+    size_t uxPayloadLen = 0;
+    size_t uxLen = 0;
+    uint32_t ulLines = 0;
+    uint32_t ulPublishes = 0;
+    BaseType_t xResult = pdTRUE;
+
+    ulPublishErrors = 0;
+
+    if( ( pxCursor == NULL ) || ( pcLine == NULL ) )
+    {
+        LogError( "Failed to allocate the log upload buffers." );
+        xResult = pdFALSE;
+    }
+    else if( xLogStoreCursorInit( pxCursor ) != pdTRUE )
+    {
+        LogWarn( "No stored log lines to upload." );
+        xResult = pdFALSE;
+    }
+    else
+    {
+        /* Empty */
+    }
+
+    while( ( xResult == pdTRUE ) &&
+           ( xLogStoreReadLine( pxCursor, pcLine, MQTT_PUBLISH_POOL_BUFFER_LEN, &uxLen ) == pdTRUE ) )
+    {
+        if( ( pcPayload != NULL ) &&
+            ( ( uxPayloadLen + 1 + uxLen ) > MQTT_PUBLISH_POOL_BUFFER_LEN ) )
+        {
+            xResult = prvPublish( xAgentHandle, pcTopic, pcPayload, uxPayloadLen );
+            pcPayload = NULL;
+            ulPublishes++;
+        }
+
+        if( ( xResult == pdTRUE ) && ( pcPayload == NULL ) )
+        {
+            pcPayload = MqttAgent_GetPublishBuffer( pdMS_TO_TICKS( LOG_UPLOAD_BLOCK_TIME_MS ) );
+            uxPayloadLen = 0;
+            xResult = ( pcPayload != NULL ) ? pdTRUE : pdFALSE;
+        }
+
+        if( xResult == pdTRUE )
+        {
+            if( uxPayloadLen > 0 )
+            {
+                pcPayload[ uxPayloadLen++ ] = '\n';
+            }
+
+            if( uxLen > ( MQTT_PUBLISH_POOL_BUFFER_LEN - uxPayloadLen ) )
+            {
+                uxLen = MQTT_PUBLISH_POOL_BUFFER_LEN - uxPayloadLen;
+            }
+
+            ( void ) memcpy( &( pcPayload[ uxPayloadLen ] ), pcLine, uxLen );
+            uxPayloadLen += uxLen;
+            ulLines++;
+        }
+    }
+
+    if( pcPayload != NULL )
+    {
+        if( xResult == pdTRUE )
+        {
+            xResult = prvPublish( xAgentHandle, pcTopic, pcPayload, uxPayloadLen );
+            ulPublishes++;
+        }
+        else
+        {
+            MqttAgent_ReleasePublishBuffer( pcPayload );
+        }
+    }
+
+    if( ( xResult == pdTRUE ) || ( ulLines > 0 ) )
+    {
+        LogInfo( "Uploaded %lu stored log lines in %lu messages to %s.", ulLines, ulPublishes, pcTopic );
+
+        if( xResult != pdTRUE )
+        {
+            LogError( "Log upload stopped early, a publish failed." );
+        }
+    }
+
+    if( pxCursor != NULL )
+    {
+        vPortFree( pxCursor );
+    }
+
+    if( pcLine != NULL )
+    {
+        vPortFree( pcLine );
+    }
+}
+
+static BaseType_t xIsMqttConnected( void )
+{
+    EventBits_t uxEvents = xEventGroupWaitBits( xSystemEvents,
+                                                EVT_MASK_MQTT_CONNECTED,
+                                                pdFALSE,
+                                                pdTRUE,
+                                                0 );
+
+    return( ( uxEvents & EVT_MASK_MQTT_CONNECTED ) == EVT_MASK_MQTT_CONNECTED );
+}
+
+/*-----------------------------------------------------------*/
+
+void vLogUploadTask( void * pvParameters )
+{
+    static char pcTopic[ LOG_UPLOAD_TOPIC_STR_LEN ] = { 0 };
+    char pcRequestTopic[ LOG_UPLOAD_TOPIC_STR_LEN ] = { 0 };
+    MQTTAgentHandle_t xAgentHandle = NULL;
+    MQTTStatus_t xStatus = MQTTSuccess;
+    size_t uxTopicLen = 0;
+
+    ( void ) pvParameters;
+
+    uxTopicLen = KVStore_getString( CS_CORE_THING_NAME, pcTopic, LOG_UPLOAD_TOPIC_STR_LEN );
+
+    if( uxTopicLen > 0 )
+    {
+        ( void ) strlcpy( pcRequestTopic, pcTopic, LOG_UPLOAD_TOPIC_STR_LEN );
+        ( void ) strlcat( pcTopic, LOG_UPLOAD_TOPIC, LOG_UPLOAD_TOPIC_STR_LEN );
+        uxTopicLen = strlcat( pcRequestTopic, LOG_UPLOAD_REQUEST_TOPIC, LOG_UPLOAD_TOPIC_STR_LEN );
+    }
+
+    if( ( uxTopicLen == 0 ) || ( uxTopicLen >= LOG_UPLOAD_TOPIC_STR_LEN ) )
+    {
+        LogError( "Failed to construct the log upload topics." );
+        vTaskDelete( NULL );
+    }
+
+    xUploadTask = xTaskGetCurrentTaskHandle();
+
+    vSleepUntilMQTTAgentReady();
+
+    xAgentHandle = xGetMqttAgentHandle();
+
+    do
+    {
+        xStatus = MqttAgent_SubscribeSync( xAgentHandle,
+                                           pcRequestTopic,
+                                           MQTTQoS1,
+                                           prvRequestCallback,
+                                           NULL );
+
+        if( xStatus != MQTTSuccess )
+        {
+            LogWarn( "Failed to subscribe to %s, error: %d.", pcRequestTopic, xStatus );
+            vTaskDelay( pdMS_TO_TICKS( LOG_UPLOAD_RETRY_MS ) );
+        }
+    }
+    while( xStatus != MQTTSuccess );
+
+    for( ; ; )
+    {
+        ( void ) ulTaskNotifyTake( pdTRUE, portMAX_DELAY );
+
+        if( xIsMqttConnected() == pdTRUE )
+        {
+            net_request_active( NET_ACTIVE_CLIENT_LOG_UPLOAD );
+            prvUpload( xAgentHandle, pcTopic );
+            net_release_active( NET_ACTIVE_CLIENT_LOG_UPLOAD );
+        }
+        else
+        {
+            LogWarn( "Log upload requested while MQTT is not connected." );
+        }
+    }
+}
+
+#endif /* defined( LOGGING_OUTPUT_FLASH ) && !defined( TFM_PSA_API ) */
@@ -0,0 +1,48 @@
+/*
+ * FreeRTOS STM32 Reference Integration
+ *
+ * Copyright (c) 2022 Amazon.com, Inc. or its affiliates. All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+/**
+ * @file log_upload.h
+ * @brief Publish the log lines kept in the OSPI flash log store over MQTT.
+ *
+ * An upload is started by publishing anything to "<thing name>/logs/request"
+ * or with the "logstore upload" command. The stored lines, oldest first, are
+ * published to "<thing name>/logs" at QoS1, as many newline separated lines
+ * per message as fit into a publish buffer.
+ */
+
+#ifndef LOG_UPLOAD_H_
+#define LOG_UPLOAD_H_
+
+#include "FreeRTOS.h"
+
+void vLogUploadTask( void * pvParameters );
+
+/**
+ * @brief Ask the upload task to publish the stored lines.
+ *
+ * @return pdFALSE if the upload task is not running.
+ */
+BaseType_t xLogUploadRequest( void );
+
+#endif /* LOG_UPLOAD_H_ */
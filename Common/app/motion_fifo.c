@@ -0,0 +1,527 @@
+/*
+ * FreeRTOS STM32 Reference Integration
+ * Copyright (C) 2022 Amazon.com, Inc. or its affiliates.  All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ *
+ * https://www.FreeRTOS.org
+ * https://github.com/FreeRTOS
+ *
+ */
+
+#include "logging_levels.h"
+#define LOG_LEVEL    LOG_INFO
+#define LOG_MODULE    LOG_MODULE_SENSOR
+#include "logging.h"
+
+/* Standard includes. */
+#include <string.h>
+#include <assert.h>
+
+/* Kernel includes. */
+#include "FreeRTOS.h"
+#include "task.h"
+#include "queue.h"
+
+#include "hw_defs.h"
+#include "b_u585i_iot02a_bus.h"
+#include "b_u585i_iot02a_errno.h"
+#include "b_u585i_iot02a_motion_sensors.h"
+
+#include "iot_i2c.h"
+#include "motion_fifo.h"
+#include "ram_sections.h"
+
+/* ISM330DHCX registers and fields used in FIFO mode */
+#define ISM330_REG_FIFO_CTRL1           0x07U
+#define ISM330_REG_FIFO_CTRL2           0x08U
+#define ISM330_REG_FIFO_CTRL3           0x09U
+#define ISM330_REG_FIFO_CTRL4           0x0AU
+#define ISM330_REG_INT1_CTRL            0x0DU
+#define ISM330_REG_FIFO_STATUS1         0x3AU
+#define ISM330_REG_FIFO_DATA_OUT_TAG    0x78U
+
+#define ISM330_FIFO_MODE_BYPASS         0x00U
+#define ISM330_FIFO_MODE_CONTINUOUS     0x06U
+#define ISM330_INT1_FIFO_TH             0x08U
+#define ISM330_FIFO_STATUS2_OVR         0x40U
+#define ISM330_FIFO_STATUS2_DIFF_MSK    0x03U
+
+#define ISM330_TAG_GYRO                 0x01U
+#define ISM330_TAG_ACCEL                0x02U
+
+/* Tag byte followed by three 16 bit little endian values */
+#define ISM330_FIFO_WORD_LEN            7U
+
+/* Largest single DMA read, leaves room for words that arrive while draining */
+#define MOTION_FIFO_DRAIN_MAX_WORDS     ( 2 * MOTION_FIFO_WATERMARK )
+
+/* Task notification index of the drain task */
+#define MOTION_FIFO_INT_IDX             1
+
+/* Interval at which the FIFO is checked in case a watermark edge was missed */
+#define MOTION_FIFO_POLL_MS             ( ( 4000UL * MOTION_FIFO_WATERMARK ) / ( 2UL * MOTION_FIFO_ODR_HZ ) )
+
+#define MOTION_FIFO_DMA_TIMEOUT_MS      100U
+#define MOTION_FIFO_BUS_RETRIES         10U
+
+static_assert( MOTION_FIFO_WATERMARK > 1, "MOTION_FIFO_WATERMARK must be larger than 1" );
+static_assert( MOTION_FIFO_DRAIN_MAX_WORDS < 512, "The ISM330DHCX FIFO holds up to 511 words" );
+static_assert( MOTION_FIFO_NUM_BLOCKS > 1, "MOTION_FIFO_NUM_BLOCKS must be larger than 1" );
+
+static TaskHandle_t xDrainTask = NULL;
+static IotI2CHandle_t xI2c = NULL;
+
+static MotionBlock_t xBlocks[ MOTION_FIFO_NUM_BLOCKS ];
+static QueueHandle_t xFreeBlocks = NULL;
+static QueueHandle_t xFullBlocks = NULL;
+
+static uint8_t ucDmaBuffer[ MOTION_FIFO_DRAIN_MAX_WORDS * ISM330_FIFO_WORD_LEN ] RAM_DMA_BUFFER;
+
+/* Block being filled by the drain task and the readings waiting for their other half */
+static MotionBlock_t * pxCurrentBlock = NULL;
+static uint32_t ulNextSeq = 0;
+static BaseType_t xAccelPending = pdFALSE;
+static BaseType_t xGyroPending = pdFALSE;
+static MotionSample_t xPendingSample;
+
+static MotionFifoStats_t xStats = { 0 };
+
+/*-----------------------------------------------------------*/
+
+static uint8_t prvDataRateCode( uint32_t ulHz )
+{
+    uint8_t ucCode;
+
+    /* Codes shared by CTRL1_XL / CTRL2_G and the FIFO batch data rates */
+    switch( ulHz )
+    {
+        case 12:
+            ucCode = 0x1U;
+            break;
+
+        case 26:
+            ucCode = 0x2U;
+            break;
+
+        case 52:
+            ucCode = 0x3U;
+            break;
+
+        case 104:
+            ucCode = 0x4U;
+            break;
+
+        case 208:
+            ucCode = 0x5U;
+            break;
+
+        case 416:
+            ucCode = 0x6U;
+            break;
+
+        case 833:
+            ucCode = 0x7U;
+            break;
+
+        case 1666:
+            ucCode = 0x8U;
+            break;
+
+        default:
+            ucCode = 0x0U;
+            break;
+    }
+
+    return ucCode;
+}
+
+/*-----------------------------------------------------------*/
+
+static int32_t prvWriteReg( uint8_t ucReg,
+                            uint8_t ucValue )
+{
+    return BSP_I2C2_WriteReg( ISM330DHCX_I2C_ADD_H, ucReg, &ucValue, 1 );
+}
+
+/*-----------------------------------------------------------*/
+
+static void prvFifoIntCallback( void * pvContext )
+{
+    BaseType_t xHigherPriorityTaskWoken = pdFALSE;
+
+    ( void ) pvContext;
+
+    if( xDrainTask != NULL )
+    {
+        vTaskNotifyGiveIndexedFromISR( xDrainTask,
+                                       MOTION_FIFO_INT_IDX,
+                                       &xHigherPriorityTaskWoken );
+
+        portYIELD_FROM_ISR( xHigherPriorityTaskWoken );
+    }
+}
+
+/*-----------------------------------------------------------*/
+
+/*
+ * Burst read of the FIFO words through the Common IO I2C driver, which runs it on
+ * DMA and blocks the drain task until it completes. The BSP keeps using the same
+ * bus for its polled register accesses, so the read is retried while they are in
+ * progress.
+ */
+static BaseType_t prvReadFifoDma( size_t uxLen )
+{
+    int32_t lError = IOT_I2C_BUSY;
+
+    for( uint32_t ulTry = 0; ( ulTry < MOTION_FIFO_BUS_RETRIES ) && ( lError == IOT_I2C_BUSY ); ulTry++ )
+    {
+        lError = iot_i2c_mem_read_sync( xI2c,
+                                        ISM330_REG_FIFO_DATA_OUT_TAG,
+                                        ucDmaBuffer,
+                                        uxLen );
+
+        if( lError == IOT_I2C_BUSY )
+        {
+            xStats.ulBusErrors++;
+            vTaskDelay( 1 );
+        }
+    }
+
+    if( lError != IOT_I2C_SUCCESS )
+    {
+        LogError( "FIFO DMA read of %lu bytes failed, error: %ld.", uxLen, lError );
+        xStats.ulBusErrors++;
+    }
+
+    return( lError == IOT_I2C_SUCCESS ? pdTRUE : pdFALSE );
+}
+
+/*-----------------------------------------------------------*/
+
+static void prvCompleteBlock( void )
+{
+    MotionBlock_t * pxOldest = NULL;
+
+    pxCurrentBlock->ulSeq = ulNextSeq++;
+    pxCurrentBlock->xTimestamp = xTaskGetTickCount();
+    xStats.ulBlocks++;
+
+    ( void ) xQueueSendToBack( xFullBlocks, &pxCurrentBlock, 0 );
+    pxCurrentBlock = NULL;
+
+    if( xQueueReceive( xFreeBlocks, &pxCurrentBlock, 0 ) != pdTRUE )
+    {
+        /* The consumer fell behind, reuse its oldest unread block */
+        if( xQueueReceive( xFullBlocks, &pxOldest, 0 ) == pdTRUE )
+        {
+            pxCurrentBlock = pxOldest;
+            xStats.ulDroppedBlocks++;
+        }
+    }
+
+    if( pxCurrentBlock != NULL )
+    {
+        pxCurrentBlock->ulSamples = 0;
+    }
+}
+
+/*-----------------------------------------------------------*/
+
+static void prvParseWords( uint32_t ulWords )
+{
+    for( uint32_t i = 0; i < ulWords; i++ )
+    {
+        const uint8_t * pucWord = &( ucDmaBuffer[ i * ISM330_FIFO_WORD_LEN ] );
+        uint8_t ucTag = pucWord[ 0 ] >> 3;
+        int16_t * psAxes = NULL;
+
+        if( ucTag == ISM330_TAG_ACCEL )
+        {
+            psAxes = xPendingSample.sAccel;
+            xAccelPending = pdTRUE;
+        }
+        else if( ucTag == ISM330_TAG_GYRO )
+        {
+            psAxes = xPendingSample.sGyro;
+            xGyroPending = pdTRUE;
+        }
+        else
+        {
+            /* Timestamp and external sensor words are not batched */
+        }
+
+        if( psAxes != NULL )
+        {
+            for( uint32_t ulAxis = 0; ulAxis < 3; ulAxis++ )
+            {
+                psAxes[ ulAxis ] = ( int16_t ) ( ( uint16_t ) pucWord[ 1 + 2 * ulAxis ] |
+                                                 ( ( uint16_t ) pucWord[ 2 + 2 * ulAxis ] << 8 ) );
+            }
+        }
+
+        /* Both sensors are batched at the same rate, so readings arrive in pairs */
+        if( ( xAccelPending == pdTRUE ) &&
+            ( xGyroPending == pdTRUE ) )
+        {
+            xAccelPending = pdFALSE;
+            xGyroPending = pdFALSE;
+
+            if( pxCurrentBlock == NULL )
+            {
+                ( void ) xQueueReceive( xFreeBlocks, &pxCurrentBlock, 0 );
+            }
+
+            if( pxCurrentBlock != NULL )
+            {
+                pxCurrentBlock->xSamples[ pxCurrentBlock->ulSamples ] = xPendingSample;
+                pxCurrentBlock->ulSamples++;
+
+                if( pxCurrentBlock->ulSamples >= MOTION_FIFO_BLOCK_SAMPLES )
+                {
+                    prvCompleteBlock();
+                }
+            }
+        }
+    }
+}
+
+/*-----------------------------------------------------------*/
+
+static void prvDrainFifo( void )
+{
+    BaseType_t xMore = pdTRUE;
+
+    while( xMore == pdTRUE )
+    {
+        uint8_t pucStatus[ 2 ] = { 0 };
+        uint32_t ulLevel = 0;
+        uint32_t ulWords = 0;
+
+        xMore = pdFALSE;
+
+        if( BSP_I2C2_ReadReg( ISM330DHCX_I2C_ADD_H, ISM330_REG_FIFO_STATUS1, pucStatus, 2 ) != BSP_ERROR_NONE )
+        {
+            xStats.ulBusErrors++;
+        }
+        else
+        {
+            ulLevel = ( uint32_t ) pucStatus[ 0 ] |
+                      ( ( uint32_t ) ( pucStatus[ 1 ] & ISM330_FIFO_STATUS2_DIFF_MSK ) << 8 );
+
+            if( pucStatus[ 1 ] & ISM330_FIFO_STATUS2_OVR )
+            {
+                xStats.ulFifoOverruns++;
+            }
+
+            ulWords = ( ulLevel > MOTION_FIFO_DRAIN_MAX_WORDS ) ? MOTION_FIFO_DRAIN_MAX_WORDS : ulLevel;
+        }
+
+        /* The FIFO output registers wrap around, so a burst read returns consecutive words */
+        if( ( ulWords > 0 ) &&
+            ( prvReadFifoDma( ulWords * ISM330_FIFO_WORD_LEN ) == pdTRUE ) )
+        {
+            prvParseWords( ulWords );
+
+            /* INT1 only rises again once the level has dropped below the watermark */
+            xMore = ( ( ulLevel - ulWords ) >= MOTION_FIFO_WATERMARK ) ? pdTRUE : pdFALSE;
+        }
+    }
+}
+
+/*-----------------------------------------------------------*/
+
+static void prvMotionFifoTask( void * pvParameters )
+{
+    ( void ) pvParameters;
+
+    for( ; ; )
+    {
+        ( void ) ulTaskNotifyTakeIndexed( MOTION_FIFO_INT_IDX,
+                                          pdTRUE,
+                                          pdMS_TO_TICKS( MOTION_FIFO_POLL_MS ) );
+
+        prvDrainFifo();
+    }
+}
+
+/*-----------------------------------------------------------*/
+
+static BaseType_t prvConfigureSensor( void )
+{
+    int32_t lBspError = BSP_ERROR_NONE;
+    uint8_t ucRateCode = prvDataRateCode( MOTION_FIFO_ODR_HZ );
+
+    configASSERT( ucRateCode != 0 );
+
+    lBspError = BSP_MOTION_SENSOR_SetOutputDataRate( 0, MOTION_ACCELERO, ( float ) MOTION_FIFO_ODR_HZ );
+    lBspError |= BSP_MOTION_SENSOR_SetOutputDataRate( 0, MOTION_GYRO, ( float ) MOTION_FIFO_ODR_HZ );
+
+    /* Flush anything batched so far by passing through bypass mode */
+    lBspError |= prvWriteReg( ISM330_REG_FIFO_CTRL4, ISM330_FIFO_MODE_BYPASS );
+    lBspError |= prvWriteReg( ISM330_REG_FIFO_CTRL1, ( uint8_t ) ( MOTION_FIFO_WATERMARK & 0xFFU ) );
+    lBspError |= prvWriteReg( ISM330_REG_FIFO_CTRL2, ( uint8_t ) ( ( MOTION_FIFO_WATERMARK >> 8 ) & 0x1U ) );
+    lBspError |= prvWriteReg( ISM330_REG_FIFO_CTRL3, ( uint8_t ) ( ( ucRateCode << 4 ) | ucRateCode ) );
+    lBspError |= prvWriteReg( ISM330_REG_INT1_CTRL, ISM330_INT1_FIFO_TH );
+    lBspError |= prvWriteReg( ISM330_REG_FIFO_CTRL4, ISM330_FIFO_MODE_CONTINUOUS );
+
+    return( lBspError == BSP_ERROR_NONE ? pdTRUE : pdFALSE );
+}
+
+/*-----------------------------------------------------------*/
+
+BaseType_t xMotionFifoStart( UBaseType_t uxPriority )
+{
+    BaseType_t xResult = pdTRUE;
+
+    configASSERT( xDrainTask == NULL );
+
+    xI2c = iot_i2c_open( 1 );
+
+    if( xI2c == NULL )
+    {
+        LogError( "Failed to open I2C2." );
+        xResult = pdFALSE;
+    }
+    else
+    {
+        uint16_t usAddr = ISM330DHCX_I2C_ADD_H >> 1;
+        IotI2CConfig_t xConfig;
+
+        ( void ) iot_i2c_ioctl( xI2c, eI2CGetMasterConfig, &xConfig );
+        xConfig.ulMasterTimeout = MOTION_FIFO_DMA_TIMEOUT_MS;
+
+        if( ( iot_i2c_ioctl( xI2c, eI2CSetSlaveAddr, &usAddr ) != IOT_I2C_SUCCESS ) ||
+            ( iot_i2c_ioctl( xI2c, eI2CSetMasterConfig, &xConfig ) != IOT_I2C_SUCCESS ) )
+        {
+            LogError( "Failed to configure I2C2." );
+            xResult = pdFALSE;
+        }
+    }
+
+    if( xResult == pdTRUE )
+    {
+        xFreeBlocks = xQueueCreate( MOTION_FIFO_NUM_BLOCKS, sizeof( MotionBlock_t * ) );
+        xFullBlocks = xQueueCreate( MOTION_FIFO_NUM_BLOCKS, sizeof( MotionBlock_t * ) );
+
+        if( ( xFreeBlocks == NULL ) || ( xFullBlocks == NULL ) )
+        {
+            LogError( "Failed to allocate motion block queues." );
+            xResult = pdFALSE;
+        }
+    }
+
+    if( xResult == pdTRUE )
+    {
+        for( uint32_t i = 0; i < MOTION_FIFO_NUM_BLOCKS; i++ )
+        {
+            MotionBlock_t * pxBlock = &( xBlocks[ i ] );
+
+            pxBlock->ulSamples = 0;
+            ( void ) xQueueSendToBack( xFreeBlocks, &pxBlock, 0 );
+        }
+
+        xResult = xTaskCreate( prvMotionFifoTask, "MotionFifo", 512, NULL, uxPriority, &xDrainTask );
+
+        if( xResult != pdPASS )
+        {
+            LogError( "Failed to create the motion FIFO drain task." );
+            xResult = pdFALSE;
+        }
+    }
+
+    if( xResult == pdTRUE )
+    {
+        xResult = prvConfigureSensor();
+
+        if( xResult != pdTRUE )
+        {
+            LogError( "Failed to configure the ISM330DHCX FIFO." );
+        }
+    }
+
+    if( xResult == pdTRUE )
+    {
+        GPIO_InitTypeDef xGpioInit =
+        {
+            .Pin       = ISM330_INT1_Pin,
+            .Mode      = GPIO_MODE_IT_RISING,
+            .Pull      = GPIO_NOPULL,
+            .Speed     = GPIO_SPEED_FREQ_LOW,
+            .Alternate = 0X0,
+        };
+
+        __HAL_RCC_GPIOE_CLK_ENABLE();
+        HAL_GPIO_Init( ISM330_INT1_GPIO_Port, &xGpioInit );
+
+        GPIO_EXTI_Register_Callback( ISM330_INT1_Pin, prvFifoIntCallback, NULL );
+
+        HAL_NVIC_SetPriority( ISM330_INT1_EXTI_IRQn, 5, 5 );
+        HAL_NVIC_EnableIRQ( ISM330_INT1_EXTI_IRQn );
+
+        LogInfo( "Motion FIFO started at %d Hz with a watermark of %d words.",
+                 MOTION_FIFO_ODR_HZ, MOTION_FIFO_WATERMARK );
+    }
+    else if( xDrainTask != NULL )
+    {
+        vTaskDelete( xDrainTask );
+        xDrainTask = NULL;
+    }
+
+    return xResult;
+}
+
+/*-----------------------------------------------------------*/
+
+MotionBlock_t * pxMotionFifoReceive( TickType_t xTicksToWait )
+{
+    MotionBlock_t * pxBlock = NULL;
+
+    configASSERT( xFullBlocks != NULL );
+
+    if( xQueueReceive( xFullBlocks, &pxBlock, xTicksToWait ) != pdTRUE )
+    {
+        pxBlock = NULL;
+    }
+
+    return pxBlock;
+}
+
+/*-----------------------------------------------------------*/
+
+void vMotionFifoRelease( MotionBlock_t * pxBlock )
+{
+    configASSERT( pxBlock >= xBlocks );
+    configASSERT( pxBlock < ( xBlocks + MOTION_FIFO_NUM_BLOCKS ) );
+
+    ( void ) xQueueSendToBack( xFreeBlocks, &pxBlock, 0 );
+}
+
+/*-----------------------------------------------------------*/
+
+void vMotionFifoGetStats( MotionFifoStats_t * pxStats )
+{
+    configASSERT( pxStats != NULL );
+
+    taskENTER_CRITICAL();
+    {
+        *pxStats = xStats;
+    }
+    taskEXIT_CRITICAL();
+}
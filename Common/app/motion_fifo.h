@@ -0,0 +1,109 @@
+/*
+ * FreeRTOS STM32 Reference Integration
+ * Copyright (C) 2022 Amazon.com, Inc. or its affiliates.  All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ *
+ * https://www.FreeRTOS.org
+ * https://github.com/FreeRTOS
+ *
+ */
+
+/**
+ * @file motion_fifo.h
+ * @brief High rate accelerometer and gyroscope sampling using the ISM330DHCX FIFO.
+ *
+ * The sensor batches samples in its FIFO and raises INT1 at a watermark. A drain
+ * task then reads the FIFO over I2C with DMA, pairs accelerometer and gyroscope
+ * readings into samples and hands them to a consumer in fixed size blocks, so the
+ * CPU is not involved for each individual sample.
+ */
+#ifndef _MOTION_FIFO_H
+#define _MOTION_FIFO_H
+
+#include "FreeRTOS.h"
+#include <stdint.h>
+
+/* Output data rate of the accelerometer and gyroscope: 12, 26, 52, 104, 208, 416, 833 or 1666 Hz. */
+#ifndef MOTION_FIFO_ODR_HZ
+#define MOTION_FIFO_ODR_HZ           416
+#endif
+
+/* FIFO words (one accelerometer or gyroscope reading each) that raise the watermark interrupt. */
+#ifndef MOTION_FIFO_WATERMARK
+#define MOTION_FIFO_WATERMARK        64
+#endif
+
+/* Samples in each block handed to the consumer. */
+#ifndef MOTION_FIFO_BLOCK_SAMPLES
+#define MOTION_FIFO_BLOCK_SAMPLES    64
+#endif
+
+/* Blocks shared between the drain task and the consumer. */
+#ifndef MOTION_FIFO_NUM_BLOCKS
+#define MOTION_FIFO_NUM_BLOCKS       4
+#endif
+
+/* Raw sensor readings, see BSP_MOTION_SENSOR_GetSensitivity for the scale */
+typedef struct
+{
+    int16_t sAccel[ 3 ];
+    int16_t sGyro[ 3 ];
+} MotionSample_t;
+
+typedef struct
+{
+    uint32_t ulSeq;         /* Incremented for every block filled, gaps mean blocks were dropped */
+    TickType_t xTimestamp;  /* Tick count when the block was completed */
+    uint32_t ulSamples;
+    MotionSample_t xSamples[ MOTION_FIFO_BLOCK_SAMPLES ];
+} MotionBlock_t;
+
+typedef struct
+{
+    uint32_t ulBlocks;        /* Blocks filled */
+    uint32_t ulDroppedBlocks; /* Blocks discarded because the consumer fell behind */
+    uint32_t ulFifoOverruns;  /* Times the sensor FIFO overflowed before it was drained */
+    uint32_t ulBusErrors;     /* Failed or retried I2C transfers */
+} MotionFifoStats_t;
+
+/*
+ * @brief Configure the sensor FIFO and start the drain task.
+ *
+ * The motion sensors must already have been initialized with BSP_MOTION_SENSOR_Init.
+ *
+ * @param[in] uxPriority Priority of the drain task.
+ * @return pdTRUE on success.
+ */
+BaseType_t xMotionFifoStart( UBaseType_t uxPriority );
+
+/*
+ * @brief Wait for the next full block of samples.
+ *
+ * The block must be returned with vMotionFifoRelease once it has been processed.
+ *
+ * @return The oldest full block or NULL if none became available in time.
+ */
+MotionBlock_t * pxMotionFifoReceive( TickType_t xTicksToWait );
+
+void vMotionFifoRelease( MotionBlock_t * pxBlock );
+
+void vMotionFifoGetStats( MotionFifoStats_t * pxStats );
+
+#endif /* _MOTION_FIFO_H */
@@ -29,6 +29,7 @@
 /* define LOG_LEVEL here if you want to modify the logging level from the default */
 
 #define LOG_LEVEL    LOG_ERROR
+#define LOG_MODULE    LOG_MODULE_SENSOR
 
 #include "logging.h"
 
@@ -57,64 +58,80 @@
 
 /* Subscription manager header include. */
 #include "subscription_manager.h"
+#include "mqtt_publish_async.h"
 
 /* Sensor includes */
 #include "b_u585i_iot02a_motion_sensors.h"
+#include "sensor_hub.h"
+#include "time_base.h"
+#include "telemetry_trace.h"
 
-/**
- * @brief Size of statically allocated buffers for holding topic names and
- * payloads.
+/*
+ * Set to 1 to sample the accelerometer and gyroscope through the sensor FIFO at
+ * MOTION_FIFO_ODR_HZ and publish statistics over each window of CS_MOTION_WINDOW_MS
+ * instead of a single reading.
  */
-#define MQTT_PUBLISH_MAX_LEN                 ( 200 )
-#define MQTT_PUBLISH_PERIOD_MS               ( 500 )
-#define MQTT_PUBLICH_TOPIC_STR_LEN           ( 256 )
-#define MQTT_PUBLISH_BLOCK_TIME_MS           ( 200 )
-#define MQTT_PUBLISH_NOTIFICATION_WAIT_MS    ( 1000 )
-#define MQTT_NOTIFY_IDX                      ( 1 )
-#define MQTT_PUBLISH_QOS                     ( MQTTQoS0 )
-
-
-/*-----------------------------------------------------------*/
+#ifndef MOTION_SENSORS_FIFO_MODE
+#define MOTION_SENSORS_FIFO_MODE    0
+#endif
+
+#if MOTION_SENSORS_FIFO_MODE == 1
+#include "motion_fifo.h"
+#include "motion_window.h"
+#endif
+
+/* Set to 1 to publish CBOR encoded readings on the ".../cbor" topic instead of JSON. */
+#ifndef MOTION_SENSORS_PUBLISH_CBOR
+#define MOTION_SENSORS_PUBLISH_CBOR    0
+#endif
+
+#if MOTION_SENSORS_PUBLISH_CBOR == 1
+#include "cbor.h"
+#define MQTT_PUBLISH_TOPIC_SUFFIX      "motion_sensor_data/cbor"
+#else
+#define MQTT_PUBLISH_TOPIC_SUFFIX      "motion_sensor_data"
+#endif
 
 /**
- * @brief Defines the structure to use as the command callback context in this
- * demo.
+ * @brief Size of statically allocated buffer for holding the topic name.
  */
-struct MQTTAgentCommandContext
-{
-    MQTTStatus_t xReturnStatus;
-    TaskHandle_t xTaskToNotify;
-    uint32_t ulNotificationValue;
-};
+#define MQTT_PUBLISH_PERIOD_MS        ( 500 )
+#define MQTT_PUBLICH_TOPIC_STR_LEN    ( 256 )
+#define MQTT_PUBLISH_BLOCK_TIME_MS    ( 200 )
+#define MQTT_PUBLISH_QOS              ( MQTTQoS0 )
 
-/*-----------------------------------------------------------*/
-static void prvPublishCommandCallback( MQTTAgentCommandContext_t * pxCommandContext,
-                                       MQTTAgentReturnInfo_t * pxReturnInfo )
-{
-    TaskHandle_t xTaskHandle = ( TaskHandle_t ) pxCommandContext;
+#if TELEMETRY_TRACE_ENABLED == 1
+static TelemetryTraceStream_t xMotionTrace = { 0 };
+#endif
 
-    configASSERT( pxReturnInfo != NULL );
+/*-----------------------------------------------------------*/
 
-    uint32_t ulNotifyValue = pxReturnInfo->returnCode;
+static void prvPublishCompleteCallback( void * pvCtx,
+                                        MQTTStatus_t xStatus )
+{
+#if TELEMETRY_TRACE_ENABLED == 1
+    if( pvCtx != NULL )
+    {
+        vTelemetryTraceComplete( ( TelemetryTraceRecord_t * ) pvCtx, xStatus );
+    }
+#else
+    ( void ) pvCtx;
+#endif
 
-    if( xTaskHandle != NULL )
+    if( xStatus != MQTTSuccess )
     {
-        /* Send the context's ulNotificationValue as the notification value so
-         * the receiving task can check the value it set in the context matches
-         * the value it receives in the notification. */
-        ( void ) xTaskNotifyIndexed( xTaskHandle,
-                                     MQTT_NOTIFY_IDX,
-                                     ulNotifyValue,
-                                     eSetValueWithOverwrite );
+        LogError( "MQTT Agent returned error code: %d during publish operation.",
+                  xStatus );
     }
 }
 
 /*-----------------------------------------------------------*/
 
-static BaseType_t prvPublishAndWaitForAck( MQTTAgentHandle_t xAgentHandle,
-                                           const char * pcTopic,
-                                           const void * pvPublishData,
-                                           size_t xPublishDataLen )
+static BaseType_t prvPublishAsync( MQTTAgentHandle_t xAgentHandle,
+                                   const char * pcTopic,
+                                   void * pvPublishData,
+                                   size_t xPublishDataLen,
+                                   void * pvCtx )
 {
     MQTTStatus_t xStatus;
     size_t uxTopicLen = 0;
@@ -136,64 +153,565 @@ static BaseType_t prvPublishAndWaitForAck( MQTTAgentHandle_t xAgentHandle,
         .payloadLength   = xPublishDataLen
     };
 
-    MQTTAgentCommandInfo_t xCommandParams =
+    /* The payload buffer is released by the agent once the publish completes */
+    xStatus = MqttAgent_PublishAsync( xAgentHandle,
+                                      &xPublishInfo,
+                                      prvPublishCompleteCallback,
+                                      pvCtx,
+                                      MQTT_PUBLISH_BLOCK_TIME_MS );
+
+    return( xStatus == MQTTSuccess );
+}
+
+/*-----------------------------------------------------------*/
+
+#if MOTION_SENSORS_PUBLISH_CBOR == 1
+
+/* Encode pcKey: { "x": lX, "y": lY, "z": lZ } into a map */
+static CborError prvEncodeAxes( CborEncoder * pxMapEncoder,
+                                const char * pcKey,
+                                int32_t lX,
+                                int32_t lY,
+                                int32_t lZ )
+{
+    CborEncoder xAxesEncoder;
+    CborError xError = cbor_encode_text_stringz( pxMapEncoder, pcKey );
+
+    if( xError == CborNoError )
     {
-        .blockTimeMs                 = MQTT_PUBLISH_BLOCK_TIME_MS,
-        .cmdCompleteCallback         = prvPublishCommandCallback,
-        .pCmdCompleteCallbackContext = ( void * ) xTaskGetCurrentTaskHandle(),
-    };
+        xError = cbor_encoder_create_map( pxMapEncoder, &xAxesEncoder, 3 );
+    }
 
-    if( xPublishInfo.qos > MQTTQoS0 )
+    if( xError == CborNoError )
     {
-        xCommandParams.pCmdCompleteCallbackContext = ( void * ) xTaskGetCurrentTaskHandle();
+        xError = cbor_encode_text_stringz( &xAxesEncoder, "x" );
+        xError |= cbor_encode_int( &xAxesEncoder, lX );
+        xError |= cbor_encode_text_stringz( &xAxesEncoder, "y" );
+        xError |= cbor_encode_int( &xAxesEncoder, lY );
+        xError |= cbor_encode_text_stringz( &xAxesEncoder, "z" );
+        xError |= cbor_encode_int( &xAxesEncoder, lZ );
     }
 
-    /* Clear the notification index */
-    xTaskNotifyStateClearIndexed( NULL, MQTT_NOTIFY_IDX );
+    if( xError == CborNoError )
+    {
+        xError = cbor_encoder_close_container( pxMapEncoder, &xAxesEncoder );
+    }
 
+    return xError;
+}
 
-    xStatus = MQTTAgent_Publish( xAgentHandle,
-                                 &xPublishInfo,
-                                 &xCommandParams );
+/*-----------------------------------------------------------*/
 
-    if( xStatus == MQTTSuccess )
+static int prvEncodeMotionCbor( uint8_t * pucBuffer,
+                                size_t uxBufferLen,
+                                const BSP_MOTION_SENSOR_Axes_t * pxAccelero,
+                                const BSP_MOTION_SENSOR_Axes_t * pxGyro,
+                                const BSP_MOTION_SENSOR_Axes_t * pxMagneto,
+                                uint64_t ullTimestampUs )
+{
+    CborEncoder xEncoder;
+    CborEncoder xMapEncoder;
+    CborError xError;
+    int lLen = -1;
+    uint64_t ullUnixMs = 0;
+    BaseType_t xHaveTime = ( xTimeBaseToUnixMs( ullTimestampUs, &ullUnixMs ) != TIME_BASE_SRC_NONE );
+
+    cbor_encoder_init( &xEncoder, pucBuffer, uxBufferLen, 0 );
+
+    xError = cbor_encoder_create_map( &xEncoder, &xMapEncoder, xHaveTime ? 4 : 3 );
+
+    if( ( xError == CborNoError ) && xHaveTime )
     {
-        uint32_t ulNotifyValue = 0;
-        BaseType_t xResult = pdFALSE;
+        xError = cbor_encode_text_stringz( &xMapEncoder, "ts_ms" );
+        xError |= cbor_encode_uint( &xMapEncoder, ullUnixMs );
+    }
 
-        xResult = xTaskNotifyWaitIndexed( MQTT_NOTIFY_IDX,
-                                          0xFFFFFFFF,
-                                          0xFFFFFFFF,
-                                          &ulNotifyValue,
-                                          pdMS_TO_TICKS( MQTT_PUBLISH_NOTIFICATION_WAIT_MS ) );
+    if( xError == CborNoError )
+    {
+        xError = prvEncodeAxes( &xMapEncoder, "acceleration_mG", pxAccelero->x, pxAccelero->y, pxAccelero->z );
+    }
 
-        if( xResult )
-        {
-            xStatus = ( MQTTStatus_t ) ulNotifyValue;
+    if( xError == CborNoError )
+    {
+        xError = prvEncodeAxes( &xMapEncoder, "gyro_mDPS", pxGyro->x, pxGyro->y, pxGyro->z );
+    }
 
-            if( xStatus != MQTTSuccess )
-            {
-                LogError( "MQTT Agent returned error code: %d during publish operation.",
-                          xStatus );
-                xResult = pdFALSE;
-            }
-        }
-        else
+    if( xError == CborNoError )
+    {
+        xError = prvEncodeAxes( &xMapEncoder, "magnetometer_mGauss", pxMagneto->x, pxMagneto->y, pxMagneto->z );
+    }
+
+    if( xError == CborNoError )
+    {
+        xError = cbor_encoder_close_container( &xEncoder, &xMapEncoder );
+    }
+
+    if( xError == CborNoError )
+    {
+        lLen = ( int ) cbor_encoder_get_buffer_size( &xEncoder, pucBuffer );
+    }
+
+    return lLen;
+}
+
+#endif /* MOTION_SENSORS_PUBLISH_CBOR == 1 */
+/*-----------------------------------------------------------*/
+
+#if MOTION_SENSORS_FIFO_MODE == 1
+
+/* Bounds applied to the CS_MOTION_WINDOW_MS setting */
+#define MOTION_WINDOW_MIN_MS    100U
+#define MOTION_WINDOW_MAX_MS    60000U
+
+static MotionWindow_t xWindow;
+
+static uint32_t prvGetWindowMs( void )
+{
+    uint32_t ulWindowMs = KVStore_getUInt32( CS_MOTION_WINDOW_MS, NULL );
+
+    if( ulWindowMs < MOTION_WINDOW_MIN_MS )
+    {
+        ulWindowMs = MOTION_WINDOW_MIN_MS;
+    }
+    else if( ulWindowMs > MOTION_WINDOW_MAX_MS )
+    {
+        ulWindowMs = MOTION_WINDOW_MAX_MS;
+    }
+
+    return ulWindowMs;
+}
+
+/*-----------------------------------------------------------*/
+
+#if MOTION_SENSORS_PUBLISH_CBOR == 1
+
+static CborError prvEncodeTriple( CborEncoder * pxMapEncoder,
+                                  const char * pcKey,
+                                  const int32_t * plValues )
+{
+    CborEncoder xArrayEncoder;
+    CborError xError;
+
+    xError = cbor_encode_text_stringz( pxMapEncoder, pcKey );
+    xError |= cbor_encoder_create_array( pxMapEncoder, &xArrayEncoder, 3 );
+
+    if( xError == CborNoError )
+    {
+        xError = cbor_encode_int( &xArrayEncoder, plValues[ 0 ] );
+        xError |= cbor_encode_int( &xArrayEncoder, plValues[ 1 ] );
+        xError |= cbor_encode_int( &xArrayEncoder, plValues[ 2 ] );
+        xError |= cbor_encoder_close_container( pxMapEncoder, &xArrayEncoder );
+    }
+
+    return xError;
+}
+
+/*-----------------------------------------------------------*/
+
+/* Encode pcKey: { "min": [ x, y, z ], "max": ..., "mean": ..., "rms": ..., "pk_pk": ... } */
+static CborError prvEncodeAxisStats( CborEncoder * pxMapEncoder,
+                                     const char * pcKey,
+                                     const MotionAxisStats_t * pxStats )
+{
+    CborEncoder xStatsEncoder;
+    CborError xError;
+
+    xError = cbor_encode_text_stringz( pxMapEncoder, pcKey );
+    xError |= cbor_encoder_create_map( pxMapEncoder, &xStatsEncoder, 5 );
+
+    if( xError == CborNoError )
+    {
+        xError = prvEncodeTriple( &xStatsEncoder, "min", pxStats->plMin );
+        xError |= prvEncodeTriple( &xStatsEncoder, "max", pxStats->plMax );
+        xError |= prvEncodeTriple( &xStatsEncoder, "mean", pxStats->plMean );
+        xError |= prvEncodeTriple( &xStatsEncoder, "rms", pxStats->plRms );
+        xError |= prvEncodeTriple( &xStatsEncoder, "pk_pk", pxStats->plPkPk );
+    }
+
+    if( xError == CborNoError )
+    {
+        xError = cbor_encoder_close_container( pxMapEncoder, &xStatsEncoder );
+    }
+
+    return xError;
+}
+
+/*-----------------------------------------------------------*/
+
+static int prvEncodeWindow( char * pcBuffer,
+                            size_t uxBufferLen,
+                            uint32_t ulWindowMs,
+                            const MotionWindowResult_t * pxResult,
+                            uint32_t ulDroppedBlocks )
+{
+    CborEncoder xEncoder;
+    CborEncoder xMapEncoder;
+    CborError xError;
+    int lLen = -1;
+
+    cbor_encoder_init( &xEncoder, ( uint8_t * ) pcBuffer, uxBufferLen, 0 );
+
+    xError = cbor_encoder_create_map( &xEncoder, &xMapEncoder, 6 );
+
+    if( xError == CborNoError )
+    {
+        xError = cbor_encode_text_stringz( &xMapEncoder, "window_ms" );
+        xError |= cbor_encode_uint( &xMapEncoder, ulWindowMs );
+        xError |= cbor_encode_text_stringz( &xMapEncoder, "odr_hz" );
+        xError |= cbor_encode_uint( &xMapEncoder, MOTION_FIFO_ODR_HZ );
+        xError |= cbor_encode_text_stringz( &xMapEncoder, "samples" );
+        xError |= cbor_encode_uint( &xMapEncoder, pxResult->ulSamples );
+        xError |= cbor_encode_text_stringz( &xMapEncoder, "dropped_blocks" );
+        xError |= cbor_encode_uint( &xMapEncoder, ulDroppedBlocks );
+    }
+
+    if( xError == CborNoError )
+    {
+        xError = prvEncodeAxisStats( &xMapEncoder, "accel_mG", &( pxResult->xAccel ) );
+    }
+
+    if( xError == CborNoError )
+    {
+        xError = prvEncodeAxisStats( &xMapEncoder, "gyro_mDPS", &( pxResult->xGyro ) );
+    }
+
+    if( xError == CborNoError )
+    {
+        xError = cbor_encoder_close_container( &xEncoder, &xMapEncoder );
+    }
+
+    if( xError == CborNoError )
+    {
+        lLen = ( int ) cbor_encoder_get_buffer_size( &xEncoder, ( uint8_t * ) pcBuffer );
+    }
+
+    return lLen;
+}
+
+#else /* MOTION_SENSORS_PUBLISH_CBOR == 1 */
+
+/* Format "pcKey": { "min": [ x, y, z ], "max": ..., "mean": ..., "rms": ..., "pk_pk": ... } */
+static int prvFormatAxisStats( char * pcBuffer,
+                               size_t uxBufferLen,
+                               const char * pcKey,
+                               const MotionAxisStats_t * pxStats )
+{
+    return snprintf( pcBuffer,
+                     uxBufferLen,
+                     "\"%s\":"
+                     "{"
+                     "\"min\":[%ld,%ld,%ld],"
+                     "\"max\":[%ld,%ld,%ld],"
+                     "\"mean\":[%ld,%ld,%ld],"
+                     "\"rms\":[%ld,%ld,%ld],"
+                     "\"pk_pk\":[%ld,%ld,%ld]"
+                     "}",
+                     pcKey,
+                     pxStats->plMin[ 0 ], pxStats->plMin[ 1 ], pxStats->plMin[ 2 ],
+                     pxStats->plMax[ 0 ], pxStats->plMax[ 1 ], pxStats->plMax[ 2 ],
+                     pxStats->plMean[ 0 ], pxStats->plMean[ 1 ], pxStats->plMean[ 2 ],
+                     pxStats->plRms[ 0 ], pxStats->plRms[ 1 ], pxStats->plRms[ 2 ],
+                     pxStats->plPkPk[ 0 ], pxStats->plPkPk[ 1 ], pxStats->plPkPk[ 2 ] );
+}
+
+/*-----------------------------------------------------------*/
+
+static int prvEncodeWindow( char * pcBuffer,
+                            size_t uxBufferLen,
+                            uint32_t ulWindowMs,
+                            const MotionWindowResult_t * pxResult,
+                            uint32_t ulDroppedBlocks )
+{
+    int lLen;
+    int lWritten;
+
+    lLen = snprintf( pcBuffer,
+                     uxBufferLen,
+                     "{"
+                     "\"window_ms\":%lu,"
+                     "\"odr_hz\":%d,"
+                     "\"samples\":%lu,"
+                     "\"dropped_blocks\":%lu,",
+                     ulWindowMs,
+                     MOTION_FIFO_ODR_HZ,
+                     pxResult->ulSamples,
+                     ulDroppedBlocks );
+
+    if( ( lLen > 0 ) && ( ( size_t ) lLen < uxBufferLen ) )
+    {
+        lWritten = prvFormatAxisStats( &( pcBuffer[ lLen ] ), uxBufferLen - lLen, "accel_mG", &( pxResult->xAccel ) );
+        lLen = ( lWritten > 0 ) ? ( lLen + lWritten ) : -1;
+    }
+
+    if( ( lLen > 0 ) && ( ( size_t ) lLen < uxBufferLen ) )
+    {
+        lWritten = snprintf( &( pcBuffer[ lLen ] ), uxBufferLen - lLen, "," );
+        lLen = ( lWritten > 0 ) ? ( lLen + lWritten ) : -1;
+    }
+
+    if( ( lLen > 0 ) && ( ( size_t ) lLen < uxBufferLen ) )
+    {
+        lWritten = prvFormatAxisStats( &( pcBuffer[ lLen ] ), uxBufferLen - lLen, "gyro_mDPS", &( pxResult->xGyro ) );
+        lLen = ( lWritten > 0 ) ? ( lLen + lWritten ) : -1;
+    }
+
+    if( ( lLen > 0 ) && ( ( size_t ) lLen < uxBufferLen ) )
+    {
+        lWritten = snprintf( &( pcBuffer[ lLen ] ), uxBufferLen - lLen, "}" );
+        lLen = ( lWritten > 0 ) ? ( lLen + lWritten ) : -1;
+    }
+
+    return lLen;
+}
+
+#endif /* MOTION_SENSORS_PUBLISH_CBOR == 1 */
+
+/*-----------------------------------------------------------*/
+
+#if MOTION_WINDOW_SPECTRUM == 1
+
+static int prvEncodeSpectrum( char * pcBuffer,
+                              size_t uxBufferLen,
+                              const MotionWindowResult_t * pxResult )
+{
+    const uint32_t ulBandWidthMilliHz = ( MOTION_FIFO_ODR_HZ * 1000U ) / ( 2U * MOTION_WINDOW_BANDS );
+    int lLen = -1;
+
+#if MOTION_SENSORS_PUBLISH_CBOR == 1
+    CborEncoder xEncoder;
+    CborEncoder xMapEncoder;
+    CborEncoder xArrayEncoder;
+    CborError xError;
+
+    cbor_encoder_init( &xEncoder, ( uint8_t * ) pcBuffer, uxBufferLen, 0 );
+
+    xError = cbor_encoder_create_map( &xEncoder, &xMapEncoder, 3 );
+
+    if( xError == CborNoError )
+    {
+        xError = cbor_encode_text_stringz( &xMapEncoder, "frames" );
+        xError |= cbor_encode_uint( &xMapEncoder, pxResult->ulFrames );
+        xError |= cbor_encode_text_stringz( &xMapEncoder, "band_mHz" );
+        xError |= cbor_encode_uint( &xMapEncoder, ulBandWidthMilliHz );
+        xError |= cbor_encode_text_stringz( &xMapEncoder, "bands_rms_mG" );
+        xError |= cbor_encoder_create_array( &xMapEncoder, &xArrayEncoder, MOTION_WINDOW_BANDS );
+    }
+
+    for( uint32_t ulBand = 0; ( xError == CborNoError ) && ( ulBand < MOTION_WINDOW_BANDS ); ulBand++ )
+    {
+        xError = cbor_encode_uint( &xArrayEncoder, pxResult->pulBandsRms[ ulBand ] );
+    }
+
+    if( xError == CborNoError )
+    {
+        xError = cbor_encoder_close_container( &xMapEncoder, &xArrayEncoder );
+        xError |= cbor_encoder_close_container( &xEncoder, &xMapEncoder );
+    }
+
+    if( xError == CborNoError )
+    {
+        lLen = ( int ) cbor_encoder_get_buffer_size( &xEncoder, ( uint8_t * ) pcBuffer );
+    }
+#else /* MOTION_SENSORS_PUBLISH_CBOR == 1 */
+    lLen = snprintf( pcBuffer, uxBufferLen,
+                     "{\"frames\":%lu,\"band_mHz\":%lu,\"bands_rms_mG\":[",
+                     pxResult->ulFrames, ulBandWidthMilliHz );
+
+    for( uint32_t ulBand = 0; ( lLen > 0 ) && ( ( size_t ) lLen < uxBufferLen ) && ( ulBand < MOTION_WINDOW_BANDS ); ulBand++ )
+    {
+        int lWritten = snprintf( &( pcBuffer[ lLen ] ), uxBufferLen - lLen,
+                                 ( ulBand < ( MOTION_WINDOW_BANDS - 1 ) ) ? "%lu," : "%lu]}",
+                                 pxResult->pulBandsRms[ ulBand ] );
+
+        lLen = ( lWritten > 0 ) ? ( lLen + lWritten ) : -1;
+    }
+#endif /* MOTION_SENSORS_PUBLISH_CBOR == 1 */
+
+    return lLen;
+}
+
+#endif /* MOTION_WINDOW_SPECTRUM == 1 */
+
+/*-----------------------------------------------------------*/
+
+/* Publish the lLen bytes in pcPayloadBuf, or release the buffer if encoding failed */
+static void prvPublishPayload( MQTTAgentHandle_t xAgentHandle,
+                               const char * pcTopicString,
+                               char * pcPayloadBuf,
+                               int lLen )
+{
+    if( pcPayloadBuf == NULL )
+    {
+        LogError( "Failed to obtain a publish buffer." );
+    }
+    else if( ( lLen > 0 ) &&
+             ( lLen < MQTT_PUBLISH_POOL_BUFFER_LEN ) )
+    {
+        if( prvPublishAsync( xAgentHandle,
+                             pcTopicString,
+                             pcPayloadBuf,
+                             ( size_t ) lLen,
+                             NULL ) != pdPASS )
         {
-            LogError( "Timed out while waiting for publish ACK or Sent event. xTimeout = %d",
-                      pdMS_TO_TICKS( MQTT_PUBLISH_NOTIFICATION_WAIT_MS ) );
-            xResult = pdFALSE;
+            LogError( "Failed to publish motion sensor data" );
         }
     }
     else
     {
-        LogError( "MQTTAgent_Publish returned error code: %d.", xStatus );
+        LogError( "Motion window does not fit in a publish buffer." );
+        MqttAgent_ReleasePublishBuffer( pcPayloadBuf );
     }
+}
 
-    return( xStatus == MQTTSuccess );
+/*-----------------------------------------------------------*/
+
+static void prvRunFifoMode( MQTTAgentHandle_t xAgentHandle,
+                            const char * pcTopicString )
+{
+    MotionWindowResult_t xResult;
+    MotionFifoStats_t xFifoStats = { 0 };
+    float fAccelSensitivity = 0.0f;
+    float fGyroSensitivity = 0.0f;
+    uint32_t ulWindowMs = prvGetWindowMs();
+    TickType_t xWindowStart = xTaskGetTickCount();
+    BaseType_t xStatus;
+
+#if MOTION_WINDOW_SPECTRUM == 1
+    static char pcSpectrumTopic[ MQTT_PUBLICH_TOPIC_STR_LEN ] = { 0 };
+
+    ( void ) snprintf( pcSpectrumTopic, MQTT_PUBLICH_TOPIC_STR_LEN, "%s/spectrum", pcTopicString );
+#endif
+
+    xStatus = xMotionFifoStart( uxTaskPriorityGet( NULL ) + 1 );
+
+    if( xStatus == pdTRUE )
+    {
+        int32_t lBspError = BSP_MOTION_SENSOR_GetSensitivity( 0, MOTION_ACCELERO, &fAccelSensitivity );
+
+        lBspError |= BSP_MOTION_SENSOR_GetSensitivity( 0, MOTION_GYRO, &fGyroSensitivity );
+
+        if( lBspError != BSP_ERROR_NONE )
+        {
+            LogError( "Failed to read motion sensor sensitivity." );
+            xStatus = pdFALSE;
+        }
+    }
+
+    vMotionWindowInit( &xWindow, fAccelSensitivity, fGyroSensitivity );
+
+    while( xStatus == pdTRUE )
+    {
+        TickType_t xElapsed = xTaskGetTickCount() - xWindowStart;
+        TickType_t xWindowTicks = pdMS_TO_TICKS( ulWindowMs );
+        MotionBlock_t * pxBlock = NULL;
+
+        if( xElapsed < xWindowTicks )
+        {
+            pxBlock = pxMotionFifoReceive( xWindowTicks - xElapsed );
+        }
+
+        if( pxBlock != NULL )
+        {
+            vMotionWindowAdd( &xWindow, pxBlock->xSamples, pxBlock->ulSamples );
+            vMotionFifoRelease( pxBlock );
+        }
+
+        if( ( ( xTaskGetTickCount() - xWindowStart ) >= xWindowTicks ) &&
+            ( xWindow.ulSamples > 0 ) )
+        {
+            xWindowStart = xTaskGetTickCount();
+
+            if( xIsMqttAgentConnected() == pdTRUE )
+            {
+                char * pcPayloadBuf = MqttAgent_GetPublishBuffer( pdMS_TO_TICKS( MQTT_PUBLISH_BLOCK_TIME_MS ) );
+                int lbytesWritten = -1;
+
+                vMotionFifoGetStats( &xFifoStats );
+                vMotionWindowGetResult( &xWindow, &xResult );
+
+                if( pcPayloadBuf != NULL )
+                {
+                    lbytesWritten = prvEncodeWindow( pcPayloadBuf,
+                                                     MQTT_PUBLISH_POOL_BUFFER_LEN,
+                                                     ulWindowMs,
+                                                     &xResult,
+                                                     xFifoStats.ulDroppedBlocks );
+                }
+
+                prvPublishPayload( xAgentHandle, pcTopicString, pcPayloadBuf, lbytesWritten );
+
+#if MOTION_WINDOW_SPECTRUM == 1
+                if( xResult.ulFrames > 0 )
+                {
+                    pcPayloadBuf = MqttAgent_GetPublishBuffer( pdMS_TO_TICKS( MQTT_PUBLISH_BLOCK_TIME_MS ) );
+                    lbytesWritten = -1;
+
+                    if( pcPayloadBuf != NULL )
+                    {
+                        lbytesWritten = prvEncodeSpectrum( pcPayloadBuf, MQTT_PUBLISH_POOL_BUFFER_LEN, &xResult );
+                    }
+
+                    prvPublishPayload( xAgentHandle, pcSpectrumTopic, pcPayloadBuf, lbytesWritten );
+                }
+#endif
+            }
+
+            vMotionWindowReset( &xWindow );
+
+            /* Pick up changes to the window length at window boundaries only */
+            ulWindowMs = prvGetWindowMs();
+        }
+    }
+
+    LogError( "Error while starting motion sensor FIFO sampling." );
 }
 
+#endif /* MOTION_SENSORS_FIFO_MODE == 1 */
+
 /*-----------------------------------------------------------*/
+
+#if SENSOR_HUB_ENABLED == 1
+
+static QueueHandle_t xSampleQueue = NULL;
+
+/* The sensor hub initializes the sensors, wait for it to finish */
+static BaseType_t xInitSensors( void )
+{
+    ( void ) xEventGroupWaitBits( xSystemEvents,
+                                  EVT_MASK_SENSORS_READY,
+                                  pdFALSE,
+                                  pdTRUE,
+                                  portMAX_DELAY );
+
+    return pdTRUE;
+}
+
+/*-----------------------------------------------------------*/
+
+/* Blocks until the sensor hub delivers the next reading */
+static BaseType_t xReadSensors( BSP_MOTION_SENSOR_Axes_t * pxAccelero,
+                                BSP_MOTION_SENSOR_Axes_t * pxGyro,
+                                BSP_MOTION_SENSOR_Axes_t * pxMagneto,
+                                uint64_t * pullTimestampUs )
+{
+    SensorHubSample_t xSample;
+    BaseType_t xResult;
+
+    xResult = xQueueReceive( xSampleQueue, &xSample, pdMS_TO_TICKS( 2 * SENSOR_HUB_MOTION_PERIOD_MS ) );
+
+    if( xResult == pdTRUE )
+    {
+        *pxAccelero = xSample.u.xMotion.xAccelero;
+        *pxGyro = xSample.u.xMotion.xGyro;
+        *pxMagneto = xSample.u.xMotion.xMagneto;
+        *pullTimestampUs = xSample.ullTimestampUs;
+    }
+
+    return xResult;
+}
+
+#else /* SENSOR_HUB_ENABLED == 1 */
+
 static BaseType_t xInitSensors( void )
 {
     int32_t lBspError = BSP_ERROR_NONE;
@@ -213,6 +731,26 @@ static BaseType_t xInitSensors( void )
     return( lBspError == BSP_ERROR_NONE ? pdTRUE : pdFALSE );
 }
 
+/*-----------------------------------------------------------*/
+
+static BaseType_t xReadSensors( BSP_MOTION_SENSOR_Axes_t * pxAccelero,
+                                BSP_MOTION_SENSOR_Axes_t * pxGyro,
+                                BSP_MOTION_SENSOR_Axes_t * pxMagneto,
+                                uint64_t * pullTimestampUs )
+{
+    int32_t lBspError = BSP_ERROR_NONE;
+
+    *pullTimestampUs = ullTimeBaseGetUs();
+
+    lBspError = BSP_MOTION_SENSOR_GetAxes( 0, MOTION_GYRO, pxGyro );
+    lBspError |= BSP_MOTION_SENSOR_GetAxes( 0, MOTION_ACCELERO, pxAccelero );
+    lBspError |= BSP_MOTION_SENSOR_GetAxes( 1, MOTION_MAGNETO, pxMagneto );
+
+    return( lBspError == BSP_ERROR_NONE ? pdTRUE : pdFALSE );
+}
+
+#endif /* SENSOR_HUB_ENABLED == 1 */
+
 /*-----------------------------------------------------------*/
 void vMotionSensorsPublish( void * pvParameters )
 {
@@ -221,10 +759,7 @@ void vMotionSensorsPublish( void * pvParameters )
     BaseType_t xExitFlag = pdFALSE;
 
     MQTTAgentHandle_t xAgentHandle = NULL;
-    char pcPayloadBuf[ MQTT_PUBLISH_MAX_LEN ];
     char pcTopicString[ MQTT_PUBLICH_TOPIC_STR_LEN ] = { 0 };
-    char * pcDeviceId = NULL;
-    int lTopicLen = 0;
 
     xResult = xInitSensors();
 
@@ -234,18 +769,7 @@ void vMotionSensorsPublish( void * pvParameters )
         vTaskDelete( NULL );
     }
 
-    pcDeviceId = KVStore_getStringHeap( CS_CORE_THING_NAME, NULL );
-
-    if( pcDeviceId == NULL )
-    {
-        xExitFlag = pdTRUE;
-    }
-    else
-    {
-        lTopicLen = snprintf( pcTopicString, ( size_t ) MQTT_PUBLICH_TOPIC_STR_LEN, "%s/motion_sensor_data", pcDeviceId );
-    }
-
-    if( ( lTopicLen <= 0 ) || ( lTopicLen > MQTT_PUBLICH_TOPIC_STR_LEN ) )
+    if( MqttAgent_BuildTelemetryTopic( MQTT_PUBLISH_TOPIC_SUFFIX, pcTopicString, MQTT_PUBLICH_TOPIC_STR_LEN ) == 0 )
     {
         LogError( "Error while constructing topic string." );
         xExitFlag = pdTRUE;
@@ -255,21 +779,63 @@ void vMotionSensorsPublish( void * pvParameters )
 
     xAgentHandle = xGetMqttAgentHandle();
 
+#if MOTION_SENSORS_FIFO_MODE == 1
+    /* Only returns on error, in which case the sensors are polled instead */
+    if( xExitFlag == pdFALSE )
+    {
+        prvRunFifoMode( xAgentHandle, pcTopicString );
+    }
+#endif
+
+#if SENSOR_HUB_ENABLED == 1
+    /* Only subscribe when polling so the hub leaves the bus to the FIFO otherwise */
+    if( xExitFlag == pdFALSE )
+    {
+        xSampleQueue = xSensorHubSubscribe( SENSOR_HUB_MOTION );
+
+        if( xSampleQueue == NULL )
+        {
+            xExitFlag = pdTRUE;
+        }
+    }
+#endif
+
     while( xExitFlag == pdFALSE )
     {
         /* Interpret sensor data */
-        int32_t lBspError = BSP_ERROR_NONE;
         BSP_MOTION_SENSOR_Axes_t xAcceleroAxes, xGyroAxes, xMagnetoAxes;
+        uint64_t ullTimestampUs = 0;
+
+        xResult = xReadSensors( &xAcceleroAxes, &xGyroAxes, &xMagnetoAxes, &ullTimestampUs );
 
-        lBspError = BSP_MOTION_SENSOR_GetAxes( 0, MOTION_GYRO, &xGyroAxes );
-        lBspError |= BSP_MOTION_SENSOR_GetAxes( 0, MOTION_ACCELERO, &xAcceleroAxes );
-        lBspError |= BSP_MOTION_SENSOR_GetAxes( 1, MOTION_MAGNETO, &xMagnetoAxes );
+#if ( TELEMETRY_TRACE_ENABLED == 1 ) && ( MOTION_SENSORS_PUBLISH_CBOR == 0 )
+        uint64_t ullReadUs = ullTimeBaseGetUs();
+#endif
 
-        if( lBspError == BSP_ERROR_NONE )
+        if( ( xResult == pdTRUE ) &&
+            ( xIsMqttAgentConnected() == pdTRUE ) )
         {
-            int lbytesWritten = snprintf( pcPayloadBuf,
-                                          MQTT_PUBLISH_MAX_LEN,
+            char * pcPayloadBuf = MqttAgent_GetPublishBuffer( pdMS_TO_TICKS( MQTT_PUBLISH_BLOCK_TIME_MS ) );
+            int lbytesWritten = -1;
+            TelemetryTraceRecord_t * pxTrace = NULL;
+
+            if( pcPayloadBuf != NULL )
+            {
+#if MOTION_SENSORS_PUBLISH_CBOR == 1
+                lbytesWritten = prvEncodeMotionCbor( ( uint8_t * ) pcPayloadBuf,
+                                                     MQTT_PUBLISH_POOL_BUFFER_LEN,
+                                                     &xAcceleroAxes, &xGyroAxes, &xMagnetoAxes,
+                                                     ullTimestampUs );
+#else
+                char pcTimestamp[ 24 ] = "null";
+
+                /* Seconds since 1970 at acquisition, null while the wall clock time is unknown */
+                ( void ) uxTimeBaseFormatUnix( ullTimestampUs, pcTimestamp, sizeof( pcTimestamp ) );
+
+                lbytesWritten = snprintf( pcPayloadBuf,
+                                          MQTT_PUBLISH_POOL_BUFFER_LEN,
                                           "{"
+                                          "\"ts\": %s,"
                                           "\"acceleration_mG\":"
                                           "{"
                                           "\"x\": %ld,"
@@ -287,29 +853,75 @@ void vMotionSensorsPublish( void * pvParameters )
                                           "\"x\": %ld,"
                                           "\"y\": %ld,"
                                           "\"z\": %ld"
-                                          "}"
                                           "}",
+                                          pcTimestamp,
                                           xAcceleroAxes.x, xAcceleroAxes.y, xAcceleroAxes.z,
                                           xGyroAxes.x, xGyroAxes.y, xGyroAxes.z,
                                           xMagnetoAxes.x, xMagnetoAxes.y, xMagnetoAxes.z );
 
-            if( ( lbytesWritten < MQTT_PUBLISH_MAX_LEN ) &&
-                ( xIsMqttAgentConnected() == pdTRUE ) )
+#if TELEMETRY_TRACE_ENABLED == 1
+                pxTrace = pxTelemetryTraceBegin( &xMotionTrace, ullTimestampUs );
+                lbytesWritten = lTelemetryTraceAppend( &xMotionTrace, pxTrace, ullReadUs, pcPayloadBuf,
+                                                       MQTT_PUBLISH_POOL_BUFFER_LEN, lbytesWritten );
+#endif
+
+                /* Closes the object after the optional trace fields */
+                if( ( lbytesWritten > 0 ) &&
+                    ( lbytesWritten < MQTT_PUBLISH_POOL_BUFFER_LEN ) )
+                {
+                    lbytesWritten += snprintf( &( pcPayloadBuf[ lbytesWritten ] ),
+                                               MQTT_PUBLISH_POOL_BUFFER_LEN - lbytesWritten, "}" );
+                }
+#endif
+            }
+
+            if( ( lbytesWritten > 0 ) &&
+                ( lbytesWritten < MQTT_PUBLISH_POOL_BUFFER_LEN ) )
             {
-                xResult = prvPublishAndWaitForAck( xAgentHandle,
-                                                   pcTopicString,
-                                                   pcPayloadBuf,
-                                                   ( size_t ) lbytesWritten );
+#if TELEMETRY_TRACE_ENABLED == 1
+                if( pxTrace != NULL )
+                {
+                    vTelemetryTraceQueued( pxTrace );
+                }
+#endif
+
+                xResult = prvPublishAsync( xAgentHandle,
+                                           pcTopicString,
+                                           pcPayloadBuf,
+                                           ( size_t ) lbytesWritten,
+                                           pxTrace );
 
                 if( xResult != pdPASS )
                 {
                     LogError( "Failed to publish motion sensor data" );
+
+#if TELEMETRY_TRACE_ENABLED == 1
+                    if( pxTrace != NULL )
+                    {
+                        vTelemetryTraceFailed( pxTrace );
+                    }
+#endif
                 }
             }
+            else if( pcPayloadBuf != NULL )
+            {
+#if TELEMETRY_TRACE_ENABLED == 1
+                if( pxTrace != NULL )
+                {
+                    vTelemetryTraceFailed( pxTrace );
+                }
+#endif
+
+                MqttAgent_ReleasePublishBuffer( pcPayloadBuf );
+            }
+            else
+            {
+                LogError( "Failed to obtain a publish buffer." );
+            }
         }
 
+#if SENSOR_HUB_ENABLED == 0
         vTaskDelay( pdMS_TO_TICKS( MQTT_PUBLISH_PERIOD_MS ) );
+#endif
     }
-
-    vPortFree( pcDeviceId );
 }
@@ -0,0 +1,320 @@
+/*
+ * FreeRTOS STM32 Reference Integration
+ * Copyright (C) 2022 Amazon.com, Inc. or its affiliates.  All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ *
+ * https://www.FreeRTOS.org
+ * https://github.com/FreeRTOS
+ *
+ */
+
+/* Standard includes. */
+#include <string.h>
+#include <math.h>
+#include <assert.h>
+
+#include "FreeRTOS.h"
+
+#include "motion_window.h"
+
+static_assert( ( MOTION_WINDOW_FFT_LEN & ( MOTION_WINDOW_FFT_LEN - 1 ) ) == 0, "MOTION_WINDOW_FFT_LEN must be a power of two" );
+static_assert( ( ( MOTION_WINDOW_FFT_LEN / 2 ) % MOTION_WINDOW_BANDS ) == 0, "MOTION_WINDOW_BANDS must divide MOTION_WINDOW_FFT_LEN / 2" );
+
+#if MOTION_WINDOW_SPECTRUM == 1
+
+#define FFT_LEN                MOTION_WINDOW_FFT_LEN
+#define BINS_PER_BAND          ( ( FFT_LEN / 2 ) / MOTION_WINDOW_BANDS )
+
+/* Mean of the squared Hann window, used to undo its attenuation */
+#define HANN_POWER_FACTOR      0.375f
+
+static float pfHann[ FFT_LEN ];
+static float pfCos[ FFT_LEN / 2 ];
+static float pfSin[ FFT_LEN / 2 ];
+static BaseType_t xTablesReady = pdFALSE;
+
+/* FFT scratch space, shared since frames are processed by a single task */
+static float pfRe[ FFT_LEN ];
+static float pfIm[ FFT_LEN ];
+
+/*-----------------------------------------------------------*/
+
+static void prvInitTables( void )
+{
+    const float fTwoPi = 6.28318530718f;
+
+    for( uint32_t n = 0; n < FFT_LEN; n++ )
+    {
+        pfHann[ n ] = 0.5f - 0.5f * cosf( ( fTwoPi * n ) / ( FFT_LEN - 1 ) );
+    }
+
+    for( uint32_t m = 0; m < ( FFT_LEN / 2 ); m++ )
+    {
+        pfCos[ m ] = cosf( ( fTwoPi * m ) / FFT_LEN );
+        pfSin[ m ] = sinf( ( fTwoPi * m ) / FFT_LEN );
+    }
+
+    xTablesReady = pdTRUE;
+}
+
+/*-----------------------------------------------------------*/
+
+/* In place iterative radix-2 complex FFT of pfRe / pfIm */
+static void prvFft( void )
+{
+    uint32_t j = 0;
+
+    for( uint32_t i = 1; i < FFT_LEN; i++ )
+    {
+        uint32_t ulBit = FFT_LEN >> 1;
+
+        for( ; ( j & ulBit ) != 0; ulBit >>= 1 )
+        {
+            j ^= ulBit;
+        }
+
+        j ^= ulBit;
+
+        if( i < j )
+        {
+            float fTmp = pfRe[ i ];
+
+            pfRe[ i ] = pfRe[ j ];
+            pfRe[ j ] = fTmp;
+
+            fTmp = pfIm[ i ];
+            pfIm[ i ] = pfIm[ j ];
+            pfIm[ j ] = fTmp;
+        }
+    }
+
+    for( uint32_t ulLen = 2; ulLen <= FFT_LEN; ulLen <<= 1 )
+    {
+        uint32_t ulHalf = ulLen / 2;
+        uint32_t ulStep = FFT_LEN / ulLen;
+
+        for( uint32_t i = 0; i < FFT_LEN; i += ulLen )
+        {
+            for( uint32_t k = 0; k < ulHalf; k++ )
+            {
+                float fWr = pfCos[ k * ulStep ];
+                float fWi = -pfSin[ k * ulStep ];
+                float fVr = ( pfRe[ i + k + ulHalf ] * fWr ) - ( pfIm[ i + k + ulHalf ] * fWi );
+                float fVi = ( pfRe[ i + k + ulHalf ] * fWi ) + ( pfIm[ i + k + ulHalf ] * fWr );
+
+                pfRe[ i + k + ulHalf ] = pfRe[ i + k ] - fVr;
+                pfIm[ i + k + ulHalf ] = pfIm[ i + k ] - fVi;
+                pfRe[ i + k ] += fVr;
+                pfIm[ i + k ] += fVi;
+            }
+        }
+    }
+}
+
+/*-----------------------------------------------------------*/
+
+static void prvProcessFrame( MotionWindow_t * pxWindow )
+{
+    for( uint32_t ulAxis = 0; ulAxis < 3; ulAxis++ )
+    {
+        const int16_t * psFrame = pxWindow->psFrame[ ulAxis ];
+        int32_t lSum = 0;
+        float fMean;
+
+        for( uint32_t n = 0; n < FFT_LEN; n++ )
+        {
+            lSum += psFrame[ n ];
+        }
+
+        fMean = ( float ) lSum / FFT_LEN;
+
+        for( uint32_t n = 0; n < FFT_LEN; n++ )
+        {
+            pfRe[ n ] = ( ( float ) psFrame[ n ] - fMean ) * pfHann[ n ];
+            pfIm[ n ] = 0.0f;
+        }
+
+        prvFft();
+
+        /* One sided power spectrum, the DC bin only holds leakage of the mean */
+        for( uint32_t k = 1; k < ( FFT_LEN / 2 ); k++ )
+        {
+            pxWindow->pfPower[ k ] += ( pfRe[ k ] * pfRe[ k ] ) + ( pfIm[ k ] * pfIm[ k ] );
+        }
+    }
+
+    pxWindow->ulFrames++;
+    pxWindow->ulFrameLen = 0;
+}
+
+#endif /* MOTION_WINDOW_SPECTRUM == 1 */
+
+/*-----------------------------------------------------------*/
+
+void vMotionWindowInit( MotionWindow_t * pxWindow,
+                        float fAccelSensitivity,
+                        float fGyroSensitivity )
+{
+    configASSERT( pxWindow != NULL );
+
+#if MOTION_WINDOW_SPECTRUM == 1
+    if( xTablesReady == pdFALSE )
+    {
+        prvInitTables();
+    }
+#endif
+
+    pxWindow->fAccelSensitivity = fAccelSensitivity;
+    pxWindow->fGyroSensitivity = fGyroSensitivity;
+
+    vMotionWindowReset( pxWindow );
+}
+
+/*-----------------------------------------------------------*/
+
+void vMotionWindowReset( MotionWindow_t * pxWindow )
+{
+    pxWindow->ulSamples = 0;
+    ( void ) memset( pxWindow->pllSum, 0, sizeof( pxWindow->pllSum ) );
+    ( void ) memset( pxWindow->pllSumSq, 0, sizeof( pxWindow->pllSumSq ) );
+
+    for( uint32_t i = 0; i < 6; i++ )
+    {
+        pxWindow->psMin[ i ] = INT16_MAX;
+        pxWindow->psMax[ i ] = INT16_MIN;
+    }
+
+#if MOTION_WINDOW_SPECTRUM == 1
+    pxWindow->ulFrameLen = 0;
+    pxWindow->ulFrames = 0;
+    ( void ) memset( pxWindow->pfPower, 0, sizeof( pxWindow->pfPower ) );
+#endif
+}
+
+/*-----------------------------------------------------------*/
+
+void vMotionWindowAdd( MotionWindow_t * pxWindow,
+                       const MotionSample_t * pxSamples,
+                       uint32_t ulCount )
+{
+    configASSERT( pxWindow != NULL );
+    configASSERT( ( pxSamples != NULL ) || ( ulCount == 0 ) );
+
+    for( uint32_t ulIdx = 0; ulIdx < ulCount; ulIdx++ )
+    {
+        const MotionSample_t * pxSample = &( pxSamples[ ulIdx ] );
+
+        for( uint32_t i = 0; i < 6; i++ )
+        {
+            int16_t sValue = ( i < 3 ) ? pxSample->sAccel[ i ] : pxSample->sGyro[ i - 3 ];
+
+            pxWindow->pllSum[ i ] += sValue;
+            pxWindow->pllSumSq[ i ] += ( int32_t ) sValue * sValue;
+
+            if( sValue < pxWindow->psMin[ i ] )
+            {
+                pxWindow->psMin[ i ] = sValue;
+            }
+
+            if( sValue > pxWindow->psMax[ i ] )
+            {
+                pxWindow->psMax[ i ] = sValue;
+            }
+        }
+
+#if MOTION_WINDOW_SPECTRUM == 1
+        for( uint32_t ulAxis = 0; ulAxis < 3; ulAxis++ )
+        {
+            pxWindow->psFrame[ ulAxis ][ pxWindow->ulFrameLen ] = pxSample->sAccel[ ulAxis ];
+        }
+
+        pxWindow->ulFrameLen++;
+
+        if( pxWindow->ulFrameLen >= MOTION_WINDOW_FFT_LEN )
+        {
+            prvProcessFrame( pxWindow );
+        }
+#endif
+    }
+
+    pxWindow->ulSamples += ulCount;
+}
+
+/*-----------------------------------------------------------*/
+
+static void prvGetAxisStats( const MotionWindow_t * pxWindow,
+                             uint32_t ulFirst,
+                             float fSensitivity,
+                             MotionAxisStats_t * pxStats )
+{
+    for( uint32_t ulAxis = 0; ulAxis < 3; ulAxis++ )
+    {
+        uint32_t i = ulFirst + ulAxis;
+        float fMean = ( float ) pxWindow->pllSum[ i ] / ( float ) pxWindow->ulSamples;
+        float fVariance = ( ( float ) pxWindow->pllSumSq[ i ] / ( float ) pxWindow->ulSamples ) - ( fMean * fMean );
+
+        pxStats->plMin[ ulAxis ] = ( int32_t ) ( pxWindow->psMin[ i ] * fSensitivity );
+        pxStats->plMax[ ulAxis ] = ( int32_t ) ( pxWindow->psMax[ i ] * fSensitivity );
+        pxStats->plMean[ ulAxis ] = ( int32_t ) ( fMean * fSensitivity );
+        pxStats->plRms[ ulAxis ] = ( fVariance > 0.0f ) ? ( int32_t ) ( sqrtf( fVariance ) * fSensitivity ) : 0;
+        pxStats->plPkPk[ ulAxis ] = ( int32_t ) ( ( pxWindow->psMax[ i ] - pxWindow->psMin[ i ] ) * fSensitivity );
+    }
+}
+
+/*-----------------------------------------------------------*/
+
+void vMotionWindowGetResult( const MotionWindow_t * pxWindow,
+                             MotionWindowResult_t * pxResult )
+{
+    configASSERT( pxWindow != NULL );
+    configASSERT( pxResult != NULL );
+
+    ( void ) memset( pxResult, 0, sizeof( MotionWindowResult_t ) );
+
+    pxResult->ulSamples = pxWindow->ulSamples;
+
+    if( pxWindow->ulSamples > 0 )
+    {
+        prvGetAxisStats( pxWindow, 0, pxWindow->fAccelSensitivity, &( pxResult->xAccel ) );
+        prvGetAxisStats( pxWindow, 3, pxWindow->fGyroSensitivity, &( pxResult->xGyro ) );
+    }
+
+#if MOTION_WINDOW_SPECTRUM == 1
+    pxResult->ulFrames = pxWindow->ulFrames;
+
+    if( pxWindow->ulFrames > 0 )
+    {
+        /* Parseval: mean square of the band = 2 * sum( |X[k]|^2 ) / N^2, corrected for the window */
+        float fScale = 2.0f / ( ( float ) FFT_LEN * FFT_LEN * HANN_POWER_FACTOR * pxWindow->ulFrames );
+
+        for( uint32_t ulBand = 0; ulBand < MOTION_WINDOW_BANDS; ulBand++ )
+        {
+            float fPower = 0.0f;
+
+            for( uint32_t k = ulBand * BINS_PER_BAND; k < ( ulBand + 1 ) * BINS_PER_BAND; k++ )
+            {
+                fPower += pxWindow->pfPower[ k ];
+            }
+
+            pxResult->pulBandsRms[ ulBand ] = ( uint32_t ) ( sqrtf( fPower * fScale ) * pxWindow->fAccelSensitivity );
+        }
+    }
+#endif
+}
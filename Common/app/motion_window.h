@@ -0,0 +1,120 @@
+/*
+ * FreeRTOS STM32 Reference Integration
+ * Copyright (C) 2022 Amazon.com, Inc. or its affiliates.  All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ *
+ * https://www.FreeRTOS.org
+ * https://github.com/FreeRTOS
+ *
+ */
+
+/**
+ * @file motion_window.h
+ * @brief Per window statistics of accelerometer and gyroscope samples.
+ *
+ * Samples are accumulated as they arrive, so the raw data never has to be kept
+ * for a whole window. Optionally, the acceleration spectrum is estimated by
+ * averaging the power spectra of consecutive MOTION_WINDOW_FFT_LEN sample frames.
+ */
+#ifndef _MOTION_WINDOW_H
+#define _MOTION_WINDOW_H
+
+#include "FreeRTOS.h"
+#include <stdint.h>
+
+#include "motion_fifo.h"
+
+/* Set to 1 to compute an acceleration magnitude spectrum for each window. */
+#ifndef MOTION_WINDOW_SPECTRUM
+#define MOTION_WINDOW_SPECTRUM    0
+#endif
+
+/* Samples per FFT frame, must be a power of two. */
+#ifndef MOTION_WINDOW_FFT_LEN
+#define MOTION_WINDOW_FFT_LEN     256
+#endif
+
+/* Number of equal width frequency bands between 0 Hz and half the sample rate. */
+#ifndef MOTION_WINDOW_BANDS
+#define MOTION_WINDOW_BANDS       16
+#endif
+
+typedef struct
+{
+    int32_t plMin[ 3 ];
+    int32_t plMax[ 3 ];
+    int32_t plMean[ 3 ];
+    int32_t plRms[ 3 ];  /* RMS with the mean removed, i.e. of the vibration only */
+    int32_t plPkPk[ 3 ];
+} MotionAxisStats_t;
+
+typedef struct
+{
+    uint32_t ulSamples;
+    MotionAxisStats_t xAccel; /* mG */
+    MotionAxisStats_t xGyro;  /* mDPS */
+#if MOTION_WINDOW_SPECTRUM == 1
+    uint32_t ulFrames;        /* FFT frames averaged, 0 if the window was shorter than one frame */
+    uint32_t pulBandsRms[ MOTION_WINDOW_BANDS ]; /* RMS acceleration of all axes per band, mG */
+#endif
+} MotionWindowResult_t;
+
+typedef struct
+{
+    float fAccelSensitivity;
+    float fGyroSensitivity;
+    uint32_t ulSamples;
+    int64_t pllSum[ 6 ];      /* Accelerometer axes first */
+    int64_t pllSumSq[ 6 ];
+    int16_t psMin[ 6 ];
+    int16_t psMax[ 6 ];
+#if MOTION_WINDOW_SPECTRUM == 1
+    uint32_t ulFrameLen;
+    uint32_t ulFrames;
+    int16_t psFrame[ 3 ][ MOTION_WINDOW_FFT_LEN ];
+    float pfPower[ MOTION_WINDOW_FFT_LEN / 2 ];
+#endif
+} MotionWindow_t;
+
+/*
+ * @brief Prepare a window for use.
+ * @param[in] fAccelSensitivity mG per LSB, see BSP_MOTION_SENSOR_GetSensitivity.
+ * @param[in] fGyroSensitivity mDPS per LSB.
+ */
+void vMotionWindowInit( MotionWindow_t * pxWindow,
+                        float fAccelSensitivity,
+                        float fGyroSensitivity );
+
+/*
+ * @brief Discard everything accumulated so far.
+ */
+void vMotionWindowReset( MotionWindow_t * pxWindow );
+
+void vMotionWindowAdd( MotionWindow_t * pxWindow,
+                       const MotionSample_t * pxSamples,
+                       uint32_t ulCount );
+
+/*
+ * @brief Compute the statistics of the samples added since the last reset.
+ */
+void vMotionWindowGetResult( const MotionWindow_t * pxWindow,
+                             MotionWindowResult_t * pxResult );
+
+#endif /* _MOTION_WINDOW_H */
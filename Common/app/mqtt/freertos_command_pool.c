@@ -32,6 +32,7 @@
 #include "logging_levels.h"
 
 #define LOG_LEVEL    LOG_ERROR
+#define LOG_MODULE    LOG_MODULE_MQTT
 
 #include "logging.h"
 
@@ -42,11 +43,18 @@
 
 /* Kernel includes. */
 #include "FreeRTOS.h"
+#include "task.h"
 #include "semphr.h"
 
+/* LDREX / STREX intrinsics */
+#include "stm32u5xx.h"
+
 /* Header include. */
 #include "freertos_command_pool.h"
 
+/* Marks the end of the free list */
+#define POOL_INDEX_NONE    UINT32_MAX
+
 /**
  * @brief The pool of command structures used to hold information on commands (such
  * as PUBLISH or SUBSCRIBE) between the command being created by an API call and
@@ -54,23 +62,130 @@
  */
 static MQTTAgentCommand_t commandStructurePool[ MQTT_COMMAND_CONTEXTS_POOL_SIZE ];
 
-static QueueHandle_t xCommandPoolQueue = NULL;
+/*
+ * Free commands form a lock-free (Treiber) stack of indexes into commandStructurePool.
+ * Exception entry and return clear the exclusive monitor, so a STREX fails whenever
+ * the task was preempted after its LDREX, which also rules out the ABA problem.
+ */
+static volatile uint32_t ulFreeHead = POOL_INDEX_NONE;
+static volatile uint32_t ulNextFree[ MQTT_COMMAND_CONTEXTS_POOL_SIZE ];
+
+/* Slow path for tasks waiting on an exhausted pool */
+static SemaphoreHandle_t xPoolAvailableSem = NULL;
+static volatile uint32_t ulWaitingTasks = 0;
+
+/* Statistics */
+static volatile uint32_t ulInUse = 0;
+static volatile uint32_t ulHighWater = 0;
+static volatile uint32_t ulExhaustedCount = 0;
+
+/*-----------------------------------------------------------*/
+
+static uint32_t prvAtomicAdd( volatile uint32_t * pulValue,
+                              int32_t lDelta )
+{
+    uint32_t ulNewValue;
+
+    do
+    {
+        ulNewValue = __LDREXW( pulValue ) + ( uint32_t ) lDelta;
+    } while( __STREXW( ulNewValue, pulValue ) != 0 );
+
+    return ulNewValue;
+}
+
+/*-----------------------------------------------------------*/
+
+static void prvAtomicMax( volatile uint32_t * pulValue,
+                          uint32_t ulCandidate )
+{
+    uint32_t ulCurrent;
+
+    do
+    {
+        ulCurrent = __LDREXW( pulValue );
+
+        if( ulCurrent >= ulCandidate )
+        {
+            __CLREX();
+            break;
+        }
+    } while( __STREXW( ulCandidate, pulValue ) != 0 );
+}
+
+/*-----------------------------------------------------------*/
+
+static MQTTAgentCommand_t * prvPoolPop( void )
+{
+    MQTTAgentCommand_t * pxCommand = NULL;
+    uint32_t ulHead;
+
+    do
+    {
+        ulHead = __LDREXW( &ulFreeHead );
+
+        if( ulHead == POOL_INDEX_NONE )
+        {
+            __CLREX();
+            break;
+        }
+    } while( __STREXW( ulNextFree[ ulHead ], &ulFreeHead ) != 0 );
+
+    if( ulHead != POOL_INDEX_NONE )
+    {
+        /* Order the pop before any use of the command */
+        __DMB();
+
+        pxCommand = &( commandStructurePool[ ulHead ] );
+        prvAtomicMax( &ulHighWater, prvAtomicAdd( &ulInUse, 1 ) );
+    }
+
+    return pxCommand;
+}
+
+/*-----------------------------------------------------------*/
+
+static void prvPoolPush( uint32_t ulIdx )
+{
+    uint32_t ulHead;
+
+    /* Finish all writes to the command before it becomes visible to other tasks */
+    __DMB();
+
+    do
+    {
+        ulHead = __LDREXW( &ulFreeHead );
+        ulNextFree[ ulIdx ] = ulHead;
+    } while( __STREXW( ulIdx, &ulFreeHead ) != 0 );
+
+    ( void ) prvAtomicAdd( &ulInUse, -1 );
+
+    /* Order the push against reading the number of waiting tasks */
+    __DMB();
+
+    if( ulWaitingTasks > 0 )
+    {
+        ( void ) xSemaphoreGive( xPoolAvailableSem );
+    }
+}
 
 /*-----------------------------------------------------------*/
 
 void Agent_InitializePool( void )
 {
-    if( xCommandPoolQueue == NULL )
+    if( xPoolAvailableSem == NULL )
     {
-        xCommandPoolQueue = xQueueCreate( MQTT_COMMAND_CONTEXTS_POOL_SIZE, sizeof( MQTTAgentCommand_t * ) );
+        xPoolAvailableSem = xSemaphoreCreateCounting( MQTT_COMMAND_CONTEXTS_POOL_SIZE, 0 );
+        configASSERT( xPoolAvailableSem != NULL );
 
-        /* Populate the queue with pointers to each command structure. */
+        /* Link every command structure into the free list. */
         for( uint32_t ulIdx = 0; ulIdx < MQTT_COMMAND_CONTEXTS_POOL_SIZE; ulIdx++ )
         {
-            MQTTAgentCommand_t * pCommand = &commandStructurePool[ ulIdx ];
-
-            ( void ) xQueueSend( xCommandPoolQueue, &pCommand, 0U );
+            ulNextFree[ ulIdx ] = ( ulIdx + 1 < MQTT_COMMAND_CONTEXTS_POOL_SIZE ) ? ( ulIdx + 1 ) : POOL_INDEX_NONE;
         }
+
+        __DMB();
+        ulFreeHead = 0;
     }
 }
 
@@ -80,16 +195,42 @@ MQTTAgentCommand_t * Agent_GetCommand( uint32_t ulBlockTimeMs )
 {
     MQTTAgentCommand_t * pxCommandStruct = NULL;
 
-    if( xCommandPoolQueue )
+    if( xPoolAvailableSem == NULL )
     {
-        if( !xQueueReceive( xCommandPoolQueue, &pxCommandStruct, pdMS_TO_TICKS( ulBlockTimeMs ) ) )
-        {
-            LogError( ( "No command structure available." ) );
-        }
+        LogError( ( "Command pool not initialized." ) );
     }
     else
     {
-        LogError( ( "Command pool not initialized." ) );
+        pxCommandStruct = prvPoolPop();
+
+        if( pxCommandStruct == NULL )
+        {
+            TickType_t xTicksToWait = pdMS_TO_TICKS( ulBlockTimeMs );
+            TimeOut_t xTimeOut;
+
+            ( void ) prvAtomicAdd( &ulExhaustedCount, 1 );
+
+            vTaskSetTimeOutState( &xTimeOut );
+            ( void ) prvAtomicAdd( &ulWaitingTasks, 1 );
+
+            /* Retry after registering as a waiter so that a concurrent release is not missed */
+            __DMB();
+            pxCommandStruct = prvPoolPop();
+
+            while( ( pxCommandStruct == NULL ) &&
+                   ( xTaskCheckForTimeOut( &xTimeOut, &xTicksToWait ) == pdFALSE ) )
+            {
+                ( void ) xSemaphoreTake( xPoolAvailableSem, xTicksToWait );
+                pxCommandStruct = prvPoolPop();
+            }
+
+            ( void ) prvAtomicAdd( &ulWaitingTasks, -1 );
+        }
+
+        if( pxCommandStruct == NULL )
+        {
+            LogError( ( "No command structure available." ) );
+        }
     }
 
     return pxCommandStruct;
@@ -99,25 +240,53 @@ MQTTAgentCommand_t * Agent_GetCommand( uint32_t ulBlockTimeMs )
 
 bool Agent_ReleaseCommand( MQTTAgentCommand_t * pCommandToRelease )
 {
-    BaseType_t xStructReturned = pdFALSE;
+    bool xStructReturned = false;
 
-    if( !xCommandPoolQueue )
+    if( xPoolAvailableSem == NULL )
     {
         LogError( ( "Command pool not initialized." ) );
     }
     /* See if the structure being returned is actually from the pool. */
     else if( ( pCommandToRelease < commandStructurePool ) ||
-             ( pCommandToRelease > ( commandStructurePool + MQTT_COMMAND_CONTEXTS_POOL_SIZE ) ) )
+             ( pCommandToRelease >= ( commandStructurePool + MQTT_COMMAND_CONTEXTS_POOL_SIZE ) ) )
     {
         LogError( ( "Provided pointer: %p does not belong to the command pool.", pCommandToRelease ) );
     }
     else
     {
-        xStructReturned = xQueueSend( xCommandPoolQueue, &pCommandToRelease, 0U );
+        prvPoolPush( ( uint32_t ) ( pCommandToRelease - commandStructurePool ) );
+        xStructReturned = true;
 
         LogDebug( ( "Returned Command Context %d to pool",
                     ( int ) ( pCommandToRelease - commandStructurePool ) ) );
     }
 
-    return ( bool ) xStructReturned;
+    return xStructReturned;
+}
+
+/*-----------------------------------------------------------*/
+
+int32_t Agent_GetCommandIndex( const MQTTAgentCommand_t * pxCommand )
+{
+    int32_t lIndex = -1;
+
+    if( ( pxCommand >= commandStructurePool ) &&
+        ( pxCommand < ( commandStructurePool + MQTT_COMMAND_CONTEXTS_POOL_SIZE ) ) )
+    {
+        lIndex = ( int32_t ) ( pxCommand - commandStructurePool );
+    }
+
+    return lIndex;
+}
+
+/*-----------------------------------------------------------*/
+
+void Agent_GetPoolStats( AgentCommandPoolStats_t * pxStats )
+{
+    configASSERT( pxStats != NULL );
+
+    pxStats->ulSize = MQTT_COMMAND_CONTEXTS_POOL_SIZE;
+    pxStats->ulInUse = ulInUse;
+    pxStats->ulHighWater = ulHighWater;
+    pxStats->ulExhaustedCount = ulExhaustedCount;
 }
@@ -80,4 +80,32 @@ MQTTAgentCommand_t * Agent_GetCommand( uint32_t blockTimeMs );
  */
 bool Agent_ReleaseCommand( MQTTAgentCommand_t * pCommandToRelease );
 
+/**
+ * @brief Get the position of a command structure within the pool.
+ *
+ * @param[in] pxCommand A command structure obtained by calling Agent_GetCommand().
+ *
+ * @return Index in the range [0, MQTT_COMMAND_CONTEXTS_POOL_SIZE), or -1 if the
+ * structure does not belong to the pool.
+ */
+int32_t Agent_GetCommandIndex( const MQTTAgentCommand_t * pxCommand );
+
+/**
+ * @brief Usage statistics of the command pool.
+ */
+typedef struct AgentCommandPoolStats
+{
+    uint32_t ulSize;           /**< Number of command structures in the pool. */
+    uint32_t ulInUse;          /**< Number of command structures currently obtained. */
+    uint32_t ulHighWater;      /**< Largest value of ulInUse so far. */
+    uint32_t ulExhaustedCount; /**< Number of Agent_GetCommand calls that found the pool empty. */
+} AgentCommandPoolStats_t;
+
+/**
+ * @brief Get a snapshot of the command pool statistics.
+ *
+ * @param[out] pxStats Statistics to fill in.
+ */
+void Agent_GetPoolStats( AgentCommandPoolStats_t * pxStats );
+
 #endif /* FREERTOS_COMMAND_POOL_H */
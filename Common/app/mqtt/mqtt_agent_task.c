@@ -28,6 +28,7 @@
 
 #include "logging_levels.h"
 #define LOG_LEVEL    LOG_INFO
+#define LOG_MODULE    LOG_MODULE_MQTT
 #include "logging.h"
 
 /* Standard includes. */
@@ -55,15 +56,27 @@
 
 /* MQTT Agent ports. */
 #include "freertos_command_pool.h"
+#include "mqtt_publish_async.h"
 
-/* Exponential backoff retry include. */
-#include "backoff_algorithm.h"
+/* Reconnect scheduling include. */
+#include "mqtt_reconnect.h"
 
 /* Subscription manager header include. */
 #include "subscription_manager.h"
+#include "topic_trie.h"
 
 #include "mbedtls_transport.h"
 #include "sys_evt.h"
+#include "dma_copy.h"
+#include "net/mxchip/mx_netconn.h"
+#include "heap_classes.h"
+#include "profiler.h"
+#include "boot_times.h"
+#include "static_alloc.h"
+#include "power_stats.h"
+
+/* DWT cycle counter for agent statistics */
+#include "stm32u5xx.h"
 
 /*-----------------------------------------------------------*/
 
@@ -73,27 +86,6 @@
  */
 #define CONNACK_RECV_TIMEOUT_MS     ( 2000U )
 
-/**
- * @brief The minimum back-off delay to use for network operation retry
- * attempts.
- */
-#define RETRY_BACKOFF_BASE          ( 10U )
-
-/**
- * @brief The maximum back-off delay for retrying failed operation
- *  with server.
- */
-#define RETRY_MAX_BACKOFF_DELAY     ( 5U * 60U )
-
-/**
- * @brief Multiplier to apply to the bacoff delay to convert arbitrary units to milliseconds.
- */
-#define RETRY_BACKOFF_MULTIPLIER    ( 100U )
-
-static_assert( RETRY_BACKOFF_BASE < UINT16_MAX );
-static_assert( RETRY_MAX_BACKOFF_DELAY < UINT16_MAX );
-static_assert( ( ( uint64_t ) RETRY_BACKOFF_MULTIPLIER * ( uint64_t ) RETRY_MAX_BACKOFF_DELAY ) < UINT32_MAX );
-
 /**
  * @brief The maximum time interval in seconds which is allowed to elapse
  *  between two Control Packets.
@@ -105,10 +97,29 @@ static_assert( ( ( uint64_t ) RETRY_BACKOFF_MULTIPLIER * ( uint64_t ) RETRY_MAX_
  */
 #define KEEP_ALIVE_INTERVAL_S                 ( 60U )
 
+/*
+ * The wifi module sleeps between the DTIM beacons of the access point while power
+ * save is on. A keep-alive that is a whole number of DTIM intervals keeps an idle
+ * connection's PINGREQ at the same offset from a beacon wake-up, instead of drifting
+ * through the interval and waking the radio separately. The DTIM interval is the
+ * beacon interval of the access point times its DTIM period: 102.4 ms and 1 by default.
+ */
+#ifndef MQTT_AGENT_BEACON_INTERVAL_US
+#define MQTT_AGENT_BEACON_INTERVAL_US         ( 102400U )
+#endif
+
+#ifndef MQTT_AGENT_DTIM_PERIOD
+#define MQTT_AGENT_DTIM_PERIOD                ( 1U )
+#endif
+
+/* Longest keep-alive accepted by AWS IoT Core */
+#define KEEP_ALIVE_MAX_S                      ( 1200U )
+
 #define MQTT_AGENT_NOTIFY_IDX                 ( 3U )
 
 #define MQTT_AGENT_NOTIFY_FLAG_SOCKET_RECV    ( 1U << 31 )
 #define MQTT_AGENT_NOTIFY_FLAG_M_QUEUE        ( 1U << 30 )
+#define MQTT_AGENT_NOTIFY_FLAG_LINK_LOST      ( 1U << 29 )
 
 /**
  * @brief Socket send and receive timeouts to use.
@@ -117,12 +128,62 @@ static_assert( ( ( uint64_t ) RETRY_BACKOFF_MULTIPLIER * ( uint64_t ) RETRY_MAX_
 
 #define AGENT_READY_EVT_MASK                  ( 1U )
 
+/**
+ * @brief Set to 1 to coalesce the packets sent by consecutive agent commands into
+ * a single transport write, delayed by at most MQTT_AGENT_BATCH_WINDOW_MS.
+ */
+#ifndef MQTT_AGENT_PUBLISH_BATCHING
+#define MQTT_AGENT_PUBLISH_BATCHING           0
+#endif
+
+#ifndef MQTT_AGENT_BATCH_WINDOW_MS
+#define MQTT_AGENT_BATCH_WINDOW_MS            ( 20U )
+#endif
+
+/* Packets larger than the batch buffer bypass it. */
+#ifndef MQTT_AGENT_BATCH_BUFFER_LEN
+#define MQTT_AGENT_BATCH_BUFFER_LEN           ( 1024U )
+#endif
+
+/**
+ * @brief Set to 1 to receive into a MQTT_AGENT_NETWORK_BUFFER_MIN_SIZE buffer and only
+ * allocate a buffer of up to MQTT_AGENT_NETWORK_BUFFER_SIZE while larger packets arrive.
+ */
+#ifndef MQTT_AGENT_DYNAMIC_BUFFER
+#define MQTT_AGENT_DYNAMIC_BUFFER             0
+#endif
+
+#ifndef MQTT_AGENT_NETWORK_BUFFER_MIN_SIZE
+#define MQTT_AGENT_NETWORK_BUFFER_MIN_SIZE    ( 1536U )
+#endif
+
+/* A grown buffer is freed once no large packet has arrived for this long. */
+#ifndef MQTT_AGENT_BUFFER_SHRINK_DELAY_MS
+#define MQTT_AGENT_BUFFER_SHRINK_DELAY_MS     ( 5000U )
+#endif
+
+#if MQTT_AGENT_DYNAMIC_BUFFER == 1
+#define MQTT_AGENT_INITIAL_BUFFER_SIZE        MQTT_AGENT_NETWORK_BUFFER_MIN_SIZE
+#else
+#define MQTT_AGENT_INITIAL_BUFFER_SIZE        MQTT_AGENT_NETWORK_BUFFER_SIZE
+#endif
+
+/* Longest thing name and MQTT endpoint host name accepted, including the null terminator */
+#ifndef MQTT_AGENT_THING_NAME_MAX_LEN
+#define MQTT_AGENT_THING_NAME_MAX_LEN         ( 129U )
+#endif
+
+#ifndef MQTT_AGENT_ENDPOINT_MAX_LEN
+#define MQTT_AGENT_ENDPOINT_MAX_LEN           ( 254U )
+#endif
+
 #define MUTEX_IS_OWNED( xHandle )    ( xTaskGetCurrentTaskHandle() == xSemaphoreGetMutexHolder( xHandle ) )
 
 struct MQTTAgentMessageContext
 {
     QueueHandle_t xQueue;
     TaskHandle_t xAgentTaskHandle;
+    NetworkContext_t * pxNetworkContext;
 };
 
 typedef struct MQTTAgentSubscriptionManagerCtx
@@ -136,6 +197,10 @@ typedef struct MQTTAgentSubscriptionManagerCtx
     size_t uxCallbackCount;
     MQTTAgentSubscribeArgs_t xInitialSubscribeArgs;
 
+    /* Index of pxCallbacks by topic filter, rebuilt whenever pxCallbacks changes */
+    TopicTrieNode_t * pxTopicTrie;
+    BaseType_t xTopicTrieValid; /* pdFALSE if the last rebuild ran out of memory */
+
     SemaphoreHandle_t xMutex;
 } SubMgrCtx_t;
 
@@ -153,8 +218,8 @@ typedef struct MQTTAgentTaskCtx
     SubMgrCtx_t xSubMgrCtx;
 
     MQTTConnectInfo_t xConnectInfo;
-    char * pcMqttEndpoint;
-    size_t uxMqttEndpointLen;
+    char pcThingName[ MQTT_AGENT_THING_NAME_MAX_LEN ];
+    char pcMqttEndpoint[ MQTT_AGENT_ENDPOINT_MAX_LEN ];
     uint32_t ulMqttPort;
 } MQTTAgentTaskCtx_t;
 
@@ -163,6 +228,21 @@ static const char * pcAlpnProtocols[] = { AWS_IOT_MQTT_ALPN, NULL };
 
 static MQTTAgentHandle_t xDefaultInstanceHandle = NULL;
 
+typedef struct
+{
+    MqttAgentStateCallback_t pxCallback;
+    void * pvCtx;
+} StateCallbackEntry_t;
+
+static StateCallbackEntry_t xStateCallbacks[ MQTT_AGENT_MAX_STATE_CALLBACKS ] = { 0 };
+
+static volatile MqttAgentState_t xAgentState = MQTT_AGENT_STATE_DISCONNECTED;
+
+/* Set while the subscriptions of a persistent session are being restored */
+static volatile BaseType_t xResubscribePending = pdFALSE;
+
+static void prvSetAgentState( MqttAgentState_t xState );
+
 /*-----------------------------------------------------------*/
 
 /**
@@ -202,6 +282,8 @@ static MQTTStatus_t prvHandleResubscribe( MQTTAgentContext_t * pxMqttAgentCtx,
  */
 static uint32_t prvGetTimeMs( void );
 
+static uint16_t prvKeepAliveSeconds( void );
+
 /*-----------------------------------------------------------*/
 
 /**
@@ -281,10 +363,8 @@ void vSleepUntilMQTTAgentReady( void )
         }
     }
 
-    while( xGetMqttAgentHandle() == NULL )
-    {
-        vTaskDelay( 10 );
-    }
+    /* EVT_MASK_MQTT_INIT is only set once the handle is valid */
+    configASSERT( xGetMqttAgentHandle() != NULL );
 }
 
 /*-----------------------------------------------------------*/
@@ -293,18 +373,8 @@ void vSleepUntilMQTTAgentConnected( void )
 {
     configASSERT( xSystemEvents != NULL );
 
-    while( 1 )
+    while( xMqttAgentWaitForState( MQTT_AGENT_STATE_CONNECTED, portMAX_DELAY ) != pdTRUE )
     {
-        EventBits_t uxEvents = xEventGroupWaitBits( xSystemEvents,
-                                                    EVT_MASK_MQTT_CONNECTED,
-                                                    pdFALSE,
-                                                    pdTRUE,
-                                                    portMAX_DELAY );
-
-        if( uxEvents & EVT_MASK_MQTT_CONNECTED )
-        {
-            break;
-        }
     }
 }
 
@@ -323,6 +393,162 @@ bool xIsMqttAgentConnected( void )
 
 /*-----------------------------------------------------------*/
 
+MqttAgentState_t xMqttAgentGetState( void )
+{
+    return xAgentState;
+}
+
+/*-----------------------------------------------------------*/
+
+BaseType_t xMqttAgentWaitForState( MqttAgentState_t xState,
+                                   TickType_t xTicksToWait )
+{
+    EventBits_t uxMask = EVT_MASK_MQTT_DISCONNECTED;
+    EventBits_t uxEvents;
+
+    configASSERT( xSystemEvents != NULL );
+
+    if( xState == MQTT_AGENT_STATE_CONNECTED )
+    {
+        uxMask = EVT_MASK_MQTT_CONNECTED;
+    }
+    else if( xState == MQTT_AGENT_STATE_RESUBSCRIBED )
+    {
+        uxMask = EVT_MASK_MQTT_RESUBSCRIBED;
+    }
+
+    uxEvents = xEventGroupWaitBits( xSystemEvents,
+                                    uxMask,
+                                    pdFALSE,
+                                    pdTRUE,
+                                    xTicksToWait );
+
+    return( ( uxEvents & uxMask ) == uxMask ) ? pdTRUE : pdFALSE;
+}
+
+/*-----------------------------------------------------------*/
+
+BaseType_t xMqttAgentRegisterStateCallback( MqttAgentStateCallback_t pxCallback,
+                                            void * pvCtx )
+{
+    BaseType_t xResult = pdFALSE;
+
+    configASSERT( pxCallback != NULL );
+
+    taskENTER_CRITICAL();
+
+    for( uint32_t ulIdx = 0; ulIdx < MQTT_AGENT_MAX_STATE_CALLBACKS; ulIdx++ )
+    {
+        if( xStateCallbacks[ ulIdx ].pxCallback == NULL )
+        {
+            xStateCallbacks[ ulIdx ].pxCallback = pxCallback;
+            xStateCallbacks[ ulIdx ].pvCtx = pvCtx;
+            xResult = pdTRUE;
+            break;
+        }
+    }
+
+    taskEXIT_CRITICAL();
+
+    if( xResult != pdTRUE )
+    {
+        LogError( "No room for another agent state callback." );
+    }
+
+    return xResult;
+}
+
+/*-----------------------------------------------------------*/
+
+void vMqttAgentUnregisterStateCallback( MqttAgentStateCallback_t pxCallback,
+                                        void * pvCtx )
+{
+    taskENTER_CRITICAL();
+
+    for( uint32_t ulIdx = 0; ulIdx < MQTT_AGENT_MAX_STATE_CALLBACKS; ulIdx++ )
+    {
+        if( ( xStateCallbacks[ ulIdx ].pxCallback == pxCallback ) &&
+            ( xStateCallbacks[ ulIdx ].pvCtx == pvCtx ) )
+        {
+            xStateCallbacks[ ulIdx ].pxCallback = NULL;
+            xStateCallbacks[ ulIdx ].pvCtx = NULL;
+        }
+    }
+
+    taskEXIT_CRITICAL();
+}
+
+/*-----------------------------------------------------------*/
+
+/* Only called from the agent task, which makes it the only writer of xAgentState */
+static void prvSetAgentState( MqttAgentState_t xState )
+{
+    if( xState != xAgentState )
+    {
+        xAgentState = xState;
+
+        /* Set the new bits before clearing the old ones so that no waiter sees neither */
+        if( xState == MQTT_AGENT_STATE_DISCONNECTED )
+        {
+            ( void ) xEventGroupSetBits( xSystemEvents, EVT_MASK_MQTT_DISCONNECTED );
+            ( void ) xEventGroupClearBits( xSystemEvents, EVT_MASK_MQTT_CONNECTED | EVT_MASK_MQTT_RESUBSCRIBED );
+        }
+        else if( xState == MQTT_AGENT_STATE_CONNECTED )
+        {
+            ( void ) xEventGroupSetBits( xSystemEvents, EVT_MASK_MQTT_CONNECTED );
+            ( void ) xEventGroupClearBits( xSystemEvents, EVT_MASK_MQTT_DISCONNECTED | EVT_MASK_MQTT_RESUBSCRIBED );
+        }
+        else
+        {
+            ( void ) xEventGroupSetBits( xSystemEvents, EVT_MASK_MQTT_CONNECTED | EVT_MASK_MQTT_RESUBSCRIBED );
+            ( void ) xEventGroupClearBits( xSystemEvents, EVT_MASK_MQTT_DISCONNECTED );
+        }
+
+        LogDebug( "Agent state: %d.", xState );
+
+        for( uint32_t ulIdx = 0; ulIdx < MQTT_AGENT_MAX_STATE_CALLBACKS; ulIdx++ )
+        {
+            MqttAgentStateCallback_t pxCallback;
+            void * pvCtx;
+
+            taskENTER_CRITICAL();
+            pxCallback = xStateCallbacks[ ulIdx ].pxCallback;
+            pvCtx = xStateCallbacks[ ulIdx ].pvCtx;
+            taskEXIT_CRITICAL();
+
+            if( pxCallback != NULL )
+            {
+                pxCallback( pvCtx, xState );
+            }
+        }
+    }
+}
+
+/*-----------------------------------------------------------*/
+
+/*
+ * Smallest keep-alive of at least KEEP_ALIVE_INTERVAL_S which is a whole number of DTIM intervals,
+ * e.g. 64 s or 625 beacons with the defaults. Falls back to KEEP_ALIVE_INTERVAL_S if there is none.
+ */
+static uint16_t prvKeepAliveSeconds( void )
+{
+    const uint32_t ulDtimUs = MQTT_AGENT_BEACON_INTERVAL_US * MQTT_AGENT_DTIM_PERIOD;
+    uint16_t usKeepAlive = KEEP_ALIVE_INTERVAL_S;
+
+    for( uint32_t ulSeconds = KEEP_ALIVE_INTERVAL_S; ulSeconds <= KEEP_ALIVE_MAX_S; ulSeconds++ )
+    {
+        if( ( ( ulSeconds * 1000000UL ) % ulDtimUs ) == 0 )
+        {
+            usKeepAlive = ( uint16_t ) ulSeconds;
+            break;
+        }
+    }
+
+    return usKeepAlive;
+}
+
+/*-----------------------------------------------------------*/
+
 static inline void prvUpdateCallbackRefs( SubCallbackElement_t * pxCallbacksList,
                                           MQTTSubscribeInfo_t * pxSubList,
                                           size_t uxOldIdx,
@@ -442,6 +668,7 @@ static inline void prvCompressCallbackList( SubCallbackElement_t * pxCallbackLis
                     pxCallbackList[ uxLastOccupiedIndex ].pvIncomingPublishCallbackContext = NULL;
                     pxCallbackList[ uxLastOccupiedIndex ].xTaskHandle = NULL;
                     pxCallbackList[ uxLastOccupiedIndex ].pxSubInfo = NULL;
+                    pxCallbackList[ uxLastOccupiedIndex ].xDeliveryQueue = NULL;
 
                     /* Increment count of active callbacks */
                     uxCallbackCount++;
@@ -474,6 +701,8 @@ static void prvSocketRecvReadyCallback( void * pvCtx )
 
     if( pxMsgCtx )
     {
+        TRACE_MARK( TRACE_MARK_MQTT_RECV, 0 );
+
         ( void ) xTaskNotifyIndexed( pxMsgCtx->xAgentTaskHandle,
                                      MQTT_AGENT_NOTIFY_IDX,
                                      MQTT_AGENT_NOTIFY_FLAG_SOCKET_RECV,
@@ -483,411 +712,1378 @@ static void prvSocketRecvReadyCallback( void * pvCtx )
 
 /*-----------------------------------------------------------*/
 
-static bool prvAgentMessageSend( MQTTAgentMessageContext_t * pxMsgCtx,
-                                 MQTTAgentCommand_t * const * pxCommandToSend,
-                                 uint32_t blockTimeMs )
+/* Called by the network task when the connection to the broker cannot survive a network change */
+static void prvLinkLostCallback( void * pvCtx )
 {
-    BaseType_t xQueueStatus = pdFAIL;
+    MQTTAgentMessageContext_t * pxMsgCtx = ( MQTTAgentMessageContext_t * ) pvCtx;
 
-    if( pxMsgCtx && pxCommandToSend )
+    if( pxMsgCtx )
     {
-        xQueueStatus = xQueueSendToBack( pxMsgCtx->xQueue, pxCommandToSend, pdMS_TO_TICKS( blockTimeMs ) );
-
-        /* Notify the agent that a message is waiting */
-        if( pxMsgCtx->xAgentTaskHandle )
-        {
-            ( void ) xTaskNotifyIndexed( pxMsgCtx->xAgentTaskHandle,
-                                         MQTT_AGENT_NOTIFY_IDX,
-                                         MQTT_AGENT_NOTIFY_FLAG_M_QUEUE,
-                                         eSetBits );
-        }
+        ( void ) xTaskNotifyIndexed( pxMsgCtx->xAgentTaskHandle,
+                                     MQTT_AGENT_NOTIFY_IDX,
+                                     MQTT_AGENT_NOTIFY_FLAG_LINK_LOST,
+                                     eSetBits );
     }
-
-    return ( bool ) xQueueStatus;
 }
 
 /*-----------------------------------------------------------*/
 
-static bool prvAgentMessageReceive( MQTTAgentMessageContext_t * pxMsgCtx,
-                                    MQTTAgentCommand_t ** ppxReceivedCommand,
-                                    uint32_t blockTimeMs )
+#if MQTT_AGENT_DYNAMIC_BUFFER == 1
+
+/*
+ * coreMQTT receives each packet into the start of its network buffer, reading the
+ * fixed header first. While the command loop runs, prvDynBufRecv reads that header on
+ * its own and never returns bytes beyond the end of the current packet, so the next
+ * packet always starts at the beginning of the buffer. When the packet does not fit, it reports no data and asks the agent to
+ * swap in a larger buffer, which is only safe between process loop iterations.
+ * The header is handed over once the packet fits (or no buffer could be allocated,
+ * in which case coreMQTT discards the packet as it would with a fixed buffer).
+ */
+typedef struct DynBuffer
 {
-    BaseType_t xQueueStatus = pdFAIL;
-    uint32_t ulNotifyValue = 0;
+    MQTTContext_t * pxMqttContext;
+    TaskHandle_t xAgentTask;
+    uint8_t * pucSmallBuffer;    /* MQTT_AGENT_NETWORK_BUFFER_MIN_SIZE, owned by the agent task */
+    uint8_t * pucLargeBuffer;    /* Allocated on demand, NULL when not in use */
+    size_t uxLargeBufferLen;
+    uint32_t ulLastLargeMs;      /* When a packet last needed the large buffer */
+    uint8_t pucHeader[ 5 ];      /* Fixed header of the next packet */
+    size_t uxHeaderLen;
+    size_t uxRemaining;          /* Bytes of the current packet not yet passed to coreMQTT */
+    size_t uxGrowLen;            /* Buffer length requested by prvDynBufRecv, or 0 */
+    BaseType_t xGrowFailed;
+    BaseType_t xActive;
+} DynBuffer_t;
+
+static DynBuffer_t xDynBuf = { 0 };
 
-    if( pxMsgCtx && ppxReceivedCommand )
+/*-----------------------------------------------------------*/
+
+static void prvDynBufSet( uint8_t * pucBuffer,
+                          size_t uxBufferLen )
+{
+    xDynBuf.pxMqttContext->networkBuffer.pBuffer = pucBuffer;
+    xDynBuf.pxMqttContext->networkBuffer.size = uxBufferLen;
+}
+
+/*-----------------------------------------------------------*/
+
+static void prvDynBufShrink( void )
+{
+    if( xDynBuf.pucLargeBuffer != NULL )
     {
-        if( xTaskNotifyWaitIndexed( MQTT_AGENT_NOTIFY_IDX,
-                                    0x0,
-                                    0xFFFFFFFF,
-                                    &ulNotifyValue,
-                                    pdMS_TO_TICKS( blockTimeMs ) ) )
-        {
-            /* Prioritize processing incoming network packets over local requests */
-            if( ulNotifyValue & MQTT_AGENT_NOTIFY_FLAG_SOCKET_RECV )
-            {
-                *ppxReceivedCommand = NULL;
-            }
-            else
-            {
-                xQueueStatus = xQueueReceive( pxMsgCtx->xQueue, ppxReceivedCommand, 0 );
-            }
-        }
+        prvDynBufSet( xDynBuf.pucSmallBuffer, MQTT_AGENT_NETWORK_BUFFER_MIN_SIZE );
+
+        vPortFree( xDynBuf.pucLargeBuffer );
+        xDynBuf.pucLargeBuffer = NULL;
+        xDynBuf.uxLargeBufferLen = 0;
+
+        LogDebug( "Network buffer shrunk to %lu bytes.", MQTT_AGENT_NETWORK_BUFFER_MIN_SIZE );
     }
+}
 
-    return ( bool ) xQueueStatus;
+/*-----------------------------------------------------------*/
+
+static void prvDynBufInit( MQTTContext_t * pxMqttContext,
+                           uint8_t * pucSmallBuffer )
+{
+    xDynBuf.pxMqttContext = pxMqttContext;
+    xDynBuf.pucSmallBuffer = pucSmallBuffer;
+    xDynBuf.pucLargeBuffer = NULL;
+    xDynBuf.uxLargeBufferLen = 0;
+    xDynBuf.xActive = pdFALSE;
 }
 
+/*-----------------------------------------------------------*/
+
+static void prvDynBufEnable( void )
+{
+    configASSERT( xDynBuf.pxMqttContext != NULL );
+
+    xDynBuf.xAgentTask = xTaskGetCurrentTaskHandle();
+    xDynBuf.uxHeaderLen = 0;
+    xDynBuf.uxRemaining = 0;
+    xDynBuf.uxGrowLen = 0;
+    xDynBuf.xGrowFailed = pdFALSE;
+    xDynBuf.xActive = pdTRUE;
+}
 
 /*-----------------------------------------------------------*/
 
-static void prvResubscribeCommandCallback( MQTTAgentCommandContext_t * pxCommandContext,
-                                           MQTTAgentReturnInfo_t * pxReturnInfo )
+static void prvDynBufDisable( void )
 {
-    SubMgrCtx_t * pxCtx = ( SubMgrCtx_t * ) pxCommandContext;
+    xDynBuf.xActive = pdFALSE;
+    xDynBuf.uxHeaderLen = 0;
+    xDynBuf.uxRemaining = 0;
+    xDynBuf.uxGrowLen = 0;
 
-    configASSERT( pxCommandContext != NULL );
-    configASSERT( pxReturnInfo != NULL );
-    configASSERT( MUTEX_IS_OWNED( pxCtx->xMutex ) );
+    prvDynBufShrink();
+}
 
-    /* Ignore pxReturnInfo->returnCode */
+/*-----------------------------------------------------------*/
 
-    for( uint32_t ulSubIdx = 0; ulSubIdx < pxCtx->uxSubscriptionCount; ulSubIdx++ )
+/* Called by the agent between process loop iterations */
+static void prvDynBufPoll( void )
+{
+    /* A partially received packet pins the current buffer */
+    if( ( xDynBuf.xActive == pdTRUE ) &&
+        ( xDynBuf.pxMqttContext->index == 0 ) )
     {
-        /* Update cached SubAck status */
-        pxCtx->pxSubAckStatus[ ulSubIdx ] = pxReturnInfo->pSubackCodes[ ulSubIdx ];
-
-        if( pxReturnInfo->pSubackCodes[ ulSubIdx ] == MQTTSubAckFailure )
+        if( xDynBuf.uxGrowLen > 0 )
         {
-            MQTTSubscribeInfo_t * const pxSubInfo = &( pxCtx->pxSubscriptions[ ulSubIdx ] );
+            /* Round up to limit reallocations for packets of similar size */
+            size_t uxLen = ( xDynBuf.uxGrowLen + 511U ) & ~( ( size_t ) 511U );
+            uint8_t * pucBuffer;
 
-            LogError( "Failed to re-subscribe to topic filter \"%.*s\".",
-                      pxSubInfo->topicFilterLength,
-                      pxSubInfo->pTopicFilter );
+            if( uxLen > MQTT_AGENT_NETWORK_BUFFER_SIZE )
+            {
+                uxLen = MQTT_AGENT_NETWORK_BUFFER_SIZE;
+            }
 
-            for( uint32_t ulCbIdx = 0; ulCbIdx < MQTT_AGENT_MAX_CALLBACKS; ulCbIdx++ )
+            /* Release the previous large buffer first to leave room on the heap */
+            prvDynBufShrink();
+
+            pucBuffer = ( uint8_t * ) pvPortMalloc( uxLen );
+
+            if( pucBuffer == NULL )
             {
-                SubCallbackElement_t * const pxCbInfo = &( pxCtx->pxCallbacks[ ulCbIdx ] );
+                LogWarn( "Failed to allocate a %lu byte network buffer, packet will be dropped.", uxLen );
+                xDynBuf.xGrowFailed = pdTRUE;
+            }
+            else
+            {
+                xDynBuf.pucLargeBuffer = pucBuffer;
+                xDynBuf.uxLargeBufferLen = uxLen;
+                prvDynBufSet( pucBuffer, uxLen );
 
-                if( ( pxCbInfo->pxSubInfo == pxSubInfo ) &&
-                    ( pxCbInfo->xTaskHandle != NULL ) )
-                {
-                    LogWarn( "Detected orphaned callback for task: %s due to failed re-subscribe operation.",
-                             pcTaskGetName( pxCbInfo->xTaskHandle ) );
-                }
+                LogDebug( "Network buffer grown to %lu bytes.", uxLen );
             }
+
+            xDynBuf.ulLastLargeMs = prvGetTimeMs();
+            xDynBuf.uxGrowLen = 0;
+        }
+        else if( ( xDynBuf.pucLargeBuffer != NULL ) &&
+                 ( xDynBuf.uxHeaderLen == 0 ) &&
+                 ( xDynBuf.uxRemaining == 0 ) &&
+                 ( ( prvGetTimeMs() - xDynBuf.ulLastLargeMs ) > MQTT_AGENT_BUFFER_SHRINK_DELAY_MS ) )
+        {
+            prvDynBufShrink();
         }
     }
-
-    ( void ) xUnlockSubCtx( pxCtx );
 }
 
 /*-----------------------------------------------------------*/
 
-static MQTTStatus_t prvHandleResubscribe( MQTTAgentContext_t * pxMqttAgentCtx,
-                                          SubMgrCtx_t * pxCtx )
+static int32_t prvDynBufRecv( NetworkContext_t * pxNetworkContext,
+                              void * pvBuffer,
+                              size_t uxBytesToRecv )
 {
-    MQTTStatus_t xStatus = MQTTSuccess;
+    int32_t lResult = 0;
+    BaseType_t xHeaderComplete = pdFALSE;
 
-    configASSERT( pxCtx );
-    configASSERT( pxCtx->xMutex );
-    configASSERT( MUTEX_IS_OWNED( pxCtx->xMutex ) );
+    if( xDynBuf.xActive == pdFALSE )
+    {
+        lResult = mbedtls_transport_recv( pxNetworkContext, pvBuffer, uxBytesToRecv );
+    }
+    else if( xDynBuf.uxRemaining > 0 )
+    {
+        /* Rest of the current packet, including packets being discarded by coreMQTT */
+        if( uxBytesToRecv > xDynBuf.uxRemaining )
+        {
+            uxBytesToRecv = xDynBuf.uxRemaining;
+        }
 
-    prvCompressSubscriptionList( pxCtx->pxSubscriptions,
-                                 pxCtx->pxCallbacks,
-                                 &( pxCtx->uxSubscriptionCount ) );
+        lResult = mbedtls_transport_recv( pxNetworkContext, pvBuffer, uxBytesToRecv );
 
-    if( ( xStatus == MQTTSuccess ) && ( pxCtx->uxSubscriptionCount > 0U ) )
+        if( lResult > 0 )
+        {
+            xDynBuf.uxRemaining -= ( size_t ) lResult;
+        }
+    }
+    else if( xDynBuf.uxGrowLen == 0 )
     {
-        MQTTAgentCommandInfo_t xCommandParams =
+        /* Read the packet type and the variable length remaining length field one byte at a time */
+        while( ( xHeaderComplete == pdFALSE ) && ( lResult >= 0 ) )
         {
-            .blockTimeMs                 = 0U,
-            .cmdCompleteCallback         = prvResubscribeCommandCallback,
-            .pCmdCompleteCallbackContext = ( void * ) pxCtx,
-        };
+            if( ( xDynBuf.uxHeaderLen >= sizeof( xDynBuf.pucHeader ) ) ||
+                ( ( xDynBuf.uxHeaderLen >= 2 ) &&
+                  ( ( xDynBuf.pucHeader[ xDynBuf.uxHeaderLen - 1 ] & 0x80U ) == 0 ) ) )
+            {
+                /* Malformed lengths are left for coreMQTT to reject */
+                xHeaderComplete = pdTRUE;
+            }
+            else
+            {
+                lResult = mbedtls_transport_recv( pxNetworkContext,
+                                                  &( xDynBuf.pucHeader[ xDynBuf.uxHeaderLen ] ),
+                                                  1 );
 
-        pxCtx->xInitialSubscribeArgs.pSubscribeInfo = pxCtx->pxSubscriptions;
-        pxCtx->xInitialSubscribeArgs.numSubscriptions = pxCtx->uxSubscriptionCount;
+                if( lResult == 1 )
+                {
+                    xDynBuf.uxHeaderLen++;
+                }
+                else if( lResult == 0 )
+                {
+                    /* The rest of the header has not arrived yet */
+                    break;
+                }
+            }
+        }
 
-        /* Enqueue the subscribe command */
-        xStatus = MQTTAgent_Subscribe( pxMqttAgentCtx,
-                                       &( pxCtx->xInitialSubscribeArgs ),
-                                       &xCommandParams );
+        if( xHeaderComplete == pdTRUE )
+        {
+            size_t uxPacketLen = xDynBuf.uxHeaderLen;
 
-        /* prvResubscribeCommandCallback handles giving the mutex */
+            for( size_t i = 1; i < xDynBuf.uxHeaderLen; i++ )
+            {
+                uxPacketLen += ( size_t ) ( xDynBuf.pucHeader[ i ] & 0x7FU ) << ( 7 * ( i - 1 ) );
+            }
 
-        if( xStatus != MQTTSuccess )
-        {
-            LogError( "Failed to enqueue the MQTT subscribe command. xStatus=%s.",
-                      MQTT_Status_strerror( xStatus ) );
+            if( uxPacketLen > MQTT_AGENT_NETWORK_BUFFER_MIN_SIZE )
+            {
+                xDynBuf.ulLastLargeMs = prvGetTimeMs();
+            }
+
+            if( ( uxPacketLen > xDynBuf.pxMqttContext->networkBuffer.size ) &&
+                ( uxPacketLen <= MQTT_AGENT_NETWORK_BUFFER_SIZE ) &&
+                ( xDynBuf.xGrowFailed == pdFALSE ) )
+            {
+                xDynBuf.uxGrowLen = uxPacketLen;
+
+                /* The remainder may already be buffered by mbedtls, so no socket event would follow */
+                ( void ) xTaskNotifyIndexed( xDynBuf.xAgentTask,
+                                             MQTT_AGENT_NOTIFY_IDX,
+                                             MQTT_AGENT_NOTIFY_FLAG_SOCKET_RECV,
+                                             eSetBits );
+                lResult = 0;
+            }
+            else
+            {
+                configASSERT( uxBytesToRecv >= xDynBuf.uxHeaderLen );
+
+                ( void ) memcpy( pvBuffer, xDynBuf.pucHeader, xDynBuf.uxHeaderLen );
+                lResult = ( int32_t ) xDynBuf.uxHeaderLen;
+
+                xDynBuf.uxRemaining = uxPacketLen - xDynBuf.uxHeaderLen;
+                xDynBuf.uxHeaderLen = 0;
+                xDynBuf.xGrowFailed = pdFALSE;
+            }
         }
     }
     else
     {
-        ( void ) xUnlockSubCtx( pxCtx );
-
-        /* Mark the resubscribe as success if there is nothing to be subscribed to. */
-        xStatus = MQTTSuccess;
+        /* Waiting for prvDynBufPoll to swap the buffer */
     }
 
-    return xStatus;
+    return lResult;
 }
 
 /*-----------------------------------------------------------*/
 
-static inline bool prvMatchTopic( MQTTSubscribeInfo_t * pxSubscribeInfo,
-                                  const char * pcTopicName,
-                                  const uint16_t usTopicLen )
+#endif /* MQTT_AGENT_DYNAMIC_BUFFER == 1 */
+
+#if MQTT_AGENT_STATS_ENABLED == 1
+
+/*
+ * MQTTAgentCommand_t belongs to the agent library, so per command timestamps are kept
+ * in arrays indexed by the position of the command in the command pool.
+ */
+typedef struct AgentCommandStamp
 {
-    MQTTStatus_t xStatus = MQTTSuccess;
-    bool isMatched = false;
+    uint32_t ulEnqueueCycles; /* Written by the sending task before the command is queued */
+    uint32_t ulDequeueMs;
+    BaseType_t xAwaitAck;     /* pdTRUE for a QoS1 / QoS2 publish taken by the agent */
+    BaseType_t xPowerOp;      /* pdTRUE for any publish taken by the agent, see power_stats.h */
+} AgentCommandStamp_t;
 
-    xStatus = MQTT_MatchTopic( pcTopicName,
-                               usTopicLen,
-                               pxSubscribeInfo->pTopicFilter,
-                               pxSubscribeInfo->topicFilterLength,
-                               &isMatched );
-    return ( xStatus == MQTTSuccess ) && isMatched;
-}
+static AgentCommandStamp_t xCommandStamps[ MQTT_COMMAND_CONTEXTS_POOL_SIZE ] = { 0 };
+
+static MqttAgentStats_t xAgentStats = { 0 };
+
+/* Cycle count when the agent last returned from prvAgentMessageReceive, or 0 */
+static uint32_t ulLoopStartCycles = 0;
+
+/* Set when a socket receive notification is pending verification by prvStatsRecv */
+static BaseType_t xRecvWakePending = pdFALSE;
 
 /*-----------------------------------------------------------*/
 
-static inline bool prvMatchCbCtx( SubCallbackElement_t * pxCbCtx,
-                                  MQTTSubscribeInfo_t * pxSubInfo,
-                                  IncomingPubCallback_t pxCallback,
-                                  void * pvCallbackCtx )
+static inline uint32_t prvCyclesToUs( uint32_t ulCycles )
 {
-    return( pxCbCtx->pxSubInfo == pxSubInfo &&
-            pxCbCtx->pvIncomingPublishCallbackContext == pvCallbackCtx &&
-            pxCbCtx->pxIncomingPublishCallback == pxCallback &&
-            pxCbCtx->xTaskHandle == xTaskGetCurrentTaskHandle() );
+    return ulCycles / ( SystemCoreClock / 1000000 );
 }
 
 /*-----------------------------------------------------------*/
 
-static void prvIncomingPublishCallback( MQTTAgentContext_t * pMqttAgentContext,
-                                        uint16_t packetId,
-                                        MQTTPublishInfo_t * pxPublishInfo )
+static void prvStatsOnEnqueue( MQTTAgentCommand_t * pxCommand )
 {
-    SubMgrCtx_t * pxCtx = NULL;
-    bool xPublishHandled = false;
+    int32_t lIndex = Agent_GetCommandIndex( pxCommand );
 
-    ( void ) packetId;
+    if( lIndex >= 0 )
+    {
+        xCommandStamps[ lIndex ].ulEnqueueCycles = DWT->CYCCNT;
+        xCommandStamps[ lIndex ].xAwaitAck = pdFALSE;
+        xCommandStamps[ lIndex ].xPowerOp = pdFALSE;
+    }
+}
 
-    configASSERT( pMqttAgentContext );
-    configASSERT( pMqttAgentContext->pIncomingCallbackContext );
-    configASSERT( pxPublishInfo );
+/*-----------------------------------------------------------*/
 
-    pxCtx = ( SubMgrCtx_t * ) pMqttAgentContext->pIncomingCallbackContext;
+static void prvStatsOnDequeue( MQTTAgentMessageContext_t * pxMsgCtx,
+                               MQTTAgentCommand_t * pxCommand )
+{
+    int32_t lIndex = Agent_GetCommandIndex( pxCommand );
+    uint32_t ulDepth = ( uint32_t ) uxQueueMessagesWaiting( pxMsgCtx->xQueue ) + 1;
 
-    if( xLockSubCtx( pxCtx ) )
+    if( ulDepth > xAgentStats.ulQueueDepthMax )
+    {
+        xAgentStats.ulQueueDepthMax = ulDepth;
+    }
+
+    if( lIndex >= 0 )
     {
-        /* Iterate over pxCtx->pxCallbacks list */
-        for( uint32_t ulCbIdx = 0; ulCbIdx < MQTT_AGENT_MAX_CALLBACKS; ulCbIdx++ )
+        uint32_t ulWaitUs = prvCyclesToUs( DWT->CYCCNT - xCommandStamps[ lIndex ].ulEnqueueCycles );
+        uint32_t ulBucket = 0;
+
+        while( ( ulBucket < ( MQTT_AGENT_STATS_HIST_BUCKETS - 1 ) ) &&
+               ( ulWaitUs >= ( 64UL << ( 2 * ulBucket ) ) ) )
         {
-            SubCallbackElement_t * const pxCallback = &( pxCtx->pxCallbacks[ ulCbIdx ] );
-            MQTTSubscribeInfo_t * const pxSubInfo = pxCallback->pxSubInfo;
+            ulBucket++;
+        }
 
-            if( ( pxSubInfo != NULL ) &&
-                prvMatchTopic( pxSubInfo,
-                               pxPublishInfo->pTopicName,
-                               pxPublishInfo->topicNameLength ) )
-            {
-                char * pcTaskName = pcTaskGetName( pxCallback->xTaskHandle );
+        xAgentStats.pulQueueWaitHist[ ulBucket ]++;
 
-                if( !pcTaskName )
-                {
-                    pcTaskName = "Unknown";
-                }
+        if( ulWaitUs > xAgentStats.ulQueueWaitMaxUs )
+        {
+            xAgentStats.ulQueueWaitMaxUs = ulWaitUs;
+        }
 
-                LogInfo( "Handling callback for task=%s, topic=\"%.*s\", filter=\"%.*s\".",
-                         pcTaskName,
-                         pxPublishInfo->topicNameLength, pxPublishInfo->pTopicName,
-                         pxSubInfo->topicFilterLength, pxSubInfo->pTopicFilter );
+        if( pxCommand->commandType == PUBLISH )
+        {
+            xCommandStamps[ lIndex ].xPowerOp = pdTRUE;
+            vPowerStatsOpStart( POWER_OP_PUBLISH );
 
-                pxCallback->pxIncomingPublishCallback( pxCallback->pvIncomingPublishCallbackContext,
-                                                       pxPublishInfo );
-                xPublishHandled = true;
+            if( pxCommand->pArgs != NULL )
+            {
+                MqttAgent_NotePublishDequeued( ( const MQTTPublishInfo_t * ) pxCommand->pArgs );
             }
         }
 
-        ( void ) xUnlockSubCtx( pxCtx );
+        /* The publish info is only guaranteed to be valid until the command completes */
+        if( ( pxCommand->commandType == PUBLISH ) &&
+            ( pxCommand->pArgs != NULL ) &&
+            ( ( ( MQTTPublishInfo_t * ) pxCommand->pArgs )->qos != MQTTQoS0 ) )
+        {
+            xCommandStamps[ lIndex ].ulDequeueMs = prvGetTimeMs();
+            xCommandStamps[ lIndex ].xAwaitAck = pdTRUE;
+        }
     }
+}
 
-    if( !xPublishHandled )
+/*-----------------------------------------------------------*/
+
+static bool prvStatsReleaseCommand( MQTTAgentCommand_t * pxCommand )
+{
+    int32_t lIndex = Agent_GetCommandIndex( pxCommand );
+
+    if( ( lIndex >= 0 ) &&
+        ( xCommandStamps[ lIndex ].xAwaitAck == pdTRUE ) )
     {
-        LogWarn( "Incoming publish with topic=\"%.*s\" does not match any callback functions.",
-                 pxPublishInfo->topicNameLength, pxPublishInfo->pTopicName );
+        uint32_t ulRttMs = prvGetTimeMs() - xCommandStamps[ lIndex ].ulDequeueMs;
+
+        xCommandStamps[ lIndex ].xAwaitAck = pdFALSE;
+
+        xAgentStats.ulPublishAcked++;
+        xAgentStats.ulPublishRttTotalMs += ulRttMs;
+
+        if( ulRttMs > xAgentStats.ulPublishRttMaxMs )
+        {
+            xAgentStats.ulPublishRttMaxMs = ulRttMs;
+        }
+    }
+
+    if( ( lIndex >= 0 ) &&
+        ( xCommandStamps[ lIndex ].xPowerOp == pdTRUE ) )
+    {
+        xCommandStamps[ lIndex ].xPowerOp = pdFALSE;
+        vPowerStatsOpEnd( POWER_OP_PUBLISH );
     }
+
+    return Agent_ReleaseCommand( pxCommand );
 }
 
 /*-----------------------------------------------------------*/
 
-static void prvSubscriptionManagerCtxFree( SubMgrCtx_t * pxSubMgrCtx )
+static void prvStatsLoopStart( void )
 {
-    configASSERT( pxSubMgrCtx );
+    ulLoopStartCycles = DWT->CYCCNT;
 
-    if( pxSubMgrCtx->xMutex )
+    /* 0 is reserved for "not running" */
+    if( ulLoopStartCycles == 0 )
     {
-        configASSERT_CONTINUE( MUTEX_IS_OWNED( pxSubMgrCtx->xMutex ) );
-        vSemaphoreDelete( pxSubMgrCtx->xMutex );
+        ulLoopStartCycles = 1;
     }
 }
 
 /*-----------------------------------------------------------*/
 
-static void prvSubscriptionManagerCtxReset( SubMgrCtx_t * pxSubMgrCtx )
+static void prvStatsLoopEnd( void )
 {
-    configASSERT( pxSubMgrCtx );
-    configASSERT_CONTINUE( MUTEX_IS_OWNED( pxSubMgrCtx->xMutex ) );
+    if( ulLoopStartCycles != 0 )
+    {
+        uint32_t ulLoopUs = prvCyclesToUs( DWT->CYCCNT - ulLoopStartCycles );
 
-    pxSubMgrCtx->uxSubscriptionCount = 0;
-    pxSubMgrCtx->uxCallbackCount = 0;
+        xAgentStats.ulLoopIterations++;
+        xAgentStats.ullLoopTotalUs += ulLoopUs;
 
-    for( size_t uxIdx = 0; uxIdx < MQTT_AGENT_MAX_SUBSCRIPTIONS; uxIdx++ )
-    {
-        pxSubMgrCtx->pxSubAckStatus[ uxIdx ] = MQTTSubAckFailure;
-        pxSubMgrCtx->pulSubCbCount[ uxIdx ] = 0;
+        if( ulLoopUs > xAgentStats.ulLoopMaxUs )
+        {
+            xAgentStats.ulLoopMaxUs = ulLoopUs;
+        }
 
-        pxSubMgrCtx->pxSubscriptions[ uxIdx ].pTopicFilter = NULL;
-        pxSubMgrCtx->pxSubscriptions[ uxIdx ].qos = 0;
-        pxSubMgrCtx->pxSubscriptions[ uxIdx ].topicFilterLength = 0;
+        ulLoopStartCycles = 0;
     }
+}
 
-    for( size_t uxIdx = 0; uxIdx < MQTT_AGENT_MAX_CALLBACKS; uxIdx++ )
+/*-----------------------------------------------------------*/
+
+static int32_t prvStatsRecv( NetworkContext_t * pxNetworkContext,
+                             void * pvBuffer,
+                             size_t uxBytesToRecv )
+{
+#if MQTT_AGENT_DYNAMIC_BUFFER == 1
+    int32_t lResult = prvDynBufRecv( pxNetworkContext, pvBuffer, uxBytesToRecv );
+#else
+    int32_t lResult = mbedtls_transport_recv( pxNetworkContext, pvBuffer, uxBytesToRecv );
+#endif
+
+    /* Only the first read after a socket notification tells whether it was needed */
+    if( xRecvWakePending == pdTRUE )
     {
-        pxSubMgrCtx->pxCallbacks[ uxIdx ].pvIncomingPublishCallbackContext = NULL;
-        pxSubMgrCtx->pxCallbacks[ uxIdx ].pxIncomingPublishCallback = NULL;
-        pxSubMgrCtx->pxCallbacks[ uxIdx ].pxSubInfo = NULL;
-        pxSubMgrCtx->pxCallbacks[ uxIdx ].xTaskHandle = NULL;
+        xRecvWakePending = pdFALSE;
+
+        if( lResult == 0 )
+        {
+            xAgentStats.ulSpuriousWakeups++;
+        }
     }
 
-    pxSubMgrCtx->xInitialSubscribeArgs.numSubscriptions = 0;
-    pxSubMgrCtx->xInitialSubscribeArgs.pSubscribeInfo = NULL;
+    return lResult;
 }
 
 /*-----------------------------------------------------------*/
 
-static MQTTStatus_t prvSubscriptionManagerCtxInit( SubMgrCtx_t * pxSubMgrCtx )
-{
-    MQTTStatus_t xStatus = MQTTSuccess;
+#endif /* MQTT_AGENT_STATS_ENABLED == 1 */
 
-    configASSERT( pxSubMgrCtx );
+/* Time between two waits of the agent, i.e. MQTT_ProcessLoop and the command handled */
+PROF_PROBE( xProfLoop, "mqtt_loop" );
 
-    pxSubMgrCtx->xMutex = xSemaphoreCreateMutex();
+#if PROFILER_ENABLED == 1
+/* Cycle count when the agent last returned from prvAgentMessageReceive, or 0 */
+static uint32_t ulProfLoopStart = 0;
+#endif
 
-    if( pxSubMgrCtx->xMutex )
+BaseType_t xMqttAgentGetStats( MqttAgentStats_t * pxStats )
+{
+    BaseType_t xResult = pdFALSE;
+
+    configASSERT( pxStats != NULL );
+
+#if MQTT_AGENT_STATS_ENABLED == 1
+    taskENTER_CRITICAL();
     {
-        LogDebug( "Creating MqttAgent Mutex." );
-        ( void ) xLockSubCtx( pxSubMgrCtx );
-        prvSubscriptionManagerCtxReset( pxSubMgrCtx );
+        *pxStats = xAgentStats;
     }
-    else
+    taskEXIT_CRITICAL();
+
+    xResult = pdTRUE;
+#else
+    ( void ) memset( pxStats, 0, sizeof( MqttAgentStats_t ) );
+#endif
+
+    return xResult;
+}
+
+/*-----------------------------------------------------------*/
+
+void vMqttAgentResetStats( void )
+{
+#if MQTT_AGENT_STATS_ENABLED == 1
+    taskENTER_CRITICAL();
     {
-        xStatus = MQTTNoMemory;
+        ( void ) memset( &xAgentStats, 0, sizeof( MqttAgentStats_t ) );
     }
-
-    return xStatus;
+    taskEXIT_CRITICAL();
+#endif
 }
 
 /*-----------------------------------------------------------*/
 
-static void prvFreeAgentTaskCtx( MQTTAgentTaskCtx_t * pxCtx )
+#if MQTT_AGENT_PUBLISH_BATCHING == 1
+
+/*
+ * Send side batching. While enabled, the transport send and writev functions given to
+ * coreMQTT append to ucBuffer instead of writing to the TLS connection. The buffer is
+ * flushed when it cannot take the next packet and from prvAgentMessageReceive once the
+ * oldest buffered packet has waited for MQTT_AGENT_BATCH_WINDOW_MS.
+ * Batching is only enabled from within MQTTAgent_CommandLoop so that CONNECT is not delayed.
+ */
+typedef struct
 {
-    if( pxCtx )
+    NetworkContext_t * pxNetworkContext;
+    BaseType_t xEnabled;
+    BaseType_t xSendFailed; /* Reported by the next send after a failed flush */
+    uint32_t ulFirstWriteMs;
+    size_t uxLen;
+    uint8_t ucBuffer[ MQTT_AGENT_BATCH_BUFFER_LEN ];
+} SendBatch_t;
+
+static SendBatch_t xSendBatch = { 0 };
+
+/*-----------------------------------------------------------*/
+
+static BaseType_t prvBatchFlush( void )
+{
+    size_t uxOffset = 0;
+
+    while( ( uxOffset < xSendBatch.uxLen ) &&
+           ( xSendBatch.xSendFailed == pdFALSE ) )
     {
-        if( pxCtx->xAgentMessageCtx.xQueue != NULL )
+        int32_t lSent = mbedtls_transport_send( xSendBatch.pxNetworkContext,
+                                                &( xSendBatch.ucBuffer[ uxOffset ] ),
+                                                xSendBatch.uxLen - uxOffset );
+
+        if( lSent > 0 )
         {
-            vQueueDelete( pxCtx->xAgentMessageCtx.xQueue );
+            uxOffset += ( size_t ) lSent;
         }
-
-        if( pxCtx->xConnectInfo.pClientIdentifier != NULL )
+        else
         {
-            vPortFree( ( void * ) pxCtx->xConnectInfo.pClientIdentifier );
+            LogError( "Failed to flush %lu batched bytes.",
+                      ( unsigned long ) ( xSendBatch.uxLen - uxOffset ) );
+            xSendBatch.xSendFailed = pdTRUE;
         }
+    }
+
+    xSendBatch.uxLen = 0;
+
+    return( xSendBatch.xSendFailed == pdFALSE );
+}
+
+/*-----------------------------------------------------------*/
+
+static void prvBatchEnable( NetworkContext_t * pxNetworkContext )
+{
+    xSendBatch.pxNetworkContext = pxNetworkContext;
+    xSendBatch.uxLen = 0;
+    xSendBatch.xSendFailed = pdFALSE;
+    xSendBatch.xEnabled = pdTRUE;
+}
+
+/*-----------------------------------------------------------*/
+
+static void prvBatchDisable( void )
+{
+    ( void ) prvBatchFlush();
+    xSendBatch.xEnabled = pdFALSE;
+}
+
+/*-----------------------------------------------------------*/
+
+static BaseType_t prvBatchReserve( size_t uxLen )
+{
+    BaseType_t xBuffered = pdFALSE;
 
-        if( pxCtx->pcMqttEndpoint != NULL )
+    if( ( xSendBatch.xEnabled == pdTRUE ) &&
+        ( uxLen <= MQTT_AGENT_BATCH_BUFFER_LEN ) )
+    {
+        if( ( xSendBatch.uxLen + uxLen ) > MQTT_AGENT_BATCH_BUFFER_LEN )
         {
-            vPortFree( pxCtx->pcMqttEndpoint );
+            ( void ) prvBatchFlush();
         }
 
-        prvSubscriptionManagerCtxFree( &( pxCtx->xSubMgrCtx ) );
+        if( xSendBatch.uxLen == 0 )
+        {
+            xSendBatch.ulFirstWriteMs = prvGetTimeMs();
+        }
 
-        vPortFree( ( void * ) pxCtx );
+        xBuffered = pdTRUE;
+    }
+    else if( xSendBatch.uxLen > 0 )
+    {
+        /* Preserve ordering before writing directly */
+        ( void ) prvBatchFlush();
     }
+    else
+    {
+        /* Empty */
+    }
+
+    return xBuffered;
 }
 
 /*-----------------------------------------------------------*/
 
-static MQTTStatus_t prvConfigureAgentTaskCtx( MQTTAgentTaskCtx_t * pxCtx,
-                                              NetworkContext_t * pxNetworkContext,
-                                              uint8_t * pucNetworkBuffer,
-                                              size_t uxNetworkBufferLen )
+static int32_t prvBatchSend( NetworkContext_t * pxNetworkContext,
+                             const void * pvBuffer,
+                             size_t uxBytesToSend )
 {
-    BaseType_t xSuccess = pdTRUE;
-    MQTTStatus_t xStatus = MQTTSuccess;
-    size_t uxTempSize = 0;
+    int32_t lResult = -1;
 
-    if( pxCtx == NULL )
+    if( xSendBatch.xSendFailed == pdTRUE )
     {
-        xStatus = MQTTBadParameter;
-        LogError( "Invalid pxCtx parameter." );
+        LogError( "Previous batched write failed." );
     }
-    else if( pxNetworkContext == NULL )
+    else if( prvBatchReserve( uxBytesToSend ) == pdTRUE )
     {
-        xStatus = MQTTBadParameter;
-        LogError( "Invalid pxNetworkContext parameter." );
+        if( xSendBatch.xSendFailed == pdFALSE )
+        {
+            ( void ) memcpy( &( xSendBatch.ucBuffer[ xSendBatch.uxLen ] ), pvBuffer, uxBytesToSend );
+            xSendBatch.uxLen += uxBytesToSend;
+            lResult = ( int32_t ) uxBytesToSend;
+        }
     }
-    else if( pucNetworkBuffer == NULL )
+    else if( xSendBatch.xSendFailed == pdFALSE )
     {
-        xStatus = MQTTBadParameter;
-        LogError( "Invalid pucNetworkBuffer parameter." );
+        lResult = mbedtls_transport_send( pxNetworkContext, pvBuffer, uxBytesToSend );
     }
     else
     {
-        /* Zero Initialize */
-        memset( pxCtx, 0, sizeof( MQTTAgentTaskCtx_t ) );
+        /* Empty */
     }
 
-    if( xStatus == MQTTSuccess )
-    {
-        /* Setup network buffer */
-        pxCtx->xNetworkFixedBuffer.pBuffer = pucNetworkBuffer;
-        pxCtx->xNetworkFixedBuffer.size = uxNetworkBufferLen;
+    return lResult;
+}
 
-        /* Setup transport interface */
-        pxCtx->xTransport.pNetworkContext = pxNetworkContext;
-        pxCtx->xTransport.send = mbedtls_transport_send;
-        pxCtx->xTransport.recv = mbedtls_transport_recv;
+/*-----------------------------------------------------------*/
 
-        /* MQTTConnectInfo_t */
+static int32_t prvBatchWritev( NetworkContext_t * pxNetworkContext,
+                               TransportOutVector_t * pxIoVec,
+                               size_t uxIoVecCount )
+{
+    int32_t lResult = -1;
+    size_t uxTotalLen = 0;
+
+    for( size_t uxIdx = 0; uxIdx < uxIoVecCount; uxIdx++ )
+    {
+        uxTotalLen += pxIoVec[ uxIdx ].iov_len;
+    }
+
+    if( xSendBatch.xSendFailed == pdTRUE )
+    {
+        LogError( "Previous batched write failed." );
+    }
+    else if( prvBatchReserve( uxTotalLen ) == pdTRUE )
+    {
+        if( xSendBatch.xSendFailed == pdFALSE )
+        {
+            for( size_t uxIdx = 0; uxIdx < uxIoVecCount; uxIdx++ )
+            {
+                ( void ) memcpy( &( xSendBatch.ucBuffer[ xSendBatch.uxLen ] ),
+                                 pxIoVec[ uxIdx ].iov_base,
+                                 pxIoVec[ uxIdx ].iov_len );
+                xSendBatch.uxLen += pxIoVec[ uxIdx ].iov_len;
+            }
+
+            lResult = ( int32_t ) uxTotalLen;
+        }
+    }
+    else if( xSendBatch.xSendFailed == pdFALSE )
+    {
+        lResult = mbedtls_transport_writev( pxNetworkContext, pxIoVec, uxIoVecCount );
+    }
+    else
+    {
+        /* Empty */
+    }
+
+    return lResult;
+}
+
+/*-----------------------------------------------------------*/
+
+/*
+ * @brief Flush the batch buffer once its oldest packet has waited for the latency window.
+ * @return Time in ms until the batch must be flushed, or UINT32_MAX if the buffer is empty.
+ */
+static uint32_t prvBatchPoll( void )
+{
+    uint32_t ulRemainingMs = UINT32_MAX;
+
+    if( xSendBatch.uxLen > 0 )
+    {
+        uint32_t ulElapsedMs = prvGetTimeMs() - xSendBatch.ulFirstWriteMs;
+
+        if( ulElapsedMs >= MQTT_AGENT_BATCH_WINDOW_MS )
+        {
+            ( void ) prvBatchFlush();
+        }
+        else
+        {
+            ulRemainingMs = MQTT_AGENT_BATCH_WINDOW_MS - ulElapsedMs;
+        }
+    }
+
+    return ulRemainingMs;
+}
+
+#endif /* MQTT_AGENT_PUBLISH_BATCHING == 1 */
+
+/*-----------------------------------------------------------*/
+
+/* Streamed payloads are read while being written, below this the packets are plain buffers again */
+static int32_t prvStreamWritev( NetworkContext_t * pxNetworkContext,
+                                TransportOutVector_t * pxIoVec,
+                                size_t uxIoVecCount )
+{
+#if MQTT_AGENT_PUBLISH_BATCHING == 1
+    return MqttAgent_StreamWritev( pxNetworkContext, pxIoVec, uxIoVecCount, prvBatchSend, prvBatchWritev );
+#else
+    return MqttAgent_StreamWritev( pxNetworkContext, pxIoVec, uxIoVecCount, mbedtls_transport_send, mbedtls_transport_writev );
+#endif
+}
+
+/*-----------------------------------------------------------*/
+
+static bool prvAgentMessageSend( MQTTAgentMessageContext_t * pxMsgCtx,
+                                 MQTTAgentCommand_t * const * pxCommandToSend,
+                                 uint32_t blockTimeMs )
+{
+    BaseType_t xQueueStatus = pdFAIL;
+
+    if( pxMsgCtx && pxCommandToSend )
+    {
+#if MQTT_AGENT_STATS_ENABLED == 1
+        prvStatsOnEnqueue( *pxCommandToSend );
+#endif
+
+        xQueueStatus = xQueueSendToBack( pxMsgCtx->xQueue, pxCommandToSend, pdMS_TO_TICKS( blockTimeMs ) );
+
+        /* Notify the agent that a message is waiting */
+        if( pxMsgCtx->xAgentTaskHandle )
+        {
+            ( void ) xTaskNotifyIndexed( pxMsgCtx->xAgentTaskHandle,
+                                         MQTT_AGENT_NOTIFY_IDX,
+                                         MQTT_AGENT_NOTIFY_FLAG_M_QUEUE,
+                                         eSetBits );
+        }
+    }
+
+    return ( bool ) xQueueStatus;
+}
+
+/*-----------------------------------------------------------*/
+
+static bool prvAgentMessageReceive( MQTTAgentMessageContext_t * pxMsgCtx,
+                                    MQTTAgentCommand_t ** ppxReceivedCommand,
+                                    uint32_t blockTimeMs )
+{
+    BaseType_t xQueueStatus = pdFAIL;
+    uint32_t ulNotifyValue = 0;
+
+    if( pxMsgCtx && ppxReceivedCommand )
+    {
+        TRACE_MARK( TRACE_MARK_MQTT_LOOP_END, 0 );
+
+#if MQTT_AGENT_STATS_ENABLED == 1
+        prvStatsLoopEnd();
+#endif
+
+#if PROFILER_ENABLED == 1
+        if( ulProfLoopStart != 0 )
+        {
+            PROF_RECORD( xProfLoop, PROF_NOW() - ulProfLoopStart );
+        }
+#endif
+
+#if MQTT_AGENT_DYNAMIC_BUFFER == 1
+        prvDynBufPoll();
+#endif
+
+#if MQTT_AGENT_PUBLISH_BATCHING == 1
+        {
+            uint32_t ulRemainingMs = prvBatchPoll();
+
+            /* Do not sleep past the end of the batch window */
+            if( blockTimeMs > ulRemainingMs )
+            {
+                blockTimeMs = ulRemainingMs;
+            }
+        }
+#endif /* MQTT_AGENT_PUBLISH_BATCHING == 1 */
+
+        if( xTaskNotifyWaitIndexed( MQTT_AGENT_NOTIFY_IDX,
+                                    0x0,
+                                    0xFFFFFFFF,
+                                    &ulNotifyValue,
+                                    pdMS_TO_TICKS( blockTimeMs ) ) )
+        {
+            if( ulNotifyValue & MQTT_AGENT_NOTIFY_FLAG_LINK_LOST )
+            {
+                /*
+                 * Fail the next receive of the process loop right away rather than
+                 * waiting for a TCP or MQTT keep alive timeout, so the agent reconnects.
+                 */
+                LogWarn( "Network connection lost, aborting the MQTT connection." );
+                mbedtls_transport_abort( pxMsgCtx->pxNetworkContext );
+
+                /* Tell the publishers now rather than after the teardown below */
+                prvSetAgentState( MQTT_AGENT_STATE_DISCONNECTED );
+                *ppxReceivedCommand = NULL;
+            }
+            /* Prioritize processing incoming network packets over local requests */
+            else if( ulNotifyValue & MQTT_AGENT_NOTIFY_FLAG_SOCKET_RECV )
+            {
+                *ppxReceivedCommand = NULL;
+
+#if MQTT_AGENT_STATS_ENABLED == 1
+                xAgentStats.ulRecvWakeups++;
+                xRecvWakePending = pdTRUE;
+#endif
+            }
+            else
+            {
+                xQueueStatus = xQueueReceive( pxMsgCtx->xQueue, ppxReceivedCommand, 0 );
+
+#if MQTT_AGENT_STATS_ENABLED == 1
+                if( xQueueStatus == pdTRUE )
+                {
+                    prvStatsOnDequeue( pxMsgCtx, *ppxReceivedCommand );
+                }
+#endif
+            }
+        }
+
+#if MQTT_AGENT_STATS_ENABLED == 1
+        prvStatsLoopStart();
+#endif
+
+#if PROFILER_ENABLED == 1
+        /* 0 is reserved for "not running" */
+        ulProfLoopStart = PROF_NOW() | 1U;
+#endif
+
+        TRACE_MARK( TRACE_MARK_MQTT_LOOP_START, 0 );
+    }
+
+    return ( bool ) xQueueStatus;
+}
+
+
+/*-----------------------------------------------------------*/
+
+static void prvResubscribeCommandCallback( MQTTAgentCommandContext_t * pxCommandContext,
+                                           MQTTAgentReturnInfo_t * pxReturnInfo )
+{
+    SubMgrCtx_t * pxCtx = ( SubMgrCtx_t * ) pxCommandContext;
+
+    configASSERT( pxCommandContext != NULL );
+    configASSERT( pxReturnInfo != NULL );
+    configASSERT( MUTEX_IS_OWNED( pxCtx->xMutex ) );
+
+    /* Ignore pxReturnInfo->returnCode */
+
+    for( uint32_t ulSubIdx = 0; ulSubIdx < pxCtx->uxSubscriptionCount; ulSubIdx++ )
+    {
+        /* Update cached SubAck status */
+        pxCtx->pxSubAckStatus[ ulSubIdx ] = pxReturnInfo->pSubackCodes[ ulSubIdx ];
+
+        if( pxReturnInfo->pSubackCodes[ ulSubIdx ] == MQTTSubAckFailure )
+        {
+            MQTTSubscribeInfo_t * const pxSubInfo = &( pxCtx->pxSubscriptions[ ulSubIdx ] );
+
+            LogError( "Failed to re-subscribe to topic filter \"%.*s\".",
+                      pxSubInfo->topicFilterLength,
+                      pxSubInfo->pTopicFilter );
+
+            for( uint32_t ulCbIdx = 0; ulCbIdx < MQTT_AGENT_MAX_CALLBACKS; ulCbIdx++ )
+            {
+                SubCallbackElement_t * const pxCbInfo = &( pxCtx->pxCallbacks[ ulCbIdx ] );
+
+                if( ( pxCbInfo->pxSubInfo == pxSubInfo ) &&
+                    ( pxCbInfo->xTaskHandle != NULL ) )
+                {
+                    LogWarn( "Detected orphaned callback for task: %s due to failed re-subscribe operation.",
+                             pcTaskGetName( pxCbInfo->xTaskHandle ) );
+                }
+            }
+        }
+    }
+
+    ( void ) xUnlockSubCtx( pxCtx );
+
+    xResubscribePending = pdFALSE;
+
+    /* Not when the command was cancelled by a teardown of the connection */
+    if( xAgentState == MQTT_AGENT_STATE_CONNECTED )
+    {
+        prvSetAgentState( MQTT_AGENT_STATE_RESUBSCRIBED );
+    }
+}
+
+/*-----------------------------------------------------------*/
+
+static MQTTStatus_t prvHandleResubscribe( MQTTAgentContext_t * pxMqttAgentCtx,
+                                          SubMgrCtx_t * pxCtx )
+{
+    MQTTStatus_t xStatus = MQTTSuccess;
+
+    configASSERT( pxCtx );
+    configASSERT( pxCtx->xMutex );
+    configASSERT( MUTEX_IS_OWNED( pxCtx->xMutex ) );
+
+    prvCompressSubscriptionList( pxCtx->pxSubscriptions,
+                                 pxCtx->pxCallbacks,
+                                 &( pxCtx->uxSubscriptionCount ) );
+
+    if( ( xStatus == MQTTSuccess ) && ( pxCtx->uxSubscriptionCount > 0U ) )
+    {
+        MQTTAgentCommandInfo_t xCommandParams =
+        {
+            .blockTimeMs                 = 0U,
+            .cmdCompleteCallback         = prvResubscribeCommandCallback,
+            .pCmdCompleteCallbackContext = ( void * ) pxCtx,
+        };
+
+        pxCtx->xInitialSubscribeArgs.pSubscribeInfo = pxCtx->pxSubscriptions;
+        pxCtx->xInitialSubscribeArgs.numSubscriptions = pxCtx->uxSubscriptionCount;
+
+        /* Enqueue the subscribe command */
+        xStatus = MQTTAgent_Subscribe( pxMqttAgentCtx,
+                                       &( pxCtx->xInitialSubscribeArgs ),
+                                       &xCommandParams );
+
+        /* prvResubscribeCommandCallback handles giving the mutex */
+
+        if( xStatus == MQTTSuccess )
+        {
+            xResubscribePending = pdTRUE;
+        }
+        else
+        {
+            LogError( "Failed to enqueue the MQTT subscribe command. xStatus=%s.",
+                      MQTT_Status_strerror( xStatus ) );
+        }
+    }
+    else
+    {
+        ( void ) xUnlockSubCtx( pxCtx );
+
+        /* Mark the resubscribe as success if there is nothing to be subscribed to. */
+        xStatus = MQTTSuccess;
+    }
+
+    return xStatus;
+}
+
+/*-----------------------------------------------------------*/
+
+static inline bool prvMatchTopic( MQTTSubscribeInfo_t * pxSubscribeInfo,
+                                  const char * pcTopicName,
+                                  const uint16_t usTopicLen )
+{
+    MQTTStatus_t xStatus = MQTTSuccess;
+    bool isMatched = false;
+
+    xStatus = MQTT_MatchTopic( pcTopicName,
+                               usTopicLen,
+                               pxSubscribeInfo->pTopicFilter,
+                               pxSubscribeInfo->topicFilterLength,
+                               &isMatched );
+    return ( xStatus == MQTTSuccess ) && isMatched;
+}
+
+/*-----------------------------------------------------------*/
+
+static inline bool prvMatchCbCtx( SubCallbackElement_t * pxCbCtx,
+                                  MQTTSubscribeInfo_t * pxSubInfo,
+                                  IncomingPubCallback_t pxCallback,
+                                  void * pvCallbackCtx )
+{
+    return( pxCbCtx->pxSubInfo == pxSubInfo &&
+            pxCbCtx->pvIncomingPublishCallbackContext == pvCallbackCtx &&
+            pxCbCtx->pxIncomingPublishCallback == pxCallback &&
+            pxCbCtx->xTaskHandle == xTaskGetCurrentTaskHandle() );
+}
+
+/*-----------------------------------------------------------*/
+
+static void prvRebuildTopicTrie( SubMgrCtx_t * pxCtx )
+{
+    configASSERT( pxCtx );
+    configASSERT_CONTINUE( MUTEX_IS_OWNED( pxCtx->xMutex ) );
+
+    vTopicTrieFree( pxCtx->pxTopicTrie );
+    pxCtx->pxTopicTrie = NULL;
+    pxCtx->xTopicTrieValid = pdTRUE;
+
+    for( uint32_t ulCbIdx = 0; ulCbIdx < MQTT_AGENT_MAX_CALLBACKS; ulCbIdx++ )
+    {
+        SubCallbackElement_t * const pxCallback = &( pxCtx->pxCallbacks[ ulCbIdx ] );
+        MQTTSubscribeInfo_t * const pxSubInfo = pxCallback->pxSubInfo;
+
+        if( ( pxSubInfo != NULL ) &&
+            ( xTopicTrieInsert( &( pxCtx->pxTopicTrie ),
+                                pxSubInfo->pTopicFilter,
+                                pxSubInfo->topicFilterLength,
+                                pxCallback ) != pdTRUE ) )
+        {
+            pxCtx->xTopicTrieValid = pdFALSE;
+            break;
+        }
+    }
+
+    if( pxCtx->xTopicTrieValid == pdFALSE )
+    {
+        LogWarn( "Failed to index topic filters, falling back to matching every callback." );
+
+        vTopicTrieFree( pxCtx->pxTopicTrie );
+        pxCtx->pxTopicTrie = NULL;
+    }
+}
+
+/*-----------------------------------------------------------*/
+
+/* Copy of a publish handed to a subscriber task, followed by the topic name and payload */
+typedef struct DeferredPublish
+{
+    IncomingPubCallback_t pxCallback;
+    void * pvCallbackCtx;
+    MQTTPublishInfo_t xPublishInfo;
+} DeferredPublish_t;
+
+static void prvDeferPublish( SubCallbackElement_t * pxCallback,
+                             const MQTTPublishInfo_t * pxPublishInfo )
+{
+    DeferredPublish_t * pxDeferred = pvPortMalloc( sizeof( DeferredPublish_t ) +
+                                                   pxPublishInfo->topicNameLength +
+                                                   pxPublishInfo->payloadLength );
+
+    if( pxDeferred == NULL )
+    {
+        LogError( "Failed to allocate %lu bytes to defer publish on topic=\"%.*s\".",
+                  sizeof( DeferredPublish_t ) + pxPublishInfo->topicNameLength + pxPublishInfo->payloadLength,
+                  pxPublishInfo->topicNameLength, pxPublishInfo->pTopicName );
+    }
+    else
+    {
+        char * pcTopicName = ( char * ) &( pxDeferred[ 1 ] );
+        uint8_t * pucPayload = ( uint8_t * ) &( pcTopicName[ pxPublishInfo->topicNameLength ] );
+        DmaCopy_t xPayloadCopy;
+
+        /* Long payloads are moved by the DMA channel while the rest is filled in */
+        ( void ) xDmaCopyStart( &xPayloadCopy, pucPayload, pxPublishInfo->pPayload, pxPublishInfo->payloadLength );
+
+        pxDeferred->pxCallback = pxCallback->pxIncomingPublishCallback;
+        pxDeferred->pvCallbackCtx = pxCallback->pvIncomingPublishCallbackContext;
+        pxDeferred->xPublishInfo = *pxPublishInfo;
+
+        ( void ) memcpy( pcTopicName, pxPublishInfo->pTopicName, pxPublishInfo->topicNameLength );
+        pxDeferred->xPublishInfo.pTopicName = pcTopicName;
+        pxDeferred->xPublishInfo.pPayload = pucPayload;
+
+        ( void ) xDmaCopyWait( &xPayloadCopy );
+
+        /* Never block the agent task on a slow subscriber */
+        if( xQueueSendToBack( pxCallback->xDeliveryQueue, &pxDeferred, 0 ) != pdTRUE )
+        {
+            LogWarn( "Delivery queue full, dropping publish on topic=\"%.*s\".",
+                     pxPublishInfo->topicNameLength, pxPublishInfo->pTopicName );
+            vPortFree( pxDeferred );
+        }
+    }
+}
+
+/*-----------------------------------------------------------*/
+
+static void prvCallSubscriber( void * pvCallback,
+                               void * pvPublishInfo )
+{
+    SubCallbackElement_t * const pxCallback = ( SubCallbackElement_t * ) pvCallback;
+    MQTTPublishInfo_t * const pxPublishInfo = ( MQTTPublishInfo_t * ) pvPublishInfo;
+    char * pcTaskName = pcTaskGetName( pxCallback->xTaskHandle );
+
+    if( !pcTaskName )
+    {
+        pcTaskName = "Unknown";
+    }
+
+    if( pxCallback->xDeliveryQueue != NULL )
+    {
+        LogDebug( "Deferring callback to task=%s, topic=\"%.*s\", filter=\"%.*s\".",
+                  pcTaskName,
+                  pxPublishInfo->topicNameLength, pxPublishInfo->pTopicName,
+                  pxCallback->pxSubInfo->topicFilterLength, pxCallback->pxSubInfo->pTopicFilter );
+
+        prvDeferPublish( pxCallback, pxPublishInfo );
+    }
+    else
+    {
+        LogInfo( "Handling callback for task=%s, topic=\"%.*s\", filter=\"%.*s\".",
+                 pcTaskName,
+                 pxPublishInfo->topicNameLength, pxPublishInfo->pTopicName,
+                 pxCallback->pxSubInfo->topicFilterLength, pxCallback->pxSubInfo->pTopicFilter );
+
+        pxCallback->pxIncomingPublishCallback( pxCallback->pvIncomingPublishCallbackContext,
+                                               pxPublishInfo );
+    }
+}
+
+/*-----------------------------------------------------------*/
+
+static void prvIncomingPublishCallback( MQTTAgentContext_t * pMqttAgentContext,
+                                        uint16_t packetId,
+                                        MQTTPublishInfo_t * pxPublishInfo )
+{
+    SubMgrCtx_t * pxCtx = NULL;
+    bool xPublishHandled = false;
+
+    ( void ) packetId;
+
+    configASSERT( pMqttAgentContext );
+    configASSERT( pMqttAgentContext->pIncomingCallbackContext );
+    configASSERT( pxPublishInfo );
+
+    pxCtx = ( SubMgrCtx_t * ) pMqttAgentContext->pIncomingCallbackContext;
+
+    if( xLockSubCtx( pxCtx ) )
+    {
+        if( pxCtx->xTopicTrieValid == pdTRUE )
+        {
+            xPublishHandled = ( uxTopicTrieMatch( pxCtx->pxTopicTrie,
+                                                  pxPublishInfo->pTopicName,
+                                                  pxPublishInfo->topicNameLength,
+                                                  prvCallSubscriber,
+                                                  pxPublishInfo ) > 0 );
+        }
+        else
+        {
+            /* Iterate over pxCtx->pxCallbacks list */
+            for( uint32_t ulCbIdx = 0; ulCbIdx < MQTT_AGENT_MAX_CALLBACKS; ulCbIdx++ )
+            {
+                SubCallbackElement_t * const pxCallback = &( pxCtx->pxCallbacks[ ulCbIdx ] );
+                MQTTSubscribeInfo_t * const pxSubInfo = pxCallback->pxSubInfo;
+
+                if( ( pxSubInfo != NULL ) &&
+                    prvMatchTopic( pxSubInfo,
+                                   pxPublishInfo->pTopicName,
+                                   pxPublishInfo->topicNameLength ) )
+                {
+                    prvCallSubscriber( pxCallback, pxPublishInfo );
+                    xPublishHandled = true;
+                }
+            }
+        }
+
+        ( void ) xUnlockSubCtx( pxCtx );
+    }
+
+    if( !xPublishHandled )
+    {
+        LogWarn( "Incoming publish with topic=\"%.*s\" does not match any callback functions.",
+                 pxPublishInfo->topicNameLength, pxPublishInfo->pTopicName );
+    }
+}
+
+/*-----------------------------------------------------------*/
+
+static void prvSubscriptionManagerCtxFree( SubMgrCtx_t * pxSubMgrCtx )
+{
+    configASSERT( pxSubMgrCtx );
+
+    if( pxSubMgrCtx->xMutex )
+    {
+        configASSERT_CONTINUE( MUTEX_IS_OWNED( pxSubMgrCtx->xMutex ) );
+        vSemaphoreDelete( pxSubMgrCtx->xMutex );
+    }
+
+    vTopicTrieFree( pxSubMgrCtx->pxTopicTrie );
+    pxSubMgrCtx->pxTopicTrie = NULL;
+}
+
+/*-----------------------------------------------------------*/
+
+static void prvSubscriptionManagerCtxReset( SubMgrCtx_t * pxSubMgrCtx )
+{
+    configASSERT( pxSubMgrCtx );
+    configASSERT_CONTINUE( MUTEX_IS_OWNED( pxSubMgrCtx->xMutex ) );
+
+    pxSubMgrCtx->uxSubscriptionCount = 0;
+    pxSubMgrCtx->uxCallbackCount = 0;
+
+    for( size_t uxIdx = 0; uxIdx < MQTT_AGENT_MAX_SUBSCRIPTIONS; uxIdx++ )
+    {
+        pxSubMgrCtx->pxSubAckStatus[ uxIdx ] = MQTTSubAckFailure;
+        pxSubMgrCtx->pulSubCbCount[ uxIdx ] = 0;
+
+        pxSubMgrCtx->pxSubscriptions[ uxIdx ].pTopicFilter = NULL;
+        pxSubMgrCtx->pxSubscriptions[ uxIdx ].qos = 0;
+        pxSubMgrCtx->pxSubscriptions[ uxIdx ].topicFilterLength = 0;
+    }
+
+    for( size_t uxIdx = 0; uxIdx < MQTT_AGENT_MAX_CALLBACKS; uxIdx++ )
+    {
+        pxSubMgrCtx->pxCallbacks[ uxIdx ].pvIncomingPublishCallbackContext = NULL;
+        pxSubMgrCtx->pxCallbacks[ uxIdx ].pxIncomingPublishCallback = NULL;
+        pxSubMgrCtx->pxCallbacks[ uxIdx ].pxSubInfo = NULL;
+        pxSubMgrCtx->pxCallbacks[ uxIdx ].xTaskHandle = NULL;
+        pxSubMgrCtx->pxCallbacks[ uxIdx ].xDeliveryQueue = NULL;
+    }
+
+    pxSubMgrCtx->xInitialSubscribeArgs.numSubscriptions = 0;
+    pxSubMgrCtx->xInitialSubscribeArgs.pSubscribeInfo = NULL;
+
+    vTopicTrieFree( pxSubMgrCtx->pxTopicTrie );
+    pxSubMgrCtx->pxTopicTrie = NULL;
+    pxSubMgrCtx->xTopicTrieValid = pdTRUE;
+}
+
+/*-----------------------------------------------------------*/
+
+static MQTTStatus_t prvSubscriptionManagerCtxInit( SubMgrCtx_t * pxSubMgrCtx )
+{
+    MQTTStatus_t xStatus = MQTTSuccess;
+
+    configASSERT( pxSubMgrCtx );
+
+    pxSubMgrCtx->xMutex = xSemaphoreCreateMutex();
+
+    if( pxSubMgrCtx->xMutex )
+    {
+        LogDebug( "Creating MqttAgent Mutex." );
+        ( void ) xLockSubCtx( pxSubMgrCtx );
+        prvSubscriptionManagerCtxReset( pxSubMgrCtx );
+    }
+    else
+    {
+        xStatus = MQTTNoMemory;
+    }
+
+    return xStatus;
+}
+
+/*-----------------------------------------------------------*/
+
+static void prvFreeAgentTaskCtx( MQTTAgentTaskCtx_t * pxCtx )
+{
+    if( pxCtx )
+    {
+        if( pxCtx->xAgentMessageCtx.xQueue != NULL )
+        {
+            vQueueDelete( pxCtx->xAgentMessageCtx.xQueue );
+        }
+
+        prvSubscriptionManagerCtxFree( &( pxCtx->xSubMgrCtx ) );
+
+        vPortFree( ( void * ) pxCtx );
+    }
+}
+
+/*-----------------------------------------------------------*/
+
+static MQTTStatus_t prvConfigureAgentTaskCtx( MQTTAgentTaskCtx_t * pxCtx,
+                                              NetworkContext_t * pxNetworkContext,
+                                              uint8_t * pucNetworkBuffer,
+                                              size_t uxNetworkBufferLen )
+{
+    BaseType_t xSuccess = pdTRUE;
+    MQTTStatus_t xStatus = MQTTSuccess;
+    size_t uxTempSize = 0;
+
+    if( pxCtx == NULL )
+    {
+        xStatus = MQTTBadParameter;
+        LogError( "Invalid pxCtx parameter." );
+    }
+    else if( pxNetworkContext == NULL )
+    {
+        xStatus = MQTTBadParameter;
+        LogError( "Invalid pxNetworkContext parameter." );
+    }
+    else if( pucNetworkBuffer == NULL )
+    {
+        xStatus = MQTTBadParameter;
+        LogError( "Invalid pucNetworkBuffer parameter." );
+    }
+    else
+    {
+        /* Zero Initialize */
+        memset( pxCtx, 0, sizeof( MQTTAgentTaskCtx_t ) );
+    }
+
+    if( xStatus == MQTTSuccess )
+    {
+        /* Setup network buffer */
+        pxCtx->xNetworkFixedBuffer.pBuffer = pucNetworkBuffer;
+        pxCtx->xNetworkFixedBuffer.size = uxNetworkBufferLen;
+
+        /* Setup transport interface */
+        pxCtx->xTransport.pNetworkContext = pxNetworkContext;
+#if MQTT_AGENT_PUBLISH_BATCHING == 1
+        pxCtx->xTransport.send = prvBatchSend;
+#else
+        pxCtx->xTransport.send = mbedtls_transport_send;
+#endif
+        pxCtx->xTransport.writev = prvStreamWritev;
+#if MQTT_AGENT_STATS_ENABLED == 1
+        pxCtx->xTransport.recv = prvStatsRecv;
+#elif MQTT_AGENT_DYNAMIC_BUFFER == 1
+        pxCtx->xTransport.recv = prvDynBufRecv;
+#else
+        pxCtx->xTransport.recv = mbedtls_transport_recv;
+#endif
+
+        /* MQTTConnectInfo_t */
         /* Always start the initial connection with a clean session */
         pxCtx->xConnectInfo.cleanSession = true;
-        pxCtx->xConnectInfo.keepAliveSeconds = KEEP_ALIVE_INTERVAL_S;
+        pxCtx->xConnectInfo.keepAliveSeconds = prvKeepAliveSeconds();
         pxCtx->xConnectInfo.pUserName = AWS_IOT_METRICS_STRING;
         pxCtx->xConnectInfo.userNameLength = AWS_IOT_METRICS_STRING_LENGTH;
         pxCtx->xConnectInfo.pPassword = NULL;
         pxCtx->xConnectInfo.passwordLength = 0U;
 
-        pxCtx->xConnectInfo.pClientIdentifier = KVStore_getStringHeap( CS_CORE_THING_NAME, &uxTempSize );
+        /* Read the connection settings in one go so that they are consistent with each other */
+        KVStoreItem_t xConnectConfig[] =
+        {
+            KV_ITEM( CS_CORE_THING_NAME,    pxCtx->pcThingName    ),
+            KV_ITEM( CS_CORE_MQTT_ENDPOINT, pxCtx->pcMqttEndpoint ),
+            KV_ITEM( CS_CORE_MQTT_PORT,     pxCtx->ulMqttPort     ),
+        };
+
+        xSuccess = KVStore_xGetItems( xConnectConfig, sizeof( xConnectConfig ) / sizeof( xConnectConfig[ 0 ] ) );
 
-        if( ( pxCtx->xConnectInfo.pClientIdentifier != NULL ) &&
-            ( uxTempSize > 0 ) &&
-            ( uxTempSize <= UINT16_MAX ) )
+        uxTempSize = strnlen( pxCtx->pcThingName, sizeof( pxCtx->pcThingName ) );
+
+        if( ( xSuccess == pdFALSE ) ||
+            ( uxTempSize == 0 ) ||
+            ( xConnectConfig[ 0 ].xLength > sizeof( pxCtx->pcThingName ) ) )
         {
-            pxCtx->xConnectInfo.clientIdentifierLength = ( uint16_t ) uxTempSize;
+            LogError( "Invalid client identifier read from KVStore." );
+            xStatus = MQTTNoMemory;
         }
-        else
+        else if( ( strnlen( pxCtx->pcMqttEndpoint, sizeof( pxCtx->pcMqttEndpoint ) ) == 0 ) ||
+                 ( xConnectConfig[ 1 ].xLength > sizeof( pxCtx->pcMqttEndpoint ) ) )
         {
-            LogError( "Invalid client identifier read from KVStore." );
+            LogError( "Invalid mqtt endpoint read from KVStore." );
+            xStatus = MQTTNoMemory;
+        }
+        else if( pxCtx->ulMqttPort == 0 )
+        {
+            LogError( "Invalid mqtt port number read from KVStore." );
             xStatus = MQTTNoMemory;
         }
+        else
+        {
+            pxCtx->xConnectInfo.pClientIdentifier = pxCtx->pcThingName;
+            pxCtx->xConnectInfo.clientIdentifierLength = ( uint16_t ) uxTempSize;
+        }
     }
 
     if( xStatus == MQTTSuccess )
     {
-        pxCtx->xAgentMessageCtx.xQueue = xQueueCreate( MQTT_AGENT_COMMAND_QUEUE_LENGTH,
-                                                       sizeof( MQTTAgentCommand_t * ) );
+        /* Created once per run of the agent task, deleted by prvFreeAgentTaskCtx */
+        pxCtx->xAgentMessageCtx.xQueue = xQueueCreateStaticStorage( MQTT_AGENT_COMMAND_QUEUE_LENGTH,
+                                                                    sizeof( MQTTAgentCommand_t * ) );
 
         if( pxCtx->xAgentMessageCtx.xQueue == NULL )
         {
@@ -896,6 +2092,7 @@ static MQTTStatus_t prvConfigureAgentTaskCtx( MQTTAgentTaskCtx_t * pxCtx,
         }
 
         pxCtx->xAgentMessageCtx.xAgentTaskHandle = xTaskGetCurrentTaskHandle();
+        pxCtx->xAgentMessageCtx.pxNetworkContext = pxNetworkContext;
     }
 
     if( xStatus == MQTTSuccess )
@@ -905,52 +2102,100 @@ static MQTTStatus_t prvConfigureAgentTaskCtx( MQTTAgentTaskCtx_t * pxCtx,
         pxCtx->xMessageInterface.send = prvAgentMessageSend;
         pxCtx->xMessageInterface.recv = prvAgentMessageReceive;
         pxCtx->xMessageInterface.getCommand = Agent_GetCommand;
+#if MQTT_AGENT_STATS_ENABLED == 1
+        pxCtx->xMessageInterface.releaseCommand = prvStatsReleaseCommand;
+#else
         pxCtx->xMessageInterface.releaseCommand = Agent_ReleaseCommand;
+#endif
     }
 
     if( xStatus == MQTTSuccess )
     {
-        pxCtx->pcMqttEndpoint = KVStore_getStringHeap( CS_CORE_MQTT_ENDPOINT,
-                                                       &( pxCtx->uxMqttEndpointLen ) );
+        xStatus = prvSubscriptionManagerCtxInit( &( pxCtx->xSubMgrCtx ) );
 
-        if( ( pxCtx->uxMqttEndpointLen == 0 ) ||
-            ( pxCtx->pcMqttEndpoint == NULL ) )
+        if( xStatus != MQTTSuccess )
         {
-            LogError( "Invalid mqtt endpoint read from KVStore." );
-            xStatus = MQTTNoMemory;
+            LogError( "Failed to initialize Subscription Manager Context." );
         }
     }
 
-    if( xStatus == MQTTSuccess )
-    {
-        pxCtx->ulMqttPort = KVStore_getUInt32( CS_CORE_MQTT_PORT, &( xSuccess ) );
+    return xStatus;
+}
+
+/*-----------------------------------------------------------*/
+
+static ReconnectClass_t prvClassifyTlsFailure( TlsTransportStatus_t xTlsStatus )
+{
+    ReconnectClass_t xClass = RECONNECT_CLASS_OTHER;
 
-        if( ( pxCtx->ulMqttPort == 0 ) ||
-            ( xSuccess == pdFALSE ) )
+    if( ( xEventGroupGetBits( xSystemEvents ) & EVT_MASK_NET_CONNECTED ) == 0 )
+    {
+        xClass = RECONNECT_CLASS_NETWORK_DOWN;
+    }
+    else
+    {
+        switch( xTlsStatus )
         {
-            LogError( "Invalid mqtt port number read from KVStore." );
-            xStatus = MQTTNoMemory;
+            case TLS_TRANSPORT_DNS_FAILED:
+            case TLS_TRANSPORT_INVALID_HOSTNAME:
+                xClass = RECONNECT_CLASS_DNS;
+                break;
+
+            case TLS_TRANSPORT_CONNECT_FAILURE:
+            case TLS_TRANSPORT_INSUFFICIENT_SOCKETS:
+                xClass = RECONNECT_CLASS_TCP;
+                break;
+
+            case TLS_TRANSPORT_HANDSHAKE_FAILED:
+            case TLS_TRANSPORT_INVALID_CREDENTIALS:
+            case TLS_TRANSPORT_PKI_OBJECT_NOT_FOUND:
+            case TLS_TRANSPORT_PKI_OBJECT_PARSE_FAIL:
+            case TLS_TRANSPORT_CLIENT_CERT_INVALID:
+            case TLS_TRANSPORT_NO_VALID_CA_CERT:
+            case TLS_TRANSPORT_CLIENT_KEY_INVALID:
+                xClass = RECONNECT_CLASS_TLS;
+                break;
+
+            default:
+                xClass = RECONNECT_CLASS_OTHER;
+                break;
         }
     }
 
-    if( xStatus == MQTTSuccess )
-    {
-        xStatus = prvSubscriptionManagerCtxInit( &( pxCtx->xSubMgrCtx ) );
+    return xClass;
+}
 
-        if( xStatus != MQTTSuccess )
-        {
-            LogError( "Failed to initialize Subscription Manager Context." );
-        }
+/*-----------------------------------------------------------*/
+
+MQTTAgentHandle_t xGetMqttAgentHandle( void )
+{
+    return xDefaultInstanceHandle;
+}
+
+/*-----------------------------------------------------------*/
+
+UBaseType_t uxMqttAgentPendingCommands( void )
+{
+    UBaseType_t uxPending = 0;
+
+    if( ( xDefaultInstanceHandle != NULL ) &&
+        ( xDefaultInstanceHandle->agentInterface.pMsgCtx != NULL ) )
+    {
+        uxPending = uxQueueMessagesWaiting( xDefaultInstanceHandle->agentInterface.pMsgCtx->xQueue );
     }
 
-    return xStatus;
+    return uxPending;
 }
 
 /*-----------------------------------------------------------*/
 
-MQTTAgentHandle_t xGetMqttAgentHandle( void )
+void vMqttAgentRequestReconnect( void )
 {
-    return xDefaultInstanceHandle;
+    if( ( xDefaultInstanceHandle != NULL ) &&
+        ( xDefaultInstanceHandle->agentInterface.pMsgCtx != NULL ) )
+    {
+        prvLinkLostCallback( xDefaultInstanceHandle->agentInterface.pMsgCtx );
+    }
 }
 
 /*-----------------------------------------------------------*/
@@ -964,7 +2209,7 @@ void vMQTTAgentTask( void * pvParameters )
     MQTTAgentTaskCtx_t * pxCtx = NULL;
     uint8_t * pucNetworkBuffer = NULL;
     NetworkContext_t * pxNetworkContext = NULL;
-    uint16_t usNextRetryBackOff = 0U;
+    ReconnectScheduler_t xReconnectSched;
 
     PkiObject_t xPrivateKey = xPkiObjectFromLabel( TLS_KEY_PRV_LABEL );
     PkiObject_t xClientCertificate = xPkiObjectFromLabel( TLS_CERT_LABEL );
@@ -972,15 +2217,24 @@ void vMQTTAgentTask( void * pvParameters )
 
     ( void ) pvParameters;
 
+    ( void ) xHeapTagSet( HEAP_TAG_MQTT );
+
     /* Miscellaneous initialization. */
     ulGlobalEntryTimeMs = prvGetTimeMs();
+    vReconnectInit( &xReconnectSched );
+
+#if MQTT_AGENT_STATS_ENABLED == 1
+    /* Enable the cycle counter used for queue wait and loop timing */
+    CoreDebug->DEMCR |= CoreDebug_DEMCR_TRCENA_Msk;
+    DWT->CTRL |= DWT_CTRL_CYCCNTENA_Msk;
+#endif
 
     /* Memory Allocation */
-    pucNetworkBuffer = ( uint8_t * ) pvPortMalloc( MQTT_AGENT_NETWORK_BUFFER_SIZE );
+    pucNetworkBuffer = ( uint8_t * ) pvPortMalloc( MQTT_AGENT_INITIAL_BUFFER_SIZE );
 
     if( pucNetworkBuffer == NULL )
     {
-        LogError( "Failed to allocate %d bytes for pucNetworkBuffer.", MQTT_AGENT_NETWORK_BUFFER_SIZE );
+        LogError( "Failed to allocate %d bytes for pucNetworkBuffer.", MQTT_AGENT_INITIAL_BUFFER_SIZE );
         xMQTTStatus = MQTTNoMemory;
     }
 
@@ -1019,7 +2273,7 @@ void vMQTTAgentTask( void * pvParameters )
         {
             xMQTTStatus = prvConfigureAgentTaskCtx( pxCtx, pxNetworkContext,
                                                     pucNetworkBuffer,
-                                                    MQTT_AGENT_NETWORK_BUFFER_SIZE );
+                                                    MQTT_AGENT_INITIAL_BUFFER_SIZE );
         }
         else
         {
@@ -1031,6 +2285,7 @@ void vMQTTAgentTask( void * pvParameters )
     if( xMQTTStatus == MQTTSuccess )
     {
         Agent_InitializePool();
+        MqttAgent_InitPublishPool();
     }
 
     if( xMQTTStatus == MQTTSuccess )
@@ -1050,8 +2305,12 @@ void vMQTTAgentTask( void * pvParameters )
         }
         else
         {
-            ( void ) xEventGroupSetBits( xSystemEvents, EVT_MASK_MQTT_INIT );
             xDefaultInstanceHandle = &( pxCtx->xAgentContext );
+            ( void ) xEventGroupSetBits( xSystemEvents, EVT_MASK_MQTT_INIT | EVT_MASK_MQTT_DISCONNECTED );
+
+#if MQTT_AGENT_DYNAMIC_BUFFER == 1
+            prvDynBufInit( &( pxCtx->xAgentContext.mqttContext ), pucNetworkBuffer );
+#endif
         }
     }
 
@@ -1066,6 +2325,10 @@ void vMQTTAgentTask( void * pvParameters )
             LogError( "Failed to configure socket recv ready callback." );
             xMQTTStatus = MQTTBadParameter;
         }
+        else
+        {
+            net_set_link_lost_callback( prvLinkLostCallback, &( pxCtx->xAgentMessageCtx ) );
+        }
     }
 
     if( xMQTTStatus != MQTTSuccess )
@@ -1076,20 +2339,12 @@ void vMQTTAgentTask( void * pvParameters )
     /* Outer Reconnect loop */
     while( xExitFlag != pdTRUE )
     {
-        BackoffAlgorithmStatus_t xBackoffAlgStatus = BackoffAlgorithmSuccess;
-        BackoffAlgorithmContext_t xReconnectParams = { 0 };
-
-        /* Initialize backoff algorithm with jitter */
-        BackoffAlgorithm_InitializeParams( &xReconnectParams,
-                                           RETRY_BACKOFF_BASE,
-                                           RETRY_MAX_BACKOFF_DELAY,
-                                           BACKOFF_ALGORITHM_RETRY_FOREVER );
+        ReconnectClass_t xFailureClass = RECONNECT_CLASS_DISCONNECT;
 
         xTlsStatus = TLS_TRANSPORT_UNKNOWN_ERROR;
 
         /* Connect a socket to the broker with retries */
-        while( xTlsStatus != TLS_TRANSPORT_SUCCESS &&
-               xBackoffAlgStatus == BackoffAlgorithmSuccess )
+        while( xTlsStatus != TLS_TRANSPORT_SUCCESS )
         {
             /* Block until the network interface is connected */
             ( void ) xEventGroupWaitBits( xSystemEvents,
@@ -1101,6 +2356,9 @@ void vMQTTAgentTask( void * pvParameters )
             LogInfo( "Attempting a TLS connection to %s:%d.",
                      pxCtx->pcMqttEndpoint, pxCtx->ulMqttPort );
 
+            /* A link loss reported before this connection does not concern it */
+            ( void ) ulTaskNotifyValueClearIndexed( NULL, MQTT_AGENT_NOTIFY_IDX, MQTT_AGENT_NOTIFY_FLAG_LINK_LOST );
+
             xTlsStatus = mbedtls_transport_connect( pxNetworkContext,
                                                     pxCtx->pcMqttEndpoint,
                                                     ( uint16_t ) pxCtx->ulMqttPort,
@@ -1108,23 +2366,12 @@ void vMQTTAgentTask( void * pvParameters )
 
             if( xTlsStatus != TLS_TRANSPORT_SUCCESS )
             {
-                /* Get back-off value (in seconds) for the next connection retry. */
-                xBackoffAlgStatus = BackoffAlgorithm_GetNextBackoff( &xReconnectParams,
-                                                                     uxRand(),
-                                                                     &usNextRetryBackOff );
-
-                if( xBackoffAlgStatus == BackoffAlgorithmSuccess )
-                {
-                    LogWarn( "Connecting to the mqtt broker failed. "
-                             "Retrying connection in %lu ms.",
-                             RETRY_BACKOFF_MULTIPLIER * usNextRetryBackOff );
-                    vTaskDelay( pdMS_TO_TICKS( RETRY_BACKOFF_MULTIPLIER * usNextRetryBackOff ) );
-                }
-                else
-                {
-                    LogError( "Connection to the broker failed, all attempts exhausted." );
-                    xExitFlag = pdTRUE;
-                }
+                vReconnectWait( ulReconnectOnFailure( &xReconnectSched,
+                                                      prvClassifyTlsFailure( xTlsStatus ) ) );
+            }
+            else
+            {
+                vBootTimeMark( BOOT_STAGE_TLS );
             }
         }
 
@@ -1174,6 +2421,7 @@ void vMQTTAgentTask( void * pvParameters )
             else
             {
                 LogError( "Failed to connect to mqtt broker." );
+                xFailureClass = RECONNECT_CLASS_MQTT_CONNECT;
             }
 
             /* Further reconnects will include a session resume operation */
@@ -1189,31 +2437,56 @@ void vMQTTAgentTask( void * pvParameters )
 
         if( xMQTTStatus == MQTTSuccess )
         {
-            ( void ) xEventGroupSetBits( xSystemEvents, EVT_MASK_MQTT_CONNECTED );
+            vBootTimeMark( BOOT_STAGE_MQTT_CONNACK );
+            prvSetAgentState( MQTT_AGENT_STATE_CONNECTED );
+
+            /* Otherwise prvResubscribeCommandCallback moves on once the SUBACK is in */
+            if( xResubscribePending == pdFALSE )
+            {
+                prvSetAgentState( MQTT_AGENT_STATE_RESUBSCRIBED );
+            }
 
-            /* Reset backoff timer */
-            BackoffAlgorithm_InitializeParams( &xReconnectParams,
-                                               RETRY_BACKOFF_BASE,
-                                               RETRY_MAX_BACKOFF_DELAY,
-                                               BACKOFF_ALGORITHM_RETRY_FOREVER );
+            vReconnectOnSuccess( &xReconnectSched );
 
             /* MQTTAgent_CommandLoop() is effectively the agent implementation.  It
              * will manage the MQTT protocol until such time that an error occurs,
              * which could be a disconnect.  If an error occurs the MQTT context on
              * which the error happened is returned so there can be an attempt to
              * clean up and reconnect however the application writer prefers. */
+#if MQTT_AGENT_PUBLISH_BATCHING == 1
+            prvBatchEnable( pxNetworkContext );
+#endif
+
+#if MQTT_AGENT_DYNAMIC_BUFFER == 1
+            prvDynBufEnable();
+#endif
+
+#if MQTT_AGENT_STATS_ENABLED == 1
+            /* Do not count the time spent reconnecting as a loop iteration */
+            ulLoopStartCycles = 0;
+#endif
+
             xMQTTStatus = MQTTAgent_CommandLoop( &( pxCtx->xAgentContext ) );
 
+#if MQTT_AGENT_PUBLISH_BATCHING == 1
+            /* Send anything still buffered, e.g. a DISCONNECT packet */
+            prvBatchDisable();
+#endif
+
+#if MQTT_AGENT_DYNAMIC_BUFFER == 1
+            prvDynBufDisable();
+#endif
+
             LogDebug( "MQTTAgent_CommandLoop returned with status: %s.",
                       MQTT_Status_strerror( xMQTTStatus ) );
         }
 
+        prvSetAgentState( MQTT_AGENT_STATE_DISCONNECTED );
+
         ( void ) MQTTAgent_CancelAll( &( pxCtx->xAgentContext ) );
 
         mbedtls_transport_disconnect( pxNetworkContext );
 
-        ( void ) xEventGroupClearBits( xSystemEvents, EVT_MASK_MQTT_CONNECTED );
-
         /* Wait for any subscription related calls to complete */
         if( !MUTEX_IS_OWNED( pxCtx->xSubMgrCtx.xMutex ) )
         {
@@ -1225,28 +2498,17 @@ void vMQTTAgentTask( void * pvParameters )
                 MQTTSubAckFailure,
                 sizeof( pxCtx->xSubMgrCtx.pxSubAckStatus ) );
 
-        if( !xExitFlag )
+        /* A failure right after the network dropped is waited out by vReconnectWait */
+        if( ( xEventGroupGetBits( xSystemEvents ) & EVT_MASK_NET_CONNECTED ) == 0 )
         {
-            /* Get back-off value (in seconds) for the next connection retry. */
-            xBackoffAlgStatus = BackoffAlgorithm_GetNextBackoff( &xReconnectParams,
-                                                                 uxRand(),
-                                                                 &usNextRetryBackOff );
-
-            if( xBackoffAlgStatus == BackoffAlgorithmSuccess )
-            {
-                LogWarn( "Disconnected from the MQTT Broker. Retrying in %lu ms.",
-                         RETRY_BACKOFF_MULTIPLIER * usNextRetryBackOff );
-
-                vTaskDelay( pdMS_TO_TICKS( RETRY_BACKOFF_MULTIPLIER * usNextRetryBackOff ) );
-            }
-            else
-            {
-                LogError( "Reconnect limit reached. Will exit..." );
-                xExitFlag = pdTRUE;
-            }
+            xFailureClass = RECONNECT_CLASS_NETWORK_DOWN;
         }
+
+        vReconnectWait( ulReconnectOnFailure( &xReconnectSched, xFailureClass ) );
     }
 
+    net_set_link_lost_callback( NULL, NULL );
+
     if( pxCtx != NULL )
     {
         prvFreeAgentTaskCtx( pxCtx );
@@ -1260,7 +2522,8 @@ void vMQTTAgentTask( void * pvParameters )
         pxNetworkContext = NULL;
     }
 
-    ( void ) xEventGroupClearBits( xSystemEvents, EVT_MASK_MQTT_INIT | EVT_MASK_MQTT_CONNECTED );
+    prvSetAgentState( MQTT_AGENT_STATE_DISCONNECTED );
+    ( void ) xEventGroupClearBits( xSystemEvents, EVT_MASK_MQTT_INIT );
 
     LogError( "Terminating MqttAgentTask." );
 
@@ -1276,284 +2539,617 @@ static uint32_t prvGetTimeMs( void )
     /* Determine the elapsed time in the application */
     ulTimeMs = ( uint32_t ) ( xTaskGetTickCount() * portTICK_PERIOD_MS ) - ulGlobalEntryTimeMs;
 
-    return ulTimeMs;
-}
+    return ulTimeMs;
+}
+
+/*-----------------------------------------------------------*/
+
+static inline MQTTQoS_t prvGetNewQoS( MQTTQoS_t xCurrentQoS,
+                                      MQTTQoS_t xRequestedQoS )
+{
+    MQTTQoS_t xNewQoS;
+
+    if( xCurrentQoS == xRequestedQoS )
+    {
+        xNewQoS = xCurrentQoS;
+    }
+    /* Otherwise, upgrade to QoS1 */
+    else
+    {
+        xNewQoS = MQTTQoS1;
+    }
+
+    return xNewQoS;
+}
+
+/*-----------------------------------------------------------*/
+
+static inline bool prvValidateQoS( MQTTQoS_t xQoS )
+{
+    return( xQoS == MQTTQoS0 || xQoS == MQTTQoS1 || xQoS == MQTTQoS2 );
+}
+
+
+/*-----------------------------------------------------------*/
+
+static void prvSubscribeRqCallback( MQTTAgentCommandContext_t * pxCommandContext,
+                                    MQTTAgentReturnInfo_t * pxReturnInfo )
+{
+    TaskHandle_t xTaskHandle = ( TaskHandle_t ) pxCommandContext;
+
+    configASSERT( pxReturnInfo );
+
+    if( xTaskHandle != NULL )
+    {
+        uint32_t ulNotifyValue = ( pxReturnInfo->returnCode & 0xFFFFFF );
+
+        if( pxReturnInfo->pSubackCodes )
+        {
+            ulNotifyValue += ( pxReturnInfo->pSubackCodes[ 0 ] << 24 );
+        }
+
+        ( void ) xTaskNotifyIndexed( xTaskHandle,
+                                     MQTT_AGENT_NOTIFY_IDX,
+                                     ulNotifyValue,
+                                     eSetValueWithOverwrite );
+    }
+}
+
+/*-----------------------------------------------------------*/
+
+static inline MQTTStatus_t prvSendSubRequest( MQTTAgentContext_t * pxAgentCtx,
+                                              MQTTSubscribeInfo_t * pxSubInfo,
+                                              MQTTSubAckStatus_t * pxSubAckStatus,
+                                              TickType_t xTimeout )
+{
+    MQTTStatus_t xStatus;
+
+    MQTTAgentSubscribeArgs_t xSubscribeArgs =
+    {
+        .numSubscriptions = 1,
+        .pSubscribeInfo   = pxSubInfo,
+    };
+
+    MQTTAgentCommandInfo_t xCommandInfo =
+    {
+        .blockTimeMs                 = xTimeout,
+        .cmdCompleteCallback         = prvSubscribeRqCallback,
+        .pCmdCompleteCallbackContext = ( void * ) ( xTaskGetCurrentTaskHandle() ),
+    };
+
+    configASSERT( pxAgentCtx );
+    configASSERT( pxSubInfo );
+    configASSERT( pxSubAckStatus );
+
+    ( void ) xTaskNotifyStateClearIndexed( NULL, MQTT_AGENT_NOTIFY_IDX );
+
+    xStatus = MQTTAgent_Subscribe( pxAgentCtx, &xSubscribeArgs, &xCommandInfo );
+
+    LogInfo( "MQTT Subscribe, filter=\"%.*s\"", pxSubInfo->topicFilterLength, pxSubInfo->pTopicFilter );
+
+    if( xStatus == MQTTSuccess )
+    {
+        uint32_t ulNotifyValue = 0;
+
+        if( xTaskNotifyWaitIndexed( MQTT_AGENT_NOTIFY_IDX,
+                                    0x0,
+                                    0xFFFFFFFF,
+                                    &ulNotifyValue,
+                                    xTimeout ) )
+        {
+            *pxSubAckStatus = ( ulNotifyValue >> 24 );
+            xStatus = ( ulNotifyValue & 0x00FFFFFF );
+        }
+        else
+        {
+            xStatus = MQTTKeepAliveTimeout;
+        }
+    }
+
+    return xStatus;
+}
+
+/*-----------------------------------------------------------*/
+
+/*
+ * @brief Add a callback and, if needed, a subscription entry for pcTopicFilter.
+ * Called with the subscription manager mutex held.
+ *
+ * @param[out] puxSubIdx Index of the subscription entry. Its SubAck status is
+ * MQTTSubAckFailure if a SUBSCRIBE needs to be sent.
+ */
+static MQTTStatus_t prvAddSubscription( SubMgrCtx_t * pxCtx,
+                                        const char * pcTopicFilter,
+                                        size_t xTopicFilterLen,
+                                        MQTTQoS_t xRequestedQoS,
+                                        IncomingPubCallback_t pxCallback,
+                                        void * pvCallbackCtx,
+                                        QueueHandle_t xDeliveryQueue,
+                                        size_t * puxSubIdx )
+{
+    size_t uxTargetSubIdx = MQTT_AGENT_MAX_SUBSCRIPTIONS;
+    size_t uxTargetCbIdx = MQTT_AGENT_MAX_CALLBACKS;
+    MQTTStatus_t xStatus;
+
+    configASSERT( MUTEX_IS_OWNED( pxCtx->xMutex ) );
+
+    /* If no slot is found, return MQTTNoMemory */
+    xStatus = MQTTNoMemory;
+
+    for( size_t uxSubIdx = 0U; uxSubIdx < MQTT_AGENT_MAX_SUBSCRIPTIONS; uxSubIdx++ )
+    {
+        MQTTSubscribeInfo_t * const pxSubInfo = &( pxCtx->pxSubscriptions[ uxSubIdx ] );
+
+        if( ( pxCtx->pxSubscriptions[ uxSubIdx ].pTopicFilter == NULL ) &&
+            ( uxTargetSubIdx == MQTT_AGENT_MAX_SUBSCRIPTIONS ) )
+        {
+            /* Check that the current context is indeed empty */
+            configASSERT( pxCtx->pxSubscriptions[ uxSubIdx ].topicFilterLength == 0 );
+
+            uxTargetSubIdx = uxSubIdx;
+            xStatus = MQTTSuccess;
+
+            /* Reset SubAckStatus to trigger a subscribe op */
+            pxCtx->pxSubAckStatus[ uxTargetSubIdx ] = MQTTSubAckFailure;
+        }
+        else if( strncmp( pxSubInfo->pTopicFilter, pcTopicFilter, pxSubInfo->topicFilterLength ) == 0 )
+        {
+            xRequestedQoS = prvGetNewQoS( pxSubInfo->qos, xRequestedQoS );
+            xStatus = MQTTSuccess;
+            uxTargetSubIdx = uxSubIdx;
+
+            /* If QoS differs, trigger a subscribe op */
+            if( pxSubInfo->qos != xRequestedQoS )
+            {
+                pxCtx->pxSubAckStatus[ uxTargetSubIdx ] = MQTTSubAckFailure;
+            }
+
+            break;
+        }
+        else
+        {
+            /* Empty */
+        }
+    }
+
+    /* Add Callback to list */
+    if( xStatus == MQTTSuccess )
+    {
+        /* If no slot is found, return MQTTNoMemory */
+        xStatus = MQTTNoMemory;
+
+        /* Find matching or empty callback context */
+        for( size_t uxCbIdx = 0U; uxCbIdx < MQTT_AGENT_MAX_CALLBACKS; uxCbIdx++ )
+        {
+            if( ( uxTargetCbIdx == MQTT_AGENT_MAX_CALLBACKS ) &&
+                ( pxCtx->pxCallbacks[ uxCbIdx ].pxSubInfo == NULL ) )
+            {
+                uxTargetCbIdx = uxCbIdx;
+                xStatus = MQTTSuccess;
+            }
+            else if( prvMatchCbCtx( &( pxCtx->pxCallbacks[ uxCbIdx ] ),
+                                    &( pxCtx->pxSubscriptions[ uxTargetSubIdx ] ),
+                                    pxCallback,
+                                    pvCallbackCtx ) )
+            {
+                uxTargetCbIdx = uxCbIdx;
+                xStatus = MQTTSuccess;
+                break;
+            }
+        }
+    }
+
+    /*
+     * Populate the subscription entry (by copying topic filter to heap)
+     */
+    if( ( xStatus == MQTTSuccess ) &&
+        ( pxCtx->pxSubAckStatus[ uxTargetSubIdx ] == MQTTSubAckFailure ) )
+    {
+        if( pxCtx->pxSubscriptions[ uxTargetSubIdx ].pTopicFilter == NULL )
+        {
+            char * pcDupTopicFilter = pvPortMalloc( xTopicFilterLen + 1 );
+
+            if( pcDupTopicFilter == NULL )
+            {
+                xStatus = MQTTNoMemory;
+            }
+            else
+            {
+                ( void ) strncpy( pcDupTopicFilter, pcTopicFilter, xTopicFilterLen + 1 );
+
+                /* Ensure null terminated */
+                pcDupTopicFilter[ xTopicFilterLen ] = '\00';
+
+                pxCtx->pxSubscriptions[ uxTargetSubIdx ].pTopicFilter = pcDupTopicFilter;
+                pxCtx->pxSubscriptions[ uxTargetSubIdx ].topicFilterLength = ( uint16_t ) xTopicFilterLen;
+
+                pxCtx->uxSubscriptionCount++;
+            }
+        }
+
+        pxCtx->pxSubscriptions[ uxTargetSubIdx ].qos = xRequestedQoS;
+    }
+
+    /*
+     * Populate the callback entry
+     */
+    if( ( xStatus == MQTTSuccess ) &&
+        ( pxCtx->pxCallbacks[ uxTargetCbIdx ].pxSubInfo == NULL ) )
+    {
+        pxCtx->pxCallbacks[ uxTargetCbIdx ].pxSubInfo = &( pxCtx->pxSubscriptions[ uxTargetSubIdx ] );
+        pxCtx->pxCallbacks[ uxTargetCbIdx ].xTaskHandle = xTaskGetCurrentTaskHandle();
+        pxCtx->pxCallbacks[ uxTargetCbIdx ].pxIncomingPublishCallback = pxCallback;
+        pxCtx->pxCallbacks[ uxTargetCbIdx ].pvIncomingPublishCallbackContext = pvCallbackCtx;
+        pxCtx->pxCallbacks[ uxTargetCbIdx ].xDeliveryQueue = xDeliveryQueue;
+
+        /* Increment subscription reference count. */
+        pxCtx->pulSubCbCount[ uxTargetSubIdx ]++;
+
+        pxCtx->uxCallbackCount++;
+
+        prvRebuildTopicTrie( pxCtx );
+
+        LogInfo( "Callback registered with filter=\"%.*s\".", xTopicFilterLen, pcTopicFilter );
+    }
+
+    *puxSubIdx = uxTargetSubIdx;
+
+    return xStatus;
+}
+
+/*-----------------------------------------------------------*/
+
+static MQTTStatus_t prvSubscribeSync( MQTTAgentHandle_t xHandle,
+                                      const char * pcTopicFilter,
+                                      MQTTQoS_t xRequestedQoS,
+                                      IncomingPubCallback_t pxCallback,
+                                      void * pvCallbackCtx,
+                                      QueueHandle_t xDeliveryQueue )
+{
+    MQTTStatus_t xStatus = MQTTSuccess;
+    size_t xTopicFilterLen = 0;
+    MQTTAgentTaskCtx_t * pxTaskCtx = ( MQTTAgentTaskCtx_t * ) xHandle;
+    SubMgrCtx_t * pxCtx = &( pxTaskCtx->xSubMgrCtx );
+
+    if( ( xHandle == NULL ) ||
+        ( pcTopicFilter == NULL ) ||
+        ( pxCallback == NULL ) ||
+        !prvValidateQoS( xRequestedQoS ) )
+    {
+        xStatus = MQTTBadParameter;
+    }
+    else /* pcTopicFilter != NULL */
+    {
+        xTopicFilterLen = strnlen( pcTopicFilter, UINT16_MAX );
+    }
+
+    if( ( xTopicFilterLen == 0 ) || ( xTopicFilterLen >= UINT16_MAX ) )
+    {
+        xStatus = MQTTBadParameter;
+    }
+
+    /* Acquire mutex */
+    if( ( xStatus == MQTTSuccess ) &&
+        xLockSubCtx( pxCtx ) )
+    {
+        size_t uxTargetSubIdx = MQTT_AGENT_MAX_SUBSCRIPTIONS;
 
-/*-----------------------------------------------------------*/
+        xStatus = prvAddSubscription( pxCtx, pcTopicFilter, xTopicFilterLen,
+                                      xRequestedQoS, pxCallback, pvCallbackCtx,
+                                      xDeliveryQueue, &uxTargetSubIdx );
 
-static inline MQTTQoS_t prvGetNewQoS( MQTTQoS_t xCurrentQoS,
-                                      MQTTQoS_t xRequestedQoS )
-{
-    MQTTQoS_t xNewQoS;
+        ( void ) xUnlockSubCtx( pxCtx );
 
-    if( xCurrentQoS == xRequestedQoS )
-    {
-        xNewQoS = xCurrentQoS;
+        if( ( xStatus == MQTTSuccess ) &&
+            ( pxCtx->pxSubAckStatus[ uxTargetSubIdx ] == MQTTSubAckFailure ) )
+        {
+            xStatus = prvSendSubRequest( &( pxTaskCtx->xAgentContext ),
+                                         &( pxCtx->pxSubscriptions[ uxTargetSubIdx ] ),
+                                         &( pxCtx->pxSubAckStatus[ uxTargetSubIdx ] ),
+                                         portMAX_DELAY );
+        }
     }
-    /* Otherwise, upgrade to QoS1 */
     else
     {
-        xNewQoS = MQTTQoS1;
+        xStatus = MQTTIllegalState;
+        LogError( "Failed to acquire MQTTAgent mutex." );
     }
 
-    return xNewQoS;
+    return xStatus;
 }
 
 /*-----------------------------------------------------------*/
 
-static inline bool prvValidateQoS( MQTTQoS_t xQoS )
+MQTTStatus_t MqttAgent_SubscribeSync( MQTTAgentHandle_t xHandle,
+                                      const char * pcTopicFilter,
+                                      MQTTQoS_t xRequestedQoS,
+                                      IncomingPubCallback_t pxCallback,
+                                      void * pvCallbackCtx )
 {
-    return( xQoS == MQTTQoS0 || xQoS == MQTTQoS1 || xQoS == MQTTQoS2 );
+    return prvSubscribeSync( xHandle, pcTopicFilter, xRequestedQoS,
+                             pxCallback, pvCallbackCtx, NULL );
 }
 
-
 /*-----------------------------------------------------------*/
 
-static void prvSubscribeRqCallback( MQTTAgentCommandContext_t * pxCommandContext,
-                                    MQTTAgentReturnInfo_t * pxReturnInfo )
+MQTTStatus_t MqttAgent_SubscribeSyncDeferred( MQTTAgentHandle_t xHandle,
+                                              const char * pcTopicFilter,
+                                              MQTTQoS_t xRequestedQoS,
+                                              IncomingPubCallback_t pxCallback,
+                                              void * pvCallbackCtx,
+                                              QueueHandle_t xDeliveryQueue )
 {
-    TaskHandle_t xTaskHandle = ( TaskHandle_t ) pxCommandContext;
-
-    configASSERT( pxReturnInfo );
+    MQTTStatus_t xStatus = MQTTBadParameter;
 
-    if( xTaskHandle != NULL )
+    if( xDeliveryQueue != NULL )
     {
-        uint32_t ulNotifyValue = ( pxReturnInfo->returnCode & 0xFFFFFF );
-
-        if( pxReturnInfo->pSubackCodes )
-        {
-            ulNotifyValue += ( pxReturnInfo->pSubackCodes[ 0 ] << 24 );
-        }
-
-        ( void ) xTaskNotifyIndexed( xTaskHandle,
-                                     MQTT_AGENT_NOTIFY_IDX,
-                                     ulNotifyValue,
-                                     eSetValueWithOverwrite );
+        xStatus = prvSubscribeSync( xHandle, pcTopicFilter, xRequestedQoS,
+                                    pxCallback, pvCallbackCtx, xDeliveryQueue );
     }
+
+    return xStatus;
 }
 
 /*-----------------------------------------------------------*/
 
-static inline MQTTStatus_t prvSendSubRequest( MQTTAgentContext_t * pxAgentCtx,
-                                              MQTTSubscribeInfo_t * pxSubInfo,
-                                              MQTTSubAckStatus_t * pxSubAckStatus,
-                                              TickType_t xTimeout )
+typedef struct
 {
-    MQTTStatus_t xStatus;
-
-    MQTTAgentSubscribeArgs_t xSubscribeArgs =
-    {
-        .numSubscriptions = 1,
-        .pSubscribeInfo   = pxSubInfo,
-    };
+    SubMgrCtx_t * pxSubMgrCtx;
+    SubscribeCompleteCallback_t xCallback;
+    void * pvCallbackCtx;
+    MQTTAgentSubscribeArgs_t xSubscribeArgs;
+    MQTTSubscribeInfo_t pxSubInfo[]; /* Referenced by the agent until the SUBACK arrives */
+} AsyncSubscribeCtx_t;
 
-    MQTTAgentCommandInfo_t xCommandInfo =
-    {
-        .blockTimeMs                 = xTimeout,
-        .cmdCompleteCallback         = prvSubscribeRqCallback,
-        .pCmdCompleteCallbackContext = ( void * ) ( xTaskGetCurrentTaskHandle() ),
-    };
+/*-----------------------------------------------------------*/
 
-    configASSERT( pxAgentCtx );
-    configASSERT( pxSubInfo );
-    configASSERT( pxSubAckStatus );
+static void prvSubscribeAsyncCallback( MQTTAgentCommandContext_t * pxCommandContext,
+                                       MQTTAgentReturnInfo_t * pxReturnInfo )
+{
+    AsyncSubscribeCtx_t * pxAsyncCtx = ( AsyncSubscribeCtx_t * ) pxCommandContext;
+    SubMgrCtx_t * pxCtx = NULL;
+    MQTTStatus_t xStatus = MQTTSuccess;
 
-    ( void ) xTaskNotifyStateClearIndexed( NULL, MQTT_AGENT_NOTIFY_IDX );
+    configASSERT( pxAsyncCtx != NULL );
+    configASSERT( pxReturnInfo != NULL );
 
-    xStatus = MQTTAgent_Subscribe( pxAgentCtx, &xSubscribeArgs, &xCommandInfo );
+    pxCtx = pxAsyncCtx->pxSubMgrCtx;
+    xStatus = pxReturnInfo->returnCode;
 
-    LogInfo( "MQTT Subscribe, filter=\"%.*s\"", pxSubInfo->topicFilterLength, pxSubInfo->pTopicFilter );
+    if( xStatus != MQTTSuccess )
+    {
+        LogError( "Subscribe request for %u topic filters failed. xStatus=%s.",
+                  pxAsyncCtx->xSubscribeArgs.numSubscriptions,
+                  MQTT_Status_strerror( xStatus ) );
+    }
 
-    if( xStatus == MQTTSuccess )
+    for( size_t uxIdx = 0U; ( pxReturnInfo->returnCode == MQTTSuccess ) &&
+         ( uxIdx < pxAsyncCtx->xSubscribeArgs.numSubscriptions ); uxIdx++ )
     {
-        uint32_t ulNotifyValue = 0;
+        MQTTSubAckStatus_t xSubAck = pxReturnInfo->pSubackCodes[ uxIdx ];
 
-        if( xTaskNotifyWaitIndexed( MQTT_AGENT_NOTIFY_IDX,
-                                    0x0,
-                                    0xFFFFFFFF,
-                                    &ulNotifyValue,
-                                    xTimeout ) )
+        /* Entries may have been moved by a compress since the request was sent */
+        for( size_t uxSubIdx = 0U; uxSubIdx < MQTT_AGENT_MAX_SUBSCRIPTIONS; uxSubIdx++ )
         {
-            *pxSubAckStatus = ( ulNotifyValue >> 24 );
-            xStatus = ( ulNotifyValue & 0x00FFFFFF );
+            if( pxCtx->pxSubscriptions[ uxSubIdx ].pTopicFilter == pxAsyncCtx->pxSubInfo[ uxIdx ].pTopicFilter )
+            {
+                pxCtx->pxSubAckStatus[ uxSubIdx ] = xSubAck;
+                break;
+            }
         }
-        else
+
+        if( xSubAck == MQTTSubAckFailure )
         {
-            xStatus = MQTTKeepAliveTimeout;
+            LogError( "Broker rejected subscription to topic filter \"%.*s\".",
+                      pxAsyncCtx->pxSubInfo[ uxIdx ].topicFilterLength,
+                      pxAsyncCtx->pxSubInfo[ uxIdx ].pTopicFilter );
+            xStatus = MQTTServerRefused;
         }
     }
 
-    return xStatus;
+    if( pxAsyncCtx->xCallback != NULL )
+    {
+        pxAsyncCtx->xCallback( pxAsyncCtx->pvCallbackCtx, xStatus );
+    }
+
+    vPortFree( pxAsyncCtx );
 }
 
 /*-----------------------------------------------------------*/
 
-MQTTStatus_t MqttAgent_SubscribeSync( MQTTAgentHandle_t xHandle,
-                                      const char * pcTopicFilter,
-                                      MQTTQoS_t xRequestedQoS,
-                                      IncomingPubCallback_t pxCallback,
-                                      void * pvCallbackCtx )
+MQTTStatus_t MqttAgent_SubscribeAsync( MQTTAgentHandle_t xHandle,
+                                       const SubscribeRequest_t * pxRequests,
+                                       size_t uxRequestCount,
+                                       SubscribeCompleteCallback_t xCompleteCallback,
+                                       void * pvCompleteCtx )
 {
     MQTTStatus_t xStatus = MQTTSuccess;
-    size_t xTopicFilterLen = 0;
     MQTTAgentTaskCtx_t * pxTaskCtx = ( MQTTAgentTaskCtx_t * ) xHandle;
-    SubMgrCtx_t * pxCtx = &( pxTaskCtx->xSubMgrCtx );
+    SubMgrCtx_t * pxCtx = NULL;
+    AsyncSubscribeCtx_t * pxAsyncCtx = NULL;
 
     if( ( xHandle == NULL ) ||
-        ( pcTopicFilter == NULL ) ||
-        ( pxCallback == NULL ) ||
-        !prvValidateQoS( xRequestedQoS ) )
-    {
-        xStatus = MQTTBadParameter;
-    }
-    else /* pcTopicFilter != NULL */
-    {
-        xTopicFilterLen = strnlen( pcTopicFilter, UINT16_MAX );
-    }
-
-    if( ( xTopicFilterLen == 0 ) || ( xTopicFilterLen >= UINT16_MAX ) )
+        ( pxRequests == NULL ) ||
+        ( uxRequestCount == 0U ) ||
+        ( uxRequestCount > MQTT_AGENT_MAX_SUBSCRIPTIONS ) )
     {
         xStatus = MQTTBadParameter;
     }
-
-    /* Acquire mutex */
-    if( ( xStatus == MQTTSuccess ) &&
-        xLockSubCtx( pxCtx ) )
+    else
     {
-        size_t uxTargetSubIdx = MQTT_AGENT_MAX_SUBSCRIPTIONS;
-        size_t uxTargetCbIdx = MQTT_AGENT_MAX_CALLBACKS;
-
-        /* If no slot is found, return MQTTNoMemory */
-        xStatus = MQTTNoMemory;
+        pxCtx = &( pxTaskCtx->xSubMgrCtx );
 
-        for( size_t uxSubIdx = 0U; uxSubIdx < MQTT_AGENT_MAX_SUBSCRIPTIONS; uxSubIdx++ )
+        for( size_t uxIdx = 0U; ( uxIdx < uxRequestCount ) && ( xStatus == MQTTSuccess ); uxIdx++ )
         {
-            MQTTSubscribeInfo_t * const pxSubInfo = &( pxCtx->pxSubscriptions[ uxSubIdx ] );
+            size_t xTopicFilterLen = 0;
 
-            if( ( pxCtx->pxSubscriptions[ uxSubIdx ].pTopicFilter == NULL ) &&
-                ( uxTargetSubIdx == MQTT_AGENT_MAX_SUBSCRIPTIONS ) )
+            if( pxRequests[ uxIdx ].pcTopicFilter != NULL )
             {
-                /* Check that the current context is indeed empty */
-                configASSERT( pxCtx->pxSubscriptions[ uxSubIdx ].topicFilterLength == 0 );
-
-                uxTargetSubIdx = uxSubIdx;
-                xStatus = MQTTSuccess;
-
-                /* Reset SubAckStatus to trigger a subscribe op */
-                pxCtx->pxSubAckStatus[ uxTargetSubIdx ] = MQTTSubAckFailure;
+                xTopicFilterLen = strnlen( pxRequests[ uxIdx ].pcTopicFilter, UINT16_MAX );
             }
-            else if( strncmp( pxSubInfo->pTopicFilter, pcTopicFilter, pxSubInfo->topicFilterLength ) == 0 )
-            {
-                xRequestedQoS = prvGetNewQoS( pxSubInfo->qos, xRequestedQoS );
-                xStatus = MQTTSuccess;
-                uxTargetSubIdx = uxSubIdx;
-
-                /* If QoS differs, trigger a subscribe op */
-                if( pxSubInfo->qos != xRequestedQoS )
-                {
-                    pxCtx->pxSubAckStatus[ uxTargetSubIdx ] = MQTTSubAckFailure;
-                }
 
-                break;
-            }
-            else
+            if( ( pxRequests[ uxIdx ].pxCallback == NULL ) ||
+                !prvValidateQoS( pxRequests[ uxIdx ].xRequestedQoS ) ||
+                ( xTopicFilterLen == 0 ) ||
+                ( xTopicFilterLen >= UINT16_MAX ) )
             {
-                /* Empty */
+                xStatus = MQTTBadParameter;
             }
         }
+    }
 
-        /* Add Callback to list */
-        if( xStatus == MQTTSuccess )
+    if( xStatus == MQTTSuccess )
+    {
+        pxAsyncCtx = pvPortMalloc( sizeof( AsyncSubscribeCtx_t ) + ( uxRequestCount * sizeof( MQTTSubscribeInfo_t ) ) );
+
+        if( pxAsyncCtx == NULL )
         {
-            /* If no slot is found, return MQTTNoMemory */
+            LogError( "Failed to allocate an asynchronous subscribe context." );
             xStatus = MQTTNoMemory;
-
-            /* Find matching or empty callback context */
-            for( size_t uxCbIdx = 0U; uxCbIdx < MQTT_AGENT_MAX_CALLBACKS; uxCbIdx++ )
-            {
-                if( ( uxTargetCbIdx == MQTT_AGENT_MAX_CALLBACKS ) &&
-                    ( pxCtx->pxCallbacks[ uxCbIdx ].pxSubInfo == NULL ) )
-                {
-                    uxTargetCbIdx = uxCbIdx;
-                    xStatus = MQTTSuccess;
-                }
-                else if( prvMatchCbCtx( &( pxCtx->pxCallbacks[ uxCbIdx ] ),
-                                        &( pxCtx->pxSubscriptions[ uxTargetSubIdx ] ),
-                                        pxCallback,
-                                        pvCallbackCtx ) )
-                {
-                    uxTargetCbIdx = uxCbIdx;
-                    xStatus = MQTTSuccess;
-                    break;
-                }
-            }
         }
+        else
+        {
+            pxAsyncCtx->pxSubMgrCtx = pxCtx;
+            pxAsyncCtx->xCallback = xCompleteCallback;
+            pxAsyncCtx->pvCallbackCtx = pvCompleteCtx;
+            pxAsyncCtx->xSubscribeArgs.pSubscribeInfo = pxAsyncCtx->pxSubInfo;
+            pxAsyncCtx->xSubscribeArgs.numSubscriptions = 0U;
+        }
+    }
 
-        /*
-         * Populate the subscription entry (by copying topic filter to heap)
-         */
-        if( ( xStatus == MQTTSuccess ) &&
-            ( pxCtx->pxSubAckStatus[ uxTargetSubIdx ] == MQTTSubAckFailure ) )
+    if( xStatus == MQTTSuccess )
+    {
+        if( xLockSubCtx( pxCtx ) )
         {
-            if( pxCtx->pxSubscriptions[ uxTargetSubIdx ].pTopicFilter == NULL )
+            for( size_t uxIdx = 0U; ( uxIdx < uxRequestCount ) && ( xStatus == MQTTSuccess ); uxIdx++ )
             {
-                char * pcDupTopicFilter = pvPortMalloc( xTopicFilterLen + 1 );
+                size_t uxSubIdx = MQTT_AGENT_MAX_SUBSCRIPTIONS;
 
-                if( pcDupTopicFilter == NULL )
-                {
-                    xStatus = MQTTNoMemory;
-                }
-                else
-                {
-                    ( void ) strncpy( pcDupTopicFilter, pcTopicFilter, xTopicFilterLen + 1 );
+                xStatus = prvAddSubscription( pxCtx,
+                                              pxRequests[ uxIdx ].pcTopicFilter,
+                                              strnlen( pxRequests[ uxIdx ].pcTopicFilter, UINT16_MAX ),
+                                              pxRequests[ uxIdx ].xRequestedQoS,
+                                              pxRequests[ uxIdx ].pxCallback,
+                                              pxRequests[ uxIdx ].pvCallbackCtx,
+                                              NULL,
+                                              &uxSubIdx );
 
-                    /* Ensure null terminated */
-                    pcDupTopicFilter[ xTopicFilterLen ] = '\00';
+                if( ( xStatus == MQTTSuccess ) &&
+                    ( pxCtx->pxSubAckStatus[ uxSubIdx ] == MQTTSubAckFailure ) )
+                {
+                    bool xDuplicate = false;
 
-                    pxCtx->pxSubscriptions[ uxTargetSubIdx ].pTopicFilter = pcDupTopicFilter;
-                    pxCtx->pxSubscriptions[ uxTargetSubIdx ].topicFilterLength = ( uint16_t ) xTopicFilterLen;
+                    /* The same filter may appear more than once in pxRequests */
+                    for( size_t uxPrev = 0U; uxPrev < pxAsyncCtx->xSubscribeArgs.numSubscriptions; uxPrev++ )
+                    {
+                        if( pxAsyncCtx->pxSubInfo[ uxPrev ].pTopicFilter == pxCtx->pxSubscriptions[ uxSubIdx ].pTopicFilter )
+                        {
+                            pxAsyncCtx->pxSubInfo[ uxPrev ].qos = pxCtx->pxSubscriptions[ uxSubIdx ].qos;
+                            xDuplicate = true;
+                        }
+                    }
 
-                    pxCtx->uxSubscriptionCount++;
+                    if( !xDuplicate )
+                    {
+                        pxAsyncCtx->pxSubInfo[ pxAsyncCtx->xSubscribeArgs.numSubscriptions ] = pxCtx->pxSubscriptions[ uxSubIdx ];
+                        pxAsyncCtx->xSubscribeArgs.numSubscriptions++;
+                    }
                 }
             }
 
-            pxCtx->pxSubscriptions[ uxTargetSubIdx ].qos = xRequestedQoS;
+            ( void ) xUnlockSubCtx( pxCtx );
+        }
+        else
+        {
+            xStatus = MQTTIllegalState;
+            LogError( "Failed to acquire MQTTAgent mutex." );
         }
+    }
 
-        /*
-         * Populate the callback entry
-         */
-        if( ( xStatus == MQTTSuccess ) &&
-            ( pxCtx->pxCallbacks[ uxTargetCbIdx ].pxSubInfo == NULL ) )
+    if( ( xStatus == MQTTSuccess ) &&
+        ( pxAsyncCtx->xSubscribeArgs.numSubscriptions > 0U ) )
+    {
+        MQTTAgentCommandInfo_t xCommandInfo =
         {
-            pxCtx->pxCallbacks[ uxTargetCbIdx ].pxSubInfo = &( pxCtx->pxSubscriptions[ uxTargetSubIdx ] );
-            pxCtx->pxCallbacks[ uxTargetCbIdx ].xTaskHandle = xTaskGetCurrentTaskHandle();
-            pxCtx->pxCallbacks[ uxTargetCbIdx ].pxIncomingPublishCallback = pxCallback;
-            pxCtx->pxCallbacks[ uxTargetCbIdx ].pvIncomingPublishCallbackContext = pvCallbackCtx;
+            .blockTimeMs                 = portMAX_DELAY,
+            .cmdCompleteCallback         = prvSubscribeAsyncCallback,
+            .pCmdCompleteCallbackContext = ( MQTTAgentCommandContext_t * ) pxAsyncCtx,
+        };
 
-            /* Increment subscription reference count. */
-            pxCtx->pulSubCbCount[ uxTargetSubIdx ]++;
+        LogInfo( "MQTT Subscribe, %u topic filters.", pxAsyncCtx->xSubscribeArgs.numSubscriptions );
 
-            pxCtx->uxCallbackCount++;
+        xStatus = MQTTAgent_Subscribe( &( pxTaskCtx->xAgentContext ),
+                                       &( pxAsyncCtx->xSubscribeArgs ),
+                                       &xCommandInfo );
 
-            LogInfo( "Callback registered with filter=\"%.*s\".", xTopicFilterLen, pcTopicFilter );
+        if( xStatus == MQTTSuccess )
+        {
+            /* Freed by prvSubscribeAsyncCallback */
+            pxAsyncCtx = NULL;
         }
-
-        ( void ) xUnlockSubCtx( pxCtx );
-
-        if( ( xStatus == MQTTSuccess ) &&
-            ( pxCtx->pxSubAckStatus[ uxTargetSubIdx ] == MQTTSubAckFailure ) )
+        else
         {
-            xStatus = prvSendSubRequest( &( pxTaskCtx->xAgentContext ),
-                                         &( pxCtx->pxSubscriptions[ uxTargetSubIdx ] ),
-                                         &( pxCtx->pxSubAckStatus[ uxTargetSubIdx ] ),
-                                         portMAX_DELAY );
+            LogError( "Failed to enqueue the MQTT subscribe command. xStatus=%s.",
+                      MQTT_Status_strerror( xStatus ) );
         }
     }
+    else if( ( xStatus == MQTTSuccess ) &&
+             ( xCompleteCallback != NULL ) )
+    {
+        /* Every filter was already subscribed */
+        xCompleteCallback( pvCompleteCtx, MQTTSuccess );
+    }
     else
     {
-        xStatus = MQTTIllegalState;
-        LogError( "Failed to acquire MQTTAgent mutex." );
+        /* Empty */
+    }
+
+    if( pxAsyncCtx != NULL )
+    {
+        vPortFree( pxAsyncCtx );
+    }
+
+    return xStatus;
+}
+
+/*-----------------------------------------------------------*/
+
+static void prvSubscribeMultiSyncCallback( void * pvCtx,
+                                           MQTTStatus_t xStatus )
+{
+    TaskHandle_t xTaskHandle = ( TaskHandle_t ) pvCtx;
+
+    ( void ) xTaskNotifyIndexed( xTaskHandle,
+                                 MQTT_AGENT_NOTIFY_IDX,
+                                 ( uint32_t ) xStatus,
+                                 eSetValueWithOverwrite );
+}
+
+/*-----------------------------------------------------------*/
+
+MQTTStatus_t MqttAgent_SubscribeMultiSync( MQTTAgentHandle_t xHandle,
+                                           const SubscribeRequest_t * pxRequests,
+                                           size_t uxRequestCount )
+{
+    MQTTStatus_t xStatus;
+
+    ( void ) xTaskNotifyStateClearIndexed( NULL, MQTT_AGENT_NOTIFY_IDX );
+
+    xStatus = MqttAgent_SubscribeAsync( xHandle, pxRequests, uxRequestCount,
+                                        prvSubscribeMultiSyncCallback,
+                                        ( void * ) xTaskGetCurrentTaskHandle() );
+
+    if( xStatus == MQTTSuccess )
+    {
+        uint32_t ulNotifyValue = 0;
+
+        ( void ) xTaskNotifyWaitIndexed( MQTT_AGENT_NOTIFY_IDX,
+                                         0x0,
+                                         0xFFFFFFFF,
+                                         &ulNotifyValue,
+                                         portMAX_DELAY );
+
+        xStatus = ( MQTTStatus_t ) ulNotifyValue;
     }
 
     return xStatus;
@@ -1561,6 +3157,38 @@ MQTTStatus_t MqttAgent_SubscribeSync( MQTTAgentHandle_t xHandle,
 
 /*-----------------------------------------------------------*/
 
+QueueHandle_t MqttAgent_CreateDeliveryQueue( UBaseType_t uxQueueLength )
+{
+    configASSERT( uxQueueLength > 0 );
+
+    return xQueueCreate( uxQueueLength, sizeof( DeferredPublish_t * ) );
+}
+
+/*-----------------------------------------------------------*/
+
+UBaseType_t MqttAgent_ProcessDeliveryQueue( QueueHandle_t xDeliveryQueue,
+                                            TickType_t xTicksToWait )
+{
+    DeferredPublish_t * pxDeferred = NULL;
+    UBaseType_t uxHandled = 0;
+
+    configASSERT( xDeliveryQueue != NULL );
+
+    while( xQueueReceive( xDeliveryQueue, &pxDeferred, xTicksToWait ) == pdTRUE )
+    {
+        pxDeferred->pxCallback( pxDeferred->pvCallbackCtx, &( pxDeferred->xPublishInfo ) );
+        vPortFree( pxDeferred );
+        uxHandled++;
+
+        /* Only wait for the first publish */
+        xTicksToWait = 0;
+    }
+
+    return uxHandled;
+}
+
+/*-----------------------------------------------------------*/
+
 static void prvAgentRequestCallback( MQTTAgentCommandContext_t * pxCommandContext,
                                      MQTTAgentReturnInfo_t * pxReturnInfo )
 {
@@ -1749,6 +3377,7 @@ MQTTStatus_t MqttAgent_UnSubscribeSync( MQTTAgentHandle_t xHandle,
                         pxCbCtx->pxIncomingPublishCallback = NULL;
                         pxCbCtx->pxSubInfo = NULL;
                         pxCbCtx->xTaskHandle = NULL;
+                        pxCbCtx->xDeliveryQueue = NULL;
 
                         configASSERT( pxCtx->uxCallbackCount > 0 );
 
@@ -1757,6 +3386,7 @@ MQTTStatus_t MqttAgent_UnSubscribeSync( MQTTAgentHandle_t xHandle,
                         LogInfo( "Callback de-registered, filter=\"%.*s\".", xTopicFilterLen, pcTopicFilter );
 
                         prvCompressCallbackList( pxCtx->pxCallbacks, &( pxCtx->uxCallbackCount ) );
+                        prvRebuildTopicTrie( pxCtx );
                         break;
                     }
                 }
@@ -3,6 +3,7 @@
 
 #include "FreeRTOS.h"
 #include <stdbool.h>
+#include <stdint.h>
 
 struct MQTTAgentTaskCtx;
 typedef struct MQTTAgentContext * MQTTAgentHandle_t;
@@ -16,7 +17,87 @@ void vSleepUntilMQTTAgentConnected( void );
 
 bool xIsMqttAgentConnected( void );
 
+/* Number of callbacks that xMqttAgentRegisterStateCallback can hold. */
+#ifndef MQTT_AGENT_MAX_STATE_CALLBACKS
+#define MQTT_AGENT_MAX_STATE_CALLBACKS    8
+#endif
+
+typedef enum
+{
+    MQTT_AGENT_STATE_DISCONNECTED = 0, /* No broker connection, publishes would only fill the command queue */
+    MQTT_AGENT_STATE_CONNECTED,        /* CONNACK received, the subscriptions of a resumed session may be pending */
+    MQTT_AGENT_STATE_RESUBSCRIBED      /* Connected and every earlier subscription is active again */
+} MqttAgentState_t;
+
+/*
+ * @brief Called from the MQTT agent task on every state change.
+ * Must not block, e.g. set a flag, notify a task or schedule a job.
+ */
+typedef void ( * MqttAgentStateCallback_t )( void * pvCtx,
+                                             MqttAgentState_t xState );
+
+MqttAgentState_t xMqttAgentGetState( void );
+
+/*
+ * @brief Block until the agent is in xState, MQTT_AGENT_STATE_CONNECTED is also
+ * satisfied by MQTT_AGENT_STATE_RESUBSCRIBED.
+ * @return pdTRUE if the state was reached within xTicksToWait.
+ */
+BaseType_t xMqttAgentWaitForState( MqttAgentState_t xState,
+                                   TickType_t xTicksToWait );
+
+/*
+ * @brief Register a callback for the state changes of the agent.
+ * The callback is not called for the current state, see xMqttAgentGetState.
+ * @return pdFALSE if all MQTT_AGENT_MAX_STATE_CALLBACKS entries are in use.
+ */
+BaseType_t xMqttAgentRegisterStateCallback( MqttAgentStateCallback_t pxCallback,
+                                            void * pvCtx );
+
+void vMqttAgentUnregisterStateCallback( MqttAgentStateCallback_t pxCallback,
+                                        void * pvCtx );
+
+/* Number of commands waiting in the agent queue, e.g. to let bulk transfers give way to other traffic */
+UBaseType_t uxMqttAgentPendingCommands( void );
+
+/* Drop the broker connection as if the link was lost, so that the agent connects again */
+void vMqttAgentRequestReconnect( void );
+
 void vMQTTAgentTask( void * pvParameters );
 
+/* Set to 1 to collect queue, round trip and event loop timing for the agent. */
+#ifndef MQTT_AGENT_STATS_ENABLED
+#define MQTT_AGENT_STATS_ENABLED        1
+#endif
+
+/* Bucket i of the queue wait histogram counts waits below 64us * 4^i, the last bucket everything above. */
+#define MQTT_AGENT_STATS_HIST_BUCKETS    8
+
+typedef struct MqttAgentStats
+{
+    uint32_t pulQueueWaitHist[ MQTT_AGENT_STATS_HIST_BUCKETS ];
+    uint32_t ulQueueWaitMaxUs;
+    uint32_t ulQueueDepthMax;     /* Most commands seen waiting in the queue on dequeue */
+
+    uint32_t ulPublishAcked;      /* QoS1 / QoS2 publishes completed */
+    uint32_t ulPublishRttTotalMs; /* From the PUBLISH being sent to its acknowledgement completing */
+    uint32_t ulPublishRttMaxMs;
+
+    uint32_t ulLoopIterations;    /* Time spent by the agent between two waits on its queue */
+    uint64_t ullLoopTotalUs;
+    uint32_t ulLoopMaxUs;
+
+    uint32_t ulRecvWakeups;       /* Socket receive notifications */
+    uint32_t ulSpuriousWakeups;   /* Receive notifications for which no data could be read */
+} MqttAgentStats_t;
+
+/*
+ * @brief Get a snapshot of the agent statistics.
+ * @return pdFALSE if MQTT_AGENT_STATS_ENABLED is not set.
+ */
+BaseType_t xMqttAgentGetStats( MqttAgentStats_t * pxStats );
+
+void vMqttAgentResetStats( void );
+
 
 #endif /* ifndef _MQTT_AGENT_TASK_H_ */
@@ -0,0 +1,624 @@
+/*
+ * FreeRTOS STM32 Reference Integration
+ * Copyright (C) 2022 Amazon.com, Inc. or its affiliates.  All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ *
+ * https://www.FreeRTOS.org
+ * https://github.com/FreeRTOS
+ *
+ */
+
+/**
+ * @file mqtt_outbox.c
+ * @brief Store and forward queue for QoS1 publishes, persisted to littlefs.
+ */
+
+#include "logging_levels.h"
+
+#define LOG_LEVEL    LOG_INFO
+#define LOG_MODULE    LOG_MODULE_MQTT
+
+#include "logging.h"
+
+/* Standard includes. */
+#include <string.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <assert.h>
+
+/* Kernel includes. */
+#include "FreeRTOS.h"
+#include "task.h"
+#include "semphr.h"
+
+#include "mqtt_outbox.h"
+
+#if MQTT_OUTBOX_ENABLED == 1
+
+#include "core_mqtt.h"
+#include "core_mqtt_agent.h"
+#include "mqtt_agent_task.h"
+#include "sys_evt.h"
+#include "net/mxchip/mx_netconn.h"
+
+#include "lfs.h"
+#include "fs/lfs_port.h"
+
+static_assert( MQTT_OUTBOX_INFLIGHT < 30U );
+
+#define OUTBOX_NOTIFY_IDX          ( 1U )
+#define OUTBOX_NOTIFY_ENQUEUED     ( 1UL << 31 )
+#define OUTBOX_NOTIFY_DISCONNECTED ( 1UL << 30 )
+#define OUTBOX_PUBLISH_BLOCK_MS    ( 500U )
+#define OUTBOX_IDLE_WAIT_MS        ( 10U * 1000U )
+#define OUTBOX_RECORD_MAGIC        ( 0x4F425831UL ) /* "OBX1" */
+
+/* Directory plus "/" plus 8 hex digits */
+#define OUTBOX_PATH_LEN            ( sizeof( MQTT_OUTBOX_DIR ) + 9U )
+
+typedef struct
+{
+    uint32_t ulMagic;
+    uint16_t usTopicLen;
+    uint16_t usReserved;
+    uint32_t ulPayloadLen;
+} OutboxRecordHeader_t;
+
+typedef struct
+{
+    uint32_t ulSeq;
+    uint8_t * pucRecord; /* Topic followed by payload */
+    MQTTPublishInfo_t xPublishInfo;
+    MQTTStatus_t xStatus;
+    BaseType_t xInUse;
+} OutboxSlot_t;
+
+static SemaphoreHandle_t xOutboxMutex = NULL;
+static TaskHandle_t xOutboxTask = NULL;
+
+/* Sequence number of the oldest stored message and of the next one to be stored */
+static uint32_t ulHeadSeq = 0;
+static uint32_t ulTailSeq = 0;
+
+static OutboxSlot_t xSlots[ MQTT_OUTBOX_INFLIGHT ];
+
+/*-----------------------------------------------------------*/
+
+static inline void vOutboxPath( char * pcPath,
+                                uint32_t ulSeq )
+{
+    ( void ) snprintf( pcPath, OUTBOX_PATH_LEN, "%s/%08lx", MQTT_OUTBOX_DIR, ( unsigned long ) ulSeq );
+}
+
+/*-----------------------------------------------------------*/
+
+static void prvRemoveRecord( lfs_t * pxLfsCtx,
+                             uint32_t ulSeq )
+{
+    char pcPath[ OUTBOX_PATH_LEN ];
+    int lError;
+
+    vOutboxPath( pcPath, ulSeq );
+
+    lError = lfs_remove( pxLfsCtx, pcPath );
+
+    if( ( lError != LFS_ERR_OK ) &&
+        ( lError != LFS_ERR_NOENT ) )
+    {
+        LogError( "Failed to remove %s, error: %d.", pcPath, lError );
+    }
+}
+
+/*-----------------------------------------------------------*/
+
+/* Advance ulHeadSeq past messages that were already removed. Called with the mutex held. */
+static void prvAdvanceHead( lfs_t * pxLfsCtx )
+{
+    char pcPath[ OUTBOX_PATH_LEN ];
+    struct lfs_info xInfo;
+
+    while( ulHeadSeq != ulTailSeq )
+    {
+        vOutboxPath( pcPath, ulHeadSeq );
+
+        if( lfs_stat( pxLfsCtx, pcPath, &xInfo ) == LFS_ERR_OK )
+        {
+            break;
+        }
+
+        ulHeadSeq++;
+    }
+}
+
+/*-----------------------------------------------------------*/
+
+static BaseType_t prvRestore( lfs_t * pxLfsCtx )
+{
+    BaseType_t xSuccess = pdTRUE;
+    struct lfs_info xInfo = { 0 };
+    lfs_dir_t xDir = { 0 };
+    BaseType_t xFound = pdFALSE;
+    uint32_t ulMin = 0;
+    uint32_t ulMax = 0;
+
+    if( lfs_stat( pxLfsCtx, MQTT_OUTBOX_DIR, &xInfo ) == LFS_ERR_NOENT )
+    {
+        if( lfs_mkdir( pxLfsCtx, MQTT_OUTBOX_DIR ) != LFS_ERR_OK )
+        {
+            LogError( "Failed to create %s directory.", MQTT_OUTBOX_DIR );
+            xSuccess = pdFALSE;
+        }
+    }
+    else if( lfs_dir_open( pxLfsCtx, &xDir, MQTT_OUTBOX_DIR ) == LFS_ERR_OK )
+    {
+        while( lfs_dir_read( pxLfsCtx, &xDir, &xInfo ) > 0 )
+        {
+            char * pcEnd = NULL;
+            uint32_t ulSeq;
+
+            if( xInfo.type != LFS_TYPE_REG )
+            {
+                continue;
+            }
+
+            ulSeq = ( uint32_t ) strtoul( xInfo.name, &pcEnd, 16 );
+
+            if( ( pcEnd == xInfo.name ) || ( *pcEnd != '\0' ) )
+            {
+                LogWarn( "Ignoring unexpected file %s in %s.", xInfo.name, MQTT_OUTBOX_DIR );
+            }
+            else if( xFound == pdFALSE )
+            {
+                ulMin = ulSeq;
+                ulMax = ulSeq;
+                xFound = pdTRUE;
+            }
+            else
+            {
+                ulMin = ( ulSeq < ulMin ) ? ulSeq : ulMin;
+                ulMax = ( ulSeq > ulMax ) ? ulSeq : ulMax;
+            }
+        }
+
+        ( void ) lfs_dir_close( pxLfsCtx, &xDir );
+    }
+    else
+    {
+        LogError( "Failed to open %s directory.", MQTT_OUTBOX_DIR );
+        xSuccess = pdFALSE;
+    }
+
+    if( xFound == pdTRUE )
+    {
+        ulHeadSeq = ulMin;
+        ulTailSeq = ulMax + 1;
+        prvAdvanceHead( pxLfsCtx );
+
+        LogInfo( "Restored outbox with %lu pending messages.", ( unsigned long ) ( ulTailSeq - ulHeadSeq ) );
+    }
+
+    return xSuccess;
+}
+
+/*-----------------------------------------------------------*/
+
+BaseType_t xMqttOutboxEnqueue( const char * pcTopic,
+                               size_t uxTopicLen,
+                               const void * pvPayload,
+                               size_t uxPayloadLen )
+{
+    BaseType_t xSuccess = pdFALSE;
+    lfs_t * pxLfsCtx = NULL;
+
+    if( ( pcTopic == NULL ) ||
+        ( uxTopicLen == 0 ) ||
+        ( uxTopicLen > UINT16_MAX ) ||
+        ( ( pvPayload == NULL ) && ( uxPayloadLen > 0 ) ) ||
+        ( ( uxTopicLen + uxPayloadLen ) > MQTT_OUTBOX_MAX_MSG_LEN ) )
+    {
+        LogError( "Invalid parameter." );
+    }
+    else if( xOutboxMutex == NULL )
+    {
+        LogError( "Outbox not initialized." );
+    }
+    else if( xSemaphoreTake( xOutboxMutex, portMAX_DELAY ) == pdTRUE )
+    {
+        /* The file system is mounted before the mutex is created */
+        pxLfsCtx = pxGetDefaultFsCtx();
+        xSuccess = pdTRUE;
+
+        if( ( ulTailSeq - ulHeadSeq ) >= MQTT_OUTBOX_MAX_MESSAGES )
+        {
+#if MQTT_OUTBOX_DROP_POLICY == MQTT_OUTBOX_DROP_OLDEST
+            LogWarn( "Outbox full, dropping oldest message." );
+            prvRemoveRecord( pxLfsCtx, ulHeadSeq );
+            ulHeadSeq++;
+            prvAdvanceHead( pxLfsCtx );
+#else
+            LogWarn( "Outbox full, dropping new message." );
+            xSuccess = pdFALSE;
+#endif
+        }
+
+        if( xSuccess == pdTRUE )
+        {
+            char pcPath[ OUTBOX_PATH_LEN ];
+            lfs_file_t xFile = { 0 };
+            OutboxRecordHeader_t xHeader =
+            {
+                .ulMagic      = OUTBOX_RECORD_MAGIC,
+                .usTopicLen   = ( uint16_t ) uxTopicLen,
+                .usReserved   = 0,
+                .ulPayloadLen = ( uint32_t ) uxPayloadLen,
+            };
+            int lError;
+
+            vOutboxPath( pcPath, ulTailSeq );
+
+            /* littlefs commits the file atomically on close */
+            lError = lfs_file_open( pxLfsCtx, &xFile, pcPath, LFS_O_WRONLY | LFS_O_CREAT | LFS_O_TRUNC );
+
+            if( lError == LFS_ERR_OK )
+            {
+                if( ( lfs_file_write( pxLfsCtx, &xFile, &xHeader, sizeof( xHeader ) ) != sizeof( xHeader ) ) ||
+                    ( lfs_file_write( pxLfsCtx, &xFile, pcTopic, uxTopicLen ) != ( lfs_ssize_t ) uxTopicLen ) ||
+                    ( ( uxPayloadLen > 0 ) &&
+                      ( lfs_file_write( pxLfsCtx, &xFile, pvPayload, uxPayloadLen ) != ( lfs_ssize_t ) uxPayloadLen ) ) )
+                {
+                    lError = LFS_ERR_IO;
+                }
+
+                if( lfs_file_close( pxLfsCtx, &xFile ) != LFS_ERR_OK )
+                {
+                    lError = LFS_ERR_IO;
+                }
+            }
+
+            if( lError == LFS_ERR_OK )
+            {
+                ulTailSeq++;
+            }
+            else
+            {
+                LogError( "Failed to write %s, error: %d.", pcPath, lError );
+                ( void ) lfs_remove( pxLfsCtx, pcPath );
+                xSuccess = pdFALSE;
+            }
+        }
+
+        ( void ) xSemaphoreGive( xOutboxMutex );
+
+        if( ( xSuccess == pdTRUE ) &&
+            ( xOutboxTask != NULL ) )
+        {
+            ( void ) xTaskNotifyIndexed( xOutboxTask, OUTBOX_NOTIFY_IDX, OUTBOX_NOTIFY_ENQUEUED, eSetBits );
+        }
+    }
+    else
+    {
+        /* Empty */
+    }
+
+    return xSuccess;
+}
+
+/*-----------------------------------------------------------*/
+
+uint32_t ulMqttOutboxCount( void )
+{
+    return( ulTailSeq - ulHeadSeq );
+}
+
+/*-----------------------------------------------------------*/
+
+/*
+ * @brief Read the message pxSlot->ulSeq into pxSlot.
+ * @return LFS_ERR_OK on success, LFS_ERR_NOMEM if it should be retried later,
+ * or another error if the message is missing or corrupt.
+ */
+static int prvLoadRecord( lfs_t * pxLfsCtx,
+                          OutboxSlot_t * pxSlot )
+{
+    char pcPath[ OUTBOX_PATH_LEN ];
+    lfs_file_t xFile = { 0 };
+    OutboxRecordHeader_t xHeader = { 0 };
+    size_t uxRecordLen = 0;
+    int lError;
+
+    vOutboxPath( pcPath, pxSlot->ulSeq );
+
+    lError = lfs_file_open( pxLfsCtx, &xFile, pcPath, LFS_O_RDONLY );
+
+    if( lError == LFS_ERR_OK )
+    {
+        if( ( lfs_file_read( pxLfsCtx, &xFile, &xHeader, sizeof( xHeader ) ) != sizeof( xHeader ) ) ||
+            ( xHeader.ulMagic != OUTBOX_RECORD_MAGIC ) ||
+            ( xHeader.usTopicLen == 0 ) ||
+            ( ( xHeader.usTopicLen + xHeader.ulPayloadLen ) > MQTT_OUTBOX_MAX_MSG_LEN ) )
+        {
+            lError = LFS_ERR_CORRUPT;
+        }
+        else
+        {
+            uxRecordLen = xHeader.usTopicLen + xHeader.ulPayloadLen;
+            pxSlot->pucRecord = pvPortMalloc( uxRecordLen );
+
+            if( pxSlot->pucRecord == NULL )
+            {
+                lError = LFS_ERR_NOMEM;
+            }
+            else if( lfs_file_read( pxLfsCtx, &xFile, pxSlot->pucRecord, uxRecordLen ) != ( lfs_ssize_t ) uxRecordLen )
+            {
+                lError = LFS_ERR_CORRUPT;
+            }
+            else
+            {
+                /* Empty */
+            }
+        }
+
+        ( void ) lfs_file_close( pxLfsCtx, &xFile );
+    }
+
+    if( lError == LFS_ERR_OK )
+    {
+        memset( &( pxSlot->xPublishInfo ), 0, sizeof( MQTTPublishInfo_t ) );
+        pxSlot->xPublishInfo.qos = MQTTQoS1;
+        pxSlot->xPublishInfo.pTopicName = ( const char * ) pxSlot->pucRecord;
+        pxSlot->xPublishInfo.topicNameLength = xHeader.usTopicLen;
+        pxSlot->xPublishInfo.pPayload = &( pxSlot->pucRecord[ xHeader.usTopicLen ] );
+        pxSlot->xPublishInfo.payloadLength = xHeader.ulPayloadLen;
+    }
+    else if( pxSlot->pucRecord != NULL )
+    {
+        vPortFree( pxSlot->pucRecord );
+        pxSlot->pucRecord = NULL;
+    }
+    else
+    {
+        /* Empty */
+    }
+
+    return lError;
+}
+
+/*-----------------------------------------------------------*/
+
+static void prvPublishCompleteCallback( MQTTAgentCommandContext_t * pxCommandContext,
+                                        MQTTAgentReturnInfo_t * pxReturnInfo )
+{
+    OutboxSlot_t * pxSlot = ( OutboxSlot_t * ) pxCommandContext;
+
+    configASSERT( pxSlot != NULL );
+    configASSERT( pxReturnInfo != NULL );
+
+    pxSlot->xStatus = pxReturnInfo->returnCode;
+
+    ( void ) xTaskNotifyIndexed( xOutboxTask,
+                                 OUTBOX_NOTIFY_IDX,
+                                 ( 1UL << ( uint32_t ) ( pxSlot - xSlots ) ),
+                                 eSetBits );
+}
+
+/*-----------------------------------------------------------*/
+
+/* Complete the slots flagged in ulNotifyBits. Returns pdFALSE if any publish failed. */
+/* Called from the agent task, stop issuing publishes as soon as the link is gone */
+static void prvAgentStateCallback( void * pvCtx,
+                                   MqttAgentState_t xState )
+{
+    ( void ) pvCtx;
+
+    if( xState == MQTT_AGENT_STATE_DISCONNECTED )
+    {
+        ( void ) xTaskNotifyIndexed( xOutboxTask, OUTBOX_NOTIFY_IDX, OUTBOX_NOTIFY_DISCONNECTED, eSetBits );
+    }
+}
+
+/*-----------------------------------------------------------*/
+
+static BaseType_t prvHandleCompletions( lfs_t * pxLfsCtx,
+                                        uint32_t ulNotifyBits,
+                                        UBaseType_t * puxInFlight )
+{
+    BaseType_t xSuccess = pdTRUE;
+
+    for( uint32_t ulIdx = 0; ulIdx < MQTT_OUTBOX_INFLIGHT; ulIdx++ )
+    {
+        OutboxSlot_t * pxSlot = &( xSlots[ ulIdx ] );
+
+        if( ( ( ulNotifyBits & ( 1UL << ulIdx ) ) != 0 ) &&
+            ( pxSlot->xInUse == pdTRUE ) )
+        {
+            if( pxSlot->xStatus == MQTTSuccess )
+            {
+                ( void ) xSemaphoreTake( xOutboxMutex, portMAX_DELAY );
+                prvRemoveRecord( pxLfsCtx, pxSlot->ulSeq );
+                prvAdvanceHead( pxLfsCtx );
+                ( void ) xSemaphoreGive( xOutboxMutex );
+            }
+            else
+            {
+                LogWarn( "Outbox publish of message %lu failed with error: %d.",
+                         ( unsigned long ) pxSlot->ulSeq, pxSlot->xStatus );
+                xSuccess = pdFALSE;
+            }
+
+            vPortFree( pxSlot->pucRecord );
+            pxSlot->pucRecord = NULL;
+            pxSlot->xInUse = pdFALSE;
+            ( *puxInFlight )--;
+        }
+    }
+
+    return xSuccess;
+}
+
+/*-----------------------------------------------------------*/
+
+void vMqttOutboxTask( void * pvParameters )
+{
+    lfs_t * pxLfsCtx = NULL;
+    MQTTAgentHandle_t xAgentHandle = NULL;
+    UBaseType_t uxInFlight = 0;
+    BaseType_t xRewind = pdTRUE;
+    uint32_t ulNextSeq = 0;
+
+    ( void ) pvParameters;
+
+    ( void ) xEventGroupWaitBits( xSystemEvents,
+                                  EVT_MASK_FS_READY,
+                                  pdFALSE,
+                                  pdTRUE,
+                                  portMAX_DELAY );
+
+    pxLfsCtx = pxGetDefaultFsCtx();
+
+    if( ( pxLfsCtx == NULL ) ||
+        ( prvRestore( pxLfsCtx ) != pdTRUE ) )
+    {
+        LogError( "Failed to initialize the outbox." );
+        vTaskDelete( NULL );
+    }
+
+    xOutboxTask = xTaskGetCurrentTaskHandle();
+    xOutboxMutex = xSemaphoreCreateMutex();
+    configASSERT( xOutboxMutex != NULL );
+
+    vSleepUntilMQTTAgentReady();
+
+    xAgentHandle = xGetMqttAgentHandle();
+
+    ( void ) xMqttAgentRegisterStateCallback( prvAgentStateCallback, NULL );
+
+    for( ; ; )
+    {
+        uint32_t ulNotifyBits = 0;
+
+        /* Start over from the oldest message once everything in flight has settled */
+        if( ( xRewind == pdTRUE ) &&
+            ( uxInFlight == 0 ) )
+        {
+            net_release_active( NET_ACTIVE_CLIENT_OUTBOX );
+            vSleepUntilMQTTAgentConnected();
+            ulNextSeq = ulHeadSeq;
+            xRewind = pdFALSE;
+        }
+
+        while( ( xRewind == pdFALSE ) &&
+               ( uxInFlight < MQTT_OUTBOX_INFLIGHT ) &&
+               ( ulNextSeq != ulTailSeq ) )
+        {
+            OutboxSlot_t * pxSlot = NULL;
+            int lError;
+
+            for( uint32_t ulIdx = 0; ulIdx < MQTT_OUTBOX_INFLIGHT; ulIdx++ )
+            {
+                if( xSlots[ ulIdx ].xInUse == pdFALSE )
+                {
+                    pxSlot = &( xSlots[ ulIdx ] );
+                    break;
+                }
+            }
+
+            configASSERT( pxSlot != NULL );
+
+            pxSlot->ulSeq = ulNextSeq;
+
+            lError = prvLoadRecord( pxLfsCtx, pxSlot );
+
+            if( lError == LFS_ERR_OK )
+            {
+                MQTTAgentCommandInfo_t xCommandParams =
+                {
+                    .blockTimeMs                 = OUTBOX_PUBLISH_BLOCK_MS,
+                    .cmdCompleteCallback         = prvPublishCompleteCallback,
+                    .pCmdCompleteCallbackContext = ( MQTTAgentCommandContext_t * ) pxSlot,
+                };
+
+                pxSlot->xStatus = MQTTIllegalState;
+                pxSlot->xInUse = pdTRUE;
+
+                if( MQTTAgent_Publish( xAgentHandle, &( pxSlot->xPublishInfo ), &xCommandParams ) == MQTTSuccess )
+                {
+                    uxInFlight++;
+                    ulNextSeq++;
+                }
+                else
+                {
+                    /* Agent queue is full, retry after the next completion */
+                    vPortFree( pxSlot->pucRecord );
+                    pxSlot->pucRecord = NULL;
+                    pxSlot->xInUse = pdFALSE;
+                    break;
+                }
+            }
+            else if( lError == LFS_ERR_NOMEM )
+            {
+                LogWarn( "Out of memory while loading outbox message %lu.", ( unsigned long ) ulNextSeq );
+                break;
+            }
+            else
+            {
+                /* Deleted by the drop policy in the meantime, or unreadable */
+                ( void ) xSemaphoreTake( xOutboxMutex, portMAX_DELAY );
+                prvRemoveRecord( pxLfsCtx, ulNextSeq );
+                prvAdvanceHead( pxLfsCtx );
+
+                if( ( int32_t ) ( ulHeadSeq - ulNextSeq ) > 0 )
+                {
+                    ulNextSeq = ulHeadSeq;
+                }
+                else
+                {
+                    ulNextSeq++;
+                }
+
+                ( void ) xSemaphoreGive( xOutboxMutex );
+            }
+        }
+
+        /* Keep the radio awake while the backlog drains */
+        if( ( xRewind == pdFALSE ) &&
+            ( ( uxInFlight > 0 ) || ( ulNextSeq != ulTailSeq ) ) )
+        {
+            net_request_active( NET_ACTIVE_CLIENT_OUTBOX );
+        }
+        else
+        {
+            net_release_active( NET_ACTIVE_CLIENT_OUTBOX );
+        }
+
+        ( void ) xTaskNotifyWaitIndexed( OUTBOX_NOTIFY_IDX,
+                                         0x0,
+                                         0xFFFFFFFF,
+                                         &ulNotifyBits,
+                                         pdMS_TO_TICKS( OUTBOX_IDLE_WAIT_MS ) );
+
+        if( ( prvHandleCompletions( pxLfsCtx, ulNotifyBits, &uxInFlight ) != pdTRUE ) ||
+            ( ( ulNotifyBits & OUTBOX_NOTIFY_DISCONNECTED ) != 0 ) )
+        {
+            xRewind = pdTRUE;
+        }
+    }
+}
+
+#endif /* MQTT_OUTBOX_ENABLED == 1 */
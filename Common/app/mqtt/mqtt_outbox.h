@@ -0,0 +1,97 @@
+/*
+ * FreeRTOS STM32 Reference Integration
+ * Copyright (C) 2022 Amazon.com, Inc. or its affiliates.  All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ *
+ * https://www.FreeRTOS.org
+ * https://github.com/FreeRTOS
+ *
+ */
+
+/**
+ * @file mqtt_outbox.h
+ * @brief Store and forward queue for QoS1 publishes, persisted to littlefs.
+ *
+ * Messages are written to MQTT_OUTBOX_DIR, one file per message named after its
+ * sequence number, so they survive both disconnects and reboots. vMqttOutboxTask
+ * publishes them in order whenever the MQTT agent is connected, keeping up to
+ * MQTT_OUTBOX_INFLIGHT publishes outstanding, and deletes each one once acknowledged.
+ */
+#ifndef MQTT_OUTBOX_H
+#define MQTT_OUTBOX_H
+
+#include "FreeRTOS.h"
+
+/* Set to 1 to build the outbox. Requires the littlefs file system. */
+#ifndef MQTT_OUTBOX_ENABLED
+#define MQTT_OUTBOX_ENABLED        0
+#endif
+
+#define MQTT_OUTBOX_DROP_OLDEST    0
+#define MQTT_OUTBOX_DROP_NEWEST    1
+
+/* Which message to discard when a message is added to a full outbox. */
+#ifndef MQTT_OUTBOX_DROP_POLICY
+#define MQTT_OUTBOX_DROP_POLICY    MQTT_OUTBOX_DROP_OLDEST
+#endif
+
+/* Maximum number of stored messages. */
+#ifndef MQTT_OUTBOX_MAX_MESSAGES
+#define MQTT_OUTBOX_MAX_MESSAGES   256U
+#endif
+
+/* Maximum length of topic plus payload of a single message. */
+#ifndef MQTT_OUTBOX_MAX_MSG_LEN
+#define MQTT_OUTBOX_MAX_MSG_LEN    1024U
+#endif
+
+/* Number of publishes awaiting a PUBACK while draining the outbox. */
+#ifndef MQTT_OUTBOX_INFLIGHT
+#define MQTT_OUTBOX_INFLIGHT       4U
+#endif
+
+#ifndef MQTT_OUTBOX_DIR
+#define MQTT_OUTBOX_DIR            "/outbox"
+#endif
+
+/*
+ * @brief Store a message to be published with QoS1 once connected.
+ *
+ * The topic and payload are copied. May be called before the outbox task has started,
+ * in which case pdFALSE is returned.
+ *
+ * @return pdTRUE if the message was stored.
+ */
+BaseType_t xMqttOutboxEnqueue( const char * pcTopic,
+                               size_t uxTopicLen,
+                               const void * pvPayload,
+                               size_t uxPayloadLen );
+
+/*
+ * @brief Number of messages waiting in the outbox.
+ */
+uint32_t ulMqttOutboxCount( void );
+
+/*
+ * @brief Task that restores the outbox from the file system and drains it.
+ */
+void vMqttOutboxTask( void * pvParameters );
+
+#endif /* MQTT_OUTBOX_H */
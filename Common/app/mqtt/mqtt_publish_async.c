@@ -0,0 +1,896 @@
+/*
+ * FreeRTOS STM32 Reference Integration
+ * Copyright (C) 2022 Amazon.com, Inc. or its affiliates.  All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ *
+ * https://www.FreeRTOS.org
+ * https://github.com/FreeRTOS
+ *
+ */
+
+/**
+ * @file mqtt_publish_async.c
+ * @brief Asynchronous publish from buffers owned by the MQTT agent.
+ */
+
+#include "logging_levels.h"
+
+#define LOG_LEVEL    LOG_ERROR
+#define LOG_MODULE    LOG_MODULE_MQTT
+
+#include "logging.h"
+
+/* Standard includes. */
+#include <string.h>
+#include <assert.h>
+
+/* Kernel includes. */
+#include "FreeRTOS.h"
+#include "task.h"
+#include "semphr.h"
+
+#include "core_mqtt_agent.h"
+
+#include "mqtt_publish_async.h"
+#include "time_base.h"
+#include "kvstore.h"
+
+#if MQTT_PUBLISH_STREAM_LFS == 1
+#include "lfs.h"
+#include "fs/lfs_port.h"
+#endif /* MQTT_PUBLISH_STREAM_LFS == 1 */
+
+static_assert( MQTT_PUBLISH_POOL_BUFFERS <= 32U );
+
+typedef struct PublishBuffer
+{
+    MQTTPublishInfo_t xPublishInfo; /* Referenced by the agent until the publish completes */
+    PublishCompleteCallback_t xCallback;
+    void * pvCtx;
+    uint64_t ullDequeuedUs; /* Written by the agent task */
+    uint8_t ucPayload[ MQTT_PUBLISH_POOL_BUFFER_LEN ];
+} PublishBuffer_t;
+
+static PublishBuffer_t xPublishPool[ MQTT_PUBLISH_POOL_BUFFERS ];
+
+/* Bit n is set while xPublishPool[ n ] is in use */
+static uint32_t ulPoolInUse = 0;
+
+/* Counts the free buffers */
+static SemaphoreHandle_t xPoolFreeSem = NULL;
+
+/* Dequeue time of the publish whose completion callback is running, only used by the agent task */
+static uint64_t ullCompletingDequeuedUs = 0;
+
+typedef enum
+{
+    STREAM_FREE = 0,
+    STREAM_QUEUED,   /* Waiting for the agent, or for the acknowledgement once xSent is set */
+    STREAM_SENDING,  /* The agent is reading and sending the payload */
+    STREAM_DONE,     /* Completed, xResult is valid */
+    STREAM_ABANDONED /* The caller timed out, the payload can no longer be read */
+} StreamState_t;
+
+typedef struct PublishStream
+{
+    MQTTPublishInfo_t xPublishInfo; /* pPayload points to this stream, which marks it for MqttAgent_StreamWritev */
+    PublishStreamRead_t xRead;
+    void * pvReadCtx;
+    StreamState_t xState;           /* Guarded by a critical section */
+    BaseType_t xSent;               /* Set once the whole packet was written */
+    MQTTStatus_t xResult;
+    SemaphoreHandle_t xDoneSem;
+    StaticSemaphore_t xDoneSemBuffer;
+} PublishStream_t;
+
+static PublishStream_t xStreams[ MQTT_PUBLISH_STREAMS ];
+
+/* Packet header and payload chunks of a streamed publish, only used by the agent task */
+static uint8_t ucStreamChunk[ MQTT_PUBLISH_STREAM_CHUNK_LEN ];
+
+#if MQTT_PUBLISH_STREAM_LFS == 1
+typedef struct
+{
+    lfs_t * pxLfsCtx;
+    lfs_file_t xFile;
+    size_t uxPos;
+} FileStreamCtx_t;
+#endif /* MQTT_PUBLISH_STREAM_LFS == 1 */
+
+/*-----------------------------------------------------------*/
+
+static PublishBuffer_t * prvBufferFromPayload( const void * pvPayload )
+{
+    PublishBuffer_t * pxBuffer = NULL;
+
+    for( uint32_t ulIdx = 0; ulIdx < MQTT_PUBLISH_POOL_BUFFERS; ulIdx++ )
+    {
+        if( pvPayload == xPublishPool[ ulIdx ].ucPayload )
+        {
+            pxBuffer = &( xPublishPool[ ulIdx ] );
+            break;
+        }
+    }
+
+    return pxBuffer;
+}
+
+/*-----------------------------------------------------------*/
+
+static void prvReleaseBuffer( PublishBuffer_t * pxBuffer )
+{
+    uint32_t ulIdx = ( uint32_t ) ( pxBuffer - xPublishPool );
+
+    taskENTER_CRITICAL();
+    {
+        configASSERT( ( ulPoolInUse & ( 1UL << ulIdx ) ) != 0 );
+        ulPoolInUse &= ~( 1UL << ulIdx );
+    }
+    taskEXIT_CRITICAL();
+
+    ( void ) xSemaphoreGive( xPoolFreeSem );
+}
+
+/*-----------------------------------------------------------*/
+
+static void prvPublishCompleteCallback( MQTTAgentCommandContext_t * pxCommandContext,
+                                        MQTTAgentReturnInfo_t * pxReturnInfo )
+{
+    PublishBuffer_t * pxBuffer = ( PublishBuffer_t * ) pxCommandContext;
+    PublishCompleteCallback_t xCallback;
+    void * pvCtx;
+
+    configASSERT( pxBuffer != NULL );
+    configASSERT( pxReturnInfo != NULL );
+
+    xCallback = pxBuffer->xCallback;
+    pvCtx = pxBuffer->pvCtx;
+    ullCompletingDequeuedUs = pxBuffer->ullDequeuedUs;
+
+    prvReleaseBuffer( pxBuffer );
+
+    if( pxReturnInfo->returnCode != MQTTSuccess )
+    {
+        LogError( "Asynchronous publish failed with error code: %d.", pxReturnInfo->returnCode );
+    }
+
+    if( xCallback != NULL )
+    {
+        xCallback( pvCtx, pxReturnInfo->returnCode );
+    }
+
+    ullCompletingDequeuedUs = 0;
+}
+
+/*-----------------------------------------------------------*/
+
+void MqttAgent_NotePublishDequeued( const MQTTPublishInfo_t * pxPublishInfo )
+{
+    for( uint32_t ulIdx = 0; ulIdx < MQTT_PUBLISH_POOL_BUFFERS; ulIdx++ )
+    {
+        if( pxPublishInfo == &( xPublishPool[ ulIdx ].xPublishInfo ) )
+        {
+            xPublishPool[ ulIdx ].ullDequeuedUs = ullTimeBaseGetUs();
+            break;
+        }
+    }
+}
+
+/*-----------------------------------------------------------*/
+
+uint64_t MqttAgent_GetPublishDequeuedUs( void )
+{
+    return ullCompletingDequeuedUs;
+}
+
+/*-----------------------------------------------------------*/
+
+void MqttAgent_InitPublishPool( void )
+{
+    if( xPoolFreeSem == NULL )
+    {
+        xPoolFreeSem = xSemaphoreCreateCounting( MQTT_PUBLISH_POOL_BUFFERS, MQTT_PUBLISH_POOL_BUFFERS );
+        configASSERT( xPoolFreeSem != NULL );
+
+        for( uint32_t ulIdx = 0; ulIdx < MQTT_PUBLISH_STREAMS; ulIdx++ )
+        {
+            xStreams[ ulIdx ].xDoneSem = xSemaphoreCreateBinaryStatic( &( xStreams[ ulIdx ].xDoneSemBuffer ) );
+        }
+    }
+}
+
+/*-----------------------------------------------------------*/
+
+void * MqttAgent_GetPublishBuffer( TickType_t xTicksToWait )
+{
+    void * pvBuffer = NULL;
+
+    if( xPoolFreeSem == NULL )
+    {
+        LogError( "Publish buffer pool not initialized." );
+    }
+    else if( xSemaphoreTake( xPoolFreeSem, xTicksToWait ) == pdTRUE )
+    {
+        taskENTER_CRITICAL();
+        {
+            for( uint32_t ulIdx = 0; ulIdx < MQTT_PUBLISH_POOL_BUFFERS; ulIdx++ )
+            {
+                if( ( ulPoolInUse & ( 1UL << ulIdx ) ) == 0 )
+                {
+                    ulPoolInUse |= ( 1UL << ulIdx );
+                    pvBuffer = xPublishPool[ ulIdx ].ucPayload;
+                    break;
+                }
+            }
+        }
+        taskEXIT_CRITICAL();
+
+        /* The semaphore count guarantees a free buffer */
+        configASSERT( pvBuffer != NULL );
+    }
+    else
+    {
+        LogWarn( "No publish buffer available." );
+    }
+
+    return pvBuffer;
+}
+
+/*-----------------------------------------------------------*/
+
+void MqttAgent_ReleasePublishBuffer( void * pvBuffer )
+{
+    PublishBuffer_t * pxBuffer = prvBufferFromPayload( pvBuffer );
+
+    if( pxBuffer == NULL )
+    {
+        LogError( "Buffer: %p does not belong to the publish pool.", pvBuffer );
+    }
+    else
+    {
+        prvReleaseBuffer( pxBuffer );
+    }
+}
+
+/*-----------------------------------------------------------*/
+
+MQTTStatus_t MqttAgent_PublishAsync( MQTTAgentHandle_t xHandle,
+                                     const MQTTPublishInfo_t * pxPublishInfo,
+                                     PublishCompleteCallback_t xCallback,
+                                     void * pvCtx,
+                                     uint32_t ulBlockTimeMs )
+{
+    MQTTStatus_t xStatus = MQTTSuccess;
+    PublishBuffer_t * pxBuffer = NULL;
+
+    if( ( xHandle == NULL ) ||
+        ( pxPublishInfo == NULL ) )
+    {
+        LogError( "Invalid parameter." );
+        xStatus = MQTTBadParameter;
+    }
+    else
+    {
+        pxBuffer = prvBufferFromPayload( pxPublishInfo->pPayload );
+
+        if( pxBuffer == NULL )
+        {
+            LogError( "Payload: %p does not belong to the publish pool.", pxPublishInfo->pPayload );
+            xStatus = MQTTBadParameter;
+        }
+        else if( pxPublishInfo->payloadLength > MQTT_PUBLISH_POOL_BUFFER_LEN )
+        {
+            LogError( "Payload length: %lu exceeds the publish buffer length.",
+                      ( unsigned long ) pxPublishInfo->payloadLength );
+            xStatus = MQTTBadParameter;
+        }
+        else
+        {
+            /* Empty */
+        }
+    }
+
+    if( xStatus == MQTTSuccess )
+    {
+        MQTTAgentCommandInfo_t xCommandParams =
+        {
+            .blockTimeMs                 = ulBlockTimeMs,
+            .cmdCompleteCallback         = prvPublishCompleteCallback,
+            .pCmdCompleteCallbackContext = ( MQTTAgentCommandContext_t * ) pxBuffer,
+        };
+
+        pxBuffer->xPublishInfo = *pxPublishInfo;
+        pxBuffer->xCallback = xCallback;
+        pxBuffer->pvCtx = pvCtx;
+        pxBuffer->ullDequeuedUs = 0;
+
+        xStatus = MQTTAgent_Publish( xHandle,
+                                     &( pxBuffer->xPublishInfo ),
+                                     &xCommandParams );
+
+        if( xStatus != MQTTSuccess )
+        {
+            LogError( "MQTTAgent_Publish returned error code: %d.", xStatus );
+        }
+    }
+
+    /* The buffer is owned by the agent from here on, so release it if the command was not queued */
+    if( ( xStatus != MQTTSuccess ) &&
+        ( pxBuffer != NULL ) )
+    {
+        prvReleaseBuffer( pxBuffer );
+    }
+
+    return xStatus;
+}
+
+/*-----------------------------------------------------------*/
+
+size_t MqttAgent_BuildTelemetryTopic( const char * pcSuffix,
+                                      char * pcBuffer,
+                                      size_t uxBufferLen )
+{
+    size_t uxLen = 0;
+
+    configASSERT( pcSuffix != NULL );
+    configASSERT( pcBuffer != NULL );
+    configASSERT( uxBufferLen > 0 );
+
+    uxLen = KVStore_getString( CS_TELEMETRY_ROOT, pcBuffer, uxBufferLen );
+
+    if( uxLen == 0 )
+    {
+        uxLen = KVStore_getString( CS_CORE_THING_NAME, pcBuffer, uxBufferLen );
+    }
+
+    if( uxLen > 0 )
+    {
+        uxLen = strlcat( pcBuffer, "/", uxBufferLen );
+    }
+
+    if( ( uxLen > 0 ) && ( uxLen < uxBufferLen ) )
+    {
+        uxLen = strlcat( pcBuffer, pcSuffix, uxBufferLen );
+    }
+
+    if( uxLen >= uxBufferLen )
+    {
+        uxLen = 0;
+    }
+
+    return uxLen;
+}
+
+/*-----------------------------------------------------------*/
+
+MQTTStatus_t MqttAgent_PublishQoS0( MQTTAgentHandle_t xHandle,
+                                    const char * pcTopic,
+                                    const void * pvPayload,
+                                    size_t xPayloadLen,
+                                    uint32_t ulBlockTimeMs )
+{
+    MQTTStatus_t xStatus = MQTTSuccess;
+    uint8_t * pucBuffer = NULL;
+    size_t uxTopicLen = 0;
+
+    if( ( pcTopic == NULL ) ||
+        ( ( pvPayload == NULL ) && ( xPayloadLen > 0 ) ) )
+    {
+        LogError( "Invalid parameter." );
+        xStatus = MQTTBadParameter;
+    }
+    else
+    {
+        uxTopicLen = strnlen( pcTopic, MQTT_PUBLISH_POOL_BUFFER_LEN );
+
+        if( ( uxTopicLen == 0 ) ||
+            ( xPayloadLen > ( MQTT_PUBLISH_POOL_BUFFER_LEN - uxTopicLen ) ) )
+        {
+            LogError( "Topic and payload of %lu bytes do not fit in a publish buffer.",
+                      ( unsigned long ) ( uxTopicLen + xPayloadLen ) );
+            xStatus = MQTTBadParameter;
+        }
+    }
+
+    if( xStatus == MQTTSuccess )
+    {
+        pucBuffer = MqttAgent_GetPublishBuffer( pdMS_TO_TICKS( ulBlockTimeMs ) );
+
+        if( pucBuffer == NULL )
+        {
+            xStatus = MQTTNoMemory;
+        }
+    }
+
+    if( xStatus == MQTTSuccess )
+    {
+        MQTTPublishInfo_t xPublishInfo =
+        {
+            .qos             = MQTTQoS0,
+            .retain          = 0,
+            .dup             = 0,
+            .pTopicName      = ( const char * ) &( pucBuffer[ xPayloadLen ] ),
+            .topicNameLength = ( uint16_t ) uxTopicLen,
+            .pPayload        = pucBuffer,
+            .payloadLength   = xPayloadLen
+        };
+
+        if( xPayloadLen > 0 )
+        {
+            ( void ) memcpy( pucBuffer, pvPayload, xPayloadLen );
+        }
+
+        ( void ) memcpy( &( pucBuffer[ xPayloadLen ] ), pcTopic, uxTopicLen );
+
+        /* Releases the buffer on failure */
+        xStatus = MqttAgent_PublishAsync( xHandle, &xPublishInfo, NULL, NULL, ulBlockTimeMs );
+    }
+
+    return xStatus;
+}
+
+/*-----------------------------------------------------------*/
+
+static PublishStream_t * prvStreamFromPayload( const void * pvPayload )
+{
+    PublishStream_t * pxStream = NULL;
+
+    for( uint32_t ulIdx = 0; ulIdx < MQTT_PUBLISH_STREAMS; ulIdx++ )
+    {
+        if( pvPayload == ( const void * ) &( xStreams[ ulIdx ] ) )
+        {
+            pxStream = &( xStreams[ ulIdx ] );
+            break;
+        }
+    }
+
+    return pxStream;
+}
+
+/*-----------------------------------------------------------*/
+
+static void prvStreamCompleteCallback( MQTTAgentCommandContext_t * pxCommandContext,
+                                       MQTTAgentReturnInfo_t * pxReturnInfo )
+{
+    PublishStream_t * pxStream = ( PublishStream_t * ) pxCommandContext;
+    BaseType_t xNotify = pdFALSE;
+
+    configASSERT( pxStream != NULL );
+    configASSERT( pxReturnInfo != NULL );
+
+    taskENTER_CRITICAL();
+    {
+        if( pxStream->xState == STREAM_ABANDONED )
+        {
+            pxStream->xState = STREAM_FREE;
+        }
+        else
+        {
+            pxStream->xResult = pxReturnInfo->returnCode;
+            pxStream->xState = STREAM_DONE;
+            xNotify = pdTRUE;
+        }
+    }
+    taskEXIT_CRITICAL();
+
+    if( xNotify == pdTRUE )
+    {
+        ( void ) xSemaphoreGive( pxStream->xDoneSem );
+    }
+}
+
+/*-----------------------------------------------------------*/
+
+static BaseType_t prvSendAll( NetworkContext_t * pxNetworkContext,
+                              TransportSend_t xSend,
+                              const uint8_t * pucData,
+                              size_t uxLen )
+{
+    size_t uxOffset = 0;
+    BaseType_t xResult = pdTRUE;
+
+    while( ( xResult == pdTRUE ) && ( uxOffset < uxLen ) )
+    {
+        int32_t lSent = xSend( pxNetworkContext, &( pucData[ uxOffset ] ), uxLen - uxOffset );
+
+        if( lSent > 0 )
+        {
+            uxOffset += ( size_t ) lSent;
+        }
+        else
+        {
+            LogError( "Failed to send %lu bytes of a streamed publish.", ( unsigned long ) ( uxLen - uxOffset ) );
+            xResult = pdFALSE;
+        }
+    }
+
+    return xResult;
+}
+
+/*-----------------------------------------------------------*/
+
+/* Write a packet whose payload is pxStream through the chunk buffer */
+static BaseType_t prvStreamSend( PublishStream_t * pxStream,
+                                 NetworkContext_t * pxNetworkContext,
+                                 const TransportOutVector_t * pxIoVec,
+                                 size_t uxIoVecCount,
+                                 TransportSend_t xSend )
+{
+    BaseType_t xResult = pdTRUE;
+    size_t uxChunkLen = 0;
+
+    /* The header, topic and packet id are small, so they go into the first chunk with the start of the payload */
+    for( size_t uxIdx = 0; ( xResult == pdTRUE ) && ( uxIdx < uxIoVecCount ); uxIdx++ )
+    {
+        const uint8_t * pucData = ( const uint8_t * ) pxIoVec[ uxIdx ].iov_base;
+        size_t uxLen = pxIoVec[ uxIdx ].iov_len;
+        BaseType_t xIsPayload = ( pxIoVec[ uxIdx ].iov_base == ( const void * ) pxStream ) ? pdTRUE : pdFALSE;
+        size_t uxOffset = 0;
+
+        while( ( xResult == pdTRUE ) && ( uxOffset < uxLen ) )
+        {
+            size_t uxPart = MQTT_PUBLISH_STREAM_CHUNK_LEN - uxChunkLen;
+
+            if( uxPart > ( uxLen - uxOffset ) )
+            {
+                uxPart = uxLen - uxOffset;
+            }
+
+            if( xIsPayload == pdFALSE )
+            {
+                ( void ) memcpy( &( ucStreamChunk[ uxChunkLen ] ), &( pucData[ uxOffset ] ), uxPart );
+            }
+            else if( pxStream->xRead( pxStream->pvReadCtx, uxOffset, &( ucStreamChunk[ uxChunkLen ] ), uxPart ) != pdTRUE )
+            {
+                LogError( "Failed to read %lu bytes at offset %lu of a streamed publish.",
+                          ( unsigned long ) uxPart, ( unsigned long ) uxOffset );
+                xResult = pdFALSE;
+            }
+            else
+            {
+                /* Empty */
+            }
+
+            uxChunkLen += uxPart;
+            uxOffset += uxPart;
+
+            if( ( xResult == pdTRUE ) &&
+                ( uxChunkLen == MQTT_PUBLISH_STREAM_CHUNK_LEN ) )
+            {
+                xResult = prvSendAll( pxNetworkContext, xSend, ucStreamChunk, uxChunkLen );
+                uxChunkLen = 0;
+            }
+        }
+    }
+
+    if( ( xResult == pdTRUE ) &&
+        ( uxChunkLen > 0 ) )
+    {
+        xResult = prvSendAll( pxNetworkContext, xSend, ucStreamChunk, uxChunkLen );
+    }
+
+    return xResult;
+}
+
+/*-----------------------------------------------------------*/
+
+int32_t MqttAgent_StreamWritev( NetworkContext_t * pxNetworkContext,
+                                TransportOutVector_t * pxIoVec,
+                                size_t uxIoVecCount,
+                                TransportSend_t xSend,
+                                TransportWritev_t xWritev )
+{
+    PublishStream_t * pxStream = NULL;
+    BaseType_t xResult = pdTRUE;
+    int32_t lResult = -1;
+    size_t uxTotalLen = 0;
+
+    for( size_t uxIdx = 0; uxIdx < uxIoVecCount; uxIdx++ )
+    {
+        if( pxStream == NULL )
+        {
+            pxStream = prvStreamFromPayload( pxIoVec[ uxIdx ].iov_base );
+        }
+
+        uxTotalLen += pxIoVec[ uxIdx ].iov_len;
+    }
+
+    if( pxStream == NULL )
+    {
+        lResult = xWritev( pxNetworkContext, pxIoVec, uxIoVecCount );
+    }
+    else
+    {
+        taskENTER_CRITICAL();
+        {
+            if( pxStream->xState == STREAM_QUEUED )
+            {
+                pxStream->xState = STREAM_SENDING;
+            }
+            else
+            {
+                xResult = pdFALSE;
+            }
+        }
+        taskEXIT_CRITICAL();
+
+        if( xResult == pdFALSE )
+        {
+            /* coreMQTT has committed to the packet, so failing it drops the connection */
+            LogError( "Streamed publish to %.*s was abandoned by its caller.",
+                      pxStream->xPublishInfo.topicNameLength, pxStream->xPublishInfo.pTopicName );
+        }
+        else
+        {
+            xResult = prvStreamSend( pxStream, pxNetworkContext, pxIoVec, uxIoVecCount, xSend );
+
+            taskENTER_CRITICAL();
+            {
+                /* A QoS1 publish waits for its acknowledgement, and may be sent again */
+                if( xResult == pdTRUE )
+                {
+                    pxStream->xSent = pdTRUE;
+                }
+
+                pxStream->xState = STREAM_QUEUED;
+            }
+            taskEXIT_CRITICAL();
+        }
+
+        /* A partial write would make coreMQTT resend from a pointer into the stream, so it is all or nothing */
+        if( xResult == pdTRUE )
+        {
+            lResult = ( int32_t ) uxTotalLen;
+        }
+    }
+
+    return lResult;
+}
+
+/*-----------------------------------------------------------*/
+
+MQTTStatus_t MqttAgent_PublishStream( MQTTAgentHandle_t xHandle,
+                                      const MQTTPublishInfo_t * pxPublishInfo,
+                                      PublishStreamRead_t xRead,
+                                      void * pvReadCtx,
+                                      uint32_t ulTimeoutMs )
+{
+    MQTTStatus_t xStatus = MQTTSuccess;
+    PublishStream_t * pxStream = NULL;
+    BaseType_t xWaitForAgent = pdFALSE;
+
+    if( ( xHandle == NULL ) ||
+        ( pxPublishInfo == NULL ) ||
+        ( xRead == NULL ) )
+    {
+        LogError( "Invalid parameter." );
+        xStatus = MQTTBadParameter;
+    }
+    else if( xPoolFreeSem == NULL )
+    {
+        LogError( "Publish buffer pool not initialized." );
+        xStatus = MQTTIllegalState;
+    }
+    else
+    {
+        taskENTER_CRITICAL();
+        {
+            for( uint32_t ulIdx = 0; ulIdx < MQTT_PUBLISH_STREAMS; ulIdx++ )
+            {
+                if( xStreams[ ulIdx ].xState == STREAM_FREE )
+                {
+                    pxStream = &( xStreams[ ulIdx ] );
+                    pxStream->xState = STREAM_QUEUED;
+                    break;
+                }
+            }
+        }
+        taskEXIT_CRITICAL();
+
+        if( pxStream == NULL )
+        {
+            LogWarn( "All %u publish streams are in use.", MQTT_PUBLISH_STREAMS );
+            xStatus = MQTTNoMemory;
+        }
+    }
+
+    if( xStatus == MQTTSuccess )
+    {
+        MQTTAgentCommandInfo_t xCommandParams =
+        {
+            .blockTimeMs                 = ulTimeoutMs,
+            .cmdCompleteCallback         = prvStreamCompleteCallback,
+            .pCmdCompleteCallbackContext = ( MQTTAgentCommandContext_t * ) pxStream,
+        };
+
+        pxStream->xPublishInfo = *pxPublishInfo;
+        pxStream->xPublishInfo.pPayload = pxStream;
+        pxStream->xRead = xRead;
+        pxStream->pvReadCtx = pvReadCtx;
+        pxStream->xResult = MQTTSuccess;
+        pxStream->xSent = pdFALSE;
+
+        xStatus = MQTTAgent_Publish( xHandle,
+                                     &( pxStream->xPublishInfo ),
+                                     &xCommandParams );
+
+        if( xStatus != MQTTSuccess )
+        {
+            LogError( "MQTTAgent_Publish returned error code: %d.", xStatus );
+
+            taskENTER_CRITICAL();
+            pxStream->xState = STREAM_FREE;
+            taskEXIT_CRITICAL();
+        }
+        else if( xSemaphoreTake( pxStream->xDoneSem, pdMS_TO_TICKS( ulTimeoutMs ) ) == pdTRUE )
+        {
+            xStatus = pxStream->xResult;
+
+            taskENTER_CRITICAL();
+            pxStream->xState = STREAM_FREE;
+            taskEXIT_CRITICAL();
+        }
+        else
+        {
+            taskENTER_CRITICAL();
+            {
+                /*
+                 * Once the agent has begun to send the payload it may read it again
+                 * until the publish completes, at the latest when the agent cancels
+                 * its pending commands on a disconnect.
+                 */
+                if( ( pxStream->xState != STREAM_QUEUED ) ||
+                    ( pxStream->xSent == pdTRUE ) )
+                {
+                    xWaitForAgent = pdTRUE;
+                }
+                else
+                {
+                    pxStream->xState = STREAM_ABANDONED;
+                }
+            }
+            taskEXIT_CRITICAL();
+
+            if( xWaitForAgent == pdTRUE )
+            {
+                ( void ) xSemaphoreTake( pxStream->xDoneSem, portMAX_DELAY );
+                xStatus = pxStream->xResult;
+
+                taskENTER_CRITICAL();
+                pxStream->xState = STREAM_FREE;
+                taskEXIT_CRITICAL();
+            }
+            else
+            {
+                LogError( "Timed out waiting for a streamed publish to %.*s.",
+                          pxPublishInfo->topicNameLength, pxPublishInfo->pTopicName );
+                xStatus = MQTTKeepAliveTimeout;
+            }
+        }
+
+        if( xStatus != MQTTSuccess )
+        {
+            LogError( "Streamed publish of %lu bytes failed with error code: %d.",
+                      ( unsigned long ) pxPublishInfo->payloadLength, xStatus );
+        }
+    }
+
+    return xStatus;
+}
+
+/*-----------------------------------------------------------*/
+
+#if MQTT_PUBLISH_STREAM_LFS == 1
+
+static BaseType_t prvFileRead( void * pvCtx,
+                               size_t uxOffset,
+                               void * pvBuffer,
+                               size_t uxLen )
+{
+    FileStreamCtx_t * pxCtx = ( FileStreamCtx_t * ) pvCtx;
+    BaseType_t xResult = pdTRUE;
+
+    /* Only seek when the publish is sent again */
+    if( ( uxOffset != pxCtx->uxPos ) &&
+        ( lfs_file_seek( pxCtx->pxLfsCtx, &( pxCtx->xFile ), ( lfs_soff_t ) uxOffset, LFS_SEEK_SET ) != ( lfs_soff_t ) uxOffset ) )
+    {
+        xResult = pdFALSE;
+    }
+    else if( lfs_file_read( pxCtx->pxLfsCtx, &( pxCtx->xFile ), pvBuffer, ( lfs_size_t ) uxLen ) != ( lfs_ssize_t ) uxLen )
+    {
+        xResult = pdFALSE;
+    }
+    else
+    {
+        pxCtx->uxPos = uxOffset + uxLen;
+    }
+
+    if( xResult == pdFALSE )
+    {
+        /* Seek on the next read */
+        pxCtx->uxPos = SIZE_MAX;
+    }
+
+    return xResult;
+}
+
+/*-----------------------------------------------------------*/
+
+MQTTStatus_t MqttAgent_PublishFile( MQTTAgentHandle_t xHandle,
+                                    const MQTTPublishInfo_t * pxPublishInfo,
+                                    const char * pcPath,
+                                    uint32_t ulTimeoutMs )
+{
+    MQTTStatus_t xStatus = MQTTSuccess;
+    FileStreamCtx_t xCtx = { 0 };
+    lfs_soff_t lSize = 0;
+
+    if( ( pxPublishInfo == NULL ) ||
+        ( pcPath == NULL ) )
+    {
+        LogError( "Invalid parameter." );
+        xStatus = MQTTBadParameter;
+    }
+    else
+    {
+        xCtx.pxLfsCtx = pxGetDefaultFsCtx();
+    }
+
+    if( xStatus != MQTTSuccess )
+    {
+        /* Empty */
+    }
+    else if( ( xCtx.pxLfsCtx == NULL ) ||
+             ( lfs_file_open( xCtx.pxLfsCtx, &( xCtx.xFile ), pcPath, LFS_O_RDONLY ) != LFS_ERR_OK ) )
+    {
+        LogError( "Failed to open %s.", pcPath );
+        xStatus = MQTTBadParameter;
+    }
+    else
+    {
+        lSize = lfs_file_size( xCtx.pxLfsCtx, &( xCtx.xFile ) );
+
+        if( lSize < 0 )
+        {
+            LogError( "Failed to get the size of %s: %ld.", pcPath, ( long ) lSize );
+            xStatus = MQTTBadParameter;
+        }
+        else
+        {
+            MQTTPublishInfo_t xPublishInfo = *pxPublishInfo;
+
+            xPublishInfo.payloadLength = ( size_t ) lSize;
+
+            xStatus = MqttAgent_PublishStream( xHandle, &xPublishInfo, prvFileRead, &xCtx, ulTimeoutMs );
+
+            if( xStatus == MQTTSuccess )
+            {
+                LogInfo( "Published %ld bytes of %s.", ( long ) lSize, pcPath );
+            }
+        }
+
+        /* The agent no longer reads the file once MqttAgent_PublishStream has returned */
+        ( void ) lfs_file_close( xCtx.pxLfsCtx, &( xCtx.xFile ) );
+    }
+
+    return xStatus;
+}
+
+#endif /* MQTT_PUBLISH_STREAM_LFS == 1 */
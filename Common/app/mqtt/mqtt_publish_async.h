@@ -0,0 +1,249 @@
+/*
+ * FreeRTOS STM32 Reference Integration
+ * Copyright (C) 2022 Amazon.com, Inc. or its affiliates.  All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ *
+ * https://www.FreeRTOS.org
+ * https://github.com/FreeRTOS
+ *
+ */
+
+/**
+ * @file mqtt_publish_async.h
+ * @brief Asynchronous publish from buffers owned by the MQTT agent.
+ *
+ * A task takes a buffer from the pool, writes its payload into it and hands it
+ * to MqttAgent_PublishAsync. The buffer then belongs to the agent and is returned
+ * to the pool once the publish has been sent (QoS0) or acknowledged (QoS1/2), so
+ * a task can have several publishes in flight without waiting for each of them.
+ *
+ * Payloads larger than a buffer, e.g. files, are streamed with
+ * MqttAgent_PublishStream instead, which reads them in chunks while they are sent.
+ */
+#ifndef MQTT_PUBLISH_ASYNC_H
+#define MQTT_PUBLISH_ASYNC_H
+
+#include "FreeRTOS.h"
+
+#include "core_mqtt.h"
+#include "mqtt_agent_task.h"
+
+/* Number of publish buffers shared by all tasks. */
+#ifndef MQTT_PUBLISH_POOL_BUFFERS
+#define MQTT_PUBLISH_POOL_BUFFERS       8U
+#endif /* MQTT_PUBLISH_POOL_BUFFERS */
+
+/* Size of each publish buffer in bytes. */
+#ifndef MQTT_PUBLISH_POOL_BUFFER_LEN
+#define MQTT_PUBLISH_POOL_BUFFER_LEN    512U
+#endif /* MQTT_PUBLISH_POOL_BUFFER_LEN */
+
+/* Number of streamed publishes that can be in flight at once. */
+#ifndef MQTT_PUBLISH_STREAMS
+#define MQTT_PUBLISH_STREAMS            2U
+#endif /* MQTT_PUBLISH_STREAMS */
+
+/* Bytes of a streamed payload read and sent at a time, by the agent task. */
+#ifndef MQTT_PUBLISH_STREAM_CHUNK_LEN
+#define MQTT_PUBLISH_STREAM_CHUNK_LEN   1024U
+#endif /* MQTT_PUBLISH_STREAM_CHUNK_LEN */
+
+/* Set to 1 for MqttAgent_PublishFile, which streams a littlefs file. */
+#ifndef MQTT_PUBLISH_STREAM_LFS
+#if defined( TFM_PSA_API )
+#define MQTT_PUBLISH_STREAM_LFS         0
+#else
+#define MQTT_PUBLISH_STREAM_LFS         1
+#endif
+#endif /* MQTT_PUBLISH_STREAM_LFS */
+
+/**
+ * @brief Called from the MQTT agent task once an asynchronous publish has completed.
+ *
+ * @param[in] pvCtx Context passed to MqttAgent_PublishAsync.
+ * @param[in] xStatus Result of the publish operation.
+ */
+typedef void (* PublishCompleteCallback_t )( void * pvCtx,
+                                             MQTTStatus_t xStatus );
+
+/**
+ * @brief Read part of a streamed payload, called from the MQTT agent task.
+ *
+ * Must not use the MQTT agent. A QoS1 publish that is sent again after a
+ * reconnect reads its payload again from offset 0.
+ *
+ * @param[in] pvCtx Context passed to MqttAgent_PublishStream.
+ * @param[in] uxOffset Offset into the payload of the first byte to read.
+ * @param[out] pvBuffer Where to write the bytes.
+ * @param[in] uxLen Number of bytes to read, never past the end of the payload.
+ *
+ * @return pdTRUE if all uxLen bytes were read.
+ */
+typedef BaseType_t (* PublishStreamRead_t )( void * pvCtx,
+                                             size_t uxOffset,
+                                             void * pvBuffer,
+                                             size_t uxLen );
+
+/**
+ * @brief Initialize the publish buffer pool. Called by the MQTT agent task. Not thread safe.
+ */
+void MqttAgent_InitPublishPool( void );
+
+/**
+ * @brief Obtain a buffer of MQTT_PUBLISH_POOL_BUFFER_LEN bytes from the publish pool.
+ *
+ * @param[in] xTicksToWait Time to wait for a buffer to become available.
+ *
+ * @return Pointer to the buffer or NULL if none became available in time.
+ */
+void * MqttAgent_GetPublishBuffer( TickType_t xTicksToWait );
+
+/**
+ * @brief Return a buffer that was not handed to MqttAgent_PublishAsync.
+ */
+void MqttAgent_ReleasePublishBuffer( void * pvBuffer );
+
+/**
+ * @brief Publish the payload held in a buffer from MqttAgent_GetPublishBuffer without waiting.
+ *
+ * pxPublishInfo is copied, but the topic name it points to is not and must stay
+ * valid until the publish has completed. pxPublishInfo->pPayload must be the start
+ * of a pool buffer. The buffer is owned by the agent after this call regardless of
+ * the result and is released before xCallback returns.
+ *
+ * @param[in] xHandle Handle of the MQTT agent.
+ * @param[in] pxPublishInfo Publish parameters, pPayload pointing to a pool buffer.
+ * @param[in] xCallback Optional callback invoked from the agent task on completion.
+ * @param[in] pvCtx Context passed to xCallback.
+ * @param[in] ulBlockTimeMs Time to wait for space in the agent command queue.
+ *
+ * @return MQTTSuccess if the publish was queued. The callback is only invoked in that case.
+ */
+MQTTStatus_t MqttAgent_PublishAsync( MQTTAgentHandle_t xHandle,
+                                     const MQTTPublishInfo_t * pxPublishInfo,
+                                     PublishCompleteCallback_t xCallback,
+                                     void * pvCtx,
+                                     uint32_t ulBlockTimeMs );
+
+/**
+ * @brief Copy a payload and its topic into a pool buffer and publish it at QoS0.
+ *
+ * Neither pcTopic nor pvPayload are referenced after this call returns, so the
+ * caller does not have to wait for the agent to send the packet. The topic is
+ * stored behind the payload, so both must fit into MQTT_PUBLISH_POOL_BUFFER_LEN.
+ *
+ * @param[in] ulBlockTimeMs Time to wait for a pool buffer and again for space
+ * in the agent command queue.
+ *
+ * @return MQTTSuccess if the publish was queued, MQTTNoMemory if no buffer was available.
+ */
+MQTTStatus_t MqttAgent_PublishQoS0( MQTTAgentHandle_t xHandle,
+                                    const char * pcTopic,
+                                    const void * pvPayload,
+                                    size_t xPayloadLen,
+                                    uint32_t ulBlockTimeMs );
+
+/**
+ * @brief Publish a payload that is read in chunks while it is being sent, and wait for the result.
+ *
+ * The payload does not have to be held in RAM. The agent task sends the packet
+ * header and then, for every MQTT_PUBLISH_STREAM_CHUNK_LEN bytes, calls xRead and
+ * writes the chunk to the TLS connection. This is for payloads much larger than a
+ * publish buffer, e.g. captured sensor data or files. The agent sends nothing else
+ * while a streamed payload is being written.
+ *
+ * pxPublishInfo->pPayload is ignored and pxPublishInfo->payloadLength is the length
+ * of the streamed payload. The topic name must stay valid until this returns.
+ *
+ * @param[in] xHandle Handle of the MQTT agent.
+ * @param[in] pxPublishInfo Topic, QoS and length of the payload.
+ * @param[in] xRead Reads the payload, see PublishStreamRead_t.
+ * @param[in] pvReadCtx Passed to xRead, must stay valid until this returns.
+ * @param[in] ulTimeoutMs Time to wait for the publish to be sent (QoS0) or
+ * acknowledged (QoS1). If the agent has begun to send it by then, this waits
+ * on until the publish completes.
+ *
+ * @return MQTTSuccess once the publish completed, MQTTNoMemory if all
+ * MQTT_PUBLISH_STREAMS are in use, or the error of the publish. On a timeout
+ * the result is MQTTKeepAliveTimeout, and the agent drops the connection when
+ * it reaches the publish, as it can no longer read the payload.
+ */
+MQTTStatus_t MqttAgent_PublishStream( MQTTAgentHandle_t xHandle,
+                                      const MQTTPublishInfo_t * pxPublishInfo,
+                                      PublishStreamRead_t xRead,
+                                      void * pvReadCtx,
+                                      uint32_t ulTimeoutMs );
+
+#if MQTT_PUBLISH_STREAM_LFS == 1
+
+/**
+ * @brief Publish the contents of a file in the default littlefs filesystem with MqttAgent_PublishStream.
+ */
+MQTTStatus_t MqttAgent_PublishFile( MQTTAgentHandle_t xHandle,
+                                    const MQTTPublishInfo_t * pxPublishInfo,
+                                    const char * pcPath,
+                                    uint32_t ulTimeoutMs );
+
+#endif /* MQTT_PUBLISH_STREAM_LFS == 1 */
+
+/**
+ * @brief Transport writev of the MQTT agent, which sends streamed payloads.
+ *
+ * Packets without a streamed payload are passed to xWritev unchanged. For a
+ * streamed payload, the vectors are copied and the payload is read into a chunk
+ * buffer, which is written with xSend every time it is full.
+ */
+int32_t MqttAgent_StreamWritev( NetworkContext_t * pxNetworkContext,
+                                TransportOutVector_t * pxIoVec,
+                                size_t uxIoVecCount,
+                                TransportSend_t xSend,
+                                TransportWritev_t xWritev );
+
+/**
+ * @brief Build the topic "<root>/<pcSuffix>" of a telemetry stream.
+ *
+ * The root is CS_TELEMETRY_ROOT, or the thing name if that is not set. The
+ * topic is sent in full with every publish, so a short root set for a fleet,
+ * e.g. "d/17", saves bytes on each small telemetry message.
+ *
+ * @return Length of the topic, 0 if there is no root or it does not fit into uxBufferLen.
+ */
+size_t MqttAgent_BuildTelemetryTopic( const char * pcSuffix,
+                                      char * pcBuffer,
+                                      size_t uxBufferLen );
+
+/**
+ * @brief Record the time at which the agent took a publish from its queue.
+ *
+ * Called by the MQTT agent task for every publish, those not sent from a pool
+ * buffer are ignored.
+ */
+void MqttAgent_NotePublishDequeued( const MQTTPublishInfo_t * pxPublishInfo );
+
+/**
+ * @brief ullTimeBaseGetUs at which the agent took the publish being completed.
+ *
+ * Only valid within a PublishCompleteCallback_t.
+ *
+ * @return 0 if not recorded, e.g. without MQTT_AGENT_STATS_ENABLED.
+ */
+uint64_t MqttAgent_GetPublishDequeuedUs( void );
+
+#endif /* MQTT_PUBLISH_ASYNC_H */
@@ -0,0 +1,259 @@
+/*
+ * FreeRTOS STM32 Reference Integration
+ * Copyright (C) 2022 Amazon.com, Inc. or its affiliates.  All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ *
+ * https://www.FreeRTOS.org
+ * https://github.com/FreeRTOS
+ *
+ */
+
+/**
+ * @file mqtt_reconnect.c
+ * @brief Reconnect scheduling for the MQTT agent.
+ */
+
+#include "logging_levels.h"
+
+#define LOG_LEVEL    LOG_INFO
+#define LOG_MODULE    LOG_MODULE_MQTT
+
+#include "logging.h"
+
+/* Standard includes. */
+#include <string.h>
+
+/* Kernel includes. */
+#include "FreeRTOS.h"
+#include "task.h"
+#include "event_groups.h"
+
+#include "sys_evt.h"
+#include "mqtt_reconnect.h"
+
+/* Granularity at which a backoff wait checks the network state */
+#define RECONNECT_POLL_MS                  ( 100U )
+
+/* Spread the retries of a fleet that sees its network come back at the same time */
+#ifndef RECONNECT_NET_UP_JITTER_MS
+#define RECONNECT_NET_UP_JITTER_MS         ( 2000U )
+#endif
+
+typedef struct
+{
+    uint32_t ulBaseMs;
+    uint32_t ulMaxMs;
+} ReconnectBackoff_t;
+
+/* Backoff bounds per failure class. Credential and protocol errors back off
+ * further since an immediate retry is unlikely to succeed. */
+static const ReconnectBackoff_t xBackoffs[ RECONNECT_CLASS_MAX ] =
+{
+    [ RECONNECT_CLASS_NETWORK_DOWN ] = { 0U,     0U          },
+    [ RECONNECT_CLASS_DNS ]          = { 1000U,  60U * 1000U },
+    [ RECONNECT_CLASS_TCP ]          = { 1000U, 120U * 1000U },
+    [ RECONNECT_CLASS_TLS ]          = { 5000U, 300U * 1000U },
+    [ RECONNECT_CLASS_MQTT_CONNECT ] = { 5000U, 300U * 1000U },
+    [ RECONNECT_CLASS_DISCONNECT ]   = { 5000U, 300U * 1000U },
+    [ RECONNECT_CLASS_OTHER ]        = { 1000U,  60U * 1000U },
+};
+
+static const char * const pcClassNames[ RECONNECT_CLASS_MAX ] =
+{
+    [ RECONNECT_CLASS_NETWORK_DOWN ] = "network down",
+    [ RECONNECT_CLASS_DNS ]          = "dns",
+    [ RECONNECT_CLASS_TCP ]          = "tcp",
+    [ RECONNECT_CLASS_TLS ]          = "tls",
+    [ RECONNECT_CLASS_MQTT_CONNECT ] = "mqtt connect",
+    [ RECONNECT_CLASS_DISCONNECT ]   = "disconnect",
+    [ RECONNECT_CLASS_OTHER ]        = "other",
+};
+
+static ReconnectScheduler_t * pxAgentScheduler = NULL;
+
+extern UBaseType_t uxRand( void );
+
+/*-----------------------------------------------------------*/
+
+void vReconnectInit( ReconnectScheduler_t * pxSched )
+{
+    configASSERT( pxSched != NULL );
+
+    memset( pxSched, 0, sizeof( ReconnectScheduler_t ) );
+
+    /* The first scheduler is the one used by the MQTT agent */
+    if( pxAgentScheduler == NULL )
+    {
+        pxAgentScheduler = pxSched;
+    }
+}
+
+/*-----------------------------------------------------------*/
+
+uint32_t ulReconnectOnFailure( ReconnectScheduler_t * pxSched,
+                               ReconnectClass_t xClass )
+{
+    uint32_t ulBoundMs = 0;
+    uint32_t ulDelayMs = 0;
+
+    configASSERT( pxSched != NULL );
+    configASSERT( xClass < RECONNECT_CLASS_MAX );
+
+    ulBoundMs = xBackoffs[ xClass ].ulBaseMs;
+
+    /* Double the bound for every consecutive failure of this class */
+    for( uint32_t ulIdx = 0;
+         ( ulIdx < pxSched->pulConsecutive[ xClass ] ) && ( ulBoundMs < xBackoffs[ xClass ].ulMaxMs );
+         ulIdx++ )
+    {
+        ulBoundMs *= 2U;
+    }
+
+    if( ulBoundMs > xBackoffs[ xClass ].ulMaxMs )
+    {
+        ulBoundMs = xBackoffs[ xClass ].ulMaxMs;
+    }
+
+    /* Full jitter */
+    if( ulBoundMs > 0 )
+    {
+        ulDelayMs = ( uint32_t ) uxRand() % ( ulBoundMs + 1U );
+    }
+
+    taskENTER_CRITICAL();
+    {
+        pxSched->pulFailures[ xClass ]++;
+        pxSched->pulConsecutive[ xClass ]++;
+        pxSched->xLastClass = xClass;
+    }
+    taskEXIT_CRITICAL();
+
+    LogWarn( "Connection failure (%s), %lu in a row, %lu total. Retrying in %lu ms.",
+             pcClassNames[ xClass ],
+             pxSched->pulConsecutive[ xClass ],
+             pxSched->pulFailures[ xClass ],
+             ulDelayMs );
+
+    return ulDelayMs;
+}
+
+/*-----------------------------------------------------------*/
+
+void vReconnectOnSuccess( ReconnectScheduler_t * pxSched )
+{
+    configASSERT( pxSched != NULL );
+
+    taskENTER_CRITICAL();
+    {
+        memset( pxSched->pulConsecutive, 0, sizeof( pxSched->pulConsecutive ) );
+        pxSched->ulConnects++;
+    }
+    taskEXIT_CRITICAL();
+}
+
+/*-----------------------------------------------------------*/
+
+static BaseType_t prvIsNetworkUp( void )
+{
+    EventBits_t uxEvents = xEventGroupGetBits( xSystemEvents );
+
+    return( ( uxEvents & EVT_MASK_NET_CONNECTED ) == EVT_MASK_NET_CONNECTED );
+}
+
+/*-----------------------------------------------------------*/
+
+static void prvWaitForNetwork( void )
+{
+    ( void ) xEventGroupWaitBits( xSystemEvents,
+                                  EVT_MASK_NET_CONNECTED,
+                                  pdFALSE,
+                                  pdTRUE,
+                                  portMAX_DELAY );
+
+    /* Network just came up, retry after a short random delay */
+    vTaskDelay( pdMS_TO_TICKS( ( uint32_t ) uxRand() % ( RECONNECT_NET_UP_JITTER_MS + 1U ) ) );
+}
+
+/*-----------------------------------------------------------*/
+
+void vReconnectWait( uint32_t ulDelayMs )
+{
+    TickType_t xTicksToWait = pdMS_TO_TICKS( ulDelayMs );
+    TimeOut_t xTimeOut;
+    BaseType_t xDone = pdFALSE;
+
+    vTaskSetTimeOutState( &xTimeOut );
+
+    while( xDone == pdFALSE )
+    {
+        if( prvIsNetworkUp() == pdFALSE )
+        {
+            LogInfo( "Waiting for the network to be connected." );
+            prvWaitForNetwork();
+            xDone = pdTRUE;
+        }
+        else if( xTaskCheckForTimeOut( &xTimeOut, &xTicksToWait ) == pdTRUE )
+        {
+            xDone = pdTRUE;
+        }
+        else
+        {
+            TickType_t xSlice = pdMS_TO_TICKS( RECONNECT_POLL_MS );
+
+            vTaskDelay( ( xTicksToWait < xSlice ) ? xTicksToWait : xSlice );
+        }
+    }
+}
+
+/*-----------------------------------------------------------*/
+
+BaseType_t xReconnectGetStats( ReconnectScheduler_t * pxStats )
+{
+    BaseType_t xResult = pdFALSE;
+
+    configASSERT( pxStats != NULL );
+
+    if( pxAgentScheduler != NULL )
+    {
+        taskENTER_CRITICAL();
+        {
+            *pxStats = *pxAgentScheduler;
+        }
+        taskEXIT_CRITICAL();
+
+        xResult = pdTRUE;
+    }
+
+    return xResult;
+}
+
+/*-----------------------------------------------------------*/
+
+const char * pcReconnectClassName( ReconnectClass_t xClass )
+{
+    const char * pcName = "unknown";
+
+    if( xClass < RECONNECT_CLASS_MAX )
+    {
+        pcName = pcClassNames[ xClass ];
+    }
+
+    return pcName;
+}
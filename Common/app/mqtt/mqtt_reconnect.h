@@ -0,0 +1,95 @@
+/*
+ * FreeRTOS STM32 Reference Integration
+ * Copyright (C) 2022 Amazon.com, Inc. or its affiliates.  All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ *
+ * https://www.FreeRTOS.org
+ * https://github.com/FreeRTOS
+ *
+ */
+
+/**
+ * @file mqtt_reconnect.h
+ * @brief Reconnect scheduling for the MQTT agent.
+ *
+ * Each class of connection failure keeps its own attempt counter and backoff
+ * range. Delays use full jitter, i.e. they are drawn uniformly from zero up to
+ * the current exponential bound, so that devices dropped at the same moment do
+ * not retry in lockstep. A wait is cut short when the network comes back up.
+ */
+#ifndef MQTT_RECONNECT_H
+#define MQTT_RECONNECT_H
+
+#include "FreeRTOS.h"
+
+typedef enum
+{
+    RECONNECT_CLASS_NETWORK_DOWN = 0, /* Network interface not connected */
+    RECONNECT_CLASS_DNS,              /* Host name lookup failed */
+    RECONNECT_CLASS_TCP,              /* TCP connect failed or no socket available */
+    RECONNECT_CLASS_TLS,              /* TLS handshake or credential failure */
+    RECONNECT_CLASS_MQTT_CONNECT,     /* CONNECT rejected or no CONNACK */
+    RECONNECT_CLASS_DISCONNECT,       /* An established connection was lost */
+    RECONNECT_CLASS_OTHER,            /* Out of memory or internal error */
+    RECONNECT_CLASS_MAX
+} ReconnectClass_t;
+
+typedef struct
+{
+    uint32_t pulFailures[ RECONNECT_CLASS_MAX ];       /* Total failures per class */
+    uint32_t pulConsecutive[ RECONNECT_CLASS_MAX ];    /* Failures since the last successful connection */
+    uint32_t ulConnects;                               /* Successful connections */
+    ReconnectClass_t xLastClass;
+} ReconnectScheduler_t;
+
+/*
+ * @brief Reset all counters.
+ */
+void vReconnectInit( ReconnectScheduler_t * pxSched );
+
+/*
+ * @brief Record a failure and return the time to wait before the next attempt.
+ */
+uint32_t ulReconnectOnFailure( ReconnectScheduler_t * pxSched,
+                               ReconnectClass_t xClass );
+
+/*
+ * @brief Record a successful connection. Resets the backoff of every class.
+ */
+void vReconnectOnSuccess( ReconnectScheduler_t * pxSched );
+
+/*
+ * @brief Wait for ulDelayMs, or until the network interface comes back up if
+ * it goes down during the wait. Also waits for the network to be connected.
+ */
+void vReconnectWait( uint32_t ulDelayMs );
+
+/*
+ * @brief Copy the counters of the MQTT agent's scheduler.
+ * @return pdFALSE if the agent has not started.
+ */
+BaseType_t xReconnectGetStats( ReconnectScheduler_t * pxStats );
+
+/*
+ * @brief Name of a failure class, for logging.
+ */
+const char * pcReconnectClassName( ReconnectClass_t xClass );
+
+#endif /* MQTT_RECONNECT_H */
@@ -31,6 +31,9 @@
 #ifndef SUBSCRIPTION_MANAGER_H
 #define SUBSCRIPTION_MANAGER_H
 
+#include "FreeRTOS.h"
+#include "queue.h"
+
 #include "mqtt_metrics.h"
 #include "core_mqtt.h"
 #include "mqtt_agent_task.h"
@@ -76,6 +79,7 @@ typedef struct
     void * pvIncomingPublishCallbackContext;
     TaskHandle_t xTaskHandle;
     MQTTSubscribeInfo_t * pxSubInfo;
+    QueueHandle_t xDeliveryQueue; /* NULL to run the callback in the MQTT agent task */
 } SubCallbackElement_t;
 
 
@@ -94,6 +98,99 @@ MQTTStatus_t MqttAgent_SubscribeSync( MQTTAgentHandle_t xHandle,
                                       IncomingPubCallback_t pxCallback,
                                       void * pvCallbackCtx );
 
+/* @brief Add a callback for a given topic filter that runs on the subscriber's own task.
+ *
+ * Matching publishes are copied to the heap and posted to xDeliveryQueue instead of
+ * being handled in the MQTT agent task, so a slow callback does not delay keep-alives
+ * or other subscribers. The subscribing task must call MqttAgent_ProcessDeliveryQueue
+ * to run the callback. Publishes are dropped if the queue is full.
+ *
+ * @param[in] xHandle Handle for the desired MQTT Agent Task instance.
+ * @param[in] pcTopicFilter Topic filter string to subscribe to.
+ * @param[in] xRequestedQoS Requested QoS for this subscription.
+ * @param[in] pxIncomingPublishCallback Callback function for the subscription.
+ * @param[in] pvIncomingPublishCallbackContext Context for the subscription callback.
+ * @param[in] xDeliveryQueue Queue created with MqttAgent_CreateDeliveryQueue.
+ * @return `MQTTSuccess` if the subscription was added successfully.
+ **/
+MQTTStatus_t MqttAgent_SubscribeSyncDeferred( MQTTAgentHandle_t xHandle,
+                                              const char * pcTopicFilter,
+                                              MQTTQoS_t xRequestedQoS,
+                                              IncomingPubCallback_t pxCallback,
+                                              void * pvCallbackCtx,
+                                              QueueHandle_t xDeliveryQueue );
+
+/**
+ * @brief One topic filter of a MqttAgent_SubscribeAsync request.
+ */
+typedef struct
+{
+    const char * pcTopicFilter;
+    MQTTQoS_t xRequestedQoS;
+    IncomingPubCallback_t pxCallback;
+    void * pvCallbackCtx;
+} SubscribeRequest_t;
+
+/**
+ * @brief Called from the MQTT agent task once the SUBACK of an asynchronous subscribe arrives.
+ *
+ * @param[in] pvCtx Context passed to MqttAgent_SubscribeAsync.
+ * @param[in] xStatus MQTTSuccess if every topic filter was granted, MQTTServerRefused
+ * if the broker rejected any of them, another error otherwise.
+ */
+typedef void (* SubscribeCompleteCallback_t )( void * pvCtx,
+                                               MQTTStatus_t xStatus );
+
+/* @brief Add callbacks for several topic filters and subscribe to them without blocking.
+ *
+ * All filters that are not subscribed yet are sent in a single SUBSCRIBE packet. Several
+ * requests may be outstanding at the same time. The callbacks are registered before this
+ * function returns, so publishes may arrive before xCompleteCallback is called.
+ *
+ * @param[in] xHandle Handle for the desired MQTT Agent Task instance.
+ * @param[in] pxRequests Topic filters and callbacks. Only read during the call.
+ * @param[in] uxRequestCount Number of elements in pxRequests.
+ * @param[in] xCompleteCallback Optional callback. Called from the calling task if nothing
+ * needed to be subscribed, otherwise from the MQTT agent task.
+ * @param[in] pvCompleteCtx Context for xCompleteCallback.
+ * @return `MQTTSuccess` if the request was queued. xCompleteCallback is only called in that case.
+ **/
+MQTTStatus_t MqttAgent_SubscribeAsync( MQTTAgentHandle_t xHandle,
+                                       const SubscribeRequest_t * pxRequests,
+                                       size_t uxRequestCount,
+                                       SubscribeCompleteCallback_t xCompleteCallback,
+                                       void * pvCompleteCtx );
+
+/* @brief Subscribe to several topic filters with a single SUBSCRIBE and wait for the SUBACK.
+ *
+ * @param[in] xHandle Handle for the desired MQTT Agent Task instance.
+ * @param[in] pxRequests Topic filters and callbacks.
+ * @param[in] uxRequestCount Number of elements in pxRequests.
+ * @return `MQTTSuccess` if all subscriptions were added successfully.
+ **/
+MQTTStatus_t MqttAgent_SubscribeMultiSync( MQTTAgentHandle_t xHandle,
+                                           const SubscribeRequest_t * pxRequests,
+                                           size_t uxRequestCount );
+
+/* @brief Create a queue for MqttAgent_SubscribeSyncDeferred.
+ *
+ * @param[in] uxQueueLength Number of publishes that may be pending before new ones are dropped.
+ * @return The queue, or NULL if out of memory.
+ **/
+QueueHandle_t MqttAgent_CreateDeliveryQueue( UBaseType_t uxQueueLength );
+
+/* @brief Run the callbacks of publishes posted to xDeliveryQueue.
+ *
+ * Waits up to xTicksToWait for the first publish, then handles any others already queued.
+ * Keep calling this after unsubscribing until the queue is empty to release pending publishes.
+ *
+ * @param[in] xDeliveryQueue Queue passed to MqttAgent_SubscribeSyncDeferred.
+ * @param[in] xTicksToWait Time to wait for a publish.
+ * @return Number of publishes handled.
+ **/
+UBaseType_t MqttAgent_ProcessDeliveryQueue( QueueHandle_t xDeliveryQueue,
+                                            TickType_t xTicksToWait );
+
 /* @brief Remove the specified callback from the given topic filter.
  * Unsubscribe from the specified topic is no other callback exist for the same filter.
  *
@@ -0,0 +1,350 @@
+/*
+ * FreeRTOS STM32 Reference Integration
+ * Copyright (C) 2022 Amazon.com, Inc. or its affiliates.  All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ *
+ * https://www.FreeRTOS.org
+ * https://github.com/FreeRTOS
+ *
+ */
+
+/**
+ * @file topic_trie.c
+ * @brief Topic filter trie used to dispatch incoming publishes.
+ */
+
+/* Standard includes. */
+#include <string.h>
+
+/* Kernel includes. */
+#include "FreeRTOS.h"
+
+#include "topic_trie.h"
+
+typedef struct TopicTrieValue
+{
+    void * pvValue;
+    struct TopicTrieValue * pxNext;
+} TopicTrieValue_t;
+
+struct TopicTrieNode
+{
+    TopicTrieNode_t * pxChildren;    /* First child with a literal level */
+    TopicTrieNode_t * pxNext;        /* Next sibling with a literal level */
+    TopicTrieNode_t * pxSingleLevel; /* Child for the '+' wildcard */
+    TopicTrieNode_t * pxMultiLevel;  /* Child for the '#' wildcard */
+    TopicTrieValue_t * pxValues;     /* Values of filters ending at this node */
+    uint16_t usLevelLen;
+    char cLevel[];                   /* Topic level, not null terminated */
+};
+
+/*-----------------------------------------------------------*/
+
+static TopicTrieNode_t * pxNodeAlloc( const char * pcLevel,
+                                      uint16_t usLevelLen )
+{
+    TopicTrieNode_t * pxNode = pvPortMalloc( sizeof( TopicTrieNode_t ) + usLevelLen );
+
+    if( pxNode != NULL )
+    {
+        memset( pxNode, 0, sizeof( TopicTrieNode_t ) );
+        pxNode->usLevelLen = usLevelLen;
+
+        if( usLevelLen > 0 )
+        {
+            memcpy( pxNode->cLevel, pcLevel, usLevelLen );
+        }
+    }
+
+    return pxNode;
+}
+
+/*-----------------------------------------------------------*/
+
+/* Length of the topic level starting at pcLevel */
+static uint16_t usLevelLength( const char * pcLevel,
+                               uint32_t ulRemaining )
+{
+    uint16_t usLen = 0;
+
+    while( ( usLen < ulRemaining ) && ( pcLevel[ usLen ] != '/' ) )
+    {
+        usLen++;
+    }
+
+    return usLen;
+}
+
+/*-----------------------------------------------------------*/
+
+static TopicTrieNode_t * pxFindChild( const TopicTrieNode_t * pxNode,
+                                      const char * pcLevel,
+                                      uint16_t usLevelLen )
+{
+    TopicTrieNode_t * pxChild = pxNode->pxChildren;
+
+    while( ( pxChild != NULL ) &&
+           ( ( pxChild->usLevelLen != usLevelLen ) ||
+             ( memcmp( pxChild->cLevel, pcLevel, usLevelLen ) != 0 ) ) )
+    {
+        pxChild = pxChild->pxNext;
+    }
+
+    return pxChild;
+}
+
+/*-----------------------------------------------------------*/
+
+BaseType_t xTopicTrieInsert( TopicTrieNode_t ** ppxRoot,
+                             const char * pcTopicFilter,
+                             uint16_t usTopicFilterLen,
+                             void * pvValue )
+{
+    BaseType_t xSuccess = pdTRUE;
+    TopicTrieNode_t * pxNode = NULL;
+    uint32_t ulOffset = 0;
+
+    configASSERT( ppxRoot != NULL );
+    configASSERT( pcTopicFilter != NULL );
+
+    if( usTopicFilterLen == 0 )
+    {
+        xSuccess = pdFALSE;
+    }
+    else if( *ppxRoot == NULL )
+    {
+        *ppxRoot = pxNodeAlloc( NULL, 0 );
+        xSuccess = ( *ppxRoot != NULL ) ? pdTRUE : pdFALSE;
+    }
+    else
+    {
+        /* Empty */
+    }
+
+    pxNode = *ppxRoot;
+
+    /* Walk one level per iteration, creating nodes as needed */
+    while( ( xSuccess == pdTRUE ) && ( ulOffset <= usTopicFilterLen ) )
+    {
+        const char * pcLevel = &( pcTopicFilter[ ulOffset ] );
+        uint16_t usLevelLen = usLevelLength( pcLevel, usTopicFilterLen - ulOffset );
+        BaseType_t xLastLevel = ( ( ulOffset + usLevelLen ) >= usTopicFilterLen ) ? pdTRUE : pdFALSE;
+        TopicTrieNode_t ** ppxChild = NULL;
+        TopicTrieNode_t * pxChild = NULL;
+
+        if( ( usLevelLen == 1 ) && ( pcLevel[ 0 ] == '#' ) )
+        {
+            /* The multi-level wildcard must be the last level */
+            xSuccess = xLastLevel;
+            ppxChild = &( pxNode->pxMultiLevel );
+        }
+        else if( ( usLevelLen == 1 ) && ( pcLevel[ 0 ] == '+' ) )
+        {
+            ppxChild = &( pxNode->pxSingleLevel );
+        }
+        else if( ( memchr( pcLevel, '#', usLevelLen ) != NULL ) ||
+                 ( memchr( pcLevel, '+', usLevelLen ) != NULL ) )
+        {
+            /* Wildcards must occupy a whole level */
+            xSuccess = pdFALSE;
+        }
+        else
+        {
+            pxChild = pxFindChild( pxNode, pcLevel, usLevelLen );
+
+            if( pxChild == NULL )
+            {
+                pxChild = pxNodeAlloc( pcLevel, usLevelLen );
+
+                if( pxChild != NULL )
+                {
+                    pxChild->pxNext = pxNode->pxChildren;
+                    pxNode->pxChildren = pxChild;
+                }
+                else
+                {
+                    xSuccess = pdFALSE;
+                }
+            }
+        }
+
+        if( ( xSuccess == pdTRUE ) && ( ppxChild != NULL ) )
+        {
+            if( *ppxChild == NULL )
+            {
+                *ppxChild = pxNodeAlloc( pcLevel, usLevelLen );
+            }
+
+            pxChild = *ppxChild;
+            xSuccess = ( pxChild != NULL ) ? pdTRUE : pdFALSE;
+        }
+
+        pxNode = pxChild;
+
+        /* Skip the level and its '/' separator */
+        ulOffset += usLevelLen + 1;
+    }
+
+    if( xSuccess == pdTRUE )
+    {
+        TopicTrieValue_t * pxValue = pvPortMalloc( sizeof( TopicTrieValue_t ) );
+
+        if( pxValue != NULL )
+        {
+            pxValue->pvValue = pvValue;
+            pxValue->pxNext = pxNode->pxValues;
+            pxNode->pxValues = pxValue;
+        }
+        else
+        {
+            xSuccess = pdFALSE;
+        }
+    }
+
+    return xSuccess;
+}
+
+/*-----------------------------------------------------------*/
+
+static size_t uxCallValues( const TopicTrieNode_t * pxNode,
+                            TopicTrieMatchCallback_t pxCallback,
+                            void * pvCtx )
+{
+    size_t uxCount = 0;
+
+    if( pxNode != NULL )
+    {
+        for( const TopicTrieValue_t * pxValue = pxNode->pxValues; pxValue != NULL; pxValue = pxValue->pxNext )
+        {
+            pxCallback( pxValue->pvValue, pvCtx );
+            uxCount++;
+        }
+    }
+
+    return uxCount;
+}
+
+/*-----------------------------------------------------------*/
+
+/*
+ * Match the topic levels starting at ulOffset against the children of pxNode.
+ * Recursion only branches on '+' children, so the depth is bounded by the number of topic levels.
+ */
+static size_t uxMatchLevel( const TopicTrieNode_t * pxNode,
+                            const char * pcTopicName,
+                            uint16_t usTopicNameLen,
+                            uint32_t ulOffset,
+                            BaseType_t xAllowWildcards,
+                            TopicTrieMatchCallback_t pxCallback,
+                            void * pvCtx )
+{
+    size_t uxCount = 0;
+
+    /* '#' also matches the parent level, so "a/#" matches "a" */
+    if( xAllowWildcards == pdTRUE )
+    {
+        uxCount += uxCallValues( pxNode->pxMultiLevel, pxCallback, pvCtx );
+    }
+
+    if( ulOffset > usTopicNameLen )
+    {
+        /* All levels consumed, pxNode matches the whole topic */
+        uxCount += uxCallValues( pxNode, pxCallback, pvCtx );
+    }
+    else
+    {
+        const char * pcLevel = &( pcTopicName[ ulOffset ] );
+        uint16_t usLevelLen = usLevelLength( pcLevel, usTopicNameLen - ulOffset );
+        uint32_t ulNextOffset = ulOffset + usLevelLen + 1;
+        const TopicTrieNode_t * pxChild = pxFindChild( pxNode, pcLevel, usLevelLen );
+
+        if( pxChild != NULL )
+        {
+            uxCount += uxMatchLevel( pxChild, pcTopicName, usTopicNameLen, ulNextOffset,
+                                     pdTRUE, pxCallback, pvCtx );
+        }
+
+        if( ( xAllowWildcards == pdTRUE ) &&
+            ( pxNode->pxSingleLevel != NULL ) )
+        {
+            uxCount += uxMatchLevel( pxNode->pxSingleLevel, pcTopicName, usTopicNameLen, ulNextOffset,
+                                     pdTRUE, pxCallback, pvCtx );
+        }
+    }
+
+    return uxCount;
+}
+
+/*-----------------------------------------------------------*/
+
+size_t uxTopicTrieMatch( const TopicTrieNode_t * pxRoot,
+                         const char * pcTopicName,
+                         uint16_t usTopicNameLen,
+                         TopicTrieMatchCallback_t pxCallback,
+                         void * pvCtx )
+{
+    size_t uxCount = 0;
+
+    configASSERT( pxCallback != NULL );
+
+    if( ( pxRoot != NULL ) &&
+        ( pcTopicName != NULL ) &&
+        ( usTopicNameLen > 0 ) )
+    {
+        /* Wildcards in the first level do not match topics starting with '$' */
+        BaseType_t xAllowWildcards = ( pcTopicName[ 0 ] != '$' ) ? pdTRUE : pdFALSE;
+
+        uxCount = uxMatchLevel( pxRoot, pcTopicName, usTopicNameLen, 0,
+                                xAllowWildcards, pxCallback, pvCtx );
+    }
+
+    return uxCount;
+}
+
+/*-----------------------------------------------------------*/
+
+void vTopicTrieFree( TopicTrieNode_t * pxRoot )
+{
+    if( pxRoot != NULL )
+    {
+        TopicTrieValue_t * pxValue = pxRoot->pxValues;
+
+        while( pxValue != NULL )
+        {
+            TopicTrieValue_t * pxNextValue = pxValue->pxNext;
+
+            vPortFree( pxValue );
+            pxValue = pxNextValue;
+        }
+
+        vTopicTrieFree( pxRoot->pxSingleLevel );
+        vTopicTrieFree( pxRoot->pxMultiLevel );
+
+        while( pxRoot->pxChildren != NULL )
+        {
+            TopicTrieNode_t * pxChild = pxRoot->pxChildren;
+
+            pxRoot->pxChildren = pxChild->pxNext;
+            vTopicTrieFree( pxChild );
+        }
+
+        vPortFree( pxRoot );
+    }
+}
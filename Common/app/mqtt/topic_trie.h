@@ -0,0 +1,79 @@
+/*
+ * FreeRTOS STM32 Reference Integration
+ * Copyright (C) 2022 Amazon.com, Inc. or its affiliates.  All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ *
+ * https://www.FreeRTOS.org
+ * https://github.com/FreeRTOS
+ *
+ */
+
+/**
+ * @file topic_trie.h
+ * @brief Topic filter trie used to dispatch incoming publishes.
+ *
+ * Each node represents one topic level. Literal levels are kept in a sibling
+ * list while the '+' and '#' wildcards have dedicated links, so matching a topic
+ * costs one sibling scan per level plus the wildcard branches, independent of
+ * the total number of filters in the trie.
+ */
+#ifndef TOPIC_TRIE_H
+#define TOPIC_TRIE_H
+
+#include <stdint.h>
+
+#include "FreeRTOS.h"
+
+typedef struct TopicTrieNode TopicTrieNode_t;
+
+/**
+ * @brief Called for every value whose filter matches the topic passed to xTopicTrieMatch.
+ */
+typedef void ( * TopicTrieMatchCallback_t )( void * pvValue,
+                                             void * pvCtx );
+
+/**
+ * @brief Add a value for the given topic filter, creating the root node if *ppxRoot is NULL.
+ *
+ * @return pdTRUE on success, pdFALSE if the filter is invalid or memory is exhausted.
+ * Nodes added before a failure are kept and released by vTopicTrieFree.
+ */
+BaseType_t xTopicTrieInsert( TopicTrieNode_t ** ppxRoot,
+                             const char * pcTopicFilter,
+                             uint16_t usTopicFilterLen,
+                             void * pvValue );
+
+/**
+ * @brief Call pxCallback for each value stored under a filter matching pcTopicName.
+ *
+ * @return Number of values for which pxCallback was called.
+ */
+size_t uxTopicTrieMatch( const TopicTrieNode_t * pxRoot,
+                         const char * pcTopicName,
+                         uint16_t usTopicNameLen,
+                         TopicTrieMatchCallback_t pxCallback,
+                         void * pvCtx );
+
+/**
+ * @brief Free the whole trie. pxRoot may be NULL.
+ */
+void vTopicTrieFree( TopicTrieNode_t * pxRoot );
+
+#endif /* TOPIC_TRIE_H */
@@ -41,6 +41,7 @@
 /* define LOG_LEVEL here if you want to modify the logging level from the default */
 
 #define LOG_LEVEL    LOG_INFO
+#define LOG_MODULE    LOG_MODULE_OTA
 
 #include "logging.h"
 
@@ -55,6 +56,8 @@
 #include "task.h"
 #include "semphr.h"
 #include "sys_evt.h"
+#include "heap_classes.h"
+#include "dma_copy.h"
 
 #include "ota_config.h"
 
@@ -81,6 +84,11 @@
 
 #include "kvstore.h"
 
+#if ( configENABLED_DATA_PROTOCOLS & OTA_DATA_OVER_HTTP )
+#include "core_http_client.h"
+#include "mbedtls_transport.h"
+#endif /* configENABLED_DATA_PROTOCOLS & OTA_DATA_OVER_HTTP */
+
 #ifdef TFM_PSA_API
 #include "tfm_fwu_defs.h"
 #include "psa/update.h"
@@ -118,6 +126,41 @@
  */
 #define otaexampleMQTT_TIMEOUT_MS                 ( 10 * 1000U )
 
+/**
+ * @brief The maximum time an incoming block waits for a free event buffer.
+ *
+ * Blocks arrive faster than they can be written to flash when the download window
+ * is large. Rather than dropping a block and waiting otaconfigFILE_REQUEST_WAIT_MS
+ * for it to be requested again, the MQTT agent is held back until the OTA agent
+ * has written an earlier block, which in turn throttles the broker through TCP.
+ */
+#define otaexampleBLOCK_BUFFER_WAIT_MS            ( 500U )
+
+/**
+ * @brief Download rate control.
+ *
+ * Before each block request, OTA gives way to commands queued for the MQTT agent
+ * for up to CS_OTA_YIELD_MS, so application publishes go out first and OTA only
+ * uses the link when it is otherwise idle. CS_OTA_RATE_LIMIT_KBPS additionally
+ * caps the download rate with a token bucket holding otaexampleRATE_BURST_MS
+ * worth of data; 0 leaves the rate unlimited. Both are read from the key value
+ * store on every request, so they can be changed at run time.
+ */
+#define otaexampleYIELD_POLL_MS                   ( 10U )
+#define otaexampleRATE_BURST_MS                   ( 1000U )
+
+/**
+ * @brief Port, socket timeouts and buffer sizes of the HTTPS connection used for
+ * downloading file blocks with ranged GET requests.
+ *
+ * The request line carries the presigned URL, which runs to well over a kilobyte.
+ */
+#define otaexampleHTTP_PORT                       ( 443U )
+#define otaexampleHTTP_TIMEOUT_MS                 ( 5 * 1000U )
+#define otaexampleHTTP_MAX_HOST_LEN               ( 128U )
+#define otaexampleHTTP_HEADER_BUFFER_SIZE         ( 2048U )
+#define otaexampleHTTP_STATUS_PARTIAL_CONTENT     ( 206U )
+
 /**
  * @brief The common prefix for all OTA topics.
  *
@@ -220,6 +263,7 @@ typedef struct OtaEventBufferPool
 {
     OtaEventData_t eventBuffer[ otaconfigMAX_NUM_OTA_DATA_BUFFERS ];
     SemaphoreHandle_t lock;
+    SemaphoreHandle_t freeBuffers; /* Counts the unused buffers in eventBuffer */
 } OtaEventBufferPool_t;
 
 /**
@@ -262,6 +306,27 @@ typedef struct OtaAppStaticBuffer
     OtaEventBufferPool_t eventBufferPool;
 } OtaAppStaticBuffer_t;
 
+#if ( configENABLED_DATA_PROTOCOLS & OTA_DATA_OVER_HTTP )
+
+/**
+ * @brief The keep-alive connection used to download file blocks over HTTP.
+ *
+ * pcPath points into the URL held by the OTA agent, which stays valid until
+ * the HTTP interface is deinitialized.
+ */
+typedef struct OtaHttpConnection
+{
+    NetworkContext_t * pxNetworkContext;
+    TransportInterface_t xTransport;
+    BaseType_t xConnected;
+    char pcHost[ otaexampleHTTP_MAX_HOST_LEN ];
+    const char * pcPath;
+    size_t uxPathLen;
+    uint8_t ucHeaderBuffer[ otaexampleHTTP_HEADER_BUFFER_SIZE ];
+} OtaHttpConnection_t;
+
+#endif /* configENABLED_DATA_PROTOCOLS & OTA_DATA_OVER_HTTP */
+
 /**
  * @brief Defines the structure to use as the command callback context in this
  * demo.
@@ -332,6 +397,36 @@ static OtaMqttStatus_t prvMQTTUnsubscribe( const char * pTopicFilter,
                                            uint16_t topicFilterLength,
                                            uint8_t ucQoS );
 
+#if ( configENABLED_DATA_PROTOCOLS & OTA_DATA_OVER_HTTP )
+
+/**
+ * @brief Function used by OTA agent to open the connection to the file download URL.
+ *
+ * @param[in] pUrl Presigned URL of the file, taken from the job document.
+ * @return OtaHttpSuccess if the host was reached, OtaHttpInitFailed otherwise.
+ */
+static OtaHttpStatus_t prvHttpInit( char * pUrl );
+
+/**
+ * @brief Function used by OTA agent to request a range of the file.
+ *
+ * Sends a ranged GET over the keep-alive connection, reconnecting once if the
+ * server closed it, and queues the response body for the OTA agent as a file block.
+ *
+ * @param[in] rangeStart Offset of the first byte requested.
+ * @param[in] rangeEnd Offset of the last byte requested.
+ * @return OtaHttpSuccess if the block was queued, OtaHttpRequestFailed otherwise.
+ */
+static OtaHttpStatus_t prvHttpRequest( uint32_t rangeStart,
+                                       uint32_t rangeEnd );
+
+/**
+ * @brief Function used by OTA agent to close the download connection.
+ */
+static OtaHttpStatus_t prvHttpDeinit( void );
+
+#endif /* configENABLED_DATA_PROTOCOLS & OTA_DATA_OVER_HTTP */
+
 /**
  * @brief Initialize the OTA event buffer pool.
  *
@@ -349,9 +444,11 @@ static BaseType_t prvOTAEventBufferPoolInit( OtaEventBufferPool_t * pxBufferPool
  * by the OTA agent task. It uses a mutex for thread safe access to the pool.
  *
  * @param[in] pxEventBufferPool Pointer to the Event Buffer pool.
+ * @param[in] xTicksToWait Time to wait for the OTA agent to free a buffer.
  * @return A pointer to an unused buffer from the pool. NULL if there are no buffers available.
  */
-static OtaEventData_t * prvOTAEventBufferGet( OtaEventBufferPool_t * pxBufferPool );
+static OtaEventData_t * prvOTAEventBufferGet( OtaEventBufferPool_t * pxBufferPool,
+                                              TickType_t xTicksToWait );
 
 /**
  * @brief Free an event buffer back to pool
@@ -460,6 +557,15 @@ static char * pcThingName = NULL;
  */
 static size_t uxThingNameLength = 0UL;
 
+#if ( configENABLED_DATA_PROTOCOLS & OTA_DATA_OVER_HTTP )
+
+/**
+ * @brief Connection used by the OTA agent for HTTP downloads.
+ */
+static OtaHttpConnection_t xHttpConnection = { 0 };
+
+#endif /* configENABLED_DATA_PROTOCOLS & OTA_DATA_OVER_HTTP */
+
 /*---------------------------------------------------------*/
 
 static BaseType_t prvOTAEventBufferPoolInit( OtaEventBufferPool_t * pxBufferPool )
@@ -471,8 +577,11 @@ static BaseType_t prvOTAEventBufferPoolInit( OtaEventBufferPool_t * pxBufferPool
     memset( pxBufferPool->eventBuffer, 0x00, sizeof( pxBufferPool->eventBuffer ) );
 
     pxBufferPool->lock = xSemaphoreCreateMutex();
+    pxBufferPool->freeBuffers = xSemaphoreCreateCounting( otaconfigMAX_NUM_OTA_DATA_BUFFERS,
+                                                          otaconfigMAX_NUM_OTA_DATA_BUFFERS );
 
-    if( pxBufferPool->lock != NULL )
+    if( ( pxBufferPool->lock != NULL ) &&
+        ( pxBufferPool->freeBuffers != NULL ) )
     {
         poolInit = pdTRUE;
     }
@@ -491,6 +600,9 @@ static void prvOTAEventBufferFree( OtaEventBufferPool_t * pxBufferPool,
     {
         pxBuffer->bufferUsed = false;
         ( void ) xSemaphoreGive( pxBufferPool->lock );
+
+        /* Wake a callback waiting for a buffer */
+        ( void ) xSemaphoreGive( pxBufferPool->freeBuffers );
     }
     else
     {
@@ -500,14 +612,19 @@ static void prvOTAEventBufferFree( OtaEventBufferPool_t * pxBufferPool,
 
 /*-----------------------------------------------------------*/
 
-static OtaEventData_t * prvOTAEventBufferGet( OtaEventBufferPool_t * pxBufferPool )
+static OtaEventData_t * prvOTAEventBufferGet( OtaEventBufferPool_t * pxBufferPool,
+                                              TickType_t xTicksToWait )
 {
     uint32_t ulIndex = 0;
     OtaEventData_t * pFreeBuffer = NULL;
 
     configASSERT( pxBufferPool != NULL );
 
-    if( xSemaphoreTake( pxBufferPool->lock, portMAX_DELAY ) == pdTRUE )
+    if( xSemaphoreTake( pxBufferPool->freeBuffers, xTicksToWait ) != pdTRUE )
+    {
+        /* All buffers are still queued for the OTA agent */
+    }
+    else if( xSemaphoreTake( pxBufferPool->lock, portMAX_DELAY ) == pdTRUE )
     {
         for( ulIndex = 0; ulIndex < otaconfigMAX_NUM_OTA_DATA_BUFFERS; ulIndex++ )
         {
@@ -532,6 +649,8 @@ static OtaEventData_t * prvOTAEventBufferGet( OtaEventBufferPool_t * pxBufferPoo
 /*-----------------------------------------------------------*/
 static void prvOTAAgentTask( void * pvParam )
 {
+    ( void ) xHeapTagSet( HEAP_TAG_OTA );
+
     OTA_EventProcessingTask( pvParam );
     vTaskDelete( NULL );
 }
@@ -783,6 +902,8 @@ static void otaAppCallback( OtaJobEvent_t event,
 
                     if( err == OtaErrNone )
                     {
+                        /* Store configuration changes still waiting for a background flush. */
+                        ( void ) KVStore_xFlush();
                         /* Slight delay to flush the logs. */
                         vTaskDelay( pdMS_TO_TICKS( 500 ) );
                         /*  Reset the device, to revert back to the old image. */
@@ -864,14 +985,19 @@ static void prvProcessIncomingData( void * pxContext,
         {
             LogDebug( ( "Received OTA image block, size %d.\n\n", pPublishInfo->payloadLength ) );
 
-            pData = prvOTAEventBufferGet( &xAppStaticBuffer.eventBufferPool );
+            pData = prvOTAEventBufferGet( &xAppStaticBuffer.eventBufferPool,
+                                          pdMS_TO_TICKS( otaexampleBLOCK_BUFFER_WAIT_MS ) );
 
             if( pData != NULL )
             {
-                memcpy( pData->data, pPublishInfo->pPayload, pPublishInfo->payloadLength );
+                DmaCopy_t xCopy;
+
+                /* The payload is only valid during the callback, wait for the copy before returning */
+                ( void ) xDmaCopyStart( &xCopy, pData->data, pPublishInfo->pPayload, pPublishInfo->payloadLength );
                 pData->dataLength = pPublishInfo->payloadLength;
                 eventMsg.eventId = OtaAgentEventReceivedFileBlock;
                 eventMsg.pEventData = pData;
+                ( void ) xDmaCopyWait( &xCopy );
 
                 /* Send job document received event. */
                 OTA_SignalEvent( &eventMsg );
@@ -919,7 +1045,8 @@ static void prvProcessIncomingJobMessage( void * pxSubscriptionContext,
         if( pPublishInfo->payloadLength <= OTA_DATA_BLOCK_SIZE )
         {
             LogInfo( ( "Received OTA job message, size: %d.\n\n", pPublishInfo->payloadLength ) );
-            pData = prvOTAEventBufferGet( &xAppStaticBuffer.eventBufferPool );
+            pData = prvOTAEventBufferGet( &xAppStaticBuffer.eventBufferPool,
+                                          pdMS_TO_TICKS( otaexampleBLOCK_BUFFER_WAIT_MS ) );
 
             if( pData != NULL )
             {
@@ -1087,6 +1214,52 @@ static OtaMqttStatus_t prvMQTTSubscribe( const char * pTopicFilter,
     return otaRet;
 }
 
+static void prvThrottleBlockRequest( uint32_t ulBytes )
+{
+    static TickType_t xLastRefill = 0;
+    static uint32_t ulTokens = 0;
+    uint32_t ulYieldMs = KVStore_getUInt32( CS_OTA_YIELD_MS, NULL );
+    uint32_t ulRateBytesPerSec = ( KVStore_getUInt32( CS_OTA_RATE_LIMIT_KBPS, NULL ) * 1000U ) / 8U;
+    TickType_t xYieldStart = xTaskGetTickCount();
+
+    /* Application traffic queued for the MQTT agent goes first */
+    while( ( uxMqttAgentPendingCommands() > 0 ) &&
+           ( ( xTaskGetTickCount() - xYieldStart ) < pdMS_TO_TICKS( ulYieldMs ) ) )
+    {
+        vTaskDelay( pdMS_TO_TICKS( otaexampleYIELD_POLL_MS ) );
+    }
+
+    if( ulRateBytesPerSec > 0 )
+    {
+        uint32_t ulCapacity = ( uint32_t ) ( ( ( uint64_t ) ulRateBytesPerSec * otaexampleRATE_BURST_MS ) / 1000U );
+        TickType_t xNow = xTaskGetTickCount();
+        uint64_t ullTokens = ulTokens + ( ( ( uint64_t ) ( xNow - xLastRefill ) * ulRateBytesPerSec ) / configTICK_RATE_HZ );
+
+        /* A request larger than the bucket still goes through, once the bucket is full */
+        if( ulCapacity < ulBytes )
+        {
+            ulCapacity = ulBytes;
+        }
+
+        ulTokens = ( ullTokens > ulCapacity ) ? ulCapacity : ( uint32_t ) ullTokens;
+        xLastRefill = xNow;
+
+        if( ulTokens < ulBytes )
+        {
+            uint32_t ulWaitMs = ( uint32_t ) ( ( ( ( uint64_t ) ( ulBytes - ulTokens ) * 1000U ) +
+                                                 ulRateBytesPerSec - 1 ) / ulRateBytesPerSec );
+
+            LogDebug( ( "Delaying block request by %u ms for the rate limit.", ulWaitMs ) );
+            vTaskDelay( pdMS_TO_TICKS( ulWaitMs ) );
+
+            ulTokens = ulBytes;
+            xLastRefill = xTaskGetTickCount();
+        }
+
+        ulTokens -= ulBytes;
+    }
+}
+
 static OtaMqttStatus_t prvMQTTPublish( const char * const pacTopic,
                                        uint16_t topicLen,
                                        const char * pMsg,
@@ -1108,6 +1281,11 @@ static OtaMqttStatus_t prvMQTTPublish( const char * const pacTopic,
     publishInfo.pPayload = pMsg;
     publishInfo.payloadLength = msgSize;
 
+    /* Block requests go to the stream topic, job updates are not throttled */
+    if( strnstr( pacTopic, "/streams/", topicLen ) != NULL )
+    {
+        prvThrottleBlockRequest( otaconfigMAX_NUM_BLOCKS_REQUEST * otaconfigFILE_BLOCK_SIZE );
+    }
 
     xTaskNotifyStateClear( NULL );
 
@@ -1215,6 +1393,284 @@ static OtaMqttStatus_t prvMQTTUnsubscribe( const char * pTopicFilter,
 
 /*-----------------------------------------------------------*/
 
+#if ( configENABLED_DATA_PROTOCOLS & OTA_DATA_OVER_HTTP )
+
+static uint32_t prvHttpGetTimeMs( void )
+{
+    return ( uint32_t ) ( ( ( uint64_t ) xTaskGetTickCount() * 1000U ) / configTICK_RATE_HZ );
+}
+
+/*-----------------------------------------------------------*/
+
+static void prvHttpDisconnect( void )
+{
+    if( xHttpConnection.xConnected == pdTRUE )
+    {
+        mbedtls_transport_disconnect( xHttpConnection.pxNetworkContext );
+        xHttpConnection.xConnected = pdFALSE;
+    }
+}
+
+/*-----------------------------------------------------------*/
+
+static BaseType_t prvHttpConnect( void )
+{
+    TlsTransportStatus_t xTlsStatus = TLS_TRANSPORT_SUCCESS;
+
+    /* Presigned URLs authenticate the request, so no client certificate is needed */
+    PkiObject_t pxRootCaChain[ 1 ] = { xPkiObjectFromLabel( TLS_ROOT_CA_CERT_LABEL ) };
+
+    if( xHttpConnection.pxNetworkContext == NULL )
+    {
+        xHttpConnection.pxNetworkContext = mbedtls_transport_allocate();
+
+        if( xHttpConnection.pxNetworkContext == NULL )
+        {
+            LogError( ( "Failed to allocate an mbedtls transport context." ) );
+            xTlsStatus = TLS_TRANSPORT_INSUFFICIENT_MEMORY;
+        }
+        else
+        {
+            xTlsStatus = mbedtls_transport_configure( xHttpConnection.pxNetworkContext,
+                                                      NULL,
+                                                      NULL,
+                                                      NULL,
+                                                      pxRootCaChain,
+                                                      1 );
+        }
+    }
+
+    if( xTlsStatus == TLS_TRANSPORT_SUCCESS )
+    {
+        xTlsStatus = mbedtls_transport_connect( xHttpConnection.pxNetworkContext,
+                                                xHttpConnection.pcHost,
+                                                otaexampleHTTP_PORT,
+                                                otaexampleHTTP_TIMEOUT_MS,
+                                                otaexampleHTTP_TIMEOUT_MS );
+    }
+
+    if( xTlsStatus == TLS_TRANSPORT_SUCCESS )
+    {
+        xHttpConnection.xConnected = pdTRUE;
+        LogInfo( ( "Connected to %s for the OTA download.", xHttpConnection.pcHost ) );
+    }
+    else
+    {
+        LogError( ( "Failed to connect to %s, error = %d.", xHttpConnection.pcHost, xTlsStatus ) );
+    }
+
+    return xHttpConnection.xConnected;
+}
+
+/*-----------------------------------------------------------*/
+
+static OtaHttpStatus_t prvHttpInit( char * pUrl )
+{
+    OtaHttpStatus_t xResult = OtaHttpSuccess;
+    const char * pcHost = NULL;
+    size_t uxHostLen = 0;
+
+    configASSERT( pUrl != NULL );
+
+    /* https://<host>/<path and query> */
+    pcHost = strstr( pUrl, "://" );
+
+    if( pcHost != NULL )
+    {
+        pcHost += 3;
+        xHttpConnection.pcPath = strchr( pcHost, '/' );
+    }
+
+    if( ( pcHost == NULL ) ||
+        ( xHttpConnection.pcPath == NULL ) )
+    {
+        LogError( ( "Malformed OTA download URL." ) );
+        xResult = OtaHttpInitFailed;
+    }
+    else
+    {
+        uxHostLen = ( size_t ) ( xHttpConnection.pcPath - pcHost );
+        xHttpConnection.uxPathLen = strlen( xHttpConnection.pcPath );
+    }
+
+    if( ( xResult == OtaHttpSuccess ) &&
+        ( uxHostLen >= sizeof( xHttpConnection.pcHost ) ) )
+    {
+        LogError( ( "OTA download host name is longer than %u bytes.", otaexampleHTTP_MAX_HOST_LEN - 1 ) );
+        xResult = OtaHttpInitFailed;
+    }
+
+    if( xResult == OtaHttpSuccess )
+    {
+        ( void ) memcpy( xHttpConnection.pcHost, pcHost, uxHostLen );
+        xHttpConnection.pcHost[ uxHostLen ] = '\0';
+
+        xHttpConnection.xTransport.send = mbedtls_transport_send;
+        xHttpConnection.xTransport.recv = mbedtls_transport_recv;
+
+        if( prvHttpConnect() != pdTRUE )
+        {
+            xResult = OtaHttpInitFailed;
+        }
+
+        xHttpConnection.xTransport.pNetworkContext = xHttpConnection.pxNetworkContext;
+    }
+
+    return xResult;
+}
+
+/*-----------------------------------------------------------*/
+
+static HTTPStatus_t prvHttpSendRange( uint32_t ulRangeStart,
+                                      uint32_t ulRangeEnd,
+                                      HTTPResponse_t * pxResponse )
+{
+    HTTPStatus_t xHttpStatus = HTTPNetworkError;
+    HTTPRequestInfo_t xRequestInfo = { 0 };
+    HTTPRequestHeaders_t xRequestHeaders = { 0 };
+
+    xRequestInfo.pMethod = HTTP_METHOD_GET;
+    xRequestInfo.methodLen = sizeof( HTTP_METHOD_GET ) - 1;
+    xRequestInfo.pPath = xHttpConnection.pcPath;
+    xRequestInfo.pathLen = xHttpConnection.uxPathLen;
+    xRequestInfo.pHost = xHttpConnection.pcHost;
+    xRequestInfo.hostLen = strlen( xHttpConnection.pcHost );
+    xRequestInfo.reqFlags = HTTP_REQUEST_KEEP_ALIVE_FLAG;
+
+    xRequestHeaders.pBuffer = xHttpConnection.ucHeaderBuffer;
+    xRequestHeaders.bufferLen = sizeof( xHttpConnection.ucHeaderBuffer );
+
+    if( xHttpConnection.xConnected == pdTRUE )
+    {
+        xHttpStatus = HTTPClient_InitializeRequestHeaders( &xRequestHeaders, &xRequestInfo );
+    }
+
+    if( xHttpStatus == HTTPSuccess )
+    {
+        xHttpStatus = HTTPClient_AddRangeHeader( &xRequestHeaders,
+                                                 ( int32_t ) ulRangeStart,
+                                                 ( int32_t ) ulRangeEnd );
+    }
+
+    if( xHttpStatus == HTTPSuccess )
+    {
+        xHttpStatus = HTTPClient_Send( &xHttpConnection.xTransport,
+                                       &xRequestHeaders,
+                                       NULL,
+                                       0,
+                                       pxResponse,
+                                       0 );
+    }
+
+    return xHttpStatus;
+}
+
+/*-----------------------------------------------------------*/
+
+static OtaHttpStatus_t prvHttpRequest( uint32_t rangeStart,
+                                       uint32_t rangeEnd )
+{
+    OtaHttpStatus_t xResult = OtaHttpRequestFailed;
+    HTTPStatus_t xHttpStatus = HTTPNetworkError;
+    HTTPResponse_t xResponse = { 0 };
+    OtaEventData_t * pData = NULL;
+    OtaEventMsg_t eventMsg = { 0 };
+
+    prvThrottleBlockRequest( rangeEnd - rangeStart + 1U );
+
+    /* Runs in the OTA agent task, which is the one freeing buffers, so do not wait */
+    pData = prvOTAEventBufferGet( &xAppStaticBuffer.eventBufferPool, 0 );
+
+    if( pData == NULL )
+    {
+        LogError( ( "Error: No OTA data buffers available." ) );
+    }
+    else
+    {
+        /* Receive into the event buffer and move the body to its start afterwards */
+        xResponse.pBuffer = pData->data;
+        xResponse.bufferLen = sizeof( pData->data );
+        xResponse.getTime = prvHttpGetTimeMs;
+
+        if( xHttpConnection.xConnected == pdFALSE )
+        {
+            ( void ) prvHttpConnect();
+        }
+
+        xHttpStatus = prvHttpSendRange( rangeStart, rangeEnd, &xResponse );
+
+        /* The server may have closed the idle connection, retry once on a new one */
+        if( ( xHttpStatus == HTTPNetworkError ) ||
+            ( xHttpStatus == HTTPNoResponse ) )
+        {
+            prvHttpDisconnect();
+
+            if( prvHttpConnect() == pdTRUE )
+            {
+                xHttpStatus = prvHttpSendRange( rangeStart, rangeEnd, &xResponse );
+            }
+        }
+
+        if( xHttpStatus != HTTPSuccess )
+        {
+            LogError( ( "Failed to request bytes %u-%u, error = %s.",
+                        rangeStart, rangeEnd, HTTPClient_strerror( xHttpStatus ) ) );
+            prvHttpDisconnect();
+        }
+        else if( xResponse.statusCode != otaexampleHTTP_STATUS_PARTIAL_CONTENT )
+        {
+            LogError( ( "Unexpected HTTP status %u for bytes %u-%u.",
+                        xResponse.statusCode, rangeStart, rangeEnd ) );
+        }
+        else
+        {
+            ( void ) memmove( pData->data, xResponse.pBody, xResponse.bodyLen );
+            pData->dataLength = xResponse.bodyLen;
+            eventMsg.eventId = OtaAgentEventReceivedFileBlock;
+            eventMsg.pEventData = pData;
+
+            if( OTA_SignalEvent( &eventMsg ) == true )
+            {
+                xResult = OtaHttpSuccess;
+            }
+        }
+
+        if( ( xResponse.respFlags & HTTP_RESPONSE_CONNECTION_CLOSE_FLAG ) != 0U )
+        {
+            prvHttpDisconnect();
+        }
+
+        if( xResult != OtaHttpSuccess )
+        {
+            prvOTAEventBufferFree( &xAppStaticBuffer.eventBufferPool, pData );
+        }
+    }
+
+    return xResult;
+}
+
+/*-----------------------------------------------------------*/
+
+static OtaHttpStatus_t prvHttpDeinit( void )
+{
+    prvHttpDisconnect();
+
+    if( xHttpConnection.pxNetworkContext != NULL )
+    {
+        mbedtls_transport_free( xHttpConnection.pxNetworkContext );
+        xHttpConnection.pxNetworkContext = NULL;
+    }
+
+    xHttpConnection.pcPath = NULL;
+    xHttpConnection.uxPathLen = 0;
+
+    return OtaHttpSuccess;
+}
+
+#endif /* configENABLED_DATA_PROTOCOLS & OTA_DATA_OVER_HTTP */
+
+/*-----------------------------------------------------------*/
+
 static void prvSetOtaInterfaces( OtaInterfaces_t * pOtaInterfaces )
 {
     configASSERT( pOtaInterfaces != NULL );
@@ -1235,6 +1691,13 @@ static void prvSetOtaInterfaces( OtaInterfaces_t * pOtaInterfaces )
     pOtaInterfaces->mqtt.publish = prvMQTTPublish;
     pOtaInterfaces->mqtt.unsubscribe = prvMQTTUnsubscribe;
 
+#if ( configENABLED_DATA_PROTOCOLS & OTA_DATA_OVER_HTTP )
+    /* Initialize the OTA library HTTP Interface.*/
+    pOtaInterfaces->http.init = prvHttpInit;
+    pOtaInterfaces->http.request = prvHttpRequest;
+    pOtaInterfaces->http.deinit = prvHttpDeinit;
+#endif /* configENABLED_DATA_PROTOCOLS & OTA_DATA_OVER_HTTP */
+
     /* Initialize the OTA library PAL Interface.*/
     pOtaInterfaces->pal.getPlatformImageState = otaPal_GetPlatformImageState;
     pOtaInterfaces->pal.setPlatformImageState = otaPal_SetPlatformImageState;
@@ -1314,6 +1777,8 @@ void vOTAUpdateTask( void * pvParam )
      */
     OtaAppBuffer_t otaAppBuffer = { 0 };
 
+    ( void ) xHeapTagSet( HEAP_TAG_OTA );
+
     /* Set OTA Library interfaces.*/
     prvSetOtaInterfaces( &otaInterfaces );
 
@@ -1387,31 +1852,19 @@ void vOTAUpdateTask( void * pvParam )
     if( ( xResult == pdPASS ) &&
         ( xMQTTAgentHandle != NULL ) )
     {
-        xMQTTStatus = MqttAgent_SubscribeSync( xMQTTAgentHandle,
-                                               OTA_JOB_ACCEPTED_RESPONSE_TOPIC_FILTER,
-                                               MQTTQoS0,
-                                               prvProcessIncomingJobMessage,
-                                               NULL );
-
-        if( xMQTTStatus != MQTTSuccess )
+        const SubscribeRequest_t xRequests[] =
         {
-            LogError( "Failed to subscribe to Job Accepted response topic filter." );
-            xResult = pdFAIL;
-        }
-    }
+            { OTA_JOB_ACCEPTED_RESPONSE_TOPIC_FILTER, MQTTQoS0, prvProcessIncomingJobMessage, NULL },
+            { OTA_JOB_NOTIFY_TOPIC_FILTER,            MQTTQoS0, prvProcessIncomingJobMessage, NULL },
+        };
 
-    if( ( xResult == pdPASS ) &&
-        ( xMQTTAgentHandle != NULL ) )
-    {
-        xMQTTStatus = MqttAgent_SubscribeSync( xMQTTAgentHandle,
-                                               OTA_JOB_NOTIFY_TOPIC_FILTER,
-                                               MQTTQoS0,
-                                               prvProcessIncomingJobMessage,
-                                               NULL );
+        xMQTTStatus = MqttAgent_SubscribeMultiSync( xMQTTAgentHandle,
+                                                    xRequests,
+                                                    sizeof( xRequests ) / sizeof( xRequests[ 0 ] ) );
 
         if( xMQTTStatus != MQTTSuccess )
         {
-            LogError( "Failed to subscribe to Job Update topic filter." );
+            LogError( "Failed to subscribe to Job Accepted response and Job Update topic filters." );
             xResult = pdFAIL;
         }
     }
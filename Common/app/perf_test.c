@@ -0,0 +1,687 @@
+/*
+ * FreeRTOS STM32 Reference Integration
+ *
+ * Copyright (c) 2022 Amazon.com, Inc. or its affiliates. All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+/**
+ * @file perf_test.c
+ * @brief On-target performance tests with pass / fail budgets.
+ *
+ * Each group measures one subsystem and fails when a budget of
+ * perf_test_config.h is exceeded. Groups that depend on state the tests cannot
+ * set up themselves, such as a connected MQTT agent, are ignored instead.
+ */
+
+#include "logging_levels.h"
+#define LOG_LEVEL    LOG_INFO
+#include "logging.h"
+
+/* Standard includes. */
+#include <string.h>
+#include <stdint.h>
+#include <stdio.h>
+
+/* FreeRTOS includes. */
+#include "FreeRTOS.h"
+#include "task.h"
+
+#include "unity_fixture.h"
+
+#include "stm32u5xx.h"
+#include "dvfs.h"
+#include "kvstore.h"
+#include "mbedtls_transport.h"
+#include "mqtt_agent_task.h"
+#include "mqtt_publish_async.h"
+
+#include "mbedtls/build_info.h"
+#include "mbedtls/gcm.h"
+#include "mbedtls/sha256.h"
+
+#ifndef TFM_PSA_API
+#include "lfs.h"
+#include "fs/lfs_port.h"
+#endif
+
+#include "perf_test.h"
+#include "perf_test_config.h"
+
+/* Task notification index used to wait for completions, index 0 belongs to stream buffers */
+#define PERF_TEST_NOTIFY_IDX        2
+
+#define PERF_TEST_KV_KEY            "perf_kv"
+#define PERF_TEST_MQTT_TOPIC        "perf"
+#define PERF_TEST_MQTT_TIMEOUT_MS   10000U
+#define PERF_TEST_LFS_FILE          "/perf_test"
+#define PERF_TEST_LFS_LEN           ( 32 * 1024 )
+#define PERF_TEST_CHUNK_LEN         1024
+#define PERF_TEST_CRYPTO_LEN        4096
+
+static const uint8_t ucTestKey[ 16 ] = { 0 };
+static const uint8_t ucTestIv[ 12 ] = { 0 };
+
+/*-----------------------------------------------------------*/
+
+static void prvStartCycleCounter( void )
+{
+    if( ( DWT->CTRL & DWT_CTRL_CYCCNTENA_Msk ) == 0 )
+    {
+        CoreDebug->DEMCR |= CoreDebug_DEMCR_TRCENA_Msk;
+        DWT->CYCCNT = 0;
+        DWT->CTRL |= DWT_CTRL_CYCCNTENA_Msk;
+    }
+}
+
+static uint32_t ulCyclesToUs( uint64_t ullCycles )
+{
+    return ( uint32_t ) ( ullCycles / ( SystemCoreClock / 1000000 ) );
+}
+
+static uint32_t ulKiBPerSecond( uint32_t ulBytes,
+                                uint64_t ullCycles )
+{
+    uint32_t ulRate = 0;
+
+    if( ullCycles > 0 )
+    {
+        ulRate = ( uint32_t ) ( ( ( uint64_t ) ulBytes * SystemCoreClock ) / ( ullCycles * 1024 ) );
+    }
+
+    return ulRate;
+}
+
+/* One line per measurement, so that runs can be compared with a script: PERF,<test>,<value>,<budget>,<unit> */
+static void prvReport( const char * pcTest,
+                       uint32_t ulValue,
+                       uint32_t ulBudget,
+                       const char * pcUnit )
+{
+    char cLine[ 96 ];
+
+    ( void ) snprintf( cLine, sizeof( cLine ), "PERF,%s,%lu,%lu,%s",
+                       pcTest, ( unsigned long ) ulValue, ( unsigned long ) ulBudget, pcUnit );
+
+    UnityPrint( cLine );
+    UNITY_PRINT_EOL();
+}
+
+/*---------------------------- TLS --------------------------*/
+
+TEST_GROUP( PERF_TLS );
+
+TEST_SETUP( PERF_TLS )
+{
+}
+
+TEST_TEAR_DOWN( PERF_TLS )
+{
+}
+
+/*
+ * The handshake itself needs the network and device credentials, so this uses
+ * the profile of the last connect made by the MQTT agent or the qualification
+ * tests. Network round trips are part of the measured time.
+ */
+TEST( PERF_TLS, Handshake )
+{
+    TlsConnectProfile_t xProfile = { 0 };
+    uint64_t ullCycles = 0;
+    uint32_t ulMs;
+
+    if( mbedtls_transport_getprofile( &xProfile ) == pdFALSE )
+    {
+        TEST_IGNORE_MESSAGE( "No TLS connect profile. Set TLS_TRANSPORT_PROFILE and connect first." );
+    }
+
+    TEST_ASSERT_TRUE_MESSAGE( xProfile.xConnected == pdTRUE, "The last TLS connect failed." );
+
+    for( uint32_t i = TLS_PROFILE_HS_HELLO; i <= TLS_PROFILE_HS_OTHER; i++ )
+    {
+        ullCycles += xProfile.ulCycles[ i ];
+    }
+
+    /* TLS connects hold the full speed level, as does this test run */
+    ulMs = ( uint32_t ) ( ullCycles / ( SystemCoreClock / 1000 ) );
+
+    prvReport( "tls_handshake", ulMs, PERF_BUDGET_TLS_HANDSHAKE_MS, "ms" );
+    TEST_ASSERT_LESS_OR_EQUAL_UINT32( PERF_BUDGET_TLS_HANDSHAKE_MS, ulMs );
+}
+
+TEST_GROUP_RUNNER( PERF_TLS )
+{
+    RUN_TEST_CASE( PERF_TLS, Handshake );
+}
+
+/*---------------------------- MQTT -------------------------*/
+
+typedef struct PublishWait
+{
+    TaskHandle_t xTask;
+    MQTTStatus_t xStatus;
+} PublishWait_t;
+
+/* Static, a publish that timed out may still complete later */
+static PublishWait_t xPublishWait;
+
+static void prvPublishComplete( void * pvCtx,
+                                MQTTStatus_t xStatus )
+{
+    PublishWait_t * pxWait = ( PublishWait_t * ) pvCtx;
+
+    pxWait->xStatus = xStatus;
+    ( void ) xTaskNotifyGiveIndexed( pxWait->xTask, PERF_TEST_NOTIFY_IDX );
+}
+
+TEST_GROUP( PERF_MQTT );
+
+TEST_SETUP( PERF_MQTT )
+{
+}
+
+TEST_TEAR_DOWN( PERF_MQTT )
+{
+}
+
+TEST( PERF_MQTT, PublishRoundTrip )
+{
+    char cTopic[ 80 ];
+    size_t uxTopicLen;
+    uint32_t ulTotalMs = 0;
+    uint32_t ulMaxMs = 0;
+
+    if( !xIsMqttAgentConnected() )
+    {
+        TEST_IGNORE_MESSAGE( "The MQTT agent is not connected." );
+    }
+
+    uxTopicLen = KVStore_getString( CS_CORE_THING_NAME, cTopic, sizeof( cTopic ) );
+
+    if( uxTopicLen > 0 )
+    {
+        uxTopicLen = strlcat( cTopic, "/" PERF_TEST_MQTT_TOPIC, sizeof( cTopic ) );
+    }
+
+    TEST_ASSERT_TRUE_MESSAGE( ( uxTopicLen > 0 ) && ( uxTopicLen < sizeof( cTopic ) ), "Failed to construct the topic." );
+
+    xPublishWait.xTask = xTaskGetCurrentTaskHandle();
+
+    for( uint32_t i = 0; i < PERF_TEST_ITERATIONS; i++ )
+    {
+        char * pcPayload = MqttAgent_GetPublishBuffer( pdMS_TO_TICKS( 1000 ) );
+        TickType_t xStart;
+        uint32_t ulMs;
+
+        TEST_ASSERT_NOT_NULL_MESSAGE( pcPayload, "No publish buffer available." );
+
+        MQTTPublishInfo_t xPublishInfo =
+        {
+            .qos             = MQTTQoS1,
+            .retain          = 0,
+            .dup             = 0,
+            .pTopicName      = cTopic,
+            .topicNameLength = uxTopicLen,
+            .pPayload        = pcPayload,
+            .payloadLength   = snprintf( pcPayload, MQTT_PUBLISH_POOL_BUFFER_LEN, "{\"seq\":%lu}", ( unsigned long ) i ),
+        };
+
+        ( void ) xTaskNotifyStateClearIndexed( NULL, PERF_TEST_NOTIFY_IDX );
+        xPublishWait.xStatus = MQTTIllegalState;
+
+        xStart = xTaskGetTickCount();
+
+        TEST_ASSERT_EQUAL( MQTTSuccess, MqttAgent_PublishAsync( xGetMqttAgentHandle(), &xPublishInfo,
+                                                                prvPublishComplete, &xPublishWait, 1000 ) );
+
+        TEST_ASSERT_EQUAL_MESSAGE( 1, ulTaskNotifyTakeIndexed( PERF_TEST_NOTIFY_IDX, pdTRUE,
+                                                               pdMS_TO_TICKS( PERF_TEST_MQTT_TIMEOUT_MS ) ),
+                                   "Timed out waiting for the PUBACK." );
+        TEST_ASSERT_EQUAL( MQTTSuccess, xPublishWait.xStatus );
+
+        ulMs = pdTICKS_TO_MS( xTaskGetTickCount() - xStart );
+        ulTotalMs += ulMs;
+
+        if( ulMs > ulMaxMs )
+        {
+            ulMaxMs = ulMs;
+        }
+    }
+
+    prvReport( "mqtt_publish_rtt", ulTotalMs / PERF_TEST_ITERATIONS, PERF_BUDGET_MQTT_PUBLISH_RTT_MS, "ms" );
+    prvReport( "mqtt_publish_rtt_max", ulMaxMs, PERF_BUDGET_MQTT_PUBLISH_RTT_MAX_MS, "ms" );
+
+    TEST_ASSERT_LESS_OR_EQUAL_UINT32( PERF_BUDGET_MQTT_PUBLISH_RTT_MS, ulTotalMs / PERF_TEST_ITERATIONS );
+    TEST_ASSERT_LESS_OR_EQUAL_UINT32( PERF_BUDGET_MQTT_PUBLISH_RTT_MAX_MS, ulMaxMs );
+}
+
+TEST_GROUP_RUNNER( PERF_MQTT )
+{
+    RUN_TEST_CASE( PERF_MQTT, PublishRoundTrip );
+}
+
+/*--------------------------- kvstore -----------------------*/
+
+static KVStoreKey_t xPerfKey = KV_STORE_KEY_INVALID;
+
+TEST_GROUP( PERF_KVSTORE );
+
+TEST_SETUP( PERF_KVSTORE )
+{
+    static const uint32_t ulDefault = 0;
+
+    /* A dedicated key, so that the test does not disturb the live configuration */
+    xPerfKey = KVStore_xRegisterKey( PERF_TEST_KV_KEY, KV_TYPE_UINT32, sizeof( uint32_t ), &ulDefault );
+    TEST_ASSERT_NOT_EQUAL( KV_STORE_KEY_INVALID, xPerfKey );
+}
+
+TEST_TEAR_DOWN( PERF_KVSTORE )
+{
+}
+
+TEST( PERF_KVSTORE, Get )
+{
+    BaseType_t xSuccess = pdTRUE;
+    uint64_t ullCycles = 0;
+    uint32_t ulUs;
+
+    for( uint32_t i = 0; ( i < PERF_TEST_ITERATIONS ) && ( xSuccess == pdTRUE ); i++ )
+    {
+        uint32_t ulStart = DWT->CYCCNT;
+
+        ( void ) KVStore_getUInt32( xPerfKey, &xSuccess );
+        ullCycles += DWT->CYCCNT - ulStart;
+    }
+
+    TEST_ASSERT_EQUAL( pdTRUE, xSuccess );
+
+    ulUs = ulCyclesToUs( ullCycles / PERF_TEST_ITERATIONS );
+
+    prvReport( "kvstore_get", ulUs, PERF_BUDGET_KV_GET_US, "us" );
+    TEST_ASSERT_LESS_OR_EQUAL_UINT32( PERF_BUDGET_KV_GET_US, ulUs );
+}
+
+TEST( PERF_KVSTORE, Set )
+{
+    BaseType_t xSuccess = pdTRUE;
+    uint64_t ullCycles = 0;
+    uint32_t ulValue = KVStore_getUInt32( xPerfKey, NULL );
+    uint32_t ulUs;
+
+    for( uint32_t i = 0; ( i < PERF_TEST_ITERATIONS ) && ( xSuccess == pdTRUE ); i++ )
+    {
+        uint32_t ulStart = DWT->CYCCNT;
+
+        /* A changed value every time, unchanged values are not written */
+        ulValue++;
+        xSuccess = KVStore_setUInt32( xPerfKey, ulValue );
+
+        /* Also waits for the write in write-back mode */
+        if( xSuccess == pdTRUE )
+        {
+            xSuccess = KVStore_xFlush();
+        }
+
+        ullCycles += DWT->CYCCNT - ulStart;
+    }
+
+    TEST_ASSERT_EQUAL( pdTRUE, xSuccess );
+
+    ulUs = ulCyclesToUs( ullCycles / PERF_TEST_ITERATIONS );
+
+    prvReport( "kvstore_set", ulUs, PERF_BUDGET_KV_SET_US, "us" );
+    TEST_ASSERT_LESS_OR_EQUAL_UINT32( PERF_BUDGET_KV_SET_US, ulUs );
+}
+
+TEST_GROUP_RUNNER( PERF_KVSTORE )
+{
+    RUN_TEST_CASE( PERF_KVSTORE, Get );
+    RUN_TEST_CASE( PERF_KVSTORE, Set );
+}
+
+/*--------------------------- littlefs ----------------------*/
+
+#ifndef TFM_PSA_API
+
+static uint8_t * pucLfsBuffer = NULL;
+
+TEST_GROUP( PERF_LFS );
+
+TEST_SETUP( PERF_LFS )
+{
+    TEST_ASSERT_NOT_NULL_MESSAGE( pxGetDefaultFsCtx(), "The filesystem is not mounted." );
+
+    pucLfsBuffer = pvPortMalloc( PERF_TEST_CHUNK_LEN );
+    TEST_ASSERT_NOT_NULL( pucLfsBuffer );
+}
+
+TEST_TEAR_DOWN( PERF_LFS )
+{
+    if( pucLfsBuffer != NULL )
+    {
+        vPortFree( pucLfsBuffer );
+        pucLfsBuffer = NULL;
+    }
+}
+
+/* Sequential write and read back of one file, measured until the close */
+TEST( PERF_LFS, ReadWrite )
+{
+    lfs_t * pxLfs = pxGetDefaultFsCtx();
+    lfs_file_t xFile = { 0 };
+    uint32_t ulStart;
+    uint32_t ulWriteKiBps;
+    uint32_t ulReadKiBps;
+    int lError;
+
+    for( size_t i = 0; i < PERF_TEST_CHUNK_LEN; i++ )
+    {
+        pucLfsBuffer[ i ] = ( uint8_t ) ( i * 7 );
+    }
+
+    ulStart = DWT->CYCCNT;
+    lError = lfs_file_open( pxLfs, &xFile, PERF_TEST_LFS_FILE, LFS_O_WRONLY | LFS_O_CREAT | LFS_O_TRUNC );
+    TEST_ASSERT_EQUAL( LFS_ERR_OK, lError );
+
+    for( uint32_t ulOffset = 0; ( ulOffset < PERF_TEST_LFS_LEN ) && ( lError >= 0 ); ulOffset += PERF_TEST_CHUNK_LEN )
+    {
+        lError = lfs_file_write( pxLfs, &xFile, pucLfsBuffer, PERF_TEST_CHUNK_LEN );
+    }
+
+    if( lError >= 0 )
+    {
+        lError = lfs_file_close( pxLfs, &xFile );
+    }
+    else
+    {
+        ( void ) lfs_file_close( pxLfs, &xFile );
+    }
+
+    ulWriteKiBps = ulKiBPerSecond( PERF_TEST_LFS_LEN, DWT->CYCCNT - ulStart );
+    TEST_ASSERT_GREATER_OR_EQUAL_INT( 0, lError );
+
+    ulStart = DWT->CYCCNT;
+    lError = lfs_file_open( pxLfs, &xFile, PERF_TEST_LFS_FILE, LFS_O_RDONLY );
+    TEST_ASSERT_EQUAL( LFS_ERR_OK, lError );
+
+    for( uint32_t ulOffset = 0; ( ulOffset < PERF_TEST_LFS_LEN ) && ( lError >= 0 ); ulOffset += PERF_TEST_CHUNK_LEN )
+    {
+        lError = lfs_file_read( pxLfs, &xFile, pucLfsBuffer, PERF_TEST_CHUNK_LEN );
+    }
+
+    ( void ) lfs_file_close( pxLfs, &xFile );
+    ulReadKiBps = ulKiBPerSecond( PERF_TEST_LFS_LEN, DWT->CYCCNT - ulStart );
+
+    ( void ) lfs_remove( pxLfs, PERF_TEST_LFS_FILE );
+
+    TEST_ASSERT_EQUAL( PERF_TEST_CHUNK_LEN, lError );
+
+    prvReport( "lfs_write", ulWriteKiBps, PERF_BUDGET_LFS_WRITE_KIBPS, "KiB/s" );
+    prvReport( "lfs_read", ulReadKiBps, PERF_BUDGET_LFS_READ_KIBPS, "KiB/s" );
+
+    TEST_ASSERT_GREATER_OR_EQUAL_UINT32( PERF_BUDGET_LFS_WRITE_KIBPS, ulWriteKiBps );
+    TEST_ASSERT_GREATER_OR_EQUAL_UINT32( PERF_BUDGET_LFS_READ_KIBPS, ulReadKiBps );
+}
+
+TEST_GROUP_RUNNER( PERF_LFS )
+{
+    RUN_TEST_CASE( PERF_LFS, ReadWrite );
+}
+
+#endif /* TFM_PSA_API */
+
+/*---------------------------- Crypto -----------------------*/
+
+static uint8_t * pucCryptoIn = NULL;
+static uint8_t * pucCryptoOut = NULL;
+
+TEST_GROUP( PERF_CRYPTO );
+
+TEST_SETUP( PERF_CRYPTO )
+{
+    pucCryptoIn = pvPortMalloc( PERF_TEST_CRYPTO_LEN );
+    pucCryptoOut = pvPortMalloc( PERF_TEST_CRYPTO_LEN );
+
+    TEST_ASSERT_NOT_NULL( pucCryptoIn );
+    TEST_ASSERT_NOT_NULL( pucCryptoOut );
+
+    for( size_t i = 0; i < PERF_TEST_CRYPTO_LEN; i++ )
+    {
+        pucCryptoIn[ i ] = ( uint8_t ) ( i * 7 );
+    }
+}
+
+TEST_TEAR_DOWN( PERF_CRYPTO )
+{
+    vPortFree( pucCryptoIn );
+    vPortFree( pucCryptoOut );
+    pucCryptoIn = NULL;
+    pucCryptoOut = NULL;
+}
+
+TEST( PERF_CRYPTO, Sha256 )
+{
+#if defined( MBEDTLS_SHA256_C )
+    uint8_t ucDigest[ 32 ];
+    uint64_t ullCycles = 0;
+    uint32_t ulKiBps;
+    int lError = 0;
+
+    for( uint32_t i = 0; ( i < PERF_TEST_ITERATIONS ) && ( lError == 0 ); i++ )
+    {
+        uint32_t ulStart = DWT->CYCCNT;
+
+        lError = mbedtls_sha256( pucCryptoIn, PERF_TEST_CRYPTO_LEN, ucDigest, 0 );
+        ullCycles += DWT->CYCCNT - ulStart;
+    }
+
+    TEST_ASSERT_EQUAL( 0, lError );
+
+    ulKiBps = ulKiBPerSecond( PERF_TEST_CRYPTO_LEN * PERF_TEST_ITERATIONS, ullCycles );
+
+    prvReport( "sha256", ulKiBps, PERF_BUDGET_SHA256_KIBPS, "KiB/s" );
+    TEST_ASSERT_GREATER_OR_EQUAL_UINT32( PERF_BUDGET_SHA256_KIBPS, ulKiBps );
+#else
+    TEST_IGNORE_MESSAGE( "MBEDTLS_SHA256_C is not enabled." );
+#endif
+}
+
+TEST( PERF_CRYPTO, AesGcm )
+{
+#if defined( MBEDTLS_GCM_C )
+    mbedtls_gcm_context xGcm;
+    uint8_t ucTag[ 16 ];
+    uint64_t ullCycles = 0;
+    uint32_t ulKiBps;
+    int lError;
+
+    mbedtls_gcm_init( &xGcm );
+
+    lError = mbedtls_gcm_setkey( &xGcm, MBEDTLS_CIPHER_ID_AES, ucTestKey, 128 );
+
+    for( uint32_t i = 0; ( i < PERF_TEST_ITERATIONS ) && ( lError == 0 ); i++ )
+    {
+        uint32_t ulStart = DWT->CYCCNT;
+
+        lError = mbedtls_gcm_crypt_and_tag( &xGcm, MBEDTLS_GCM_ENCRYPT, PERF_TEST_CRYPTO_LEN,
+                                            ucTestIv, sizeof( ucTestIv ), NULL, 0,
+                                            pucCryptoIn, pucCryptoOut, sizeof( ucTag ), ucTag );
+        ullCycles += DWT->CYCCNT - ulStart;
+    }
+
+    mbedtls_gcm_free( &xGcm );
+
+    TEST_ASSERT_EQUAL( 0, lError );
+
+    ulKiBps = ulKiBPerSecond( PERF_TEST_CRYPTO_LEN * PERF_TEST_ITERATIONS, ullCycles );
+
+    prvReport( "aes128_gcm", ulKiBps, PERF_BUDGET_AES_GCM_KIBPS, "KiB/s" );
+    TEST_ASSERT_GREATER_OR_EQUAL_UINT32( PERF_BUDGET_AES_GCM_KIBPS, ulKiBps );
+#else
+    TEST_IGNORE_MESSAGE( "MBEDTLS_GCM_C is not enabled." );
+#endif
+}
+
+TEST_GROUP_RUNNER( PERF_CRYPTO )
+{
+    RUN_TEST_CASE( PERF_CRYPTO, Sha256 );
+    RUN_TEST_CASE( PERF_CRYPTO, AesGcm );
+}
+
+/*---------------------------- ISR --------------------------*/
+
+static TaskHandle_t xIsrWaiter = NULL;
+static TaskHandle_t xIsrTrigger = NULL;
+static volatile uint32_t ulIsrCycles = 0;
+
+void PERF_TEST_SWI_IRQHandler( void )
+{
+    BaseType_t xHigherPriorityTaskWoken = pdFALSE;
+
+    ulIsrCycles = DWT->CYCCNT;
+
+    if( xIsrWaiter != NULL )
+    {
+        vTaskNotifyGiveIndexedFromISR( xIsrWaiter, PERF_TEST_NOTIFY_IDX, &xHigherPriorityTaskWoken );
+    }
+
+    portYIELD_FROM_ISR( xHigherPriorityTaskWoken );
+}
+
+/*
+ * Pends the interrupt once the test task has blocked: this task has a lower
+ * priority, so it only runs once the test task waits for the notification.
+ */
+static void prvIsrTriggerTask( void * pvParameters )
+{
+    ( void ) pvParameters;
+
+    for( ; ; )
+    {
+        ( void ) ulTaskNotifyTake( pdTRUE, portMAX_DELAY );
+        NVIC_SetPendingIRQ( PERF_TEST_SWI_IRQn );
+    }
+}
+
+TEST_GROUP( PERF_ISR );
+
+TEST_SETUP( PERF_ISR )
+{
+    xIsrWaiter = xTaskGetCurrentTaskHandle();
+
+    if( uxTaskPriorityGet( NULL ) <= ( tskIDLE_PRIORITY + 1 ) )
+    {
+        TEST_IGNORE_MESSAGE( "The test task must have a priority above tskIDLE_PRIORITY + 1." );
+    }
+
+    TEST_ASSERT_EQUAL( pdPASS, xTaskCreate( prvIsrTriggerTask, "PerfIsr", configMINIMAL_STACK_SIZE,
+                                            NULL, tskIDLE_PRIORITY + 1, &xIsrTrigger ) );
+
+    HAL_NVIC_SetPriority( PERF_TEST_SWI_IRQn, configLIBRARY_MAX_SYSCALL_INTERRUPT_PRIORITY, 0 );
+    HAL_NVIC_EnableIRQ( PERF_TEST_SWI_IRQn );
+}
+
+TEST_TEAR_DOWN( PERF_ISR )
+{
+    HAL_NVIC_DisableIRQ( PERF_TEST_SWI_IRQn );
+
+    if( xIsrTrigger != NULL )
+    {
+        vTaskDelete( xIsrTrigger );
+        xIsrTrigger = NULL;
+    }
+
+    xIsrWaiter = NULL;
+}
+
+TEST( PERF_ISR, IsrToTask )
+{
+    uint64_t ullCycles = 0;
+    uint32_t ulMaxCycles = 0;
+    uint32_t ulUs;
+    uint32_t ulMaxUs;
+
+    for( uint32_t i = 0; i < PERF_TEST_ITERATIONS; i++ )
+    {
+        uint32_t ulCycles;
+
+        ( void ) xTaskNotifyStateClearIndexed( NULL, PERF_TEST_NOTIFY_IDX );
+        ( void ) xTaskNotifyGive( xIsrTrigger );
+
+        TEST_ASSERT_EQUAL_MESSAGE( 1, ulTaskNotifyTakeIndexed( PERF_TEST_NOTIFY_IDX, pdTRUE, pdMS_TO_TICKS( 100 ) ),
+                                   "The interrupt did not fire." );
+
+        ulCycles = DWT->CYCCNT - ulIsrCycles;
+        ullCycles += ulCycles;
+
+        if( ulCycles > ulMaxCycles )
+        {
+            ulMaxCycles = ulCycles;
+        }
+    }
+
+    ulUs = ulCyclesToUs( ullCycles / PERF_TEST_ITERATIONS );
+    ulMaxUs = ulCyclesToUs( ulMaxCycles );
+
+    prvReport( "isr_to_task", ulUs, PERF_BUDGET_ISR_TO_TASK_US, "us" );
+    prvReport( "isr_to_task_max", ulMaxUs, PERF_BUDGET_ISR_TO_TASK_MAX_US, "us" );
+
+    TEST_ASSERT_LESS_OR_EQUAL_UINT32( PERF_BUDGET_ISR_TO_TASK_US, ulUs );
+    TEST_ASSERT_LESS_OR_EQUAL_UINT32( PERF_BUDGET_ISR_TO_TASK_MAX_US, ulMaxUs );
+}
+
+TEST_GROUP_RUNNER( PERF_ISR )
+{
+    RUN_TEST_CASE( PERF_ISR, IsrToTask );
+}
+
+/*-----------------------------------------------------------*/
+
+static void prvRunAllGroups( void )
+{
+    RUN_TEST_GROUP( PERF_ISR );
+    RUN_TEST_GROUP( PERF_CRYPTO );
+    RUN_TEST_GROUP( PERF_KVSTORE );
+#ifndef TFM_PSA_API
+    RUN_TEST_GROUP( PERF_LFS );
+#endif
+    RUN_TEST_GROUP( PERF_TLS );
+    RUN_TEST_GROUP( PERF_MQTT );
+}
+
+/*-----------------------------------------------------------*/
+
+int RunPerfTests( int argc,
+                  const char * argv[] )
+{
+    int lFailures;
+
+    /* Budgets are given for the full speed level and cycles are converted with SystemCoreClock */
+    vDvfsRequest( DVFS_CLIENT_CLI );
+
+    prvStartCycleCounter();
+
+    LogInfo( "Running performance tests at %lu MHz.", SystemCoreClock / 1000000 );
+
+    lFailures = UnityMain( argc, argv, prvRunAllGroups );
+
+    vDvfsRelease( DVFS_CLIENT_CLI );
+
+    return lFailures;
+}
@@ -0,0 +1,45 @@
+/*
+ * FreeRTOS STM32 Reference Integration
+ *
+ * Copyright (c) 2022 Amazon.com, Inc. or its affiliates. All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+/**
+ * @file perf_test.h
+ * @brief On-target performance tests with pass / fail budgets.
+ */
+
+#ifndef PERF_TEST_H_
+#define PERF_TEST_H_
+
+/**
+ * @brief Run the performance test groups with Unity.
+ *
+ * Takes the arguments of UnityMain, e.g. "-g PERF_CRYPTO" to run a single group
+ * and "-v" for verbose output. Each measurement is also printed as a line
+ * "PERF,<test>,<value>,<budget>,<unit>". Budgets are set in perf_test_config.h.
+ * The core is held at full speed for the duration of the run.
+ *
+ * @return The number of failed tests.
+ */
+int RunPerfTests( int argc,
+                  const char * argv[] );
+
+#endif /* PERF_TEST_H_ */
@@ -50,6 +50,7 @@
 
 /* Subscription manager header include. */
 #include "subscription_manager.h"
+#include "mqtt_publish_async.h"
 
 
 /**
@@ -303,34 +304,49 @@ static MQTTStatus_t prvPublishToTopic( MQTTQoS_t xQoS,
     xCommandParams.cmdCompleteCallback = prvPublishCommandCallback;
     xCommandParams.pCmdCompleteCallbackContext = &xCommandContext;
 
-    /* Loop in case the queue used to communicate with the MQTT agent is full and
-     * attempts to post to it time out.  The queue will not become full if the
-     * priority of the MQTT agent task is higher than the priority of the task
-     * calling this function. */
-    do
+    if( xQoS == MQTTQoS0 )
     {
-        xMQTTStatus = MQTTAgent_Publish( xMQTTAgentHandle,
-                                         &xPublishInfo,
-                                         &xCommandParams );
-
-        if( xMQTTStatus == MQTTSuccess )
+        /* QoS0 has no acknowledgment to wait for, so hand a copy to the agent and return. */
+        do
         {
-            /* Wait for this task to get notified, passing out the value it gets  notified with. */
-            xNotifyStatus = xTaskNotifyWait( 0,
-                                             0,
-                                             &ulNotifiedValue,
-                                             portMAX_DELAY );
+            xMQTTStatus = MqttAgent_PublishQoS0( xMQTTAgentHandle,
+                                                 pcTopic,
+                                                 pucPayload,
+                                                 xPayloadLength,
+                                                 configMAX_COMMAND_SEND_BLOCK_TIME_MS );
+        } while( xMQTTStatus != MQTTSuccess );
+    }
+    else
+    {
+        /* Loop in case the queue used to communicate with the MQTT agent is full and
+         * attempts to post to it time out.  The queue will not become full if the
+         * priority of the MQTT agent task is higher than the priority of the task
+         * calling this function. */
+        do
+        {
+            xMQTTStatus = MQTTAgent_Publish( xMQTTAgentHandle,
+                                             &xPublishInfo,
+                                             &xCommandParams );
 
-            if( xNotifyStatus == pdTRUE )
-            {
-                xMQTTStatus = ( MQTTStatus_t ) ( ulNotifiedValue );
-            }
-            else
+            if( xMQTTStatus == MQTTSuccess )
             {
-                xMQTTStatus = MQTTRecvFailed;
+                /* Wait for this task to get notified, passing out the value it gets  notified with. */
+                xNotifyStatus = xTaskNotifyWait( 0,
+                                                 0,
+                                                 &ulNotifiedValue,
+                                                 portMAX_DELAY );
+
+                if( xNotifyStatus == pdTRUE )
+                {
+                    xMQTTStatus = ( MQTTStatus_t ) ( ulNotifiedValue );
+                }
+                else
+                {
+                    xMQTTStatus = MQTTRecvFailed;
+                }
             }
-        }
-    } while( xMQTTStatus != MQTTSuccess );
+        } while( xMQTTStatus != MQTTSuccess );
+    }
 
     return xMQTTStatus;
 }
@@ -46,6 +46,10 @@
 #include "mqtt_agent_task.h" /* For device advisor test. */
 #include "ota_config.h"
 
+#if ( PERF_TEST_ENABLED == 1 )
+#include "perf_test.h"
+#endif
+
 #define TEST_RESULT_BUFFER_CAPACITY    1024
 
 /*----------------------- Log Helper -----------------------*/
@@ -438,6 +442,19 @@ void run_qualification_main( void * pvArgs )
 
     RunQualificationTest();
 
+#if ( PERF_TEST_ENABLED == 1 )
+    {
+        const char * pcPerfArgv[] = { "perftest" };
+
+        LogInfo( "Run performance tests." );
+
+        if( RunPerfTests( 1, pcPerfArgv ) != 0 )
+        {
+            LogError( "Performance budgets exceeded." );
+        }
+    }
+#endif /* PERF_TEST_ENABLED == 1 */
+
     LogInfo( "End qualification test." );
 
     for( ; ; )
@@ -0,0 +1,292 @@
+/*
+ * FreeRTOS STM32 Reference Integration
+ * Copyright (C) 2022 Amazon.com, Inc. or its affiliates.  All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ *
+ * https://www.FreeRTOS.org
+ * https://github.com/FreeRTOS
+ *
+ */
+
+#include "logging_levels.h"
+/* define LOG_LEVEL here if you want to modify the logging level from the default */
+
+#define LOG_LEVEL    LOG_INFO
+#define LOG_MODULE    LOG_MODULE_SENSOR
+
+#include "logging.h"
+
+/* Kernel includes. */
+#include "FreeRTOS.h"
+#include "task.h"
+#include "queue.h"
+
+#include "sys_evt.h"
+
+#include "sensor_hub.h"
+#include "work_queue.h"
+
+#if SENSOR_HUB_ENABLED == 1
+
+typedef struct
+{
+    SensorHubClass_t xClass;
+    QueueHandle_t xQueue;
+    WorkJob_t * pxJob; /* Scheduled after each sample, may be NULL */
+} SensorHubSubscriber_t;
+
+static SensorHubSubscriber_t xSubscribers[ SENSOR_HUB_MAX_SUBSCRIBERS ] = { 0 };
+static UBaseType_t uxNumSubscribers = 0;
+
+static BaseType_t xClassReady[ SENSOR_HUB_NUM_CLASSES ] = { pdFALSE };
+static uint32_t ulClassSeq[ SENSOR_HUB_NUM_CLASSES ] = { 0 };
+
+static const uint32_t ulClassPeriodMs[ SENSOR_HUB_NUM_CLASSES ] =
+{
+    SENSOR_HUB_ENV_PERIOD_MS,
+    SENSOR_HUB_MOTION_PERIOD_MS
+};
+
+static WorkJob_t xClassJob[ SENSOR_HUB_NUM_CLASSES ] = { 0 };
+
+/*-----------------------------------------------------------*/
+
+static BaseType_t prvInitEnvSensors( void )
+{
+    int32_t lBspError = BSP_ERROR_NONE;
+
+    lBspError = BSP_ENV_SENSOR_Init( 0, ENV_TEMPERATURE );
+    lBspError |= BSP_ENV_SENSOR_Init( 0, ENV_HUMIDITY );
+    lBspError |= BSP_ENV_SENSOR_Init( 1, ENV_TEMPERATURE );
+    lBspError |= BSP_ENV_SENSOR_Init( 1, ENV_PRESSURE );
+
+    lBspError |= BSP_ENV_SENSOR_Enable( 0, ENV_TEMPERATURE );
+    lBspError |= BSP_ENV_SENSOR_Enable( 0, ENV_HUMIDITY );
+    lBspError |= BSP_ENV_SENSOR_Enable( 1, ENV_TEMPERATURE );
+    lBspError |= BSP_ENV_SENSOR_Enable( 1, ENV_PRESSURE );
+
+    lBspError |= BSP_ENV_SENSOR_SetOutputDataRate( 0, ENV_TEMPERATURE, 1.0f );
+    lBspError |= BSP_ENV_SENSOR_SetOutputDataRate( 0, ENV_HUMIDITY, 1.0f );
+    lBspError |= BSP_ENV_SENSOR_SetOutputDataRate( 1, ENV_TEMPERATURE, 1.0f );
+    lBspError |= BSP_ENV_SENSOR_SetOutputDataRate( 1, ENV_PRESSURE, 1.0f );
+
+    return( lBspError == BSP_ERROR_NONE ? pdTRUE : pdFALSE );
+}
+
+/*-----------------------------------------------------------*/
+
+static BaseType_t prvInitMotionSensors( void )
+{
+    int32_t lBspError = BSP_ERROR_NONE;
+
+    /* Gyro + Accelerometer*/
+    lBspError = BSP_MOTION_SENSOR_Init( 0, MOTION_GYRO | MOTION_ACCELERO );
+    lBspError |= BSP_MOTION_SENSOR_Enable( 0, MOTION_GYRO );
+    lBspError |= BSP_MOTION_SENSOR_Enable( 0, MOTION_ACCELERO );
+    lBspError |= BSP_MOTION_SENSOR_SetOutputDataRate( 0, MOTION_GYRO, 1.0f );
+    lBspError |= BSP_MOTION_SENSOR_SetOutputDataRate( 0, MOTION_ACCELERO, 1.0f );
+
+    /* Magnetometer */
+    lBspError |= BSP_MOTION_SENSOR_Init( 1, MOTION_MAGNETO );
+    lBspError |= BSP_MOTION_SENSOR_Enable( 1, MOTION_MAGNETO );
+    lBspError |= BSP_MOTION_SENSOR_SetOutputDataRate( 1, MOTION_MAGNETO, 1.0f );
+
+    return( lBspError == BSP_ERROR_NONE ? pdTRUE : pdFALSE );
+}
+
+/*-----------------------------------------------------------*/
+
+/* All registers of a class are read back-to-back so the sample is coherent */
+static BaseType_t prvReadClass( SensorHubClass_t xClass,
+                                SensorHubSample_t * pxSample )
+{
+    int32_t lBspError = BSP_ERROR_NONE;
+
+    pxSample->xClass = xClass;
+    pxSample->xTimestamp = xTaskGetTickCount();
+    pxSample->ullTimestampUs = ullTimeBaseGetUs();
+
+    if( xClass == SENSOR_HUB_ENV )
+    {
+        SensorHubEnvData_t * pxEnv = &( pxSample->u.xEnv );
+
+        lBspError = BSP_ENV_SENSOR_GetValue( 0, ENV_TEMPERATURE, &pxEnv->fTemperature0 );
+        lBspError |= BSP_ENV_SENSOR_GetValue( 0, ENV_HUMIDITY, &pxEnv->fHumidity );
+        lBspError |= BSP_ENV_SENSOR_GetValue( 1, ENV_TEMPERATURE, &pxEnv->fTemperature1 );
+        lBspError |= BSP_ENV_SENSOR_GetValue( 1, ENV_PRESSURE, &pxEnv->fBarometricPressure );
+    }
+    else
+    {
+        SensorHubMotionData_t * pxMotion = &( pxSample->u.xMotion );
+
+        lBspError = BSP_MOTION_SENSOR_GetAxes( 0, MOTION_GYRO, &pxMotion->xGyro );
+        lBspError |= BSP_MOTION_SENSOR_GetAxes( 0, MOTION_ACCELERO, &pxMotion->xAccelero );
+        lBspError |= BSP_MOTION_SENSOR_GetAxes( 1, MOTION_MAGNETO, &pxMotion->xMagneto );
+    }
+
+    pxSample->ulSeq = ulClassSeq[ xClass ]++;
+
+    return( lBspError == BSP_ERROR_NONE ? pdTRUE : pdFALSE );
+}
+
+/*-----------------------------------------------------------*/
+
+static void prvDeliver( const SensorHubSample_t * pxSample )
+{
+    for( UBaseType_t uxIdx = 0; uxIdx < uxNumSubscribers; uxIdx++ )
+    {
+        if( xSubscribers[ uxIdx ].xClass == pxSample->xClass )
+        {
+            ( void ) xQueueOverwrite( xSubscribers[ uxIdx ].xQueue, pxSample );
+
+            if( xSubscribers[ uxIdx ].pxJob != NULL )
+            {
+                vWorkJobSchedule( xSubscribers[ uxIdx ].pxJob, 0 );
+            }
+        }
+    }
+}
+
+/*-----------------------------------------------------------*/
+
+/* Samples one class, runs on the worker every period of the class once it has a subscriber */
+static void prvSampleJob( void * pvCtx )
+{
+    SensorHubClass_t xClass = ( SensorHubClass_t ) ( uintptr_t ) pvCtx;
+    SensorHubSample_t xSample;
+
+    if( prvReadClass( xClass, &xSample ) == pdTRUE )
+    {
+        prvDeliver( &xSample );
+    }
+    else
+    {
+        LogError( "Error while reading sensor class %d.", xClass );
+    }
+}
+
+/*-----------------------------------------------------------*/
+
+QueueHandle_t xSensorHubSubscribeJob( SensorHubClass_t xClass,
+                                      WorkJob_t * pxJob )
+{
+    QueueHandle_t xQueue = NULL;
+    BaseType_t xFirst = pdTRUE;
+
+    configASSERT( xClass < SENSOR_HUB_NUM_CLASSES );
+
+    ( void ) xEventGroupWaitBits( xSystemEvents,
+                                  EVT_MASK_SENSORS_READY,
+                                  pdFALSE,
+                                  pdTRUE,
+                                  portMAX_DELAY );
+
+    if( xClassReady[ xClass ] != pdTRUE )
+    {
+        LogError( "Sensor class %d is not available.", xClass );
+    }
+    else
+    {
+        xQueue = xQueueCreate( 1, sizeof( SensorHubSample_t ) );
+    }
+
+    if( xQueue != NULL )
+    {
+        taskENTER_CRITICAL();
+
+        if( uxNumSubscribers < SENSOR_HUB_MAX_SUBSCRIBERS )
+        {
+            for( UBaseType_t uxIdx = 0; uxIdx < uxNumSubscribers; uxIdx++ )
+            {
+                if( xSubscribers[ uxIdx ].xClass == xClass )
+                {
+                    xFirst = pdFALSE;
+                }
+            }
+
+            xSubscribers[ uxNumSubscribers ].xClass = xClass;
+            xSubscribers[ uxNumSubscribers ].xQueue = xQueue;
+            xSubscribers[ uxNumSubscribers ].pxJob = pxJob;
+            uxNumSubscribers++;
+        }
+        else
+        {
+            vQueueDelete( xQueue );
+            xQueue = NULL;
+        }
+
+        taskEXIT_CRITICAL();
+
+        if( xQueue == NULL )
+        {
+            LogError( "Sensor hub subscriber table is full." );
+        }
+        else if( xFirst == pdTRUE )
+        {
+            /* Start sampling the class right away */
+            vWorkJobSchedulePeriodic( &xClassJob[ xClass ], 0, ulClassPeriodMs[ xClass ] );
+        }
+    }
+
+    return xQueue;
+}
+
+/*-----------------------------------------------------------*/
+
+QueueHandle_t xSensorHubSubscribe( SensorHubClass_t xClass )
+{
+    return xSensorHubSubscribeJob( xClass, NULL );
+}
+
+/*-----------------------------------------------------------*/
+
+void vSensorHubInit( void )
+{
+    xClassReady[ SENSOR_HUB_ENV ] = prvInitEnvSensors();
+
+    if( xClassReady[ SENSOR_HUB_ENV ] != pdTRUE )
+    {
+        LogError( "Error while initializing environmental sensors." );
+    }
+
+    xClassReady[ SENSOR_HUB_MOTION ] = prvInitMotionSensors();
+
+    if( xClassReady[ SENSOR_HUB_MOTION ] != pdTRUE )
+    {
+        LogError( "Error while initializing motion sensors." );
+    }
+
+    vWorkJobInit( &xClassJob[ SENSOR_HUB_ENV ], "HubEnv", prvSampleJob,
+                  ( void * ) ( uintptr_t ) SENSOR_HUB_ENV );
+    vWorkJobInit( &xClassJob[ SENSOR_HUB_MOTION ], "HubMotion", prvSampleJob,
+                  ( void * ) ( uintptr_t ) SENSOR_HUB_MOTION );
+
+    /* Subscribers are released even on failure so they can report it */
+    ( void ) xEventGroupSetBits( xSystemEvents, EVT_MASK_SENSORS_READY );
+}
+
+#else /* SENSOR_HUB_ENABLED == 1 */
+
+void vSensorHubInit( void )
+{
+    /* Each publisher drives its own sensors */
+}
+
+#endif /* SENSOR_HUB_ENABLED == 1 */
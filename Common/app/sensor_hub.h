@@ -0,0 +1,128 @@
+/*
+ * FreeRTOS STM32 Reference Integration
+ * Copyright (C) 2022 Amazon.com, Inc. or its affiliates.  All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ *
+ * https://www.FreeRTOS.org
+ * https://github.com/FreeRTOS
+ *
+ */
+
+/**
+ * @file sensor_hub.h
+ * @brief Single owner of the I2C2 sensor bus.
+ *
+ * The hub task initializes the environmental and motion sensors, reads each
+ * sensor class back-to-back at its own period and hands timestamped samples to
+ * subscribers. Every subscriber gets a single entry queue that is overwritten
+ * with the latest sample, so a slow subscriber never stalls the bus.
+ */
+#ifndef _SENSOR_HUB_H
+#define _SENSOR_HUB_H
+
+#include "FreeRTOS.h"
+#include "queue.h"
+
+#include "time_base.h"
+#include "work_queue.h"
+
+#include "b_u585i_iot02a_env_sensors.h"
+#include "b_u585i_iot02a_motion_sensors.h"
+
+/* Set to 0 to let each publisher task drive its sensors directly. */
+#ifndef SENSOR_HUB_ENABLED
+#define SENSOR_HUB_ENABLED             1
+#endif
+
+/* Total number of subscriptions over all sensor classes. */
+#ifndef SENSOR_HUB_MAX_SUBSCRIBERS
+#define SENSOR_HUB_MAX_SUBSCRIBERS     4
+#endif
+
+#ifndef SENSOR_HUB_ENV_PERIOD_MS
+#define SENSOR_HUB_ENV_PERIOD_MS       1000U
+#endif
+
+#ifndef SENSOR_HUB_MOTION_PERIOD_MS
+#define SENSOR_HUB_MOTION_PERIOD_MS    500U
+#endif
+
+typedef enum
+{
+    SENSOR_HUB_ENV = 0,
+    SENSOR_HUB_MOTION,
+    SENSOR_HUB_NUM_CLASSES
+} SensorHubClass_t;
+
+typedef struct
+{
+    float_t fTemperature0;
+    float_t fTemperature1;
+    float_t fHumidity;
+    float_t fBarometricPressure;
+} SensorHubEnvData_t;
+
+typedef struct
+{
+    BSP_MOTION_SENSOR_Axes_t xAccelero;
+    BSP_MOTION_SENSOR_Axes_t xGyro;
+    BSP_MOTION_SENSOR_Axes_t xMagneto;
+} SensorHubMotionData_t;
+
+typedef struct
+{
+    SensorHubClass_t xClass;
+    TickType_t xTimestamp;   /* Tick count when the first register of the sample was read */
+    uint64_t ullTimestampUs; /* The same instant from ullTimeBaseGetUs */
+    uint32_t ulSeq;        /* Incremented for every sample of this class, gaps mean missed samples */
+    union
+    {
+        SensorHubEnvData_t xEnv;
+        SensorHubMotionData_t xMotion;
+    } u;
+} SensorHubSample_t;
+
+/*
+ * @brief Initialize the sensors, call once from a task before any subscription.
+ *
+ * Sampling runs as jobs on the worker of work_queue.h, one per sensor class.
+ */
+void vSensorHubInit( void );
+
+/*
+ * @brief Subscribe to the samples of one sensor class.
+ *
+ * Blocks until vSensorHubInit has initialized the sensors. Samples are only
+ * acquired while a class has at least one subscriber.
+ *
+ * @return A queue holding the latest SensorHubSample_t, or NULL if the sensors
+ * of that class are not available or the subscriber table is full.
+ */
+QueueHandle_t xSensorHubSubscribe( SensorHubClass_t xClass );
+
+/*
+ * @brief Subscribe like xSensorHubSubscribe and run pxJob after each sample.
+ *
+ * The job reads the returned queue without blocking.
+ */
+QueueHandle_t xSensorHubSubscribeJob( SensorHubClass_t xClass,
+                                      WorkJob_t * pxJob );
+
+#endif /* _SENSOR_HUB_H */
@@ -30,25 +30,33 @@
  * strings, and for determining whether an incoming MQTT message is related to the
  * device shadow.
  *
- * This example assumes there is a powerOn state in the device shadow. It does the
- * following operations:
+ * The reported state is made of the properties registered with shadow_props.h.
+ * This task registers a powerOn property itself. It does the following operations:
  * 1. Assemble strings for the MQTT topics of device shadow, by using macros defined by the Device Shadow library.
  * 2. Subscribe to those MQTT topics using the MQTT Agent.
  * 3. Register callbacks for incoming shadow topic publishes with the subsciption_manager.
- * 3. Publish to report the current state of powerOn.
- * 5. Check if powerOn has been changed and send an update if so.
+ * 4. Publish to report the current state of all properties.
+ * 5. Wait for a property to change, then for SHADOW_PROPS_COALESCE_MS so that a burst of
+ *    changes is sent as one update carrying only the changed properties.
  * 6. If a publish to update reported state was sent, wait until either prvIncomingPublishUpdateAcceptedCallback
  *    or prvIncomingPublishUpdateRejectedCallback handle the response.
- * 7. Wait until time for next check and repeat from step 5.
+ * 7. Repeat from step 5. Properties that were not accepted are retried every shadowMS_BETWEEN_REPORTS,
+ *    otherwise the task sleeps until the next change.
  *
  * Meanwhile, when prvIncomingPublishUpdateDeltaCallback receives changes to the shadow state,
- * it will apply them on the device.
+ * it passes the desired values to the callbacks of the registered properties.
+ *
+ * Properties may also belong to named shadows. Rather than subscribing to the response
+ * topics of every named shadow, one wildcard filter per response type, e.g.
+ * "$aws/things/<thing>/shadow/name/+/update/delta", covers all of them and the callbacks
+ * dispatch on the shadow name found in the topic.
  */
 
 #include "logging_levels.h"
 /* define LOG_LEVEL here if you want to modify the logging level from the default */
 
 #define LOG_LEVEL    LOG_INFO
+#define LOG_MODULE    LOG_MODULE_SHADOW
 
 #include "logging.h"
 
@@ -70,6 +78,8 @@
 
 /* JSON library includes. */
 #include "core_json.h"
+#include "shadow_json.h"
+#include "shadow_props.h"
 
 /* Shadow API header. */
 #include "shadow.h"
@@ -79,9 +89,10 @@
 #include "hw_defs.h"
 
 /**
- * @brief Format string representing a Shadow document with a "reported" state.
+ * @brief Size of the buffer the reported state document is built in.
  *
- * The real json document will look like this:
+ * The document will look like this, with only the properties that changed since
+ * the last accepted report:
  * {
  *   "state": {
  *     "reported": {
@@ -96,35 +107,10 @@
  * but may be reused once the update is completed. For this demo, a timestamp
  * is used for a client token.
  */
-#define shadowexampleSHADOW_REPORTED_JSON \
-    "{"                                   \
-    "\"state\":{"                         \
-    "\"reported\":{"                      \
-    "\"powerOn\":%1u"                     \
-    "}"                                   \
-    "},"                                  \
-    "\"clientToken\":\"%06lu\""           \
-    "}"
-
-/**
- * @brief The expected size of #SHADOW_REPORTED_JSON.
- *
- * Since all of the format specifiers in #SHADOW_REPORTED_JSON include a length,
- * its actual size can be calculated at compile time from the difference between
- * the lengths of the format strings and their formatted output. We must subtract 2
- * from the length as according the following formula:
- * 1. The length of the format string "%1u" is 3.
- * 2. The length of the format string "%06lu" is 5.
- * 3. The formatted length in case 1. is 1 ( for the state of powerOn ).
- * 4. The formatted length in case 2. is 6 ( for the clientToken length ).
- * 5. Thus the additional size of our format is 2 = 3 + 5 - 1 - 6 + 1 (termination character).
- *
- * Custom applications may calculate the length of the JSON document with the same method.
- */
-#define shadowexampleSHADOW_REPORTED_JSON_LENGTH       ( sizeof( shadowexampleSHADOW_REPORTED_JSON ) - 2 )
+#define shadowexampleUPDATE_DOCUMENT_LEN               ( 256U )
 
 /**
- * @brief Time in ms to wait between checking for updates to report.
+ * @brief Time in ms to wait before retrying properties that were not accepted.
  */
 #define shadowMS_BETWEEN_REPORTS                       ( 15000U )
 
@@ -142,13 +128,6 @@
  */
 #define shadowexampleMAX_COMMAND_SEND_BLOCK_TIME_MS    ( 60 * 1000 )
 
-/**
- * @brief An invalid value for the powerOn state. This is used to set the last
- * reported state to a value that will not match the current state. As we only
- * set the powerOn state to 0 or 1, any other value will suffice.
- */
-#define shadowexampleINVALID_POWERON_STATE             ( 2 )
-
 /**
  * @brief Defines structure passed to callbacks and local functions.
  */
@@ -167,16 +146,27 @@ typedef struct MQTTAgentCommandContext
     char * pcTopicDelete;
     uint16_t usTopicDeleteLen;
 
+#if SHADOW_PROPS_MAX_SHADOWS > 1
+    /* Wildcard filters matching the responses of every named shadow */
+    char * pcTopicNamedDelta;
+    char * pcTopicNamedAccepted;
+    char * pcTopicNamedRejected;
+
+    /* /update topic of the named shadow being reported */
+    char * pcTopicNamedUpdate;
+    uint16_t usTopicNamedUpdateMaxLen;
+#endif
+
     /**
-     * @brief The simulated device current power on state.
+     * @brief The simulated device power on state.
      */
-    uint32_t ulCurrentPowerOnState;
+    ShadowPropId_t xPowerOnProp;
 
     /**
-     * @brief The last reported state. It is initialized to an invalid value so that
-     * an update is initially sent.
+     * @brief Latest document version of each shadow seen on /update/delta or /update/accepted.
+     * Deltas that are not newer are stale and dropped.
      */
-    uint32_t ulReportedPowerOnState;
+    uint32_t ulShadowVersion[ SHADOW_PROPS_MAX_SHADOWS ];
 
     /**
      * @brief Match the received clientToken with the one sent in a device shadow
@@ -204,10 +194,17 @@ extern MQTTAgentContext_t xGlobalMqttAgentContext;
  */
 static bool prvSubscribeToShadowUpdateTopics( ShadowDeviceCtx_t * pxCtx );
 
+#if SHADOW_PROPS_MAX_SHADOWS > 1
+static ShadowStatus_t prvAssembleNamedTopic( ShadowTopicStringType_t xType,
+                                             const ShadowDeviceCtx_t * pxCtx,
+                                             const char * pcShadowName,
+                                             char ** ppcTopic );
+#endif
+
 /**
  * @brief The callback to execute when there is an incoming publish on the
- * topic for delta updates. It verifies the document and sets the
- * powerOn state accordingly.
+ * topic for delta updates. It verifies the document and passes the desired
+ * values to the registered properties.
  */
 static void prvIncomingPublishUpdateDeltaCallback( void * pvCtx,
                                                    MQTTPublishInfo_t * pxPublishInfo );
@@ -328,6 +325,20 @@ static bool prvInitializeCtx( ShadowDeviceCtx_t * pxCtx )
                                           pxCtx->usTopicDeleteLen,
                                           &( pxCtx->usTopicDeleteLen ) );
 
+#if SHADOW_PROPS_MAX_SHADOWS > 1
+        xStatus |= prvAssembleNamedTopic( ShadowTopicStringTypeUpdateDelta, pxCtx, "+", &( pxCtx->pcTopicNamedDelta ) );
+        xStatus |= prvAssembleNamedTopic( ShadowTopicStringTypeUpdateAccepted, pxCtx, "+", &( pxCtx->pcTopicNamedAccepted ) );
+        xStatus |= prvAssembleNamedTopic( ShadowTopicStringTypeUpdateRejected, pxCtx, "+", &( pxCtx->pcTopicNamedRejected ) );
+
+        pxCtx->usTopicNamedUpdateMaxLen = SHADOW_TOPIC_LEN_UPDATE( pxCtx->ucDeviceNameLen, SHADOW_PROPS_SHADOW_NAME_LEN ) + 1;
+        pxCtx->pcTopicNamedUpdate = pvPortMalloc( pxCtx->usTopicNamedUpdateMaxLen );
+
+        if( pxCtx->pcTopicNamedUpdate == NULL )
+        {
+            xStatus = SHADOW_FAIL;
+        }
+#endif /* SHADOW_PROPS_MAX_SHADOWS > 1 */
+
         xSuccess &= ( xStatus == SHADOW_SUCCESS );
     }
     else
@@ -340,46 +351,108 @@ static bool prvInitializeCtx( ShadowDeviceCtx_t * pxCtx )
 
 /*-----------------------------------------------------------*/
 
-static bool prvSubscribeToShadowUpdateTopics( ShadowDeviceCtx_t * pxCtx )
+#if SHADOW_PROPS_MAX_SHADOWS > 1
+
+/*
+ * @brief Allocate and assemble a null terminated topic of named shadow pcShadowName.
+ */
+static ShadowStatus_t prvAssembleNamedTopic( ShadowTopicStringType_t xType,
+                                             const ShadowDeviceCtx_t * pxCtx,
+                                             const char * pcShadowName,
+                                             char ** ppcTopic )
 {
-    MQTTStatus_t xStatus = MQTTSuccess;
+    ShadowStatus_t xStatus = SHADOW_FAIL;
+    uint16_t usBufferLen = SHADOW_TOPIC_LEN_MAX( pxCtx->ucDeviceNameLen, SHADOW_PROPS_SHADOW_NAME_LEN ) + 1;
+    uint16_t usTopicLen = 0;
 
-    xStatus = MqttAgent_SubscribeSync( pxCtx->xAgentHandle,
-                                       pxCtx->pcTopicUpdateDelta,
-                                       MQTTQoS1,
-                                       prvIncomingPublishUpdateDeltaCallback,
-                                       pxCtx );
+    *ppcTopic = pvPortMalloc( usBufferLen );
 
-    if( xStatus != MQTTSuccess )
+    if( *ppcTopic != NULL )
     {
-        LogError( "Failed to subscribe to topic: %s", pxCtx->pcTopicUpdateDelta );
+        xStatus = Shadow_AssembleTopicString( xType,
+                                              pxCtx->pcDeviceName,
+                                              pxCtx->ucDeviceNameLen,
+                                              pcShadowName,
+                                              ( uint8_t ) strlen( pcShadowName ),
+                                              *ppcTopic,
+                                              usBufferLen - 1,
+                                              &usTopicLen );
     }
-    else
+
+    if( xStatus == SHADOW_SUCCESS )
     {
-        xStatus = MqttAgent_SubscribeSync( pxCtx->xAgentHandle,
-                                           pxCtx->pcTopicUpdateAccepted,
-                                           MQTTQoS1,
-                                           prvIncomingPublishUpdateAcceptedCallback,
-                                           pxCtx );
+        ( *ppcTopic )[ usTopicLen ] = '\0';
+    }
 
-        if( xStatus != MQTTSuccess )
+    return xStatus;
+}
+
+#endif /* SHADOW_PROPS_MAX_SHADOWS > 1 */
+
+/*-----------------------------------------------------------*/
+
+/*
+ * @brief Find the registered shadow an incoming shadow response belongs to.
+ *
+ * @return Index of the shadow, or -1 if the topic is not for a known shadow.
+ */
+static int32_t prvShadowFromTopic( const MQTTPublishInfo_t * pxPublishInfo )
+{
+    int32_t lShadow = -1;
+    ShadowMessageType_t xMessageType;
+    const char * pcThingName = NULL;
+    uint8_t ucThingNameLen = 0;
+    const char * pcShadowName = NULL;
+    uint8_t ucShadowNameLen = 0;
+
+    if( Shadow_MatchTopicString( pxPublishInfo->pTopicName,
+                                 pxPublishInfo->topicNameLength,
+                                 &xMessageType,
+                                 &pcThingName,
+                                 &ucThingNameLen,
+                                 &pcShadowName,
+                                 &ucShadowNameLen ) == SHADOW_SUCCESS )
+    {
+        lShadow = lShadowPropsFindShadow( pcShadowName, ucShadowNameLen );
+
+        if( lShadow < 0 )
         {
-            LogError( "Failed to subscribe to topic: %s", pxCtx->pcTopicUpdateAccepted );
+            LogDebug( "Ignoring response for unknown shadow %.*s.", ucShadowNameLen, pcShadowName );
         }
     }
 
-    if( xStatus == MQTTSuccess )
+    return lShadow;
+}
+
+/*-----------------------------------------------------------*/
+
+static bool prvSubscribeToShadowUpdateTopics( ShadowDeviceCtx_t * pxCtx )
+{
+    MQTTStatus_t xStatus = MQTTSuccess;
+
+    const SubscribeRequest_t xRequests[] =
     {
-        xStatus = MqttAgent_SubscribeSync( pxCtx->xAgentHandle,
-                                           pxCtx->pcTopicUpdateRejected,
-                                           MQTTQoS1,
-                                           prvIncomingPublishUpdateRejectedCallback,
-                                           pxCtx );
+        { pxCtx->pcTopicUpdateDelta,    MQTTQoS1, prvIncomingPublishUpdateDeltaCallback,    pxCtx },
+        { pxCtx->pcTopicUpdateAccepted, MQTTQoS1, prvIncomingPublishUpdateAcceptedCallback, pxCtx },
+        { pxCtx->pcTopicUpdateRejected, MQTTQoS1, prvIncomingPublishUpdateRejectedCallback, pxCtx },
+#if SHADOW_PROPS_MAX_SHADOWS > 1
+        { pxCtx->pcTopicNamedDelta,     MQTTQoS1, prvIncomingPublishUpdateDeltaCallback,    pxCtx },
+        { pxCtx->pcTopicNamedAccepted,  MQTTQoS1, prvIncomingPublishUpdateAcceptedCallback, pxCtx },
+        { pxCtx->pcTopicNamedRejected,  MQTTQoS1, prvIncomingPublishUpdateRejectedCallback, pxCtx },
+#endif
+    };
+
+    /* Subscribe to all topics with a single SUBSCRIBE packet */
+    xStatus = MqttAgent_SubscribeMultiSync( pxCtx->xAgentHandle,
+                                            xRequests,
+                                            sizeof( xRequests ) / sizeof( xRequests[ 0 ] ) );
 
-        if( xStatus != MQTTSuccess )
-        {
-            LogError( "Failed to subscribe to topic: %s", pxCtx->pcTopicUpdateRejected );
-        }
+    if( xStatus != MQTTSuccess )
+    {
+        LogError( "Failed to subscribe to shadow update topics: %s, %s, %s",
+                  pxCtx->pcTopicUpdateDelta,
+                  pxCtx->pcTopicUpdateAccepted,
+                  pxCtx->pcTopicUpdateRejected );
     }
 
     return( xStatus == MQTTSuccess );
@@ -387,18 +460,36 @@ static bool prvSubscribeToShadowUpdateTopics( ShadowDeviceCtx_t * pxCtx )
 
 /*-----------------------------------------------------------*/
 
+static void prvPowerOnDesiredCallback( ShadowPropId_t xId,
+                                       uint32_t ulDesired,
+                                       void * pvCtx )
+{
+    ( void ) pvCtx;
+
+    LogInfo( "Setting powerOn state to %u.", ( unsigned int ) ulDesired );
+
+    if( ulDesired == 1 )
+    {
+        HAL_GPIO_WritePin( LED_RED_GPIO_Port, LED_RED_Pin, GPIO_PIN_RESET ); /* Turn the LED ON */
+    }
+    else
+    {
+        HAL_GPIO_WritePin( LED_RED_GPIO_Port, LED_RED_Pin, GPIO_PIN_SET ); /* Turn the LED off */
+    }
+
+    /* Report the new state */
+    vShadowPropSet( xId, ulDesired );
+}
+
+/*-----------------------------------------------------------*/
+
 static void prvIncomingPublishUpdateDeltaCallback( void * pvCtx,
                                                    MQTTPublishInfo_t * pxPublishInfo )
 {
-    static uint32_t ulCurrentVersion = 0; /* Remember the latest version number we've received */
-    uint32_t ulVersion = 0UL;
-    uint32_t ulNewState = 0UL;
-    char * pcOutValue = NULL;
-    uint32_t ulOutValueLength = 0UL;
-    JSONStatus_t result = JSONSuccess;
-
     ShadowDeviceCtx_t * pxCtx = ( ShadowDeviceCtx_t * ) pvCtx;
+    int32_t lShadow = -1;
 
+    configASSERT( pvCtx != NULL );
     configASSERT( pxPublishInfo != NULL );
     configASSERT( pxPublishInfo->pPayload != NULL );
 
@@ -421,87 +512,14 @@ static void prvIncomingPublishUpdateDeltaCallback( void * pvCtx,
      *      "version": 12
      *  }
      */
+    lShadow = prvShadowFromTopic( pxPublishInfo );
 
-    /* Make sure the payload is a valid json document. */
-    result = JSON_Validate( pxPublishInfo->pPayload,
-                            pxPublishInfo->payloadLength );
-
-    if( result != JSONSuccess )
+    if( lShadow >= 0 )
     {
-        LogError( "Invalid JSON document received!" );
-    }
-    else
-    {
-        /* Obtain the version value. */
-        result = JSON_Search( ( char * ) pxPublishInfo->pPayload,
-                              pxPublishInfo->payloadLength,
-                              "version",
-                              sizeof( "version" ) - 1,
-                              &pcOutValue,
-                              ( size_t * ) &ulOutValueLength );
-
-        if( result != JSONSuccess )
-        {
-            LogError( "Version field not found in JSON document!" );
-        }
-        else
-        {
-            /* Convert the extracted value to an unsigned integer value. */
-            ulVersion = ( uint32_t ) strtoul( pcOutValue, NULL, 10 );
-
-            /* Make sure the version is newer than the last one we received. */
-            if( ulVersion <= ulCurrentVersion )
-            {
-                /* In this demo, we discard the incoming message
-                 * if the version number is not newer than the latest
-                 * that we've received before. Your application may use a
-                 * different approach.
-                 */
-                LogWarn( ( "Received unexpected delta update with version %u. Current version is %u",
-                           ( unsigned int ) ulVersion,
-                           ( unsigned int ) ulCurrentVersion ) );
-            }
-            else
-            {
-                LogInfo( "Received delta update with version %.*s.",
-                         ulOutValueLength,
-                         pcOutValue );
-
-                /* Set received version as the current version. */
-                ulCurrentVersion = ulVersion;
-
-                /* Get powerOn state from json documents. */
-                result = JSON_Search( ( char * ) pxPublishInfo->pPayload,
-                                      pxPublishInfo->payloadLength,
-                                      "state.powerOn",
-                                      sizeof( "state.powerOn" ) - 1,
-                                      &pcOutValue,
-                                      ( size_t * ) &ulOutValueLength );
-
-                if( result != JSONSuccess )
-                {
-                    LogWarn( "powerOn field not found in JSON document!" );
-                }
-                else
-                {
-                    /* Convert the powerOn state value to an unsigned integer value. */
-                    ulNewState = ( uint32_t ) strtoul( pcOutValue, NULL, 10 );
-
-                    LogInfo( "Setting powerOn state to %u.", ( unsigned int ) ulNewState );
-                    /* Set the new powerOn state. */
-                    pxCtx->ulCurrentPowerOnState = ulNewState;
-
-                    if( ulNewState == 1 )
-                    {
-                        HAL_GPIO_WritePin( LED_RED_GPIO_Port, LED_RED_Pin, GPIO_PIN_RESET ); /* Turn the LED ON */
-                    }
-                    else
-                    {
-                        HAL_GPIO_WritePin( LED_RED_GPIO_Port, LED_RED_Pin, GPIO_PIN_SET ); /* Turn the LED off */
-                    }
-                }
-            }
-        }
+        ( void ) xShadowPropsHandleDelta( ( uint32_t ) lShadow,
+                                          pxPublishInfo->pPayload,
+                                          pxPublishInfo->payloadLength,
+                                          &( pxCtx->ulShadowVersion[ lShadow ] ) );
     }
 }
 
@@ -510,10 +528,14 @@ static void prvIncomingPublishUpdateDeltaCallback( void * pvCtx,
 static void prvIncomingPublishUpdateAcceptedCallback( void * pvCtx,
                                                       MQTTPublishInfo_t * pxPublishInfo )
 {
-    char * pcOutValue = NULL;
-    uint32_t ulOutValueLength = 0UL;
     uint32_t ulReceivedToken = 0UL;
     JSONStatus_t result = JSONSuccess;
+    int32_t lShadow = -1;
+    ShadowJsonField_t xFields[] =
+    {
+        { .pcPath = "clientToken" },
+        { .pcPath = "version" },
+    };
 
     ShadowDeviceCtx_t * pxCtx = ( ShadowDeviceCtx_t * ) pvCtx;
 
@@ -548,33 +570,48 @@ static void prvIncomingPublishUpdateAcceptedCallback( void * pvCtx,
      *  }
      */
 
-    /* Make sure the payload is a valid json document. */
-    result = JSON_Validate( pxPublishInfo->pPayload,
-                            pxPublishInfo->payloadLength );
+    lShadow = prvShadowFromTopic( pxPublishInfo );
 
-    if( result != JSONSuccess )
+    if( lShadow < 0 )
     {
-        LogError( "Invalid JSON document received!" );
+        result = JSONNotFound;
     }
     else
     {
-        /* Get clientToken from json documents. */
-        result = JSON_Search( ( char * ) pxPublishInfo->pPayload,
-                              pxPublishInfo->payloadLength,
-                              "clientToken",
-                              sizeof( "clientToken" ) - 1,
-                              &pcOutValue,
-                              ( size_t * ) &ulOutValueLength );
+        /* Pick out all fields of interest in one pass over the document. */
+        result = xShadowJsonExtract( pxPublishInfo->pPayload,
+                                     pxPublishInfo->payloadLength,
+                                     xFields,
+                                     sizeof( xFields ) / sizeof( xFields[ 0 ] ) );
+
+        if( result != JSONSuccess )
+        {
+            LogError( "Invalid JSON document received!" );
+        }
+        else if( xFields[ 1 ].pcValue != NULL )
+        {
+            /* Any accepted update, ours or not, supersedes older deltas */
+            uint32_t ulVersion = ( uint32_t ) strtoul( xFields[ 1 ].pcValue, NULL, 10 );
+
+            if( ulVersion > pxCtx->ulShadowVersion[ lShadow ] )
+            {
+                pxCtx->ulShadowVersion[ lShadow ] = ulVersion;
+            }
+        }
+        else
+        {
+            /* No version to track */
+        }
     }
 
-    if( result != JSONSuccess )
+    if( ( result != JSONSuccess ) || ( xFields[ 0 ].pcValue == NULL ) )
     {
         LogDebug( "Ignoring publish on /update/accepted with no clientToken field." );
     }
     else
     {
         /* Convert the code to an unsigned integer value. */
-        ulReceivedToken = ( uint32_t ) strtoul( pcOutValue, NULL, 10 );
+        ulReceivedToken = ( uint32_t ) strtoul( xFields[ 0 ].pcValue, NULL, 10 );
 
         /* If we are waiting for a response, ulClientToken will be the token for the response
          * we are waiting for, else it will be 0. ulReceivedToken may not match if the response is
@@ -589,24 +626,8 @@ static void prvIncomingPublishUpdateAcceptedCallback( void * pvCtx,
         {
             LogInfo( "Received accepted response for update with token %lu. ", ( unsigned long ) pxCtx->ulClientToken );
 
-            /*  Obtain the accepted state from the response and update our last sent state. */
-            result = JSON_Search( ( char * ) pxPublishInfo->pPayload,
-                                  pxPublishInfo->payloadLength,
-                                  "state.reported.powerOn",
-                                  sizeof( "state.reported.powerOn" ) - 1,
-                                  &pcOutValue,
-                                  ( size_t * ) &ulOutValueLength );
-
-            if( result != JSONSuccess )
-            {
-                LogError( "powerOn field not found in JSON document!" );
-            }
-            else
-            {
-                /* Convert the powerOn state value to an unsigned integer value and
-                 * save the new last reported value*/
-                pxCtx->ulReportedPowerOnState = ( uint32_t ) strtoul( pcOutValue, NULL, 10 );
-            }
+            /* The values sent with this token are now the reported state. */
+            vShadowPropsReportAccepted( ( uint32_t ) lShadow );
 
             /* Wake up the shadow task which is waiting for this response. */
             xTaskNotifyGive( pxCtx->xShadowDeviceTaskHandle );
@@ -620,9 +641,12 @@ static void prvIncomingPublishUpdateRejectedCallback( void * pvCtx,
                                                       MQTTPublishInfo_t * pxPublishInfo )
 {
     JSONStatus_t result = JSONSuccess;
-    char * pcOutValue = NULL;
-    uint32_t ulOutValueLength = 0UL;
     uint32_t ulReceivedToken = 0UL;
+    ShadowJsonField_t xFields[] =
+    {
+        { .pcPath = "clientToken" },
+        { .pcPath = "code" },
+    };
 
     ShadowDeviceCtx_t * pxCtx = ( ShadowDeviceCtx_t * ) pvCtx;
 
@@ -643,33 +667,24 @@ static void prvIncomingPublishUpdateRejectedCallback( void * pvCtx,
      * }
      */
 
-    /* Make sure the payload is a valid json document. */
-    result = JSON_Validate( pxPublishInfo->pPayload,
-                            pxPublishInfo->payloadLength );
+    /* Pick out all fields of interest in one pass over the document. */
+    result = xShadowJsonExtract( pxPublishInfo->pPayload,
+                                 pxPublishInfo->payloadLength,
+                                 xFields,
+                                 sizeof( xFields ) / sizeof( xFields[ 0 ] ) );
 
     if( result != JSONSuccess )
     {
         LogError( "Invalid JSON document received!" );
     }
-    else
-    {
-        /* Get clientToken from json documents. */
-        result = JSON_Search( ( char * ) pxPublishInfo->pPayload,
-                              pxPublishInfo->payloadLength,
-                              "clientToken",
-                              sizeof( "clientToken" ) - 1,
-                              &pcOutValue,
-                              ( size_t * ) &ulOutValueLength );
-    }
-
-    if( result != JSONSuccess )
+    else if( xFields[ 0 ].pcValue == NULL )
     {
-        LogDebug( "Ignoring publish on /update/rejected with clientToken %lu.", ( unsigned long ) ulReceivedToken );
+        LogDebug( "Ignoring publish on /update/rejected with no clientToken field." );
     }
     else
     {
         /* Convert the code to an unsigned integer value. */
-        ulReceivedToken = ( uint32_t ) strtoul( pcOutValue, NULL, 10 );
+        ulReceivedToken = ( uint32_t ) strtoul( xFields[ 0 ].pcValue, NULL, 10 );
 
         /* If we are waiting for a response, ulClientToken will be the token for the response
          * we are waiting for, else it will be 0. ulReceivedToken may not match if the response is
@@ -682,23 +697,15 @@ static void prvIncomingPublishUpdateRejectedCallback( void * pvCtx,
         }
         else
         {
-            /*  Obtain the error code. */
-            result = JSON_Search( ( char * ) pxPublishInfo->pPayload,
-                                  pxPublishInfo->payloadLength,
-                                  "code",
-                                  sizeof( "code" ) - 1,
-                                  &pcOutValue,
-                                  ( size_t * ) &ulOutValueLength );
-
-            if( result != JSONSuccess )
+            if( xFields[ 1 ].pcValue == NULL )
             {
                 LogWarn( "Received rejected response for update with token %lu and no error code.", ( unsigned long ) pxCtx->ulClientToken );
             }
             else
             {
                 LogWarn( "Received rejected response for update with token %lu and error code %.*s.", ( unsigned long ) pxCtx->ulClientToken,
-                         ulOutValueLength,
-                         pcOutValue );
+                         xFields[ 1 ].uxValueLen,
+                         xFields[ 1 ].pcValue );
             }
 
             /* Wake up the shadow task which is waiting for this response. */
@@ -709,6 +716,44 @@ static void prvIncomingPublishUpdateRejectedCallback( void * pvCtx,
 
 /*-----------------------------------------------------------*/
 
+static void prvSetUpdateTopic( ShadowDeviceCtx_t * pxCtx,
+                               uint32_t ulShadow,
+                               MQTTPublishInfo_t * pxPublishInfo )
+{
+    pxPublishInfo->pTopicName = pxCtx->pcTopicUpdate;
+    pxPublishInfo->topicNameLength = pxCtx->usTopicUpdateLen;
+
+#if SHADOW_PROPS_MAX_SHADOWS > 1
+    if( ulShadow != SHADOW_PROPS_CLASSIC )
+    {
+        const char * pcShadowName = pcShadowPropsShadowName( ulShadow );
+        uint16_t usTopicLen = 0;
+
+        if( Shadow_AssembleTopicString( ShadowTopicStringTypeUpdate,
+                                        pxCtx->pcDeviceName,
+                                        pxCtx->ucDeviceNameLen,
+                                        pcShadowName,
+                                        ( uint8_t ) strlen( pcShadowName ),
+                                        pxCtx->pcTopicNamedUpdate,
+                                        pxCtx->usTopicNamedUpdateMaxLen,
+                                        &usTopicLen ) == SHADOW_SUCCESS )
+        {
+            pxPublishInfo->pTopicName = pxCtx->pcTopicNamedUpdate;
+            pxPublishInfo->topicNameLength = usTopicLen;
+        }
+        else
+        {
+            /* Registered names are checked against SHADOW_PROPS_SHADOW_NAME_LEN */
+            configASSERT( 0 );
+        }
+    }
+#else
+    ( void ) ulShadow;
+#endif /* SHADOW_PROPS_MAX_SHADOWS > 1 */
+}
+
+/*-----------------------------------------------------------*/
+
 void vShadowDeviceTask( void * pvParameters )
 {
     bool xStatus = true;
@@ -717,10 +762,12 @@ void vShadowDeviceTask( void * pvParameters )
     MQTTAgentCommandInfo_t xCommandParams = { 0 };
     MQTTStatus_t xCommandAdded;
     ShadowDeviceCtx_t xShadowCtx = { 0 };
+    ShadowReportBuilder_t xReport;
+    TickType_t xTicksToWait;
 
     /* A buffer containing the update document. It has static duration to prevent
      * it from being placed on the call stack. */
-    static char pcUpdateDocument[ shadowexampleSHADOW_REPORTED_JSON_LENGTH + 1 ] = { 0 };
+    static char pcUpdateDocument[ shadowexampleUPDATE_DOCUMENT_LEN ] = { 0 };
 
     /* Remove compiler warnings about unused parameters. */
     ( void ) pvParameters;
@@ -728,6 +775,12 @@ void vShadowDeviceTask( void * pvParameters )
     /* Record the handle of this task so that the callbacks can send a notification to this task. */
     xShadowCtx.xShadowDeviceTaskHandle = xTaskGetCurrentTaskHandle();
 
+    /* Property changes wake this task on SHADOW_PROPS_NOTIFY_INDEX */
+    vShadowPropsSetListener( xShadowCtx.xShadowDeviceTaskHandle );
+
+    xShadowCtx.xPowerOnProp = xShadowPropRegister( NULL, "powerOn", 0, prvPowerOnDesiredCallback, NULL );
+    configASSERT( xShadowCtx.xPowerOnProp != SHADOW_PROP_INVALID );
+
     /* Wait for MqttAgent to be ready. */
     vSleepUntilMQTTAgentReady();
 
@@ -742,19 +795,12 @@ void vShadowDeviceTask( void * pvParameters )
     xCommandParams.blockTimeMs = shadowexampleMAX_COMMAND_SEND_BLOCK_TIME_MS;
     xCommandParams.cmdCompleteCallback = NULL;
 
-    /* Set up MQTTPublishInfo_t for the update reports. */
+    /* Set up MQTTPublishInfo_t for the update reports. The topic is set per shadow. */
     xPublishInfo.qos = MQTTQoS1;
-    xPublishInfo.pTopicName = xShadowCtx.pcTopicUpdate;
-    xPublishInfo.topicNameLength = xShadowCtx.usTopicUpdateLen;
     xPublishInfo.pPayload = pcUpdateDocument;
-    xPublishInfo.payloadLength = ( shadowexampleSHADOW_REPORTED_JSON_LENGTH + 1 );
 
     /* Wait for first mqtt connection */
-    ( void ) xEventGroupWaitBits( xSystemEvents,
-                                  EVT_MASK_MQTT_CONNECTED,
-                                  pdFALSE,
-                                  pdTRUE,
-                                  portMAX_DELAY );
+    ( void ) xMqttAgentWaitForState( MQTT_AGENT_STATE_CONNECTED, portMAX_DELAY );
 
     if( xStatus == true )
     {
@@ -766,63 +812,89 @@ void vShadowDeviceTask( void * pvParameters )
     {
         for( ; ; )
         {
-            if( xShadowCtx.ulCurrentPowerOnState == xShadowCtx.ulReportedPowerOnState )
-            {
-                LogDebug( "No change in powerOn state since last report. Current state is %u.", xShadowCtx.ulCurrentPowerOnState );
-            }
-            else
-            {
-                LogInfo( "PowerOn state is now %u. Sending new report.", ( unsigned int ) xShadowCtx.ulCurrentPowerOnState );
-
-                /* Create a new client token and save it for use in the update accepted and rejected callbacks. */
-                xShadowCtx.ulClientToken = ( xTaskGetTickCount() % 1000000 );
-
-                /* Generate update report. */
-                ( void ) memset( pcUpdateDocument,
-                                 0x00,
-                                 sizeof( pcUpdateDocument ) );
-
-                snprintf( pcUpdateDocument,
-                          shadowexampleSHADOW_REPORTED_JSON_LENGTH + 1,
-                          shadowexampleSHADOW_REPORTED_JSON,
-                          ( unsigned int ) xShadowCtx.ulCurrentPowerOnState,
-                          ( long unsigned ) xShadowCtx.ulClientToken );
-
-                /* Send update. */
-                LogInfo( "Publishing to /update with following client token %lu.", ( long unsigned ) xShadowCtx.ulClientToken );
-                LogDebug( "Publish content: %.*s", shadowexampleSHADOW_REPORTED_JSON_LENGTH, pcUpdateDocument );
+            /* The accepted and rejected replies are lost until the response topics are restored */
+            ( void ) xMqttAgentWaitForState( MQTT_AGENT_STATE_RESUBSCRIBED, portMAX_DELAY );
 
-                xCommandAdded = MQTTAgent_Publish( xShadowCtx.xAgentHandle,
-                                                   &xPublishInfo,
-                                                   &xCommandParams );
+            /* Each shadow is reported with its own update */
+            for( uint32_t ulShadow = 0; ulShadow < ulShadowPropsNumShadows(); ulShadow++ )
+            {
+                /* Generate update report with only the properties that changed. */
+                vShadowReportBegin( &xReport, pcUpdateDocument, sizeof( pcUpdateDocument ) );
 
-                if( xCommandAdded != MQTTSuccess )
+                if( ulShadowPropsCollect( ulShadow, &xReport ) == 0 )
                 {
-                    LogError( "Failed to publish report to shadow." );
+                    LogDebug( "No change in reported state of shadow %lu since last report.", ( unsigned long ) ulShadow );
                 }
                 else
                 {
-                    /* Wait for the response to our report. When the Device shadow service receives the request it will
-                     * publish a response to  the /update/accepted or update/rejected */
-                    ulNotificationValue = ulTaskNotifyTake( pdFALSE, pdMS_TO_TICKS( shadow_SIGNAL_TIMEOUT ) );
+                    prvSetUpdateTopic( &xShadowCtx, ulShadow, &xPublishInfo );
+
+                    /* Create a new client token and save it for use in the update accepted and rejected callbacks. */
+                    xShadowCtx.ulClientToken = ( xTaskGetTickCount() % 1000000 );
+
+                    xPublishInfo.payloadLength = uxShadowReportEnd( &xReport, xShadowCtx.ulClientToken );
 
-                    if( ulNotificationValue == 0 )
+                    if( xPublishInfo.payloadLength == 0 )
+                    {
+                        LogError( "Failed to build shadow report." );
+                        xCommandAdded = MQTTNoMemory;
+                    }
+                    else
                     {
-                        LogError( "Timed out waiting for response to report." );
+                        /* Send update. */
+                        LogInfo( "Publishing to %.*s with following client token %lu.",
+                                 xPublishInfo.topicNameLength, xPublishInfo.pTopicName,
+                                 ( long unsigned ) xShadowCtx.ulClientToken );
+                        LogDebug( "Publish content: %.*s", xPublishInfo.payloadLength, pcUpdateDocument );
+
+                        xCommandAdded = MQTTAgent_Publish( xShadowCtx.xAgentHandle,
+                                                           &xPublishInfo,
+                                                           &xCommandParams );
+                    }
 
-                        /* If we time out waiting for a response and then the report is accepted, the
-                         * state may be out of sync. Set the reported state as to ensure we resend the
-                         * report. */
-                        xShadowCtx.ulReportedPowerOnState = shadowexampleINVALID_POWERON_STATE;
+                    if( xCommandAdded != MQTTSuccess )
+                    {
+                        LogError( "Failed to publish report to shadow." );
+                    }
+                    else
+                    {
+                        /* Wait for the response to our report. When the Device shadow service receives the request it will
+                         * publish a response to  the /update/accepted or update/rejected */
+                        ulNotificationValue = ulTaskNotifyTake( pdFALSE, pdMS_TO_TICKS( shadow_SIGNAL_TIMEOUT ) );
+
+                        if( ulNotificationValue == 0 )
+                        {
+                            /* If we time out waiting for a response and then the report is accepted, the
+                             * state may be out of sync. The values are left unreported so that they are
+                             * sent again. */
+                            LogError( "Timed out waiting for response to report." );
+                        }
                     }
                 }
 
-                /* Clear the client token */
+                /* Clear the client token. Values that were not accepted are collected again. */
                 xShadowCtx.ulClientToken = 0;
+                vShadowPropsReportDone();
+            }
+
+            /* Wait for a property to change. Only retry after a while if some values were not accepted. */
+            if( ulShadowPropsUnreported() > 0 )
+            {
+                xTicksToWait = pdMS_TO_TICKS( shadowMS_BETWEEN_REPORTS );
+            }
+            else
+            {
+                xTicksToWait = portMAX_DELAY;
             }
 
-            LogDebug( "Sleeping until next update check." );
-            vTaskDelay( pdMS_TO_TICKS( shadowMS_BETWEEN_REPORTS ) );
+            LogDebug( "Sleeping until next property change." );
+
+            if( ulTaskNotifyTakeIndexed( SHADOW_PROPS_NOTIFY_INDEX, pdTRUE, xTicksToWait ) != 0 )
+            {
+                /* Let a burst of changes settle so that they are sent as one update. */
+                vTaskDelay( pdMS_TO_TICKS( SHADOW_PROPS_COALESCE_MS ) );
+                ( void ) ulTaskNotifyTakeIndexed( SHADOW_PROPS_NOTIFY_INDEX, pdTRUE, 0 );
+            }
         }
     }
     else
@@ -0,0 +1,270 @@
+/*
+ * FreeRTOS STM32 Reference Integration
+ * Copyright (C) 2022 Amazon.com, Inc. or its affiliates.  All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ *
+ * https://www.FreeRTOS.org
+ * https://github.com/FreeRTOS
+ *
+ */
+
+/**
+ * @file shadow_json.c
+ * @brief Single pass field extraction from, and incremental building of, shadow documents.
+ */
+
+/* Standard includes. */
+#include <stdarg.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "FreeRTOS.h"
+
+#include "shadow_json.h"
+
+/*-----------------------------------------------------------*/
+
+/* Find component ulLevel of a dotted path */
+static bool prvPathComponent( const char * pcPath,
+                              uint32_t ulLevel,
+                              const char ** ppcComponent,
+                              size_t * puxLen,
+                              bool * pxIsLast )
+{
+    const char * pcComponent = pcPath;
+    const char * pcEnd = NULL;
+
+    for( uint32_t ulIdx = 0; ( pcComponent != NULL ) && ( ulIdx < ulLevel ); ulIdx++ )
+    {
+        pcComponent = strchr( pcComponent, '.' );
+
+        if( pcComponent != NULL )
+        {
+            pcComponent++;
+        }
+    }
+
+    if( pcComponent != NULL )
+    {
+        pcEnd = strchr( pcComponent, '.' );
+
+        *ppcComponent = pcComponent;
+        *puxLen = ( pcEnd != NULL ) ? ( size_t ) ( pcEnd - pcComponent ) : strlen( pcComponent );
+        *pxIsLast = ( pcEnd == NULL );
+    }
+
+    return( pcComponent != NULL );
+}
+
+/*-----------------------------------------------------------*/
+
+static JSONStatus_t prvExtractLevel( const char * pcObject,
+                                     size_t uxObjectLen,
+                                     uint32_t ulLevel,
+                                     ShadowJsonField_t * pxFields,
+                                     size_t uxNumFields )
+{
+    JSONStatus_t xStatus = JSONSuccess;
+    size_t uxStart = 0;
+    size_t uxNext = 0;
+    JSONPair_t xPair = { 0 };
+
+    if( ulLevel >= SHADOW_JSON_MAX_DEPTH )
+    {
+        xStatus = JSONMaxDepthExceeded;
+    }
+
+    while( xStatus == JSONSuccess )
+    {
+        bool xDescend = false;
+
+        xStatus = JSON_Iterate( pcObject, uxObjectLen, &uxStart, &uxNext, &xPair );
+
+        for( size_t uxIdx = 0; ( xStatus == JSONSuccess ) && ( uxIdx < uxNumFields ); uxIdx++ )
+        {
+            ShadowJsonField_t * pxField = &( pxFields[ uxIdx ] );
+            const char * pcComponent = NULL;
+            size_t uxComponentLen = 0;
+            bool xIsLast = false;
+
+            /* The first occurrence wins, as with JSON_Search */
+            if( ( pxField->pcValue == NULL ) &&
+                ( xPair.key != NULL ) &&
+                ( prvPathComponent( pxField->pcPath, ulLevel, &pcComponent, &uxComponentLen, &xIsLast ) == true ) &&
+                ( uxComponentLen == xPair.keyLength ) &&
+                ( strncmp( pcComponent, xPair.key, uxComponentLen ) == 0 ) )
+            {
+                if( xIsLast == true )
+                {
+                    pxField->pcValue = xPair.value;
+                    pxField->uxValueLen = xPair.valueLength;
+                    pxField->xType = xPair.jsonType;
+
+                    /* Strings are returned without their quotes, as with JSON_Search */
+                    if( ( xPair.jsonType == JSONString ) &&
+                        ( xPair.valueLength >= 2 ) &&
+                        ( xPair.value[ 0 ] == '"' ) )
+                    {
+                        pxField->pcValue++;
+                        pxField->uxValueLen -= 2;
+                    }
+                }
+                else if( xPair.jsonType == JSONObject )
+                {
+                    xDescend = true;
+                }
+                else
+                {
+                    /* The path continues below a value that is not an object */
+                }
+            }
+        }
+
+        if( xDescend == true )
+        {
+            xStatus = prvExtractLevel( xPair.value, xPair.valueLength, ulLevel + 1, pxFields, uxNumFields );
+        }
+    }
+
+    /* Reaching the end of the object is the normal way out */
+    if( xStatus == JSONNotFound )
+    {
+        xStatus = JSONSuccess;
+    }
+
+    return xStatus;
+}
+
+/*-----------------------------------------------------------*/
+
+JSONStatus_t xShadowJsonExtract( const char * pcDocument,
+                                 size_t uxDocumentLen,
+                                 ShadowJsonField_t * pxFields,
+                                 size_t uxNumFields )
+{
+    JSONStatus_t xStatus = JSONSuccess;
+
+    if( ( pcDocument == NULL ) ||
+        ( uxDocumentLen == 0 ) ||
+        ( pxFields == NULL ) )
+    {
+        xStatus = JSONNullParameter;
+    }
+    else
+    {
+        for( size_t uxIdx = 0; uxIdx < uxNumFields; uxIdx++ )
+        {
+            configASSERT( pxFields[ uxIdx ].pcPath != NULL );
+
+            pxFields[ uxIdx ].pcValue = NULL;
+            pxFields[ uxIdx ].uxValueLen = 0;
+        }
+
+        xStatus = prvExtractLevel( pcDocument, uxDocumentLen, 0, pxFields, uxNumFields );
+    }
+
+    return xStatus;
+}
+
+/*-----------------------------------------------------------*/
+
+static void prvAppend( ShadowReportBuilder_t * pxBuilder,
+                       const char * pcFormat,
+                       ... )
+{
+    va_list xArgs;
+    int lLen;
+
+    if( pxBuilder->xOverflow == false )
+    {
+        va_start( xArgs, pcFormat );
+        lLen = vsnprintf( &( pxBuilder->pcBuffer[ pxBuilder->uxLen ] ),
+                          pxBuilder->uxBufferLen - pxBuilder->uxLen,
+                          pcFormat,
+                          xArgs );
+        va_end( xArgs );
+
+        if( ( lLen < 0 ) ||
+            ( ( size_t ) lLen >= ( pxBuilder->uxBufferLen - pxBuilder->uxLen ) ) )
+        {
+            pxBuilder->xOverflow = true;
+        }
+        else
+        {
+            pxBuilder->uxLen += ( size_t ) lLen;
+        }
+    }
+}
+
+/*-----------------------------------------------------------*/
+
+void vShadowReportBegin( ShadowReportBuilder_t * pxBuilder,
+                         char * pcBuffer,
+                         size_t uxBufferLen )
+{
+    configASSERT( pxBuilder != NULL );
+    configASSERT( pcBuffer != NULL );
+    configASSERT( uxBufferLen > 0 );
+
+    pxBuilder->pcBuffer = pcBuffer;
+    pxBuilder->uxBufferLen = uxBufferLen;
+    pxBuilder->uxLen = 0;
+    pxBuilder->ulFields = 0;
+    pxBuilder->xOverflow = false;
+
+    prvAppend( pxBuilder, "{\"state\":{\"reported\":{" );
+}
+
+/*-----------------------------------------------------------*/
+
+void vShadowReportAddUInt( ShadowReportBuilder_t * pxBuilder,
+                           const char * pcKey,
+                           uint32_t ulValue )
+{
+    configASSERT( pxBuilder != NULL );
+    configASSERT( pcKey != NULL );
+
+    prvAppend( pxBuilder, "%s\"%s\":%lu",
+               ( pxBuilder->ulFields > 0 ) ? "," : "",
+               pcKey,
+               ( unsigned long ) ulValue );
+
+    pxBuilder->ulFields++;
+}
+
+/*-----------------------------------------------------------*/
+
+size_t uxShadowReportEnd( ShadowReportBuilder_t * pxBuilder,
+                          uint32_t ulClientToken )
+{
+    size_t uxLen = 0;
+
+    configASSERT( pxBuilder != NULL );
+
+    prvAppend( pxBuilder, "}},\"clientToken\":\"%06lu\"}", ( unsigned long ) ulClientToken );
+
+    if( ( pxBuilder->xOverflow == false ) &&
+        ( pxBuilder->ulFields > 0 ) )
+    {
+        uxLen = pxBuilder->uxLen;
+    }
+
+    return uxLen;
+}
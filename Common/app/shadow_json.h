@@ -0,0 +1,102 @@
+/*
+ * FreeRTOS STM32 Reference Integration
+ * Copyright (C) 2022 Amazon.com, Inc. or its affiliates.  All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ *
+ * https://www.FreeRTOS.org
+ * https://github.com/FreeRTOS
+ *
+ */
+
+/**
+ * @file shadow_json.h
+ * @brief Single pass field extraction from, and incremental building of, shadow documents.
+ */
+#ifndef _SHADOW_JSON_H
+#define _SHADOW_JSON_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "core_json.h"
+
+/* Deepest dotted path that can be extracted, e.g. 3 for "state.reported.powerOn". */
+#ifndef SHADOW_JSON_MAX_DEPTH
+#define SHADOW_JSON_MAX_DEPTH    4
+#endif
+
+typedef struct
+{
+    const char * pcPath;  /* Dotted path of the field, e.g. "state.powerOn" */
+    const char * pcValue; /* Set to the value within the document, NULL if not found */
+    size_t uxValueLen;
+    JSONTypes_t xType;
+} ShadowJsonField_t;
+
+/*
+ * @brief Locate all of pxFields in a JSON document with one scan.
+ *
+ * Each level of the document is walked once and only descended into where
+ * a requested path continues, instead of validating the whole document and
+ * then searching it again from the start for every field.
+ *
+ * @return JSONSuccess if the document could be scanned, in which case every
+ * field was either found or has pcValue set to NULL. JSONIllegalDocument or
+ * JSONMaxDepthExceeded otherwise.
+ */
+JSONStatus_t xShadowJsonExtract( const char * pcDocument,
+                                 size_t uxDocumentLen,
+                                 ShadowJsonField_t * pxFields,
+                                 size_t uxNumFields );
+
+typedef struct
+{
+    char * pcBuffer;
+    size_t uxBufferLen;
+    size_t uxLen;
+    uint32_t ulFields;
+    bool xOverflow;
+} ShadowReportBuilder_t;
+
+/*
+ * @brief Start a document of the form { "state": { "reported": { ... } }, "clientToken": "..." }.
+ */
+void vShadowReportBegin( ShadowReportBuilder_t * pxBuilder,
+                         char * pcBuffer,
+                         size_t uxBufferLen );
+
+/*
+ * @brief Add a reported field. Only fields that changed need to be added.
+ */
+void vShadowReportAddUInt( ShadowReportBuilder_t * pxBuilder,
+                           const char * pcKey,
+                           uint32_t ulValue );
+
+/*
+ * @brief Close the document.
+ *
+ * @return Length of the document without the null terminator, or 0 if no
+ * field was added or the document did not fit into the buffer.
+ */
+size_t uxShadowReportEnd( ShadowReportBuilder_t * pxBuilder,
+                          uint32_t ulClientToken );
+
+#endif /* _SHADOW_JSON_H */
@@ -0,0 +1,445 @@
+/*
+ * FreeRTOS STM32 Reference Integration
+ * Copyright (C) 2022 Amazon.com, Inc. or its affiliates.  All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ *
+ * https://www.FreeRTOS.org
+ * https://github.com/FreeRTOS
+ *
+ */
+
+/**
+ * @file shadow_props.c
+ * @brief Registry of device shadow properties reported by the shadow device task.
+ */
+
+#include "logging_levels.h"
+/* define LOG_LEVEL here if you want to modify the logging level from the default */
+
+#define LOG_LEVEL    LOG_INFO
+#define LOG_MODULE    LOG_MODULE_SHADOW
+
+#include "logging.h"
+
+/* Standard includes. */
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+
+/* Kernel includes. */
+#include "FreeRTOS.h"
+#include "task.h"
+
+#include "shadow_props.h"
+
+#define SHADOW_PROPS_PATH_PREFIX        "state."
+#define SHADOW_PROPS_PATH_PREFIX_LEN    ( sizeof( SHADOW_PROPS_PATH_PREFIX ) - 1 )
+
+typedef struct
+{
+    /* "state.<name>", the path of the property within a delta document */
+    char pcPath[ SHADOW_PROPS_PATH_PREFIX_LEN + SHADOW_PROPS_NAME_LEN + 1 ];
+    uint32_t ulValue;
+    uint32_t ulReported;
+    uint32_t ulInFlight;
+    bool xReported; /* ulReported holds an accepted value */
+    bool xInFlight; /* ulInFlight is part of the update waiting for a response */
+    uint32_t ulShadow;
+    ShadowPropDesiredCallback_t xDesiredCallback;
+    void * pvCtx;
+} ShadowProp_t;
+
+static ShadowProp_t xProps[ SHADOW_PROPS_MAX_PROPS ] = { 0 };
+static volatile uint32_t ulNumProps = 0;
+
+/* Entry 0 is the classic shadow and stays empty */
+static char pcShadowNames[ SHADOW_PROPS_MAX_SHADOWS ][ SHADOW_PROPS_SHADOW_NAME_LEN + 1 ] = { 0 };
+static volatile uint32_t ulNumShadows = 1;
+static TaskHandle_t xListenerTask = NULL;
+
+/*-----------------------------------------------------------*/
+
+static inline const char * prvPropName( const ShadowProp_t * pxProp )
+{
+    return &( pxProp->pcPath[ SHADOW_PROPS_PATH_PREFIX_LEN ] );
+}
+
+/*-----------------------------------------------------------*/
+
+int32_t lShadowPropsFindShadow( const char * pcShadowName,
+                                size_t uxShadowNameLen )
+{
+    int32_t lShadow = -1;
+    uint32_t ulCount = ulNumShadows;
+
+    if( uxShadowNameLen == 0 )
+    {
+        lShadow = SHADOW_PROPS_CLASSIC;
+    }
+
+    for( uint32_t ulIdx = 1; ( lShadow < 0 ) && ( ulIdx < ulCount ); ulIdx++ )
+    {
+        if( ( strnlen( pcShadowNames[ ulIdx ], SHADOW_PROPS_SHADOW_NAME_LEN + 1 ) == uxShadowNameLen ) &&
+            ( strncmp( pcShadowNames[ ulIdx ], pcShadowName, uxShadowNameLen ) == 0 ) )
+        {
+            lShadow = ( int32_t ) ulIdx;
+        }
+    }
+
+    return lShadow;
+}
+
+/*-----------------------------------------------------------*/
+
+uint32_t ulShadowPropsNumShadows( void )
+{
+    return ulNumShadows;
+}
+
+/*-----------------------------------------------------------*/
+
+const char * pcShadowPropsShadowName( uint32_t ulShadow )
+{
+    configASSERT( ulShadow < ulNumShadows );
+
+    return pcShadowNames[ ulShadow ];
+}
+
+/*-----------------------------------------------------------*/
+
+ShadowPropId_t xShadowPropRegister( const char * pcShadowName,
+                                    const char * pcName,
+                                    uint32_t ulInitial,
+                                    ShadowPropDesiredCallback_t xDesiredCallback,
+                                    void * pvCtx )
+{
+    ShadowPropId_t xId = SHADOW_PROP_INVALID;
+    size_t uxNameLen = 0;
+    size_t uxShadowNameLen = 0;
+    int32_t lShadow = -1;
+
+    configASSERT( pcName != NULL );
+
+    uxNameLen = strnlen( pcName, SHADOW_PROPS_NAME_LEN + 1 );
+
+    if( pcShadowName != NULL )
+    {
+        uxShadowNameLen = strnlen( pcShadowName, SHADOW_PROPS_SHADOW_NAME_LEN + 1 );
+    }
+
+    if( ( uxNameLen == 0 ) || ( uxNameLen > SHADOW_PROPS_NAME_LEN ) )
+    {
+        LogError( "Invalid shadow property name length: %lu.", ( unsigned long ) uxNameLen );
+    }
+    else if( uxShadowNameLen > SHADOW_PROPS_SHADOW_NAME_LEN )
+    {
+        LogError( "Invalid shadow name length: %lu.", ( unsigned long ) uxShadowNameLen );
+    }
+    else
+    {
+        vTaskSuspendAll();
+
+        lShadow = lShadowPropsFindShadow( pcShadowName, uxShadowNameLen );
+
+        if( ( lShadow < 0 ) &&
+            ( ulNumShadows < SHADOW_PROPS_MAX_SHADOWS ) )
+        {
+            ( void ) memcpy( pcShadowNames[ ulNumShadows ], pcShadowName, uxShadowNameLen );
+            pcShadowNames[ ulNumShadows ][ uxShadowNameLen ] = '\0';
+
+            lShadow = ( int32_t ) ulNumShadows;
+            ulNumShadows++;
+        }
+
+        if( ( lShadow >= 0 ) &&
+            ( ulNumProps < SHADOW_PROPS_MAX_PROPS ) )
+        {
+            ShadowProp_t * pxProp = &( xProps[ ulNumProps ] );
+
+            ( void ) memcpy( pxProp->pcPath, SHADOW_PROPS_PATH_PREFIX, SHADOW_PROPS_PATH_PREFIX_LEN );
+            ( void ) memcpy( &( pxProp->pcPath[ SHADOW_PROPS_PATH_PREFIX_LEN ] ), pcName, uxNameLen );
+            pxProp->pcPath[ SHADOW_PROPS_PATH_PREFIX_LEN + uxNameLen ] = '\0';
+
+            pxProp->ulValue = ulInitial;
+            pxProp->xReported = false;
+            pxProp->xInFlight = false;
+            pxProp->xDesiredCallback = xDesiredCallback;
+            pxProp->pvCtx = pvCtx;
+            pxProp->ulShadow = ( uint32_t ) lShadow;
+
+            xId = ( ShadowPropId_t ) ulNumProps;
+
+            /* Publish the entry only once it is complete */
+            ulNumProps++;
+        }
+
+        ( void ) xTaskResumeAll();
+
+        if( xId == SHADOW_PROP_INVALID )
+        {
+            LogError( "No room to register shadow property %s.", pcName );
+        }
+        else if( xListenerTask != NULL )
+        {
+            /* The new property has not been reported yet */
+            ( void ) xTaskNotifyGiveIndexed( xListenerTask, SHADOW_PROPS_NOTIFY_INDEX );
+        }
+    }
+
+    return xId;
+}
+
+/*-----------------------------------------------------------*/
+
+void vShadowPropSet( ShadowPropId_t xId,
+                     uint32_t ulValue )
+{
+    bool xChanged = false;
+
+    configASSERT( ( xId >= 0 ) && ( ( uint32_t ) xId < ulNumProps ) );
+
+    taskENTER_CRITICAL();
+    {
+        xChanged = ( xProps[ xId ].ulValue != ulValue );
+        xProps[ xId ].ulValue = ulValue;
+    }
+    taskEXIT_CRITICAL();
+
+    if( ( xChanged == true ) &&
+        ( xListenerTask != NULL ) )
+    {
+        ( void ) xTaskNotifyGiveIndexed( xListenerTask, SHADOW_PROPS_NOTIFY_INDEX );
+    }
+}
+
+/*-----------------------------------------------------------*/
+
+uint32_t ulShadowPropGet( ShadowPropId_t xId )
+{
+    configASSERT( ( xId >= 0 ) && ( ( uint32_t ) xId < ulNumProps ) );
+
+    /* An aligned 32 bit read is atomic */
+    return xProps[ xId ].ulValue;
+}
+
+/*-----------------------------------------------------------*/
+
+void vShadowPropsSetListener( TaskHandle_t xTask )
+{
+    xListenerTask = xTask;
+}
+
+/*-----------------------------------------------------------*/
+
+uint32_t ulShadowPropsCollect( uint32_t ulShadow,
+                               ShadowReportBuilder_t * pxBuilder )
+{
+    uint32_t ulAdded = 0;
+    uint32_t ulCount = ulNumProps;
+
+    configASSERT( pxBuilder != NULL );
+
+    for( uint32_t ulIdx = 0; ulIdx < ulCount; ulIdx++ )
+    {
+        ShadowProp_t * pxProp = &( xProps[ ulIdx ] );
+        bool xPending = false;
+
+        if( pxProp->ulShadow != ulShadow )
+        {
+            continue;
+        }
+
+        taskENTER_CRITICAL();
+        {
+            pxProp->ulInFlight = pxProp->ulValue;
+            xPending = ( pxProp->xReported == false ) ||
+                       ( pxProp->ulReported != pxProp->ulInFlight );
+            pxProp->xInFlight = xPending;
+        }
+        taskEXIT_CRITICAL();
+
+        if( xPending == true )
+        {
+            vShadowReportAddUInt( pxBuilder, prvPropName( pxProp ), pxProp->ulInFlight );
+            ulAdded++;
+        }
+    }
+
+    return ulAdded;
+}
+
+/*-----------------------------------------------------------*/
+
+void vShadowPropsReportAccepted( uint32_t ulShadow )
+{
+    uint32_t ulCount = ulNumProps;
+
+    taskENTER_CRITICAL();
+    {
+        for( uint32_t ulIdx = 0; ulIdx < ulCount; ulIdx++ )
+        {
+            if( ( xProps[ ulIdx ].ulShadow == ulShadow ) &&
+                ( xProps[ ulIdx ].xInFlight == true ) )
+            {
+                xProps[ ulIdx ].ulReported = xProps[ ulIdx ].ulInFlight;
+                xProps[ ulIdx ].xReported = true;
+                xProps[ ulIdx ].xInFlight = false;
+            }
+        }
+    }
+    taskEXIT_CRITICAL();
+}
+
+/*-----------------------------------------------------------*/
+
+void vShadowPropsReportDone( void )
+{
+    uint32_t ulCount = ulNumProps;
+
+    taskENTER_CRITICAL();
+    {
+        for( uint32_t ulIdx = 0; ulIdx < ulCount; ulIdx++ )
+        {
+            xProps[ ulIdx ].xInFlight = false;
+        }
+    }
+    taskEXIT_CRITICAL();
+}
+
+/*-----------------------------------------------------------*/
+
+uint32_t ulShadowPropsUnreported( void )
+{
+    uint32_t ulCount = ulNumProps;
+    uint32_t ulUnreported = 0;
+
+    taskENTER_CRITICAL();
+    {
+        for( uint32_t ulIdx = 0; ulIdx < ulCount; ulIdx++ )
+        {
+            if( ( xProps[ ulIdx ].xReported == false ) ||
+                ( xProps[ ulIdx ].ulReported != xProps[ ulIdx ].ulValue ) )
+            {
+                ulUnreported++;
+            }
+        }
+    }
+    taskEXIT_CRITICAL();
+
+    return ulUnreported;
+}
+
+/*-----------------------------------------------------------*/
+
+JSONStatus_t xShadowPropsHandleDelta( uint32_t ulShadow,
+                                      const char * pcDocument,
+                                      size_t uxDocumentLen,
+                                      uint32_t * pulVersion )
+{
+    JSONStatus_t xStatus = JSONSuccess;
+    uint32_t ulCount = ulNumProps;
+    uint32_t ulFields = 1;
+    uint32_t ulVersion = 0;
+
+    /* Field 0 is the document version, followed by one field per property of the shadow */
+    ShadowJsonField_t xFields[ SHADOW_PROPS_MAX_PROPS + 1 ] = { 0 };
+    uint8_t ucPropIdx[ SHADOW_PROPS_MAX_PROPS + 1 ] = { 0 };
+
+    configASSERT( pulVersion != NULL );
+
+    xFields[ 0 ].pcPath = "version";
+
+    for( uint32_t ulIdx = 0; ulIdx < ulCount; ulIdx++ )
+    {
+        if( xProps[ ulIdx ].ulShadow == ulShadow )
+        {
+            xFields[ ulFields ].pcPath = xProps[ ulIdx ].pcPath;
+            ucPropIdx[ ulFields ] = ( uint8_t ) ulIdx;
+            ulFields++;
+        }
+    }
+
+    xStatus = xShadowJsonExtract( pcDocument, uxDocumentLen, xFields, ulFields );
+
+    if( xStatus != JSONSuccess )
+    {
+        LogError( "Invalid JSON document received!" );
+    }
+    else if( xFields[ 0 ].pcValue == NULL )
+    {
+        LogError( "Version field not found in JSON document!" );
+        xStatus = JSONNotFound;
+    }
+    else
+    {
+        ulVersion = ( uint32_t ) strtoul( xFields[ 0 ].pcValue, NULL, 10 );
+
+        if( ulVersion <= *pulVersion )
+        {
+            LogWarn( "Dropping stale delta with version %lu. Current version is %lu.",
+                     ( unsigned long ) ulVersion,
+                     ( unsigned long ) *pulVersion );
+        }
+        else
+        {
+            LogInfo( "Received delta update with version %lu.", ( unsigned long ) ulVersion );
+
+            *pulVersion = ulVersion;
+
+            for( uint32_t ulIdx = 1; ulIdx < ulFields; ulIdx++ )
+            {
+                const ShadowJsonField_t * pxField = &( xFields[ ulIdx ] );
+                const ShadowProp_t * pxProp = &( xProps[ ucPropIdx[ ulIdx ] ] );
+                uint32_t ulDesired = 0;
+
+                if( pxField->pcValue == NULL )
+                {
+                    /* Not part of this delta */
+                }
+                else if( ( pxField->xType != JSONNumber ) &&
+                         ( pxField->xType != JSONTrue ) &&
+                         ( pxField->xType != JSONFalse ) )
+                {
+                    LogWarn( "Ignoring desired value of %s with unsupported type.", prvPropName( pxProp ) );
+                }
+                else
+                {
+                    if( pxField->xType == JSONNumber )
+                    {
+                        ulDesired = ( uint32_t ) strtoul( pxField->pcValue, NULL, 10 );
+                    }
+                    else
+                    {
+                        ulDesired = ( pxField->xType == JSONTrue ) ? 1 : 0;
+                    }
+
+                    LogInfo( "Desired %s is %lu.", prvPropName( pxProp ), ( unsigned long ) ulDesired );
+
+                    if( pxProp->xDesiredCallback != NULL )
+                    {
+                        pxProp->xDesiredCallback( ( ShadowPropId_t ) ucPropIdx[ ulIdx ], ulDesired, pxProp->pvCtx );
+                    }
+                }
+            }
+        }
+    }
+
+    return xStatus;
+}
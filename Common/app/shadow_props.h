@@ -0,0 +1,184 @@
+/*
+ * FreeRTOS STM32 Reference Integration
+ * Copyright (C) 2022 Amazon.com, Inc. or its affiliates.  All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ *
+ * https://www.FreeRTOS.org
+ * https://github.com/FreeRTOS
+ *
+ */
+
+/**
+ * @file shadow_props.h
+ * @brief Registry of device shadow properties reported by the shadow device task.
+ *
+ * Application code registers a named property and sets its value whenever it
+ * changes. The shadow device task coalesces changes made within
+ * SHADOW_PROPS_COALESCE_MS into a single /update publish that only carries the
+ * properties whose value differs from the last accepted report.
+ *
+ * Properties belong either to the classic shadow or to a named shadow. Each
+ * shadow is reported with its own /update publish.
+ */
+#ifndef _SHADOW_PROPS_H
+#define _SHADOW_PROPS_H
+
+#include "FreeRTOS.h"
+#include "task.h"
+
+#include "shadow_json.h"
+
+/* Number of properties that can be registered. */
+#ifndef SHADOW_PROPS_MAX_PROPS
+#define SHADOW_PROPS_MAX_PROPS       8
+#endif
+
+/* Longest property name, excluding the null terminator. */
+#ifndef SHADOW_PROPS_NAME_LEN
+#define SHADOW_PROPS_NAME_LEN        31
+#endif
+
+/* Number of shadows properties can belong to, including the classic shadow. */
+#ifndef SHADOW_PROPS_MAX_SHADOWS
+#define SHADOW_PROPS_MAX_SHADOWS     4
+#endif
+
+/* Longest named shadow name, excluding the null terminator. */
+#ifndef SHADOW_PROPS_SHADOW_NAME_LEN
+#define SHADOW_PROPS_SHADOW_NAME_LEN    32
+#endif
+
+/* Index of the classic, unnamed, shadow. */
+#define SHADOW_PROPS_CLASSIC         0
+
+/* Time to wait after the first change for further changes to join the same report. */
+#ifndef SHADOW_PROPS_COALESCE_MS
+#define SHADOW_PROPS_COALESCE_MS     500
+#endif
+
+/* Notification index the shadow device task is woken on when a property changes. */
+#ifndef SHADOW_PROPS_NOTIFY_INDEX
+#define SHADOW_PROPS_NOTIFY_INDEX    1
+#endif
+
+typedef int32_t ShadowPropId_t;
+
+#define SHADOW_PROP_INVALID    ( ( ShadowPropId_t ) -1 )
+
+/*
+ * @brief Called from the MQTT agent task when a delta requests a new value.
+ *
+ * The callback should act on ulDesired and call vShadowPropSet once the device
+ * has reached the new state so that it gets reported.
+ */
+typedef void ( * ShadowPropDesiredCallback_t )( ShadowPropId_t xId,
+                                                uint32_t ulDesired,
+                                                void * pvCtx );
+
+/*
+ * @brief Register a property reported in state.reported.<pcName>.
+ *
+ * @param[in] pcShadowName Name of the named shadow the property belongs to,
+ * or NULL for the classic shadow.
+ *
+ * @return Id of the property, or SHADOW_PROP_INVALID if the registry is full
+ * or a name is too long.
+ */
+ShadowPropId_t xShadowPropRegister( const char * pcShadowName,
+                                    const char * pcName,
+                                    uint32_t ulInitial,
+                                    ShadowPropDesiredCallback_t xDesiredCallback,
+                                    void * pvCtx );
+
+/*
+ * @brief Set the current value of a property and schedule a report if it changed.
+ */
+void vShadowPropSet( ShadowPropId_t xId,
+                     uint32_t ulValue );
+
+uint32_t ulShadowPropGet( ShadowPropId_t xId );
+
+/*
+ * The functions below are used by the shadow device task.
+ */
+
+/*
+ * @brief Set the task woken on SHADOW_PROPS_NOTIFY_INDEX when a property changes.
+ */
+void vShadowPropsSetListener( TaskHandle_t xTask );
+
+/*
+ * @brief Number of shadows that have properties, including the classic shadow.
+ */
+uint32_t ulShadowPropsNumShadows( void );
+
+/*
+ * @brief Name of shadow ulShadow, an empty string for SHADOW_PROPS_CLASSIC.
+ */
+const char * pcShadowPropsShadowName( uint32_t ulShadow );
+
+/*
+ * @brief Find a shadow by name. A zero length name is the classic shadow.
+ *
+ * @return Index of the shadow, or -1 if no property belongs to it.
+ */
+int32_t lShadowPropsFindShadow( const char * pcShadowName,
+                                size_t uxShadowNameLen );
+
+/*
+ * @brief Add every property of shadow ulShadow not yet reported with its current value to pxBuilder
+ * and mark those values as in flight.
+ *
+ * @return Number of properties added.
+ */
+uint32_t ulShadowPropsCollect( uint32_t ulShadow,
+                               ShadowReportBuilder_t * pxBuilder );
+
+/*
+ * @brief Mark the values in flight as reported. Called when the update is accepted.
+ */
+void vShadowPropsReportAccepted( uint32_t ulShadow );
+
+/*
+ * @brief Finish the update in flight. Values that were not accepted are
+ * collected again by the next report.
+ */
+void vShadowPropsReportDone( void );
+
+/*
+ * @brief Number of properties whose current value has not been accepted yet.
+ */
+uint32_t ulShadowPropsUnreported( void );
+
+/*
+ * @brief Apply the desired values of a /update/delta document of shadow ulShadow.
+ *
+ * A delta whose version is not newer than *pulVersion is stale, e.g. because a
+ * later update was already accepted, and is dropped. Otherwise *pulVersion is
+ * advanced and the desired callback of every property in the delta is called.
+ *
+ * @return JSONSuccess if the document could be parsed.
+ */
+JSONStatus_t xShadowPropsHandleDelta( uint32_t ulShadow,
+                                      const char * pcDocument,
+                                      size_t uxDocumentLen,
+                                      uint32_t * pulVersion );
+
+#endif /* _SHADOW_PROPS_H */
@@ -0,0 +1,503 @@
+/*
+ * FreeRTOS STM32 Reference Integration
+ *
+ * Copyright (c) 2022 Amazon.com, Inc. or its affiliates. All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+/**
+ * @file soak_test.c
+ * @brief Long running soak test tracking the fragmentation of the heap.
+ */
+
+#include "logging_levels.h"
+#define LOG_LEVEL     LOG_INFO
+#define LOG_MODULE    LOG_MODULE_APP
+#include "logging.h"
+
+/* Standard includes. */
+#include <string.h>
+#include <stdint.h>
+#include <stdio.h>
+
+/* FreeRTOS includes. */
+#include "FreeRTOS.h"
+#include "task.h"
+#include "event_groups.h"
+
+#include "kvstore.h"
+#include "sys_evt.h"
+#include "heap_classes.h"
+#include "mqtt_agent_task.h"
+#include "mqtt_publish_async.h"
+#include "shadow_props.h"
+
+#include "soak_test.h"
+
+#define SOAK_NOTIFY_IDX              2
+#define SOAK_TASK_STACK_WORDS        768
+#define SOAK_TASK_PRIO               ( tskIDLE_PRIORITY + 2 )
+#define SOAK_TOPIC_LEN               96
+#define SOAK_SAMPLE_JSON_LEN         256
+
+/* Time for the agent to notice a requested disconnect, then to connect again */
+#define SOAK_DISCONNECT_TIMEOUT_MS   ( 10 * 1000 )
+#define SOAK_RECONNECT_TIMEOUT_MS    ( 120 * 1000 )
+#define SOAK_POLL_MS                 50
+
+/* Publishes per cycle, with lengths spread over SOAK_PUBLISH_MIN_LEN to SOAK_PUBLISH_MAX_LEN */
+#define SOAK_PUBLISH_COUNT           8
+#define SOAK_PUBLISH_MIN_LEN         16
+#define SOAK_PUBLISH_MAX_LEN         384
+#define SOAK_PUBLISH_BLOCK_MS        1000
+
+#define SOAK_SHADOW_PROP_NAME        "soakCycle"
+
+extern void vSuspendOTAUpdate( void );
+extern void vResumeOTAUpdate( void );
+
+static TaskHandle_t xSoakTask = NULL;
+static volatile BaseType_t xSoakStopRequested = pdFALSE;
+static SoakStatus_t xSoakStatus = { 0 };
+static SoakSample_t xSoakHistory[ SOAK_HISTORY_LEN ];
+static uint32_t ulSoakHistoryNext = 0;
+static ShadowPropId_t xSoakShadowProp = SHADOW_PROP_INVALID;
+
+static char cSoakDataTopic[ SOAK_TOPIC_LEN ];
+static char cSoakHeapTopic[ SOAK_TOPIC_LEN ];
+static char cSoakPayload[ SOAK_PUBLISH_MAX_LEN ];
+
+static const char * const pcSoakOpNames[ SOAK_OP_COUNT ] =
+{
+    "reconnect",
+    "publish",
+    "ota",
+    "shadow"
+};
+
+/*-----------------------------------------------------------*/
+
+const char * pcSoakOpName( uint32_t ulIndex )
+{
+    return ( ulIndex < SOAK_OP_COUNT ) ? pcSoakOpNames[ ulIndex ] : "invalid";
+}
+
+/*-----------------------------------------------------------*/
+
+static BaseType_t prvWaitForMqtt( BaseType_t xConnected,
+                                  uint32_t ulTimeoutMs )
+{
+    TickType_t xStart = xTaskGetTickCount();
+    BaseType_t xReached = pdFALSE;
+
+    do
+    {
+        EventBits_t xEvents = xEventGroupGetBits( xSystemEvents );
+
+        xReached = ( ( ( xEvents & EVT_MASK_MQTT_CONNECTED ) != 0 ) == ( xConnected == pdTRUE ) );
+
+        if( xReached == pdFALSE )
+        {
+            vTaskDelay( pdMS_TO_TICKS( SOAK_POLL_MS ) );
+        }
+    }
+    while( ( xReached == pdFALSE ) &&
+           ( xSoakStopRequested == pdFALSE ) &&
+           ( ( xTaskGetTickCount() - xStart ) < pdMS_TO_TICKS( ulTimeoutMs ) ) );
+
+    return xReached;
+}
+
+/*-----------------------------------------------------------*/
+
+/* Drop the broker connection and wait until the agent has a new one */
+static BaseType_t prvOpReconnect( void )
+{
+    BaseType_t xSuccess = pdFALSE;
+
+    if( xIsMqttAgentConnected() == true )
+    {
+        vMqttAgentRequestReconnect();
+
+        if( prvWaitForMqtt( pdFALSE, SOAK_DISCONNECT_TIMEOUT_MS ) == pdTRUE )
+        {
+            xSuccess = prvWaitForMqtt( pdTRUE, SOAK_RECONNECT_TIMEOUT_MS );
+        }
+    }
+    else
+    {
+        /* Still recovering from an earlier failure */
+        xSuccess = prvWaitForMqtt( pdTRUE, SOAK_RECONNECT_TIMEOUT_MS );
+    }
+
+    return xSuccess;
+}
+
+/*-----------------------------------------------------------*/
+
+static BaseType_t prvOpPublish( uint32_t ulCycle )
+{
+    BaseType_t xSuccess = pdTRUE;
+    size_t uxTopicLen = strlen( cSoakDataTopic );
+
+    for( uint32_t i = 0; ( i < SOAK_PUBLISH_COUNT ) && ( xSoakStopRequested == pdFALSE ); i++ )
+    {
+        /* Vary the lengths from cycle to cycle so that blocks of different sizes are interleaved */
+        size_t uxLen = SOAK_PUBLISH_MIN_LEN +
+                       ( ( ( ulCycle * 7U ) + ( i * 53U ) ) % ( SOAK_PUBLISH_MAX_LEN - SOAK_PUBLISH_MIN_LEN + 1U ) );
+
+        if( ( uxLen + uxTopicLen ) > MQTT_PUBLISH_POOL_BUFFER_LEN )
+        {
+            uxLen = MQTT_PUBLISH_POOL_BUFFER_LEN - uxTopicLen;
+        }
+
+        if( MqttAgent_PublishQoS0( xGetMqttAgentHandle(), cSoakDataTopic,
+                                   cSoakPayload, uxLen, SOAK_PUBLISH_BLOCK_MS ) != MQTTSuccess )
+        {
+            xSuccess = pdFALSE;
+        }
+    }
+
+    return xSuccess;
+}
+
+/*-----------------------------------------------------------*/
+
+static BaseType_t prvOpOta( void )
+{
+    vSuspendOTAUpdate();
+    vResumeOTAUpdate();
+
+    return pdTRUE;
+}
+
+/*-----------------------------------------------------------*/
+
+static BaseType_t prvOpShadow( uint32_t ulCycle )
+{
+    BaseType_t xSuccess = pdFALSE;
+
+    if( xSoakShadowProp == SHADOW_PROP_INVALID )
+    {
+        xSoakShadowProp = xShadowPropRegister( NULL, SOAK_SHADOW_PROP_NAME, ulCycle, NULL, NULL );
+    }
+
+    if( xSoakShadowProp != SHADOW_PROP_INVALID )
+    {
+        /* Reported by the shadow device task with the next coalesced update */
+        vShadowPropSet( xSoakShadowProp, ulCycle );
+        xSuccess = pdTRUE;
+    }
+
+    return xSuccess;
+}
+
+/*-----------------------------------------------------------*/
+
+static void prvPublishSample( const SoakSample_t * pxSample )
+{
+    char cJson[ SOAK_SAMPLE_JSON_LEN ];
+    int lLen = snprintf( cJson, sizeof( cJson ),
+                         "{\"uptime\":%lu,\"cycle\":%lu,\"free\":%lu,\"largest\":%lu,\"blocks\":%lu,"
+                         "\"min_free\":%lu,\"alloc_failures\":%lu,\"frag_index\":%lu}",
+                         ( unsigned long ) pxSample->ulUptimeS,
+                         ( unsigned long ) pxSample->ulCycle,
+                         ( unsigned long ) pxSample->ulFreeBytes,
+                         ( unsigned long ) pxSample->ulLargestFreeBlock,
+                         ( unsigned long ) pxSample->ulFreeBlocks,
+                         ( unsigned long ) pxSample->ulMinEverFreeBytes,
+                         ( unsigned long ) pxSample->ulAllocFailures,
+                         ( unsigned long ) pxSample->ulFragPermille );
+
+    if( ( lLen > 0 ) &&
+        ( lLen < ( int ) sizeof( cJson ) ) &&
+        ( xIsMqttAgentConnected() == true ) )
+    {
+        if( MqttAgent_PublishQoS0( xGetMqttAgentHandle(), cSoakHeapTopic,
+                                   cJson, ( size_t ) lLen, SOAK_PUBLISH_BLOCK_MS ) != MQTTSuccess )
+        {
+            LogWarn( "Failed to publish the soak sample." );
+        }
+    }
+}
+
+/*-----------------------------------------------------------*/
+
+static void prvTakeSample( void )
+{
+    HeapFragStats_t xFragStats;
+    SoakSample_t xSample;
+
+    vHeapGetFragStats( &xFragStats );
+
+    xSample.ulUptimeS = xTaskGetTickCount() / configTICK_RATE_HZ;
+    xSample.ulCycle = xSoakStatus.ulCycles;
+    xSample.ulFreeBytes = ( uint32_t ) xFragStats.uxFreeBytes;
+    xSample.ulLargestFreeBlock = ( uint32_t ) xFragStats.uxLargestFreeBlock;
+    xSample.ulFreeBlocks = ( uint32_t ) xFragStats.uxFreeBlocks;
+    xSample.ulMinEverFreeBytes = ( uint32_t ) xFragStats.uxMinEverFreeBytes;
+    xSample.ulAllocFailures = xFragStats.ulAllocFailures;
+    xSample.ulFragPermille = xFragStats.ulFragPermille;
+
+    taskENTER_CRITICAL();
+    {
+        if( xSoakStatus.ulSamples == 0 )
+        {
+            xSoakStatus.xFirst = xSample;
+            xSoakStatus.ulMaxFragPermille = xSample.ulFragPermille;
+            xSoakStatus.ulMinLargestFreeBlock = xSample.ulLargestFreeBlock;
+        }
+
+        if( xSample.ulFragPermille > xSoakStatus.ulMaxFragPermille )
+        {
+            xSoakStatus.ulMaxFragPermille = xSample.ulFragPermille;
+        }
+
+        if( xSample.ulLargestFreeBlock < xSoakStatus.ulMinLargestFreeBlock )
+        {
+            xSoakStatus.ulMinLargestFreeBlock = xSample.ulLargestFreeBlock;
+        }
+
+        xSoakStatus.xLast = xSample;
+        xSoakStatus.ulSamples++;
+
+        xSoakHistory[ ulSoakHistoryNext ] = xSample;
+        ulSoakHistoryNext = ( ulSoakHistoryNext + 1U ) % SOAK_HISTORY_LEN;
+    }
+    taskEXIT_CRITICAL();
+
+    LogInfo( "Soak cycle %lu: free %lu, largest %lu, blocks %lu, min free %lu, alloc failures %lu, fragmentation %lu.%lu %%",
+             xSample.ulCycle, xSample.ulFreeBytes, xSample.ulLargestFreeBlock, xSample.ulFreeBlocks,
+             xSample.ulMinEverFreeBytes, xSample.ulAllocFailures,
+             xSample.ulFragPermille / 10U, xSample.ulFragPermille % 10U );
+
+    prvPublishSample( &xSample );
+}
+
+/*-----------------------------------------------------------*/
+
+static void prvSoakTask( void * pvParameters )
+{
+    const SoakParams_t * pxParams = &( xSoakStatus.xParams );
+    TickType_t xLastSample = xTaskGetTickCount();
+
+    ( void ) pvParameters;
+
+    ( void ) memset( cSoakPayload, 's', sizeof( cSoakPayload ) );
+
+    LogInfo( "Soak test started, ops 0x%lx, cycle %lu ms, sample %lu ms.",
+             pxParams->ulOps, pxParams->ulCycleMs, pxParams->ulSampleMs );
+
+    prvTakeSample();
+
+    while( xSoakStopRequested == pdFALSE )
+    {
+        uint32_t ulCycle = xSoakStatus.ulCycles;
+
+        for( uint32_t i = 0; ( i < SOAK_OP_COUNT ) && ( xSoakStopRequested == pdFALSE ); i++ )
+        {
+            BaseType_t xSuccess = pdTRUE;
+
+            if( ( pxParams->ulOps & ( 1UL << i ) ) == 0 )
+            {
+                continue;
+            }
+
+            switch( 1UL << i )
+            {
+                case SOAK_OP_RECONNECT:
+                    xSuccess = prvOpReconnect();
+                    break;
+
+                case SOAK_OP_PUBLISH:
+                    xSuccess = prvOpPublish( ulCycle );
+                    break;
+
+                case SOAK_OP_OTA:
+                    xSuccess = prvOpOta();
+                    break;
+
+                case SOAK_OP_SHADOW:
+                default:
+                    xSuccess = prvOpShadow( ulCycle );
+                    break;
+            }
+
+            taskENTER_CRITICAL();
+            {
+                xSoakStatus.ulOpRuns[ i ]++;
+
+                if( xSuccess == pdFALSE )
+                {
+                    xSoakStatus.ulOpFailures[ i ]++;
+                }
+            }
+            taskEXIT_CRITICAL();
+
+            if( xSuccess == pdFALSE )
+            {
+                LogWarn( "Soak cycle %lu: %s failed.", ulCycle, pcSoakOpName( i ) );
+            }
+        }
+
+        taskENTER_CRITICAL();
+        xSoakStatus.ulCycles++;
+        taskEXIT_CRITICAL();
+
+        if( ( xTaskGetTickCount() - xLastSample ) >= pdMS_TO_TICKS( pxParams->ulSampleMs ) )
+        {
+            xLastSample = xTaskGetTickCount();
+            prvTakeSample();
+        }
+
+        /* Woken early by vSoakStop */
+        ( void ) ulTaskNotifyTakeIndexed( SOAK_NOTIFY_IDX, pdTRUE, pdMS_TO_TICKS( pxParams->ulCycleMs ) );
+    }
+
+    prvTakeSample();
+
+    LogInfo( "Soak test stopped after %lu cycles.", xSoakStatus.ulCycles );
+
+    taskENTER_CRITICAL();
+    {
+        xSoakStatus.xRunning = pdFALSE;
+        xSoakTask = NULL;
+    }
+    taskEXIT_CRITICAL();
+
+    vTaskDelete( NULL );
+}
+
+/*-----------------------------------------------------------*/
+
+static BaseType_t prvBuildTopics( void )
+{
+    BaseType_t xSuccess = pdFALSE;
+    char cThingName[ SOAK_TOPIC_LEN ];
+
+    if( KVStore_getString( CS_CORE_THING_NAME, cThingName, sizeof( cThingName ) ) == 0 )
+    {
+        LogError( "The thing name is not set." );
+    }
+    else
+    {
+        int lDataLen = snprintf( cSoakDataTopic, sizeof( cSoakDataTopic ), "%s/soak/data", cThingName );
+        int lHeapLen = snprintf( cSoakHeapTopic, sizeof( cSoakHeapTopic ), "%s/soak/heap", cThingName );
+
+        if( ( lDataLen > 0 ) && ( lDataLen < ( int ) sizeof( cSoakDataTopic ) ) &&
+            ( lHeapLen > 0 ) && ( lHeapLen < ( int ) sizeof( cSoakHeapTopic ) ) )
+        {
+            xSuccess = pdTRUE;
+        }
+        else
+        {
+            LogError( "The thing name is too long for the soak topics." );
+        }
+    }
+
+    return xSuccess;
+}
+
+/*-----------------------------------------------------------*/
+
+BaseType_t xSoakStart( const SoakParams_t * pxParams )
+{
+    BaseType_t xStarted = pdFALSE;
+
+    configASSERT( pxParams != NULL );
+
+    if( xSoakTask != NULL )
+    {
+        LogError( "A soak test is already running." );
+    }
+    else if( prvBuildTopics() == pdTRUE )
+    {
+        ( void ) memset( &xSoakStatus, 0, sizeof( xSoakStatus ) );
+        ( void ) memset( xSoakHistory, 0, sizeof( xSoakHistory ) );
+        ulSoakHistoryNext = 0;
+
+        xSoakStatus.xParams = *pxParams;
+        xSoakStatus.xRunning = pdTRUE;
+        xSoakStopRequested = pdFALSE;
+
+        if( xTaskCreate( prvSoakTask, "Soak", SOAK_TASK_STACK_WORDS, NULL, SOAK_TASK_PRIO, &xSoakTask ) == pdPASS )
+        {
+            xStarted = pdTRUE;
+        }
+        else
+        {
+            LogError( "Failed to create the soak test task." );
+            xSoakStatus.xRunning = pdFALSE;
+            xSoakTask = NULL;
+        }
+    }
+
+    return xStarted;
+}
+
+/*-----------------------------------------------------------*/
+
+void vSoakStop( void )
+{
+    taskENTER_CRITICAL();
+    {
+        if( xSoakTask != NULL )
+        {
+            xSoakStopRequested = pdTRUE;
+            ( void ) xTaskNotifyGiveIndexed( xSoakTask, SOAK_NOTIFY_IDX );
+        }
+    }
+    taskEXIT_CRITICAL();
+}
+
+/*-----------------------------------------------------------*/
+
+void vSoakGetStatus( SoakStatus_t * pxStatus )
+{
+    configASSERT( pxStatus != NULL );
+
+    taskENTER_CRITICAL();
+    *pxStatus = xSoakStatus;
+    taskEXIT_CRITICAL();
+}
+
+/*-----------------------------------------------------------*/
+
+uint32_t ulSoakGetHistory( SoakSample_t * pxSamples,
+                           uint32_t ulMaxSamples )
+{
+    uint32_t ulCount = 0;
+
+    configASSERT( pxSamples != NULL );
+
+    taskENTER_CRITICAL();
+    {
+        uint32_t ulAvailable = ( xSoakStatus.ulSamples < SOAK_HISTORY_LEN ) ? xSoakStatus.ulSamples : SOAK_HISTORY_LEN;
+
+        ulCount = ( ulAvailable < ulMaxSamples ) ? ulAvailable : ulMaxSamples;
+
+        for( uint32_t i = 0; i < ulCount; i++ )
+        {
+            pxSamples[ i ] = xSoakHistory[ ( ulSoakHistoryNext + SOAK_HISTORY_LEN - ulCount + i ) % SOAK_HISTORY_LEN ];
+        }
+    }
+    taskEXIT_CRITICAL();
+
+    return ulCount;
+}
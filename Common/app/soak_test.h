@@ -0,0 +1,123 @@
+/*
+ * FreeRTOS STM32 Reference Integration
+ *
+ * Copyright (c) 2022 Amazon.com, Inc. or its affiliates. All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+/**
+ * @file soak_test.h
+ * @brief Long running soak test tracking the fragmentation of the heap.
+ *
+ * Each cycle runs the enabled operations, which allocate and free the same kind
+ * of memory as days of uptime do: an MQTT reconnect with a new TLS session,
+ * publishes of varying sizes, an OTA suspend and resume, which aborts any job in
+ * progress and requests the job document again, and a shadow update.
+ * Every sample period the state of the heap is logged, kept in a history and
+ * published to <thing name>/soak/heap.
+ */
+
+#ifndef SOAK_TEST_H_
+#define SOAK_TEST_H_
+
+#include <stdint.h>
+
+#include "FreeRTOS.h"
+
+#define SOAK_OP_RECONNECT        ( 1UL << 0 )
+#define SOAK_OP_PUBLISH          ( 1UL << 1 )
+#define SOAK_OP_OTA              ( 1UL << 2 )
+#define SOAK_OP_SHADOW           ( 1UL << 3 )
+#define SOAK_OP_ALL              ( SOAK_OP_RECONNECT | SOAK_OP_PUBLISH | SOAK_OP_OTA | SOAK_OP_SHADOW )
+#define SOAK_OP_COUNT            4
+
+#ifndef SOAK_CYCLE_MS
+#define SOAK_CYCLE_MS            ( 30 * 1000 )
+#endif
+
+#ifndef SOAK_SAMPLE_MS
+#define SOAK_SAMPLE_MS           ( 5 * 60 * 1000 )
+#endif
+
+/* Samples kept for the "soak history" command, about 4 hours with the default sample period */
+#ifndef SOAK_HISTORY_LEN
+#define SOAK_HISTORY_LEN         48
+#endif
+
+typedef struct SoakParams
+{
+    uint32_t ulCycleMs;  /* Pause between the end of a cycle and the start of the next */
+    uint32_t ulSampleMs; /* Period of the heap samples */
+    uint32_t ulOps;      /* SOAK_OP_* bits */
+} SoakParams_t;
+
+typedef struct SoakSample
+{
+    uint32_t ulUptimeS;
+    uint32_t ulCycle;
+    uint32_t ulFreeBytes;
+    uint32_t ulLargestFreeBlock;
+    uint32_t ulFreeBlocks;
+    uint32_t ulMinEverFreeBytes;
+    uint32_t ulAllocFailures;
+    uint32_t ulFragPermille;
+} SoakSample_t;
+
+typedef struct SoakStatus
+{
+    BaseType_t xRunning;
+    SoakParams_t xParams;
+    uint32_t ulCycles;
+    uint32_t ulOpRuns[ SOAK_OP_COUNT ];
+    uint32_t ulOpFailures[ SOAK_OP_COUNT ];
+    uint32_t ulSamples;
+    SoakSample_t xFirst;            /* Sample taken at the start */
+    SoakSample_t xLast;
+    uint32_t ulMaxFragPermille;     /* Worst values over all samples */
+    uint32_t ulMinLargestFreeBlock;
+} SoakStatus_t;
+
+/**
+ * @brief Start the soak test task.
+ *
+ * @return pdFALSE if a soak test is already running or the task could not be created.
+ */
+BaseType_t xSoakStart( const SoakParams_t * pxParams );
+
+/**
+ * @brief Ask the soak test to stop at the end of the current operation.
+ */
+void vSoakStop( void );
+
+void vSoakGetStatus( SoakStatus_t * pxStatus );
+
+/**
+ * @brief Copy up to ulMaxSamples of the most recent samples, oldest first.
+ *
+ * @return The number of samples copied.
+ */
+uint32_t ulSoakGetHistory( SoakSample_t * pxSamples,
+                           uint32_t ulMaxSamples );
+
+/**
+ * @brief Name of operation ulIndex, the index of its SOAK_OP_* bit.
+ */
+const char * pcSoakOpName( uint32_t ulIndex );
+
+#endif /* SOAK_TEST_H_ */
@@ -0,0 +1,250 @@
+/*
+ * FreeRTOS STM32 Reference Integration
+ *
+ * Copyright (c) 2022 Amazon.com, Inc. or its affiliates. All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+/**
+ * @file telemetry_trace.c
+ * @brief Correlation ids and on-device stage timestamps for sensor publishes.
+ */
+
+#include "logging_levels.h"
+#define LOG_LEVEL     LOG_INFO
+#define LOG_MODULE    LOG_MODULE_SENSOR
+#include "logging.h"
+
+/* Standard includes. */
+#include <string.h>
+#include <stdio.h>
+
+/* FreeRTOS includes. */
+#include "FreeRTOS.h"
+#include "task.h"
+
+#include "time_base.h"
+#include "mqtt_publish_async.h"
+#include "telemetry_trace.h"
+
+#if TELEMETRY_TRACE_ENABLED == 1
+
+/*-----------------------------------------------------------*/
+
+static uint32_t prvSinceSample( const TelemetryTraceRecord_t * pxRecord,
+                                uint64_t ullTimeUs )
+{
+    return ( ullTimeUs > pxRecord->ullSampleUs ) ? ( uint32_t ) ( ullTimeUs - pxRecord->ullSampleUs ) : 0;
+}
+
+/*-----------------------------------------------------------*/
+
+TelemetryTraceRecord_t * pxTelemetryTraceBegin( TelemetryTraceStream_t * pxStream,
+                                                uint64_t ullSampleUs )
+{
+    TelemetryTraceRecord_t * pxRecord = NULL;
+
+    configASSERT( pxStream != NULL );
+
+    taskENTER_CRITICAL();
+    {
+        pxRecord = &( pxStream->pxRecords[ pxStream->ulNextId % TELEMETRY_TRACE_SLOTS ] );
+
+        if( pxRecord->xInFlight == pdTRUE )
+        {
+            pxStream->ulOverwritten++;
+        }
+
+        ( void ) memset( pxRecord, 0, sizeof( TelemetryTraceRecord_t ) );
+        pxRecord->ulId = pxStream->ulNextId;
+        pxRecord->ullSampleUs = ullSampleUs;
+        pxRecord->xInFlight = pdTRUE;
+
+        pxStream->ulNextId++;
+    }
+    taskEXIT_CRITICAL();
+
+    return pxRecord;
+}
+
+/*-----------------------------------------------------------*/
+
+/* Most recent completed record not reported yet, marked as reported. PRE: in a critical section */
+static BaseType_t prvTakeDone( TelemetryTraceStream_t * pxStream,
+                               TelemetryTraceRecord_t * pxDone )
+{
+    TelemetryTraceRecord_t * pxLatest = NULL;
+
+    for( uint32_t i = 0; i < TELEMETRY_TRACE_SLOTS; i++ )
+    {
+        TelemetryTraceRecord_t * pxRecord = &( pxStream->pxRecords[ i ] );
+
+        if( ( pxRecord->xDone == pdTRUE ) &&
+            ( ( pxLatest == NULL ) || ( ( int32_t ) ( pxRecord->ulId - pxLatest->ulId ) > 0 ) ) )
+        {
+            pxLatest = pxRecord;
+        }
+    }
+
+    if( pxLatest != NULL )
+    {
+        pxLatest->xDone = pdFALSE;
+        *pxDone = *pxLatest;
+    }
+
+    return( pxLatest != NULL );
+}
+
+/*-----------------------------------------------------------*/
+
+int lTelemetryTraceAppend( TelemetryTraceStream_t * pxStream,
+                           TelemetryTraceRecord_t * pxRecord,
+                           uint64_t ullReadUs,
+                           char * pcBuffer,
+                           size_t uxBufferLen,
+                           int lLen )
+{
+    uint32_t ulBuildUs = prvSinceSample( pxRecord, ullTimeBaseGetUs() );
+    TelemetryTraceRecord_t xDone;
+    BaseType_t xHaveDone;
+    uint64_t ullUnixMs = 0;
+    int32_t lSource;
+    int lWritten;
+
+    configASSERT( pxStream != NULL );
+    configASSERT( pxRecord != NULL );
+    configASSERT( pcBuffer != NULL );
+
+    lSource = ( int32_t ) xTimeBaseToUnixMs( pxRecord->ullSampleUs, &ullUnixMs );
+
+    taskENTER_CRITICAL();
+    xHaveDone = prvTakeDone( pxStream, &xDone );
+    taskEXIT_CRITICAL();
+
+    if( ( lLen < 0 ) || ( ( size_t ) lLen >= uxBufferLen ) )
+    {
+        lLen = -1;
+    }
+    else
+    {
+        if( lSource != ( int32_t ) TIME_BASE_SRC_NONE )
+        {
+            lWritten = snprintf( &( pcBuffer[ lLen ] ), uxBufferLen - ( size_t ) lLen,
+                                 ", \"trace\": { \"id\": %lu, \"t0_ms\": %llu, \"src\": %ld, \"read_us\": %lu, \"build_us\": %lu",
+                                 ( unsigned long ) pxRecord->ulId, ( unsigned long long ) ullUnixMs, ( long ) lSource,
+                                 ( unsigned long ) prvSinceSample( pxRecord, ullReadUs ), ( unsigned long ) ulBuildUs );
+        }
+        else
+        {
+            lWritten = snprintf( &( pcBuffer[ lLen ] ), uxBufferLen - ( size_t ) lLen,
+                                 ", \"trace\": { \"id\": %lu, \"t0_ms\": null, \"src\": 0, \"read_us\": %lu, \"build_us\": %lu",
+                                 ( unsigned long ) pxRecord->ulId,
+                                 ( unsigned long ) prvSinceSample( pxRecord, ullReadUs ), ( unsigned long ) ulBuildUs );
+        }
+
+        lLen = ( ( lWritten > 0 ) && ( ( size_t ) lWritten < ( uxBufferLen - ( size_t ) lLen ) ) ) ? ( lLen + lWritten ) : -1;
+    }
+
+    if( ( lLen > 0 ) && ( xHaveDone == pdTRUE ) )
+    {
+        if( xDone.ulDequeueUs > 0 )
+        {
+            lWritten = snprintf( &( pcBuffer[ lLen ] ), uxBufferLen - ( size_t ) lLen,
+                                 ", \"prev\": { \"id\": %lu, \"queue_us\": %lu, \"dequeue_us\": %lu, \"sent_us\": %lu, \"ok\": %d }",
+                                 ( unsigned long ) xDone.ulId, ( unsigned long ) xDone.ulQueueUs,
+                                 ( unsigned long ) xDone.ulDequeueUs, ( unsigned long ) xDone.ulSentUs,
+                                 ( xDone.xSuccess == pdTRUE ) ? 1 : 0 );
+        }
+        else
+        {
+            lWritten = snprintf( &( pcBuffer[ lLen ] ), uxBufferLen - ( size_t ) lLen,
+                                 ", \"prev\": { \"id\": %lu, \"queue_us\": %lu, \"sent_us\": %lu, \"ok\": %d }",
+                                 ( unsigned long ) xDone.ulId, ( unsigned long ) xDone.ulQueueUs,
+                                 ( unsigned long ) xDone.ulSentUs, ( xDone.xSuccess == pdTRUE ) ? 1 : 0 );
+        }
+
+        lLen = ( ( lWritten > 0 ) && ( ( size_t ) lWritten < ( uxBufferLen - ( size_t ) lLen ) ) ) ? ( lLen + lWritten ) : -1;
+    }
+
+    if( lLen > 0 )
+    {
+        lWritten = snprintf( &( pcBuffer[ lLen ] ), uxBufferLen - ( size_t ) lLen, " }" );
+        lLen = ( ( lWritten > 0 ) && ( ( size_t ) lWritten < ( uxBufferLen - ( size_t ) lLen ) ) ) ? ( lLen + lWritten ) : -1;
+    }
+
+    if( lLen < 0 )
+    {
+        LogWarn( "Trace %lu does not fit in the payload.", ( unsigned long ) pxRecord->ulId );
+    }
+
+    return lLen;
+}
+
+/*-----------------------------------------------------------*/
+
+void vTelemetryTraceQueued( TelemetryTraceRecord_t * pxRecord )
+{
+    configASSERT( pxRecord != NULL );
+
+    pxRecord->ulQueueUs = prvSinceSample( pxRecord, ullTimeBaseGetUs() );
+}
+
+/*-----------------------------------------------------------*/
+
+static void prvComplete( TelemetryTraceRecord_t * pxRecord,
+                         BaseType_t xSuccess,
+                         uint64_t ullDequeuedUs )
+{
+    uint32_t ulSentUs = prvSinceSample( pxRecord, ullTimeBaseGetUs() );
+
+    taskENTER_CRITICAL();
+    {
+        /* A record reused by a newer publish is no longer in flight for this one */
+        if( pxRecord->xInFlight == pdTRUE )
+        {
+            pxRecord->ulSentUs = ulSentUs;
+            pxRecord->ulDequeueUs = ( ullDequeuedUs > 0 ) ? prvSinceSample( pxRecord, ullDequeuedUs ) : 0;
+            pxRecord->xSuccess = xSuccess;
+            pxRecord->xInFlight = pdFALSE;
+            pxRecord->xDone = pdTRUE;
+        }
+    }
+    taskEXIT_CRITICAL();
+}
+
+/*-----------------------------------------------------------*/
+
+void vTelemetryTraceComplete( TelemetryTraceRecord_t * pxRecord,
+                              MQTTStatus_t xStatus )
+{
+    configASSERT( pxRecord != NULL );
+
+    prvComplete( pxRecord, ( xStatus == MQTTSuccess ) ? pdTRUE : pdFALSE, MqttAgent_GetPublishDequeuedUs() );
+}
+
+/*-----------------------------------------------------------*/
+
+void vTelemetryTraceFailed( TelemetryTraceRecord_t * pxRecord )
+{
+    configASSERT( pxRecord != NULL );
+
+    prvComplete( pxRecord, pdFALSE, 0 );
+}
+
+#endif /* TELEMETRY_TRACE_ENABLED == 1 */
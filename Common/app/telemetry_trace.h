@@ -0,0 +1,126 @@
+/*
+ * FreeRTOS STM32 Reference Integration
+ *
+ * Copyright (c) 2022 Amazon.com, Inc. or its affiliates. All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+/**
+ * @file telemetry_trace.h
+ * @brief Correlation ids and on-device stage timestamps for sensor publishes.
+ *
+ * With TELEMETRY_TRACE_ENABLED set, the JSON payloads of the env and motion
+ * sensor publishes carry a "trace" object:
+ *
+ *   "trace": { "id": 42, "t0_ms": 1700000000123, "src": 3, "read_us": 150, "build_us": 410,
+ *              "prev": { "id": 41, "queue_us": 430, "dequeue_us": 2210, "sent_us": 3020, "ok": 1 } }
+ *
+ * id increases by one per publish of a stream and restarts at 0 on boot.
+ * t0_ms is the wall clock time of the sample in ms since 1970, null while it is
+ * unknown, and src the TimeBaseSource_t it came from. The stage times are in us
+ * since the sample:
+ * - read_us:    the publishing task got the reading (sensor read, sensor hub queue)
+ * - build_us:   the payload was encoded
+ * - queue_us:   the publish was handed to the MQTT agent
+ * - dequeue_us: the agent took it from its queue, absent without agent statistics
+ * - sent_us:    the publish completed, i.e. the TLS write returned at QoS0
+ *
+ * The last three stages are only known once the payload has been sent, so they
+ * are carried by the "prev" object of the next publish of the stream. The
+ * tools/telemetry_latency.py script joins both with the cloud arrival time.
+ */
+
+#ifndef TELEMETRY_TRACE_H_
+#define TELEMETRY_TRACE_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "FreeRTOS.h"
+#include "core_mqtt.h"
+
+#ifndef TELEMETRY_TRACE_ENABLED
+#define TELEMETRY_TRACE_ENABLED    0
+#endif
+
+/* Publishes of a stream that may be in flight at the same time */
+#ifndef TELEMETRY_TRACE_SLOTS
+#define TELEMETRY_TRACE_SLOTS      4
+#endif
+
+typedef struct TelemetryTraceRecord
+{
+    uint32_t ulId;
+    uint64_t ullSampleUs; /* ullTimeBaseGetUs at acquisition */
+    uint32_t ulQueueUs;   /* Stage times relative to ullSampleUs */
+    uint32_t ulDequeueUs;
+    uint32_t ulSentUs;
+    BaseType_t xInFlight;
+    BaseType_t xDone;     /* Completed and not reported yet */
+    BaseType_t xSuccess;
+} TelemetryTraceRecord_t;
+
+typedef struct TelemetryTraceStream
+{
+    uint32_t ulNextId;
+    uint32_t ulOverwritten; /* Records reused while still in flight */
+    TelemetryTraceRecord_t pxRecords[ TELEMETRY_TRACE_SLOTS ];
+} TelemetryTraceStream_t;
+
+/**
+ * @brief Start the trace of a new publish of pxStream for a sample taken at ullSampleUs.
+ *
+ * @return The record to pass to the other functions.
+ */
+TelemetryTraceRecord_t * pxTelemetryTraceBegin( TelemetryTraceStream_t * pxStream,
+                                                uint64_t ullSampleUs );
+
+/**
+ * @brief Append ", \"trace\": { ... }" at offset lLen of pcBuffer.
+ *
+ * The encode stage is taken at the time of the call, so call it once the rest
+ * of the payload has been formatted. ullReadUs is the time the reading reached
+ * the publishing task.
+ *
+ * @return The new length of the payload, or -1 if the trace does not fit.
+ */
+int lTelemetryTraceAppend( TelemetryTraceStream_t * pxStream,
+                           TelemetryTraceRecord_t * pxRecord,
+                           uint64_t ullReadUs,
+                           char * pcBuffer,
+                           size_t uxBufferLen,
+                           int lLen );
+
+/**
+ * @brief Mark the publish as handed to the agent. Call right before MqttAgent_PublishAsync.
+ */
+void vTelemetryTraceQueued( TelemetryTraceRecord_t * pxRecord );
+
+/**
+ * @brief Mark the publish as completed. Call from its PublishCompleteCallback_t.
+ */
+void vTelemetryTraceComplete( TelemetryTraceRecord_t * pxRecord,
+                              MQTTStatus_t xStatus );
+
+/**
+ * @brief Mark the publish as failed when it was not handed to the agent.
+ */
+void vTelemetryTraceFailed( TelemetryTraceRecord_t * pxRecord );
+
+#endif /* TELEMETRY_TRACE_H_ */
@@ -6,7 +6,10 @@
 #define CLI_PROMPT_STR                "> "
 #define CLI_OUTPUT_EOL                "\r\n"
 
+/* Host side tools and documentation assume 115200 */
+#ifndef CLI_UART_BAUD_RATE
 #define CLI_UART_BAUD_RATE            ( 115200 )
+#endif
 
 #define CLI_PROMPT_LEN                ( 2 )
 #define CLI_OUTPUT_EOL_LEN            ( 2 )
@@ -29,14 +32,27 @@
 /* 115.2 bytes per 10 ms */
 #define CLI_UART_BYTES_PER_RX_TIME    ( CLI_UART_FRAMES_PER_SEC * CLI_UART_RX_HW_TIMEOUT_MS / 1000 )
 
-#define CLI_UART_RX_READ_SZ_10MS      128
-
-#define CLI_UART_TX_WRITE_SZ_5MS      64
+/*
+ * Circular DMA receive ring. Its half transfer, wrap around and idle line events move
+ * the data to the receive stream. At 921600 baud, 512 bytes give a half transfer every 2.8 ms.
+ */
+#ifndef CLI_UART_RX_DMA_LEN
+#define CLI_UART_RX_DMA_LEN           512
+#endif
 
-#define CLI_UART_RX_STREAM_LEN        512
+#ifndef CLI_UART_RX_STREAM_LEN
+#define CLI_UART_RX_STREAM_LEN        1024
+#endif
 
 #define CLI_UART_TX_STREAM_LEN        2304
 
+/* Largest baud rate error accepted by xConsoleSetBaudRate, USART1 runs from HSI16 */
+#ifndef CLI_UART_BAUD_MAX_ERROR_PCT
+#define CLI_UART_BAUD_MAX_ERROR_PCT   2
+#endif
+
+#define CLI_UART_TX_DRAIN_TIMEOUT_MS  1000
+
 void Task_CLI( void * pvParameters );
 
 
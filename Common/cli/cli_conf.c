@@ -70,7 +70,7 @@ const CLI_Command_Definition_t xCommandDef_conf =
 
 static void vSubCommand_CommitConfig( ConsoleIO_t * pxCIO )
 {
-    BaseType_t xResult = KVStore_xCommitChanges();
+    BaseType_t xResult = KVStore_xFlush();
 
     if( xResult == pdTRUE )
     {
@@ -172,7 +172,7 @@ static void vSubCommand_GetConfig( ConsoleIO_t * pxCIO,
             break;
     }
 
-    if( ( xKey == CS_NUM_KEYS ) ||
+    if( ( xKey == KV_STORE_KEY_INVALID ) ||
         ( xKvType == KV_TYPE_LAST ) )
     {
     }
@@ -194,7 +194,7 @@ static void vSubCommand_GetConfig( ConsoleIO_t * pxCIO,
     }
     else
     {
-        if( ( xKey == CS_NUM_KEYS ) ||
+        if( ( xKey == KV_STORE_KEY_INVALID ) ||
             ( xKvType == KV_TYPE_NONE ) )
         {
             lResponseLen = snprintf( pcCliScratchBuffer, CLI_OUTPUT_SCRATCH_BUF_LEN,
@@ -213,7 +213,7 @@ static void vSubCommand_GetConfig( ConsoleIO_t * pxCIO,
 
 static void vSubCommand_GetConfigAll( ConsoleIO_t * pxCIO )
 {
-    for( KVStoreKey_t key = 0; key < CS_NUM_KEYS; key++ )
+    for( KVStoreKey_t key = 0; key < KVStore_uxGetNumKeys(); key++ )
     {
         vSubCommand_GetConfig( pxCIO, kvStoreKeyMap[ key ] );
     }
@@ -308,6 +308,14 @@ static void vSubCommand_SetConfig( ConsoleIO_t * pxCIO,
                }
 
             case KV_TYPE_STRING:
+
+                /* Log levels take effect immediately, and are only stored if valid */
+                if( ( xKey == CS_LOG_LEVELS ) &&
+                    ( lLoggingSetLevels( pcValue ) != 1 ) )
+                {
+                    break;
+                }
+
                 xParseResult = KVStore_setString( xKey, pcValue );
                 lCharsPrinted = snprintf( pcCliScratchBuffer, CLI_OUTPUT_SCRATCH_BUF_LEN,
                                           "%s=\"%s\"\r\n",
@@ -327,7 +335,7 @@ static void vSubCommand_SetConfig( ConsoleIO_t * pxCIO,
 
         if( xParseResult == pdFALSE )
         {
-            if( xKey == CS_NUM_KEYS )
+            if( xKey == KV_STORE_KEY_INVALID )
             {
                 lCharsPrinted = snprintf( pcCliScratchBuffer, CLI_OUTPUT_SCRATCH_BUF_LEN,
                                           "Error: key: %s was not recognized.\r\n",
@@ -0,0 +1,232 @@
+/*
+ * FreeRTOS STM32 Reference Integration
+ *
+ * Copyright (c) 2022 Amazon.com, Inc. or its affiliates. All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#include <string.h>
+#include <stdio.h>
+#include <stdarg.h>
+
+#include "FreeRTOS.h"
+#include "task.h"
+
+#include "cli.h"
+#include "cli_prv.h"
+#include "crit_stats.h"
+
+#if CRIT_STATS_ENABLED == 1
+
+static void prvCritStatCommand( ConsoleIO_t * const pxCIO,
+                                uint32_t ulArgc,
+                                char * ppcArgv[] );
+
+const CLI_Command_Definition_t xCommandDef_critstat =
+{
+    "critstat",
+    "critstat [ stat | reset ]\r\n"
+    "    Duration of the interrupt masked and scheduler suspended sections.\r\n"
+    "        stat:  Count, maximum, histogram and longest call sites since boot or the last reset.\r\n"
+    "        reset: Clear the statistics.\r\n"
+    "    Without an argument, stat is run.\r\n\n",
+    prvCritStatCommand
+};
+
+/*-----------------------------------------------------------*/
+
+static void prvPrintf( ConsoleIO_t * const pxCIO,
+                       const char * pcFormat,
+                       ... ) __attribute__( ( format( printf, 2, 3 ) ) );
+
+static void prvPrintf( ConsoleIO_t * const pxCIO,
+                       const char * pcFormat,
+                       ... )
+{
+    va_list xArgs;
+    size_t xLen;
+
+    va_start( xArgs, pcFormat );
+    xLen = vsnprintf( pcCliScratchBuffer, CLI_OUTPUT_SCRATCH_BUF_LEN, pcFormat, xArgs );
+    va_end( xArgs );
+
+    if( xLen >= CLI_OUTPUT_SCRATCH_BUF_LEN )
+    {
+        xLen = CLI_OUTPUT_SCRATCH_BUF_LEN - 1;
+    }
+
+    pxCIO->write( pcCliScratchBuffer, xLen );
+}
+
+/*-----------------------------------------------------------*/
+
+/* Cycles to hundredths of a microsecond, printed as xx.yy */
+static uint32_t prvCyclesToCentiUs( uint64_t ullCycles )
+{
+    uint32_t ulCyclesPerUs = SystemCoreClock / 1000000UL;
+    uint64_t ullCentiUs = 0;
+
+    if( ulCyclesPerUs > 0 )
+    {
+        ullCentiUs = ( ullCycles * 100U ) / ulCyclesPerUs;
+    }
+
+    return ( ullCentiUs > UINT32_MAX ) ? UINT32_MAX : ( uint32_t ) ullCentiUs;
+}
+
+/*-----------------------------------------------------------*/
+
+/* Thumb bit cleared, so that the address can be passed to addr2line as is */
+static unsigned long prvSiteAddr( const void * pvSite )
+{
+    return ( unsigned long ) ( ( uintptr_t ) pvSite & ~( ( uintptr_t ) 1U ) );
+}
+
+/*-----------------------------------------------------------*/
+
+static void prvPrintSites( ConsoleIO_t * const pxCIO,
+                           const CritStats_t * pxStats )
+{
+    CritStatsSite_t xSorted[ CRIT_STATS_SITES ];
+    size_t uxCount = 0;
+
+    /* Insertion sort on the maximum, longest first */
+    for( size_t i = 0; i < CRIT_STATS_SITES; i++ )
+    {
+        if( pxStats->xSites[ i ].pvSite != NULL )
+        {
+            size_t j = uxCount;
+
+            while( ( j > 0 ) &&
+                   ( xSorted[ j - 1 ].ulMaxCycles < pxStats->xSites[ i ].ulMaxCycles ) )
+            {
+                xSorted[ j ] = xSorted[ j - 1 ];
+                j--;
+            }
+
+            xSorted[ j ] = pxStats->xSites[ i ];
+            uxCount++;
+        }
+    }
+
+    for( size_t i = 0; i < uxCount; i++ )
+    {
+        uint32_t ulMax = prvCyclesToCentiUs( xSorted[ i ].ulMaxCycles );
+
+        prvPrintf( pxCIO, "    0x%08lx  count %10lu  max %7lu.%02lu us\r\n",
+                   prvSiteAddr( xSorted[ i ].pvSite ),
+                   ( unsigned long ) xSorted[ i ].ulCount,
+                   ( unsigned long ) ( ulMax / 100U ), ( unsigned long ) ( ulMax % 100U ) );
+    }
+
+    if( uxCount == 0 )
+    {
+        prvPrintf( pxCIO, "    None of at least %u us.\r\n", ( unsigned int ) CRIT_STATS_SITE_MIN_US );
+    }
+}
+
+/*-----------------------------------------------------------*/
+
+static void prvCritStat( ConsoleIO_t * const pxCIO )
+{
+    static CritStats_t xStats[ CRIT_STATS_KIND_MAX ];
+
+    for( CritStatsKind_t xKind = 0; xKind < CRIT_STATS_KIND_MAX; xKind++ )
+    {
+        vCritStatsGet( xKind, &( xStats[ xKind ] ) );
+    }
+
+    prvPrintf( pxCIO, "Core clock: %lu Hz, times in us\r\n", ( unsigned long ) SystemCoreClock );
+    pxCIO->print( "+-----------------+------------+-----------+------------+------------+\r\n" );
+    pxCIO->print( "| Section         |   Count    |    Avg    |    Max     | Max site   |\r\n" );
+    pxCIO->print( "+-----------------+------------+-----------+------------+------------+\r\n" );
+
+    for( CritStatsKind_t xKind = 0; xKind < CRIT_STATS_KIND_MAX; xKind++ )
+    {
+        const CritStats_t * pxStats = &( xStats[ xKind ] );
+        uint32_t ulAvg = 0;
+        uint32_t ulMax = prvCyclesToCentiUs( pxStats->ulMaxCycles );
+
+        if( pxStats->ulCount > 0 )
+        {
+            ulAvg = prvCyclesToCentiUs( pxStats->ullTotalCycles / pxStats->ulCount );
+        }
+
+        prvPrintf( pxCIO, "| %-15.15s | %10lu | %6lu.%02lu | %7lu.%02lu | 0x%08lx |\r\n",
+                   pcCritStatsKindName( xKind ),
+                   ( unsigned long ) pxStats->ulCount,
+                   ( unsigned long ) ( ulAvg / 100U ), ( unsigned long ) ( ulAvg % 100U ),
+                   ( unsigned long ) ( ulMax / 100U ), ( unsigned long ) ( ulMax % 100U ),
+                   prvSiteAddr( pxStats->pvMaxSite ) );
+    }
+
+    pxCIO->print( "+-----------------+------------+-----------+------------+------------+\r\n" );
+
+    pxCIO->print( "\r\nHistogram (us)       <1      1      2      4      8     16     32     64    128    256    512  >=1024\r\n" );
+
+    for( CritStatsKind_t xKind = 0; xKind < CRIT_STATS_KIND_MAX; xKind++ )
+    {
+        prvPrintf( pxCIO, "%-16.16s", pcCritStatsKindName( xKind ) );
+
+        for( size_t i = 0; i < CRIT_STATS_HIST_BUCKETS; i++ )
+        {
+            prvPrintf( pxCIO, " %6lu", ( unsigned long ) xStats[ xKind ].pulHist[ i ] );
+        }
+
+        pxCIO->print( "\r\n" );
+    }
+
+    for( CritStatsKind_t xKind = 0; xKind < CRIT_STATS_KIND_MAX; xKind++ )
+    {
+        prvPrintf( pxCIO, "\r\nLongest %s call sites:\r\n", pcCritStatsKindName( xKind ) );
+        prvPrintSites( pxCIO, &( xStats[ xKind ] ) );
+    }
+
+    pxCIO->print( "\r\nResolve the sites with: arm-none-eabi-addr2line -f -e <elf> <address>\r\n" );
+}
+
+/*-----------------------------------------------------------*/
+
+static void prvCritStatCommand( ConsoleIO_t * const pxCIO,
+                                uint32_t ulArgc,
+                                char * ppcArgv[] )
+{
+    const char * pcVerb = "stat";
+
+    if( ulArgc > 1 )
+    {
+        pcVerb = ppcArgv[ 1 ];
+    }
+
+    if( strcmp( pcVerb, "stat" ) == 0 )
+    {
+        prvCritStat( pxCIO );
+    }
+    else if( strcmp( pcVerb, "reset" ) == 0 )
+    {
+        vCritStatsReset();
+        pxCIO->print( "Critical section statistics cleared.\r\n" );
+    }
+    else
+    {
+        pxCIO->print( "Error: Unknown argument. See \"help critstat\".\r\n" );
+    }
+}
+
+#endif /* CRIT_STATS_ENABLED == 1 */
@@ -0,0 +1,1177 @@
+/*
+ * FreeRTOS STM32 Reference Integration
+ * Copyright (C) 2021 Amazon.com, Inc. or its affiliates.  All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ * http://www.FreeRTOS.org
+ * http://aws.amazon.com/freertos
+ *
+
+ */
+
+/* Standard includes. */
+#include <string.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdarg.h>
+
+/* FreeRTOS includes. */
+#include "FreeRTOS.h"
+#include "task.h"
+
+#include "cli.h"
+#include "cli_prv.h"
+
+#include "stm32u5xx.h"
+#include "dvfs.h"
+
+#include "mbedtls/build_info.h"
+#include "mbedtls/entropy.h"
+#include "mbedtls/ctr_drbg.h"
+#include "mbedtls/gcm.h"
+#include "mbedtls/chachapoly.h"
+#include "mbedtls/sha256.h"
+#include "mbedtls/ecdsa.h"
+#include "mbedtls/ecdh.h"
+#include "mbedtls/rsa.h"
+#include "entropy_poll.h"
+
+#if defined( TFM_PSA_API )
+#include "psa/crypto.h"
+#endif
+
+/* Bytes processed per record size by the symmetric tests */
+#define CRYPTOBENCH_SYM_BYTES          ( 64 * 1024 )
+#define CRYPTOBENCH_SYM_MIN_OPS        4
+#define CRYPTOBENCH_MAX_RECORD_LEN     16384
+#define CRYPTOBENCH_GCM_TAG_LEN        16
+#define CRYPTOBENCH_GCM_IV_LEN         12
+#define CRYPTOBENCH_GCM_AAD_LEN        13
+
+/* Operations per curve for the public key tests */
+#define CRYPTOBENCH_PK_OPS             8
+#define CRYPTOBENCH_RSA_BITS           2048
+#define CRYPTOBENCH_RSA_EXPONENT       65537
+
+#define CRYPTOBENCH_TRNG_BYTES         ( 16 * 1024 )
+#define CRYPTOBENCH_TRNG_CHUNK_LEN     1024
+
+/* Implementation reached by the mbedtls calls of each test */
+#if defined( MBEDTLS_GCM_ALT )
+#define CRYPTOBENCH_IMPL_GCM           "hw"
+#else
+#define CRYPTOBENCH_IMPL_GCM           "sw"
+#endif
+
+#if defined( MBEDTLS_CHACHA20_ALT )
+#define CRYPTOBENCH_IMPL_CHACHAPOLY    "opt"
+#else
+#define CRYPTOBENCH_IMPL_CHACHAPOLY    "sw"
+#endif
+
+#if defined( MBEDTLS_SHA256_ALT )
+#define CRYPTOBENCH_IMPL_SHA256        "hw"
+#else
+#define CRYPTOBENCH_IMPL_SHA256        "sw"
+#endif
+
+#if defined( MBEDTLS_ECDSA_SIGN_ALT )
+#define CRYPTOBENCH_IMPL_ECDSA_SIGN    "hw"
+#else
+#define CRYPTOBENCH_IMPL_ECDSA_SIGN    "sw"
+#endif
+
+#if defined( MBEDTLS_ECDSA_VERIFY_ALT )
+#define CRYPTOBENCH_IMPL_ECDSA_VERIFY  "hw"
+#else
+#define CRYPTOBENCH_IMPL_ECDSA_VERIFY  "sw"
+#endif
+
+#if defined( MBEDTLS_ECDH_GEN_PUBLIC_ALT )
+#define CRYPTOBENCH_IMPL_ECDH_GEN      "hw"
+#else
+#define CRYPTOBENCH_IMPL_ECDH_GEN      "sw"
+#endif
+
+#if defined( MBEDTLS_ECDH_COMPUTE_SHARED_ALT )
+#define CRYPTOBENCH_IMPL_ECDH_SHARED   "hw"
+#else
+#define CRYPTOBENCH_IMPL_ECDH_SHARED   "sw"
+#endif
+
+#if defined( MBEDTLS_RSA_ALT )
+#define CRYPTOBENCH_IMPL_RSA           "hw"
+#else
+#define CRYPTOBENCH_IMPL_RSA           "sw"
+#endif
+
+typedef struct
+{
+    uint32_t ulCount;
+    uint64_t ullTotalCycles;
+    uint32_t ulMaxCycles;
+} CycleStats_t;
+
+typedef struct
+{
+    mbedtls_entropy_context xEntropy;
+    mbedtls_ctr_drbg_context xDrbg;
+} BenchRng_t;
+
+typedef struct
+{
+    mbedtls_ecp_group_id xId;
+    const char * pcName;
+#if defined( TFM_PSA_API )
+    size_t uxBits;
+#endif
+} BenchCurve_t;
+
+static const size_t xRecordSizes[] = { 64, 256, 1024, CRYPTOBENCH_MAX_RECORD_LEN };
+
+#if defined( MBEDTLS_ECP_C )
+static const BenchCurve_t xCurves[] =
+{
+#if defined( MBEDTLS_ECP_DP_SECP256R1_ENABLED )
+#if defined( TFM_PSA_API )
+    { MBEDTLS_ECP_DP_SECP256R1, "p256", 256 },
+#else
+    { MBEDTLS_ECP_DP_SECP256R1, "p256" },
+#endif
+#endif
+#if defined( MBEDTLS_ECP_DP_SECP384R1_ENABLED )
+#if defined( TFM_PSA_API )
+    { MBEDTLS_ECP_DP_SECP384R1, "p384", 384 },
+#else
+    { MBEDTLS_ECP_DP_SECP384R1, "p384" },
+#endif
+#endif
+};
+#endif /* MBEDTLS_ECP_C */
+
+/* The first 16 bytes are the AES-128 key */
+static const uint8_t ucBenchKey[ 32 ] =
+{
+    0x00, 0x01, 0x02, 0x03, 0x04, 0x05, 0x06, 0x07,
+    0x08, 0x09, 0x0a, 0x0b, 0x0c, 0x0d, 0x0e, 0x0f,
+    0x10, 0x11, 0x12, 0x13, 0x14, 0x15, 0x16, 0x17,
+    0x18, 0x19, 0x1a, 0x1b, 0x1c, 0x1d, 0x1e, 0x1f
+};
+
+static const uint8_t ucBenchIv[ CRYPTOBENCH_GCM_IV_LEN ] = { 0 };
+static const uint8_t ucBenchAad[ CRYPTOBENCH_GCM_AAD_LEN ] = { 0 };
+
+/* Stands in for a SHA-256 digest in the signature tests */
+static const uint8_t ucBenchHash[ 32 ] =
+{
+    0xba, 0x78, 0x16, 0xbf, 0x8f, 0x01, 0xcf, 0xea, 0x41, 0x41, 0x40, 0xde, 0x5d, 0xae, 0x22, 0x23,
+    0xb0, 0x03, 0x61, 0xa3, 0x96, 0x17, 0x7a, 0x9c, 0xb4, 0x10, 0xff, 0x61, 0xf2, 0x00, 0x15, 0xad
+};
+
+static void prvCryptoBenchCommand( ConsoleIO_t * const pxCIO,
+                                   uint32_t ulArgc,
+                                   char * ppcArgv[] );
+
+const CLI_Command_Definition_t xCommandDef_cryptobench =
+{
+    "cryptobench",
+    "cryptobench [ gcm | chachapoly | sha256 | ecdsa | ecdh | rsa | trng | all ]\r\n"
+    "    Measure the latency and throughput of the cryptographic primitives used by TLS.\r\n"
+    "        gcm:    AES-128-GCM encryption of 64 B to 16 KiB records.\r\n"
+    "        chachapoly: ChaCha20-Poly1305 encryption of the same records.\r\n"
+    "        sha256: SHA-256 of 64 B to 16 KiB buffers.\r\n"
+    "        ecdsa:  ECDSA sign and verify on P-256 and P-384.\r\n"
+    "        ecdh:   ECDH key generation and shared secret on P-256 and P-384.\r\n"
+    "        rsa:    RSA-2048 PKCS#1 v1.5 verify, after generating a key.\r\n"
+    "        trng:   Throughput of the hardware entropy source.\r\n"
+    "    Results are labelled hw, opt or sw for the mbedtls path in use and psa for PSA calls.\r\n"
+    "    Without an argument, all tests are run.\r\n\n",
+    prvCryptoBenchCommand
+};
+
+/*-----------------------------------------------------------*/
+
+static inline void vStartCycleCounter( void )
+{
+    if( ( DWT->CTRL & DWT_CTRL_CYCCNTENA_Msk ) == 0 )
+    {
+        CoreDebug->DEMCR |= CoreDebug_DEMCR_TRCENA_Msk;
+        DWT->CYCCNT = 0;
+        DWT->CTRL |= DWT_CTRL_CYCCNTENA_Msk;
+    }
+}
+
+static inline uint32_t ulCyclesToUs( uint64_t ullCycles )
+{
+    return ( uint32_t ) ( ullCycles / ( SystemCoreClock / 1000000 ) );
+}
+
+static void vRecordCycles( CycleStats_t * pxStats,
+                           uint32_t ulStartCycles )
+{
+    uint32_t ulCycles = DWT->CYCCNT - ulStartCycles;
+
+    pxStats->ulCount++;
+    pxStats->ullTotalCycles += ulCycles;
+
+    if( ulCycles > pxStats->ulMaxCycles )
+    {
+        pxStats->ulMaxCycles = ulCycles;
+    }
+}
+
+static uint32_t ulKiBPerSecond( uint64_t ullBytes,
+                                uint64_t ullCycles )
+{
+    uint32_t ulRate = 0;
+    uint64_t ullUs = ulCyclesToUs( ullCycles );
+
+    if( ullUs > 0 )
+    {
+        ulRate = ( uint32_t ) ( ( ullBytes * 1000000 ) / ( ullUs * 1024 ) );
+    }
+
+    return ulRate;
+}
+
+static void prvPrintf( ConsoleIO_t * const pxCIO,
+                       const char * pcFormat,
+                       ... ) __attribute__( ( format( printf, 2, 3 ) ) );
+
+static void prvPrintf( ConsoleIO_t * const pxCIO,
+                       const char * pcFormat,
+                       ... )
+{
+    va_list xArgs;
+    size_t xLen;
+
+    va_start( xArgs, pcFormat );
+    xLen = vsnprintf( pcCliScratchBuffer, CLI_OUTPUT_SCRATCH_BUF_LEN, pcFormat, xArgs );
+    va_end( xArgs );
+
+    if( xLen >= CLI_OUTPUT_SCRATCH_BUF_LEN )
+    {
+        xLen = CLI_OUTPUT_SCRATCH_BUF_LEN - 1;
+    }
+
+    pxCIO->write( pcCliScratchBuffer, xLen );
+}
+
+/* Print one result line. When ulBytesPerOp is not 0, the throughput is appended. */
+static void prvPrintResult( ConsoleIO_t * const pxCIO,
+                            const char * pcLabel,
+                            const char * pcImpl,
+                            const CycleStats_t * pxStats,
+                            uint32_t ulBytesPerOp )
+{
+    uint32_t ulAvgUs = 0;
+
+    if( pxStats->ulCount > 0 )
+    {
+        ulAvgUs = ulCyclesToUs( pxStats->ullTotalCycles / pxStats->ulCount );
+    }
+
+    if( ulBytesPerOp == 0 )
+    {
+        prvPrintf( pxCIO, "%-18s %-3s n=%-4lu avg=%8lu us  max=%8lu us\r\n",
+                   pcLabel, pcImpl, pxStats->ulCount, ulAvgUs,
+                   ulCyclesToUs( pxStats->ulMaxCycles ) );
+    }
+    else
+    {
+        prvPrintf( pxCIO, "%-18s %-3s n=%-4lu avg=%8lu us  max=%8lu us  %6lu KiB/s\r\n",
+                   pcLabel, pcImpl, pxStats->ulCount, ulAvgUs,
+                   ulCyclesToUs( pxStats->ulMaxCycles ),
+                   ulKiBPerSecond( ( uint64_t ) ulBytesPerOp * pxStats->ulCount,
+                                   pxStats->ullTotalCycles ) );
+    }
+}
+
+static void prvPrintError( ConsoleIO_t * const pxCIO,
+                           const char * pcLabel,
+                           const char * pcImpl,
+                           int32_t lError )
+{
+    prvPrintf( pxCIO, "%-18s %-3s Error: %ld\r\n", pcLabel, pcImpl, lError );
+}
+
+static uint32_t ulSymOps( size_t uxLen )
+{
+    uint32_t ulOps = CRYPTOBENCH_SYM_BYTES / uxLen;
+
+    if( ulOps < CRYPTOBENCH_SYM_MIN_OPS )
+    {
+        ulOps = CRYPTOBENCH_SYM_MIN_OPS;
+    }
+
+    return ulOps;
+}
+
+/*-----------------------------------------------------------*/
+
+#if defined( MBEDTLS_GCM_C )
+static void prvBenchGcm( ConsoleIO_t * const pxCIO,
+                         uint8_t * pucIn,
+                         uint8_t * pucOut )
+{
+    mbedtls_gcm_context xGcm;
+    uint8_t ucTag[ CRYPTOBENCH_GCM_TAG_LEN ];
+    char cLabel[ 24 ];
+    int lError;
+
+    mbedtls_gcm_init( &xGcm );
+
+    lError = mbedtls_gcm_setkey( &xGcm, MBEDTLS_CIPHER_ID_AES, ucBenchKey, 128 );
+
+    for( size_t i = 0; i < ( sizeof( xRecordSizes ) / sizeof( xRecordSizes[ 0 ] ) ); i++ )
+    {
+        CycleStats_t xStats = { 0 };
+        uint32_t ulOps = ulSymOps( xRecordSizes[ i ] );
+
+        ( void ) snprintf( cLabel, sizeof( cLabel ), "gcm-%u", ( unsigned int ) xRecordSizes[ i ] );
+
+        for( uint32_t ulOp = 0; ( ulOp < ulOps ) && ( lError == 0 ); ulOp++ )
+        {
+            uint32_t ulStart = DWT->CYCCNT;
+
+            lError = mbedtls_gcm_crypt_and_tag( &xGcm, MBEDTLS_GCM_ENCRYPT, xRecordSizes[ i ],
+                                                ucBenchIv, sizeof( ucBenchIv ),
+                                                ucBenchAad, sizeof( ucBenchAad ),
+                                                pucIn, pucOut, sizeof( ucTag ), ucTag );
+            vRecordCycles( &xStats, ulStart );
+        }
+
+        if( lError != 0 )
+        {
+            prvPrintError( pxCIO, cLabel, CRYPTOBENCH_IMPL_GCM, lError );
+            break;
+        }
+
+        prvPrintResult( pxCIO, cLabel, CRYPTOBENCH_IMPL_GCM, &xStats, xRecordSizes[ i ] );
+    }
+
+    mbedtls_gcm_free( &xGcm );
+}
+#endif /* MBEDTLS_GCM_C */
+
+#if defined( MBEDTLS_CHACHAPOLY_C )
+static void prvBenchChachaPoly( ConsoleIO_t * const pxCIO,
+                                uint8_t * pucIn,
+                                uint8_t * pucOut )
+{
+    mbedtls_chachapoly_context xChachaPoly;
+    uint8_t ucTag[ 16 ];
+    char cLabel[ 24 ];
+    int lError;
+
+    mbedtls_chachapoly_init( &xChachaPoly );
+
+    lError = mbedtls_chachapoly_setkey( &xChachaPoly, ucBenchKey );
+
+    for( size_t i = 0; i < ( sizeof( xRecordSizes ) / sizeof( xRecordSizes[ 0 ] ) ); i++ )
+    {
+        CycleStats_t xStats = { 0 };
+        uint32_t ulOps = ulSymOps( xRecordSizes[ i ] );
+
+        ( void ) snprintf( cLabel, sizeof( cLabel ), "chachapoly-%u", ( unsigned int ) xRecordSizes[ i ] );
+
+        for( uint32_t ulOp = 0; ( ulOp < ulOps ) && ( lError == 0 ); ulOp++ )
+        {
+            uint32_t ulStart = DWT->CYCCNT;
+
+            lError = mbedtls_chachapoly_encrypt_and_tag( &xChachaPoly, xRecordSizes[ i ], ucBenchIv,
+                                                         ucBenchAad, sizeof( ucBenchAad ),
+                                                         pucIn, pucOut, ucTag );
+            vRecordCycles( &xStats, ulStart );
+        }
+
+        if( lError != 0 )
+        {
+            prvPrintError( pxCIO, cLabel, CRYPTOBENCH_IMPL_CHACHAPOLY, lError );
+            break;
+        }
+
+        prvPrintResult( pxCIO, cLabel, CRYPTOBENCH_IMPL_CHACHAPOLY, &xStats, xRecordSizes[ i ] );
+    }
+
+    mbedtls_chachapoly_free( &xChachaPoly );
+}
+#endif /* MBEDTLS_CHACHAPOLY_C */
+
+#if defined( MBEDTLS_SHA256_C )
+static void prvBenchSha256( ConsoleIO_t * const pxCIO,
+                            uint8_t * pucIn )
+{
+    uint8_t ucDigest[ 32 ];
+    char cLabel[ 24 ];
+
+    for( size_t i = 0; i < ( sizeof( xRecordSizes ) / sizeof( xRecordSizes[ 0 ] ) ); i++ )
+    {
+        CycleStats_t xStats = { 0 };
+        uint32_t ulOps = ulSymOps( xRecordSizes[ i ] );
+        int lError = 0;
+
+        ( void ) snprintf( cLabel, sizeof( cLabel ), "sha256-%u", ( unsigned int ) xRecordSizes[ i ] );
+
+        for( uint32_t ulOp = 0; ( ulOp < ulOps ) && ( lError == 0 ); ulOp++ )
+        {
+            uint32_t ulStart = DWT->CYCCNT;
+
+            lError = mbedtls_sha256( pucIn, xRecordSizes[ i ], ucDigest, 0 );
+            vRecordCycles( &xStats, ulStart );
+        }
+
+        if( lError != 0 )
+        {
+            prvPrintError( pxCIO, cLabel, CRYPTOBENCH_IMPL_SHA256, lError );
+            break;
+        }
+
+        prvPrintResult( pxCIO, cLabel, CRYPTOBENCH_IMPL_SHA256, &xStats, xRecordSizes[ i ] );
+    }
+}
+#endif /* MBEDTLS_SHA256_C */
+
+#if defined( MBEDTLS_ECDSA_C )
+static void prvBenchEcdsa( ConsoleIO_t * const pxCIO,
+                           BenchRng_t * pxRng )
+{
+    char cLabel[ 24 ];
+
+    for( size_t i = 0; i < ( sizeof( xCurves ) / sizeof( xCurves[ 0 ] ) ); i++ )
+    {
+        CycleStats_t xSignStats = { 0 };
+        CycleStats_t xVerifyStats = { 0 };
+        mbedtls_ecp_group xGrp;
+        mbedtls_ecp_point xQ;
+        mbedtls_mpi xD, xR, xS;
+        int lError;
+
+        mbedtls_ecp_group_init( &xGrp );
+        mbedtls_ecp_point_init( &xQ );
+        mbedtls_mpi_init( &xD );
+        mbedtls_mpi_init( &xR );
+        mbedtls_mpi_init( &xS );
+
+        lError = mbedtls_ecp_group_load( &xGrp, xCurves[ i ].xId );
+
+        if( lError == 0 )
+        {
+            lError = mbedtls_ecp_gen_keypair( &xGrp, &xD, &xQ, mbedtls_ctr_drbg_random, &( pxRng->xDrbg ) );
+        }
+
+        ( void ) snprintf( cLabel, sizeof( cLabel ), "ecdsa-sign-%s", xCurves[ i ].pcName );
+
+        for( uint32_t ulOp = 0; ( ulOp < CRYPTOBENCH_PK_OPS ) && ( lError == 0 ); ulOp++ )
+        {
+            uint32_t ulStart = DWT->CYCCNT;
+
+            lError = mbedtls_ecdsa_sign( &xGrp, &xR, &xS, &xD, ucBenchHash, sizeof( ucBenchHash ),
+                                         mbedtls_ctr_drbg_random, &( pxRng->xDrbg ) );
+            vRecordCycles( &xSignStats, ulStart );
+        }
+
+        if( lError != 0 )
+        {
+            prvPrintError( pxCIO, cLabel, CRYPTOBENCH_IMPL_ECDSA_SIGN, lError );
+        }
+        else
+        {
+            prvPrintResult( pxCIO, cLabel, CRYPTOBENCH_IMPL_ECDSA_SIGN, &xSignStats, 0 );
+
+            ( void ) snprintf( cLabel, sizeof( cLabel ), "ecdsa-verify-%s", xCurves[ i ].pcName );
+
+            for( uint32_t ulOp = 0; ( ulOp < CRYPTOBENCH_PK_OPS ) && ( lError == 0 ); ulOp++ )
+            {
+                uint32_t ulStart = DWT->CYCCNT;
+
+                lError = mbedtls_ecdsa_verify( &xGrp, ucBenchHash, sizeof( ucBenchHash ), &xQ, &xR, &xS );
+                vRecordCycles( &xVerifyStats, ulStart );
+            }
+
+            if( lError != 0 )
+            {
+                prvPrintError( pxCIO, cLabel, CRYPTOBENCH_IMPL_ECDSA_VERIFY, lError );
+            }
+            else
+            {
+                prvPrintResult( pxCIO, cLabel, CRYPTOBENCH_IMPL_ECDSA_VERIFY, &xVerifyStats, 0 );
+            }
+        }
+
+        mbedtls_mpi_free( &xS );
+        mbedtls_mpi_free( &xR );
+        mbedtls_mpi_free( &xD );
+        mbedtls_ecp_point_free( &xQ );
+        mbedtls_ecp_group_free( &xGrp );
+    }
+}
+#endif /* MBEDTLS_ECDSA_C */
+
+#if defined( MBEDTLS_ECDH_C )
+static void prvBenchEcdh( ConsoleIO_t * const pxCIO,
+                          BenchRng_t * pxRng )
+{
+    char cLabel[ 24 ];
+
+    for( size_t i = 0; i < ( sizeof( xCurves ) / sizeof( xCurves[ 0 ] ) ); i++ )
+    {
+        CycleStats_t xGenStats = { 0 };
+        CycleStats_t xSharedStats = { 0 };
+        mbedtls_ecp_group xGrp;
+        mbedtls_ecp_point xQ, xPeerQ;
+        mbedtls_mpi xD, xPeerD, xZ;
+        int lError;
+
+        mbedtls_ecp_group_init( &xGrp );
+        mbedtls_ecp_point_init( &xQ );
+        mbedtls_ecp_point_init( &xPeerQ );
+        mbedtls_mpi_init( &xD );
+        mbedtls_mpi_init( &xPeerD );
+        mbedtls_mpi_init( &xZ );
+
+        lError = mbedtls_ecp_group_load( &xGrp, xCurves[ i ].xId );
+
+        if( lError == 0 )
+        {
+            lError = mbedtls_ecdh_gen_public( &xGrp, &xPeerD, &xPeerQ,
+                                              mbedtls_ctr_drbg_random, &( pxRng->xDrbg ) );
+        }
+
+        ( void ) snprintf( cLabel, sizeof( cLabel ), "ecdh-gen-%s", xCurves[ i ].pcName );
+
+        for( uint32_t ulOp = 0; ( ulOp < CRYPTOBENCH_PK_OPS ) && ( lError == 0 ); ulOp++ )
+        {
+            uint32_t ulStart = DWT->CYCCNT;
+
+            lError = mbedtls_ecdh_gen_public( &xGrp, &xD, &xQ,
+                                              mbedtls_ctr_drbg_random, &( pxRng->xDrbg ) );
+            vRecordCycles( &xGenStats, ulStart );
+        }
+
+        if( lError != 0 )
+        {
+            prvPrintError( pxCIO, cLabel, CRYPTOBENCH_IMPL_ECDH_GEN, lError );
+        }
+        else
+        {
+            prvPrintResult( pxCIO, cLabel, CRYPTOBENCH_IMPL_ECDH_GEN, &xGenStats, 0 );
+
+            ( void ) snprintf( cLabel, sizeof( cLabel ), "ecdh-shared-%s", xCurves[ i ].pcName );
+
+            for( uint32_t ulOp = 0; ( ulOp < CRYPTOBENCH_PK_OPS ) && ( lError == 0 ); ulOp++ )
+            {
+                uint32_t ulStart = DWT->CYCCNT;
+
+                lError = mbedtls_ecdh_compute_shared( &xGrp, &xZ, &xPeerQ, &xD,
+                                                      mbedtls_ctr_drbg_random, &( pxRng->xDrbg ) );
+                vRecordCycles( &xSharedStats, ulStart );
+            }
+
+            if( lError != 0 )
+            {
+                prvPrintError( pxCIO, cLabel, CRYPTOBENCH_IMPL_ECDH_SHARED, lError );
+            }
+            else
+            {
+                prvPrintResult( pxCIO, cLabel, CRYPTOBENCH_IMPL_ECDH_SHARED, &xSharedStats, 0 );
+            }
+        }
+
+        mbedtls_mpi_free( &xZ );
+        mbedtls_mpi_free( &xPeerD );
+        mbedtls_mpi_free( &xD );
+        mbedtls_ecp_point_free( &xPeerQ );
+        mbedtls_ecp_point_free( &xQ );
+        mbedtls_ecp_group_free( &xGrp );
+    }
+}
+#endif /* MBEDTLS_ECDH_C */
+
+#if defined( MBEDTLS_RSA_C ) && defined( MBEDTLS_GENPRIME )
+static void prvBenchRsa( ConsoleIO_t * const pxCIO,
+                         BenchRng_t * pxRng )
+{
+    CycleStats_t xStats = { 0 };
+    mbedtls_rsa_context xRsa;
+    uint8_t * pucSig = NULL;
+    int lError;
+
+    pxCIO->print( "Generating an RSA-2048 key, this may take a while...\r\n" );
+
+    mbedtls_rsa_init( &xRsa );
+
+    pucSig = pvPortMalloc( CRYPTOBENCH_RSA_BITS / 8 );
+
+    if( pucSig == NULL )
+    {
+        lError = MBEDTLS_ERR_RSA_BAD_INPUT_DATA;
+    }
+    else
+    {
+        lError = mbedtls_rsa_gen_key( &xRsa, mbedtls_ctr_drbg_random, &( pxRng->xDrbg ),
+                                      CRYPTOBENCH_RSA_BITS, CRYPTOBENCH_RSA_EXPONENT );
+    }
+
+    if( lError == 0 )
+    {
+        lError = mbedtls_rsa_pkcs1_sign( &xRsa, mbedtls_ctr_drbg_random, &( pxRng->xDrbg ),
+                                         MBEDTLS_MD_SHA256, sizeof( ucBenchHash ), ucBenchHash, pucSig );
+    }
+
+    for( uint32_t ulOp = 0; ( ulOp < CRYPTOBENCH_PK_OPS ) && ( lError == 0 ); ulOp++ )
+    {
+        uint32_t ulStart = DWT->CYCCNT;
+
+        lError = mbedtls_rsa_pkcs1_verify( &xRsa, MBEDTLS_MD_SHA256,
+                                           sizeof( ucBenchHash ), ucBenchHash, pucSig );
+        vRecordCycles( &xStats, ulStart );
+    }
+
+    if( lError != 0 )
+    {
+        prvPrintError( pxCIO, "rsa-verify-2048", CRYPTOBENCH_IMPL_RSA, lError );
+    }
+    else
+    {
+        prvPrintResult( pxCIO, "rsa-verify-2048", CRYPTOBENCH_IMPL_RSA, &xStats, 0 );
+    }
+
+    vPortFree( pucSig );
+    mbedtls_rsa_free( &xRsa );
+}
+#endif /* MBEDTLS_RSA_C && MBEDTLS_GENPRIME */
+
+#if defined( MBEDTLS_ENTROPY_HARDWARE_ALT )
+static void prvBenchTrng( ConsoleIO_t * const pxCIO,
+                          uint8_t * pucOut )
+{
+    CycleStats_t xStats = { 0 };
+    int lError = 0;
+
+    for( uint32_t ulOp = 0;
+         ( ulOp < ( CRYPTOBENCH_TRNG_BYTES / CRYPTOBENCH_TRNG_CHUNK_LEN ) ) && ( lError == 0 );
+         ulOp++ )
+    {
+        size_t uxLen = 0;
+        uint32_t ulStart = DWT->CYCCNT;
+
+        lError = mbedtls_hardware_poll( NULL, pucOut, CRYPTOBENCH_TRNG_CHUNK_LEN, &uxLen );
+        vRecordCycles( &xStats, ulStart );
+
+        if( ( lError == 0 ) &&
+            ( uxLen != CRYPTOBENCH_TRNG_CHUNK_LEN ) )
+        {
+            lError = MBEDTLS_ERR_ENTROPY_SOURCE_FAILED;
+        }
+    }
+
+    if( lError != 0 )
+    {
+        prvPrintError( pxCIO, "trng-1024", "hw", lError );
+    }
+    else
+    {
+        prvPrintResult( pxCIO, "trng-1024", "hw", &xStats, CRYPTOBENCH_TRNG_CHUNK_LEN );
+    }
+}
+#endif /* MBEDTLS_ENTROPY_HARDWARE_ALT */
+
+/*-----------------------------------------------------------*/
+
+#if defined( TFM_PSA_API )
+
+static psa_status_t xPsaGenerateKey( psa_key_type_t xType,
+                                     size_t uxBits,
+                                     psa_key_usage_t xUsage,
+                                     psa_algorithm_t xAlg,
+                                     psa_key_id_t * pxKeyId )
+{
+    psa_key_attributes_t xAttrs = PSA_KEY_ATTRIBUTES_INIT;
+
+    psa_set_key_type( &xAttrs, xType );
+    psa_set_key_bits( &xAttrs, uxBits );
+    psa_set_key_usage_flags( &xAttrs, xUsage );
+    psa_set_key_algorithm( &xAttrs, xAlg );
+    psa_set_key_lifetime( &xAttrs, PSA_KEY_LIFETIME_VOLATILE );
+
+    return psa_generate_key( &xAttrs, pxKeyId );
+}
+
+static void prvBenchPsaGcm( ConsoleIO_t * const pxCIO,
+                            uint8_t * pucIn,
+                            uint8_t * pucOut )
+{
+    psa_key_attributes_t xAttrs = PSA_KEY_ATTRIBUTES_INIT;
+    psa_key_id_t xKeyId = 0;
+    psa_status_t xStatus;
+    char cLabel[ 24 ];
+
+    psa_set_key_type( &xAttrs, PSA_KEY_TYPE_AES );
+    psa_set_key_bits( &xAttrs, 128 );
+    psa_set_key_usage_flags( &xAttrs, PSA_KEY_USAGE_ENCRYPT );
+    psa_set_key_algorithm( &xAttrs, PSA_ALG_GCM );
+
+    xStatus = psa_import_key( &xAttrs, ucBenchKey, 16, &xKeyId );
+
+    for( size_t i = 0; i < ( sizeof( xRecordSizes ) / sizeof( xRecordSizes[ 0 ] ) ); i++ )
+    {
+        CycleStats_t xStats = { 0 };
+        uint32_t ulOps = ulSymOps( xRecordSizes[ i ] );
+
+        ( void ) snprintf( cLabel, sizeof( cLabel ), "gcm-%u", ( unsigned int ) xRecordSizes[ i ] );
+
+        for( uint32_t ulOp = 0; ( ulOp < ulOps ) && ( xStatus == PSA_SUCCESS ); ulOp++ )
+        {
+            size_t uxOutLen = 0;
+            uint32_t ulStart = DWT->CYCCNT;
+
+            xStatus = psa_aead_encrypt( xKeyId, PSA_ALG_GCM,
+                                        ucBenchIv, sizeof( ucBenchIv ),
+                                        ucBenchAad, sizeof( ucBenchAad ),
+                                        pucIn, xRecordSizes[ i ],
+                                        pucOut, xRecordSizes[ i ] + CRYPTOBENCH_GCM_TAG_LEN,
+                                        &uxOutLen );
+            vRecordCycles( &xStats, ulStart );
+        }
+
+        if( xStatus != PSA_SUCCESS )
+        {
+            prvPrintError( pxCIO, cLabel, "psa", xStatus );
+            break;
+        }
+
+        prvPrintResult( pxCIO, cLabel, "psa", &xStats, xRecordSizes[ i ] );
+    }
+
+    ( void ) psa_destroy_key( xKeyId );
+}
+
+static void prvBenchPsaSha256( ConsoleIO_t * const pxCIO,
+                               uint8_t * pucIn )
+{
+    uint8_t ucDigest[ PSA_HASH_LENGTH( PSA_ALG_SHA_256 ) ];
+    char cLabel[ 24 ];
+
+    for( size_t i = 0; i < ( sizeof( xRecordSizes ) / sizeof( xRecordSizes[ 0 ] ) ); i++ )
+    {
+        CycleStats_t xStats = { 0 };
+        uint32_t ulOps = ulSymOps( xRecordSizes[ i ] );
+        psa_status_t xStatus = PSA_SUCCESS;
+
+        ( void ) snprintf( cLabel, sizeof( cLabel ), "sha256-%u", ( unsigned int ) xRecordSizes[ i ] );
+
+        for( uint32_t ulOp = 0; ( ulOp < ulOps ) && ( xStatus == PSA_SUCCESS ); ulOp++ )
+        {
+            size_t uxDigestLen = 0;
+            uint32_t ulStart = DWT->CYCCNT;
+
+            xStatus = psa_hash_compute( PSA_ALG_SHA_256, pucIn, xRecordSizes[ i ],
+                                        ucDigest, sizeof( ucDigest ), &uxDigestLen );
+            vRecordCycles( &xStats, ulStart );
+        }
+
+        if( xStatus != PSA_SUCCESS )
+        {
+            prvPrintError( pxCIO, cLabel, "psa", xStatus );
+            break;
+        }
+
+        prvPrintResult( pxCIO, cLabel, "psa", &xStats, xRecordSizes[ i ] );
+    }
+}
+
+static void prvBenchPsaEcdsa( ConsoleIO_t * const pxCIO )
+{
+    uint8_t ucSig[ PSA_SIGNATURE_MAX_SIZE ];
+    char cLabel[ 24 ];
+
+    for( size_t i = 0; i < ( sizeof( xCurves ) / sizeof( xCurves[ 0 ] ) ); i++ )
+    {
+        CycleStats_t xSignStats = { 0 };
+        CycleStats_t xVerifyStats = { 0 };
+        psa_key_id_t xKeyId = 0;
+        size_t uxSigLen = 0;
+        psa_status_t xStatus;
+
+        xStatus = xPsaGenerateKey( PSA_KEY_TYPE_ECC_KEY_PAIR( PSA_ECC_FAMILY_SECP_R1 ), xCurves[ i ].uxBits,
+                                   PSA_KEY_USAGE_SIGN_HASH | PSA_KEY_USAGE_VERIFY_HASH,
+                                   PSA_ALG_ECDSA( PSA_ALG_SHA_256 ), &xKeyId );
+
+        ( void ) snprintf( cLabel, sizeof( cLabel ), "ecdsa-sign-%s", xCurves[ i ].pcName );
+
+        for( uint32_t ulOp = 0; ( ulOp < CRYPTOBENCH_PK_OPS ) && ( xStatus == PSA_SUCCESS ); ulOp++ )
+        {
+            uint32_t ulStart = DWT->CYCCNT;
+
+            xStatus = psa_sign_hash( xKeyId, PSA_ALG_ECDSA( PSA_ALG_SHA_256 ),
+                                     ucBenchHash, sizeof( ucBenchHash ),
+                                     ucSig, sizeof( ucSig ), &uxSigLen );
+            vRecordCycles( &xSignStats, ulStart );
+        }
+
+        if( xStatus != PSA_SUCCESS )
+        {
+            prvPrintError( pxCIO, cLabel, "psa", xStatus );
+        }
+        else
+        {
+            prvPrintResult( pxCIO, cLabel, "psa", &xSignStats, 0 );
+
+            ( void ) snprintf( cLabel, sizeof( cLabel ), "ecdsa-verify-%s", xCurves[ i ].pcName );
+
+            for( uint32_t ulOp = 0; ( ulOp < CRYPTOBENCH_PK_OPS ) && ( xStatus == PSA_SUCCESS ); ulOp++ )
+            {
+                uint32_t ulStart = DWT->CYCCNT;
+
+                xStatus = psa_verify_hash( xKeyId, PSA_ALG_ECDSA( PSA_ALG_SHA_256 ),
+                                           ucBenchHash, sizeof( ucBenchHash ),
+                                           ucSig, uxSigLen );
+                vRecordCycles( &xVerifyStats, ulStart );
+            }
+
+            if( xStatus != PSA_SUCCESS )
+            {
+                prvPrintError( pxCIO, cLabel, "psa", xStatus );
+            }
+            else
+            {
+                prvPrintResult( pxCIO, cLabel, "psa", &xVerifyStats, 0 );
+            }
+        }
+
+        ( void ) psa_destroy_key( xKeyId );
+    }
+}
+
+static void prvBenchPsaEcdh( ConsoleIO_t * const pxCIO )
+{
+    uint8_t ucPeerPub[ PSA_EXPORT_PUBLIC_KEY_MAX_SIZE ];
+    uint8_t ucShared[ PSA_RAW_KEY_AGREEMENT_OUTPUT_MAX_SIZE ];
+    char cLabel[ 24 ];
+
+    for( size_t i = 0; i < ( sizeof( xCurves ) / sizeof( xCurves[ 0 ] ) ); i++ )
+    {
+        CycleStats_t xGenStats = { 0 };
+        CycleStats_t xSharedStats = { 0 };
+        psa_key_type_t xType = PSA_KEY_TYPE_ECC_KEY_PAIR( PSA_ECC_FAMILY_SECP_R1 );
+        psa_key_id_t xPeerKeyId = 0;
+        psa_key_id_t xKeyId = 0;
+        size_t uxPeerPubLen = 0;
+        psa_status_t xStatus;
+
+        xStatus = xPsaGenerateKey( xType, xCurves[ i ].uxBits, PSA_KEY_USAGE_DERIVE,
+                                   PSA_ALG_ECDH, &xPeerKeyId );
+
+        if( xStatus == PSA_SUCCESS )
+        {
+            xStatus = psa_export_public_key( xPeerKeyId, ucPeerPub, sizeof( ucPeerPub ), &uxPeerPubLen );
+        }
+
+        ( void ) snprintf( cLabel, sizeof( cLabel ), "ecdh-gen-%s", xCurves[ i ].pcName );
+
+        /* Ephemeral key generation as done for each handshake */
+        for( uint32_t ulOp = 0; ( ulOp < CRYPTOBENCH_PK_OPS ) && ( xStatus == PSA_SUCCESS ); ulOp++ )
+        {
+            uint32_t ulStart;
+
+            ( void ) psa_destroy_key( xKeyId );
+            xKeyId = 0;
+
+            ulStart = DWT->CYCCNT;
+            xStatus = xPsaGenerateKey( xType, xCurves[ i ].uxBits, PSA_KEY_USAGE_DERIVE,
+                                       PSA_ALG_ECDH, &xKeyId );
+            vRecordCycles( &xGenStats, ulStart );
+        }
+
+        if( xStatus != PSA_SUCCESS )
+        {
+            prvPrintError( pxCIO, cLabel, "psa", xStatus );
+        }
+        else
+        {
+            prvPrintResult( pxCIO, cLabel, "psa", &xGenStats, 0 );
+
+            ( void ) snprintf( cLabel, sizeof( cLabel ), "ecdh-shared-%s", xCurves[ i ].pcName );
+
+            for( uint32_t ulOp = 0; ( ulOp < CRYPTOBENCH_PK_OPS ) && ( xStatus == PSA_SUCCESS ); ulOp++ )
+            {
+                size_t uxSharedLen = 0;
+                uint32_t ulStart = DWT->CYCCNT;
+
+                xStatus = psa_raw_key_agreement( PSA_ALG_ECDH, xKeyId, ucPeerPub, uxPeerPubLen,
+                                                 ucShared, sizeof( ucShared ), &uxSharedLen );
+                vRecordCycles( &xSharedStats, ulStart );
+            }
+
+            if( xStatus != PSA_SUCCESS )
+            {
+                prvPrintError( pxCIO, cLabel, "psa", xStatus );
+            }
+            else
+            {
+                prvPrintResult( pxCIO, cLabel, "psa", &xSharedStats, 0 );
+            }
+        }
+
+        ( void ) psa_destroy_key( xKeyId );
+        ( void ) psa_destroy_key( xPeerKeyId );
+    }
+}
+
+static void prvBenchPsaRsa( ConsoleIO_t * const pxCIO )
+{
+    CycleStats_t xStats = { 0 };
+    psa_algorithm_t xAlg = PSA_ALG_RSA_PKCS1V15_SIGN( PSA_ALG_SHA_256 );
+    psa_key_id_t xKeyId = 0;
+    uint8_t * pucSig = NULL;
+    size_t uxSigLen = 0;
+    psa_status_t xStatus = PSA_ERROR_INSUFFICIENT_MEMORY;
+
+    pxCIO->print( "Generating an RSA-2048 key, this may take a while...\r\n" );
+
+    pucSig = pvPortMalloc( CRYPTOBENCH_RSA_BITS / 8 );
+
+    if( pucSig != NULL )
+    {
+        xStatus = xPsaGenerateKey( PSA_KEY_TYPE_RSA_KEY_PAIR, CRYPTOBENCH_RSA_BITS,
+                                   PSA_KEY_USAGE_SIGN_HASH | PSA_KEY_USAGE_VERIFY_HASH,
+                                   xAlg, &xKeyId );
+    }
+
+    if( xStatus == PSA_SUCCESS )
+    {
+        xStatus = psa_sign_hash( xKeyId, xAlg, ucBenchHash, sizeof( ucBenchHash ),
+                                 pucSig, CRYPTOBENCH_RSA_BITS / 8, &uxSigLen );
+    }
+
+    for( uint32_t ulOp = 0; ( ulOp < CRYPTOBENCH_PK_OPS ) && ( xStatus == PSA_SUCCESS ); ulOp++ )
+    {
+        uint32_t ulStart = DWT->CYCCNT;
+
+        xStatus = psa_verify_hash( xKeyId, xAlg, ucBenchHash, sizeof( ucBenchHash ),
+                                   pucSig, uxSigLen );
+        vRecordCycles( &xStats, ulStart );
+    }
+
+    if( xStatus != PSA_SUCCESS )
+    {
+        prvPrintError( pxCIO, "rsa-verify-2048", "psa", xStatus );
+    }
+    else
+    {
+        prvPrintResult( pxCIO, "rsa-verify-2048", "psa", &xStats, 0 );
+    }
+
+    ( void ) psa_destroy_key( xKeyId );
+    vPortFree( pucSig );
+}
+
+static void prvBenchPsaTrng( ConsoleIO_t * const pxCIO,
+                             uint8_t * pucOut )
+{
+    CycleStats_t xStats = { 0 };
+    psa_status_t xStatus = PSA_SUCCESS;
+
+    for( uint32_t ulOp = 0;
+         ( ulOp < ( CRYPTOBENCH_TRNG_BYTES / CRYPTOBENCH_TRNG_CHUNK_LEN ) ) && ( xStatus == PSA_SUCCESS );
+         ulOp++ )
+    {
+        uint32_t ulStart = DWT->CYCCNT;
+
+        xStatus = psa_generate_random( pucOut, CRYPTOBENCH_TRNG_CHUNK_LEN );
+        vRecordCycles( &xStats, ulStart );
+    }
+
+    if( xStatus != PSA_SUCCESS )
+    {
+        prvPrintError( pxCIO, "trng-1024", "psa", xStatus );
+    }
+    else
+    {
+        prvPrintResult( pxCIO, "trng-1024", "psa", &xStats, CRYPTOBENCH_TRNG_CHUNK_LEN );
+    }
+}
+
+#endif /* TFM_PSA_API */
+
+/*-----------------------------------------------------------*/
+
+/* Also skips the remaining tests once a background run is cancelled */
+static BaseType_t xIsSelected( const char * pcTest,
+                               const char * pcName )
+{
+    return ( ( xCliJobCancelled() == pdFALSE ) &&
+             ( ( strcmp( pcTest, "all" ) == 0 ) ||
+               ( strcmp( pcTest, pcName ) == 0 ) ) ) ? pdTRUE : pdFALSE;
+}
+
+static void prvRunTests( ConsoleIO_t * const pxCIO,
+                         const char * pcTest,
+                         BenchRng_t * pxRng,
+                         uint8_t * pucIn,
+                         uint8_t * pucOut )
+{
+    ( void ) pxRng;
+
+    if( xIsSelected( pcTest, "gcm" ) )
+    {
+#if defined( MBEDTLS_GCM_C )
+        prvBenchGcm( pxCIO, pucIn, pucOut );
+#endif
+#if defined( TFM_PSA_API )
+        prvBenchPsaGcm( pxCIO, pucIn, pucOut );
+#endif
+    }
+
+    if( xIsSelected( pcTest, "chachapoly" ) )
+    {
+#if defined( MBEDTLS_CHACHAPOLY_C )
+        prvBenchChachaPoly( pxCIO, pucIn, pucOut );
+#endif
+    }
+
+    if( xIsSelected( pcTest, "sha256" ) )
+    {
+#if defined( MBEDTLS_SHA256_C )
+        prvBenchSha256( pxCIO, pucIn );
+#endif
+#if defined( TFM_PSA_API )
+        prvBenchPsaSha256( pxCIO, pucIn );
+#endif
+    }
+
+    if( xIsSelected( pcTest, "ecdsa" ) )
+    {
+#if defined( MBEDTLS_ECDSA_C )
+        prvBenchEcdsa( pxCIO, pxRng );
+#endif
+#if defined( TFM_PSA_API )
+        prvBenchPsaEcdsa( pxCIO );
+#endif
+    }
+
+    if( xIsSelected( pcTest, "ecdh" ) )
+    {
+#if defined( MBEDTLS_ECDH_C )
+        prvBenchEcdh( pxCIO, pxRng );
+#endif
+#if defined( TFM_PSA_API )
+        prvBenchPsaEcdh( pxCIO );
+#endif
+    }
+
+    if( xIsSelected( pcTest, "rsa" ) )
+    {
+#if defined( MBEDTLS_RSA_C ) && defined( MBEDTLS_GENPRIME )
+        prvBenchRsa( pxCIO, pxRng );
+#endif
+#if defined( TFM_PSA_API )
+        prvBenchPsaRsa( pxCIO );
+#endif
+    }
+
+    if( xIsSelected( pcTest, "trng" ) )
+    {
+#if defined( MBEDTLS_ENTROPY_HARDWARE_ALT )
+        prvBenchTrng( pxCIO, pucOut );
+#endif
+#if defined( TFM_PSA_API )
+        prvBenchPsaTrng( pxCIO, pucOut );
+#endif
+    }
+}
+
+static void prvCryptoBenchCommand( ConsoleIO_t * const pxCIO,
+                                   uint32_t ulArgc,
+                                   char * ppcArgv[] )
+{
+    const char * pcTest = "all";
+    BenchRng_t * pxRng = NULL;
+    uint8_t * pucIn = NULL;
+    uint8_t * pucOut = NULL;
+    int lError;
+
+    if( ulArgc > 1 )
+    {
+        pcTest = ppcArgv[ 1 ];
+    }
+
+    if( ( strcmp( pcTest, "gcm" ) != 0 ) &&
+        ( strcmp( pcTest, "chachapoly" ) != 0 ) &&
+        ( strcmp( pcTest, "sha256" ) != 0 ) &&
+        ( strcmp( pcTest, "ecdsa" ) != 0 ) &&
+        ( strcmp( pcTest, "ecdh" ) != 0 ) &&
+        ( strcmp( pcTest, "rsa" ) != 0 ) &&
+        ( strcmp( pcTest, "trng" ) != 0 ) &&
+        ( strcmp( pcTest, "all" ) != 0 ) )
+    {
+        pxCIO->print( "Error: Unknown test. See \"help cryptobench\".\r\n" );
+        return;
+    }
+
+    pxRng = pvPortMalloc( sizeof( BenchRng_t ) );
+    pucIn = pvPortMalloc( CRYPTOBENCH_MAX_RECORD_LEN );
+    pucOut = pvPortMalloc( CRYPTOBENCH_MAX_RECORD_LEN + CRYPTOBENCH_GCM_TAG_LEN );
+
+    if( ( pxRng == NULL ) ||
+        ( pucIn == NULL ) ||
+        ( pucOut == NULL ) )
+    {
+        pxCIO->print( "Error: Failed to allocate the benchmark buffers.\r\n" );
+    }
+    else
+    {
+        mbedtls_entropy_init( &( pxRng->xEntropy ) );
+        mbedtls_ctr_drbg_init( &( pxRng->xDrbg ) );
+
+        lError = mbedtls_ctr_drbg_seed( &( pxRng->xDrbg ), mbedtls_entropy_func,
+                                        &( pxRng->xEntropy ), NULL, 0 );
+
+        if( lError != 0 )
+        {
+            prvPrintf( pxCIO, "Error: mbedtls_ctr_drbg_seed failed: %d\r\n", lError );
+        }
+        else
+        {
+            for( size_t i = 0; i < CRYPTOBENCH_MAX_RECORD_LEN; i++ )
+            {
+                pucIn[ i ] = ( uint8_t ) ( i * 7 );
+            }
+
+            /* Cycle counts are converted with SystemCoreClock, which must not change during a run */
+            vDvfsRequest( DVFS_CLIENT_CLI );
+
+            vStartCycleCounter();
+
+            prvPrintf( pxCIO, "Core clock: %lu MHz\r\n", SystemCoreClock / 1000000 );
+
+            prvRunTests( pxCIO, pcTest, pxRng, pucIn, pucOut );
+
+            vDvfsRelease( DVFS_CLIENT_CLI );
+        }
+
+        mbedtls_ctr_drbg_free( &( pxRng->xDrbg ) );
+        mbedtls_entropy_free( &( pxRng->xEntropy ) );
+    }
+
+    vPortFree( pucOut );
+    vPortFree( pucIn );
+    vPortFree( pxRng );
+}
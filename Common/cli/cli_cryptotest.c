@@ -0,0 +1,120 @@
+/*
+ * FreeRTOS STM32 Reference Integration
+ * Copyright (C) 2021 Amazon.com, Inc. or its affiliates.  All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ * http://www.FreeRTOS.org
+ * http://aws.amazon.com/freertos
+ *
+ */
+
+/* Standard includes. */
+#include <stdio.h>
+
+/* FreeRTOS includes. */
+#include "FreeRTOS.h"
+#include "task.h"
+
+#include "cli.h"
+#include "cli_prv.h"
+
+#include "mbedtls/build_info.h"
+
+#if defined( MBEDTLS_SELF_TEST )
+
+#include "mbedtls/aes.h"
+#include "mbedtls/gcm.h"
+#include "mbedtls/sha256.h"
+#include "mbedtls/sha1.h"
+#include "mbedtls/md5.h"
+
+typedef struct
+{
+    const char * pcName;
+    int ( * pxSelfTest )( int lVerbose );
+} CryptoSelfTest_t;
+
+/* The hardware accelerated primitives when the corresponding _ALT is defined */
+static const CryptoSelfTest_t xSelfTests[] =
+{
+#if defined( MBEDTLS_AES_C )
+    { "aes",    mbedtls_aes_self_test    },
+#endif
+#if defined( MBEDTLS_GCM_C )
+    { "gcm",    mbedtls_gcm_self_test    },
+#endif
+#if defined( MBEDTLS_SHA256_C )
+    { "sha256", mbedtls_sha256_self_test },
+#endif
+#if defined( MBEDTLS_SHA1_C )
+    { "sha1",   mbedtls_sha1_self_test   },
+#endif
+#if defined( MBEDTLS_MD5_C )
+    { "md5",    mbedtls_md5_self_test    },
+#endif
+};
+
+static void prvCryptoTestCommand( ConsoleIO_t * const pxCIO,
+                                  uint32_t ulArgc,
+                                  char * ppcArgv[] );
+
+const CLI_Command_Definition_t xCommandDef_cryptotest =
+{
+    "cryptotest",
+    "cryptotest\r\n"
+    "    Run the mbedtls self tests of the primitives that may be hardware accelerated.\r\n\n",
+    prvCryptoTestCommand
+};
+
+static void prvCryptoTestCommand( ConsoleIO_t * const pxCIO,
+                                  uint32_t ulArgc,
+                                  char * ppcArgv[] )
+{
+    uint32_t ulFailures = 0;
+
+    ( void ) ulArgc;
+    ( void ) ppcArgv;
+
+    for( size_t uxIndex = 0; uxIndex < ( sizeof( xSelfTests ) / sizeof( xSelfTests[ 0 ] ) ); uxIndex++ )
+    {
+        TickType_t xStart = xTaskGetTickCount();
+        int lResult = xSelfTests[ uxIndex ].pxSelfTest( 0 );
+        TickType_t xElapsed = xTaskGetTickCount() - xStart;
+
+        if( lResult != 0 )
+        {
+            ulFailures++;
+        }
+
+        ( void ) snprintf( pcCliScratchBuffer, CLI_OUTPUT_SCRATCH_BUF_LEN,
+                           "%-8s %s (%lu ms)\r\n",
+                           xSelfTests[ uxIndex ].pcName,
+                           ( lResult == 0 ) ? "passed" : "FAILED",
+                           ( unsigned long ) pdTICKS_TO_MS( xElapsed ) );
+        pxCIO->print( pcCliScratchBuffer );
+    }
+
+    ( void ) snprintf( pcCliScratchBuffer, CLI_OUTPUT_SCRATCH_BUF_LEN,
+                       "%lu of %lu self tests failed.\r\n",
+                       ( unsigned long ) ulFailures,
+                       ( unsigned long ) ( sizeof( xSelfTests ) / sizeof( xSelfTests[ 0 ] ) ) );
+    pxCIO->print( pcCliScratchBuffer );
+}
+
+#endif /* MBEDTLS_SELF_TEST */
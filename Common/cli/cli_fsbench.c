@@ -0,0 +1,644 @@
+/*
+ * FreeRTOS STM32 Reference Integration
+ * Copyright (C) 2021 Amazon.com, Inc. or its affiliates.  All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ * http://www.FreeRTOS.org
+ * http://aws.amazon.com/freertos
+ *
+
+ */
+
+/* Standard includes. */
+#include <string.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdarg.h>
+
+/* FreeRTOS includes. */
+#include "FreeRTOS.h"
+#include "task.h"
+
+#include "cli.h"
+#include "cli_prv.h"
+
+#ifndef TFM_PSA_API
+
+#include "stm32u5xx.h"
+#include "lfs.h"
+#include "fs/lfs_port.h"
+#include "kvstore.h"
+
+#define FSBENCH_DIR              "/fsbench"
+#define FSBENCH_SEQ_FILE         FSBENCH_DIR "/seq"
+#define FSBENCH_SEQ_LEN          ( 64 * 1024 )
+#define FSBENCH_CHUNK_LEN        1024
+#define FSBENCH_RAND_READS       256
+#define FSBENCH_RAND_READ_LEN    32
+#define FSBENCH_META_FILES       32
+#define FSBENCH_META_FILE_LEN    16
+#define FSBENCH_KV_COMMITS       8
+#define FSBENCH_KV_KEY           "fsbench_kv"
+#define FSBENCH_WEAR_PER_LINE    16
+
+typedef struct
+{
+    uint32_t ulCount;
+    uint32_t ulTotalUs;
+    uint32_t ulMaxUs;
+} LatencyStats_t;
+
+static void prvFsBenchCommand( ConsoleIO_t * const pxCIO,
+                               uint32_t ulArgc,
+                               char * ppcArgv[] );
+
+const CLI_Command_Definition_t xCommandDef_fsbench =
+{
+    "fsbench",
+    "fsbench [ seq | rand | meta | kv | usage | wear [ -v ] | all ]\r\n"
+    "    Measure filesystem latency and throughput and report block wear.\r\n"
+    "        seq:   Sequential write and read of a 64 KiB file.\r\n"
+    "        rand:  32 byte reads at random offsets of the same file.\r\n"
+    "        meta:  Create and remove a set of small files.\r\n"
+    "        kv:    Latency of kvstore commits.\r\n"
+    "        usage: littlefs usage and block device counters since boot.\r\n"
+    "        wear:  Erase counts per block since boot, -v lists every block.\r\n"
+    "    Without an argument, all tests are run.\r\n\n",
+    prvFsBenchCommand
+};
+
+/*-----------------------------------------------------------*/
+
+static inline void vStartCycleCounter( void )
+{
+    if( ( DWT->CTRL & DWT_CTRL_CYCCNTENA_Msk ) == 0 )
+    {
+        CoreDebug->DEMCR |= CoreDebug_DEMCR_TRCENA_Msk;
+        DWT->CYCCNT = 0;
+        DWT->CTRL |= DWT_CTRL_CYCCNTENA_Msk;
+    }
+}
+
+static inline uint32_t ulCyclesToUs( uint32_t ulCycles )
+{
+    return ulCycles / ( SystemCoreClock / 1000000 );
+}
+
+static void vRecordLatency( LatencyStats_t * pxStats,
+                            uint32_t ulStartCycles )
+{
+    uint32_t ulUs = ulCyclesToUs( DWT->CYCCNT - ulStartCycles );
+
+    pxStats->ulCount++;
+    pxStats->ulTotalUs += ulUs;
+
+    if( ulUs > pxStats->ulMaxUs )
+    {
+        pxStats->ulMaxUs = ulUs;
+    }
+}
+
+static uint32_t ulKiBPerSecond( uint32_t ulBytes,
+                                uint32_t ulUs )
+{
+    uint32_t ulRate = 0;
+
+    if( ulUs > 0 )
+    {
+        ulRate = ( uint32_t ) ( ( ( uint64_t ) ulBytes * 1000000 ) / ( ( uint64_t ) ulUs * 1024 ) );
+    }
+
+    return ulRate;
+}
+
+static void prvPrintf( ConsoleIO_t * const pxCIO,
+                       const char * pcFormat,
+                       ... ) __attribute__( ( format( printf, 2, 3 ) ) );
+
+static void prvPrintf( ConsoleIO_t * const pxCIO,
+                       const char * pcFormat,
+                       ... )
+{
+    va_list xArgs;
+    size_t xLen;
+
+    va_start( xArgs, pcFormat );
+    xLen = vsnprintf( pcCliScratchBuffer, CLI_OUTPUT_SCRATCH_BUF_LEN, pcFormat, xArgs );
+    va_end( xArgs );
+
+    if( xLen >= CLI_OUTPUT_SCRATCH_BUF_LEN )
+    {
+        xLen = CLI_OUTPUT_SCRATCH_BUF_LEN - 1;
+    }
+
+    pxCIO->write( pcCliScratchBuffer, xLen );
+}
+
+static void prvPrintLatency( ConsoleIO_t * const pxCIO,
+                             const char * pcLabel,
+                             const LatencyStats_t * pxStats )
+{
+    uint32_t ulAvgUs = 0;
+
+    if( pxStats->ulCount > 0 )
+    {
+        ulAvgUs = pxStats->ulTotalUs / pxStats->ulCount;
+    }
+
+    prvPrintf( pxCIO, "%-16s n=%-4lu avg=%8lu us  max=%8lu us\r\n",
+               pcLabel, pxStats->ulCount, ulAvgUs, pxStats->ulMaxUs );
+}
+
+/*-----------------------------------------------------------*/
+
+static BaseType_t xPrepareBenchDir( ConsoleIO_t * const pxCIO,
+                                    lfs_t * pxLfs )
+{
+    BaseType_t xSuccess = pdTRUE;
+    int lError = lfs_mkdir( pxLfs, FSBENCH_DIR );
+
+    if( ( lError != LFS_ERR_OK ) &&
+        ( lError != LFS_ERR_EXIST ) )
+    {
+        prvPrintf( pxCIO, "Error: Failed to create %s: %d\r\n", FSBENCH_DIR, lError );
+        xSuccess = pdFALSE;
+    }
+
+    return xSuccess;
+}
+
+static void vFillPattern( uint8_t * pucBuffer,
+                          size_t xLen,
+                          uint32_t ulOffset )
+{
+    for( size_t i = 0; i < xLen; i++ )
+    {
+        pucBuffer[ i ] = ( uint8_t ) ( ( ulOffset + i ) * 7 );
+    }
+}
+
+static void prvBenchSequential( ConsoleIO_t * const pxCIO,
+                                lfs_t * pxLfs,
+                                uint8_t * pucBuffer )
+{
+    lfs_file_t xFile = { 0 };
+    uint32_t ulStartCycles;
+    uint32_t ulWriteUs = 0;
+    uint32_t ulReadUs = 0;
+    uint32_t ulOffset = 0;
+    int lError;
+
+    ulStartCycles = DWT->CYCCNT;
+    lError = lfs_file_open( pxLfs, &xFile, FSBENCH_SEQ_FILE, LFS_O_WRONLY | LFS_O_CREAT | LFS_O_TRUNC );
+
+    if( lError == LFS_ERR_OK )
+    {
+        while( ( lError >= 0 ) && ( ulOffset < FSBENCH_SEQ_LEN ) )
+        {
+            vFillPattern( pucBuffer, FSBENCH_CHUNK_LEN, ulOffset );
+            lError = lfs_file_write( pxLfs, &xFile, pucBuffer, FSBENCH_CHUNK_LEN );
+            ulOffset += FSBENCH_CHUNK_LEN;
+        }
+
+        /* Closing flushes the last cached program, include it in the measurement */
+        if( lError >= 0 )
+        {
+            lError = lfs_file_close( pxLfs, &xFile );
+        }
+        else
+        {
+            ( void ) lfs_file_close( pxLfs, &xFile );
+        }
+
+        ulWriteUs = ulCyclesToUs( DWT->CYCCNT - ulStartCycles );
+    }
+
+    if( lError < 0 )
+    {
+        prvPrintf( pxCIO, "Error: Sequential write failed: %d\r\n", lError );
+    }
+    else
+    {
+        BaseType_t xMatch = pdTRUE;
+
+        ulOffset = 0;
+        ulStartCycles = DWT->CYCCNT;
+        lError = lfs_file_open( pxLfs, &xFile, FSBENCH_SEQ_FILE, LFS_O_RDONLY );
+
+        if( lError == LFS_ERR_OK )
+        {
+            while( ( lError >= 0 ) && ( ulOffset < FSBENCH_SEQ_LEN ) )
+            {
+                lError = lfs_file_read( pxLfs, &xFile, pucBuffer, FSBENCH_CHUNK_LEN );
+
+                if( lError != FSBENCH_CHUNK_LEN )
+                {
+                    lError = ( lError < 0 ) ? lError : LFS_ERR_CORRUPT;
+                }
+                else
+                {
+                    /* Checked after the read so that only the first difference costs time */
+                    if( ( xMatch == pdTRUE ) &&
+                        ( pucBuffer[ 0 ] != ( uint8_t ) ( ulOffset * 7 ) ) )
+                    {
+                        xMatch = pdFALSE;
+                    }
+
+                    ulOffset += FSBENCH_CHUNK_LEN;
+                }
+            }
+
+            ( void ) lfs_file_close( pxLfs, &xFile );
+            ulReadUs = ulCyclesToUs( DWT->CYCCNT - ulStartCycles );
+        }
+
+        if( lError < 0 )
+        {
+            prvPrintf( pxCIO, "Error: Sequential read failed: %d\r\n", lError );
+        }
+        else
+        {
+            prvPrintf( pxCIO, "seq write        %lu bytes in %lu us, %lu KiB/s\r\n",
+                       ( uint32_t ) FSBENCH_SEQ_LEN, ulWriteUs, ulKiBPerSecond( FSBENCH_SEQ_LEN, ulWriteUs ) );
+            prvPrintf( pxCIO, "seq read         %lu bytes in %lu us, %lu KiB/s%s\r\n",
+                       ( uint32_t ) FSBENCH_SEQ_LEN, ulReadUs, ulKiBPerSecond( FSBENCH_SEQ_LEN, ulReadUs ),
+                       ( xMatch == pdTRUE ) ? "" : " (data mismatch)" );
+        }
+    }
+}
+
+static void prvBenchRandomRead( ConsoleIO_t * const pxCIO,
+                                lfs_t * pxLfs,
+                                uint8_t * pucBuffer )
+{
+    lfs_file_t xFile = { 0 };
+    LatencyStats_t xStats = { 0 };
+    uint32_t ulRandom = DWT->CYCCNT | 1;
+    int lError;
+
+    lError = lfs_file_open( pxLfs, &xFile, FSBENCH_SEQ_FILE, LFS_O_RDONLY );
+
+    if( lError == LFS_ERR_OK )
+    {
+        for( uint32_t i = 0; ( i < FSBENCH_RAND_READS ) && ( lError >= 0 ); i++ )
+        {
+            uint32_t ulStartCycles;
+            lfs_soff_t xOffset;
+
+            /* xorshift32, good enough to defeat the littlefs read cache */
+            ulRandom ^= ulRandom << 13;
+            ulRandom ^= ulRandom >> 17;
+            ulRandom ^= ulRandom << 5;
+
+            xOffset = ( lfs_soff_t ) ( ulRandom % ( FSBENCH_SEQ_LEN - FSBENCH_RAND_READ_LEN ) );
+
+            ulStartCycles = DWT->CYCCNT;
+            lError = lfs_file_seek( pxLfs, &xFile, xOffset, LFS_SEEK_SET );
+
+            if( lError >= 0 )
+            {
+                lError = lfs_file_read( pxLfs, &xFile, pucBuffer, FSBENCH_RAND_READ_LEN );
+            }
+
+            vRecordLatency( &xStats, ulStartCycles );
+        }
+
+        ( void ) lfs_file_close( pxLfs, &xFile );
+    }
+
+    if( lError < 0 )
+    {
+        prvPrintf( pxCIO, "Error: Random read failed: %d. Does %s exist?\r\n", lError, FSBENCH_SEQ_FILE );
+    }
+    else
+    {
+        prvPrintLatency( pxCIO, "rand read 32B", &xStats );
+    }
+}
+
+static void prvBenchMetadata( ConsoleIO_t * const pxCIO,
+                              lfs_t * pxLfs,
+                              uint8_t * pucBuffer )
+{
+    LatencyStats_t xCreate = { 0 };
+    LatencyStats_t xRemove = { 0 };
+    char pcPath[ 32 ];
+    int lError = LFS_ERR_OK;
+
+    vFillPattern( pucBuffer, FSBENCH_META_FILE_LEN, 0 );
+
+    for( uint32_t i = 0; ( i < FSBENCH_META_FILES ) && ( lError >= 0 ); i++ )
+    {
+        lfs_file_t xFile = { 0 };
+        uint32_t ulStartCycles = DWT->CYCCNT;
+
+        ( void ) snprintf( pcPath, sizeof( pcPath ), FSBENCH_DIR "/m%02lu", i );
+
+        lError = lfs_file_open( pxLfs, &xFile, pcPath, LFS_O_WRONLY | LFS_O_CREAT | LFS_O_TRUNC );
+
+        if( lError == LFS_ERR_OK )
+        {
+            lError = lfs_file_write( pxLfs, &xFile, pucBuffer, FSBENCH_META_FILE_LEN );
+
+            if( lError >= 0 )
+            {
+                lError = lfs_file_close( pxLfs, &xFile );
+            }
+            else
+            {
+                ( void ) lfs_file_close( pxLfs, &xFile );
+            }
+        }
+
+        vRecordLatency( &xCreate, ulStartCycles );
+    }
+
+    /* Remove whatever was created, even after a failure */
+    for( uint32_t i = 0; i < xCreate.ulCount; i++ )
+    {
+        uint32_t ulStartCycles = DWT->CYCCNT;
+        int lRemoveError;
+
+        ( void ) snprintf( pcPath, sizeof( pcPath ), FSBENCH_DIR "/m%02lu", i );
+
+        lRemoveError = lfs_remove( pxLfs, pcPath );
+
+        vRecordLatency( &xRemove, ulStartCycles );
+
+        if( ( lError >= 0 ) &&
+            ( lRemoveError < 0 ) &&
+            ( lRemoveError != LFS_ERR_NOENT ) )
+        {
+            lError = lRemoveError;
+        }
+    }
+
+    if( lError < 0 )
+    {
+        prvPrintf( pxCIO, "Error: Metadata test failed: %d\r\n", lError );
+    }
+    else
+    {
+        prvPrintLatency( pxCIO, "create 16B file", &xCreate );
+        prvPrintLatency( pxCIO, "remove file", &xRemove );
+    }
+}
+
+static void prvBenchKvCommit( ConsoleIO_t * const pxCIO )
+{
+    static const uint32_t ulDefault = 0;
+    LatencyStats_t xStats = { 0 };
+    BaseType_t xSuccess = pdTRUE;
+    KVStoreKey_t xKey;
+
+    /* A dedicated key, so that the test does not disturb the live configuration */
+    xKey = KVStore_xRegisterKey( FSBENCH_KV_KEY, KV_TYPE_UINT32, sizeof( uint32_t ), &ulDefault );
+
+    if( xKey == KV_STORE_KEY_INVALID )
+    {
+        pxCIO->print( "Error: Failed to register the " FSBENCH_KV_KEY " kvstore key.\r\n" );
+    }
+    else
+    {
+        uint32_t ulValue = KVStore_getUInt32( xKey, NULL );
+
+        for( uint32_t i = 0; ( i < FSBENCH_KV_COMMITS ) && ( xSuccess == pdTRUE ); i++ )
+        {
+            uint32_t ulStartCycles = DWT->CYCCNT;
+
+            /* A changed value every time, unchanged values are not written */
+            ulValue++;
+            xSuccess = KVStore_setUInt32( xKey, ulValue );
+
+            /* Unlike KVStore_xCommitChanges, also waits for the write in write-back mode */
+            if( xSuccess == pdTRUE )
+            {
+                xSuccess = KVStore_xFlush();
+            }
+
+            vRecordLatency( &xStats, ulStartCycles );
+        }
+
+        if( xSuccess == pdTRUE )
+        {
+            prvPrintLatency( pxCIO, "kvstore commit", &xStats );
+        }
+        else
+        {
+            pxCIO->print( "Error: kvstore commit failed.\r\n" );
+        }
+    }
+}
+
+static void prvReportUsage( ConsoleIO_t * const pxCIO,
+                            lfs_t * pxLfs )
+{
+    lfs_ssize_t xBlocksUsed = lfs_fs_size( pxLfs );
+    LfsPortStats_t xStats = { 0 };
+
+    if( xBlocksUsed < 0 )
+    {
+        prvPrintf( pxCIO, "Error: lfs_fs_size failed: %ld\r\n", ( int32_t ) xBlocksUsed );
+    }
+    else
+    {
+        uint32_t ulBlockCount = pxLfs->cfg->block_count;
+        uint32_t ulBlockSize = pxLfs->cfg->block_size;
+
+        prvPrintf( pxCIO, "usage            %ld / %lu blocks of %lu bytes (%lu%%)\r\n",
+                   ( int32_t ) xBlocksUsed, ulBlockCount, ulBlockSize,
+                   ( uint32_t ) ( ( ( uint32_t ) xBlocksUsed * 100 ) / ulBlockCount ) );
+    }
+
+    vLfsPortOspiGetStats( &xStats );
+
+    prvPrintf( pxCIO, "reads            %lu (%lu bytes)\r\n", xStats.ulReads, xStats.ulReadBytes );
+    prvPrintf( pxCIO, "programs         %lu (%lu bytes)\r\n", xStats.ulProgs, xStats.ulProgBytes );
+    prvPrintf( pxCIO, "erases           %lu, %lu of them pre-erased\r\n", xStats.ulErases, xStats.ulErasesSkipped );
+    prvPrintf( pxCIO, "background erase %lu\r\n", xStats.ulBackgroundErases );
+}
+
+static void prvReportWear( ConsoleIO_t * const pxCIO,
+                           BaseType_t xVerbose )
+{
+    size_t xBlockCount = 0;
+    const uint16_t * pusCounts = pusLfsPortOspiEraseCounts( &xBlockCount );
+    uint32_t ulMin = UINT16_MAX;
+    uint32_t ulMax = 0;
+    uint32_t ulTotal = 0;
+
+    for( size_t i = 0; i < xBlockCount; i++ )
+    {
+        ulTotal += pusCounts[ i ];
+
+        if( pusCounts[ i ] < ulMin )
+        {
+            ulMin = pusCounts[ i ];
+        }
+
+        if( pusCounts[ i ] > ulMax )
+        {
+            ulMax = pusCounts[ i ];
+        }
+    }
+
+    if( xBlockCount > 0 )
+    {
+        prvPrintf( pxCIO, "erase count      min=%lu max=%lu mean=%lu.%02lu over %u blocks\r\n",
+                   ulMin, ulMax, ulTotal / xBlockCount,
+                   ( ( ulTotal % xBlockCount ) * 100 ) / xBlockCount, ( unsigned int ) xBlockCount );
+    }
+
+    if( xVerbose == pdTRUE )
+    {
+        for( size_t i = 0; i < xBlockCount; i += FSBENCH_WEAR_PER_LINE )
+        {
+            size_t xLen = snprintf( pcCliScratchBuffer, CLI_OUTPUT_SCRATCH_BUF_LEN, "%5u:", ( unsigned int ) i );
+
+            for( size_t j = i; ( j < xBlockCount ) && ( j < ( i + FSBENCH_WEAR_PER_LINE ) ) && ( xLen < CLI_OUTPUT_SCRATCH_BUF_LEN ); j++ )
+            {
+                xLen += snprintf( &( pcCliScratchBuffer[ xLen ] ), CLI_OUTPUT_SCRATCH_BUF_LEN - xLen, " %5u", pusCounts[ j ] );
+            }
+
+            if( xLen >= CLI_OUTPUT_SCRATCH_BUF_LEN )
+            {
+                xLen = CLI_OUTPUT_SCRATCH_BUF_LEN - 1;
+            }
+
+            pxCIO->write( pcCliScratchBuffer, xLen );
+            pxCIO->print( "\r\n" );
+        }
+    }
+}
+
+/*-----------------------------------------------------------*/
+
+static void prvRunFileTests( ConsoleIO_t * const pxCIO,
+                             lfs_t * pxLfs,
+                             const char * pcTest,
+                             BaseType_t xVerbose )
+{
+    BaseType_t xAll = ( strcmp( pcTest, "all" ) == 0 );
+    uint8_t * pucBuffer = pvPortMalloc( FSBENCH_CHUNK_LEN );
+
+    if( pucBuffer == NULL )
+    {
+        pxCIO->print( "Error: Failed to allocate the test buffer.\r\n" );
+    }
+    else if( xPrepareBenchDir( pxCIO, pxLfs ) == pdTRUE )
+    {
+        vStartCycleCounter();
+
+        /* The random read test reads back the file written by the sequential test */
+        if( ( xAll == pdTRUE ) ||
+            ( strcmp( pcTest, "seq" ) == 0 ) ||
+            ( strcmp( pcTest, "rand" ) == 0 ) )
+        {
+            prvBenchSequential( pxCIO, pxLfs, pucBuffer );
+        }
+
+        /* Later tests are skipped once a background run is cancelled */
+        if( ( xCliJobCancelled() == pdFALSE ) &&
+            ( ( xAll == pdTRUE ) ||
+              ( strcmp( pcTest, "rand" ) == 0 ) ) )
+        {
+            prvBenchRandomRead( pxCIO, pxLfs, pucBuffer );
+        }
+
+        if( ( xCliJobCancelled() == pdFALSE ) &&
+            ( ( xAll == pdTRUE ) ||
+              ( strcmp( pcTest, "meta" ) == 0 ) ) )
+        {
+            prvBenchMetadata( pxCIO, pxLfs, pucBuffer );
+        }
+
+        ( void ) lfs_remove( pxLfs, FSBENCH_SEQ_FILE );
+        ( void ) lfs_remove( pxLfs, FSBENCH_DIR );
+
+        if( ( xAll == pdTRUE ) &&
+            ( xCliJobCancelled() == pdFALSE ) )
+        {
+            prvBenchKvCommit( pxCIO );
+            prvReportUsage( pxCIO, pxLfs );
+            prvReportWear( pxCIO, xVerbose );
+        }
+    }
+    else
+    {
+        /* Error already reported */
+    }
+
+    if( pucBuffer != NULL )
+    {
+        vPortFree( pucBuffer );
+    }
+}
+
+/*-----------------------------------------------------------*/
+
+static void prvFsBenchCommand( ConsoleIO_t * const pxCIO,
+                               uint32_t ulArgc,
+                               char * ppcArgv[] )
+{
+    const char * pcTest = "all";
+    BaseType_t xVerbose = pdFALSE;
+    lfs_t * pxLfs = pxGetDefaultFsCtx();
+
+    if( ulArgc > 1 )
+    {
+        pcTest = ppcArgv[ 1 ];
+    }
+
+    if( ( ulArgc > 2 ) &&
+        ( strcmp( ppcArgv[ 2 ], "-v" ) == 0 ) )
+    {
+        xVerbose = pdTRUE;
+    }
+
+    if( pxLfs == NULL )
+    {
+        pxCIO->print( "Error: The filesystem is not mounted.\r\n" );
+    }
+    else if( strcmp( pcTest, "usage" ) == 0 )
+    {
+        prvReportUsage( pxCIO, pxLfs );
+    }
+    else if( strcmp( pcTest, "wear" ) == 0 )
+    {
+        prvReportWear( pxCIO, xVerbose );
+    }
+    else if( strcmp( pcTest, "kv" ) == 0 )
+    {
+        vStartCycleCounter();
+        prvBenchKvCommit( pxCIO );
+    }
+    else if( ( strcmp( pcTest, "seq" ) != 0 ) &&
+             ( strcmp( pcTest, "rand" ) != 0 ) &&
+             ( strcmp( pcTest, "meta" ) != 0 ) &&
+             ( strcmp( pcTest, "all" ) != 0 ) )
+    {
+        pxCIO->print( "Error: Unknown test. See \"help fsbench\".\r\n" );
+    }
+    else
+    {
+        prvRunFileTests( pxCIO, pxLfs, pcTest, xVerbose );
+    }
+}
+
+#endif /* TFM_PSA_API */
@@ -0,0 +1,235 @@
+/*
+ * FreeRTOS STM32 Reference Integration
+ *
+ * Copyright (c) 2022 Amazon.com, Inc. or its affiliates. All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+/* Standard includes. */
+#include <string.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+/* FreeRTOS includes. */
+#include "FreeRTOS.h"
+#include "task.h"
+
+#include "cli.h"
+#include "cli_prv.h"
+
+#include "net_iperf.h"
+
+/* Default length of a client test, or time a server waits for a client */
+#define IPERF_CLI_DEFAULT_S    10
+#define IPERF_CLI_SERVER_S     60
+#define IPERF_CLI_MAX_S        600
+
+static void prvIperfCommand( ConsoleIO_t * const pxCIO,
+                             uint32_t ulArgc,
+                             char * ppcArgv[] );
+
+const CLI_Command_Definition_t xCommandDef_iperf =
+{
+    "iperf",
+    "iperf\r\n"
+    "    iperf -c <host> [ -u | --tls ] [ -p <port> ] [ -t <s> ] [ -l <len> ] [ -b <kbit/s> ]\r\n"
+    "        Send to an iperf2 server (\"iperf -s [-u]\") for -t seconds (10).\r\n"
+    "        -u sends UDP datagrams of -l bytes (1470) at -b kbit/s (1000) and prints the\r\n"
+    "        loss and jitter reported by the server. --tls sends through mbedtls_transport\r\n"
+    "        to a TLS proxy in front of the server, verified with the root_ca_cert.\r\n\n"
+    "    iperf -s [ -u ] [ -p <port> ] [ -t <s> ]\r\n"
+    "        Wait up to -t seconds (60) for one test of an iperf2 client, \"iperf -c <device> [-u]\".\r\n"
+    "        TCP tests are served by the lwiperf server that runs from boot on port 5001.\r\n\n"
+    "    Results give the throughput, the TCP retransmits of the whole stack and the CPU load.\r\n\n",
+    prvIperfCommand
+};
+
+/*-----------------------------------------------------------*/
+
+static BaseType_t prvParseUInt( const char * pcArg,
+                                uint32_t ulMax,
+                                uint32_t * pulValue )
+{
+    BaseType_t xSuccess = pdFALSE;
+    char * pcEnd = NULL;
+    uint32_t ulValue;
+
+    if( pcArg != NULL )
+    {
+        ulValue = strtoul( pcArg, &pcEnd, 10 );
+
+        if( ( pcEnd != pcArg ) && ( *pcEnd == '\0' ) && ( ulValue <= ulMax ) )
+        {
+            *pulValue = ulValue;
+            xSuccess = pdTRUE;
+        }
+    }
+
+    return xSuccess;
+}
+
+/*-----------------------------------------------------------*/
+
+static void prvPrintResult( ConsoleIO_t * const pxCIO,
+                            const NetIperfParams_t * pxParams,
+                            const NetIperfResult_t * pxResult )
+{
+    static const char * const pcProtoNames[] = { "tcp", "udp", "tls" };
+
+    ( void ) snprintf( pcCliScratchBuffer, CLI_OUTPUT_SCRATCH_BUF_LEN,
+                       "[%s %s] %lu.%03lu s, %lu KiB, %lu kbit/s, %lu retransmits, CPU %lu.%lu %%\r\n",
+                       pcProtoNames[ pxParams->xProto ],
+                       ( pxParams->pcHost != NULL ) ? "client" : "server",
+                       ( unsigned long ) ( pxResult->ulMs / 1000U ),
+                       ( unsigned long ) ( pxResult->ulMs % 1000U ),
+                       ( unsigned long ) ( pxResult->ullBytes / 1024U ),
+                       ( unsigned long ) pxResult->ulKbps,
+                       ( unsigned long ) pxResult->ulRexmit,
+                       ( unsigned long ) ( pxResult->ulCpuPermille / 10U ),
+                       ( unsigned long ) ( pxResult->ulCpuPermille % 10U ) );
+    pxCIO->print( pcCliScratchBuffer );
+
+    if( pxResult->xUdpReport == pdTRUE )
+    {
+        uint32_t ulSent = pxResult->ulDatagrams + pxResult->ulLost;
+
+        ( void ) snprintf( pcCliScratchBuffer, CLI_OUTPUT_SCRATCH_BUF_LEN,
+                           "[udp] %lu / %lu datagrams lost (%lu %%), %lu out of order, jitter %lu us\r\n",
+                           ( unsigned long ) pxResult->ulLost,
+                           ( unsigned long ) ulSent,
+                           ( unsigned long ) ( ( ulSent > 0 ) ? ( ( pxResult->ulLost * 100U ) / ulSent ) : 0 ),
+                           ( unsigned long ) pxResult->ulOutOfOrder,
+                           ( unsigned long ) pxResult->ulJitterUs );
+        pxCIO->print( pcCliScratchBuffer );
+    }
+}
+
+/*-----------------------------------------------------------*/
+
+static void prvIperfCommand( ConsoleIO_t * const pxCIO,
+                             uint32_t ulArgc,
+                             char * ppcArgv[] )
+{
+    NetIperfParams_t xParams =
+    {
+        .xProto       = NET_IPERF_TCP,
+        .pcHost       = NULL,
+        .usPort       = NET_IPERF_PORT,
+        .ulDurationMs = 0,
+        .ulRateKbps   = NET_IPERF_UDP_KBPS,
+        .uxLen        = 0,
+    };
+    NetIperfResult_t xResult;
+    BaseType_t xServer = pdFALSE;
+    BaseType_t xValid = pdTRUE;
+    uint32_t ulSeconds = 0;
+    uint32_t ulLen = 0;
+    uint32_t ulValue = 0;
+
+    for( uint32_t i = 1; ( i < ulArgc ) && ( xValid == pdTRUE ); i++ )
+    {
+        const char * pcNext = ( ( i + 1 ) < ulArgc ) ? ppcArgv[ i + 1 ] : NULL;
+
+        if( strcmp( ppcArgv[ i ], "-s" ) == 0 )
+        {
+            xServer = pdTRUE;
+        }
+        else if( strcmp( ppcArgv[ i ], "-u" ) == 0 )
+        {
+            xParams.xProto = NET_IPERF_UDP;
+        }
+        else if( strcmp( ppcArgv[ i ], "--tls" ) == 0 )
+        {
+            xParams.xProto = NET_IPERF_TLS;
+        }
+        else if( ( strcmp( ppcArgv[ i ], "-c" ) == 0 ) && ( pcNext != NULL ) )
+        {
+            xParams.pcHost = pcNext;
+            i++;
+        }
+        else if( ( strcmp( ppcArgv[ i ], "-p" ) == 0 ) &&
+                 ( prvParseUInt( pcNext, UINT16_MAX, &ulValue ) == pdTRUE ) )
+        {
+            xParams.usPort = ( uint16_t ) ulValue;
+            i++;
+        }
+        else if( ( strcmp( ppcArgv[ i ], "-t" ) == 0 ) &&
+                 ( prvParseUInt( pcNext, IPERF_CLI_MAX_S, &ulSeconds ) == pdTRUE ) )
+        {
+            i++;
+        }
+        else if( ( strcmp( ppcArgv[ i ], "-l" ) == 0 ) &&
+                 ( prvParseUInt( pcNext, UINT16_MAX, &ulLen ) == pdTRUE ) )
+        {
+            i++;
+        }
+        else if( ( strcmp( ppcArgv[ i ], "-b" ) == 0 ) &&
+                 ( prvParseUInt( pcNext, UINT32_MAX, &ulValue ) == pdTRUE ) )
+        {
+            xParams.ulRateKbps = ulValue;
+            i++;
+        }
+        else
+        {
+            pxCIO->print( "Error: Invalid argument: " );
+            pxCIO->print( ppcArgv[ i ] );
+            pxCIO->print( "\r\n" );
+            xValid = pdFALSE;
+        }
+    }
+
+    if( xValid == pdFALSE )
+    {
+        /* Already reported */
+    }
+    else if( ( xServer == pdTRUE ) == ( xParams.pcHost != NULL ) )
+    {
+        pxCIO->print( "Error: Select one of -s or -c <host>. See \"help iperf\".\r\n" );
+    }
+    else
+    {
+        if( ulSeconds == 0 )
+        {
+            ulSeconds = ( xServer == pdTRUE ) ? IPERF_CLI_SERVER_S : IPERF_CLI_DEFAULT_S;
+        }
+
+        if( ulLen == 0 )
+        {
+            ulLen = ( xParams.xProto == NET_IPERF_UDP ) ? NET_IPERF_UDP_LEN : NET_IPERF_TCP_LEN;
+        }
+
+        xParams.ulDurationMs = ulSeconds * 1000U;
+        xParams.uxLen = ulLen;
+
+        if( xServer == pdTRUE )
+        {
+            pxCIO->print( "Waiting for an iperf client...\r\n" );
+        }
+
+        if( xNetIperfRun( &xParams, &xResult ) == pdTRUE )
+        {
+            prvPrintResult( pxCIO, &xParams, &xResult );
+        }
+        else
+        {
+            pxCIO->print( "Error: The iperf test failed, see the log for details.\r\n" );
+        }
+    }
+}
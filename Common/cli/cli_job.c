@@ -0,0 +1,341 @@
+/*
+ * FreeRTOS STM32 Reference Integration
+ *
+ * Copyright (c) 2022 Amazon.com, Inc. or its affiliates. All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+/*
+ * Background execution of CLI commands.
+ *
+ * A command line ending with " &" runs in a separate task while the cli task
+ * keeps reading input. Only one job runs at a time. Commands opt into progress
+ * reporting and cancellation with vCliJobProgress and xCliJobCancelled, which
+ * do nothing when called from the cli task. Commands that read console input
+ * must not be run in the background.
+ */
+
+#include <string.h>
+#include <stdio.h>
+
+#include "FreeRTOS.h"
+#include "task.h"
+
+#include "cli.h"
+#include "cli_prv.h"
+
+#ifndef CLI_JOB_STACK_WORDS
+#define CLI_JOB_STACK_WORDS    2048
+#endif
+
+/* Below the cli task so that the console stays responsive */
+#ifndef CLI_JOB_PRIORITY
+#define CLI_JOB_PRIORITY       9
+#endif
+
+typedef struct CliJob
+{
+    TaskHandle_t xTask;
+    ConsoleIO_t * pxCIO;
+    const CLI_Command_Definition_t * pxCommand;
+    uint32_t ulId;
+    TickType_t xStartTicks;
+    volatile BaseType_t xCancel;
+    volatile uint32_t ulDone;
+    volatile uint32_t ulTotal;
+    uint32_t ulArgc;
+    char ** ppcArgv; /* Followed by the argument strings in the same allocation */
+    char pcScratch[ CLI_OUTPUT_SCRATCH_BUF_LEN ];
+} CliJob_t;
+
+static char pcCliMainScratchBuffer[ CLI_OUTPUT_SCRATCH_BUF_LEN ];
+
+/* Set while a job runs, cleared by the job task before it frees the job */
+static CliJob_t * volatile pxActiveJob = NULL;
+static uint32_t ulLastJobId = 0;
+
+static void prvJobsCommand( ConsoleIO_t * const pxCIO,
+                            uint32_t ulArgc,
+                            char * ppcArgv[] );
+
+static void prvCancelCommand( ConsoleIO_t * const pxCIO,
+                              uint32_t ulArgc,
+                              char * ppcArgv[] );
+
+const CLI_Command_Definition_t xCommandDef_jobs =
+{
+    "jobs",
+    "jobs\r\n"
+    "    List the command running in the background.\r\n"
+    "    A command line ending with \" &\" runs in the background, e.g. \"cryptobench all &\".\r\n\n",
+    prvJobsCommand
+};
+
+const CLI_Command_Definition_t xCommandDef_cancel =
+{
+    "cancel",
+    "cancel\r\n"
+    "    Ask the command running in the background to stop.\r\n\n",
+    prvCancelCommand
+};
+
+/*-----------------------------------------------------------*/
+
+static CliJob_t * prvCurrentJob( void )
+{
+    CliJob_t * pxJob = pxActiveJob;
+
+    if( ( pxJob != NULL ) &&
+        ( pxJob->xTask != xTaskGetCurrentTaskHandle() ) )
+    {
+        pxJob = NULL;
+    }
+
+    return pxJob;
+}
+
+/*-----------------------------------------------------------*/
+
+char * pcCliGetScratchBuffer( void )
+{
+    CliJob_t * pxJob = prvCurrentJob();
+
+    return ( pxJob != NULL ) ? pxJob->pcScratch : pcCliMainScratchBuffer;
+}
+
+/*-----------------------------------------------------------*/
+
+BaseType_t xCliJobCancelled( void )
+{
+    CliJob_t * pxJob = prvCurrentJob();
+
+    return ( pxJob != NULL ) ? pxJob->xCancel : pdFALSE;
+}
+
+/*-----------------------------------------------------------*/
+
+void vCliJobProgress( uint32_t ulDone,
+                      uint32_t ulTotal )
+{
+    CliJob_t * pxJob = prvCurrentJob();
+
+    if( pxJob != NULL )
+    {
+        pxJob->ulTotal = ulTotal;
+        pxJob->ulDone = ulDone;
+    }
+}
+
+/*-----------------------------------------------------------*/
+
+static void prvJobTask( void * pvParameters )
+{
+    CliJob_t * pxJob = ( CliJob_t * ) pvParameters;
+    uint32_t ulElapsedMs;
+    BaseType_t xCancelled;
+
+    pxJob->pxCommand->pxCommandInterpreter( pxJob->pxCIO, pxJob->ulArgc, pxJob->ppcArgv );
+
+    ulElapsedMs = ( uint32_t ) ( ( xTaskGetTickCount() - pxJob->xStartTicks ) * portTICK_PERIOD_MS );
+    xCancelled = pxJob->xCancel;
+
+    ( void ) snprintf( pxJob->pcScratch, CLI_OUTPUT_SCRATCH_BUF_LEN, "\r\n[%lu] %s: %s, %lu ms\r\n",
+                       ( unsigned long ) pxJob->ulId,
+                       ( xCancelled == pdTRUE ) ? "Cancelled" : "Done",
+                       pxJob->pxCommand->pcCommand,
+                       ( unsigned long ) ulElapsedMs );
+    pxJob->pxCIO->print( pxJob->pcScratch );
+
+    taskENTER_CRITICAL();
+    {
+        pxActiveJob = NULL;
+    }
+    taskEXIT_CRITICAL();
+
+    vPortFree( pxJob );
+    vTaskDelete( NULL );
+}
+
+/*-----------------------------------------------------------*/
+
+BaseType_t xCliJobStart( ConsoleIO_t * const pxCIO,
+                         const CLI_Command_Definition_t * pxCommand,
+                         uint32_t ulArgc,
+                         char * ppcArgv[] )
+{
+    BaseType_t xResult = pdFAIL;
+    size_t uxArgsLen = 0;
+    CliJob_t * pxJob = NULL;
+
+    configASSERT( pxCIO != NULL );
+    configASSERT( pxCommand != NULL );
+
+    for( uint32_t i = 0; i < ulArgc; i++ )
+    {
+        uxArgsLen += strlen( ppcArgv[ i ] ) + 1;
+    }
+
+    if( pxActiveJob != NULL )
+    {
+        pxCIO->print( "Error: A job is already running, see \"jobs\".\r\n" );
+    }
+    else
+    {
+        pxJob = ( CliJob_t * ) pvPortMalloc( sizeof( CliJob_t ) + ( ulArgc * sizeof( char * ) ) + uxArgsLen );
+
+        if( pxJob == NULL )
+        {
+            pxCIO->print( "Error: Not enough memory to start the job.\r\n" );
+        }
+    }
+
+    if( pxJob != NULL )
+    {
+        char * pcArgs;
+
+        ( void ) memset( pxJob, 0, sizeof( CliJob_t ) );
+
+        pxJob->pxCIO = pxCIO;
+        pxJob->pxCommand = pxCommand;
+        pxJob->ulId = ++ulLastJobId;
+        pxJob->xStartTicks = xTaskGetTickCount();
+        pxJob->xCancel = pdFALSE;
+        pxJob->ulArgc = ulArgc;
+        pxJob->ppcArgv = ( char ** ) &( pxJob[ 1 ] );
+
+        pcArgs = ( char * ) &( pxJob->ppcArgv[ ulArgc ] );
+
+        for( uint32_t i = 0; i < ulArgc; i++ )
+        {
+            size_t uxLen = strlen( ppcArgv[ i ] ) + 1;
+
+            ( void ) memcpy( pcArgs, ppcArgv[ i ], uxLen );
+            pxJob->ppcArgv[ i ] = pcArgs;
+            pcArgs += uxLen;
+        }
+
+        /* The job must be visible before its task first runs */
+        vTaskSuspendAll();
+        {
+            if( xTaskCreate( prvJobTask, "cli_job", CLI_JOB_STACK_WORDS, pxJob,
+                             CLI_JOB_PRIORITY, &( pxJob->xTask ) ) == pdPASS )
+            {
+                pxActiveJob = pxJob;
+                xResult = pdPASS;
+            }
+        }
+        ( void ) xTaskResumeAll();
+
+        if( xResult == pdPASS )
+        {
+            ( void ) snprintf( pcCliScratchBuffer, CLI_OUTPUT_SCRATCH_BUF_LEN, "[%lu] %s\r\n",
+                               ( unsigned long ) pxJob->ulId, pxCommand->pcCommand );
+            pxCIO->print( pcCliScratchBuffer );
+        }
+        else
+        {
+            pxCIO->print( "Error: Failed to create the job task.\r\n" );
+            vPortFree( pxJob );
+        }
+    }
+
+    return xResult;
+}
+
+/*-----------------------------------------------------------*/
+
+static void prvJobsCommand( ConsoleIO_t * const pxCIO,
+                            uint32_t ulArgc,
+                            char * ppcArgv[] )
+{
+    uint32_t ulId = 0;
+    const char * pcName = NULL;
+    uint32_t ulDone = 0;
+    uint32_t ulTotal = 0;
+    TickType_t xStartTicks = 0;
+    BaseType_t xCancel = pdFALSE;
+
+    ( void ) ulArgc;
+    ( void ) ppcArgv;
+
+    taskENTER_CRITICAL();
+    {
+        if( pxActiveJob != NULL )
+        {
+            ulId = pxActiveJob->ulId;
+            pcName = pxActiveJob->pxCommand->pcCommand;
+            ulDone = pxActiveJob->ulDone;
+            ulTotal = pxActiveJob->ulTotal;
+            xStartTicks = pxActiveJob->xStartTicks;
+            xCancel = pxActiveJob->xCancel;
+        }
+    }
+    taskEXIT_CRITICAL();
+
+    if( pcName == NULL )
+    {
+        pxCIO->print( "No job running.\r\n" );
+    }
+    else
+    {
+        size_t uxLen = ( size_t ) snprintf( pcCliScratchBuffer, CLI_OUTPUT_SCRATCH_BUF_LEN, "[%lu] %s, %lu ms",
+                                            ( unsigned long ) ulId, pcName,
+                                            ( unsigned long ) ( ( xTaskGetTickCount() - xStartTicks ) * portTICK_PERIOD_MS ) );
+
+        if( ( ulTotal > 0 ) && ( uxLen < CLI_OUTPUT_SCRATCH_BUF_LEN ) )
+        {
+            uxLen += ( size_t ) snprintf( &( pcCliScratchBuffer[ uxLen ] ), CLI_OUTPUT_SCRATCH_BUF_LEN - uxLen,
+                                          ", %lu / %lu (%lu%%)",
+                                          ( unsigned long ) ulDone, ( unsigned long ) ulTotal,
+                                          ( unsigned long ) ( ( ( uint64_t ) ulDone * 100U ) / ulTotal ) );
+        }
+
+        if( uxLen < CLI_OUTPUT_SCRATCH_BUF_LEN )
+        {
+            ( void ) snprintf( &( pcCliScratchBuffer[ uxLen ] ), CLI_OUTPUT_SCRATCH_BUF_LEN - uxLen,
+                               "%s\r\n", ( xCancel == pdTRUE ) ? ", cancelling" : "" );
+        }
+
+        pxCIO->print( pcCliScratchBuffer );
+    }
+}
+
+/*-----------------------------------------------------------*/
+
+static void prvCancelCommand( ConsoleIO_t * const pxCIO,
+                              uint32_t ulArgc,
+                              char * ppcArgv[] )
+{
+    BaseType_t xFound = pdFALSE;
+
+    ( void ) ulArgc;
+    ( void ) ppcArgv;
+
+    taskENTER_CRITICAL();
+    {
+        if( pxActiveJob != NULL )
+        {
+            pxActiveJob->xCancel = pdTRUE;
+            xFound = pdTRUE;
+        }
+    }
+    taskEXIT_CRITICAL();
+
+    pxCIO->print( ( xFound == pdTRUE ) ? "Cancellation requested.\r\n" : "No job running.\r\n" );
+}
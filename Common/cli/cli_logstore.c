@@ -0,0 +1,176 @@
+/*
+ * FreeRTOS STM32 Reference Integration
+ *
+ * Copyright (c) 2022 Amazon.com, Inc. or its affiliates. All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#include <string.h>
+#include <stdio.h>
+
+#include "FreeRTOS.h"
+#include "task.h"
+
+#include "cli.h"
+#include "cli_prv.h"
+
+#if defined( LOGGING_OUTPUT_FLASH ) && !defined( TFM_PSA_API )
+
+#include "fs/log_store.h"
+#include "log_upload.h"
+
+static void prvLogStoreCommand( ConsoleIO_t * const pxCIO,
+                                uint32_t ulArgc,
+                                char * ppcArgv[] );
+
+const CLI_Command_Definition_t xCommandDef_logstore =
+{
+    "logstore",
+    "logstore [ stat | dump | upload | erase ]\r\n"
+    "    Access the log lines kept in the OSPI flash.\r\n"
+    "        stat:   Store counters and compression ratio since boot.\r\n"
+    "        dump:   Print the stored lines, oldest first.\r\n"
+    "        upload: Publish the stored lines to <thing name>/logs.\r\n"
+    "        erase:  Erase every stored line.\r\n"
+    "    Without an argument, stat is run.\r\n\n",
+    prvLogStoreCommand
+};
+
+/*-----------------------------------------------------------*/
+
+static void prvLogStoreStat( ConsoleIO_t * const pxCIO )
+{
+    LogStoreStats_t xStats;
+    uint32_t ulRatio = 0;
+    int lLen = 0;
+
+    vLogStoreGetStats( &xStats );
+
+    if( xStats.ulStoredBytes > 0 )
+    {
+        ulRatio = ( uint32_t ) ( ( ( uint64_t ) xStats.ulTextBytes * 100U ) / xStats.ulStoredBytes );
+    }
+
+    lLen = snprintf( pcCliScratchBuffer, CLI_OUTPUT_SCRATCH_BUF_LEN,
+                     "Sector:          %lu of %lu, sequence %lu\r\n"
+                     "Lines stored:    %lu\r\n"
+                     "Lines dropped:   %lu\r\n"
+                     "Text bytes:      %lu\r\n"
+                     "Stored bytes:    %lu\r\n"
+                     "Ratio:           %lu.%02lu\r\n"
+                     "Pages written:   %lu\r\n"
+                     "Sectors erased:  %lu\r\n"
+                     "Last reset page: %s\r\n",
+                     xStats.ulSector, ( uint32_t ) LOG_STORE_NUM_SECTORS, xStats.ulSeq,
+                     xStats.ulLines,
+                     xStats.ulDropped,
+                     xStats.ulTextBytes,
+                     xStats.ulStoredBytes,
+                     ulRatio / 100U, ulRatio % 100U,
+                     xStats.ulPagesWritten,
+                     xStats.ulSectorsErased,
+                     ( xStats.xRecovered == pdTRUE ) ? "recovered" : "none" );
+
+    if( lLen >= CLI_OUTPUT_SCRATCH_BUF_LEN )
+    {
+        lLen = CLI_OUTPUT_SCRATCH_BUF_LEN - 1;
+    }
+
+    if( lLen > 0 )
+    {
+        pxCIO->write( pcCliScratchBuffer, ( size_t ) lLen );
+    }
+}
+
+static void prvLogStoreDump( ConsoleIO_t * const pxCIO )
+{
+    LogStoreCursor_t * pxCursor = pvPortMalloc( sizeof( LogStoreCursor_t ) );
+    size_t uxLen = 0;
+
+    if( pxCursor == NULL )
+    {
+        pxCIO->print( "Error: Failed to allocate the read cursor.\r\n" );
+    }
+    else if( xLogStoreCursorInit( pxCursor ) != pdTRUE )
+    {
+        pxCIO->print( "No stored log lines.\r\n" );
+    }
+    else
+    {
+        while( xLogStoreReadLine( pxCursor, pcCliScratchBuffer, CLI_OUTPUT_SCRATCH_BUF_LEN, &uxLen ) == pdTRUE )
+        {
+            pxCIO->write( pcCliScratchBuffer, uxLen );
+            pxCIO->print( "\r\n" );
+        }
+    }
+
+    if( pxCursor != NULL )
+    {
+        vPortFree( pxCursor );
+    }
+}
+
+static void prvLogStoreCommand( ConsoleIO_t * const pxCIO,
+                                uint32_t ulArgc,
+                                char * ppcArgv[] )
+{
+    const char * pcVerb = "stat";
+
+    if( ulArgc > 1 )
+    {
+        pcVerb = ppcArgv[ 1 ];
+    }
+
+    if( strcmp( pcVerb, "stat" ) == 0 )
+    {
+        prvLogStoreStat( pxCIO );
+    }
+    else if( strcmp( pcVerb, "dump" ) == 0 )
+    {
+        prvLogStoreDump( pxCIO );
+    }
+    else if( strcmp( pcVerb, "upload" ) == 0 )
+    {
+        if( xLogUploadRequest() == pdTRUE )
+        {
+            pxCIO->print( "Log upload started.\r\n" );
+        }
+        else
+        {
+            pxCIO->print( "Error: The log upload task is not running.\r\n" );
+        }
+    }
+    else if( strcmp( pcVerb, "erase" ) == 0 )
+    {
+        if( xLogStoreErase() == pdTRUE )
+        {
+            pxCIO->print( "Log store erased.\r\n" );
+        }
+        else
+        {
+            pxCIO->print( "Error: Failed to erase the log store.\r\n" );
+        }
+    }
+    else
+    {
+        pxCIO->print( "Error: Unknown argument. See \"help logstore\".\r\n" );
+    }
+}
+
+#endif /* defined( LOGGING_OUTPUT_FLASH ) && !defined( TFM_PSA_API ) */
@@ -0,0 +1,151 @@
+/*
+ * FreeRTOS STM32 Reference Integration
+ * Copyright (C) 2021 Amazon.com, Inc. or its affiliates.  All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ * http://www.FreeRTOS.org
+ * http://aws.amazon.com/freertos
+ *
+
+/* Standard includes. */
+#include <string.h>
+#include <stdint.h>
+#include <stdio.h>
+
+/* FreeRTOS includes. */
+#include "FreeRTOS.h"
+#include "task.h"
+
+#include "cli.h"
+#include "cli_prv.h"
+
+#include "net_stats.h"
+
+static void prvLwipStatsCommand( ConsoleIO_t * const pxCIO,
+                                 uint32_t ulArgc,
+                                 char * ppcArgv[] );
+
+const CLI_Command_Definition_t xCommandDef_lwipstats =
+{
+    "lwipstats",
+    "lwipstats\r\n"
+    "    lwipstats\r\n"
+    "        Display the use of the lwIP heap and memory pools, the mailbox\r\n"
+    "        high-water marks and the TCP retransmit and out of order counters.\r\n"
+    "        Pools marked with '!' are exhausted or failed an allocation recently.\r\n\n"
+    "    lwipstats -c | --clear\r\n"
+    "        Display and then restart the high-water marks and counters.\r\n\n",
+    prvLwipStatsCommand
+};
+
+/*-----------------------------------------------------------*/
+
+static void prvPrintLine( ConsoleIO_t * const pxCIO,
+                          size_t xLen )
+{
+    if( xLen >= CLI_OUTPUT_SCRATCH_BUF_LEN )
+    {
+        xLen = CLI_OUTPUT_SCRATCH_BUF_LEN - 1;
+    }
+
+    pxCIO->write( pcCliScratchBuffer, xLen );
+}
+
+/*-----------------------------------------------------------*/
+
+static void prvPrintPool( ConsoleIO_t * const pxCIO,
+                          const NetPoolStats_t * pxPool )
+{
+    size_t xLen = snprintf( pcCliScratchBuffer, CLI_OUTPUT_SCRATCH_BUF_LEN,
+                            "| %-16s%c | %8lu | %8lu | %8lu | %6lu |\r\n",
+                            pxPool->pcName,
+                            ( pxPool->xExhausted == pdTRUE ) ? '!' : ' ',
+                            pxPool->ulAvail,
+                            pxPool->ulUsed,
+                            pxPool->ulMax,
+                            pxPool->ulErr );
+
+    prvPrintLine( pxCIO, xLen );
+}
+
+/*-----------------------------------------------------------*/
+
+static void prvPrintCounter( ConsoleIO_t * const pxCIO,
+                             const char * pcLabel,
+                             uint32_t ulValue )
+{
+    size_t xLen = snprintf( pcCliScratchBuffer, CLI_OUTPUT_SCRATCH_BUF_LEN,
+                            "| %-24s | %12lu |\r\n", pcLabel, ulValue );
+
+    prvPrintLine( pxCIO, xLen );
+}
+
+/*-----------------------------------------------------------*/
+
+static void prvLwipStatsCommand( ConsoleIO_t * const pxCIO,
+                                 uint32_t ulArgc,
+                                 char * ppcArgv[] )
+{
+    static NetStats_t xStats;
+    BaseType_t xClear = pdFALSE;
+
+    for( uint32_t i = 1; i < ulArgc; i++ )
+    {
+        if( ( strcmp( "-c", ppcArgv[ i ] ) == 0 ) ||
+            ( strcmp( "--clear", ppcArgv[ i ] ) == 0 ) )
+        {
+            xClear = pdTRUE;
+        }
+        else
+        {
+            pxCIO->print( "Error: Unrecognized argument: " );
+            pxCIO->print( ppcArgv[ i ] );
+            pxCIO->print( "\r\n" );
+        }
+    }
+
+    vNetStatsGet( &xStats, xClear );
+
+    pxCIO->print( "+-------------------------------------------------------------+\r\n" );
+    pxCIO->print( "| Pool              |    Avail |     Used |      Max |    Err |\r\n" );
+    pxCIO->print( "|-------------------|----------|----------|----------|--------|\r\n" );
+    prvPrintPool( pxCIO, &( xStats.xHeap ) );
+
+    for( uint32_t i = 0; i < MEMP_MAX; i++ )
+    {
+        prvPrintPool( pxCIO, &( xStats.xPools[ i ] ) );
+    }
+
+    pxCIO->print( "+-------------------------------------------------------------+\r\n\r\n" );
+
+    pxCIO->print( "+-----------------------------------------+\r\n" );
+    pxCIO->print( "| Counter                  |        Value |\r\n" );
+    pxCIO->print( "|--------------------------|--------------|\r\n" );
+    prvPrintCounter( pxCIO, "TCP segments sent", xStats.ulTcpXmit );
+    prvPrintCounter( pxCIO, "TCP retransmits", xStats.ulTcpRexmit );
+    prvPrintCounter( pxCIO, "TCP input drops", xStats.ulTcpDrop );
+    prvPrintCounter( pxCIO, "TCP memory errors", xStats.ulTcpMemErr );
+    prvPrintCounter( pxCIO, "TCP out of order segs", xStats.ulTcpOoseq );
+    prvPrintCounter( pxCIO, "TCP out of order max", xStats.ulTcpOoseqMax );
+    prvPrintCounter( pxCIO, "mbox full", xStats.ulMboxFull );
+    prvPrintCounter( pxCIO, "mbox max depth", xStats.ulMboxMaxDepth );
+    prvPrintCounter( pxCIO, "tcpip mbox max depth", xStats.ulTcpipMboxMaxDepth );
+    prvPrintCounter( pxCIO, "Pool exhaustion alarms", xStats.ulExhaustedAlarms );
+    pxCIO->print( "+-----------------------------------------+\r\n" );
+}
@@ -29,21 +29,30 @@
 #include "stream_buffer.h"
 
 #include "tls_transport_config.h"
+#include "mbedtls/build_info.h"
 
 #include <string.h>
 
+/* Buckets of the registered command hash table, must be a power of two */
+#ifndef CLI_COMMAND_HASH_BUCKETS
+#define CLI_COMMAND_HASH_BUCKETS    32U
+#endif
+
+#if ( ( CLI_COMMAND_HASH_BUCKETS & ( CLI_COMMAND_HASH_BUCKETS - 1U ) ) != 0 )
+#error "CLI_COMMAND_HASH_BUCKETS must be a power of two"
+#endif
+
 typedef struct xCOMMAND_INPUT_LIST
 {
     const CLI_Command_Definition_t * pxCommandLineDefinition;
-    struct xCOMMAND_INPUT_LIST * pxNext;
+    struct xCOMMAND_INPUT_LIST * pxNext;     /* Registration order, used by help */
+    struct xCOMMAND_INPUT_LIST * pxHashNext; /* Next command in the same hash bucket */
 } CLI_Definition_List_Item_t;
 
 
 extern ConsoleIO_t xConsoleIO;
 extern BaseType_t xInitConsoleUart( void );
 
-char pcCliScratchBuffer[ CLI_OUTPUT_SCRATCH_BUF_LEN ];
-
 /*
  * The callback function that is executed when "help" is entered.  This is the
  * only default command that is always present.
@@ -78,9 +87,40 @@ static const CLI_Command_Definition_t xHelpCommand =
 static CLI_Definition_List_Item_t xRegisteredCommands =
 {
     &xHelpCommand,
+    NULL,
     NULL
 };
 
+static CLI_Definition_List_Item_t * pxCommandBuckets[ CLI_COMMAND_HASH_BUCKETS ] = { NULL };
+
+
+/*-----------------------------------------------------------*/
+
+/* FNV-1a of a command name, up to the first space */
+static uint32_t prvHashCommand( const char * pcCommand )
+{
+    uint32_t ulHash = 2166136261UL;
+
+    while( ( *pcCommand != '\0' ) && ( *pcCommand != ' ' ) )
+    {
+        ulHash ^= ( uint8_t ) *pcCommand;
+        ulHash *= 16777619UL;
+        pcCommand++;
+    }
+
+    return ulHash;
+}
+
+/*-----------------------------------------------------------*/
+
+/* Must be called from a critical section */
+static void prvHashInsert( CLI_Definition_List_Item_t * pxItem )
+{
+    uint32_t ulBucket = prvHashCommand( pxItem->pxCommandLineDefinition->pcCommand ) & ( CLI_COMMAND_HASH_BUCKETS - 1U );
+
+    pxItem->pxHashNext = pxCommandBuckets[ ulBucket ];
+    pxCommandBuckets[ ulBucket ] = pxItem;
+}
 
 /*-----------------------------------------------------------*/
 
@@ -101,6 +141,12 @@ BaseType_t FreeRTOS_CLIRegisterCommand( const CLI_Command_Definition_t * const p
     {
         taskENTER_CRITICAL();
         {
+            /* The help command is hashed along with the first registered command. */
+            if( pxLastCommandInList == &xRegisteredCommands )
+            {
+                prvHashInsert( &xRegisteredCommands );
+            }
+
             /* Reference the command being registered from the newly created
              * list item. */
             pxNewListItem->pxCommandLineDefinition = pxCommandToRegister;
@@ -115,6 +161,8 @@ BaseType_t FreeRTOS_CLIRegisterCommand( const CLI_Command_Definition_t * const p
 
             /* Set the end of list marker to the new list item. */
             pxLastCommandInList = pxNewListItem;
+
+            prvHashInsert( pxNewListItem );
         }
         taskEXIT_CRITICAL();
 
@@ -128,7 +176,14 @@ BaseType_t FreeRTOS_CLIRegisterCommand( const CLI_Command_Definition_t * const p
 
 static const CLI_Definition_List_Item_t * prvFindMatchingCommand( const char * const pcCommandInput )
 {
-    const CLI_Definition_List_Item_t * pxCommand = &xRegisteredCommands;
+    uint32_t ulBucket = prvHashCommand( pcCommandInput ) & ( CLI_COMMAND_HASH_BUCKETS - 1U );
+    const CLI_Definition_List_Item_t * pxCommand = pxCommandBuckets[ ulBucket ];
+
+    /* The help command is only hashed once another command is registered */
+    if( xRegisteredCommands.pxNext == NULL )
+    {
+        pxCommand = &xRegisteredCommands;
+    }
 
     while( pxCommand != NULL )
     {
@@ -143,7 +198,7 @@ static const CLI_Definition_List_Item_t * prvFindMatchingCommand( const char * c
         }
         else
         {
-            pxCommand = pxCommand->pxNext;
+            pxCommand = pxCommand->pxHashNext;
         }
     }
 
@@ -183,8 +238,16 @@ void FreeRTOS_CLIProcessCommand( ConsoleIO_t * const pxCIO,
         /* Assert that we read all of the tokens */
         configASSERT( strtok_r( NULL, " ", &pcTokenizerCtx ) == NULL );
 
-        /* Call the callback function that is registered to this command. */
-        pxCommand->pxCommandLineDefinition->pxCommandInterpreter( pxCIO, ulArgC, pcArgv );
+        /* A trailing "&" runs the command in the background */
+        if( ( ulArgC > 1 ) && ( strcmp( pcArgv[ ulArgC - 1 ], "&" ) == 0 ) )
+        {
+            ( void ) xCliJobStart( pxCIO, pxCommand->pxCommandLineDefinition, ulArgC - 1, pcArgv );
+        }
+        else
+        {
+            /* Call the callback function that is registered to this command. */
+            pxCommand->pxCommandLineDefinition->pxCommandInterpreter( pxCIO, ulArgC, pcArgv );
+        }
     }
     else
     {
@@ -262,29 +325,13 @@ static void prvHelpCommand( ConsoleIO_t * const pxConsoleIO,
                             uint32_t ulArgc,
                             char * ppcArgv[] )
 {
-    static const CLI_Definition_List_Item_t * pxCommand = NULL;
+    const CLI_Definition_List_Item_t * pxCommand = NULL;
 
     /* Check for an argument containing a recognized command */
     if( ( ulArgc > 1 ) &&
         ( ppcArgv[ 1 ] != NULL ) )
     {
-        BaseType_t xFound = pdFALSE;
-        pxCommand = &xRegisteredCommands;
-
-        while( pxCommand != NULL &&
-               xFound == pdFALSE )
-        {
-            if( strncmp( pxCommand->pxCommandLineDefinition->pcCommand,
-                         ppcArgv[ 1 ],
-                         strlen( pxCommand->pxCommandLineDefinition->pcCommand ) ) == 0 )
-            {
-                xFound = pdTRUE;
-            }
-            else
-            {
-                pxCommand = pxCommand->pxNext;
-            }
-        }
+        pxCommand = prvFindMatchingCommand( ppcArgv[ 1 ] );
     }
 
     /* Print help for a single command if we found one specified */
@@ -339,14 +386,53 @@ void Task_CLI( void * pvParameters )
     ( void ) pvParameters;
     FreeRTOS_CLIRegisterCommand( &xCommandDef_conf );
     FreeRTOS_CLIRegisterCommand( &xCommandDef_pki );
+    FreeRTOS_CLIRegisterCommand( &xCommandDef_prov );
     FreeRTOS_CLIRegisterCommand( &xCommandDef_ps );
+    FreeRTOS_CLIRegisterCommand( &xCommandDef_top );
     FreeRTOS_CLIRegisterCommand( &xCommandDef_kill );
     FreeRTOS_CLIRegisterCommand( &xCommandDef_killAll );
     FreeRTOS_CLIRegisterCommand( &xCommandDef_heapStat );
     FreeRTOS_CLIRegisterCommand( &xCommandDef_reset );
     FreeRTOS_CLIRegisterCommand( &xCommandDef_uptime );
+    FreeRTOS_CLIRegisterCommand( &xCommandDef_powerstat );
+    FreeRTOS_CLIRegisterCommand( &xCommandDef_boottime );
     FreeRTOS_CLIRegisterCommand( &xCommandDef_rngtest );
     FreeRTOS_CLIRegisterCommand( &xCommandDef_assert );
+    FreeRTOS_CLIRegisterCommand( &xCommandDef_netstat );
+    FreeRTOS_CLIRegisterCommand( &xCommandDef_lwipstats );
+    FreeRTOS_CLIRegisterCommand( &xCommandDef_iperf );
+    FreeRTOS_CLIRegisterCommand( &xCommandDef_netimpair );
+    FreeRTOS_CLIRegisterCommand( &xCommandDef_tlsprof );
+    FreeRTOS_CLIRegisterCommand( &xCommandDef_mqttstats );
+    FreeRTOS_CLIRegisterCommand( &xCommandDef_mqttload );
+    FreeRTOS_CLIRegisterCommand( &xCommandDef_soak );
+    FreeRTOS_CLIRegisterCommand( &xCommandDef_jobs );
+    FreeRTOS_CLIRegisterCommand( &xCommandDef_cancel );
+#ifndef TFM_PSA_API
+    FreeRTOS_CLIRegisterCommand( &xCommandDef_fsbench );
+#else
+    FreeRTOS_CLIRegisterCommand( &xCommandDef_nsintf );
+#endif
+#if defined( LOGGING_OUTPUT_FLASH ) && !defined( TFM_PSA_API )
+    FreeRTOS_CLIRegisterCommand( &xCommandDef_logstore );
+#endif
+#if TRACE_RECORDER_ENABLED == 1
+    FreeRTOS_CLIRegisterCommand( &xCommandDef_trace );
+#endif
+#if PROFILER_ENABLED == 1
+    FreeRTOS_CLIRegisterCommand( &xCommandDef_prof );
+#endif
+#if CRIT_STATS_ENABLED == 1
+    FreeRTOS_CLIRegisterCommand( &xCommandDef_critstat );
+#endif
+#if MEM_OPS_ENABLED == 1
+    FreeRTOS_CLIRegisterCommand( &xCommandDef_membench );
+#endif
+#if defined( MBEDTLS_SELF_TEST )
+    FreeRTOS_CLIRegisterCommand( &xCommandDef_cryptotest );
+#endif
+    FreeRTOS_CLIRegisterCommand( &xCommandDef_cryptobench );
+    FreeRTOS_CLIRegisterCommand( &xCommandDef_perftest );
 
     char * pcCommandBuffer = NULL;
 
@@ -0,0 +1,446 @@
+/*
+ * FreeRTOS STM32 Reference Integration
+ *
+ * Copyright (c) 2022 Amazon.com, Inc. or its affiliates. All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+/* Standard includes. */
+#include <string.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdarg.h>
+
+/* FreeRTOS includes. */
+#include "FreeRTOS.h"
+#include "task.h"
+
+#include "cli.h"
+#include "cli_prv.h"
+
+#include "stm32u5xx.h"
+#include "dvfs.h"
+#include "mem_ops.h"
+#include "dma_copy.h"
+
+#if MEM_OPS_ENABLED == 1
+
+/* Bytes moved per size and implementation */
+#define MEMBENCH_BYTES        ( 256 * 1024 )
+#define MEMBENCH_MIN_OPS      16
+#define MEMBENCH_MAX_LEN      16384
+
+/* Room for the misaligned variants */
+#define MEMBENCH_BUF_LEN      ( MEMBENCH_MAX_LEN + 8 )
+
+typedef void * ( * MemCopyFunc_t )( void * pvDst,
+                                    const void * pvSrc,
+                                    size_t uxLen );
+typedef void * ( * MemSetFunc_t )( void * pvDst,
+                                   int lValue,
+                                   size_t uxLen );
+typedef int ( * MemCmpFunc_t )( const void * pvBuf1,
+                                const void * pvBuf2,
+                                size_t uxLen );
+
+typedef struct
+{
+    uint32_t ulCount;
+    uint64_t ullTotalCycles;
+    uint32_t ulMaxCycles;
+} CycleStats_t;
+
+/* Destination and source offsets from a word boundary */
+typedef struct
+{
+    size_t uxDstOffset;
+    size_t uxSrcOffset;
+    const char * pcName;
+} BenchAlign_t;
+
+static const size_t xSizes[] = { 16, 64, 256, 1024, 4096, MEMBENCH_MAX_LEN };
+
+static const BenchAlign_t xAligns[] =
+{
+    { 0, 0, "a" },
+    { 1, 1, "u1" },
+    { 0, 3, "m3" }
+};
+
+static void prvMemBenchCommand( ConsoleIO_t * const pxCIO,
+                                uint32_t ulArgc,
+                                char * ppcArgv[] );
+
+const CLI_Command_Definition_t xCommandDef_membench =
+{
+    "membench",
+    "membench [ memcpy | memset | memcmp | all ]\r\n"
+    "    Compare the newlib memory functions (lib) with those of mem_ops.c (opt).\r\n"
+    "        memcpy: 16 B to 16 KiB copies, both word aligned (a), equally misaligned (u1)\r\n"
+    "                or with a source 3 bytes off the destination alignment (m3).\r\n"
+    "                Copies of at least DMA_COPY_MIN_LEN bytes also run through dma_copy (dma).\r\n"
+    "        memset: 16 B to 16 KiB fills at the same destination alignments.\r\n"
+    "        memcmp: 16 B to 16 KiB comparisons of equal buffers.\r\n"
+    "    Without an argument, all tests are run.\r\n\n",
+    prvMemBenchCommand
+};
+
+/*-----------------------------------------------------------*/
+
+static inline void vStartCycleCounter( void )
+{
+    if( ( DWT->CTRL & DWT_CTRL_CYCCNTENA_Msk ) == 0 )
+    {
+        CoreDebug->DEMCR |= CoreDebug_DEMCR_TRCENA_Msk;
+        DWT->CYCCNT = 0;
+        DWT->CTRL |= DWT_CTRL_CYCCNTENA_Msk;
+    }
+}
+
+static void vRecordCycles( CycleStats_t * pxStats,
+                           uint32_t ulStartCycles )
+{
+    uint32_t ulCycles = DWT->CYCCNT - ulStartCycles;
+
+    pxStats->ulCount++;
+    pxStats->ullTotalCycles += ulCycles;
+
+    if( ulCycles > pxStats->ulMaxCycles )
+    {
+        pxStats->ulMaxCycles = ulCycles;
+    }
+}
+
+static uint32_t ulKiBPerSecond( uint64_t ullBytes,
+                                uint64_t ullCycles )
+{
+    uint32_t ulRate = 0;
+
+    if( ullCycles > 0 )
+    {
+        ulRate = ( uint32_t ) ( ( ullBytes * SystemCoreClock ) / ( ullCycles * 1024 ) );
+    }
+
+    return ulRate;
+}
+
+static void prvPrintf( ConsoleIO_t * const pxCIO,
+                       const char * pcFormat,
+                       ... ) __attribute__( ( format( printf, 2, 3 ) ) );
+
+static void prvPrintf( ConsoleIO_t * const pxCIO,
+                       const char * pcFormat,
+                       ... )
+{
+    va_list xArgs;
+    size_t xLen;
+
+    va_start( xArgs, pcFormat );
+    xLen = vsnprintf( pcCliScratchBuffer, CLI_OUTPUT_SCRATCH_BUF_LEN, pcFormat, xArgs );
+    va_end( xArgs );
+
+    if( xLen >= CLI_OUTPUT_SCRATCH_BUF_LEN )
+    {
+        xLen = CLI_OUTPUT_SCRATCH_BUF_LEN - 1;
+    }
+
+    pxCIO->write( pcCliScratchBuffer, xLen );
+}
+
+/* Short operations take well under a microsecond, so the results are in cycles */
+static void prvPrintResult( ConsoleIO_t * const pxCIO,
+                            const char * pcLabel,
+                            const char * pcImpl,
+                            const CycleStats_t * pxStats,
+                            size_t uxBytesPerOp )
+{
+    uint32_t ulAvgCycles = 0;
+
+    if( pxStats->ulCount > 0 )
+    {
+        ulAvgCycles = ( uint32_t ) ( pxStats->ullTotalCycles / pxStats->ulCount );
+    }
+
+    prvPrintf( pxCIO, "%-18s %-3s n=%-5lu avg=%7lu cyc  max=%7lu cyc  %7lu KiB/s\r\n",
+               pcLabel, pcImpl, pxStats->ulCount, ulAvgCycles, pxStats->ulMaxCycles,
+               ulKiBPerSecond( ( uint64_t ) uxBytesPerOp * pxStats->ulCount,
+                               pxStats->ullTotalCycles ) );
+}
+
+static uint32_t ulOpsForSize( size_t uxLen )
+{
+    uint32_t ulOps = MEMBENCH_BYTES / uxLen;
+
+    if( ulOps < MEMBENCH_MIN_OPS )
+    {
+        ulOps = MEMBENCH_MIN_OPS;
+    }
+
+    return ulOps;
+}
+
+/*-----------------------------------------------------------*/
+
+static void prvBenchCopyImpl( ConsoleIO_t * const pxCIO,
+                              const char * pcLabel,
+                              const char * pcImpl,
+                              MemCopyFunc_t xCopy,
+                              uint8_t * pucDst,
+                              const uint8_t * pucSrc,
+                              size_t uxLen )
+{
+    CycleStats_t xStats = { 0 };
+    uint32_t ulOps = ulOpsForSize( uxLen );
+
+    for( uint32_t ulOp = 0; ulOp < ulOps; ulOp++ )
+    {
+        uint32_t ulStart = DWT->CYCCNT;
+
+        ( void ) xCopy( pucDst, pucSrc, uxLen );
+        vRecordCycles( &xStats, ulStart );
+    }
+
+    if( __real_memcmp( pucDst, pucSrc, uxLen ) != 0 )
+    {
+        prvPrintf( pxCIO, "%-18s %-3s Error: copy mismatch\r\n", pcLabel, pcImpl );
+    }
+    else
+    {
+        prvPrintResult( pxCIO, pcLabel, pcImpl, &xStats, uxLen );
+    }
+}
+
+static void prvBenchMemcpy( ConsoleIO_t * const pxCIO,
+                            uint8_t * pucIn,
+                            uint8_t * pucOut )
+{
+    char cLabel[ 24 ];
+
+    for( size_t i = 0; i < ( sizeof( xAligns ) / sizeof( xAligns[ 0 ] ) ); i++ )
+    {
+        uint8_t * pucDst = &( pucOut[ xAligns[ i ].uxDstOffset ] );
+        const uint8_t * pucSrc = &( pucIn[ xAligns[ i ].uxSrcOffset ] );
+
+        for( size_t j = 0; j < ( sizeof( xSizes ) / sizeof( xSizes[ 0 ] ) ); j++ )
+        {
+            ( void ) snprintf( cLabel, sizeof( cLabel ), "memcpy-%s-%u",
+                               xAligns[ i ].pcName, ( unsigned int ) xSizes[ j ] );
+
+            prvBenchCopyImpl( pxCIO, cLabel, "lib", __real_memcpy, pucDst, pucSrc, xSizes[ j ] );
+            prvBenchCopyImpl( pxCIO, cLabel, "opt", pvMemOpsCopyCpu, pucDst, pucSrc, xSizes[ j ] );
+
+#if DMA_COPY_ENABLED == 1
+            if( xSizes[ j ] >= DMA_COPY_MIN_LEN )
+            {
+                prvBenchCopyImpl( pxCIO, cLabel, "dma", pvDmaCopy, pucDst, pucSrc, xSizes[ j ] );
+            }
+#endif
+        }
+    }
+
+#if DMA_COPY_ENABLED == 1
+    {
+        DmaCopyStats_t xDmaStats;
+
+        vDmaCopyGetStats( &xDmaStats );
+        prvPrintf( pxCIO, "dma copies: %lu, cpu fallbacks: %lu (busy: %lu), aborted: %lu\r\n",
+                   xDmaStats.ulDmaCopies, xDmaStats.ulCpuCopies, xDmaStats.ulBusy, xDmaStats.ulAborted );
+    }
+#endif
+}
+
+static void prvBenchSetImpl( ConsoleIO_t * const pxCIO,
+                             const char * pcLabel,
+                             const char * pcImpl,
+                             MemSetFunc_t xSet,
+                             uint8_t * pucDst,
+                             size_t uxLen )
+{
+    CycleStats_t xStats = { 0 };
+    uint32_t ulOps = ulOpsForSize( uxLen );
+
+    for( uint32_t ulOp = 0; ulOp < ulOps; ulOp++ )
+    {
+        uint32_t ulStart = DWT->CYCCNT;
+
+        ( void ) xSet( pucDst, ( int ) ulOp, uxLen );
+        vRecordCycles( &xStats, ulStart );
+    }
+
+    prvPrintResult( pxCIO, pcLabel, pcImpl, &xStats, uxLen );
+}
+
+static void prvBenchMemset( ConsoleIO_t * const pxCIO,
+                            uint8_t * pucOut )
+{
+    char cLabel[ 24 ];
+
+    for( size_t i = 0; i < ( sizeof( xAligns ) / sizeof( xAligns[ 0 ] ) ); i++ )
+    {
+        /* Only the destination alignment matters */
+        if( xAligns[ i ].uxSrcOffset != xAligns[ i ].uxDstOffset )
+        {
+            continue;
+        }
+
+        for( size_t j = 0; j < ( sizeof( xSizes ) / sizeof( xSizes[ 0 ] ) ); j++ )
+        {
+            uint8_t * pucDst = &( pucOut[ xAligns[ i ].uxDstOffset ] );
+
+            ( void ) snprintf( cLabel, sizeof( cLabel ), "memset-%s-%u",
+                               xAligns[ i ].pcName, ( unsigned int ) xSizes[ j ] );
+
+            prvBenchSetImpl( pxCIO, cLabel, "lib", __real_memset, pucDst, xSizes[ j ] );
+            prvBenchSetImpl( pxCIO, cLabel, "opt", __wrap_memset, pucDst, xSizes[ j ] );
+        }
+    }
+}
+
+static void prvBenchCmpImpl( ConsoleIO_t * const pxCIO,
+                             const char * pcLabel,
+                             const char * pcImpl,
+                             MemCmpFunc_t xCmp,
+                             const uint8_t * pucBuf1,
+                             const uint8_t * pucBuf2,
+                             size_t uxLen )
+{
+    CycleStats_t xStats = { 0 };
+    uint32_t ulOps = ulOpsForSize( uxLen );
+    int lResult = 0;
+
+    for( uint32_t ulOp = 0; ( ulOp < ulOps ) && ( lResult == 0 ); ulOp++ )
+    {
+        uint32_t ulStart = DWT->CYCCNT;
+
+        lResult = xCmp( pucBuf1, pucBuf2, uxLen );
+        vRecordCycles( &xStats, ulStart );
+    }
+
+    if( lResult != 0 )
+    {
+        prvPrintf( pxCIO, "%-18s %-3s Error: unexpected difference\r\n", pcLabel, pcImpl );
+    }
+    else
+    {
+        prvPrintResult( pxCIO, pcLabel, pcImpl, &xStats, uxLen );
+    }
+}
+
+static void prvBenchMemcmp( ConsoleIO_t * const pxCIO,
+                            uint8_t * pucIn,
+                            uint8_t * pucOut )
+{
+    char cLabel[ 24 ];
+
+    for( size_t i = 0; i < ( sizeof( xAligns ) / sizeof( xAligns[ 0 ] ) ); i++ )
+    {
+        uint8_t * pucBuf1 = &( pucOut[ xAligns[ i ].uxDstOffset ] );
+        const uint8_t * pucBuf2 = &( pucIn[ xAligns[ i ].uxSrcOffset ] );
+
+        ( void ) pvMemOpsCopyCpu( pucBuf1, pucBuf2, MEMBENCH_MAX_LEN );
+
+        for( size_t j = 0; j < ( sizeof( xSizes ) / sizeof( xSizes[ 0 ] ) ); j++ )
+        {
+            ( void ) snprintf( cLabel, sizeof( cLabel ), "memcmp-%s-%u",
+                               xAligns[ i ].pcName, ( unsigned int ) xSizes[ j ] );
+
+            prvBenchCmpImpl( pxCIO, cLabel, "lib", __real_memcmp, pucBuf1, pucBuf2, xSizes[ j ] );
+            prvBenchCmpImpl( pxCIO, cLabel, "opt", __wrap_memcmp, pucBuf1, pucBuf2, xSizes[ j ] );
+        }
+    }
+}
+
+/*-----------------------------------------------------------*/
+
+static BaseType_t xIsSelected( const char * pcTest,
+                               const char * pcName )
+{
+    return ( ( xCliJobCancelled() == pdFALSE ) &&
+             ( ( strcmp( pcTest, "all" ) == 0 ) ||
+               ( strcmp( pcTest, pcName ) == 0 ) ) ) ? pdTRUE : pdFALSE;
+}
+
+static void prvMemBenchCommand( ConsoleIO_t * const pxCIO,
+                                uint32_t ulArgc,
+                                char * ppcArgv[] )
+{
+    const char * pcTest = "all";
+    uint8_t * pucIn = NULL;
+    uint8_t * pucOut = NULL;
+
+    if( ulArgc > 1 )
+    {
+        pcTest = ppcArgv[ 1 ];
+    }
+
+    if( ( strcmp( pcTest, "memcpy" ) != 0 ) &&
+        ( strcmp( pcTest, "memset" ) != 0 ) &&
+        ( strcmp( pcTest, "memcmp" ) != 0 ) &&
+        ( strcmp( pcTest, "all" ) != 0 ) )
+    {
+        pxCIO->print( "Error: Unknown test. See \"help membench\".\r\n" );
+        return;
+    }
+
+    /* pvPortMalloc returns 8 byte aligned blocks */
+    pucIn = pvPortMalloc( MEMBENCH_BUF_LEN );
+    pucOut = pvPortMalloc( MEMBENCH_BUF_LEN );
+
+    if( ( pucIn == NULL ) ||
+        ( pucOut == NULL ) )
+    {
+        pxCIO->print( "Error: Failed to allocate the benchmark buffers.\r\n" );
+    }
+    else
+    {
+        for( size_t i = 0; i < MEMBENCH_BUF_LEN; i++ )
+        {
+            pucIn[ i ] = ( uint8_t ) ( i * 7 );
+        }
+
+        /* Cycle counts are converted with SystemCoreClock, which must not change during a run */
+        vDvfsRequest( DVFS_CLIENT_CLI );
+
+        vStartCycleCounter();
+
+        prvPrintf( pxCIO, "Core clock: %lu MHz\r\n", SystemCoreClock / 1000000 );
+
+        if( xIsSelected( pcTest, "memcpy" ) )
+        {
+            prvBenchMemcpy( pxCIO, pucIn, pucOut );
+        }
+
+        if( xIsSelected( pcTest, "memset" ) )
+        {
+            prvBenchMemset( pxCIO, pucOut );
+        }
+
+        if( xIsSelected( pcTest, "memcmp" ) )
+        {
+            prvBenchMemcmp( pxCIO, pucIn, pucOut );
+        }
+
+        vDvfsRelease( DVFS_CLIENT_CLI );
+    }
+
+    vPortFree( pucOut );
+    vPortFree( pucIn );
+}
+
+#endif /* MEM_OPS_ENABLED == 1 */
@@ -0,0 +1,550 @@
+/*
+ * FreeRTOS STM32 Reference Integration
+ *
+ * Copyright (c) 2022 Amazon.com, Inc. or its affiliates. All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+/* Standard includes. */
+#include <string.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+/* FreeRTOS includes. */
+#include "FreeRTOS.h"
+#include "task.h"
+
+#include "cli.h"
+#include "cli_prv.h"
+
+#include "kvstore.h"
+#include "time_base.h"
+#include "mqtt_agent_task.h"
+#include "mqtt_publish_async.h"
+#include "freertos_command_pool.h"
+
+#define MQTT_LOAD_MAX_TASKS         8
+#define MQTT_LOAD_MAX_TOPICS        16
+#define MQTT_LOAD_TOPIC_LEN         80
+#define MQTT_LOAD_MAX_RATE          1000
+#define MQTT_LOAD_MAX_S             600
+#define MQTT_LOAD_TASK_STACK        512
+#define MQTT_LOAD_TASK_PRIORITY     5
+
+/* Task notification index used by the publishing tasks to signal their exit, index 0 belongs to stream buffers */
+#define MQTT_LOAD_NOTIFY_IDX        2
+
+/* Time allowed for outstanding publishes to complete once the test has ended */
+#define MQTT_LOAD_DRAIN_MS          10000
+
+/* Bucket i of the latency histogram counts latencies below 1 ms * 2^i, the last bucket everything above */
+#define MQTT_LOAD_HIST_BUCKETS      13
+
+typedef struct MqttLoadParams
+{
+    uint32_t ulRate;        /* Publishes per second and task, 0 for as fast as possible */
+    uint32_t ulPayloadLen;
+    MQTTQoS_t xQoS;
+    uint32_t ulTasks;
+    uint32_t ulTopics;
+    uint32_t ulDurationMs;
+} MqttLoadParams_t;
+
+/* Updated by the publishing tasks and the agent callback, guarded by critical sections */
+typedef struct MqttLoadStats
+{
+    uint32_t ulQueued;
+    uint32_t ulCompleted;
+    uint32_t ulFailed;      /* Completed with an error */
+    uint32_t ulNoBuffer;    /* Publish buffer pool empty */
+    uint32_t ulNoCommand;   /* Agent command pool empty */
+    uint32_t ulQueueFull;   /* Agent command queue full */
+    uint32_t ulInFlight;
+    uint64_t ullBytes;      /* Payload bytes completed */
+    uint64_t ullLatencyTotalUs;
+    uint32_t ulLatencyMaxUs;
+    uint32_t pulHist[ MQTT_LOAD_HIST_BUCKETS ];
+} MqttLoadStats_t;
+
+static MqttLoadParams_t xLoadParams;
+static MqttLoadStats_t xLoadStats;
+
+/* Referenced by queued publishes until they complete */
+static char cLoadTopics[ MQTT_LOAD_MAX_TOPICS ][ MQTT_LOAD_TOPIC_LEN ];
+static size_t uxLoadTopicLens[ MQTT_LOAD_MAX_TOPICS ];
+
+static volatile BaseType_t xLoadStop = pdFALSE;
+static TaskHandle_t xLoadController = NULL;
+
+static void prvMqttLoadCommand( ConsoleIO_t * const pxCIO,
+                                uint32_t ulArgc,
+                                char * ppcArgv[] );
+
+const CLI_Command_Definition_t xCommandDef_mqttload =
+{
+    "mqttload",
+    "mqttload [ -r <msg/s> ] [ -s <bytes> ] [ -q 0|1 ] [ -n <tasks> ] [ -f <topics> ] [ -t <s> ]\r\n"
+    "    Generate publish load through the MQTT agent and report the latency from\r\n"
+    "    queueing to completion (PUBACK for QoS1), the throughput and the exhaustion\r\n"
+    "    of the publish buffers, the agent command pool and its queue.\r\n"
+    "        -r: Publishes per second and task, 0 for as fast as the buffers allow (10).\r\n"
+    "        -s: Payload length, up to the publish buffer length (64).\r\n"
+    "        -q: QoS (1).\r\n"
+    "        -n: Number of publishing tasks (1).\r\n"
+    "        -f: Number of topics, <thing>/load/<n>, used in turn (1).\r\n"
+    "        -t: Duration in seconds (10).\r\n"
+    "    The mqttstats counters are reset at the start of a run.\r\n\n",
+    prvMqttLoadCommand
+};
+
+/*-----------------------------------------------------------*/
+
+/* Runs in the MQTT agent task, pvCtx carries the low 32 bits of the enqueue time in us */
+static void prvPublishComplete( void * pvCtx,
+                                MQTTStatus_t xStatus )
+{
+    uint32_t ulLatencyUs = ( uint32_t ) ullTimeBaseGetUs() - ( uint32_t ) ( uintptr_t ) pvCtx;
+    uint32_t ulBucket = 0;
+
+    while( ( ulBucket < ( MQTT_LOAD_HIST_BUCKETS - 1 ) ) &&
+           ( ulLatencyUs >= ( 1000UL << ulBucket ) ) )
+    {
+        ulBucket++;
+    }
+
+    taskENTER_CRITICAL();
+
+    xLoadStats.ulInFlight--;
+
+    if( xStatus == MQTTSuccess )
+    {
+        xLoadStats.ulCompleted++;
+        xLoadStats.ullBytes += xLoadParams.ulPayloadLen;
+        xLoadStats.ullLatencyTotalUs += ulLatencyUs;
+        xLoadStats.pulHist[ ulBucket ]++;
+
+        if( ulLatencyUs > xLoadStats.ulLatencyMaxUs )
+        {
+            xLoadStats.ulLatencyMaxUs = ulLatencyUs;
+        }
+    }
+    else
+    {
+        xLoadStats.ulFailed++;
+    }
+
+    taskEXIT_CRITICAL();
+}
+
+/*-----------------------------------------------------------*/
+
+static void prvPublishOne( uint32_t ulSeq )
+{
+    char * pcPayload = MqttAgent_GetPublishBuffer( 0 );
+
+    if( pcPayload == NULL )
+    {
+        taskENTER_CRITICAL();
+        xLoadStats.ulNoBuffer++;
+        taskEXIT_CRITICAL();
+    }
+    else
+    {
+        uint32_t ulTopic = ulSeq % xLoadParams.ulTopics;
+        MQTTStatus_t xStatus;
+        MQTTPublishInfo_t xPublishInfo =
+        {
+            .qos             = xLoadParams.xQoS,
+            .retain          = 0,
+            .dup             = 0,
+            .pTopicName      = cLoadTopics[ ulTopic ],
+            .topicNameLength = uxLoadTopicLens[ ulTopic ],
+            .pPayload        = pcPayload,
+            .payloadLength   = xLoadParams.ulPayloadLen,
+        };
+
+        ( void ) memset( pcPayload, 'x', xLoadParams.ulPayloadLen );
+        ( void ) memcpy( pcPayload, &ulSeq, ( xLoadParams.ulPayloadLen < sizeof( ulSeq ) ) ? xLoadParams.ulPayloadLen : sizeof( ulSeq ) );
+
+        /* Counted first, the callback may run before MqttAgent_PublishAsync returns */
+        taskENTER_CRITICAL();
+        xLoadStats.ulInFlight++;
+        taskEXIT_CRITICAL();
+
+        xStatus = MqttAgent_PublishAsync( xGetMqttAgentHandle(), &xPublishInfo, prvPublishComplete,
+                                          ( void * ) ( uintptr_t ) ( uint32_t ) ullTimeBaseGetUs(), 0 );
+
+        taskENTER_CRITICAL();
+
+        if( xStatus == MQTTSuccess )
+        {
+            xLoadStats.ulQueued++;
+        }
+        else
+        {
+            xLoadStats.ulInFlight--;
+
+            if( xStatus == MQTTNoMemory )
+            {
+                xLoadStats.ulNoCommand++;
+            }
+            else
+            {
+                xLoadStats.ulQueueFull++;
+            }
+        }
+
+        taskEXIT_CRITICAL();
+    }
+}
+
+/*-----------------------------------------------------------*/
+
+static void prvLoadTask( void * pvParameters )
+{
+    uint32_t ulTaskIdx = ( uint32_t ) ( uintptr_t ) pvParameters;
+    uint32_t ulSeq = ulTaskIdx;
+    TickType_t xLastWake = xTaskGetTickCount();
+    TickType_t xPeriod = 0;
+
+    if( xLoadParams.ulRate > 0 )
+    {
+        xPeriod = pdMS_TO_TICKS( 1000U / xLoadParams.ulRate );
+    }
+
+    while( xLoadStop == pdFALSE )
+    {
+        prvPublishOne( ulSeq );
+        ulSeq += xLoadParams.ulTasks;
+
+        if( xPeriod > 0 )
+        {
+            vTaskDelayUntil( &xLastWake, xPeriod );
+        }
+        else
+        {
+            /* Let the agent and lower priority tasks drain the queue */
+            taskYIELD();
+        }
+    }
+
+    ( void ) xTaskNotifyGiveIndexed( xLoadController, MQTT_LOAD_NOTIFY_IDX );
+    vTaskDelete( NULL );
+}
+
+/*-----------------------------------------------------------*/
+
+static BaseType_t prvSetupTopics( ConsoleIO_t * const pxCIO )
+{
+    BaseType_t xSuccess = pdTRUE;
+    char cThingName[ MQTT_LOAD_TOPIC_LEN ];
+
+    if( KVStore_getString( CS_CORE_THING_NAME, cThingName, sizeof( cThingName ) ) == 0 )
+    {
+        pxCIO->print( "Error: The thing name is not set.\r\n" );
+        xSuccess = pdFALSE;
+    }
+
+    for( uint32_t i = 0; ( i < xLoadParams.ulTopics ) && ( xSuccess == pdTRUE ); i++ )
+    {
+        int lLen = snprintf( cLoadTopics[ i ], MQTT_LOAD_TOPIC_LEN, "%s/load/%lu", cThingName, ( unsigned long ) i );
+
+        if( ( lLen <= 0 ) || ( lLen >= MQTT_LOAD_TOPIC_LEN ) )
+        {
+            pxCIO->print( "Error: The thing name is too long for the load topics.\r\n" );
+            xSuccess = pdFALSE;
+        }
+        else
+        {
+            uxLoadTopicLens[ i ] = ( size_t ) lLen;
+        }
+    }
+
+    return xSuccess;
+}
+
+/*-----------------------------------------------------------*/
+
+static void prvPrintStat( ConsoleIO_t * const pxCIO,
+                          const char * pcLabel,
+                          uint32_t ulValue )
+{
+    size_t xLen = snprintf( pcCliScratchBuffer, CLI_OUTPUT_SCRATCH_BUF_LEN,
+                            "| %-24s | %12lu |\r\n", pcLabel, ( unsigned long ) ulValue );
+
+    if( xLen >= CLI_OUTPUT_SCRATCH_BUF_LEN )
+    {
+        xLen = CLI_OUTPUT_SCRATCH_BUF_LEN - 1;
+    }
+
+    pxCIO->write( pcCliScratchBuffer, xLen );
+}
+
+/*-----------------------------------------------------------*/
+
+/* Upper bound of the bucket holding the given share of the latencies, in ms */
+static uint32_t prvPercentileMs( const MqttLoadStats_t * pxStats,
+                                 uint32_t ulPermille )
+{
+    uint32_t ulTarget = ( uint32_t ) ( ( ( uint64_t ) pxStats->ulCompleted * ulPermille + 999U ) / 1000U );
+    uint32_t ulCount = 0;
+    uint32_t ulBucket = 0;
+
+    for( ulBucket = 0; ulBucket < ( MQTT_LOAD_HIST_BUCKETS - 1 ); ulBucket++ )
+    {
+        ulCount += pxStats->pulHist[ ulBucket ];
+
+        if( ulCount >= ulTarget )
+        {
+            break;
+        }
+    }
+
+    return ( ulBucket < ( MQTT_LOAD_HIST_BUCKETS - 1 ) ) ? ( 1UL << ulBucket ) : ( pxStats->ulLatencyMaxUs / 1000U );
+}
+
+/*-----------------------------------------------------------*/
+
+static void prvPrintResults( ConsoleIO_t * const pxCIO,
+                             const MqttLoadStats_t * pxStats,
+                             uint32_t ulElapsedMs,
+                             const AgentCommandPoolStats_t * pxPoolBefore,
+                             const AgentCommandPoolStats_t * pxPoolAfter )
+{
+    MqttAgentStats_t xAgentStats = { 0 };
+    char cLabel[ 25 ];
+
+    pxCIO->print( "+-----------------------------------------+\r\n" );
+    pxCIO->print( "| Latency                  |   Publishes  |\r\n" );
+    pxCIO->print( "|--------------------------|--------------|\r\n" );
+
+    for( uint32_t i = 0; i < MQTT_LOAD_HIST_BUCKETS; i++ )
+    {
+        if( i < ( MQTT_LOAD_HIST_BUCKETS - 1 ) )
+        {
+            ( void ) snprintf( cLabel, sizeof( cLabel ), "< %lu ms", 1UL << i );
+        }
+        else
+        {
+            ( void ) snprintf( cLabel, sizeof( cLabel ), ">= %lu ms", 1UL << ( i - 1 ) );
+        }
+
+        prvPrintStat( pxCIO, cLabel, pxStats->pulHist[ i ] );
+    }
+
+    pxCIO->print( "|--------------------------|--------------|\r\n" );
+    prvPrintStat( pxCIO, "latency avg (us)",
+                  ( pxStats->ulCompleted > 0 ) ? ( uint32_t ) ( pxStats->ullLatencyTotalUs / pxStats->ulCompleted ) : 0 );
+    prvPrintStat( pxCIO, "latency p50 (ms) <=", prvPercentileMs( pxStats, 500 ) );
+    prvPrintStat( pxCIO, "latency p99 (ms) <=", prvPercentileMs( pxStats, 990 ) );
+    prvPrintStat( pxCIO, "latency max (us)", pxStats->ulLatencyMaxUs );
+    pxCIO->print( "|--------------------------|--------------|\r\n" );
+    prvPrintStat( pxCIO, "queued", pxStats->ulQueued );
+    prvPrintStat( pxCIO, "completed", pxStats->ulCompleted );
+    prvPrintStat( pxCIO, "failed", pxStats->ulFailed );
+    prvPrintStat( pxCIO, "still in flight", pxStats->ulInFlight );
+    prvPrintStat( pxCIO, "publishes / s",
+                  ( ulElapsedMs > 0 ) ? ( uint32_t ) ( ( ( uint64_t ) pxStats->ulCompleted * 1000U ) / ulElapsedMs ) : 0 );
+    prvPrintStat( pxCIO, "payload bytes / s",
+                  ( ulElapsedMs > 0 ) ? ( uint32_t ) ( ( pxStats->ullBytes * 1000U ) / ulElapsedMs ) : 0 );
+    pxCIO->print( "|--------------------------|--------------|\r\n" );
+    prvPrintStat( pxCIO, "no publish buffer", pxStats->ulNoBuffer );
+    prvPrintStat( pxCIO, "no agent command", pxStats->ulNoCommand );
+    prvPrintStat( pxCIO, "agent queue full", pxStats->ulQueueFull );
+    prvPrintStat( pxCIO, "pool exhausted events", pxPoolAfter->ulExhaustedCount - pxPoolBefore->ulExhaustedCount );
+    prvPrintStat( pxCIO, "pool high water", pxPoolAfter->ulHighWater );
+
+    if( xMqttAgentGetStats( &xAgentStats ) == pdTRUE )
+    {
+        prvPrintStat( pxCIO, "queue depth max", xAgentStats.ulQueueDepthMax );
+        prvPrintStat( pxCIO, "queue wait max (us)", xAgentStats.ulQueueWaitMaxUs );
+        prvPrintStat( pxCIO, "agent loop max (us)", xAgentStats.ulLoopMaxUs );
+    }
+
+    pxCIO->print( "+-----------------------------------------+\r\n" );
+}
+
+/*-----------------------------------------------------------*/
+
+static BaseType_t prvParseArgs( ConsoleIO_t * const pxCIO,
+                                uint32_t ulArgc,
+                                char * ppcArgv[] )
+{
+    BaseType_t xValid = pdTRUE;
+    uint32_t ulSeconds = 10;
+    uint32_t ulQoS = 1;
+
+    xLoadParams.ulRate = 10;
+    xLoadParams.ulPayloadLen = 64;
+    xLoadParams.ulTasks = 1;
+    xLoadParams.ulTopics = 1;
+
+    for( uint32_t i = 1; ( i < ulArgc ) && ( xValid == pdTRUE ); i += 2 )
+    {
+        uint32_t * pulValue = NULL;
+        uint32_t ulMin = 1;
+        uint32_t ulMax = 0;
+        char * pcEnd = NULL;
+
+        if( strcmp( ppcArgv[ i ], "-r" ) == 0 )
+        {
+            pulValue = &( xLoadParams.ulRate );
+            ulMin = 0;
+            ulMax = MQTT_LOAD_MAX_RATE;
+        }
+        else if( strcmp( ppcArgv[ i ], "-s" ) == 0 )
+        {
+            pulValue = &( xLoadParams.ulPayloadLen );
+            ulMax = MQTT_PUBLISH_POOL_BUFFER_LEN;
+        }
+        else if( strcmp( ppcArgv[ i ], "-q" ) == 0 )
+        {
+            pulValue = &ulQoS;
+            ulMin = 0;
+            ulMax = 1;
+        }
+        else if( strcmp( ppcArgv[ i ], "-n" ) == 0 )
+        {
+            pulValue = &( xLoadParams.ulTasks );
+            ulMax = MQTT_LOAD_MAX_TASKS;
+        }
+        else if( strcmp( ppcArgv[ i ], "-f" ) == 0 )
+        {
+            pulValue = &( xLoadParams.ulTopics );
+            ulMax = MQTT_LOAD_MAX_TOPICS;
+        }
+        else if( strcmp( ppcArgv[ i ], "-t" ) == 0 )
+        {
+            pulValue = &ulSeconds;
+            ulMax = MQTT_LOAD_MAX_S;
+        }
+
+        if( ( pulValue == NULL ) || ( ( i + 1 ) >= ulArgc ) )
+        {
+            xValid = pdFALSE;
+        }
+        else
+        {
+            *pulValue = strtoul( ppcArgv[ i + 1 ], &pcEnd, 10 );
+
+            if( ( pcEnd == ppcArgv[ i + 1 ] ) || ( *pcEnd != '\0' ) ||
+                ( *pulValue < ulMin ) || ( *pulValue > ulMax ) )
+            {
+                xValid = pdFALSE;
+            }
+        }
+
+        if( xValid == pdFALSE )
+        {
+            pxCIO->print( "Error: Invalid argument: " );
+            pxCIO->print( ppcArgv[ i ] );
+            pxCIO->print( ". See \"help mqttload\".\r\n" );
+        }
+    }
+
+    xLoadParams.xQoS = ( ulQoS == 0 ) ? MQTTQoS0 : MQTTQoS1;
+    xLoadParams.ulDurationMs = ulSeconds * 1000U;
+
+    return xValid;
+}
+
+/*-----------------------------------------------------------*/
+
+static void prvMqttLoadCommand( ConsoleIO_t * const pxCIO,
+                                uint32_t ulArgc,
+                                char * ppcArgv[] )
+{
+    static MqttLoadStats_t xResults;
+    AgentCommandPoolStats_t xPoolBefore = { 0 };
+    AgentCommandPoolStats_t xPoolAfter = { 0 };
+    uint32_t ulStarted = 0;
+    uint64_t ullStartUs;
+    uint32_t ulElapsedMs;
+
+    if( xLoadStats.ulInFlight != 0 )
+    {
+        /* Their callbacks still reference the topics and statistics */
+        pxCIO->print( "Error: Publishes of the previous run are still in flight.\r\n" );
+    }
+    else if( prvParseArgs( pxCIO, ulArgc, ppcArgv ) == pdFALSE )
+    {
+        /* Already reported */
+    }
+    else if( !xIsMqttAgentConnected() )
+    {
+        pxCIO->print( "Error: The MQTT agent is not connected.\r\n" );
+    }
+    else if( prvSetupTopics( pxCIO ) == pdTRUE )
+    {
+        ( void ) memset( &xLoadStats, 0, sizeof( xLoadStats ) );
+        xLoadStop = pdFALSE;
+        xLoadController = xTaskGetCurrentTaskHandle();
+        ( void ) xTaskNotifyStateClearIndexed( NULL, MQTT_LOAD_NOTIFY_IDX );
+
+        vMqttAgentResetStats();
+        Agent_GetPoolStats( &xPoolBefore );
+
+        ullStartUs = ullTimeBaseGetUs();
+
+        for( uint32_t i = 0; i < xLoadParams.ulTasks; i++ )
+        {
+            if( xTaskCreate( prvLoadTask, "MqttLoad", MQTT_LOAD_TASK_STACK, ( void * ) ( uintptr_t ) i,
+                             MQTT_LOAD_TASK_PRIORITY, NULL ) == pdPASS )
+            {
+                ulStarted++;
+            }
+            else
+            {
+                pxCIO->print( "Error: Failed to create a publishing task.\r\n" );
+            }
+        }
+
+        vTaskDelay( pdMS_TO_TICKS( xLoadParams.ulDurationMs ) );
+
+        xLoadStop = pdTRUE;
+
+        for( uint32_t i = 0; i < ulStarted; i++ )
+        {
+            ( void ) ulTaskNotifyTakeIndexed( MQTT_LOAD_NOTIFY_IDX, pdFALSE, portMAX_DELAY );
+        }
+
+        /* Completions after the end are part of the run, their publishes were queued during it */
+        for( uint32_t ulWaitMs = 0; ( xLoadStats.ulInFlight > 0 ) && ( ulWaitMs < MQTT_LOAD_DRAIN_MS ); ulWaitMs += 10 )
+        {
+            vTaskDelay( pdMS_TO_TICKS( 10 ) );
+        }
+
+        ulElapsedMs = ( uint32_t ) ( ( ullTimeBaseGetUs() - ullStartUs ) / 1000U );
+        Agent_GetPoolStats( &xPoolAfter );
+
+        taskENTER_CRITICAL();
+        xResults = xLoadStats;
+        taskEXIT_CRITICAL();
+
+        ( void ) snprintf( pcCliScratchBuffer, CLI_OUTPUT_SCRATCH_BUF_LEN,
+                           "%lu tasks, %lu msg/s each, %lu bytes, QoS%d, %lu topics, %lu ms\r\n",
+                           ( unsigned long ) ulStarted, ( unsigned long ) xLoadParams.ulRate,
+                           ( unsigned long ) xLoadParams.ulPayloadLen, xLoadParams.xQoS,
+                           ( unsigned long ) xLoadParams.ulTopics, ( unsigned long ) ulElapsedMs );
+        pxCIO->print( pcCliScratchBuffer );
+
+        prvPrintResults( pxCIO, &xResults, ulElapsedMs, &xPoolBefore, &xPoolAfter );
+    }
+}
@@ -0,0 +1,151 @@
+/*
+ * FreeRTOS STM32 Reference Integration
+ * Copyright (C) 2021 Amazon.com, Inc. or its affiliates.  All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ * http://www.FreeRTOS.org
+ * http://aws.amazon.com/freertos
+ *
+ */
+
+/* Standard includes. */
+#include <string.h>
+#include <stdint.h>
+#include <stdio.h>
+
+/* FreeRTOS includes. */
+#include "FreeRTOS.h"
+#include "task.h"
+
+#include "cli.h"
+#include "cli_prv.h"
+
+#include "mqtt_agent_task.h"
+#include "freertos_command_pool.h"
+
+static void prvMqttStatsCommand( ConsoleIO_t * const pxCIO,
+                                 uint32_t ulArgc,
+                                 char * ppcArgv[] );
+
+const CLI_Command_Definition_t xCommandDef_mqttstats =
+{
+    "mqttstats",
+    "mqttstats [reset]\r\n"
+    "    Display MQTT agent queue wait, publish round trip and event loop statistics.\r\n"
+    "    Requires MQTT_AGENT_STATS_ENABLED to be set to 1.\r\n\n",
+    prvMqttStatsCommand
+};
+
+/*-----------------------------------------------------------*/
+
+static void prvPrintStat( ConsoleIO_t * const pxCIO,
+                          const char * pcLabel,
+                          uint32_t ulValue )
+{
+    size_t xLen = snprintf( pcCliScratchBuffer, CLI_OUTPUT_SCRATCH_BUF_LEN,
+                            "| %-24s | %12lu |\r\n", pcLabel, ulValue );
+
+    if( xLen >= CLI_OUTPUT_SCRATCH_BUF_LEN )
+    {
+        xLen = CLI_OUTPUT_SCRATCH_BUF_LEN - 1;
+    }
+
+    pxCIO->write( pcCliScratchBuffer, xLen );
+}
+
+/*-----------------------------------------------------------*/
+
+static void prvPrintStats( ConsoleIO_t * const pxCIO,
+                           const MqttAgentStats_t * pxStats )
+{
+    AgentCommandPoolStats_t xPoolStats = { 0 };
+    char pcLabel[ 25 ];
+
+    Agent_GetPoolStats( &xPoolStats );
+
+    pxCIO->print( "+-----------------------------------------+\r\n" );
+    pxCIO->print( "| Queue wait               |     Commands |\r\n" );
+    pxCIO->print( "|--------------------------|--------------|\r\n" );
+
+    for( uint32_t i = 0; i < MQTT_AGENT_STATS_HIST_BUCKETS; i++ )
+    {
+        if( i < ( MQTT_AGENT_STATS_HIST_BUCKETS - 1 ) )
+        {
+            ( void ) snprintf( pcLabel, sizeof( pcLabel ), "< %lu us", 64UL << ( 2 * i ) );
+        }
+        else
+        {
+            ( void ) snprintf( pcLabel, sizeof( pcLabel ), ">= %lu us", 64UL << ( 2 * ( i - 1 ) ) );
+        }
+
+        prvPrintStat( pxCIO, pcLabel, pxStats->pulQueueWaitHist[ i ] );
+    }
+
+    pxCIO->print( "|--------------------------|--------------|\r\n" );
+    prvPrintStat( pxCIO, "queue wait max (us)", pxStats->ulQueueWaitMaxUs );
+    prvPrintStat( pxCIO, "queue depth max", pxStats->ulQueueDepthMax );
+    prvPrintStat( pxCIO, "pool in use", xPoolStats.ulInUse );
+    prvPrintStat( pxCIO, "pool high water", xPoolStats.ulHighWater );
+    prvPrintStat( pxCIO, "pool exhausted", xPoolStats.ulExhaustedCount );
+    pxCIO->print( "|--------------------------|--------------|\r\n" );
+    prvPrintStat( pxCIO, "publishes acked", pxStats->ulPublishAcked );
+    prvPrintStat( pxCIO, "publish rtt avg (ms)",
+                  ( pxStats->ulPublishAcked > 0 ) ? ( pxStats->ulPublishRttTotalMs / pxStats->ulPublishAcked ) : 0 );
+    prvPrintStat( pxCIO, "publish rtt max (ms)", pxStats->ulPublishRttMaxMs );
+    pxCIO->print( "|--------------------------|--------------|\r\n" );
+    prvPrintStat( pxCIO, "loop iterations", pxStats->ulLoopIterations );
+    prvPrintStat( pxCIO, "loop avg (us)",
+                  ( pxStats->ulLoopIterations > 0 ) ? ( uint32_t ) ( pxStats->ullLoopTotalUs / pxStats->ulLoopIterations ) : 0 );
+    prvPrintStat( pxCIO, "loop max (us)", pxStats->ulLoopMaxUs );
+    prvPrintStat( pxCIO, "recv wakeups", pxStats->ulRecvWakeups );
+    prvPrintStat( pxCIO, "spurious wakeups", pxStats->ulSpuriousWakeups );
+    pxCIO->print( "+-----------------------------------------+\r\n" );
+}
+
+/*-----------------------------------------------------------*/
+
+static void prvMqttStatsCommand( ConsoleIO_t * const pxCIO,
+                                 uint32_t ulArgc,
+                                 char * ppcArgv[] )
+{
+    MqttAgentStats_t xStats = { 0 };
+
+    if( ulArgc > 2 )
+    {
+        pxCIO->print( "Error: Too many arguments.\r\n" );
+    }
+    else if( ( ulArgc == 2 ) &&
+             ( strcmp( "reset", ppcArgv[ 1 ] ) != 0 ) )
+    {
+        pxCIO->print( "Error: Unknown argument. Usage: mqttstats [reset]\r\n" );
+    }
+    else if( xMqttAgentGetStats( &xStats ) == pdFALSE )
+    {
+        pxCIO->print( "Error: No MQTT agent statistics available. Is MQTT_AGENT_STATS_ENABLED set?\r\n" );
+    }
+    else if( ulArgc == 2 )
+    {
+        vMqttAgentResetStats();
+        pxCIO->print( "MQTT agent statistics cleared.\r\n" );
+    }
+    else
+    {
+        prvPrintStats( pxCIO, &xStats );
+    }
+}
@@ -0,0 +1,416 @@
+/*
+ * FreeRTOS STM32 Reference Integration
+ *
+ * Copyright (c) 2022 Amazon.com, Inc. or its affiliates. All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+/* Standard includes. */
+#include <string.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+/* FreeRTOS includes. */
+#include "FreeRTOS.h"
+#include "task.h"
+#include "event_groups.h"
+
+#include "cli.h"
+#include "cli_prv.h"
+
+#include "net/mxchip/mx_netconn.h"
+#include "sys_evt.h"
+
+#define NETIMPAIR_MAX_DELAY_MS     5000
+#define NETIMPAIR_MAX_OUTAGE_S     600
+#define NETIMPAIR_RECOVER_MAX_S    180
+#define NETIMPAIR_POLL_MS          10
+
+static void prvNetImpairCommand( ConsoleIO_t * const pxCIO,
+                                 uint32_t ulArgc,
+                                 char * ppcArgv[] );
+
+const CLI_Command_Definition_t xCommandDef_netimpair =
+{
+    "netimpair",
+    "netimpair\r\n"
+    "    netimpair\r\n"
+    "        Display the link impairment settings and counters.\r\n\n"
+    "    netimpair [ --loss <%> ] [ --rx-drop <%> ] [ --tx-drop <%> ] [ --corrupt <%> ]\r\n"
+    "              [ --reorder <%> ] [ --delay <ms> ] [ --jitter <ms> ] [ --spi-error <%> ]\r\n"
+    "        Impair the wifi link until changed again. Options which are not given are off.\r\n"
+    "        Rates are in percent of frames with one decimal, --loss sets both drop rates.\r\n"
+    "        Delay, jitter, reordering and corruption apply to received frames, --spi-error\r\n"
+    "        to the SPI headers from the wifi module. Run iperf or mqttload to benchmark\r\n"
+    "        the stack under the impairment.\r\n\n"
+    "    netimpair --outage <s>\r\n"
+    "        Drop all frames for s seconds on top of the current impairment, then time\r\n"
+    "        how long the network and MQTT connections take to come back.\r\n\n"
+    "    netimpair off\r\n"
+    "        Turn the impairment off.\r\n\n",
+    prvNetImpairCommand
+};
+
+/*-----------------------------------------------------------*/
+
+static BaseType_t prvParseUInt( const char * pcArg,
+                                uint32_t ulMax,
+                                uint32_t * pulValue )
+{
+    BaseType_t xSuccess = pdFALSE;
+    char * pcEnd = NULL;
+    uint32_t ulValue;
+
+    if( pcArg != NULL )
+    {
+        ulValue = strtoul( pcArg, &pcEnd, 10 );
+
+        if( ( pcEnd != pcArg ) && ( *pcEnd == '\0' ) && ( ulValue <= ulMax ) )
+        {
+            *pulValue = ulValue;
+            xSuccess = pdTRUE;
+        }
+    }
+
+    return xSuccess;
+}
+
+/*-----------------------------------------------------------*/
+
+/* Parse a percentage of at most 100 with up to one decimal, e.g. "2.5", into per mille */
+static BaseType_t prvParsePercent( const char * pcArg,
+                                   uint32_t * pulPermille )
+{
+    BaseType_t xSuccess = pdFALSE;
+    char * pcEnd = NULL;
+    uint32_t ulValue;
+
+    if( ( pcArg != NULL ) &&
+        ( pcArg[ 0 ] >= '0' ) &&
+        ( pcArg[ 0 ] <= '9' ) )
+    {
+        ulValue = strtoul( pcArg, &pcEnd, 10 ) * 10U;
+
+        if( ( pcEnd[ 0 ] == '.' ) &&
+            ( pcEnd[ 1 ] >= '0' ) &&
+            ( pcEnd[ 1 ] <= '9' ) )
+        {
+            ulValue += ( uint32_t ) ( pcEnd[ 1 ] - '0' );
+            pcEnd += 2;
+        }
+
+        if( ( *pcEnd == '\0' ) && ( ulValue <= 1000U ) )
+        {
+            *pulPermille = ulValue;
+            xSuccess = pdTRUE;
+        }
+    }
+
+    return xSuccess;
+}
+
+/*-----------------------------------------------------------*/
+
+static void prvPrintRow( ConsoleIO_t * const pxCIO,
+                         const char * pcLabel,
+                         uint32_t ulValue,
+                         BaseType_t xPermille )
+{
+    size_t xLen;
+
+    if( xPermille == pdTRUE )
+    {
+        xLen = snprintf( pcCliScratchBuffer, CLI_OUTPUT_SCRATCH_BUF_LEN,
+                         "| %-24s | %10lu.%lu |\r\n", pcLabel,
+                         ( unsigned long ) ( ulValue / 10U ), ( unsigned long ) ( ulValue % 10U ) );
+    }
+    else
+    {
+        xLen = snprintf( pcCliScratchBuffer, CLI_OUTPUT_SCRATCH_BUF_LEN,
+                         "| %-24s | %12lu |\r\n", pcLabel, ( unsigned long ) ulValue );
+    }
+
+    if( xLen >= CLI_OUTPUT_SCRATCH_BUF_LEN )
+    {
+        xLen = CLI_OUTPUT_SCRATCH_BUF_LEN - 1;
+    }
+
+    pxCIO->write( pcCliScratchBuffer, xLen );
+}
+
+/*-----------------------------------------------------------*/
+
+static void prvPrintImpairment( ConsoleIO_t * const pxCIO )
+{
+    NetImpairConfig_t xConfig;
+    NetImpairStats_t xStats;
+
+    ( void ) net_get_impairment( &xConfig, &xStats );
+
+    pxCIO->print( "+-----------------------------------------+\r\n" );
+    prvPrintRow( pxCIO, "rx drop (%)", xConfig.ulRxDropPermille, pdTRUE );
+    prvPrintRow( pxCIO, "tx drop (%)", xConfig.ulTxDropPermille, pdTRUE );
+    prvPrintRow( pxCIO, "corrupt (%)", xConfig.ulCorruptPermille, pdTRUE );
+    prvPrintRow( pxCIO, "reorder (%)", xConfig.ulReorderPermille, pdTRUE );
+    prvPrintRow( pxCIO, "spi error (%)", xConfig.ulSpiErrorPermille, pdTRUE );
+    prvPrintRow( pxCIO, "delay (ms)", xConfig.ulDelayMs, pdFALSE );
+    prvPrintRow( pxCIO, "jitter (ms)", xConfig.ulJitterMs, pdFALSE );
+    pxCIO->print( "|--------------------------|--------------|\r\n" );
+    prvPrintRow( pxCIO, "rx dropped", xStats.ulRxDropped, pdFALSE );
+    prvPrintRow( pxCIO, "tx dropped", xStats.ulTxDropped, pdFALSE );
+    prvPrintRow( pxCIO, "corrupted", xStats.ulCorrupted, pdFALSE );
+    prvPrintRow( pxCIO, "reordered", xStats.ulReordered, pdFALSE );
+    prvPrintRow( pxCIO, "delayed", xStats.ulDelayed, pdFALSE );
+    prvPrintRow( pxCIO, "hold slots full", xStats.ulHoldFull, pdFALSE );
+    prvPrintRow( pxCIO, "spi errors", xStats.ulSpiErrors, pdFALSE );
+    pxCIO->print( "+-----------------------------------------+\r\n" );
+}
+
+/*-----------------------------------------------------------*/
+
+/*
+ * Black out the link for ulSeconds and time the recovery of the connections.
+ * Times are measured by polling the system event group every NETIMPAIR_POLL_MS.
+ */
+static void prvRunOutage( ConsoleIO_t * const pxCIO,
+                          uint32_t ulSeconds )
+{
+    NetImpairConfig_t xSaved;
+    NetImpairConfig_t xOutage;
+    const EventBits_t xConnected = EVT_MASK_NET_CONNECTED | EVT_MASK_MQTT_CONNECTED;
+    EventBits_t xLost = 0;
+    EventBits_t xEvents;
+    TickType_t xMqttLostTick = 0;
+    TickType_t xNetUpTick = 0;
+    TickType_t xMqttUpTick = 0;
+    TickType_t xStartTick;
+    TickType_t xEndTick;
+
+    ( void ) net_get_impairment( &xSaved, NULL );
+
+    if( ( xEventGroupGetBits( xSystemEvents ) & xConnected ) != xConnected )
+    {
+        pxCIO->print( "Warning: Not connected to the MQTT broker, recovery times are meaningless.\r\n" );
+    }
+
+    xOutage = xSaved;
+    xOutage.ulRxDropPermille = 1000;
+    xOutage.ulTxDropPermille = 1000;
+
+    ( void ) net_set_impairment( &xOutage );
+    xStartTick = xTaskGetTickCount();
+
+    while( ( xTaskGetTickCount() - xStartTick ) < pdMS_TO_TICKS( ulSeconds * 1000U ) )
+    {
+        xEvents = xEventGroupGetBits( xSystemEvents );
+
+        if( ( ( xLost & EVT_MASK_MQTT_CONNECTED ) == 0 ) &&
+            ( ( xEvents & EVT_MASK_MQTT_CONNECTED ) == 0 ) )
+        {
+            xMqttLostTick = xTaskGetTickCount();
+        }
+
+        xLost |= ( xConnected & ~xEvents );
+        vTaskDelay( pdMS_TO_TICKS( NETIMPAIR_POLL_MS ) );
+    }
+
+    ( void ) net_set_impairment( &xSaved );
+    xEndTick = xTaskGetTickCount();
+
+    pxCIO->print( "Outage over, waiting for the connections to recover...\r\n" );
+
+    do
+    {
+        xEvents = xEventGroupGetBits( xSystemEvents );
+
+        /* A connection may only notice the outage once traffic resumes */
+        if( ( ( xLost & EVT_MASK_MQTT_CONNECTED ) == 0 ) &&
+            ( ( xEvents & EVT_MASK_MQTT_CONNECTED ) == 0 ) )
+        {
+            xMqttLostTick = xTaskGetTickCount();
+        }
+
+        xLost |= ( xConnected & ~xEvents );
+
+        if( ( xNetUpTick == 0 ) &&
+            ( ( xEvents & EVT_MASK_NET_CONNECTED ) != 0 ) )
+        {
+            xNetUpTick = xTaskGetTickCount();
+        }
+
+        if( ( xMqttUpTick == 0 ) &&
+            ( ( xLost & EVT_MASK_MQTT_CONNECTED ) != 0 ) &&
+            ( ( xEvents & EVT_MASK_MQTT_CONNECTED ) != 0 ) )
+        {
+            xMqttUpTick = xTaskGetTickCount();
+        }
+
+        /* Give a connection which survived the outage a few seconds to fail late */
+        if( ( xMqttUpTick != 0 ) ||
+            ( ( ( xLost & EVT_MASK_MQTT_CONNECTED ) == 0 ) &&
+              ( ( xTaskGetTickCount() - xEndTick ) > pdMS_TO_TICKS( 5000 ) ) ) )
+        {
+            break;
+        }
+
+        vTaskDelay( pdMS_TO_TICKS( NETIMPAIR_POLL_MS ) );
+    }
+    while( ( xTaskGetTickCount() - xEndTick ) < pdMS_TO_TICKS( NETIMPAIR_RECOVER_MAX_S * 1000U ) );
+
+    ( void ) snprintf( pcCliScratchBuffer, CLI_OUTPUT_SCRATCH_BUF_LEN,
+                       "Outage of %lu s, network %s\r\n",
+                       ( unsigned long ) ulSeconds,
+                       ( ( xLost & EVT_MASK_NET_CONNECTED ) != 0 ) ? "went down" : "stayed up" );
+    pxCIO->print( pcCliScratchBuffer );
+
+    if( ( xLost & EVT_MASK_NET_CONNECTED ) != 0 )
+    {
+        ( void ) snprintf( pcCliScratchBuffer, CLI_OUTPUT_SCRATCH_BUF_LEN,
+                           "    network up %lu ms after the end of the outage\r\n",
+                           ( unsigned long ) ( ( xNetUpTick != 0 ) ? pdTICKS_TO_MS( xNetUpTick - xEndTick ) : 0 ) );
+        pxCIO->print( pcCliScratchBuffer );
+    }
+
+    if( ( xLost & EVT_MASK_MQTT_CONNECTED ) == 0 )
+    {
+        pxCIO->print( "    MQTT connection survived the outage\r\n" );
+    }
+    else
+    {
+        ( void ) snprintf( pcCliScratchBuffer, CLI_OUTPUT_SCRATCH_BUF_LEN,
+                           "    MQTT disconnected %lu ms after the start of the outage\r\n",
+                           ( unsigned long ) pdTICKS_TO_MS( xMqttLostTick - xStartTick ) );
+        pxCIO->print( pcCliScratchBuffer );
+
+        if( xMqttUpTick != 0 )
+        {
+            ( void ) snprintf( pcCliScratchBuffer, CLI_OUTPUT_SCRATCH_BUF_LEN,
+                               "    MQTT reconnected %lu ms after the end of the outage\r\n",
+                               ( unsigned long ) pdTICKS_TO_MS( xMqttUpTick - xEndTick ) );
+        }
+        else
+        {
+            ( void ) snprintf( pcCliScratchBuffer, CLI_OUTPUT_SCRATCH_BUF_LEN,
+                               "    MQTT not reconnected within %lu s\r\n",
+                               ( unsigned long ) NETIMPAIR_RECOVER_MAX_S );
+        }
+
+        pxCIO->print( pcCliScratchBuffer );
+    }
+}
+
+/*-----------------------------------------------------------*/
+
+static void prvNetImpairCommand( ConsoleIO_t * const pxCIO,
+                                 uint32_t ulArgc,
+                                 char * ppcArgv[] )
+{
+    NetImpairConfig_t xConfig = { 0 };
+    BaseType_t xValid = pdTRUE;
+    uint32_t ulOutageS = 0;
+    uint32_t ulValue = 0;
+
+    for( uint32_t i = 1; ( i < ulArgc ) && ( xValid == pdTRUE ); i++ )
+    {
+        const char * pcNext = ( ( i + 1 ) < ulArgc ) ? ppcArgv[ i + 1 ] : NULL;
+
+        if( strcmp( ppcArgv[ i ], "off" ) == 0 )
+        {
+            /* All zero */
+        }
+        else if( ( strcmp( ppcArgv[ i ], "--loss" ) == 0 ) &&
+                 ( prvParsePercent( pcNext, &ulValue ) == pdTRUE ) )
+        {
+            xConfig.ulRxDropPermille = ulValue;
+            xConfig.ulTxDropPermille = ulValue;
+            i++;
+        }
+        else if( ( strcmp( ppcArgv[ i ], "--rx-drop" ) == 0 ) &&
+                 ( prvParsePercent( pcNext, &xConfig.ulRxDropPermille ) == pdTRUE ) )
+        {
+            i++;
+        }
+        else if( ( strcmp( ppcArgv[ i ], "--tx-drop" ) == 0 ) &&
+                 ( prvParsePercent( pcNext, &xConfig.ulTxDropPermille ) == pdTRUE ) )
+        {
+            i++;
+        }
+        else if( ( strcmp( ppcArgv[ i ], "--corrupt" ) == 0 ) &&
+                 ( prvParsePercent( pcNext, &xConfig.ulCorruptPermille ) == pdTRUE ) )
+        {
+            i++;
+        }
+        else if( ( strcmp( ppcArgv[ i ], "--reorder" ) == 0 ) &&
+                 ( prvParsePercent( pcNext, &xConfig.ulReorderPermille ) == pdTRUE ) )
+        {
+            i++;
+        }
+        else if( ( strcmp( ppcArgv[ i ], "--spi-error" ) == 0 ) &&
+                 ( prvParsePercent( pcNext, &xConfig.ulSpiErrorPermille ) == pdTRUE ) )
+        {
+            i++;
+        }
+        else if( ( strcmp( ppcArgv[ i ], "--delay" ) == 0 ) &&
+                 ( prvParseUInt( pcNext, NETIMPAIR_MAX_DELAY_MS, &xConfig.ulDelayMs ) == pdTRUE ) )
+        {
+            i++;
+        }
+        else if( ( strcmp( ppcArgv[ i ], "--jitter" ) == 0 ) &&
+                 ( prvParseUInt( pcNext, NETIMPAIR_MAX_DELAY_MS, &xConfig.ulJitterMs ) == pdTRUE ) )
+        {
+            i++;
+        }
+        else if( ( strcmp( ppcArgv[ i ], "--outage" ) == 0 ) &&
+                 ( prvParseUInt( pcNext, NETIMPAIR_MAX_OUTAGE_S, &ulOutageS ) == pdTRUE ) &&
+                 ( ulOutageS > 0 ) )
+        {
+            i++;
+        }
+        else
+        {
+            pxCIO->print( "Error: Invalid argument: " );
+            pxCIO->print( ppcArgv[ i ] );
+            pxCIO->print( "\r\n" );
+            xValid = pdFALSE;
+        }
+    }
+
+    if( xValid == pdFALSE )
+    {
+        /* Already reported */
+    }
+    else if( net_get_impairment( NULL, NULL ) == pdFALSE )
+    {
+        pxCIO->print( "Error: Link impairment is not enabled in this build, see MX_NET_IMPAIR_ENABLED.\r\n" );
+    }
+    else if( ulOutageS > 0 )
+    {
+        prvRunOutage( pxCIO, ulOutageS );
+    }
+    else
+    {
+        if( ulArgc > 1 )
+        {
+            ( void ) net_set_impairment( &xConfig );
+        }
+
+        prvPrintImpairment( pxCIO );
+    }
+}
@@ -0,0 +1,161 @@
+/*
+ * FreeRTOS STM32 Reference Integration
+ * Copyright (C) 2021 Amazon.com, Inc. or its affiliates.  All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ * http://www.FreeRTOS.org
+ * http://aws.amazon.com/freertos
+ *
+
+/* Standard includes. */
+#include <string.h>
+#include <stdint.h>
+#include <stdio.h>
+
+/* FreeRTOS includes. */
+#include "FreeRTOS.h"
+#include "task.h"
+
+#include "cli.h"
+#include "cli_prv.h"
+
+#include "net/mxchip/mx_netconn.h"
+#include "lwip/sys.h"
+
+static void prvNetStatCommand( ConsoleIO_t * const pxCIO,
+                               uint32_t ulArgc,
+                               char * ppcArgv[] );
+
+const CLI_Command_Definition_t xCommandDef_netstat =
+{
+    "netstat",
+    "netstat\r\n"
+    "    netstat\r\n"
+    "        Display wifi module dataplane throughput and latency counters,\r\n"
+    "        and the lwIP mailbox counters.\r\n\n"
+    "    netstat -c | --clear\r\n"
+    "        Display and then reset the counters.\r\n\n",
+    prvNetStatCommand
+};
+
+/*-----------------------------------------------------------*/
+
+static void prvPrintCounter( ConsoleIO_t * const pxCIO,
+                             const char * pcLabel,
+                             uint32_t ulValue )
+{
+    size_t xLen = snprintf( pcCliScratchBuffer, CLI_OUTPUT_SCRATCH_BUF_LEN,
+                            "| %-24s | %12lu |\r\n", pcLabel, ulValue );
+
+    if( xLen >= CLI_OUTPUT_SCRATCH_BUF_LEN )
+    {
+        xLen = CLI_OUTPUT_SCRATCH_BUF_LEN - 1;
+    }
+
+    pxCIO->write( pcCliScratchBuffer, xLen );
+}
+
+/*-----------------------------------------------------------*/
+
+static void prvNetStatCommand( ConsoleIO_t * const pxCIO,
+                               uint32_t ulArgc,
+                               char * ppcArgv[] )
+{
+    MxDataplaneStats_t xStats = { 0 };
+    SysArchMboxStats_t xMboxStats = { 0 };
+    BaseType_t xClear = pdFALSE;
+
+    for( uint32_t i = 1; i < ulArgc; i++ )
+    {
+        if( ( strcmp( "-c", ppcArgv[ i ] ) == 0 ) ||
+            ( strcmp( "--clear", ppcArgv[ i ] ) == 0 ) )
+        {
+            xClear = pdTRUE;
+        }
+        else
+        {
+            pxCIO->print( "Error: Unrecognized argument: " );
+            pxCIO->print( ppcArgv[ i ] );
+            pxCIO->print( "\r\n" );
+        }
+    }
+
+    if( net_get_dataplane_stats( &xStats ) == pdFALSE )
+    {
+        pxCIO->print( "Error: Wifi dataplane has not been started.\r\n" );
+    }
+    else
+    {
+        uint32_t ulCyclesPerUs = SystemCoreClock / 1000000;
+        uint32_t ulAvgXferUs = 0;
+        uint32_t ulFramesPerXferX100 = 0;
+        uint32_t ulFramesPerBurstX100 = 0;
+
+        if( xStats.ulTransactions > 0 )
+        {
+            ulAvgXferUs = ( uint32_t ) ( xStats.ullXferCycles / xStats.ulTransactions / ulCyclesPerUs );
+            ulFramesPerXferX100 = ( 100 * ( xStats.ulTxFrames + xStats.ulRxFrames ) ) / xStats.ulTransactions;
+        }
+
+        if( xStats.ulBursts > 0 )
+        {
+            ulFramesPerBurstX100 = ( 100 * xStats.ulTransactions ) / xStats.ulBursts;
+        }
+
+        pxCIO->print( "+-----------------------------------------+\r\n" );
+        pxCIO->print( "| Counter                  |        Value |\r\n" );
+        pxCIO->print( "|--------------------------|--------------|\r\n" );
+        prvPrintCounter( pxCIO, "SPI transactions", xStats.ulTransactions );
+        prvPrintCounter( pxCIO, "TX frames", xStats.ulTxFrames );
+        prvPrintCounter( pxCIO, "TX priority frames", xStats.ulTxPrioFrames );
+        prvPrintCounter( pxCIO, "TX bytes", xStats.ulTxBytes );
+        prvPrintCounter( pxCIO, "RX frames", xStats.ulRxFrames );
+        prvPrintCounter( pxCIO, "RX bytes", xStats.ulRxBytes );
+        prvPrintCounter( pxCIO, "RX direct frames", xStats.ulRxDirectFrames );
+        prvPrintCounter( pxCIO, "Transfer errors", xStats.ulErrors );
+        prvPrintCounter( pxCIO, "Flow timeouts", xStats.ulFlowTimeouts );
+        prvPrintCounter( pxCIO, "Header errors", xStats.ulHeaderErrors );
+        prvPrintCounter( pxCIO, "SPI clock divisor", xStats.ulSpiClockDivisor );
+        prvPrintCounter( pxCIO, "SPI clock changes", xStats.ulSpiClockChanges );
+        prvPrintCounter( pxCIO, "RX pbuf misses", xStats.ulRxPbufMiss );
+        prvPrintCounter( pxCIO, "Polled wakeups", xStats.ulPollHits );
+        prvPrintCounter( pxCIO, "Bursts", xStats.ulBursts );
+        prvPrintCounter( pxCIO, "Max burst length", xStats.ulMaxBurstLen );
+        prvPrintCounter( pxCIO, "Frames / xfer (x100)", ulFramesPerXferX100 );
+        prvPrintCounter( pxCIO, "Xfers / burst (x100)", ulFramesPerBurstX100 );
+        prvPrintCounter( pxCIO, "Avg xfer time (us)", ulAvgXferUs );
+        prvPrintCounter( pxCIO, "Max xfer time (us)", xStats.ulMaxXferCycles / ulCyclesPerUs );
+        prvPrintCounter( pxCIO, "Control queue depth", xStats.ulCtrlQueueDepth );
+        prvPrintCounter( pxCIO, "Data queue depth", xStats.ulDataQueueDepth );
+        prvPrintCounter( pxCIO, "Priority queue depth", xStats.ulPrioQueueDepth );
+
+        sys_arch_mbox_get_stats( &xMboxStats, xClear );
+        prvPrintCounter( pxCIO, "lwIP mbox posts", xMboxStats.ulPosts );
+        prvPrintCounter( pxCIO, "lwIP mbox full", xMboxStats.ulFull );
+        prvPrintCounter( pxCIO, "lwIP mbox max depth", xMboxStats.ulMaxDepth );
+        prvPrintCounter( pxCIO, "tcpip mbox depth", xMboxStats.ulTcpipDepth );
+        prvPrintCounter( pxCIO, "tcpip mbox max depth", xMboxStats.ulTcpipMaxDepth );
+        pxCIO->print( "+-----------------------------------------+\r\n" );
+
+        if( xClear == pdTRUE )
+        {
+            net_clear_dataplane_stats();
+        }
+    }
+}
@@ -0,0 +1,173 @@
+/*
+ * FreeRTOS STM32 Reference Integration
+ *
+ * Copyright (c) 2022 Amazon.com, Inc. or its affiliates. All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#include <string.h>
+#include <stdio.h>
+#include <stdarg.h>
+
+#include "FreeRTOS.h"
+#include "task.h"
+
+#include "cli.h"
+#include "cli_prv.h"
+
+#if defined( TFM_PSA_API )
+
+#include "ns_interface_stats.h"
+
+static void prvNsIntfCommand( ConsoleIO_t * const pxCIO,
+                              uint32_t ulArgc,
+                              char * ppcArgv[] );
+
+const CLI_Command_Definition_t xCommandDef_nsintf =
+{
+    "nsintf",
+    "nsintf [ stat | reset ]\r\n"
+    "    Contention of the lock serialising the secure calls.\r\n"
+    "        stat:  Wait and hold times per calling task since boot or the last reset.\r\n"
+    "        reset: Clear the statistics.\r\n"
+    "    Without an argument, stat is run.\r\n\n",
+    prvNsIntfCommand
+};
+
+/*-----------------------------------------------------------*/
+
+static void prvPrintf( ConsoleIO_t * const pxCIO,
+                       const char * pcFormat,
+                       ... ) __attribute__( ( format( printf, 2, 3 ) ) );
+
+static void prvPrintf( ConsoleIO_t * const pxCIO,
+                       const char * pcFormat,
+                       ... )
+{
+    va_list xArgs;
+    size_t xLen;
+
+    va_start( xArgs, pcFormat );
+    xLen = vsnprintf( pcCliScratchBuffer, CLI_OUTPUT_SCRATCH_BUF_LEN, pcFormat, xArgs );
+    va_end( xArgs );
+
+    if( xLen >= CLI_OUTPUT_SCRATCH_BUF_LEN )
+    {
+        xLen = CLI_OUTPUT_SCRATCH_BUF_LEN - 1;
+    }
+
+    pxCIO->write( pcCliScratchBuffer, xLen );
+}
+
+/*-----------------------------------------------------------*/
+
+static void prvNsIntfStat( ConsoleIO_t * const pxCIO )
+{
+    static NsIntfStats_t xStats;
+    unsigned long ulAvgWait = 0;
+    unsigned long ulAvgHold = 0;
+
+    vNsIntfGetStats( &xStats );
+
+    if( xStats.ulContended > 0 )
+    {
+        ulAvgWait = ( unsigned long ) ( xStats.ullWaitUs / xStats.ulContended );
+    }
+
+    if( xStats.ulCalls > 0 )
+    {
+        ulAvgHold = ( unsigned long ) ( xStats.ullHoldUs / xStats.ulCalls );
+    }
+
+    prvPrintf( pxCIO, "Secure calls: %lu, contended: %lu, priority inheritance: %lu\r\n",
+               ( unsigned long ) xStats.ulCalls,
+               ( unsigned long ) xStats.ulContended,
+               ( unsigned long ) xStats.ulInversions );
+    prvPrintf( pxCIO, "Wait (contended) avg: %lu us, max: %lu us by %s\r\n",
+               ulAvgWait, ( unsigned long ) xStats.ulMaxWaitUs, xStats.pcMaxWaitTask );
+    prvPrintf( pxCIO, "Hold avg: %lu us, max: %lu us by %s, veneer 0x%08lx\r\n",
+               ulAvgHold, ( unsigned long ) xStats.ulMaxHoldUs, xStats.pcMaxHoldTask,
+               ( unsigned long ) ( ( uintptr_t ) xStats.pvMaxHoldFn & ~( ( uintptr_t ) 1U ) ) );
+
+    pxCIO->print( "+------------------+------+------------+------------+------------+------------+------------+\r\n" );
+    pxCIO->print( "| Task             | Prio |   Calls    | Contended  | Avg wait   | Max wait   | Max hold   |\r\n" );
+    pxCIO->print( "+------------------+------+------------+------------+------------+------------+------------+\r\n" );
+
+    for( size_t i = 0; i < NS_INTF_STATS_CLIENTS; i++ )
+    {
+        const NsIntfClientStats_t * pxClient = &( xStats.xClients[ i ] );
+        unsigned long ulClientAvgWait = 0;
+
+        if( pxClient->ulCalls == 0 )
+        {
+            continue;
+        }
+
+        if( pxClient->ulContended > 0 )
+        {
+            ulClientAvgWait = ( unsigned long ) ( pxClient->ullWaitUs / pxClient->ulContended );
+        }
+
+        prvPrintf( pxCIO, "| %-16.16s | %4lu | %10lu | %10lu | %10lu | %10lu | %10lu |\r\n",
+                   pxClient->pcName,
+                   ( unsigned long ) pxClient->uxPriority,
+                   ( unsigned long ) pxClient->ulCalls,
+                   ( unsigned long ) pxClient->ulContended,
+                   ulClientAvgWait,
+                   ( unsigned long ) pxClient->ulMaxWaitUs,
+                   ( unsigned long ) pxClient->ulMaxHoldUs );
+    }
+
+    pxCIO->print( "+------------------+------+------------+------------+------------+------------+------------+\r\n" );
+
+    if( xStats.ulUntracked > 0 )
+    {
+        prvPrintf( pxCIO, "%lu calls from untracked tasks\r\n", ( unsigned long ) xStats.ulUntracked );
+    }
+}
+
+/*-----------------------------------------------------------*/
+
+static void prvNsIntfCommand( ConsoleIO_t * const pxCIO,
+                              uint32_t ulArgc,
+                              char * ppcArgv[] )
+{
+    const char * pcVerb = "stat";
+
+    if( ulArgc > 1 )
+    {
+        pcVerb = ppcArgv[ 1 ];
+    }
+
+    if( strcmp( pcVerb, "stat" ) == 0 )
+    {
+        prvNsIntfStat( pxCIO );
+    }
+    else if( strcmp( pcVerb, "reset" ) == 0 )
+    {
+        vNsIntfResetStats();
+        pxCIO->print( "Secure call statistics cleared.\r\n" );
+    }
+    else
+    {
+        pxCIO->print( "Error: Unknown argument. See \"help nsintf\".\r\n" );
+    }
+}
+
+#endif /* TFM_PSA_API */
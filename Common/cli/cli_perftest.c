@@ -0,0 +1,68 @@
+/*
+ * FreeRTOS STM32 Reference Integration
+ *
+ * Copyright (c) 2022 Amazon.com, Inc. or its affiliates. All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+/* FreeRTOS includes. */
+#include "FreeRTOS.h"
+#include "task.h"
+
+#include "cli.h"
+#include "cli_prv.h"
+
+#include "perf_test.h"
+
+static void prvPerfTestCommand( ConsoleIO_t * const pxCIO,
+                                uint32_t ulArgc,
+                                char * ppcArgv[] );
+
+const CLI_Command_Definition_t xCommandDef_perftest =
+{
+    "perftest",
+    "perftest [ -g <group> ] [ -n <test> ] [ -v ]\r\n"
+    "    Run the on-target performance tests and check the results against the budgets of perf_test_config.h.\r\n"
+    "        -g: Only run one group: PERF_ISR, PERF_CRYPTO, PERF_KVSTORE, PERF_LFS, PERF_TLS or PERF_MQTT.\r\n"
+    "        -n: Only run tests whose name contains the string.\r\n"
+    "        -v: Print the name of each test as it starts.\r\n"
+    "    Each measurement is printed as PERF,<test>,<value>,<budget>,<unit>.\r\n\n",
+    prvPerfTestCommand
+};
+
+/*-----------------------------------------------------------*/
+
+static void prvPerfTestCommand( ConsoleIO_t * const pxCIO,
+                                uint32_t ulArgc,
+                                char * ppcArgv[] )
+{
+    int lFailures;
+
+    /* The arguments follow the unity_fixture conventions, argv[ 0 ] is the command name */
+    lFailures = RunPerfTests( ( int ) ulArgc, ( const char ** ) ppcArgv );
+
+    if( lFailures == 0 )
+    {
+        pxCIO->print( "All performance budgets met.\r\n" );
+    }
+    else
+    {
+        pxCIO->print( "Performance budgets exceeded, see the FAIL lines above.\r\n" );
+    }
+}
@@ -171,12 +171,11 @@ static void vPrintDer( ConsoleIO_t * pxCIO,
 
 #define CSR_BUFFER_LEN    2048
 
-static void vSubCommand_GenerateCsr( ConsoleIO_t * pxCIO,
-                                     uint32_t ulArgc,
-                                     char * ppcArgv[] )
+PkiStatus_t xCliPkiGenerateCsr( const char * pcPrvKeyLabel,
+                                unsigned char ** ppucCsrDer,
+                                size_t * puxCsrDerLen )
 {
     PkiStatus_t xStatus = PKI_SUCCESS;
-    char * pcPrvKeyLabel = NULL;
     unsigned char * pucCsrDer = NULL;
     size_t uxCsrDerLen = 0;
     mbedtls_pk_context xPkCtx;
@@ -185,13 +184,9 @@ static void vSubCommand_GenerateCsr( ConsoleIO_t * pxCIO,
 
     int lError = -1;
 
-    pcPrvKeyLabel = TLS_KEY_PRV_LABEL;
-
-    if( ( ulArgc > LABEL_IDX ) &&
-        ( ppcArgv[ LABEL_IDX ] != NULL ) )
-    {
-        pcPrvKeyLabel = ppcArgv[ LABEL_IDX ];
-    }
+    configASSERT( pcPrvKeyLabel != NULL );
+    configASSERT( ppucCsrDer != NULL );
+    configASSERT( puxCsrDerLen != NULL );
 
     xPrvKeyObj = xPkiObjectFromLabel( pcPrvKeyLabel );
 
@@ -199,7 +194,14 @@ static void vSubCommand_GenerateCsr( ConsoleIO_t * pxCIO,
     mbedtls_pk_init( &xPkCtx );
     mbedtls_entropy_init( &xEntropyCtx );
 
-    xStatus = xPkiReadPrivateKey( &xPkCtx, &xPrvKeyObj, mbedtls_entropy_func, &xEntropyCtx );
+    if( pucCsrDer == NULL )
+    {
+        xStatus = PKI_ERR_NOMEM;
+    }
+    else
+    {
+        xStatus = xPkiReadPrivateKey( &xPkCtx, &xPrvKeyObj, mbedtls_entropy_func, &xEntropyCtx );
+    }
 
     if( xStatus == PKI_SUCCESS )
     {
@@ -267,17 +269,18 @@ static void vSubCommand_GenerateCsr( ConsoleIO_t * pxCIO,
         }
     }
 
-    if( ( lError >= 0 ) &&
-        ( uxCsrDerLen > 0 ) &&
-        ( pucCsrDer != NULL ) )
+    if( ( xStatus == PKI_SUCCESS ) &&
+        ( ( lError < 0 ) || ( uxCsrDerLen == 0 ) ) )
     {
-        vPrintDer( pxCIO,
-                   "-----BEGIN CERTIFICATE REQUEST-----\r\n",
-                   "-----END CERTIFICATE REQUEST-----\r\n",
-                   pucCsrDer, uxCsrDerLen );
+        xStatus = PKI_ERR;
     }
 
-    if( pucCsrDer != NULL )
+    if( xStatus == PKI_SUCCESS )
+    {
+        *ppucCsrDer = pucCsrDer;
+        *puxCsrDerLen = uxCsrDerLen;
+    }
+    else if( pucCsrDer != NULL )
     {
         vPortFree( pucCsrDer );
     }
@@ -285,52 +288,70 @@ static void vSubCommand_GenerateCsr( ConsoleIO_t * pxCIO,
     mbedtls_entropy_free( &xEntropyCtx );
 
 #ifdef MBEDTLS_TRANSPORT_PKCS11
-    lError = lPKCS11PkMbedtlsCloseSessionAndFree( &xPkCtx );
+    ( void ) lPKCS11PkMbedtlsCloseSessionAndFree( &xPkCtx );
 #endif /* MBEDTLS_TRANSPORT_PKCS11 */
+
+    return xStatus;
 }
 
-static void vSubCommand_GenerateCertificate( ConsoleIO_t * pxCIO,
-                                             uint32_t ulArgc,
-                                             char * ppcArgv[] )
+static void vSubCommand_GenerateCsr( ConsoleIO_t * pxCIO,
+                                     uint32_t ulArgc,
+                                     char * ppcArgv[] )
 {
-    PkiStatus_t xResult = PKI_SUCCESS;
-    char * pcCertLabel = NULL;
-    char * pcPrvKeyLabel = NULL;
-    unsigned char * pucCertDer = NULL;
-    size_t uxCertDerLen = 0;
-    mbedtls_pk_context xPkCtx;
-    mbedtls_entropy_context xEntropyCtx;
-    PkiObject_t xPrvKeyObject;
-    int lError = 0;
-
-    pcCertLabel = TLS_CERT_LABEL;
-    pcPrvKeyLabel = TLS_KEY_PRV_LABEL;
+    char * pcPrvKeyLabel = TLS_KEY_PRV_LABEL;
+    unsigned char * pucCsrDer = NULL;
+    size_t uxCsrDerLen = 0;
 
     if( ( ulArgc > LABEL_IDX ) &&
         ( ppcArgv[ LABEL_IDX ] != NULL ) )
     {
-        pcCertLabel = ppcArgv[ LABEL_IDX ];
+        pcPrvKeyLabel = ppcArgv[ LABEL_IDX ];
     }
 
-    if( ( ulArgc > LABEL_PRV_IDX ) &&
-        ( ppcArgv[ LABEL_PRV_IDX ] != NULL ) )
+    if( xCliPkiGenerateCsr( pcPrvKeyLabel, &pucCsrDer, &uxCsrDerLen ) == PKI_SUCCESS )
     {
-        pcPrvKeyLabel = ppcArgv[ LABEL_PRV_IDX ];
+        vPrintDer( pxCIO,
+                   "-----BEGIN CERTIFICATE REQUEST-----\r\n",
+                   "-----END CERTIFICATE REQUEST-----\r\n",
+                   pucCsrDer, uxCsrDerLen );
+
+        vPortFree( pucCsrDer );
     }
+}
+
+PkiStatus_t xCliPkiGenerateCertificate( const char * pcCertLabel,
+                                        const char * pcPrvKeyLabel,
+                                        unsigned char ** ppucCertDer,
+                                        size_t * puxCertDerLen )
+{
+    PkiStatus_t xResult = PKI_SUCCESS;
+    unsigned char * pucCertDer = NULL;
+    size_t uxCertDerLen = 0;
+    mbedtls_pk_context xPkCtx;
+    mbedtls_entropy_context xEntropyCtx;
+    PkiObject_t xPrvKeyObject;
+    int lError = 0;
 
-    pucCertDer = mbedtls_calloc( 1, CSR_BUFFER_LEN );
+    configASSERT( pcCertLabel != NULL );
+    configASSERT( pcPrvKeyLabel != NULL );
+    configASSERT( ppucCertDer != NULL );
+    configASSERT( puxCertDerLen != NULL );
 
-    if( !pucCertDer )
-    {
-        xResult = PKI_ERR_NOMEM;
-    }
+    pucCertDer = pvPortMalloc( CSR_BUFFER_LEN );
 
     xPrvKeyObject = xPkiObjectFromLabel( pcPrvKeyLabel );
 
     mbedtls_pk_init( &xPkCtx );
     mbedtls_entropy_init( &xEntropyCtx );
 
-    xResult = xPkiReadPrivateKey( &xPkCtx, &xPrvKeyObject, mbedtls_entropy_func, &xEntropyCtx );
+    if( pucCertDer == NULL )
+    {
+        xResult = PKI_ERR_NOMEM;
+    }
+    else
+    {
+        xResult = xPkiReadPrivateKey( &xPkCtx, &xPrvKeyObject, mbedtls_entropy_func, &xEntropyCtx );
+    }
 
     if( xResult == PKI_SUCCESS )
     {
@@ -460,46 +481,85 @@ static void vSubCommand_GenerateCertificate( ConsoleIO_t * pxCIO,
         mbedtls_x509write_crt_free( &xWriteCertCtx );
     }
 
-    if( ( lError >= 0 ) &&
-        ( uxCertDerLen > 0 ) &&
-        ( pucCertDer != NULL ) )
+    if( ( xResult == PKI_SUCCESS ) &&
+        ( ( lError < 0 ) || ( uxCertDerLen == 0 ) ) )
+    {
+        xResult = PKI_ERR;
+    }
+
+    if( xResult == PKI_SUCCESS )
     {
         mbedtls_x509_crt xCertContext;
         mbedtls_x509_crt_init( &xCertContext );
 
-        lError = mbedtls_x509_crt_parse_der_nocopy( &xCertContext,
-                                                    pucCertDer,
-                                                    uxCertDerLen );
+        /* Parse a copy so that the caller keeps the DER buffer */
+        lError = mbedtls_x509_crt_parse_der( &xCertContext,
+                                             pucCertDer,
+                                             uxCertDerLen );
 
         MBEDTLS_MSG_IF_ERROR( lError, "Failed to validate resulting certificate." );
 
         if( lError >= 0 )
         {
-/*            PkiObject_t xCert = xPkiObjectFromLabel( pcCertLabel ); */
-            xCertContext.MBEDTLS_PRIVATE( own_buffer ) = 1;
-
             xResult = xPkiWriteCertificate( pcCertLabel, &xCertContext );
-
-            vPrintDer( pxCIO,
-                       "-----BEGIN CERTIFICATE-----\r\n",
-                       "-----END CERTIFICATE-----\r\n",
-                       pucCertDer, uxCertDerLen );
+        }
+        else
+        {
+            xResult = PKI_ERR;
         }
 
         mbedtls_x509_crt_free( &xCertContext );
-        pucCertDer = NULL;
     }
 
-    if( pucCertDer != NULL )
+    if( xResult == PKI_SUCCESS )
+    {
+        *ppucCertDer = pucCertDer;
+        *puxCertDerLen = uxCertDerLen;
+    }
+    else if( pucCertDer != NULL )
     {
-        mbedtls_free( pucCertDer );
+        vPortFree( pucCertDer );
     }
 
     mbedtls_entropy_free( &xEntropyCtx );
 
 #ifdef MBEDTLS_TRANSPORT_PKCS11
-    lError = lPKCS11PkMbedtlsCloseSessionAndFree( &xPkCtx );
+    ( void ) lPKCS11PkMbedtlsCloseSessionAndFree( &xPkCtx );
 #endif /* MBEDTLS_TRANSPORT_PKCS11 */
+
+    return xResult;
+}
+
+static void vSubCommand_GenerateCertificate( ConsoleIO_t * pxCIO,
+                                             uint32_t ulArgc,
+                                             char * ppcArgv[] )
+{
+    char * pcCertLabel = TLS_CERT_LABEL;
+    char * pcPrvKeyLabel = TLS_KEY_PRV_LABEL;
+    unsigned char * pucCertDer = NULL;
+    size_t uxCertDerLen = 0;
+
+    if( ( ulArgc > LABEL_IDX ) &&
+        ( ppcArgv[ LABEL_IDX ] != NULL ) )
+    {
+        pcCertLabel = ppcArgv[ LABEL_IDX ];
+    }
+
+    if( ( ulArgc > LABEL_PRV_IDX ) &&
+        ( ppcArgv[ LABEL_PRV_IDX ] != NULL ) )
+    {
+        pcPrvKeyLabel = ppcArgv[ LABEL_PRV_IDX ];
+    }
+
+    if( xCliPkiGenerateCertificate( pcCertLabel, pcPrvKeyLabel, &pucCertDer, &uxCertDerLen ) == PKI_SUCCESS )
+    {
+        vPrintDer( pxCIO,
+                   "-----BEGIN CERTIFICATE-----\r\n",
+                   "-----END CERTIFICATE-----\r\n",
+                   pucCertDer, uxCertDerLen );
+
+        vPortFree( pucCertDer );
+    }
 }
 
 
@@ -0,0 +1,150 @@
+/*
+ * FreeRTOS STM32 Reference Integration
+ *
+ * Copyright (c) 2022 Amazon.com, Inc. or its affiliates. All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+/* Standard includes. */
+#include <string.h>
+#include <stdint.h>
+#include <stdio.h>
+
+/* FreeRTOS includes. */
+#include "FreeRTOS.h"
+#include "task.h"
+
+#include "cli.h"
+#include "cli_prv.h"
+
+#include "power_stats.h"
+
+static void prvPowerStatCommand( ConsoleIO_t * const pxCIO,
+                                 uint32_t ulArgc,
+                                 char * ppcArgv[] );
+
+const CLI_Command_Definition_t xCommandDef_powerstat =
+{
+    "powerstat",
+    "powerstat\r\n"
+    "    Print the time spent in each power state of the core and the wifi module,\r\n"
+    "    the tickless idle wakes and the energy estimated from the POWER_*_UA\r\n"
+    "    currents of power_stats.h, in total and per publish and OTA download.\r\n\n",
+    prvPowerStatCommand
+};
+
+/*-----------------------------------------------------------*/
+
+#if POWER_STATS_ENABLED == 1
+
+static void prvPrintStat( ConsoleIO_t * const pxCIO,
+                          const char * pcLabel,
+                          uint32_t ulValue )
+{
+    size_t xLen = snprintf( pcCliScratchBuffer, CLI_OUTPUT_SCRATCH_BUF_LEN,
+                            "| %-24s | %12lu |\r\n", pcLabel, ( unsigned long ) ulValue );
+
+    if( xLen >= CLI_OUTPUT_SCRATCH_BUF_LEN )
+    {
+        xLen = CLI_OUTPUT_SCRATCH_BUF_LEN - 1;
+    }
+
+    pxCIO->write( pcCliScratchBuffer, xLen );
+}
+
+/*-----------------------------------------------------------*/
+
+static void prvPowerStatCommand( ConsoleIO_t * const pxCIO,
+                                 uint32_t ulArgc,
+                                 char * ppcArgv[] )
+{
+    static PowerStats_t xStats;
+    char cLabel[ 25 ];
+    uint32_t ulUptimeMs = 0;
+
+    ( void ) ulArgc;
+    ( void ) ppcArgv;
+
+    vPowerStatsGet( &xStats );
+
+    for( uint32_t i = 0; i < POWER_STATE_COUNT; i++ )
+    {
+        ulUptimeMs += xStats.pulStateMs[ i ];
+    }
+
+    pxCIO->print( "+-----------------------------------------+\r\n" );
+    pxCIO->print( "| Core state               |      Time ms |\r\n" );
+    pxCIO->print( "|--------------------------|--------------|\r\n" );
+    prvPrintStat( pxCIO, "run at 160 MHz", xStats.ulRunHighMs );
+    prvPrintStat( pxCIO, "run at 48 MHz", xStats.pulStateMs[ POWER_STATE_RUN ] - xStats.ulRunHighMs );
+
+    for( uint32_t i = POWER_STATE_SLEEP; i < POWER_STATE_COUNT; i++ )
+    {
+        prvPrintStat( pxCIO, pcPowerStatsStateName( ( PowerState_t ) i ), xStats.pulStateMs[ i ] );
+    }
+
+    prvPrintStat( pxCIO, "idle wakes", xStats.ulWakes );
+    prvPrintStat( pxCIO, "woke from standby", xStats.ulStandbyWakes );
+    pxCIO->print( "|--------------------------|--------------|\r\n" );
+    pxCIO->print( "| Wifi state               |      Time ms |\r\n" );
+    pxCIO->print( "|--------------------------|--------------|\r\n" );
+
+    for( uint32_t i = 0; i < POWER_RADIO_COUNT; i++ )
+    {
+        prvPrintStat( pxCIO, pcPowerStatsRadioName( ( PowerRadioState_t ) i ), xStats.pulRadioMs[ i ] );
+    }
+
+    pxCIO->print( "|--------------------------|--------------|\r\n" );
+    prvPrintStat( pxCIO, "energy (mJ)", ( uint32_t ) ( xStats.ullEnergyUj / 1000U ) );
+    prvPrintStat( pxCIO, "average power (uW)",
+                  ( ulUptimeMs > 0 ) ? ( uint32_t ) ( ( xStats.ullEnergyUj * 1000U ) / ulUptimeMs ) : 0 );
+
+    for( uint32_t i = 0; i < POWER_OP_COUNT; i++ )
+    {
+        const PowerOpStats_t * pxOp = &( xStats.pxOps[ i ] );
+        const char * pcName = pcPowerStatsOpName( ( PowerOp_t ) i );
+
+        pxCIO->print( "|--------------------------|--------------|\r\n" );
+        ( void ) snprintf( cLabel, sizeof( cLabel ), "%s count", pcName );
+        prvPrintStat( pxCIO, cLabel, pxOp->ulCount );
+        ( void ) snprintf( cLabel, sizeof( cLabel ), "%s active ms", pcName );
+        prvPrintStat( pxCIO, cLabel, pxOp->ulActiveMs );
+        ( void ) snprintf( cLabel, sizeof( cLabel ), "%s wakes", pcName );
+        prvPrintStat( pxCIO, cLabel, pxOp->ulWakes );
+        ( void ) snprintf( cLabel, sizeof( cLabel ), "%s energy / op (uJ)", pcName );
+        prvPrintStat( pxCIO, cLabel,
+                      ( pxOp->ulCount > 0 ) ? ( uint32_t ) ( pxOp->ullEnergyUj / pxOp->ulCount ) : 0 );
+    }
+
+    pxCIO->print( "+-----------------------------------------+\r\n" );
+}
+
+#else /* POWER_STATS_ENABLED == 1 */
+
+static void prvPowerStatCommand( ConsoleIO_t * const pxCIO,
+                                 uint32_t ulArgc,
+                                 char * ppcArgv[] )
+{
+    ( void ) ulArgc;
+    ( void ) ppcArgv;
+
+    pxCIO->print( "Error: POWER_STATS_ENABLED is not set.\r\n" );
+}
+
+#endif /* POWER_STATS_ENABLED == 1 */
@@ -0,0 +1,166 @@
+/*
+ * FreeRTOS STM32 Reference Integration
+ *
+ * Copyright (c) 2022 Amazon.com, Inc. or its affiliates. All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#include <string.h>
+#include <stdio.h>
+#include <stdarg.h>
+
+#include "FreeRTOS.h"
+#include "task.h"
+
+#include "cli.h"
+#include "cli_prv.h"
+#include "profiler.h"
+
+#if PROFILER_ENABLED == 1
+
+static void prvProfCommand( ConsoleIO_t * const pxCIO,
+                            uint32_t ulArgc,
+                            char * ppcArgv[] );
+
+const CLI_Command_Definition_t xCommandDef_prof =
+{
+    "prof",
+    "prof [ stat | reset ]\r\n"
+    "    Timing of the code regions instrumented with PROF_BEGIN / PROF_END.\r\n"
+    "        stat:  Count and duration of each probe since boot or the last reset.\r\n"
+    "        reset: Clear the statistics of all probes.\r\n"
+    "    Without an argument, stat is run.\r\n\n",
+    prvProfCommand
+};
+
+/*-----------------------------------------------------------*/
+
+static void prvPrintf( ConsoleIO_t * const pxCIO,
+                       const char * pcFormat,
+                       ... ) __attribute__( ( format( printf, 2, 3 ) ) );
+
+static void prvPrintf( ConsoleIO_t * const pxCIO,
+                       const char * pcFormat,
+                       ... )
+{
+    va_list xArgs;
+    size_t xLen;
+
+    va_start( xArgs, pcFormat );
+    xLen = vsnprintf( pcCliScratchBuffer, CLI_OUTPUT_SCRATCH_BUF_LEN, pcFormat, xArgs );
+    va_end( xArgs );
+
+    if( xLen >= CLI_OUTPUT_SCRATCH_BUF_LEN )
+    {
+        xLen = CLI_OUTPUT_SCRATCH_BUF_LEN - 1;
+    }
+
+    pxCIO->write( pcCliScratchBuffer, xLen );
+}
+
+/*-----------------------------------------------------------*/
+
+/* Cycles to hundredths of a microsecond, printed as xx.yy */
+static uint32_t prvCyclesToCentiUs( uint64_t ullCycles )
+{
+    uint32_t ulCyclesPerUs = SystemCoreClock / 1000000UL;
+    uint64_t ullCentiUs = 0;
+
+    if( ulCyclesPerUs > 0 )
+    {
+        ullCentiUs = ( ullCycles * 100U ) / ulCyclesPerUs;
+    }
+
+    return ( ullCentiUs > UINT32_MAX ) ? UINT32_MAX : ( uint32_t ) ullCentiUs;
+}
+
+/*-----------------------------------------------------------*/
+
+static void prvProfStat( ConsoleIO_t * const pxCIO )
+{
+    const ProfProbe_t * pxProbe = NULL;
+    ProfProbe_t xCopy;
+    uint32_t ulProbes = 0;
+
+    prvPrintf( pxCIO, "Core clock: %lu Hz, times in us\r\n", ( unsigned long ) SystemCoreClock );
+    pxCIO->print( "+--------------------+------------+-----------+-----------+------------+------------+\r\n" );
+    pxCIO->print( "| Probe              |   Count    |    Min    |    Avg    |    Max     | Total (ms) |\r\n" );
+    pxCIO->print( "+--------------------+------------+-----------+-----------+------------+------------+\r\n" );
+
+    while( ( pxProbe = pxProfNext( pxProbe, &xCopy ) ) != NULL )
+    {
+        uint32_t ulMin = 0;
+        uint32_t ulAvg = 0;
+        uint32_t ulMax = 0;
+        uint32_t ulTotalMs = prvCyclesToCentiUs( xCopy.ullSumCycles / 1000U ) / 100U;
+
+        if( xCopy.ulCount > 0 )
+        {
+            ulMin = prvCyclesToCentiUs( xCopy.ulMinCycles );
+            ulAvg = prvCyclesToCentiUs( xCopy.ullSumCycles / xCopy.ulCount );
+            ulMax = prvCyclesToCentiUs( xCopy.ulMaxCycles );
+        }
+
+        prvPrintf( pxCIO, "| %-18.18s | %10lu | %6lu.%02lu | %6lu.%02lu | %7lu.%02lu | %10lu |\r\n",
+                   xCopy.pcName,
+                   ( unsigned long ) xCopy.ulCount,
+                   ( unsigned long ) ( ulMin / 100U ), ( unsigned long ) ( ulMin % 100U ),
+                   ( unsigned long ) ( ulAvg / 100U ), ( unsigned long ) ( ulAvg % 100U ),
+                   ( unsigned long ) ( ulMax / 100U ), ( unsigned long ) ( ulMax % 100U ),
+                   ( unsigned long ) ulTotalMs );
+        ulProbes++;
+    }
+
+    pxCIO->print( "+--------------------+------------+-----------+-----------+------------+------------+\r\n" );
+
+    if( ulProbes == 0 )
+    {
+        pxCIO->print( "No probe has been recorded yet.\r\n" );
+    }
+}
+
+/*-----------------------------------------------------------*/
+
+static void prvProfCommand( ConsoleIO_t * const pxCIO,
+                            uint32_t ulArgc,
+                            char * ppcArgv[] )
+{
+    const char * pcVerb = "stat";
+
+    if( ulArgc > 1 )
+    {
+        pcVerb = ppcArgv[ 1 ];
+    }
+
+    if( strcmp( pcVerb, "stat" ) == 0 )
+    {
+        prvProfStat( pxCIO );
+    }
+    else if( strcmp( pcVerb, "reset" ) == 0 )
+    {
+        vProfReset();
+        pxCIO->print( "Profiler statistics cleared.\r\n" );
+    }
+    else
+    {
+        pxCIO->print( "Error: Unknown argument. See \"help prof\".\r\n" );
+    }
+}
+
+#endif /* PROFILER_ENABLED == 1 */
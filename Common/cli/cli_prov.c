@@ -0,0 +1,755 @@
+/*
+ * FreeRTOS STM32 Reference Integration
+ *
+ * Copyright (c) 2022 Amazon.com, Inc. or its affiliates. All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+/*
+ * Binary provisioning protocol on the console uart.
+ *
+ * "prov binary [baud]" answers "PROV BINARY <baud>" in text, locks the console so
+ * that no log line is sent in between frames, and switches to the requested baud
+ * rate. Both sides then exchange frames until an EXIT request, or until no frame
+ * was received for CLI_PROV_IDLE_TIMEOUT_MS, and the baud rate is restored.
+ *
+ * Frame, multi byte fields are little endian:
+ *   u8  sof     CLI_PROV_SOF
+ *   u8  type    Request type, or'ed with PROV_RESPONSE in the answer
+ *   u8  seq     Chosen by the host, echoed in the answer
+ *   u8  status  0 in requests, a ProvStatus_t in answers
+ *   u16 len     Payload length, up to CLI_PROV_MAX_PAYLOAD
+ *   u8  payload[ len ]
+ *   u32 crc     CRC-32 (IEEE 802.3, as zlib.crc32) of all the preceding bytes
+ *
+ * Labels and kvstore keys are sent as a u8 length followed by the characters,
+ * an empty label selects the default tls object. Certificates, CSRs and keys are
+ * sent as DER. See tools/provision.py for the host side.
+ */
+
+#include "FreeRTOS.h"
+#include "task.h"
+
+#include "cli.h"
+#include "cli_prv.h"
+#include "logging.h"
+#include "kvstore.h"
+
+#include <string.h>
+#include <stdlib.h>
+#include <stdio.h>
+
+#include "tls_transport_config.h"
+#include "PkiObject.h"
+
+#include "mbedtls/x509_crt.h"
+
+#ifndef CLI_PROV_BAUD_RATE
+#define CLI_PROV_BAUD_RATE              ( 460800 )
+#endif
+
+#define CLI_PROV_MAX_PAYLOAD            ( 4096U )
+#define CLI_PROV_IDLE_TIMEOUT_MS        ( 10000U )
+#define CLI_PROV_BYTE_TIMEOUT_MS        ( 200U )
+#define CLI_PROV_NAME_MAX_LEN           ( 64U )
+
+#define CLI_PROV_SOF                    ( 0xA5U )
+#define CLI_PROV_VERSION                ( 1U )
+#define CLI_PROV_HEADER_LEN             ( 6U )
+#define CLI_PROV_CRC_LEN                ( 4U )
+
+#define PROV_RESPONSE                   ( 0x80U )
+
+typedef enum
+{
+    PROV_PING = 0x01,       /* -> u8 version, u8 0, u16 max payload */
+    PROV_EXIT = 0x02,       /* Answered at the current baud rate, then the cli resumes */
+    PROV_KV_SET = 0x10,     /* { key, u16 len, value as for "conf set" }... -> u16 entries set */
+    PROV_KV_COMMIT = 0x11,  /* As "conf commit" */
+    PROV_KEY_GEN = 0x20,    /* private label, public label -> public key */
+    PROV_CSR_GEN = 0x21,    /* private label -> CSR */
+    PROV_CERT_GEN = 0x22,   /* cert label, private label -> self-signed certificate */
+    PROV_CERT_WRITE = 0x23, /* cert label, certificate */
+    PROV_CERT_READ = 0x24   /* cert label -> certificate */
+} ProvType_t;
+
+typedef enum
+{
+    PROV_ST_OK = 0,
+    PROV_ST_ERR_CRC = 1,
+    PROV_ST_ERR_LEN = 2,
+    PROV_ST_ERR_TYPE = 3,
+    PROV_ST_ERR_ARG = 4,
+    PROV_ST_ERR_FAILED = 5,
+    PROV_ST_ERR_NOMEM = 6
+} ProvStatus_t;
+
+typedef enum
+{
+    PROV_RX_FRAME,
+    PROV_RX_IDLE,
+    PROV_RX_BAD_CRC,
+    PROV_RX_BAD_LEN,
+    PROV_RX_TRUNCATED
+} ProvRxResult_t;
+
+typedef struct
+{
+    uint8_t ucType;
+    uint8_t ucSeq;
+    uint16_t usLen;
+    uint8_t * pucPayload; /* CLI_PROV_MAX_PAYLOAD + 1 bytes, the last one for a terminator */
+} ProvFrame_t;
+
+typedef struct
+{
+    const uint8_t * pucData;
+    size_t uxLen;
+    void * pvHeap; /* Released with vPortFree once sent */
+    uint8_t ucShort[ 4 ];
+} ProvReply_t;
+
+static void prvProvCommand( ConsoleIO_t * const pxCIO,
+                            uint32_t ulArgc,
+                            char * ppcArgv[] );
+
+const CLI_Command_Definition_t xCommandDef_prov =
+{
+    "prov",
+    "prov binary [baud]\r\n"
+    "    Switch the console to the binary provisioning protocol used by\r\n"
+    "    tools/provision.py --binary, at the given baud rate (default 460800).\r\n"
+    "    The console returns to text mode after 10 s without a frame.\r\n\n",
+    prvProvCommand
+};
+
+/*-----------------------------------------------------------*/
+
+/* Same result as zlib.crc32( data, ulCrc ), so that calls can be chained */
+static uint32_t prvCrc32( uint32_t ulCrc,
+                          const uint8_t * pucData,
+                          size_t uxLen )
+{
+    static const uint32_t ulNibbleTable[ 16 ] =
+    {
+        0x00000000, 0x1DB71064, 0x3B6E20C8, 0x26D930AC,
+        0x76DC4190, 0x6B6B51F4, 0x4DB26158, 0x5005713C,
+        0xEDB88320, 0xF00F9344, 0xD6D6A3E8, 0xCB61B38C,
+        0x9B64C2B0, 0x86D3D2D4, 0xA00AE278, 0xBDBDF21C
+    };
+
+    ulCrc = ~ulCrc;
+
+    for( size_t uxIdx = 0; uxIdx < uxLen; uxIdx++ )
+    {
+        ulCrc ^= pucData[ uxIdx ];
+        ulCrc = ( ulCrc >> 4 ) ^ ulNibbleTable[ ulCrc & 0xFU ];
+        ulCrc = ( ulCrc >> 4 ) ^ ulNibbleTable[ ulCrc & 0xFU ];
+    }
+
+    return ~ulCrc;
+}
+
+/*-----------------------------------------------------------*/
+
+static BaseType_t prvReadBytes( ConsoleIO_t * const pxCIO,
+                                uint8_t * pucBuffer,
+                                size_t uxLen,
+                                TickType_t xTimeout )
+{
+    BaseType_t xResult = pdTRUE;
+    size_t uxRead = 0;
+
+    while( ( uxRead < uxLen ) && ( xResult == pdTRUE ) )
+    {
+        int32_t lRead = pxCIO->read_timeout( ( char * ) &( pucBuffer[ uxRead ] ), uxLen - uxRead, xTimeout );
+
+        if( lRead > 0 )
+        {
+            uxRead += ( size_t ) lRead;
+        }
+        else
+        {
+            xResult = pdFALSE;
+        }
+    }
+
+    return xResult;
+}
+
+/*-----------------------------------------------------------*/
+
+static ProvRxResult_t prvReceiveFrame( ConsoleIO_t * const pxCIO,
+                                       ProvFrame_t * pxFrame )
+{
+    ProvRxResult_t xResult = PROV_RX_IDLE;
+    const TickType_t xByteTimeout = pdMS_TO_TICKS( CLI_PROV_BYTE_TIMEOUT_MS );
+    TickType_t xDeadline = xTaskGetTickCount() + pdMS_TO_TICKS( CLI_PROV_IDLE_TIMEOUT_MS );
+    uint8_t ucHeader[ CLI_PROV_HEADER_LEN ] = { 0 };
+    uint8_t ucCrc[ CLI_PROV_CRC_LEN ];
+
+    /* Skip anything up to the start of a frame, such as a line ending left by the "prov" command */
+    while( ( ucHeader[ 0 ] != CLI_PROV_SOF ) &&
+           ( ( int32_t ) ( xDeadline - xTaskGetTickCount() ) > 0 ) )
+    {
+        ( void ) prvReadBytes( pxCIO, ucHeader, 1, xByteTimeout );
+    }
+
+    if( ucHeader[ 0 ] == CLI_PROV_SOF )
+    {
+        xResult = PROV_RX_TRUNCATED;
+
+        if( prvReadBytes( pxCIO, &( ucHeader[ 1 ] ), CLI_PROV_HEADER_LEN - 1, xByteTimeout ) == pdTRUE )
+        {
+            pxFrame->ucType = ucHeader[ 1 ];
+            pxFrame->ucSeq = ucHeader[ 2 ];
+            pxFrame->usLen = ( uint16_t ) ( ucHeader[ 4 ] | ( ucHeader[ 5 ] << 8 ) );
+
+            if( pxFrame->usLen > CLI_PROV_MAX_PAYLOAD )
+            {
+                xResult = PROV_RX_BAD_LEN;
+            }
+            else if( ( prvReadBytes( pxCIO, pxFrame->pucPayload, pxFrame->usLen, xByteTimeout ) == pdTRUE ) &&
+                     ( prvReadBytes( pxCIO, ucCrc, CLI_PROV_CRC_LEN, xByteTimeout ) == pdTRUE ) )
+            {
+                uint32_t ulCrc = prvCrc32( 0, ucHeader, CLI_PROV_HEADER_LEN );
+                uint32_t ulRxCrc = ( ( uint32_t ) ucCrc[ 0 ] ) | ( ( uint32_t ) ucCrc[ 1 ] << 8 ) |
+                                   ( ( uint32_t ) ucCrc[ 2 ] << 16 ) | ( ( uint32_t ) ucCrc[ 3 ] << 24 );
+
+                ulCrc = prvCrc32( ulCrc, pxFrame->pucPayload, pxFrame->usLen );
+
+                xResult = ( ulCrc == ulRxCrc ) ? PROV_RX_FRAME : PROV_RX_BAD_CRC;
+            }
+            else
+            {
+                /* Keep xResult */
+            }
+        }
+    }
+
+    return xResult;
+}
+
+/*-----------------------------------------------------------*/
+
+static void prvSendFrame( ConsoleIO_t * const pxCIO,
+                          uint8_t ucType,
+                          uint8_t ucSeq,
+                          uint8_t ucStatus,
+                          const uint8_t * pucPayload,
+                          size_t uxLen )
+{
+    uint8_t ucHeader[ CLI_PROV_HEADER_LEN ];
+    uint8_t ucCrc[ CLI_PROV_CRC_LEN ];
+    uint32_t ulCrc = 0;
+
+    configASSERT( uxLen <= UINT16_MAX );
+
+    ucHeader[ 0 ] = CLI_PROV_SOF;
+    ucHeader[ 1 ] = ucType | PROV_RESPONSE;
+    ucHeader[ 2 ] = ucSeq;
+    ucHeader[ 3 ] = ucStatus;
+    ucHeader[ 4 ] = ( uint8_t ) ( uxLen & 0xFFU );
+    ucHeader[ 5 ] = ( uint8_t ) ( uxLen >> 8 );
+
+    ulCrc = prvCrc32( ulCrc, ucHeader, CLI_PROV_HEADER_LEN );
+    ulCrc = prvCrc32( ulCrc, pucPayload, uxLen );
+
+    ucCrc[ 0 ] = ( uint8_t ) ulCrc;
+    ucCrc[ 1 ] = ( uint8_t ) ( ulCrc >> 8 );
+    ucCrc[ 2 ] = ( uint8_t ) ( ulCrc >> 16 );
+    ucCrc[ 3 ] = ( uint8_t ) ( ulCrc >> 24 );
+
+    pxCIO->write( ucHeader, CLI_PROV_HEADER_LEN );
+
+    if( uxLen > 0 )
+    {
+        pxCIO->write( pucPayload, uxLen );
+    }
+
+    pxCIO->write( ucCrc, CLI_PROV_CRC_LEN );
+}
+
+/*-----------------------------------------------------------*/
+
+/* Consume a u8 length prefixed label from *ppucData, pcDefault when it is empty */
+static BaseType_t prvTakeLabel( const uint8_t ** ppucData,
+                                size_t * puxLen,
+                                char * pcLabel,
+                                const char * pcDefault )
+{
+    BaseType_t xResult = pdFALSE;
+
+    if( *puxLen > 0 )
+    {
+        size_t uxLabelLen = ( *ppucData )[ 0 ];
+
+        if( ( uxLabelLen <= configTLS_MAX_LABEL_LEN ) &&
+            ( uxLabelLen < *puxLen ) )
+        {
+            if( uxLabelLen == 0 )
+            {
+                ( void ) strncpy( pcLabel, pcDefault, configTLS_MAX_LABEL_LEN + 1 );
+                pcLabel[ configTLS_MAX_LABEL_LEN ] = '\0';
+            }
+            else
+            {
+                ( void ) memcpy( pcLabel, &( ( *ppucData )[ 1 ] ), uxLabelLen );
+                pcLabel[ uxLabelLen ] = '\0';
+            }
+
+            *ppucData += uxLabelLen + 1;
+            *puxLen -= uxLabelLen + 1;
+            xResult = pdTRUE;
+        }
+    }
+
+    return xResult;
+}
+
+/*-----------------------------------------------------------*/
+
+/* Set a kvstore entry from its text form, as "conf set" does */
+static BaseType_t prvKvSet( const char * pcKey,
+                            const char * pcValue,
+                            size_t uxValueLen )
+{
+    KVStoreKey_t xKey = kvStringToKey( pcKey );
+    BaseType_t xResult = pdFALSE;
+    char * pcEndPtr = NULL;
+
+    switch( KVStore_getType( xKey ) )
+    {
+        case KV_TYPE_BASE_T:
+           {
+               BaseType_t xValue = strtol( pcValue, &pcEndPtr, 10 );
+
+               if( ( pcEndPtr != pcValue ) && ( *pcEndPtr == '\0' ) )
+               {
+                   xResult = KVStore_setBase( xKey, xValue );
+               }
+
+               break;
+           }
+
+        case KV_TYPE_INT32:
+           {
+               int32_t lValue = strtol( pcValue, &pcEndPtr, 10 );
+
+               if( ( pcEndPtr != pcValue ) && ( *pcEndPtr == '\0' ) )
+               {
+                   xResult = KVStore_setInt32( xKey, lValue );
+               }
+
+               break;
+           }
+
+        case KV_TYPE_UBASE_T:
+           {
+               UBaseType_t uxValue = strtoul( pcValue, &pcEndPtr, 10 );
+
+               if( ( pcEndPtr != pcValue ) && ( *pcEndPtr == '\0' ) )
+               {
+                   xResult = KVStore_setUBase( xKey, uxValue );
+               }
+
+               break;
+           }
+
+        case KV_TYPE_UINT32:
+           {
+               uint32_t ulValue = strtoul( pcValue, &pcEndPtr, 10 );
+
+               if( ( pcEndPtr != pcValue ) && ( *pcEndPtr == '\0' ) )
+               {
+                   xResult = KVStore_setUInt32( xKey, ulValue );
+               }
+
+               break;
+           }
+
+        case KV_TYPE_STRING:
+
+            /* Log levels take effect immediately, and are only stored if valid */
+            if( ( xKey != CS_LOG_LEVELS ) ||
+                ( lLoggingSetLevels( pcValue ) == 1 ) )
+            {
+                xResult = KVStore_setString( xKey, pcValue );
+            }
+
+            break;
+
+        case KV_TYPE_BLOB:
+            xResult = KVStore_setBlob( xKey, uxValueLen, pcValue );
+            break;
+
+        case KV_TYPE_NONE:
+        default:
+            break;
+    }
+
+    return xResult;
+}
+
+static ProvStatus_t prvHandleKvSet( ProvFrame_t * pxFrame,
+                                    ProvReply_t * pxReply )
+{
+    ProvStatus_t xStatus = PROV_ST_OK;
+    size_t uxPos = 0;
+    uint16_t usApplied = 0;
+
+    while( ( uxPos < pxFrame->usLen ) &&
+           ( xStatus == PROV_ST_OK ) )
+    {
+        uint8_t * pucRecord = &( pxFrame->pucPayload[ uxPos ] );
+        size_t uxLeft = pxFrame->usLen - uxPos;
+        size_t uxNameLen = pucRecord[ 0 ];
+        size_t uxValueLen = 0;
+
+        if( ( uxNameLen == 0 ) ||
+            ( uxNameLen > CLI_PROV_NAME_MAX_LEN ) ||
+            ( uxLeft < ( uxNameLen + 3 ) ) )
+        {
+            xStatus = PROV_ST_ERR_LEN;
+        }
+        else
+        {
+            uxValueLen = pucRecord[ uxNameLen + 1 ] | ( pucRecord[ uxNameLen + 2 ] << 8 );
+
+            if( uxLeft < ( uxNameLen + 3 + uxValueLen ) )
+            {
+                xStatus = PROV_ST_ERR_LEN;
+            }
+        }
+
+        if( xStatus == PROV_ST_OK )
+        {
+            char cName[ CLI_PROV_NAME_MAX_LEN + 1 ];
+            char * pcValue = ( char * ) &( pucRecord[ uxNameLen + 3 ] );
+            char cNext = pcValue[ uxValueLen ];
+
+            ( void ) memcpy( cName, &( pucRecord[ 1 ] ), uxNameLen );
+            cName[ uxNameLen ] = '\0';
+
+            /* Terminate the value in place, the payload buffer has a spare byte for the last one */
+            pcValue[ uxValueLen ] = '\0';
+
+            if( prvKvSet( cName, pcValue, uxValueLen ) == pdTRUE )
+            {
+                usApplied++;
+            }
+            else
+            {
+                LogError( "Failed to set %s.", cName );
+                xStatus = PROV_ST_ERR_ARG;
+            }
+
+            pcValue[ uxValueLen ] = cNext;
+            uxPos += uxNameLen + 3 + uxValueLen;
+        }
+    }
+
+    /* Entries before a failed one stay set, the answer says how many */
+    pxReply->ucShort[ 0 ] = ( uint8_t ) usApplied;
+    pxReply->ucShort[ 1 ] = ( uint8_t ) ( usApplied >> 8 );
+    pxReply->pucData = pxReply->ucShort;
+    pxReply->uxLen = 2;
+
+    return xStatus;
+}
+
+/*-----------------------------------------------------------*/
+
+static ProvStatus_t prvHandlePki( ProvFrame_t * pxFrame,
+                                  ProvReply_t * pxReply )
+{
+    ProvStatus_t xStatus = PROV_ST_OK;
+    PkiStatus_t xPkiStatus = PKI_ERR;
+    const uint8_t * pucData = pxFrame->pucPayload;
+    size_t uxLen = pxFrame->usLen;
+    char pcLabel[ configTLS_MAX_LABEL_LEN + 1 ];
+    char pcLabel2[ configTLS_MAX_LABEL_LEN + 1 ];
+    unsigned char * pucDer = NULL;
+    size_t uxDerLen = 0;
+
+    switch( pxFrame->ucType )
+    {
+        case PROV_KEY_GEN:
+
+            if( ( prvTakeLabel( &pucData, &uxLen, pcLabel, TLS_KEY_PRV_LABEL ) == pdTRUE ) &&
+                ( prvTakeLabel( &pucData, &uxLen, pcLabel2, TLS_KEY_PUB_LABEL ) == pdTRUE ) )
+            {
+                xPkiStatus = xPkiGenerateECKeypair( pcLabel, pcLabel2, &pucDer, &uxDerLen );
+            }
+            else
+            {
+                xStatus = PROV_ST_ERR_ARG;
+            }
+
+            break;
+
+        case PROV_CSR_GEN:
+
+            if( prvTakeLabel( &pucData, &uxLen, pcLabel, TLS_KEY_PRV_LABEL ) == pdTRUE )
+            {
+                xPkiStatus = xCliPkiGenerateCsr( pcLabel, &pucDer, &uxDerLen );
+            }
+            else
+            {
+                xStatus = PROV_ST_ERR_ARG;
+            }
+
+            break;
+
+        case PROV_CERT_GEN:
+
+            if( ( prvTakeLabel( &pucData, &uxLen, pcLabel, TLS_CERT_LABEL ) == pdTRUE ) &&
+                ( prvTakeLabel( &pucData, &uxLen, pcLabel2, TLS_KEY_PRV_LABEL ) == pdTRUE ) )
+            {
+                xPkiStatus = xCliPkiGenerateCertificate( pcLabel, pcLabel2, &pucDer, &uxDerLen );
+            }
+            else
+            {
+                xStatus = PROV_ST_ERR_ARG;
+            }
+
+            break;
+
+        case PROV_CERT_WRITE:
+
+            if( ( prvTakeLabel( &pucData, &uxLen, pcLabel, TLS_CERT_LABEL ) == pdTRUE ) &&
+                ( uxLen > 0 ) )
+            {
+                mbedtls_x509_crt xCertCtx;
+
+                mbedtls_x509_crt_init( &xCertCtx );
+
+                if( mbedtls_x509_crt_parse_der( &xCertCtx, pucData, uxLen ) == 0 )
+                {
+                    xPkiStatus = xPkiWriteCertificate( pcLabel, &xCertCtx );
+                }
+                else
+                {
+                    xStatus = PROV_ST_ERR_ARG;
+                }
+
+                mbedtls_x509_crt_free( &xCertCtx );
+            }
+            else
+            {
+                xStatus = PROV_ST_ERR_ARG;
+            }
+
+            break;
+
+        case PROV_CERT_READ:
+
+            if( prvTakeLabel( &pucData, &uxLen, pcLabel, TLS_CERT_LABEL ) == pdTRUE )
+            {
+                mbedtls_x509_crt xCertCtx;
+                PkiObject_t xCert = xPkiObjectFromLabel( pcLabel );
+
+                mbedtls_x509_crt_init( &xCertCtx );
+
+                xPkiStatus = xPkiReadCertificate( &xCertCtx, &xCert );
+
+                if( xPkiStatus == PKI_SUCCESS )
+                {
+                    pucDer = pvPortMalloc( xCertCtx.raw.len );
+
+                    if( pucDer != NULL )
+                    {
+                        ( void ) memcpy( pucDer, xCertCtx.raw.p, xCertCtx.raw.len );
+                        uxDerLen = xCertCtx.raw.len;
+                    }
+                    else
+                    {
+                        xPkiStatus = PKI_ERR_NOMEM;
+                    }
+                }
+
+                mbedtls_x509_crt_free( &xCertCtx );
+            }
+            else
+            {
+                xStatus = PROV_ST_ERR_ARG;
+            }
+
+            break;
+
+        default:
+            xStatus = PROV_ST_ERR_TYPE;
+            break;
+    }
+
+    if( xStatus == PROV_ST_OK )
+    {
+        if( xPkiStatus == PKI_ERR_NOMEM )
+        {
+            xStatus = PROV_ST_ERR_NOMEM;
+        }
+        else if( xPkiStatus != PKI_SUCCESS )
+        {
+            xStatus = PROV_ST_ERR_FAILED;
+        }
+        else if( uxDerLen > CLI_PROV_MAX_PAYLOAD )
+        {
+            xStatus = PROV_ST_ERR_LEN;
+        }
+        else
+        {
+            pxReply->pucData = pucDer;
+            pxReply->uxLen = uxDerLen;
+        }
+    }
+
+    /* Released after the answer was sent */
+    pxReply->pvHeap = pucDer;
+
+    return xStatus;
+}
+
+/*-----------------------------------------------------------*/
+
+static void prvProvSession( ConsoleIO_t * const pxCIO,
+                            uint8_t * pucPayload )
+{
+    ProvFrame_t xFrame = { .pucPayload = pucPayload };
+    BaseType_t xExit = pdFALSE;
+
+    while( xExit == pdFALSE )
+    {
+        ProvRxResult_t xRx = prvReceiveFrame( pxCIO, &xFrame );
+        ProvReply_t xReply = { 0 };
+        ProvStatus_t xStatus = PROV_ST_OK;
+
+        switch( xRx )
+        {
+            case PROV_RX_FRAME:
+
+                switch( xFrame.ucType )
+                {
+                    case PROV_PING:
+                        xReply.ucShort[ 0 ] = CLI_PROV_VERSION;
+                        xReply.ucShort[ 1 ] = 0;
+                        xReply.ucShort[ 2 ] = ( uint8_t ) CLI_PROV_MAX_PAYLOAD;
+                        xReply.ucShort[ 3 ] = ( uint8_t ) ( CLI_PROV_MAX_PAYLOAD >> 8 );
+                        xReply.pucData = xReply.ucShort;
+                        xReply.uxLen = 4;
+                        break;
+
+                    case PROV_EXIT:
+                        xExit = pdTRUE;
+                        break;
+
+                    case PROV_KV_SET:
+                        xStatus = prvHandleKvSet( &xFrame, &xReply );
+                        break;
+
+                    case PROV_KV_COMMIT:
+                        xStatus = ( KVStore_xFlush() == pdTRUE ) ? PROV_ST_OK : PROV_ST_ERR_FAILED;
+                        break;
+
+                    default:
+                        xStatus = prvHandlePki( &xFrame, &xReply );
+                        break;
+                }
+
+                prvSendFrame( pxCIO, xFrame.ucType, xFrame.ucSeq, xStatus,
+                              xReply.pucData, xReply.uxLen );
+                break;
+
+            case PROV_RX_BAD_CRC:
+            case PROV_RX_TRUNCATED:
+                /* The host retries with the same sequence number */
+                prvSendFrame( pxCIO, xFrame.ucType, xFrame.ucSeq, PROV_ST_ERR_CRC, NULL, 0 );
+                break;
+
+            case PROV_RX_BAD_LEN:
+                prvSendFrame( pxCIO, xFrame.ucType, xFrame.ucSeq, PROV_ST_ERR_LEN, NULL, 0 );
+                break;
+
+            case PROV_RX_IDLE:
+            default:
+                xExit = pdTRUE;
+                break;
+        }
+
+        if( xReply.pvHeap != NULL )
+        {
+            vPortFree( xReply.pvHeap );
+        }
+    }
+}
+
+/*-----------------------------------------------------------*/
+
+static void prvProvCommand( ConsoleIO_t * const pxCIO,
+                            uint32_t ulArgc,
+                            char * ppcArgv[] )
+{
+    uint32_t ulBaudRate = CLI_PROV_BAUD_RATE;
+    uint32_t ulTextBaudRate = ulConsoleGetBaudRate();
+    uint8_t * pucPayload = NULL;
+
+    if( ( ulArgc > 2 ) &&
+        ( ppcArgv[ 2 ] != NULL ) )
+    {
+        ulBaudRate = strtoul( ppcArgv[ 2 ], NULL, 10 );
+    }
+
+    if( ( ulArgc < 2 ) ||
+        ( strcmp( "binary", ppcArgv[ 1 ] ) != 0 ) )
+    {
+        pxCIO->print( "Error: Unknown argument. See \"help prov\".\r\n" );
+    }
+    else if( xConsoleBaudRateValid( ulBaudRate ) != pdTRUE )
+    {
+        pxCIO->print( "Error: Unsupported baud rate.\r\n" );
+    }
+    else if( ( pucPayload = pvPortMalloc( CLI_PROV_MAX_PAYLOAD + 1 ) ) == NULL )
+    {
+        pxCIO->print( "Error: Failed to allocate the frame buffer.\r\n" );
+    }
+    else
+    {
+        int lLen = snprintf( pcCliScratchBuffer, CLI_OUTPUT_SCRATCH_BUF_LEN,
+                             "PROV BINARY %lu\r\n", ulBaudRate );
+
+        /* Hold back log lines until the session ends */
+        pxCIO->lock();
+
+        pxCIO->write( pcCliScratchBuffer, ( size_t ) lLen );
+
+        if( ( ulBaudRate == ulTextBaudRate ) ||
+            ( xConsoleSetBaudRate( ulBaudRate ) == pdTRUE ) )
+        {
+            prvProvSession( pxCIO, pucPayload );
+
+            if( ulBaudRate != ulTextBaudRate )
+            {
+                ( void ) xConsoleSetBaudRate( ulTextBaudRate );
+            }
+        }
+
+        pxCIO->unlock();
+
+        vPortFree( pucPayload );
+    }
+}
@@ -25,6 +25,10 @@
 
 #include "semphr.h"
 #include "cli.h"
+#include "profiler.h"
+#include "crit_stats.h"
+#include "mem_ops.h"
+#include "PkiObject.h"
 
 /**
  * Defines the interface for different console implementations. Interface
@@ -88,7 +92,10 @@ typedef struct xCOMMAND_LINE_INPUT
 } CLI_Command_Definition_t;
 
 
-extern char pcCliScratchBuffer[ CLI_OUTPUT_SCRATCH_BUF_LEN ];
+/* Output scratch buffer of the calling task, a background job has its own */
+char * pcCliGetScratchBuffer( void );
+
+#define pcCliScratchBuffer    ( pcCliGetScratchBuffer() )
 
 /*
  * Register the command passed in using the pxCommandToRegister parameter.
@@ -106,6 +113,27 @@ BaseType_t FreeRTOS_CLIRegisterCommand( const CLI_Command_Definition_t * const p
 void FreeRTOS_CLIProcessCommand( ConsoleIO_t * const pxConsoleIO,
                                  char * pcCommandInput );
 
+/*
+ * @brief Run a command in a background task, see cli_job.c.
+ * @return pdPASS if the job was started, an error is printed to pxCIO otherwise.
+ */
+BaseType_t xCliJobStart( ConsoleIO_t * const pxCIO,
+                         const CLI_Command_Definition_t * pxCommand,
+                         uint32_t ulArgc,
+                         char * ppcArgv[] );
+
+/*
+ * @brief pdTRUE once "cancel" was entered for the background job calling this.
+ * Long running commands check it between steps. Always pdFALSE in the cli task.
+ */
+BaseType_t xCliJobCancelled( void );
+
+/*
+ * @brief Report the progress of the background job calling this, shown by "jobs".
+ */
+void vCliJobProgress( uint32_t ulDone,
+                      uint32_t ulTotal );
+
 /*-----------------------------------------------------------*/
 
 /*
@@ -123,15 +151,76 @@ char * FreeRTOS_CLIGetOutputBuffer( void );
 
 UART_HandleTypeDef * vInitUartEarly( void );
 
+/*
+ * @brief Console baud rate control, see cli_uart_drv.c.
+ * xConsoleSetBaudRate waits for pending output and must be called from the cli task
+ * with the console locked.
+ */
+BaseType_t xConsoleBaudRateValid( uint32_t ulBaudRate );
+BaseType_t xConsoleSetBaudRate( uint32_t ulBaudRate );
+uint32_t ulConsoleGetBaudRate( void );
+
+/*
+ * @brief Generate a CSR or a self-signed certificate for a stored private key, see cli_pki.c.
+ * On success *ppucDer is a heap buffer holding the DER, to be released with vPortFree.
+ * The certificate is also written to pcCertLabel.
+ */
+PkiStatus_t xCliPkiGenerateCsr( const char * pcPrvKeyLabel,
+                                unsigned char ** ppucCsrDer,
+                                size_t * puxCsrDerLen );
+PkiStatus_t xCliPkiGenerateCertificate( const char * pcCertLabel,
+                                        const char * pcPrvKeyLabel,
+                                        unsigned char ** ppucCertDer,
+                                        size_t * puxCertDerLen );
+
 extern const CLI_Command_Definition_t xCommandDef_conf;
 extern const CLI_Command_Definition_t xCommandDef_pki;
+extern const CLI_Command_Definition_t xCommandDef_prov;
 extern const CLI_Command_Definition_t xCommandDef_ps;
+extern const CLI_Command_Definition_t xCommandDef_top;
 extern const CLI_Command_Definition_t xCommandDef_kill;
 extern const CLI_Command_Definition_t xCommandDef_killAll;
 extern const CLI_Command_Definition_t xCommandDef_heapStat;
 extern const CLI_Command_Definition_t xCommandDef_reset;
 extern const CLI_Command_Definition_t xCommandDef_uptime;
+extern const CLI_Command_Definition_t xCommandDef_powerstat;
+extern const CLI_Command_Definition_t xCommandDef_boottime;
 extern const CLI_Command_Definition_t xCommandDef_rngtest;
 extern const CLI_Command_Definition_t xCommandDef_assert;
+extern const CLI_Command_Definition_t xCommandDef_netstat;
+extern const CLI_Command_Definition_t xCommandDef_lwipstats;
+extern const CLI_Command_Definition_t xCommandDef_iperf;
+extern const CLI_Command_Definition_t xCommandDef_netimpair;
+extern const CLI_Command_Definition_t xCommandDef_tlsprof;
+extern const CLI_Command_Definition_t xCommandDef_mqttstats;
+extern const CLI_Command_Definition_t xCommandDef_mqttload;
+extern const CLI_Command_Definition_t xCommandDef_soak;
+extern const CLI_Command_Definition_t xCommandDef_jobs;
+extern const CLI_Command_Definition_t xCommandDef_cancel;
+#ifndef TFM_PSA_API
+extern const CLI_Command_Definition_t xCommandDef_fsbench;
+#else
+extern const CLI_Command_Definition_t xCommandDef_nsintf;
+#endif
+#if defined( LOGGING_OUTPUT_FLASH ) && !defined( TFM_PSA_API )
+extern const CLI_Command_Definition_t xCommandDef_logstore;
+#endif
+#if TRACE_RECORDER_ENABLED == 1
+extern const CLI_Command_Definition_t xCommandDef_trace;
+#endif
+#if PROFILER_ENABLED == 1
+extern const CLI_Command_Definition_t xCommandDef_prof;
+#endif
+#if CRIT_STATS_ENABLED == 1
+extern const CLI_Command_Definition_t xCommandDef_critstat;
+#endif
+#if MEM_OPS_ENABLED == 1
+extern const CLI_Command_Definition_t xCommandDef_membench;
+#endif
+#if defined( MBEDTLS_SELF_TEST )
+extern const CLI_Command_Definition_t xCommandDef_cryptotest;
+#endif
+extern const CLI_Command_Definition_t xCommandDef_cryptobench;
+extern const CLI_Command_Definition_t xCommandDef_perftest;
 
 #endif /* _CLI_PRIV */
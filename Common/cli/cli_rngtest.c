@@ -34,11 +34,13 @@ static void prvRngTestCommand( ConsoleIO_t * const pxCIO,
 
     mbedtls_entropy_init( &xEntropyCtx );
 
-    while( uxBytesWritten < uxNumRandomBytes )
+    while( ( uxBytesWritten < uxNumRandomBytes ) &&
+           ( xCliJobCancelled() == pdFALSE ) )
     {
         size_t uxCharsWrittenThisIter = 0;
         int lError = 0;
 
+        vCliJobProgress( uxBytesWritten, uxNumRandomBytes );
 
         lError = mbedtls_entropy_func( &xEntropyCtx, pucEntropyBuffer, MBEDTLS_ENTROPY_BLOCK_SIZE );
 
@@ -0,0 +1,344 @@
+/*
+ * FreeRTOS STM32 Reference Integration
+ *
+ * Copyright (c) 2022 Amazon.com, Inc. or its affiliates. All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+/* Standard includes. */
+#include <string.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+/* FreeRTOS includes. */
+#include "FreeRTOS.h"
+#include "task.h"
+
+#include "cli.h"
+#include "cli_prv.h"
+
+#include "soak_test.h"
+
+/* Longest cycle and sample period accepted, in seconds */
+#define SOAK_CLI_MAX_CYCLE_S     3600
+#define SOAK_CLI_MAX_SAMPLE_S    ( 24 * 3600 )
+
+static void prvSoakCommand( ConsoleIO_t * const pxCIO,
+                            uint32_t ulArgc,
+                            char * ppcArgv[] );
+
+const CLI_Command_Definition_t xCommandDef_soak =
+{
+    "soak",
+    "soak [ start [ -c <s> ] [ -s <s> ] [ -o <op>[,<op>...] ] | stop | history ]\r\n"
+    "    Run connect, publish, OTA abort and shadow cycles for hours or days while\r\n"
+    "    sampling the heap, to find fragmentation before it turns into allocation\r\n"
+    "    failures in the field. Samples are logged and published to <thing>/soak/heap.\r\n"
+    "    Without arguments the status and the first, last and worst samples are printed.\r\n"
+    "        start: Start the soak test in the background.\r\n"
+    "            -c: Pause between cycles in seconds (30).\r\n"
+    "            -s: Heap sampling period in seconds (300).\r\n"
+    "            -o: Operations of a cycle, reconnect, publish, ota and shadow (all).\r\n"
+    "        stop: Stop the soak test after the current operation.\r\n"
+    "        history: Print the most recent heap samples, oldest first.\r\n\n",
+    prvSoakCommand
+};
+
+/*-----------------------------------------------------------*/
+
+static BaseType_t prvParseUInt( const char * pcArg,
+                                uint32_t ulMax,
+                                uint32_t * pulValue )
+{
+    BaseType_t xSuccess = pdFALSE;
+    char * pcEnd = NULL;
+    uint32_t ulValue;
+
+    if( pcArg != NULL )
+    {
+        ulValue = strtoul( pcArg, &pcEnd, 10 );
+
+        if( ( pcEnd != pcArg ) && ( *pcEnd == '\0' ) && ( ulValue <= ulMax ) )
+        {
+            *pulValue = ulValue;
+            xSuccess = pdTRUE;
+        }
+    }
+
+    return xSuccess;
+}
+
+/*-----------------------------------------------------------*/
+
+/* Parse a comma separated list of operation names into SOAK_OP_* bits */
+static BaseType_t prvParseOps( const char * pcArg,
+                               uint32_t * pulOps )
+{
+    BaseType_t xSuccess = ( pcArg != NULL ) ? pdTRUE : pdFALSE;
+    uint32_t ulOps = 0;
+
+    while( ( xSuccess == pdTRUE ) && ( *pcArg != '\0' ) )
+    {
+        const char * pcComma = strchr( pcArg, ',' );
+        size_t uxLen = ( pcComma != NULL ) ? ( size_t ) ( pcComma - pcArg ) : strlen( pcArg );
+        uint32_t i = 0;
+
+        for( i = 0; i < SOAK_OP_COUNT; i++ )
+        {
+            const char * pcName = pcSoakOpName( i );
+
+            if( ( strlen( pcName ) == uxLen ) && ( strncmp( pcName, pcArg, uxLen ) == 0 ) )
+            {
+                ulOps |= ( 1UL << i );
+                break;
+            }
+        }
+
+        if( i == SOAK_OP_COUNT )
+        {
+            xSuccess = pdFALSE;
+        }
+        else
+        {
+            pcArg += ( pcComma != NULL ) ? ( uxLen + 1 ) : uxLen;
+        }
+    }
+
+    if( ( xSuccess == pdTRUE ) && ( ulOps != 0 ) )
+    {
+        *pulOps = ulOps;
+    }
+    else
+    {
+        xSuccess = pdFALSE;
+    }
+
+    return xSuccess;
+}
+
+/*-----------------------------------------------------------*/
+
+static void prvPrintStat( ConsoleIO_t * const pxCIO,
+                          const char * pcLabel,
+                          uint32_t ulValue )
+{
+    size_t xLen = snprintf( pcCliScratchBuffer, CLI_OUTPUT_SCRATCH_BUF_LEN,
+                            "| %-24s | %12lu |\r\n", pcLabel, ( unsigned long ) ulValue );
+
+    if( xLen >= CLI_OUTPUT_SCRATCH_BUF_LEN )
+    {
+        xLen = CLI_OUTPUT_SCRATCH_BUF_LEN - 1;
+    }
+
+    pxCIO->write( pcCliScratchBuffer, xLen );
+}
+
+/*-----------------------------------------------------------*/
+
+static void prvPrintSampleRow( ConsoleIO_t * const pxCIO,
+                               const char * pcLabel,
+                               const SoakSample_t * pxSample )
+{
+    ( void ) snprintf( pcCliScratchBuffer, CLI_OUTPUT_SCRATCH_BUF_LEN,
+                       "| %-6s | %8lu | %7lu | %7lu | %7lu | %7lu | %6lu | %5lu | %3lu.%lu %% |\r\n",
+                       pcLabel,
+                       ( unsigned long ) pxSample->ulUptimeS,
+                       ( unsigned long ) pxSample->ulCycle,
+                       ( unsigned long ) pxSample->ulFreeBytes,
+                       ( unsigned long ) pxSample->ulLargestFreeBlock,
+                       ( unsigned long ) pxSample->ulMinEverFreeBytes,
+                       ( unsigned long ) pxSample->ulFreeBlocks,
+                       ( unsigned long ) pxSample->ulAllocFailures,
+                       ( unsigned long ) ( pxSample->ulFragPermille / 10U ),
+                       ( unsigned long ) ( pxSample->ulFragPermille % 10U ) );
+    pxCIO->print( pcCliScratchBuffer );
+}
+
+/*-----------------------------------------------------------*/
+
+static void prvPrintSampleHeader( ConsoleIO_t * const pxCIO )
+{
+    pxCIO->print( "+--------+----------+---------+---------+---------+---------+--------+-------+---------+\r\n" );
+    pxCIO->print( "| Sample | Uptime s |   Cycle |    Free | Largest | MinFree | Blocks | Fails |    Frag |\r\n" );
+    pxCIO->print( "|--------|----------|---------|---------|---------|---------|--------|-------|---------|\r\n" );
+}
+
+/*-----------------------------------------------------------*/
+
+static void prvPrintStatus( ConsoleIO_t * const pxCIO )
+{
+    static SoakStatus_t xStatus;
+    char cLabel[ 25 ];
+
+    vSoakGetStatus( &xStatus );
+
+    ( void ) snprintf( pcCliScratchBuffer, CLI_OUTPUT_SCRATCH_BUF_LEN,
+                       "Soak test %s, ops 0x%lx, cycle %lu s, sample %lu s.\r\n",
+                       ( xStatus.xRunning == pdTRUE ) ? "running" : "stopped",
+                       ( unsigned long ) xStatus.xParams.ulOps,
+                       ( unsigned long ) ( xStatus.xParams.ulCycleMs / 1000U ),
+                       ( unsigned long ) ( xStatus.xParams.ulSampleMs / 1000U ) );
+    pxCIO->print( pcCliScratchBuffer );
+
+    pxCIO->print( "+-----------------------------------------+\r\n" );
+    prvPrintStat( pxCIO, "cycles", xStatus.ulCycles );
+
+    for( uint32_t i = 0; i < SOAK_OP_COUNT; i++ )
+    {
+        ( void ) snprintf( cLabel, sizeof( cLabel ), "%s runs", pcSoakOpName( i ) );
+        prvPrintStat( pxCIO, cLabel, xStatus.ulOpRuns[ i ] );
+        ( void ) snprintf( cLabel, sizeof( cLabel ), "%s failures", pcSoakOpName( i ) );
+        prvPrintStat( pxCIO, cLabel, xStatus.ulOpFailures[ i ] );
+    }
+
+    prvPrintStat( pxCIO, "samples", xStatus.ulSamples );
+    prvPrintStat( pxCIO, "min largest free block", xStatus.ulMinLargestFreeBlock );
+    prvPrintStat( pxCIO, "max frag index (0.1 %)", xStatus.ulMaxFragPermille );
+    pxCIO->print( "+-----------------------------------------+\r\n" );
+
+    if( xStatus.ulSamples > 0 )
+    {
+        prvPrintSampleHeader( pxCIO );
+        prvPrintSampleRow( pxCIO, "first", &( xStatus.xFirst ) );
+        prvPrintSampleRow( pxCIO, "last", &( xStatus.xLast ) );
+        pxCIO->print( "+--------+----------+---------+---------+---------+---------+--------+-------+---------+\r\n" );
+
+        if( xStatus.xLast.ulFreeBytes < xStatus.xFirst.ulFreeBytes )
+        {
+            ( void ) snprintf( pcCliScratchBuffer, CLI_OUTPUT_SCRATCH_BUF_LEN,
+                               "Free heap dropped by %lu bytes since the first sample.\r\n",
+                               ( unsigned long ) ( xStatus.xFirst.ulFreeBytes - xStatus.xLast.ulFreeBytes ) );
+            pxCIO->print( pcCliScratchBuffer );
+        }
+    }
+}
+
+/*-----------------------------------------------------------*/
+
+static void prvPrintHistory( ConsoleIO_t * const pxCIO )
+{
+    static SoakSample_t xSamples[ SOAK_HISTORY_LEN ];
+    uint32_t ulCount = ulSoakGetHistory( xSamples, SOAK_HISTORY_LEN );
+    char cLabel[ 8 ];
+
+    if( ulCount == 0 )
+    {
+        pxCIO->print( "No soak samples.\r\n" );
+    }
+    else
+    {
+        prvPrintSampleHeader( pxCIO );
+
+        for( uint32_t i = 0; i < ulCount; i++ )
+        {
+            ( void ) snprintf( cLabel, sizeof( cLabel ), "%lu", ( unsigned long ) i );
+            prvPrintSampleRow( pxCIO, cLabel, &( xSamples[ i ] ) );
+        }
+
+        pxCIO->print( "+--------+----------+---------+---------+---------+---------+--------+-------+---------+\r\n" );
+    }
+}
+
+/*-----------------------------------------------------------*/
+
+static void prvSoakStart( ConsoleIO_t * const pxCIO,
+                          uint32_t ulArgc,
+                          char * ppcArgv[] )
+{
+    SoakParams_t xParams =
+    {
+        .ulCycleMs  = SOAK_CYCLE_MS,
+        .ulSampleMs = SOAK_SAMPLE_MS,
+        .ulOps      = SOAK_OP_ALL,
+    };
+    BaseType_t xValid = pdTRUE;
+
+    for( uint32_t i = 2; ( i < ulArgc ) && ( xValid == pdTRUE ); i += 2 )
+    {
+        const char * pcNext = ( ( i + 1 ) < ulArgc ) ? ppcArgv[ i + 1 ] : NULL;
+        uint32_t ulSeconds = 0;
+
+        if( ( strcmp( ppcArgv[ i ], "-c" ) == 0 ) &&
+            ( prvParseUInt( pcNext, SOAK_CLI_MAX_CYCLE_S, &ulSeconds ) == pdTRUE ) )
+        {
+            xParams.ulCycleMs = ulSeconds * 1000U;
+        }
+        else if( ( strcmp( ppcArgv[ i ], "-s" ) == 0 ) &&
+                 ( prvParseUInt( pcNext, SOAK_CLI_MAX_SAMPLE_S, &ulSeconds ) == pdTRUE ) &&
+                 ( ulSeconds > 0 ) )
+        {
+            xParams.ulSampleMs = ulSeconds * 1000U;
+        }
+        else if( ( strcmp( ppcArgv[ i ], "-o" ) == 0 ) &&
+                 ( prvParseOps( pcNext, &xParams.ulOps ) == pdTRUE ) )
+        {
+            /* Parsed */
+        }
+        else
+        {
+            pxCIO->print( "Error: Invalid argument: " );
+            pxCIO->print( ppcArgv[ i ] );
+            pxCIO->print( ". See \"help soak\".\r\n" );
+            xValid = pdFALSE;
+        }
+    }
+
+    if( xValid == pdFALSE )
+    {
+        /* Already reported */
+    }
+    else if( xSoakStart( &xParams ) == pdTRUE )
+    {
+        pxCIO->print( "Soak test started.\r\n" );
+    }
+    else
+    {
+        pxCIO->print( "Error: Failed to start the soak test, see the log.\r\n" );
+    }
+}
+
+/*-----------------------------------------------------------*/
+
+static void prvSoakCommand( ConsoleIO_t * const pxCIO,
+                            uint32_t ulArgc,
+                            char * ppcArgv[] )
+{
+    if( ulArgc < 2 )
+    {
+        prvPrintStatus( pxCIO );
+    }
+    else if( strcmp( ppcArgv[ 1 ], "start" ) == 0 )
+    {
+        prvSoakStart( pxCIO, ulArgc, ppcArgv );
+    }
+    else if( ( strcmp( ppcArgv[ 1 ], "stop" ) == 0 ) && ( ulArgc == 2 ) )
+    {
+        vSoakStop();
+        pxCIO->print( "Soak test stopping.\r\n" );
+    }
+    else if( ( strcmp( ppcArgv[ 1 ], "history" ) == 0 ) && ( ulArgc == 2 ) )
+    {
+        prvPrintHistory( pxCIO );
+    }
+    else
+    {
+        pxCIO->print( "Error: Invalid arguments. See \"help soak\".\r\n" );
+    }
+}
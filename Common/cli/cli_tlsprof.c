@@ -0,0 +1,114 @@
+/*
+ * FreeRTOS STM32 Reference Integration
+ * Copyright (C) 2021 Amazon.com, Inc. or its affiliates.  All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ * http://www.FreeRTOS.org
+ * http://aws.amazon.com/freertos
+ *
+
+ */
+
+/* Standard includes. */
+#include <string.h>
+#include <stdint.h>
+#include <stdio.h>
+
+/* FreeRTOS includes. */
+#include "FreeRTOS.h"
+#include "task.h"
+
+#include "cli.h"
+#include "cli_prv.h"
+
+#include "stm32u5xx.h"
+#include "mbedtls_transport.h"
+
+static void prvTlsProfCommand( ConsoleIO_t * const pxCIO,
+                               uint32_t ulArgc,
+                               char * ppcArgv[] );
+
+const CLI_Command_Definition_t xCommandDef_tlsprof =
+{
+    "tlsprof",
+    "tlsprof\r\n"
+    "    Display the time and heap spent in each phase of the last TLS connect.\r\n"
+    "    Requires TLS_TRANSPORT_PROFILE to be set to 1.\r\n\n",
+    prvTlsProfCommand
+};
+
+/*-----------------------------------------------------------*/
+
+static void prvPrintPhase( ConsoleIO_t * const pxCIO,
+                           const char * pcLabel,
+                           uint32_t ulValue )
+{
+    size_t xLen = snprintf( pcCliScratchBuffer, CLI_OUTPUT_SCRATCH_BUF_LEN,
+                            "| %-24s | %12lu |\r\n", pcLabel, ulValue );
+
+    if( xLen >= CLI_OUTPUT_SCRATCH_BUF_LEN )
+    {
+        xLen = CLI_OUTPUT_SCRATCH_BUF_LEN - 1;
+    }
+
+    pxCIO->write( pcCliScratchBuffer, xLen );
+}
+
+/*-----------------------------------------------------------*/
+
+static void prvTlsProfCommand( ConsoleIO_t * const pxCIO,
+                               uint32_t ulArgc,
+                               char * ppcArgv[] )
+{
+    TlsConnectProfile_t xProfile = { 0 };
+
+    ( void ) ppcArgv;
+
+    if( ulArgc > 1 )
+    {
+        pxCIO->print( "Error: tlsprof does not take any arguments.\r\n" );
+    }
+    else if( mbedtls_transport_getprofile( &xProfile ) == pdFALSE )
+    {
+        pxCIO->print( "Error: No TLS connect profile available. Is TLS_TRANSPORT_PROFILE enabled?\r\n" );
+    }
+    else
+    {
+        uint32_t ulCyclesPerUs = SystemCoreClock / 1000000;
+        uint32_t ulTotalUs = 0;
+
+        pxCIO->print( "+-----------------------------------------+\r\n" );
+        pxCIO->print( "| Phase                    |    Time (us) |\r\n" );
+        pxCIO->print( "|--------------------------|--------------|\r\n" );
+
+        for( uint32_t i = 0; i < TLS_PROFILE_NUM_PHASES; i++ )
+        {
+            uint32_t ulPhaseUs = xProfile.ulCycles[ i ] / ulCyclesPerUs;
+
+            prvPrintPhase( pxCIO, mbedtls_transport_profilephasename( ( TlsProfilePhase_t ) i ), ulPhaseUs );
+            ulTotalUs += ulPhaseUs;
+        }
+
+        pxCIO->print( "|--------------------------|--------------|\r\n" );
+        prvPrintPhase( pxCIO, "total", ulTotalUs );
+        prvPrintPhase( pxCIO, "heap peak (bytes)", ( uint32_t ) xProfile.uxHeapPeakBytes );
+        prvPrintPhase( pxCIO, "connected", ( uint32_t ) xProfile.xConnected );
+        pxCIO->print( "+-----------------------------------------+\r\n" );
+    }
+}
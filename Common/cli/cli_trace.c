@@ -0,0 +1,397 @@
+/*
+ * FreeRTOS STM32 Reference Integration
+ *
+ * Copyright (c) 2022 Amazon.com, Inc. or its affiliates. All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#include <string.h>
+#include <stdio.h>
+#include <stdarg.h>
+
+#include "FreeRTOS.h"
+#include "task.h"
+
+#include "cli.h"
+#include "cli_prv.h"
+
+#if TRACE_RECORDER_ENABLED == 1
+
+#define TRACE_TID_ISR_BASE    ( 1000U )
+
+static void prvTraceCommand( ConsoleIO_t * const pxCIO,
+                             uint32_t ulArgc,
+                             char * ppcArgv[] );
+
+const CLI_Command_Definition_t xCommandDef_trace =
+{
+    "trace",
+    "trace [ start [ once ] | stop | stat | dump | json ]\r\n"
+    "    Record scheduler, queue, notification and interrupt events.\r\n"
+    "        start: Clear the ring and record, keeping the latest events,\r\n"
+    "               or the first ones with \"once\".\r\n"
+    "        stop:  Stop recording.\r\n"
+    "        stat:  Recorder state.\r\n"
+    "        dump:  Stop and list the recorded events.\r\n"
+    "        json:  Stop and print the events as Chrome trace JSON for Perfetto.\r\n"
+    "    Without an argument, stat is run.\r\n\n",
+    prvTraceCommand
+};
+
+typedef struct TraceIrqName
+{
+    int32_t lIrq;
+    const char * pcName;
+} TraceIrqName_t;
+
+static const TraceIrqName_t xIrqNames[] =
+{
+    { PendSV_IRQn,           "PendSV"   },
+    { SysTick_IRQn,          "SysTick"  },
+    { EXTI11_IRQn,           "EXTI11"   },
+    { EXTI14_IRQn,           "EXTI14"   },
+    { EXTI15_IRQn,           "EXTI15"   },
+    { GPDMA1_Channel3_IRQn,  "GPDMA1_3" },
+    { GPDMA1_Channel4_IRQn,  "GPDMA1_4" },
+    { GPDMA1_Channel5_IRQn,  "GPDMA1_5" },
+    { SPI2_IRQn,             "SPI2"     },
+    { USART1_IRQn,           "USART1"   },
+    { OCTOSPI2_IRQn,         "OCTOSPI2" },
+};
+
+static const char * const pcEventNames[] =
+{
+    "?",
+    "task in",
+    "task out",
+    "task create",
+    "isr enter",
+    "isr exit",
+    "queue send",
+    "queue receive",
+    "queue block",
+    "notify",
+    "notify take",
+    "mark",
+};
+
+static const char * const pcMarkNames[] =
+{
+    "?",
+    "mx notify",
+    "mx wake",
+    "lwip input",
+    "mqtt recv",
+    "mqtt loop start",
+    "mqtt loop end",
+};
+
+/*-----------------------------------------------------------*/
+
+static void prvPrintf( ConsoleIO_t * const pxCIO,
+                       const char * pcFormat,
+                       ... ) __attribute__( ( format( printf, 2, 3 ) ) );
+
+static void prvPrintf( ConsoleIO_t * const pxCIO,
+                       const char * pcFormat,
+                       ... )
+{
+    va_list xArgs;
+    size_t xLen;
+
+    va_start( xArgs, pcFormat );
+    xLen = vsnprintf( pcCliScratchBuffer, CLI_OUTPUT_SCRATCH_BUF_LEN, pcFormat, xArgs );
+    va_end( xArgs );
+
+    if( xLen >= CLI_OUTPUT_SCRATCH_BUF_LEN )
+    {
+        xLen = CLI_OUTPUT_SCRATCH_BUF_LEN - 1;
+    }
+
+    pxCIO->write( pcCliScratchBuffer, xLen );
+}
+
+static const char * prvIrqName( uint32_t ulException,
+                                char * pcBuffer,
+                                size_t uxBufferLen )
+{
+    int32_t lIrq = ( int32_t ) ulException - 16;
+    const char * pcName = NULL;
+
+    for( size_t uxIdx = 0; uxIdx < ( sizeof( xIrqNames ) / sizeof( xIrqNames[ 0 ] ) ); uxIdx++ )
+    {
+        if( xIrqNames[ uxIdx ].lIrq == lIrq )
+        {
+            pcName = xIrqNames[ uxIdx ].pcName;
+        }
+    }
+
+    if( pcName == NULL )
+    {
+        ( void ) snprintf( pcBuffer, uxBufferLen, "IRQ %ld", lIrq );
+        pcName = pcBuffer;
+    }
+
+    return pcName;
+}
+
+static const char * prvContextName( uint32_t ulContext,
+                                    char * pcBuffer,
+                                    size_t uxBufferLen )
+{
+    const char * pcName = NULL;
+
+    if( ( ulContext & TRACE_CTX_ISR ) != 0 )
+    {
+        pcName = prvIrqName( ulContext & ~TRACE_CTX_ISR, pcBuffer, uxBufferLen );
+    }
+    else
+    {
+        pcName = pcTraceTaskName( ulContext );
+
+        if( pcName == NULL )
+        {
+            ( void ) snprintf( pcBuffer, uxBufferLen, "task %lu", ulContext );
+            pcName = pcBuffer;
+        }
+    }
+
+    return pcName;
+}
+
+static inline uint32_t prvContextTid( uint32_t ulContext )
+{
+    return( ( ( ulContext & TRACE_CTX_ISR ) != 0 ) ? ( TRACE_TID_ISR_BASE + ( ulContext & ~TRACE_CTX_ISR ) ) : ulContext );
+}
+
+static const char * prvEventName( const TraceEvent_t * pxEvent )
+{
+    const char * pcName = "?";
+
+    if( pxEvent->ucType == TRACE_EVT_MARK )
+    {
+        uint32_t ulMark = pxEvent->ulArg >> 24;
+
+        if( ulMark < ( sizeof( pcMarkNames ) / sizeof( pcMarkNames[ 0 ] ) ) )
+        {
+            pcName = pcMarkNames[ ulMark ];
+        }
+    }
+    else if( pxEvent->ucType < ( sizeof( pcEventNames ) / sizeof( pcEventNames[ 0 ] ) ) )
+    {
+        pcName = pcEventNames[ pxEvent->ucType ];
+    }
+    else
+    {
+        /* Unknown event */
+    }
+
+    return pcName;
+}
+
+/* Index of the oldest event still in the ring */
+static uint32_t prvFirstEvent( void )
+{
+    uint32_t ulHead = xTraceRecorder.ulHead;
+
+    return( ( ulHead > xTraceRecorder.ulEventCount ) ? ( ulHead - xTraceRecorder.ulEventCount ) : 0 );
+}
+
+static inline const TraceEvent_t * prvEvent( uint32_t ulIdx )
+{
+    return &( xTraceRecorder.pxEvents[ ulIdx & ( xTraceRecorder.ulEventCount - 1U ) ] );
+}
+
+/*-----------------------------------------------------------*/
+
+static void prvTraceStat( ConsoleIO_t * const pxCIO )
+{
+    uint32_t ulHead = xTraceRecorder.ulHead;
+
+    prvPrintf( pxCIO,
+               "Recording:  %s%s\r\n"
+               "Events:     %lu of %lu\r\n"
+               "Overwritten: %lu\r\n"
+               "Ring:       0x%08lx, %lu bytes per event\r\n",
+               ( xTraceRecorder.ulEnabled != 0 ) ? "yes" : "no",
+               ( xTraceRecorder.ulStopWhenFull != 0 ) ? ", stops when full" : "",
+               ( ulHead > xTraceRecorder.ulEventCount ) ? xTraceRecorder.ulEventCount : ulHead,
+               xTraceRecorder.ulEventCount,
+               ( ulHead > xTraceRecorder.ulEventCount ) ? ( ulHead - xTraceRecorder.ulEventCount ) : 0,
+               ( uint32_t ) xTraceRecorder.pxEvents,
+               xTraceRecorder.ulEventLen );
+}
+
+static void prvTraceDump( ConsoleIO_t * const pxCIO )
+{
+    uint32_t ulHead = xTraceRecorder.ulHead;
+    uint32_t ulFirst = prvFirstEvent();
+    uint32_t ulMhz = xTraceRecorder.ulCpuHz / 1000000UL;
+    uint32_t ulPrev = 0;
+    char cContext[ 16 ];
+
+    if( ulFirst < ulHead )
+    {
+        ulPrev = prvEvent( ulFirst )->ulTimestamp;
+    }
+
+    pxCIO->print( "   +us    context           event             arg\r\n" );
+
+    for( uint32_t ulIdx = ulFirst; ulIdx < ulHead; ulIdx++ )
+    {
+        const TraceEvent_t * pxEvent = prvEvent( ulIdx );
+        uint32_t ulDeltaUs = ( ulMhz > 0 ) ? ( ( pxEvent->ulTimestamp - ulPrev ) / ulMhz ) : 0;
+
+        prvPrintf( pxCIO, "%6lu    %-16s  %-16s  0x%08lx\r\n",
+                   ulDeltaUs,
+                   prvContextName( pxEvent->usContext, cContext, sizeof( cContext ) ),
+                   prvEventName( pxEvent ),
+                   pxEvent->ulArg );
+
+        ulPrev = pxEvent->ulTimestamp;
+    }
+}
+
+/*
+ * Chrome trace event format: a B / E slice on one thread per task and per
+ * interrupt, and instant events for everything else.
+ * Timestamps are microseconds since the first event, unwrapped from the 32 bit cycle counter.
+ */
+static void prvTraceJson( ConsoleIO_t * const pxCIO )
+{
+    uint32_t ulHead = xTraceRecorder.ulHead;
+    uint32_t ulFirst = prvFirstEvent();
+    uint32_t ulMhz = xTraceRecorder.ulCpuHz / 1000000UL;
+    uint64_t ullCycles = 0;
+    uint32_t ulPrev = 0;
+    uint32_t ulNamed[ ( TRACE_RECORDER_TASKS + 256U ) / 32U ] = { 0 };
+    char cContext[ 16 ];
+
+    if( ulMhz == 0 )
+    {
+        ulMhz = 1;
+    }
+
+    if( ulFirst < ulHead )
+    {
+        ulPrev = prvEvent( ulFirst )->ulTimestamp;
+    }
+
+    pxCIO->print( "{\"displayTimeUnit\":\"ns\",\"traceEvents\":[\r\n" );
+    pxCIO->print( "{\"ph\":\"M\",\"name\":\"process_name\",\"pid\":1,\"args\":{\"name\":\"STM32U5\"}}" );
+
+    for( uint32_t ulIdx = ulFirst; ulIdx < ulHead; ulIdx++ )
+    {
+        const TraceEvent_t * pxEvent = prvEvent( ulIdx );
+        uint32_t ulContext = pxEvent->usContext;
+        uint32_t ulTid = prvContextTid( ulContext );
+        uint32_t ulBit = ( ( ulContext & TRACE_CTX_ISR ) != 0 ) ?
+                         ( TRACE_RECORDER_TASKS + ( ( ulContext & ~TRACE_CTX_ISR ) & 0xFFU ) ) :
+                         ( ulContext % TRACE_RECORDER_TASKS );
+        uint64_t ullNs = 0;
+        uint32_t ulUs = 0;
+        uint32_t ulFrac = 0;
+
+        ullCycles += ( uint32_t ) ( pxEvent->ulTimestamp - ulPrev );
+        ulPrev = pxEvent->ulTimestamp;
+
+        ullNs = ( ullCycles * 1000U ) / ulMhz;
+        ulUs = ( uint32_t ) ( ullNs / 1000U );
+        ulFrac = ( uint32_t ) ( ullNs % 1000U );
+
+        /* Name each thread before its first event */
+        if( ( ulNamed[ ulBit / 32U ] & ( 1UL << ( ulBit % 32U ) ) ) == 0 )
+        {
+            ulNamed[ ulBit / 32U ] |= ( 1UL << ( ulBit % 32U ) );
+
+            prvPrintf( pxCIO, ",\r\n{\"ph\":\"M\",\"name\":\"thread_name\",\"pid\":1,\"tid\":%lu,\"args\":{\"name\":\"%s\"}}",
+                       ulTid, prvContextName( ulContext, cContext, sizeof( cContext ) ) );
+        }
+
+        switch( pxEvent->ucType )
+        {
+            case TRACE_EVT_TASK_IN:
+            case TRACE_EVT_ISR_ENTER:
+                prvPrintf( pxCIO, ",\r\n{\"ph\":\"B\",\"name\":\"%s\",\"pid\":1,\"tid\":%lu,\"ts\":%lu.%03lu}",
+                           prvContextName( ulContext, cContext, sizeof( cContext ) ), ulTid, ulUs, ulFrac );
+                break;
+
+            case TRACE_EVT_TASK_OUT:
+            case TRACE_EVT_ISR_EXIT:
+                prvPrintf( pxCIO, ",\r\n{\"ph\":\"E\",\"pid\":1,\"tid\":%lu,\"ts\":%lu.%03lu}",
+                           ulTid, ulUs, ulFrac );
+                break;
+
+            default:
+                prvPrintf( pxCIO, ",\r\n{\"ph\":\"i\",\"s\":\"t\",\"name\":\"%s\",\"pid\":1,\"tid\":%lu,\"ts\":%lu.%03lu,\"args\":{\"arg\":\"0x%08lx\"}}",
+                           prvEventName( pxEvent ), ulTid, ulUs, ulFrac, pxEvent->ulArg );
+                break;
+        }
+    }
+
+    pxCIO->print( "\r\n]}\r\n" );
+}
+
+/*-----------------------------------------------------------*/
+
+static void prvTraceCommand( ConsoleIO_t * const pxCIO,
+                             uint32_t ulArgc,
+                             char * ppcArgv[] )
+{
+    const char * pcVerb = "stat";
+
+    if( ulArgc > 1 )
+    {
+        pcVerb = ppcArgv[ 1 ];
+    }
+
+    if( strcmp( pcVerb, "start" ) == 0 )
+    {
+        uint32_t ulStopWhenFull = ( ( ulArgc > 2 ) && ( strcmp( ppcArgv[ 2 ], "once" ) == 0 ) ) ? 1 : 0;
+
+        vTraceStart( ulStopWhenFull );
+        pxCIO->print( "Trace recording started.\r\n" );
+    }
+    else if( strcmp( pcVerb, "stop" ) == 0 )
+    {
+        vTraceStop();
+        pxCIO->print( "Trace recording stopped.\r\n" );
+    }
+    else if( strcmp( pcVerb, "stat" ) == 0 )
+    {
+        prvTraceStat( pxCIO );
+    }
+    else if( strcmp( pcVerb, "dump" ) == 0 )
+    {
+        /* Writing to the console would otherwise record over the ring being printed */
+        vTraceStop();
+        prvTraceDump( pxCIO );
+    }
+    else if( strcmp( pcVerb, "json" ) == 0 )
+    {
+        vTraceStop();
+        prvTraceJson( pxCIO );
+    }
+    else
+    {
+        pxCIO->print( "Error: Unknown argument. See \"help trace\".\r\n" );
+    }
+}
+
+#endif /* TRACE_RECORDER_ENABLED == 1 */
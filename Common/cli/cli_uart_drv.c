@@ -28,13 +28,14 @@
 #include "logging.h"
 #include "stream_buffer.h"
 #include "message_buffer.h"
+#include "ram_sections.h"
+#include "periph_stats.h"
 
 #include <string.h>
 
-#define HW_FIFO_LEN    8
-
 extern volatile StreamBufferHandle_t xLogMBuf;
 
+/* Only used for log lines that would wrap around the end of ucTxRing */
 static char ucLogLineTxBuff[ dlMAX_PRINT_STRING_LENGTH ];
 static SemaphoreHandle_t xUartTxSem = NULL;
 
@@ -44,7 +45,74 @@ static volatile BaseType_t xPartialCommand = pdFALSE;
 #define BUFFER_READ_TIMEOUT_MS    pdMS_TO_TICKS( 5 )
 
 StreamBufferHandle_t xUartRxStream = NULL;
-StreamBufferHandle_t xUartTxStream = NULL;
+
+/*
+ * Transmit ring, sent by GPDMA directly from ucTxRing.
+ * Writers hold xTxRingMutex and only advance ulTxHead. The DMA completion
+ * interrupt advances ulTxTail and starts the next contiguous segment, so data
+ * wrapping around the end of the ring is sent as two transfers.
+ * One byte is always left free so that ulTxHead == ulTxTail means empty.
+ */
+static uint8_t ucTxRing[ CLI_UART_TX_STREAM_LEN ] RAM_DMA_BUFFER;
+static volatile uint32_t ulTxHead = 0;
+static volatile uint32_t ulTxTail = 0;
+
+/* Length of the DMA transfer in progress, 0 when idle */
+static volatile uint32_t ulTxDmaLen = 0;
+
+static SemaphoreHandle_t xTxRingMutex = NULL;
+
+/* Given by each DMA completion, taken by a writer waiting for space */
+static SemaphoreHandle_t xTxSpaceSem = NULL;
+
+static DMA_HandleTypeDef xHndlUartTxDma =
+{
+    .Instance                  = GPDMA1_Channel3,
+    .Init                      =
+    {
+        .Request               = GPDMA1_REQUEST_USART1_TX,
+        .BlkHWRequest          = DMA_BREQ_SINGLE_BURST,
+        .Direction             = DMA_MEMORY_TO_PERIPH,
+        .SrcInc                = DMA_SINC_INCREMENTED,
+        .DestInc               = DMA_DINC_FIXED,
+        .SrcDataWidth          = DMA_SRC_DATAWIDTH_BYTE,
+        .DestDataWidth         = DMA_DEST_DATAWIDTH_BYTE,
+        .Priority              = DMA_LOW_PRIORITY_LOW_WEIGHT,
+        .SrcBurstLength        = 1,
+        .DestBurstLength       = 1,
+        .TransferAllocatedPort = DMA_SRC_ALLOCATED_PORT0 | DMA_DEST_ALLOCATED_PORT1,
+        .TransferEventMode     = DMA_TCEM_BLOCK_TRANSFER,
+        .Mode                  = DMA_NORMAL,
+    },
+};
+
+/*
+ * Receive ring, written by a circular GPDMA transfer. The UART half transfer, wrap around
+ * and idle line events move the bytes received since ulRxRingPos to xUartRxStream.
+ */
+static uint8_t ucRxRing[ CLI_UART_RX_DMA_LEN ] RAM_DMA_BUFFER;
+static volatile uint32_t ulRxRingPos = 0;
+
+/* Bytes lost because xUartRxStream was full, reported by the reader */
+static volatile uint32_t ulRxDropped = 0;
+static uint32_t ulRxDroppedReported = 0;
+
+static DMA_HandleTypeDef xHndlUartRxDma =
+{
+    .Instance                  = GPDMA1_Channel12,
+    .InitLinkedList            =
+    {
+        .Priority              = DMA_LOW_PRIORITY_HIGH_WEIGHT,
+        .LinkStepMode          = DMA_LSM_FULL_EXECUTION,
+        .LinkAllocatedPort     = DMA_LINK_ALLOCATED_PORT0,
+        .TransferEventMode     = DMA_TCEM_BLOCK_TRANSFER,
+        .LinkedListMode        = DMA_LINKEDLIST_CIRCULAR,
+    },
+};
+
+/* Single node looping on itself, the UART HAL fills its addresses and length */
+static DMA_QListTypeDef xUartRxDmaQueue;
+static DMA_NodeTypeDef xUartRxDmaNode RAM_DMA_BUFFER;
 
 static char pcInputBuffer[ CLI_INPUT_LINE_LEN_MAX ] = { 0 };
 static volatile uint32_t ulInBufferIdx = 0;
@@ -66,7 +134,6 @@ static UART_HandleTypeDef xConsoleHandle =
 
 static BaseType_t xExitFlag = pdFALSE;
 
-static TaskHandle_t xRxThreadHandle = NULL;
 static TaskHandle_t xTxThreadHandle = NULL;
 
 static void vUart1MspInitCallback( UART_HandleTypeDef * huart )
@@ -80,7 +147,8 @@ static void vUart1MspInitCallback( UART_HandleTypeDef * huart )
         __HAL_RCC_USART1_CLK_DISABLE();
 
         xClockInit.PeriphClockSelection = RCC_PERIPHCLK_USART1;
-        xClockInit.Usart1ClockSelection = RCC_USART1CLKSOURCE_PCLK2;
+        /* HSI16 keeps the baud rate independent of the DVFS level */
+        xClockInit.Usart1ClockSelection = RCC_USART1CLKSOURCE_HSI;
 
         xHalStatus = HAL_RCCEx_PeriphCLKConfig( &xClockInit );
 
@@ -112,7 +180,23 @@ static void vUart1MspInitCallback( UART_HandleTypeDef * huart )
 
 void USART1_IRQHandler( void )
 {
+    TRACE_ISR_ENTER();
     HAL_UART_IRQHandler( &xConsoleHandle );
+    TRACE_ISR_EXIT();
+}
+
+void GPDMA1_Channel3_IRQHandler( void )
+{
+    TRACE_ISR_ENTER();
+    HAL_DMA_IRQHandler( &xHndlUartTxDma );
+    TRACE_ISR_EXIT();
+}
+
+void GPDMA1_Channel12_IRQHandler( void )
+{
+    TRACE_ISR_ENTER();
+    HAL_DMA_IRQHandler( &xHndlUartRxDma );
+    TRACE_ISR_EXIT();
 }
 
 static void vUart1MspDeInitCallback( UART_HandleTypeDef * huart )
@@ -128,10 +212,10 @@ static void vUart1MspDeInitCallback( UART_HandleTypeDef * huart )
 
 static void txCompleteCallback( UART_HandleTypeDef * pxUartHandle );
 static void vTxThread( void * pvParameters );
-static void vRxThread( void * pvParameters );
 static void rxEventCallback( UART_HandleTypeDef * pxUartHandle,
-                             uint16_t usBytesRead );
+                             uint16_t usRingPos );
 static void rxErrorCallback( UART_HandleTypeDef * pxUartHandle );
+static HAL_StatusTypeDef prvRxStart( void );
 
 
 /* Should only be called before the scheduler has been initialized / after an assertion has occurred */
@@ -152,11 +236,12 @@ BaseType_t xInitConsoleUart( void )
     HAL_StatusTypeDef xHalRslt = HAL_OK;
 
     xUartTxSem = xSemaphoreCreateBinary();
+    xTxRingMutex = xSemaphoreCreateMutex();
+    xTxSpaceSem = xSemaphoreCreateBinary();
 
     ( void ) HAL_UART_DeInit( &xConsoleHandle );
 
     xUartRxStream = xStreamBufferCreate( CLI_UART_RX_STREAM_LEN, 1 );
-    xUartTxStream = xStreamBufferCreate( CLI_UART_TX_STREAM_LEN, HW_FIFO_LEN ); /*TODO maybe increase this */
 
     xHalRslt |= HAL_UART_RegisterCallback( &xConsoleHandle, HAL_UART_MSPINIT_CB_ID, vUart1MspInitCallback );
     xHalRslt |= HAL_UART_RegisterCallback( &xConsoleHandle, HAL_UART_MSPDEINIT_CB_ID, vUart1MspDeInitCallback );
@@ -193,8 +278,88 @@ BaseType_t xInitConsoleUart( void )
         xHalRslt |= HAL_UARTEx_EnableFifoMode( &xConsoleHandle );
     }
 
-    /* Start TX and RX tasks */
-    xTaskCreate( vRxThread, "uartRx", 1024, NULL, 30, &xRxThreadHandle );
+    /* Transmit DMA channel */
+    if( xHalRslt == HAL_OK )
+    {
+        __HAL_RCC_GPDMA1_CLK_ENABLE();
+
+        xHalRslt = HAL_DMA_Init( &xHndlUartTxDma );
+    }
+
+    if( xHalRslt == HAL_OK )
+    {
+        xHalRslt = HAL_DMA_ConfigChannelAttributes( &xHndlUartTxDma, DMA_CHANNEL_NPRIV );
+    }
+
+    if( xHalRslt == HAL_OK )
+    {
+        __HAL_LINKDMA( &xConsoleHandle, hdmatx, xHndlUartTxDma );
+
+        HAL_NVIC_SetPriority( GPDMA1_Channel3_IRQn, 5, 1 );
+        HAL_NVIC_EnableIRQ( GPDMA1_Channel3_IRQn );
+    }
+
+    /* Receive DMA channel, circular */
+    if( xHalRslt == HAL_OK )
+    {
+        DMA_NodeConfTypeDef xNodeConf = { 0 };
+
+        xNodeConf.NodeType = DMA_GPDMA_LINEAR_NODE;
+        xNodeConf.Init.Request = GPDMA1_REQUEST_USART1_RX;
+        xNodeConf.Init.BlkHWRequest = DMA_BREQ_SINGLE_BURST;
+        xNodeConf.Init.Direction = DMA_PERIPH_TO_MEMORY;
+        xNodeConf.Init.SrcInc = DMA_SINC_FIXED;
+        xNodeConf.Init.DestInc = DMA_DINC_INCREMENTED;
+        xNodeConf.Init.SrcDataWidth = DMA_SRC_DATAWIDTH_BYTE;
+        xNodeConf.Init.DestDataWidth = DMA_DEST_DATAWIDTH_BYTE;
+        xNodeConf.Init.SrcBurstLength = 1;
+        xNodeConf.Init.DestBurstLength = 1;
+        xNodeConf.Init.TransferAllocatedPort = DMA_SRC_ALLOCATED_PORT0 | DMA_DEST_ALLOCATED_PORT1;
+        xNodeConf.Init.TransferEventMode = DMA_TCEM_BLOCK_TRANSFER;
+        xNodeConf.Init.Mode = DMA_NORMAL;
+        xNodeConf.TriggerConfig.TriggerPolarity = DMA_TRIG_POLARITY_MASKED;
+        xNodeConf.DataHandlingConfig.DataExchange = DMA_EXCHANGE_NONE;
+        xNodeConf.DataHandlingConfig.DataAlignment = DMA_DATA_RIGHTALIGN_ZEROPADDED;
+
+        xHalRslt = HAL_DMAEx_List_BuildNode( &xNodeConf, &xUartRxDmaNode );
+    }
+
+    if( xHalRslt == HAL_OK )
+    {
+        xHalRslt = HAL_DMAEx_List_InsertNode( &xUartRxDmaQueue, NULL, &xUartRxDmaNode );
+    }
+
+    if( xHalRslt == HAL_OK )
+    {
+        xHalRslt = HAL_DMAEx_List_SetCircularMode( &xUartRxDmaQueue );
+    }
+
+    if( xHalRslt == HAL_OK )
+    {
+        xHalRslt = HAL_DMAEx_List_Init( &xHndlUartRxDma );
+    }
+
+    if( xHalRslt == HAL_OK )
+    {
+        xHalRslt = HAL_DMAEx_List_LinkQ( &xHndlUartRxDma, &xUartRxDmaQueue );
+    }
+
+    if( xHalRslt == HAL_OK )
+    {
+        xHalRslt = HAL_DMA_ConfigChannelAttributes( &xHndlUartRxDma, DMA_CHANNEL_NPRIV );
+    }
+
+    if( xHalRslt == HAL_OK )
+    {
+        __HAL_LINKDMA( &xConsoleHandle, hdmarx, xHndlUartRxDma );
+
+        HAL_NVIC_SetPriority( GPDMA1_Channel12_IRQn, 5, 1 );
+        HAL_NVIC_EnableIRQ( GPDMA1_Channel12_IRQn );
+
+        xHalRslt = prvRxStart();
+    }
+
+    /* Start TX task */
     xTaskCreate( vTxThread, "uartTx", 1024, NULL, 24, &xTxThreadHandle );
 
     ( void ) xSemaphoreGive( xUartTxSem );
@@ -203,213 +368,340 @@ BaseType_t xInitConsoleUart( void )
 }
 
 
-/* Receive buffer A/B */
-static uint8_t puxRxBufferA[ CLI_UART_RX_READ_SZ_10MS ] = { 0 };
-static uint8_t puxRxBufferB[ CLI_UART_RX_READ_SZ_10MS ] = { 0 };
+static HAL_StatusTypeDef prvRxStart( void )
+{
+    ulRxRingPos = 0;
 
-static uint8_t * pucNextBuffer = NULL;
+    return HAL_UARTEx_ReceiveToIdle_DMA( &xConsoleHandle, ucRxRing, CLI_UART_RX_DMA_LEN );
+}
 
-#define ERROR_FLAG       ( 1U << 31 )
-#define BUFFER_A_FLAG    ( 1U << 30 )
-#define BUFFER_B_FLAG    ( 1U << 29 )
-#define FLAGS_MASK       ( ERROR_FLAG | BUFFER_A_FLAG | BUFFER_B_FLAG )
-#define READ_LEN_MASK    ( ~FLAGS_MASK )
+/* Divider for ulBaudRate, or 0 when USART1 cannot generate it closely enough */
+static uint32_t prvBaudRateDivider( uint32_t ulBaudRate )
+{
+    uint32_t ulClock = HAL_RCCEx_GetPeriphCLKFreq( RCC_PERIPHCLK_USART1 );
+    uint32_t ulDiv = 0;
 
-/* */
-static void rxErrorCallback( UART_HandleTypeDef * pxUartHandle )
+    if( ulBaudRate > 0 )
+    {
+        ulDiv = UART_DIV_SAMPLING16( ulClock, ulBaudRate, UART_PRESCALER_DIV1 );
+    }
+
+    /* 16x oversampling needs a divider of at least 16 */
+    if( ( ulDiv < 16U ) || ( ulDiv > 0xFFFFU ) )
+    {
+        ulDiv = 0;
+    }
+    else
+    {
+        uint32_t ulActual = ulClock / ulDiv;
+        uint32_t ulError = ( ulActual > ulBaudRate ) ? ( ulActual - ulBaudRate ) : ( ulBaudRate - ulActual );
+
+        if( ( ulError * 100U ) > ( ulBaudRate * CLI_UART_BAUD_MAX_ERROR_PCT ) )
+        {
+            ulDiv = 0;
+        }
+    }
+
+    return ulDiv;
+}
+
+BaseType_t xConsoleBaudRateValid( uint32_t ulBaudRate )
 {
-    BaseType_t xHigherPriorityTaskWoken = pdFALSE;
+    return( prvBaudRateDivider( ulBaudRate ) != 0 );
+}
+
+/*
+ * Switch the console to ulBaudRate once everything queued has been sent.
+ * Bytes received during the switch are discarded. Callers hold the console lock
+ * so that no log line is started in between.
+ */
+BaseType_t xConsoleSetBaudRate( uint32_t ulBaudRate )
+{
+    uint32_t ulDiv = prvBaudRateDivider( ulBaudRate );
+    BaseType_t xResult = pdFALSE;
+    TickType_t xDeadline = xTaskGetTickCount() + pdMS_TO_TICKS( CLI_UART_TX_DRAIN_TIMEOUT_MS );
 
-    ( void ) xTaskNotifyIndexedFromISR( xRxThreadHandle,
-                                        1,
-                                        ERROR_FLAG,
-                                        eSetValueWithOverwrite,
-                                        &xHigherPriorityTaskWoken );
+    /* The transfer complete interrupt, which clears ulTxDmaLen, waits for the last stop bit */
+    while( ( ( ulTxHead != ulTxTail ) || ( ulTxDmaLen != 0 ) ) &&
+           ( ( int32_t ) ( xDeadline - xTaskGetTickCount() ) > 0 ) )
+    {
+        vTaskDelay( 1 );
+    }
 
-    portYIELD_FROM_ISR( xHigherPriorityTaskWoken );
+    if( ulDiv == 0 )
+    {
+        LogError( "Unsupported console baud rate: %lu", ulBaudRate );
+    }
+    else if( ( ulTxHead != ulTxTail ) || ( ulTxDmaLen != 0 ) )
+    {
+        LogError( "Timed out waiting for the console transmit ring to drain." );
+    }
+    else
+    {
+        ( void ) HAL_UART_AbortReceive( &xConsoleHandle );
+
+        __HAL_UART_DISABLE( &xConsoleHandle );
+        xConsoleHandle.Instance->BRR = ulDiv;
+        xConsoleHandle.Init.BaudRate = ulBaudRate;
+        __HAL_UART_ENABLE( &xConsoleHandle );
+
+        /* Only the cli task reads xUartRxStream, and it is the caller */
+        ( void ) xStreamBufferReset( xUartRxStream );
+
+        xResult = ( prvRxStart() == HAL_OK );
+    }
+
+    return xResult;
 }
 
+uint32_t ulConsoleGetBaudRate( void )
+{
+    return xConsoleHandle.Init.BaudRate;
+}
 
-static void rxEventCallback( UART_HandleTypeDef * pxUartHandle,
-                             uint16_t usBytesRead )
+/* The HAL aborts a DMA reception on error, restart it */
+static void rxErrorCallback( UART_HandleTypeDef * pxUartHandle )
 {
-    BaseType_t xHigherPriorityTaskWoken = pdFALSE;
     HAL_StatusTypeDef xHalStatus = HAL_OK;
+    uint32_t ulErrorCode = pxUartHandle->ErrorCode;
 
-    /* Check if we read some data or timed out */
-    if( usBytesRead > 0 )
+    xPeriphErrStats.ulUartParity += ( ( ulErrorCode & HAL_UART_ERROR_PE ) != 0 ) ? 1 : 0;
+    xPeriphErrStats.ulUartNoise += ( ( ulErrorCode & HAL_UART_ERROR_NE ) != 0 ) ? 1 : 0;
+    xPeriphErrStats.ulUartFraming += ( ( ulErrorCode & HAL_UART_ERROR_FE ) != 0 ) ? 1 : 0;
+    xPeriphErrStats.ulUartOverrun += ( ( ulErrorCode & HAL_UART_ERROR_ORE ) != 0 ) ? 1 : 0;
+    xPeriphErrStats.ulUartDma += ( ( ulErrorCode & HAL_UART_ERROR_DMA ) != 0 ) ? 1 : 0;
+
+    if( pxUartHandle->RxState == HAL_UART_STATE_READY )
     {
-        uint32_t ulNotifyValue = usBytesRead;
+        xHalStatus = prvRxStart();
+    }
 
-        /* Determine next buffer to write to */
-        configASSERT( pucNextBuffer != NULL );
+    configASSERT( xHalStatus == HAL_OK );
+}
 
-        if( pucNextBuffer == puxRxBufferA )
-        {
-            ulNotifyValue |= BUFFER_A_FLAG;
-            pucNextBuffer = puxRxBufferB;
-        }
-        else if( pucNextBuffer == puxRxBufferB )
-        {
-            ulNotifyValue |= BUFFER_B_FLAG;
-            pucNextBuffer = puxRxBufferA;
-        }
-        else
-        {
-            /* pxUartHandle->pRxBuffPtr contents unrecognized */
-            configASSERT( 0 );
-        }
+/* usRingPos is the offset in ucRxRing the DMA has written up to */
+static void rxEventCallback( UART_HandleTypeDef * pxUartHandle,
+                             uint16_t usRingPos )
+{
+    BaseType_t xHigherPriorityTaskWoken = pdFALSE;
+    uint32_t ulPos = ulRxRingPos;
+    uint32_t ulEnd = ( usRingPos >= CLI_UART_RX_DMA_LEN ) ? 0 : usRingPos;
 
-        ( void ) xTaskNotifyIndexedFromISR( xRxThreadHandle,
-                                            1,
-                                            ulNotifyValue,
-                                            eSetValueWithOverwrite,
-                                            &xHigherPriorityTaskWoken );
-    }
-    else /* Otherwise IDLE timeout event, continue using the same buffer */
+    ( void ) pxUartHandle;
+
+    if( ulPos != ulEnd )
     {
-        configASSERT( pucNextBuffer != NULL );
+        /* Keep the uart clocked while someone is typing */
+        vLowPowerConsoleActivity();
     }
 
-    xHalStatus = HAL_UARTEx_ReceiveToIdle_IT( pxUartHandle,
-                                              pucNextBuffer,
-                                              CLI_UART_RX_READ_SZ_10MS );
+    while( ulPos != ulEnd )
+    {
+        uint32_t ulLen = ( ulEnd > ulPos ) ? ( ulEnd - ulPos ) : ( CLI_UART_RX_DMA_LEN - ulPos );
+        size_t xBytesPushed = xStreamBufferSendFromISR( xUartRxStream, &( ucRxRing[ ulPos ] ),
+                                                        ulLen, &xHigherPriorityTaskWoken );
 
-    configASSERT( xHalStatus == HAL_OK );
+        ulRxDropped += ( ulLen - xBytesPushed );
+        ulPos = ( ulPos + ulLen ) % CLI_UART_RX_DMA_LEN;
+    }
+
+    ulRxRingPos = ulPos;
 
     portYIELD_FROM_ISR( xHigherPriorityTaskWoken );
 }
 
-static void vRxThread( void * pvParameters )
+/* Log receive overruns from task context */
+static void prvRxReportDropped( void )
 {
-    /* Start the initial receive into buffer A */
-    pucNextBuffer = puxRxBufferA;
-    rxEventCallback( &xConsoleHandle, 0 );
+    uint32_t ulDropped = ulRxDropped;
 
-    while( !xExitFlag )
+    if( ulDropped != ulRxDroppedReported )
     {
-        uint32_t ulNotifyValue = 0;
+        LogWarn( "Dropped %lu bytes. Console receive buffer full.", ulDropped - ulRxDroppedReported );
+        ulRxDroppedReported = ulDropped;
+    }
+}
 
-        /* Wait for completion event */
-        if( xTaskNotifyWaitIndexed( 1, 0, 0xFFFFFFFF, &ulNotifyValue, pdMS_TO_TICKS( 30 ) ) == pdTRUE )
-        {
-            size_t xBytes = ( ulNotifyValue & READ_LEN_MASK );
-            size_t xBytesPushed = 0;
+/*
+ * Start sending the oldest contiguous segment of ucTxRing if the DMA channel is idle.
+ * Must be called from the DMA completion interrupt or from a critical section.
+ */
+static void prvTxStartNext( void )
+{
+    uint32_t ulHead = ulTxHead;
+    uint32_t ulTail = ulTxTail;
 
-            if( ( xBytes > 0 ) &&
-                ( ( ulNotifyValue & BUFFER_A_FLAG ) > 0 ) )
-            {
-                xBytesPushed = xStreamBufferSend( xUartRxStream, puxRxBufferA, xBytes, 0 );
-            }
-            else if( ( xBytes > 0 ) &&
-                     ( ( ulNotifyValue & BUFFER_B_FLAG ) > 0 ) )
-            {
-                xBytesPushed = xStreamBufferSend( xUartRxStream, puxRxBufferB, xBytes, 0 );
-            }
-            else /* Zero bytes or error case */
-            {
-                xBytesPushed = 0;
-            }
+    if( ( ulTxDmaLen == 0 ) && ( ulHead != ulTail ) )
+    {
+        uint32_t ulLen = ( ulHead > ulTail ) ? ( ulHead - ulTail ) : ( CLI_UART_TX_STREAM_LEN - ulTail );
 
-            /* Log warning if failed to add data */
-            if( xBytesPushed != xBytes )
-            {
-                LogWarn( "Dropped %ld bytes. Console receive buffer full.", xBytes - xBytesPushed );
-            }
+        ulTxDmaLen = ulLen;
+
+        if( HAL_UART_Transmit_DMA( &xConsoleHandle, &( ucTxRing[ ulTail ] ), ( uint16_t ) ulLen ) != HAL_OK )
+        {
+            ulTxDmaLen = 0;
         }
     }
 }
 
-/* */
 static void txCompleteCallback( UART_HandleTypeDef * pxUartHandle )
 {
     BaseType_t xHigherPriorityTaskWoken = pdFALSE;
 
-    ( void ) vTaskNotifyGiveIndexedFromISR( xTxThreadHandle, 1, &xHigherPriorityTaskWoken );
+    ( void ) pxUartHandle;
+
+    ulTxTail = ( ulTxTail + ulTxDmaLen ) % CLI_UART_TX_STREAM_LEN;
+    ulTxDmaLen = 0;
+
+    prvTxStartNext();
+
+    ( void ) xSemaphoreGiveFromISR( xTxSpaceSem, &xHigherPriorityTaskWoken );
 
     portYIELD_FROM_ISR( xHigherPriorityTaskWoken );
 }
 
+/* Number of bytes that can be written at ulTxHead without wrapping. PRE: xTxRingMutex held */
+static size_t prvTxRingContiguousFree( void )
+{
+    uint32_t ulHead = ulTxHead;
+    uint32_t ulTail = ulTxTail;
+    size_t uxFree = ( ulTail + CLI_UART_TX_STREAM_LEN - ulHead - 1 ) % CLI_UART_TX_STREAM_LEN;
+    size_t uxToEnd = CLI_UART_TX_STREAM_LEN - ulHead;
 
-/* Uart transmit thread */
-static void vTxThread( void * pvParameters )
+    return ( uxFree < uxToEnd ) ? uxFree : uxToEnd;
+}
+
+/* Make uxLen bytes written at ulTxHead available to the DMA. PRE: xTxRingMutex held */
+static void prvTxRingCommit( size_t uxLen )
 {
-    uint8_t pucTxBuffer[ CLI_UART_TX_WRITE_SZ_5MS ] = { 0 };
-    HAL_StatusTypeDef xHalStatus = HAL_OK;
+    ulTxHead = ( ulTxHead + uxLen ) % CLI_UART_TX_STREAM_LEN;
 
-    size_t xBytes = 0;
+    taskENTER_CRITICAL();
+    prvTxStartNext();
+    taskEXIT_CRITICAL();
+}
 
-    while( !xExitFlag )
+/* Copy data to ucTxRing, waiting for transfers to complete while it is full. PRE: xTxRingMutex held */
+static void prvTxRingWrite( const uint8_t * pucData,
+                            size_t uxLen )
+{
+    while( uxLen > 0 )
     {
-        /* Read up to 64 bytes
-         * wait up to BUFFER_READ_TIMEOUT before getting less than 64 */
-        xBytes = xStreamBufferReceive( xUartTxStream,
-                                       pucTxBuffer,
-                                       CLI_UART_TX_WRITE_SZ_5MS,
-                                       BUFFER_READ_TIMEOUT_MS );
+        size_t uxChunk = prvTxRingContiguousFree();
 
-        /* If tx buffer is empty */
-        if( xBytes == 0 )
+        if( uxChunk == 0 )
         {
-            /* Take the uart write semaphore (non-blocking) */
-            if( xSemaphoreTake( xUartTxSem, 0 ) == pdTRUE )
+            /* Restart the transfer in case the last attempt to start it failed */
+            if( xSemaphoreTake( xTxSpaceSem, BUFFER_READ_TIMEOUT_MS ) == pdFALSE )
             {
-                xBytes = xMessageBufferReceive( xLogMBuf, ucLogLineTxBuff, dlMAX_PRINT_STRING_LENGTH, 0 );
+                taskENTER_CRITICAL();
+                prvTxStartNext();
+                taskEXIT_CRITICAL();
+            }
+        }
+        else
+        {
+            if( uxChunk > uxLen )
+            {
+                uxChunk = uxLen;
+            }
 
-                /* All log messages should be less than the maximum length */
-                configASSERT( ( xBytes + CLI_OUTPUT_EOL_LEN + CLI_INPUT_LINE_LEN_MAX ) <= CLI_UART_TX_STREAM_LEN );
+            ( void ) memcpy( &( ucTxRing[ ulTxHead ] ), pucData, uxChunk );
+            prvTxRingCommit( uxChunk );
 
-                /* If we got a log message to output, add it to the stream buffer to be processed */
-                if( xBytes > 0 )
-                {
-                    if( xPartialCommand == pdTRUE )
-                    {
-                        /* Overwrite existing line contents */
-                        ( void ) xStreamBufferSend( xUartTxStream, "\r\033[K", 4, 0 );
-                    }
+            pucData += uxChunk;
+            uxLen -= uxChunk;
+        }
+    }
+}
 
-                    /* enqueue the log message */
-                    ( void ) xStreamBufferSend( xUartTxStream, ucLogLineTxBuff, xBytes, 0 );
+/* Move the next log line to ucTxRing, receiving it in place unless it would wrap. PRE: xTxRingMutex held */
+static void prvTxRingWriteLogLine( void )
+{
+    size_t xLen = xMessageBufferNextLengthBytes( xLogMBuf );
 
-                    /* Add CRLF */
-                    ( void ) xStreamBufferSend( xUartTxStream, CLI_OUTPUT_EOL, CLI_OUTPUT_EOL_LEN, 0 );
+    /* All log messages should be less than the maximum length */
+    configASSERT( ( xLen + CLI_OUTPUT_EOL_LEN + CLI_INPUT_LINE_LEN_MAX ) <= CLI_UART_TX_STREAM_LEN );
 
-                    if( xPartialCommand == pdTRUE )
-                    {
-                        ( void ) xStreamBufferSend( xUartTxStream, CLI_PROMPT_STR, CLI_PROMPT_LEN, 0 );
+    if( xLen > 0 )
+    {
+        /* Lines that would wrap around the end of the ring go through ucLogLineTxBuff */
+        if( prvTxRingContiguousFree() >= xLen )
+        {
+            xLen = xMessageBufferReceive( xLogMBuf, &( ucTxRing[ ulTxHead ] ), xLen, 0 );
+            prvTxRingCommit( xLen );
+        }
+        else
+        {
+            xLen = xMessageBufferReceive( xLogMBuf, ucLogLineTxBuff, dlMAX_PRINT_STRING_LENGTH, 0 );
+            prvTxRingWrite( ( uint8_t * ) ucLogLineTxBuff, xLen );
+        }
 
-                        /* Restore current command line contents */
-                        if( ulInBufferIdx > 0 )
-                        {
-                            ( void ) xStreamBufferSend( xUartTxStream, pcInputBuffer, ulInBufferIdx, 0 );
-                        }
-                    }
+        prvTxRingWrite( ( const uint8_t * ) CLI_OUTPUT_EOL, CLI_OUTPUT_EOL_LEN );
+    }
+}
 
-                    ( void ) xSemaphoreGive( xUartTxSem );
-                    xBytes = xStreamBufferReceive( xUartTxStream,
-                                                   pucTxBuffer,
-                                                   CLI_UART_TX_WRITE_SZ_5MS,
-                                                   0 );
-                }
-                else
-                {
-                    ( void ) xSemaphoreGive( xUartTxSem );
-                }
-            }
+/* Uart transmit thread, moves log lines to the transmit ring */
+static void vTxThread( void * pvParameters )
+{
+    uint8_t ucDummy = 0;
+
+    ( void ) pvParameters;
+
+#if defined( LOGGING_OUTPUT_UART )
+    {
+        size_t uxLen;
+
+        /* Lines logged before the scheduler started precede anything in xLogMBuf */
+        ( void ) xSemaphoreTake( xTxRingMutex, portMAX_DELAY );
+
+        while( ( uxLen = uxLoggingEarlyRead( ucLogLineTxBuff, sizeof( ucLogLineTxBuff ) ) ) > 0 )
+        {
+            prvTxRingWrite( ( const uint8_t * ) ucLogLineTxBuff, uxLen );
+            prvTxRingWrite( ( const uint8_t * ) CLI_OUTPUT_EOL, CLI_OUTPUT_EOL_LEN );
         }
 
-        /* Transmit if bytes available to transmit */
-        if( xBytes > 0 )
+        ( void ) xSemaphoreGive( xTxRingMutex );
+    }
+#endif /* defined( LOGGING_OUTPUT_UART ) */
+
+    while( !xExitFlag )
+    {
+        /* Wait for a log line. The message is longer than the buffer given, so it is left in place */
+        ( void ) xMessageBufferReceive( xLogMBuf, &ucDummy, 0, portMAX_DELAY );
+
+        /* Do not interleave log lines with the echo of a command being typed. Lines
+         * logged while a command holds the console queue up until it is released. */
+        if( ( xMessageBufferIsEmpty( xLogMBuf ) == pdFALSE ) &&
+            ( xSemaphoreTake( xUartTxSem, portMAX_DELAY ) == pdTRUE ) )
         {
-            ( void ) xTaskNotifyStateClearIndexed( NULL, 1 );
-            xHalStatus = HAL_UART_Transmit_IT( &xConsoleHandle, pucTxBuffer, ( uint16_t ) xBytes );
-/*			configASSERT( xHalStatus == HAL_OK ); */
+            ( void ) xSemaphoreTake( xTxRingMutex, portMAX_DELAY );
+
+            if( xPartialCommand == pdTRUE )
+            {
+                /* Overwrite existing line contents */
+                prvTxRingWrite( ( const uint8_t * ) "\r\033[K", 4 );
+            }
 
-            if( xHalStatus == HAL_OK )
+            /* Send every queued line before restoring the prompt */
+            while( xMessageBufferIsEmpty( xLogMBuf ) == pdFALSE )
             {
-                /* Wait for completion event (should be within 1 or 2 ms) */
-                ( void ) ulTaskNotifyTakeIndexed( 1, pdTRUE, portMAX_DELAY );
+                prvTxRingWriteLogLine();
             }
+
+            if( xPartialCommand == pdTRUE )
+            {
+                prvTxRingWrite( ( const uint8_t * ) CLI_PROMPT_STR, CLI_PROMPT_LEN );
+
+                /* Restore current command line contents */
+                if( ulInBufferIdx > 0 )
+                {
+                    prvTxRingWrite( ( const uint8_t * ) pcInputBuffer, ulInBufferIdx );
+                }
+            }
+
+            ( void ) xSemaphoreGive( xTxRingMutex );
+            ( void ) xSemaphoreGive( xUartTxSem );
         }
     }
 }
@@ -417,23 +709,15 @@ static void vTxThread( void * pvParameters )
 static void uart_write( const void * const pvOutputBuffer,
                         uint32_t xOutputBufferLen )
 {
-    size_t xBytesSent = 0;
-
-    const uint8_t * const pcBuffer = ( uint8_t * const ) pvOutputBuffer;
-
     if( ( pvOutputBuffer != NULL ) &&
         ( xOutputBufferLen > 0 ) )
     {
-        while( xBytesSent < xOutputBufferLen )
-        {
-            xBytesSent += xStreamBufferSend( xUartTxStream,
-                                             ( const void * ) &( pcBuffer[ xBytesSent ] ),
-                                             xOutputBufferLen - xBytesSent,
-                                             portMAX_DELAY );
-        }
-    }
+        ( void ) xSemaphoreTake( xTxRingMutex, portMAX_DELAY );
+
+        prvTxRingWrite( ( const uint8_t * ) pvOutputBuffer, xOutputBufferLen );
 
-    configASSERT( xBytesSent == xOutputBufferLen );
+        ( void ) xSemaphoreGive( xTxRingMutex );
+    }
 }
 
 /* Get at least once byte, possibly up to pcInputBuffer if the uart stays busy */
@@ -449,6 +733,8 @@ static int32_t uart_read( char * const pcInputBuffer,
                                             pcInputBuffer,
                                             xInputBufferLen,
                                             portMAX_DELAY );
+
+        prvRxReportDropped();
     }
 
     return ulBytesRead;
@@ -468,6 +754,8 @@ static int32_t uart_read_timeout( char * const pcInputBuffer,
                                             pcInputBuffer,
                                             xInputBufferLen,
                                             xTimeout );
+
+        prvRxReportDropped();
     }
 
     return ulBytesRead;
@@ -35,6 +35,10 @@
 
 #include "cli.h"
 #include "cli_prv.h"
+#include "heap_classes.h"
+#include "task_stats.h"
+#include "boot_times.h"
+#include "dvfs.h"
 
 #include "core_cm33.h"
 
@@ -42,6 +46,10 @@ static void prvPSCommand( ConsoleIO_t * const pxConsoleIO,
                           uint32_t ulArgc,
                           char * ppcArgv[] );
 
+static void prvTopCommand( ConsoleIO_t * const pxCIO,
+                           uint32_t ulArgc,
+                           char * ppcArgv[] );
+
 static void vKillAllCommand( ConsoleIO_t * const pxCIO,
                              uint32_t ulArgc,
                              char * ppcArgv[] );
@@ -54,6 +62,8 @@ static void vHeapStatCommand( ConsoleIO_t * const pxCIO,
                               uint32_t ulArgc,
                               char * ppcArgv[] );
 
+static void vHeapTagPrint( ConsoleIO_t * const pxCIO );
+
 static void vResetCommand( ConsoleIO_t * const pxCIO,
                            uint32_t ulArgc,
                            char * ppcArgv[] );
@@ -62,6 +72,10 @@ static void vUptimeCommand( ConsoleIO_t * const pxCIO,
                             uint32_t ulArgc,
                             char * ppcArgv[] );
 
+static void vBootTimeCommand( ConsoleIO_t * const pxCIO,
+                              uint32_t ulArgc,
+                              char * ppcArgv[] );
+
 static void vAssertCommand( ConsoleIO_t * const pxCIO,
                             uint32_t ulArgc,
                             char * ppcArgv[] );
@@ -71,11 +85,27 @@ static void vAssertCommand( ConsoleIO_t * const pxCIO,
 const CLI_Command_Definition_t xCommandDef_ps =
 {
     "ps",
-    "ps\r\n"
-    "    List the status of all running tasks and related runtime statistics.\r\n\n",
+    "ps [hints]\r\n"
+    "    List the status of all running tasks and related runtime statistics.\r\n"
+    "    hints: print task_stacks.h depths sized from the stack high water marks.\r\n\n",
     prvPSCommand
 };
 
+#define TOP_INTERVAL_DEFAULT_MS    1000U
+#define TOP_INTERVAL_MIN_MS        100U
+#define TOP_INTERVAL_MAX_MS        60000U
+
+const CLI_Command_Definition_t xCommandDef_top =
+{
+    "top",
+    "top\r\n"
+    "    top [ interval_ms ]\r\n"
+    "    Sample the CPU usage of each task over interval_ms ( default 1000 ) and list it\r\n"
+    "    with the largest delay between each task becoming ready and running, in us,\r\n"
+    "    during the interval and since the task was created.\r\n\n",
+    prvTopCommand
+};
+
 const CLI_Command_Definition_t xCommandDef_kill =
 {
     "kill",
@@ -111,7 +141,10 @@ const CLI_Command_Definition_t xCommandDef_heapStat =
     "    heapstat --kilo\r\n"
     "        Display heap statistics in Kilobytes (KB).\r\n\n"
     "    heapstat --mega\r\n"
-    "        Display heap statistics in Megabytes (MB).\r\n\n",
+    "        Display heap statistics in Megabytes (MB).\r\n\n"
+    "    heapstat -t | --tags\r\n"
+    "        Also display the heap usage of each subsystem in bytes.\r\n"
+    "        Requires HEAP_ACCOUNTING.\r\n\n",
     vHeapStatCommand
 };
 
@@ -131,6 +164,15 @@ const CLI_Command_Definition_t xCommandDef_uptime =
     vUptimeCommand
 };
 
+const CLI_Command_Definition_t xCommandDef_boottime =
+{
+    "boottime",
+    "boottime\r\n"
+    "    List the time each boot stage was reached, in ms since reset, for this boot\r\n"
+    "    and the previous one if it was recorded before a warm reset.\r\n\n",
+    vBootTimeCommand
+};
+
 const CLI_Command_Definition_t xCommandDef_assert =
 {
     "assert",
@@ -179,28 +221,60 @@ static inline const char * pceTaskStateToString( eTaskState xState )
 
 /*-----------------------------------------------------------*/
 
-static uint32_t ulGetStackDepth( TaskHandle_t xTask )
+/* High water usage plus TASK_STATS_STACK_MARGIN_PCT, rounded up to 64 words */
+#define PS_HINT_ROUND_WORDS    64U
+
+/*
+ * Print a TASK_STACK_<NAME> define for the task, NAME being the task name in
+ * upper case with anything other than letters and digits replaced by '_'.
+ * Returns the words the stack has beyond the hint.
+ */
+static uint32_t prvPrintStackHint( ConsoleIO_t * const pxCIO,
+                               const TaskStatus_t * pxTaskStatus )
 {
-    struct tskTaskControlBlockRedef
+    char cMacroName[ configMAX_TASK_NAME_LEN + 1 ] = { 0 };
+    uint32_t ulStackSize = ulTaskStatsStackDepth( pxTaskStatus->xHandle );
+    uint32_t ulUsed = ulStackSize - ( uint32_t ) pxTaskStatus->usStackHighWaterMark;
+    uint32_t ulHint = ulUsed + ( ( ulUsed * TASK_STATS_STACK_MARGIN_PCT ) / 100U );
+    int lRslt;
+
+    ulHint = ( ( ulHint + PS_HINT_ROUND_WORDS - 1U ) / PS_HINT_ROUND_WORDS ) * PS_HINT_ROUND_WORDS;
+
+    for( size_t i = 0; ( i < configMAX_TASK_NAME_LEN ) && ( pxTaskStatus->pcTaskName[ i ] != '\0' ); i++ )
     {
-        volatile StackType_t * pxDontCare0;
+        char cChar = pxTaskStatus->pcTaskName[ i ];
 
-#if ( portUSING_MPU_WRAPPERS == 1 )
-        xMPU_SETTINGS xDontCare1;
-#endif
-        ListItem_t xDontCare2;
-        ListItem_t xDontCare3;
-        UBaseType_t uxDontCare4;
-        StackType_t * pxStack;
-        char pcDontCare5[ configMAX_TASK_NAME_LEN ];
-
-#if ( ( portSTACK_GROWTH > 0 ) || ( configRECORD_STACK_HIGH_ADDRESS == 1 ) )
-        StackType_t * pxEndOfStack;
-#endif
-    };
-    struct tskTaskControlBlockRedef * pxTCB = ( struct tskTaskControlBlockRedef * ) xTask;
+        if( ( cChar >= 'a' ) && ( cChar <= 'z' ) )
+        {
+            cChar = ( char ) ( cChar - 'a' + 'A' );
+        }
+        else if( !( ( ( cChar >= 'A' ) && ( cChar <= 'Z' ) ) ||
+                    ( ( cChar >= '0' ) && ( cChar <= '9' ) ) ) )
+        {
+            cChar = '_';
+        }
+        else
+        {
+            /* Kept as is */
+        }
+
+        cMacroName[ i ] = cChar;
+    }
+
+    lRslt = snprintf( pcCliScratchBuffer, CLI_OUTPUT_SCRATCH_BUF_LEN,
+                      "#define TASK_STACK_%-16s %5lu /* now %lu, used %lu */\r\n",
+                      cMacroName,
+                      ( unsigned long ) ulHint,
+                      ( unsigned long ) ulStackSize,
+                      ( unsigned long ) ulUsed );
 
-    return( ( ( ( uintptr_t ) pxTCB->pxEndOfStack - ( uintptr_t ) pxTCB->pxStack ) / sizeof( StackType_t ) ) + 2 );
+    if( ( lRslt > 0 ) &&
+        ( lRslt < CLI_OUTPUT_SCRATCH_BUF_LEN ) )
+    {
+        pxCIO->write( pcCliScratchBuffer, ( size_t ) lRslt );
+    }
+
+    return ( ulStackSize > ulHint ) ? ( ulStackSize - ulHint ) : 0;
 }
 
 static void prvPSCommand( ConsoleIO_t * const pxCIO,
@@ -208,6 +282,7 @@ static void prvPSCommand( ConsoleIO_t * const pxCIO,
                           char * ppcArgv[] )
 {
     UBaseType_t uxNumTasks = uxTaskGetNumberOfTasks();
+    BaseType_t xHints = ( ( ulArgc > 1 ) && ( strcmp( ppcArgv[ 1 ], "hints" ) == 0 ) ) ? pdTRUE : pdFALSE;
 
     TaskStatus_t * pxTaskStatusArray = ( TaskStatus_t * ) pvPortMalloc( sizeof( TaskStatus_t ) * uxNumTasks );
 
@@ -222,41 +297,187 @@ static void prvPSCommand( ConsoleIO_t * const pxCIO,
                                            uxNumTasks,
                                            &ulTotalRuntime );
 
-        ulTotalRuntime /= 100;
+        if( xHints == pdTRUE )
+        {
+            uint32_t ulSlackWords = 0;
 
-        snprintf( pcCliScratchBuffer, CLI_OUTPUT_SCRATCH_BUF_LEN, "Total Runtime: %lu\r\n", ulTotalRuntime );
+            for( uint32_t i = 0; i < uxNumTasks; i++ )
+            {
+                ulSlackWords += prvPrintStackHint( pxCIO, &( pxTaskStatusArray[ i ] ) );
+            }
 
-        pxCIO->print( pcCliScratchBuffer );
+            /* High water marks cover the whole uptime */
+            snprintf( pcCliScratchBuffer, CLI_OUTPUT_SCRATCH_BUF_LEN,
+                      "/* Uptime %lu s, %lu bytes of stack above the hints */\r\n",
+                      ( unsigned long ) ( xTaskGetTickCount() / configTICK_RATE_HZ ),
+                      ( unsigned long ) ( ulSlackWords * sizeof( StackType_t ) ) );
+            pxCIO->print( pcCliScratchBuffer );
+        }
+        else
+        {
+            ulTotalRuntime /= 100;
 
-        pxCIO->print( "+----------------------------------------------------------------------------------+\r\n" );
-        pxCIO->print( "| Task |   State   |    Task Name     |___Priority__| %CPU | Stack | Stack | Stack |\r\n" );
-        pxCIO->print( "|  ID  |           |                  | Base | Cur. |      | Alloc |  HWM  | Usage |\r\n" );
-        pxCIO->print( "+----------------------------------------------------------------------------------+\r\n" );
-        /* "| 1234 | AAAAAAAAA | AAAAAAAAAAAAAAAA |  00  |  00  | 000% | 00000 | 00000 | 000%  |" */
+            if( ulTotalRuntime == 0 )
+            {
+                ulTotalRuntime = 1;
+            }
 
-        for( uint32_t i = 0; i < uxNumTasks; i++ )
-        {
-            uint32_t ulStackSize = ulGetStackDepth( pxTaskStatusArray[ i ].xHandle );
-            uint32_t ucStackUsagePct = ( 100 * ( ulStackSize - pxTaskStatusArray[ i ].usStackHighWaterMark ) / ulStackSize );
-            snprintf( pcCliScratchBuffer, CLI_OUTPUT_SCRATCH_BUF_LEN,
-                      "| %4lu | %-9s | %-16s |  %2lu  |  %2lu  | %3lu%% | %5lu | %5lu | %3lu%%  |\r\n",
-                      pxTaskStatusArray[ i ].xTaskNumber,
-                      pceTaskStateToString( pxTaskStatusArray[ i ].eCurrentState ),
-                      pxTaskStatusArray[ i ].pcTaskName,
-                      pxTaskStatusArray[ i ].uxBasePriority,
-                      pxTaskStatusArray[ i ].uxCurrentPriority,
-                      pxTaskStatusArray[ i ].ulRunTimeCounter / ulTotalRuntime,
-                      ulStackSize,
-                      ( uint32_t ) pxTaskStatusArray[ i ].usStackHighWaterMark,
-                      ucStackUsagePct );
+            snprintf( pcCliScratchBuffer, CLI_OUTPUT_SCRATCH_BUF_LEN, "Total Runtime: %lu\r\n", ulTotalRuntime );
 
             pxCIO->print( pcCliScratchBuffer );
+
+            pxCIO->print( "+----------------------------------------------------------------------------------+\r\n" );
+            pxCIO->print( "| Task |   State   |    Task Name     |___Priority__| %CPU | Stack | Stack | Stack |\r\n" );
+            pxCIO->print( "|  ID  |           |                  | Base | Cur. |      | Alloc |  HWM  | Usage |\r\n" );
+            pxCIO->print( "+----------------------------------------------------------------------------------+\r\n" );
+            /* "| 1234 | AAAAAAAAA | AAAAAAAAAAAAAAAA |  00  |  00  | 000% | 00000 | 00000 | 000%  |" */
+
+            for( uint32_t i = 0; i < uxNumTasks; i++ )
+            {
+                uint32_t ulStackSize = ulTaskStatsStackDepth( pxTaskStatusArray[ i ].xHandle );
+                uint32_t ucStackUsagePct = ( 100 * ( ulStackSize - pxTaskStatusArray[ i ].usStackHighWaterMark ) / ulStackSize );
+                snprintf( pcCliScratchBuffer, CLI_OUTPUT_SCRATCH_BUF_LEN,
+                          "| %4lu | %-9s | %-16s |  %2lu  |  %2lu  | %3lu%% | %5lu | %5lu | %3lu%%  |\r\n",
+                          pxTaskStatusArray[ i ].xTaskNumber,
+                          pceTaskStateToString( pxTaskStatusArray[ i ].eCurrentState ),
+                          pxTaskStatusArray[ i ].pcTaskName,
+                          pxTaskStatusArray[ i ].uxBasePriority,
+                          pxTaskStatusArray[ i ].uxCurrentPriority,
+                          pxTaskStatusArray[ i ].ulRunTimeCounter / ulTotalRuntime,
+                          ulStackSize,
+                          ( uint32_t ) pxTaskStatusArray[ i ].usStackHighWaterMark,
+                          ucStackUsagePct );
+
+                pxCIO->print( pcCliScratchBuffer );
+            }
         }
 
         vPortFree( pxTaskStatusArray );
     }
 }
 
+static uint32_t prvTicksToUs( uint32_t ulTicks,
+                              uint32_t ulCounterHz )
+{
+    uint32_t ulUs = ulTicks;
+
+    if( ( ulCounterHz != 0 ) && ( ulCounterHz != 1000000U ) )
+    {
+        ulUs = ( uint32_t ) ( ( ( uint64_t ) ulTicks * 1000000U ) / ulCounterHz );
+    }
+
+    return ulUs;
+}
+
+static void prvTopCommand( ConsoleIO_t * const pxCIO,
+                           uint32_t ulArgc,
+                           char * ppcArgv[] )
+{
+    uint32_t ulIntervalMs = TOP_INTERVAL_DEFAULT_MS;
+    uint32_t ulCounterHz = ulTaskStatsCounterHz();
+    /* Leave room for tasks created during the interval */
+    UBaseType_t uxMaxTasks = uxTaskGetNumberOfTasks() + 4;
+    TaskStatus_t * pxBefore = NULL;
+    TaskStatus_t * pxAfter = NULL;
+
+    if( ulArgc > 1 )
+    {
+        ulIntervalMs = strtoul( ppcArgv[ 1 ], NULL, 10 );
+    }
+
+    if( ( ulIntervalMs < TOP_INTERVAL_MIN_MS ) || ( ulIntervalMs > TOP_INTERVAL_MAX_MS ) )
+    {
+        snprintf( pcCliScratchBuffer, CLI_OUTPUT_SCRATCH_BUF_LEN,
+                  "Error: interval_ms must be between %lu and %lu.\r\n",
+                  ( unsigned long ) TOP_INTERVAL_MIN_MS, ( unsigned long ) TOP_INTERVAL_MAX_MS );
+        pxCIO->print( pcCliScratchBuffer );
+    }
+    else
+    {
+        pxBefore = ( TaskStatus_t * ) pvPortMalloc( sizeof( TaskStatus_t ) * uxMaxTasks * 2 );
+
+        if( pxBefore == NULL )
+        {
+            pxCIO->print( "Error: Not enough memory to complete the operation" );
+        }
+        else
+        {
+            configRUN_TIME_COUNTER_TYPE xTotalBefore = 0;
+            configRUN_TIME_COUNTER_TYPE xTotalAfter = 0;
+            UBaseType_t uxNumBefore;
+            UBaseType_t uxNumAfter;
+            uint32_t ulTotalDelta;
+
+            pxAfter = &( pxBefore[ uxMaxTasks ] );
+
+            uxNumBefore = uxTaskGetSystemState( pxBefore, uxMaxTasks, &xTotalBefore );
+#if TASK_STATS_LATENCY_ENABLED == 1
+            vTaskStatsResetInterval();
+#endif
+            vTaskDelay( pdMS_TO_TICKS( ulIntervalMs ) );
+            uxNumAfter = uxTaskGetSystemState( pxAfter, uxMaxTasks, &xTotalAfter );
+
+            ulTotalDelta = ( uint32_t ) xTotalAfter - ( uint32_t ) xTotalBefore;
+
+            if( ulTotalDelta == 0 )
+            {
+                ulTotalDelta = 1;
+            }
+
+            snprintf( pcCliScratchBuffer, CLI_OUTPUT_SCRATCH_BUF_LEN,
+                      "Interval: %lu ms, %lu ticks at %lu Hz\r\n",
+                      ( unsigned long ) ulIntervalMs, ( unsigned long ) ulTotalDelta,
+                      ( unsigned long ) ulCounterHz );
+            pxCIO->print( pcCliScratchBuffer );
+
+            pxCIO->print( "+--------------------------------------------------------------------------------------+\r\n" );
+            pxCIO->print( "| Task |   State   |    Task Name     | Prio |  %CPU  | Run Time |  Max Latency (us)   |\r\n" );
+            pxCIO->print( "|  ID  |           |                  |      |        |   (us)   | Interval |  Total   |\r\n" );
+            pxCIO->print( "+--------------------------------------------------------------------------------------+\r\n" );
+
+            for( UBaseType_t i = 0; i < uxNumAfter; i++ )
+            {
+                uint32_t ulRunTime = ( uint32_t ) pxAfter[ i ].ulRunTimeCounter;
+                uint32_t ulPermille;
+                uint32_t ulMax = 0;
+                uint32_t ulIntervalMax = 0;
+
+                /* Tasks created during the interval started from 0 */
+                for( UBaseType_t j = 0; j < uxNumBefore; j++ )
+                {
+                    if( pxBefore[ j ].xTaskNumber == pxAfter[ i ].xTaskNumber )
+                    {
+                        ulRunTime -= ( uint32_t ) pxBefore[ j ].ulRunTimeCounter;
+                        break;
+                    }
+                }
+
+                ulPermille = ( uint32_t ) ( ( ( uint64_t ) ulRunTime * 1000U ) / ulTotalDelta );
+
+#if TASK_STATS_LATENCY_ENABLED == 1
+                vTaskStatsGetLatency( pxAfter[ i ].xTaskNumber, &ulMax, &ulIntervalMax );
+#endif
+
+                snprintf( pcCliScratchBuffer, CLI_OUTPUT_SCRATCH_BUF_LEN,
+                          "| %4lu | %-9s | %-16s |  %2lu  | %3lu.%lu%% | %8lu | %8lu | %8lu |\r\n",
+                          ( unsigned long ) pxAfter[ i ].xTaskNumber,
+                          pceTaskStateToString( pxAfter[ i ].eCurrentState ),
+                          pxAfter[ i ].pcTaskName,
+                          ( unsigned long ) pxAfter[ i ].uxCurrentPriority,
+                          ( unsigned long ) ( ulPermille / 10U ),
+                          ( unsigned long ) ( ulPermille % 10U ),
+                          ( unsigned long ) prvTicksToUs( ulRunTime, ulCounterHz ),
+                          ( unsigned long ) prvTicksToUs( ulIntervalMax, ulCounterHz ),
+                          ( unsigned long ) prvTicksToUs( ulMax, ulCounterHz ) );
+
+                pxCIO->print( pcCliScratchBuffer );
+            }
+
+            vPortFree( pxBefore );
+        }
+    }
+}
+
 typedef enum
 {
     SIGHUP = 1,
@@ -427,13 +648,14 @@ static void vKillAllCommand( ConsoleIO_t * const pxCIO,
 }
 
 
-/* only implemented for heap_4.c */
+/* only implemented for heap_4.c with the heap_classes.c front end */
 static void vHeapStatCommand( ConsoleIO_t * const pxCIO,
                               uint32_t ulArgc,
                               char * ppcArgv[] )
 {
     size_t xDivisor = 1;
     const char * cDivSymbol = NULL;
+    BaseType_t xShowTags = pdFALSE;
 
     for( uint32_t i = 1; i < ulArgc; i++ )
     {
@@ -463,6 +685,10 @@ static void vHeapStatCommand( ConsoleIO_t * const pxCIO,
                     {
                         xDivisor = 1;
                     }
+                    else if( strcmp( "--tags", ppcArgv[ i ] ) == 0 )
+                    {
+                        xShowTags = pdTRUE;
+                    }
                     else
                     {
                         pxCIO->print( "Error: Unrecognized argument: " );
@@ -486,6 +712,10 @@ static void vHeapStatCommand( ConsoleIO_t * const pxCIO,
                     xDivisor = 1;
                     break;
 
+                case 't':
+                    xShowTags = pdTRUE;
+                    break;
+
                 default:
                     pxCIO->print( "Error: Unrecognized argument: " );
                     pxCIO->print( ppcArgv[ i ] );
@@ -616,8 +846,127 @@ static void vHeapStatCommand( ConsoleIO_t * const pxCIO,
             xLen = CLI_OUTPUT_SCRATCH_BUF_LEN - 1;
         }
 
+        pxCIO->write( pcCliScratchBuffer, xLen );
+
+        HeapClassStats_t xClassStats = { 0 };
+
+        vHeapClassGetStats( &xClassStats );
+
+        /* Free blocks held by the size classes are counted as allocated by heap_4 */
+        xLen = snprintf( pcCliScratchBuffer, CLI_OUTPUT_SCRATCH_BUF_LEN, pcFormatString,
+                         "Class Cached", xClassStats.uxCachedBytes / xDivisor, xClassStats.uxCachedBytes,
+                         ( 100 * xClassStats.uxCachedBytes ) / xHeapSize );
+
+        if( xLen >= CLI_OUTPUT_SCRATCH_BUF_LEN )
+        {
+            xLen = CLI_OUTPUT_SCRATCH_BUF_LEN - 1;
+        }
+
+        pxCIO->write( pcCliScratchBuffer, xLen );
+
+        HeapFragStats_t xFragStats = { 0 };
+
+        vHeapGetFragStats( &xFragStats );
+
+        xLen = snprintf( pcCliScratchBuffer, CLI_OUTPUT_SCRATCH_BUF_LEN, pcFormatString,
+                         "Largest Free", xFragStats.uxLargestFreeBlock / xDivisor, xFragStats.uxLargestFreeBlock,
+                         ( 100 * xFragStats.uxLargestFreeBlock ) / xHeapSize );
+
+        if( xLen >= CLI_OUTPUT_SCRATCH_BUF_LEN )
+        {
+            xLen = CLI_OUTPUT_SCRATCH_BUF_LEN - 1;
+        }
+
+        pxCIO->write( pcCliScratchBuffer, xLen );
+
+        /* Fragmentation is the share of the free bytes outside the largest free block */
+        xLen = snprintf( pcCliScratchBuffer, CLI_OUTPUT_SCRATCH_BUF_LEN,
+                         "| Free blocks: %-6lu Fragmented: %3lu.%lu %%  Failed: %-5lu |\r\n",
+                         ( unsigned long ) xFragStats.uxFreeBlocks,
+                         ( unsigned long ) ( xFragStats.ulFragPermille / 10U ),
+                         ( unsigned long ) ( xFragStats.ulFragPermille % 10U ),
+                         ( unsigned long ) xFragStats.ulAllocFailures );
+
+        if( xLen >= CLI_OUTPUT_SCRATCH_BUF_LEN )
+        {
+            xLen = CLI_OUTPUT_SCRATCH_BUF_LEN - 1;
+        }
+
         pxCIO->write( pcCliScratchBuffer, xLen );
         pxCIO->print( "+--------------------------------------------------------+\r\n" );
+
+        pxCIO->print( "| Class (Bytes)    | Cached      | Hits        | Misses  |\r\n" );
+        pxCIO->print( "|------------------|-------------|-------------|---------|\r\n" );
+
+        for( uint32_t ulClass = 0; ulClass < HEAP_CLASS_COUNT; ulClass++ )
+        {
+            xLen = snprintf( pcCliScratchBuffer, CLI_OUTPUT_SCRATCH_BUF_LEN,
+                             "| %-16lu | %-11lu | %-11lu | %-7lu |\r\n",
+                             ( unsigned long ) xClassStats.uxBlockLen[ ulClass ],
+                             ( unsigned long ) xClassStats.uxCached[ ulClass ],
+                             ( unsigned long ) xClassStats.ulHits[ ulClass ],
+                             ( unsigned long ) xClassStats.ulMisses[ ulClass ] );
+
+            if( xLen >= CLI_OUTPUT_SCRATCH_BUF_LEN )
+            {
+                xLen = CLI_OUTPUT_SCRATCH_BUF_LEN - 1;
+            }
+
+            pxCIO->write( pcCliScratchBuffer, xLen );
+        }
+
+        xLen = snprintf( pcCliScratchBuffer, CLI_OUTPUT_SCRATCH_BUF_LEN,
+                         "| Flushes: %-45lu |\r\n", ( unsigned long ) xClassStats.ulFlushes );
+
+        if( xLen >= CLI_OUTPUT_SCRATCH_BUF_LEN )
+        {
+            xLen = CLI_OUTPUT_SCRATCH_BUF_LEN - 1;
+        }
+
+        pxCIO->write( pcCliScratchBuffer, xLen );
+        pxCIO->print( "+--------------------------------------------------------+\r\n" );
+
+        if( xShowTags == pdTRUE )
+        {
+            vHeapTagPrint( pxCIO );
+        }
+    }
+}
+
+/*-----------------------------------------------------------*/
+
+static void vHeapTagPrint( ConsoleIO_t * const pxCIO )
+{
+    HeapTagStats_t xTagStats = { 0 };
+
+    if( xHeapTagGetStats( &xTagStats ) == pdFALSE )
+    {
+        pxCIO->print( "Heap accounting is disabled, build with HEAP_ACCOUNTING 1.\r\n" );
+    }
+    else
+    {
+        pxCIO->print( "| Tag      | Current    | Peak       | Allocs     | Frees   |\r\n" );
+        pxCIO->print( "|----------|------------|------------|------------|---------|\r\n" );
+
+        for( uint32_t ulTag = 0; ulTag < HEAP_TAG_COUNT; ulTag++ )
+        {
+            size_t xLen = snprintf( pcCliScratchBuffer, CLI_OUTPUT_SCRATCH_BUF_LEN,
+                                    "| %-8s | %-10lu | %-10lu | %-10lu | %-7lu |\r\n",
+                                    pcHeapTagName( ( HeapTag_t ) ulTag ),
+                                    ( unsigned long ) xTagStats.uxCurrentBytes[ ulTag ],
+                                    ( unsigned long ) xTagStats.uxPeakBytes[ ulTag ],
+                                    ( unsigned long ) xTagStats.ulAllocs[ ulTag ],
+                                    ( unsigned long ) xTagStats.ulFrees[ ulTag ] );
+
+            if( xLen >= CLI_OUTPUT_SCRATCH_BUF_LEN )
+            {
+                xLen = CLI_OUTPUT_SCRATCH_BUF_LEN - 1;
+            }
+
+            pxCIO->write( pcCliScratchBuffer, xLen );
+        }
+
+        pxCIO->print( "+-----------------------------------------------------------+\r\n" );
     }
 }
 
@@ -626,6 +975,10 @@ static void vResetCommand( ConsoleIO_t * const pxCIO,
                            char * ppcArgv[] )
 {
     pxCIO->print( "Resetting device." );
+
+    /* Store committed configuration changes that are still waiting for a background flush */
+    ( void ) KVStore_xFlush();
+
     vTaskDelay( pdMS_TO_TICKS( 100 ) );
     NVIC_SystemReset();
 }
@@ -660,6 +1013,115 @@ static void vUptimeCommand( ConsoleIO_t * const pxCIO,
     {
         pxCIO->write( pcCliScratchBuffer, ( size_t ) lRslt );
     }
+
+#if LOW_POWER_ENABLED == 1
+    {
+        LowPowerStats_t xStats;
+
+        vLowPowerGetStats( &xStats );
+
+        lRslt = snprintf( pcCliScratchBuffer,
+                          CLI_OUTPUT_SCRATCH_BUF_LEN,
+                          "sleep: %lu ms in %lu sleeps, stop 2: %lu ms in %lu stops\r\n",
+                          ( unsigned long ) xStats.ulSleepMs, ( unsigned long ) xStats.ulSleepCount,
+                          ( unsigned long ) xStats.ulStopMs, ( unsigned long ) xStats.ulStopCount );
+
+        if( ( lRslt > 0 ) &&
+            ( lRslt < CLI_OUTPUT_SCRATCH_BUF_LEN ) )
+        {
+            pxCIO->write( pcCliScratchBuffer, ( size_t ) lRslt );
+        }
+    }
+#endif /* LOW_POWER_ENABLED == 1 */
+
+#if DVFS_ENABLED == 1
+    {
+        DvfsStats_t xDvfsStats;
+
+        vDvfsGetStats( &xDvfsStats );
+
+        lRslt = snprintf( pcCliScratchBuffer,
+                          CLI_OUTPUT_SCRATCH_BUF_LEN,
+                          "clock: %s, %lu ms at 160 MHz, %lu ms at 48 MHz, %lu transitions, requests 0x%02lx\r\n",
+                          ( xDvfsStats.xLevel == DVFS_LEVEL_HIGH ) ? "160 MHz" : "48 MHz",
+                          ( unsigned long ) xDvfsStats.ulHighMs, ( unsigned long ) xDvfsStats.ulLowMs,
+                          ( unsigned long ) xDvfsStats.ulTransitions, ( unsigned long ) xDvfsStats.ulRequests );
+
+        if( ( lRslt > 0 ) &&
+            ( lRslt < CLI_OUTPUT_SCRATCH_BUF_LEN ) )
+        {
+            pxCIO->write( pcCliScratchBuffer, ( size_t ) lRslt );
+        }
+    }
+#endif /* DVFS_ENABLED == 1 */
+}
+
+static void prvPrintBootTime( ConsoleIO_t * const pxCIO,
+                              uint32_t ulStageMs )
+{
+    int lRslt;
+
+    if( ulStageMs == BOOT_TIME_NONE )
+    {
+        lRslt = snprintf( pcCliScratchBuffer, CLI_OUTPUT_SCRATCH_BUF_LEN, " %10s", "-" );
+    }
+    else
+    {
+        lRslt = snprintf( pcCliScratchBuffer, CLI_OUTPUT_SCRATCH_BUF_LEN, " %10lu", ( unsigned long ) ulStageMs );
+    }
+
+    if( ( lRslt > 0 ) &&
+        ( lRslt < CLI_OUTPUT_SCRATCH_BUF_LEN ) )
+    {
+        pxCIO->write( pcCliScratchBuffer, ( size_t ) lRslt );
+    }
+}
+
+static void vBootTimeCommand( ConsoleIO_t * const pxCIO,
+                              uint32_t ulArgc,
+                              char * ppcArgv[] )
+{
+    const BootTimes_t * pxCurrent = pxBootTimesGet( pdFALSE );
+    const BootTimes_t * pxPrevious = pxBootTimesGet( pdTRUE );
+    int lRslt;
+
+    ( void ) ulArgc;
+    ( void ) ppcArgv;
+
+    lRslt = snprintf( pcCliScratchBuffer, CLI_OUTPUT_SCRATCH_BUF_LEN,
+                      "%-14s %10s %10s\r\n", "Stage", "This boot", "Previous" );
+
+    if( ( lRslt > 0 ) &&
+        ( lRslt < CLI_OUTPUT_SCRATCH_BUF_LEN ) )
+    {
+        pxCIO->write( pcCliScratchBuffer, ( size_t ) lRslt );
+    }
+
+    for( uint32_t i = 0; i < BOOT_STAGE_MAX; i++ )
+    {
+        lRslt = snprintf( pcCliScratchBuffer, CLI_OUTPUT_SCRATCH_BUF_LEN, "%-14s", pcBootStageName( ( BootStage_t ) i ) );
+
+        if( ( lRslt > 0 ) &&
+            ( lRslt < CLI_OUTPUT_SCRATCH_BUF_LEN ) )
+        {
+            pxCIO->write( pcCliScratchBuffer, ( size_t ) lRslt );
+        }
+
+        prvPrintBootTime( pxCIO, pxCurrent->ulStageMs[ i ] );
+        prvPrintBootTime( pxCIO, ( pxPrevious != NULL ) ? pxPrevious->ulStageMs[ i ] : BOOT_TIME_NONE );
+        pxCIO->print( "\r\n" );
+    }
+
+    lRslt = snprintf( pcCliScratchBuffer, CLI_OUTPUT_SCRATCH_BUF_LEN,
+                      "Boot %lu since power on, reset flags: 0x%08lx\r\n",
+                      ( unsigned long ) pxCurrent->ulBootCount,
+                      ( unsigned long ) pxCurrent->ulResetSource );
+
+    if( ( lRslt > 0 ) &&
+        ( lRslt < CLI_OUTPUT_SCRATCH_BUF_LEN ) )
+    {
+        pxCIO->write( pcCliScratchBuffer, ( size_t ) lRslt );
+    }
 }
 
 static void vAssertCommand( ConsoleIO_t * const pxCIO,
@@ -41,18 +41,123 @@
 #include "logging.h"
 #include "hw_defs.h"
 
+#if defined( LOGGING_OUTPUT_FLASH )
+#include "fs/log_store.h"
+#endif
+
 /*-----------------------------------------------------------*/
 /* todo take into account maximum cli line length */
 #if ( CLI_UART_TX_STREAM_LEN < dlMAX_LOG_LINE_LENGTH )
 #error "CLI_UART_TX_STREAM_LEN must be >= dlMAX_LOG_LINE_LENGTH"
 #endif
 
+/* Format log lines in a low priority task instead of in the calling task or ISR */
+#ifndef LOGGING_DEFERRED
+#define LOGGING_DEFERRED    0
+#endif
+
+#if LOGGING_DEFERRED
+
+/* Bytes of records queued for the logging task, must be a power of two */
+#ifndef LOGGING_DEFERRED_RING_LEN
+#define LOGGING_DEFERRED_RING_LEN    4096U
+#endif
+
+/* Largest record, including the copies of string arguments */
+#ifndef LOGGING_DEFERRED_RECORD_MAX
+#define LOGGING_DEFERRED_RECORD_MAX    512U
+#endif
+
+/* Longest string argument copied into a record, including the terminator */
+#ifndef LOGGING_DEFERRED_STR_MAX
+#define LOGGING_DEFERRED_STR_MAX    128U
+#endif
+
+#ifndef LOGGING_TASK_PRIORITY
+#define LOGGING_TASK_PRIORITY    ( tskIDLE_PRIORITY + 1 )
+#endif
+
+#ifndef LOGGING_TASK_STACK_DEPTH
+#define LOGGING_TASK_STACK_DEPTH    ( configMINIMAL_STACK_SIZE )
+#endif
+
+#if ( ( LOGGING_DEFERRED_RING_LEN & ( LOGGING_DEFERRED_RING_LEN - 1 ) ) != 0 ) || ( LOGGING_DEFERRED_RING_LEN > 32768U )
+#error "LOGGING_DEFERRED_RING_LEN must be a power of two no larger than 32768"
+#endif
+
+#if ( LOGGING_DEFERRED_RECORD_MAX > LOGGING_DEFERRED_RING_LEN )
+#error "LOGGING_DEFERRED_RECORD_MAX must be <= LOGGING_DEFERRED_RING_LEN"
+#endif
+
+static BaseType_t prvFormatNextRecord( char * pcBuffer,
+                                       uint32_t * pulLen,
+                                       BaseType_t xSkipReserved );
+static void prvLoggingTask( void * pvParameters );
+
+static TaskHandle_t xLogTask = NULL;
+#endif /* LOGGING_DEFERRED */
+
 volatile StreamBufferHandle_t xLogMBuf = NULL;
 
 UART_HandleTypeDef * pxEarlyUart = NULL;
 
 static char pcPrintBuff[ dlMAX_LOG_LINE_LENGTH ];
 
+#if defined( LOGGING_OUTPUT_UART )
+
+/* Bytes of log lines kept from before the scheduler starts until the uart transmit task sends them */
+#ifndef LOGGING_EARLY_BUFFER_LEN
+#define LOGGING_EARLY_BUFFER_LEN    1024U
+#endif
+
+/* Lines as a 16 bit length followed by the text, without line ending */
+static uint8_t ucEarlyBuffer[ LOGGING_EARLY_BUFFER_LEN ];
+static size_t uxEarlyHead = 0;
+static size_t uxEarlyTail = 0;
+static uint32_t ulEarlyDropped = 0;
+
+#endif /* defined( LOGGING_OUTPUT_UART ) */
+
+static void prvSendLogMessageDirect( const char * buffer,
+                                     unsigned int count );
+
+/* Runtime level of every module before lLoggingSetLevels is called */
+#ifndef LOG_LEVEL_RUNTIME_DFLT
+#define LOG_LEVEL_RUNTIME_DFLT    LOG_DEBUG
+#endif
+
+volatile uint8_t ucLogModuleLevel[ LOG_MODULE_MAX ] =
+{
+    [ 0 ... ( LOG_MODULE_MAX - 1 ) ] = LOG_LEVEL_RUNTIME_DFLT
+};
+
+/* Indexed by LogModule_t */
+static const char * const pcLogModuleNames[ LOG_MODULE_MAX ] =
+{
+    "app",
+    "sys",
+    "net",
+    "tls",
+    "mqtt",
+    "http",
+    "ota",
+    "fs",
+    "kvstore",
+    "pkcs11",
+    "sensor",
+    "shadow",
+    "defender",
+};
+
+static const char * const pcLogLevelNames[] =
+{
+    "none",
+    "error",
+    "warn",
+    "info",
+    "debug",
+};
+
 /* Should only be called during an assert with the scheduler suspended. */
 void vDyingGasp( void )
 {
@@ -63,6 +168,19 @@ void vDyingGasp( void )
 
     pxEarlyUart = vInitUartEarly();
 
+#if defined( LOGGING_OUTPUT_UART )
+    /* Lines from before the scheduler started that were not sent yet are the oldest */
+    {
+        size_t uxLen;
+
+        while( ( uxLen = uxLoggingEarlyRead( pcPrintBuff, dlMAX_PRINT_STRING_LENGTH ) ) > 0 )
+        {
+            ( void ) HAL_UART_Transmit( pxEarlyUart, ( uint8_t * ) pcPrintBuff, uxLen, 10 * 1000 );
+            ( void ) HAL_UART_Transmit( pxEarlyUart, ( uint8_t * ) "\r\n", 2, 10 * 1000 );
+        }
+    }
+#endif /* defined( LOGGING_OUTPUT_UART ) */
+
     do
     {
         xNumBytes = xMessageBufferReceiveFromISR( xLogMBuf, pcPrintBuff, dlMAX_PRINT_STRING_LENGTH, 0 );
@@ -74,45 +192,193 @@ void vDyingGasp( void )
     }
     while( xNumBytes != 0 );
 
+#if LOGGING_DEFERRED
+    uint32_t ulLen = 0;
+
+    /* Records still queued are newer than the formatted lines sent above */
+    while( prvFormatNextRecord( pcPrintBuff, &ulLen, pdTRUE ) == pdTRUE )
+    {
+        prvSendLogMessageDirect( pcPrintBuff, ulLen );
+        ( void ) HAL_UART_Transmit( pxEarlyUart, ( uint8_t * ) pcPrintBuff, ulLen, 10 * 1000 );
+        ( void ) HAL_UART_Transmit( pxEarlyUart, ( uint8_t * ) "\r\n", 2, 10 * 1000 );
+
+        vPetWatchdog();
+    }
+#endif /* LOGGING_DEFERRED */
+
+#if defined( LOGGING_OUTPUT_FLASH )
+    /* Kept in RAM and programmed on the next boot */
+    vLogStoreDyingGasp();
+#endif
+
     HAL_GPIO_WritePin( LED_RED_GPIO_Port, LED_GREEN_Pin, GPIO_PIN_SET );
     HAL_GPIO_WritePin( LED_RED_GPIO_Port, LED_RED_Pin, GPIO_PIN_RESET );
 }
 
+#if defined( LOGGING_OUTPUT_ITM )
+
+/*
+ * Write a line to ITM stimulus port 0, four bytes per write where possible.
+ * Nothing is sent unless the debugger has enabled the ITM and the port.
+ */
+static void prvItmWriteLine( const char * pcLine,
+                             size_t uxLen )
+{
+    if( ( ( ITM->TCR & ITM_TCR_ITMENA_Msk ) != 0UL ) &&
+        ( ( ITM->TER & 1UL ) != 0UL ) )
+    {
+        UBaseType_t uxSavedInterruptStatus = taskENTER_CRITICAL_FROM_ISR();
+        size_t uxIdx = 0;
+
+        while( ( uxLen - uxIdx ) >= sizeof( uint32_t ) )
+        {
+            uint32_t ulWord = 0;
+
+            ( void ) memcpy( &ulWord, &( pcLine[ uxIdx ] ), sizeof( uint32_t ) );
+
+            /* Wait for space in the stimulus port FIFO */
+            while( ITM->PORT[ 0U ].u32 == 0UL )
+            {
+                __NOP();
+            }
+
+            ITM->PORT[ 0U ].u32 = ulWord;
+            uxIdx += sizeof( uint32_t );
+        }
+
+        for( ; uxIdx < uxLen; uxIdx++ )
+        {
+            ( void ) ITM_SendChar( ( uint32_t ) pcLine[ uxIdx ] );
+        }
+
+        ( void ) ITM_SendChar( '\r' );
+        ( void ) ITM_SendChar( '\n' );
+
+        taskEXIT_CRITICAL_FROM_ISR( uxSavedInterruptStatus );
+    }
+}
+
+#endif /* defined( LOGGING_OUTPUT_ITM ) */
+
+/* Write a line to the outputs that do not go through the uart transmit task, from any context */
+static void prvSendLogMessageDirect( const char * buffer,
+                                     unsigned int count )
+{
+#if defined( LOGGING_OUTPUT_ITM )
+    prvItmWriteLine( buffer, count );
+#endif
+
+#if defined( LOGGING_OUTPUT_RTT )
+    vLoggingRttWriteLine( buffer, count );
+#endif
+
+#if defined( LOGGING_OUTPUT_FLASH )
+    vLogStoreWriteLine( buffer, count );
+#endif
+
+    ( void ) buffer;
+    ( void ) count;
+}
+
+#if defined( LOGGING_OUTPUT_UART )
+
 /*
- * Blocking write function for early printing
+ * Queue a line logged before the scheduler starts, to be sent by the uart
+ * transmit task instead of blocking boot for the transmit time.
  * PRE: must be called when scheduler is not running.
  */
 static void vSendLogMessageEarly( const char * buffer,
                                   unsigned int count )
 {
+    UBaseType_t uxSavedInterruptStatus;
+
     configASSERT( xTaskGetSchedulerState() != taskSCHEDULER_RUNNING );
 
-#ifdef LOGGING_OUTPUT_ITM
-    uint32_t i = 0;
+    if( count > UINT16_MAX )
+    {
+        count = UINT16_MAX;
+    }
+
+    uxSavedInterruptStatus = taskENTER_CRITICAL_FROM_ISR();
 
-    for( unsigned int i = 0; i < len; i++ )
+    if( ( uxEarlyHead + sizeof( uint16_t ) + count ) <= LOGGING_EARLY_BUFFER_LEN )
     {
-        ( void ) ITM_SendChar( lineOutBuf[ i ] );
+        uint16_t usLen = ( uint16_t ) count;
+
+        ( void ) memcpy( &( ucEarlyBuffer[ uxEarlyHead ] ), &usLen, sizeof( uint16_t ) );
+        ( void ) memcpy( &( ucEarlyBuffer[ uxEarlyHead + sizeof( uint16_t ) ] ), buffer, count );
+        uxEarlyHead += sizeof( uint16_t ) + count;
     }
-#endif
+    else
+    {
+        ulEarlyDropped++;
+    }
+
+    taskEXIT_CRITICAL_FROM_ISR( uxSavedInterruptStatus );
+}
 
+/*-----------------------------------------------------------*/
 
-#ifdef LOGGING_OUTPUT_UART
-    /* blocking write to UART */
-    ( void ) HAL_UART_Transmit( pxEarlyUart, ( uint8_t * ) buffer, count, 100000 );
-    ( void ) HAL_UART_Transmit( pxEarlyUart, ( uint8_t * ) "\r\n", 2, 100000 );
-#endif
+size_t uxLoggingEarlyRead( char * pcBuffer,
+                           size_t uxBufferLen )
+{
+    size_t uxLen = 0;
+    UBaseType_t uxSavedInterruptStatus;
+
+    configASSERT( pcBuffer != NULL );
+    configASSERT( uxBufferLen > 0 );
+
+    uxSavedInterruptStatus = taskENTER_CRITICAL_FROM_ISR();
+
+    if( uxEarlyTail < uxEarlyHead )
+    {
+        uint16_t usLen;
+
+        ( void ) memcpy( &usLen, &( ucEarlyBuffer[ uxEarlyTail ] ), sizeof( uint16_t ) );
+        uxLen = ( usLen < uxBufferLen ) ? usLen : uxBufferLen;
+        ( void ) memcpy( pcBuffer, &( ucEarlyBuffer[ uxEarlyTail + sizeof( uint16_t ) ] ), uxLen );
+        uxEarlyTail += sizeof( uint16_t ) + usLen;
+    }
+    else if( ulEarlyDropped > 0 )
+    {
+        int lLen = snprintf( pcBuffer, uxBufferLen, "<WRN> %lu early log lines dropped, see LOGGING_EARLY_BUFFER_LEN",
+                             ( unsigned long ) ulEarlyDropped );
+
+        uxLen = ( lLen > 0 ) ? ( size_t ) lLen : 0;
+        uxLen = ( uxLen < uxBufferLen ) ? uxLen : ( uxBufferLen - 1 );
+        ulEarlyDropped = 0;
+    }
+    else
+    {
+        /* Nothing left, the buffer is not reused once the scheduler runs */
+    }
+
+    taskEXIT_CRITICAL_FROM_ISR( uxSavedInterruptStatus );
+
+    return uxLen;
 }
 
+#endif /* defined( LOGGING_OUTPUT_UART ) */
+
 void vInitLoggingEarly( void )
 {
+#if defined( LOGGING_OUTPUT_RTT )
+    vLoggingRttInit();
+#endif
+
     pxEarlyUart = vInitUartEarly();
-    vSendLogMessageEarly( "\r\n", 2 );
+
+#if defined( LOGGING_OUTPUT_UART )
+    vSendLogMessageEarly( "", 0 );
+#endif
 }
 
 static void vSendLogMessage( const char * buffer,
                              unsigned int count )
 {
+    prvSendLogMessageDirect( buffer, count );
+
+#if defined( LOGGING_OUTPUT_UART )
     if( xTaskGetSchedulerState() == taskSCHEDULER_NOT_STARTED )
     {
         vSendLogMessageEarly( buffer, count );
@@ -164,50 +430,39 @@ static void vSendLogMessage( const char * buffer,
             }
         }
     }
+#endif /* defined( LOGGING_OUTPUT_UART ) */
 }
 
 void vLoggingInit( void )
 {
     xLogMBuf = xMessageBufferCreate( dlLOGGING_STREAM_LENGTH );
+
+#if LOGGING_DEFERRED
+    if( xTaskCreate( prvLoggingTask, "Logging", LOGGING_TASK_STACK_DEPTH, NULL, LOGGING_TASK_PRIORITY, &xLogTask ) != pdPASS )
+    {
+        /* Log lines are formatted by the calling task instead */
+        xLogTask = NULL;
+    }
+#endif /* LOGGING_DEFERRED */
 }
 
 /*-----------------------------------------------------------*/
 
-void vLoggingPrintf( const char * const pcLogLevel,
-                     const char * const pcFileName,
-                     const unsigned long ulLineNumber,
-                     const char * const pcFormat,
-                     ... )
+/* Format the level, timestamp and task name at the start of a log line */
+static uint32_t prvFormatPrefix( char * pcBuffer,
+                                 const char * pcLogLevel,
+                                 uint32_t ulTicks,
+                                 const char * pcTaskName )
 {
     uint32_t ulLenTotal = 0;
     int32_t lLenPart = -1;
-    va_list args;
-    const char * pcTaskName = NULL;
-    BaseType_t xSchedulerWasSuspended = pdFALSE;
-
-    /* Additional info to place at the start of the log line */
-    if( xTaskGetSchedulerState() != taskSCHEDULER_NOT_STARTED )
-    {
-        pcTaskName = pcTaskGetName( NULL );
-    }
-    else
-    {
-        pcTaskName = "None";
-    }
-
-    if( xTaskGetSchedulerState() == taskSCHEDULER_RUNNING )
-    {
-        xSchedulerWasSuspended = pdTRUE;
-        /* Suspend the scheduler to access pcPrintBuff */
-        vTaskSuspendAll();
-    }
 
-    pcPrintBuff[ 0 ] = '\0';
-    lLenPart = snprintf( pcPrintBuff,
+    pcBuffer[ 0 ] = '\0';
+    lLenPart = snprintf( pcBuffer,
                          dlMAX_PRINT_STRING_LENGTH,
                          "<%-3.3s> %8lu [%-10.10s] ",
                          pcLogLevel,
-                         ( ( unsigned long ) xTaskGetTickCount() / portTICK_PERIOD_MS ) & 0xFFFFFF,
+                         ( ( unsigned long ) ulTicks / portTICK_PERIOD_MS ) & 0xFFFFFF,
                          pcTaskName );
 
     configASSERT( lLenPart > 0 );
@@ -221,35 +476,24 @@ void vLoggingPrintf( const char * const pcLogLevel,
         ulLenTotal = dlMAX_PRINT_STRING_LENGTH;
     }
 
-    if( ulLenTotal < dlMAX_PRINT_STRING_LENGTH )
-    {
-        /* There are a variable number of parameters. */
-        va_start( args, pcFormat );
-        lLenPart = vsnprintf( &pcPrintBuff[ ulLenTotal ],
-                              ( dlMAX_PRINT_STRING_LENGTH - ulLenTotal ),
-                              pcFormat,
-                              args );
-        va_end( args );
-
-        configASSERT( lLenPart > 0 );
+    return ulLenTotal;
+}
 
-        if( lLenPart + ulLenTotal < dlMAX_PRINT_STRING_LENGTH )
-        {
-            ulLenTotal += lLenPart;
-        }
-        else
-        {
-            ulLenTotal = dlMAX_PRINT_STRING_LENGTH;
-        }
-    }
+/* Strip the line ending of the message and append the file name and line number */
+static uint32_t prvFormatTrailer( char * pcBuffer,
+                                  uint32_t ulLenTotal,
+                                  const char * const pcFileName,
+                                  const unsigned long ulLineNumber )
+{
+    int32_t lLenPart = -1;
 
     /* remove any \r\n\0 characters at the end of the message */
     while( ulLenTotal > 0 &&
-           ( pcPrintBuff[ ulLenTotal - 1 ] == '\r' ||
-             pcPrintBuff[ ulLenTotal - 1 ] == '\n' ||
-             pcPrintBuff[ ulLenTotal - 1 ] == '\0' ) )
+           ( pcBuffer[ ulLenTotal - 1 ] == '\r' ||
+             pcBuffer[ ulLenTotal - 1 ] == '\n' ||
+             pcBuffer[ ulLenTotal - 1 ] == '\0' ) )
     {
-        pcPrintBuff[ ulLenTotal - 1 ] = '\0';
+        pcBuffer[ ulLenTotal - 1 ] = '\0';
         ulLenTotal--;
     }
 
@@ -258,7 +502,7 @@ void vLoggingPrintf( const char * const pcLogLevel,
         ( ulLenTotal < dlMAX_LOG_LINE_LENGTH ) )
     {
         /* Add the trailer including file name and line number */
-        lLenPart = snprintf( &pcPrintBuff[ ulLenTotal ],
+        lLenPart = snprintf( &pcBuffer[ ulLenTotal ],
                              ( dlMAX_LOG_LINE_LENGTH - ulLenTotal ),
                              " (%s:%lu)",
                              pcFileName,
@@ -276,12 +520,881 @@ void vLoggingPrintf( const char * const pcLogLevel,
         }
     }
 
-    vSendLogMessage( ( void * ) pcPrintBuff, ulLenTotal );
+    return ulLenTotal;
+}
 
-    if( xSchedulerWasSuspended == pdTRUE )
+/*-----------------------------------------------------------*/
+
+#if LOGGING_DEFERRED
+
+/*
+ * Deferred logging
+ *
+ * Callers only pack the format string pointer, the timestamp, the task name and
+ * the raw arguments of a log line into a record in ucLogRing. Space is reserved
+ * in a short critical section, the record is then filled without any lock and
+ * marked as committed. The logging task formats committed records in order.
+ *
+ * Arguments are stored at their natural size, rounded up to 4 bytes. Strings
+ * are copied into the record, up to LOGGING_DEFERRED_STR_MAX bytes, since the
+ * buffer they point to may be gone by the time the record is formatted.
+ */
+
+#define LOG_RECORD_RESERVED     0U
+#define LOG_RECORD_COMMITTED    1U
+#define LOG_RECORD_PADDING      2U
+
+#define LOG_RECORD_NAME_LEN     12U
+#define LOG_RECORD_ALIGN        ( sizeof( void * ) )
+#define LOG_ALIGN( x, a )       ( ( ( x ) + ( a ) - 1U ) & ~( ( a ) - 1U ) )
+
+typedef struct LogRecord
+{
+    uint16_t usLen;          /* Ring bytes used by the record, including this header */
+    volatile uint8_t ucState;
+    uint8_t ucReserved;
+    uint32_t ulTicks;
+    const char * pcLogLevel;
+    const char * pcFileName;
+    uint32_t ulLineNumber;
+    const char * pcFormat;
+    char cTaskName[ LOG_RECORD_NAME_LEN ];
+    /* Packed arguments follow */
+} LogRecord_t;
+
+typedef enum
+{
+    LOG_ARG_NONE,
+    LOG_ARG_INT,
+    LOG_ARG_LONG,
+    LOG_ARG_LONG_LONG,
+    LOG_ARG_SIZE,
+    LOG_ARG_DOUBLE,
+    LOG_ARG_PTR,
+    LOG_ARG_STR,
+} LogArgType_t;
+
+typedef struct LogSpec
+{
+    size_t uxLen;             /* Length of the conversion specification, including the '%' */
+    BaseType_t xStarWidth;    /* Width given as an int argument */
+    BaseType_t xStarPrecision; /* Precision given as an int argument */
+    BaseType_t xIsStore;      /* %n, whose argument is consumed but not printed */
+    LogArgType_t xType;
+} LogSpec_t;
+
+static uint8_t ucLogRing[ LOGGING_DEFERRED_RING_LEN ] __attribute__( ( aligned( 8 ) ) );
+
+/* Free running byte counters, only ulLogHead is written by producers */
+static volatile uint32_t ulLogHead = 0;
+static volatile uint32_t ulLogTail = 0;
+
+static volatile uint32_t ulLogDropped = 0;
+static uint32_t ulLogDroppedReported = 0;
+
+/*-----------------------------------------------------------*/
+
+static void prvParseSpec( const char * pcSpec,
+                          LogSpec_t * pxSpec )
+{
+    size_t uxIdx = 1;
+    size_t uxLongs = 0;
+    BaseType_t xIsSize = pdFALSE;
+
+    pxSpec->xStarWidth = pdFALSE;
+    pxSpec->xStarPrecision = pdFALSE;
+    pxSpec->xIsStore = pdFALSE;
+    pxSpec->xType = LOG_ARG_NONE;
+
+    while( ( pcSpec[ uxIdx ] != '\0' ) && ( strchr( "-+ #0", pcSpec[ uxIdx ] ) != NULL ) )
     {
-        xTaskResumeAll();
+        uxIdx++;
+    }
+
+    if( pcSpec[ uxIdx ] == '*' )
+    {
+        pxSpec->xStarWidth = pdTRUE;
+        uxIdx++;
+    }
+
+    while( isdigit( ( int ) pcSpec[ uxIdx ] ) )
+    {
+        uxIdx++;
+    }
+
+    if( pcSpec[ uxIdx ] == '.' )
+    {
+        uxIdx++;
+
+        if( pcSpec[ uxIdx ] == '*' )
+        {
+            pxSpec->xStarPrecision = pdTRUE;
+            uxIdx++;
+        }
+
+        while( isdigit( ( int ) pcSpec[ uxIdx ] ) )
+        {
+            uxIdx++;
+        }
+    }
+
+    while( ( pcSpec[ uxIdx ] != '\0' ) && ( strchr( "hlLqjzt", pcSpec[ uxIdx ] ) != NULL ) )
+    {
+        if( ( pcSpec[ uxIdx ] == 'l' ) || ( pcSpec[ uxIdx ] == 'q' ) || ( pcSpec[ uxIdx ] == 'j' ) )
+        {
+            uxLongs += ( pcSpec[ uxIdx ] == 'l' ) ? 1 : 2;
+        }
+        else if( ( pcSpec[ uxIdx ] == 'z' ) || ( pcSpec[ uxIdx ] == 't' ) )
+        {
+            xIsSize = pdTRUE;
+        }
+
+        uxIdx++;
+    }
+
+    switch( pcSpec[ uxIdx ] )
+    {
+        case 'd':
+        case 'i':
+        case 'u':
+        case 'o':
+        case 'x':
+        case 'X':
+        case 'c':
+
+            if( uxLongs >= 2 )
+            {
+                pxSpec->xType = LOG_ARG_LONG_LONG;
+            }
+            else if( uxLongs == 1 )
+            {
+                pxSpec->xType = LOG_ARG_LONG;
+            }
+            else if( xIsSize == pdTRUE )
+            {
+                pxSpec->xType = LOG_ARG_SIZE;
+            }
+            else
+            {
+                pxSpec->xType = LOG_ARG_INT;
+            }
+
+            break;
+
+        case 'f':
+        case 'F':
+        case 'e':
+        case 'E':
+        case 'g':
+        case 'G':
+        case 'a':
+        case 'A':
+            pxSpec->xType = LOG_ARG_DOUBLE;
+            break;
+
+        case 'n':
+            pxSpec->xIsStore = pdTRUE;
+            pxSpec->xType = LOG_ARG_PTR;
+            break;
+
+        case 'p':
+            pxSpec->xType = LOG_ARG_PTR;
+            break;
+
+        case 's':
+            pxSpec->xType = LOG_ARG_STR;
+            break;
+
+        default:
+            break;
     }
+
+    /* Stop at the terminator of a truncated specification */
+    pxSpec->uxLen = ( pcSpec[ uxIdx ] == '\0' ) ? uxIdx : uxIdx + 1;
+}
+
+/*-----------------------------------------------------------*/
+
+/*
+ * Copy the arguments of pcFormat to pucArgs, or only return the length they need
+ * if pucArgs is NULL. At most uxArgsLen bytes are written.
+ */
+static size_t prvPackArgs( uint8_t * pucArgs,
+                           size_t uxArgsLen,
+                           const char * pcFormat,
+                           va_list args )
+{
+    size_t uxOffset = 0;
+    LogSpec_t xSpec;
+
+    while( ( pcFormat = strchr( pcFormat, '%' ) ) != NULL )
+    {
+        union
+        {
+            int lInt;
+            long lLong;
+            long long llLongLong;
+            size_t uxSize;
+            double dDouble;
+            void * pvPtr;
+        } xValue;
+        size_t uxValueLen = 0;
+        int lStar;
+
+        prvParseSpec( pcFormat, &xSpec );
+        pcFormat += xSpec.uxLen;
+
+        for( uint32_t ulStars = ( xSpec.xStarWidth ? 1 : 0 ) + ( xSpec.xStarPrecision ? 1 : 0 ); ulStars > 0; ulStars-- )
+        {
+            lStar = va_arg( args, int );
+
+            if( ( pucArgs != NULL ) && ( uxOffset + sizeof( int ) <= uxArgsLen ) )
+            {
+                ( void ) memcpy( &pucArgs[ uxOffset ], &lStar, sizeof( int ) );
+            }
+
+            uxOffset += LOG_ALIGN( sizeof( int ), 4U );
+        }
+
+        switch( xSpec.xType )
+        {
+            case LOG_ARG_INT:
+                xValue.lInt = va_arg( args, int );
+                uxValueLen = sizeof( int );
+                break;
+
+            case LOG_ARG_LONG:
+                xValue.lLong = va_arg( args, long );
+                uxValueLen = sizeof( long );
+                break;
+
+            case LOG_ARG_LONG_LONG:
+                xValue.llLongLong = va_arg( args, long long );
+                uxValueLen = sizeof( long long );
+                break;
+
+            case LOG_ARG_SIZE:
+                xValue.uxSize = va_arg( args, size_t );
+                uxValueLen = sizeof( size_t );
+                break;
+
+            case LOG_ARG_DOUBLE:
+                xValue.dDouble = va_arg( args, double );
+                uxValueLen = sizeof( double );
+                break;
+
+            case LOG_ARG_PTR:
+                xValue.pvPtr = va_arg( args, void * );
+                uxValueLen = sizeof( void * );
+                break;
+
+            case LOG_ARG_STR:
+               {
+                   const char * pcStr = va_arg( args, const char * );
+                   size_t uxStrLen;
+
+                   if( pcStr == NULL )
+                   {
+                       pcStr = "(null)";
+                   }
+
+                   uxStrLen = strnlen( pcStr, LOGGING_DEFERRED_STR_MAX - 1 );
+
+                   /* The string may have grown since the length was computed */
+                   if( ( pucArgs != NULL ) && ( uxOffset + uxStrLen + 1 > uxArgsLen ) )
+                   {
+                       uxStrLen = ( uxArgsLen > uxOffset ) ? uxArgsLen - uxOffset - 1 : 0;
+                   }
+
+                   if( ( pucArgs != NULL ) && ( uxOffset < uxArgsLen ) )
+                   {
+                       ( void ) memcpy( &pucArgs[ uxOffset ], pcStr, uxStrLen );
+                       pucArgs[ uxOffset + uxStrLen ] = '\0';
+                   }
+
+                   uxOffset += LOG_ALIGN( uxStrLen + 1, 4U );
+                   break;
+               }
+
+            case LOG_ARG_NONE:
+            default:
+                break;
+        }
+
+        if( uxValueLen > 0 )
+        {
+            if( ( pucArgs != NULL ) && ( uxOffset + uxValueLen <= uxArgsLen ) )
+            {
+                ( void ) memcpy( &pucArgs[ uxOffset ], &xValue, uxValueLen );
+            }
+
+            uxOffset += LOG_ALIGN( uxValueLen, 4U );
+        }
+    }
+
+    return uxOffset;
+}
+
+/*-----------------------------------------------------------*/
+
+/*
+ * Format a record the same way as prvLogImmediate.
+ * Conversions are expanded one at a time by snprintf from the packed arguments.
+ */
+static uint32_t prvFormatRecord( const LogRecord_t * pxRecord,
+                                 char * pcBuffer )
+{
+    const uint8_t * pucArgs = ( const uint8_t * ) &pxRecord[ 1 ];
+    const size_t uxArgsLen = pxRecord->usLen - sizeof( LogRecord_t );
+    const char * pcFormat = pxRecord->pcFormat;
+    size_t uxOffset = 0;
+    uint32_t ulLenTotal = 0;
+    LogSpec_t xSpec;
+
+    ulLenTotal = prvFormatPrefix( pcBuffer, pxRecord->pcLogLevel, pxRecord->ulTicks, pxRecord->cTaskName );
+
+    while( ( *pcFormat != '\0' ) && ( ulLenTotal < ( dlMAX_PRINT_STRING_LENGTH - 1 ) ) )
+    {
+        char cSpec[ 32 ];
+        size_t uxSpecLen = 0;
+        int32_t lLenPart = 0;
+        size_t uxRemaining = ( dlMAX_PRINT_STRING_LENGTH ) - ulLenTotal;
+
+        if( ( *pcFormat != '%' ) || ( pcFormat[ 1 ] == '%' ) )
+        {
+            pcBuffer[ ulLenTotal++ ] = *pcFormat;
+            pcFormat += ( *pcFormat == '%' ) ? 2 : 1;
+            continue;
+        }
+
+        prvParseSpec( pcFormat, &xSpec );
+
+        /* Rebuild the specification with any '*' replaced by its argument */
+        for( size_t uxIdx = 0; ( uxIdx < xSpec.uxLen ) && ( uxSpecLen < ( sizeof( cSpec ) - 12 ) ); uxIdx++ )
+        {
+            if( pcFormat[ uxIdx ] == '*' )
+            {
+                int lStar = 0;
+
+                if( uxOffset + sizeof( int ) <= uxArgsLen )
+                {
+                    ( void ) memcpy( &lStar, &pucArgs[ uxOffset ], sizeof( int ) );
+                }
+
+                uxOffset += LOG_ALIGN( sizeof( int ), 4U );
+                uxSpecLen += snprintf( &cSpec[ uxSpecLen ], sizeof( cSpec ) - uxSpecLen, "%d", lStar );
+            }
+            else
+            {
+                cSpec[ uxSpecLen++ ] = pcFormat[ uxIdx ];
+            }
+        }
+
+        cSpec[ uxSpecLen ] = '\0';
+        pcFormat += xSpec.uxLen;
+
+        if( xSpec.xType == LOG_ARG_STR )
+        {
+            const char * pcStr = ( uxOffset < uxArgsLen ) ? ( const char * ) &pucArgs[ uxOffset ] : "";
+
+            lLenPart = snprintf( &pcBuffer[ ulLenTotal ], uxRemaining, cSpec, pcStr );
+            uxOffset += LOG_ALIGN( strlen( pcStr ) + 1, 4U );
+        }
+        else if( xSpec.xType != LOG_ARG_NONE )
+        {
+            union
+            {
+                int lInt;
+                long lLong;
+                long long llLongLong;
+                size_t uxSize;
+                double dDouble;
+                void * pvPtr;
+            } xValue = { 0 };
+            size_t uxValueLen = sizeof( int );
+
+            switch( xSpec.xType )
+            {
+                case LOG_ARG_LONG:
+                    uxValueLen = sizeof( long );
+                    break;
+
+                case LOG_ARG_LONG_LONG:
+                    uxValueLen = sizeof( long long );
+                    break;
+
+                case LOG_ARG_SIZE:
+                    uxValueLen = sizeof( size_t );
+                    break;
+
+                case LOG_ARG_DOUBLE:
+                    uxValueLen = sizeof( double );
+                    break;
+
+                case LOG_ARG_PTR:
+                    uxValueLen = sizeof( void * );
+                    break;
+
+                default:
+                    break;
+            }
+
+            if( uxOffset + uxValueLen <= uxArgsLen )
+            {
+                ( void ) memcpy( &xValue, &pucArgs[ uxOffset ], uxValueLen );
+            }
+
+            uxOffset += LOG_ALIGN( uxValueLen, 4U );
+
+            switch( xSpec.xType )
+            {
+                case LOG_ARG_INT:
+                    lLenPart = snprintf( &pcBuffer[ ulLenTotal ], uxRemaining, cSpec, xValue.lInt );
+                    break;
+
+                case LOG_ARG_LONG:
+                    lLenPart = snprintf( &pcBuffer[ ulLenTotal ], uxRemaining, cSpec, xValue.lLong );
+                    break;
+
+                case LOG_ARG_LONG_LONG:
+                    lLenPart = snprintf( &pcBuffer[ ulLenTotal ], uxRemaining, cSpec, xValue.llLongLong );
+                    break;
+
+                case LOG_ARG_SIZE:
+                    lLenPart = snprintf( &pcBuffer[ ulLenTotal ], uxRemaining, cSpec, xValue.uxSize );
+                    break;
+
+                case LOG_ARG_DOUBLE:
+                    lLenPart = snprintf( &pcBuffer[ ulLenTotal ], uxRemaining, cSpec, xValue.dDouble );
+                    break;
+
+                case LOG_ARG_PTR:
+
+                    if( xSpec.xIsStore == pdFALSE )
+                    {
+                        lLenPart = snprintf( &pcBuffer[ ulLenTotal ], uxRemaining, cSpec, xValue.pvPtr );
+                    }
+
+                    break;
+
+                default:
+                    break;
+            }
+        }
+        else
+        {
+            /* Unknown conversion, print it verbatim */
+            lLenPart = snprintf( &pcBuffer[ ulLenTotal ], uxRemaining, "%s", cSpec );
+        }
+
+        if( lLenPart > 0 )
+        {
+            ulLenTotal += ( ( size_t ) lLenPart < uxRemaining ) ? ( uint32_t ) lLenPart : ( uint32_t ) ( uxRemaining - 1 );
+        }
+    }
+
+    pcBuffer[ ulLenTotal ] = '\0';
+
+    return prvFormatTrailer( pcBuffer, ulLenTotal, pxRecord->pcFileName, pxRecord->ulLineNumber );
+}
+
+/*-----------------------------------------------------------*/
+
+/* Reserve uxLen bytes of ucLogRing, or return NULL and count a dropped line if it is full */
+static LogRecord_t * prvReserveRecord( size_t uxLen,
+                                       BaseType_t xFromISR,
+                                       BaseType_t * pxWasEmpty )
+{
+    LogRecord_t * pxRecord = NULL;
+    UBaseType_t uxContext = 0;
+
+    if( xFromISR == pdTRUE )
+    {
+        uxContext = taskENTER_CRITICAL_FROM_ISR();
+    }
+    else
+    {
+        taskENTER_CRITICAL();
+    }
+
+    {
+        uint32_t ulUsed = ulLogHead - ulLogTail;
+        uint32_t ulOffset = ulLogHead & ( LOGGING_DEFERRED_RING_LEN - 1 );
+        uint32_t ulContiguous = LOGGING_DEFERRED_RING_LEN - ulOffset;
+        uint32_t ulPadding = ( uxLen > ulContiguous ) ? ulContiguous : 0;
+
+        if( ( uxLen <= LOGGING_DEFERRED_RECORD_MAX ) &&
+            ( ( ulUsed + ulPadding + uxLen ) <= LOGGING_DEFERRED_RING_LEN ) )
+        {
+            *pxWasEmpty = ( ulUsed == 0 );
+
+            /* Records are contiguous, skip the end of the ring if it is too short */
+            if( ulPadding > 0 )
+            {
+                LogRecord_t * pxPadding = ( LogRecord_t * ) &ucLogRing[ ulOffset ];
+
+                pxPadding->usLen = ( uint16_t ) ulPadding;
+                pxPadding->ucState = LOG_RECORD_PADDING;
+                ulOffset = 0;
+            }
+
+            pxRecord = ( LogRecord_t * ) &ucLogRing[ ulOffset ];
+            pxRecord->usLen = ( uint16_t ) uxLen;
+            pxRecord->ucState = LOG_RECORD_RESERVED;
+
+            ulLogHead += ulPadding + uxLen;
+        }
+        else
+        {
+            ulLogDropped++;
+        }
+    }
+
+    if( xFromISR == pdTRUE )
+    {
+        taskEXIT_CRITICAL_FROM_ISR( uxContext );
+    }
+    else
+    {
+        taskEXIT_CRITICAL();
+    }
+
+    return pxRecord;
+}
+
+/*-----------------------------------------------------------*/
+
+static void prvLogDeferred( const char * const pcLogLevel,
+                            const char * const pcFileName,
+                            const unsigned long ulLineNumber,
+                            const char * const pcFormat,
+                            va_list args )
+{
+    BaseType_t xFromISR = xPortIsInsideInterrupt();
+    BaseType_t xWasEmpty = pdFALSE;
+    LogRecord_t * pxRecord = NULL;
+    size_t uxArgsLen = 0;
+    va_list xArgsCopy;
+
+    va_copy( xArgsCopy, args );
+    uxArgsLen = prvPackArgs( NULL, 0, pcFormat, xArgsCopy );
+    va_end( xArgsCopy );
+
+    pxRecord = prvReserveRecord( LOG_ALIGN( sizeof( LogRecord_t ) + uxArgsLen, LOG_RECORD_ALIGN ),
+                                 xFromISR,
+                                 &xWasEmpty );
+
+    if( pxRecord != NULL )
+    {
+        pxRecord->ulTicks = ( xFromISR == pdTRUE ) ? xTaskGetTickCountFromISR() : xTaskGetTickCount();
+        pxRecord->pcLogLevel = pcLogLevel;
+        pxRecord->pcFileName = pcFileName;
+        pxRecord->ulLineNumber = ulLineNumber;
+        pxRecord->pcFormat = pcFormat;
+
+        /* The task may be deleted before the record is formatted, so keep a copy of its name */
+        ( void ) strncpy( pxRecord->cTaskName, pcTaskGetName( NULL ), LOG_RECORD_NAME_LEN - 1 );
+        pxRecord->cTaskName[ LOG_RECORD_NAME_LEN - 1 ] = '\0';
+
+        ( void ) prvPackArgs( ( uint8_t * ) &pxRecord[ 1 ],
+                              pxRecord->usLen - sizeof( LogRecord_t ),
+                              pcFormat,
+                              args );
+
+        __DMB();
+        pxRecord->ucState = LOG_RECORD_COMMITTED;
+
+        /* The logging task only waits for a notification once the ring is empty */
+        if( xWasEmpty == pdTRUE )
+        {
+            if( xFromISR == pdTRUE )
+            {
+                BaseType_t xHigherPriorityTaskWoken = pdFALSE;
+
+                vTaskNotifyGiveFromISR( xLogTask, &xHigherPriorityTaskWoken );
+                portYIELD_FROM_ISR( xHigherPriorityTaskWoken );
+            }
+            else
+            {
+                ( void ) xTaskNotifyGive( xLogTask );
+            }
+        }
+    }
+}
+
+/*-----------------------------------------------------------*/
+
+/*
+ * Format the oldest committed record into pcBuffer and release it.
+ * Records that are still being written are skipped when xSkipReserved is set.
+ *
+ * @return pdTRUE if a record was formatted.
+ */
+static BaseType_t prvFormatNextRecord( char * pcBuffer,
+                                       uint32_t * pulLen,
+                                       BaseType_t xSkipReserved )
+{
+    BaseType_t xFormatted = pdFALSE;
+    BaseType_t xWaiting = pdFALSE;
+
+    while( ( xFormatted == pdFALSE ) &&
+           ( xWaiting == pdFALSE ) &&
+           ( ulLogTail != ulLogHead ) )
+    {
+        const LogRecord_t * pxRecord = ( LogRecord_t * ) &ucLogRing[ ulLogTail & ( LOGGING_DEFERRED_RING_LEN - 1 ) ];
+        uint8_t ucState = pxRecord->ucState;
+
+        __DMB();
+
+        if( ucState == LOG_RECORD_COMMITTED )
+        {
+            *pulLen = prvFormatRecord( pxRecord, pcBuffer );
+            xFormatted = pdTRUE;
+        }
+        else if( ( ucState == LOG_RECORD_RESERVED ) && ( xSkipReserved == pdFALSE ) )
+        {
+            xWaiting = pdTRUE;
+        }
+
+        if( xWaiting == pdFALSE )
+        {
+            ulLogTail += pxRecord->usLen;
+        }
+    }
+
+    return xFormatted;
+}
+
+/*-----------------------------------------------------------*/
+
+static void prvLoggingTask( void * pvParameters )
+{
+    uint32_t ulLen = 0;
+
+    ( void ) pvParameters;
+
+    for( ; ; )
+    {
+        while( prvFormatNextRecord( pcPrintBuff, &ulLen, pdFALSE ) == pdTRUE )
+        {
+            vSendLogMessage( pcPrintBuff, ulLen );
+        }
+
+        if( ulLogDropped != ulLogDroppedReported )
+        {
+            uint32_t ulDropped = ulLogDropped;
+
+            ulLen = prvFormatPrefix( pcPrintBuff, "WRN", xTaskGetTickCount(), pcTaskGetName( NULL ) );
+            ulLen += snprintf( &pcPrintBuff[ ulLen ], dlMAX_PRINT_STRING_LENGTH - ulLen,
+                               "%lu log lines dropped.", ( unsigned long ) ( ulDropped - ulLogDroppedReported ) );
+            vSendLogMessage( pcPrintBuff, ulLen );
+
+            ulLogDroppedReported = ulDropped;
+        }
+
+        /* A record that is still being written is polled every tick */
+        ( void ) ulTaskNotifyTake( pdTRUE, ( ulLogTail != ulLogHead ) ? 1 : portMAX_DELAY );
+    }
+}
+
+#endif /* LOGGING_DEFERRED */
+
+/*-----------------------------------------------------------*/
+
+static void prvLogImmediate( const char * const pcLogLevel,
+                             const char * const pcFileName,
+                             const unsigned long ulLineNumber,
+                             const char * const pcFormat,
+                             va_list args )
+{
+    uint32_t ulLenTotal = 0;
+    int32_t lLenPart = -1;
+    const char * pcTaskName = NULL;
+    BaseType_t xSchedulerWasSuspended = pdFALSE;
+
+    /* Additional info to place at the start of the log line */
+    if( xTaskGetSchedulerState() != taskSCHEDULER_NOT_STARTED )
+    {
+        pcTaskName = pcTaskGetName( NULL );
+    }
+    else
+    {
+        pcTaskName = "None";
+    }
+
+    if( xTaskGetSchedulerState() == taskSCHEDULER_RUNNING )
+    {
+        xSchedulerWasSuspended = pdTRUE;
+        /* Suspend the scheduler to access pcPrintBuff */
+        vTaskSuspendAll();
+    }
+
+    ulLenTotal = prvFormatPrefix( pcPrintBuff, pcLogLevel, xTaskGetTickCount(), pcTaskName );
+
+    if( ulLenTotal < dlMAX_PRINT_STRING_LENGTH )
+    {
+        /* There are a variable number of parameters. */
+        lLenPart = vsnprintf( &pcPrintBuff[ ulLenTotal ],
+                              ( dlMAX_PRINT_STRING_LENGTH - ulLenTotal ),
+                              pcFormat,
+                              args );
+
+        configASSERT( lLenPart > 0 );
+
+        if( lLenPart + ulLenTotal < dlMAX_PRINT_STRING_LENGTH )
+        {
+            ulLenTotal += lLenPart;
+        }
+        else
+        {
+            ulLenTotal = dlMAX_PRINT_STRING_LENGTH;
+        }
+    }
+
+    ulLenTotal = prvFormatTrailer( pcPrintBuff, ulLenTotal, pcFileName, ulLineNumber );
+
+    vSendLogMessage( ( void * ) pcPrintBuff, ulLenTotal );
+
+    if( xSchedulerWasSuspended == pdTRUE )
+    {
+        xTaskResumeAll();
+    }
+}
+
+/*-----------------------------------------------------------*/
+
+void vLoggingPrintf( const char * const pcLogLevel,
+                     const char * const pcFileName,
+                     const unsigned long ulLineNumber,
+                     const char * const pcFormat,
+                     ... )
+{
+    va_list args;
+
+    va_start( args, pcFormat );
+
+#if LOGGING_DEFERRED
+    if( ( xLogTask != NULL ) &&
+        ( xTaskGetSchedulerState() != taskSCHEDULER_NOT_STARTED ) )
+    {
+        prvLogDeferred( pcLogLevel, pcFileName, ulLineNumber, pcFormat, args );
+    }
+    else
+#endif /* LOGGING_DEFERRED */
+    {
+        prvLogImmediate( pcLogLevel, pcFileName, ulLineNumber, pcFormat, args );
+    }
+
+    va_end( args );
+}
+
+/*-----------------------------------------------------------*/
+
+const char * pcLoggingModuleName( LogModule_t xModule )
+{
+    return ( xModule < LOG_MODULE_MAX ) ? pcLogModuleNames[ xModule ] : "";
+}
+
+const char * pcLoggingLevelName( uint8_t ucLevel )
+{
+    return ( ucLevel <= LOG_DEBUG ) ? pcLogLevelNames[ ucLevel ] : "";
+}
+
+/* Parse the module and level of one "module=level" pair of uxLen characters */
+static BaseType_t prvParseLevel( const char * pcPair,
+                                 size_t uxLen,
+                                 uint32_t * pulModuleMask,
+                                 uint8_t * pucLevel )
+{
+    const char * pcEquals = memchr( pcPair, '=', uxLen );
+    BaseType_t xValid = pdFALSE;
+
+    if( pcEquals != NULL )
+    {
+        size_t uxNameLen = pcEquals - pcPair;
+        const char * pcLevel = pcEquals + 1;
+        size_t uxLevelLen = uxLen - uxNameLen - 1;
+
+        *pulModuleMask = 0;
+
+        if( ( uxNameLen == 3 ) && ( strncmp( pcPair, "all", 3 ) == 0 ) )
+        {
+            *pulModuleMask = ( 1UL << LOG_MODULE_MAX ) - 1;
+        }
+
+        for( uint32_t ulModule = 0; ulModule < LOG_MODULE_MAX; ulModule++ )
+        {
+            if( ( strlen( pcLogModuleNames[ ulModule ] ) == uxNameLen ) &&
+                ( strncmp( pcPair, pcLogModuleNames[ ulModule ], uxNameLen ) == 0 ) )
+            {
+                *pulModuleMask = 1UL << ulModule;
+            }
+        }
+
+        for( uint8_t ucLevel = LOG_NONE; ucLevel <= LOG_DEBUG; ucLevel++ )
+        {
+            if( ( ( uxLevelLen == 1 ) && ( *pcLevel == ( '0' + ucLevel ) ) ) ||
+                ( ( strlen( pcLogLevelNames[ ucLevel ] ) == uxLevelLen ) &&
+                  ( strncmp( pcLevel, pcLogLevelNames[ ucLevel ], uxLevelLen ) == 0 ) ) )
+            {
+                *pucLevel = ucLevel;
+                xValid = ( *pulModuleMask != 0 );
+            }
+        }
+    }
+
+    return xValid;
+}
+
+int32_t lLoggingSetLevels( const char * pcLevels )
+{
+    uint8_t ucLevels[ LOG_MODULE_MAX ];
+    BaseType_t xValid = pdTRUE;
+
+    configASSERT( pcLevels != NULL );
+
+    for( uint32_t ulModule = 0; ulModule < LOG_MODULE_MAX; ulModule++ )
+    {
+        ucLevels[ ulModule ] = ucLogModuleLevel[ ulModule ];
+    }
+
+    /* Validate the whole list before applying any of it */
+    while( ( xValid == pdTRUE ) && ( *pcLevels != '\0' ) )
+    {
+        size_t uxLen = strcspn( pcLevels, ", " );
+        uint32_t ulModuleMask = 0;
+        uint8_t ucLevel = LOG_NONE;
+
+        if( uxLen > 0 )
+        {
+            xValid = prvParseLevel( pcLevels, uxLen, &ulModuleMask, &ucLevel );
+
+            for( uint32_t ulModule = 0; ulModule < LOG_MODULE_MAX; ulModule++ )
+            {
+                if( ( ulModuleMask & ( 1UL << ulModule ) ) != 0 )
+                {
+                    ucLevels[ ulModule ] = ucLevel;
+                }
+            }
+        }
+
+        pcLevels += uxLen;
+
+        if( *pcLevels != '\0' )
+        {
+            pcLevels++;
+        }
+    }
+
+    if( xValid == pdTRUE )
+    {
+        for( uint32_t ulModule = 0; ulModule < LOG_MODULE_MAX; ulModule++ )
+        {
+            ucLogModuleLevel[ ulModule ] = ucLevels[ ulModule ];
+        }
+    }
+
+    return ( int32_t ) xValid;
 }
 
 /*-----------------------------------------------------------*/
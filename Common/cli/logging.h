@@ -29,6 +29,7 @@
 
 /* Standard Include. */
 #include <stdio.h>
+#include <stdint.h>
 
 /* Include header for logging level macros. */
 #include "logging_levels.h"
@@ -39,8 +40,20 @@
 #define dlLOGGING_STREAM_LENGTH      4096
 #define dlMAX_LOG_LINE_LENGTH        ( dlMAX_PRINT_STRING_LENGTH + CLI_OUTPUT_EOL_LEN )
 
-/* Default logging config */
-#if ( !defined( LOGGING_OUTPUT_UART ) && !defined( LOGGING_OUTPUT_ITM ) && !defined( LOGGING_OUTPUT_NONE ) )
+/*
+ * Default logging config
+ * Any combination of these outputs may be defined:
+ * LOGGING_OUTPUT_UART: the CLI console, through xLogMBuf and the uart transmit task.
+ * LOGGING_OUTPUT_ITM:  ITM stimulus port 0, sent over SWO once the debugger has enabled tracing.
+ * LOGGING_OUTPUT_RTT:  a memory ring read by the debugger, see logging_rtt.c.
+ * ITM and RTT lines are written directly by the logging task or interrupt.
+ *
+ * LOGGING_OUTPUT_FLASH may be added to any of them to also keep the lines in a
+ * compressed ring in the OSPI flash, see log_store.h. Only available in the
+ * project without TrustZone, which owns the flash.
+ */
+#if ( !defined( LOGGING_OUTPUT_UART ) && !defined( LOGGING_OUTPUT_ITM ) && \
+    !defined( LOGGING_OUTPUT_RTT ) && !defined( LOGGING_OUTPUT_NONE ) )
 #define LOGGING_OUTPUT_UART
 #endif
 
@@ -50,6 +63,39 @@
 #define LOG_LEVEL             LOG_INFO
 #endif
 
+/*
+ * Modules with a log level that can be changed at runtime.
+ * A file selects its module by defining LOG_MODULE before using the logging macros.
+ * LOG_LEVEL still sets the most verbose level compiled into the file.
+ */
+typedef enum LogModule
+{
+    LOG_MODULE_APP,
+    LOG_MODULE_SYS,
+    LOG_MODULE_NET,
+    LOG_MODULE_TLS,
+    LOG_MODULE_MQTT,
+    LOG_MODULE_HTTP,
+    LOG_MODULE_OTA,
+    LOG_MODULE_FS,
+    LOG_MODULE_KVSTORE,
+    LOG_MODULE_PKCS11,
+    LOG_MODULE_SENSOR,
+    LOG_MODULE_SHADOW,
+    LOG_MODULE_DEFENDER,
+    LOG_MODULE_MAX
+} LogModule_t;
+
+#ifndef LOG_MODULE
+#define LOG_MODULE    LOG_MODULE_APP
+#endif
+
+/* Runtime log level of each module, see xLoggingSetLevels */
+extern volatile uint8_t ucLogModuleLevel[ LOG_MODULE_MAX ];
+
+/* Checked before any argument is evaluated or formatted */
+#define LogEnabled( level )    ( ( level ) <= ucLogModuleLevel[ LOG_MODULE ] )
+
 /* Get rid of extra C89 style parentheses generated by core FreeRTOS libraries */
 
 #define REMOVE_PARENS( ... )    STR( OVE __VA_ARGS__ )
@@ -69,6 +115,39 @@ void vLoggingDeInit( void );
 void vDyingGasp( void );
 void vInitLoggingEarly( void );
 
+#if defined( LOGGING_OUTPUT_UART )
+
+/*
+ * Copy the oldest line logged before the scheduler started to pcBuffer, without
+ * line ending, and remove it. Once all lines have been read, a warning line is
+ * returned if any were dropped because the early buffer was full.
+ * Returns the line length, or 0 when there is nothing left.
+ */
+size_t uxLoggingEarlyRead( char * pcBuffer,
+                           size_t uxBufferLen );
+#endif /* defined( LOGGING_OUTPUT_UART ) */
+
+/*
+ * Set runtime log levels from a list of module=level pairs separated by commas,
+ * e.g. "mqtt=debug,net=warn". The module "all" sets every module. Levels are
+ * none, error, warn, info, debug or 0 - 4.
+ * Returns 1 if the whole list was valid, in which case it has been applied.
+ */
+int32_t lLoggingSetLevels( const char * pcLevels );
+const char * pcLoggingModuleName( LogModule_t xModule );
+const char * pcLoggingLevelName( uint8_t ucLevel );
+
+#if defined( LOGGING_OUTPUT_RTT )
+void vLoggingRttInit( void );
+
+/* Append a line and a CRLF to the RTT up buffer, or drop it if the host has not read enough */
+void vLoggingRttWriteLine( const char * pcLine,
+                           size_t uxLen );
+
+/* Number of lines dropped because the RTT up buffer was full */
+uint32_t ulLoggingRttDropped( void );
+#endif
+
 /* task.h cannot be included here because this file is included by FreeRTOSConfig.h */
 extern void vTaskSuspendAll( void );
 
@@ -99,25 +178,25 @@ extern void vTaskSuspendAll( void );
 #else
 
 #if ( LOG_LEVEL >= LOG_ERROR )
-#define LogError( ... )    SdkLog( "ERR", REMOVE_PARENS( __VA_ARGS__ ) )
+#define LogError( ... )    do { if( LogEnabled( LOG_ERROR ) ) { SdkLog( "ERR", REMOVE_PARENS( __VA_ARGS__ ) ); } } while( 0 )
 #else
 #define LogError( ... )
 #endif
 
 #if ( LOG_LEVEL >= LOG_WARN )
-#define LogWarn( ... )    SdkLog( "WRN", REMOVE_PARENS( __VA_ARGS__ ) )
+#define LogWarn( ... )    do { if( LogEnabled( LOG_WARN ) ) { SdkLog( "WRN", REMOVE_PARENS( __VA_ARGS__ ) ); } } while( 0 )
 #else
 #define LogWarn( ... )
 #endif
 
 #if ( LOG_LEVEL >= LOG_INFO )
-#define LogInfo( ... )    SdkLog( "INF", REMOVE_PARENS( __VA_ARGS__ ) )
+#define LogInfo( ... )    do { if( LogEnabled( LOG_INFO ) ) { SdkLog( "INF", REMOVE_PARENS( __VA_ARGS__ ) ); } } while( 0 )
 #else
 #define LogInfo( ... )
 #endif
 
 #if ( LOG_LEVEL >= LOG_DEBUG )
-#define LogDebug( ... )    SdkLog( "DBG", REMOVE_PARENS( __VA_ARGS__ ) )
+#define LogDebug( ... )    do { if( LogEnabled( LOG_DEBUG ) ) { SdkLog( "DBG", REMOVE_PARENS( __VA_ARGS__ ) ); } } while( 0 )
 #else
 #define LogDebug( ... )
 #endif
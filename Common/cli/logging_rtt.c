@@ -0,0 +1,207 @@
+/*
+ * FreeRTOS STM32 Reference Integration
+ *
+ * Copyright (c) 2022 Amazon.com, Inc. or its affiliates. All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+/*
+ * Memory ring log transport using the SEGGER RTT control block layout.
+ *
+ * Log lines are copied into an up buffer in RAM which a debugger reads in the
+ * background (J-Link RTT viewer, "rtt" commands of OpenOCD or pyOCD). Writes
+ * never wait for the host, a line that does not fit is dropped and counted.
+ */
+
+#include <stdint.h>
+#include <string.h>
+
+#include "FreeRTOS.h"
+#include "task.h"
+#include "logging.h"
+#include "hw_defs.h"
+
+#if defined( LOGGING_OUTPUT_RTT )
+
+/* Bytes of log output buffered for the debugger */
+#ifndef LOGGING_RTT_UP_BUFFER_LEN
+#define LOGGING_RTT_UP_BUFFER_LEN    4096U
+#endif
+
+#define LOGGING_RTT_DOWN_BUFFER_LEN    16U
+#define LOGGING_RTT_ID_LEN             16U
+
+/* Layouts below are read by the debugger and must match SEGGER_RTT.h */
+typedef struct RttBufferUp
+{
+    const char * sName;
+    char * pBuffer;
+    uint32_t SizeOfBuffer;
+    volatile uint32_t WrOff; /* Written by the target */
+    volatile uint32_t RdOff; /* Written by the host */
+    uint32_t Flags;
+} RttBufferUp_t;
+
+typedef struct RttBufferDown
+{
+    const char * sName;
+    char * pBuffer;
+    uint32_t SizeOfBuffer;
+    volatile uint32_t WrOff; /* Written by the host */
+    volatile uint32_t RdOff; /* Written by the target */
+    uint32_t Flags;
+} RttBufferDown_t;
+
+typedef struct RttControlBlock
+{
+    char acID[ LOGGING_RTT_ID_LEN ];
+    int32_t MaxNumUpBuffers;
+    int32_t MaxNumDownBuffers;
+    RttBufferUp_t aUp[ 1 ];
+    RttBufferDown_t aDown[ 1 ];
+} RttControlBlock_t;
+
+/* Skip data that does not fit instead of waiting for the host */
+#define RTT_MODE_NO_BLOCK_SKIP    0U
+
+static char cRttUpBuffer[ LOGGING_RTT_UP_BUFFER_LEN ];
+static char cRttDownBuffer[ LOGGING_RTT_DOWN_BUFFER_LEN ];
+
+/* Named as in the SEGGER sources so that debuggers can locate it from the elf file */
+RttControlBlock_t _SEGGER_RTT = { 0 };
+
+static volatile uint32_t ulRttDropped = 0;
+
+/*-----------------------------------------------------------*/
+
+void vLoggingRttInit( void )
+{
+    RttControlBlock_t * pxCb = &_SEGGER_RTT;
+
+    pxCb->MaxNumUpBuffers = 1;
+    pxCb->MaxNumDownBuffers = 1;
+
+    pxCb->aUp[ 0 ].sName = "Terminal";
+    pxCb->aUp[ 0 ].pBuffer = cRttUpBuffer;
+    pxCb->aUp[ 0 ].SizeOfBuffer = LOGGING_RTT_UP_BUFFER_LEN;
+    pxCb->aUp[ 0 ].WrOff = 0;
+    pxCb->aUp[ 0 ].RdOff = 0;
+    pxCb->aUp[ 0 ].Flags = RTT_MODE_NO_BLOCK_SKIP;
+
+    pxCb->aDown[ 0 ].sName = "Terminal";
+    pxCb->aDown[ 0 ].pBuffer = cRttDownBuffer;
+    pxCb->aDown[ 0 ].SizeOfBuffer = LOGGING_RTT_DOWN_BUFFER_LEN;
+    pxCb->aDown[ 0 ].WrOff = 0;
+    pxCb->aDown[ 0 ].RdOff = 0;
+    pxCb->aDown[ 0 ].Flags = RTT_MODE_NO_BLOCK_SKIP;
+
+    /*
+     * Write the ID last, and in two parts, so that a debugger scanning RAM
+     * neither finds a partly initialized block nor a copy of the ID string.
+     */
+    __DMB();
+    ( void ) strcpy( &( pxCb->acID[ 7 ] ), "RTT" );
+    __DMB();
+    ( void ) strcpy( &( pxCb->acID[ 0 ] ), "SEGGER" );
+    __DMB();
+    pxCb->acID[ 6 ] = ' ';
+}
+
+/*-----------------------------------------------------------*/
+
+/* Bytes the target can write before reaching the read offset of the host */
+static uint32_t prvRttUpFree( const RttBufferUp_t * pxBuf )
+{
+    uint32_t ulWrOff = pxBuf->WrOff;
+    uint32_t ulRdOff = pxBuf->RdOff;
+    uint32_t ulFree = 0;
+
+    if( ulRdOff > ulWrOff )
+    {
+        ulFree = ulRdOff - ulWrOff - 1;
+    }
+    else
+    {
+        ulFree = pxBuf->SizeOfBuffer - ( ulWrOff - ulRdOff ) - 1;
+    }
+
+    return ulFree;
+}
+
+/* Copy uxLen bytes at ulWrOff, wrapping at the end of the buffer. Returns the offset after them */
+static uint32_t prvRttUpCopy( RttBufferUp_t * pxBuf,
+                              uint32_t ulWrOff,
+                              const char * pcData,
+                              size_t uxLen )
+{
+    uint32_t ulToEnd = pxBuf->SizeOfBuffer - ulWrOff;
+
+    if( ulToEnd > uxLen )
+    {
+        ( void ) memcpy( &( pxBuf->pBuffer[ ulWrOff ] ), pcData, uxLen );
+        ulWrOff += uxLen;
+    }
+    else
+    {
+        ( void ) memcpy( &( pxBuf->pBuffer[ ulWrOff ] ), pcData, ulToEnd );
+        ( void ) memcpy( pxBuf->pBuffer, &( pcData[ ulToEnd ] ), uxLen - ulToEnd );
+        ulWrOff = uxLen - ulToEnd;
+    }
+
+    return ulWrOff;
+}
+
+/*-----------------------------------------------------------*/
+
+void vLoggingRttWriteLine( const char * pcLine,
+                           size_t uxLen )
+{
+    RttBufferUp_t * pxBuf = &( _SEGGER_RTT.aUp[ 0 ] );
+    UBaseType_t uxSavedInterruptStatus = 0;
+
+    /* Lines written from tasks and interrupts must not interleave */
+    uxSavedInterruptStatus = taskENTER_CRITICAL_FROM_ISR();
+
+    /* A buffer size of 0 means vLoggingRttInit has not been called yet */
+    if( ( pxBuf->SizeOfBuffer > 0 ) &&
+        ( prvRttUpFree( pxBuf ) >= ( uxLen + 2 ) ) )
+    {
+        uint32_t ulWrOff = pxBuf->WrOff;
+
+        ulWrOff = prvRttUpCopy( pxBuf, ulWrOff, pcLine, uxLen );
+        ulWrOff = prvRttUpCopy( pxBuf, ulWrOff, "\r\n", 2 );
+
+        /* The line must be visible before the host sees the new offset */
+        __DMB();
+        pxBuf->WrOff = ulWrOff;
+    }
+    else
+    {
+        ulRttDropped++;
+    }
+
+    taskEXIT_CRITICAL_FROM_ISR( uxSavedInterruptStatus );
+}
+
+uint32_t ulLoggingRttDropped( void )
+{
+    return ulRttDropped;
+}
+
+#endif /* defined( LOGGING_OUTPUT_RTT ) */
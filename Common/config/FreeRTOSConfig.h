@@ -70,6 +70,7 @@ extern uint32_t SystemCoreClock;
 #define configMAX_PRIORITIES                       ( 56 )
 #define configMINIMAL_STACK_SIZE                   ( ( uint16_t ) 1024 )
 #define configTOTAL_HEAP_SIZE                      ( ( size_t ) 300 * 1024 )
+#define configAPPLICATION_ALLOCATED_HEAP           1 /* ucHeap is defined in heap_classes.c */
 #define configMAX_TASK_NAME_LEN                    ( 32 )
 #define configUSE_TRACE_FACILITY                   1
 #define configUSE_16_BIT_TICKS                     0
@@ -101,7 +102,9 @@ extern uint32_t SystemCoreClock;
 #define configTIMER_TASK_STACK_DEPTH               2048
 
 
-#define configTASK_NOTIFICATION_ARRAY_ENTRIES      8
+/* Index 8 is reserved for the lwIP mailboxes, see LWIP_MBOX_NOTIFY_IDX,
+ * and index 9 for the DMA copies, see DMA_COPY_NOTIFY_IDX */
+#define configTASK_NOTIFICATION_ARRAY_ENTRIES      10
 
 /* CMSIS-RTOS V2 flags */
 #define configUSE_OS2_THREAD_SUSPEND_RESUME        1
@@ -194,6 +197,25 @@ extern uint32_t SystemCoreClock;
 #define portCONFIGURE_TIMER_FOR_RUN_TIME_STATS()
 #define portGET_RUN_TIME_COUNTER_VALUE()    ( timer_get_count( pxHndlTim5 ) )
 
+/* Trace hooks of the latency statistics and, when TRACE_RECORDER_ENABLED is 1, the trace recorder */
+#include "task_stats.h"
+#include "trace_recorder.h"
+
+#define traceTASK_SWITCHED_IN()    \
+    do {                           \
+        TASK_STATS_SWITCHED_IN();  \
+        TRACE_TASK_SWITCHED_IN();  \
+    } while( 0 )
+
+/* Tickless idle with Stop 2 entry, see low_power.h */
+#include "low_power.h"
+
+#if LOW_POWER_ENABLED == 1
+#define configUSE_TICKLESS_IDLE                              2
+#define configEXPECTED_IDLE_TIME_BEFORE_SLEEP                2
+#define portSUPPRESS_TICKS_AND_SLEEP( xExpectedIdleTime )    vLowPowerSuppressTicksAndSleep( xExpectedIdleTime )
+#endif
+
 
 
 #endif /* FREERTOS_CONFIG_H */
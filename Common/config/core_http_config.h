@@ -32,6 +32,10 @@
 #define LOG_LEVEL    LOG_ERROR
 #endif
 
+#ifndef LOG_MODULE
+#define LOG_MODULE    LOG_MODULE_HTTP
+#endif
+
 #include "logging.h"
 
 
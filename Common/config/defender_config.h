@@ -68,4 +68,13 @@
  */
 #define DEFENDER_USE_LONG_KEYS    0
 
+/**
+ * Set to 1 to add the lwIP memory pool, mailbox and TCP counters of net_stats.h
+ * to the custom metrics of the report. Each custom metric has to be created in
+ * the account before Defender accepts the report, see prvCollectCustomMetrics.
+ */
+#ifndef DEFENDER_LWIP_METRICS
+#define DEFENDER_LWIP_METRICS     0
+#endif
+
 #endif /* ifndef DEFENDER_CONFIG_H_ */
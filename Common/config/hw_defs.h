@@ -23,6 +23,10 @@
 #define MXCHIP_RESET_Pin           GPIO_PIN_15
 #define MXCHIP_RESET_GPIO_Port     GPIOF
 
+#define ISM330_INT1_Pin            GPIO_PIN_11
+#define ISM330_INT1_GPIO_Port      GPIOE
+#define ISM330_INT1_EXTI_IRQn      EXTI11_IRQn
+
 extern RTC_HandleTypeDef * pxHndlRtc;
 extern SPI_HandleTypeDef * pxHndlSpi2;
 extern TIM_HandleTypeDef * pxHndlTim5;
@@ -30,6 +34,8 @@ extern UART_HandleTypeDef * pxHndlUart1;
 extern DCACHE_HandleTypeDef * pxHndlDCache;
 extern DMA_HandleTypeDef * pxHndlGpdmaCh4;
 extern DMA_HandleTypeDef * pxHndlGpdmaCh5;
+extern DMA_HandleTypeDef * pxHndlGpdmaCh6;
+extern I2C_HandleTypeDef * pxHndlI2c2;
 extern IWDG_HandleTypeDef * pxHwndIwdg;
 
 static inline uint32_t timer_get_count( TIM_HandleTypeDef * pxHndl )
@@ -46,12 +52,28 @@ static inline uint32_t timer_get_count( TIM_HandleTypeDef * pxHndl )
 
 void hw_init( void );
 
+/* Reconfigure the PLL as the system clock after waking up from Stop mode */
+void hw_clock_restore( void );
+
 typedef void ( * GPIOInterruptCallback_t ) ( void * pvContext );
 
 void GPIO_EXTI_Register_Callback( uint16_t usGpioPinMask,
                                   GPIOInterruptCallback_t pvCallback,
                                   void * pvContext );
 
+void GPIO_EXTI_Register_Deferred_Callback( uint16_t usGpioPinMask,
+                                           GPIOInterruptCallback_t pvCallback,
+                                           void * pvContext );
+
+typedef struct
+{
+    uint32_t ulEdges;     /* Rising edges received */
+    uint32_t ulCoalesced; /* Edges merged into a deferred callback still pending */
+} GPIOInterruptStats_t;
+
+void GPIO_EXTI_Get_Stats( uint16_t usGpioPinMask,
+                          GPIOInterruptStats_t * pxStats );
+
 void vDoSystemReset( void );
 
 static inline void vPetWatchdog( void )
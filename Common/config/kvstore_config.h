@@ -39,6 +39,15 @@ typedef enum KvStoreEnum
     CS_WIFI_SSID,
     CS_WIFI_CREDENTIAL,
     CS_TIME_HWM_S_1970,
+    CS_NET_DHCP_LEASE,
+    CS_NET_WIFI_AP,
+    CS_CORE_MQTT_ENDPOINT_ADDR,
+    CS_TLS_SESSION,
+    CS_MOTION_WINDOW_MS,
+    CS_OTA_RATE_LIMIT_KBPS,
+    CS_OTA_YIELD_MS,
+    CS_LOG_LEVELS,
+    CS_TELEMETRY_ROOT,
     CS_NUM_KEYS
 } KVStoreKey_t;
 
@@ -96,27 +105,55 @@ typedef enum KvStoreEnum
 #if !defined( WIFI_SECURITY_DFLT )
 #define WIFI_SECURITY_DFLT    ""
 #endif /* !defined ( WIFI_SECURITY_DFLT ) */
+
+/* Runtime log levels applied at boot, e.g. "all=info,mqtt=debug" */
+#if !defined( LOG_LEVELS_DFLT )
+#define LOG_LEVELS_DFLT    ""
+#endif /* !defined ( LOG_LEVELS_DFLT ) */
+
+/* Topic prefix of the sensor telemetry, the thing name when empty */
+#if !defined( TELEMETRY_ROOT_DFLT )
+#define TELEMETRY_ROOT_DFLT    ""
+#endif /* !defined ( TELEMETRY_ROOT_DFLT ) */
 /* -------------------------------- Values for common attributes -------------------------------- */
 
 /* Array to map between strings and KVStoreKey_t IDs */
-#define KV_STORE_STRINGS   \
-    {                      \
-        "thing_name",      \
-        "mqtt_endpoint",   \
-        "mqtt_port",       \
-        "wifi_ssid",       \
-        "wifi_credential", \
-        "time_hwm"         \
+#define KV_STORE_STRINGS      \
+    {                         \
+        "thing_name",         \
+        "mqtt_endpoint",      \
+        "mqtt_port",          \
+        "wifi_ssid",          \
+        "wifi_credential",    \
+        "time_hwm",           \
+        "net_lease",          \
+        "net_ap",             \
+        "mqtt_endpoint_addr", \
+        "tls_session",        \
+        "motion_window_ms",   \
+        "ota_rate_kbps",      \
+        "ota_yield_ms",       \
+        "log_levels",         \
+        "telemetry_root"      \
     }
 
-#define KV_STORE_DEFAULTS                                                          \
-    {                                                                              \
-        KV_DFLT( KV_TYPE_STRING, THING_NAME_DFLT ),    /* CS_CORE_THING_NAME */    \
-        KV_DFLT( KV_TYPE_STRING, MQTT_ENDPOINT_DFLT ), /* CS_CORE_MQTT_ENDPOINT */ \
-        KV_DFLT( KV_TYPE_UINT32, MQTT_PORT_DFLT ),     /* CS_CORE_MQTT_PORT */     \
-        KV_DFLT( KV_TYPE_STRING, WIFI_SSID_DFLT ),     /* CS_WIFI_SSID */          \
-        KV_DFLT( KV_TYPE_STRING, WIFI_PASSWORD_DFLT ), /* CS_WIFI_CREDENTIAL */    \
-        KV_DFLT( KV_TYPE_UINT32, 0 ),                  /* CS_TIME_HWM_S_1970 */    \
+#define KV_STORE_DEFAULTS                                                                \
+    {                                                                                    \
+        KV_DFLT( KV_TYPE_STRING, THING_NAME_DFLT ),     /* CS_CORE_THING_NAME */         \
+        KV_DFLT( KV_TYPE_STRING, MQTT_ENDPOINT_DFLT ),  /* CS_CORE_MQTT_ENDPOINT */      \
+        KV_DFLT( KV_TYPE_UINT32, MQTT_PORT_DFLT ),      /* CS_CORE_MQTT_PORT */          \
+        KV_DFLT( KV_TYPE_STRING, WIFI_SSID_DFLT ),      /* CS_WIFI_SSID */               \
+        KV_DFLT( KV_TYPE_STRING, WIFI_PASSWORD_DFLT ),  /* CS_WIFI_CREDENTIAL */         \
+        KV_DFLT( KV_TYPE_UINT32, 0 ),                   /* CS_TIME_HWM_S_1970 */         \
+        KV_DFLT( KV_TYPE_BLOB, "" ),                    /* CS_NET_DHCP_LEASE */          \
+        KV_DFLT( KV_TYPE_BLOB, "" ),                    /* CS_NET_WIFI_AP */             \
+        KV_DFLT( KV_TYPE_BLOB, "" ),                    /* CS_CORE_MQTT_ENDPOINT_ADDR */ \
+        KV_DFLT( KV_TYPE_BLOB, "" ),                    /* CS_TLS_SESSION */             \
+        KV_DFLT( KV_TYPE_UINT32, 1000 ),                /* CS_MOTION_WINDOW_MS */        \
+        KV_DFLT( KV_TYPE_UINT32, 0 ),                   /* CS_OTA_RATE_LIMIT_KBPS */     \
+        KV_DFLT( KV_TYPE_UINT32, 250 ),                 /* CS_OTA_YIELD_MS */            \
+        KV_DFLT( KV_TYPE_STRING, LOG_LEVELS_DFLT ),     /* CS_LOG_LEVELS */              \
+        KV_DFLT( KV_TYPE_STRING, TELEMETRY_ROOT_DFLT ), /* CS_TELEMETRY_ROOT */          \
     }
 
 #endif /* _KVSTORE_CONFIG_H */
@@ -42,6 +42,7 @@
 #define LWIP_SO_RCVRCVTIMEO_NONSTANDARD       1
 #define LWIP_TCPIP_CORE_LOCKING               1
 #define LWIP_ARP                              1
+#define ETHARP_SUPPORT_STATIC_ENTRIES         1  /* Used to seed the gateway entry from a persisted DHCP lease */
 #define LWIP_STATS                            1
 #define MIB2_STATS                            1
 #define LWIP_POSIX_SOCKETS_IO_NAMES           0
@@ -97,13 +98,7 @@
  * ---------------------------------
  */
 
-/*#define TCPIP_THREAD_NAME              "TCP/IP" */
-/*#define TCPIP_THREAD_STACKSIZE          (4096U) */
-/*#define TCPIP_THREAD_PRIO               (24) */
-/*#define TCPIP_MBOX_SIZE                 20 */
-/*#define DEFAULT_UDP_RECVMBOX_SIZE       10 */
-/*#define DEFAULT_TCP_RECVMBOX_SIZE       20 */
-/*#define DEFAULT_ACCEPTMBOX_SIZE         10 */
+/* The tcpip_thread name, stack, priority and mailbox sizes are set in lwipopts_freertos.h */
 #define DEFAULT_THREAD_STACKSIZE    2048
 #define LWIP_COMPAT_MUTEX           0
 
@@ -130,8 +125,7 @@
 
 #define TCP_SND_QUEUELEN    ( 4 * TCP_SND_BUF / TCP_MSS )
 
-/* TCP receive window. */
-#define PBUF_POOL_SIZE      40
+/* PBUF_POOL_SIZE is set by LWIP_MEM_PROFILE in lwipopts_freertos.h */
 
 
 #define TCP_MSL             20 * 1000UL /* The maximum segment lifetime in milliseconds */
@@ -142,9 +136,7 @@
 #define LWIP_RAW            1             /* PING changed to 1 */
 /*#define DEFAULT_RAW_RECVMBOX_SIZE       3 / * for ICMP PING * / */
 
-/* To use single transmit pbuf ,this may be more efficient for MXCHIP */
-/*#define LWIP_NETIF_TX_SINGLE_PBUF 1 */
-/*#define TCP_OVERSIZE              1 */
+/* LWIP_NETIF_TX_SINGLE_PBUF and TCP_OVERSIZE are set by LWIP_MEM_PROFILE in lwipopts_freertos.h */
 /* when allocating buffer for MXCHIP , an header must be provisionned for TX buffers , default is zero */
 #define PBUF_LINK_ENCAPSULATION_HLEN    28
 #endif /* LWIP_HDR_LWIPOPTS_H */
@@ -36,6 +36,10 @@
 #define LOG_LEVEL    LOG_INFO
 #endif
 
+#ifndef LOG_MODULE
+#define LOG_MODULE    LOG_MODULE_OTA
+#endif
+
 #include "logging.h"
 #include "test_param_config.h"
 #include "test_execution_config.h"
@@ -136,8 +140,12 @@
  *  how many data blocks response is expected for each data requests.
  *  Please note that this must be set larger than zero.
  *
+ *  All blocks of a request are in flight at the same time, so this is the download window.
+ *  With 2 KB blocks, a window of 8 keeps 16 KB in flight per round trip to the streaming
+ *  service. Each block in flight needs an OTA event buffer, see otaconfigMAX_NUM_OTA_DATA_BUFFERS.
+ *
  */
-#define otaconfigMAX_NUM_BLOCKS_REQUEST         2U
+#define otaconfigMAX_NUM_BLOCKS_REQUEST         8U
 
 /**
  * @brief The maximum number of requests allowed to send without a response before we abort.
@@ -152,7 +160,8 @@
  * @brief The number of data buffers reserved by the OTA agent.
  *
  * This configurations parameter sets the maximum number of static data buffers used by
- * the OTA agent for job and file data blocks received.
+ * the OTA agent for job and file data blocks received. One buffer per block of the
+ * download window plus one for job messages.
  */
 #define otaconfigMAX_NUM_OTA_DATA_BUFFERS       ( otaconfigMAX_NUM_BLOCKS_REQUEST + 1 )
 
@@ -208,7 +217,7 @@
  * Enable data over HTTP - ( OTA_DATA_OVER_HTTP)
  * Enable data over both MQTT & HTTP ( OTA_DATA_OVER_MQTT | OTA_DATA_OVER_HTTP )
  */
-#define configENABLED_DATA_PROTOCOLS      ( OTA_DATA_OVER_MQTT )
+#define configENABLED_DATA_PROTOCOLS      ( OTA_DATA_OVER_MQTT | OTA_DATA_OVER_HTTP )
 
 /**
  * @brief The preferred protocol selected for OTA data operations.
@@ -218,8 +227,12 @@
  * and following update here to switch to HTTP as primary.
  *
  * Note - use OTA_DATA_OVER_HTTP for HTTP as primary data protocol.
+ *
+ * HTTP is preferred since each block is a plain ranged GET on a keep-alive TLS
+ * connection, without the MQTT and CBOR framing. Jobs that only list MQTT still
+ * download over MQTT.
  */
 
-#define configOTA_PRIMARY_DATA_PROTOCOL    OTA_DATA_OVER_MQTT
+#define configOTA_PRIMARY_DATA_PROTOCOL    OTA_DATA_OVER_HTTP
 
 #endif /* OTA_CONFIG_H_ */
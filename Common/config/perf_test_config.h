@@ -0,0 +1,97 @@
+/*
+ * FreeRTOS STM32 Reference Integration
+ *
+ * Copyright (c) 2022 Amazon.com, Inc. or its affiliates. All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+/**
+ * @file perf_test_config.h
+ * @brief Pass / fail budgets of the on-target performance tests.
+ *
+ * The defaults leave some margin over the values measured on a B-U585I-IOT02A
+ * running the ntz build at full clock. Override with -D to tighten them for a
+ * regression run on a known board and network.
+ */
+
+#ifndef PERF_TEST_CONFIG_H_
+#define PERF_TEST_CONFIG_H_
+
+/* Operations averaged by each test, the maximum is checked as well where noted */
+#ifndef PERF_TEST_ITERATIONS
+#define PERF_TEST_ITERATIONS                 16
+#endif
+
+/* TLS handshake of the last connect, from the ClientHello to Finished. Needs TLS_TRANSPORT_PROFILE. */
+#ifndef PERF_BUDGET_TLS_HANDSHAKE_MS
+#define PERF_BUDGET_TLS_HANDSHAKE_MS         4000
+#endif
+
+/* QoS1 publish until its PUBACK has been processed by the agent, average and maximum */
+#ifndef PERF_BUDGET_MQTT_PUBLISH_RTT_MS
+#define PERF_BUDGET_MQTT_PUBLISH_RTT_MS      500
+#endif
+
+#ifndef PERF_BUDGET_MQTT_PUBLISH_RTT_MAX_MS
+#define PERF_BUDGET_MQTT_PUBLISH_RTT_MAX_MS  2000
+#endif
+
+/* Cached read of a kvstore value and a set with flush to the backing store */
+#ifndef PERF_BUDGET_KV_GET_US
+#define PERF_BUDGET_KV_GET_US                50
+#endif
+
+#ifndef PERF_BUDGET_KV_SET_US
+#define PERF_BUDGET_KV_SET_US                60000
+#endif
+
+/* Sequential littlefs file throughput, including the close */
+#ifndef PERF_BUDGET_LFS_WRITE_KIBPS
+#define PERF_BUDGET_LFS_WRITE_KIBPS          24
+#endif
+
+#ifndef PERF_BUDGET_LFS_READ_KIBPS
+#define PERF_BUDGET_LFS_READ_KIBPS           512
+#endif
+
+/* Throughput on 4 KiB records */
+#ifndef PERF_BUDGET_SHA256_KIBPS
+#define PERF_BUDGET_SHA256_KIBPS             8192
+#endif
+
+#ifndef PERF_BUDGET_AES_GCM_KIBPS
+#define PERF_BUDGET_AES_GCM_KIBPS            4096
+#endif
+
+/* From the interrupt handler to the notified task running, average and maximum */
+#ifndef PERF_BUDGET_ISR_TO_TASK_US
+#define PERF_BUDGET_ISR_TO_TASK_US           10
+#endif
+
+#ifndef PERF_BUDGET_ISR_TO_TASK_MAX_US
+#define PERF_BUDGET_ISR_TO_TASK_MAX_US       50
+#endif
+
+/* Otherwise unused interrupt that the latency test pends from software */
+#ifndef PERF_TEST_SWI_IRQn
+#define PERF_TEST_SWI_IRQn                   TIM17_IRQn
+#define PERF_TEST_SWI_IRQHandler             TIM17_IRQHandler
+#endif
+
+#endif /* PERF_TEST_CONFIG_H_ */
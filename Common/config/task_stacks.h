@@ -0,0 +1,99 @@
+/*
+ * FreeRTOS STM32 Reference Integration
+ *
+ * Copyright (c) 2022 Amazon.com, Inc. or its affiliates. All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+/**
+ * @file task_stacks.h
+ * @brief Stack depths, in words, of the tasks with a static stack.
+ *
+ * Running "ps hints" on a device that has gone through its usual workload
+ * (TLS connect, OTA, sensor publishing) prints a suggested value for each
+ * task. The suggestion is the high water usage plus 25 % margin, rounded up
+ * to 64 words, and can be pasted here or passed with -D.
+ *
+ * tools/stack_usage.py gives a static estimate for the same tasks from the
+ * -fstack-usage and -fcallgraph-info output of the ntz build, which also
+ * covers paths the workload did not reach apart from indirect calls.
+ */
+
+#ifndef TASK_STACKS_H_
+#define TASK_STACKS_H_
+
+#ifndef TASK_STACK_INIT
+#define TASK_STACK_INIT            1024
+#endif
+
+#ifndef TASK_STACK_CLI
+#define TASK_STACK_CLI             2048
+#endif
+
+#ifndef TASK_STACK_MXNET
+#define TASK_STACK_MXNET           1024
+#endif
+
+#ifndef TASK_STACK_MXDATA
+#define TASK_STACK_MXDATA          4096
+#endif
+
+#ifndef TASK_STACK_MXCTRL
+#define TASK_STACK_MXCTRL          4096
+#endif
+
+#ifndef TASK_STACK_LFSERASE
+#define TASK_STACK_LFSERASE        1024
+#endif
+
+/* Shared by the jobs of work_queue.h: heartbeat, sensor hub, environment publisher, Defender */
+#ifndef TASK_STACK_WORKER
+#define TASK_STACK_WORKER          2048
+#endif
+
+#ifndef TASK_STACK_MQTTAGENT
+#define TASK_STACK_MQTTAGENT       2048
+#endif
+
+#ifndef TASK_STACK_OTAUPDATE
+#define TASK_STACK_OTAUPDATE       4096
+#endif
+
+#ifndef TASK_STACK_MOTIONS
+#define TASK_STACK_MOTIONS         2048
+#endif
+
+#ifndef TASK_STACK_SHADOWDEVICE
+#define TASK_STACK_SHADOWDEVICE    1024
+#endif
+
+#ifndef TASK_STACK_MQTTOUTBOX
+#define TASK_STACK_MQTTOUTBOX      2048
+#endif
+
+#ifndef TASK_STACK_LOGUPLOAD
+#define TASK_STACK_LOGUPLOAD       1024
+#endif
+
+/* TF-M build only, refills the NS entropy pool with one secure call */
+#ifndef TASK_STACK_ENTROPYFILL
+#define TASK_STACK_ENTROPYFILL     256
+#endif
+
+#endif /* TASK_STACKS_H_ */
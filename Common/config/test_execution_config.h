@@ -71,4 +71,12 @@
  */
 #define CORE_PKCS11_TEST_ENABLED            ( 0 )
 
+/**
+ * @brief Configuration to run the performance tests of perf_test.c after the
+ * qualification tests. Budgets are set in perf_test_config.h.
+ *
+ * #define PERF_TEST_ENABLED  (0)
+ */
+#define PERF_TEST_ENABLED                   ( 0 )
+
 #endif /* TEST_EXECUTION_CONFIG_H */
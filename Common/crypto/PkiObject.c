@@ -20,9 +20,16 @@
  * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
  */
 
+/* Required to hand heap buffers over to mbedtls_x509_crt */
+#define MBEDTLS_ALLOW_PRIVATE_ACCESS
+
 #include "tls_transport_config.h"
 #include "PkiObject.h"
 #include "PkiObject_prv.h"
+
+#include "FreeRTOS.h"
+#include "task.h"
+
 #include "mbedtls_error_utils.h"
 #include "mbedtls_transport.h"
 
@@ -34,6 +41,25 @@
 
 #include "ota_config.h"
 
+/* Incremented whenever a stored certificate or key is replaced */
+static volatile uint32_t ulPkiGeneration = 0;
+
+/*-----------------------------------------------------------*/
+
+static void vPkiBumpGeneration( void )
+{
+    taskENTER_CRITICAL();
+    ulPkiGeneration++;
+    taskEXIT_CRITICAL();
+}
+
+/*-----------------------------------------------------------*/
+
+uint32_t ulPkiGetGeneration( void )
+{
+    return ulPkiGeneration;
+}
+
 /*-----------------------------------------------------------*/
 
 PkiStatus_t xPrvMbedtlsErrToPkiStatus( int lError )
@@ -69,6 +95,22 @@ PkiStatus_t xPrvMbedtlsErrToPkiStatus( int lError )
     return xStatus;
 }
 
+/*-----------------------------------------------------------*/
+
+void vPrvX509CrtTakeBuffer( mbedtls_x509_crt * pxCertChain )
+{
+    configASSERT( pxCertChain != NULL );
+
+    while( pxCertChain->next != NULL )
+    {
+        pxCertChain = pxCertChain->next;
+    }
+
+    configASSERT( pxCertChain->raw.p != NULL );
+
+    pxCertChain->own_buffer = 1;
+}
+
 #if TEST_AUTOMATION_INTEGRATION == 1
 char g_CodeSigningCert[] = otapalconfigCODE_SIGNING_CERTIFICATE;
 char g_ClientCertificate[] = keyCLIENT_CERTIFICATE_PEM;
@@ -211,9 +253,10 @@ PkiStatus_t xPkiReadCertificate( mbedtls_x509_crt * pxMbedtlsCertCtx,
 
         case OBJ_FORM_DER:
            {
-               int lError = mbedtls_x509_crt_parse_der( pxMbedtlsCertCtx,
-                                                        pxCertificate->pucBuffer,
-                                                        pxCertificate->uxLen );
+               /* The buffer must outlive the certificate, see PKI_OBJ_DER */
+               int lError = mbedtls_x509_crt_parse_der_nocopy( pxMbedtlsCertCtx,
+                                                               pxCertificate->pucBuffer,
+                                                               pxCertificate->uxLen );
 
                MBEDTLS_LOG_IF_ERROR( lError, "Failed to parse certificate from buffer: 0x%08X, length: %ld,",
                                      pxCertificate->pucBuffer, pxCertificate->uxLen );
@@ -344,6 +387,11 @@ PkiStatus_t xPkiWriteCertificate( const char * pcCertLabel,
             break;
     }
 
+    if( xStatus == PKI_SUCCESS )
+    {
+        vPkiBumpGeneration();
+    }
+
     return xStatus;
 }
 
@@ -416,6 +464,51 @@ PkiStatus_t xPkiWritePubKey( const char * pcPubKeyLabel,
             break;
     }
 
+    if( xStatus == PKI_SUCCESS )
+    {
+        vPkiBumpGeneration();
+    }
+
+    return xStatus;
+}
+
+/*-----------------------------------------------------------*/
+
+PkiStatus_t xPkiWritePrvKey( const char * pcPrvKeyLabel,
+                             const mbedtls_pk_context * pxPkContext )
+{
+    PkiStatus_t xStatus = PKI_SUCCESS;
+    PkiObject_t xPrvKeyObject = { 0 };
+
+    configASSERT( pcPrvKeyLabel != NULL );
+    configASSERT( pxPkContext != NULL );
+
+    xPrvKeyObject = xPkiObjectFromLabel( pcPrvKeyLabel );
+
+    switch( xPrvKeyObject.xForm )
+    {
+#ifdef MBEDTLS_TRANSPORT_PKCS11
+        case OBJ_FORM_PKCS11_LABEL:
+            xStatus = xPkcs11WritePrvKey( xPrvKeyObject.pcPkcs11Label, pxPkContext );
+            break;
+#endif /* ifdef MBEDTLS_TRANSPORT_PKCS11 */
+
+        case OBJ_FORM_NONE:
+            LogError( "Invalid private key form specified." );
+            xStatus = PKI_ERR_ARG_INVALID;
+            break;
+
+        default:
+            LogError( "Importing a private key is not supported for this key form." );
+            xStatus = PKI_ERR_NOT_IMPLEMENTED;
+            break;
+    }
+
+    if( xStatus == PKI_SUCCESS )
+    {
+        vPkiBumpGeneration();
+    }
+
     return xStatus;
 }
 
@@ -768,5 +861,10 @@ PkiStatus_t xPkiGenerateECKeypair( const char * pcPrvKeyLabel,
         }
     }
 
+    if( xStatus == PKI_SUCCESS )
+    {
+        vPkiBumpGeneration();
+    }
+
     return xStatus;
 }
@@ -23,9 +23,11 @@
 
 #include "logging_levels.h"
 #define LOG_LEVEL    LOG_DEBUG
+#define LOG_MODULE    LOG_MODULE_PKCS11
 #include "logging.h"
 
 #include "FreeRTOS.h"
+#include "task.h"
 
 #include <string.h>
 #include <stdlib.h>
@@ -56,6 +58,35 @@
 #include "pk_wrap.h"
 #include "mbedtls/ecp.h"
 
+/* Number of idle PKCS#11 sessions kept open for later key and certificate reads */
+#ifndef PKI_PKCS11_SESSION_POOL_LEN
+#define PKI_PKCS11_SESSION_POOL_LEN    2
+#endif
+
+/* Number of label to object handle lookups remembered */
+#ifndef PKI_PKCS11_HANDLE_CACHE_LEN
+#define PKI_PKCS11_HANDLE_CACHE_LEN    4
+#endif
+
+typedef struct Pkcs11PooledSession
+{
+    CK_SESSION_HANDLE xSession; /* CK_INVALID_HANDLE if the slot is empty */
+    BaseType_t xInUse;
+} Pkcs11PooledSession_t;
+
+typedef struct Pkcs11HandleCacheEntry
+{
+    CK_OBJECT_HANDLE xHandle; /* CK_INVALID_HANDLE if the entry is unused */
+    CK_OBJECT_CLASS xClass;
+    uint32_t ulGeneration;    /* ulPkiGetGeneration() when xHandle was looked up */
+    size_t uxLabelLen;
+    char pcLabel[ pkcs11configMAX_LABEL_LENGTH + 1 ];
+} Pkcs11HandleCacheEntry_t;
+
+static Pkcs11PooledSession_t xSessionPool[ PKI_PKCS11_SESSION_POOL_LEN ] = { 0 };
+
+static Pkcs11HandleCacheEntry_t xHandleCache[ PKI_PKCS11_HANDLE_CACHE_LEN ] = { 0 };
+static size_t uxHandleCacheNext = 0;
 
 static CK_RV xPrvExportPubKeyDer( CK_SESSION_HANDLE xSession,
                                   CK_OBJECT_HANDLE xPublicKeyHandle,
@@ -226,6 +257,152 @@ PkiStatus_t xPrvCkRvToPkiStatus( CK_RV xError )
 
 /*-----------------------------------------------------------*/
 
+CK_RV xPkcs11AcquireSession( CK_SESSION_HANDLE_PTR pxSession )
+{
+    CK_RV xResult = CKR_OK;
+
+    configASSERT( pxSession != NULL );
+
+    *pxSession = CK_INVALID_HANDLE;
+
+    taskENTER_CRITICAL();
+
+    for( size_t uxIdx = 0; uxIdx < PKI_PKCS11_SESSION_POOL_LEN; uxIdx++ )
+    {
+        if( ( xSessionPool[ uxIdx ].xSession != CK_INVALID_HANDLE ) &&
+            ( xSessionPool[ uxIdx ].xInUse == pdFALSE ) )
+        {
+            xSessionPool[ uxIdx ].xInUse = pdTRUE;
+            *pxSession = xSessionPool[ uxIdx ].xSession;
+            break;
+        }
+    }
+
+    taskEXIT_CRITICAL();
+
+    if( *pxSession == CK_INVALID_HANDLE )
+    {
+        xResult = xInitializePkcs11Session( pxSession );
+    }
+
+    return xResult;
+}
+
+/*-----------------------------------------------------------*/
+
+void vPkcs11ReleaseSession( CK_SESSION_HANDLE xSession )
+{
+    BaseType_t xPooled = pdFALSE;
+
+    if( xSession != CK_INVALID_HANDLE )
+    {
+        taskENTER_CRITICAL();
+
+        for( size_t uxIdx = 0; uxIdx < PKI_PKCS11_SESSION_POOL_LEN; uxIdx++ )
+        {
+            if( xSessionPool[ uxIdx ].xSession == xSession )
+            {
+                xSessionPool[ uxIdx ].xInUse = pdFALSE;
+                xPooled = pdTRUE;
+                break;
+            }
+        }
+
+        for( size_t uxIdx = 0; ( xPooled == pdFALSE ) && ( uxIdx < PKI_PKCS11_SESSION_POOL_LEN ); uxIdx++ )
+        {
+            if( xSessionPool[ uxIdx ].xSession == CK_INVALID_HANDLE )
+            {
+                xSessionPool[ uxIdx ].xSession = xSession;
+                xSessionPool[ uxIdx ].xInUse = pdFALSE;
+                xPooled = pdTRUE;
+            }
+        }
+
+        taskEXIT_CRITICAL();
+    }
+
+    if( ( xSession != CK_INVALID_HANDLE ) &&
+        ( xPooled == pdFALSE ) )
+    {
+        CK_FUNCTION_LIST_PTR pxFunctionList = NULL;
+
+        if( ( C_GetFunctionList( &pxFunctionList ) == CKR_OK ) &&
+            ( pxFunctionList != NULL ) )
+        {
+            ( void ) pxFunctionList->C_CloseSession( xSession );
+        }
+    }
+}
+
+/*-----------------------------------------------------------*/
+
+CK_RV xPkcs11FindObjectCached( CK_SESSION_HANDLE xSession,
+                               const char * pcLabel,
+                               size_t uxLabelLen,
+                               CK_OBJECT_CLASS xClass,
+                               CK_OBJECT_HANDLE_PTR pxHandle )
+{
+    CK_RV xResult = CKR_OK;
+    char pcLabelBuffer[ pkcs11configMAX_LABEL_LENGTH + 1 ] = { 0 };
+    uint32_t ulGeneration = ulPkiGetGeneration();
+
+    configASSERT( pcLabel != NULL );
+    configASSERT( pxHandle != NULL );
+    configASSERT( uxLabelLen <= pkcs11configMAX_LABEL_LENGTH );
+
+    *pxHandle = CK_INVALID_HANDLE;
+
+    taskENTER_CRITICAL();
+
+    for( size_t uxIdx = 0; uxIdx < PKI_PKCS11_HANDLE_CACHE_LEN; uxIdx++ )
+    {
+        const Pkcs11HandleCacheEntry_t * pxEntry = &( xHandleCache[ uxIdx ] );
+
+        if( ( pxEntry->xHandle != CK_INVALID_HANDLE ) &&
+            ( pxEntry->ulGeneration == ulGeneration ) &&
+            ( pxEntry->xClass == xClass ) &&
+            ( pxEntry->uxLabelLen == uxLabelLen ) &&
+            ( memcmp( pxEntry->pcLabel, pcLabel, uxLabelLen ) == 0 ) )
+        {
+            *pxHandle = pxEntry->xHandle;
+            break;
+        }
+    }
+
+    taskEXIT_CRITICAL();
+
+    if( *pxHandle == CK_INVALID_HANDLE )
+    {
+        ( void ) memcpy( pcLabelBuffer, pcLabel, uxLabelLen );
+
+        xResult = xFindObjectWithLabelAndClass( xSession,
+                                                pcLabelBuffer, uxLabelLen,
+                                                xClass, pxHandle );
+
+        if( ( xResult == CKR_OK ) &&
+            ( *pxHandle != CK_INVALID_HANDLE ) )
+        {
+            taskENTER_CRITICAL();
+
+            Pkcs11HandleCacheEntry_t * pxEntry = &( xHandleCache[ uxHandleCacheNext ] );
+
+            uxHandleCacheNext = ( uxHandleCacheNext + 1 ) % PKI_PKCS11_HANDLE_CACHE_LEN;
+
+            pxEntry->xHandle = *pxHandle;
+            pxEntry->xClass = xClass;
+            pxEntry->ulGeneration = ulGeneration;
+            pxEntry->uxLabelLen = uxLabelLen;
+            ( void ) memcpy( pxEntry->pcLabel, pcLabelBuffer, sizeof( pxEntry->pcLabel ) );
+
+            taskEXIT_CRITICAL();
+        }
+    }
+
+    return xResult;
+}
+
+/*-----------------------------------------------------------*/
+
 PkiStatus_t xPkcs11InitMbedtlsPkContext( const char * pcLabel,
                                          mbedtls_pk_context * pxPkCtx,
                                          CK_SESSION_HANDLE_PTR pxSessionHandle )
@@ -261,7 +438,7 @@ PkiStatus_t xPkcs11InitMbedtlsPkContext( const char * pcLabel,
         CK_OBJECT_HANDLE xPkHandle = CK_INVALID_HANDLE;
         CK_RV xResult;
 
-        xResult = xInitializePkcs11Session( &xSession );
+        xResult = xPkcs11AcquireSession( &xSession );
 
         if( xResult != CKR_OK )
         {
@@ -273,9 +450,9 @@ PkiStatus_t xPkcs11InitMbedtlsPkContext( const char * pcLabel,
 
         if( xStatus == PKI_SUCCESS )
         {
-            xResult = xFindObjectWithLabelAndClass( xSession,
-                                                    pcLabelBuffer, uxLabelLen,
-                                                    CKO_PRIVATE_KEY, &xPkHandle );
+            xResult = xPkcs11FindObjectCached( xSession,
+                                               pcLabelBuffer, uxLabelLen,
+                                               CKO_PRIVATE_KEY, &xPkHandle );
 
             if( ( xResult != CKR_OK ) ||
                 ( xPkHandle == CK_INVALID_HANDLE ) )
@@ -292,11 +469,19 @@ PkiStatus_t xPkcs11InitMbedtlsPkContext( const char * pcLabel,
             xStatus = xPrvCkRvToPkiStatus( xResult );
         }
 
-        if( ( xStatus == PKI_SUCCESS ) &&
-            ( pxSessionHandle != NULL ) )
+        /* On success the session belongs to pxPkCtx until it is freed */
+        if( xStatus != PKI_SUCCESS )
+        {
+            vPkcs11ReleaseSession( xSession );
+        }
+        else if( pxSessionHandle != NULL )
         {
             *pxSessionHandle = xSession;
         }
+        else
+        {
+            /* Empty */
+        }
     }
 
     return xStatus;
@@ -400,7 +585,7 @@ PkiStatus_t xPkcs11ReadCertificate( mbedtls_x509_crt * pxCertificateContext,
 {
     CK_FUNCTION_LIST_PTR pxFunctionList = NULL;
     PkiStatus_t xStatus = PKI_SUCCESS;
-    CK_SESSION_HANDLE xSession;
+    CK_SESSION_HANDLE xSession = CK_INVALID_HANDLE;
     size_t uxLabelLen = 0;
 
     if( !pcLabel )
@@ -439,7 +624,7 @@ PkiStatus_t xPkcs11ReadCertificate( mbedtls_x509_crt * pxCertificateContext,
 
     if( xStatus == PKI_SUCCESS )
     {
-        CK_RV xResult = xInitializePkcs11Session( &xSession );
+        CK_RV xResult = xPkcs11AcquireSession( &xSession );
 
         if( xResult != CKR_OK )
         {
@@ -465,9 +650,9 @@ PkiStatus_t xPkcs11ReadCertificate( mbedtls_x509_crt * pxCertificateContext,
         xStatus = xPrvMbedtlsErrToPkiStatus( lRslt );
     }
 
-    if( pxFunctionList && xSession )
+    if( xSession != CK_INVALID_HANDLE )
     {
-        pxFunctionList->C_CloseSession( xSession );
+        vPkcs11ReleaseSession( xSession );
     }
 
     return xStatus;
@@ -749,4 +934,95 @@ PkiStatus_t xPkcs11WritePubKey( const char * pcLabel,
     return xStatus;
 }
 
+/*-----------------------------------------------------------*/
+
+PkiStatus_t xPkcs11WritePrvKey( const char * pcLabel,
+                                const mbedtls_pk_context * pxPrvKeyContext )
+{
+    char pcLabelBuffer[ pkcs11configMAX_LABEL_LENGTH + 1 ];
+    CK_FUNCTION_LIST_PTR pxFunctionList = NULL;
+    PkiStatus_t xStatus = PKI_SUCCESS;
+    CK_SESSION_HANDLE xSession = 0;
+    size_t uxLabelLen = 0;
+    CK_RV xResult = CKR_OK;
+
+
+    if( !pcLabel )
+    {
+        xStatus = PKI_ERR_ARG_INVALID;
+        LogError( "pcLabel cannot be NULL." );
+    }
+    else if( !pxPrvKeyContext )
+    {
+        xStatus = PKI_ERR_ARG_INVALID;
+        LogError( "pxPrvKeyContext cannot be NULL." );
+    }
+    else
+    {
+        uxLabelLen = strnlen( pcLabel, pkcs11configMAX_LABEL_LENGTH );
+        ( void ) strncpy( pcLabelBuffer, pcLabel, pkcs11configMAX_LABEL_LENGTH + 1 );
+    }
+
+    if( uxLabelLen == 0 )
+    {
+        xStatus = PKI_ERR_ARG_INVALID;
+        LogError( "pcLabel must have a length > 0." );
+    }
+    else
+    {
+        xResult = C_GetFunctionList( &pxFunctionList );
+    }
+
+    if( xResult != CKR_OK )
+    {
+        LogError( "Failed to get PKCS11 function list pointer. CK_RV: %s",
+                  pcPKCS11StrError( xResult ) );
+
+        xStatus = xPrvCkRvToPkiStatus( xResult );
+    }
+
+    if( xStatus == PKI_SUCCESS )
+    {
+        xResult = xInitializePkcs11Session( &xSession );
+
+        if( xResult != CKR_OK )
+        {
+            LogError( "Failed to initialize PKCS11 session. CK_RV: %s",
+                      pcPKCS11StrError( xResult ) );
+
+            xStatus = xPrvCkRvToPkiStatus( xResult );
+        }
+    }
+
+    if( xStatus == PKI_SUCCESS )
+    {
+        xResult = xPrvDestoryObject( xSession, CKO_PRIVATE_KEY, pcLabelBuffer, uxLabelLen );
+
+        if( xResult != CKR_OK )
+        {
+            LogError( "Failed to delete existing PKCS11 object. CK_RV: %s",
+                      pcPKCS11StrError( xResult ) );
+
+            xStatus = xPrvCkRvToPkiStatus( xResult );
+        }
+    }
+
+    if( xStatus == PKI_SUCCESS )
+    {
+        int lRslt = lWriteEcPrivateKeyToPKCS11( pxPrvKeyContext,
+                                                xSession,
+                                                pcLabelBuffer, uxLabelLen );
+
+        xStatus = xPrvMbedtlsErrToPkiStatus( lRslt );
+    }
+
+    if( xSession )
+    {
+        pxFunctionList->C_CloseSession( xSession );
+        xSession = 0;
+    }
+
+    return xStatus;
+}
+
 #endif /* MBEDTLS_TRANSPORT_PKCS11 */
@@ -23,6 +23,7 @@
 
 #include "logging_levels.h"
 #define LOG_LEVEL    LOG_DEBUG
+#define LOG_MODULE    LOG_MODULE_PKCS11
 #include "logging.h"
 
 #include "tls_transport_config.h"
@@ -40,6 +41,7 @@
 #define MBEDTLS_ALLOW_PRIVATE_ACCESS
 
 #include "mbedtls_transport.h"
+#include "PkiObject_prv.h"
 
 /* Mbedtls includes */
 #include "mbedtls/x509_crt.h"
@@ -67,6 +69,16 @@ psa_key_handle_t xOTACodeVerifyKeyHandle = ( psa_key_handle_t ) OTA_SIGNING_KEY_
 psa_status_t xReadPublicKeyFromPSACrypto( unsigned char ** ppucPubKeyDer,
                                           size_t * puxPubDerKeyLen,
                                           psa_key_id_t xKeyId )
+{
+    return xReadPublicKeyAndAttrsFromPSACrypto( ppucPubKeyDer, puxPubDerKeyLen, xKeyId, NULL );
+}
+
+/*-----------------------------------------------------------*/
+
+psa_status_t xReadPublicKeyAndAttrsFromPSACrypto( unsigned char ** ppucPubKeyDer,
+                                                  size_t * puxPubDerKeyLen,
+                                                  psa_key_id_t xKeyId,
+                                                  psa_key_attributes_t * pxKeyAttrs )
 {
     psa_status_t xStatus = PSA_SUCCESS;
     psa_key_attributes_t xKeyAttrs = PSA_KEY_ATTRIBUTES_INIT;
@@ -347,6 +359,12 @@ psa_status_t xReadPublicKeyFromPSACrypto( unsigned char ** ppucPubKeyDer,
         }
 
         *puxPubDerKeyLen = uxBytesWritten;
+
+        /* Saves the caller another secure call to read them */
+        if( pxKeyAttrs != NULL )
+        {
+            *pxKeyAttrs = xKeyAttrs;
+        }
     }
 
     if( xStatus != PSA_SUCCESS )
@@ -541,23 +559,23 @@ int32_t lReadCertificateFromPSACrypto( mbedtls_x509_crt * pxCertificateContext,
 int32_t lWriteCertificateToPsaIts( psa_storage_uid_t xCertUid,
                                    const mbedtls_x509_crt * pxCertificateContext )
 {
-    psa_status_t xStatus;
+    int32_t lError;
 
     if( ( pxCertificateContext == NULL ) ||
         ( pxCertificateContext->raw.p == NULL ) ||
         ( pxCertificateContext->raw.len == 0 ) )
     {
-        xStatus = PSA_ERROR_INVALID_ARGUMENT;
+        lError = mbedtls_psa_err_translate_pk( PSA_ERROR_INVALID_ARGUMENT );
     }
     else
     {
-        xStatus = psa_its_set( xCertUid,
-                               pxCertificateContext->raw.len,
-                               pxCertificateContext->raw.p,
-                               PSA_STORAGE_FLAG_NONE );
+        /* Keeps the NS object cache of mbedtls_pk_psa.c coherent */
+        lError = lWriteObjectToPsaIts( xCertUid,
+                                       pxCertificateContext->raw.p,
+                                       pxCertificateContext->raw.len );
     }
 
-    return mbedtls_psa_err_translate_pk( xStatus );
+    return lError;
 }
 
 /*-----------------------------------------------------------*/
@@ -604,6 +622,7 @@ int32_t lReadCertificateFromPsaIts( mbedtls_x509_crt * pxCertificateContext,
              */
             if( lError == 0 )
             {
+                vPrvX509CrtTakeBuffer( pxCertificateContext );
                 pucCertBuffer = NULL;
             }
         }
@@ -623,23 +642,23 @@ int32_t lReadCertificateFromPsaIts( mbedtls_x509_crt * pxCertificateContext,
 int32_t lWriteCertificateToPsaPS( psa_storage_uid_t xCertUid,
                                   const mbedtls_x509_crt * pxCertificateContext )
 {
-    psa_status_t xStatus;
+    int32_t lError;
 
     if( ( pxCertificateContext == NULL ) ||
         ( pxCertificateContext->raw.p == NULL ) ||
         ( pxCertificateContext->raw.len == 0 ) )
     {
-        xStatus = PSA_ERROR_INVALID_ARGUMENT;
+        lError = mbedtls_psa_err_translate_pk( PSA_ERROR_INVALID_ARGUMENT );
     }
     else
     {
-        xStatus = psa_ps_set( xCertUid,
-                              pxCertificateContext->raw.len,
-                              pxCertificateContext->raw.p,
-                              PSA_STORAGE_FLAG_NONE );
+        /* Keeps the NS object cache of mbedtls_pk_psa.c coherent */
+        lError = lWriteObjectToPsaPs( xCertUid,
+                                      pxCertificateContext->raw.p,
+                                      pxCertificateContext->raw.len );
     }
 
-    return mbedtls_psa_err_translate_pk( xStatus );
+    return lError;
 }
 
 /*-----------------------------------------------------------*/
@@ -686,6 +705,7 @@ int32_t lReadCertificateFromPsaPS( mbedtls_x509_crt * pxCertificateContext,
              */
             if( lError == 0 )
             {
+                vPrvX509CrtTakeBuffer( pxCertificateContext );
                 pucCertBuffer = NULL;
             }
         }
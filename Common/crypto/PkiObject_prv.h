@@ -30,8 +30,25 @@
 #ifdef MBEDTLS_TRANSPORT_PKCS11
 #include "pkcs11.h"
 PkiStatus_t xPrvCkRvToPkiStatus( CK_RV xError );
+
+/**
+ * @brief xFindObjectWithLabelAndClass, remembering the result until the next
+ * ulPkiGetGeneration() change.
+ */
+CK_RV xPkcs11FindObjectCached( CK_SESSION_HANDLE xSession,
+                               const char * pcLabel,
+                               size_t uxLabelLen,
+                               CK_OBJECT_CLASS xClass,
+                               CK_OBJECT_HANDLE_PTR pxHandle );
 #endif
 
 PkiStatus_t xPrvMbedtlsErrToPkiStatus( int lError );
 
+/**
+ * @brief Transfer ownership of the buffer of the last certificate in a chain
+ * after mbedtls_x509_crt_parse_der_nocopy, so that mbedtls_x509_crt_free
+ * releases it with mbedtls_free.
+ */
+void vPrvX509CrtTakeBuffer( mbedtls_x509_crt * pxCertChain );
+
 #endif /* _PKI_OBJECT_PRV_H */
@@ -0,0 +1,250 @@
+/*
+ * FreeRTOS STM32 Reference Integration
+ * Copyright (C) 2021 Amazon.com, Inc. or its affiliates.  All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ * http://www.FreeRTOS.org
+ * http://aws.amazon.com/freertos
+ *
+
+ */
+
+/*
+ * ChaCha20 (RFC 8439) for the mbedtls ChaCha20-Poly1305 cipher suites.
+ *
+ * The mbedtls implementation serializes each keystream block and XORs it one
+ * byte at a time. Here the 20 rounds run on locals, the keystream stays in
+ * native little endian words and whole blocks are XORed a word at a time,
+ * using the unaligned access support of the Cortex-M33.
+ */
+
+#include <string.h>
+
+#include "mbedtls/build_info.h"
+
+#if defined( MBEDTLS_CHACHA20_C ) && defined( MBEDTLS_CHACHA20_ALT )
+
+#include "mbedtls/chacha20.h"
+#include "mbedtls/platform_util.h"
+
+#include "ram_sections.h"
+
+#if defined( __BYTE_ORDER__ ) && ( __BYTE_ORDER__ != __ORDER_LITTLE_ENDIAN__ )
+#error "chacha20_alt.c requires a little endian target"
+#endif
+
+#define CHACHA20_BLOCK_LEN      64
+#define CHACHA20_CTR_INDEX      12
+
+#define CHACHA20_ROTL( x, n )    ( ( ( x ) << ( n ) ) | ( ( x ) >> ( 32 - ( n ) ) ) )
+
+#define CHACHA20_QUARTER_ROUND( a, b, c, d )                  \
+    do {                                                      \
+        a += b; d ^= a; d = CHACHA20_ROTL( d, 16 );           \
+        c += d; b ^= c; b = CHACHA20_ROTL( b, 12 );           \
+        a += b; d ^= a; d = CHACHA20_ROTL( d, 8 );            \
+        c += d; b ^= c; b = CHACHA20_ROTL( b, 7 );            \
+    } while( 0 )
+
+/*-----------------------------------------------------------*/
+
+static inline uint32_t ulLoad32( const uint8_t * pucIn )
+{
+    uint32_t ulValue;
+
+    ( void ) memcpy( &ulValue, pucIn, sizeof( ulValue ) );
+
+    return ulValue;
+}
+
+static inline void vStore32( uint8_t * pucOut,
+                             uint32_t ulValue )
+{
+    ( void ) memcpy( pucOut, &ulValue, sizeof( ulValue ) );
+}
+
+/* Compute the keystream block for the current counter and advance it. */
+RAM_FUNC static void prvChaCha20Block( uint32_t pulState[ 16 ],
+                                       uint32_t pulKeystream[ 16 ] )
+{
+    uint32_t x0 = pulState[ 0 ], x1 = pulState[ 1 ], x2 = pulState[ 2 ], x3 = pulState[ 3 ];
+    uint32_t x4 = pulState[ 4 ], x5 = pulState[ 5 ], x6 = pulState[ 6 ], x7 = pulState[ 7 ];
+    uint32_t x8 = pulState[ 8 ], x9 = pulState[ 9 ], x10 = pulState[ 10 ], x11 = pulState[ 11 ];
+    uint32_t x12 = pulState[ 12 ], x13 = pulState[ 13 ], x14 = pulState[ 14 ], x15 = pulState[ 15 ];
+
+    for( uint32_t i = 0; i < 10; i++ )
+    {
+        /* Column round */
+        CHACHA20_QUARTER_ROUND( x0, x4, x8, x12 );
+        CHACHA20_QUARTER_ROUND( x1, x5, x9, x13 );
+        CHACHA20_QUARTER_ROUND( x2, x6, x10, x14 );
+        CHACHA20_QUARTER_ROUND( x3, x7, x11, x15 );
+
+        /* Diagonal round */
+        CHACHA20_QUARTER_ROUND( x0, x5, x10, x15 );
+        CHACHA20_QUARTER_ROUND( x1, x6, x11, x12 );
+        CHACHA20_QUARTER_ROUND( x2, x7, x8, x13 );
+        CHACHA20_QUARTER_ROUND( x3, x4, x9, x14 );
+    }
+
+    pulKeystream[ 0 ] = x0 + pulState[ 0 ];
+    pulKeystream[ 1 ] = x1 + pulState[ 1 ];
+    pulKeystream[ 2 ] = x2 + pulState[ 2 ];
+    pulKeystream[ 3 ] = x3 + pulState[ 3 ];
+    pulKeystream[ 4 ] = x4 + pulState[ 4 ];
+    pulKeystream[ 5 ] = x5 + pulState[ 5 ];
+    pulKeystream[ 6 ] = x6 + pulState[ 6 ];
+    pulKeystream[ 7 ] = x7 + pulState[ 7 ];
+    pulKeystream[ 8 ] = x8 + pulState[ 8 ];
+    pulKeystream[ 9 ] = x9 + pulState[ 9 ];
+    pulKeystream[ 10 ] = x10 + pulState[ 10 ];
+    pulKeystream[ 11 ] = x11 + pulState[ 11 ];
+    pulKeystream[ 12 ] = x12 + pulState[ 12 ];
+    pulKeystream[ 13 ] = x13 + pulState[ 13 ];
+    pulKeystream[ 14 ] = x14 + pulState[ 14 ];
+    pulKeystream[ 15 ] = x15 + pulState[ 15 ];
+
+    pulState[ CHACHA20_CTR_INDEX ]++;
+}
+
+/*-----------------------------------------------------------*/
+
+void mbedtls_chacha20_init( mbedtls_chacha20_context * ctx )
+{
+    mbedtls_platform_zeroize( ctx, sizeof( mbedtls_chacha20_context ) );
+
+    /* No keystream until the first block is computed */
+    ctx->uxKeystreamBytesUsed = CHACHA20_BLOCK_LEN;
+}
+
+void mbedtls_chacha20_free( mbedtls_chacha20_context * ctx )
+{
+    if( ctx != NULL )
+    {
+        mbedtls_platform_zeroize( ctx, sizeof( mbedtls_chacha20_context ) );
+    }
+}
+
+int mbedtls_chacha20_setkey( mbedtls_chacha20_context * ctx,
+                             const unsigned char key[ 32 ] )
+{
+    /* "expand 32-byte k" */
+    ctx->ulState[ 0 ] = 0x61707865;
+    ctx->ulState[ 1 ] = 0x3320646e;
+    ctx->ulState[ 2 ] = 0x79622d32;
+    ctx->ulState[ 3 ] = 0x6b206574;
+
+    for( size_t i = 0; i < 8; i++ )
+    {
+        ctx->ulState[ 4 + i ] = ulLoad32( &key[ 4 * i ] );
+    }
+
+    return 0;
+}
+
+int mbedtls_chacha20_starts( mbedtls_chacha20_context * ctx,
+                             const unsigned char nonce[ 12 ],
+                             uint32_t counter )
+{
+    ctx->ulState[ CHACHA20_CTR_INDEX ] = counter;
+    ctx->ulState[ 13 ] = ulLoad32( &nonce[ 0 ] );
+    ctx->ulState[ 14 ] = ulLoad32( &nonce[ 4 ] );
+    ctx->ulState[ 15 ] = ulLoad32( &nonce[ 8 ] );
+
+    mbedtls_platform_zeroize( &( ctx->xKeystream ), sizeof( ctx->xKeystream ) );
+    ctx->uxKeystreamBytesUsed = CHACHA20_BLOCK_LEN;
+
+    return 0;
+}
+
+int mbedtls_chacha20_update( mbedtls_chacha20_context * ctx,
+                             size_t size,
+                             const unsigned char * input,
+                             unsigned char * output )
+{
+    size_t uxOffset = 0;
+
+    /* Use the rest of the previous block first */
+    while( ( size > 0 ) && ( ctx->uxKeystreamBytesUsed < CHACHA20_BLOCK_LEN ) )
+    {
+        output[ uxOffset ] = input[ uxOffset ] ^ ctx->xKeystream.ucBytes[ ctx->uxKeystreamBytesUsed ];
+        ctx->uxKeystreamBytesUsed++;
+        uxOffset++;
+        size--;
+    }
+
+    while( size >= CHACHA20_BLOCK_LEN )
+    {
+        prvChaCha20Block( ctx->ulState, ctx->xKeystream.ulWords );
+
+        for( size_t i = 0; i < 16; i++ )
+        {
+            vStore32( &output[ uxOffset + ( 4 * i ) ],
+                      ulLoad32( &input[ uxOffset + ( 4 * i ) ] ) ^ ctx->xKeystream.ulWords[ i ] );
+        }
+
+        uxOffset += CHACHA20_BLOCK_LEN;
+        size -= CHACHA20_BLOCK_LEN;
+    }
+
+    if( size > 0 )
+    {
+        prvChaCha20Block( ctx->ulState, ctx->xKeystream.ulWords );
+
+        for( size_t i = 0; i < size; i++ )
+        {
+            output[ uxOffset + i ] = input[ uxOffset + i ] ^ ctx->xKeystream.ucBytes[ i ];
+        }
+
+        ctx->uxKeystreamBytesUsed = size;
+    }
+
+    return 0;
+}
+
+int mbedtls_chacha20_crypt( const unsigned char key[ 32 ],
+                            const unsigned char nonce[ 12 ],
+                            uint32_t counter,
+                            size_t data_len,
+                            const unsigned char * input,
+                            unsigned char * output )
+{
+    mbedtls_chacha20_context xCtx;
+    int lError;
+
+    mbedtls_chacha20_init( &xCtx );
+
+    lError = mbedtls_chacha20_setkey( &xCtx, key );
+
+    if( lError == 0 )
+    {
+        lError = mbedtls_chacha20_starts( &xCtx, nonce, counter );
+    }
+
+    if( lError == 0 )
+    {
+        lError = mbedtls_chacha20_update( &xCtx, data_len, input, output );
+    }
+
+    mbedtls_chacha20_free( &xCtx );
+
+    return lError;
+}
+
+#endif /* MBEDTLS_CHACHA20_C && MBEDTLS_CHACHA20_ALT */
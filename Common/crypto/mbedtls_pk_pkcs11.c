@@ -40,6 +40,7 @@
 #include "mbedtls/asn1.h"
 #include "mbedtls/x509_crt.h"
 #include "mbedtls/platform.h"
+#include "mbedtls/platform_util.h"
 #include "mbedtls/asn1write.h"
 #include "mbedtls/ecdsa.h"
 #include "pk_wrap.h"
@@ -47,6 +48,8 @@
 #include "core_pkcs11_config.h"
 #include "core_pkcs11.h"
 
+#include "PkiObject_prv.h"
+
 
 typedef struct P11PkCtx
 {
@@ -230,11 +233,11 @@ int32_t lReadCertificateFromPKCS11( mbedtls_x509_crt * pxCertificateContext,
     if( xResult == CKR_OK )
     {
         /* Get the handle of the certificate. */
-        xResult = xFindObjectWithLabelAndClass( xP11SessionHandle,
-                                                pcCertLabelCopy,
-                                                xLabelLen,
-                                                CKO_CERTIFICATE,
-                                                &xCertObj );
+        xResult = xPkcs11FindObjectCached( xP11SessionHandle,
+                                           pcCertLabelCopy,
+                                           xLabelLen,
+                                           CKO_CERTIFICATE,
+                                           &xCertObj );
 
         if( xCertObj == CK_INVALID_HANDLE )
         {
@@ -278,9 +281,31 @@ int32_t lReadCertificateFromPKCS11( mbedtls_x509_crt * pxCertificateContext,
     /* Decode the certificate. */
     if( CKR_OK == xResult )
     {
-        lResult = mbedtls_x509_crt_parse( pxCertificateContext,
-                                          ( unsigned char * ) xTemplate.pValue,
-                                          xTemplate.ulValueLen );
+        const unsigned char * pucCert = ( const unsigned char * ) xTemplate.pValue;
+
+        /* Legacy objects may still hold a NULL terminated PEM blob */
+        if( ( xTemplate.ulValueLen != 0 ) &&
+            ( pucCert[ xTemplate.ulValueLen - 1 ] == '\0' ) &&
+            ( strstr( ( const char * ) pucCert, "-----BEGIN CERTIFICATE-----" ) != NULL ) )
+        {
+            lResult = mbedtls_x509_crt_parse( pxCertificateContext,
+                                              pucCert,
+                                              xTemplate.ulValueLen );
+        }
+        else
+        {
+            /* Parse the DER object in place rather than copying it again. */
+            lResult = mbedtls_x509_crt_parse_der_nocopy( pxCertificateContext,
+                                                         pucCert,
+                                                         xTemplate.ulValueLen );
+
+            if( lResult == 0 )
+            {
+                /* Hand the buffer over so that mbedtls_x509_crt_free releases it. */
+                vPrvX509CrtTakeBuffer( pxCertificateContext );
+                xTemplate.pValue = NULL;
+            }
+        }
     }
     else
     {
@@ -554,6 +579,123 @@ int32_t lWriteEcPublicKeyToPKCS11( const mbedtls_pk_context * pxPubKeyContext,
 
 /*-----------------------------------------------------------*/
 
+int32_t lWriteEcPrivateKeyToPKCS11( const mbedtls_pk_context * pxPrvKeyContext,
+                                    CK_SESSION_HANDLE xP11SessionHandle,
+                                    char * pcPrvKeyLabel,
+                                    size_t uxPrvKeyLabelLen )
+{
+    CK_RV xResult;
+    CK_OBJECT_HANDLE xKeyHandle = 0;
+    CK_FUNCTION_LIST_PTR pxFunctionList;
+    CK_BYTE pucPrivateValue[ 32 ] = { 0 };
+    static CK_BYTE pucEcParams[] = pkcs11DER_ENCODED_OID_P256;
+
+    configASSERT( pxPrvKeyContext );
+    configASSERT( pxPrvKeyContext->pk_ctx );
+    configASSERT( pxPrvKeyContext->pk_info );
+    configASSERT( xP11SessionHandle );
+    configASSERT( pcPrvKeyLabel );
+    configASSERT( uxPrvKeyLabelLen > 0 );
+
+    xResult = C_GetFunctionList( &pxFunctionList );
+
+    if( xResult == CKR_OK )
+    {
+        /* Look for an existing object that we may need to overwrite */
+        xResult = xFindObjectWithLabelAndClass( xP11SessionHandle,
+                                                pcPrvKeyLabel,
+                                                uxPrvKeyLabelLen,
+                                                CKO_PRIVATE_KEY,
+                                                &xKeyHandle );
+    }
+
+    if( ( xResult == CKR_OK ) &&
+        ( xKeyHandle != CK_INVALID_HANDLE ) )
+    {
+        xResult = pxFunctionList->C_DestroyObject( xP11SessionHandle,
+                                                   xKeyHandle );
+    }
+
+    /* Export the private value of a P-256 key as a 32 byte big endian integer */
+    if( xResult == CKR_OK )
+    {
+        mbedtls_ecp_keypair * pxEcpKey = ( mbedtls_ecp_keypair * ) ( pxPrvKeyContext->pk_ctx );
+
+        if( ( pxPrvKeyContext->pk_info->type == MBEDTLS_PK_ECKEY ) &&
+            ( pxEcpKey->grp.id == MBEDTLS_ECP_DP_SECP256R1 ) )
+        {
+            if( mbedtls_mpi_write_binary( &( pxEcpKey->d ),
+                                          pucPrivateValue,
+                                          sizeof( pucPrivateValue ) ) != 0 )
+            {
+                xResult = CKR_FUNCTION_FAILED;
+            }
+        }
+        else
+        {
+            xResult = CKR_FUNCTION_NOT_SUPPORTED;
+        }
+    }
+
+    if( xResult == CKR_OK )
+    {
+        CK_OBJECT_CLASS xObjClass = CKO_PRIVATE_KEY;
+        CK_KEY_TYPE xKeyType = CKK_EC;
+        CK_BBOOL xPersistKey = CK_TRUE;
+        CK_BBOOL xSign = CK_TRUE;
+
+        CK_ATTRIBUTE pxTemplate[ 7 ] =
+        {
+            {
+                .type = CKA_CLASS,
+                .ulValueLen = sizeof( CK_OBJECT_CLASS ),
+                .pValue = &xObjClass,
+            },
+            {
+                .type = CKA_KEY_TYPE,
+                .ulValueLen = sizeof( CK_KEY_TYPE ),
+                .pValue = &xKeyType,
+            },
+            {
+                .type = CKA_LABEL,
+                .ulValueLen = uxPrvKeyLabelLen,
+                .pValue = pcPrvKeyLabel,
+            },
+            {
+                .type = CKA_TOKEN,
+                .ulValueLen = sizeof( CK_BBOOL ),
+                .pValue = &xPersistKey,
+            },
+            {
+                .type = CKA_SIGN,
+                .ulValueLen = sizeof( CK_BBOOL ),
+                .pValue = &xSign,
+            },
+            {
+                .type = CKA_EC_PARAMS,
+                .ulValueLen = sizeof( pucEcParams ),
+                .pValue = pucEcParams,
+            },
+            {
+                .type = CKA_VALUE,
+                .ulValueLen = sizeof( pucPrivateValue ),
+                .pValue = pucPrivateValue,
+            }
+        };
+
+        xResult = pxFunctionList->C_CreateObject( xP11SessionHandle,
+                                                  pxTemplate,
+                                                  7,
+                                                  &xKeyHandle );
+    }
+
+    mbedtls_platform_zeroize( pucPrivateValue, sizeof( pucPrivateValue ) );
+
+    return( ( xResult == CKR_OK ) ? 0 : -1 );
+}
+
+/*-----------------------------------------------------------*/
+
 const char * pcPKCS11StrError( CK_RV xError )
 {
     switch( xError )
@@ -955,7 +1097,6 @@ int lPKCS11PkMbedtlsCloseSessionAndFree( mbedtls_pk_context * pxMbedtlsPkCtx )
 {
     CK_RV xResult = CKR_OK;
     P11PkCtx_t * pxP11Ctx = NULL;
-    CK_FUNCTION_LIST_PTR pxFunctionList = NULL;
 
     configASSERT( pxMbedtlsPkCtx );
 
@@ -970,17 +1111,7 @@ int lPKCS11PkMbedtlsCloseSessionAndFree( mbedtls_pk_context * pxMbedtlsPkCtx )
 
     if( xResult == CKR_OK )
     {
-        xResult = C_GetFunctionList( &pxFunctionList );
-    }
-
-    if( xResult == CKR_OK )
-    {
-        configASSERT( pxFunctionList );
-        xResult = pxFunctionList->C_CloseSession( pxP11Ctx->xSessionHandle );
-    }
-
-    if( xResult == CKR_OK )
-    {
+        vPkcs11ReleaseSession( pxP11Ctx->xSessionHandle );
         pxP11Ctx->xSessionHandle = CK_INVALID_HANDLE;
     }
 
@@ -1050,6 +1181,8 @@ static void p11_ecdsa_ctx_free( void * pvCtx )
     {
         P11EcDsaCtx_t * pxP11EcDsa = ( P11EcDsaCtx_t * ) pvCtx;
 
+        vPkcs11ReleaseSession( pxP11EcDsa->xP11PkCtx.xSessionHandle );
+
         mbedtls_ecdsa_free( &( pxP11EcDsa->xMbedEcDsaCtx ) );
 
         mbedtls_free( pvCtx );
@@ -1603,6 +1736,8 @@ static void p11_rsa_ctx_free( void * pvCtx )
     {
         P11RsaCtx_t * pxP11Rsa = ( P11RsaCtx_t * ) pvCtx;
 
+        vPkcs11ReleaseSession( pxP11Rsa->xP11PkCtx.xSessionHandle );
+
         mbedtls_rsa_free( &( pxP11Rsa->xMbedRsaCtx ) );
 
         mbedtls_free( pvCtx );
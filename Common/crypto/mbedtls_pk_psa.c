@@ -53,6 +53,51 @@
 
 #include "psa_util.h"
 
+#include "FreeRTOS.h"
+#include "task.h"
+#include "semphr.h"
+
+/*
+ * Objects read from ITS and PS through lReadObjectFromPsaIts and
+ * lReadObjectFromPsaPs are certificates and public keys, which need no
+ * protection from the non-secure side. Keeping a copy here saves a secure
+ * call and a flash read for each of them on every TLS connect. The entries
+ * are dropped by the write functions of this file, which every certificate
+ * and public key write goes through. Set PSA_OBJECT_CACHE_ENTRIES to 0 to
+ * always read from the secure side.
+ */
+#ifndef PSA_OBJECT_CACHE_ENTRIES
+#define PSA_OBJECT_CACHE_ENTRIES    4
+#endif
+
+/* Larger objects are not cached */
+#ifndef PSA_OBJECT_CACHE_MAX_LEN
+#define PSA_OBJECT_CACHE_MAX_LEN    4096
+#endif
+
+typedef enum
+{
+    PSA_OBJECT_ITS = 0,
+    PSA_OBJECT_PS
+} PsaObjectStore_t;
+
+#if PSA_OBJECT_CACHE_ENTRIES > 0
+typedef struct
+{
+    PsaObjectStore_t xStore;
+    psa_storage_uid_t xUid;
+    uint8_t * pucData; /* NULL for a free entry */
+    size_t uxLen;
+} PsaObjectCacheEntry_t;
+
+static PsaObjectCacheEntry_t xObjectCache[ PSA_OBJECT_CACHE_ENTRIES ] = { 0 };
+static SemaphoreHandle_t xObjectCacheMutex = NULL;
+static StaticSemaphore_t xObjectCacheMutexBuffer;
+
+/* Next entry to replace once all are in use */
+static size_t uxObjectCacheVictim = 0;
+#endif /* PSA_OBJECT_CACHE_ENTRIES > 0 */
+
 /* Forward declarations */
 static int psa_ecdsa_check_pair( const void * pvPub,
                                  const void * pvPrv,
@@ -84,6 +129,8 @@ typedef struct PsaPkCtx_t
 {
     mbedtls_ecdsa_context xEcdsaCtx;
     psa_key_id_t xKeyId;
+    size_t uxBits;       /* Key size, cached to avoid a secure call per query */
+    BaseType_t xCanSign; /* pdTRUE if xKeyId is a key pair usable with psa_sign_hash */
 } PsaPkCtx_t;
 
 
@@ -192,12 +239,197 @@ psa_status_t xReadObjectFromPSACrypto( unsigned char ** ppucObject,
 
 /*-----------------------------------------------------------*/
 
+#if PSA_OBJECT_CACHE_ENTRIES > 0
+
+static BaseType_t xObjectCacheLock( void )
+{
+    BaseType_t xLocked = pdFALSE;
+
+    if( xObjectCacheMutex == NULL )
+    {
+        taskENTER_CRITICAL();
+
+        if( xObjectCacheMutex == NULL )
+        {
+            xObjectCacheMutex = xSemaphoreCreateMutexStatic( &xObjectCacheMutexBuffer );
+        }
+
+        taskEXIT_CRITICAL();
+    }
+
+    if( xObjectCacheMutex != NULL )
+    {
+        xLocked = xSemaphoreTake( xObjectCacheMutex, portMAX_DELAY );
+    }
+
+    return xLocked;
+}
+
+/*-----------------------------------------------------------*/
+
+/* Called with xObjectCacheMutex held */
+static PsaObjectCacheEntry_t * pxObjectCacheFind( PsaObjectStore_t xStore,
+                                                  psa_storage_uid_t xUid )
+{
+    PsaObjectCacheEntry_t * pxEntry = NULL;
+
+    for( size_t i = 0; ( i < PSA_OBJECT_CACHE_ENTRIES ) && ( pxEntry == NULL ); i++ )
+    {
+        if( ( xObjectCache[ i ].pucData != NULL ) &&
+            ( xObjectCache[ i ].xStore == xStore ) &&
+            ( xObjectCache[ i ].xUid == xUid ) )
+        {
+            pxEntry = &( xObjectCache[ i ] );
+        }
+    }
+
+    return pxEntry;
+}
+
+/*-----------------------------------------------------------*/
+
+/* Called with xObjectCacheMutex held */
+static void vObjectCacheDrop( PsaObjectCacheEntry_t * pxEntry )
+{
+    mbedtls_free( pxEntry->pucData );
+    pxEntry->pucData = NULL;
+    pxEntry->uxLen = 0;
+}
+
+#endif /* PSA_OBJECT_CACHE_ENTRIES > 0 */
+
+/*-----------------------------------------------------------*/
+
+/* On a hit, return a copy owned by the caller, as a read from storage would */
+static BaseType_t xObjectCacheGet( PsaObjectStore_t xStore,
+                                   psa_storage_uid_t xUid,
+                                   uint8_t ** ppucData,
+                                   size_t * puxDataLen )
+{
+    BaseType_t xHit = pdFALSE;
+
+#if PSA_OBJECT_CACHE_ENTRIES > 0
+    if( xObjectCacheLock() == pdTRUE )
+    {
+        PsaObjectCacheEntry_t * pxEntry = pxObjectCacheFind( xStore, xUid );
+
+        if( pxEntry != NULL )
+        {
+            uint8_t * pucCopy = mbedtls_calloc( 1, pxEntry->uxLen );
+
+            if( pucCopy != NULL )
+            {
+                ( void ) memcpy( pucCopy, pxEntry->pucData, pxEntry->uxLen );
+                *ppucData = pucCopy;
+
+                if( puxDataLen != NULL )
+                {
+                    *puxDataLen = pxEntry->uxLen;
+                }
+
+                xHit = pdTRUE;
+            }
+        }
+
+        ( void ) xSemaphoreGive( xObjectCacheMutex );
+    }
+#else
+    ( void ) xStore;
+    ( void ) xUid;
+    ( void ) ppucData;
+    ( void ) puxDataLen;
+#endif /* PSA_OBJECT_CACHE_ENTRIES > 0 */
+
+    return xHit;
+}
+
+/*-----------------------------------------------------------*/
+
+static void vObjectCachePut( PsaObjectStore_t xStore,
+                             psa_storage_uid_t xUid,
+                             const uint8_t * pucData,
+                             size_t uxDataLen )
+{
+#if PSA_OBJECT_CACHE_ENTRIES > 0
+    if( ( uxDataLen > 0 ) &&
+        ( uxDataLen <= PSA_OBJECT_CACHE_MAX_LEN ) &&
+        ( xObjectCacheLock() == pdTRUE ) )
+    {
+        PsaObjectCacheEntry_t * pxEntry = pxObjectCacheFind( xStore, xUid );
+
+        for( size_t i = 0; ( i < PSA_OBJECT_CACHE_ENTRIES ) && ( pxEntry == NULL ); i++ )
+        {
+            if( xObjectCache[ i ].pucData == NULL )
+            {
+                pxEntry = &( xObjectCache[ i ] );
+            }
+        }
+
+        if( pxEntry == NULL )
+        {
+            pxEntry = &( xObjectCache[ uxObjectCacheVictim ] );
+            uxObjectCacheVictim = ( uxObjectCacheVictim + 1 ) % PSA_OBJECT_CACHE_ENTRIES;
+        }
+
+        if( pxEntry->pucData != NULL )
+        {
+            vObjectCacheDrop( pxEntry );
+        }
+
+        pxEntry->pucData = mbedtls_calloc( 1, uxDataLen );
+
+        if( pxEntry->pucData != NULL )
+        {
+            ( void ) memcpy( pxEntry->pucData, pucData, uxDataLen );
+            pxEntry->xStore = xStore;
+            pxEntry->xUid = xUid;
+            pxEntry->uxLen = uxDataLen;
+        }
+
+        ( void ) xSemaphoreGive( xObjectCacheMutex );
+    }
+#else
+    ( void ) xStore;
+    ( void ) xUid;
+    ( void ) pucData;
+    ( void ) uxDataLen;
+#endif /* PSA_OBJECT_CACHE_ENTRIES > 0 */
+}
+
+/*-----------------------------------------------------------*/
+
+static void vObjectCacheInvalidate( PsaObjectStore_t xStore,
+                                    psa_storage_uid_t xUid )
+{
+#if PSA_OBJECT_CACHE_ENTRIES > 0
+    if( xObjectCacheLock() == pdTRUE )
+    {
+        PsaObjectCacheEntry_t * pxEntry = pxObjectCacheFind( xStore, xUid );
+
+        if( pxEntry != NULL )
+        {
+            vObjectCacheDrop( pxEntry );
+        }
+
+        ( void ) xSemaphoreGive( xObjectCacheMutex );
+    }
+#else
+    ( void ) xStore;
+    ( void ) xUid;
+#endif /* PSA_OBJECT_CACHE_ENTRIES > 0 */
+}
+
+/*-----------------------------------------------------------*/
+
 int32_t lWriteObjectToPsaIts( psa_storage_uid_t xObjectUid,
                               const uint8_t * pucData,
                               size_t uxDataLen )
 {
     psa_status_t xStatus = PSA_SUCCESS;
 
+    /* Also on failure, the stored object may have changed */
+    vObjectCacheInvalidate( PSA_OBJECT_ITS, xObjectUid );
+
     xStatus = psa_its_set( xObjectUid, uxDataLen, pucData, PSA_STORAGE_FLAG_NONE );
 
     return mbedtls_psa_err_translate_pk( xStatus );
@@ -213,6 +445,7 @@ int32_t lReadObjectFromPsaIts( uint8_t ** ppucData,
     struct psa_storage_info_t xStorageInfo = { 0 };
     void * pvDataBuffer = NULL;
     size_t uxDataLen = 0;
+    BaseType_t xCached = pdFALSE;
 
     configASSERT( xObjectUid > 0 );
 
@@ -221,13 +454,21 @@ int32_t lReadObjectFromPsaIts( uint8_t ** ppucData,
         xStatus = PSA_ERROR_INVALID_ARGUMENT;
     }
 
-    if( xStatus == PSA_SUCCESS )
+    if( ( xStatus == PSA_SUCCESS ) &&
+        ( xObjectCacheGet( PSA_OBJECT_ITS, xObjectUid, ppucData, puxDataLen ) == pdTRUE ) )
+    {
+        xCached = pdTRUE;
+    }
+
+    if( ( xStatus == PSA_SUCCESS ) &&
+        ( xCached == pdFALSE ) )
     {
         /* Fetch key attributes to validate the storage id. */
         xStatus = psa_its_get_info( xObjectUid, &xStorageInfo );
     }
 
-    if( xStatus == PSA_SUCCESS )
+    if( ( xStatus == PSA_SUCCESS ) &&
+        ( xCached == pdFALSE ) )
     {
         pvDataBuffer = mbedtls_calloc( 1, xStorageInfo.size );
 
@@ -237,7 +478,8 @@ int32_t lReadObjectFromPsaIts( uint8_t ** ppucData,
         }
     }
 
-    if( xStatus == PSA_SUCCESS )
+    if( ( xStatus == PSA_SUCCESS ) &&
+        ( xCached == pdFALSE ) )
     {
         xStatus = psa_its_get( xObjectUid,
                                0,
@@ -246,8 +488,11 @@ int32_t lReadObjectFromPsaIts( uint8_t ** ppucData,
                                &uxDataLen );
     }
 
-    if( xStatus == PSA_SUCCESS )
+    if( ( xStatus == PSA_SUCCESS ) &&
+        ( xCached == pdFALSE ) )
     {
+        vObjectCachePut( PSA_OBJECT_ITS, xObjectUid, pvDataBuffer, uxDataLen );
+
         *ppucData = ( unsigned char * ) pvDataBuffer;
 
         if( puxDataLen != NULL )
@@ -255,6 +500,10 @@ int32_t lReadObjectFromPsaIts( uint8_t ** ppucData,
             *puxDataLen = uxDataLen;
         }
     }
+    else if( pvDataBuffer != NULL )
+    {
+        mbedtls_free( pvDataBuffer );
+    }
 
     return mbedtls_psa_err_translate_pk( xStatus );
 }
@@ -267,6 +516,9 @@ int32_t lWriteObjectToPsaPs( psa_storage_uid_t xObjectUid,
 {
     psa_status_t xStatus = PSA_SUCCESS;
 
+    /* Also on failure, the stored object may have changed */
+    vObjectCacheInvalidate( PSA_OBJECT_PS, xObjectUid );
+
     xStatus = psa_ps_set( xObjectUid, uxDataLen, pucData, PSA_STORAGE_FLAG_NONE );
 
     return mbedtls_psa_err_translate_pk( xStatus );
@@ -282,6 +534,7 @@ int32_t lReadObjectFromPsaPs( uint8_t ** ppucData,
     struct psa_storage_info_t xStorageInfo = { 0 };
     void * pvDataBuffer = NULL;
     size_t uxDataLen = 0;
+    BaseType_t xCached = pdFALSE;
 
     configASSERT( xObjectUid > 0 );
 
@@ -290,13 +543,21 @@ int32_t lReadObjectFromPsaPs( uint8_t ** ppucData,
         xStatus = PSA_ERROR_INVALID_ARGUMENT;
     }
 
-    if( xStatus == PSA_SUCCESS )
+    if( ( xStatus == PSA_SUCCESS ) &&
+        ( xObjectCacheGet( PSA_OBJECT_PS, xObjectUid, ppucData, puxDataLen ) == pdTRUE ) )
+    {
+        xCached = pdTRUE;
+    }
+
+    if( ( xStatus == PSA_SUCCESS ) &&
+        ( xCached == pdFALSE ) )
     {
         /* Fetch key attributes to validate the storage id. */
         xStatus = psa_ps_get_info( xObjectUid, &xStorageInfo );
     }
 
-    if( xStatus == PSA_SUCCESS )
+    if( ( xStatus == PSA_SUCCESS ) &&
+        ( xCached == pdFALSE ) )
     {
         pvDataBuffer = mbedtls_calloc( 1, xStorageInfo.size );
 
@@ -306,7 +567,8 @@ int32_t lReadObjectFromPsaPs( uint8_t ** ppucData,
         }
     }
 
-    if( xStatus == PSA_SUCCESS )
+    if( ( xStatus == PSA_SUCCESS ) &&
+        ( xCached == pdFALSE ) )
     {
         xStatus = psa_ps_get( xObjectUid,
                               0,
@@ -315,8 +577,11 @@ int32_t lReadObjectFromPsaPs( uint8_t ** ppucData,
                               &uxDataLen );
     }
 
-    if( xStatus == PSA_SUCCESS )
+    if( ( xStatus == PSA_SUCCESS ) &&
+        ( xCached == pdFALSE ) )
     {
+        vObjectCachePut( PSA_OBJECT_PS, xObjectUid, pvDataBuffer, uxDataLen );
+
         *ppucData = ( unsigned char * ) pvDataBuffer;
 
         if( puxDataLen != NULL )
@@ -324,6 +589,10 @@ int32_t lReadObjectFromPsaPs( uint8_t ** ppucData,
             *puxDataLen = uxDataLen;
         }
     }
+    else if( pvDataBuffer != NULL )
+    {
+        mbedtls_free( pvDataBuffer );
+    }
 
     return mbedtls_psa_err_translate_pk( xStatus );
 }
@@ -361,9 +630,11 @@ int32_t lPsa_initMbedtlsPkContext( mbedtls_pk_context * pxMbedtlsPkCtx,
     {
         unsigned char * pucPubKeyDer = NULL;
         size_t uxPubKeyLen = 0;
+        psa_key_attributes_t xKeyAttrs = PSA_KEY_ATTRIBUTES_INIT;
         psa_status_t xPsaStatus = PSA_SUCCESS;
 
-        xPsaStatus = xReadPublicKeyFromPSACrypto( &pucPubKeyDer, &uxPubKeyLen, pxPsaPk->xKeyId );
+        xPsaStatus = xReadPublicKeyAndAttrsFromPSACrypto( &pucPubKeyDer, &uxPubKeyLen,
+                                                          pxPsaPk->xKeyId, &xKeyAttrs );
 
         if( xPsaStatus != PSA_SUCCESS )
         {
@@ -371,6 +642,11 @@ int32_t lPsa_initMbedtlsPkContext( mbedtls_pk_context * pxMbedtlsPkCtx,
         }
         else
         {
+            pxPsaPk->uxBits = psa_get_key_bits( &xKeyAttrs );
+            pxPsaPk->xCanSign = ( PSA_KEY_TYPE_IS_KEY_PAIR( psa_get_key_type( &xKeyAttrs ) ) &&
+                                  ( ( psa_get_key_usage_flags( &xKeyAttrs ) & PSA_KEY_USAGE_SIGN_HASH ) != 0 ) ) ? pdTRUE : pdFALSE;
+            psa_reset_key_attributes( &xKeyAttrs );
+
             mbedtls_pk_context xPkContext = { 0 };
 
             mbedtls_pk_init( &xPkContext );
@@ -497,19 +773,12 @@ static int psa_ecdsa_sign( void * pvCtx,
 
 static size_t psa_ecdsa_get_bitlen( const void * pvCtx )
 {
-    PsaPkCtx_t * pxPsaCtx = ( PsaPkCtx_t * ) pvCtx;
-    psa_key_attributes_t attributes = PSA_KEY_ATTRIBUTES_INIT;
-    size_t bits = 0;
+    const PsaPkCtx_t * pxPsaCtx = ( const PsaPkCtx_t * ) pvCtx;
 
     configASSERT( pvCtx );
 
-    if( psa_get_key_attributes( pxPsaCtx->xKeyId, &attributes ) == PSA_SUCCESS )
-    {
-        bits = psa_get_key_bits( &attributes );
-        psa_reset_key_attributes( &attributes );
-    }
-
-    return( bits );
+    /* Read along with the public key in lPsa_initMbedtlsPkContext */
+    return( pxPsaCtx->uxBits );
 }
 
 /*-----------------------------------------------------------*/
@@ -569,30 +838,15 @@ static int psa_ecdsa_check_pair( const void * pvPub,
         lResult = mbedtls_mpi_cmp_mpi( &( xPubCtx.Q.Z ), &( xPrvCtx.xEcdsaCtx.Q.Z ) );
     }
 
-    /* Test sign op */
-    if( lResult == 0 )
+    /*
+     * xEcdsaCtx.Q was exported from the PSA key pair itself, so matching points
+     * prove the pairing. Only check that the key can sign rather than spending
+     * a secure ECDSA signature on a test hash.
+     */
+    if( ( lResult == 0 ) &&
+        ( xPrvCtx.xCanSign != pdTRUE ) )
     {
-        unsigned char pucTestHash[ 32 ] =
-        {
-            0x01, 0x02, 0x03, 0x04, 0x05, 0x06, 0x07, 0x08,
-            0x11, 0x12, 0x13, 0x14, 0x15, 0x16, 0x17, 0x18,
-            0x21, 0x22, 0x23, 0x24, 0x25, 0x26, 0x27, 0x28,
-            0x31, 0x32, 0x33, 0x34, 0x35, 0x36, 0x37, 0x38
-        };
-        unsigned char pucTestSignature[ MBEDTLS_ECDSA_MAX_SIG_LEN( 256 ) ] = { 0 };
-        size_t uxSigLen = 0;
-
-        lResult = psa_ecdsa_sign( &xPrvCtx, MBEDTLS_MD_SHA256,
-                                  pucTestHash, sizeof( pucTestHash ),
-                                  pucTestSignature, sizeof( pucTestSignature ), &uxSigLen,
-                                  NULL, NULL );
-
-        if( lResult == 0 )
-        {
-            lResult = mbedtls_ecdsa_read_signature( &xPubCtx,
-                                                    pucTestHash, sizeof( pucTestHash ),
-                                                    pucTestSignature, uxSigLen );
-        }
+        lResult = MBEDTLS_ERR_PK_KEY_INVALID_FORMAT;
     }
 
     return lResult;
@@ -83,7 +83,9 @@ typedef struct PkiObject
     };
 } PkiObject_t;
 
-/* Convenience initializers */
+/* Convenience initializers.
+ * Certificates in a PKI_OBJ_DER buffer are parsed in place, so the buffer
+ * (typically a const array in flash) must outlive the certificate context. */
 #define PKI_OBJ_PEM( buffer, len )    { .xForm = OBJ_FORM_PEM, .uxLen = len, .pucBuffer = buffer }
 #define PKI_OBJ_DER( buffer, len )    { .xForm = OBJ_FORM_DER, .uxLen = len, .pucBuffer = buffer }
 
@@ -113,6 +115,14 @@ PkiStatus_t xPkiReadCertificate( mbedtls_x509_crt * pxMbedtlsCertCtx,
 PkiStatus_t xPkiWriteCertificate( const char * pcCertLabel,
                                   const mbedtls_x509_crt * pxMbedtlsCertCtx );
 
+/**
+ * @brief Get a counter that changes whenever xPkiWriteCertificate, xPkiWritePubKey
+ * or xPkiGenerateECKeypair replaces a stored object.
+ *
+ * Used to invalidate copies of certificates and keys parsed from storage.
+ */
+uint32_t ulPkiGetGeneration( void );
+
 /**
  * @brief Initialize the private key object
  *
@@ -139,6 +149,15 @@ PkiStatus_t xPkiWritePubKey( const char * pcPubKeyLabel,
                              const size_t uxPubKeyDerLen,
                              mbedtls_pk_context * pxPkContext );
 
+/**
+ * @brief Store the EC private key in pxPkContext under pcPrvKeyLabel.
+ *
+ * Only supported for PKCS11 labels. Keys are normally generated on the device,
+ * this is for importing a key provisioned from elsewhere.
+ */
+PkiStatus_t xPkiWritePrvKey( const char * pcPrvKeyLabel,
+                             const mbedtls_pk_context * pxPkContext );
+
 PkiStatus_t xPkiGenerateECKeypair( const char * pcPrvKeyLabel,
                                    const char * pcPubKeyLabel,
                                    unsigned char ** ppucPubKeyDer,
@@ -150,6 +169,24 @@ PkiStatus_t xPkcs11GenerateKeyPairEC( char * pcPrivateKeyLabel,
                                       unsigned char ** ppucPublicKeyDer,
                                       size_t * puxPublicKeyDerLen );
 
+/**
+ * @brief Take an idle session from the PKI layer's pool, or open a new one.
+ *
+ * Sessions are not shared: the caller owns the handle until it calls
+ * vPkcs11ReleaseSession.
+ */
+CK_RV xPkcs11AcquireSession( CK_SESSION_HANDLE_PTR pxSession );
+
+/**
+ * @brief Return a session to the pool, closing it when the pool is full.
+ */
+void vPkcs11ReleaseSession( CK_SESSION_HANDLE xSession );
+
+/**
+ * @brief Initialize pxPkCtx to use the PKCS#11 private key with label pcLabel.
+ *
+ * The session used by pxPkCtx is returned to the pool when pxPkCtx is freed.
+ */
 PkiStatus_t xPkcs11InitMbedtlsPkContext( const char * pcLabel,
                                          mbedtls_pk_context * pxPkCtx,
                                          CK_SESSION_HANDLE_PTR pxSessionHandle );
@@ -171,6 +208,9 @@ PkiStatus_t xPkcs11ReadPublicKey( unsigned char ** ppucPublicKeyDer,
 PkiStatus_t xPkcs11WritePubKey( const char * pcLabel,
                                 const mbedtls_pk_context * pxPubKeyContext );
 
+PkiStatus_t xPkcs11WritePrvKey( const char * pcLabel,
+                                const mbedtls_pk_context * pxPrvKeyContext );
+
 #endif /* MBEDTLS_TRANSPORT_PKCS11 */
 
 #ifdef MBEDTLS_TRANSPORT_PSA
@@ -0,0 +1,89 @@
+/*
+ * FreeRTOS STM32 Reference Integration
+ *
+ * Copyright (c) 2022 Amazon.com, Inc. or its affiliates. All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+/**
+ * @file boot_times.h
+ * @brief Time of each boot milestone, in ms since reset.
+ *
+ * Each stage is recorded the first time it is reached after a reset. The
+ * record is kept in retained RAM, so the stages reached by the previous boot
+ * can still be read after a watchdog or software reset. The stages are logged
+ * once the first MQTT connection is acknowledged and listed by the "boottime"
+ * command.
+ */
+
+#ifndef BOOT_TIMES_H_
+#define BOOT_TIMES_H_
+
+#include <stdint.h>
+
+#include "FreeRTOS.h"
+
+typedef enum BootStage
+{
+    BOOT_STAGE_HW_INIT = 0,  /* hw_init returned */
+    BOOT_STAGE_VECTOR_TABLE, /* Vector table relocated to RAM */
+    BOOT_STAGE_SCHEDULER,    /* First task running */
+    BOOT_STAGE_FS_MOUNT,     /* Filesystem mounted */
+    BOOT_STAGE_KVSTORE,      /* KVStore cache loaded, EVT_MASK_FS_READY */
+    BOOT_STAGE_WIFI_ASSOC,   /* Associated with the access point */
+    BOOT_STAGE_DHCP,         /* Address bound, EVT_MASK_NET_CONNECTED */
+    BOOT_STAGE_DNS,          /* MQTT endpoint address resolved */
+    BOOT_STAGE_TLS,          /* TLS handshake complete */
+    BOOT_STAGE_MQTT_CONNACK, /* CONNACK received, EVT_MASK_MQTT_CONNECTED */
+    BOOT_STAGE_MAX
+} BootStage_t;
+
+/* Value of a stage not reached */
+#define BOOT_TIME_NONE    ( 0xFFFFFFFFUL )
+
+typedef struct BootTimes
+{
+    uint32_t ulMagic;
+    uint32_t ulBootCount;                     /* Boots since the retained RAM was lost */
+    uint32_t ulResetSource;                   /* RCC->CSR at reset */
+    uint32_t ulStageMs[ BOOT_STAGE_MAX ];     /* ms since reset, or BOOT_TIME_NONE */
+} BootTimes_t;
+
+/**
+ * @brief Start recording a new boot. Must be called at the start of main.
+ *
+ * @param[in] ulResetSource Reset flags to keep with the record.
+ */
+void vBootTimesInit( uint32_t ulResetSource );
+
+/**
+ * @brief Record the time a stage is first reached. Later calls for the same stage are ignored.
+ */
+void vBootTimeMark( BootStage_t xStage );
+
+/**
+ * @brief Stages of the current boot, or with xPrevious set, of the boot before it.
+ *
+ * @return The record, or NULL if there is no record of the previous boot.
+ */
+const BootTimes_t * pxBootTimesGet( BaseType_t xPrevious );
+
+const char * pcBootStageName( BootStage_t xStage );
+
+#endif /* BOOT_TIMES_H_ */
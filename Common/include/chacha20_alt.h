@@ -0,0 +1,49 @@
+/*
+ * FreeRTOS STM32 Reference Integration
+ * Copyright (C) 2021 Amazon.com, Inc. or its affiliates.  All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ * http://www.FreeRTOS.org
+ * http://aws.amazon.com/freertos
+ *
+
+ */
+
+#ifndef _CHACHA20_ALT_H
+#define _CHACHA20_ALT_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+ * Context of the word oriented ChaCha20 implementation in
+ * Common/crypto/chacha20_alt.c, selected with MBEDTLS_CHACHA20_ALT.
+ */
+typedef struct mbedtls_chacha20_context
+{
+    uint32_t ulState[ 16 ];         /* Key, nonce and block counter */
+    union
+    {
+        uint32_t ulWords[ 16 ];
+        uint8_t ucBytes[ 64 ];
+    } xKeystream;                   /* Keystream of the last block, little endian */
+    size_t uxKeystreamBytesUsed;    /* Bytes of xKeystream already consumed */
+} mbedtls_chacha20_context;
+
+#endif /* _CHACHA20_ALT_H */
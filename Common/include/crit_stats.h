@@ -0,0 +1,126 @@
+/*
+ * FreeRTOS STM32 Reference Integration
+ *
+ * Copyright (c) 2022 Amazon.com, Inc. or its affiliates. All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+/**
+ * @file crit_stats.h
+ * @brief Duration of the interrupt masked and scheduler suspended sections.
+ *
+ * The kernel entry points below are wrapped at link time with
+ * -Wl,--wrap=ulSetInterruptMask,--wrap=vClearInterruptMask,
+ * --wrap=vPortEnterCritical,--wrap=vTaskSuspendAll,--wrap=xTaskResumeAll,
+ * which the non-TrustZone project passes to the linker. Every outermost
+ * section is timed with the DWT cycle counter:
+ *
+ * - Interrupts masked: from the BASEPRI raise by taskENTER_CRITICAL,
+ *   portSET_INTERRUPT_MASK_FROM_ISR or sys_arch_protect until it is
+ *   lowered back to 0. During that time no interrupt at or below
+ *   configMAX_SYSCALL_INTERRUPT_PRIORITY is taken, so the longest section
+ *   bounds the latency added to those interrupts.
+ * - Scheduler suspended: from vTaskSuspendAll to the matching
+ *   xTaskResumeAll, called outside of tasks.c. No other task runs meanwhile.
+ *
+ * The call site is the return address of the outermost call, which
+ * arm-none-eabi-addr2line resolves to a file and line. Sections masked with
+ * __disable_irq directly are not seen.
+ */
+
+#ifndef CRIT_STATS_H_
+#define CRIT_STATS_H_
+
+#include <stdint.h>
+
+#include "FreeRTOS.h"
+
+/* The TrustZone project does not pass the --wrap options to its linker */
+#ifndef CRIT_STATS_ENABLED
+#if defined( TFM_PSA_API )
+#define CRIT_STATS_ENABLED    0
+#else
+#define CRIT_STATS_ENABLED    1
+#endif
+#endif
+
+/* Buckets of the duration histogram: < 1 us, then powers of two up to >= 1024 us */
+#define CRIT_STATS_HIST_BUCKETS    12
+
+/* Call sites tracked per kind, those with the shortest maximum are evicted first */
+#ifndef CRIT_STATS_SITES
+#define CRIT_STATS_SITES           8
+#endif
+
+/* Sections shorter than this are counted but not attributed to a call site */
+#ifndef CRIT_STATS_SITE_MIN_US
+#define CRIT_STATS_SITE_MIN_US     5
+#endif
+
+typedef enum CritStatsKind
+{
+    CRIT_STATS_IRQ_MASKED = 0,
+    CRIT_STATS_SCHED_SUSPENDED,
+    CRIT_STATS_KIND_MAX
+} CritStatsKind_t;
+
+typedef struct CritStatsSite
+{
+    const void * pvSite; /* Return address of the outermost call, NULL for an unused entry */
+    uint32_t ulCount;    /* Sections of at least CRIT_STATS_SITE_MIN_US */
+    uint32_t ulMaxCycles;
+} CritStatsSite_t;
+
+typedef struct CritStats
+{
+    uint32_t ulCount;
+    uint64_t ullTotalCycles;
+    uint32_t ulMaxCycles;
+    const void * pvMaxSite;
+    uint32_t pulHist[ CRIT_STATS_HIST_BUCKETS ];
+    CritStatsSite_t xSites[ CRIT_STATS_SITES ];
+} CritStats_t;
+
+#if CRIT_STATS_ENABLED == 1
+
+/**
+ * @brief Start the cycle counter, call once before the scheduler is started.
+ */
+void vCritStatsInit( void );
+
+/**
+ * @brief Take a snapshot of the statistics of one kind of section.
+ */
+void vCritStatsGet( CritStatsKind_t xKind,
+                    CritStats_t * pxStats );
+
+/**
+ * @brief Clear the statistics of all kinds.
+ */
+void vCritStatsReset( void );
+
+const char * pcCritStatsKindName( CritStatsKind_t xKind );
+
+#else /* CRIT_STATS_ENABLED == 1 */
+
+#define vCritStatsInit()
+
+#endif /* CRIT_STATS_ENABLED == 1 */
+
+#endif /* CRIT_STATS_H_ */
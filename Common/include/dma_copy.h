@@ -0,0 +1,150 @@
+/*
+ * FreeRTOS STM32 Reference Integration
+ *
+ * Copyright (c) 2022 Amazon.com, Inc. or its affiliates. All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+/**
+ * @file dma_copy.h
+ * @brief Memory to memory copies on GPDMA1 channel 8.
+ *
+ * A task starts a copy with xDmaCopyStart, does other work, and then calls
+ * xDmaCopyWait, which blocks on a task notification until the channel is
+ * done. Other tasks run meanwhile, the copy itself takes no CPU time.
+ *
+ * The copy moves words, split in blocks of at most DMA_COPY_MAX_BLOCK_LEN
+ * bytes that the interrupt chains. Bytes before the first and after the last
+ * word boundary are copied by the CPU when the copy starts. A copy is done
+ * entirely by the CPU, before xDmaCopyStart returns, when:
+ *
+ * - it is shorter than DMA_COPY_MIN_LEN;
+ * - the source and destination alignments differ;
+ * - the destination is not internal SRAM, or the source is not internal
+ *   flash, SRAM or an external memory region;
+ * - it is started from an interrupt, a critical section or with the
+ *   scheduler suspended;
+ * - the channel is busy with another copy.
+ *
+ * Either way, the destination holds the data once xDmaCopyWait returns.
+ */
+
+#ifndef DMA_COPY_H_
+#define DMA_COPY_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "FreeRTOS.h"
+#include "task.h"
+
+/* The TrustZone project leaves the GPDMA channels to the secure side */
+#ifndef DMA_COPY_ENABLED
+#if defined( TFM_PSA_API )
+#define DMA_COPY_ENABLED           0
+#else
+#define DMA_COPY_ENABLED           1
+#endif
+#endif
+
+/* Shortest copy worth the channel setup, the interrupt and the context switch */
+#ifndef DMA_COPY_MIN_LEN
+#define DMA_COPY_MIN_LEN           2048U
+#endif
+
+/* Time in ms after which a copy is aborted and completed by the CPU */
+#ifndef DMA_COPY_TIMEOUT_MS
+#define DMA_COPY_TIMEOUT_MS        10U
+#endif
+
+/*
+ * Task notification index a task waiting in xDmaCopyWait is woken on.
+ * Not used for anything else, since any task may start a copy.
+ */
+#define DMA_COPY_NOTIFY_IDX        9
+
+#if DMA_COPY_NOTIFY_IDX >= configTASK_NOTIFICATION_ARRAY_ENTRIES
+#error "configTASK_NOTIFICATION_ARRAY_ENTRIES has no room for DMA_COPY_NOTIFY_IDX"
+#endif
+
+/* One copy, owned by the task that started it */
+typedef struct DmaCopy
+{
+    uint8_t * pucDst;             /* Block in progress */
+    const uint8_t * pucSrc;
+    size_t uxRemaining;           /* Bytes left from pucDst, 0 once done */
+    TaskHandle_t xTask;           /* Notified on completion */
+    volatile BaseType_t xPending; /* pdTRUE while the channel owns the copy */
+    volatile BaseType_t xFailed;  /* Transfer error, the rest is left to the CPU */
+} DmaCopy_t;
+
+typedef struct DmaCopyStats
+{
+    uint32_t ulDmaCopies;  /* Copies moved by the channel */
+    uint32_t ulCpuCopies;  /* Copies long enough for the channel, done by the CPU */
+    uint32_t ulBusy;       /* Of which the channel was busy */
+    uint32_t ulAborted;    /* Transfers that failed or timed out */
+} DmaCopyStats_t;
+
+#if DMA_COPY_ENABLED == 1
+
+/**
+ * @brief Set up the channel, call once before the scheduler is started.
+ */
+void vDmaCopyInit( void );
+
+#else
+
+#define vDmaCopyInit()
+
+#endif /* DMA_COPY_ENABLED == 1 */
+
+/**
+ * @brief Start copying uxLen bytes from pvSrc to pvDst.
+ *
+ * Neither buffer may be accessed until xDmaCopyWait returns.
+ *
+ * @return pdTRUE if the channel is moving the data, pdFALSE if the CPU has
+ * already copied it.
+ */
+BaseType_t xDmaCopyStart( DmaCopy_t * pxCopy,
+                          void * pvDst,
+                          const void * pvSrc,
+                          size_t uxLen );
+
+/**
+ * @brief Wait for a copy started by the calling task.
+ *
+ * @return pdTRUE if the copy was completed by the channel, pdFALSE if the
+ * CPU did all or part of it.
+ */
+BaseType_t xDmaCopyWait( DmaCopy_t * pxCopy );
+
+/**
+ * @brief Copy and wait, a drop in replacement for memcpy in tasks.
+ *
+ * @return pvDst.
+ */
+void * pvDmaCopy( void * pvDst,
+                  const void * pvSrc,
+                  size_t uxLen );
+
+void vDmaCopyGetStats( DmaCopyStats_t * pxStats );
+
+#endif /* DMA_COPY_H_ */
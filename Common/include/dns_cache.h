@@ -0,0 +1,89 @@
+/*
+ * FreeRTOS STM32 Reference Integration
+ * Copyright (C) 2022 Amazon.com, Inc. or its affiliates.  All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+/**
+ * @file dns_cache.h
+ * @brief Small host name to IPv4 address cache used by the TLS transport.
+ *
+ * Fresh answers come from the lwIP resolver table, which honours the record TTL.
+ * Once lwIP has expired a record, the last address that was known to work is
+ * returned while a background query revalidates it (stale-while-revalidate).
+ * The address of the MQTT endpoint is persisted to the key value store so that
+ * the first connection after a reboot does not wait for a DNS round trip either.
+ */
+
+#ifndef _DNS_CACHE_H
+#define _DNS_CACHE_H
+
+#include "FreeRTOS.h"
+#include "lwip/ip_addr.h"
+
+/* Number of host names tracked. One each for the MQTT and HTTP endpoints. */
+#ifndef DNS_CACHE_ENTRIES
+#define DNS_CACHE_ENTRIES                    2
+#endif
+
+/* Longest host name that can be cached, including the null terminator. */
+#ifndef DNS_CACHE_HOSTNAME_LEN
+#define DNS_CACHE_HOSTNAME_LEN               128
+#endif
+
+/* Set to 1 to use an expired address while it is refreshed in the background. */
+#ifndef DNS_CACHE_STALE_WHILE_REVALIDATE
+#define DNS_CACHE_STALE_WHILE_REVALIDATE     1
+#endif
+
+/* Longest time an address may be served after it was last confirmed. */
+#ifndef DNS_CACHE_MAX_STALE_S
+#define DNS_CACHE_MAX_STALE_S                ( 60 * 60 )
+#endif
+
+/* Set to 1 to persist the MQTT endpoint address to CS_CORE_MQTT_ENDPOINT_ADDR. */
+#ifndef DNS_CACHE_PERSIST
+#define DNS_CACHE_PERSIST                    1
+#endif
+
+/*
+ * @brief Look up a cached address for pcHostName.
+ *
+ * A fresh address is returned when lwIP still holds a valid record. Otherwise
+ * a stale address is returned (if allowed) and an asynchronous query is started
+ * to refresh the cache.
+ *
+ * @return pdTRUE if *pxAddr holds an address worth trying, pdFALSE if the caller
+ * must perform a blocking lookup.
+ */
+BaseType_t xDnsCacheLookup( const char * pcHostName,
+                            ip_addr_t * pxAddr );
+
+/*
+ * @brief Record an address that pcHostName was successfully connected to.
+ */
+void vDnsCacheUpdate( const char * pcHostName,
+                      const ip_addr_t * pxAddr );
+
+/*
+ * @brief Drop the cached address of pcHostName, e.g. after a failed connection.
+ */
+void vDnsCacheInvalidate( const char * pcHostName );
+
+#endif /* _DNS_CACHE_H */
@@ -0,0 +1,121 @@
+/*
+ * FreeRTOS STM32 Reference Integration
+ *
+ * Copyright (c) 2022 Amazon.com, Inc. or its affiliates. All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+/**
+ * @file dvfs.h
+ * @brief Voltage and frequency scaling between a full speed and a low power level.
+ *
+ * The core runs at 160 MHz from the PLL in voltage range 1 while a client holds
+ * a request for full speed: TLS handshakes, OTA downloads and their signature
+ * check, wifi module SPI bursts, OSPI flash operations and the crypto
+ * benchmarks. Once the last request is released and none comes back for
+ * DVFS_LOW_DELAY_MS, the core drops to 48 MHz from the MSI in voltage range 3
+ * with the PLL off, which is enough for sampling the sensors and an idle
+ * network stack.
+ *
+ * The peripheral clocks are kept consistent across transitions:
+ * - TIM5 is prescaled again so the run time counter stays at 1 MHz.
+ * - USART1 runs from HSI16, so the console baud rate does not depend on the level.
+ * - SPI2 and OCTOSPI2 derive their clocks from PCLK1 and SYSCLK and stay
+ *   calibrated for full speed, so their users hold a request while they transfer.
+ * - I2C2 keeps its timing register and runs slower at the low power level.
+ */
+
+#ifndef DVFS_H_
+#define DVFS_H_
+
+#include <stdint.h>
+
+/* The RCC and PWR registers belong to the secure image in the TrustZone project */
+#ifndef DVFS_ENABLED
+#if defined( TFM_PSA_API )
+#define DVFS_ENABLED    0
+#else
+#define DVFS_ENABLED    1
+#endif
+#endif
+
+/* Time in ms without any request before the core drops to the low power level */
+#ifndef DVFS_LOW_DELAY_MS
+#define DVFS_LOW_DELAY_MS    ( 200U )
+#endif
+
+/* Clients that may hold a request for full speed, one bit each */
+#define DVFS_CLIENT_TLS          ( 1UL << 0 )
+#define DVFS_CLIENT_OTA          ( 1UL << 1 )
+#define DVFS_CLIENT_DATAPLANE    ( 1UL << 2 )
+#define DVFS_CLIENT_OSPI         ( 1UL << 3 )
+#define DVFS_CLIENT_CLI          ( 1UL << 4 )
+
+typedef enum
+{
+    DVFS_LEVEL_LOW = 0, /* 48 MHz from MSI, voltage range 3 */
+    DVFS_LEVEL_HIGH,    /* 160 MHz from PLL, voltage range 1 */
+} DvfsLevel_t;
+
+typedef struct DvfsStats
+{
+    DvfsLevel_t xLevel;      /* Current level */
+    uint32_t ulRequests;     /* Mask of the clients holding a request */
+    uint32_t ulTransitions;  /* Level changes since boot */
+    uint32_t ulHighMs;       /* Time at full speed, in ticks of 1 ms */
+    uint32_t ulLowMs;        /* Time at the low power level, in ticks of 1 ms */
+} DvfsStats_t;
+
+#if DVFS_ENABLED == 1
+
+/**
+ * @brief Create the timer that lowers the level once no client needs full speed.
+ *
+ * The core stays at full speed until then. Called by the init task.
+ */
+void vDvfsInit( void );
+
+/**
+ * @brief Switch to full speed, if needed, before returning and stay there until
+ * vDvfsRelease is called for ulClient.
+ *
+ * Must be called from a task.
+ */
+void vDvfsRequest( uint32_t ulClient );
+void vDvfsRelease( uint32_t ulClient );
+
+/**
+ * @brief Bring the clock tree back to the current level after Stop 2.
+ *
+ * Called with interrupts disabled.
+ */
+void vDvfsRestoreClock( void );
+
+void vDvfsGetStats( DvfsStats_t * pxStats );
+
+#else /* DVFS_ENABLED == 1 */
+
+#define vDvfsInit()
+#define vDvfsRequest( ulClient )
+#define vDvfsRelease( ulClient )
+#define vDvfsRestoreClock()    hw_clock_restore()
+
+#endif /* DVFS_ENABLED == 1 */
+
+#endif /* DVFS_H_ */
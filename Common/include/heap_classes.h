@@ -0,0 +1,156 @@
+/*
+ * FreeRTOS STM32 Reference Integration
+ *
+ * Copyright (c) 2022 Amazon.com, Inc. or its affiliates. All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+/**
+ * @file heap_classes.h
+ * @brief Size class front end of the heap_4 allocator.
+ *
+ * Small blocks freed with vPortFree are kept on a free list per size class and
+ * handed out again by pvPortMalloc without walking the heap_4 free list. The
+ * cached blocks are returned to heap_4 when it runs out of memory.
+ *
+ * With HEAP_ACCOUNTING set, every block also records the subsystem it was
+ * allocated for, so current and peak usage can be reported per subsystem.
+ */
+
+#ifndef HEAP_CLASSES_H_
+#define HEAP_CLASSES_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "FreeRTOS.h"
+#include "task.h"
+
+/* Set to 1 to account heap usage per HeapTag_t, at a cost of 8 bytes per block */
+#ifndef HEAP_ACCOUNTING
+#define HEAP_ACCOUNTING     0
+#endif
+
+#define HEAP_CLASS_COUNT    9
+
+#if HEAP_ACCOUNTING == 1
+#define HEAP_BLOCK_PREFIX_LEN    8U
+#else
+#define HEAP_BLOCK_PREFIX_LEN    0U
+#endif
+
+/*
+ * Subsystem an allocation is charged to, either the tag of the calling task set
+ * with xHeapTagSet or the tag given to pvHeapMallocTagged.
+ */
+typedef enum
+{
+    HEAP_TAG_OTHER = 0,
+    HEAP_TAG_TLS,
+    HEAP_TAG_LWIP,
+    HEAP_TAG_KVSTORE,
+    HEAP_TAG_OTA,
+    HEAP_TAG_MQTT,
+    HEAP_TAG_COUNT
+} HeapTag_t;
+
+typedef struct HeapTagStats
+{
+    size_t uxCurrentBytes[ HEAP_TAG_COUNT ]; /* Requested bytes currently allocated */
+    size_t uxPeakBytes[ HEAP_TAG_COUNT ];    /* Largest uxCurrentBytes since boot */
+    uint32_t ulAllocs[ HEAP_TAG_COUNT ];     /* Successful allocations since boot */
+    uint32_t ulFrees[ HEAP_TAG_COUNT ];      /* Frees since boot */
+} HeapTagStats_t;
+
+typedef struct HeapClassStats
+{
+    size_t uxBlockLen[ HEAP_CLASS_COUNT ]; /* Usable length of the blocks of each class */
+    size_t uxCached[ HEAP_CLASS_COUNT ];   /* Blocks on the free list of each class */
+    uint32_t ulHits[ HEAP_CLASS_COUNT ];   /* Allocations served from the free list */
+    uint32_t ulMisses[ HEAP_CLASS_COUNT ]; /* Allocations passed to heap_4 */
+    size_t uxCachedBytes;                  /* Bytes held on all free lists */
+    uint32_t ulFlushes;                    /* Times the free lists were returned to heap_4 */
+} HeapClassStats_t;
+
+typedef struct HeapFragStats
+{
+    size_t uxFreeBytes;         /* Free in heap_4, not counting the blocks cached by the size classes */
+    size_t uxLargestFreeBlock;
+    size_t uxSmallestFreeBlock;
+    size_t uxFreeBlocks;        /* Number of blocks on the heap_4 free list */
+    size_t uxMinEverFreeBytes;
+    size_t uxCachedBytes;
+    uint32_t ulAllocFailures;   /* pvPortMalloc calls which returned NULL since boot */
+    size_t uxLastFailedLen;     /* Size requested by the last of those */
+    uint32_t ulFragPermille;    /* 1000 * ( 1 - uxLargestFreeBlock / uxFreeBytes ) */
+} HeapFragStats_t;
+
+/**
+ * @brief Take a snapshot of the heap_4 free list and the allocation failures.
+ *
+ * Walks the free list with the scheduler suspended, which takes in the order of
+ * a microsecond per free block.
+ */
+void vHeapGetFragStats( HeapFragStats_t * pxStats );
+
+/**
+ * @brief Take a snapshot of the size class statistics.
+ */
+void vHeapClassGetStats( HeapClassStats_t * pxStats );
+
+/**
+ * @brief Return every cached block to heap_4, e.g. before measuring fragmentation.
+ */
+void vHeapClassFlush( void );
+
+/**
+ * @brief Charge the following allocations of the calling task to xTag.
+ *
+ * Call once at the start of a task to tag the whole task, or restore the
+ * returned tag afterwards to tag a section.
+ *
+ * @return The previous tag of the calling task.
+ */
+HeapTag_t xHeapTagSet( HeapTag_t xTag );
+
+/**
+ * @brief Set the tag of a task other than the calling one, e.g. right after its creation.
+ */
+void vHeapTagSetTask( TaskHandle_t xTask,
+                      HeapTag_t xTag );
+
+/**
+ * @brief pvPortMalloc charged to xTag, whatever the tag of the calling task.
+ */
+void * pvHeapMallocTagged( size_t xWantedSize,
+                           HeapTag_t xTag );
+
+/**
+ * @brief Take a snapshot of the per tag statistics.
+ *
+ * @return pdFALSE if HEAP_ACCOUNTING is not enabled.
+ */
+BaseType_t xHeapTagGetStats( HeapTagStats_t * pxStats );
+
+/**
+ * @brief Get a short name for a tag, e.g. for CLI output.
+ */
+const char * pcHeapTagName( HeapTag_t xTag );
+
+#endif /* HEAP_CLASSES_H_ */
@@ -0,0 +1,102 @@
+/*
+ * FreeRTOS STM32 Reference Integration
+ *
+ * Copyright (c) 2022 Amazon.com, Inc. or its affiliates. All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+/**
+ * @file hw_cache.h
+ * @brief Data cache maintenance for buffers accessed by DMA.
+ *
+ * On the STM32U5, DCACHE1 only caches the external memory regions (FMC and
+ * OCTOSPI, 0x60000000 - 0x9FFFFFFF). Internal SRAM is never cached, so the
+ * helpers below return immediately for buffers placed there and drivers can
+ * call them unconditionally around each transfer.
+ */
+
+#ifndef HW_CACHE_H_
+#define HW_CACHE_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "FreeRTOS.h"
+
+#define HW_CACHE_LINE_SZ             ( 16UL )
+
+/* Start and end of the external memory regions that are cached by DCACHE1 */
+#define HW_CACHE_REGION_START        ( 0x60000000UL )
+#define HW_CACHE_REGION_END          ( 0xA0000000UL )
+
+#define HW_CACHE_ALIGN_DOWN( x )     ( ( uint32_t ) ( x ) & ~( HW_CACHE_LINE_SZ - 1 ) )
+#define HW_CACHE_ALIGN_UP( x )       ( ( ( uint32_t ) ( x ) + HW_CACHE_LINE_SZ - 1 ) & ~( HW_CACHE_LINE_SZ - 1 ) )
+
+/* Declare a buffer that may be invalidated without touching its neighbours */
+#define HW_CACHE_ALIGNED             __attribute__( ( aligned( HW_CACHE_LINE_SZ ) ) )
+
+/**
+ * @brief Check whether any part of a buffer may be held in the data cache.
+ */
+BaseType_t xCacheRangeIsCached( const void * pvBuffer,
+                                size_t uxLen );
+
+/**
+ * @brief Check whether a buffer covers whole cache lines only.
+ */
+static inline BaseType_t xCacheRangeIsAligned( const void * pvBuffer,
+                                               size_t uxLen )
+{
+    return( ( ( ( uint32_t ) pvBuffer | ( uint32_t ) uxLen ) & ( HW_CACHE_LINE_SZ - 1 ) ) == 0 );
+}
+
+/**
+ * @brief Write back dirty lines of a buffer before a DMA transfer reads it.
+ *
+ * The range is expanded to whole cache lines.
+ *
+ * @return pdTRUE on success or when the buffer is not cached.
+ */
+BaseType_t xCacheCleanRange( const void * pvBuffer,
+                             size_t uxLen );
+
+/**
+ * @brief Discard cached lines of a buffer written by a DMA transfer.
+ *
+ * Call it both before the transfer, so that no dirty line is evicted over the
+ * incoming data, and after it. A cached buffer must cover whole cache lines,
+ * otherwise data adjacent to it would be lost.
+ *
+ * @return pdTRUE on success or when the buffer is not cached, pdFALSE if a
+ * cached buffer is not line aligned.
+ */
+BaseType_t xCacheInvalidateRange( void * pvBuffer,
+                                  size_t uxLen );
+
+/**
+ * @brief Write back and then discard the cached lines of a buffer.
+ *
+ * The range is expanded to whole cache lines.
+ *
+ * @return pdTRUE on success or when the buffer is not cached.
+ */
+BaseType_t xCacheCleanInvalidateRange( void * pvBuffer,
+                                       size_t uxLen );
+
+#endif /* HW_CACHE_H_ */
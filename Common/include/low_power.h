@@ -0,0 +1,123 @@
+/*
+ * FreeRTOS STM32 Reference Integration
+ *
+ * Copyright (c) 2022 Amazon.com, Inc. or its affiliates. All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+/**
+ * @file low_power.h
+ * @brief Tickless idle with Stop 2 entry, timed by LPTIM1.
+ *
+ * When no task is ready, the idle task stops SysTick and sleeps until the next
+ * task timeout, which includes the lwIP timeouts and the software timers. A
+ * free running LPTIM1 clocked by the LSE wakes the core and measures the time
+ * slept, so the tick count and the HAL tick stay in step with real time.
+ *
+ * The core enters Stop 2 unless a DMA transfer is in flight, the console is
+ * still transmitting, a client holds a Stop inhibit (SPI transaction with the
+ * wifi module, OSPI flash operation) or the console was used within
+ * LOW_POWER_CONSOLE_AWAKE_MS. Otherwise it waits in Sleep mode, where the
+ * peripherals keep running. The wifi module notify and flow lines and the
+ * console RX line wake the core from Stop 2 through the EXTI. The first
+ * character typed on a sleeping console is used to wake it and is lost.
+ *
+ * TIM5 stops in Stop 2, so the run time statistics only count awake time.
+ *
+ * This file is included by FreeRTOSConfig.h and must not include FreeRTOS.h.
+ */
+
+#ifndef LOW_POWER_H_
+#define LOW_POWER_H_
+
+#include <stdint.h>
+
+/* LPTIM1 and the PWR registers belong to the secure image in the TrustZone project */
+#ifndef LOW_POWER_ENABLED
+#if defined( TFM_PSA_API )
+#define LOW_POWER_ENABLED    0
+#else
+#define LOW_POWER_ENABLED    1
+#endif
+#endif
+
+/* Shortest expected idle time, in ms, worth the clock restore after Stop 2 */
+#ifndef LOW_POWER_STOP_MIN_MS
+#define LOW_POWER_STOP_MIN_MS         ( 10U )
+#endif
+
+/* Longest sleep in ms, must leave the idle task time to pet the 10 s watchdog */
+#ifndef LOW_POWER_MAX_SLEEP_MS
+#define LOW_POWER_MAX_SLEEP_MS        ( 4000U )
+#endif
+
+/* Time in ms the console stays out of Stop 2 after receiving a character */
+#ifndef LOW_POWER_CONSOLE_AWAKE_MS
+#define LOW_POWER_CONSOLE_AWAKE_MS    ( 30000U )
+#endif
+
+/* Clients that may hold a Stop inhibit, one bit each */
+#define LOW_POWER_CLIENT_DATAPLANE    ( 1UL << 0 )
+#define LOW_POWER_CLIENT_OSPI         ( 1UL << 1 )
+#define LOW_POWER_CLIENT_DMA_COPY     ( 1UL << 2 )
+
+typedef struct LowPowerStats
+{
+    uint32_t ulSleepCount;   /* Tickless sleeps in Sleep mode */
+    uint32_t ulStopCount;    /* Tickless sleeps in Stop 2 */
+    uint32_t ulSleepMs;      /* Time spent in Sleep mode, counted in ticks of 1 ms */
+    uint32_t ulStopMs;       /* Time spent in Stop 2, counted in ticks of 1 ms */
+    uint32_t ulStandbyWakes; /* 1 if this boot woke up from Standby */
+} LowPowerStats_t;
+
+#if LOW_POWER_ENABLED == 1
+
+/**
+ * @brief Start the LSE and configure the wake sources. Called by hw_init.
+ */
+void vLowPowerInit( void );
+
+/**
+ * @brief Keep the core out of Stop 2 until vLowPowerStopAllow is called for ulClient.
+ *
+ * May be called from an interrupt.
+ */
+void vLowPowerStopInhibit( uint32_t ulClient );
+void vLowPowerStopAllow( uint32_t ulClient );
+
+/**
+ * @brief Keep the core out of Stop 2 for LOW_POWER_CONSOLE_AWAKE_MS. May be called from an interrupt.
+ */
+void vLowPowerConsoleActivity( void );
+
+void vLowPowerGetStats( LowPowerStats_t * pxStats );
+
+/* Called by the idle task through portSUPPRESS_TICKS_AND_SLEEP, with the scheduler suspended */
+void vLowPowerSuppressTicksAndSleep( uint32_t ulExpectedIdleTicks );
+
+#else /* LOW_POWER_ENABLED == 1 */
+
+#define vLowPowerInit()
+#define vLowPowerStopInhibit( ulClient )
+#define vLowPowerStopAllow( ulClient )
+#define vLowPowerConsoleActivity()
+
+#endif /* LOW_POWER_ENABLED == 1 */
+
+#endif /* LOW_POWER_H_ */
@@ -0,0 +1,96 @@
+/*
+ * FreeRTOS STM32 Reference Integration
+ *
+ * Copyright (c) 2022 Amazon.com, Inc. or its affiliates. All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+/**
+ * @file mbedtls_arena.h
+ * @brief Per connection memory arenas for mbedtls allocations.
+ *
+ * An arena is a single heap block split into fixed size pools for small
+ * allocations and a bump region for larger ones. While an arena is selected
+ * for a task, mbedtls_platform_calloc serves that task from the arena and
+ * falls back to the FreeRTOS heap when the arena is full. The bump region is
+ * rewound whenever all of its allocations have been freed, e.g. at the end of
+ * a TLS handshake.
+ */
+
+#ifndef MBEDTLS_ARENA_H_
+#define MBEDTLS_ARENA_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "FreeRTOS.h"
+
+typedef struct MbedtlsArena MbedtlsArena_t;
+
+typedef struct MbedtlsArenaStats
+{
+    size_t uxLen;            /* Bytes available to allocations */
+    size_t uxPoolBlocksUsed; /* Pool blocks currently allocated */
+    size_t uxBumpUsed;       /* Bytes of the bump region in use */
+    size_t uxBumpHighWater;  /* Largest uxBumpUsed since the arena was created */
+    uint32_t ulFallbacks;    /* Allocations the arena could not serve */
+} MbedtlsArenaStats_t;
+
+/**
+ * @brief Allocate an arena with uxLen bytes for allocations.
+ *
+ * @return The arena, or NULL if uxLen does not cover the pools or out of memory.
+ */
+MbedtlsArena_t * pxMbedtlsArenaCreate( size_t uxLen );
+
+/**
+ * @brief Release an arena.
+ *
+ * Blocks still allocated from the arena stay valid. The arena memory is
+ * returned to the heap once the last of them is freed.
+ */
+void vMbedtlsArenaDelete( MbedtlsArena_t * pxArena );
+
+/**
+ * @brief Serve the mbedtls allocations of the calling task from pxArena.
+ *
+ * @param[in] pxArena The arena to use, or NULL to use the heap again.
+ *
+ * @return The arena previously selected for the calling task.
+ */
+MbedtlsArena_t * pxMbedtlsArenaSelect( MbedtlsArena_t * pxArena );
+
+/**
+ * @brief Allocate uxLen zeroed bytes from the arena of the calling task.
+ *
+ * @return The block, or NULL if no arena is selected or it is full.
+ */
+void * pvMbedtlsArenaCalloc( size_t uxLen );
+
+/**
+ * @brief Zeroize and free pv if it was allocated from an arena.
+ *
+ * @return pdTRUE if pv belonged to an arena, pdFALSE if it is a heap block.
+ */
+BaseType_t xMbedtlsArenaFree( void * pv );
+
+void vMbedtlsArenaGetStats( const MbedtlsArena_t * pxArena,
+                            MbedtlsArenaStats_t * pxStats );
+
+#endif /* MBEDTLS_ARENA_H_ */
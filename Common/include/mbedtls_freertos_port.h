@@ -45,4 +45,10 @@ typedef struct mbedtls_threading_mutex
 int mbedtls_platform_threading_init( void );
 #endif
 
+/**
+ * @brief Zero uxLen bytes at the word aligned pvBuffer, in a way the compiler cannot elide.
+ */
+void mbedtls_platform_wipe( void * pvBuffer,
+                            size_t uxLen );
+
 #endif /* ifndef MBEDTLS_FREERTOS_PORT_H_ */
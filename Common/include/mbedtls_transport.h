@@ -97,6 +97,42 @@ typedef enum TlsTransportStatus
 
 typedef void ( * GenericCallback_t )( void * );
 
+/* Set to 1 to record per-phase cycle counts and heap usage of each connect. */
+#ifndef TLS_TRANSPORT_PROFILE
+#define TLS_TRANSPORT_PROFILE    0
+#endif
+
+/* Order of the AEAD cipher suites offered in the ClientHello. */
+typedef enum TlsCipherPref
+{
+    TLS_CIPHER_PREF_AUTO = 0,   /* ChaCha20-Poly1305 first unless AES-GCM is hardware accelerated */
+    TLS_CIPHER_PREF_AES_GCM,    /* AES-GCM first, then ChaCha20-Poly1305 */
+    TLS_CIPHER_PREF_CHACHAPOLY, /* ChaCha20-Poly1305 first, then AES-GCM */
+    TLS_CIPHER_PREF_DEFAULT,    /* The unmodified mbedtls cipher suite list */
+    TLS_CIPHER_PREF_INVALID
+} TlsCipherPref_t;
+
+typedef enum TlsProfilePhase
+{
+    TLS_PROFILE_CA_CHAIN = 0,    /* Root CA parsing and validation in mbedtls_transport_configure */
+    TLS_PROFILE_CLIENT_CRED,     /* Client certificate and key setup in mbedtls_transport_configure */
+    TLS_PROFILE_DNS,             /* Host name lookup */
+    TLS_PROFILE_TCP_CONNECT,     /* TCP connection establishment */
+    TLS_PROFILE_HS_HELLO,        /* ClientHello / ServerHello, including the round trip */
+    TLS_PROFILE_HS_SERVER_CERT,  /* Server certificate chain parsing and verification */
+    TLS_PROFILE_HS_KEY_EXCHANGE, /* Server key exchange verification and ECDHE */
+    TLS_PROFILE_HS_SIGN,         /* CertificateVerify signature with the device key */
+    TLS_PROFILE_HS_OTHER,        /* Remaining handshake states, e.g. Finished */
+    TLS_PROFILE_NUM_PHASES
+} TlsProfilePhase_t;
+
+typedef struct TlsConnectProfile
+{
+    uint32_t ulCycles[ TLS_PROFILE_NUM_PHASES ]; /* DWT cycles spent in each phase, including time blocked on the network */
+    size_t uxHeapPeakBytes;                      /* Largest drop in free heap observed during configure and connect */
+    BaseType_t xConnected;                       /* pdTRUE if the connect succeeded */
+} TlsConnectProfile_t;
+
 /*-----------------------------------------------------------*/
 
 /**
@@ -120,7 +156,94 @@ TlsTransportStatus_t mbedtls_transport_configure( NetworkContext_t * pxNetworkCo
                                                   const PkiObject_t * pxRootCaCerts,
                                                   const size_t uxNumRootCA );
 
+/**
+ * @brief Get the profile of the most recent connect attempt by any TLS context.
+ *
+ * @return pdTRUE if *pxProfile was written, pdFALSE if profiling is disabled or
+ * no connect has been attempted.
+ */
+BaseType_t mbedtls_transport_getprofile( TlsConnectProfile_t * pxProfile );
+
+/**
+ * @brief Get a short name for a profile phase, e.g. for CLI output.
+ */
+const char * mbedtls_transport_profilephasename( TlsProfilePhase_t xPhase );
+
+/**
+ * @brief Select the maximum fragment length requested from the server.
+ *
+ * Must be called before mbedtls_transport_configure. Smaller fragments shrink
+ * the per-connection record buffers once the server accepts the extension;
+ * MBEDTLS_SSL_MAX_FRAG_LEN_NONE disables the request.
+ *
+ * @param[in] ucMaxFragLen One of the MBEDTLS_SSL_MAX_FRAG_LEN_* codes.
+ */
+TlsTransportStatus_t mbedtls_transport_setmaxfraglen( NetworkContext_t * pxNetworkContext,
+                                                     uint8_t ucMaxFragLen );
+
+/**
+ * @brief Select the cipher suites offered to the server and their order.
+ *
+ * Must be called before mbedtls_transport_configure. Except for
+ * TLS_CIPHER_PREF_DEFAULT, only forward secret AEAD suites are offered.
+ *
+ * @param[in] xCipherPref One of the TLS_CIPHER_PREF_* values.
+ */
+TlsTransportStatus_t mbedtls_transport_setcipherpref( NetworkContext_t * pxNetworkContext,
+                                                     TlsCipherPref_t xCipherPref );
+
+/**
+ * @brief Select the length of the arena serving mbedtls allocations during the handshake.
+ *
+ * Must be called before the first mbedtls_transport_connect of the context. The
+ * arena is kept for later reconnects and released by mbedtls_transport_free.
+ *
+ * @param[in] uxArenaLen Length in bytes, 0 to allocate from the FreeRTOS heap.
+ */
+TlsTransportStatus_t mbedtls_transport_setarenalen( NetworkContext_t * pxNetworkContext,
+                                                    size_t uxArenaLen );
+
+/**
+ * @brief Select the TCP keepalive settings of the connection.
+ *
+ * Takes effect on the next mbedtls_transport_connect. A dead peer on an idle
+ * connection is detected within ulIdleS + ulIntervalS * ulCount seconds.
+ *
+ * @param[in] ulIdleS Idle time before the first probe, 0 to disable keepalive.
+ * @param[in] ulIntervalS Time between probes.
+ * @param[in] ulCount Unanswered probes before the connection is dropped.
+ */
+TlsTransportStatus_t mbedtls_transport_setkeepalive( NetworkContext_t * pxNetworkContext,
+                                                     uint32_t ulIdleS,
+                                                     uint32_t ulIntervalS,
+                                                     uint32_t ulCount );
+
+/**
+ * @brief Abort the connection when sent data stays unacknowledged for ulTimeoutMs.
+ *
+ * Emulates TCP_USER_TIMEOUT, which lwIP lacks. The check runs while receiving
+ * or waiting to send, which then report a connection reset.
+ *
+ * @param[in] ulTimeoutMs Timeout in milliseconds, 0 to disable it.
+ */
+TlsTransportStatus_t mbedtls_transport_setusertimeout( NetworkContext_t * pxNetworkContext,
+                                                       uint32_t ulTimeoutMs );
 
+/**
+ * @brief Abort the TCP connection without a TLS close notify or TCP FIN.
+ *
+ * Used when the network under the connection is known to be gone. The next
+ * receive or send reports a connection reset. Must be called from the task
+ * that receives from the connection.
+ */
+void mbedtls_transport_abort( NetworkContext_t * pxNetworkContext );
+
+/**
+ * @brief Register a callback invoked whenever received data is ready to be read.
+ *
+ * The callback runs in the context of the lwIP tcpip thread, so it must only
+ * signal the reading task (e.g. with a task notification) and return.
+ */
 int32_t mbedtls_transport_setrecvcallback( NetworkContext_t * pxNetworkContext,
                                            GenericCallback_t pxCallback,
                                            void * pvCtx );
@@ -196,6 +319,21 @@ int32_t mbedtls_transport_send( NetworkContext_t * pxNetworkContext,
                                 const void * pBuffer,
                                 size_t uxBytesToSend );
 
+/**
+ * @brief Sends a list of buffers over an established TLS connection.
+ *
+ * This is the TLS version of the transport interface's
+ * #TransportWritev_t function. Consecutive small buffers are gathered into
+ * a single TLS record of up to TLS_TRANSPORT_COALESCE_LEN bytes.
+ *
+ * @return Number of bytes (> 0) sent on success;
+ * 0 if the socket times out without sending any bytes;
+ * else a negative value to represent error.
+ */
+int32_t mbedtls_transport_writev( NetworkContext_t * pxNetworkContext,
+                                  TransportOutVector_t * pxIoVec,
+                                  size_t uxIoVecCount );
+
 
 #ifdef MBEDTLS_TRANSPORT_PKCS11
 extern mbedtls_pk_info_t mbedtls_pkcs11_pk_ecdsa;
@@ -216,6 +354,11 @@ int32_t lWriteEcPublicKeyToPKCS11( const mbedtls_pk_context * pxPubKeyContext,
                                    char * pcPubKeyLabel,
                                    size_t uxPubKeyLabelLen );
 
+int32_t lWriteEcPrivateKeyToPKCS11( const mbedtls_pk_context * pxPrvKeyContext,
+                                    CK_SESSION_HANDLE xP11SessionHandle,
+                                    char * pcPrvKeyLabel,
+                                    size_t uxPrvKeyLabelLen );
+
 CK_RV xPKCS11_initMbedtlsPkContext( mbedtls_pk_context * pxMbedtlsPkCtx,
                                     CK_SESSION_HANDLE xSessionHandle,
                                     CK_OBJECT_HANDLE xPkHandle );
@@ -243,6 +386,12 @@ psa_status_t xReadPublicKeyFromPSACrypto( unsigned char ** ppucPubKeyDer,
                                           size_t * puxPubDerKeyLen,
                                           psa_key_id_t xKeyId );
 
+/* As xReadPublicKeyFromPSACrypto, also returning the key attributes read in the same pass. */
+psa_status_t xReadPublicKeyAndAttrsFromPSACrypto( unsigned char ** ppucPubKeyDer,
+                                                  size_t * puxPubDerKeyLen,
+                                                  psa_key_id_t xKeyId,
+                                                  psa_key_attributes_t * pxKeyAttrs );
+
 int32_t lWritePublicKeyToPSACrypto( psa_key_id_t xPubKeyId,
                                     const mbedtls_pk_context * pxPublicKeyContext );
 
@@ -0,0 +1,105 @@
+/*
+ * FreeRTOS STM32 Reference Integration
+ *
+ * Copyright (c) 2022 Amazon.com, Inc. or its affiliates. All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+/**
+ * @file mem_ops.h
+ * @brief memcpy, memset and memcmp tuned for the Cortex-M33.
+ *
+ * The library functions are wrapped at link time with
+ * -Wl,--wrap=memcpy,--wrap=memset,--wrap=memcmp, which the non-TrustZone
+ * project passes to the linker next to the crit_stats.h options. Every call
+ * made from the application, lwIP, mbedtls and the kernel reaches the
+ * versions below, which:
+ *
+ * - align the destination, then move 32 bytes per iteration with word
+ *   accesses, or 16 with unaligned loads when the source alignment differs;
+ * - compare a word at a time and only fall back to bytes to locate the
+ *   first difference.
+ *
+ * Calls the compiler expands inline and those made from within newlib are
+ * not affected. The library versions remain reachable as __real_memcpy,
+ * __real_memset and __real_memcmp, which the membench command compares.
+ *
+ * With MEM_OPS_DMA_ENABLED, copies of at least MEM_OPS_DMA_MIN_LEN bytes
+ * go through pvDmaCopy from dma_copy.h, which only uses the DMA channel for
+ * copies made from a task and otherwise falls back to pvMemOpsCopyCpu.
+ */
+
+#ifndef MEM_OPS_H_
+#define MEM_OPS_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+/* The TrustZone project does not pass the --wrap options to its linker */
+#ifndef MEM_OPS_ENABLED
+#if defined( TFM_PSA_API )
+#define MEM_OPS_ENABLED           0
+#else
+#define MEM_OPS_ENABLED           1
+#endif
+#endif
+
+/* Offload long memcpy calls from tasks to GPDMA1 channel 8 */
+#ifndef MEM_OPS_DMA_ENABLED
+#define MEM_OPS_DMA_ENABLED       0
+#endif
+
+/* Shortest memcpy worth blocking the calling task on a DMA transfer */
+#ifndef MEM_OPS_DMA_MIN_LEN
+#define MEM_OPS_DMA_MIN_LEN       4096U
+#endif
+
+#if MEM_OPS_ENABLED == 1
+
+void * __wrap_memcpy( void * pvDst,
+                      const void * pvSrc,
+                      size_t uxLen );
+void * __wrap_memset( void * pvDst,
+                      int lValue,
+                      size_t uxLen );
+int __wrap_memcmp( const void * pvBuf1,
+                   const void * pvBuf2,
+                   size_t uxLen );
+
+/* The newlib versions */
+void * __real_memcpy( void * pvDst,
+                      const void * pvSrc,
+                      size_t uxLen );
+void * __real_memset( void * pvDst,
+                      int lValue,
+                      size_t uxLen );
+int __real_memcmp( const void * pvBuf1,
+                   const void * pvBuf2,
+                   size_t uxLen );
+
+/**
+ * @brief Copy with the CPU only, regardless of MEM_OPS_DMA_ENABLED.
+ */
+void * pvMemOpsCopyCpu( void * pvDst,
+                        const void * pvSrc,
+                        size_t uxLen );
+
+#endif /* MEM_OPS_ENABLED == 1 */
+
+#endif /* MEM_OPS_H_ */
@@ -0,0 +1,117 @@
+/*
+ * FreeRTOS STM32 Reference Integration
+ *
+ * Copyright (c) 2022 Amazon.com, Inc. or its affiliates. All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+/**
+ * @file net_iperf.h
+ * @brief iperf2 compatible throughput tests over lwIP, optionally through TLS.
+ *
+ * TCP tests against the device use the lwiperf server, which is started once
+ * the wifi link is up. The TCP, TLS and UDP clients and the UDP server run in
+ * the calling task, so that a test measures the network path alone without the
+ * MQTT or TLS framing of the application.
+ */
+
+#ifndef _NET_IPERF_H
+#define _NET_IPERF_H
+
+#include "FreeRTOS.h"
+
+#include <stdint.h>
+#include <stddef.h>
+
+/* Port of iperf2 and of lwiperf */
+#ifndef NET_IPERF_PORT
+#define NET_IPERF_PORT              5001
+#endif
+
+/* Bytes per write of the TCP and TLS clients */
+#ifndef NET_IPERF_TCP_LEN
+#define NET_IPERF_TCP_LEN           1460
+#endif
+
+/* Datagram length of the UDP client, the iperf2 default */
+#ifndef NET_IPERF_UDP_LEN
+#define NET_IPERF_UDP_LEN           1470
+#endif
+
+/* Send rate of the UDP client */
+#ifndef NET_IPERF_UDP_KBPS
+#define NET_IPERF_UDP_KBPS          1000
+#endif
+
+/* Task notification index used while waiting for the lwiperf server */
+#ifndef NET_IPERF_NOTIFY_IDX
+#define NET_IPERF_NOTIFY_IDX        2
+#endif
+
+typedef enum NetIperfProto
+{
+    NET_IPERF_TCP,
+    NET_IPERF_UDP,
+    NET_IPERF_TLS
+} NetIperfProto_t;
+
+typedef struct NetIperfParams
+{
+    NetIperfProto_t xProto;
+    const char * pcHost;    /* Server to send to, NULL to wait for a client instead */
+    uint16_t usPort;
+    uint32_t ulDurationMs;  /* Length of a client test, or how long a server waits for a client */
+    uint32_t ulRateKbps;    /* Send rate of the UDP client */
+    size_t uxLen;           /* Bytes per write or per datagram */
+} NetIperfParams_t;
+
+typedef struct NetIperfResult
+{
+    uint64_t ullBytes;
+    uint32_t ulMs;
+    uint32_t ulKbps;
+    uint32_t ulRexmit;       /* TCP segments retransmitted by the whole stack during the test */
+    uint32_t ulCpuPermille;  /* Time not spent in the idle task */
+    BaseType_t xUdpReport;   /* pdTRUE when the UDP fields below are valid */
+    uint32_t ulDatagrams;
+    uint32_t ulLost;
+    uint32_t ulOutOfOrder;
+    uint32_t ulJitterUs;
+} NetIperfResult_t;
+
+/*
+ * @brief Start the lwiperf TCP server on NET_IPERF_PORT, if not yet running.
+ * Results of tests run against it are logged.
+ */
+void vNetIperfServerStart( void );
+
+/*
+ * @brief Run one test and wait for its result.
+ *
+ * With pcHost set, this sends to an iperf2 server ("iperf -s [-u]"). TLS tests
+ * need a TLS terminating proxy in front of the server and a root CA for it in
+ * the TLS_ROOT_CA_CERT_LABEL slot. Otherwise, this waits for the next test of an
+ * iperf2 client ("iperf -c <device> [-u]"), which TLS does not support.
+ *
+ * @return pdTRUE if the test completed and *pxResult was written.
+ */
+BaseType_t xNetIperfRun( const NetIperfParams_t * pxParams,
+                         NetIperfResult_t * pxResult );
+
+#endif /* _NET_IPERF_H */
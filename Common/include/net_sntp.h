@@ -0,0 +1,80 @@
+/*
+ * FreeRTOS STM32 Reference Integration
+ *
+ * Copyright (c) 2022 Amazon.com, Inc. or its affiliates. All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+/**
+ * @file net_sntp.h
+ * @brief SNTP client correcting the time base once the network is up.
+ *
+ * The time base starts from the RTC, or from the CS_TIME_HWM_S_1970 high-water
+ * mark, so that TLS and sensor timestamps do not wait for the network. Once an
+ * address is bound, a single SNTP query is sent from a work queue job and the
+ * reply, if it is not older than the high-water mark, is passed on to
+ * vTimeBaseSetUnixMs. The query is repeated every NET_SNTP_RESYNC_MS to bound the
+ * RTC drift.
+ */
+
+#ifndef _NET_SNTP_H
+#define _NET_SNTP_H
+
+#include "FreeRTOS.h"
+
+#include <stdint.h>
+
+#ifndef NET_SNTP_ENABLED
+#define NET_SNTP_ENABLED          1
+#endif
+
+#ifndef NET_SNTP_SERVER
+#define NET_SNTP_SERVER           "pool.ntp.org"
+#endif
+
+/* Time allowed for the DNS lookup and for the reply each */
+#ifndef NET_SNTP_TIMEOUT_MS
+#define NET_SNTP_TIMEOUT_MS       ( 5U * 1000U )
+#endif
+
+/* Delay after the first failed query, doubled after each further one */
+#ifndef NET_SNTP_RETRY_MIN_MS
+#define NET_SNTP_RETRY_MIN_MS     ( 15U * 1000U )
+#endif
+
+#ifndef NET_SNTP_RETRY_MAX_MS
+#define NET_SNTP_RETRY_MAX_MS     ( 15U * 60U * 1000U )
+#endif
+
+#ifndef NET_SNTP_RESYNC_MS
+#define NET_SNTP_RESYNC_MS        ( 12U * 60U * 60U * 1000U )
+#endif
+
+/*
+ * @brief Prepare the client. Call once after vWorkQueueInit.
+ */
+void vNetSntpInit( void );
+
+/*
+ * @brief Query the server now, unless the last successful query is more recent
+ * than NET_SNTP_RESYNC_MS. Called when an address is bound, does not block.
+ */
+void vNetSntpRequest( void );
+
+#endif /* _NET_SNTP_H */
@@ -0,0 +1,83 @@
+/*
+ * FreeRTOS STM32 Reference Integration
+ *
+ * Copyright (c) 2022 Amazon.com, Inc. or its affiliates. All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+/**
+ * @file net_stats.h
+ * @brief lwIP memory pool, mailbox and TCP counters with exhaustion alarms.
+ *
+ * A monitor running from an lwIP timer samples the pools periodically and
+ * raises an alarm when one of them runs out of free elements or fails an
+ * allocation, so that pools can be sized from field data.
+ */
+
+#ifndef _NET_STATS_H
+#define _NET_STATS_H
+
+#include "FreeRTOS.h"
+#include "lwip/memp.h"
+
+/* Interval between two samples of the pools by the monitor. */
+#ifndef NET_STATS_MONITOR_MS
+#define NET_STATS_MONITOR_MS    1000
+#endif
+
+typedef struct NetPoolStats
+{
+    const char * pcName;
+    uint32_t ulAvail;      /* Elements, or bytes for the heap */
+    uint32_t ulUsed;
+    uint32_t ulMax;        /* Most used since boot or the last clear */
+    uint32_t ulErr;        /* Failed allocations since boot or the last clear */
+    BaseType_t xExhausted; /* pdTRUE while the monitor considers the pool exhausted */
+} NetPoolStats_t;
+
+typedef struct NetStats
+{
+    NetPoolStats_t xHeap;                /* MEM_SIZE heap */
+    NetPoolStats_t xPools[ MEMP_MAX ];   /* memp pools, including PBUF_POOL */
+    uint32_t ulTcpXmit;
+    uint32_t ulTcpRexmit;                /* Segments retransmitted */
+    uint32_t ulTcpDrop;                  /* Segments dropped on input */
+    uint32_t ulTcpMemErr;                /* Out of memory errors of the TCP layer */
+    uint32_t ulTcpOoseq;                 /* Out of order segments currently queued */
+    uint32_t ulTcpOoseqMax;              /* Most out of order segments queued at a sample */
+    uint32_t ulMboxFull;                 /* Posts that found their mailbox full */
+    uint32_t ulMboxMaxDepth;             /* Most messages waiting in one mailbox */
+    uint32_t ulTcpipMboxMaxDepth;
+    uint32_t ulExhaustedAlarms;          /* Times a pool became exhausted, never cleared */
+} NetStats_t;
+
+/*
+ * @brief Start the pool monitor. Called by the network task once lwIP is up.
+ */
+void vNetStatsInit( void );
+
+/*
+ * @brief Take a snapshot of the lwIP counters.
+ *
+ * @param[in] xClear pdTRUE to restart the high-water marks, errors and TCP counters.
+ */
+void vNetStatsGet( NetStats_t * pxStats,
+                   BaseType_t xClear );
+
+#endif /* _NET_STATS_H */
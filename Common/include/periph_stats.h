@@ -0,0 +1,56 @@
+/*
+ * FreeRTOS STM32 Reference Integration
+ *
+ * Copyright (c) 2022 Amazon.com, Inc. or its affiliates. All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+/**
+ * @file periph_stats.h
+ * @brief Error counters of the peripheral drivers.
+ *
+ * The counters are incremented by the HAL error callbacks and never cleared.
+ * They live in a single global so that tools/perf_probe.py can read them
+ * through the debug probe while the target runs, without using the console.
+ * Each field is written by one interrupt handler only.
+ */
+
+#ifndef PERIPH_STATS_H_
+#define PERIPH_STATS_H_
+
+#include <stdint.h>
+
+typedef struct PeriphErrStats
+{
+    uint32_t ulUartParity;   /* Console USART1 */
+    uint32_t ulUartNoise;
+    uint32_t ulUartFraming;
+    uint32_t ulUartOverrun;
+    uint32_t ulUartDma;
+    uint32_t ulSpiErrors;    /* SPI2 link to the MXCHIP module */
+    uint32_t ulSpiLastCode;  /* HAL_SPI_ERROR_x bits of the last error */
+    uint32_t ulOspiErrors;   /* OCTOSPI NOR flash */
+    uint32_t ulOspiLastCode; /* HAL_OSPI_ERROR_x bits of the last error */
+    uint32_t ulRngSeed;      /* RNG health test failures */
+    uint32_t ulRngClock;
+} PeriphErrStats_t;
+
+extern volatile PeriphErrStats_t xPeriphErrStats;
+
+#endif /* PERIPH_STATS_H_ */
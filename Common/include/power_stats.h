@@ -0,0 +1,166 @@
+/*
+ * FreeRTOS STM32 Reference Integration
+ *
+ * Copyright (c) 2022 Amazon.com, Inc. or its affiliates. All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+/**
+ * @file power_stats.h
+ * @brief Power state residency and estimated energy per operation.
+ *
+ * The time spent in Run, Sleep and Stop 2 comes from the tickless idle
+ * statistics of low_power.h, with Run split between the two DVFS levels in
+ * proportion to the time spent at each level. The time the wifi module spends
+ * in power save, awake or without an association is reported by net_main.
+ *
+ * Energy is estimated from these times and the current drawn in each state,
+ * POWER_*_UA at POWER_SUPPLY_MV. The defaults are typical figures from the
+ * STM32U585 and EMW3080 datasheets and should be replaced by the currents
+ * measured on the board in use.
+ *
+ * Publishes and OTA downloads are tracked as operations. The energy used and
+ * the tickless idle wakes while at least one operation of a kind is in flight
+ * are charged to that kind, so that the energy per publish and per OTA can be
+ * compared between firmware builds and configurations.
+ *
+ * Standby is not entered by this firmware and its time is always 0. A boot that
+ * woke up from Standby, entered by an external supervisor, is flagged.
+ */
+
+#ifndef POWER_STATS_H_
+#define POWER_STATS_H_
+
+#include <stdint.h>
+
+#ifndef POWER_STATS_ENABLED
+#define POWER_STATS_ENABLED    1
+#endif
+
+#ifndef POWER_SUPPLY_MV
+#define POWER_SUPPLY_MV           ( 3300U )
+#endif
+
+/* Core current in each state, in uA */
+#ifndef POWER_RUN_HIGH_UA
+#define POWER_RUN_HIGH_UA         ( 17000U ) /* 160 MHz, voltage range 1 */
+#endif
+
+#ifndef POWER_RUN_LOW_UA
+#define POWER_RUN_LOW_UA          ( 3500U )  /* 48 MHz, voltage range 3 */
+#endif
+
+#ifndef POWER_SLEEP_UA
+#define POWER_SLEEP_UA            ( 2500U )
+#endif
+
+#ifndef POWER_STOP2_UA
+#define POWER_STOP2_UA            ( 8U )
+#endif
+
+#ifndef POWER_STANDBY_UA
+#define POWER_STANDBY_UA          ( 2U )
+#endif
+
+/* Wifi module current in each state, in uA */
+#ifndef POWER_RADIO_DOWN_UA
+#define POWER_RADIO_DOWN_UA       ( 20000U ) /* Scanning or connecting */
+#endif
+
+#ifndef POWER_RADIO_ACTIVE_UA
+#define POWER_RADIO_ACTIVE_UA     ( 45000U )
+#endif
+
+#ifndef POWER_RADIO_PS_UA
+#define POWER_RADIO_PS_UA         ( 2500U )
+#endif
+
+typedef enum
+{
+    POWER_STATE_RUN = 0,
+    POWER_STATE_SLEEP,
+    POWER_STATE_STOP2,
+    POWER_STATE_STANDBY,
+    POWER_STATE_COUNT
+} PowerState_t;
+
+typedef enum
+{
+    POWER_RADIO_DOWN = 0, /* No association, or the module is being reset */
+    POWER_RADIO_ACTIVE,   /* Associated with power save off */
+    POWER_RADIO_PS,       /* Associated in power save */
+    POWER_RADIO_COUNT
+} PowerRadioState_t;
+
+typedef enum
+{
+    POWER_OP_PUBLISH = 0, /* From the agent sending the PUBLISH to its completion */
+    POWER_OP_OTA,         /* From opening the image file to closing or aborting it */
+    POWER_OP_COUNT
+} PowerOp_t;
+
+typedef struct PowerOpStats
+{
+    uint32_t ulCount;     /* Operations completed */
+    uint32_t ulActiveMs;  /* Time with at least one operation in flight */
+    uint32_t ulWakes;     /* Tickless idle wakes during that time */
+    uint64_t ullEnergyUj; /* Estimated energy used during that time */
+} PowerOpStats_t;
+
+typedef struct PowerStats
+{
+    uint32_t pulStateMs[ POWER_STATE_COUNT ];
+    uint32_t ulRunHighMs;     /* Part of the Run time at 160 MHz */
+    uint32_t pulRadioMs[ POWER_RADIO_COUNT ];
+    uint32_t ulWakes;         /* Tickless idle wakes from Sleep and Stop 2 */
+    uint32_t ulStandbyWakes;  /* 1 if this boot woke up from Standby */
+    uint64_t ullEnergyUj;     /* Estimated energy since boot */
+    PowerOpStats_t pxOps[ POWER_OP_COUNT ];
+} PowerStats_t;
+
+#if POWER_STATS_ENABLED == 1
+
+void vPowerStatsGet( PowerStats_t * pxStats );
+
+/**
+ * @brief Report the state of the wifi module. Called by net_main whenever it may have changed.
+ */
+void vPowerStatsSetRadioState( PowerRadioState_t xState );
+
+/**
+ * @brief Mark the start and the end of an operation. Operations of the same kind may overlap.
+ *
+ * Must be called from a task.
+ */
+void vPowerStatsOpStart( PowerOp_t xOp );
+void vPowerStatsOpEnd( PowerOp_t xOp );
+
+const char * pcPowerStatsStateName( PowerState_t xState );
+const char * pcPowerStatsRadioName( PowerRadioState_t xState );
+const char * pcPowerStatsOpName( PowerOp_t xOp );
+
+#else /* POWER_STATS_ENABLED == 1 */
+
+#define vPowerStatsSetRadioState( xState )
+#define vPowerStatsOpStart( xOp )
+#define vPowerStatsOpEnd( xOp )
+
+#endif /* POWER_STATS_ENABLED == 1 */
+
+#endif /* POWER_STATS_H_ */
@@ -0,0 +1,102 @@
+/*
+ * FreeRTOS STM32 Reference Integration
+ *
+ * Copyright (c) 2022 Amazon.com, Inc. or its affiliates. All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+/**
+ * @file profiler.h
+ * @brief Named code region probes timed with the DWT cycle counter.
+ *
+ * A probe is defined once per file with PROF_PROBE and a region is timed with
+ * PROF_BEGIN / PROF_END in the same scope:
+ *
+ *     PROF_PROBE( xProfSend, "tls_send" );
+ *
+ *     PROF_BEGIN( xProfSend );
+ *     ...
+ *     PROF_END( xProfSend );
+ *
+ * Each probe accumulates the count, minimum, maximum and sum of its durations
+ * in cycles and joins the list printed by the "prof" command the first time
+ * it is recorded. With PROFILER_ENABLED set to 0 the macros expand to nothing.
+ */
+
+#ifndef PROFILER_H_
+#define PROFILER_H_
+
+#include <stdint.h>
+
+#include "FreeRTOS.h"
+
+#ifndef PROFILER_ENABLED
+#define PROFILER_ENABLED    0
+#endif
+
+typedef struct ProfProbe
+{
+    const char * pcName;
+    struct ProfProbe * pxNext; /* Next recorded probe, in order of first use */
+    uint32_t ulRegistered;
+    uint32_t ulCount;
+    uint32_t ulMinCycles;
+    uint32_t ulMaxCycles;
+    uint64_t ullSumCycles;
+} ProfProbe_t;
+
+#if PROFILER_ENABLED == 1
+
+/**
+ * @brief Add one duration to a probe. Can be called from tasks and interrupts.
+ */
+void vProfRecord( ProfProbe_t * pxProbe,
+                  uint32_t ulCycles );
+
+/**
+ * @brief Clear the statistics of all probes, they stay listed.
+ */
+void vProfReset( void );
+
+/**
+ * @brief Copy the statistics of the probe following pxPrev, or of the first one if pxPrev is NULL.
+ *
+ * @return The probe copied, to pass as pxPrev for the next one, or NULL at the end of the list.
+ */
+const ProfProbe_t * pxProfNext( const ProfProbe_t * pxPrev,
+                                ProfProbe_t * pxCopy );
+
+#define PROF_NOW()                     ( DWT->CYCCNT )
+
+#define PROF_PROBE( xProbe, pcLabel )  static ProfProbe_t xProbe = { .pcName = ( pcLabel ), .ulMinCycles = UINT32_MAX }
+#define PROF_BEGIN( xProbe )           const uint32_t ulProfStart_ ## xProbe = PROF_NOW()
+#define PROF_END( xProbe )             vProfRecord( &( xProbe ), PROF_NOW() - ulProfStart_ ## xProbe )
+#define PROF_RECORD( xProbe, ulCycles )    vProfRecord( &( xProbe ), ( ulCycles ) )
+
+#else /* PROFILER_ENABLED == 1 */
+
+/* Keeps the trailing semicolon of PROF_PROBE valid at file scope */
+#define PROF_PROBE( xProbe, pcLabel )  struct ProfProbe
+#define PROF_BEGIN( xProbe )
+#define PROF_END( xProbe )
+#define PROF_RECORD( xProbe, ulCycles )
+
+#endif /* PROFILER_ENABLED == 1 */
+
+#endif /* PROFILER_H_ */
@@ -0,0 +1,63 @@
+/*
+ * FreeRTOS STM32 Reference Integration
+ *
+ * Copyright (c) 2022 Amazon.com, Inc. or its affiliates. All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+/**
+ * @file ram_sections.h
+ * @brief Attributes placing uninitialized buffers in a given SRAM bank, and functions in SRAM.
+ *
+ * Each SRAM bank has its own port on the bus matrix, so a DMA transfer to one
+ * bank does not stall the CPU accessing another. The internal SRAMs are not
+ * covered by DCACHE1, which only caches the external memories, so DMA buffers
+ * need no cache maintenance wherever they are placed.
+ *
+ * The sections are named .bss.* so that linker scripts without a matching rule
+ * keep them in .bss. The STM32U585AIIXQ_FLASH.ld script of the non-TrustZone
+ * project places them in dedicated banks, where they are not zero initialized.
+ *
+ * Likewise, RAM_FUNC functions are placed in .text.ram_func, which other
+ * linker scripts keep in flash. The non-TrustZone script collects them in its
+ * .ramfunc section, which the startup code copies to SRAM1. That section also
+ * lists the kernel, HAL and mbedtls functions placed by name, with the reason
+ * for each. tools/ramfunc_report.py lists what a build actually placed.
+ */
+
+#ifndef RAM_SECTIONS_H_
+#define RAM_SECTIONS_H_
+
+/* Buffers written or read by a DMA channel, placed in SRAM4 */
+#define RAM_DMA_BUFFER    __attribute__( ( section( ".bss.ram_dma" ), aligned( 32 ) ) )
+
+/* Data accessed by the CPU only, e.g. task stacks, placed in SRAM3 next to the FreeRTOS heap */
+#define RAM_CPU_DATA      __attribute__( ( section( ".bss.ram_cpu" ), aligned( 8 ) ) )
+
+/* Data kept across a warm reset, placed in SRAM3 and never initialized by the startup code.
+ * Its contents are random after power on and must be validated, e.g. with a magic number. */
+#define RAM_RETAINED      __attribute__( ( section( ".bss.ram_retained" ), aligned( 4 ) ) )
+
+/* Functions executed from SRAM1 without flash wait states or ICACHE misses, which also keeps
+ * their timing steady while the other flash bank is erased or programmed. long_call lets
+ * callers in flash reach them without a veneer. Only for short, hot paths: SRAM1 is shared
+ * with .data and .bss. */
+#define RAM_FUNC          __attribute__( ( section( ".text.ram_func" ), long_call, noinline ) )
+
+#endif /* RAM_SECTIONS_H_ */
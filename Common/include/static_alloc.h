@@ -0,0 +1,95 @@
+/*
+ * FreeRTOS STM32 Reference Integration
+ *
+ * Copyright (c) 2022 Amazon.com, Inc. or its affiliates. All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+/**
+ * @file static_alloc.h
+ * @brief Create long lived tasks, queues and event groups without the heap.
+ *
+ * Each expansion of these macros declares its own static storage, so a macro
+ * must only be used at a call site that runs once for the life of the
+ * system or whose previous object has been deleted. Stacks and queue
+ * storage are placed in SRAM3 with RAM_CPU_DATA and are not zero
+ * initialized. The control blocks stay in .bss.
+ *
+ * The stack depths come from task_stacks.h. The TrustZone project, whose
+ * non-secure RAM has no room set aside for the stacks, keeps allocating
+ * from the heap.
+ */
+
+#ifndef STATIC_ALLOC_H_
+#define STATIC_ALLOC_H_
+
+#include "FreeRTOS.h"
+#include "task.h"
+#include "queue.h"
+#include "event_groups.h"
+
+#include "ram_sections.h"
+#include "task_stacks.h"
+
+#if defined( TFM_PSA_API )
+
+#define xTaskCreateStaticStack( pxTaskCode, pcName, ulStackDepth, pvParameters, uxPriority, pxCreatedTask ) \
+    xTaskCreate( ( pxTaskCode ), ( pcName ), ( ulStackDepth ), ( pvParameters ), ( uxPriority ), ( pxCreatedTask ) )
+
+#define xQueueCreateStaticStorage( uxQueueLength, uxItemSize ) \
+    xQueueCreate( ( uxQueueLength ), ( uxItemSize ) )
+
+#define xEventGroupCreateStaticStorage() \
+    xEventGroupCreate()
+
+#else /* defined( TFM_PSA_API ) */
+
+/* Same arguments as xTaskCreate with a constant ulStackDepth, returns pdPASS or pdFAIL */
+#define xTaskCreateStaticStack( pxTaskCode, pcName, ulStackDepth, pvParameters, uxPriority, pxCreatedTask ) \
+    ( {                                                                                                 \
+        static StackType_t uxStack[ ( ulStackDepth ) ] RAM_CPU_DATA;                                    \
+        static StaticTask_t xTaskBuffer;                                                                \
+        TaskHandle_t xNewTask = xTaskCreateStatic( ( pxTaskCode ), ( pcName ), ( ulStackDepth ),       \
+                                                   ( pvParameters ), ( uxPriority ),                    \
+                                                   uxStack, &xTaskBuffer );                             \
+        TaskHandle_t * pxHandleOut = ( pxCreatedTask );                                                 \
+        if( pxHandleOut != NULL )                                                                       \
+        {                                                                                               \
+            *pxHandleOut = xNewTask;                                                                    \
+        }                                                                                               \
+        ( xNewTask != NULL ) ? pdPASS : pdFAIL;                                                         \
+    } )
+
+/* Same arguments as xQueueCreate */
+#define xQueueCreateStaticStorage( uxQueueLength, uxItemSize )                                           \
+    ( {                                                                                                 \
+        static uint8_t ucStorage[ ( uxQueueLength ) * ( uxItemSize ) ] RAM_CPU_DATA;                    \
+        static StaticQueue_t xQueueBuffer;                                                              \
+        xQueueCreateStatic( ( uxQueueLength ), ( uxItemSize ), ucStorage, &xQueueBuffer );              \
+    } )
+
+#define xEventGroupCreateStaticStorage()                \
+    ( {                                                \
+        static StaticEventGroup_t xEventGroupBuffer;   \
+        xEventGroupCreateStatic( &xEventGroupBuffer ); \
+    } )
+
+#endif /* defined( TFM_PSA_API ) */
+
+#endif /* STATIC_ALLOC_H_ */
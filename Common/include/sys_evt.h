@@ -35,6 +35,9 @@
 #define EVT_MASK_NET_CONNECTED     0x04
 #define EVT_MASK_MQTT_INIT         0x08
 #define EVT_MASK_MQTT_CONNECTED    0x10
+#define EVT_MASK_SENSORS_READY     0x20
+#define EVT_MASK_MQTT_RESUBSCRIBED 0x40
+#define EVT_MASK_MQTT_DISCONNECTED 0x80
 
 extern EventGroupHandle_t xSystemEvents;
 
@@ -0,0 +1,109 @@
+/*
+ * FreeRTOS STM32 Reference Integration
+ *
+ * Copyright (c) 2022 Amazon.com, Inc. or its affiliates. All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+/**
+ * @file task_stats.h
+ * @brief Per task scheduling latency, measured with the run time stats counter.
+ *
+ * With TASK_STATS_LATENCY_ENABLED set to 1, the trace hooks below record when
+ * a task is moved to the ready list and, when it is next switched in, the delay
+ * since then. The largest delays are reported by the "top" command next to the
+ * per task CPU usage.
+ *
+ * ulTaskStatsStackDepth gives the stack size of a task, which together with
+ * its high-water mark shows how much of the stack was used since boot.
+ *
+ * This file is included by FreeRTOSConfig.h and must not include FreeRTOS.h.
+ */
+
+#ifndef TASK_STATS_H_
+#define TASK_STATS_H_
+
+#include <stdint.h>
+
+#ifndef TASK_STATS_LATENCY_ENABLED
+#define TASK_STATS_LATENCY_ENABLED    1
+#endif
+
+/* Tasks tracked, indexed by task number */
+#ifndef TASK_STATS_MAX_TASKS
+#define TASK_STATS_MAX_TASKS          ( 64U )
+#endif
+
+/**
+ * @brief Frequency of portGET_RUN_TIME_COUNTER_VALUE in Hz, or 0 before the timer is running.
+ */
+uint32_t ulTaskStatsCounterHz( void );
+
+/* Headroom over the measured stack use kept by the stack size hints, in percent */
+#ifndef TASK_STATS_STACK_MARGIN_PCT
+#define TASK_STATS_STACK_MARGIN_PCT    ( 25U )
+#endif
+
+/**
+ * @brief Stack depth a task was created with, in words.
+ *
+ * @param[in] xTask Handle of the task, a TaskHandle_t.
+ */
+uint32_t ulTaskStatsStackDepth( struct tskTaskControlBlock * xTask );
+
+#if TASK_STATS_LATENCY_ENABLED == 1
+
+void vTaskStatsReady( uint32_t ulTaskNumber );
+void vTaskStatsSwitchedIn( uint32_t ulTaskNumber );
+
+/**
+ * @brief Restart the maxima reported in pulIntervalMax by vTaskStatsGetLatency.
+ */
+void vTaskStatsResetInterval( void );
+
+/**
+ * @brief Largest ready to running delays of a task, in run time counter ticks.
+ *
+ * @param[in] ulTaskNumber Task number, as in TaskStatus_t.xTaskNumber.
+ * @param[out] pulMax Largest delay since the task was created.
+ * @param[out] pulIntervalMax Largest delay since the last vTaskStatsResetInterval.
+ */
+void vTaskStatsGetLatency( uint32_t ulTaskNumber,
+                           uint32_t * pulMax,
+                           uint32_t * pulIntervalMax );
+
+/* FreeRTOS trace hooks, expanded inside tasks.c. A running task re-added to the
+ * ready list, e.g. after a priority change, is not waiting to run. */
+#define traceMOVED_TASK_TO_READY_STATE( pxTCB )            \
+    do {                                                   \
+        if( ( pxTCB ) != pxCurrentTCB )                    \
+        {                                                  \
+            vTaskStatsReady( ( pxTCB )->uxTCBNumber );     \
+        }                                                  \
+    } while( 0 )
+
+#define TASK_STATS_SWITCHED_IN()    vTaskStatsSwitchedIn( pxCurrentTCB->uxTCBNumber )
+
+#else /* TASK_STATS_LATENCY_ENABLED == 1 */
+
+#define TASK_STATS_SWITCHED_IN()
+
+#endif /* TASK_STATS_LATENCY_ENABLED == 1 */
+
+#endif /* TASK_STATS_H_ */
@@ -0,0 +1,93 @@
+/*
+ * FreeRTOS STM32 Reference Integration
+ * Copyright (C) 2022 Amazon.com, Inc. or its affiliates.  All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ *
+ * https://www.FreeRTOS.org
+ * https://github.com/FreeRTOS
+ *
+ */
+
+/**
+ * @file time_base.h
+ * @brief Monotonic microsecond time base and its mapping to wall clock time.
+ *
+ * The monotonic time is TIM5 extended to 64 bits in software. At boot it is
+ * anchored to the RTC when the RTC holds a plausible date, or otherwise to the
+ * CS_TIME_HWM_S_1970 high-water mark, which is only a lower bound. A trusted
+ * time source, such as the SNTP client in net_sntp.c, replaces the anchor
+ * through vTimeBaseSetUnixMs, which also sets the RTC and advances the
+ * high-water mark.
+ */
+#ifndef _TIME_BASE_H
+#define _TIME_BASE_H
+
+#include "FreeRTOS.h"
+#include <stdint.h>
+#include <stddef.h>
+
+/* How often the TIM5 counter is sampled to catch its roughly 71 minute wrap around. */
+#ifndef TIME_BASE_WRAP_CHECK_MS
+#define TIME_BASE_WRAP_CHECK_MS    ( 15 * 60 * 1000 )
+#endif
+
+typedef enum
+{
+    TIME_BASE_SRC_NONE = 0, /* Wall clock time unknown */
+    TIME_BASE_SRC_HWM,      /* Derived from the high-water mark, may lag real time */
+    TIME_BASE_SRC_RTC,      /* Read from the RTC at boot */
+    TIME_BASE_SRC_SYNCED    /* Set by a trusted source since boot */
+} TimeBaseSource_t;
+
+/*
+ * @brief Anchor the time base. Call once after KVStore_init.
+ */
+void vTimeBaseInit( void );
+
+/*
+ * @brief Microseconds since boot. Callable from any task.
+ */
+uint64_t ullTimeBaseGetUs( void );
+
+/*
+ * @brief Convert a value from ullTimeBaseGetUs to milliseconds since 1970.
+ *
+ * @return Where the wall clock time came from. *pullUnixMs is only written
+ * when the result is not TIME_BASE_SRC_NONE.
+ */
+TimeBaseSource_t xTimeBaseToUnixMs( uint64_t ullMonotonicUs,
+                                    uint64_t * pullUnixMs );
+
+/*
+ * @brief Format a value from ullTimeBaseGetUs as "<seconds since 1970>.<ms>".
+ *
+ * @return Length of the string, or 0 if the wall clock time is unknown or it
+ * does not fit into uxBufferLen.
+ */
+size_t uxTimeBaseFormatUnix( uint64_t ullMonotonicUs,
+                             char * pcBuffer,
+                             size_t uxBufferLen );
+
+/*
+ * @brief Set the wall clock time from a trusted source.
+ */
+void vTimeBaseSetUnixMs( uint64_t ullUnixMs );
+
+#endif /* _TIME_BASE_H */
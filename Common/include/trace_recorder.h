@@ -0,0 +1,170 @@
+/*
+ * FreeRTOS STM32 Reference Integration
+ *
+ * Copyright (c) 2022 Amazon.com, Inc. or its affiliates. All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+/**
+ * @file trace_recorder.h
+ * @brief Timeline of scheduler, queue, notification and interrupt events in a RAM ring.
+ *
+ * With TRACE_RECORDER_ENABLED set to 1, the FreeRTOS trace hooks below and the
+ * TRACE_ISR_ENTER / TRACE_ISR_EXIT macros in the traced interrupt handlers
+ * append events stamped with the DWT cycle counter to xTraceEvents. Recording
+ * starts with vTraceStart, e.g. from the "trace" command, and the ring can be
+ * read by a debugger through xTraceRecorder or printed as Chrome trace event
+ * JSON, which Perfetto (ui.perfetto.dev) and chrome://tracing open directly.
+ *
+ * This file is included by FreeRTOSConfig.h and must not include FreeRTOS.h.
+ */
+
+#ifndef TRACE_RECORDER_H_
+#define TRACE_RECORDER_H_
+
+#include <stdint.h>
+
+#ifndef TRACE_RECORDER_ENABLED
+#define TRACE_RECORDER_ENABLED    0
+#endif
+
+/* Events kept in the ring, 12 bytes each */
+#ifndef TRACE_RECORDER_EVENTS
+#define TRACE_RECORDER_EVENTS     ( 2048U )
+#endif
+
+/* Task names remembered for the export, indexed by task number */
+#ifndef TRACE_RECORDER_TASKS
+#define TRACE_RECORDER_TASKS      ( 64U )
+#endif
+
+#define TRACE_RECORDER_NAME_LEN   ( 16U )
+
+/* Set in TraceEvent_t.usContext for events recorded in an exception handler */
+#define TRACE_CTX_ISR             ( 0x8000U )
+
+typedef enum
+{
+    TRACE_EVT_TASK_IN = 1,   /* ulArg: task number */
+    TRACE_EVT_TASK_OUT,      /* ulArg: task number */
+    TRACE_EVT_TASK_CREATE,   /* ulArg: task number */
+    TRACE_EVT_ISR_ENTER,     /* ulArg: exception number */
+    TRACE_EVT_ISR_EXIT,      /* ulArg: exception number */
+    TRACE_EVT_QUEUE_SEND,    /* ulArg: queue address, includes semaphore gives */
+    TRACE_EVT_QUEUE_RECEIVE, /* ulArg: queue address, includes semaphore takes */
+    TRACE_EVT_QUEUE_BLOCK,   /* ulArg: queue address the task blocks on */
+    TRACE_EVT_NOTIFY,        /* ulArg: ( task number << 8 ) | notification index */
+    TRACE_EVT_NOTIFY_TAKE,   /* ulArg: notification index the task took or waited on */
+    TRACE_EVT_MARK           /* ulArg: ( mark << 24 ) | 24 bit value */
+} TraceEventType_t;
+
+/* Application marks recorded with TRACE_MARK */
+typedef enum
+{
+    TRACE_MARK_MX_NOTIFY = 1,  /* Wi-Fi module raised its notify line */
+    TRACE_MARK_MX_WAKE,        /* Wi-Fi dataplane task woke up */
+    TRACE_MARK_LWIP_INPUT,     /* Frame handed to lwIP, value: length */
+    TRACE_MARK_MQTT_RECV,      /* Socket data ready for the MQTT agent */
+    TRACE_MARK_MQTT_LOOP_START,
+    TRACE_MARK_MQTT_LOOP_END
+} TraceMark_t;
+
+typedef struct TraceEvent
+{
+    uint32_t ulTimestamp; /* DWT->CYCCNT */
+    uint32_t ulArg;
+    uint16_t usContext;   /* Number of the running task, or TRACE_CTX_ISR | exception number */
+    uint8_t ucType;       /* TraceEventType_t */
+    uint8_t ucReserved;
+} TraceEvent_t;
+
+/* Layout published for debugger scripts */
+typedef struct TraceRecorder
+{
+    uint32_t ulMagic;         /* "TRCR" once initialized */
+    uint32_t ulEventLen;      /* sizeof( TraceEvent_t ) */
+    uint32_t ulEventCount;    /* Events in the ring */
+    volatile uint32_t ulHead; /* Events recorded since the last clear, the next one goes to ulHead % ulEventCount */
+    volatile uint32_t ulEnabled;
+    uint32_t ulStopWhenFull;  /* Keep the first events instead of the latest */
+    uint32_t ulCpuHz;
+    TraceEvent_t * pxEvents;
+} TraceRecorder_t;
+
+#if TRACE_RECORDER_ENABLED == 1
+
+extern TraceRecorder_t xTraceRecorder;
+
+void vTraceRecord( uint8_t ucType,
+                   uint32_t ulArg );
+void vTraceTaskSwitch( uint8_t ucType,
+                       uint32_t ulTaskNumber );
+void vTraceTaskCreate( uint32_t ulTaskNumber,
+                       const char * pcName );
+void vTraceIsrEnter( void );
+void vTraceIsrExit( void );
+
+/**
+ * @brief Clear the ring and start recording.
+ *
+ * @param[in] ulStopWhenFull Non zero to stop once the ring is full rather than overwrite the oldest events.
+ */
+void vTraceStart( uint32_t ulStopWhenFull );
+void vTraceStop( void );
+
+/**
+ * @brief Name of a task seen by the recorder since boot, or NULL.
+ */
+const char * pcTraceTaskName( uint32_t ulTaskNumber );
+
+#define TRACE_ISR_ENTER()    vTraceIsrEnter()
+#define TRACE_ISR_EXIT()     vTraceIsrExit()
+#define TRACE_MARK( xMark, ulValue ) \
+    vTraceRecord( TRACE_EVT_MARK, ( ( uint32_t ) ( xMark ) << 24 ) | ( ( uint32_t ) ( ulValue ) & 0xFFFFFFUL ) )
+
+/* Combined with the other switch in hooks into traceTASK_SWITCHED_IN by FreeRTOSConfig.h */
+#define TRACE_TASK_SWITCHED_IN()                             vTraceTaskSwitch( TRACE_EVT_TASK_IN, pxCurrentTCB->uxTCBNumber )
+
+/* FreeRTOS trace hooks, expanded inside tasks.c and queue.c */
+#define traceTASK_SWITCHED_OUT()                             vTraceTaskSwitch( TRACE_EVT_TASK_OUT, pxCurrentTCB->uxTCBNumber )
+#define traceTASK_CREATE( pxNewTCB )                         vTraceTaskCreate( ( pxNewTCB )->uxTCBNumber, ( pxNewTCB )->pcTaskName )
+
+#define traceQUEUE_SEND( pxQueue )                           vTraceRecord( TRACE_EVT_QUEUE_SEND, ( uint32_t ) ( pxQueue ) )
+#define traceQUEUE_SEND_FROM_ISR( pxQueue )                  vTraceRecord( TRACE_EVT_QUEUE_SEND, ( uint32_t ) ( pxQueue ) )
+#define traceQUEUE_RECEIVE( pxQueue )                        vTraceRecord( TRACE_EVT_QUEUE_RECEIVE, ( uint32_t ) ( pxQueue ) )
+#define traceQUEUE_RECEIVE_FROM_ISR( pxQueue )               vTraceRecord( TRACE_EVT_QUEUE_RECEIVE, ( uint32_t ) ( pxQueue ) )
+#define traceBLOCKING_ON_QUEUE_RECEIVE( pxQueue )            vTraceRecord( TRACE_EVT_QUEUE_BLOCK, ( uint32_t ) ( pxQueue ) )
+#define traceBLOCKING_ON_QUEUE_SEND( pxQueue )               vTraceRecord( TRACE_EVT_QUEUE_BLOCK, ( uint32_t ) ( pxQueue ) )
+
+#define traceTASK_NOTIFY( uxIndexToNotify )                  vTraceRecord( TRACE_EVT_NOTIFY, ( ( uint32_t ) pxTCB->uxTCBNumber << 8 ) | ( uint32_t ) ( uxIndexToNotify ) )
+#define traceTASK_NOTIFY_FROM_ISR( uxIndexToNotify )         vTraceRecord( TRACE_EVT_NOTIFY, ( ( uint32_t ) pxTCB->uxTCBNumber << 8 ) | ( uint32_t ) ( uxIndexToNotify ) )
+#define traceTASK_NOTIFY_GIVE_FROM_ISR( uxIndexToNotify )    vTraceRecord( TRACE_EVT_NOTIFY, ( ( uint32_t ) pxTCB->uxTCBNumber << 8 ) | ( uint32_t ) ( uxIndexToNotify ) )
+#define traceTASK_NOTIFY_TAKE( uxIndexToWait )               vTraceRecord( TRACE_EVT_NOTIFY_TAKE, ( uint32_t ) ( uxIndexToWait ) )
+#define traceTASK_NOTIFY_WAIT( uxIndexToWait )               vTraceRecord( TRACE_EVT_NOTIFY_TAKE, ( uint32_t ) ( uxIndexToWait ) )
+
+#else /* TRACE_RECORDER_ENABLED == 1 */
+
+#define TRACE_ISR_ENTER()
+#define TRACE_ISR_EXIT()
+#define TRACE_MARK( xMark, ulValue )
+#define TRACE_TASK_SWITCHED_IN()
+
+#endif /* TRACE_RECORDER_ENABLED == 1 */
+
+#endif /* TRACE_RECORDER_H_ */
@@ -0,0 +1,116 @@
+/*
+ * FreeRTOS STM32 Reference Integration
+ *
+ * Copyright (c) 2022 Amazon.com, Inc. or its affiliates. All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+/**
+ * @file warm_state.h
+ * @brief State kept in retained RAM so that a warm reset can skip the slow steps of a cold boot.
+ *
+ * Each record is a snapshot owned by one module: the kvstore cache, which also
+ * carries the DHCP lease, the access point of the last Wi-Fi association and the
+ * MQTT endpoint address, and the last TLS session. A record is protected by a
+ * CRC and only handed out after a software or watchdog reset, e.g. the reset
+ * that activates an OTA image. After any other reset every record is dropped.
+ *
+ * Every record has a single writer, so the records need no lock. A record is
+ * invalidated before it is rewritten, a reset in the middle of an update drops
+ * it rather than leaving a torn copy.
+ */
+
+#ifndef WARM_STATE_H_
+#define WARM_STATE_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "FreeRTOS.h"
+
+/* Without a retained RAM section the records would never survive a reset */
+#ifndef WARM_STATE_ENABLED
+#if defined( TFM_PSA_API )
+#define WARM_STATE_ENABLED          0
+#else
+#define WARM_STATE_ENABLED          1
+#endif
+#endif
+
+/* Room for each record, a snapshot that does not fit is not kept */
+#ifndef WARM_STATE_KVSTORE_LEN
+#define WARM_STATE_KVSTORE_LEN      2560U
+#endif
+
+/* A session keeps the certificate of the server with MBEDTLS_SSL_KEEP_PEER_CERTIFICATE */
+#ifndef WARM_STATE_TLS_SESSION_LEN
+#define WARM_STATE_TLS_SESSION_LEN  2048U
+#endif
+
+typedef enum
+{
+    WARM_STATE_KVSTORE = 0, /* Values of the compile time keys, as stored in flash */
+    WARM_STATE_TLS_SESSION, /* Session of the last TLS handshake, with its endpoint */
+    WARM_STATE_MAX
+} WarmStateRecord_t;
+
+/**
+ * @brief Validate the records kept across the reset. Must be called at the start of main.
+ *
+ * @param[in] xWarmReset pdTRUE after a software or watchdog reset. Otherwise the
+ * contents of the retained RAM are not trusted and all the records are dropped.
+ */
+void vWarmStateInit( BaseType_t xWarmReset );
+
+/**
+ * @brief Snapshot of a record kept from before the reset.
+ *
+ * @param[out] puxLength Length of the record.
+ * @return The record, valid until it is written or cleared, or NULL if there is none.
+ */
+const void * pvWarmStateGet( WarmStateRecord_t xRecord,
+                             size_t * puxLength );
+
+/**
+ * @brief Start rewriting a record in place, e.g. to serialize into it without a copy.
+ * The previous snapshot is invalidated.
+ *
+ * @param[out] puxCapacity Room for the record.
+ * @return The buffer of the record, to be completed by vWarmStateCommit.
+ */
+void * pvWarmStateBegin( WarmStateRecord_t xRecord,
+                         size_t * puxCapacity );
+
+/**
+ * @brief Complete a record started with pvWarmStateBegin.
+ */
+void vWarmStateCommit( WarmStateRecord_t xRecord,
+                       size_t uxLength );
+
+/**
+ * @brief Replace a record with a copy of pvData.
+ *
+ * @return pdFALSE if the record does not fit, in which case the record is cleared.
+ */
+BaseType_t xWarmStateSet( WarmStateRecord_t xRecord,
+                          const void * pvData,
+                          size_t uxLength );
+
+void vWarmStateClear( WarmStateRecord_t xRecord );
+
+#endif /* WARM_STATE_H_ */
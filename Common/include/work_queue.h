@@ -0,0 +1,117 @@
+/*
+ * FreeRTOS STM32 Reference Integration
+ *
+ * Copyright (c) 2022 Amazon.com, Inc. or its affiliates. All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+/**
+ * @file work_queue.h
+ * @brief Periodic and one-shot jobs run by a single shared worker task.
+ *
+ * Short periodic work, such as the heartbeat LED, sensor sampling and the
+ * Defender metrics report, runs as jobs instead of each having a task that
+ * mostly sleeps. The jobs share one stack, and jobs due within
+ * WORK_QUEUE_SLACK_MS of each other run in the same wakeup.
+ *
+ * Jobs are run one at a time, in order of their due time, and must not
+ * block: anything that waits for an event reschedules its job from the
+ * event instead, with vWorkJobSchedule. The FreeRTOS timer task is not used
+ * for this, its priority is above the I2C, CBOR and MQTT work of the jobs.
+ */
+
+#ifndef WORK_QUEUE_H_
+#define WORK_QUEUE_H_
+
+#include <stdint.h>
+
+#include "FreeRTOS.h"
+#include "task.h"
+
+/* Below the MQTT agent, whose callbacks schedule some of the jobs */
+#ifndef WORK_QUEUE_TASK_PRIORITY
+#if defined( TFM_PSA_API )
+#define WORK_QUEUE_TASK_PRIORITY    ( tskIDLE_PRIORITY + 2 )
+#else
+#define WORK_QUEUE_TASK_PRIORITY    6
+#endif
+#endif
+
+/* A job may run up to this much early to share a wakeup with another one */
+#ifndef WORK_QUEUE_SLACK_MS
+#define WORK_QUEUE_SLACK_MS         20U
+#endif
+
+/* Jobs running longer than this are logged, they delay every other job */
+#ifndef WORK_QUEUE_SLOW_JOB_MS
+#define WORK_QUEUE_SLOW_JOB_MS      200U
+#endif
+
+typedef void ( * WorkFunction_t )( void * pvCtx );
+
+/* Owned by the caller of vWorkJobInit, must stay valid for the life of the system */
+typedef struct WorkJob
+{
+    const char * pcName;
+    WorkFunction_t pxFunction;
+    void * pvCtx;
+    TickType_t xPeriod;       /* 0 for a one-shot job */
+    TickType_t xDue;          /* Tick count the job is next due at */
+    BaseType_t xScheduled;    /* pdTRUE while xDue is valid */
+    BaseType_t xListed;       /* pdTRUE once linked in the job list */
+    struct WorkJob * pxNext;
+    uint32_t ulRuns;
+    TickType_t xMaxRunTicks;
+} WorkJob_t;
+
+/**
+ * @brief Create the worker task, jobs scheduled before are run once it starts.
+ */
+void vWorkQueueInit( void );
+
+void vWorkJobInit( WorkJob_t * pxJob,
+                   const char * pcName,
+                   WorkFunction_t pxFunction,
+                   void * pvCtx );
+
+/**
+ * @brief Run a job once, after ulDelayMs.
+ *
+ * A job that is already scheduled is moved to the new due time and stops
+ * being periodic. May be called from any task, and by a job for itself.
+ */
+void vWorkJobSchedule( WorkJob_t * pxJob,
+                       uint32_t ulDelayMs );
+
+/**
+ * @brief Run a job after ulDelayMs and then every ulPeriodMs.
+ *
+ * The period is counted from the due time, not the end of the previous run,
+ * so a periodic job does not drift. Runs that are missed are skipped.
+ */
+void vWorkJobSchedulePeriodic( WorkJob_t * pxJob,
+                               uint32_t ulDelayMs,
+                               uint32_t ulPeriodMs );
+
+/**
+ * @brief Stop a job, it finishes its current run if any.
+ */
+void vWorkJobCancel( WorkJob_t * pxJob );
+
+#endif /* WORK_QUEUE_H_ */
@@ -23,14 +23,31 @@
  *
  */
 
+#define LOG_MODULE    LOG_MODULE_KVSTORE
+
 #include "FreeRTOS.h"
 #include "semphr.h"
 #include "kvstore.h"
 #include "kvstore_prv.h"
 #include <string.h>
+#include <assert.h>
 
 static SemaphoreHandle_t xKvMutex = NULL;
 
+#if KV_STORE_CACHE_ENABLE
+
+/* Lock-free attempts a reader makes before waiting for the writer on xKvMutex */
+#ifndef KV_STORE_READ_RETRIES
+#define KV_STORE_READ_RETRIES    2U
+#endif
+
+/*
+ * Sequence counter guarding the cache, odd while a writer is modifying it.
+ * Readers copy a value without taking xKvMutex and retry if the counter changed.
+ */
+static volatile uint32_t ulKvSequence = 0;
+#endif
+
 #if KV_STORE_CACHE_ENABLE
 #define READ_ENTRY     xprvCopyValueFromCache
 #define WRITE_ENTRY    xprvWriteCacheEntry
@@ -39,24 +56,145 @@ static SemaphoreHandle_t xKvMutex = NULL;
 #define WRITE_ENTRY    xprvWriteValueToImpl
 #endif
 
-const char * const kvStoreKeyMap[ CS_NUM_KEYS ] = KV_STORE_STRINGS;
+/* Slots in the open addressing table used to look up keys by name */
+#ifndef KV_STORE_HASH_SLOTS
+#define KV_STORE_HASH_SLOTS    64U
+#endif
+
+static_assert( ( KV_STORE_HASH_SLOTS & ( KV_STORE_HASH_SLOTS - 1U ) ) == 0, "KV_STORE_HASH_SLOTS must be a power of two" );
+static_assert( KV_STORE_HASH_SLOTS > KV_STORE_NUM_KEYS, "KV_STORE_HASH_SLOTS must be larger than KV_STORE_NUM_KEYS" );
+
+const char * kvStoreKeyMap[ KV_STORE_NUM_KEYS ] = KV_STORE_STRINGS;
 
 const KVStoreDefaultEntry_t kvStoreDefaults[ CS_NUM_KEYS ] = KV_STORE_DEFAULTS;
 
+/* Keys registered at runtime follow the compile time keys */
+static KVStoreDefaultEntry_t xDynamicDefaults[ KV_STORE_DYNAMIC_KEYS ] = { 0 };
+static char pcDynamicKeyNames[ KV_STORE_DYNAMIC_KEYS ][ KVSTORE_KEY_MAX_LEN + 1 ] = { 0 };
+static volatile UBaseType_t uxNumKeys = CS_NUM_KEYS;
+
+/* Key index + 1 of each used slot, 0 for empty slots */
+static uint16_t usKeyHashTable[ KV_STORE_HASH_SLOTS ] = { 0 };
+
+static inline BaseType_t xIsValidKey( KVStoreKey_t xKey )
+{
+    return( ( ( UBaseType_t ) xKey < uxNumKeys ) ? pdTRUE : pdFALSE );
+}
+
+static inline const KVStoreDefaultEntry_t * pxGetDefault( KVStoreKey_t xKey )
+{
+    const KVStoreDefaultEntry_t * pxDefault = NULL;
+
+    if( ( UBaseType_t ) xKey < CS_NUM_KEYS )
+    {
+        pxDefault = &( kvStoreDefaults[ xKey ] );
+    }
+    else
+    {
+        pxDefault = &( xDynamicDefaults[ xKey - CS_NUM_KEYS ] );
+    }
+
+    return pxDefault;
+}
+
+/*
+ * @brief 32 bit FNV-1a hash of a key name.
+ */
+uint32_t ulprvHashKeyName( const char * pcKey )
+{
+    uint32_t ulHash = 2166136261UL;
+
+    while( *pcKey != '\0' )
+    {
+        ulHash ^= ( uint8_t ) *pcKey;
+        ulHash *= 16777619UL;
+        pcKey++;
+    }
+
+    return ulHash;
+}
+
+/*
+ * @brief Find the slot holding the given key name, or the empty slot it would be inserted into.
+ * @param[out] pulSlot Index of the slot found.
+ * @return The key or KV_STORE_KEY_INVALID.
+ */
+static KVStoreKey_t xHashLookup( const char * pcKey,
+                                 uint32_t * pulSlot )
+{
+    KVStoreKey_t xKey = KV_STORE_KEY_INVALID;
+    uint32_t ulSlot = ulprvHashKeyName( pcKey ) & ( KV_STORE_HASH_SLOTS - 1U );
+
+    /* The table is never full, so linear probing always ends on an empty slot */
+    while( usKeyHashTable[ ulSlot ] != 0 )
+    {
+        KVStoreKey_t xCandidate = ( KVStoreKey_t ) ( usKeyHashTable[ ulSlot ] - 1U );
+
+        if( strcmp( kvStoreKeyMap[ xCandidate ], pcKey ) == 0 )
+        {
+            xKey = xCandidate;
+            break;
+        }
+
+        ulSlot = ( ulSlot + 1U ) & ( KV_STORE_HASH_SLOTS - 1U );
+    }
+
+    *pulSlot = ulSlot;
+
+    return xKey;
+}
+
+static void vHashInsert( KVStoreKey_t xKey )
+{
+    uint32_t ulSlot = 0;
+
+    if( xHashLookup( kvStoreKeyMap[ xKey ], &ulSlot ) == KV_STORE_KEY_INVALID )
+    {
+        usKeyHashTable[ ulSlot ] = ( uint16_t ) ( xKey + 1U );
+    }
+    else
+    {
+        LogError( "Duplicate kvstore key: %s.", kvStoreKeyMap[ xKey ] );
+    }
+}
+
+/*
+ * @brief Take exclusive access to the key value store for a modification.
+ */
+static inline void vWriteLock( void )
+{
+    ( void ) xSemaphoreTake( xKvMutex, portMAX_DELAY );
+
+#if KV_STORE_CACHE_ENABLE
+    ulKvSequence++;
+    portMEMORY_BARRIER();
+#endif
+}
+
+static inline void vWriteUnlock( void )
+{
+#if KV_STORE_CACHE_ENABLE
+    portMEMORY_BARRIER();
+    ulKvSequence++;
+#endif
+
+    ( void ) xSemaphoreGive( xKvMutex );
+}
+
 static size_t xReadEntryOrDefault( KVStoreKey_t xKey,
                                    void * pvBuffer,
                                    size_t xBufferSize )
 {
     size_t xLength = 0;
 
-    configASSERT( xKey < CS_NUM_KEYS );
+    configASSERT( xIsValidKey( xKey ) == pdTRUE );
     configASSERT( pvBuffer != NULL );
 
     ( void ) READ_ENTRY( xKey, NULL, &xLength, pvBuffer, xBufferSize );
 
     if( xLength == 0 )
     {
-        size_t xDataLen = kvStoreDefaults[ xKey ].length;
+        size_t xDataLen = pxGetDefault( xKey )->length;
 
         if( xBufferSize < xDataLen )
         {
@@ -67,14 +205,14 @@ static size_t xReadEntryOrDefault( KVStoreKey_t xKey,
 
         if( xDataLen > sizeof( void * ) )
         {
-            ( void ) memcpy( pvBuffer, kvStoreDefaults[ xKey ].blob, xDataLen );
+            ( void ) memcpy( pvBuffer, pxGetDefault( xKey )->blob, xDataLen );
         }
         else
         {
-            ( void ) memcpy( pvBuffer, &( kvStoreDefaults[ xKey ].u32 ), xDataLen );
+            ( void ) memcpy( pvBuffer, &( pxGetDefault( xKey )->u32 ), xDataLen );
         }
 
-        xLength = kvStoreDefaults[ xKey ].length;
+        xLength = pxGetDefault( xKey )->length;
     }
 
 /* TEST_AUTOMATION_INTEGRATION is set in ota_config.h, help us to set attributes easily. */
@@ -110,6 +248,50 @@ static size_t xReadEntryOrDefault( KVStoreKey_t xKey,
     return xLength;
 }
 
+/*
+ * @brief Read an entry without blocking other readers.
+ *
+ * With the cache enabled the value is copied optimistically and kept only if no
+ * writer ran in the meantime. A reader that keeps colliding with writes falls back
+ * to xKvMutex, so a preempted lower priority writer is not starved by a spinning reader.
+ */
+static size_t xReadEntryShared( KVStoreKey_t xKey,
+                                void * pvBuffer,
+                                size_t xBufferSize )
+{
+    size_t xLength = 0;
+    BaseType_t xDone = pdFALSE;
+
+#if KV_STORE_CACHE_ENABLE
+    for( uint32_t ulAttempt = 0; ( ulAttempt < KV_STORE_READ_RETRIES ) && ( xDone == pdFALSE ); ulAttempt++ )
+    {
+        uint32_t ulSequence = ulKvSequence;
+
+        portMEMORY_BARRIER();
+
+        if( ( ulSequence & 1U ) == 0 )
+        {
+            xLength = xReadEntryOrDefault( xKey, pvBuffer, xBufferSize );
+
+            portMEMORY_BARRIER();
+
+            xDone = ( ulKvSequence == ulSequence );
+        }
+    }
+#endif /* KV_STORE_CACHE_ENABLE */
+
+    if( xDone == pdFALSE )
+    {
+        ( void ) xSemaphoreTake( xKvMutex, portMAX_DELAY );
+
+        xLength = xReadEntryOrDefault( xKey, pvBuffer, xBufferSize );
+
+        ( void ) xSemaphoreGive( xKvMutex );
+    }
+
+    return xLength;
+}
+
 /*
  * @brief Initialize KeyValue store and load runtime configuration from flash into ram.
  * Must be called after filesystem has been initialized.
@@ -119,9 +301,15 @@ void KVStore_init( void )
     if( xKvMutex == NULL )
     {
         xKvMutex = xSemaphoreCreateMutex();
+
+        for( uint32_t i = 0; i < CS_NUM_KEYS; i++ )
+        {
+            configASSERT( strlen( kvStoreKeyMap[ i ] ) <= KVSTORE_KEY_MAX_LEN );
+            vHashInsert( i );
+        }
     }
 
-    ( void ) xSemaphoreTake( xKvMutex, portMAX_DELAY );
+    vWriteLock();
 
 #if KV_STORE_CACHE_ENABLE
     vprvCacheInit();
@@ -131,7 +319,7 @@ void KVStore_init( void )
     vprvNvImplInit();
 #endif
 
-    ( void ) xSemaphoreGive( xKvMutex );
+    vWriteUnlock();
 }
 
 BaseType_t KVStore_setBlob( KVStoreKey_t key,
@@ -140,10 +328,14 @@ BaseType_t KVStore_setBlob( KVStoreKey_t key,
 {
     BaseType_t xReturn = pdFALSE;
 
-    if( ( key < CS_NUM_KEYS ) && ( pvNewValue != NULL ) && ( xLength > 0 ) &&
-        ( kvStoreDefaults[ key ].type == KV_TYPE_BLOB ) )
+    if( ( xIsValidKey( key ) == pdTRUE ) && ( pvNewValue != NULL ) && ( xLength > 0 ) &&
+        ( pxGetDefault( key )->type == KV_TYPE_BLOB ) )
     {
+        vWriteLock();
+
         xReturn = WRITE_ENTRY( key, KV_TYPE_BLOB, xLength, pvNewValue );
+
+        vWriteUnlock();
     }
 
     return xReturn;
@@ -154,11 +346,15 @@ BaseType_t KVStore_setString( KVStoreKey_t key,
 {
     BaseType_t xReturn = pdFALSE;
 
-    if( ( key < CS_NUM_KEYS ) &&
+    if( ( xIsValidKey( key ) == pdTRUE ) &&
         ( pcNewValue != NULL ) &&
-        ( kvStoreDefaults[ key ].type == KV_TYPE_STRING ) )
+        ( pxGetDefault( key )->type == KV_TYPE_STRING ) )
     {
+        vWriteLock();
+
         xReturn = WRITE_ENTRY( key, KV_TYPE_STRING, strlen( pcNewValue ) + 1, ( const void * ) pcNewValue );
+
+        vWriteUnlock();
     }
 
     return xReturn;
@@ -169,9 +365,13 @@ BaseType_t KVStore_setUInt32( KVStoreKey_t key,
 {
     BaseType_t xReturn = pdFALSE;
 
-    if( ( key < CS_NUM_KEYS ) && ( kvStoreDefaults[ key ].type == KV_TYPE_UINT32 ) )
+    if( ( xIsValidKey( key ) == pdTRUE ) && ( pxGetDefault( key )->type == KV_TYPE_UINT32 ) )
     {
+        vWriteLock();
+
         xReturn = WRITE_ENTRY( key, KV_TYPE_UINT32, sizeof( uint32_t ), ( const void * ) &ulNewVal );
+
+        vWriteUnlock();
     }
 
     return xReturn;
@@ -182,9 +382,13 @@ BaseType_t KVStore_setInt32( KVStoreKey_t key,
 {
     BaseType_t xReturn = pdFALSE;
 
-    if( ( key < CS_NUM_KEYS ) && ( kvStoreDefaults[ key ].type == KV_TYPE_INT32 ) )
+    if( ( xIsValidKey( key ) == pdTRUE ) && ( pxGetDefault( key )->type == KV_TYPE_INT32 ) )
     {
+        vWriteLock();
+
         xReturn = WRITE_ENTRY( key, KV_TYPE_INT32, sizeof( int32_t ), ( const void * ) &lNewVal );
+
+        vWriteUnlock();
     }
 
     return xReturn;
@@ -195,10 +399,14 @@ BaseType_t KVStore_setUBase( KVStoreKey_t key,
 {
     BaseType_t xReturn = pdFALSE;
 
-    if( ( key < CS_NUM_KEYS ) && ( kvStoreDefaults[ key ].type == KV_TYPE_UBASE_T ) )
+    if( ( xIsValidKey( key ) == pdTRUE ) && ( pxGetDefault( key )->type == KV_TYPE_UBASE_T ) )
     {
+        vWriteLock();
+
         xReturn = WRITE_ENTRY( key, KV_TYPE_UBASE_T, sizeof( UBaseType_t ),
                                ( const void * ) &uxNewVal );
+
+        vWriteUnlock();
     }
 
     return xReturn;
@@ -209,9 +417,13 @@ BaseType_t KVStore_setBase( KVStoreKey_t key,
 {
     BaseType_t xReturn = pdFALSE;
 
-    if( ( key < CS_NUM_KEYS ) && ( kvStoreDefaults[ key ].type == KV_TYPE_BASE_T ) )
+    if( ( xIsValidKey( key ) == pdTRUE ) && ( pxGetDefault( key )->type == KV_TYPE_BASE_T ) )
     {
+        vWriteLock();
+
         xReturn = WRITE_ENTRY( key, KV_TYPE_BASE_T, sizeof( BaseType_t ), ( const void * ) &xNewVal );
+
+        vWriteUnlock();
     }
 
     return xReturn;
@@ -221,7 +433,7 @@ size_t KVStore_getSize( KVStoreKey_t xKey )
 {
     size_t xDataLen = 0;
 
-    if( xKey < CS_NUM_KEYS )
+    if( xIsValidKey( xKey ) == pdTRUE )
     {
         /* First check cache if available */
 #if KV_STORE_CACHE_ENABLE
@@ -234,7 +446,7 @@ size_t KVStore_getSize( KVStoreKey_t xKey )
         if( xDataLen == 0 )
         {
             /* Otherwise read default value */
-            xDataLen = kvStoreDefaults[ xKey ].length;
+            xDataLen = pxGetDefault( xKey )->length;
         }
     }
 
@@ -271,13 +483,9 @@ size_t KVStore_getBlob( KVStoreKey_t key,
 {
     size_t xLength = 0;
 
-    if( ( key < CS_NUM_KEYS ) && ( pvBuffer != NULL ) && ( kvStoreDefaults[ key ].type == KV_TYPE_BLOB ) )
+    if( ( xIsValidKey( key ) == pdTRUE ) && ( pvBuffer != NULL ) && ( pxGetDefault( key )->type == KV_TYPE_BLOB ) )
     {
-        ( void ) xSemaphoreTake( xKvMutex, portMAX_DELAY );
-
-        xLength = xReadEntryOrDefault( key, pvBuffer, xMaxLength );
-
-        ( void ) xSemaphoreGive( xKvMutex );
+        xLength = xReadEntryShared( key, pvBuffer, xMaxLength );
     }
 
     return xLength;
@@ -291,7 +499,7 @@ void * KVStore_getBlobHeap( KVStoreKey_t key,
 
     if( xLen > 0 )
     {
-        pvBuffer = pvPortMalloc( xLen );
+        pvBuffer = pvHeapMallocTagged( xLen, HEAP_TAG_KVSTORE );
 
         if( pvBuffer != NULL )
         {
@@ -321,9 +529,9 @@ KVStoreValueType_t KVStore_getType( KVStoreKey_t key )
 {
     KVStoreValueType_t xKvType = KV_TYPE_NONE;
 
-    if( key < CS_NUM_KEYS )
+    if( xIsValidKey( key ) == pdTRUE )
     {
-        xKvType = kvStoreDefaults[ key ].type;
+        xKvType = pxGetDefault( key )->type;
     }
 
     return( xKvType );
@@ -335,18 +543,14 @@ size_t KVStore_getString( KVStoreKey_t key,
 {
     size_t xSizeWritten = 0;
 
-    if( ( key < CS_NUM_KEYS ) &&
+    if( ( xIsValidKey( key ) == pdTRUE ) &&
         ( pcBuffer != NULL ) &&
-        ( kvStoreDefaults[ key ].type == KV_TYPE_STRING ) )
+        ( pxGetDefault( key )->type == KV_TYPE_STRING ) )
     {
-        ( void ) xSemaphoreTake( xKvMutex, portMAX_DELAY );
-
-        xSizeWritten = xReadEntryOrDefault( key, ( void * ) pcBuffer, xMaxLength );
+        xSizeWritten = xReadEntryShared( key, ( void * ) pcBuffer, xMaxLength );
 
         /* Ensure null terminated */
         pcBuffer[ xMaxLength - 1 ] = '\0';
-
-        ( void ) xSemaphoreGive( xKvMutex );
     }
 
     /* Remove null terminator from returned count */
@@ -366,7 +570,7 @@ char * KVStore_getStringHeap( KVStoreKey_t key,
 
     if( xLen > 0 )
     {
-        pcBuffer = pvPortMalloc( xLen );
+        pcBuffer = pvHeapMallocTagged( xLen, HEAP_TAG_KVSTORE );
 
         if( pcBuffer != NULL )
         {
@@ -399,15 +603,11 @@ uint32_t KVStore_getUInt32( KVStoreKey_t key,
 
     size_t xSizeWritten = 0;
 
-    if( ( key < CS_NUM_KEYS ) &&
-        ( kvStoreDefaults[ key ].type == KV_TYPE_UINT32 ) )
+    if( ( xIsValidKey( key ) == pdTRUE ) &&
+        ( pxGetDefault( key )->type == KV_TYPE_UINT32 ) )
     {
-        ( void ) xSemaphoreTake( xKvMutex, portMAX_DELAY );
-
-        xSizeWritten = xReadEntryOrDefault( key, ( void * ) &ulReturnValue,
-                                            sizeof( uint32_t ) );
-
-        ( void ) xSemaphoreGive( xKvMutex );
+        xSizeWritten = xReadEntryShared( key, ( void * ) &ulReturnValue,
+                                         sizeof( uint32_t ) );
     }
 
     if( pxSuccess != NULL )
@@ -425,13 +625,9 @@ int32_t KVStore_getInt32( KVStoreKey_t key,
 
     size_t xSizeWritten = 0;
 
-    if( ( key < CS_NUM_KEYS ) && ( kvStoreDefaults[ key ].type == KV_TYPE_INT32 ) )
+    if( ( xIsValidKey( key ) == pdTRUE ) && ( pxGetDefault( key )->type == KV_TYPE_INT32 ) )
     {
-        ( void ) xSemaphoreTake( xKvMutex, portMAX_DELAY );
-
-        xSizeWritten = xReadEntryOrDefault( key, ( void * ) &lReturnValue, sizeof( int32_t ) );
-
-        ( void ) xSemaphoreGive( xKvMutex );
+        xSizeWritten = xReadEntryShared( key, ( void * ) &lReturnValue, sizeof( int32_t ) );
     }
 
     if( pxSuccess != NULL )
@@ -449,13 +645,9 @@ BaseType_t KVStore_getBase( KVStoreKey_t key,
 
     size_t xSizeWritten = 0;
 
-    if( ( key < CS_NUM_KEYS ) && ( kvStoreDefaults[ key ].type == KV_TYPE_BASE_T ) )
+    if( ( xIsValidKey( key ) == pdTRUE ) && ( pxGetDefault( key )->type == KV_TYPE_BASE_T ) )
     {
-        ( void ) xSemaphoreTake( xKvMutex, portMAX_DELAY );
-
-        xSizeWritten = xReadEntryOrDefault( key, ( void * ) &xReturnValue, sizeof( BaseType_t ) );
-
-        ( void ) xSemaphoreGive( xKvMutex );
+        xSizeWritten = xReadEntryShared( key, ( void * ) &xReturnValue, sizeof( BaseType_t ) );
     }
 
     if( pxSuccess != NULL )
@@ -473,13 +665,9 @@ UBaseType_t KVStore_getUBase( KVStoreKey_t key,
 
     size_t xSizeWritten = 0;
 
-    if( ( key < CS_NUM_KEYS ) && ( kvStoreDefaults[ key ].type == KV_TYPE_BASE_T ) )
+    if( ( xIsValidKey( key ) == pdTRUE ) && ( pxGetDefault( key )->type == KV_TYPE_BASE_T ) )
     {
-        ( void ) xSemaphoreTake( xKvMutex, portMAX_DELAY );
-
-        xSizeWritten = xReadEntryOrDefault( key, ( void * ) &xReturnValue, sizeof( UBaseType_t ) );
-
-        ( void ) xSemaphoreGive( xKvMutex );
+        xSizeWritten = xReadEntryShared( key, ( void * ) &xReturnValue, sizeof( UBaseType_t ) );
     }
 
     if( pxSuccess != NULL )
@@ -494,7 +682,7 @@ const char * kvKeyToString( KVStoreKey_t xKey )
 {
     const char * retVal = NULL;
 
-    if( ( xKey < CS_NUM_KEYS ) && ( xKey >= 0 ) )
+    if( xIsValidKey( xKey ) == pdTRUE )
     {
         retVal = kvStoreKeyMap[ xKey ];
     }
@@ -502,18 +690,353 @@ const char * kvKeyToString( KVStoreKey_t xKey )
     return retVal;
 }
 
+#if KV_STORE_CACHE_ENABLE
+
+/*
+ * @brief Commit changes staged in the cache to non-volatile storage.
+ * With KV_STORE_WRITE_BACK_ENABLE the write happens in the background within
+ * KV_STORE_FLUSH_DELAY_MS, use KVStore_xFlush when the data must be stored on return.
+ */
+BaseType_t KVStore_xCommitChanges( void )
+{
+    BaseType_t xResult;
+
+    ( void ) xSemaphoreTake( xKvMutex, portMAX_DELAY );
+
+    xResult = xprvCommitCache( pdFALSE );
+
+    ( void ) xSemaphoreGive( xKvMutex );
+
+    return xResult;
+}
+
+/*
+ * @brief Write all committed and staged changes to non-volatile storage before returning.
+ */
+BaseType_t KVStore_xFlush( void )
+{
+    BaseType_t xResult;
+
+    ( void ) xSemaphoreTake( xKvMutex, portMAX_DELAY );
+
+    xResult = xprvCommitCache( pdTRUE );
+
+    ( void ) xSemaphoreGive( xKvMutex );
+
+    return xResult;
+}
+
+#endif /* KV_STORE_CACHE_ENABLE */
+
 KVStoreKey_t kvStringToKey( const char * pcKey )
 {
-    KVStoreKey_t xKey = CS_NUM_KEYS;
+    KVStoreKey_t xKey = KV_STORE_KEY_INVALID;
+    uint32_t ulSlot = 0;
+
+    if( pcKey != NULL )
+    {
+        xKey = xHashLookup( pcKey, &ulSlot );
+    }
+
+    return xKey;
+}
+
+UBaseType_t KVStore_uxGetNumKeys( void )
+{
+    return uxNumKeys;
+}
+
+/*
+ * @brief Add a key to the keyspace at runtime.
+ *
+ * The value of the key is loaded from non-volatile storage when it is registered
+ * and can then be used with the other KVStore functions like a compile time key.
+ * Registering a name that already exists with the same type returns the existing key.
+ *
+ * @param[in] pcName Name of the key, at most KVSTORE_KEY_MAX_LEN characters. The name is copied.
+ * @param[in] xType Type of the value.
+ * @param[in] xDefaultLength Length of the default value, 0 for no default.
+ * @param[in] pvDefault Default value. Values larger than a pointer are referenced, not copied,
+ * so they must remain valid while the key is in use.
+ * @return The key or KV_STORE_KEY_INVALID on failure.
+ */
+KVStoreKey_t KVStore_xRegisterKey( const char * pcName,
+                                   KVStoreValueType_t xType,
+                                   size_t xDefaultLength,
+                                   const void * pvDefault )
+{
+    KVStoreKey_t xKey = KV_STORE_KEY_INVALID;
+    size_t xNameLength = 0;
 
-    for( uint32_t i = 0; i < CS_NUM_KEYS; i++ )
+    configASSERT( xKvMutex != NULL );
+
+    if( pcName != NULL )
+    {
+        xNameLength = strnlen( pcName, KVSTORE_KEY_MAX_LEN + 1 );
+    }
+
+    if( ( xNameLength == 0 ) ||
+        ( xNameLength > KVSTORE_KEY_MAX_LEN ) ||
+        ( xType == KV_TYPE_NONE ) ||
+        ( xType >= KV_TYPE_LAST ) ||
+        ( xDefaultLength > KVSTORE_VAL_MAX_LEN ) ||
+        ( ( xDefaultLength > 0 ) && ( pvDefault == NULL ) ) )
+    {
+        LogError( "Invalid parameters for kvstore key registration." );
+    }
+    else
     {
-        if( 0 == strcmp( kvStoreKeyMap[ i ], pcKey ) )
+        uint32_t ulSlot = 0;
+
+        vWriteLock();
+
+        xKey = xHashLookup( pcName, &ulSlot );
+
+        if( xKey != KV_STORE_KEY_INVALID )
         {
-            xKey = i;
-            break;
+            if( pxGetDefault( xKey )->type != xType )
+            {
+                LogError( "kvstore key: %s is already registered with a different type.", pcName );
+                xKey = KV_STORE_KEY_INVALID;
+            }
         }
+        else if( uxNumKeys >= KV_STORE_NUM_KEYS )
+        {
+            LogError( "No room to register kvstore key: %s. Increase KV_STORE_DYNAMIC_KEYS.", pcName );
+        }
+        else
+        {
+            UBaseType_t uxIndex = uxNumKeys - CS_NUM_KEYS;
+            KVStoreDefaultEntry_t * pxDefault = &( xDynamicDefaults[ uxIndex ] );
+
+            xKey = ( KVStoreKey_t ) uxNumKeys;
+
+            ( void ) memcpy( pcDynamicKeyNames[ uxIndex ], pcName, xNameLength );
+            pcDynamicKeyNames[ uxIndex ][ xNameLength ] = '\0';
+            kvStoreKeyMap[ xKey ] = pcDynamicKeyNames[ uxIndex ];
+
+            pxDefault->type = xType;
+            pxDefault->length = xDefaultLength;
+
+            if( xDefaultLength > sizeof( void * ) )
+            {
+                pxDefault->blob = pvDefault;
+            }
+            else if( xDefaultLength > 0 )
+            {
+                ( void ) memcpy( &( pxDefault->u32 ), pvDefault, xDefaultLength );
+            }
+            else
+            {
+                pxDefault->blob = NULL;
+            }
+
+            /* Publish the name and default before the key can be found */
+            portMEMORY_BARRIER();
+            usKeyHashTable[ ulSlot ] = ( uint16_t ) ( xKey + 1U );
+            uxNumKeys++;
+
+#if KV_STORE_CACHE_ENABLE
+            vprvCacheLoadKey( xKey );
+#endif
+        }
+
+        vWriteUnlock();
     }
 
     return xKey;
 }
+
+/*
+ * @brief Length of the value a batch item would write, 0 if the item is not valid.
+ */
+static size_t xGetItemWriteLength( const KVStoreItem_t * pxItem )
+{
+    size_t xLength = 0;
+
+    if( ( xIsValidKey( pxItem->xKey ) == pdFALSE ) ||
+        ( pxItem->pvData == NULL ) ||
+        ( pxItem->xSize == 0 ) )
+    {
+        xLength = 0;
+    }
+    else if( pxGetDefault( pxItem->xKey )->type == KV_TYPE_STRING )
+    {
+        xLength = strnlen( ( const char * ) pxItem->pvData, pxItem->xSize );
+
+        /* Only accept terminated strings */
+        xLength = ( xLength < pxItem->xSize ) ? ( xLength + 1 ) : 0;
+    }
+    else if( pxGetDefault( pxItem->xKey )->type == KV_TYPE_BLOB )
+    {
+        xLength = pxItem->xSize;
+    }
+    else if( pxItem->xSize == pxGetDefault( pxItem->xKey )->length )
+    {
+        xLength = pxItem->xSize;
+    }
+    else
+    {
+        xLength = 0;
+    }
+
+    return xLength;
+}
+
+static void prvReadItems( KVStoreItem_t * pxItems,
+                          size_t xNumItems )
+{
+    for( size_t i = 0; i < xNumItems; i++ )
+    {
+        KVStoreItem_t * pxItem = &( pxItems[ i ] );
+
+        pxItem->xLength = 0;
+
+        if( ( xIsValidKey( pxItem->xKey ) == pdTRUE ) &&
+            ( pxItem->pvData != NULL ) &&
+            ( pxItem->xSize > 0 ) )
+        {
+            KVStoreValueType_t xType = pxGetDefault( pxItem->xKey )->type;
+
+            if( xType == KV_TYPE_STRING )
+            {
+                pxItem->xLength = xReadEntryOrDefault( pxItem->xKey, pxItem->pvData, pxItem->xSize );
+
+                /* Ensure null terminated */
+                ( ( char * ) pxItem->pvData )[ pxItem->xSize - 1 ] = '\0';
+            }
+            else if( ( xType == KV_TYPE_BLOB ) ||
+                     ( pxItem->xSize == pxGetDefault( pxItem->xKey )->length ) )
+            {
+                pxItem->xLength = xReadEntryOrDefault( pxItem->xKey, pxItem->pvData, pxItem->xSize );
+            }
+            else
+            {
+                LogError( "Buffer for kvstore key: %s does not match the size of its type.",
+                          kvStoreKeyMap[ pxItem->xKey ] );
+            }
+        }
+    }
+}
+
+/*
+ * @brief Read several keys into caller provided buffers as one consistent snapshot.
+ *
+ * No write to the key value store can be observed part way through the batch.
+ * A value longer than its buffer is truncated, which the caller can detect
+ * from xLength being larger than xSize.
+ *
+ * @return pdTRUE if every item was read.
+ */
+BaseType_t KVStore_xGetItems( KVStoreItem_t * pxItems,
+                              size_t xNumItems )
+{
+    BaseType_t xResult = pdFALSE;
+    BaseType_t xDone = pdFALSE;
+
+    if( ( pxItems != NULL ) && ( xNumItems > 0 ) )
+    {
+#if KV_STORE_CACHE_ENABLE
+        for( uint32_t ulAttempt = 0; ( ulAttempt < KV_STORE_READ_RETRIES ) && ( xDone == pdFALSE ); ulAttempt++ )
+        {
+            uint32_t ulSequence = ulKvSequence;
+
+            portMEMORY_BARRIER();
+
+            if( ( ulSequence & 1U ) == 0 )
+            {
+                prvReadItems( pxItems, xNumItems );
+
+                portMEMORY_BARRIER();
+
+                xDone = ( ulKvSequence == ulSequence );
+            }
+        }
+#endif /* KV_STORE_CACHE_ENABLE */
+
+        if( xDone == pdFALSE )
+        {
+            ( void ) xSemaphoreTake( xKvMutex, portMAX_DELAY );
+
+            prvReadItems( pxItems, xNumItems );
+
+            ( void ) xSemaphoreGive( xKvMutex );
+        }
+
+        xResult = pdTRUE;
+
+        for( size_t i = 0; i < xNumItems; i++ )
+        {
+            if( pxItems[ i ].xLength == 0 )
+            {
+                xResult = pdFALSE;
+            }
+        }
+    }
+
+    return xResult;
+}
+
+/*
+ * @brief Write several keys at once.
+ *
+ * All items are validated before anything is written so that an invalid item leaves
+ * the store untouched, and readers observe either none or all of the new values.
+ *
+ * @param[in] xCommit When pdTRUE the batch is written to non-volatile storage before
+ * returning. With KV_STORE_WRITE_BACK_ENABLE the batch is stored by a single journal
+ * append, so it survives a power loss either completely or not at all.
+ * @return pdTRUE if every item was written (and committed when requested).
+ */
+BaseType_t KVStore_xSetItems( const KVStoreItem_t * pxItems,
+                              size_t xNumItems,
+                              BaseType_t xCommit )
+{
+    BaseType_t xResult = pdFALSE;
+
+    if( ( pxItems != NULL ) && ( xNumItems > 0 ) )
+    {
+        xResult = pdTRUE;
+
+        for( size_t i = 0; ( i < xNumItems ) && ( xResult == pdTRUE ); i++ )
+        {
+            if( xGetItemWriteLength( &( pxItems[ i ] ) ) == 0 )
+            {
+                LogError( "Invalid value in kvstore batch write at index %d.", i );
+                xResult = pdFALSE;
+            }
+        }
+    }
+
+    if( xResult == pdTRUE )
+    {
+        vWriteLock();
+
+        for( size_t i = 0; i < xNumItems; i++ )
+        {
+            const KVStoreItem_t * pxItem = &( pxItems[ i ] );
+
+            if( WRITE_ENTRY( pxItem->xKey,
+                             pxGetDefault( pxItem->xKey )->type,
+                             xGetItemWriteLength( pxItem ),
+                             pxItem->pvData ) != pdTRUE )
+            {
+                xResult = pdFALSE;
+            }
+        }
+
+        vWriteUnlock();
+    }
+
+#if KV_STORE_CACHE_ENABLE
+    if( ( xResult == pdTRUE ) && ( xCommit == pdTRUE ) )
+    {
+        xResult = KVStore_xFlush();
+    }
+#else
+    /* Values are written through to non-volatile storage */
+    ( void ) xCommit;
+#endif
+
+    return xResult;
+}
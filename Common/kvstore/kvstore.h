@@ -63,10 +63,37 @@ typedef enum KVStoreKey
 
 #include "kvstore_config.h"
 
-extern const char * const kvStoreKeyMap[ CS_NUM_KEYS ];
+/* Number of keys application modules may add with KVStore_xRegisterKey */
+#ifndef KV_STORE_DYNAMIC_KEYS
+#define KV_STORE_DYNAMIC_KEYS    16
+#endif
+
+#define KV_STORE_NUM_KEYS        ( CS_NUM_KEYS + KV_STORE_DYNAMIC_KEYS )
+
+/* Returned by kvStringToKey and KVStore_xRegisterKey when there is no such key */
+#define KV_STORE_KEY_INVALID     ( ( KVStoreKey_t ) KV_STORE_NUM_KEYS )
+
+extern const char * kvStoreKeyMap[ KV_STORE_NUM_KEYS ];
 
 typedef enum KvStoreEnum KVStoreKey_t;
 
+/*
+ * One key of a KVStore_xGetItems or KVStore_xSetItems batch.
+ * Numeric values must be given a buffer of exactly the size of their type.
+ * Strings are written up to the first null terminator within xSize bytes.
+ */
+typedef struct KVStoreItem
+{
+    KVStoreKey_t xKey;
+    void * pvData;  /* Buffer to read the value into, or value to write */
+    size_t xSize;   /* Size of the buffer at pvData */
+    size_t xLength; /* Set by KVStore_xGetItems to the full length of the value, 0 on failure */
+} KVStoreItem_t;
+
+/* Batch item reading into or writing from the variable or array var */
+#define KV_ITEM( key, var ) \
+    { .xKey = ( key ), .pvData = ( void * ) &( var ), .xSize = sizeof( var ), .xLength = 0 }
+
 /* Public function definitions */
 void KVStore_init( void );
 
@@ -114,6 +141,19 @@ BaseType_t KVStore_setBase( KVStoreKey_t key,
 const char * kvKeyToString( KVStoreKey_t xKey );
 KVStoreKey_t kvStringToKey( const char * pcKey );
 
+KVStoreKey_t KVStore_xRegisterKey( const char * pcName,
+                                   KVStoreValueType_t xType,
+                                   size_t xDefaultLength,
+                                   const void * pvDefault );
+UBaseType_t KVStore_uxGetNumKeys( void );
+
+BaseType_t KVStore_xGetItems( KVStoreItem_t * pxItems,
+                              size_t xNumItems );
+BaseType_t KVStore_xSetItems( const KVStoreItem_t * pxItems,
+                              size_t xNumItems,
+                              BaseType_t xCommit );
+
 BaseType_t KVStore_xCommitChanges( void );
+BaseType_t KVStore_xFlush( void );
 
 #endif /* _KVSTORE_H */
@@ -23,20 +23,51 @@
  *
  */
 
+#define LOG_MODULE    LOG_MODULE_KVSTORE
+
 #include "FreeRTOS.h"
+#include "timers.h"
 #include "kvstore_prv.h"
+#include "warm_state.h"
 #include <string.h>
 
 #if KV_STORE_CACHE_ENABLE
 
+/* Keep a copy of the stored values across a warm reset, so that the cache is not read back from flash */
+#if KV_STORE_NVIMPL_ENABLE && ( WARM_STATE_ENABLED == 1 )
+#define KV_STORE_WARM_STATE    1
+#else
+#define KV_STORE_WARM_STATE    0
+#endif
+
+/*
+ * Values larger than a pointer are stored in a dedicated arena rather than on the
+ * FreeRTOS heap, so that updating them does not fragment the heap used by TLS and lwIP.
+ * The arena is carved into power of two size classes by a bump pointer and freed
+ * blocks are kept on a free list per class. Values loaded at boot are therefore
+ * placed contiguously at the start of the arena.
+ */
+#ifndef KV_STORE_ARENA_SIZE
+#define KV_STORE_ARENA_SIZE         2048U
+#endif
+
+#define KV_STORE_SLAB_MIN_SIZE      16U
+#define KV_STORE_SLAB_NUM_CLASSES   8U
+
 typedef struct
 {
     KVStoreValueType_t type;
     size_t length;
+    size_t capacity; /* Size of the buffer at pvData, 0 when the value is stored in place */
+    void * pvData;
+
+    /*
+     * Small values are kept here rather than in pvData so that a reader racing a
+     * writer never mistakes an in place value for a buffer address.
+     */
     union
     {
-        void * pvData;
-        char * pcData;
+        void * pvInline;
         UBaseType_t uxData;
         BaseType_t xData;
         uint32_t ulData;
@@ -45,20 +76,132 @@ typedef struct
     BaseType_t xChangePending;
 } KVStoreCacheEntry_t;
 
-static KVStoreCacheEntry_t kvStoreCache[ CS_NUM_KEYS ] = { 0 };
+typedef struct KVStoreSlabBlock
+{
+    struct KVStoreSlabBlock * pxNext;
+} KVStoreSlabBlock_t;
+
+static KVStoreCacheEntry_t kvStoreCache[ KV_STORE_NUM_KEYS ] = { 0 };
+
+static union
+{
+    uint64_t ullAlign;
+    uint8_t ucData[ KV_STORE_ARENA_SIZE ];
+} xArena = { 0 };
+
+static size_t xArenaUsed = 0;
+static KVStoreSlabBlock_t * pxSlabFreeList[ KV_STORE_SLAB_NUM_CLASSES ] = { 0 };
+
+#if KV_STORE_WRITE_BACK_ENABLE
+static TimerHandle_t xFlushTimer = NULL;
+#endif
+
+#if KV_STORE_WARM_STATE
+/* The WARM_STATE_KVSTORE record starts with the key layout, then holds this header
+ * and the value, padded to 4 bytes, for each compile time key that is set */
+typedef struct
+{
+    uint16_t usKey;
+    uint16_t usType;
+    uint32_t ulLength;
+} KVStoreWarmEntry_t;
+
+#define KV_STORE_WARM_PAD( x )    ( ( ( x ) + 3U ) & ~( ( size_t ) 3U ) )
+#endif /* KV_STORE_WARM_STATE */
+
+static inline BaseType_t xIsArenaBlock( const void * pvData )
+{
+    const uint8_t * pucData = ( const uint8_t * ) pvData;
+
+    return( ( pucData >= xArena.ucData ) &&
+            ( pucData < &( xArena.ucData[ KV_STORE_ARENA_SIZE ] ) ) );
+}
+
+/*
+ * @brief Allocate a buffer of at least xLength bytes for a cached value.
+ * @param[out] pxCapacity Usable size of the returned buffer.
+ * @return The buffer, or NULL if neither the arena nor the heap has room.
+ */
+static void * pvSlabAlloc( size_t xLength,
+                           size_t * pxCapacity )
+{
+    void * pvData = NULL;
+    size_t xClassSize = KV_STORE_SLAB_MIN_SIZE;
+    uint32_t ulClass = 0;
+
+    while( ( xClassSize < xLength ) &&
+           ( ulClass < KV_STORE_SLAB_NUM_CLASSES ) )
+    {
+        xClassSize <<= 1;
+        ulClass++;
+    }
+
+    if( ulClass >= KV_STORE_SLAB_NUM_CLASSES )
+    {
+        /* Larger than any size class */
+    }
+    else if( pxSlabFreeList[ ulClass ] != NULL )
+    {
+        pvData = pxSlabFreeList[ ulClass ];
+        pxSlabFreeList[ ulClass ] = pxSlabFreeList[ ulClass ]->pxNext;
+    }
+    else if( ( KV_STORE_ARENA_SIZE - xArenaUsed ) >= xClassSize )
+    {
+        pvData = &( xArena.ucData[ xArenaUsed ] );
+        xArenaUsed += xClassSize;
+    }
+    else
+    {
+        LogWarn( "kvstore arena is full, consider increasing KV_STORE_ARENA_SIZE." );
+    }
+
+    if( pvData != NULL )
+    {
+        *pxCapacity = xClassSize;
+    }
+    else
+    {
+        pvData = pvHeapMallocTagged( xLength, HEAP_TAG_KVSTORE );
+        *pxCapacity = ( pvData != NULL ) ? xLength : 0;
+    }
+
+    return pvData;
+}
+
+static void vSlabFree( void * pvData,
+                       size_t xCapacity )
+{
+    if( xIsArenaBlock( pvData ) == pdTRUE )
+    {
+        uint32_t ulClass = 0;
+
+        while( ( KV_STORE_SLAB_MIN_SIZE << ulClass ) < xCapacity )
+        {
+            ulClass++;
+        }
 
+        configASSERT( ( KV_STORE_SLAB_MIN_SIZE << ulClass ) == xCapacity );
+
+        ( ( KVStoreSlabBlock_t * ) pvData )->pxNext = pxSlabFreeList[ ulClass ];
+        pxSlabFreeList[ ulClass ] = ( KVStoreSlabBlock_t * ) pvData;
+    }
+    else
+    {
+        vPortFree( pvData );
+    }
+}
 
 static inline void * pvGetDataWritePtr( KVStoreKey_t key )
 {
     void * pvData = NULL;
 
-    if( kvStoreCache[ key ].length > sizeof( void * ) )
+    if( kvStoreCache[ key ].capacity > 0 )
     {
         pvData = kvStoreCache[ key ].pvData;
     }
     else
     {
-        pvData = ( void * ) &( kvStoreCache[ key ].pvData );
+        pvData = ( void * ) &( kvStoreCache[ key ].pvInline );
     }
 
     configASSERT( pvData != NULL );
@@ -73,13 +216,13 @@ static inline const void * pvGetDataReadPtr( KVStoreKey_t key )
     {
         pvData = NULL;
     }
-    else if( kvStoreCache[ key ].length > sizeof( void * ) )
+    else if( kvStoreCache[ key ].capacity > 0 )
     {
         pvData = kvStoreCache[ key ].pvData;
     }
     else
     {
-        pvData = ( void * ) &( kvStoreCache[ key ].pvData );
+        pvData = ( void * ) &( kvStoreCache[ key ].pvInline );
     }
 
     return pvData;
@@ -88,28 +231,31 @@ static inline const void * pvGetDataReadPtr( KVStoreKey_t key )
 static inline void vAllocateDataBuffer( KVStoreKey_t key,
                                         size_t xNewLength )
 {
-    if( xNewLength > sizeof( void * ) )
+    if( xNewLength > sizeof( kvStoreCache[ key ].pvInline ) )
     {
-        kvStoreCache[ key ].pvData = pvPortMalloc( xNewLength );
+        kvStoreCache[ key ].pvData = pvSlabAlloc( xNewLength, &( kvStoreCache[ key ].capacity ) );
         kvStoreCache[ key ].length = xNewLength;
+        configASSERT( kvStoreCache[ key ].pvData != NULL );
     }
     else
     {
         kvStoreCache[ key ].ulData = 0;
+        kvStoreCache[ key ].capacity = 0;
         kvStoreCache[ key ].length = xNewLength;
     }
 }
 
 static inline void vClearDataBuffer( KVStoreKey_t key )
 {
-    /* Check if data is heap allocated > sizeof( void * ) */
-    if( kvStoreCache[ key ].length > sizeof( void * ) )
+    /* Check if data is stored in a separate buffer */
+    if( kvStoreCache[ key ].capacity > 0 )
     {
-        vPortFree( kvStoreCache[ key ].pvData );
+        vSlabFree( kvStoreCache[ key ].pvData, kvStoreCache[ key ].capacity );
         kvStoreCache[ key ].pvData = NULL;
+        kvStoreCache[ key ].capacity = 0;
         kvStoreCache[ key ].length = 0;
     }
-    else /* Statically allocated */
+    else /* Stored in place */
     {
         kvStoreCache[ key ].length = 0;
         kvStoreCache[ key ].xData = 0;
@@ -119,46 +265,307 @@ static inline void vClearDataBuffer( KVStoreKey_t key )
 static inline void vReallocDataBuffer( KVStoreKey_t key,
                                        size_t xNewLength )
 {
-    if( xNewLength > kvStoreCache[ key ].length )
+    size_t xCapacity = kvStoreCache[ key ].capacity;
+
+    if( xCapacity == 0 )
+    {
+        xCapacity = sizeof( kvStoreCache[ key ].pvInline );
+    }
+
+    if( xNewLength > xCapacity )
     {
         /* Need to allocate a bigger buffer */
         vClearDataBuffer( key );
         vAllocateDataBuffer( key, xNewLength );
     }
-    else /* New value is same size or smaller. Re-use already allocated buffer */
+    else /* New value fits in the current buffer. Re-use it */
     {
         kvStoreCache[ key ].length = xNewLength;
     }
 }
 
-/*
- * @brief Initialize the Key Value Store Cache by reading each entry from the storage nvm store.
- */
-void vprvCacheInit( void )
+#if KV_STORE_WRITE_BACK_ENABLE
+static void prvJournalLoad( KVStoreKey_t xKey,
+                            KVStoreValueType_t xType,
+                            size_t xLength,
+                            const void * pvData )
 {
+    /* The journal is replayed again when a key is registered, keep values set since startup */
+    if( kvStoreCache[ xKey ].xChangePending == pdFALSE )
+    {
+        ( void ) xprvWriteCacheEntry( xKey, xType, xLength, pvData );
+
+        /* The value was just read back from non-volatile storage */
+        kvStoreCache[ xKey ].xChangePending = pdFALSE;
+    }
+}
+
+static const void * pvJournalSource( KVStoreKey_t xKey,
+                                     BaseType_t xAll,
+                                     KVStoreValueType_t * pxType,
+                                     size_t * pxLength )
+{
+    const void * pvData = NULL;
+
+    if( ( xAll == pdTRUE ) ||
+        ( kvStoreCache[ xKey ].xChangePending == pdTRUE ) )
+    {
+        pvData = pvGetDataReadPtr( xKey );
+        *pxType = kvStoreCache[ xKey ].type;
+        *pxLength = kvStoreCache[ xKey ].length;
+    }
+
+    return pvData;
+}
+
+static void prvFlushTimerCallback( TimerHandle_t xTimer )
+{
+    ( void ) xTimer;
+
+    if( KVStore_xFlush() != pdTRUE )
+    {
+        LogError( "Failed to flush pending kvstore changes." );
+    }
+}
+#endif /* KV_STORE_WRITE_BACK_ENABLE */
+
 #if KV_STORE_NVIMPL_ENABLE
-    /* Read from file system into ram */
+static void prvLoadEntryFromImpl( KVStoreKey_t xKey )
+{
+    /* pvData pointer should be NULL on startup */
+    configASSERT_CONTINUE( kvStoreCache[ xKey ].pvData == NULL );
+
+
+    kvStoreCache[ xKey ].xChangePending = pdFALSE;
+    kvStoreCache[ xKey ].type = KV_TYPE_NONE;
+
+    size_t xNvLength = xprvGetValueLengthFromImpl( xKey );
+
+    if( xNvLength > 0 )
+    {
+        vAllocateDataBuffer( xKey, xNvLength );
+
+        KVStoreValueType_t * pxType = &( kvStoreCache[ xKey ].type );
+        size_t * pxLength = &( kvStoreCache[ xKey ].length );
+
+        ( void ) xprvReadValueFromImpl( xKey, pxType, pxLength, pvGetDataWritePtr( xKey ), *pxLength );
+    }
+}
+#endif /* KV_STORE_NVIMPL_ENABLE */
+
+#if KV_STORE_WARM_STATE
+
+/* Identifies the compile time keys and their types, the snapshot of another firmware is not used */
+static uint32_t ulWarmLayout( void )
+{
+    uint32_t ulLayout = CS_NUM_KEYS;
+
     for( uint32_t i = 0; i < CS_NUM_KEYS; i++ )
     {
-        /* pvData pointer should be NULL on startup */
-        configASSERT_CONTINUE( kvStoreCache[ i ].pvData == NULL );
+        ulLayout = ( ulLayout * 31U ) ^ ulprvHashKeyName( kvStoreKeyMap[ i ] ) ^ ( uint32_t ) kvStoreDefaults[ i ].type;
+    }
 
+    return ulLayout;
+}
 
-        kvStoreCache[ i ].xChangePending = pdFALSE;
-        kvStoreCache[ i ].type = KV_TYPE_NONE;
+/*
+ * @brief Snapshot the values of the compile time keys, which must match non-volatile storage.
+ * Keys registered at runtime are read from storage when they are registered again.
+ */
+static void prvWarmSave( void )
+{
+    size_t uxCapacity = 0;
+    uint8_t * pucRecord = ( uint8_t * ) pvWarmStateBegin( WARM_STATE_KVSTORE, &uxCapacity );
+    uint32_t ulLayout = ulWarmLayout();
+    size_t uxOffset = sizeof( ulLayout );
+    BaseType_t xFits = ( uxCapacity >= uxOffset );
 
-        size_t xNvLength = xprvGetValueLengthFromImpl( i );
+    if( xFits == pdTRUE )
+    {
+        ( void ) memcpy( pucRecord, &ulLayout, sizeof( ulLayout ) );
+    }
 
-        if( xNvLength > 0 )
+    for( uint32_t i = 0; ( i < CS_NUM_KEYS ) && ( xFits == pdTRUE ); i++ )
+    {
+        if( kvStoreCache[ i ].type != KV_TYPE_NONE )
         {
-            vAllocateDataBuffer( i, xNvLength );
+            KVStoreWarmEntry_t xEntry =
+            {
+                .usKey    = ( uint16_t ) i,
+                .usType   = ( uint16_t ) kvStoreCache[ i ].type,
+                .ulLength = ( uint32_t ) kvStoreCache[ i ].length,
+            };
+
+            if( ( uxCapacity - uxOffset ) < ( sizeof( xEntry ) + KV_STORE_WARM_PAD( xEntry.ulLength ) ) )
+            {
+                xFits = pdFALSE;
+            }
+            else
+            {
+                ( void ) memcpy( &( pucRecord[ uxOffset ] ), &xEntry, sizeof( xEntry ) );
+                uxOffset += sizeof( xEntry );
+
+                ( void ) memcpy( &( pucRecord[ uxOffset ] ), pvGetDataReadPtr( i ), xEntry.ulLength );
+                uxOffset += KV_STORE_WARM_PAD( xEntry.ulLength );
+            }
+        }
+    }
+
+    if( xFits == pdTRUE )
+    {
+        vWarmStateCommit( WARM_STATE_KVSTORE, uxOffset );
+    }
+    else
+    {
+        LogWarn( "kvstore values do not fit in WARM_STATE_KVSTORE_LEN, a warm reset reads them from flash." );
+    }
+}
+
+/*
+ * @brief Walk the snapshot kept across the reset, loading the values into the cache with xApply.
+ * @return pdFALSE if there is no usable snapshot.
+ */
+static BaseType_t xWarmParse( const uint8_t * pucRecord,
+                              size_t uxLength,
+                              BaseType_t xApply )
+{
+    uint32_t ulLayout = 0;
+    size_t uxOffset = sizeof( ulLayout );
+    BaseType_t xValid = ( uxLength >= uxOffset );
+
+    if( xValid == pdTRUE )
+    {
+        ( void ) memcpy( &ulLayout, pucRecord, sizeof( ulLayout ) );
+        xValid = ( ulLayout == ulWarmLayout() );
+    }
+
+    while( ( xValid == pdTRUE ) &&
+           ( uxOffset < uxLength ) )
+    {
+        KVStoreWarmEntry_t xEntry = { 0 };
+
+        if( ( uxLength - uxOffset ) < sizeof( xEntry ) )
+        {
+            xValid = pdFALSE;
+        }
+        else
+        {
+            ( void ) memcpy( &xEntry, &( pucRecord[ uxOffset ] ), sizeof( xEntry ) );
+            uxOffset += sizeof( xEntry );
+
+            if( ( xEntry.usKey >= CS_NUM_KEYS ) ||
+                ( xEntry.usType == KV_TYPE_NONE ) ||
+                ( xEntry.usType >= KV_TYPE_LAST ) ||
+                ( xEntry.ulLength == 0 ) ||
+                ( ( uxLength - uxOffset ) < KV_STORE_WARM_PAD( xEntry.ulLength ) ) )
+            {
+                xValid = pdFALSE;
+            }
+            else
+            {
+                if( xApply == pdTRUE )
+                {
+                    ( void ) xprvWriteCacheEntry( xEntry.usKey, ( KVStoreValueType_t ) xEntry.usType,
+                                                  xEntry.ulLength, &( pucRecord[ uxOffset ] ) );
+                    kvStoreCache[ xEntry.usKey ].xChangePending = pdFALSE;
+                }
+
+                uxOffset += KV_STORE_WARM_PAD( xEntry.ulLength );
+            }
+        }
+    }
+
+    return xValid;
+}
+
+static BaseType_t xWarmRestore( void )
+{
+    size_t uxLength = 0;
+    const uint8_t * pucRecord = ( const uint8_t * ) pvWarmStateGet( WARM_STATE_KVSTORE, &uxLength );
+    BaseType_t xRestored = pdFALSE;
+
+    /* Check the whole record before loading part of it */
+    if( ( pucRecord != NULL ) &&
+        ( xWarmParse( pucRecord, uxLength, pdFALSE ) == pdTRUE ) )
+    {
+        ( void ) xWarmParse( pucRecord, uxLength, pdTRUE );
+        xRestored = pdTRUE;
+        LogInfo( "Loaded the kvstore cache kept across the reset." );
+    }
+
+    return xRestored;
+}
+
+#endif /* KV_STORE_WARM_STATE */
+
+/*
+ * @brief Load the stored value of a key registered at runtime into the cache.
+ */
+void vprvCacheLoadKey( KVStoreKey_t xKey )
+{
+    configASSERT( ( UBaseType_t ) xKey < KVStore_uxGetNumKeys() );
+
+#if KV_STORE_WRITE_BACK_ENABLE
+    if( xprvReplayJournalFromImpl( prvJournalLoad ) == pdFALSE )
+    {
+        prvLoadEntryFromImpl( xKey );
+    }
+#elif KV_STORE_NVIMPL_ENABLE
+    prvLoadEntryFromImpl( xKey );
+#else
+    ( void ) xKey;
+#endif /* KV_STORE_NVIMPL_ENABLE */
+}
 
-            KVStoreValueType_t * pxType = &( kvStoreCache[ i ].type );
-            size_t * pxLength = &( kvStoreCache[ i ].length );
+/*
+ * @brief Initialize the Key Value Store Cache by reading each entry from the storage nvm store.
+ */
+void vprvCacheInit( void )
+{
+#if KV_STORE_NVIMPL_ENABLE
+    BaseType_t xJournalFound = pdFALSE;
+    BaseType_t xWarmFound = pdFALSE;
 
-            ( void ) xprvReadValueFromImpl( i, pxType, pxLength, pvGetDataWritePtr( i ), *pxLength );
+#if KV_STORE_WARM_STATE
+    /* After a warm reset the snapshot matches what is in flash */
+    xWarmFound = xWarmRestore();
+#endif
+
+#if KV_STORE_WRITE_BACK_ENABLE
+    /* The journal holds every value in one file, read with a single access */
+    if( xWarmFound == pdFALSE )
+    {
+        xJournalFound = xprvReplayJournalFromImpl( prvJournalLoad );
+    }
+#endif
+
+    /* Otherwise read each value from its own file. Entries start out empty, meaning
+     * the default, so only the keys that have been set need to be read. */
+    if( ( xWarmFound == pdFALSE ) &&
+        ( xJournalFound == pdFALSE ) &&
+        ( xprvListKeysFromImpl( prvLoadEntryFromImpl ) == pdFALSE ) )
+    {
+        for( uint32_t i = 0; i < KVStore_uxGetNumKeys(); i++ )
+        {
+            prvLoadEntryFromImpl( i );
         }
     }
+
+#if KV_STORE_WARM_STATE
+    if( xWarmFound == pdFALSE )
+    {
+        prvWarmSave();
+    }
+#endif
+
+#if KV_STORE_WRITE_BACK_ENABLE
+    if( xFlushTimer == NULL )
+    {
+        xFlushTimer = xTimerCreate( "KVFlush", pdMS_TO_TICKS( KV_STORE_FLUSH_DELAY_MS ),
+                                    pdFALSE, NULL, prvFlushTimerCallback );
+        configASSERT( xFlushTimer != NULL );
+    }
+#endif /* KV_STORE_WRITE_BACK_ENABLE */
 #endif /* KV_STORE_NVIMPL_ENABLE */
 }
 
@@ -169,7 +576,7 @@ void vprvCacheInit( void )
  */
 size_t prvGetCacheEntryLength( KVStoreKey_t xKey )
 {
-    configASSERT( xKey < CS_NUM_KEYS );
+    configASSERT( ( UBaseType_t ) xKey < KVStore_uxGetNumKeys() );
     return kvStoreCache[ xKey ].length;
 }
 
@@ -180,7 +587,7 @@ size_t prvGetCacheEntryLength( KVStoreKey_t xKey )
  */
 KVStoreValueType_t prvGetCacheEntryType( KVStoreKey_t xKey )
 {
-    configASSERT( xKey < CS_NUM_KEYS );
+    configASSERT( ( UBaseType_t ) xKey < KVStore_uxGetNumKeys() );
     return kvStoreCache[ xKey ].type;
 }
 
@@ -197,7 +604,7 @@ BaseType_t xprvWriteCacheEntry( KVStoreKey_t xKey,
                                 size_t xLength,
                                 const void * pvNewValue )
 {
-    configASSERT( xKey < CS_NUM_KEYS );
+    configASSERT( ( UBaseType_t ) xKey < KVStore_uxGetNumKeys() );
     configASSERT( xNewType < KV_TYPE_LAST );
     configASSERT( xLength > 0 );
     configASSERT( pvNewValue != NULL );
@@ -256,15 +663,27 @@ BaseType_t xprvCopyValueFromCache( KVStoreKey_t xKey,
 {
     const void * pvDataPtr = NULL;
     size_t xDataLen = 0;
+    size_t xLength = 0;
 
-    configASSERT( xKey < CS_NUM_KEYS );
+    configASSERT( ( UBaseType_t ) xKey < KVStore_uxGetNumKeys() );
     configASSERT( pvBuffer != NULL );
 
     pvDataPtr = pvGetDataReadPtr( xKey );
 
     if( pvDataPtr != NULL )
     {
-        xDataLen = kvStoreCache[ xKey ].length;
+        /*
+         * Readers may run concurrently with a writer and discard the result afterwards,
+         * so read each field once and never copy beyond the buffer seen here.
+         */
+        xLength = kvStoreCache[ xKey ].length;
+        xDataLen = xLength;
+
+        if( ( kvStoreCache[ xKey ].capacity > 0 ) &&
+            ( xDataLen > kvStoreCache[ xKey ].capacity ) )
+        {
+            xDataLen = kvStoreCache[ xKey ].capacity;
+        }
 
         if( xBufferSize < xDataLen )
         {
@@ -282,29 +701,100 @@ BaseType_t xprvCopyValueFromCache( KVStoreKey_t xKey,
 
         if( pxDataLength != NULL )
         {
-            *pxDataLength = kvStoreCache[ xKey ].length;
+            *pxDataLength = xLength;
         }
     }
 
     return( xDataLen > 0 );
 }
 
-BaseType_t KVStore_xCommitChanges( void )
+/*
+ * @brief Write pending changes in the cache to non-volatile storage.
+ * @param[in] xFlush When pdFALSE and write-back is enabled, the write is deferred by up to
+ * KV_STORE_FLUSH_DELAY_MS so that changes committed in quick succession share a single update.
+ * @return pdTRUE if the changes were written or scheduled successfully.
+ */
+BaseType_t xprvCommitCache( BaseType_t xFlush )
 {
     BaseType_t xSuccess = pdTRUE;
 
-#if KV_STORE_NVIMPL_ENABLE
-    for( uint32_t i = 0; i < CS_NUM_KEYS; i++ )
+#if KV_STORE_WRITE_BACK_ENABLE
+    if( ( xFlush == pdFALSE ) &&
+        ( xTimerIsTimerActive( xFlushTimer ) == pdFALSE ) )
+    {
+        /* Write immediately if the timer command queue is full */
+        xFlush = ( xTimerStart( xFlushTimer, 0 ) != pdPASS );
+    }
+
+    if( xFlush == pdTRUE )
+    {
+        xSuccess = xprvWriteJournalToImpl( pvJournalSource );
+
+        if( xSuccess == pdTRUE )
+        {
+            for( uint32_t i = 0; i < KVStore_uxGetNumKeys(); i++ )
+            {
+                kvStoreCache[ i ].xChangePending = pdFALSE;
+            }
+        }
+
+#if KV_STORE_WARM_STATE
+        if( xSuccess == pdTRUE )
+        {
+            prvWarmSave();
+        }
+        else
+        {
+            /* Flash may hold part of the changes */
+            vWarmStateClear( WARM_STATE_KVSTORE );
+        }
+#endif
+    }
+#elif KV_STORE_NVIMPL_ENABLE
+    BaseType_t xChanged = pdFALSE;
+
+    ( void ) xFlush;
+
+    for( uint32_t i = 0; i < KVStore_uxGetNumKeys(); i++ )
     {
         if( kvStoreCache[ i ].xChangePending == pdTRUE )
         {
-            xSuccess &= xprvWriteValueToImpl( i,
-                                              kvStoreCache[ i ].type,
-                                              kvStoreCache[ i ].length,
-                                              pvGetDataReadPtr( i ) );
+            xChanged = pdTRUE;
+
+            BaseType_t xWritten = xprvWriteValueToImpl( i,
+                                                        kvStoreCache[ i ].type,
+                                                        kvStoreCache[ i ].length,
+                                                        pvGetDataReadPtr( i ) );
+
+            if( xWritten == pdTRUE )
+            {
+                kvStoreCache[ i ].xChangePending = pdFALSE;
+            }
+
+            xSuccess &= xWritten;
         }
     }
-#endif /* if KV_STORE_NVIMPL_ENABLE */
+
+#if KV_STORE_WARM_STATE
+    if( xChanged == pdFALSE )
+    {
+        /* The snapshot is still current */
+    }
+    else if( xSuccess == pdTRUE )
+    {
+        prvWarmSave();
+    }
+    else
+    {
+        /* Flash may hold part of the changes */
+        vWarmStateClear( WARM_STATE_KVSTORE );
+    }
+#else
+    ( void ) xChanged;
+#endif
+#else
+    ( void ) xFlush;
+#endif /* if KV_STORE_WRITE_BACK_ENABLE */
     return xSuccess;
 }
 
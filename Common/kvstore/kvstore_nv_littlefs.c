@@ -25,6 +25,7 @@
 
 
 #include "logging_levels.h"
+#define LOG_MODULE    LOG_MODULE_KVSTORE
 #include "logging.h"
 #include "kvstore_prv.h"
 #include <string.h>
@@ -43,6 +44,20 @@ typedef struct
     size_t length; /* Length of value portion (excludes type and length fields */
 } KVStoreTLVHeader_t;
 
+#if KV_STORE_WRITE_BACK_ENABLE
+
+#define KVSTORE_JOURNAL        KVSTORE_PREFIX ".journal"
+#define KVSTORE_JOURNAL_TMP    KVSTORE_PREFIX ".journal.tmp"
+
+/* Each journal record is this header followed by the key name and the value */
+typedef struct
+{
+    uint8_t ucKeyLength; /* Length of the key name, excluding the null terminator */
+    uint8_t ucType;
+    uint16_t usLength;   /* Length of the value */
+} KVStoreJournalHeader_t;
+#endif /* KV_STORE_WRITE_BACK_ENABLE */
+
 static inline void vLfsSSizeToErr( lfs_ssize_t * pxReturnValue,
                                    size_t xExpectedLength )
 {
@@ -99,6 +114,60 @@ size_t xprvGetValueLengthFromImpl( KVStoreKey_t xKey )
     return xLength;
 }
 
+/*
+ * @brief Call pxFound for each key that has a value file, with a single pass over
+ * the directory rather than a lookup per key. Keys without a file keep their
+ * default, which is read in place from kvStoreDefaults.
+ * @return pdTRUE if the directory was listed or does not exist yet.
+ */
+BaseType_t xprvListKeysFromImpl( void ( * pxFound )( KVStoreKey_t xKey ) )
+{
+    lfs_t * pLfsCtx = pxGetDefaultFsCtx();
+    lfs_dir_t xDir = { 0 };
+    struct lfs_info xInfo = { 0 };
+    uint32_t ulFound = 0;
+    int lReturn;
+
+    configASSERT( pxFound != NULL );
+
+    lReturn = lfs_dir_open( pLfsCtx, &xDir, KVSTORE_PREFIX );
+
+    if( lReturn == LFS_ERR_OK )
+    {
+        while( ( lReturn = lfs_dir_read( pLfsCtx, &xDir, &xInfo ) ) > 0 )
+        {
+            /* Skips ".", ".." and the journal files */
+            if( ( xInfo.type == LFS_TYPE_REG ) &&
+                ( xInfo.name[ 0 ] != '.' ) &&
+                ( xInfo.size >= sizeof( KVStoreTLVHeader_t ) ) )
+            {
+                KVStoreKey_t xKey = kvStringToKey( xInfo.name );
+
+                if( xKey != KV_STORE_KEY_INVALID )
+                {
+                    pxFound( xKey );
+                    ulFound++;
+                }
+            }
+        }
+
+        ( void ) lfs_dir_close( pLfsCtx, &xDir );
+
+        LogDebug( "Found %lu stored kvstore values.", ulFound );
+    }
+    else if( lReturn == LFS_ERR_NOENT )
+    {
+        /* Nothing stored yet, every key has its default value */
+        lReturn = LFS_ERR_OK;
+    }
+    else
+    {
+        LogError( "Error while listing stored kvstore values: %ld.", lReturn );
+    }
+
+    return( lReturn == LFS_ERR_OK );
+}
+
 BaseType_t xprvReadValueFromImpl( KVStoreKey_t xKey,
                                   KVStoreValueType_t * pxType,
                                   size_t * pxLength,
@@ -261,6 +330,406 @@ BaseType_t xprvWriteValueToImpl( KVStoreKey_t xKey,
     return( lReturn == LFS_ERR_OK );
 }
 
+#if KV_STORE_WRITE_BACK_ENABLE
+
+/*
+ * @brief Read the whole journal into a heap allocated buffer with a single read.
+ * @param[out] ppucJournal Buffer holding the journal, to be freed with vPortFree, or NULL.
+ * @param[out] pxLength Length of the journal.
+ * @return LFS_ERR_OK on success, LFS_ERR_NOENT if no journal has been written yet.
+ */
+static lfs_ssize_t prvLoadJournal( lfs_t * pLfsCtx,
+                                   uint8_t ** ppucJournal,
+                                   size_t * pxLength )
+{
+    lfs_file_t xFile = { 0 };
+    lfs_ssize_t lReturn = lfs_file_open( pLfsCtx, &xFile, KVSTORE_JOURNAL, LFS_O_RDONLY );
+
+    *ppucJournal = NULL;
+    *pxLength = 0;
+
+    if( lReturn == LFS_ERR_OK )
+    {
+        lfs_soff_t lSize = lfs_file_size( pLfsCtx, &xFile );
+
+        if( lSize < 0 )
+        {
+            lReturn = lSize;
+        }
+        else if( lSize > 0 )
+        {
+            *ppucJournal = pvHeapMallocTagged( lSize, HEAP_TAG_KVSTORE );
+
+            if( *ppucJournal == NULL )
+            {
+                LogError( "Failed to allocate %ld bytes to read the kvstore journal.", lSize );
+                lReturn = LFS_ERR_NOMEM;
+            }
+            else
+            {
+                lReturn = lfs_file_read( pLfsCtx, &xFile, *ppucJournal, lSize );
+                vLfsSSizeToErr( &lReturn, lSize );
+            }
+
+            if( lReturn == LFS_ERR_OK )
+            {
+                *pxLength = lSize;
+            }
+            else if( *ppucJournal != NULL )
+            {
+                vPortFree( *ppucJournal );
+                *ppucJournal = NULL;
+            }
+        }
+        else
+        {
+            /* Empty journal */
+        }
+
+        ( void ) lfs_file_close( pLfsCtx, &xFile );
+    }
+
+    return lReturn;
+}
+
+/*
+ * @brief Parse the record at *pxOffset of a journal held in memory and advance *pxOffset past it.
+ * @param[out] pxHeader Header of the record.
+ * @param[out] pcKey Buffer of KVSTORE_KEY_MAX_LEN + 1 bytes receiving the null terminated key name.
+ * @param[out] ppucValue Set to the value inside the journal buffer.
+ * @return pdTRUE if a complete and valid record was found.
+ */
+static BaseType_t xParseJournalRecord( const uint8_t * pucJournal,
+                                       size_t xLength,
+                                       size_t * pxOffset,
+                                       KVStoreJournalHeader_t * pxHeader,
+                                       char * pcKey,
+                                       const uint8_t ** ppucValue )
+{
+    BaseType_t xValid = pdFALSE;
+    size_t xOffset = *pxOffset;
+
+    if( ( xLength - xOffset ) >= sizeof( KVStoreJournalHeader_t ) )
+    {
+        ( void ) memcpy( pxHeader, &( pucJournal[ xOffset ] ), sizeof( KVStoreJournalHeader_t ) );
+        xOffset += sizeof( KVStoreJournalHeader_t );
+
+        if( ( pxHeader->ucKeyLength > 0 ) &&
+            ( pxHeader->ucKeyLength <= KVSTORE_KEY_MAX_LEN ) &&
+            ( pxHeader->ucType > KV_TYPE_NONE ) &&
+            ( pxHeader->ucType < KV_TYPE_LAST ) &&
+            ( pxHeader->usLength > 0 ) &&
+            ( pxHeader->usLength <= KVSTORE_VAL_MAX_LEN ) &&
+            ( ( xLength - xOffset ) >= ( ( size_t ) pxHeader->ucKeyLength + pxHeader->usLength ) ) )
+        {
+            ( void ) memcpy( pcKey, &( pucJournal[ xOffset ] ), pxHeader->ucKeyLength );
+            pcKey[ pxHeader->ucKeyLength ] = '\0';
+            xOffset += pxHeader->ucKeyLength;
+
+            *ppucValue = &( pucJournal[ xOffset ] );
+            xOffset += pxHeader->usLength;
+
+            *pxOffset = xOffset;
+            xValid = pdTRUE;
+        }
+    }
+
+    return xValid;
+}
+
+/*
+ * @brief Load every record of the journal, oldest first, so later records win.
+ * Records of keys that have not been registered (yet) are skipped.
+ * @param[in] xLoad Callback receiving each record.
+ * @return pdTRUE if a journal exists, in which case it supersedes any per-key files.
+ */
+BaseType_t xprvReplayJournalFromImpl( KVStoreJournalLoad_t xLoad )
+{
+    lfs_t * pLfsCtx = pxGetDefaultFsCtx();
+    uint8_t * pucJournal = NULL;
+    size_t xLength = 0;
+    lfs_ssize_t lReturn = LFS_ERR_OK;
+
+    configASSERT( xLoad != NULL );
+
+    lReturn = prvLoadJournal( pLfsCtx, &pucJournal, &xLength );
+
+    if( lReturn == LFS_ERR_OK )
+    {
+        size_t xOffset = 0;
+        uint32_t ulRecords = 0;
+        KVStoreJournalHeader_t xHeader = { 0 };
+        char pcKey[ KVSTORE_KEY_MAX_LEN + 1 ] = { 0 };
+        const uint8_t * pucValue = NULL;
+
+        while( xParseJournalRecord( pucJournal, xLength, &xOffset, &xHeader, pcKey, &pucValue ) == pdTRUE )
+        {
+            KVStoreKey_t xKey = kvStringToKey( pcKey );
+
+            if( xKey != KV_STORE_KEY_INVALID )
+            {
+                xLoad( xKey, ( KVStoreValueType_t ) xHeader.ucType, xHeader.usLength, pucValue );
+            }
+
+            ulRecords++;
+        }
+
+        if( xOffset != xLength )
+        {
+            LogError( "kvstore journal is corrupt after %lu records.", ulRecords );
+        }
+        else
+        {
+            LogDebug( "Replayed %lu kvstore journal records.", ulRecords );
+        }
+    }
+    else if( lReturn != LFS_ERR_NOENT )
+    {
+        LogError( "Error while reading the kvstore journal: %ld.", lReturn );
+    }
+    else
+    {
+        /* No journal has been written yet */
+    }
+
+    if( pucJournal != NULL )
+    {
+        vPortFree( pucJournal );
+    }
+
+    return( lReturn != LFS_ERR_NOENT );
+}
+
+/*
+ * @brief Copy the journal records of keys that are not registered to an open file,
+ * so that compaction keeps the values of modules that register their keys later.
+ */
+static lfs_ssize_t prvCopyUnregisteredRecords( lfs_t * pLfsCtx,
+                                               lfs_file_t * pxFile )
+{
+    lfs_ssize_t lReturn = LFS_ERR_OK;
+    uint8_t * pucJournal = NULL;
+    size_t xLength = 0;
+
+    if( prvLoadJournal( pLfsCtx, &pucJournal, &xLength ) == LFS_ERR_OK )
+    {
+        size_t xOffset = 0;
+        size_t xRecordStart = 0;
+        KVStoreJournalHeader_t xHeader = { 0 };
+        char pcKey[ KVSTORE_KEY_MAX_LEN + 1 ] = { 0 };
+        const uint8_t * pucValue = NULL;
+
+        /* A corrupt tail ends the copy without failing the compaction */
+        while( ( lReturn == LFS_ERR_OK ) &&
+               ( xParseJournalRecord( pucJournal, xLength, &xOffset, &xHeader, pcKey, &pucValue ) == pdTRUE ) )
+        {
+            if( kvStringToKey( pcKey ) == KV_STORE_KEY_INVALID )
+            {
+                lReturn = lfs_file_write( pLfsCtx, pxFile, &( pucJournal[ xRecordStart ] ), xOffset - xRecordStart );
+                vLfsSSizeToErr( &lReturn, xOffset - xRecordStart );
+            }
+
+            xRecordStart = xOffset;
+        }
+    }
+
+    if( pucJournal != NULL )
+    {
+        vPortFree( pucJournal );
+    }
+
+    return lReturn;
+}
+
+/*
+ * @brief Append a record for each value returned by xSource to an open file.
+ */
+static lfs_ssize_t prvWriteJournalRecords( lfs_t * pLfsCtx,
+                                           lfs_file_t * pxFile,
+                                           KVStoreJournalSource_t xSource,
+                                           BaseType_t xAll )
+{
+    lfs_ssize_t lReturn = LFS_ERR_OK;
+
+    for( uint32_t i = 0; ( i < KVStore_uxGetNumKeys() ) && ( lReturn == LFS_ERR_OK ); i++ )
+    {
+        KVStoreValueType_t xType = KV_TYPE_NONE;
+        size_t xLength = 0;
+        const void * pvData = xSource( i, xAll, &xType, &xLength );
+
+        if( pvData != NULL )
+        {
+            KVStoreJournalHeader_t xHeader =
+            {
+                .ucKeyLength = ( uint8_t ) strlen( kvStoreKeyMap[ i ] ),
+                .ucType      = ( uint8_t ) xType,
+                .usLength    = ( uint16_t ) xLength
+            };
+
+            configASSERT( xLength <= KVSTORE_VAL_MAX_LEN );
+
+            lReturn = lfs_file_write( pLfsCtx, pxFile, &xHeader, sizeof( KVStoreJournalHeader_t ) );
+            vLfsSSizeToErr( &lReturn, sizeof( KVStoreJournalHeader_t ) );
+
+            if( lReturn == LFS_ERR_OK )
+            {
+                lReturn = lfs_file_write( pLfsCtx, pxFile, kvStoreKeyMap[ i ], xHeader.ucKeyLength );
+                vLfsSSizeToErr( &lReturn, xHeader.ucKeyLength );
+            }
+
+            if( lReturn == LFS_ERR_OK )
+            {
+                lReturn = lfs_file_write( pLfsCtx, pxFile, pvData, xLength );
+                vLfsSSizeToErr( &lReturn, xLength );
+            }
+        }
+    }
+
+    return lReturn;
+}
+
+/*
+ * @brief Replace the journal with a single record per key.
+ * The snapshot is written to a temporary file first and renamed over the journal,
+ * so a reset at any point leaves either the old or the new journal intact.
+ */
+static lfs_ssize_t prvCompactJournal( lfs_t * pLfsCtx,
+                                      KVStoreJournalSource_t xSource,
+                                      BaseType_t xMigrate )
+{
+    lfs_file_t xFile = { 0 };
+    lfs_ssize_t lReturn = lfs_file_open( pLfsCtx, &xFile, KVSTORE_JOURNAL_TMP,
+                                         LFS_O_WRONLY | LFS_O_TRUNC | LFS_O_CREAT );
+
+    if( lReturn != LFS_ERR_OK )
+    {
+        LogError( "Error while opening file: %s.", KVSTORE_JOURNAL_TMP );
+    }
+    else
+    {
+        lReturn = prvCopyUnregisteredRecords( pLfsCtx, &xFile );
+
+        if( lReturn == LFS_ERR_OK )
+        {
+            lReturn = prvWriteJournalRecords( pLfsCtx, &xFile, xSource, pdTRUE );
+        }
+
+        if( lReturn == LFS_ERR_OK )
+        {
+            lReturn = lfs_file_close( pLfsCtx, &xFile );
+        }
+        else
+        {
+            ( void ) lfs_file_close( pLfsCtx, &xFile );
+        }
+
+        if( lReturn == LFS_ERR_OK )
+        {
+            lReturn = lfs_rename( pLfsCtx, KVSTORE_JOURNAL_TMP, KVSTORE_JOURNAL );
+        }
+
+        if( lReturn == LFS_ERR_OK )
+        {
+            if( xMigrate == pdTRUE )
+            {
+                LogInfo( "Migrated kvstore values to %s.", KVSTORE_JOURNAL );
+            }
+        }
+        else
+        {
+            LogError( "Error while compacting the kvstore journal: %ld.", lReturn );
+            ( void ) lfs_remove( pLfsCtx, KVSTORE_JOURNAL_TMP );
+        }
+
+        if( ( lReturn == LFS_ERR_OK ) &&
+            ( xMigrate == pdTRUE ) )
+        {
+            /* Values stored one file per key are now part of the journal */
+            for( uint32_t i = 0; i < KVStore_uxGetNumKeys(); i++ )
+            {
+                char pcFileName[ KVSTORE_MAX_FNANME ] = { 0 };
+
+                ( void ) strncpy( pcFileName, KVSTORE_PREFIX, KVSTORE_MAX_FNANME );
+                ( void ) strncat( pcFileName, kvStoreKeyMap[ i ], KVSTORE_MAX_FNANME );
+                ( void ) lfs_remove( pLfsCtx, pcFileName );
+            }
+        }
+    }
+
+    return lReturn;
+}
+
+/*
+ * @brief Write all pending values to the journal in a single file commit.
+ * @param[in] xSource Callback providing the value of each key.
+ * @return pdTRUE if the values were stored successfully.
+ */
+BaseType_t xprvWriteJournalToImpl( KVStoreJournalSource_t xSource )
+{
+    lfs_t * pLfsCtx = pxGetDefaultFsCtx();
+    struct lfs_info xFileInfo = { 0 };
+    lfs_ssize_t lReturn = LFS_ERR_OK;
+    size_t xPendingLength = 0;
+
+    configASSERT( xSource != NULL );
+
+    for( uint32_t i = 0; i < KVStore_uxGetNumKeys(); i++ )
+    {
+        KVStoreValueType_t xType = KV_TYPE_NONE;
+        size_t xLength = 0;
+
+        if( xSource( i, pdFALSE, &xType, &xLength ) != NULL )
+        {
+            xPendingLength += sizeof( KVStoreJournalHeader_t ) + strlen( kvStoreKeyMap[ i ] ) + xLength;
+        }
+    }
+
+    if( xPendingLength == 0 )
+    {
+        /* Nothing to do */
+    }
+    else if( lfs_stat( pLfsCtx, KVSTORE_JOURNAL, &xFileInfo ) != LFS_ERR_OK )
+    {
+        /* First write since values were stored one file per key */
+        lReturn = prvCompactJournal( pLfsCtx, xSource, pdTRUE );
+    }
+    else if( ( xFileInfo.size + xPendingLength ) > KV_STORE_JOURNAL_MAX_LEN )
+    {
+        lReturn = prvCompactJournal( pLfsCtx, xSource, pdFALSE );
+    }
+    else
+    {
+        lfs_file_t xFile = { 0 };
+
+        lReturn = lfs_file_open( pLfsCtx, &xFile, KVSTORE_JOURNAL, LFS_O_WRONLY | LFS_O_APPEND );
+
+        if( lReturn == LFS_ERR_OK )
+        {
+            lReturn = prvWriteJournalRecords( pLfsCtx, &xFile, xSource, pdFALSE );
+
+            if( lReturn == LFS_ERR_OK )
+            {
+                lReturn = lfs_file_close( pLfsCtx, &xFile );
+            }
+            else
+            {
+                ( void ) lfs_file_close( pLfsCtx, &xFile );
+            }
+        }
+
+        /* A failed append may leave a partial record behind, so start over from a snapshot */
+        if( lReturn != LFS_ERR_OK )
+        {
+            LogWarn( "Error while appending to the kvstore journal: %ld.", lReturn );
+            lReturn = prvCompactJournal( pLfsCtx, xSource, pdFALSE );
+        }
+    }
+
+    return( lReturn == LFS_ERR_OK );
+}
+
+#endif /* KV_STORE_WRITE_BACK_ENABLE */
+
 void vprvNvImplInit( void )
 {
     /*TODO: Wait for filesystem initialization */
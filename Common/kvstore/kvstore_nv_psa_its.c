@@ -25,6 +25,7 @@
 
 
 #include "logging_levels.h"
+#define LOG_MODULE    LOG_MODULE_KVSTORE
 #include "logging.h"
 #include "kvstore_prv.h"
 #include <string.h>
@@ -32,7 +33,10 @@
 #if KV_STORE_NVIMPL_ARM_PSA
 #include "psa/internal_trusted_storage.h"
 
-#define KVSTORE_UID_OFFSET    0x1234
+#define KVSTORE_UID_OFFSET            0x1234
+
+/* Keys registered at runtime are stored under a uid derived from their name */
+#define KVSTORE_DYNAMIC_UID_OFFSET    0x100000000ULL
 
 typedef struct
 {
@@ -40,9 +44,56 @@ typedef struct
     size_t length; /* Length of value portion (excludes type and length fields */
 } KVStoreHeader_t;
 
+#if KV_STORE_WRITE_BACK_ENABLE
+
+/*
+ * In write-back mode all values are kept together in a snapshot spread over a few
+ * ITS objects, so that loading or committing the whole store takes one secure call
+ * per object instead of several per key.
+ */
+
+/* Largest ITS object written, must not exceed ITS_MAX_ASSET_SIZE of the TF-M build */
+#ifndef KV_STORE_ITS_OBJECT_SIZE
+#define KV_STORE_ITS_OBJECT_SIZE    512U
+#endif
+
+/* Number of ITS objects the snapshot may be spread over */
+#ifndef KV_STORE_ITS_MAX_OBJECTS
+#define KV_STORE_ITS_MAX_OBJECTS    4U
+#endif
+
+#define KVSTORE_SNAPSHOT_UID        ( KVSTORE_UID_OFFSET - KV_STORE_ITS_MAX_OBJECTS )
+
+/* Each snapshot object is a sequence of records: this header, the key name and the value */
+typedef struct
+{
+    uint8_t ucKeyLength; /* Length of the key name, excluding the null terminator */
+    uint8_t ucType;
+    uint16_t usLength;   /* Length of the value */
+} KVStoreRecordHeader_t;
+
+/* Hash of the contents of each snapshot object as last read or written, 0 if absent */
+static uint32_t ulObjectHash[ KV_STORE_ITS_MAX_OBJECTS ] = { 0 };
+
+/* Set when the snapshot holds values of keys that have not been registered yet */
+static BaseType_t xUnregisteredRecords = pdFALSE;
+
+#endif /* KV_STORE_WRITE_BACK_ENABLE */
+
 static inline psa_storage_uid_t xKeyToUID( KVStoreKey_t xKey )
 {
-    return( KVSTORE_UID_OFFSET + xKey );
+    psa_storage_uid_t xUid = 0;
+
+    if( xKey < CS_NUM_KEYS )
+    {
+        xUid = KVSTORE_UID_OFFSET + xKey;
+    }
+    else
+    {
+        xUid = KVSTORE_DYNAMIC_UID_OFFSET + ulprvHashKeyName( kvStoreKeyMap[ xKey ] );
+    }
+
+    return xUid;
 }
 
 static inline BaseType_t xPSAStatusToBool( psa_status_t xStatus )
@@ -165,7 +216,7 @@ BaseType_t xprvWriteValueToImpl( const KVStoreKey_t xKey,
     psa_status_t xResult = PSA_SUCCESS;
     void * pvBuffer = NULL;
 
-    if( ( xKey > CS_NUM_KEYS ) ||
+    if( ( ( UBaseType_t ) xKey >= KVStore_uxGetNumKeys() ) ||
         ( xType == KV_TYPE_NONE ) ||
         ( xLength < 0 ) ||
         ( pvData == NULL ) )
@@ -176,7 +227,7 @@ BaseType_t xprvWriteValueToImpl( const KVStoreKey_t xKey,
     /* Stage in memory to reduce number of flash writes required */
     if( xResult == PSA_SUCCESS )
     {
-        pvBuffer = pvPortMalloc( sizeof( KVStoreHeader_t ) + xLength );
+        pvBuffer = pvHeapMallocTagged( sizeof( KVStoreHeader_t ) + xLength, HEAP_TAG_KVSTORE );
 
         if( pvBuffer == NULL )
         {
@@ -215,6 +266,376 @@ BaseType_t xprvWriteValueToImpl( const KVStoreKey_t xKey,
     return xPSAStatusToBool( xResult );
 }
 
+#if KV_STORE_WRITE_BACK_ENABLE
+
+static inline psa_storage_uid_t xSnapshotUID( uint32_t ulObject )
+{
+    return KVSTORE_SNAPSHOT_UID + ulObject;
+}
+
+static uint32_t ulHashObject( const uint8_t * pucData,
+                              size_t xLength )
+{
+    uint32_t ulHash = 2166136261UL;
+
+    for( size_t i = 0; i < xLength; i++ )
+    {
+        ulHash = ( ulHash ^ pucData[ i ] ) * 16777619UL;
+    }
+
+    /* 0 is reserved for objects that do not exist */
+    return( ( ulHash == 0 ) ? 1 : ulHash );
+}
+
+/*
+ * @brief Parse the record at *pxOffset of a snapshot object and advance *pxOffset past it.
+ * @param[out] pcKey Buffer of KVSTORE_KEY_MAX_LEN + 1 bytes receiving the null terminated key name.
+ * @param[out] ppucValue Set to the value inside the object buffer.
+ * @return pdTRUE if a complete and valid record was found.
+ */
+static BaseType_t xParseRecord( const uint8_t * pucObject,
+                                size_t xLength,
+                                size_t * pxOffset,
+                                KVStoreRecordHeader_t * pxHeader,
+                                char * pcKey,
+                                const uint8_t ** ppucValue )
+{
+    BaseType_t xValid = pdFALSE;
+    size_t xOffset = *pxOffset;
+
+    if( ( xLength - xOffset ) >= sizeof( KVStoreRecordHeader_t ) )
+    {
+        ( void ) memcpy( pxHeader, &( pucObject[ xOffset ] ), sizeof( KVStoreRecordHeader_t ) );
+        xOffset += sizeof( KVStoreRecordHeader_t );
+
+        if( ( pxHeader->ucKeyLength > 0 ) &&
+            ( pxHeader->ucKeyLength <= KVSTORE_KEY_MAX_LEN ) &&
+            ( pxHeader->ucType > KV_TYPE_NONE ) &&
+            ( pxHeader->ucType < KV_TYPE_LAST ) &&
+            ( pxHeader->usLength > 0 ) &&
+            ( pxHeader->usLength <= KVSTORE_VAL_MAX_LEN ) &&
+            ( ( xLength - xOffset ) >= ( ( size_t ) pxHeader->ucKeyLength + pxHeader->usLength ) ) )
+        {
+            ( void ) memcpy( pcKey, &( pucObject[ xOffset ] ), pxHeader->ucKeyLength );
+            pcKey[ pxHeader->ucKeyLength ] = '\0';
+            xOffset += pxHeader->ucKeyLength;
+
+            *ppucValue = &( pucObject[ xOffset ] );
+            xOffset += pxHeader->usLength;
+
+            *pxOffset = xOffset;
+            xValid = pdTRUE;
+        }
+    }
+
+    return xValid;
+}
+
+/*
+ * @brief Read one snapshot object into a buffer of KV_STORE_ITS_OBJECT_SIZE bytes.
+ * @return Length of the object, 0 if it does not exist or could not be read.
+ */
+static size_t xReadSnapshotObject( uint32_t ulObject,
+                                   uint8_t * pucBuffer )
+{
+    size_t xLength = 0;
+    psa_status_t xStatus = psa_its_get( xSnapshotUID( ulObject ), 0, KV_STORE_ITS_OBJECT_SIZE,
+                                        pucBuffer, &xLength );
+
+    if( xStatus != PSA_SUCCESS )
+    {
+        if( xStatus != PSA_ERROR_DOES_NOT_EXIST )
+        {
+            LogError( "Error while reading kvstore snapshot object %lu: %ld.", ulObject, xStatus );
+        }
+
+        xLength = 0;
+    }
+
+    return xLength;
+}
+
+/*
+ * @brief Load every record of the snapshot.
+ * Records of keys that have not been registered (yet) are skipped.
+ * @param[in] xLoad Callback receiving each record.
+ * @return pdTRUE if a snapshot exists, in which case it supersedes any per-key objects.
+ */
+BaseType_t xprvReplayJournalFromImpl( KVStoreJournalLoad_t xLoad )
+{
+    BaseType_t xFound = pdFALSE;
+    uint8_t * pucObject = pvHeapMallocTagged( KV_STORE_ITS_OBJECT_SIZE, HEAP_TAG_KVSTORE );
+
+    configASSERT( xLoad != NULL );
+
+    if( pucObject == NULL )
+    {
+        LogError( "Failed to allocate %lu bytes to read the kvstore snapshot.", KV_STORE_ITS_OBJECT_SIZE );
+    }
+    else
+    {
+        uint32_t ulRecords = 0;
+        BaseType_t xUnregistered = pdFALSE;
+
+        /* Objects are filled in order, so the first missing one ends the snapshot */
+        for( uint32_t ulObject = 0; ulObject < KV_STORE_ITS_MAX_OBJECTS; ulObject++ )
+        {
+            size_t xLength = ( ( ulObject == 0 ) || ( ulObjectHash[ ulObject - 1 ] != 0 ) ) ?
+                             xReadSnapshotObject( ulObject, pucObject ) : 0;
+            size_t xOffset = 0;
+            KVStoreRecordHeader_t xHeader = { 0 };
+            char pcKey[ KVSTORE_KEY_MAX_LEN + 1 ] = { 0 };
+            const uint8_t * pucValue = NULL;
+
+            while( xParseRecord( pucObject, xLength, &xOffset, &xHeader, pcKey, &pucValue ) == pdTRUE )
+            {
+                KVStoreKey_t xKey = kvStringToKey( pcKey );
+
+                if( xKey != KV_STORE_KEY_INVALID )
+                {
+                    xLoad( xKey, ( KVStoreValueType_t ) xHeader.ucType, xHeader.usLength, pucValue );
+                }
+                else
+                {
+                    xUnregistered = pdTRUE;
+                }
+
+                ulRecords++;
+            }
+
+            if( xOffset != xLength )
+            {
+                LogError( "kvstore snapshot object %lu is corrupt.", ulObject );
+            }
+
+            ulObjectHash[ ulObject ] = ( xLength > 0 ) ? ulHashObject( pucObject, xLength ) : 0;
+        }
+
+        xFound = ( ulObjectHash[ 0 ] != 0 );
+        xUnregisteredRecords = xUnregistered;
+
+        LogDebug( "Loaded %lu kvstore records from the snapshot.", ulRecords );
+
+        explicit_bzero( pucObject, KV_STORE_ITS_OBJECT_SIZE );
+        vPortFree( pucObject );
+    }
+
+    return xFound;
+}
+
+/*
+ * @brief Append a record to the snapshot buffer, starting a new object when it does not fit.
+ * Records never span objects, so each object can be parsed on its own.
+ * @return pdFALSE if the snapshot is full.
+ */
+static BaseType_t xAddRecord( uint8_t * pucSnapshot,
+                              size_t * pxObjectLengths,
+                              uint32_t * pulObject,
+                              const KVStoreRecordHeader_t * pxHeader,
+                              const char * pcKey,
+                              const void * pvData )
+{
+    BaseType_t xAdded = pdFALSE;
+    size_t xRecordLength = sizeof( KVStoreRecordHeader_t ) + pxHeader->ucKeyLength + pxHeader->usLength;
+
+    configASSERT( xRecordLength <= KV_STORE_ITS_OBJECT_SIZE );
+
+    if( ( pxObjectLengths[ *pulObject ] + xRecordLength ) > KV_STORE_ITS_OBJECT_SIZE )
+    {
+        ( *pulObject )++;
+    }
+
+    if( *pulObject < KV_STORE_ITS_MAX_OBJECTS )
+    {
+        uint8_t * pucRecord = &( pucSnapshot[ ( *pulObject * KV_STORE_ITS_OBJECT_SIZE ) + pxObjectLengths[ *pulObject ] ] );
+
+        ( void ) memcpy( pucRecord, pxHeader, sizeof( KVStoreRecordHeader_t ) );
+        ( void ) memcpy( &( pucRecord[ sizeof( KVStoreRecordHeader_t ) ] ), pcKey, pxHeader->ucKeyLength );
+        ( void ) memcpy( &( pucRecord[ sizeof( KVStoreRecordHeader_t ) + pxHeader->ucKeyLength ] ), pvData, pxHeader->usLength );
+
+        pxObjectLengths[ *pulObject ] += xRecordLength;
+        xAdded = pdTRUE;
+    }
+    else
+    {
+        LogError( "kvstore snapshot is full, increase KV_STORE_ITS_MAX_OBJECTS." );
+    }
+
+    return xAdded;
+}
+
+/*
+ * @brief Keep the records of keys that are not registered, so that modules registering
+ * their keys later do not lose their values.
+ */
+static BaseType_t xAddUnregisteredRecords( uint8_t * pucSnapshot,
+                                           size_t * pxObjectLengths,
+                                           uint32_t * pulObject )
+{
+    BaseType_t xSuccess = pdTRUE;
+    uint8_t * pucObject = pvHeapMallocTagged( KV_STORE_ITS_OBJECT_SIZE, HEAP_TAG_KVSTORE );
+
+    xSuccess = ( pucObject != NULL );
+
+    for( uint32_t ulObject = 0; ( ulObject < KV_STORE_ITS_MAX_OBJECTS ) && ( xSuccess == pdTRUE ); ulObject++ )
+    {
+        size_t xLength = ( ulObjectHash[ ulObject ] != 0 ) ? xReadSnapshotObject( ulObject, pucObject ) : 0;
+        size_t xOffset = 0;
+        KVStoreRecordHeader_t xHeader = { 0 };
+        char pcKey[ KVSTORE_KEY_MAX_LEN + 1 ] = { 0 };
+        const uint8_t * pucValue = NULL;
+
+        while( ( xSuccess == pdTRUE ) &&
+               ( xParseRecord( pucObject, xLength, &xOffset, &xHeader, pcKey, &pucValue ) == pdTRUE ) )
+        {
+            if( kvStringToKey( pcKey ) == KV_STORE_KEY_INVALID )
+            {
+                xSuccess = xAddRecord( pucSnapshot, pxObjectLengths, pulObject, &xHeader, pcKey, pucValue );
+            }
+        }
+    }
+
+    if( pucObject != NULL )
+    {
+        explicit_bzero( pucObject, KV_STORE_ITS_OBJECT_SIZE );
+        vPortFree( pucObject );
+    }
+
+    return xSuccess;
+}
+
+/*
+ * @brief Store a snapshot of all values if any of them has a pending change.
+ *
+ * Only the objects whose contents changed are written. Each object is replaced
+ * atomically by ITS, so a snapshot that fits in one object is committed atomically.
+ *
+ * @param[in] xSource Callback providing the value of each key.
+ * @return pdTRUE if the values were stored successfully.
+ */
+BaseType_t xprvWriteJournalToImpl( KVStoreJournalSource_t xSource )
+{
+    BaseType_t xSuccess = pdTRUE;
+    BaseType_t xPending = pdFALSE;
+    uint8_t * pucSnapshot = NULL;
+    size_t xObjectLengths[ KV_STORE_ITS_MAX_OBJECTS ] = { 0 };
+    uint32_t ulObject = 0;
+
+    configASSERT( xSource != NULL );
+
+    for( uint32_t i = 0; ( i < KVStore_uxGetNumKeys() ) && ( xPending == pdFALSE ); i++ )
+    {
+        KVStoreValueType_t xType = KV_TYPE_NONE;
+        size_t xLength = 0;
+
+        xPending = ( xSource( i, pdFALSE, &xType, &xLength ) != NULL );
+    }
+
+    if( xPending == pdTRUE )
+    {
+        pucSnapshot = pvHeapMallocTagged( KV_STORE_ITS_OBJECT_SIZE * KV_STORE_ITS_MAX_OBJECTS, HEAP_TAG_KVSTORE );
+
+        if( pucSnapshot == NULL )
+        {
+            LogError( "Failed to allocate %lu bytes for the kvstore snapshot.",
+                      KV_STORE_ITS_OBJECT_SIZE * KV_STORE_ITS_MAX_OBJECTS );
+            xSuccess = pdFALSE;
+        }
+    }
+
+    if( ( pucSnapshot != NULL ) &&
+        ( xUnregisteredRecords == pdTRUE ) )
+    {
+        xSuccess = xAddUnregisteredRecords( pucSnapshot, xObjectLengths, &ulObject );
+    }
+
+    for( uint32_t i = 0; ( pucSnapshot != NULL ) && ( i < KVStore_uxGetNumKeys() ) && ( xSuccess == pdTRUE ); i++ )
+    {
+        KVStoreValueType_t xType = KV_TYPE_NONE;
+        size_t xLength = 0;
+        const void * pvData = xSource( i, pdTRUE, &xType, &xLength );
+
+        if( pvData != NULL )
+        {
+            KVStoreRecordHeader_t xHeader =
+            {
+                .ucKeyLength = ( uint8_t ) strlen( kvStoreKeyMap[ i ] ),
+                .ucType      = ( uint8_t ) xType,
+                .usLength    = ( uint16_t ) xLength
+            };
+
+            configASSERT( xLength <= KVSTORE_VAL_MAX_LEN );
+
+            xSuccess = xAddRecord( pucSnapshot, xObjectLengths, &ulObject, &xHeader, kvStoreKeyMap[ i ], pvData );
+        }
+    }
+
+    if( ( pucSnapshot != NULL ) && ( xSuccess == pdTRUE ) )
+    {
+        BaseType_t xMigrate = ( ulObjectHash[ 0 ] == 0 );
+
+        for( ulObject = 0; ( ulObject < KV_STORE_ITS_MAX_OBJECTS ) && ( xSuccess == pdTRUE ); ulObject++ )
+        {
+            const uint8_t * pucObject = &( pucSnapshot[ ulObject * KV_STORE_ITS_OBJECT_SIZE ] );
+            size_t xLength = xObjectLengths[ ulObject ];
+            uint32_t ulHash = ( xLength > 0 ) ? ulHashObject( pucObject, xLength ) : 0;
+
+            if( ulHash == ulObjectHash[ ulObject ] )
+            {
+                /* Unchanged */
+            }
+            else if( xLength > 0 )
+            {
+                xSuccess = xPSAStatusToBool( psa_its_set( xSnapshotUID( ulObject ), xLength, pucObject, 0 ) );
+            }
+            else
+            {
+                ( void ) psa_its_remove( xSnapshotUID( ulObject ) );
+            }
+
+            if( xSuccess == pdTRUE )
+            {
+                ulObjectHash[ ulObject ] = ulHash;
+            }
+            else
+            {
+                LogError( "Error while writing kvstore snapshot object %lu.", ulObject );
+            }
+        }
+
+        /* Values are now read from the snapshot, drop the objects of the previous layout */
+        if( ( xSuccess == pdTRUE ) && ( xMigrate == pdTRUE ) )
+        {
+            for( uint32_t i = 0; i < KVStore_uxGetNumKeys(); i++ )
+            {
+                ( void ) psa_its_remove( xKeyToUID( i ) );
+            }
+
+            LogInfo( "Migrated kvstore values to a single snapshot." );
+        }
+    }
+
+    if( pucSnapshot != NULL )
+    {
+        explicit_bzero( pucSnapshot, KV_STORE_ITS_OBJECT_SIZE * KV_STORE_ITS_MAX_OBJECTS );
+        vPortFree( pucSnapshot );
+    }
+
+    return xSuccess;
+}
+
+#endif /* KV_STORE_WRITE_BACK_ENABLE */
+
+/*
+ * @brief ITS objects cannot be enumerated, so each key is looked up in turn.
+ */
+BaseType_t xprvListKeysFromImpl( void ( * pxFound )( KVStoreKey_t xKey ) )
+{
+    ( void ) pxFound;
+
+    return pdFALSE;
+}
+
 void vprvNvImplInit( void )
 {
 /*	tfm_its_init(); */
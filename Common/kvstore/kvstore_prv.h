@@ -28,26 +28,46 @@
 
 #include "kvstore_config_plat.h"
 #include "kvstore.h"
+#include "heap_classes.h"
+
+#ifndef KV_STORE_WRITE_BACK_ENABLE
+#define KV_STORE_WRITE_BACK_ENABLE    0
+#endif
+
+#ifndef KV_STORE_FLUSH_DELAY_MS
+#define KV_STORE_FLUSH_DELAY_MS       5000
+#endif
+
+/* Size the journal may grow to before it is compacted into a snapshot of all keys */
+#ifndef KV_STORE_JOURNAL_MAX_LEN
+#define KV_STORE_JOURNAL_MAX_LEN      4096
+#endif
+
+#if KV_STORE_WRITE_BACK_ENABLE && !( KV_STORE_CACHE_ENABLE && ( KV_STORE_NVIMPL_LITTLEFS || KV_STORE_NVIMPL_ARM_PSA ) )
+#error "KV_STORE_WRITE_BACK_ENABLE requires KV_STORE_CACHE_ENABLE and a non-volatile backend"
+#endif
 
 /* Private Types */
 
 typedef struct
 {
-    const KVStoreValueType_t type;
-    const size_t length;
+    KVStoreValueType_t type;
+    size_t length;
     union
     {
-        const uint32_t u32;
-        const int32_t i32;
-        const BaseType_t bt;
-        const UBaseType_t ubt;
-        const void * const blob;
-        const char * const str;
+        uint32_t u32;
+        int32_t i32;
+        BaseType_t bt;
+        UBaseType_t ubt;
+        const void * blob;
+        const char * str;
     };
 } KVStoreDefaultEntry_t;
 
 extern const KVStoreDefaultEntry_t kvStoreDefaults[ CS_NUM_KEYS ];
 
+uint32_t ulprvHashKeyName( const char * pcKey );
+
 /* Private functions for NVM implementation */
 
 #if KV_STORE_NVIMPL_ENABLE
@@ -72,6 +92,37 @@ BaseType_t xprvWriteValueToImpl( KVStoreKey_t xKey,
 
 void vprvNvImplInit( void );
 
+/*
+ * @brief Call pxFound for each key with a value in non-volatile storage.
+ * @return pdFALSE if the implementation cannot list the keys it stores.
+ */
+BaseType_t xprvListKeysFromImpl( void ( * pxFound )( KVStoreKey_t xKey ) );
+
+#if KV_STORE_WRITE_BACK_ENABLE
+
+/*
+ * @brief Called for each record found while replaying the journal.
+ */
+typedef void ( * KVStoreJournalLoad_t )( KVStoreKey_t xKey,
+                                         KVStoreValueType_t xType,
+                                         size_t xLength,
+                                         const void * pvData );
+
+/*
+ * @brief Returns the value to record for xKey, or NULL if it should be skipped.
+ * When xAll is pdFALSE only values with a pending change are returned.
+ */
+typedef const void * ( * KVStoreJournalSource_t )( KVStoreKey_t xKey,
+                                                   BaseType_t xAll,
+                                                   KVStoreValueType_t * pxType,
+                                                   size_t * pxLength );
+
+BaseType_t xprvReplayJournalFromImpl( KVStoreJournalLoad_t xLoad );
+
+BaseType_t xprvWriteJournalToImpl( KVStoreJournalSource_t xSource );
+
+#endif /* KV_STORE_WRITE_BACK_ENABLE */
+
 #endif /* KV_STORE_NVIMPL_ENABLE */
 
 
@@ -90,6 +141,10 @@ BaseType_t xprvWriteCacheEntry( KVStoreKey_t xKey,
 
 void vprvCacheInit( void );
 
+void vprvCacheLoadKey( KVStoreKey_t xKey );
+
+BaseType_t xprvCommitCache( BaseType_t xFlush );
+
 size_t prvGetCacheEntryLength( KVStoreKey_t xKey );
 KVStoreValueType_t prvGetCacheEntryType( KVStoreKey_t xKey );
 
@@ -0,0 +1,347 @@
+/*
+ * FreeRTOS STM32 Reference Integration
+ * Copyright (C) 2022 Amazon.com, Inc. or its affiliates.  All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+/**
+ * @file dns_cache.c
+ * @brief Host name to IPv4 address cache with stale-while-revalidate support.
+ */
+#include "logging_levels.h"
+
+#define LOG_LEVEL    LOG_INFO
+#define LOG_MODULE    LOG_MODULE_NET
+
+#include "logging.h"
+
+#include "dns_cache.h"
+
+#include <string.h>
+
+/* FreeRTOS includes. */
+#include "FreeRTOS.h"
+#include "task.h"
+
+/* lwIP includes. */
+#include "lwip/tcpip.h"
+#include "lwip/dns.h"
+
+#include "kvstore.h"
+
+#define DNS_CACHE_RECORD_MAGIC    0x444E5331 /* "DNS1" */
+
+typedef struct
+{
+    char cHostName[ DNS_CACHE_HOSTNAME_LEN ];
+    uint32_t ulAddr;          /* IPv4 address in network byte order, 0 if unused */
+    TickType_t xUpdatedTick;  /* Time the address was last confirmed */
+    BaseType_t xAgeUnknown;   /* pdTRUE if the address was loaded from flash */
+} DnsCacheEntry_t;
+
+#if DNS_CACHE_PERSIST == 1
+typedef struct
+{
+    uint32_t ulMagic;
+    uint32_t ulAddr;
+    char cHostName[ DNS_CACHE_HOSTNAME_LEN ];
+} DnsCacheRecord_t;
+#endif /* DNS_CACHE_PERSIST == 1 */
+
+/* Accessed from the caller tasks and from the tcpip thread, guarded by a critical section */
+static DnsCacheEntry_t xDnsCache[ DNS_CACHE_ENTRIES ] = { 0 };
+static uint32_t ulNextVictim = 0;
+
+#if DNS_CACHE_PERSIST == 1
+static BaseType_t xRecordLoaded = pdFALSE;
+#endif /* DNS_CACHE_PERSIST == 1 */
+
+/*-----------------------------------------------------------*/
+
+/* Must be called from within a critical section */
+static DnsCacheEntry_t * pxFindEntry( const char * pcHostName )
+{
+    DnsCacheEntry_t * pxEntry = NULL;
+
+    for( uint32_t i = 0; i < DNS_CACHE_ENTRIES; i++ )
+    {
+        if( ( xDnsCache[ i ].ulAddr != 0 ) &&
+            ( strncmp( xDnsCache[ i ].cHostName, pcHostName, DNS_CACHE_HOSTNAME_LEN ) == 0 ) )
+        {
+            pxEntry = &( xDnsCache[ i ] );
+            break;
+        }
+    }
+
+    return pxEntry;
+}
+
+/*-----------------------------------------------------------*/
+
+/* Must be called from within a critical section */
+static void vStoreEntry( const char * pcHostName,
+                         uint32_t ulAddr,
+                         BaseType_t xAgeUnknown )
+{
+    DnsCacheEntry_t * pxEntry = pxFindEntry( pcHostName );
+
+    if( pxEntry == NULL )
+    {
+        for( uint32_t i = 0; i < DNS_CACHE_ENTRIES; i++ )
+        {
+            if( xDnsCache[ i ].ulAddr == 0 )
+            {
+                pxEntry = &( xDnsCache[ i ] );
+                break;
+            }
+        }
+    }
+
+    /* Table full, replace entries in turn */
+    if( pxEntry == NULL )
+    {
+        pxEntry = &( xDnsCache[ ulNextVictim ] );
+        ulNextVictim = ( ulNextVictim + 1 ) % DNS_CACHE_ENTRIES;
+    }
+
+    ( void ) strncpy( pxEntry->cHostName, pcHostName, DNS_CACHE_HOSTNAME_LEN - 1 );
+    pxEntry->cHostName[ DNS_CACHE_HOSTNAME_LEN - 1 ] = '\0';
+    pxEntry->ulAddr = ulAddr;
+    pxEntry->xUpdatedTick = xTaskGetTickCount();
+    pxEntry->xAgeUnknown = xAgeUnknown;
+}
+
+/*-----------------------------------------------------------*/
+
+#if DNS_CACHE_PERSIST == 1
+
+static BaseType_t xIsMqttEndpoint( const char * pcHostName )
+{
+    char * pcEndpoint = KVStore_getStringHeap( CS_CORE_MQTT_ENDPOINT, NULL );
+    BaseType_t xResult = pdFALSE;
+
+    if( pcEndpoint != NULL )
+    {
+        xResult = ( strncmp( pcEndpoint, pcHostName, DNS_CACHE_HOSTNAME_LEN ) == 0 ) ? pdTRUE : pdFALSE;
+        vPortFree( pcEndpoint );
+    }
+
+    return xResult;
+}
+
+/*-----------------------------------------------------------*/
+
+/* Seed the cache with the persisted MQTT endpoint address, once per boot */
+static void vLoadRecord( void )
+{
+    DnsCacheRecord_t xRecord = { 0 };
+
+    if( xRecordLoaded == pdFALSE )
+    {
+        xRecordLoaded = pdTRUE;
+
+        if( ( KVStore_getBlob( CS_CORE_MQTT_ENDPOINT_ADDR, &xRecord, sizeof( DnsCacheRecord_t ) ) == sizeof( DnsCacheRecord_t ) ) &&
+            ( xRecord.ulMagic == DNS_CACHE_RECORD_MAGIC ) &&
+            ( xRecord.ulAddr != 0 ) )
+        {
+            xRecord.cHostName[ DNS_CACHE_HOSTNAME_LEN - 1 ] = '\0';
+
+            if( xIsMqttEndpoint( xRecord.cHostName ) == pdTRUE )
+            {
+                taskENTER_CRITICAL();
+                vStoreEntry( xRecord.cHostName, xRecord.ulAddr, pdTRUE );
+                taskEXIT_CRITICAL();
+
+                LogDebug( "Loaded cached address for %s.", xRecord.cHostName );
+            }
+        }
+    }
+}
+
+/*-----------------------------------------------------------*/
+
+static void vSaveRecord( const char * pcHostName,
+                         uint32_t ulAddr )
+{
+    DnsCacheRecord_t xRecord = { 0 };
+    DnsCacheRecord_t xStoredRecord = { 0 };
+
+    xRecord.ulMagic = DNS_CACHE_RECORD_MAGIC;
+    xRecord.ulAddr = ulAddr;
+    ( void ) strncpy( xRecord.cHostName, pcHostName, DNS_CACHE_HOSTNAME_LEN - 1 );
+
+    /* Only write to flash when the address changed */
+    if( ( xIsMqttEndpoint( pcHostName ) == pdTRUE ) &&
+        ( ( KVStore_getBlob( CS_CORE_MQTT_ENDPOINT_ADDR, &xStoredRecord, sizeof( DnsCacheRecord_t ) ) != sizeof( DnsCacheRecord_t ) ) ||
+          ( memcmp( &xRecord, &xStoredRecord, sizeof( DnsCacheRecord_t ) ) != 0 ) ) )
+    {
+        if( ( KVStore_setBlob( CS_CORE_MQTT_ENDPOINT_ADDR, sizeof( DnsCacheRecord_t ), &xRecord ) == pdTRUE ) &&
+            ( KVStore_xCommitChanges() == pdTRUE ) )
+        {
+            LogInfo( "Saved address of %s.", pcHostName );
+        }
+        else
+        {
+            LogError( "Failed to save address of %s.", pcHostName );
+        }
+    }
+}
+
+#endif /* DNS_CACHE_PERSIST == 1 */
+
+/*-----------------------------------------------------------*/
+
+/* Called from the tcpip thread when a background query completes */
+static void vDnsFoundCallback( const char * pcName,
+                               const ip_addr_t * pxAddr,
+                               void * pvCallbackArg )
+{
+    ( void ) pvCallbackArg;
+
+    if( ( pxAddr != NULL ) &&
+        IP_IS_V4( pxAddr ) )
+    {
+        taskENTER_CRITICAL();
+
+        /* Only refresh hosts still in the cache */
+        if( pxFindEntry( pcName ) != NULL )
+        {
+            vStoreEntry( pcName, ip4_addr_get_u32( ip_2_ip4( pxAddr ) ), pdFALSE );
+        }
+
+        taskEXIT_CRITICAL();
+
+        LogDebug( "Refreshed cached address for %s.", pcName );
+    }
+    else
+    {
+        LogWarn( "Background lookup of %s failed.", pcName );
+    }
+}
+
+/*-----------------------------------------------------------*/
+
+BaseType_t xDnsCacheLookup( const char * pcHostName,
+                            ip_addr_t * pxAddr )
+{
+    BaseType_t xResult = pdFALSE;
+    DnsCacheEntry_t * pxEntry = NULL;
+    uint32_t ulAddr = 0;
+    ip_addr_t xResolvedAddr = { 0 };
+    err_t xError = ERR_OK;
+
+    configASSERT( pcHostName != NULL );
+    configASSERT( pxAddr != NULL );
+
+    if( strnlen( pcHostName, DNS_CACHE_HOSTNAME_LEN ) < DNS_CACHE_HOSTNAME_LEN )
+    {
+#if DNS_CACHE_PERSIST == 1
+        vLoadRecord();
+#endif /* DNS_CACHE_PERSIST == 1 */
+
+        taskENTER_CRITICAL();
+
+        pxEntry = pxFindEntry( pcHostName );
+
+        if( ( pxEntry != NULL ) &&
+            ( DNS_CACHE_STALE_WHILE_REVALIDATE == 1 ) &&
+            ( ( pxEntry->xAgeUnknown == pdTRUE ) ||
+              ( ( xTaskGetTickCount() - pxEntry->xUpdatedTick ) < ( DNS_CACHE_MAX_STALE_S * configTICK_RATE_HZ ) ) ) )
+        {
+            ulAddr = pxEntry->ulAddr;
+        }
+
+        taskEXIT_CRITICAL();
+    }
+
+    /* Without a usable cached address the caller performs a blocking lookup */
+    if( ulAddr != 0 )
+    {
+        /*
+         * lwIP answers from its own table while the record TTL holds, otherwise
+         * it starts a query and reports the result through the callback.
+         */
+        LOCK_TCPIP_CORE();
+        xError = dns_gethostbyname( pcHostName, &xResolvedAddr, vDnsFoundCallback, NULL );
+        UNLOCK_TCPIP_CORE();
+
+        if( ( xError == ERR_OK ) &&
+            IP_IS_V4( &xResolvedAddr ) )
+        {
+            ulAddr = ip4_addr_get_u32( ip_2_ip4( &xResolvedAddr ) );
+        }
+        else if( xError == ERR_INPROGRESS )
+        {
+            LogDebug( "Using stale address for %s while it is refreshed.", pcHostName );
+        }
+        else
+        {
+            LogWarn( "Failed to start refresh of %s: %d.", pcHostName, xError );
+        }
+
+        ip_addr_set_ip4_u32( pxAddr, ulAddr );
+        xResult = pdTRUE;
+    }
+
+    return xResult;
+}
+
+/*-----------------------------------------------------------*/
+
+void vDnsCacheUpdate( const char * pcHostName,
+                      const ip_addr_t * pxAddr )
+{
+    configASSERT( pcHostName != NULL );
+    configASSERT( pxAddr != NULL );
+
+    if( IP_IS_V4( pxAddr ) &&
+        !ip_addr_isany( pxAddr ) &&
+        ( strnlen( pcHostName, DNS_CACHE_HOSTNAME_LEN ) < DNS_CACHE_HOSTNAME_LEN ) )
+    {
+        uint32_t ulAddr = ip4_addr_get_u32( ip_2_ip4( pxAddr ) );
+
+        taskENTER_CRITICAL();
+        vStoreEntry( pcHostName, ulAddr, pdFALSE );
+        taskEXIT_CRITICAL();
+
+#if DNS_CACHE_PERSIST == 1
+        vSaveRecord( pcHostName, ulAddr );
+#endif /* DNS_CACHE_PERSIST == 1 */
+    }
+}
+
+/*-----------------------------------------------------------*/
+
+void vDnsCacheInvalidate( const char * pcHostName )
+{
+    DnsCacheEntry_t * pxEntry = NULL;
+
+    configASSERT( pcHostName != NULL );
+
+    taskENTER_CRITICAL();
+
+    pxEntry = pxFindEntry( pcHostName );
+
+    if( pxEntry != NULL )
+    {
+        pxEntry->ulAddr = 0;
+    }
+
+    taskEXIT_CRITICAL();
+}
@@ -38,6 +38,10 @@
 #define LOG_LEVEL    LOG_ERROR
 #endif
 
+#ifndef LOG_MODULE
+#define LOG_MODULE    LOG_MODULE_NET
+#endif
+
 #include "logging.h"
 
 /* Include some files for defining library routines */
@@ -116,6 +120,16 @@ typedef u32_t      sys_prot_t;
 
 extern UBaseType_t uxRand( void );
 
+/* Checksum routines for the Cortex-M33, see chksum_arch.c */
+u16_t lwip_chksum_arch( const void * pvData,
+                        int lLen );
+u16_t lwip_chksum_copy_arch( void * pvDst,
+                             const void * pvSrc,
+                             u16_t usLen );
+
+#define LWIP_CHKSUM                        lwip_chksum_arch
+#define LWIP_CHKSUM_COPY( dst, src, len )    lwip_chksum_copy_arch( dst, src, len )
+
 #define LWIP_RAND()    ( ( u32_t ) uxRand() )
 
 #endif /* __ARCH_CC_H__ */
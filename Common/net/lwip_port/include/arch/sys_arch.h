@@ -45,15 +45,62 @@ typedef SemaphoreHandle_t   sys_sem_t;
 typedef SemaphoreHandle_t   sys_mutex_t;
 typedef TaskHandle_t        sys_thread_t;
 
+/*
+ * Task notification index a task waiting in sys_arch_mbox_fetch is woken on.
+ * Not used for anything else, since any task reading a socket may wait here.
+ */
+#define LWIP_MBOX_NOTIFY_IDX    8
+
+#if LWIP_MBOX_NOTIFY_IDX >= configTASK_NOTIFICATION_ARRAY_ENTRIES
+#error "configTASK_NOTIFICATION_ARRAY_ENTRIES has no room for LWIP_MBOX_NOTIFY_IDX"
+#endif
+
+/*
+ * Mailboxes are rings of message pointers. Posting stores the pointer and
+ * notifies the consumer directly, rather than copying it through a queue. A
+ * mailbox has a single consumer at a time, as lwIP uses them (tcpip_thread,
+ * or the task reading a netconn), so it waits on a task notification.
+ */
 struct sys_mbox
 {
-    QueueHandle_t xMbox;
-    TaskHandle_t xTask;
+    void ** ppvSlots;                   /* NULL once the mailbox is freed */
+    uint32_t ulSize;
+    uint32_t ulHead;                    /* Next slot written by a producer */
+    uint32_t ulTail;                    /* Next slot read by the consumer */
+    uint32_t ulCount;
+    uint32_t ulMaxCount;                /* Most messages waiting since the mailbox was created */
+    TaskHandle_t volatile xTask;        /* Consumer in sys_arch_mbox_fetch */
+    SemaphoreHandle_t xSpaceSem;        /* Given by the consumer while producers wait for space */
+    uint32_t ulSpaceWaiters;
 };
 typedef struct sys_mbox sys_mbox_t;
 
-#define sys_mbox_valid( x )          ( ( ( ( x ) == NULL ) || ( ( x )->xMbox == NULL ) ) ? pdFALSE : pdTRUE )
-#define sys_mbox_set_invalid( x )    do { if( ( x ) != NULL ) { ( x )->xMbox = NULL; ( x )->xTask = NULL; } } while( 0 )
+#define sys_mbox_valid( x )          ( ( ( ( x ) == NULL ) || ( ( x )->ppvSlots == NULL ) ) ? pdFALSE : pdTRUE )
+#define sys_mbox_set_invalid( x )    do { if( ( x ) != NULL ) { ( x )->ppvSlots = NULL; ( x )->xTask = NULL; } } while( 0 )
+
+typedef struct SysArchMboxStats
+{
+    uint32_t ulPosts;       /* Messages posted to any mailbox */
+    uint32_t ulFull;        /* Posts that found their mailbox full */
+    uint32_t ulMaxDepth;    /* Most messages waiting in one mailbox */
+    uint32_t ulTcpipDepth;  /* Messages waiting for tcpip_thread */
+    uint32_t ulTcpipMaxDepth;
+} SysArchMboxStats_t;
+
+/**
+ * @brief Mailbox counters since boot or the last clear.
+ *
+ * @param[out] pxStats The counters.
+ * @param[in] xClear pdTRUE to restart ulPosts, ulFull and ulMaxDepth.
+ */
+void sys_arch_mbox_get_stats( SysArchMboxStats_t * pxStats,
+                              BaseType_t xClear );
+
+/**
+ * @brief Lock a mutex only if that does not block.
+ * @return pdTRUE if the mutex was locked.
+ */
+BaseType_t sys_mutex_trylock( sys_mutex_t * pxMutex );
 #define sys_sem_valid( x )           ( ( ( *x ) == NULL ) ? pdFALSE : pdTRUE )
 #define sys_sem_set_invalid( x )     ( ( *x ) = NULL )
 
@@ -35,17 +35,103 @@
 
 #include "FreeRTOSConfig.h"
 
-/* tcpip_thread should run on HIGH priority */
+/* tcpip_thread should run on HIGH priority, just below the MxData dataplane thread.
+ * See the priority map in mx_prv.h. */
 #define TCPIP_THREAD_NAME             "lwIP"
 #define TCPIP_THREAD_STACKSIZE        ( 4096 )
 #define TCPIP_THREAD_PRIO             25
 
+/*
+ * ------------------------------------
+ * ---------- Memory profiles ---------
+ * ------------------------------------
+ */
+
+/**
+ * LWIP_MEM_PROFILE: selects the buffer, window and pool sizes below.
+ *
+ * LWIP_MEM_PROFILE_LOW_RAM:    4 segment windows and small pools, for builds
+ *                              short of RAM that only run MQTT traffic.
+ *                              Roughly 90 KB less than the default profile.
+ * LWIP_MEM_PROFILE_DEFAULT:    24 KB windows, the historical configuration.
+ * LWIP_MEM_PROFILE_THROUGHPUT: 64 KB receive window (needs window scaling),
+ *                              48 KB send buffer and single pbuf TX for bulk
+ *                              OTA downloads and backlog uploads.
+ *                              Roughly 30 KB more than the default profile.
+ *
+ * Compare the profiles on the target with iperf2 against the lwiperf server
+ * started once the wifi link is up, e.g. "iperf -c <ip> -t 30" for RX and
+ * "iperf -c <ip> -r" for TX, and check the "netstat" memory counters for
+ * allocation failures. The "iperf" CLI command adds UDP and TLS tests and
+ * reports the retransmits and CPU load of a test.
+ */
+#define LWIP_MEM_PROFILE_LOW_RAM       0
+#define LWIP_MEM_PROFILE_DEFAULT       1
+#define LWIP_MEM_PROFILE_THROUGHPUT    2
 
-#define TCPIP_MBOX_SIZE               16
-#define DEFAULT_RAW_RECVMBOX_SIZE     16
-#define DEFAULT_UDP_RECVMBOX_SIZE     16
-#define DEFAULT_TCP_RECVMBOX_SIZE     16
-#define DEFAULT_ACCEPTMBOX_SIZE       16
+#ifndef LWIP_MEM_PROFILE
+#define LWIP_MEM_PROFILE    LWIP_MEM_PROFILE_DEFAULT
+#endif
+
+#if ( LWIP_MEM_PROFILE == LWIP_MEM_PROFILE_LOW_RAM )
+#define MEM_SIZE                     ( 24 * 1600 )
+#define PBUF_POOL_SIZE               12
+#define TCP_WND                      ( 4 * TCP_MSS )
+#define TCP_SND_BUF                  ( 4 * TCP_MSS )
+#define MEMP_NUM_TCP_PCB             8
+#define MEMP_NUM_TCP_PCB_LISTEN      4
+#define MEMP_NUM_TCP_SEG             32
+#define MEMP_NUM_NETCONN             12
+#define TCPIP_MBOX_SIZE              8
+#define DEFAULT_RAW_RECVMBOX_SIZE    4
+#define DEFAULT_UDP_RECVMBOX_SIZE    8
+#define DEFAULT_TCP_RECVMBOX_SIZE    8
+#define DEFAULT_ACCEPTMBOX_SIZE      4
+
+/* Size TX pbufs to the data written, small MQTT packets would otherwise
+ * reserve a full segment of heap each. */
+#define TCP_OVERSIZE                 0
+#define LWIP_NETIF_TX_SINGLE_PBUF    0
+
+#elif ( LWIP_MEM_PROFILE == LWIP_MEM_PROFILE_DEFAULT )
+#define MEM_SIZE                     ( 50 * 1600 )
+#define PBUF_POOL_SIZE               40
+#define TCP_WND                      ( 24 * 1024 )
+#define TCP_SND_BUF                  ( 24 * 1024 )
+#define MEMP_NUM_TCP_PCB             32
+#define MEMP_NUM_TCP_PCB_LISTEN      32
+#define MEMP_NUM_TCP_SEG             255
+#define MEMP_NUM_NETCONN             32
+#define TCPIP_MBOX_SIZE              16
+#define DEFAULT_RAW_RECVMBOX_SIZE    16
+#define DEFAULT_UDP_RECVMBOX_SIZE    16
+#define DEFAULT_TCP_RECVMBOX_SIZE    16
+#define DEFAULT_ACCEPTMBOX_SIZE      16
+
+#elif ( LWIP_MEM_PROFILE == LWIP_MEM_PROFILE_THROUGHPUT )
+#define MEM_SIZE                     ( 60 * 1600 )
+#define PBUF_POOL_SIZE               48
+#define TCP_WND                      ( 64 * 1024 )
+#define TCP_SND_BUF                  ( 48 * 1024 )
+#define MEMP_NUM_TCP_PCB             32
+#define MEMP_NUM_TCP_PCB_LISTEN      8
+#define MEMP_NUM_TCP_SEG             255
+#define MEMP_NUM_NETCONN             32
+#define TCPIP_MBOX_SIZE              32
+#define DEFAULT_RAW_RECVMBOX_SIZE    16
+#define DEFAULT_UDP_RECVMBOX_SIZE    16
+#define DEFAULT_TCP_RECVMBOX_SIZE    48
+#define DEFAULT_ACCEPTMBOX_SIZE      8
+
+/* Build each segment in one PBUF_RAM with link headroom so that prvxLinkOutput
+ * hands a single contiguous frame to the dataplane instead of a chain, and
+ * never needs its pbuf_clone fallback for TCP. */
+#define TCP_OVERSIZE                 TCP_MSS
+#define LWIP_NETIF_TX_SINGLE_PBUF    1
+
+#else
+#error "Unknown LWIP_MEM_PROFILE"
+#endif /* LWIP_MEM_PROFILE */
 
 /*fix http IOT issue */
 #define LWIP_WND_SCALE                1
@@ -90,8 +176,8 @@
 /**
  * MEM_SIZE: the size of the heap memory. If the application will send
  * a lot of data that needs to be copied, this should be set high.
+ * Set by LWIP_MEM_PROFILE.
  */
-#define MEM_SIZE    ( 50 * 1600 )
 
 /*
  * ------------------------------------------------
@@ -103,28 +189,24 @@
  * per active UDP "connection". */
 #define MEMP_NUM_UDP_PCB           8
 
-/* MEMP_NUM_TCP_PCB: the number of simulatenously active TCP
- * connections. */
-#define MEMP_NUM_TCP_PCB           32
-
-/* MEMP_NUM_TCP_PCB_LISTEN: the number of listening TCP
- * connections. */
-#define MEMP_NUM_TCP_PCB_LISTEN    32 /*16 original */
-
-/* MEMP_NUM_TCP_SEG: the number of simultaneously queued TCP
- * segments. */
-#define MEMP_NUM_TCP_SEG           255
+/* MEMP_NUM_TCP_PCB, MEMP_NUM_TCP_PCB_LISTEN and MEMP_NUM_TCP_SEG: the number
+ * of active and listening TCP connections and of queued TCP segments.
+ * Set by LWIP_MEM_PROFILE. */
 
 /* MEMP_NUM_ARP_QUEUE: the number of simulateously queued outgoing
  * packets (pbufs) that are waiting for an ARP request (to resolve
  * their destination address) to finish. (requires the ARP_QUEUEING option) */
 #define MEMP_NUM_ARP_QUEUE         8
 
+/* MEMP_NUM_SYS_TIMEOUT: the timeouts of the stack itself plus those of the
+ * application, the net_stats pool monitor and the DHCP lease ARP seed. */
+#define MEMP_NUM_SYS_TIMEOUT       ( LWIP_NUM_SYS_TIMEOUT_INTERNAL + 2 )
+
 /**
  * MEMP_NUM_NETCONN: the number of struct netconns.
  * (only needed if you use the sequential API, like api_lib.c)
+ * Set by LWIP_MEM_PROFILE.
  */
-#define MEMP_NUM_NETCONN           32
 
 /*
  * ----------------------------------
@@ -147,11 +229,11 @@
 /* TCP Maximum segment size. */
 #define TCP_MSS        1476
 
-/* TCP sender buffer space (bytes). */
-#define TCP_SND_BUF    ( 24 * 1024 )        /*(12 * 1024) */
+/* TCP_SND_BUF (sender buffer space) and TCP_WND (receive window) are set by LWIP_MEM_PROFILE. */
 
-/* TCP receive window. */
-#define TCP_WND        ( 24 * 1024 )
+/* Checksum data while tcp_write copies it into the segment (LWIP_CHKSUM_COPY in arch/cc.h),
+ * rather than in a second pass over the segment in tcp_output. */
+#define TCP_CHECKSUM_ON_COPY    1
 
 /*
  * ---------------------------------
@@ -266,4 +348,14 @@ extern int FreeRTOS_errno;
 #define errno    FreeRTOS_errno
 #endif
 
+/* Checks on the LWIP_MEM_PROFILE values.
+ * The receive window must fit in the RX pbuf pool, and queued segments in the segment pool */
+#if ( TCP_WND > ( PBUF_POOL_SIZE * ( PBUF_POOL_BUFSIZE - 128 ) ) )
+#error "TCP_WND does not fit in PBUF_POOL_SIZE pbufs"
+#endif
+
+#if ( ( 4 * TCP_SND_BUF / TCP_MSS ) > MEMP_NUM_TCP_SEG )
+#error "MEMP_NUM_TCP_SEG is too small for TCP_SND_QUEUELEN"
+#endif
+
 #endif /* __LWIPOPTS_FREERTOS_H__ */
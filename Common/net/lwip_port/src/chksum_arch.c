@@ -0,0 +1,246 @@
+/*
+ * FreeRTOS STM32 Reference Integration
+ *
+ * Copyright (c) 2022 Amazon.com, Inc. or its affiliates. All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+/*
+ * Internet checksum routines for the Cortex-M33, used by lwIP as LWIP_CHKSUM
+ * and LWIP_CHKSUM_COPY (see arch/cc.h).
+ *
+ * The bulk of the data is summed 32 bits at a time with an add with carry
+ * chain, two words per LDRD. The copy variant stores each word as it is
+ * summed, so that tcp_write (TCP_CHECKSUM_ON_COPY) reads the payload once.
+ */
+
+#include "lwip/opt.h"
+
+#include <stdint.h>
+#include <string.h>
+
+/*-----------------------------------------------------------*/
+
+static inline uint32_t prvFold( uint32_t ulSum )
+{
+    ulSum = ( ulSum >> 16 ) + ( ulSum & 0xFFFFUL );
+    ulSum = ( ulSum >> 16 ) + ( ulSum & 0xFFFFUL );
+
+    return ulSum;
+}
+
+/*-----------------------------------------------------------*/
+
+static inline uint32_t prvAddCarry( uint32_t ulSum,
+                                    uint64_t ullSum )
+{
+    uint32_t ulLow = ( uint32_t ) ullSum;
+    uint32_t ulHigh = ( uint32_t ) ( ullSum >> 32 );
+
+    ulSum += ulLow;
+    ulSum += ( ulSum < ulLow ) ? 1UL : 0UL;
+    ulSum += ulHigh;
+    ulSum += ( ulSum < ulHigh ) ? 1UL : 0UL;
+
+    return ulSum;
+}
+
+/*-----------------------------------------------------------*/
+
+/* One's complement sum of uxWords 32 bit words */
+static uint32_t prvSumWords( const uint32_t * pulSrc,
+                             size_t uxWords )
+{
+    uint32_t ulSum = 0;
+    uint64_t ullSum = 0;
+
+#if defined( __GNUC__ ) && defined( __ARM_ARCH_8M_MAIN__ )
+    uint32_t ulA, ulB, ulC, ulD;
+
+    while( uxWords >= 4U )
+    {
+        __asm volatile (
+            "ldrd %[a], %[b], [%[src]], #8  \n"
+            "ldrd %[c], %[d], [%[src]], #8  \n"
+            "adds %[sum], %[sum], %[a]      \n"
+            "adcs %[sum], %[sum], %[b]      \n"
+            "adcs %[sum], %[sum], %[c]      \n"
+            "adcs %[sum], %[sum], %[d]      \n"
+            "adc  %[sum], %[sum], #0        \n"
+            : [ sum ] "+r" ( ulSum ), [ src ] "+r" ( pulSrc ),
+            [ a ] "=&r" ( ulA ), [ b ] "=&r" ( ulB ), [ c ] "=&r" ( ulC ), [ d ] "=&r" ( ulD )
+            :
+            : "cc", "memory"
+            );
+        uxWords -= 4U;
+    }
+#endif
+
+    while( uxWords > 0U )
+    {
+        ullSum += *pulSrc;
+        pulSrc++;
+        uxWords--;
+    }
+
+    return prvAddCarry( ulSum, ullSum );
+}
+
+/*-----------------------------------------------------------*/
+
+/* Copy uxWords 32 bit words to an aligned destination and return their one's complement sum */
+static uint32_t prvCopySumWords( uint32_t * pulDst,
+                                 const uint8_t * pucSrc,
+                                 size_t uxWords )
+{
+    uint32_t ulSum = 0;
+    uint64_t ullSum = 0;
+
+#if defined( __GNUC__ ) && defined( __ARM_ARCH_8M_MAIN__ )
+    uint32_t ulA, ulB, ulC, ulD;
+
+    /* LDR supports unaligned addresses on the M33, STRD needs the aligned destination */
+    while( uxWords >= 4U )
+    {
+        __asm volatile (
+            "ldr  %[a], [%[src]], #4        \n"
+            "ldr  %[b], [%[src]], #4        \n"
+            "ldr  %[c], [%[src]], #4        \n"
+            "ldr  %[d], [%[src]], #4        \n"
+            "strd %[a], %[b], [%[dst]], #8  \n"
+            "strd %[c], %[d], [%[dst]], #8  \n"
+            "adds %[sum], %[sum], %[a]      \n"
+            "adcs %[sum], %[sum], %[b]      \n"
+            "adcs %[sum], %[sum], %[c]      \n"
+            "adcs %[sum], %[sum], %[d]      \n"
+            "adc  %[sum], %[sum], #0        \n"
+            : [ sum ] "+r" ( ulSum ), [ src ] "+r" ( pucSrc ), [ dst ] "+r" ( pulDst ),
+            [ a ] "=&r" ( ulA ), [ b ] "=&r" ( ulB ), [ c ] "=&r" ( ulC ), [ d ] "=&r" ( ulD )
+            :
+            : "cc", "memory"
+            );
+        uxWords -= 4U;
+    }
+#endif
+
+    while( uxWords > 0U )
+    {
+        uint32_t ulWord;
+
+        ( void ) memcpy( &ulWord, pucSrc, sizeof( ulWord ) );
+        *pulDst = ulWord;
+        ullSum += ulWord;
+        pulDst++;
+        pucSrc += sizeof( ulWord );
+        uxWords--;
+    }
+
+    return prvAddCarry( ulSum, ullSum );
+}
+
+/*-----------------------------------------------------------*/
+
+/*
+ * Sums 16 bit pairs counted from the start of the buffer, as loaded in host
+ * (little endian) order, which gives the checksum in network order as lwIP
+ * expects. The word loop runs from the first aligned address of the
+ * destination, or of the source when only summing. When that address is at
+ * an odd offset, its pairs straddle those of the buffer and its sum is byte
+ * swapped before it is added.
+ */
+static u16_t prvChksum( uint8_t * pucDst,
+                        const uint8_t * pucSrc,
+                        size_t uxLen )
+{
+    uint32_t ulSum = 0;
+    size_t uxOffset = 0;
+    uintptr_t uxAddr = ( uintptr_t ) ( ( pucDst != NULL ) ? pucDst : pucSrc );
+    size_t uxHead = ( 4U - ( uxAddr & 3U ) ) & 3U;
+    size_t uxWords;
+
+    if( uxHead > uxLen )
+    {
+        uxHead = uxLen;
+    }
+
+    for( ; uxOffset < uxHead; uxOffset++ )
+    {
+        if( pucDst != NULL )
+        {
+            pucDst[ uxOffset ] = pucSrc[ uxOffset ];
+        }
+
+        ulSum += ( uint32_t ) pucSrc[ uxOffset ] << ( ( uxOffset & 1U ) * 8U );
+    }
+
+    uxWords = ( uxLen - uxOffset ) / 4U;
+
+    if( uxWords > 0U )
+    {
+        uint32_t ulWordSum;
+
+        if( pucDst != NULL )
+        {
+            ulWordSum = prvCopySumWords( ( uint32_t * ) &( pucDst[ uxOffset ] ), &( pucSrc[ uxOffset ] ), uxWords );
+        }
+        else
+        {
+            ulWordSum = prvSumWords( ( const uint32_t * ) &( pucSrc[ uxOffset ] ), uxWords );
+        }
+
+        ulWordSum = prvFold( ulWordSum );
+
+        if( ( uxOffset & 1U ) != 0U )
+        {
+            ulWordSum = ( ( ulWordSum & 0xFFUL ) << 8 ) | ( ulWordSum >> 8 );
+        }
+
+        ulSum += ulWordSum;
+        uxOffset += uxWords * 4U;
+    }
+
+    for( ; uxOffset < uxLen; uxOffset++ )
+    {
+        if( pucDst != NULL )
+        {
+            pucDst[ uxOffset ] = pucSrc[ uxOffset ];
+        }
+
+        ulSum += ( uint32_t ) pucSrc[ uxOffset ] << ( ( uxOffset & 1U ) * 8U );
+    }
+
+    return ( u16_t ) prvFold( ulSum );
+}
+
+/*-----------------------------------------------------------*/
+
+u16_t lwip_chksum_arch( const void * pvData,
+                        int lLen )
+{
+    return prvChksum( NULL, ( const uint8_t * ) pvData, ( lLen > 0 ) ? ( size_t ) lLen : 0U );
+}
+
+/*-----------------------------------------------------------*/
+
+u16_t lwip_chksum_copy_arch( void * pvDst,
+                             const void * pvSrc,
+                             u16_t usLen )
+{
+    return prvChksum( ( uint8_t * ) pvDst, ( const uint8_t * ) pvSrc, usLen );
+}
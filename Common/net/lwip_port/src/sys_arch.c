@@ -37,8 +37,11 @@
 /****************************************************************************** */
 
 /* ------------------------ System architecture includes ----------------------------- */
+#include <string.h>
+
 #include "arch/sys_arch.h"
 #include "logging.h"
+#include "heap_classes.h"
 
 /* ------------------------ lwIP includes --------------------------------- */
 #include "lwip/opt.h"
@@ -49,9 +52,6 @@
 #include "lwip/mem.h"
 #include "lwip/stats.h"
 
-#if !INCLUDE_xTaskAbortDelay
-#error "lwIP FreeRTOS port requires INCLUDE_xTaskAbortDelay"
-#endif
 #if !INCLUDE_xTaskGetCurrentTaskHandle
 #error "lwIP FreeRTOS port requires INCLUDE_xTaskGetCurrentTaskHandle"
 #endif
@@ -61,6 +61,120 @@
  * the interrupt handler setting this variable manually. */
 portBASE_TYPE xInsideISR = pdFALSE;
 
+/* Mailbox counters, updated with interrupts masked */
+static SysArchMboxStats_t xMboxStats = { 0 };
+
+/* tcpip_thread and its mailbox, found by the first fetch of that task */
+static TaskHandle_t xTcpipTask = NULL;
+static sys_mbox_t * pxTcpipMbox = NULL;
+
+/*---------------------------------------------------------------------------*
+* Routine:  prvMboxPush
+*---------------------------------------------------------------------------*
+* Description:
+*      Add a message to the mailbox if it has room. Called with interrupts
+*      masked.
+* Inputs:
+*      sys_mbox_t mbox         -- Handle of mailbox
+*      void *msg               -- Pointer to data to post
+* Outputs:
+*      TaskHandle_t *          -- Consumer to notify, if any
+*      BaseType_t              -- pdTRUE if the message was added
+*---------------------------------------------------------------------------*/
+static BaseType_t prvMboxPush( sys_mbox_t * pxMailBox,
+                               void * pxMessageToPost,
+                               TaskHandle_t * pxConsumer )
+{
+    BaseType_t xPushed = pdFALSE;
+
+    *pxConsumer = NULL;
+
+    if( pxMailBox->ulCount < pxMailBox->ulSize )
+    {
+        pxMailBox->ppvSlots[ pxMailBox->ulHead ] = pxMessageToPost;
+        pxMailBox->ulHead = ( pxMailBox->ulHead + 1U ) % pxMailBox->ulSize;
+        pxMailBox->ulCount++;
+
+        if( pxMailBox->ulCount > pxMailBox->ulMaxCount )
+        {
+            pxMailBox->ulMaxCount = pxMailBox->ulCount;
+        }
+
+        if( pxMailBox->ulCount > xMboxStats.ulMaxDepth )
+        {
+            xMboxStats.ulMaxDepth = pxMailBox->ulCount;
+        }
+
+        if( ( pxMailBox == pxTcpipMbox ) &&
+            ( pxMailBox->ulCount > xMboxStats.ulTcpipMaxDepth ) )
+        {
+            xMboxStats.ulTcpipMaxDepth = pxMailBox->ulCount;
+        }
+
+        xMboxStats.ulPosts++;
+        *pxConsumer = pxMailBox->xTask;
+        xPushed = pdTRUE;
+    }
+    else
+    {
+        xMboxStats.ulFull++;
+    }
+
+    return xPushed;
+}
+
+/*---------------------------------------------------------------------------*
+* Routine:  prvMboxPop
+*---------------------------------------------------------------------------*
+* Description:
+*      Remove the oldest message from the mailbox if there is one. Called
+*      with interrupts masked.
+* Inputs:
+*      sys_mbox_t mbox         -- Handle of mailbox
+*      void **msg              -- Pointer to pointer to msg received
+* Outputs:
+*      BaseType_t              -- pdTRUE if a message was removed
+*---------------------------------------------------------------------------*/
+static BaseType_t prvMboxPop( sys_mbox_t * pxMailBox,
+                              void ** ppvBuffer )
+{
+    BaseType_t xPopped = pdFALSE;
+
+    if( pxMailBox->ulCount > 0U )
+    {
+        *ppvBuffer = pxMailBox->ppvSlots[ pxMailBox->ulTail ];
+        pxMailBox->ulTail = ( pxMailBox->ulTail + 1U ) % pxMailBox->ulSize;
+        pxMailBox->ulCount--;
+        xPopped = pdTRUE;
+    }
+
+    return xPopped;
+}
+
+/*---------------------------------------------------------------------------*
+* Routine:  prvMboxNotify
+*---------------------------------------------------------------------------*
+* Description:
+*      Wake the consumer of a mailbox after a post.
+*---------------------------------------------------------------------------*/
+static void prvMboxNotify( TaskHandle_t xConsumer )
+{
+    if( xConsumer != NULL )
+    {
+        if( xInsideISR != pdFALSE )
+        {
+            portBASE_TYPE xHigherPriorityTaskWoken = pdFALSE;
+
+            vTaskNotifyGiveIndexedFromISR( xConsumer, LWIP_MBOX_NOTIFY_IDX, &xHigherPriorityTaskWoken );
+            portYIELD_FROM_ISR( xHigherPriorityTaskWoken );
+        }
+        else
+        {
+            ( void ) xTaskNotifyGiveIndexed( xConsumer, LWIP_MBOX_NOTIFY_IDX );
+        }
+    }
+}
+
 /*---------------------------------------------------------------------------*
 * Routine:  sys_mbox_new
 *---------------------------------------------------------------------------*
@@ -75,17 +189,31 @@ err_t sys_mbox_new( sys_mbox_t * pxMailBox,
                     int iSize )
 {
     err_t xReturn = ERR_MEM;
-    sys_mbox_t pxTempMbox;
+    sys_mbox_t xTempMbox = { 0 };
+
+    configASSERT( iSize > 0 );
 
-    pxTempMbox.xMbox = xQueueCreate( iSize, sizeof( void * ) );
+    xTempMbox.ppvSlots = pvPortMalloc( ( size_t ) iSize * sizeof( void * ) );
+    xTempMbox.xSpaceSem = xSemaphoreCreateBinary();
 
-    if( pxTempMbox.xMbox != NULL )
+    if( ( xTempMbox.ppvSlots != NULL ) &&
+        ( xTempMbox.xSpaceSem != NULL ) )
     {
-        pxTempMbox.xTask = NULL;
-        *pxMailBox = pxTempMbox;
+        xTempMbox.ulSize = ( uint32_t ) iSize;
+        *pxMailBox = xTempMbox;
         xReturn = ERR_OK;
         SYS_STATS_INC_USED( mbox );
     }
+    else
+    {
+        if( xTempMbox.xSpaceSem != NULL )
+        {
+            vSemaphoreDelete( xTempMbox.xSpaceSem );
+        }
+
+        vPortFree( xTempMbox.ppvSlots );
+        SYS_STATS_INC( mbox.err );
+    }
 
     return xReturn;
 }
@@ -105,19 +233,17 @@ err_t sys_mbox_new( sys_mbox_t * pxMailBox,
 *---------------------------------------------------------------------------*/
 void sys_mbox_free( sys_mbox_t * pxMailBox )
 {
-    unsigned long ulMessagesWaiting;
-    QueueHandle_t xMbox;
+    void ** ppvSlots;
     TaskHandle_t xTask;
-    sys_mbox_t volatile * pvxMailBox = pxMailBox;
+    UBaseType_t uxSavedMask;
 
-    if( pvxMailBox != NULL )
+    if( pxMailBox != NULL )
     {
-        ulMessagesWaiting = uxQueueMessagesWaiting( pvxMailBox->xMbox );
-        configASSERT( ( ulMessagesWaiting == 0 ) );
+        configASSERT( ( pxMailBox->ulCount == 0 ) );
 
 #if SYS_STATS
         {
-            if( ulMessagesWaiting != 0UL )
+            if( pxMailBox->ulCount != 0UL )
             {
                 SYS_STATS_INC( mbox.err );
             }
@@ -126,18 +252,17 @@ void sys_mbox_free( sys_mbox_t * pxMailBox )
         }
 #endif /* SYS_STATS */
 
-        taskENTER_CRITICAL();
-        xMbox = pvxMailBox->xMbox;
-        xTask = pvxMailBox->xTask;
-        pvxMailBox->xMbox = NULL;
-        taskEXIT_CRITICAL();
+        uxSavedMask = portSET_INTERRUPT_MASK_FROM_ISR();
+        ppvSlots = pxMailBox->ppvSlots;
+        xTask = pxMailBox->xTask;
+        pxMailBox->ppvSlots = NULL;
+        portCLEAR_INTERRUPT_MASK_FROM_ISR( uxSavedMask );
 
-        if( xTask != NULL )
-        {
-            xTaskAbortDelay( xTask );
-        }
+        /* A consumer still waiting sees the mailbox is gone and returns */
+        prvMboxNotify( xTask );
 
-        vQueueDelete( xMbox );
+        vPortFree( ppvSlots );
+        vSemaphoreDelete( pxMailBox->xSpaceSem );
     }
 }
 
@@ -145,7 +270,7 @@ void sys_mbox_free( sys_mbox_t * pxMailBox )
 * Routine:  sys_mbox_post
 *---------------------------------------------------------------------------*
 * Description:
-*      Post the "msg" to the mailbox.
+*      Post the "msg" to the mailbox, waiting for room if it is full.
 * Inputs:
 *      sys_mbox_t mbox         -- Handle of mailbox
 *      void *data              -- Pointer to data to post
@@ -153,8 +278,48 @@ void sys_mbox_free( sys_mbox_t * pxMailBox )
 void sys_mbox_post( sys_mbox_t * pxMailBox,
                     void * pxMessageToPost )
 {
-    while( xQueueSendToBack( pxMailBox->xMbox, &pxMessageToPost, portMAX_DELAY ) != pdTRUE )
+    BaseType_t xPushed = pdFALSE;
+
+    configASSERT( xInsideISR == ( portBASE_TYPE ) 0 );
+
+    while( ( xPushed == pdFALSE ) && ( pxMailBox->ppvSlots != NULL ) )
     {
+        TaskHandle_t xConsumer = NULL;
+        BaseType_t xMoreWaiters = pdFALSE;
+        UBaseType_t uxSavedMask = portSET_INTERRUPT_MASK_FROM_ISR();
+
+        xPushed = prvMboxPush( pxMailBox, pxMessageToPost, &xConsumer );
+
+        if( xPushed == pdFALSE )
+        {
+            pxMailBox->ulSpaceWaiters++;
+        }
+        else
+        {
+            /* Pass the wakeup on if another producer waits and there is still room */
+            xMoreWaiters = ( ( pxMailBox->ulSpaceWaiters > 0U ) &&
+                             ( pxMailBox->ulCount < pxMailBox->ulSize ) ) ? pdTRUE : pdFALSE;
+        }
+
+        portCLEAR_INTERRUPT_MASK_FROM_ISR( uxSavedMask );
+
+        if( xPushed == pdFALSE )
+        {
+            ( void ) xSemaphoreTake( pxMailBox->xSpaceSem, portMAX_DELAY );
+
+            uxSavedMask = portSET_INTERRUPT_MASK_FROM_ISR();
+            pxMailBox->ulSpaceWaiters--;
+            portCLEAR_INTERRUPT_MASK_FROM_ISR( uxSavedMask );
+        }
+        else
+        {
+            if( xMoreWaiters == pdTRUE )
+            {
+                ( void ) xSemaphoreGive( pxMailBox->xSpaceSem );
+            }
+
+            prvMboxNotify( xConsumer );
+        }
     }
 }
 
@@ -174,26 +339,25 @@ void sys_mbox_post( sys_mbox_t * pxMailBox,
 err_t sys_mbox_trypost( sys_mbox_t * pxMailBox,
                         void * pxMessageToPost )
 {
-    err_t xReturn;
-    portBASE_TYPE xHigherPriorityTaskWoken = pdFALSE;
+    err_t xReturn = ERR_MEM;
+    TaskHandle_t xConsumer = NULL;
+    UBaseType_t uxSavedMask = portSET_INTERRUPT_MASK_FROM_ISR();
 
-    if( xInsideISR != pdFALSE )
-    {
-        xReturn = xQueueSendFromISR( pxMailBox->xMbox, &pxMessageToPost, &xHigherPriorityTaskWoken );
-    }
-    else
+    if( ( pxMailBox->ppvSlots != NULL ) &&
+        ( prvMboxPush( pxMailBox, pxMessageToPost, &xConsumer ) == pdTRUE ) )
     {
-        xReturn = xQueueSend( pxMailBox->xMbox, &pxMessageToPost, ( TickType_t ) 0 );
+        xReturn = ERR_OK;
     }
 
-    if( xReturn == pdPASS )
+    portCLEAR_INTERRUPT_MASK_FROM_ISR( uxSavedMask );
+
+    if( xReturn == ERR_OK )
     {
-        xReturn = ERR_OK;
+        prvMboxNotify( xConsumer );
     }
     else
     {
-        /* The queue was already full. */
-        xReturn = ERR_MEM;
+        /* The mailbox was already full. */
         SYS_STATS_INC( mbox.err );
     }
 
@@ -242,72 +406,109 @@ u32_t sys_arch_mbox_fetch( sys_mbox_t * pxMailBox,
 {
     void * pvDummy;
     unsigned long ulReturn = SYS_ARCH_TIMEOUT;
-    QueueHandle_t xMbox;
-    TaskHandle_t xTask;
-    BaseType_t xResult;
-    sys_mbox_t volatile * pvxMailBox = pxMailBox;
+    TaskHandle_t xTask = xTaskGetCurrentTaskHandle();
+    TickType_t xTicksToWait = ( ulTimeOut != 0UL ) ? ( ulTimeOut / portTICK_PERIOD_MS ) : portMAX_DELAY;
+    TimeOut_t xTimeOut;
+    BaseType_t xDone = pdFALSE;
+    UBaseType_t uxSavedMask;
+
+    configASSERT( xInsideISR == ( portBASE_TYPE ) 0 );
 
-    if( pvxMailBox == NULL )
+    if( NULL == ppvBuffer )
     {
-        goto exit;
+        ppvBuffer = &pvDummy;
     }
 
-    taskENTER_CRITICAL();
-    xMbox = pvxMailBox->xMbox;
-    xTask = xTaskGetCurrentTaskHandle();
-
-    if( ( xMbox != NULL ) && ( xTask != NULL ) && ( pvxMailBox->xTask == NULL ) )
+    if( ( pxMailBox == NULL ) || ( xTask == NULL ) )
     {
-        pvxMailBox->xTask = xTask;
+        xDone = pdTRUE;
     }
     else
     {
-        xMbox = NULL;
-    }
+        /* Only one task at a time may wait on a mailbox */
+        uxSavedMask = portSET_INTERRUPT_MASK_FROM_ISR();
 
-    taskEXIT_CRITICAL();
+        if( ( pxMailBox->ppvSlots != NULL ) && ( pxMailBox->xTask == NULL ) )
+        {
+            pxMailBox->xTask = xTask;
+        }
+        else
+        {
+            xDone = pdTRUE;
+        }
 
-    if( xMbox == NULL )
-    {
-        goto exit;
-    }
+        portCLEAR_INTERRUPT_MASK_FROM_ISR( uxSavedMask );
 
-    if( NULL == ppvBuffer )
-    {
-        ppvBuffer = &pvDummy;
+        if( ( xDone == pdFALSE ) && ( xTcpipTask == xTask ) )
+        {
+            pxTcpipMbox = pxMailBox;
+        }
+
+        vTaskSetTimeOutState( &xTimeOut );
     }
 
-    if( ulTimeOut != 0UL )
+    while( xDone == pdFALSE )
     {
-        configASSERT( xInsideISR == ( portBASE_TYPE ) 0 );
+        BaseType_t xSpaceWaiters = pdFALSE;
+
+        uxSavedMask = portSET_INTERRUPT_MASK_FROM_ISR();
 
-        if( pdTRUE == xQueueReceive( xMbox, &( *ppvBuffer ), ulTimeOut / portTICK_PERIOD_MS ) )
+        if( pxMailBox->ppvSlots == NULL )
         {
+            /* Freed while waiting */
+            xDone = pdTRUE;
+        }
+        else if( prvMboxPop( pxMailBox, ppvBuffer ) == pdTRUE )
+        {
+            xSpaceWaiters = ( pxMailBox->ulSpaceWaiters > 0U ) ? pdTRUE : pdFALSE;
+            pxMailBox->xTask = NULL;
             ulReturn = 1UL;
+            xDone = pdTRUE;
         }
         else
         {
-            /* Timed out. */
-            *ppvBuffer = NULL;
+            /* Wait below */
         }
-    }
-    else
-    {
-        for( xResult = pdFALSE; ( xMbox != NULL ) && ( xResult != pdTRUE ); )
+
+        portCLEAR_INTERRUPT_MASK_FROM_ISR( uxSavedMask );
+
+        if( xSpaceWaiters == pdTRUE )
         {
-            xResult = xQueueReceive( xMbox, &( *ppvBuffer ), portMAX_DELAY );
-            xMbox = pvxMailBox->xMbox;
+            ( void ) xSemaphoreGive( pxMailBox->xSpaceSem );
         }
 
-        if( xResult == pdTRUE )
+        if( xDone == pdFALSE )
         {
-            ulReturn = 1UL;
+            /* A post after the check above has already notified this task */
+            if( ( xTicksToWait != portMAX_DELAY ) &&
+                ( xTaskCheckForTimeOut( &xTimeOut, &xTicksToWait ) == pdTRUE ) )
+            {
+                xDone = pdTRUE;
+            }
+            else
+            {
+                ( void ) ulTaskNotifyTakeIndexed( LWIP_MBOX_NOTIFY_IDX, pdTRUE, xTicksToWait );
+            }
         }
     }
 
-    pvxMailBox->xTask = NULL;
+    if( ulReturn == SYS_ARCH_TIMEOUT )
+    {
+        *ppvBuffer = NULL;
+
+        if( pxMailBox != NULL )
+        {
+            uxSavedMask = portSET_INTERRUPT_MASK_FROM_ISR();
+
+            if( pxMailBox->xTask == xTask )
+            {
+                pxMailBox->xTask = NULL;
+            }
+
+            portCLEAR_INTERRUPT_MASK_FROM_ISR( uxSavedMask );
+        }
+    }
 
-exit:
     return ulReturn;
 }
 
@@ -329,34 +530,75 @@ u32_t sys_arch_mbox_tryfetch( sys_mbox_t * pxMailBox,
                               void ** ppvBuffer )
 {
     void * pvDummy;
-    unsigned long ulReturn;
-    long lResult;
-    portBASE_TYPE xHigherPriorityTaskWoken = pdFALSE;
+    unsigned long ulReturn = SYS_MBOX_EMPTY;
+    BaseType_t xSpaceWaiters = pdFALSE;
+    UBaseType_t uxSavedMask;
 
     if( ppvBuffer == NULL )
     {
         ppvBuffer = &pvDummy;
     }
 
-    if( xInsideISR != pdFALSE )
+    uxSavedMask = portSET_INTERRUPT_MASK_FROM_ISR();
+
+    if( ( pxMailBox->ppvSlots != NULL ) &&
+        ( prvMboxPop( pxMailBox, ppvBuffer ) == pdTRUE ) )
     {
-        lResult = xQueueReceiveFromISR( pxMailBox->xMbox, &( *ppvBuffer ), &xHigherPriorityTaskWoken );
+        xSpaceWaiters = ( pxMailBox->ulSpaceWaiters > 0U ) ? pdTRUE : pdFALSE;
+        ulReturn = ERR_OK;
     }
-    else
+
+    portCLEAR_INTERRUPT_MASK_FROM_ISR( uxSavedMask );
+
+    if( xSpaceWaiters == pdTRUE )
     {
-        lResult = xQueueReceive( pxMailBox->xMbox, &( *ppvBuffer ), 0UL );
+        if( xInsideISR != pdFALSE )
+        {
+            portBASE_TYPE xHigherPriorityTaskWoken = pdFALSE;
+
+            ( void ) xSemaphoreGiveFromISR( pxMailBox->xSpaceSem, &xHigherPriorityTaskWoken );
+            portYIELD_FROM_ISR( xHigherPriorityTaskWoken );
+        }
+        else
+        {
+            ( void ) xSemaphoreGive( pxMailBox->xSpaceSem );
+        }
     }
 
-    if( lResult == pdPASS )
+    return ulReturn;
+}
+
+/*---------------------------------------------------------------------------*
+* Routine:  sys_arch_mbox_get_stats
+*---------------------------------------------------------------------------*
+* Description:
+*      Copy the mailbox counters, optionally restarting them.
+*---------------------------------------------------------------------------*/
+void sys_arch_mbox_get_stats( SysArchMboxStats_t * pxStats,
+                              BaseType_t xClear )
+{
+    UBaseType_t uxSavedMask;
+
+    configASSERT( pxStats != NULL );
+
+    uxSavedMask = portSET_INTERRUPT_MASK_FROM_ISR();
+
+    *pxStats = xMboxStats;
+
+    if( pxTcpipMbox != NULL )
     {
-        ulReturn = ERR_OK;
+        pxStats->ulTcpipDepth = pxTcpipMbox->ulCount;
     }
-    else
+
+    if( xClear == pdTRUE )
     {
-        ulReturn = SYS_MBOX_EMPTY;
+        xMboxStats.ulPosts = 0;
+        xMboxStats.ulFull = 0;
+        xMboxStats.ulMaxDepth = 0;
+        xMboxStats.ulTcpipMaxDepth = 0;
     }
 
-    return ulReturn;
+    portCLEAR_INTERRUPT_MASK_FROM_ISR( uxSavedMask );
 }
 
 /*---------------------------------------------------------------------------*
@@ -492,6 +734,14 @@ void sys_mutex_lock( sys_mutex_t * pxMutex )
     }
 }
 
+/** Lock a mutex if it is free
+ * @param mutex the mutex to lock
+ * @return pdTRUE if the mutex was locked */
+BaseType_t sys_mutex_trylock( sys_mutex_t * pxMutex )
+{
+    return ( xSemaphoreTake( *pxMutex, 0 ) == pdPASS ) ? pdTRUE : pdFALSE;
+}
+
 /** Unlock a mutex
  * @param mutex the mutex to unlock */
 void sys_mutex_unlock( sys_mutex_t * pxMutex )
@@ -593,7 +843,14 @@ sys_thread_t sys_thread_new( const char * pcName,
 
     if( xResult == pdPASS )
     {
+        vHeapTagSetTask( xCreatedTask, HEAP_TAG_LWIP );
         xReturn = xCreatedTask;
+
+        /* Lets the mailbox statistics tell which mailbox is the tcpip_thread one */
+        if( ( pcName != NULL ) && ( strcmp( pcName, TCPIP_THREAD_NAME ) == 0 ) )
+        {
+            xTcpipTask = xCreatedTask;
+        }
     }
     else
     {
@@ -662,16 +919,13 @@ sys_sem_t * sys_arch_netconn_sem_get( void )
 *      sys_arch_protect() is only required if your port is supporting an
 *      operating system.
 * Outputs:
-*      sys_prot_t              -- Previous protection level (not used here)
+*      sys_prot_t              -- Previous BASEPRI value
 *---------------------------------------------------------------------------*/
 sys_prot_t sys_arch_protect( void )
 {
-    if( xInsideISR == pdFALSE )
-    {
-        taskENTER_CRITICAL();
-    }
-
-    return ( sys_prot_t ) 1;
+    /* Raise BASEPRI to the syscall level. Nesting is handled by returning the
+     * previous level, and it also works from interrupts, unlike taskENTER_CRITICAL. */
+    return ( sys_prot_t ) portSET_INTERRUPT_MASK_FROM_ISR();
 }
 
 /*---------------------------------------------------------------------------*
@@ -683,16 +937,11 @@ sys_prot_t sys_arch_protect( void )
 *      sys_arch_protect() for more information. This function is only
 *      required if your port is supporting an operating system.
 * Inputs:
-*      sys_prot_t              -- Previous protection level (not used here)
+*      sys_prot_t              -- BASEPRI value returned by sys_arch_protect
 *---------------------------------------------------------------------------*/
 void sys_arch_unprotect( sys_prot_t xValue )
 {
-    ( void ) xValue;
-
-    if( xInsideISR == pdFALSE )
-    {
-        taskEXIT_CRITICAL();
-    }
+    portCLEAR_INTERRUPT_MASK_FROM_ISR( ( UBaseType_t ) xValue );
 }
 
 /*-------------------------------------------------------------------------*
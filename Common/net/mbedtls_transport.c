@@ -27,12 +27,19 @@
 #include "logging_levels.h"
 
 #define LOG_LEVEL    LOG_INFO
+#define LOG_MODULE    LOG_MODULE_TLS
 
 #include "logging.h"
 
 #define MBEDTLS_ALLOW_PRIVATE_ACCESS
 
 #include "mbedtls_transport.h"
+#include "mbedtls_arena.h"
+#include "dns_cache.h"
+#include "profiler.h"
+#include "boot_times.h"
+#include "dvfs.h"
+#include "warm_state.h"
 #include <string.h>
 
 /* FreeRTOS includes. */
@@ -50,26 +57,167 @@
 #include "mbedtls/ssl.h"
 #include "mbedtls/asn1.h"
 #include "mbedtls/oid.h"
+#include "mbedtls/platform_util.h"
 #include "pk_wrap.h"
 
 #include "errno.h"
 
+/* lwIP includes. */
+#include "lwip/tcpip.h"
+#include "lwip/api.h"
+#include "lwip/pbuf.h"
+#include "lwip/tcp.h"
+#include "lwip/priv/sockets_priv.h"
+
+#if TLS_TRANSPORT_PROFILE == 1
+#include "stm32u5xx.h"
+#endif /* TLS_TRANSPORT_PROFILE == 1 */
+
 #define MBEDTLS_DEBUG_THRESHOLD    1
 
-#ifdef MBEDTLS_TRANSPORT_PKCS11
-#include "core_pkcs11_config.h"
-#include "core_pkcs11.h"
+/* Set to 1 to resume the previous TLS session (ticket or session ID) on reconnect. */
+#ifndef TLS_SESSION_RESUMPTION
+#define TLS_SESSION_RESUMPTION    1
+#endif
+
+/* Sessions older than this are not offered to the server. */
+#ifndef TLS_SESSION_MAX_AGE_S
+#define TLS_SESSION_MAX_AGE_S     ( 12 * 60 * 60 )
+#endif
+
+/*
+ * Set to 1 to keep the last session in the key value store across reboots.
+ * The session holds the master secret, so only enable this when the kvstore is
+ * backed by protected storage.
+ */
+#ifndef TLS_SESSION_PERSIST
+#define TLS_SESSION_PERSIST       0
+#endif
+
+/*
+ * Size of the per-connection buffer used by mbedtls_transport_writev to merge
+ * the pieces of an MQTT packet into a single TLS record. 0 disables coalescing.
+ */
+#ifndef TLS_TRANSPORT_COALESCE_LEN
+#define TLS_TRANSPORT_COALESCE_LEN    1024
+#endif
+
+/*
+ * Maximum fragment length requested from the server by default. With
+ * MBEDTLS_SSL_VARIABLE_BUFFER_LENGTH, mbedtls shrinks the record buffers to the
+ * negotiated size once the handshake completes.
+ */
+#ifndef TLS_TRANSPORT_MAX_FRAG_LEN
+#define TLS_TRANSPORT_MAX_FRAG_LEN    MBEDTLS_SSL_MAX_FRAG_LEN_4096
 #endif
 
+/*
+ * Cipher suite order used by default. With TLS_CIPHER_PREF_AUTO, ChaCha20-Poly1305
+ * is preferred when AES-GCM runs in software: it is several times faster than
+ * software AES on Cortex-M33, in particular on the non-secure side of the TF-M
+ * build where the AES peripheral belongs to the secure side.
+ */
+#ifndef TLS_TRANSPORT_CIPHER_PREF
+#define TLS_TRANSPORT_CIPHER_PREF    TLS_CIPHER_PREF_AUTO
+#endif
+
+/*
+ * Number of parsed certificate chains kept for reuse by later calls to
+ * mbedtls_transport_configure, from any context.
+ */
+#ifndef TLS_CERT_CACHE_ENTRIES
+#define TLS_CERT_CACHE_ENTRIES        4
+#endif
+
+/*
+ * Length of the arena serving the mbedtls allocations made during the handshake
+ * of each context, 0 to allocate from the FreeRTOS heap. Allocations the arena
+ * cannot serve also fall back to the heap.
+ */
+#ifndef TLS_TRANSPORT_ARENA_LEN
+#define TLS_TRANSPORT_ARENA_LEN       0
+#endif
+
+/*
+ * Set to 1 to receive TLS records from the netconn of the socket, copying
+ * them from the pbuf payloads straight into the mbedtls input buffer and
+ * freeing each pbuf once consumed, rather than through lwip_recv. Sending,
+ * select and socket options still go through the socket. Receiving and
+ * closing a connection must then happen in the same task, which is how the
+ * MQTT agent and the HTTP client use it.
+ */
+#ifndef TLS_TRANSPORT_NETCONN_RECV
+#define TLS_TRANSPORT_NETCONN_RECV    1
+#endif
+
+/*
+ * TCP keepalive used by default, see mbedtls_transport_setkeepalive. With the
+ * lwIP defaults a dead peer on an idle connection goes unnoticed for over two
+ * hours, these settings detect it within TLS_TRANSPORT_KEEPALIVE_IDLE_S +
+ * TLS_TRANSPORT_KEEPALIVE_INTERVAL_S * TLS_TRANSPORT_KEEPALIVE_COUNT seconds.
+ */
+#ifndef TLS_TRANSPORT_KEEPALIVE_IDLE_S
+#define TLS_TRANSPORT_KEEPALIVE_IDLE_S        20
+#endif
+
+#ifndef TLS_TRANSPORT_KEEPALIVE_INTERVAL_S
+#define TLS_TRANSPORT_KEEPALIVE_INTERVAL_S    5
+#endif
+
+#ifndef TLS_TRANSPORT_KEEPALIVE_COUNT
+#define TLS_TRANSPORT_KEEPALIVE_COUNT         3
+#endif
+
+/*
+ * Abort the connection when sent data stays unacknowledged for this long, 0 to
+ * rely on the lwIP retransmission limit, which takes several minutes. See
+ * mbedtls_transport_setusertimeout.
+ */
+#ifndef TLS_TRANSPORT_USER_TIMEOUT_MS
+#define TLS_TRANSPORT_USER_TIMEOUT_MS         15000
+#endif
+
+/* Minimum time between two checks of the user timeout */
+#define TLS_USER_TIMEOUT_POLL_MS              250
+
+PROF_PROBE( xProfRecv, "tls_recv" );
+PROF_PROBE( xProfSend, "tls_send" );
+
+#if TLS_TRANSPORT_COALESCE_LEN > MBEDTLS_SSL_OUT_CONTENT_LEN
+#error "TLS_TRANSPORT_COALESCE_LEN must not exceed MBEDTLS_SSL_OUT_CONTENT_LEN"
+#endif
+
+#if !defined( MBEDTLS_SSL_CLI_C )
+#undef TLS_SESSION_RESUMPTION
+#define TLS_SESSION_RESUMPTION    0
+#endif
+
+#if TLS_SESSION_PERSIST == 1
+#include "kvstore.h"
+#endif /* TLS_SESSION_PERSIST == 1 */
+
+/* Keep the last session in retained RAM, so that a warm reset resumes it */
+#if ( TLS_SESSION_RESUMPTION == 1 ) && ( WARM_STATE_ENABLED == 1 )
+#define TLS_SESSION_WARM    1
+#else
+#define TLS_SESSION_WARM    0
+#endif
+
+#if ( TLS_SESSION_PERSIST == 1 ) || ( TLS_SESSION_WARM == 1 )
+#define TLS_SESSION_RECORD_MAGIC    0x544C5331 /* "TLS1" */
+
+/* A stored session is this header followed by the serialized session */
 typedef struct
 {
-    TaskHandle_t xTaskHandle;
-    void * pvRecvReadyCallbackCtx;
-    GenericCallback_t pxRecvReadyCallback;
-    StackType_t puxStackBuffer[ 128 ];
-    StaticTask_t xTaskBuffer;
-    SockHandle_t xSockHandle;
-} NotifyThreadCtx_t;
+    uint32_t ulMagic;
+    uint32_t ulSessionId;
+} TlsSessionRecordHeader_t;
+#endif /* ( TLS_SESSION_PERSIST == 1 ) || ( TLS_SESSION_WARM == 1 ) */
+
+#ifdef MBEDTLS_TRANSPORT_PKCS11
+#include "core_pkcs11_config.h"
+#include "core_pkcs11.h"
+#endif
 
 /**
  * @brief Secured connection context.
@@ -78,19 +226,49 @@ typedef struct TLSContext
 {
     ConnectionState_t xConnectionState;
     SockHandle_t xSockHandle;
+    uint32_t ulSendTimeoutMs;
+    uint8_t ucMaxFragLen; /* MBEDTLS_SSL_MAX_FRAG_LEN_* code requested from the server */
+    TlsCipherPref_t xCipherPref;
+
+    /* Handshake allocations, created on the first connect if uxArenaLen > 0 */
+    size_t uxArenaLen;
+    MbedtlsArena_t * pxArena;
+
+    /* Called from the tcpip thread when the socket becomes readable */
+    GenericCallback_t pxRecvReadyCallback;
+    void * pvRecvReadyCallbackCtx;
+    BaseType_t xRecvReadyHooked;
 
-    NotifyThreadCtx_t * pxNotifyThreadCtx;
+    struct netconn * pxConn; /* Netconn of xSockHandle, looked up on first use */
+
+#if TLS_TRANSPORT_NETCONN_RECV == 1
+    struct pbuf * pxRecvPbuf; /* Received data not yet consumed by mbedtls */
+#endif /* TLS_TRANSPORT_NETCONN_RECV == 1 */
+
+    /* TCP keepalive applied on connect, disabled if ulKeepIdleS is 0 */
+    uint32_t ulKeepIdleS;
+    uint32_t ulKeepIntervalS;
+    uint32_t ulKeepCount;
+
+    /* Emulated TCP_USER_TIMEOUT, disabled if ulUserTimeoutMs is 0 */
+    uint32_t ulUserTimeoutMs;
+    TickType_t xLastUserTimeoutCheck;
+    TickType_t xUnackedSince;    /* Time ulUnackedSeq was first seen unacknowledged */
+    uint32_t ulUnackedSeq;       /* Oldest unacknowledged sequence number */
+    BaseType_t xUnackedPending;  /* pdTRUE if xUnackedSince and ulUnackedSeq are valid */
 
     /* TLS connection */
     mbedtls_ssl_config xSslConfig;
     mbedtls_ssl_context xSslCtx;
 
-    /* Certificates */
-    mbedtls_x509_crt xRootCaChain;
-    mbedtls_x509_crt xClientCert;
+    /* Certificates, shared with other contexts through xCertCache */
+    mbedtls_x509_crt * pxRootCaChain;
+    mbedtls_x509_crt * pxClientCert;
 
     /* Private Key */
     mbedtls_pk_context xPkCtx;
+    uint32_t ulPkKey;        /* Identity of the key and certificate objects xPkCtx was checked against, 0 if none */
+    uint32_t ulPkGeneration; /* ulPkiGetGeneration() when xPkCtx was read */
 
 #ifdef MBEDTLS_TRANSPORT_PKCS11
     CK_SESSION_HANDLE xP11SessionHandle;
@@ -102,8 +280,45 @@ typedef struct TLSContext
 #ifdef TRANSPORT_USE_CTR_DRBG
     mbedtls_ctr_drbg_context xCtrDrbgCtx;
 #endif /* TRANSPORT_USE_CTR_DRBG */
+
+#if TLS_TRANSPORT_COALESCE_LEN > 0
+    uint8_t ucCoalesceBuf[ TLS_TRANSPORT_COALESCE_LEN ];
+#endif /* TLS_TRANSPORT_COALESCE_LEN > 0 */
+
+#if TLS_TRANSPORT_PROFILE == 1
+    TlsConnectProfile_t xProfile;
+    size_t uxProfileHeapStart; /* Free heap when the profiled operation started */
+#endif /* TLS_TRANSPORT_PROFILE == 1 */
+
+#if TLS_SESSION_RESUMPTION == 1
+    /* Session from the last successful handshake */
+    mbedtls_ssl_session xSession;
+    uint32_t ulSessionId;          /* Hash of the host and port, 0 if xSession is empty */
+    TickType_t xSessionTick;       /* Time the session was established */
+    BaseType_t xSessionAgeUnknown; /* pdTRUE if the session was kept across a reset */
+    BaseType_t xSessionOffered;    /* pdTRUE if xSession was offered in the current handshake */
+#if ( TLS_SESSION_PERSIST == 1 ) || ( TLS_SESSION_WARM == 1 )
+    BaseType_t xSessionLoaded;
+#endif /* ( TLS_SESSION_PERSIST == 1 ) || ( TLS_SESSION_WARM == 1 ) */
+#endif /* TLS_SESSION_RESUMPTION == 1 */
 } TLSContext_t;
 
+/**
+ * @brief Parsed certificate chain that can be shared by several TLS contexts.
+ */
+typedef struct CertCacheEntry
+{
+    uint32_t ulKey;          /* Identity of the PkiObject_t(s) the chain was read from, 0 if unused */
+    uint32_t ulGeneration;   /* ulPkiGetGeneration() when the chain was read */
+    uint32_t ulRefCount;     /* Number of TLS contexts using pxChain */
+    mbedtls_x509_crt * pxChain;
+} CertCacheEntry_t;
+
+/* Distinguishes CA chain and client certificate keys read from the same objects */
+#define CERT_CACHE_SEED_CA        0x811C9DC5
+#define CERT_CACHE_SEED_CLIENT    0x050C5D1F
+
+static CertCacheEntry_t xCertCache[ TLS_CERT_CACHE_ENTRIES ] = { 0 };
 
 /*-----------------------------------------------------------*/
 
@@ -115,14 +330,13 @@ static TlsTransportStatus_t xConfigureCAChain( TLSContext_t * pxTLSCtx,
                                                const PkiObject_t * pxRootCaCerts,
                                                const size_t uxNumRootCA );
 
-static inline void vStopSocketNotifyTask( NotifyThreadCtx_t * pxNotifyThreadCtx );
+static void vHookRecvReady( TLSContext_t * pxTLSCtx );
 
-static void vCreateSocketNotifyTask( NotifyThreadCtx_t * pxNotifyThreadCtx,
-                                     SockHandle_t xSockHandle );
-static void vFreeNotifyThreadCtx( NotifyThreadCtx_t * pxNotifyThreadCtx );
+static void vUnhookRecvReady( TLSContext_t * pxTLSCtx );
 
-
-static void vFreeNotifyThreadCtx( NotifyThreadCtx_t * pxNotifyThreadCtx );
+#if TLS_SESSION_RESUMPTION == 1
+static void vInvalidateSession( TLSContext_t * pxTLSCtx );
+#endif /* TLS_SESSION_RESUMPTION == 1 */
 
 #ifdef MBEDTLS_DEBUG_C
 /* Used to print mbedTLS log output. */
@@ -135,60 +349,453 @@ static void vTLSDebugPrint( void * ctx,
 
 /*-----------------------------------------------------------*/
 
-static void vSocketNotifyThread( void * pvParameters )
+/*
+ * Context of the socket hooked by vHookRecvReady, indexed by socket number.
+ * Written with the tcpip core lock held and read from the tcpip thread.
+ */
+static TLSContext_t * pxRecvReadyCtx[ MEMP_NUM_NETCONN ] = { 0 };
+
+/* Event callback installed by the lwIP sockets layer, shared by all sockets */
+static netconn_callback xSocketEventCallback = NULL;
+
+/*-----------------------------------------------------------*/
+
+/*
+ * Netconn event callback of hooked sockets. Passes every event on to the
+ * sockets layer and signals the owner of the socket directly when data (or an
+ * error) arrives, without a select() round trip through a helper task.
+ */
+static void vRecvReadyEventCallback( struct netconn * pxConn,
+                                     enum netconn_evt xEvent,
+                                     u16_t usLen )
+{
+    int lIdx = pxConn->socket - LWIP_SOCKET_OFFSET;
+
+    if( xSocketEventCallback != NULL )
+    {
+        xSocketEventCallback( pxConn, xEvent, usLen );
+    }
+
+    if( ( ( xEvent == NETCONN_EVT_RCVPLUS ) ||
+          ( xEvent == NETCONN_EVT_ERROR ) ) &&
+        ( lIdx >= 0 ) &&
+        ( lIdx < MEMP_NUM_NETCONN ) )
+    {
+        TLSContext_t * pxTLSCtx = pxRecvReadyCtx[ lIdx ];
+
+        if( ( pxTLSCtx != NULL ) &&
+            ( pxTLSCtx->pxRecvReadyCallback != NULL ) )
+        {
+            pxTLSCtx->pxRecvReadyCallback( pxTLSCtx->pvRecvReadyCallbackCtx );
+        }
+    }
+}
+
+/*-----------------------------------------------------------*/
+
+/* Check for data buffered by mbedtls or still waiting in the socket */
+static BaseType_t xRecvDataPending( TLSContext_t * pxTLSCtx )
+{
+    BaseType_t xPending = pdFALSE;
+
+    if( ( mbedtls_ssl_get_bytes_avail( &( pxTLSCtx->xSslCtx ) ) > 0 ) ||
+        ( mbedtls_ssl_check_pending( &( pxTLSCtx->xSslCtx ) ) != 0 ) )
+    {
+        xPending = pdTRUE;
+    }
+
+#if TLS_TRANSPORT_NETCONN_RECV == 1
+    else if( pxTLSCtx->pxRecvPbuf != NULL )
+    {
+        xPending = pdTRUE;
+    }
+#endif /* TLS_TRANSPORT_NETCONN_RECV == 1 */
+    else if( pxTLSCtx->xSockHandle >= 0 )
+    {
+        struct timeval xTimeout = { 0 };
+        fd_set xReadSet;
+
+        FD_ZERO( &xReadSet );
+        FD_SET( pxTLSCtx->xSockHandle, &xReadSet );
+
+        if( sock_select( pxTLSCtx->xSockHandle + 1, &xReadSet, NULL, NULL, &xTimeout ) > 0 )
+        {
+            xPending = pdTRUE;
+        }
+    }
+    else
+    {
+        /* Empty */
+    }
+
+    return xPending;
+}
+
+/*-----------------------------------------------------------*/
+
+static void vHookRecvReady( TLSContext_t * pxTLSCtx )
+{
+    int lIdx = pxTLSCtx->xSockHandle - LWIP_SOCKET_OFFSET;
+
+    if( ( pxTLSCtx->pxRecvReadyCallback != NULL ) &&
+        ( pxTLSCtx->xRecvReadyHooked == pdFALSE ) &&
+        ( lIdx >= 0 ) &&
+        ( lIdx < MEMP_NUM_NETCONN ) )
+    {
+        struct lwip_sock * pxSock = NULL;
+
+        LOCK_TCPIP_CORE();
+
+        pxSock = lwip_socket_dbg_get_socket( pxTLSCtx->xSockHandle );
+
+        if( ( pxSock != NULL ) &&
+            ( pxSock->conn != NULL ) )
+        {
+            if( pxSock->conn->callback != vRecvReadyEventCallback )
+            {
+                xSocketEventCallback = pxSock->conn->callback;
+                pxSock->conn->callback = vRecvReadyEventCallback;
+            }
+
+            pxRecvReadyCtx[ lIdx ] = pxTLSCtx;
+            pxTLSCtx->xRecvReadyHooked = pdTRUE;
+        }
+
+        UNLOCK_TCPIP_CORE();
+
+        if( pxTLSCtx->xRecvReadyHooked == pdFALSE )
+        {
+            LogError( "Failed to hook receive events of socket: %d.", pxTLSCtx->xSockHandle );
+        }
+        /* Data may have arrived before the hook was installed */
+        else if( xRecvDataPending( pxTLSCtx ) == pdTRUE )
+        {
+            pxTLSCtx->pxRecvReadyCallback( pxTLSCtx->pvRecvReadyCallbackCtx );
+        }
+        else
+        {
+            /* Empty */
+        }
+    }
+}
+
+/*-----------------------------------------------------------*/
+
+/* Must be called before the socket is closed */
+static void vUnhookRecvReady( TLSContext_t * pxTLSCtx )
+{
+    int lIdx = pxTLSCtx->xSockHandle - LWIP_SOCKET_OFFSET;
+
+    if( pxTLSCtx->xRecvReadyHooked == pdTRUE )
+    {
+        struct lwip_sock * pxSock = NULL;
+
+        configASSERT( ( lIdx >= 0 ) && ( lIdx < MEMP_NUM_NETCONN ) );
+
+        LOCK_TCPIP_CORE();
+
+        pxSock = lwip_socket_dbg_get_socket( pxTLSCtx->xSockHandle );
+
+        if( ( pxSock != NULL ) &&
+            ( pxSock->conn != NULL ) &&
+            ( pxSock->conn->callback == vRecvReadyEventCallback ) )
+        {
+            pxSock->conn->callback = xSocketEventCallback;
+        }
+
+        pxRecvReadyCtx[ lIdx ] = NULL;
+        pxTLSCtx->xRecvReadyHooked = pdFALSE;
+
+        UNLOCK_TCPIP_CORE();
+    }
+}
+
+/*-----------------------------------------------------------*/
+
+/* Close the connected socket, along with anything received and not yet read */
+static void vCloseSocket( TLSContext_t * pxTLSCtx )
+{
+    if( pxTLSCtx->xSockHandle >= 0 )
+    {
+        vUnhookRecvReady( pxTLSCtx );
+
+#if TLS_TRANSPORT_NETCONN_RECV == 1
+        if( pxTLSCtx->pxRecvPbuf != NULL )
+        {
+            ( void ) pbuf_free( pxTLSCtx->pxRecvPbuf );
+            pxTLSCtx->pxRecvPbuf = NULL;
+        }
+
+#endif /* TLS_TRANSPORT_NETCONN_RECV == 1 */
+
+        pxTLSCtx->pxConn = NULL;
+        pxTLSCtx->xUnackedPending = pdFALSE;
+
+        ( void ) sock_close( pxTLSCtx->xSockHandle );
+        pxTLSCtx->xSockHandle = -1;
+    }
+}
+
+/*-----------------------------------------------------------*/
+
+/* Netconn of the connected socket, NULL if there is none */
+static struct netconn * pxGetConn( TLSContext_t * pxTLSCtx )
+{
+    if( ( pxTLSCtx->pxConn == NULL ) &&
+        ( pxTLSCtx->xSockHandle >= 0 ) )
+    {
+        struct lwip_sock * pxSock = NULL;
+
+        LOCK_TCPIP_CORE();
+
+        pxSock = lwip_socket_dbg_get_socket( pxTLSCtx->xSockHandle );
+
+        if( pxSock != NULL )
+        {
+            pxTLSCtx->pxConn = pxSock->conn;
+        }
+
+        UNLOCK_TCPIP_CORE();
+    }
+
+    return pxTLSCtx->pxConn;
+}
+
+/*-----------------------------------------------------------*/
+
+/*
+ * lwIP has no TCP_USER_TIMEOUT: unacknowledged data is retransmitted up to
+ * TCP_MAXRTX times with exponential backoff before the connection is dropped.
+ * Emulate it by aborting the connection once the oldest unacknowledged sequence
+ * number has not moved for ulUserTimeoutMs. Returns pdTRUE if it was aborted.
+ */
+static BaseType_t xUserTimeoutExpired( TLSContext_t * pxTLSCtx )
+{
+    BaseType_t xExpired = pdFALSE;
+    TickType_t xNow = xTaskGetTickCount();
+    struct netconn * pxConn = NULL;
+
+    if( ( pxTLSCtx->ulUserTimeoutMs > 0 ) &&
+        ( ( xNow - pxTLSCtx->xLastUserTimeoutCheck ) >= pdMS_TO_TICKS( TLS_USER_TIMEOUT_POLL_MS ) ) )
+    {
+        pxTLSCtx->xLastUserTimeoutCheck = xNow;
+        pxConn = pxGetConn( pxTLSCtx );
+    }
+
+    if( pxConn != NULL )
+    {
+        struct tcp_pcb * pxPcb = NULL;
+
+        LOCK_TCPIP_CORE();
+
+        pxPcb = pxConn->pcb.tcp;
+
+        if( ( pxPcb == NULL ) ||
+            ( ( pxPcb->unacked == NULL ) && ( pxPcb->unsent == NULL ) ) )
+        {
+            /* Nothing in flight, or already closed and reported by the next receive */
+            pxTLSCtx->xUnackedPending = pdFALSE;
+        }
+        else if( ( pxTLSCtx->xUnackedPending == pdFALSE ) ||
+                 ( pxPcb->lastack != pxTLSCtx->ulUnackedSeq ) )
+        {
+            pxTLSCtx->xUnackedPending = pdTRUE;
+            pxTLSCtx->ulUnackedSeq = pxPcb->lastack;
+            pxTLSCtx->xUnackedSince = xNow;
+        }
+        else if( ( xNow - pxTLSCtx->xUnackedSince ) >= pdMS_TO_TICKS( pxTLSCtx->ulUserTimeoutMs ) )
+        {
+            /* Wakes up any reader of the netconn with ERR_ABRT */
+            tcp_abort( pxPcb );
+            pxTLSCtx->xUnackedPending = pdFALSE;
+            xExpired = pdTRUE;
+        }
+        else
+        {
+            /* Still within the timeout */
+        }
+
+        UNLOCK_TCPIP_CORE();
+
+        if( xExpired == pdTRUE )
+        {
+            LogWarn( "No acknowledgement from the peer for %lu ms, connection aborted.",
+                     pxTLSCtx->ulUserTimeoutMs );
+        }
+    }
+
+    return xExpired;
+}
+
+/*-----------------------------------------------------------*/
+
+#if TLS_TRANSPORT_PROFILE == 1
+
+/* Profile of the last connect attempt, guarded by a critical section */
+static TlsConnectProfile_t xLastProfile = { 0 };
+static BaseType_t xLastProfileValid = pdFALSE;
+
+/*-----------------------------------------------------------*/
+
+static inline uint32_t ulProfileStart( void )
+{
+    return DWT->CYCCNT;
+}
+
+/*-----------------------------------------------------------*/
+
+static void vProfileBegin( TLSContext_t * pxTLSCtx,
+                           TlsProfilePhase_t xFirstPhase )
+{
+    /* Clear this phase and every later one */
+    for( uint32_t i = xFirstPhase; i < TLS_PROFILE_NUM_PHASES; i++ )
+    {
+        pxTLSCtx->xProfile.ulCycles[ i ] = 0;
+    }
+
+    pxTLSCtx->uxProfileHeapStart = xPortGetFreeHeapSize();
+
+    if( xFirstPhase == TLS_PROFILE_CA_CHAIN )
+    {
+        pxTLSCtx->xProfile.uxHeapPeakBytes = 0;
+    }
+}
+
+/*-----------------------------------------------------------*/
+
+static void vProfileRecord( TLSContext_t * pxTLSCtx,
+                            TlsProfilePhase_t xPhase,
+                            uint32_t ulStartCycles )
+{
+    size_t uxFreeHeap = xPortGetFreeHeapSize();
+
+    pxTLSCtx->xProfile.ulCycles[ xPhase ] += DWT->CYCCNT - ulStartCycles;
+
+    /* Heap is only sampled at phase boundaries, so short lived peaks within a phase are missed */
+    if( ( uxFreeHeap < pxTLSCtx->uxProfileHeapStart ) &&
+        ( ( pxTLSCtx->uxProfileHeapStart - uxFreeHeap ) > pxTLSCtx->xProfile.uxHeapPeakBytes ) )
+    {
+        pxTLSCtx->xProfile.uxHeapPeakBytes = pxTLSCtx->uxProfileHeapStart - uxFreeHeap;
+    }
+}
+
+/*-----------------------------------------------------------*/
+
+static void vProfilePublish( TLSContext_t * pxTLSCtx,
+                             BaseType_t xConnected )
+{
+    pxTLSCtx->xProfile.xConnected = xConnected;
+
+    taskENTER_CRITICAL();
+    xLastProfile = pxTLSCtx->xProfile;
+    xLastProfileValid = pdTRUE;
+    taskEXIT_CRITICAL();
+}
+
+/*-----------------------------------------------------------*/
+
+static TlsProfilePhase_t xHandshakeStateToPhase( int lState )
+{
+    TlsProfilePhase_t xPhase = TLS_PROFILE_HS_OTHER;
+
+    switch( lState )
+    {
+        case MBEDTLS_SSL_HELLO_REQUEST:
+        case MBEDTLS_SSL_CLIENT_HELLO:
+        case MBEDTLS_SSL_SERVER_HELLO:
+            xPhase = TLS_PROFILE_HS_HELLO;
+            break;
+
+        case MBEDTLS_SSL_SERVER_CERTIFICATE:
+            xPhase = TLS_PROFILE_HS_SERVER_CERT;
+            break;
+
+        case MBEDTLS_SSL_SERVER_KEY_EXCHANGE:
+        case MBEDTLS_SSL_CLIENT_KEY_EXCHANGE:
+            xPhase = TLS_PROFILE_HS_KEY_EXCHANGE;
+            break;
+
+        case MBEDTLS_SSL_CERTIFICATE_VERIFY:
+            xPhase = TLS_PROFILE_HS_SIGN;
+            break;
+
+        default:
+            xPhase = TLS_PROFILE_HS_OTHER;
+            break;
+    }
+
+    return xPhase;
+}
+
+/*-----------------------------------------------------------*/
+
+/* Equivalent to mbedtls_ssl_handshake, stepping through the states to time each one */
+static int lProfiledHandshake( TLSContext_t * pxTLSCtx )
+{
+    mbedtls_ssl_context * pxSslCtx = &( pxTLSCtx->xSslCtx );
+    int lError = 0;
+
+    while( ( pxSslCtx->MBEDTLS_PRIVATE( state ) != MBEDTLS_SSL_HANDSHAKE_OVER ) &&
+           ( ( lError == 0 ) ||
+             ( lError == MBEDTLS_ERR_SSL_WANT_READ ) ||
+             ( lError == MBEDTLS_ERR_SSL_WANT_WRITE ) ) )
+    {
+        TlsProfilePhase_t xPhase = xHandshakeStateToPhase( pxSslCtx->MBEDTLS_PRIVATE( state ) );
+        uint32_t ulStart = ulProfileStart();
+
+        lError = mbedtls_ssl_handshake_step( pxSslCtx );
+
+        vProfileRecord( pxTLSCtx, xPhase, ulStart );
+    }
+
+    return lError;
+}
+
+#endif /* TLS_TRANSPORT_PROFILE == 1 */
+
+/*-----------------------------------------------------------*/
+
+BaseType_t mbedtls_transport_getprofile( TlsConnectProfile_t * pxProfile )
 {
-    NotifyThreadCtx_t * pxCtx = ( NotifyThreadCtx_t * ) pvParameters;
-    SockHandle_t xSockHandle = pxCtx->xSockHandle;
-    BaseType_t xExitFlag = pdFALSE;
-    fd_set xReadSet;
-    fd_set xErrorSet;
-    int lRslt;
-    uint32_t ulNotifyValue = 0;
+    BaseType_t xResult = pdFALSE;
 
-    ( void ) xTaskNotifyStateClear( NULL );
+    configASSERT( pxProfile != NULL );
 
-    if( pxCtx->pxRecvReadyCallback == NULL )
-    {
-        xExitFlag = pdTRUE;
-    }
+#if TLS_TRANSPORT_PROFILE == 1
+    taskENTER_CRITICAL();
 
-    while( !xExitFlag )
+    if( xLastProfileValid == pdTRUE )
     {
-        FD_ZERO( &xReadSet );
-        FD_ZERO( &xErrorSet );
-        FD_SET( xSockHandle, &xReadSet );
-        FD_SET( xSockHandle, &xErrorSet );
-
-        lRslt = sock_select( xSockHandle + 1, &xReadSet, NULL, &xErrorSet, NULL );
+        *pxProfile = xLastProfile;
+        xResult = pdTRUE;
+    }
 
-        xExitFlag |= ( lRslt == 0 );
+    taskEXIT_CRITICAL();
+#else
+    ( void ) pxProfile;
+#endif /* TLS_TRANSPORT_PROFILE == 1 */
 
-        if( ( lRslt == 0 ) ||
-            FD_ISSET( xSockHandle, &xErrorSet ) )
-        {
-            xExitFlag = pdTRUE;
-        }
-        else
-        {
-            if( FD_ISSET( xSockHandle, &xReadSet ) &&
-                pxCtx->pxRecvReadyCallback )
-            {
-                pxCtx->pxRecvReadyCallback( pxCtx->pvRecvReadyCallbackCtx );
-            }
-        }
+    return xResult;
+}
 
-        if( xTaskNotifyWait( 0x0, 0xFFFFFFFF, &ulNotifyValue, portMAX_DELAY ) )
-        {
-            if( ulNotifyValue == 0xFFFFFFFF )
-            {
-                xExitFlag = pdTRUE;
-            }
-        }
-    }
+/*-----------------------------------------------------------*/
 
-    /* Delete thread error */
-    pxCtx->xTaskHandle = NULL;
-    vTaskDelete( NULL );
+const char * mbedtls_transport_profilephasename( TlsProfilePhase_t xPhase )
+{
+    static const char * const pcPhaseNames[ TLS_PROFILE_NUM_PHASES ] =
+    {
+        "ca_chain",
+        "client_cred",
+        "dns",
+        "tcp_connect",
+        "hs_hello",
+        "hs_server_cert",
+        "hs_key_exchange",
+        "hs_sign",
+        "hs_other",
+    };
+
+    return( ( xPhase < TLS_PROFILE_NUM_PHASES ) ? pcPhaseNames[ xPhase ] : "unknown" );
 }
 
 /*-----------------------------------------------------------*/
@@ -342,27 +949,58 @@ static void vLogCertInfo( mbedtls_x509_crt * pxCert,
 
 /*-----------------------------------------------------------*/
 /*TODO add proper timeout */
+/* Block until the socket can accept more data or xTicksToWait elapses */
+static void vWaitForWritable( SockHandle_t xSockHandle,
+                              TickType_t xTicksToWait )
+{
+    uint32_t ulWaitMs = ( uint32_t ) ( xTicksToWait * portTICK_PERIOD_MS );
+    struct timeval xTimeout =
+    {
+        .tv_sec  = ulWaitMs / 1000,
+        .tv_usec = ( ulWaitMs % 1000 ) * 1000,
+    };
+    fd_set xWriteSet;
+    fd_set xErrorSet;
+
+    FD_ZERO( &xWriteSet );
+    FD_ZERO( &xErrorSet );
+    FD_SET( xSockHandle, &xWriteSet );
+    FD_SET( xSockHandle, &xErrorSet );
+
+    /* The next send reports any error, so the result is not needed here */
+    ( void ) sock_select( xSockHandle + 1, NULL, &xWriteSet, &xErrorSet, &xTimeout );
+}
+
+/*-----------------------------------------------------------*/
+
 static int mbedtls_ssl_send( void * pvCtx,
                              const unsigned char * pcBuf,
                              size_t uxLen )
 {
-    SockHandle_t * pxSockHandle = ( SockHandle_t * ) pvCtx;
+    TLSContext_t * pxTLSCtx = ( TLSContext_t * ) pvCtx;
     int lError = 0;
     size_t uxBytesSent = 0;
-    uint32_t ulBackofftimeMs = 1;
 
-    if( ( pxSockHandle == NULL ) ||
-        ( *pxSockHandle < 0 ) )
+    if( ( pxTLSCtx == NULL ) ||
+        ( pxTLSCtx->xSockHandle < 0 ) )
     {
         lError = MBEDTLS_ERR_NET_SOCKET_FAILED;
     }
     else
     {
-        while( uxBytesSent < uxLen && lError == 0 )
+        TimeOut_t xTimeOut;
+        TickType_t xTicksToWait = pdMS_TO_TICKS( pxTLSCtx->ulSendTimeoutMs );
+        BaseType_t xTimedOut = pdFALSE;
+
+        vTaskSetTimeOutState( &xTimeOut );
+
+        while( ( uxBytesSent < uxLen ) &&
+               ( lError == 0 ) &&
+               ( xTimedOut == pdFALSE ) )
         {
-            ssize_t xRslt = sock_send( *pxSockHandle,
-                                       ( void * const ) pcBuf,
-                                       uxLen,
+            ssize_t xRslt = sock_send( pxTLSCtx->xSockHandle,
+                                       ( const void * ) &( pcBuf[ uxBytesSent ] ),
+                                       uxLen - uxBytesSent,
                                        0 );
 
             if( xRslt > 0 )
@@ -371,20 +1009,28 @@ static int mbedtls_ssl_send( void * pvCtx,
             }
             else
             {
-                lError = *__errno();
-
-                if( lError != EWOULDBLOCK )
-                {
-                    LogError( "Got Error code: %ld", lError );
-                }
-
-                switch( lError )
+                switch( *__errno() )
                 {
 #if EAGAIN != EWOULDBLOCK
                     case EAGAIN:
 #endif
                     case EINTR:
                     case EWOULDBLOCK:
+
+                        /* Send buffer full, wait until it drains or the send timeout expires */
+                        if( xUserTimeoutExpired( pxTLSCtx ) == pdTRUE )
+                        {
+                            lError = MBEDTLS_ERR_NET_CONN_RESET;
+                        }
+                        else if( xTaskCheckForTimeOut( &xTimeOut, &xTicksToWait ) == pdTRUE )
+                        {
+                            xTimedOut = pdTRUE;
+                        }
+                        else
+                        {
+                            vWaitForWritable( pxTLSCtx->xSockHandle, xTicksToWait );
+                        }
+
                         break;
 
                     case EPIPE:
@@ -393,36 +1039,103 @@ static int mbedtls_ssl_send( void * pvCtx,
                         break;
 
                     default:
+                        LogError( "Got Error code: %ld", *__errno() );
                         lError = MBEDTLS_ERR_NET_SEND_FAILED;
                         break;
                 }
-
-                if( lError == EWOULDBLOCK )
-                {
-                    vTaskDelay( ulBackofftimeMs );
-                    ulBackofftimeMs = ulBackofftimeMs * 2;
-                    lError = 0;
-                }
             }
         }
+
+        /* mbedtls retries the remainder of a partially sent record on the next call */
+        if( ( xTimedOut == pdTRUE ) &&
+            ( uxBytesSent == 0 ) )
+        {
+            lError = MBEDTLS_ERR_SSL_WANT_WRITE;
+        }
     }
 
-    return ( int ) lError < 0 ? lError : uxBytesSent;
+    return ( lError < 0 ) ? lError : ( int ) uxBytesSent;
 }
 
 /*-----------------------------------------------------------*/
 
+#if TLS_TRANSPORT_NETCONN_RECV == 1
+
+static int mbedtls_ssl_recv( void * pvCtx,
+                             unsigned char * pcBuf,
+                             size_t xLen )
+{
+    TLSContext_t * pxTLSCtx = ( TLSContext_t * ) pvCtx;
+    struct netconn * pxConn = NULL;
+    int lResult = MBEDTLS_ERR_NET_INVALID_CONTEXT;
+    err_t xError = ERR_OK;
+
+    if( pxTLSCtx != NULL )
+    {
+        pxConn = pxGetConn( pxTLSCtx );
+    }
+
+    if( pxConn != NULL )
+    {
+        /* Honours the SO_RCVTIMEO and O_NONBLOCK settings of the socket */
+        if( pxTLSCtx->pxRecvPbuf == NULL )
+        {
+            xError = netconn_recv_tcp_pbuf( pxConn, &( pxTLSCtx->pxRecvPbuf ) );
+        }
+
+        switch( xError )
+        {
+            case ERR_OK:
+               {
+                   struct pbuf * pxPbuf = pxTLSCtx->pxRecvPbuf;
+                   u16_t usLen = ( xLen < pxPbuf->tot_len ) ? ( u16_t ) xLen : pxPbuf->tot_len;
+
+                   usLen = pbuf_copy_partial( pxPbuf, pcBuf, usLen, 0 );
+
+                   /* Frees the pbufs of the chain which have been read completely */
+                   pxTLSCtx->pxRecvPbuf = pbuf_free_header( pxPbuf, usLen );
+                   lResult = ( int ) usLen;
+               }
+               break;
+
+            case ERR_WOULDBLOCK:
+            case ERR_TIMEOUT:
+                lResult = MBEDTLS_ERR_SSL_WANT_READ;
+                break;
+
+            case ERR_CLSD:
+                /* Orderly shutdown by the peer */
+                lResult = 0;
+                break;
+
+            case ERR_RST:
+            case ERR_ABRT:
+            case ERR_CONN:
+                lResult = MBEDTLS_ERR_NET_CONN_RESET;
+                break;
+
+            default:
+                lResult = MBEDTLS_ERR_NET_RECV_FAILED;
+                break;
+        }
+    }
+
+    return lResult;
+}
+
+#else /* TLS_TRANSPORT_NETCONN_RECV == 1 */
+
 static int mbedtls_ssl_recv( void * pvCtx,
                              unsigned char * pcBuf,
                              size_t xLen )
 {
-    SockHandle_t * pxSockHandle = ( SockHandle_t * ) pvCtx;
+    TLSContext_t * pxTLSCtx = ( TLSContext_t * ) pvCtx;
     int lError = -1;
 
-    if( ( pxSockHandle != NULL ) &&
-        ( *pxSockHandle >= 0 ) )
+    if( ( pxTLSCtx != NULL ) &&
+        ( pxTLSCtx->xSockHandle >= 0 ) )
     {
-        lError = sock_recv( *pxSockHandle,
+        lError = sock_recv( pxTLSCtx->xSockHandle,
                             ( void * ) pcBuf,
                             xLen,
                             0 );
@@ -457,6 +1170,8 @@ static int mbedtls_ssl_recv( void * pvCtx,
     return lError;
 }
 
+#endif /* TLS_TRANSPORT_NETCONN_RECV == 1 */
+
 /*-----------------------------------------------------------*/
 
 NetworkContext_t * mbedtls_transport_allocate( void )
@@ -473,12 +1188,43 @@ NetworkContext_t * mbedtls_transport_allocate( void )
     {
         pxTLSCtx->xConnectionState = STATE_ALLOCATED;
         pxTLSCtx->xSockHandle = -1;
+        pxTLSCtx->ulSendTimeoutMs = 0;
+        pxTLSCtx->ucMaxFragLen = TLS_TRANSPORT_MAX_FRAG_LEN;
+        pxTLSCtx->xCipherPref = TLS_TRANSPORT_CIPHER_PREF;
+        pxTLSCtx->uxArenaLen = TLS_TRANSPORT_ARENA_LEN;
+        pxTLSCtx->pxArena = NULL;
+
+#if TLS_TRANSPORT_PROFILE == 1
+        ( void ) memset( &( pxTLSCtx->xProfile ), 0, sizeof( TlsConnectProfile_t ) );
+        pxTLSCtx->uxProfileHeapStart = 0;
+
+        /* Enable the cycle counter used for phase timing */
+        CoreDebug->DEMCR |= CoreDebug_DEMCR_TRCENA_Msk;
+        DWT->CTRL |= DWT_CTRL_CYCCNTENA_Msk;
+#endif /* TLS_TRANSPORT_PROFILE == 1 */
+        pxTLSCtx->pxRecvReadyCallback = NULL;
+        pxTLSCtx->pvRecvReadyCallbackCtx = NULL;
+        pxTLSCtx->xRecvReadyHooked = pdFALSE;
+        pxTLSCtx->pxConn = NULL;
+#if TLS_TRANSPORT_NETCONN_RECV == 1
+        pxTLSCtx->pxRecvPbuf = NULL;
+#endif /* TLS_TRANSPORT_NETCONN_RECV == 1 */
+        pxTLSCtx->ulKeepIdleS = TLS_TRANSPORT_KEEPALIVE_IDLE_S;
+        pxTLSCtx->ulKeepIntervalS = TLS_TRANSPORT_KEEPALIVE_INTERVAL_S;
+        pxTLSCtx->ulKeepCount = TLS_TRANSPORT_KEEPALIVE_COUNT;
+        pxTLSCtx->ulUserTimeoutMs = TLS_TRANSPORT_USER_TIMEOUT_MS;
+        pxTLSCtx->xLastUserTimeoutCheck = 0;
+        pxTLSCtx->xUnackedSince = 0;
+        pxTLSCtx->ulUnackedSeq = 0;
+        pxTLSCtx->xUnackedPending = pdFALSE;
         mbedtls_ssl_config_init( &( pxTLSCtx->xSslConfig ) );
         mbedtls_ssl_init( &( pxTLSCtx->xSslCtx ) );
 
-        mbedtls_x509_crt_init( &( pxTLSCtx->xClientCert ) );
-        mbedtls_x509_crt_init( &( pxTLSCtx->xRootCaChain ) );
+        pxTLSCtx->pxClientCert = NULL;
+        pxTLSCtx->pxRootCaChain = NULL;
         mbedtls_pk_init( &( pxTLSCtx->xPkCtx ) );
+        pxTLSCtx->ulPkKey = 0;
+        pxTLSCtx->ulPkGeneration = 0;
 
 #ifdef MBEDTLS_TRANSPORT_PKCS11
         pxTLSCtx->xP11SessionHandle = CK_INVALID_HANDLE;
@@ -490,6 +1236,17 @@ NetworkContext_t * mbedtls_transport_allocate( void )
         mbedtls_ctr_drbg_init( &( pxTLSCtx->xCtrDrbgCtx ) );
 #endif /* TRANSPORT_USE_CTR_DRBG */
 
+#if TLS_SESSION_RESUMPTION == 1
+        mbedtls_ssl_session_init( &( pxTLSCtx->xSession ) );
+        pxTLSCtx->ulSessionId = 0;
+        pxTLSCtx->xSessionTick = 0;
+        pxTLSCtx->xSessionAgeUnknown = pdFALSE;
+        pxTLSCtx->xSessionOffered = pdFALSE;
+#if ( TLS_SESSION_PERSIST == 1 ) || ( TLS_SESSION_WARM == 1 )
+        pxTLSCtx->xSessionLoaded = pdFALSE;
+#endif /* ( TLS_SESSION_PERSIST == 1 ) || ( TLS_SESSION_WARM == 1 ) */
+#endif /* TLS_SESSION_RESUMPTION == 1 */
+
 #ifdef MBEDTLS_THREADING_ALT
         mbedtls_platform_threading_init();
 #endif /* MBEDTLS_THREADING_ALT */
@@ -506,29 +1263,26 @@ void mbedtls_transport_free( NetworkContext_t * pxNetworkContext )
 
     if( pxNetworkContext != NULL )
     {
-        vFreeNotifyThreadCtx( pxTLSCtx->pxNotifyThreadCtx );
+        vCloseSocket( pxTLSCtx );
 
-        if( pxTLSCtx->xSockHandle >= 0 )
+        mbedtls_ssl_config_free( &( pxTLSCtx->xSslConfig ) );
+        mbedtls_ssl_free( &( pxTLSCtx->xSslCtx ) );
+        if( pxTLSCtx->pxRootCaChain != NULL )
         {
-            ( void ) sock_close( pxTLSCtx->xSockHandle );
+            vCertCacheRelease( pxTLSCtx->pxRootCaChain );
+        }
+
+        if( pxTLSCtx->pxClientCert != NULL )
+        {
+            vCertCacheRelease( pxTLSCtx->pxClientCert );
         }
 
-        mbedtls_ssl_config_free( &( pxTLSCtx->xSslConfig ) );
-        mbedtls_ssl_free( &( pxTLSCtx->xSslCtx ) );
-        mbedtls_x509_crt_free( &( pxTLSCtx->xRootCaChain ) );
-        mbedtls_x509_crt_free( &( pxTLSCtx->xClientCert ) );
         mbedtls_pk_free( &( pxTLSCtx->xPkCtx ) );
 
 #ifdef MBEDTLS_TRANSPORT_PKCS11
         if( pxTLSCtx->xP11SessionHandle != CK_INVALID_HANDLE )
         {
-            CK_FUNCTION_LIST_PTR pxFunctionList = NULL;
-
-            if( ( C_GetFunctionList( &pxFunctionList ) == CKR_OK ) &&
-                ( pxFunctionList->C_CloseSession != NULL ) )
-            {
-                pxFunctionList->C_CloseSession( pxTLSCtx->xP11SessionHandle );
-            }
+            vPkcs11ReleaseSession( pxTLSCtx->xP11SessionHandle );
         }
 #endif /* MBEDTLS_TRANSPORT_PKCS11 */
 
@@ -537,6 +1291,13 @@ void mbedtls_transport_free( NetworkContext_t * pxNetworkContext )
         mbedtls_ctr_drbg_free( &( pxTLSCtx->xCtrDrbgCtx ) );
 #endif /* TRANSPORT_USE_CTR_DRBG */
 
+#if TLS_SESSION_RESUMPTION == 1
+        mbedtls_ssl_session_free( &( pxTLSCtx->xSession ) );
+#endif /* TLS_SESSION_RESUMPTION == 1 */
+
+        /* Released once the blocks that outlived the handshake are freed */
+        vMbedtlsArenaDelete( pxTLSCtx->pxArena );
+
         vPortFree( ( void * ) pxTLSCtx );
     }
 }
@@ -605,6 +1366,240 @@ static int lValidateCertByProfile( TLSContext_t * pxTLSCtx,
 
 /*-----------------------------------------------------------*/
 
+static uint32_t ulHashBytes( uint32_t ulHash,
+                             const void * pvData,
+                             size_t uxLen )
+{
+    const uint8_t * pucData = ( const uint8_t * ) pvData;
+
+    for( size_t i = 0; i < uxLen; i++ )
+    {
+        ulHash = ( ulHash ^ pucData[ i ] ) * 0x01000193;
+    }
+
+    return ulHash;
+}
+
+/*-----------------------------------------------------------*/
+
+/* FNV-1a hash identifying where a set of PKI objects is read from, rather than their contents */
+static uint32_t ulPkiObjectKey( const PkiObject_t * pxObjects,
+                                size_t uxNumObjects,
+                                uint32_t ulSeed )
+{
+    uint32_t ulHash = ulSeed;
+
+    for( size_t uxIdx = 0; uxIdx < uxNumObjects; uxIdx++ )
+    {
+        const PkiObject_t * pxObject = &( pxObjects[ uxIdx ] );
+
+        ulHash = ulHashBytes( ulHash, &( pxObject->xForm ), sizeof( pxObject->xForm ) );
+
+        switch( pxObject->xForm )
+        {
+            case OBJ_FORM_PEM:
+            case OBJ_FORM_DER:
+                ulHash = ulHashBytes( ulHash, &( pxObject->pucBuffer ), sizeof( pxObject->pucBuffer ) );
+                ulHash = ulHashBytes( ulHash, &( pxObject->uxLen ), sizeof( pxObject->uxLen ) );
+                break;
+
+#ifdef MBEDTLS_TRANSPORT_PKCS11
+            case OBJ_FORM_PKCS11_LABEL:
+                ulHash = ulHashBytes( ulHash, pxObject->pcPkcs11Label, pxObject->uxLen );
+                break;
+#endif /* MBEDTLS_TRANSPORT_PKCS11 */
+#ifdef MBEDTLS_TRANSPORT_PSA
+            case OBJ_FORM_PSA_CRYPTO:
+                ulHash = ulHashBytes( ulHash, &( pxObject->xPsaCryptoId ), sizeof( pxObject->xPsaCryptoId ) );
+                break;
+
+            case OBJ_FORM_PSA_ITS:
+            case OBJ_FORM_PSA_PS:
+                ulHash = ulHashBytes( ulHash, &( pxObject->xPsaStorageId ), sizeof( pxObject->xPsaStorageId ) );
+                break;
+#endif /* MBEDTLS_TRANSPORT_PSA */
+            default:
+                break;
+        }
+    }
+
+    /* 0 marks an unused cache entry */
+    return( ( ulHash == 0 ) ? 1 : ulHash );
+}
+
+/*-----------------------------------------------------------*/
+
+static void vFreeCertChain( mbedtls_x509_crt * pxChain )
+{
+    if( pxChain != NULL )
+    {
+        /* Frees every certificate in the chain except the head */
+        mbedtls_x509_crt_free( pxChain );
+        mbedtls_free( pxChain );
+    }
+}
+
+/*-----------------------------------------------------------*/
+
+/*
+ * @brief Take a reference to the cached chain read from the objects identified by ulKey.
+ * @return The chain, or NULL if it is not cached or the objects have been rewritten since.
+ */
+static mbedtls_x509_crt * pxCertCacheAcquire( uint32_t ulKey )
+{
+    mbedtls_x509_crt * pxChain = NULL;
+    mbedtls_x509_crt * pxStaleChains[ TLS_CERT_CACHE_ENTRIES ] = { NULL };
+    uint32_t ulGeneration = ulPkiGetGeneration();
+
+    taskENTER_CRITICAL();
+
+    for( uint32_t i = 0; i < TLS_CERT_CACHE_ENTRIES; i++ )
+    {
+        CertCacheEntry_t * pxEntry = &( xCertCache[ i ] );
+
+        if( pxEntry->ulKey == 0 )
+        {
+            continue;
+        }
+        else if( pxEntry->ulGeneration != ulGeneration )
+        {
+            /* Reclaim outdated chains that are no longer in use */
+            if( pxEntry->ulRefCount == 0 )
+            {
+                pxStaleChains[ i ] = pxEntry->pxChain;
+                pxEntry->pxChain = NULL;
+                pxEntry->ulKey = 0;
+            }
+        }
+        else if( pxEntry->ulKey == ulKey )
+        {
+            pxEntry->ulRefCount++;
+            pxChain = pxEntry->pxChain;
+        }
+        else
+        {
+            /* Empty */
+        }
+    }
+
+    taskEXIT_CRITICAL();
+
+    for( uint32_t i = 0; i < TLS_CERT_CACHE_ENTRIES; i++ )
+    {
+        vFreeCertChain( pxStaleChains[ i ] );
+    }
+
+    return pxChain;
+}
+
+/*-----------------------------------------------------------*/
+
+/*
+ * @brief Add a newly read chain to the cache, holding one reference to it.
+ *
+ * @return The chain to use. This is an equivalent chain and pxChain is freed if
+ * another context cached the same objects in the meantime.
+ */
+static mbedtls_x509_crt * pxCertCacheInsert( uint32_t ulKey,
+                                             uint32_t ulGeneration,
+                                             mbedtls_x509_crt * pxChain )
+{
+    mbedtls_x509_crt * pxResult = pxChain;
+    mbedtls_x509_crt * pxFreeChain = NULL;
+    CertCacheEntry_t * pxSlot = NULL;
+
+    taskENTER_CRITICAL();
+
+    for( uint32_t i = 0; i < TLS_CERT_CACHE_ENTRIES; i++ )
+    {
+        CertCacheEntry_t * pxEntry = &( xCertCache[ i ] );
+
+        if( ( pxEntry->ulKey == ulKey ) &&
+            ( pxEntry->ulGeneration == ulGeneration ) )
+        {
+            pxEntry->ulRefCount++;
+            pxResult = pxEntry->pxChain;
+            pxFreeChain = pxChain;
+            pxSlot = NULL;
+            break;
+        }
+        else if( pxEntry->ulKey == 0 )
+        {
+            pxSlot = pxEntry;
+        }
+        else if( ( pxEntry->ulRefCount == 0 ) &&
+                 ( ( pxSlot == NULL ) || ( pxSlot->ulKey != 0 ) ) )
+        {
+            /* Evict an unused chain if there is no free slot */
+            pxSlot = pxEntry;
+        }
+        else
+        {
+            /* Entry in use */
+        }
+    }
+
+    if( pxSlot != NULL )
+    {
+        pxFreeChain = pxSlot->pxChain;
+
+        pxSlot->ulKey = ulKey;
+        pxSlot->ulGeneration = ulGeneration;
+        pxSlot->ulRefCount = 1;
+        pxSlot->pxChain = pxChain;
+    }
+
+    taskEXIT_CRITICAL();
+
+    /* Otherwise every entry is in use and pxChain stays private to the caller */
+    vFreeCertChain( pxFreeChain );
+
+    return pxResult;
+}
+
+/*-----------------------------------------------------------*/
+
+static void vCertCacheRelease( mbedtls_x509_crt * pxChain )
+{
+    BaseType_t xCached = pdFALSE;
+    BaseType_t xFree = pdFALSE;
+
+    taskENTER_CRITICAL();
+
+    for( uint32_t i = 0; i < TLS_CERT_CACHE_ENTRIES; i++ )
+    {
+        CertCacheEntry_t * pxEntry = &( xCertCache[ i ] );
+
+        if( ( pxEntry->ulKey != 0 ) &&
+            ( pxEntry->pxChain == pxChain ) )
+        {
+            configASSERT( pxEntry->ulRefCount > 0 );
+            pxEntry->ulRefCount--;
+            xCached = pdTRUE;
+
+            /* Keep the chain for the next configure unless it is outdated */
+            if( ( pxEntry->ulRefCount == 0 ) &&
+                ( pxEntry->ulGeneration != ulPkiGetGeneration() ) )
+            {
+                pxEntry->ulKey = 0;
+                pxEntry->pxChain = NULL;
+                xFree = pdTRUE;
+            }
+
+            break;
+        }
+    }
+
+    taskEXIT_CRITICAL();
+
+    if( ( xCached == pdFALSE ) || ( xFree == pdTRUE ) )
+    {
+        vFreeCertChain( pxChain );
+    }
+}
+
+/*-----------------------------------------------------------*/
+
 static TlsTransportStatus_t xConfigureCertificateAuth( TLSContext_t * pxTLSCtx,
                                                        const PkiObject_t * pxPrivateKey,
                                                        const PkiObject_t * pxClientCert )
@@ -613,66 +1608,122 @@ static TlsTransportStatus_t xConfigureCertificateAuth( TLSContext_t * pxTLSCtx,
     mbedtls_pk_context * pxPkCtx = NULL;
     mbedtls_x509_crt * pxCertCtx = NULL;
     mbedtls_pk_context * pxCertPkCtx = NULL;
+    uint32_t ulGeneration = ulPkiGetGeneration();
+    uint32_t ulCertKey = 0;
+    uint32_t ulPkKey = 0;
+    BaseType_t xReusePk = pdFALSE;
 
     configASSERT( pxTLSCtx );
     configASSERT( pxPrivateKey );
     configASSERT( pxClientCert );
 
-    pxCertCtx = &( pxTLSCtx->xClientCert );
+    ulCertKey = ulPkiObjectKey( pxClientCert, 1, CERT_CACHE_SEED_CLIENT );
+    ulPkKey = ulPkiObjectKey( pxPrivateKey, 1, ulCertKey );
+
     pxPkCtx = &( pxTLSCtx->xPkCtx );
 
-    /* Reset pk and certificate contexts if this is a reconfiguration */
-    if( pxTLSCtx->xConnectionState == STATE_CONFIGURED )
+    /* Release the certificate used by the previous configuration */
+    if( pxTLSCtx->pxClientCert != NULL )
     {
-        mbedtls_pk_free( pxPkCtx );
-        mbedtls_x509_crt_free( pxCertCtx );
+        vCertCacheRelease( pxTLSCtx->pxClientCert );
+        pxTLSCtx->pxClientCert = NULL;
+    }
 
+    /* The key was already read and checked against this certificate, unless either has been rewritten */
+    if( ( pxTLSCtx->ulPkKey == ulPkKey ) &&
+        ( pxTLSCtx->ulPkGeneration == ulGeneration ) )
+    {
+        xReusePk = pdTRUE;
+    }
+    else if( pxTLSCtx->ulPkKey != 0 )
+    {
+        mbedtls_pk_free( pxPkCtx );
         mbedtls_pk_init( pxPkCtx );
-        mbedtls_x509_crt_init( pxCertCtx );
+        pxTLSCtx->ulPkKey = 0;
+    }
+    else
+    {
+        /* Empty */
     }
 
     configASSERT( pxTLSCtx->xSslConfig.f_rng );
 
-    xStatus = xPkiReadPrivateKey( pxPkCtx, pxPrivateKey,
-                                  pxTLSCtx->xSslConfig.f_rng,
-                                  pxTLSCtx->xSslConfig.p_rng );
-
-    if( xStatus != TLS_TRANSPORT_SUCCESS )
-    {
-        LogError( "Failed to add private key to TLS context." );
-    }
-    else
+    if( xReusePk == pdFALSE )
     {
-        xStatus = xPkiReadCertificate( pxCertCtx, pxClientCert );
+        xStatus = xPkiReadPrivateKey( pxPkCtx, pxPrivateKey,
+                                      pxTLSCtx->xSslConfig.f_rng,
+                                      pxTLSCtx->xSslConfig.p_rng );
 
         if( xStatus != TLS_TRANSPORT_SUCCESS )
         {
-            LogError( "Failed to add client certificate to TLS context." );
-        }
-        else
-        {
-            pxCertPkCtx = &( pxCertCtx->MBEDTLS_PRIVATE( pk ) );
+            LogError( "Failed to add private key to TLS context." );
         }
     }
 
     if( xStatus == TLS_TRANSPORT_SUCCESS )
     {
-        int lRslt = lValidateCertByProfile( pxTLSCtx, pxCertCtx );
+        pxCertCtx = pxCertCacheAcquire( ulCertKey );
 
-        if( lRslt != 0 )
+        if( pxCertCtx != NULL )
         {
-            vLogCertificateVerifyResult( lRslt );
+            LogDebug( "Reusing parsed client certificate." );
+        }
+        else
+        {
+            pxCertCtx = mbedtls_calloc( 1, sizeof( mbedtls_x509_crt ) );
+
+            if( pxCertCtx == NULL )
+            {
+                LogError( "Failed to allocate memory for mbedtls_x509_crt object." );
+                xStatus = TLS_TRANSPORT_INSUFFICIENT_MEMORY;
+            }
+            else
+            {
+                mbedtls_x509_crt_init( pxCertCtx );
+
+                xStatus = xPkiReadCertificate( pxCertCtx, pxClientCert );
+
+                if( xStatus != TLS_TRANSPORT_SUCCESS )
+                {
+                    LogError( "Failed to add client certificate to TLS context." );
+                }
+            }
+
+            if( xStatus == TLS_TRANSPORT_SUCCESS )
+            {
+                int lRslt = lValidateCertByProfile( pxTLSCtx, pxCertCtx );
+
+                if( lRslt != 0 )
+                {
+                    vLogCertificateVerifyResult( lRslt );
+
+                    xStatus = TLS_TRANSPORT_CLIENT_CERT_INVALID;
+                }
+                else
+                {
+                    vLogCertInfo( pxCertCtx, "Client Certificate:" );
+                }
+            }
 
-            xStatus = TLS_TRANSPORT_CLIENT_CERT_INVALID;
-        }
-        else
-        {
-            vLogCertInfo( pxCertCtx, "Client Certificate:" );
+            if( xStatus == TLS_TRANSPORT_SUCCESS )
+            {
+                pxCertCtx = pxCertCacheInsert( ulCertKey, ulGeneration, pxCertCtx );
+            }
+            else
+            {
+                vFreeCertChain( pxCertCtx );
+                pxCertCtx = NULL;
+            }
         }
+
+        pxTLSCtx->pxClientCert = pxCertCtx;
     }
 
-    if( xStatus == TLS_TRANSPORT_SUCCESS )
+    if( ( xStatus == TLS_TRANSPORT_SUCCESS ) &&
+        ( xReusePk == pdFALSE ) )
     {
+        pxCertPkCtx = &( pxCertCtx->MBEDTLS_PRIVATE( pk ) );
+
         configASSERT( pxCertPkCtx );
         configASSERT( pxPkCtx );
 
@@ -687,7 +1738,8 @@ static TlsTransportStatus_t xConfigureCertificateAuth( TLSContext_t * pxTLSCtx,
     }
 
     /* Validate that the cert and pk match. */
-    if( xStatus == TLS_TRANSPORT_SUCCESS )
+    if( ( xStatus == TLS_TRANSPORT_SUCCESS ) &&
+        ( xReusePk == pdFALSE ) )
     {
         mbedtls_pk_context xTempPubKeyCtx;
 
@@ -713,6 +1765,19 @@ static TlsTransportStatus_t xConfigureCertificateAuth( TLSContext_t * pxTLSCtx,
         xStatus = ( lError == 0 ) ? TLS_TRANSPORT_SUCCESS : TLS_TRANSPORT_INVALID_CREDENTIALS;
     }
 
+    if( xStatus == TLS_TRANSPORT_SUCCESS )
+    {
+        pxTLSCtx->ulPkKey = ulPkKey;
+        pxTLSCtx->ulPkGeneration = ulGeneration;
+    }
+    else
+    {
+        /* Force the key to be read again on the next attempt */
+        mbedtls_pk_free( pxPkCtx );
+        mbedtls_pk_init( pxPkCtx );
+        pxTLSCtx->ulPkKey = 0;
+    }
+
     return xStatus;
 }
 
@@ -728,19 +1793,49 @@ static TlsTransportStatus_t xConfigureCAChain( TLSContext_t * pxTLSCtx,
     mbedtls_x509_crt * pxRootCaChain = NULL;
     size_t uxValidCertCount = 0;
     int lError = 0;
+    uint32_t ulGeneration = ulPkiGetGeneration();
+    uint32_t ulKey = 0;
+    size_t uxNumToRead = uxNumRootCA;
 
     configASSERT( pxTLSCtx );
     configASSERT( pxRootCaCerts );
     configASSERT( uxNumRootCA );
 
-    pxRootCaChain = &( pxTLSCtx->xRootCaChain );
+    ulKey = ulPkiObjectKey( pxRootCaCerts, uxNumRootCA, CERT_CACHE_SEED_CA );
+
+    /* Release the chain used by the previous configuration */
+    if( pxTLSCtx->pxRootCaChain != NULL )
+    {
+        vCertCacheRelease( pxTLSCtx->pxRootCaChain );
+        pxTLSCtx->pxRootCaChain = NULL;
+    }
+
+    pxRootCaChain = pxCertCacheAcquire( ulKey );
+
+    if( pxRootCaChain != NULL )
+    {
+        LogDebug( "Reusing parsed CA certificate chain." );
+        uxValidCertCount = 1;
+        uxNumToRead = 0;
+    }
+    else
+    {
+        pxRootCaChain = mbedtls_calloc( 1, sizeof( mbedtls_x509_crt ) );
+
+        if( pxRootCaChain == NULL )
+        {
+            LogError( "Failed to allocate memory for mbedtls_x509_crt object." );
+            lError = MBEDTLS_ERR_X509_ALLOC_FAILED;
+            uxNumToRead = 0;
+        }
+    }
 
-    for( size_t uxIdx = 0; uxIdx < uxNumRootCA; uxIdx++ )
+    for( size_t uxIdx = 0; uxIdx < uxNumToRead; uxIdx++ )
     {
         const PkiObject_t * pxRootCert = &( pxRootCaCerts[ uxIdx ] );
         mbedtls_x509_crt * pxTempCaCert = NULL;
 
-        /* Heap allocate all but the first mbedtls_x509_crt object */
+        /* The first mbedtls_x509_crt object was allocated above */
         if( pxRootCertIterator == NULL )
         {
             pxTempCaCert = pxRootCaChain;
@@ -800,7 +1895,7 @@ static TlsTransportStatus_t xConfigureCAChain( TLSContext_t * pxTLSCtx,
             /* Free any allocated data */
             mbedtls_x509_crt_free( pxTempCaCert );
 
-            /* Free pxTempCaCert if it is heap allocated (not first in list) */
+            /* Free pxTempCaCert unless it is the head of the list */
             if( pxRootCertIterator != NULL )
             {
                 mbedtls_free( pxTempCaCert );
@@ -823,9 +1918,89 @@ static TlsTransportStatus_t xConfigureCAChain( TLSContext_t * pxTLSCtx,
         xStatus = TLS_TRANSPORT_NO_VALID_CA_CERT;
     }
 
+    if( xStatus == TLS_TRANSPORT_SUCCESS )
+    {
+        /* Returns the existing chain if the set was just cached by another context */
+        if( uxNumToRead > 0 )
+        {
+            pxRootCaChain = pxCertCacheInsert( ulKey, ulGeneration, pxRootCaChain );
+        }
+
+        pxTLSCtx->pxRootCaChain = pxRootCaChain;
+    }
+    else
+    {
+        vFreeCertChain( pxRootCaChain );
+    }
+
     return xStatus;
 }
 
+/*-----------------------------------------------------------*/
+
+/* Forward secret AEAD suites, unsupported entries are skipped by mbedtls */
+static const int lCiphersuitesAesFirst[] =
+{
+#if defined( MBEDTLS_SSL_PROTO_TLS1_3 ) || defined( MBEDTLS_SSL_PROTO_TLS1_3_EXPERIMENTAL )
+    MBEDTLS_TLS1_3_AES_128_GCM_SHA256,
+    MBEDTLS_TLS1_3_AES_256_GCM_SHA384,
+    MBEDTLS_TLS1_3_CHACHA20_POLY1305_SHA256,
+#endif
+    MBEDTLS_TLS_ECDHE_ECDSA_WITH_AES_128_GCM_SHA256,
+    MBEDTLS_TLS_ECDHE_ECDSA_WITH_AES_256_GCM_SHA384,
+    MBEDTLS_TLS_ECDHE_RSA_WITH_AES_128_GCM_SHA256,
+    MBEDTLS_TLS_ECDHE_RSA_WITH_AES_256_GCM_SHA384,
+    MBEDTLS_TLS_ECDHE_ECDSA_WITH_CHACHA20_POLY1305_SHA256,
+    MBEDTLS_TLS_ECDHE_RSA_WITH_CHACHA20_POLY1305_SHA256,
+    0
+};
+
+static const int lCiphersuitesChachaFirst[] =
+{
+#if defined( MBEDTLS_SSL_PROTO_TLS1_3 ) || defined( MBEDTLS_SSL_PROTO_TLS1_3_EXPERIMENTAL )
+    MBEDTLS_TLS1_3_CHACHA20_POLY1305_SHA256,
+    MBEDTLS_TLS1_3_AES_128_GCM_SHA256,
+    MBEDTLS_TLS1_3_AES_256_GCM_SHA384,
+#endif
+    MBEDTLS_TLS_ECDHE_ECDSA_WITH_CHACHA20_POLY1305_SHA256,
+    MBEDTLS_TLS_ECDHE_RSA_WITH_CHACHA20_POLY1305_SHA256,
+    MBEDTLS_TLS_ECDHE_ECDSA_WITH_AES_128_GCM_SHA256,
+    MBEDTLS_TLS_ECDHE_ECDSA_WITH_AES_256_GCM_SHA384,
+    MBEDTLS_TLS_ECDHE_RSA_WITH_AES_128_GCM_SHA256,
+    MBEDTLS_TLS_ECDHE_RSA_WITH_AES_256_GCM_SHA384,
+    0
+};
+
+/* Returns the cipher suite list for xCipherPref, or NULL for the mbedtls default. */
+static const int * plGetCiphersuites( TlsCipherPref_t xCipherPref )
+{
+    const int * plCiphersuites = NULL;
+
+    if( xCipherPref == TLS_CIPHER_PREF_AUTO )
+    {
+#if defined( MBEDTLS_AES_ALT ) && defined( MBEDTLS_GCM_ALT )
+        xCipherPref = TLS_CIPHER_PREF_AES_GCM;
+#else
+        xCipherPref = TLS_CIPHER_PREF_CHACHAPOLY;
+#endif
+    }
+
+    if( xCipherPref == TLS_CIPHER_PREF_AES_GCM )
+    {
+        plCiphersuites = lCiphersuitesAesFirst;
+    }
+    else if( xCipherPref == TLS_CIPHER_PREF_CHACHAPOLY )
+    {
+        plCiphersuites = lCiphersuitesChachaFirst;
+    }
+    else
+    {
+        /* Keep the list set by mbedtls_ssl_config_defaults */
+    }
+
+    return plCiphersuites;
+}
+
 /*-----------------------------------------------------------*/
 TlsTransportStatus_t mbedtls_transport_configure( NetworkContext_t * pxNetworkContext,
                                                   const char ** ppcAlpnProtos,
@@ -875,9 +2050,10 @@ TlsTransportStatus_t mbedtls_transport_configure( NetworkContext_t * pxNetworkCo
     if( pxTLSCtx->xConnectionState == STATE_ALLOCATED )
     {
 #ifdef MBEDTLS_TRANSPORT_PKCS11
-        if( xStatus == TLS_TRANSPORT_SUCCESS )
+        if( ( xStatus == TLS_TRANSPORT_SUCCESS ) &&
+            ( pxTLSCtx->xP11SessionHandle == CK_INVALID_HANDLE ) )
         {
-            if( xInitializePkcs11Session( &( pxTLSCtx->xP11SessionHandle ) ) != CKR_OK )
+            if( xPkcs11AcquireSession( &( pxTLSCtx->xP11SessionHandle ) ) != CKR_OK )
             {
                 LogError( "Failed to initialize PKCS11 session." );
 
@@ -976,13 +2152,39 @@ TlsTransportStatus_t mbedtls_transport_configure( NetworkContext_t * pxNetworkCo
         mbedtls_ssl_conf_cert_profile( pxSslConfig, &mbedtls_x509_crt_profile_default );
 
         mbedtls_ssl_conf_authmode( pxSslConfig, MBEDTLS_SSL_VERIFY_REQUIRED );
+
+#if ( TLS_SESSION_RESUMPTION == 1 ) && defined( MBEDTLS_SSL_SESSION_TICKETS )
+        mbedtls_ssl_conf_session_tickets( pxSslConfig, MBEDTLS_SSL_SESSION_TICKETS_ENABLED );
+#endif
+
+        const int * plCiphersuites = plGetCiphersuites( pxTLSCtx->xCipherPref );
+
+        if( plCiphersuites != NULL )
+        {
+            mbedtls_ssl_conf_ciphersuites( pxSslConfig, plCiphersuites );
+        }
+    }
+
+#if TLS_TRANSPORT_PROFILE == 1
+    if( xStatus == TLS_TRANSPORT_SUCCESS )
+    {
+        vProfileBegin( pxTLSCtx, TLS_PROFILE_CA_CHAIN );
     }
+#endif /* TLS_TRANSPORT_PROFILE == 1 */
 
     /* Configure certificate auth if a cert and key were provided */
     if( ( xStatus == TLS_TRANSPORT_SUCCESS ) &&
         pxPrivateKey && pxClientCert )
     {
+#if TLS_TRANSPORT_PROFILE == 1
+        uint32_t ulStart = ulProfileStart();
+#endif /* TLS_TRANSPORT_PROFILE == 1 */
+
         xStatus = xConfigureCertificateAuth( pxTLSCtx, pxPrivateKey, pxClientCert );
+
+#if TLS_TRANSPORT_PROFILE == 1
+        vProfileRecord( pxTLSCtx, TLS_PROFILE_CLIENT_CRED, ulStart );
+#endif /* TLS_TRANSPORT_PROFILE == 1 */
     }
 
     /* Configure ALPN Protocols */
@@ -1005,9 +2207,9 @@ TlsTransportStatus_t mbedtls_transport_configure( NetworkContext_t * pxNetworkCo
         /* Enable the max fragment extension. 4096 bytes is currently the largest fragment size permitted.
          * See RFC 8449 https://tools.ietf.org/html/rfc8449 for more information.
          *
-         * Smaller values can be found in "mbedtls/include/ssl.h".
+         * Smaller values can be requested with mbedtls_transport_setmaxfraglen.
          */
-        lError = mbedtls_ssl_conf_max_frag_len( pxSslConfig, MBEDTLS_SSL_MAX_FRAG_LEN_4096 );
+        lError = mbedtls_ssl_conf_max_frag_len( pxSslConfig, pxTLSCtx->ucMaxFragLen );
 
         MBEDTLS_MSG_IF_ERROR( lError, "Failed to configure maximum fragment length extension, " );
         xStatus = lMbedtlsErrToTransportError( lError );
@@ -1019,13 +2221,27 @@ TlsTransportStatus_t mbedtls_transport_configure( NetworkContext_t * pxNetworkCo
     {
         if( pxTLSCtx->xConnectionState == STATE_CONFIGURED )
         {
-            mbedtls_x509_crt_free( &( pxTLSCtx->xRootCaChain ) );
-            mbedtls_x509_crt_init( &( pxTLSCtx->xRootCaChain ) );
+#if TLS_SESSION_RESUMPTION == 1
+            /* Credentials may have changed, do not resume the old session */
+            vInvalidateSession( pxTLSCtx );
+#endif /* TLS_SESSION_RESUMPTION == 1 */
+
+#if TLS_SESSION_WARM == 1
+            vWarmStateClear( WARM_STATE_TLS_SESSION );
+#endif /* TLS_SESSION_WARM == 1 */
         }
 
+#if TLS_TRANSPORT_PROFILE == 1
+        uint32_t ulStart = ulProfileStart();
+#endif /* TLS_TRANSPORT_PROFILE == 1 */
+
         xStatus = xConfigureCAChain( pxTLSCtx, pxRootCaCerts, uxNumRootCA );
 
-        mbedtls_ssl_conf_ca_chain( pxSslConfig, &( pxTLSCtx->xRootCaChain ), NULL );
+#if TLS_TRANSPORT_PROFILE == 1
+        vProfileRecord( pxTLSCtx, TLS_PROFILE_CA_CHAIN, ulStart );
+#endif /* TLS_TRANSPORT_PROFILE == 1 */
+
+        mbedtls_ssl_conf_ca_chain( pxSslConfig, pxTLSCtx->pxRootCaChain, NULL );
     }
 
     /* Initialize SSL context */
@@ -1052,7 +2268,7 @@ TlsTransportStatus_t mbedtls_transport_configure( NetworkContext_t * pxNetworkCo
         else
         {
             /* Setup mbedtls IO callbacks */
-            mbedtls_ssl_set_bio( pxSslCtx, &( pxTLSCtx->xSockHandle ),
+            mbedtls_ssl_set_bio( pxSslCtx, pxTLSCtx,
                                  mbedtls_ssl_send, mbedtls_ssl_recv, NULL );
 
             pxTLSCtx->xConnectionState = STATE_CONFIGURED;
@@ -1075,14 +2291,68 @@ static TlsTransportStatus_t xConnectSocket( TLSContext_t * pxTLSCtx,
     configASSERT( usPort > 0 );
 
     /* Close socket if already allocated */
-    if( pxTLSCtx->xSockHandle >= 0 )
+    vCloseSocket( pxTLSCtx );
+
+#if LWIP_IPV4 == 1
+    /* Try the cached address first to avoid a DNS round trip on reconnect */
     {
-        ( void ) sock_close( pxTLSCtx->xSockHandle );
-        pxTLSCtx->xSockHandle = -1;
+        ip_addr_t xCachedAddr = { 0 };
+        BaseType_t xCacheHit = pdFALSE;
+
+#if TLS_TRANSPORT_PROFILE == 1
+        uint32_t ulStart = ulProfileStart();
+#endif /* TLS_TRANSPORT_PROFILE == 1 */
+
+        xCacheHit = xDnsCacheLookup( pcHostName, &xCachedAddr );
+
+#if TLS_TRANSPORT_PROFILE == 1
+        vProfileRecord( pxTLSCtx, TLS_PROFILE_DNS, ulStart );
+#endif /* TLS_TRANSPORT_PROFILE == 1 */
+
+        if( xCacheHit == pdTRUE )
+        {
+            struct sockaddr_in xSockAddr = { 0 };
+            char ipAddrBuff[ IP4ADDR_STRLEN_MAX ] = { 0 };
+
+            xSockAddr.sin_len = sizeof( struct sockaddr_in );
+            xSockAddr.sin_family = AF_INET;
+            xSockAddr.sin_port = htons( usPort );
+            inet_addr_from_ip4addr( &( xSockAddr.sin_addr ), ip_2_ip4( &xCachedAddr ) );
+
+            ( void ) inet_ntoa_r( xSockAddr.sin_addr, ipAddrBuff, IP4ADDR_STRLEN_MAX );
+            LogInfo( "Trying cached address: %.*s, port: %uh for host: %s.",
+                     IP4ADDR_STRLEN_MAX, ipAddrBuff, usPort, pcHostName );
+
+            pxTLSCtx->xSockHandle = sock_socket( AF_INET, SOCK_STREAM, IPPROTO_TCP );
+
+            if( pxTLSCtx->xSockHandle < 0 )
+            {
+                LogError( "Failed to allocate socket." );
+                xStatus = TLS_TRANSPORT_INSUFFICIENT_SOCKETS;
+            }
+            else if( sock_connect( pxTLSCtx->xSockHandle,
+                                   ( struct sockaddr * ) &xSockAddr,
+                                   sizeof( struct sockaddr_in ) ) != 0 )
+            {
+                LogWarn( "Failed to connect to cached address, falling back to DNS lookup." );
+                ( void ) sock_close( pxTLSCtx->xSockHandle );
+                pxTLSCtx->xSockHandle = -1;
+                vDnsCacheInvalidate( pcHostName );
+            }
+            else
+            {
+                LogInfo( "Connected socket: %ld to host: %s, address: %.*s, port: %uh.",
+                         pxTLSCtx->xSockHandle, pcHostName,
+                         IP4ADDR_STRLEN_MAX, ipAddrBuff, usPort );
+                vDnsCacheUpdate( pcHostName, &xCachedAddr );
+            }
+        }
     }
+#endif /* LWIP_IPV4 == 1 */
 
-    /* Perform address (DNS) lookup */
-    if( xStatus == TLS_TRANSPORT_SUCCESS )
+    /* Perform address (DNS) lookup unless already connected to a cached address */
+    if( ( xStatus == TLS_TRANSPORT_SUCCESS ) &&
+        ( pxTLSCtx->xSockHandle < 0 ) )
     {
         const struct addrinfo xAddrInfoHint =
         {
@@ -1091,9 +2361,17 @@ static TlsTransportStatus_t xConnectSocket( TLSContext_t * pxTLSCtx,
             .ai_protocol = IPPROTO_TCP,
         };
 
+#if TLS_TRANSPORT_PROFILE == 1
+        uint32_t ulStart = ulProfileStart();
+#endif /* TLS_TRANSPORT_PROFILE == 1 */
+
         lError = dns_getaddrinfo( pcHostName, NULL,
                                   &xAddrInfoHint, &pxAddrInfo );
 
+#if TLS_TRANSPORT_PROFILE == 1
+        vProfileRecord( pxTLSCtx, TLS_PROFILE_DNS, ulStart );
+#endif /* TLS_TRANSPORT_PROFILE == 1 */
+
         if( ( lError != 0 ) || ( pxAddrInfo == NULL ) )
         {
             LogError( "Failed to resolve hostname: %s to IP address.", pcHostName );
@@ -1107,7 +2385,15 @@ static TlsTransportStatus_t xConnectSocket( TLSContext_t * pxTLSCtx,
         }
     }
 
-    if( xStatus == TLS_TRANSPORT_SUCCESS )
+    /* A cached address is only known to be good once the socket is connected to it */
+    if( ( xStatus == TLS_TRANSPORT_SUCCESS ) &&
+        ( ( pxTLSCtx->xSockHandle >= 0 ) || ( pxAddrInfo != NULL ) ) )
+    {
+        vBootTimeMark( BOOT_STAGE_DNS );
+    }
+
+    if( ( xStatus == TLS_TRANSPORT_SUCCESS ) &&
+        ( pxAddrInfo != NULL ) )
     {
         struct addrinfo * pxAddrIter = NULL;
 
@@ -1185,6 +2471,15 @@ static TlsTransportStatus_t xConnectSocket( TLSContext_t * pxTLSCtx,
                         LogInfo( "Connected socket: %ld to host: %s, address: %.*s, port: %uh.",
                                  pxTLSCtx->xSockHandle, pcHostName,
                                  IP4ADDR_STRLEN_MAX, ipAddrBuff, usPort );
+
+                        {
+                            ip_addr_t xConnectedAddr = { 0 };
+
+                            inet_addr_to_ip4addr( ip_2_ip4( &xConnectedAddr ),
+                                                  &( ( ( struct sockaddr_in * ) pxAddrIter->ai_addr )->sin_addr ) );
+                            IP_SET_TYPE_VAL( xConnectedAddr, IPADDR_TYPE_V4 );
+                            vDnsCacheUpdate( pcHostName, &xConnectedAddr );
+                        }
                     }
 #endif /* if LWIP_IPV4 == 1 */
 #if LWIP_IPV6 == 1
@@ -1209,21 +2504,284 @@ static TlsTransportStatus_t xConnectSocket( TLSContext_t * pxTLSCtx,
         }
     }
 
-    if( pxAddrInfo != NULL )
+    if( pxAddrInfo != NULL )
+    {
+        dns_freeaddrinfo( pxAddrInfo );
+        pxAddrInfo = NULL;
+    }
+
+    if( ( xStatus == TLS_TRANSPORT_SUCCESS ) &&
+        ( pxTLSCtx->xSockHandle < 0 ) )
+    {
+        xStatus = TLS_TRANSPORT_CONNECT_FAILURE;
+    }
+
+    return xStatus;
+}
+
+/*-----------------------------------------------------------*/
+
+#if TLS_SESSION_RESUMPTION == 1
+
+/* FNV-1a hash of the host name and port, used to match sessions to endpoints */
+static uint32_t ulGetSessionId( const char * pcHostName,
+                                uint16_t usPort )
+{
+    uint32_t ulHash = 0x811C9DC5;
+
+    for( const char * pcIter = pcHostName; *pcIter != '\0'; pcIter++ )
+    {
+        ulHash = ( ulHash ^ ( uint8_t ) *pcIter ) * 0x01000193;
+    }
+
+    ulHash = ( ulHash ^ ( usPort & 0xFF ) ) * 0x01000193;
+    ulHash = ( ulHash ^ ( usPort >> 8 ) ) * 0x01000193;
+
+    /* 0 marks an empty session */
+    return( ( ulHash == 0 ) ? 1 : ulHash );
+}
+
+/*-----------------------------------------------------------*/
+
+static void vInvalidateSession( TLSContext_t * pxTLSCtx )
+{
+    mbedtls_ssl_session_free( &( pxTLSCtx->xSession ) );
+    mbedtls_ssl_session_init( &( pxTLSCtx->xSession ) );
+    pxTLSCtx->ulSessionId = 0;
+    pxTLSCtx->xSessionAgeUnknown = pdFALSE;
+}
+
+/*-----------------------------------------------------------*/
+
+#if ( TLS_SESSION_PERSIST == 1 ) || ( TLS_SESSION_WARM == 1 )
+
+static BaseType_t xParseSessionRecord( TLSContext_t * pxTLSCtx,
+                                       const uint8_t * pucRecord,
+                                       size_t uxRecordLen )
+{
+    BaseType_t xParsed = pdFALSE;
+
+    if( uxRecordLen > sizeof( TlsSessionRecordHeader_t ) )
+    {
+        TlsSessionRecordHeader_t xHeader = { 0 };
+
+        ( void ) memcpy( &xHeader, pucRecord, sizeof( TlsSessionRecordHeader_t ) );
+
+        if( ( xHeader.ulMagic == TLS_SESSION_RECORD_MAGIC ) &&
+            ( xHeader.ulSessionId != 0 ) &&
+            ( mbedtls_ssl_session_load( &( pxTLSCtx->xSession ),
+                                        &( pucRecord[ sizeof( TlsSessionRecordHeader_t ) ] ),
+                                        uxRecordLen - sizeof( TlsSessionRecordHeader_t ) ) == 0 ) )
+        {
+            pxTLSCtx->ulSessionId = xHeader.ulSessionId;
+            pxTLSCtx->xSessionTick = xTaskGetTickCount();
+
+            /* There is no wall clock, so the age of a stored session is unknown */
+            pxTLSCtx->xSessionAgeUnknown = pdTRUE;
+            xParsed = pdTRUE;
+        }
+        else
+        {
+            vInvalidateSession( pxTLSCtx );
+        }
+    }
+
+    return xParsed;
+}
+
+/*-----------------------------------------------------------*/
+
+static void vLoadSession( TLSContext_t * pxTLSCtx )
+{
+    BaseType_t xLoaded = pdFALSE;
+
+#if TLS_SESSION_WARM == 1
+    {
+        size_t uxRecordLen = 0;
+        const uint8_t * pucRecord = ( const uint8_t * ) pvWarmStateGet( WARM_STATE_TLS_SESSION, &uxRecordLen );
+
+        if( ( pucRecord != NULL ) &&
+            ( xParseSessionRecord( pxTLSCtx, pucRecord, uxRecordLen ) == pdTRUE ) )
+        {
+            LogDebug( "Loaded TLS session kept across the reset." );
+            xLoaded = pdTRUE;
+        }
+    }
+#endif /* TLS_SESSION_WARM == 1 */
+
+#if TLS_SESSION_PERSIST == 1
+    if( xLoaded == pdFALSE )
+    {
+        size_t uxRecordLen = 0;
+        uint8_t * pucRecord = ( uint8_t * ) KVStore_getBlobHeap( CS_TLS_SESSION, &uxRecordLen );
+
+        if( ( pucRecord != NULL ) &&
+            ( xParseSessionRecord( pxTLSCtx, pucRecord, uxRecordLen ) == pdTRUE ) )
+        {
+            LogDebug( "Loaded stored TLS session." );
+        }
+
+        if( pucRecord != NULL )
+        {
+            mbedtls_platform_zeroize( pucRecord, uxRecordLen );
+            vPortFree( pucRecord );
+        }
+    }
+#else
+    ( void ) xLoaded;
+#endif /* TLS_SESSION_PERSIST == 1 */
+}
+
+/*-----------------------------------------------------------*/
+
+static void vSaveSession( TLSContext_t * pxTLSCtx )
+{
+    size_t uxSessionLen = 0;
+    uint8_t * pucRecord = NULL;
+    int lError = 0;
+
+    /* Query the serialized length */
+    lError = mbedtls_ssl_session_save( &( pxTLSCtx->xSession ), NULL, 0, &uxSessionLen );
+
+    if( ( lError == MBEDTLS_ERR_SSL_BUFFER_TOO_SMALL ) &&
+        ( uxSessionLen > 0 ) )
+    {
+        pucRecord = ( uint8_t * ) pvPortMalloc( sizeof( TlsSessionRecordHeader_t ) + uxSessionLen );
+    }
+
+    if( pucRecord != NULL )
+    {
+        TlsSessionRecordHeader_t xHeader =
+        {
+            .ulMagic     = TLS_SESSION_RECORD_MAGIC,
+            .ulSessionId = pxTLSCtx->ulSessionId,
+        };
+
+        ( void ) memcpy( pucRecord, &xHeader, sizeof( TlsSessionRecordHeader_t ) );
+
+        lError = mbedtls_ssl_session_save( &( pxTLSCtx->xSession ),
+                                           &( pucRecord[ sizeof( TlsSessionRecordHeader_t ) ] ),
+                                           uxSessionLen, &uxSessionLen );
+
+#if TLS_SESSION_WARM == 1
+        if( ( lError != 0 ) ||
+            ( xWarmStateSet( WARM_STATE_TLS_SESSION, pucRecord, sizeof( TlsSessionRecordHeader_t ) + uxSessionLen ) != pdTRUE ) )
+        {
+            LogDebug( "TLS session does not fit in WARM_STATE_TLS_SESSION_LEN." );
+            vWarmStateClear( WARM_STATE_TLS_SESSION );
+        }
+#endif /* TLS_SESSION_WARM == 1 */
+
+#if TLS_SESSION_PERSIST == 1
+        if( ( lError != 0 ) ||
+            ( KVStore_setBlob( CS_TLS_SESSION, sizeof( TlsSessionRecordHeader_t ) + uxSessionLen, pucRecord ) != pdTRUE ) ||
+            ( KVStore_xCommitChanges() != pdTRUE ) )
+        {
+            LogWarn( "Failed to store TLS session." );
+        }
+#endif /* TLS_SESSION_PERSIST == 1 */
+
+        mbedtls_platform_zeroize( pucRecord, sizeof( TlsSessionRecordHeader_t ) + uxSessionLen );
+        vPortFree( pucRecord );
+    }
+    else
+    {
+        LogWarn( "Failed to serialize TLS session." );
+
+#if TLS_SESSION_WARM == 1
+        vWarmStateClear( WARM_STATE_TLS_SESSION );
+#endif /* TLS_SESSION_WARM == 1 */
+    }
+}
+
+#endif /* ( TLS_SESSION_PERSIST == 1 ) || ( TLS_SESSION_WARM == 1 ) */
+
+/*-----------------------------------------------------------*/
+
+/* Offer the saved session to the server, if it matches the endpoint and is recent enough */
+static void vOfferSession( TLSContext_t * pxTLSCtx,
+                           uint32_t ulSessionId )
+{
+    pxTLSCtx->xSessionOffered = pdFALSE;
+
+#if ( TLS_SESSION_PERSIST == 1 ) || ( TLS_SESSION_WARM == 1 )
+    if( pxTLSCtx->xSessionLoaded == pdFALSE )
+    {
+        pxTLSCtx->xSessionLoaded = pdTRUE;
+
+        if( pxTLSCtx->ulSessionId == 0 )
+        {
+            vLoadSession( pxTLSCtx );
+        }
+    }
+#endif /* ( TLS_SESSION_PERSIST == 1 ) || ( TLS_SESSION_WARM == 1 ) */
+
+    if( pxTLSCtx->ulSessionId == 0 )
+    {
+        /* No saved session */
+    }
+    else if( pxTLSCtx->ulSessionId != ulSessionId )
+    {
+        LogDebug( "Saved TLS session belongs to a different endpoint." );
+        vInvalidateSession( pxTLSCtx );
+    }
+    else if( ( pxTLSCtx->xSessionAgeUnknown == pdFALSE ) &&
+             ( ( xTaskGetTickCount() - pxTLSCtx->xSessionTick ) >= ( TLS_SESSION_MAX_AGE_S * configTICK_RATE_HZ ) ) )
+    {
+        LogDebug( "Saved TLS session expired." );
+        vInvalidateSession( pxTLSCtx );
+    }
+    else
+    {
+        int lError = mbedtls_ssl_set_session( &( pxTLSCtx->xSslCtx ), &( pxTLSCtx->xSession ) );
+
+        if( lError == 0 )
+        {
+            pxTLSCtx->xSessionOffered = pdTRUE;
+            LogDebug( "Offering saved TLS session." );
+        }
+        else
+        {
+            LogWarn( "Failed to set saved TLS session: Error: %s : %s.",
+                     mbedtlsHighLevelCodeOrDefault( lError ),
+                     mbedtlsLowLevelCodeOrDefault( lError ) );
+            vInvalidateSession( pxTLSCtx );
+        }
+    }
+}
+
+/*-----------------------------------------------------------*/
+
+/* Keep the session of the connection that was just established */
+static void vKeepSession( TLSContext_t * pxTLSCtx,
+                          uint32_t ulSessionId )
+{
+    int lError = 0;
+
+    vInvalidateSession( pxTLSCtx );
+
+    lError = mbedtls_ssl_get_session( &( pxTLSCtx->xSslCtx ), &( pxTLSCtx->xSession ) );
+
+    if( lError == 0 )
     {
-        dns_freeaddrinfo( pxAddrInfo );
-        pxAddrInfo = NULL;
-    }
+        pxTLSCtx->ulSessionId = ulSessionId;
+        pxTLSCtx->xSessionTick = xTaskGetTickCount();
 
-    if( ( xStatus == TLS_TRANSPORT_SUCCESS ) &&
-        ( pxTLSCtx->xSockHandle < 0 ) )
+#if ( TLS_SESSION_PERSIST == 1 ) || ( TLS_SESSION_WARM == 1 )
+        vSaveSession( pxTLSCtx );
+#endif /* ( TLS_SESSION_PERSIST == 1 ) || ( TLS_SESSION_WARM == 1 ) */
+    }
+    else
     {
-        xStatus = TLS_TRANSPORT_CONNECT_FAILURE;
+        LogWarn( "Failed to save TLS session: Error: %s : %s.",
+                 mbedtlsHighLevelCodeOrDefault( lError ),
+                 mbedtlsLowLevelCodeOrDefault( lError ) );
+        vInvalidateSession( pxTLSCtx );
     }
-
-    return xStatus;
 }
 
+#endif /* TLS_SESSION_RESUMPTION == 1 */
+
 /*-----------------------------------------------------------*/
 
 TlsTransportStatus_t mbedtls_transport_connect( NetworkContext_t * pxNetworkContext,
@@ -1263,6 +2821,9 @@ TlsTransportStatus_t mbedtls_transport_connect( NetworkContext_t * pxNetworkCont
     else
     {
         pxSslCtx = &( pxTLSCtx->xSslCtx );
+
+        /* Bounds the wait for send buffer space in mbedtls_ssl_send */
+        pxTLSCtx->ulSendTimeoutMs = ulSendTimeoutMs;
     }
 
     /* Set hostname for SNI and server certificate verification */
@@ -1283,7 +2844,20 @@ TlsTransportStatus_t mbedtls_transport_connect( NetworkContext_t * pxNetworkCont
 
     if( xStatus == TLS_TRANSPORT_SUCCESS )
     {
+#if TLS_TRANSPORT_PROFILE == 1
+        uint32_t ulStart = 0;
+
+        vProfileBegin( pxTLSCtx, TLS_PROFILE_DNS );
+        ulStart = ulProfileStart();
+#endif /* TLS_TRANSPORT_PROFILE == 1 */
+
         xStatus = xConnectSocket( pxTLSCtx, pcHostName, usPort );
+
+#if TLS_TRANSPORT_PROFILE == 1
+        /* xConnectSocket records the lookup time itself, the rest is spent connecting */
+        vProfileRecord( pxTLSCtx, TLS_PROFILE_TCP_CONNECT, ulStart );
+        pxTLSCtx->xProfile.ulCycles[ TLS_PROFILE_TCP_CONNECT ] -= pxTLSCtx->xProfile.ulCycles[ TLS_PROFILE_DNS ];
+#endif /* TLS_TRANSPORT_PROFILE == 1 */
     }
 
     /* Set send and receive timeout parameters */
@@ -1317,6 +2891,31 @@ TlsTransportStatus_t mbedtls_transport_connect( NetworkContext_t * pxNetworkCont
         }
     }
 
+    /* Detect a dead peer on an idle connection */
+    if( ( xStatus == TLS_TRANSPORT_SUCCESS ) &&
+        ( pxTLSCtx->ulKeepIdleS > 0 ) )
+    {
+        int lKeepAlive = 1;
+        int lKeepIdle = ( int ) pxTLSCtx->ulKeepIdleS;
+        int lKeepInterval = ( int ) pxTLSCtx->ulKeepIntervalS;
+        int lKeepCount = ( int ) pxTLSCtx->ulKeepCount;
+
+        lError = sock_setsockopt( pxTLSCtx->xSockHandle, SOL_SOCKET, SO_KEEPALIVE,
+                                  &lKeepAlive, sizeof( lKeepAlive ) );
+        lError |= sock_setsockopt( pxTLSCtx->xSockHandle, IPPROTO_TCP, TCP_KEEPIDLE,
+                                   &lKeepIdle, sizeof( lKeepIdle ) );
+        lError |= sock_setsockopt( pxTLSCtx->xSockHandle, IPPROTO_TCP, TCP_KEEPINTVL,
+                                   &lKeepInterval, sizeof( lKeepInterval ) );
+        lError |= sock_setsockopt( pxTLSCtx->xSockHandle, IPPROTO_TCP, TCP_KEEPCNT,
+                                   &lKeepCount, sizeof( lKeepCount ) );
+
+        if( lError != SOCK_OK )
+        {
+            LogError( "Failed to set TCP keepalive socket options." );
+            xStatus = TLS_TRANSPORT_INVALID_PARAMETER;
+        }
+    }
+
     if( ( xStatus == TLS_TRANSPORT_SUCCESS ) &&
         ( ulRecvTimeoutMs == 0 ) )
     {
@@ -1339,16 +2938,62 @@ TlsTransportStatus_t mbedtls_transport_connect( NetworkContext_t * pxNetworkCont
         }
     }
 
+#if TLS_SESSION_RESUMPTION == 1
+    if( xStatus == TLS_TRANSPORT_SUCCESS )
+    {
+        vOfferSession( pxTLSCtx, ulGetSessionId( pcHostName, usPort ) );
+    }
+#endif /* TLS_SESSION_RESUMPTION == 1 */
+
     /* Perform TLS handshake. */
     if( xStatus == TLS_TRANSPORT_SUCCESS )
     {
+        MbedtlsArena_t * pxPrevArena = NULL;
+
+        if( ( pxTLSCtx->pxArena == NULL ) &&
+            ( pxTLSCtx->uxArenaLen > 0 ) )
+        {
+            pxTLSCtx->pxArena = pxMbedtlsArenaCreate( pxTLSCtx->uxArenaLen );
+
+            if( pxTLSCtx->pxArena == NULL )
+            {
+                LogWarn( "Failed to create a %lu byte arena, allocating from the heap.",
+                         pxTLSCtx->uxArenaLen );
+            }
+        }
+
+        /* Only the handshake allocates from the arena, so long lived objects
+         * such as the shared certificate chains stay on the heap. */
+        pxPrevArena = pxMbedtlsArenaSelect( pxTLSCtx->pxArena );
+
+        /* The public key operations of the handshake run at full speed */
+        vDvfsRequest( DVFS_CLIENT_TLS );
+
         /* Perform the TLS handshake. */
+#if TLS_TRANSPORT_PROFILE == 1
+        lError = lProfiledHandshake( pxTLSCtx );
+#else
         do
         {
             lError = mbedtls_ssl_handshake( pxSslCtx );
         }
         while( ( lError == MBEDTLS_ERR_SSL_WANT_READ ) ||
                ( lError == MBEDTLS_ERR_SSL_WANT_WRITE ) );
+#endif /* TLS_TRANSPORT_PROFILE == 1 */
+
+        vDvfsRelease( DVFS_CLIENT_TLS );
+
+        ( void ) pxMbedtlsArenaSelect( pxPrevArena );
+
+        if( pxTLSCtx->pxArena != NULL )
+        {
+            MbedtlsArenaStats_t xStats = { 0 };
+
+            vMbedtlsArenaGetStats( pxTLSCtx->pxArena, &xStats );
+
+            LogDebug( "Network connection %p: Arena high water: %lu / %lu, fallbacks: %lu.",
+                      pxTLSCtx, xStats.uxBumpHighWater, xStats.uxLen, xStats.ulFallbacks );
+        }
 
         if( lError != 0 )
         {
@@ -1357,11 +3002,41 @@ TlsTransportStatus_t mbedtls_transport_connect( NetworkContext_t * pxNetworkCont
                       mbedtlsLowLevelCodeOrDefault( lError ) );
 
             xStatus = TLS_TRANSPORT_HANDSHAKE_FAILED;
+
+#ifdef MBEDTLS_SSL_MAX_FRAGMENT_LENGTH
+            /*
+             * Some servers abort the handshake instead of ignoring the max fragment
+             * length extension. Fall back to full size records on the next attempt.
+             */
+            if( ( lError != MBEDTLS_ERR_X509_CERT_VERIFY_FAILED ) &&
+                ( pxTLSCtx->xSslConfig.MBEDTLS_PRIVATE( mfl_code ) != MBEDTLS_SSL_MAX_FRAG_LEN_NONE ) )
+            {
+                LogWarn( "Disabling the max fragment length extension for the next attempt." );
+                ( void ) mbedtls_ssl_conf_max_frag_len( &( pxTLSCtx->xSslConfig ), MBEDTLS_SSL_MAX_FRAG_LEN_NONE );
+            }
+#endif /* MBEDTLS_SSL_MAX_FRAGMENT_LENGTH */
+
+#if TLS_SESSION_RESUMPTION == 1
+            /* Fall back to a full handshake on the next attempt */
+            if( pxTLSCtx->xSessionOffered == pdTRUE )
+            {
+                vInvalidateSession( pxTLSCtx );
+            }
+#endif /* TLS_SESSION_RESUMPTION == 1 */
         }
         else
         {
             LogInfo( "Network connection %p: TLS handshake successful.",
                      pxTLSCtx );
+
+            LogInfo( "Network connection %p: Max record payload in: %d, out: %d.",
+                     pxTLSCtx,
+                     mbedtls_ssl_get_max_in_record_payload( pxSslCtx ),
+                     mbedtls_ssl_get_max_out_record_payload( pxSslCtx ) );
+
+#if TLS_SESSION_RESUMPTION == 1
+            vKeepSession( pxTLSCtx, ulGetSessionId( pcHostName, usPort ) );
+#endif /* TLS_SESSION_RESUMPTION == 1 */
         }
     }
 
@@ -1370,23 +3045,17 @@ TlsTransportStatus_t mbedtls_transport_connect( NetworkContext_t * pxNetworkCont
         LogInfo( "Network connection %p: Connection to %s:%u established.",
                  pxNetworkContext, pcHostName, usPort );
 
-        if( ( xStatus == TLS_TRANSPORT_SUCCESS ) &&
-            pxTLSCtx->pxNotifyThreadCtx )
-        {
-            vCreateSocketNotifyTask( pxTLSCtx->pxNotifyThreadCtx, pxTLSCtx->xSockHandle );
-        }
-
         pxTLSCtx->xConnectionState = STATE_CONNECTED;
+
+        vHookRecvReady( pxTLSCtx );
     }
     else
     {
         /* Clean up on failure. */
-        if( ( pxNetworkContext != NULL ) &&
-            ( pxTLSCtx->xSockHandle >= 0 ) )
+        if( pxNetworkContext != NULL )
         {
             /* Deallocate the open socket. */
-            sock_close( pxTLSCtx->xSockHandle );
-            pxTLSCtx->xSockHandle = -1;
+            vCloseSocket( pxTLSCtx );
         }
 
         /* Reset SSL session context for reconnect attempt */
@@ -1397,117 +3066,203 @@ TlsTransportStatus_t mbedtls_transport_connect( NetworkContext_t * pxNetworkCont
                  pcHostName, usPort );
     }
 
+#if TLS_TRANSPORT_PROFILE == 1
+    if( pxTLSCtx != NULL )
+    {
+        vProfilePublish( pxTLSCtx, ( xStatus == TLS_TRANSPORT_SUCCESS ) ? pdTRUE : pdFALSE );
+    }
+#endif /* TLS_TRANSPORT_PROFILE == 1 */
+
     return xStatus;
 }
 
 /*-----------------------------------------------------------*/
 
-static inline void vStopSocketNotifyTask( NotifyThreadCtx_t * pxNotifyThreadCtx )
+TlsTransportStatus_t mbedtls_transport_setmaxfraglen( NetworkContext_t * pxNetworkContext,
+                                                     uint8_t ucMaxFragLen )
 {
-    configASSERT( pxNotifyThreadCtx );
+    TLSContext_t * pxTLSCtx = ( TLSContext_t * ) pxNetworkContext;
+    TlsTransportStatus_t xStatus = TLS_TRANSPORT_SUCCESS;
 
-    while( ( pxNotifyThreadCtx->xTaskHandle != NULL ) &&
-           ( eTaskGetState( pxNotifyThreadCtx->xTaskHandle ) != eDeleted ) )
+    if( pxTLSCtx == NULL )
+    {
+        LogError( "Provided pxNetworkContext cannot be NULL." );
+        xStatus = TLS_TRANSPORT_INVALID_PARAMETER;
+    }
+    else if( ucMaxFragLen >= MBEDTLS_SSL_MAX_FRAG_LEN_INVALID )
+    {
+        LogError( "Invalid max fragment length code: %u.", ucMaxFragLen );
+        xStatus = TLS_TRANSPORT_INVALID_PARAMETER;
+    }
+    else
     {
-        ( void ) xTaskNotify( pxNotifyThreadCtx->xTaskHandle, 0xFFFFFFFF, eSetValueWithOverwrite );
-        vTaskDelay( 1 );
+        /* Takes effect on the next call to mbedtls_transport_configure */
+        pxTLSCtx->ucMaxFragLen = ucMaxFragLen;
     }
+
+    return xStatus;
 }
 
 /*-----------------------------------------------------------*/
 
-static void vCreateSocketNotifyTask( NotifyThreadCtx_t * pxNotifyThreadCtx,
-                                     SockHandle_t xSockHandle )
+TlsTransportStatus_t mbedtls_transport_setcipherpref( NetworkContext_t * pxNetworkContext,
+                                                     TlsCipherPref_t xCipherPref )
 {
-    TaskHandle_t xTaskHandle = NULL;
+    TLSContext_t * pxTLSCtx = ( TLSContext_t * ) pxNetworkContext;
+    TlsTransportStatus_t xStatus = TLS_TRANSPORT_SUCCESS;
 
-    configASSERT_CONTINUE( pxNotifyThreadCtx );
+    if( pxTLSCtx == NULL )
+    {
+        LogError( "Provided pxNetworkContext cannot be NULL." );
+        xStatus = TLS_TRANSPORT_INVALID_PARAMETER;
+    }
+    else if( ( xCipherPref < TLS_CIPHER_PREF_AUTO ) ||
+             ( xCipherPref >= TLS_CIPHER_PREF_INVALID ) )
+    {
+        LogError( "Invalid cipher suite preference: %d.", xCipherPref );
+        xStatus = TLS_TRANSPORT_INVALID_PARAMETER;
+    }
+    else
+    {
+        /* Takes effect on the next call to mbedtls_transport_configure */
+        pxTLSCtx->xCipherPref = xCipherPref;
+    }
 
-    vStopSocketNotifyTask( pxNotifyThreadCtx );
+    return xStatus;
+}
 
-    if( pxNotifyThreadCtx &&
-        pxNotifyThreadCtx->pxRecvReadyCallback )
-    {
-        pxNotifyThreadCtx->xSockHandle = xSockHandle;
+/*-----------------------------------------------------------*/
 
-        xTaskHandle = xTaskCreateStatic( vSocketNotifyThread,
-                                         "SockNotify",
-                                         128,
-                                         ( void * ) pxNotifyThreadCtx,
-                                         tskIDLE_PRIORITY,
-                                         pxNotifyThreadCtx->puxStackBuffer,
-                                         &( pxNotifyThreadCtx->xTaskBuffer ) );
+TlsTransportStatus_t mbedtls_transport_setarenalen( NetworkContext_t * pxNetworkContext,
+                                                    size_t uxArenaLen )
+{
+    TLSContext_t * pxTLSCtx = ( TLSContext_t * ) pxNetworkContext;
+    TlsTransportStatus_t xStatus = TLS_TRANSPORT_SUCCESS;
 
-        pxNotifyThreadCtx->xTaskHandle = xTaskHandle;
+    if( pxTLSCtx == NULL )
+    {
+        LogError( "Provided pxNetworkContext cannot be NULL." );
+        xStatus = TLS_TRANSPORT_INVALID_PARAMETER;
+    }
+    else if( pxTLSCtx->pxArena != NULL )
+    {
+        LogError( "The arena of this context was already created." );
+        xStatus = TLS_TRANSPORT_INVALID_PARAMETER;
+    }
+    else
+    {
+        /* Takes effect on the next call to mbedtls_transport_connect */
+        pxTLSCtx->uxArenaLen = uxArenaLen;
     }
+
+    return xStatus;
 }
+
 /*-----------------------------------------------------------*/
 
-static void vFreeNotifyThreadCtx( NotifyThreadCtx_t * pxNotifyThreadCtx )
+TlsTransportStatus_t mbedtls_transport_setkeepalive( NetworkContext_t * pxNetworkContext,
+                                                     uint32_t ulIdleS,
+                                                     uint32_t ulIntervalS,
+                                                     uint32_t ulCount )
 {
-    if( pxNotifyThreadCtx )
-    {
-        vStopSocketNotifyTask( pxNotifyThreadCtx );
+    TLSContext_t * pxTLSCtx = ( TLSContext_t * ) pxNetworkContext;
+    TlsTransportStatus_t xStatus = TLS_TRANSPORT_SUCCESS;
 
-        vPortFree( pxNotifyThreadCtx );
+    if( pxTLSCtx == NULL )
+    {
+        LogError( "Provided pxNetworkContext cannot be NULL." );
+        xStatus = TLS_TRANSPORT_INVALID_PARAMETER;
+    }
+    else if( ( ulIdleS > 0 ) &&
+             ( ( ulIntervalS == 0 ) || ( ulCount == 0 ) ) )
+    {
+        LogError( "Keepalive interval and count must not be 0." );
+        xStatus = TLS_TRANSPORT_INVALID_PARAMETER;
+    }
+    else
+    {
+        /* Takes effect on the next call to mbedtls_transport_connect */
+        pxTLSCtx->ulKeepIdleS = ulIdleS;
+        pxTLSCtx->ulKeepIntervalS = ulIntervalS;
+        pxTLSCtx->ulKeepCount = ulCount;
     }
+
+    return xStatus;
 }
 
 /*-----------------------------------------------------------*/
 
-int32_t mbedtls_transport_setrecvcallback( NetworkContext_t * pxNetworkContext,
-                                           GenericCallback_t pxCallback,
-                                           void * pvCtx )
+TlsTransportStatus_t mbedtls_transport_setusertimeout( NetworkContext_t * pxNetworkContext,
+                                                       uint32_t ulTimeoutMs )
 {
     TLSContext_t * pxTLSCtx = ( TLSContext_t * ) pxNetworkContext;
-    NotifyThreadCtx_t * pxNotifyThreadCtx = NULL;
-    int32_t lError = 0;
+    TlsTransportStatus_t xStatus = TLS_TRANSPORT_SUCCESS;
 
-    if( ( pxTLSCtx == NULL ) ||
-        ( pxCallback == NULL ) )
+    if( pxTLSCtx == NULL )
     {
-        lError = -1;
+        LogError( "Provided pxNetworkContext cannot be NULL." );
+        xStatus = TLS_TRANSPORT_INVALID_PARAMETER;
     }
     else
     {
-        pxNotifyThreadCtx = pxTLSCtx->pxNotifyThreadCtx;
+        pxTLSCtx->ulUserTimeoutMs = ulTimeoutMs;
+        pxTLSCtx->xUnackedPending = pdFALSE;
+    }
+
+    return xStatus;
+}
+
+/*-----------------------------------------------------------*/
+
+void mbedtls_transport_abort( NetworkContext_t * pxNetworkContext )
+{
+    TLSContext_t * pxTLSCtx = ( TLSContext_t * ) pxNetworkContext;
+    struct netconn * pxConn = NULL;
+
+    if( pxTLSCtx != NULL )
+    {
+        pxConn = pxGetConn( pxTLSCtx );
     }
 
-    if( pxNotifyThreadCtx == NULL )
+    if( pxConn != NULL )
     {
-        pxNotifyThreadCtx = pvPortMalloc( sizeof( NotifyThreadCtx_t ) );
+        LOCK_TCPIP_CORE();
 
-        if( pxNotifyThreadCtx == NULL )
+        /* The next receive or send on the connection then fails with a reset */
+        if( pxConn->pcb.tcp != NULL )
         {
-            LogError( "Failed to allocate memory for a NotifyThreadCtx_t." );
-            lError = -1;
-        }
-        else
-        {
-            pxTLSCtx->pxNotifyThreadCtx = pxNotifyThreadCtx;
-            pxNotifyThreadCtx->xSockHandle = -1;
-            pxNotifyThreadCtx->xTaskHandle = 0;
+            tcp_abort( pxConn->pcb.tcp );
         }
+
+        UNLOCK_TCPIP_CORE();
     }
-    /* Connected and pxNotifyThreadCtx already exists */
-    else if( ( pxTLSCtx->xConnectionState == STATE_CONNECTED ) &&
-             pxNotifyThreadCtx->xTaskHandle )
+}
+
+/*-----------------------------------------------------------*/
+
+int32_t mbedtls_transport_setrecvcallback( NetworkContext_t * pxNetworkContext,
+                                           GenericCallback_t pxCallback,
+                                           void * pvCtx )
+{
+    TLSContext_t * pxTLSCtx = ( TLSContext_t * ) pxNetworkContext;
+    int32_t lError = 0;
+
+    if( ( pxTLSCtx == NULL ) ||
+        ( pxCallback == NULL ) )
     {
-        vStopSocketNotifyTask( pxNotifyThreadCtx );
+        lError = -1;
     }
     else
     {
-        /* Empty */
-    }
+        /* Remove the hook while the callback is swapped */
+        vUnhookRecvReady( pxTLSCtx );
 
-    if( lError == 0 )
-    {
-        pxNotifyThreadCtx->pxRecvReadyCallback = pxCallback;
-        pxNotifyThreadCtx->pvRecvReadyCallbackCtx = pvCtx;
+        pxTLSCtx->pxRecvReadyCallback = pxCallback;
+        pxTLSCtx->pvRecvReadyCallbackCtx = pvCtx;
 
         if( pxTLSCtx->xConnectionState == STATE_CONNECTED )
         {
-            vCreateSocketNotifyTask( pxNotifyThreadCtx, pxTLSCtx->xSockHandle );
+            vHookRecvReady( pxTLSCtx );
         }
     }
 
@@ -1576,17 +3331,8 @@ void mbedtls_transport_disconnect( NetworkContext_t * pxNetworkContext )
             pxTLSCtx->xConnectionState = STATE_CONFIGURED;
         }
 
-        if( pxTLSCtx->pxNotifyThreadCtx )
-        {
-            vStopSocketNotifyTask( pxTLSCtx->pxNotifyThreadCtx );
-        }
-
-        if( pxTLSCtx->xSockHandle >= 0 )
-        {
-            /* Call socket close function to deallocate the socket. */
-            sock_close( pxTLSCtx->xSockHandle );
-            pxTLSCtx->xSockHandle = -1;
-        }
+        /* Call socket close function to deallocate the socket. */
+        vCloseSocket( pxTLSCtx );
 
         /* Clear SSL connection context for re-use */
         if( pxTLSCtx->xConnectionState == STATE_CONFIGURED )
@@ -1624,15 +3370,26 @@ int32_t mbedtls_transport_recv( NetworkContext_t * pxNetworkContext,
     {
         if( pxTLSCtx->xConnectionState == STATE_CONNECTED )
         {
+            PROF_BEGIN( xProfRecv );
             tlsStatus = ( int32_t ) mbedtls_ssl_read( &( pxTLSCtx->xSslCtx ),
                                                       pBuffer,
                                                       uxBytesToRecv );
+            PROF_END( xProfRecv );
         }
         else
         {
             tlsStatus = 0;
         }
 
+        /* Nothing received, check that the peer still acknowledges what was sent */
+        if( ( ( tlsStatus == MBEDTLS_ERR_SSL_TIMEOUT ) ||
+              ( tlsStatus == MBEDTLS_ERR_SSL_WANT_READ ) ||
+              ( tlsStatus == MBEDTLS_ERR_SSL_WANT_WRITE ) ) &&
+            ( xUserTimeoutExpired( pxTLSCtx ) == pdTRUE ) )
+        {
+            tlsStatus = MBEDTLS_ERR_NET_CONN_RESET;
+        }
+
         if( ( tlsStatus == MBEDTLS_ERR_SSL_TIMEOUT ) ||
             ( tlsStatus == MBEDTLS_ERR_SSL_WANT_READ ) ||
             ( tlsStatus == MBEDTLS_ERR_SSL_WANT_WRITE ) )
@@ -1648,16 +3405,7 @@ int32_t mbedtls_transport_recv( NetworkContext_t * pxNetworkContext,
             tlsStatus = -1;
             pxTLSCtx->xConnectionState = STATE_CONFIGURED;
 
-            if( pxTLSCtx->xSockHandle >= 0 )
-            {
-                if( pxTLSCtx->pxNotifyThreadCtx )
-                {
-                    vStopSocketNotifyTask( pxTLSCtx->pxNotifyThreadCtx );
-                }
-
-                sock_close( pxTLSCtx->xSockHandle );
-                pxTLSCtx->xSockHandle = -1;
-            }
+            vCloseSocket( pxTLSCtx );
         }
         else if( tlsStatus < 0 )
         {
@@ -1667,10 +3415,11 @@ int32_t mbedtls_transport_recv( NetworkContext_t * pxNetworkContext,
         }
         else
         {
-            if( pxTLSCtx->pxNotifyThreadCtx &&
-                pxTLSCtx->pxNotifyThreadCtx->xTaskHandle )
+            /* No further receive event will arrive for data that is already buffered */
+            if( ( pxTLSCtx->xRecvReadyHooked == pdTRUE ) &&
+                ( xRecvDataPending( pxTLSCtx ) == pdTRUE ) )
             {
-                ( void ) xTaskNotify( pxTLSCtx->pxNotifyThreadCtx->xTaskHandle, 0x0, eSetValueWithOverwrite );
+                pxTLSCtx->pxRecvReadyCallback( pxTLSCtx->pvRecvReadyCallbackCtx );
             }
         }
     }
@@ -1705,9 +3454,11 @@ int32_t mbedtls_transport_send( NetworkContext_t * pxNetworkContext,
     {
         if( pxTLSCtx->xConnectionState == STATE_CONNECTED )
         {
+            PROF_BEGIN( xProfSend );
             tlsStatus = ( int32_t ) mbedtls_ssl_write( &( pxTLSCtx->xSslCtx ),
                                                        pBuffer,
                                                        uxBytesToSend );
+            PROF_END( xProfSend );
         }
         else
         {
@@ -1729,16 +3480,7 @@ int32_t mbedtls_transport_send( NetworkContext_t * pxNetworkContext,
             tlsStatus = -1;
             pxTLSCtx->xConnectionState = STATE_CONFIGURED;
 
-            if( pxTLSCtx->xSockHandle >= 0 )
-            {
-                if( pxTLSCtx->pxNotifyThreadCtx )
-                {
-                    vStopSocketNotifyTask( pxTLSCtx->pxNotifyThreadCtx );
-                }
-
-                sock_close( pxTLSCtx->xSockHandle );
-                pxTLSCtx->xSockHandle = -1;
-            }
+            vCloseSocket( pxTLSCtx );
         }
         else if( tlsStatus < 0 )
         {
@@ -1757,6 +3499,127 @@ int32_t mbedtls_transport_send( NetworkContext_t * pxNetworkContext,
 
 /*-----------------------------------------------------------*/
 
+int32_t mbedtls_transport_writev( NetworkContext_t * pxNetworkContext,
+                                  TransportOutVector_t * pxIoVec,
+                                  size_t uxIoVecCount )
+{
+    int32_t lBytesSent = 0;
+
+#if TLS_TRANSPORT_COALESCE_LEN > 0
+    TLSContext_t * pxTLSCtx = ( TLSContext_t * ) pxNetworkContext;
+    size_t uxBufferedLen = 0;
+    BaseType_t xDone = pdFALSE;
+
+    if( ( pxTLSCtx == NULL ) ||
+        ( pxIoVec == NULL ) )
+    {
+        LogWarn( ( "mbedtls_transport_writev: Invalid parameter" ) );
+        lBytesSent = -1;
+        xDone = pdTRUE;
+    }
+
+    for( size_t uxIdx = 0; ( uxIdx <= uxIoVecCount ) && ( xDone == pdFALSE ); uxIdx++ )
+    {
+        /* An extra pass with no vector flushes what is left in the buffer */
+        const uint8_t * pucData = NULL;
+        size_t uxDataLen = 0;
+
+        if( uxIdx < uxIoVecCount )
+        {
+            pucData = ( const uint8_t * ) pxIoVec[ uxIdx ].iov_base;
+            uxDataLen = pxIoVec[ uxIdx ].iov_len;
+        }
+
+        if( ( uxIdx < uxIoVecCount ) &&
+            ( ( uxBufferedLen + uxDataLen ) <= TLS_TRANSPORT_COALESCE_LEN ) )
+        {
+            if( uxDataLen > 0 )
+            {
+                ( void ) memcpy( &( pxTLSCtx->ucCoalesceBuf[ uxBufferedLen ] ), pucData, uxDataLen );
+                uxBufferedLen += uxDataLen;
+            }
+        }
+        else
+        {
+            int32_t lRslt = 0;
+
+            /* Flush the buffer as one record */
+            if( uxBufferedLen > 0 )
+            {
+                lRslt = mbedtls_transport_send( pxNetworkContext, pxTLSCtx->ucCoalesceBuf, uxBufferedLen );
+
+                if( lRslt > 0 )
+                {
+                    lBytesSent += lRslt;
+                }
+
+                /* Let the caller retry the remainder (or report the error) */
+                if( lRslt != ( int32_t ) uxBufferedLen )
+                {
+                    xDone = pdTRUE;
+                }
+
+                uxBufferedLen = 0;
+            }
+
+            if( ( xDone == pdFALSE ) &&
+                ( uxIdx < uxIoVecCount ) )
+            {
+                if( uxDataLen <= TLS_TRANSPORT_COALESCE_LEN )
+                {
+                    ( void ) memcpy( pxTLSCtx->ucCoalesceBuf, pucData, uxDataLen );
+                    uxBufferedLen = uxDataLen;
+                }
+                else
+                {
+                    /* Too large to coalesce, send directly */
+                    lRslt = mbedtls_transport_send( pxNetworkContext, pucData, uxDataLen );
+
+                    if( lRslt > 0 )
+                    {
+                        lBytesSent += lRslt;
+                    }
+
+                    if( lRslt != ( int32_t ) uxDataLen )
+                    {
+                        xDone = pdTRUE;
+                    }
+                }
+            }
+
+            /* Report an error only if nothing was sent */
+            if( ( lRslt < 0 ) &&
+                ( lBytesSent == 0 ) )
+            {
+                lBytesSent = lRslt;
+            }
+        }
+    }
+#else /* TLS_TRANSPORT_COALESCE_LEN > 0 */
+    BaseType_t xDone = pdFALSE;
+
+    for( size_t uxIdx = 0; ( uxIdx < uxIoVecCount ) && ( xDone == pdFALSE ); uxIdx++ )
+    {
+        int32_t lRslt = mbedtls_transport_send( pxNetworkContext, pxIoVec[ uxIdx ].iov_base, pxIoVec[ uxIdx ].iov_len );
+
+        if( lRslt > 0 )
+        {
+            lBytesSent += lRslt;
+        }
+        else if( lBytesSent == 0 )
+        {
+            lBytesSent = lRslt;
+        }
+
+        xDone = ( lRslt != ( int32_t ) pxIoVec[ uxIdx ].iov_len );
+    }
+#endif /* TLS_TRANSPORT_COALESCE_LEN > 0 */
+
+    return lBytesSent;
+}
+
+/*-----------------------------------------------------------*/
+
 #ifdef MBEDTLS_DEBUG_C
 static inline const char * pcMbedtlsLevelToFrLevel( int lLevel )
 {
@@ -25,20 +25,27 @@
 
 #include "logging_levels.h"
 #define LOG_LEVEL    LOG_WARN
+#define LOG_MODULE    LOG_MODULE_NET
 
 #include "logging.h"
 
 #include "hw_defs.h"
+#include "hw_cache.h"
 #include "FreeRTOS.h"
 #include "semphr.h"
 #include "event_groups.h"
 #include "stdbool.h"
 #include "stm32u5xx_hal.h"
-#include "message_buffer.h"
 #include "atomic.h"
+#include <string.h>
 
 #include "mx_ipc.h"
 #include "mx_prv.h"
+#include "profiler.h"
+#include "low_power.h"
+#include "dvfs.h"
+#include "periph_stats.h"
+#include "ram_sections.h"
 
 #define EVT_SPI_DONE        0x8
 #define EVT_SPI_ERROR       0x10
@@ -50,6 +57,8 @@
 
 static MxDataplaneCtx_t * volatile pxSpiCtx = NULL;
 
+PROF_PROBE( xProfTransaction, "mx_spi_transaction" );
+
 uint32_t prvGetNextRequestID( void )
 {
     uint32_t ulRequestId = 0;
@@ -69,22 +78,60 @@ uint32_t prvGetNextRequestID( void )
 }
 
 
+/*
+ * @brief Start the second half of an unequal length full-duplex exchange from ISR context.
+ * @return pdTRUE if a chained transfer was started.
+ */
+static BaseType_t xStartChainedTransferFromISR( MxDataplaneCtx_t * pxCtx,
+                                                SPI_HandleTypeDef * hspi )
+{
+    HAL_StatusTypeDef xHalStatus = HAL_ERROR;
+    uint16_t usLen = pxCtx->usChainLen;
+
+    pxCtx->usChainLen = 0;
+
+    if( pxCtx->pucChainTxBuffer != NULL )
+    {
+        xHalStatus = HAL_SPI_Transmit_DMA( hspi, pxCtx->pucChainTxBuffer, usLen );
+    }
+    else if( pxCtx->pucChainRxBuffer != NULL )
+    {
+        xHalStatus = HAL_SPI_Receive_DMA( hspi, pxCtx->pucChainRxBuffer, usLen );
+    }
+
+    pxCtx->pucChainTxBuffer = NULL;
+    pxCtx->pucChainRxBuffer = NULL;
+
+    return( xHalStatus == HAL_OK );
+}
+
 /* Callback functions */
-static void spi_transfer_done_callback( SPI_HandleTypeDef * hspi )
+RAM_FUNC static void spi_transfer_done_callback( SPI_HandleTypeDef * hspi )
 {
     BaseType_t xHigherPriorityTaskWoken = pdFALSE;
     BaseType_t rslt = pdFALSE;
 
     if( pxSpiCtx != NULL )
     {
-        rslt = xTaskNotifyIndexedFromISR( pxSpiCtx->xDataPlaneTaskHandle,
-                                          SPI_EVT_DMA_IDX,
-                                          EVT_SPI_DONE,
-                                          eSetBits,
-                                          &xHigherPriorityTaskWoken );
-        configASSERT( rslt == pdTRUE );
+        uint32_t ulEvent = EVT_SPI_DONE;
 
-        portYIELD_FROM_ISR( xHigherPriorityTaskWoken );
+        if( pxSpiCtx->usChainLen > 0 )
+        {
+            /* Only wake the dataplane task once the chained transfer completes */
+            ulEvent = ( xStartChainedTransferFromISR( pxSpiCtx, hspi ) == pdTRUE ) ? 0 : EVT_SPI_ERROR;
+        }
+
+        if( ulEvent != 0 )
+        {
+            rslt = xTaskNotifyIndexedFromISR( pxSpiCtx->xDataPlaneTaskHandle,
+                                              SPI_EVT_DMA_IDX,
+                                              ulEvent,
+                                              eSetBits,
+                                              &xHigherPriorityTaskWoken );
+            configASSERT( rslt == pdTRUE );
+
+            portYIELD_FROM_ISR( xHigherPriorityTaskWoken );
+        }
     }
 }
 
@@ -94,6 +141,9 @@ static void spi_transfer_error_callback( SPI_HandleTypeDef * hspi )
 
     BaseType_t rslt = pdFALSE;
 
+    xPeriphErrStats.ulSpiErrors++;
+    xPeriphErrStats.ulSpiLastCode = hspi->ErrorCode;
+
     if( pxSpiCtx != NULL )
     {
         rslt = xTaskNotifyIndexedFromISR( pxSpiCtx->xDataPlaneTaskHandle,
@@ -108,13 +158,15 @@ static void spi_transfer_error_callback( SPI_HandleTypeDef * hspi )
 }
 
 /* Notify / IRQ pin transition means data is ready */
-static void spi_notify_callback( void * pvContext )
+RAM_FUNC static void spi_notify_callback( void * pvContext )
 {
     MxDataplaneCtx_t * pxCtx = ( MxDataplaneCtx_t * ) pvContext;
     BaseType_t xHigherPriorityTaskWoken = pdFALSE;
 
     if( pxSpiCtx != NULL )
     {
+        TRACE_MARK( TRACE_MARK_MX_NOTIFY, 0 );
+
         vTaskNotifyGiveIndexedFromISR( pxCtx->xDataPlaneTaskHandle,
                                        DATA_WAITING_IDX,
                                        &xHigherPriorityTaskWoken );
@@ -123,7 +175,7 @@ static void spi_notify_callback( void * pvContext )
     }
 }
 
-static void spi_flow_callback( void * pvContext )
+RAM_FUNC static void spi_flow_callback( void * pvContext )
 {
     MxDataplaneCtx_t * pxCtx = ( MxDataplaneCtx_t * ) pvContext;
 
@@ -202,6 +254,134 @@ static inline BaseType_t xWaitForSPIEvent( TickType_t xTimeout )
     return xReturnValue;
 }
 
+#if MX_SPI_CLOCK_RAMP == 1
+
+/* SPI2 prescaler settings the clock ramp may select, ordered from slowest to fastest */
+static const struct
+{
+    uint32_t ulPrescaler;
+    uint32_t ulDivisor;
+} xSpiClockLadder[] =
+{
+    { SPI_BAUDRATEPRESCALER_32, 32 },
+    { SPI_BAUDRATEPRESCALER_16, 16 },
+    { SPI_BAUDRATEPRESCALER_8,  8  },
+    { SPI_BAUDRATEPRESCALER_4,  4  },
+    { SPI_BAUDRATEPRESCALER_2,  2  },
+};
+
+#define SPI_CLOCK_LADDER_LEN    ( sizeof( xSpiClockLadder ) / sizeof( xSpiClockLadder[ 0 ] ) )
+
+/*
+ * @brief Apply the prescaler for the given clock ladder level.
+ * Only called between transactions, when the HAL has disabled the SPI peripheral.
+ */
+static void vSpiClockApply( MxDataplaneCtx_t * pxCtx,
+                            uint32_t ulLevel )
+{
+    SPI_HandleTypeDef * pxSpi = pxCtx->pxSpiHandle;
+
+    configASSERT( ulLevel < SPI_CLOCK_LADDER_LEN );
+    configASSERT( ( pxSpi->Instance->CR1 & SPI_CR1_SPE ) == 0 );
+
+    pxSpi->Init.BaudRatePrescaler = xSpiClockLadder[ ulLevel ].ulPrescaler;
+    MODIFY_REG( pxSpi->Instance->CFG1, SPI_CFG1_MBR, xSpiClockLadder[ ulLevel ].ulPrescaler );
+
+    pxCtx->xSpiClock.ulLevel = ulLevel;
+    pxCtx->xSpiClock.ulNextLevel = ulLevel;
+    pxCtx->xSpiClock.ulGoodHeaders = 0;
+    pxCtx->xSpiClock.ulRecentErrors = 0;
+    pxCtx->xStats.ulSpiClockDivisor = xSpiClockLadder[ ulLevel ].ulDivisor;
+    pxCtx->xStats.ulSpiClockChanges++;
+
+    LogInfo( "SPI clock set to PCLK / %lu", xSpiClockLadder[ ulLevel ].ulDivisor );
+}
+
+/*
+ * @brief Start probing from the statically configured prescaler after a module reset.
+ */
+static void vSpiClockInit( MxDataplaneCtx_t * pxCtx )
+{
+    uint32_t ulLevel = 0;
+
+    for( uint32_t i = 0; i < SPI_CLOCK_LADDER_LEN; i++ )
+    {
+        if( xSpiClockLadder[ i ].ulPrescaler == pxCtx->pxSpiHandle->Init.BaudRatePrescaler )
+        {
+            ulLevel = i;
+        }
+
+        if( xSpiClockLadder[ i ].ulPrescaler == MX_SPI_CLOCK_RAMP_MIN_PRESCALER )
+        {
+            pxCtx->xSpiClock.ulCeiling = i;
+        }
+    }
+
+    pxCtx->xSpiClock.xLastErrorTick = xTaskGetTickCount();
+
+    vSpiClockApply( pxCtx, ulLevel );
+}
+
+/*
+ * @brief Step the SPI clock up after a run of valid headers, or down after a burst of errors.
+ * A level which produced an error burst becomes the new ceiling so that it is not probed again.
+ */
+static void vSpiClockUpdate( MxDataplaneCtx_t * pxCtx,
+                             BaseType_t xHeaderValid )
+{
+    if( xHeaderValid == pdTRUE )
+    {
+        pxCtx->xSpiClock.ulGoodHeaders++;
+
+        if( ( pxCtx->xSpiClock.ulGoodHeaders >= MX_SPI_CLOCK_RAMP_UP_COUNT ) &&
+            ( pxCtx->xSpiClock.ulLevel < pxCtx->xSpiClock.ulCeiling ) )
+        {
+            pxCtx->xSpiClock.ulNextLevel = pxCtx->xSpiClock.ulLevel + 1;
+        }
+    }
+    else
+    {
+        TickType_t xNow = xTaskGetTickCount();
+
+        if( ( xNow - pxCtx->xSpiClock.xLastErrorTick ) > pdMS_TO_TICKS( MX_SPI_CLOCK_RAMP_ERROR_WINDOW_MS ) )
+        {
+            pxCtx->xSpiClock.ulRecentErrors = 0;
+        }
+
+        pxCtx->xSpiClock.xLastErrorTick = xNow;
+        pxCtx->xSpiClock.ulGoodHeaders = 0;
+        pxCtx->xSpiClock.ulRecentErrors++;
+
+        if( ( pxCtx->xSpiClock.ulRecentErrors >= MX_SPI_CLOCK_RAMP_DOWN_ERRORS ) &&
+            ( pxCtx->xSpiClock.ulLevel > 0 ) )
+        {
+            LogWarn( "SPI header error burst, reducing SPI clock." );
+            pxCtx->xSpiClock.ulCeiling = pxCtx->xSpiClock.ulLevel - 1;
+            pxCtx->xSpiClock.ulNextLevel = pxCtx->xSpiClock.ulLevel - 1;
+        }
+    }
+}
+
+/*
+ * @brief Apply any clock change decided during the last transaction.
+ * Called with CS deasserted so that a transaction never spans two clock rates.
+ */
+static inline void vSpiClockCommit( MxDataplaneCtx_t * pxCtx )
+{
+    if( pxCtx->xSpiClock.ulNextLevel != pxCtx->xSpiClock.ulLevel )
+    {
+        vSpiClockApply( pxCtx, pxCtx->xSpiClock.ulNextLevel );
+    }
+}
+
+#else /* MX_SPI_CLOCK_RAMP == 1 */
+
+#define vSpiClockInit( pxCtx )
+#define vSpiClockUpdate( pxCtx, xHeaderValid )
+#define vSpiClockCommit( pxCtx )
+
+#endif /* MX_SPI_CLOCK_RAMP == 1 */
+
 /*
  * @brief Exchange SPIHeader_t headers with the wifi module.
  * */
@@ -213,6 +393,7 @@ static inline BaseType_t xDoSpiHeaderTransfer( MxDataplaneCtx_t * pxCtx,
 
     SPIHeader_t xRxHeader = { 0 };
     SPIHeader_t xTxHeader = { 0 };
+    BaseType_t xHeaderValid = pdTRUE;
 
     xTxHeader.type = MX_SPI_WRITE;
     xTxHeader.len = *psTxLen;
@@ -235,6 +416,15 @@ static inline BaseType_t xDoSpiHeaderTransfer( MxDataplaneCtx_t * pxCtx,
         xHalStatus = ( xWaitForSPIEvent( MX_SPI_EVENT_TIMEOUT ) == pdTRUE ) ? HAL_OK : HAL_ERROR;
     }
 
+    /* Injected errors take the same path as a header corrupted on the wire */
+    if( ( xHalStatus == HAL_OK ) &&
+        ( xRxHeader.type == MX_SPI_READ ) &&
+        ( xRxHeader.len != 0 ) &&
+        ( xMxImpairSpiError() == pdTRUE ) )
+    {
+        xRxHeader.lenx = xRxHeader.len;
+    }
+
     if( ( xHalStatus == HAL_OK ) &&
         ( xRxHeader.len < MX_MAX_MESSAGE_LEN ) &&
         ( xRxHeader.type == MX_SPI_READ ) &&
@@ -249,12 +439,21 @@ static inline BaseType_t xDoSpiHeaderTransfer( MxDataplaneCtx_t * pxCtx,
         {
             LogError( "RX header validation failed. len: %d, lenx: %d, xord: %d, type: %d, xHalStatus: %d",
                       xRxHeader.len, xRxHeader.lenx, ( xRxHeader.len ) ^ ( xRxHeader.lenx ), xRxHeader.type, xHalStatus );
+            pxCtx->xStats.ulHeaderErrors++;
+            xHeaderValid = pdFALSE;
         }
 
         *psRxLen = 0;
         *psTxLen = 0;
     }
 
+    if( xHalStatus != HAL_OK )
+    {
+        xHeaderValid = pdFALSE;
+    }
+
+    vSpiClockUpdate( pxCtx, xHeaderValid );
+
     return( xHalStatus == HAL_OK );
 }
 
@@ -268,13 +467,23 @@ static inline BaseType_t xReceiveMessage( MxDataplaneCtx_t * pxCtx,
     configASSERT( pucRxBuffer != NULL );
     configASSERT( ulRxDataLen > 0 );
 
-    ( void ) xTaskNotifyStateClearIndexed( NULL, SPI_EVT_DMA_IDX );
+    if( xCacheInvalidateRange( pucRxBuffer, ulRxDataLen ) == pdFALSE )
+    {
+        xHalStatus = HAL_ERROR;
+    }
+    else
+    {
+        ( void ) xTaskNotifyStateClearIndexed( NULL, SPI_EVT_DMA_IDX );
 
-    xHalStatus = HAL_SPI_Receive_DMA( pxCtx->pxSpiHandle,
-                                      pucRxBuffer,
-                                      ulRxDataLen );
+        xHalStatus = HAL_SPI_Receive_DMA( pxCtx->pxSpiHandle,
+                                          pucRxBuffer,
+                                          ulRxDataLen );
 
-    xHalStatus |= ( xWaitForSPIEvent( MX_SPI_EVENT_TIMEOUT ) == pdTRUE ) ? HAL_OK : HAL_ERROR;
+        xHalStatus |= ( xWaitForSPIEvent( MX_SPI_EVENT_TIMEOUT ) == pdTRUE ) ? HAL_OK : HAL_ERROR;
+
+        /* Drop any line speculatively refilled while the transfer was in progress */
+        ( void ) xCacheInvalidateRange( pucRxBuffer, ulRxDataLen );
+    }
 
     return xHalStatus == HAL_OK;
 }
@@ -289,6 +498,7 @@ static inline BaseType_t xTransmitMessage( MxDataplaneCtx_t * pxCtx,
     configASSERT( pucTxBuffer != NULL );
     configASSERT( usTxDataLen > 0 );
 
+    ( void ) xCacheCleanRange( pucTxBuffer, usTxDataLen );
 
     ( void ) xTaskNotifyStateClearIndexed( NULL, SPI_EVT_DMA_IDX );
 
@@ -301,6 +511,14 @@ static inline BaseType_t xTransmitMessage( MxDataplaneCtx_t * pxCtx,
     return xHalStatus == HAL_OK;
 }
 
+/*
+ * @brief Exchange payloads of (potentially) different lengths with the module.
+ *
+ * The HAL only supports full duplex DMA transfers with equal length buffers, so the
+ * common length is exchanged first and the remainder of the longer side is chained
+ * from the transfer complete interrupt. The dataplane task is only woken once, after
+ * both transfers have completed.
+ */
 static inline BaseType_t xTransmitReceiveMessage( MxDataplaneCtx_t * pxCtx,
                                                   uint8_t * pucTxBuffer,
                                                   uint32_t usTxDataLen,
@@ -308,6 +526,7 @@ static inline BaseType_t xTransmitReceiveMessage( MxDataplaneCtx_t * pxCtx,
                                                   uint32_t usRxDataLen )
 {
     HAL_StatusTypeDef xHalStatus;
+    uint32_t usCommonLen = ( usTxDataLen < usRxDataLen ) ? usTxDataLen : usRxDataLen;
 
     configASSERT( pxCtx != NULL );
     configASSERT( pucTxBuffer != NULL );
@@ -315,52 +534,123 @@ static inline BaseType_t xTransmitReceiveMessage( MxDataplaneCtx_t * pxCtx,
     configASSERT( pucRxBuffer != NULL );
     configASSERT( usRxDataLen > 0 );
 
-    /* Split into two dma transactions */
+    pxCtx->pucChainTxBuffer = NULL;
+    pxCtx->pucChainRxBuffer = NULL;
+
     if( usTxDataLen > usRxDataLen )
     {
-        ( void ) xTaskNotifyStateClearIndexed( NULL, SPI_EVT_DMA_IDX );
-
-        xHalStatus = HAL_SPI_TransmitReceive_DMA( pxCtx->pxSpiHandle,
-                                                  pucTxBuffer,
-                                                  pucRxBuffer,
-                                                  usRxDataLen );
+        pxCtx->pucChainTxBuffer = &pucTxBuffer[ usCommonLen ];
+        pxCtx->usChainLen = usTxDataLen - usCommonLen;
+    }
+    else if( usTxDataLen < usRxDataLen )
+    {
+        pxCtx->pucChainRxBuffer = &pucRxBuffer[ usCommonLen ];
+        pxCtx->usChainLen = usRxDataLen - usCommonLen;
+    }
+    else /* usTxDataLen == usRxDataLen */
+    {
+        pxCtx->usChainLen = 0;
+    }
 
-        xHalStatus |= ( xWaitForSPIEvent( MX_SPI_EVENT_TIMEOUT ) == pdTRUE ) ? HAL_OK : HAL_ERROR;
+    ( void ) xCacheCleanRange( pucTxBuffer, usTxDataLen );
 
-        xHalStatus |= xTransmitMessage( pxCtx,
-                                        &pucTxBuffer[ usRxDataLen ],
-                                        usTxDataLen - usRxDataLen );
+    if( xCacheInvalidateRange( pucRxBuffer, usRxDataLen ) == pdFALSE )
+    {
+        xHalStatus = HAL_ERROR;
     }
-    else if( usTxDataLen < usRxDataLen )
+    else
     {
         ( void ) xTaskNotifyStateClearIndexed( NULL, SPI_EVT_DMA_IDX );
 
         xHalStatus = HAL_SPI_TransmitReceive_DMA( pxCtx->pxSpiHandle,
                                                   pucTxBuffer,
                                                   pucRxBuffer,
-                                                  usTxDataLen );
+                                                  usCommonLen );
 
-        xHalStatus |= ( xWaitForSPIEvent( MX_SPI_EVENT_TIMEOUT ) == pdTRUE ) ? HAL_OK : HAL_ERROR;
+        if( xHalStatus == HAL_OK )
+        {
+            xHalStatus = ( xWaitForSPIEvent( MX_SPI_EVENT_TIMEOUT ) == pdTRUE ) ? HAL_OK : HAL_ERROR;
+        }
 
-        xHalStatus |= xReceiveMessage( pxCtx,
-                                       &pucRxBuffer[ usTxDataLen ],
-                                       usRxDataLen - usTxDataLen );
+        /* Drop any line speculatively refilled while the transfer was in progress */
+        ( void ) xCacheInvalidateRange( pucRxBuffer, usRxDataLen );
     }
-    else /* usTxDataLen == usRxDataLen */
-    {
-        xHalStatus = HAL_SPI_TransmitReceive_DMA( pxCtx->pxSpiHandle,
-                                                  pucTxBuffer,
-                                                  pucRxBuffer,
-                                                  usTxDataLen );
 
-        xHalStatus |= ( xWaitForSPIEvent( MX_SPI_EVENT_TIMEOUT ) == pdTRUE ) ? HAL_OK : HAL_ERROR;
-    }
+    /* Make sure a stale chained transfer is never started by a later transaction */
+    pxCtx->usChainLen = 0;
+    pxCtx->pucChainTxBuffer = NULL;
+    pxCtx->pucChainRxBuffer = NULL;
 
     return xHalStatus == HAL_OK;
 }
 
 
-static void vProcessRxPacket( MessageBufferHandle_t * xControlPlaneResponseBuff,
+/*
+ * @brief Transmit a chained TX pbuf segment by segment while receiving ulRxDataLen bytes.
+ *
+ * Each segment is exchanged with the corresponding region of the RX buffer so that TX
+ * and RX bytes stay aligned on the wire. Any RX data beyond the end of the TX chain is
+ * received at the end.
+ */
+static BaseType_t xTransferTxChain( MxDataplaneCtx_t * pxCtx,
+                                    PacketBuffer_t * pxTxBuff,
+                                    uint8_t * pucRxBuffer,
+                                    uint32_t ulRxDataLen )
+{
+    BaseType_t xResult = pdTRUE;
+    uint32_t ulOffset = 0;
+
+    configASSERT( pxTxBuff != NULL );
+    configASSERT( ( pucRxBuffer != NULL ) || ( ulRxDataLen == 0 ) );
+
+    for( PacketBuffer_t * pxSegment = pxTxBuff;
+         ( pxSegment != NULL ) && ( xResult == pdTRUE );
+         pxSegment = pxSegment->next )
+    {
+        uint32_t ulSegmentLen = pxSegment->len;
+        uint32_t ulRxSegmentLen = 0;
+
+        if( ulSegmentLen == 0 )
+        {
+            continue;
+        }
+
+        if( ulOffset < ulRxDataLen )
+        {
+            ulRxSegmentLen = ulRxDataLen - ulOffset;
+
+            if( ulRxSegmentLen > ulSegmentLen )
+            {
+                ulRxSegmentLen = ulSegmentLen;
+            }
+        }
+
+        if( ulRxSegmentLen > 0 )
+        {
+            xResult = xTransmitReceiveMessage( pxCtx,
+                                               pxSegment->payload,
+                                               ulSegmentLen,
+                                               &pucRxBuffer[ ulOffset ],
+                                               ulRxSegmentLen );
+        }
+        else
+        {
+            xResult = xTransmitMessage( pxCtx, pxSegment->payload, ulSegmentLen );
+        }
+
+        ulOffset += ulSegmentLen;
+    }
+
+    if( ( xResult == pdTRUE ) &&
+        ( ulOffset < ulRxDataLen ) )
+    {
+        xResult = xReceiveMessage( pxCtx, &pucRxBuffer[ ulOffset ], ulRxDataLen - ulOffset );
+    }
+
+    return xResult;
+}
+
+static void vProcessRxPacket( MxRing_t * pxControlPlaneResponseRing,
                               NetInterface_t * pxNetif,
                               PacketBuffer_t ** ppxRxPacket )
 {
@@ -409,14 +699,11 @@ static void vProcessRxPacket( MessageBufferHandle_t * xControlPlaneResponseBuff,
     /* forward to control plane handler */
     else
     {
-        xResult = xMessageBufferSend( xControlPlaneResponseBuff,
-                                      ppxRxPacket,
-                                      sizeof( PacketBuffer_t * ),
-                                      0 );
+        xResult = xMxRingPush( pxControlPlaneResponseRing, *ppxRxPacket );
 
         if( xResult == pdFALSE )
         {
-            LogError( "Error while adding received message to xControlPlaneResponseBuff: %d.", xResult );
+            LogError( "pxControlPlaneResponseRing is full." );
 
             LogError( "Dropping response message: Request ID: %d, AppID: %d",
                       pxRxPktHeader->ulIPCRequestId,
@@ -488,183 +775,461 @@ static inline BaseType_t xWaitForFlow( MxDataplaneCtx_t * pxCtx )
     return( ( BaseType_t ) ( ulFlowValue != 0 ) );
 }
 
-void vDataplaneThread( void * pvParameters )
+/*
+ * @brief Top up the set of pre-allocated RX pbufs.
+ * Called between transactions so that pool allocation is kept off the critical
+ * path between the header exchange and the payload transfer.
+ */
+static void vRxPbufReplenish( MxDataplaneCtx_t * pxCtx )
 {
-    /* Get context struct (contains instance parameters) */
-    MxDataplaneCtx_t * pxCtx = ( MxDataplaneCtx_t * ) pvParameters;
+    while( pxCtx->ulRxPbufReadyCount < MX_RX_PBUF_READY_LEN )
+    {
+        PacketBuffer_t * pxPbuf = PBUF_ALLOC_RX( MX_RX_BUFF_SZ );
 
-    BaseType_t exitFlag = pdFALSE;
+        if( pxPbuf == NULL )
+        {
+            break;
+        }
 
-    /* Export context for callbacks */
-    pxSpiCtx = pxCtx;
+        pxCtx->pxRxPbufReady[ pxCtx->ulRxPbufReadyCount ] = pxPbuf;
+        pxCtx->ulRxPbufReadyCount++;
+    }
+}
 
-    vInitCallbacks( pxCtx );
+/*
+ * @brief Get an RX pbuf of usRxLen bytes, preferring a pre-allocated one.
+ */
+static PacketBuffer_t * pxRxPbufGet( MxDataplaneCtx_t * pxCtx,
+                                     uint16_t usRxLen )
+{
+    PacketBuffer_t * pxPbuf = NULL;
 
-    /* set CS/NSS high */
-    vGpioSet( pxCtx->gpio_nss );
+    if( ( usRxLen <= MX_RX_BUFF_SZ ) &&
+        ( pxCtx->ulRxPbufReadyCount > 0 ) )
+    {
+        pxCtx->ulRxPbufReadyCount--;
+        pxPbuf = pxCtx->pxRxPbufReady[ pxCtx->ulRxPbufReadyCount ];
+        pxCtx->pxRxPbufReady[ pxCtx->ulRxPbufReadyCount ] = NULL;
 
-    /* Do hardware reset */
-    vDoHardReset( pxCtx );
+        PBUF_SHRINK( pxPbuf, usRxLen );
+    }
+    else
+    {
+        pxCtx->xStats.ulRxPbufMiss++;
+        pxPbuf = PBUF_ALLOC_RX( usRxLen );
+    }
 
-    while( exitFlag == pdFALSE )
+    return pxPbuf;
+}
+
+/*
+ * @brief Pick the next data plane frame to transmit using weighted round robin
+ * between the latency-critical and bulk rings.
+ * @return The ring the frame at *ppxTxBuff was peeked from, or NULL if both are empty.
+ */
+static MxRing_t * pxSelectDataPlaneRing( MxDataplaneCtx_t * pxCtx,
+                                         PacketBuffer_t ** ppxTxBuff )
+{
+    MxRing_t * pxRing = NULL;
+
+    if( ( pxCtx->ulTxPrioCredit > 0 ) &&
+        ( xMxRingPeek( pxCtx->pxDataPlanePrioSendRing, ( void ** ) ppxTxBuff ) == pdTRUE ) )
+    {
+        pxCtx->ulTxPrioCredit--;
+        pxRing = pxCtx->pxDataPlanePrioSendRing;
+    }
+    else if( xMxRingPeek( pxCtx->pxDataPlaneSendRing, ( void ** ) ppxTxBuff ) == pdTRUE )
+    {
+        pxCtx->ulTxPrioCredit = MX_TX_PRIO_WEIGHT;
+        pxRing = pxCtx->pxDataPlaneSendRing;
+    }
+    else if( xMxRingPeek( pxCtx->pxDataPlanePrioSendRing, ( void ** ) ppxTxBuff ) == pdTRUE )
+    {
+        /* Bulk ring is empty, so there is no one to be fair to */
+        pxRing = pxCtx->pxDataPlanePrioSendRing;
+    }
+    else
     {
-        PacketBuffer_t * pxTxBuff = NULL;
-        PacketBuffer_t * pxRxBuff = NULL;
+        /* Both rings are empty */
+    }
 
-        if( pxCtx->ulTxPacketsWaiting == 0 )
-        {
-            LogDebug( "Starting wait for DATA_WAITING_IDX event" );
-            ulTaskNotifyTakeIndexed( DATA_WAITING_IDX,
-                                     pdFALSE,
-                                     500 );
-        }
+    return pxRing;
+}
 
-        /* Skip this transaction if IRQ pin is low and there are no pending tx packets */
-        if( ( xGpioGet( pxCtx->gpio_notify ) == pdFALSE ) &&
-            ( pxCtx->ulTxPacketsWaiting == 0 ) )
-        {
-            continue;
-        }
+/*
+ * @brief Check whether any control or data plane frame is waiting to be sent.
+ */
+static inline BaseType_t xTxPending( MxDataplaneCtx_t * pxCtx )
+{
+    return( ( pxCtx->ulTxPacketsWaiting > 0 ) ||
+            ( xMxRingIsEmpty( pxCtx->pxDataPlaneSendRing ) == pdFALSE ) ||
+            ( xMxRingIsEmpty( pxCtx->pxDataPlanePrioSendRing ) == pdFALSE ) );
+}
 
-        /* Clear flow state */
-        xTaskNotifyStateClearIndexed( NULL, SPI_EVT_FLOW_IDX );
+static inline void vUpdateXferStats( MxDataplaneCtx_t * pxCtx,
+                                     uint32_t ulCycles )
+{
+    pxCtx->xStats.ullXferCycles += ulCycles;
 
-        /* Set CS low to initiate transaction */
-        vGpioClear( pxCtx->gpio_nss );
+    if( ulCycles > pxCtx->xStats.ulMaxXferCycles )
+    {
+        pxCtx->xStats.ulMaxXferCycles = ulCycles;
+    }
+}
 
-        BaseType_t xResult = pdTRUE;
+/*
+ * @brief Perform a single CS-framed SPI transaction with the wifi module.
+ * @return pdTRUE if at least one frame was exchanged in either direction.
+ */
+static BaseType_t xDoSpiTransaction( MxDataplaneCtx_t * pxCtx )
+{
+    PacketBuffer_t * pxTxBuff = NULL;
+    PacketBuffer_t * pxRxBuff = NULL;
+    BaseType_t xResult = pdTRUE;
+    BaseType_t xFrameExchanged = pdFALSE;
+    uint16_t usTxLen = 0;
+    uint16_t usRxLen = 0;
+    uint32_t ulStartCycles;
 
-        /* Wait for the module to be ready */
-        if( xWaitForFlow( pxCtx ) == pdTRUE )
-        {
-            uint16_t usTxLen = 0;
-            uint16_t usRxLen = 0;
+    /* Clear flow state */
+    xTaskNotifyStateClearIndexed( NULL, SPI_EVT_FLOW_IDX );
 
-            QueueHandle_t xSourceQueue = NULL;
+    ulStartCycles = DWT->CYCCNT;
 
-            /* Prepare a control plane messages for TX */
-            if( xQueuePeek( pxCtx->xControlPlaneSendQueue, &pxTxBuff, 0 ) == pdTRUE )
-            {
-                configASSERT( pxTxBuff != NULL );
-                configASSERT( pxTxBuff->ref > 0 );
-                usTxLen = pxTxBuff->tot_len;
-                xSourceQueue = pxCtx->xControlPlaneSendQueue;
-                LogDebug( "Preparing controlplane message for transmission" );
-            }
-            else if( xQueuePeek( pxCtx->xDataPlaneSendQueue, &pxTxBuff, 0 ) == pdTRUE )
+    /* Set CS low to initiate transaction */
+    vGpioClear( pxCtx->gpio_nss );
+
+    /* Wait for the module to be ready */
+    if( xWaitForFlow( pxCtx ) == pdTRUE )
+    {
+        QueueHandle_t xSourceQueue = NULL;
+        MxRing_t * pxSourceRing = NULL;
+
+        /* Prepare a control plane messages for TX */
+        if( xQueuePeek( pxCtx->xControlPlaneSendQueue, &pxTxBuff, 0 ) == pdTRUE )
+        {
+            configASSERT( pxTxBuff != NULL );
+            configASSERT( pxTxBuff->ref > 0 );
+            usTxLen = pxTxBuff->tot_len;
+            xSourceQueue = pxCtx->xControlPlaneSendQueue;
+            LogDebug( "Preparing controlplane message for transmission" );
+        }
+        else
+        {
+            pxSourceRing = pxSelectDataPlaneRing( pxCtx, &pxTxBuff );
+
+            if( pxSourceRing != NULL )
             {
                 configASSERT( pxTxBuff != NULL );
                 configASSERT( pxTxBuff->ref > 0 );
                 usTxLen = pxTxBuff->tot_len;
-                xSourceQueue = pxCtx->xDataPlaneSendQueue;
                 LogDebug( "Preparing dataplane message for transmission" );
             }
-            else
-            {
-                /* Empty, no TX packets */
-            }
+        }
+
+        if( ( pxTxBuff == NULL ) &&
+            ( pxCtx->ulTxPacketsWaiting != 0 ) )
+        {
+            LogWarn( "Mismatch between ulTxPacketsWaiting and queue contents. Resetting ulTxPacketsWaiting" );
+            pxCtx->ulTxPacketsWaiting = 0;
+        }
 
-            if( ( pxTxBuff == NULL ) &&
-                ( pxCtx->ulTxPacketsWaiting != 0 ) )
+        if( xResult == pdTRUE )
+        {
+            /* Transfer the header */
+            xResult = xDoSpiHeaderTransfer( pxCtx, &usTxLen, &usRxLen );
+        }
+
+        if( xResult == pdTRUE )
+        {
+            /* Allocate RX buffer */
+            if( usRxLen > 0 )
             {
-                LogWarn( "Mismatch between ulTxPacketsWaiting and queue contents. Resetting ulTxPacketsWaiting" );
-                pxSpiCtx->ulTxPacketsWaiting = 0;
+                pxRxBuff = pxRxPbufGet( pxCtx, usRxLen );
             }
 
-            if( xResult == pdTRUE )
+            /* Wait for flow pin to go high */
+            xResult = xWaitForFlow( pxCtx );
+        }
+
+        /* Read from the queue or ring */
+        if( ( xResult == pdTRUE ) &&
+            ( xSourceQueue != NULL ) )
+        {
+            xResult = xQueueReceive( xSourceQueue, &pxTxBuff, 0 );
+            configASSERT( pxTxBuff != NULL );
+            configASSERT( xResult == pdTRUE );
+
+            /* Decrement TX packets waiting counter */
+            ( void ) Atomic_Decrement_u32( &( pxCtx->ulTxPacketsWaiting ) );
+        }
+        else if( ( xResult == pdTRUE ) &&
+                 ( pxSourceRing != NULL ) )
+        {
+            xResult = xMxRingPop( pxSourceRing, ( void ** ) &pxTxBuff );
+            configASSERT( pxTxBuff != NULL );
+            configASSERT( xResult == pdTRUE );
+
+            if( pxSourceRing == pxCtx->pxDataPlanePrioSendRing )
             {
-                /* Transfer the header */
-                xResult = xDoSpiHeaderTransfer( pxCtx, &usTxLen, &usRxLen );
+                pxCtx->xStats.ulTxPrioFrames++;
             }
+        }
+        else if( pxTxBuff != NULL )
+        {
+            pxTxBuff = NULL;
+        }
 
-            if( xResult == pdTRUE )
+        /* Transmit / receive packet data */
+        if( xResult == pdTRUE )
+        {
+            /* Chained (zero-copy) transmit case, with or without receive */
+            if( ( usTxLen > 0 ) &&
+                ( pxTxBuff->next != NULL ) )
             {
-                /* Allocate RX buffer */
-                if( usRxLen > 0 )
-                {
-                    pxRxBuff = PBUF_ALLOC_RX( usRxLen );
-                }
-
-                /* Wait for flow pin to go high */
-                xResult = xWaitForFlow( pxCtx );
-            }
+                configASSERT( ( pxRxBuff != NULL ) || ( usRxLen == 0 ) );
 
-            /* Read from the queue */
-            if( ( xResult == pdTRUE ) &&
-                ( xSourceQueue != NULL ) )
+                xResult = xTransferTxChain( pxCtx,
+                                            pxTxBuff,
+                                            ( pxRxBuff != NULL ) ? pxRxBuff->payload : NULL,
+                                            usRxLen );
+            }
+            /* Transmit case */
+            else if( ( usTxLen > 0 ) &&
+                     ( usRxLen == 0 ) )
             {
-                xResult = xQueueReceive( xSourceQueue, &pxTxBuff, 0 );
-                configASSERT( pxTxBuff != NULL );
-                configASSERT( xResult == pdTRUE );
+                configASSERT( pxTxBuff );
+                xResult = xTransmitMessage( pxCtx, pxTxBuff->payload, usTxLen );
             }
-            else if( pxTxBuff != NULL )
+            else if( ( usRxLen > 0 ) &&
+                     ( usTxLen == 0 ) )
             {
-                pxTxBuff = NULL;
+                configASSERT( pxRxBuff );
+                xResult = xReceiveMessage( pxCtx, pxRxBuff->payload, usRxLen );
             }
-
-            /* Transmit / receive packet data */
-            if( xResult == pdTRUE )
+            else if( ( usRxLen > 0 ) &&
+                     ( usTxLen > 0 ) )
             {
-                /* Transmit case */
-                if( ( usTxLen > 0 ) &&
-                    ( usRxLen == 0 ) )
-                {
-                    configASSERT( pxTxBuff );
-                    xResult = xTransmitMessage( pxCtx, pxTxBuff->payload, usTxLen );
-                }
-                else if( ( usRxLen > 0 ) &&
-                         ( usTxLen == 0 ) )
-                {
-                    configASSERT( pxRxBuff );
-                    xResult = xReceiveMessage( pxCtx, pxRxBuff->payload, usRxLen );
-                }
-                else if( ( usRxLen > 0 ) &&
-                         ( usTxLen > 0 ) )
-                {
-                    configASSERT( pxRxBuff );
-                    configASSERT( pxTxBuff );
-
-                    xResult = xTransmitReceiveMessage( pxCtx,
-                                                       pxTxBuff->payload,
-                                                       usTxLen,
-                                                       pxRxBuff->payload,
-                                                       usRxLen );
-                }
+                configASSERT( pxRxBuff );
+                configASSERT( pxTxBuff );
+
+                xResult = xTransmitReceiveMessage( pxCtx,
+                                                   pxTxBuff->payload,
+                                                   usTxLen,
+                                                   pxRxBuff->payload,
+                                                   usRxLen );
             }
         }
-        else
+
+        pxCtx->xStats.ulTransactions++;
+
+        if( xResult == pdFALSE )
+        {
+            pxCtx->xStats.ulErrors++;
+        }
+    }
+    else
+    {
+        LogDebug( "Timed out while waiting for flow event." );
+        pxCtx->xStats.ulFlowTimeouts++;
+        xResult = pdFALSE;
+    }
+
+    /* Set CS / NSS high (idle) */
+    vGpioSet( pxCtx->gpio_nss );
+
+    vUpdateXferStats( pxCtx, DWT->CYCCNT - ulStartCycles );
+
+    vSpiClockCommit( pxCtx );
+
+    if( pxTxBuff != NULL )
+    {
+        if( xResult == pdTRUE )
         {
-            LogDebug( "Timed out while waiting for flow event." );
-            xResult = pdFALSE;
+            pxCtx->xStats.ulTxFrames++;
+            pxCtx->xStats.ulTxBytes += usTxLen;
+            xFrameExchanged = pdTRUE;
         }
 
-        /* Set CS / NSS high (idle) */
-        vGpioSet( pxCtx->gpio_nss );
+        /* Free the TX buffer */
+        LogDebug( "Decreasing reference count of pxTxBuff %p from %d to %d", pxTxBuff, pxTxBuff->ref, ( pxTxBuff->ref - 1 ) );
+        PBUF_FREE( pxTxBuff );
+        pxTxBuff = NULL;
+    }
+
+    if( ( xResult == pdTRUE ) &&
+        ( pxRxBuff != NULL ) )
+    {
+        pxCtx->xStats.ulRxFrames++;
+        pxCtx->xStats.ulRxBytes += usRxLen;
+        xFrameExchanged = pdTRUE;
+        vProcessRxPacket( pxCtx->pxControlPlaneResponseRing, pxCtx->pxNetif, &pxRxBuff );
+    }
+    else if( pxRxBuff != NULL )
+    {
+        LogDebug( "Decreasing reference count of pxRxBuff %p from %d to %d", pxRxBuff, pxRxBuff->ref, ( pxRxBuff->ref - 1 ) );
+        PBUF_FREE( pxRxBuff );
+        pxRxBuff = NULL;
+    }
+
+    configASSERT( pxTxBuff == NULL );
+    configASSERT( pxRxBuff == NULL );
+
+    vRxPbufReplenish( pxCtx );
+
+    return xFrameExchanged;
+}
+
+static inline void vUpdateBurstStats( MxDataplaneCtx_t * pxCtx,
+                                      uint32_t ulBurstLen )
+{
+    if( ulBurstLen > 0 )
+    {
+        pxCtx->xStats.ulBursts++;
 
-        if( pxTxBuff != NULL )
+        if( ulBurstLen > pxCtx->xStats.ulMaxBurstLen )
         {
-            /* Decrement TX packets waiting counter */
-            ( void ) Atomic_Decrement_u32( &( pxSpiCtx->ulTxPacketsWaiting ) );
+            pxCtx->xStats.ulMaxBurstLen = ulBurstLen;
+        }
+    }
+}
 
-            /* Free the TX buffer */
-            LogDebug( "Decreasing reference count of pxTxBuff %p from %d to %d", pxTxBuff, pxTxBuff->ref, ( pxTxBuff->ref - 1 ) );
-            PBUF_FREE( pxTxBuff );
-            pxTxBuff = NULL;
+/*
+ * @brief Spin for a short while waiting for either side to have data pending.
+ * @return pdTRUE if data became available before the spin count expired.
+ */
+static inline BaseType_t xPollForData( MxDataplaneCtx_t * pxCtx )
+{
+    BaseType_t xDataWaiting = pdFALSE;
+
+    for( uint32_t ulSpin = 0; ulSpin < MX_DATAPLANE_POLL_SPIN_COUNT; ulSpin++ )
+    {
+        if( ( xGpioGet( pxCtx->gpio_notify ) != pdFALSE ) ||
+            ( xTxPending( pxCtx ) == pdTRUE ) )
+        {
+            xDataWaiting = pdTRUE;
+            break;
         }
+    }
 
-        if( ( xResult == pdTRUE ) &&
-            ( pxRxBuff != NULL ) )
+    return xDataWaiting;
+}
+
+/*
+ * @brief Ask the dataplane thread to hard reset the module between transactions.
+ */
+void vDataplaneRequestReset( MxDataplaneCtx_t * pxCtx )
+{
+    configASSERT( pxCtx->xDataPlaneTaskHandle != NULL );
+
+    pxCtx->xResetRequested = pdTRUE;
+
+    ( void ) xTaskNotifyGiveIndexed( pxCtx->xDataPlaneTaskHandle, DATA_WAITING_IDX );
+}
+
+void vDataplaneThread( void * pvParameters )
+{
+    /* Get context struct (contains instance parameters) */
+    MxDataplaneCtx_t * pxCtx = ( MxDataplaneCtx_t * ) pvParameters;
+
+    BaseType_t exitFlag = pdFALSE;
+
+    /* Export context for callbacks */
+    pxSpiCtx = pxCtx;
+
+    ( void ) memset( &( pxCtx->xStats ), 0, sizeof( MxDataplaneStats_t ) );
+
+    vMxRingSetConsumer( pxCtx->pxDataPlaneSendRing );
+    vMxRingSetConsumer( pxCtx->pxDataPlanePrioSendRing );
+
+    pxCtx->ulRxPbufReadyCount = 0;
+    vRxPbufReplenish( pxCtx );
+
+    /* Enable the cycle counter used for transaction timing */
+    CoreDebug->DEMCR |= CoreDebug_DEMCR_TRCENA_Msk;
+    DWT->CTRL |= DWT_CTRL_CYCCNTENA_Msk;
+
+    vInitCallbacks( pxCtx );
+
+    /* set CS/NSS high */
+    vGpioSet( pxCtx->gpio_nss );
+
+    /* Do hardware reset */
+    vDoHardReset( pxCtx );
+
+    /* Start probing for the fastest reliable SPI clock */
+    vSpiClockInit( pxCtx );
+
+    TickType_t xLastBusyTick = xTaskGetTickCount() - pdMS_TO_TICKS( MX_DATAPLANE_POLL_HOLD_MS );
+
+    while( exitFlag == pdFALSE )
+    {
+        uint32_t ulBurstLen = 0;
+        BaseType_t xTrafficHot = ( ( xTaskGetTickCount() - xLastBusyTick ) < pdMS_TO_TICKS( MX_DATAPLANE_POLL_HOLD_MS ) );
+
+        /* A burst cut short leaves the notify line high without a new edge, so check it before blocking */
+        if( ( xTxPending( pxCtx ) == pdFALSE ) &&
+            ( xGpioGet( pxCtx->gpio_notify ) == pdFALSE ) )
         {
-            vProcessRxPacket( pxCtx->xControlPlaneResponseBuff, pxCtx->pxNetif, &pxRxBuff );
+            if( ( xTrafficHot == pdTRUE ) &&
+                ( xPollForData( pxCtx ) == pdTRUE ) )
+            {
+                pxCtx->xStats.ulPollHits++;
+            }
+            else
+            {
+                LogDebug( "Starting wait for DATA_WAITING_IDX event" );
+                ulTaskNotifyTakeIndexed( DATA_WAITING_IDX,
+                                         pdFALSE,
+                                         xTrafficHot ? MX_DATAPLANE_HOT_WAIT_TICKS : portMAX_DELAY );
+                TRACE_MARK( TRACE_MARK_MX_WAKE, 0 );
+            }
         }
-        else if( pxRxBuff != NULL )
+
+        if( pxCtx->xResetRequested == pdTRUE )
         {
-            LogDebug( "Decreasing reference count of pxRxBuff %p from %d to %d", pxRxBuff, pxRxBuff->ref, ( pxRxBuff->ref - 1 ) );
-            PBUF_FREE( pxRxBuff );
-            pxRxBuff = NULL;
+            LogWarn( "Resetting wifi module." );
+            vDoHardReset( pxCtx );
+            vSpiClockInit( pxCtx );
+            pxCtx->xResetRequested = pdFALSE;
         }
 
-        configASSERT( pxTxBuff == NULL );
-        configASSERT( pxRxBuff == NULL );
+        /*
+         * Drain queued frames back to back while either side has data pending,
+         * rather than returning to the notification wait between frames.
+         */
+        /* SPI2 stops in Stop 2. The notify line wakes the core between transactions. */
+        vLowPowerStopInhibit( LOW_POWER_CLIENT_DATAPLANE );
+
+        /* The SPI2 prescaler ladder assumes PCLK1 at full speed */
+        vDvfsRequest( DVFS_CLIENT_DATAPLANE );
+
+        while( ( ulBurstLen < MX_DATAPLANE_BURST_MAX ) &&
+               ( ( xGpioGet( pxCtx->gpio_notify ) != pdFALSE ) ||
+                 ( xTxPending( pxCtx ) == pdTRUE ) ) )
+        {
+            BaseType_t xTransferred;
+
+            PROF_BEGIN( xProfTransaction );
+            xTransferred = xDoSpiTransaction( pxCtx );
+            PROF_END( xProfTransaction );
+
+            if( xTransferred == pdFALSE )
+            {
+                break;
+            }
+
+            ulBurstLen++;
+        }
+
+        vDvfsRelease( DVFS_CLIENT_DATAPLANE );
+        vLowPowerStopAllow( LOW_POWER_CLIENT_DATAPLANE );
+
+        vUpdateBurstStats( pxCtx, ulBurstLen );
+
+        if( ulBurstLen >= MX_DATAPLANE_POLL_BURST_THRESHOLD )
+        {
+            xLastBusyTick = xTaskGetTickCount();
+        }
     }
 }
@@ -24,6 +24,7 @@
 
 #include "logging_levels.h"
 #define LOG_LEVEL    LOG_ERROR
+#define LOG_MODULE    LOG_MODULE_NET
 #include "logging.h"
 
 
@@ -31,7 +32,6 @@
 
 #include "FreeRTOS.h"
 #include "semphr.h"
-#include "message_buffer.h"
 #include "netif/ethernet.h"
 #include "string.h"
 #include "atomic.h"
@@ -46,6 +46,12 @@ typedef struct
     PacketBuffer_t * pxTxPbuf;
     PacketBuffer_t * pxRxPbuf;
     TaskHandle_t xWaitingTask;
+
+    /* Completion callback for asynchronous requests, NULL for synchronous requests */
+    MxRequestCallback_t xCallback;
+    void * pvCallbackCtx;
+    TickType_t xStartTick;
+    TickType_t xTimeout;
 } IPCRequestCtx_t;
 
 /* Static variables */
@@ -53,6 +59,7 @@ IPCRequestCtx_t xIPCRequestCtxArray[ NUM_IPC_REQUEST_CTX ];
 static SemaphoreHandle_t xContextArrayMutex = NULL;     /* Mutex that must be held while modifying the xIPCRequestCtxArray */
 static SemaphoreHandle_t xContextCountSemaphore = NULL; /* Allow clients to block while waiting for an IPCRequestCtx_t. */
 static ControlPlaneCtx_t * pxControlPlaneCtx = NULL;
+static TaskHandle_t xControlPlaneTaskHandle = NULL;
 
 static void vClearCtx( IPCRequestCtx_t * pxRequestCtx )
 {
@@ -76,8 +83,10 @@ static void vClearCtx( IPCRequestCtx_t * pxRequestCtx )
             pxRequestCtx->pxTxPbuf = NULL;
         }
 
-        /* Clear the handle of the waiting task */
+        /* Clear the handle of the waiting task and any completion callback */
         pxRequestCtx->xWaitingTask = NULL;
+        pxRequestCtx->xCallback = NULL;
+        pxRequestCtx->pvCallbackCtx = NULL;
 
         /* Free the response buffer pbuf and clear the pointer */
         if( pxRequestCtx->pxRxPbuf != NULL )
@@ -109,57 +118,125 @@ static IPCRequestCtx_t * pxFindAvailableCtx( TickType_t xTimeout,
     /* Wait for a context to become available, then take a token from xContextCountSemaphore */
     xResult = xSemaphoreTake( xContextCountSemaphore, xTimeout );
 
-    configASSERT( xResult == pdTRUE );
-
-    configASSERT( xContextArrayMutex != NULL );
-
-    xResult = xSemaphoreTake( xContextArrayMutex, xTimeout );
-
     if( xResult == pdTRUE )
     {
-        for( uint32_t i = 0; i < NUM_IPC_REQUEST_CTX; i++ )
+        configASSERT( xContextArrayMutex != NULL );
+
+        xResult = xSemaphoreTake( xContextArrayMutex, xTimeout );
+
+        if( xResult == pdTRUE )
         {
-            if( xIPCRequestCtxArray[ i ].ulRequestID == 0 )
+            for( uint32_t i = 0; i < NUM_IPC_REQUEST_CTX; i++ )
             {
-                xIPCRequestCtxArray[ i ].ulRequestID = prvGetNextRequestID();
+                if( xIPCRequestCtxArray[ i ].ulRequestID == 0 )
+                {
+                    /* A request ID of 0 marks a free context, skip it on wrap around */
+                    do
+                    {
+                        xIPCRequestCtxArray[ i ].ulRequestID = prvGetNextRequestID();
+                    } while( xIPCRequestCtxArray[ i ].ulRequestID == 0 );
 
-                pxRequestCtx = &( xIPCRequestCtxArray[ i ] );
+                    pxRequestCtx = &( xIPCRequestCtxArray[ i ] );
 
-                if( pxRequestCtx->pxRxPbuf != NULL )
-                {
-                    PBUF_FREE( pxRequestCtx->pxRxPbuf );
-                    LogWarn( "pxRxPbuf for IPCRequestCtx %d was non-null upon re-use.", i );
-                }
+                    if( pxRequestCtx->pxRxPbuf != NULL )
+                    {
+                        PBUF_FREE( pxRequestCtx->pxRxPbuf );
+                        LogWarn( "pxRxPbuf for IPCRequestCtx %d was non-null upon re-use.", i );
+                    }
 
-                if( pxRequestCtx->pxTxPbuf != NULL )
-                {
-                    PBUF_FREE( pxRequestCtx->pxTxPbuf );
-                    LogWarn( "pxTxPbuf for IPCRequestCtx %d was non-null upon re-use.", i );
-                }
+                    if( pxRequestCtx->pxTxPbuf != NULL )
+                    {
+                        PBUF_FREE( pxRequestCtx->pxTxPbuf );
+                        LogWarn( "pxTxPbuf for IPCRequestCtx %d was non-null upon re-use.", i );
+                    }
 
-                if( pxRequestCtx->xWaitingTask != NULL )
-                {
-                    pxRequestCtx->xWaitingTask = NULL;
-                    LogWarn( "xWaitingTask for IPCRequestCtx %d was non-null upon re-use.", i );
-                }
+                    if( pxRequestCtx->xWaitingTask != NULL )
+                    {
+                        pxRequestCtx->xWaitingTask = NULL;
+                        LogWarn( "xWaitingTask for IPCRequestCtx %d was non-null upon re-use.", i );
+                    }
+
+                    pxRequestCtx->xCallback = NULL;
+                    pxRequestCtx->pvCallbackCtx = NULL;
 
-                /* Allocate a tx pbuf */
-                pxRequestCtx->pxTxPbuf = PBUF_ALLOC_TX( xPbufLen );
-/*                LogDebug( "Allocated pbuf: %p length: %d ref: %d",  pxRequestCtx->pxTxPbuf, pxRequestCtx->pxRxPbuf->tot_len, pxRequestCtx->pxRxPbuf->ref ); */
-                break;
+                    /* Allocate a tx pbuf */
+                    pxRequestCtx->pxTxPbuf = PBUF_ALLOC_TX( xPbufLen );
+/*                    LogDebug( "Allocated pbuf: %p length: %d ref: %d",  pxRequestCtx->pxTxPbuf, pxRequestCtx->pxRxPbuf->tot_len, pxRequestCtx->pxRxPbuf->ref ); */
+                    break;
+                }
             }
+
+            xResult = xSemaphoreGive( xContextArrayMutex );
+
+            configASSERT( xResult == pdTRUE );
         }
+        else
+        {
+            LogError( "Timed out while acquiring xContextArrayMutex." );
 
-        xResult = xSemaphoreGive( xContextArrayMutex );
+            /* Return the token taken above */
+            ( void ) xSemaphoreGive( xContextCountSemaphore );
+        }
+    }
 
-        configASSERT( xResult == pdTRUE );
+    /* Failing to allocate the TX pbuf releases the context */
+    if( ( pxRequestCtx != NULL ) &&
+        ( pxRequestCtx->pxTxPbuf == NULL ) )
+    {
+        LogError( "Failed to allocate a pbuf for IPC request." );
+        vClearCtx( pxRequestCtx );
+        pxRequestCtx = NULL;
+    }
+
+    return pxRequestCtx;
+}
+
+/*
+ * @brief Copy a request into the context's TX pbuf and hand it to the dataplane thread.
+ */
+static IPCError_t xQueueIPCRequest( IPCRequestCtx_t * pxRequestCtx,
+                                    IPCPacket_t * pxTxPkt,
+                                    uint32_t ulTxPacketLen,
+                                    TickType_t xTimeout )
+{
+    IPCError_t xReturnValue = IPC_SUCCESS;
+    BaseType_t xResult = pdFALSE;
+
+    LogDebug( "Sending IPC packet with request_id: %d, api_id: %d, total_len: %d",
+              pxRequestCtx->ulRequestID, pxTxPkt->xHeader.usIPCApiId, ulTxPacketLen );
+
+    /* Set request ID */
+    pxTxPkt->xHeader.ulIPCRequestId = pxRequestCtx->ulRequestID;
+
+    /* Copy to pbuf */
+    ( void ) memcpy( pxRequestCtx->pxTxPbuf->payload, pxTxPkt, ulTxPacketLen );
+
+    configASSERT( pxControlPlaneCtx->xControlPlaneSendQueue != NULL );
+
+    /* Send to dataplane thread for transmission */
+    xResult = xQueueSend( pxControlPlaneCtx->xControlPlaneSendQueue,
+                          &( pxRequestCtx->pxTxPbuf ),
+                          xTimeout );
+
+    if( xResult != pdTRUE )
+    {
+        LogError( "Error when sending message with request id=%d", pxRequestCtx->ulRequestID );
+        xReturnValue = IPC_ERROR_INTERNAL;
     }
     else
     {
-        LogError( "Timed out while acquiring xContextArrayMutex." );
+        Atomic_Increment_u32( pxControlPlaneCtx->pulTxPacketsWaiting );
+
+        /* Clear the pointer. Reference is now owned by the queue. */
+        pxRequestCtx->pxTxPbuf = NULL;
+
+        configASSERT( pxControlPlaneCtx->xDataPlaneTaskHandle != NULL );
+
+        /* Notify dataplane thread of a waiting message */
+        xTaskNotifyGiveIndexed( pxControlPlaneCtx->xDataPlaneTaskHandle, DATA_WAITING_IDX );
     }
 
-    return pxRequestCtx;
+    return xReturnValue;
 }
 
 static IPCError_t xSendIPCRequest( IPCPacket_t * pxTxPkt,
@@ -179,14 +256,14 @@ static IPCError_t xSendIPCRequest( IPCPacket_t * pxTxPkt,
                   ( pxResponse == NULL && ulResponseLength == 0 ) );
 
     BaseType_t ulTxPacketLen = sizeof( IPCHeader_t ) + ulTxPacketDataLen;
-    BaseType_t xResult = pdFALSE;
+
+    TimeOut_t xTimeOut;
+
+    vTaskSetTimeOutState( &xTimeOut );
 
     /* Allocate a request context */
     IPCRequestCtx_t * pxRequestCtx = pxFindAvailableCtx( xTimeout, ulTxPacketLen );
 
-    LogDebug( "Sending IPC packet with request_id: %d, api_id: %d, pktdatalen: %d, total_len: %d",
-              pxRequestCtx->ulRequestID, pxTxPkt->xHeader.usIPCApiId, ulTxPacketDataLen, ulTxPacketLen );
-
     if( pxRequestCtx == NULL )
     {
         LogError( "Timed out while finding a request context." );
@@ -194,50 +271,28 @@ static IPCError_t xSendIPCRequest( IPCPacket_t * pxTxPkt,
     }
     else
     {
-        /* Set request ID */
-        pxTxPkt->xHeader.ulIPCRequestId = pxRequestCtx->ulRequestID;
-
         /* Set task handle */
         pxRequestCtx->xWaitingTask = xTaskGetCurrentTaskHandle();
 
-        /* Copy to pbuf */
-        ( void ) memcpy( pxRequestCtx->pxTxPbuf->payload, pxTxPkt, ulTxPacketLen );
-
-        configASSERT( pxControlPlaneCtx->xControlPlaneSendQueue != NULL );
+        ( void ) xTaskCheckForTimeOut( &xTimeOut, &xTimeout );
 
-        /* Send to dataplane thread for transmission */
-        xResult = xQueueSend( pxControlPlaneCtx->xControlPlaneSendQueue,
-                              &( pxRequestCtx->pxTxPbuf ),
-                              xTimeout );
-
-        Atomic_Increment_u32( pxControlPlaneCtx->pulTxPacketsWaiting );
-
-        if( xResult != pdTRUE )
-        {
-            LogError( "Error when sending message with request id=%d", pxRequestCtx->ulRequestID );
-            xReturnValue = IPC_ERROR_INTERNAL;
-        }
-        else
-        {
-            /* Clear the pointer. Reference is now owned by the queue. */
-            pxRequestCtx->pxTxPbuf = NULL;
-
-            configASSERT( pxControlPlaneCtx->xDataPlaneTaskHandle != NULL );
-
-            /* Notify dataplane thread of a waiting message */
-            xTaskNotifyGiveIndexed( pxControlPlaneCtx->xDataPlaneTaskHandle, DATA_WAITING_IDX );
-        }
+        xReturnValue = xQueueIPCRequest( pxRequestCtx, pxTxPkt, ulTxPacketLen, xTimeout );
     }
 
     IPCPacket_t * pxResponsePacket = NULL;
 
-    /* If the message was sent successfully, wait for a task notification */
-    if( xResult == pdTRUE )
+    /* If the message was sent successfully, wait for the router to deliver the response */
+    if( ( pxRequestCtx != NULL ) &&
+        ( xReturnValue == IPC_SUCCESS ) )
     {
-        /* Wait for notification */
-        xResult = xTaskNotifyWait( 0, 0, NULL, xTimeout );
+        /* Ignore stale notifications left over from earlier timed out requests */
+        while( ( pxRequestCtx->pxRxPbuf == NULL ) &&
+               ( xTaskCheckForTimeOut( &xTimeOut, &xTimeout ) == pdFALSE ) )
+        {
+            ( void ) xTaskNotifyWait( 0, 0, NULL, xTimeout );
+        }
 
-        if( xResult == pdTRUE )
+        if( pxRequestCtx->pxRxPbuf != NULL )
         {
             pxResponsePacket = ( IPCPacket_t * ) pxRequestCtx->pxRxPbuf->payload;
         }
@@ -262,6 +317,161 @@ static IPCError_t xSendIPCRequest( IPCPacket_t * pxTxPkt,
     return xReturnValue;
 }
 
+/*
+ * @brief Send a request without waiting for the response.
+ * xCallback is called from the control plane router task once the response arrives
+ * or, with IPC_TIMEOUT, once xTimeout ticks have elapsed.
+ */
+static IPCError_t xSendIPCRequestAsync( IPCPacket_t * pxTxPkt,
+                                        uint32_t ulTxPacketDataLen,
+                                        MxRequestCallback_t xCallback,
+                                        void * pvCallbackCtx,
+                                        TickType_t xTimeout )
+{
+    IPCError_t xReturnValue = IPC_SUCCESS;
+
+    /* Validate inputs */
+    configASSERT( pxTxPkt != NULL );
+
+    configASSERT( ulTxPacketDataLen <= sizeof( IPCPacketData_t ) );
+
+    BaseType_t ulTxPacketLen = sizeof( IPCHeader_t ) + ulTxPacketDataLen;
+    IPCRequestCtx_t * pxRequestCtx = NULL;
+
+    if( xCallback == NULL )
+    {
+        xReturnValue = IPC_PARAMETER_ERROR;
+    }
+    else
+    {
+        /* Do not block the caller when all request contexts are in use */
+        pxRequestCtx = pxFindAvailableCtx( 0, ulTxPacketLen );
+
+        if( pxRequestCtx == NULL )
+        {
+            LogWarn( "No request context available for asynchronous request." );
+            xReturnValue = IPC_ERROR_INTERNAL;
+        }
+    }
+
+    if( pxRequestCtx != NULL )
+    {
+        /* Set the completion fields under the mutex so the router sees them all at once */
+        BaseType_t xResult = xSemaphoreTake( xContextArrayMutex, portMAX_DELAY );
+
+        configASSERT( xResult == pdTRUE );
+
+        pxRequestCtx->pvCallbackCtx = pvCallbackCtx;
+        pxRequestCtx->xStartTick = xTaskGetTickCount();
+        pxRequestCtx->xTimeout = xTimeout;
+        pxRequestCtx->xCallback = xCallback;
+
+        xResult = xSemaphoreGive( xContextArrayMutex );
+
+        configASSERT( xResult == pdTRUE );
+
+        xReturnValue = xQueueIPCRequest( pxRequestCtx, pxTxPkt, ulTxPacketLen, 0 );
+    }
+
+    if( xReturnValue == IPC_SUCCESS )
+    {
+        /* Wake the router so that it accounts for the new deadline */
+        configASSERT( xControlPlaneTaskHandle != NULL );
+        ( void ) xTaskNotifyGiveIndexed( xControlPlaneTaskHandle, CONTROL_RESP_WAITING_IDX );
+    }
+    else if( pxRequestCtx != NULL )
+    {
+        vClearCtx( pxRequestCtx );
+    }
+    else
+    {
+        /* No context to release */
+    }
+
+    return xReturnValue;
+}
+
+/*
+ * @brief Call the completion callback of an asynchronous request and release its context.
+ * Must be called from the control plane router task without holding xContextArrayMutex.
+ */
+static void vCompleteAsyncRequest( IPCRequestCtx_t * pxRequestCtx,
+                                   IPCError_t xError,
+                                   PacketBuffer_t * pxRxPbuf )
+{
+    const void * pvResponse = NULL;
+    uint32_t ulResponseLength = 0;
+
+    if( ( pxRxPbuf != NULL ) &&
+        ( pxRxPbuf->tot_len > sizeof( IPCHeader_t ) ) )
+    {
+        pvResponse = &( ( ( IPCPacket_t * ) pxRxPbuf->payload )->xData );
+        ulResponseLength = pxRxPbuf->tot_len - sizeof( IPCHeader_t );
+    }
+
+    pxRequestCtx->xCallback( xError, pvResponse, ulResponseLength, pxRequestCtx->pvCallbackCtx );
+
+    vClearCtx( pxRequestCtx );
+}
+
+/*
+ * @brief Time out any asynchronous requests which are past their deadline.
+ * @return Ticks until the next outstanding asynchronous request deadline, or portMAX_DELAY.
+ */
+static TickType_t xExpireAsyncRequests( void )
+{
+    TickType_t xWaitTicks = portMAX_DELAY;
+    BaseType_t xExpired;
+
+    do
+    {
+        IPCRequestCtx_t * pxExpiredCtx = NULL;
+        TickType_t xNow = xTaskGetTickCount();
+
+        xExpired = pdFALSE;
+        xWaitTicks = portMAX_DELAY;
+
+        ( void ) xSemaphoreTake( xContextArrayMutex, portMAX_DELAY );
+
+        for( uint32_t i = 0; i < NUM_IPC_REQUEST_CTX; i++ )
+        {
+            IPCRequestCtx_t * pxRequestCtx = &( xIPCRequestCtxArray[ i ] );
+
+            if( ( pxRequestCtx->ulRequestID != 0 ) &&
+                ( pxRequestCtx->xCallback != NULL ) )
+            {
+                TickType_t xElapsed = xNow - pxRequestCtx->xStartTick;
+
+                if( xElapsed >= pxRequestCtx->xTimeout )
+                {
+                    pxExpiredCtx = pxRequestCtx;
+                    break;
+                }
+                else if( ( pxRequestCtx->xTimeout - xElapsed ) < xWaitTicks )
+                {
+                    xWaitTicks = pxRequestCtx->xTimeout - xElapsed;
+                }
+                else
+                {
+                    /* Later deadline */
+                }
+            }
+        }
+
+        ( void ) xSemaphoreGive( xContextArrayMutex );
+
+        if( pxExpiredCtx != NULL )
+        {
+            LogWarn( "Asynchronous request with RequestId: %d timed out.", pxExpiredCtx->ulRequestID );
+            vCompleteAsyncRequest( pxExpiredCtx, IPC_TIMEOUT, NULL );
+            xExpired = pdTRUE;
+        }
+    }
+    while( xExpired == pdTRUE );
+
+    return xWaitTicks;
+}
+
 IPCError_t mx_RequestVersion( char * pcVersionBuffer,
                               uint32_t ulVersionLength,
                               TickType_t xTimeout )
@@ -326,9 +536,13 @@ IPCError_t mx_GetMacAddress( MacAddress_t * pxMacAddress,
     return xReturnValue;
 }
 
-IPCError_t mx_Connect( const char * pcSSID,
-                       const char * pcPSK,
-                       TickType_t xTimeout )
+/*
+ * @brief Validate connect parameters and fill in an IPC_WIFI_CONNECT request.
+ */
+static IPCError_t xPrepareConnectRequest( IPCPacket_t * pxTxPkt,
+                                          const char * pcSSID,
+                                          const char * pcPSK,
+                                          const MxApInfo_t * pxApInfo )
 {
     IPCError_t xReturnValue = IPC_SUCCESS;
 
@@ -361,38 +575,127 @@ IPCError_t mx_Connect( const char * pcSSID,
 
     if( xReturnValue == IPC_SUCCESS )
     {
-        IPCPacket_t xTxPkt;
+        pxTxPkt->xHeader.usIPCApiId = IPC_WIFI_CONNECT;
 
-        xTxPkt.xHeader.usIPCApiId = IPC_WIFI_CONNECT;
+        pxTxPkt->xData.xRequestWifiConnect.ucUseStaticIp = pdFALSE;
 
-        xTxPkt.xData.xRequestWifiConnect.ucUseAttr = pdFALSE;
-        xTxPkt.xData.xRequestWifiConnect.ucUseStaticIp = pdFALSE;
-        xTxPkt.xData.xRequestWifiConnect.ucAccessPointChannel = 0;
-        xTxPkt.xData.xRequestWifiConnect.ucSecurityType = 0;
+        if( pxApInfo != NULL )
+        {
+            /* Skip the scan and associate directly with the given access point */
+            pxTxPkt->xData.xRequestWifiConnect.ucUseAttr = pdTRUE;
+            pxTxPkt->xData.xRequestWifiConnect.ucAccessPointChannel = pxApInfo->ucChannel;
+            pxTxPkt->xData.xRequestWifiConnect.ucSecurityType = pxApInfo->ucSecurity;
+
+            ( void ) memcpy( &( pxTxPkt->xData.xRequestWifiConnect.ucAccessPointBssid ),
+                             &( pxApInfo->xBssid ), MX_BSSID_LEN );
+        }
+        else
+        {
+            pxTxPkt->xData.xRequestWifiConnect.ucUseAttr = pdFALSE;
+            pxTxPkt->xData.xRequestWifiConnect.ucAccessPointChannel = 0;
+            pxTxPkt->xData.xRequestWifiConnect.ucSecurityType = 0;
 
-        ( void ) memset( &( xTxPkt.xData.xRequestWifiConnect.ucAccessPointBssid ),
-                         0, MX_BSSID_LEN );
-        ( void ) memset( &( xTxPkt.xData.xRequestWifiConnect.xStaticIpInfo ),
+            ( void ) memset( &( pxTxPkt->xData.xRequestWifiConnect.ucAccessPointBssid ),
+                             0, MX_BSSID_LEN );
+        }
+        ( void ) memset( &( pxTxPkt->xData.xRequestWifiConnect.xStaticIpInfo ),
                          0, sizeof( IPInfoType_t ) );
 
 
-        ( void ) strncpy( xTxPkt.xData.xRequestWifiConnect.cSSID,
+        ( void ) strncpy( pxTxPkt->xData.xRequestWifiConnect.cSSID,
                           pcSSID,
                           MX_SSID_BUF_LEN );
 
-        xTxPkt.xData.xRequestWifiConnect.lKeyLength = lPSKLength;
+        pxTxPkt->xData.xRequestWifiConnect.lKeyLength = lPSKLength;
 
-        ( void ) strncpy( xTxPkt.xData.xRequestWifiConnect.cPSK,
+        ( void ) strncpy( pxTxPkt->xData.xRequestWifiConnect.cPSK,
                           pcPSK,
                           MX_PSK_BUF_LEN );
+    }
+
+    return xReturnValue;
+}
+
+IPCError_t mx_Connect( const char * pcSSID,
+                       const char * pcPSK,
+                       TickType_t xTimeout )
+{
+    IPCPacket_t xTxPkt;
+
+    IPCError_t xReturnValue = xPrepareConnectRequest( &xTxPkt, pcSSID, pcPSK, NULL );
+
+    if( xReturnValue == IPC_SUCCESS )
+    {
+        xReturnValue = xSendIPCRequest( &xTxPkt,
+                                        sizeof( IPCRequestWifiConnect_t ),
+                                        NULL,
+                                        0,
+                                        xTimeout );
+    }
+
+    return xReturnValue;
+}
+
+IPCError_t mx_ConnectToBssid( const char * pcSSID,
+                              const char * pcPSK,
+                              const MxApInfo_t * pxApInfo,
+                              TickType_t xTimeout )
+{
+    IPCPacket_t xTxPkt;
+    IPCError_t xReturnValue = IPC_PARAMETER_ERROR;
 
+    if( pxApInfo != NULL )
+    {
+        xReturnValue = xPrepareConnectRequest( &xTxPkt, pcSSID, pcPSK, pxApInfo );
+    }
 
+    if( xReturnValue == IPC_SUCCESS )
+    {
         xReturnValue = xSendIPCRequest( &xTxPkt,
                                         sizeof( IPCRequestWifiConnect_t ),
                                         NULL,
                                         0,
                                         xTimeout );
     }
+
+    return xReturnValue;
+}
+
+IPCError_t mx_GetApInfo( MxApInfo_t * pxApInfo,
+                         TickType_t xTimeout )
+{
+    IPCError_t xReturnValue = IPC_SUCCESS;
+
+    if( pxApInfo != NULL )
+    {
+        IPCPacket_t xTxPkt;
+        IPCResponseWifiGetLinkInfo_t xLinkInfo = { 0 };
+
+        xTxPkt.xHeader.usIPCApiId = IPC_WIFI_GET_LINKINFO;
+
+        xReturnValue = xSendIPCRequest( &xTxPkt,
+                                        0,
+                                        &xLinkInfo,
+                                        sizeof( IPCResponseWifiGetLinkInfo_t ),
+                                        xTimeout );
+
+        if( ( xReturnValue == IPC_SUCCESS ) &&
+            ( ( xLinkInfo.lStatus != IPC_SUCCESS ) ||
+              ( xLinkInfo.lIsConnected == 0 ) ) )
+        {
+            xReturnValue = IPC_ERROR;
+        }
+
+        if( xReturnValue == IPC_SUCCESS )
+        {
+            ( void ) memcpy( &( pxApInfo->xBssid ), xLinkInfo.ucBssid, MX_BSSID_LEN );
+            pxApInfo->ucChannel = ( uint8_t ) xLinkInfo.lChannel;
+            pxApInfo->ucSecurity = ( uint8_t ) xLinkInfo.ulSecurity;
+        }
+
+        /* Clear sensitive data */
+        ( void ) memset( xLinkInfo.cKey, 0, MX_PSK_BUF_LEN );
+    }
     else
     {
         xReturnValue = IPC_PARAMETER_ERROR;
@@ -401,6 +704,28 @@ IPCError_t mx_Connect( const char * pcSSID,
     return xReturnValue;
 }
 
+IPCError_t mx_ConnectAsync( const char * pcSSID,
+                            const char * pcPSK,
+                            MxRequestCallback_t xCallback,
+                            void * pvCallbackCtx,
+                            TickType_t xTimeout )
+{
+    IPCPacket_t xTxPkt;
+
+    IPCError_t xReturnValue = xPrepareConnectRequest( &xTxPkt, pcSSID, pcPSK, NULL );
+
+    if( xReturnValue == IPC_SUCCESS )
+    {
+        xReturnValue = xSendIPCRequestAsync( &xTxPkt,
+                                             sizeof( IPCRequestWifiConnect_t ),
+                                             xCallback,
+                                             pvCallbackCtx,
+                                             xTimeout );
+    }
+
+    return xReturnValue;
+}
+
 IPCError_t mx_Disconnect( TickType_t xTimeout )
 {
     IPCError_t xReturnValue = IPC_SUCCESS;
@@ -416,6 +741,23 @@ IPCError_t mx_Disconnect( TickType_t xTimeout )
     return xReturnValue;
 }
 
+IPCError_t mx_DisconnectAsync( MxRequestCallback_t xCallback,
+                               void * pvCallbackCtx,
+                               TickType_t xTimeout )
+{
+    IPCError_t xReturnValue = IPC_SUCCESS;
+
+    IPCPacket_t xTxPkt;
+
+    xTxPkt.xHeader.usIPCApiId = IPC_WIFI_DISCONNECT;
+
+    xReturnValue = xSendIPCRequestAsync( &xTxPkt, 0,
+                                         xCallback, pvCallbackCtx,
+                                         xTimeout );
+
+    return xReturnValue;
+}
+
 IPCError_t mx_SetBypassMode( BaseType_t xEnable,
                              TickType_t xTimeout )
 {
@@ -440,6 +782,29 @@ IPCError_t mx_SetBypassMode( BaseType_t xEnable,
     return xError;
 }
 
+IPCError_t mx_SetPowerSave( BaseType_t xEnable,
+                            TickType_t xTimeout )
+{
+    IPCError_t xError = IPC_SUCCESS;
+
+    IPCPacket_t xTxPkt;
+
+    if( ( xEnable == pdFALSE ) ||
+        ( xEnable == pdTRUE ) )
+    {
+        xTxPkt.xHeader.usIPCApiId = ( xEnable == pdTRUE ) ? IPC_WIFI_PS_ON : IPC_WIFI_PS_OFF;
+        xError = xSendIPCRequest( &xTxPkt, 0,
+                                  NULL, 0,
+                                  xTimeout );
+    }
+    else
+    {
+        xError = IPC_PARAMETER_ERROR;
+    }
+
+    return xError;
+}
+
 IPCError_t mx_RegisterEventCallback( MxEventCallback_t xCallback,
                                      void * pxCallbackContext )
 {
@@ -489,22 +854,31 @@ void prvControlPlaneRouter( void * pvParameters )
         xIPCRequestCtxArray[ i ].pxTxPbuf = NULL;
         xIPCRequestCtxArray[ i ].pxRxPbuf = NULL;
         xIPCRequestCtxArray[ i ].xWaitingTask = NULL;
+        xIPCRequestCtxArray[ i ].xCallback = NULL;
+        xIPCRequestCtxArray[ i ].pvCallbackCtx = NULL;
     }
 
     xSemaphoreGive( xContextArrayMutex );
 
+    xControlPlaneTaskHandle = xTaskGetCurrentTaskHandle();
+
+    vMxRingSetConsumer( pxCtx->pxControlPlaneResponseRing );
+
     while( 1 )
     {
         PacketBuffer_t * pxRxPbuf = NULL;
 
-        /* Block on the input message queue */
-        xResult = xMessageBufferReceive( pxCtx->xControlPlaneResponseBuff,
-                                         &pxRxPbuf,
-                                         sizeof( PacketBuffer_t * ),
-                                         portMAX_DELAY );
+        xResult = xMxRingPop( pxCtx->pxControlPlaneResponseRing, ( void ** ) &pxRxPbuf );
 
-        if( ( xResult != pdFALSE ) &&
-            ( pxRxPbuf != NULL ) )
+        if( xResult == pdFALSE )
+        {
+            /*
+             * Block until the dataplane thread adds a response to the empty ring,
+             * a new asynchronous request is sent, or the next asynchronous request deadline.
+             */
+            ( void ) ulTaskNotifyTakeIndexed( CONTROL_RESP_WAITING_IDX, pdTRUE, xExpireAsyncRequests() );
+        }
+        else if( pxRxPbuf != NULL )
         {
             IPCPacket_t * pxRxPacket = ( IPCPacket_t * ) pxRxPbuf->payload;
 
@@ -540,6 +914,7 @@ void prvControlPlaneRouter( void * pvParameters )
                 configASSERT( xResult == pdTRUE );
 
                 IPCRequestCtx_t * pxTargetCtx = NULL;
+                IPCRequestCtx_t * pxAsyncCtx = NULL;
 
                 for( uint32_t i = 0; i < NUM_IPC_REQUEST_CTX; i++ )
                 {
@@ -550,8 +925,17 @@ void prvControlPlaneRouter( void * pvParameters )
                     }
                 }
 
-                /* Send packet to waiting thread */
+                /* Complete an asynchronous request once the mutex has been released */
                 if( ( pxTargetCtx != NULL ) &&
+                    ( pxTargetCtx->pxRxPbuf == NULL ) &&
+                    ( pxTargetCtx->xCallback != NULL ) )
+                {
+                    pbuf_ref( pxRxPbuf );
+                    pxTargetCtx->pxRxPbuf = pxRxPbuf;
+                    pxAsyncCtx = pxTargetCtx;
+                }
+                /* Send packet to waiting thread */
+                else if( ( pxTargetCtx != NULL ) &&
                     ( pxTargetCtx->pxRxPbuf == NULL ) &&
                     ( pxTargetCtx->xWaitingTask != NULL ) )
                 {
@@ -582,6 +966,11 @@ void prvControlPlaneRouter( void * pvParameters )
                 /* Return the mutex */
                 xResult = xSemaphoreGive( xContextArrayMutex );
                 configASSERT( xResult == pdTRUE );
+
+                if( pxAsyncCtx != NULL )
+                {
+                    vCompleteAsyncRequest( pxAsyncCtx, IPC_SUCCESS, pxAsyncCtx->pxRxPbuf );
+                }
             }
 
             LogDebug( "Decreasing reference count of pxRxPbuf %p from %d to %d", pxRxPbuf, pxRxPbuf->ref, ( pxRxPbuf->ref - 1 ) );
@@ -589,7 +978,7 @@ void prvControlPlaneRouter( void * pvParameters )
         }
         else
         {
-            LogError( "Error when reading from xControlPlaneResponseBuff" );
+            LogError( "NULL packet read from pxControlPlaneResponseRing" );
         }
     }
 }
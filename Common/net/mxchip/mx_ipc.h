@@ -59,6 +59,25 @@ typedef enum
 typedef void ( * MxEventCallback_t )( MxStatus_t,
                                       void * );
 
+/* Parameters of the access point the module is associated with */
+typedef struct
+{
+    struct eth_addr xBssid;
+    uint8_t ucChannel;
+    uint8_t ucSecurity;
+} MxApInfo_t;
+
+/*
+ * @brief Completion callback for asynchronous requests.
+ * Called from the control plane router task with the response payload, or with
+ * IPC_TIMEOUT and a NULL payload if no response arrived in time.
+ * Must not block or issue synchronous mx_* requests.
+ */
+typedef void ( * MxRequestCallback_t )( IPCError_t xError,
+                                        const void * pvResponse,
+                                        uint32_t ulResponseLength,
+                                        void * pvCallbackCtx );
+
 IPCError_t mx_RequestVersion( char * pcVersionBuffer,
                               uint32_t ulVersionLength,
                               TickType_t xTimeout );
@@ -72,11 +91,36 @@ IPCError_t mx_Connect( const char * pcSSID,
                        const char * pcPSK,
                        TickType_t xTimeout );
 
+IPCError_t mx_ConnectToBssid( const char * pcSSID,
+                              const char * pcPSK,
+                              const MxApInfo_t * pxApInfo,
+                              TickType_t xTimeout );
+
+IPCError_t mx_GetApInfo( MxApInfo_t * pxApInfo,
+                         TickType_t xTimeout );
+
+IPCError_t mx_ConnectAsync( const char * pcSSID,
+                            const char * pcPSK,
+                            MxRequestCallback_t xCallback,
+                            void * pvCallbackCtx,
+                            TickType_t xTimeout );
+
 IPCError_t mx_Disconnect( TickType_t xTimeout );
 
+IPCError_t mx_DisconnectAsync( MxRequestCallback_t xCallback,
+                               void * pvCallbackCtx,
+                               TickType_t xTimeout );
+
 IPCError_t mx_SetBypassMode( BaseType_t xEnable,
                              TickType_t xTimeout );
 
+/*
+ * @brief Enable or disable the module power save mode, in which the radio only
+ * wakes up for the DTIM beacons of the access point while the link is idle.
+ */
+IPCError_t mx_SetPowerSave( BaseType_t xEnable,
+                            TickType_t xTimeout );
+
 IPCError_t mx_RegisterEventCallback( MxEventCallback_t pvCallback,
                                      void * pxCallbackContext );
 
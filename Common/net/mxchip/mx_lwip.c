@@ -24,16 +24,30 @@
 #include "logging_levels.h"
 
 #define LOG_LEVEL    LOG_ERROR
+#define LOG_MODULE    LOG_MODULE_NET
 
 #include "logging.h"
 
 #include "mx_lwip.h"
+#include "lwip/prot/ip4.h"
+#include "lwip/tcpip.h"
+#include "lwip/dhcp.h"
+#include "lwip/dns.h"
+#include "lwip/etharp.h"
+#include "lwip/timeouts.h"
+#include "netif/ethernet.h"
 
 #include "FreeRTOS.h"
+#include "timers.h"
 #include "atomic.h"
+#include "kvstore.h"
 #include "mx_prv.h"
 
-static void vAddMXHeaderToEthernetFrame( PacketBuffer_t * pxTxPacket )
+/*
+ * @brief Prepend a BypassInOut_t header to an outgoing ethernet frame in place.
+ * @return pdTRUE on success, pdFALSE if the first pbuf has no room for the header.
+ */
+static BaseType_t xAddMXHeaderToEthernetFrame( PacketBuffer_t * pxTxPacket )
 {
     configASSERT( pxTxPacket != NULL );
 
@@ -41,26 +55,68 @@ static void vAddMXHeaderToEthernetFrame( PacketBuffer_t * pxTxPacket )
     uint16_t ulEthPacketLen = pxTxPacket->tot_len;
 
     /* Adjust pbuf size to include BypassInOut_t header */
-    uint8_t cErr = pbuf_header( pxTxPacket, sizeof( BypassInOut_t ) );
-
-    configASSERT( cErr == 0 );
+    BaseType_t xResult = ( pbuf_add_header( pxTxPacket, sizeof( BypassInOut_t ) ) == 0 );
 
-    /* Add on bypass header */
-    BypassInOut_t * pxBypassHeader = ( BypassInOut_t * ) pxTxPacket->payload;
+    if( xResult == pdTRUE )
+    {
+        /* Add on bypass header */
+        BypassInOut_t * pxBypassHeader = ( BypassInOut_t * ) pxTxPacket->payload;
 
-    pxBypassHeader->xHeader.usIPCApiId = IPC_WIFI_BYPASS_OUT;
-    pxBypassHeader->xHeader.ulIPCRequestId = prvGetNextRequestID();
+        pxBypassHeader->xHeader.usIPCApiId = IPC_WIFI_BYPASS_OUT;
+        pxBypassHeader->xHeader.ulIPCRequestId = prvGetNextRequestID();
 
-    /* Send to station interface */
-    pxBypassHeader->lIndex = WIFI_BYPASS_MODE_STATION;
+        /* Send to station interface */
+        pxBypassHeader->lIndex = WIFI_BYPASS_MODE_STATION;
 
-    /* Fill pad region with zeros */
-    ( void ) memset( pxBypassHeader->ucPad, 0, MX_BYPASS_PAD_LEN );
+        /* Fill pad region with zeros */
+        ( void ) memset( pxBypassHeader->ucPad, 0, MX_BYPASS_PAD_LEN );
 
-    /* Set length field */
-    pxBypassHeader->usDataLen = ulEthPacketLen;
+        /* Set length field */
+        pxBypassHeader->usDataLen = ulEthPacketLen;
+    }
 
     configASSERT( pxTxPacket->ref >= 1 );
+
+    return xResult;
+}
+
+/*
+ * @brief Determine if an outgoing ethernet frame should use the latency-critical TX queue.
+ */
+static BaseType_t xIsPriorityFrame( const PacketBuffer_t * pxPbuf )
+{
+    BaseType_t xPriority = pdFALSE;
+    const struct eth_hdr * pxEthHeader = ( const struct eth_hdr * ) pxPbuf->payload;
+
+    if( pxPbuf->len >= SIZEOF_ETH_HDR )
+    {
+        switch( lwip_htons( pxEthHeader->type ) )
+        {
+            case ETHTYPE_ARP:
+                xPriority = pdTRUE;
+                break;
+
+            case ETHTYPE_IP:
+
+                if( pxPbuf->len >= ( SIZEOF_ETH_HDR + IP_HLEN ) )
+                {
+                    const struct ip_hdr * pxIpHeader = ( const struct ip_hdr * ) ( ( const uint8_t * ) pxPbuf->payload + SIZEOF_ETH_HDR );
+
+                    if( ( ( IPH_TOS( pxIpHeader ) >> 2 ) >= MX_TX_PRIO_DSCP_MIN ) ||
+                        ( pxPbuf->tot_len <= MX_TX_PRIO_FRAME_LEN ) )
+                    {
+                        xPriority = pdTRUE;
+                    }
+                }
+
+                break;
+
+            default:
+                break;
+        }
+    }
+
+    return xPriority;
 }
 
 /* Callback for lwip netif events
@@ -117,6 +173,347 @@ static void vLwipStatusCallback( struct netif * pxNetif )
     xLastFlags = pxNetif->flags;
 }
 
+#if ( MX_NET_IMPAIR_ENABLED == 1 )
+
+typedef struct
+{
+    PacketBuffer_t * pxPbuf; /* NULL when the slot is free */
+    TickType_t xHoldTick;    /* Tick the frame was held back at */
+    TickType_t xHoldTicks;   /* Ticks to hold it for */
+    uint32_t ulSeq;          /* Arrival order, to deliver frames due on the same tick in order */
+} MxImpairSlot_t;
+
+extern UBaseType_t uxRand( void );
+
+static NetImpairConfig_t xImpairConfig = { 0 };
+static NetImpairStats_t xImpairStats = { 0 };
+static volatile BaseType_t xImpairActive = pdFALSE;
+static uint32_t ulImpairRandom = 1;
+
+static MxImpairSlot_t xImpairSlots[ MX_IMPAIR_HOLD_SLOTS ];
+static uint32_t ulImpairSeq = 0;
+static NetInterface_t * pxImpairNetif = NULL;
+static TimerHandle_t xImpairTimer = NULL;
+static BaseType_t xImpairArmed = pdFALSE;
+static TickType_t xImpairArmedDue = 0;
+
+/* xorshift32, shared by the dataplane and sending tasks without locking */
+static uint32_t ulImpairRand( void )
+{
+    uint32_t ulValue = ulImpairRandom;
+
+    ulValue ^= ulValue << 13;
+    ulValue ^= ulValue >> 17;
+    ulValue ^= ulValue << 5;
+    ulImpairRandom = ulValue;
+
+    return ulValue;
+}
+
+static inline BaseType_t xImpairHit( uint32_t ulPermille )
+{
+    return( ( ulPermille > 0 ) && ( ( ulImpairRand() % 1000U ) < ulPermille ) );
+}
+
+/* Ticks left before a held frame is due, negative once overdue */
+static inline int32_t lImpairTicksLeft( const MxImpairSlot_t * pxSlot,
+                                        TickType_t xNow )
+{
+    return ( int32_t ) ( pxSlot->xHoldTicks - ( xNow - pxSlot->xHoldTick ) );
+}
+
+/* Runs in the timer task, passes the frames which are due to tcpip_thread */
+static void vImpairTimerCallback( TimerHandle_t xTimer )
+{
+    MxImpairSlot_t xDue[ MX_IMPAIR_HOLD_SLOTS ];
+    uint32_t ulDueCount = 0;
+    int32_t lNextTicks = INT32_MAX;
+    TickType_t xNow = xTaskGetTickCount();
+
+    taskENTER_CRITICAL();
+    {
+        for( uint32_t i = 0; i < MX_IMPAIR_HOLD_SLOTS; i++ )
+        {
+            if( xImpairSlots[ i ].pxPbuf == NULL )
+            {
+                /* Free slot */
+            }
+            else if( lImpairTicksLeft( &( xImpairSlots[ i ] ), xNow ) <= 0 )
+            {
+                uint32_t ulPos = ulDueCount;
+                int32_t lTicksLeft = lImpairTicksLeft( &( xImpairSlots[ i ] ), xNow );
+
+                /* Insertion sort by due tick, then arrival */
+                while( ( ulPos > 0 ) &&
+                       ( ( lImpairTicksLeft( &( xDue[ ulPos - 1 ] ), xNow ) > lTicksLeft ) ||
+                         ( ( lImpairTicksLeft( &( xDue[ ulPos - 1 ] ), xNow ) == lTicksLeft ) &&
+                           ( ( int32_t ) ( xDue[ ulPos - 1 ].ulSeq - xImpairSlots[ i ].ulSeq ) > 0 ) ) ) )
+                {
+                    xDue[ ulPos ] = xDue[ ulPos - 1 ];
+                    ulPos--;
+                }
+
+                xDue[ ulPos ] = xImpairSlots[ i ];
+                ulDueCount++;
+                xImpairSlots[ i ].pxPbuf = NULL;
+            }
+            else if( lImpairTicksLeft( &( xImpairSlots[ i ] ), xNow ) < lNextTicks )
+            {
+                lNextTicks = lImpairTicksLeft( &( xImpairSlots[ i ] ), xNow );
+            }
+        }
+
+        xImpairArmed = ( lNextTicks != INT32_MAX );
+        xImpairArmedDue = xNow + ( TickType_t ) lNextTicks;
+    }
+    taskEXIT_CRITICAL();
+
+    for( uint32_t i = 0; i < ulDueCount; i++ )
+    {
+        if( tcpip_input( xDue[ i ].pxPbuf, pxImpairNetif ) != ERR_OK )
+        {
+            PBUF_FREE( xDue[ i ].pxPbuf );
+        }
+    }
+
+    if( lNextTicks != INT32_MAX )
+    {
+        ( void ) xTimerChangePeriod( xTimer, ( TickType_t ) lNextTicks, 0 );
+    }
+}
+
+/*
+ * @brief Hold a received frame back for ulDelayMs.
+ * @return pdFALSE if all slots are in use and the frame should be passed on now.
+ */
+static BaseType_t xImpairHold( NetInterface_t * pxNetif,
+                               PacketBuffer_t * pxPbuf,
+                               uint32_t ulDelayMs )
+{
+    BaseType_t xHeld = pdFALSE;
+    BaseType_t xArm = pdFALSE;
+    TickType_t xNow = xTaskGetTickCount();
+    TickType_t xHoldTicks = pdMS_TO_TICKS( ulDelayMs );
+
+    if( xHoldTicks == 0 )
+    {
+        xHoldTicks = 1;
+    }
+
+    taskENTER_CRITICAL();
+    {
+        for( uint32_t i = 0; ( i < MX_IMPAIR_HOLD_SLOTS ) && ( xHeld == pdFALSE ); i++ )
+        {
+            if( xImpairSlots[ i ].pxPbuf == NULL )
+            {
+                xImpairSlots[ i ].pxPbuf = pxPbuf;
+                xImpairSlots[ i ].xHoldTick = xNow;
+                xImpairSlots[ i ].xHoldTicks = xHoldTicks;
+                xImpairSlots[ i ].ulSeq = ulImpairSeq++;
+                xHeld = pdTRUE;
+            }
+        }
+
+        /* Move the timer forward when this frame is due before the one it is armed for */
+        if( ( xHeld == pdTRUE ) &&
+            ( ( xImpairArmed == pdFALSE ) ||
+              ( ( int32_t ) ( xImpairArmedDue - ( xNow + xHoldTicks ) ) > 0 ) ) )
+        {
+            xImpairArmed = pdTRUE;
+            xImpairArmedDue = xNow + xHoldTicks;
+            xArm = pdTRUE;
+        }
+    }
+    taskEXIT_CRITICAL();
+
+    if( xHeld == pdTRUE )
+    {
+        pxImpairNetif = pxNetif;
+        xImpairStats.ulDelayed++;
+
+        if( xArm == pdTRUE )
+        {
+            /* A frame whose timer command is lost is still delivered with the next one */
+            ( void ) xTimerChangePeriod( xImpairTimer, xHoldTicks, 0 );
+        }
+    }
+    else
+    {
+        xImpairStats.ulHoldFull++;
+    }
+
+    return xHeld;
+}
+
+/*
+ * @brief Apply the link impairment to a received frame.
+ * @return pdTRUE if the frame was dropped or held back, pdFALSE to pass it on now.
+ */
+static BaseType_t xImpairInput( NetInterface_t * pxNetif,
+                                PacketBuffer_t * pxPbuf )
+{
+    BaseType_t xConsumed = pdFALSE;
+
+    if( xImpairActive == pdFALSE )
+    {
+        /* Not impaired */
+    }
+    else if( xImpairHit( xImpairConfig.ulRxDropPermille ) == pdTRUE )
+    {
+        PBUF_FREE( pxPbuf );
+        xImpairStats.ulRxDropped++;
+        xConsumed = pdTRUE;
+    }
+    else
+    {
+        uint32_t ulDelayMs = xImpairConfig.ulDelayMs;
+
+        /* A single bit error always fails the IP, TCP or UDP checksum */
+        if( ( pxPbuf->len > SIZEOF_ETH_HDR ) &&
+            ( xImpairHit( xImpairConfig.ulCorruptPermille ) == pdTRUE ) )
+        {
+            uint32_t ulRandom = ulImpairRand();
+            uint8_t * pucFrame = ( uint8_t * ) pxPbuf->payload;
+
+            pucFrame[ SIZEOF_ETH_HDR + ( ( ulRandom >> 3 ) % ( pxPbuf->len - SIZEOF_ETH_HDR ) ) ] ^= ( uint8_t ) ( 1U << ( ulRandom & 0x7U ) );
+            xImpairStats.ulCorrupted++;
+        }
+
+        if( xImpairConfig.ulJitterMs > 0 )
+        {
+            ulDelayMs += ulImpairRand() % ( xImpairConfig.ulJitterMs + 1 );
+        }
+
+        if( xImpairHit( xImpairConfig.ulReorderPermille ) == pdTRUE )
+        {
+            ulDelayMs += MX_IMPAIR_REORDER_MS;
+            xImpairStats.ulReordered++;
+        }
+
+        if( ulDelayMs > 0 )
+        {
+            xConsumed = xImpairHold( pxNetif, pxPbuf, ulDelayMs );
+        }
+    }
+
+    return xConsumed;
+}
+
+/* @return pdTRUE if a frame to be sent should be dropped */
+static inline BaseType_t xImpairOutput( void )
+{
+    BaseType_t xDrop = pdFALSE;
+
+    if( ( xImpairActive == pdTRUE ) &&
+        ( xImpairHit( xImpairConfig.ulTxDropPermille ) == pdTRUE ) )
+    {
+        xImpairStats.ulTxDropped++;
+        xDrop = pdTRUE;
+    }
+
+    return xDrop;
+}
+
+BaseType_t xMxImpairSpiError( void )
+{
+    BaseType_t xError = pdFALSE;
+
+    if( ( xImpairActive == pdTRUE ) &&
+        ( xImpairHit( xImpairConfig.ulSpiErrorPermille ) == pdTRUE ) )
+    {
+        xImpairStats.ulSpiErrors++;
+        xError = pdTRUE;
+    }
+
+    return xError;
+}
+
+BaseType_t net_set_impairment( const NetImpairConfig_t * pxConfig )
+{
+    NetImpairConfig_t xConfig = { 0 };
+    BaseType_t xActive;
+
+    if( pxConfig != NULL )
+    {
+        xConfig = *pxConfig;
+    }
+
+    xActive = ( ( xConfig.ulRxDropPermille | xConfig.ulTxDropPermille | xConfig.ulCorruptPermille |
+                  xConfig.ulReorderPermille | xConfig.ulDelayMs | xConfig.ulJitterMs |
+                  xConfig.ulSpiErrorPermille ) != 0 );
+
+    if( xImpairTimer == NULL )
+    {
+        xImpairTimer = xTimerCreate( "NetImpair", 1, pdFALSE, NULL, vImpairTimerCallback );
+        configASSERT( xImpairTimer != NULL );
+    }
+
+    taskENTER_CRITICAL();
+    {
+        xImpairConfig = xConfig;
+        ( void ) memset( &xImpairStats, 0, sizeof( NetImpairStats_t ) );
+        ulImpairRandom = ( uint32_t ) uxRand() | 1U;
+        xImpairActive = xActive;
+    }
+    taskEXIT_CRITICAL();
+
+    if( xActive == pdTRUE )
+    {
+        LogWarn( "Link impaired: rx drop %lu, tx drop %lu, corrupt %lu, reorder %lu, spi error %lu per mille, delay %lu +%lu ms.",
+                 xConfig.ulRxDropPermille, xConfig.ulTxDropPermille, xConfig.ulCorruptPermille,
+                 xConfig.ulReorderPermille, xConfig.ulSpiErrorPermille, xConfig.ulDelayMs, xConfig.ulJitterMs );
+    }
+    else
+    {
+        LogInfo( "Link impairment off." );
+    }
+
+    return pdTRUE;
+}
+
+BaseType_t net_get_impairment( NetImpairConfig_t * pxConfig,
+                               NetImpairStats_t * pxStats )
+{
+    taskENTER_CRITICAL();
+    {
+        if( pxConfig != NULL )
+        {
+            *pxConfig = xImpairConfig;
+        }
+
+        if( pxStats != NULL )
+        {
+            *pxStats = xImpairStats;
+        }
+    }
+    taskEXIT_CRITICAL();
+
+    return pdTRUE;
+}
+
+#else /* MX_NET_IMPAIR_ENABLED == 1 */
+
+#define xImpairInput( pxNetif, pxPbuf )    ( pdFALSE )
+#define xImpairOutput()                    ( pdFALSE )
+
+BaseType_t net_set_impairment( const NetImpairConfig_t * pxConfig )
+{
+    ( void ) pxConfig;
+
+    return pdFALSE;
+}
+
+BaseType_t net_get_impairment( NetImpairConfig_t * pxConfig,
+                               NetImpairStats_t * pxStats )
+{
+    ( void ) pxConfig;
+    ( void ) pxStats;
+
+    return pdFALSE;
+}
+
+#endif /* MX_NET_IMPAIR_ENABLED == 1 */
+
 /* Network output function for lwip */
 err_t prvxLinkOutput( NetInterface_t * pxNetif,
                       PacketBuffer_t * pxPbuf )
@@ -124,61 +521,83 @@ err_t prvxLinkOutput( NetInterface_t * pxNetif,
     err_t xError = ERR_OK;
     BaseType_t xReturn = pdFALSE;
     struct pbuf * pxPbufToSend = pxPbuf;
+    MxRing_t * pxTxRing = NULL;
+
+    /* Get context from netif struct */
+    MxNetConnectCtx_t * pxCtx = ( pxNetif != NULL ) ? ( MxNetConnectCtx_t * ) pxNetif->state : NULL;
 
     if( ( pxPbuf == NULL ) || ( pxNetif == NULL ) )
     {
         xError = ERR_VAL;
     }
-    /* Handle any chained packets */
-    else if( ( pxPbuf->len != pxPbuf->tot_len ) ||
-             ( pxPbuf->next != NULL ) )
+    else if( xImpairOutput() == pdTRUE )
     {
-        pxPbufToSend = pbuf_clone( PBUF_RAW, PBUF_RAM, pxPbuf );
-
-        if( pxPbufToSend == NULL )
-        {
-            xError = ERR_MEM;
-        }
-
-        /* Input buffer will be freed by lwip after the current function returns */
-        /* pbuf_clone sets the refcount = 1 upon creation */
+        /* Lost on the air as far as lwIP can tell */
+        pxPbufToSend = NULL;
     }
     else
     {
-        /* Increment reference counter */
+        /*
+         * Send the frame in place, including chained pbufs which are transferred
+         * segment by segment by the dataplane thread.
+         * Increment reference counter, lwip frees its own reference on return.
+         */
         pbuf_ref( pxPbufToSend );
+        pxTxRing = xIsPriorityFrame( pxPbufToSend ) ? pxCtx->pxDataPlanePrioSendRing : pxCtx->pxDataPlaneSendRing;
+
+        if( xAddMXHeaderToEthernetFrame( pxPbufToSend ) == pdFALSE )
+        {
+            /* No headroom for the bypass header, fall back to a copy with link encapsulation space */
+            PBUF_FREE( pxPbufToSend );
+
+            /* pbuf_clone sets the refcount = 1 upon creation */
+            pxPbufToSend = pbuf_clone( PBUF_RAW_TX, PBUF_RAM, pxPbuf );
+
+            if( pxPbufToSend == NULL )
+            {
+                xError = ERR_MEM;
+            }
+            else if( xAddMXHeaderToEthernetFrame( pxPbufToSend ) == pdFALSE )
+            {
+                PBUF_FREE( pxPbufToSend );
+                pxPbufToSend = NULL;
+                xError = ERR_BUF;
+            }
+        }
     }
 
 /*    vPrintBuffer("ETH_TX", pxPbuf->payload, pxPbuf->tot_len ); */
 
-    /* Get context from netif struct */
-    MxNetConnectCtx_t * pxCtx = ( MxNetConnectCtx_t * ) pxNetif->state;
+    configASSERT( pxCtx->pxDataPlaneSendRing != NULL );
+    configASSERT( pxCtx->pxDataPlanePrioSendRing != NULL );
 
-    if( xError == ERR_OK )
+    if( ( xError == ERR_OK ) &&
+        ( pxPbufToSend != NULL ) )
     {
-        vAddMXHeaderToEthernetFrame( pxPbuf );
-    }
-
-    configASSERT( pxCtx->xDataPlaneSendQueue != NULL );
-    configASSERT( pxCtx->pulTxPacketsWaiting != NULL );
-    configASSERT( pxCtx->xDataPlaneTaskHandle != NULL );
+        TickType_t xStartTick = xTaskGetTickCount();
 
-    if( xError == ERR_OK )
-    {
         configASSERT( pxPbufToSend != NULL );
-        xReturn = xQueueSend( pxCtx->xDataPlaneSendQueue,
-                              &pxPbufToSend,
-                              MX_ETH_PACKET_ENQUEUE_TIMEOUT );
+
+        /*
+         * The ring wakes the dataplane thread itself when it goes from empty to non-empty.
+         * When full, wait for the dataplane thread (which runs at a higher priority) to drain it,
+         * unless this is the dataplane thread sending from the direct input path.
+         */
+        xReturn = xMxRingPush( pxTxRing, pxPbufToSend );
+
+        while( ( xReturn == pdFALSE ) &&
+               ( xTaskGetCurrentTaskHandle() != pxCtx->xDataPlaneTaskHandle ) &&
+               ( ( xTaskGetTickCount() - xStartTick ) < MX_ETH_PACKET_ENQUEUE_TIMEOUT ) )
+        {
+            vTaskDelay( 1 );
+            xReturn = xMxRingPush( pxTxRing, pxPbufToSend );
+        }
 
         if( xReturn == pdTRUE )
         {
             xError = ERR_OK;
-            LogDebug( "Packet enqueued into xDataPlaneSendQueue addr: %p, len: %d, refs: %d, remaining space: %d",
-                      pxPbufToSend, pxPbufToSend->tot_len, pxPbufToSend->ref, uxQueueSpacesAvailable( pxCtx->xDataPlaneSendQueue ) );
-
-            ( void ) Atomic_Increment_u32( pxCtx->pulTxPacketsWaiting );
-
-            ( void ) xTaskNotifyGiveIndexed( pxCtx->xDataPlaneTaskHandle, DATA_WAITING_IDX );
+            LogDebug( "Packet enqueued into pxTxRing addr: %p, len: %d, refs: %d, waiting: %d",
+                      pxPbufToSend, pxPbufToSend->tot_len, pxPbufToSend->ref, ulMxRingCount( pxTxRing ) );
         }
         else
         {
@@ -190,6 +609,65 @@ err_t prvxLinkOutput( NetInterface_t * pxNetif,
     return xError;
 }
 
+#if ( MX_LWIP_DIRECT_INPUT == 1 )
+
+/* Frames posted to tcpip_thread by xMxNetifInput and those processed by it, each written by one task */
+static volatile uint32_t ulInputPosted = 0;
+static volatile uint32_t ulInputDone = 0;
+static uint32_t ulInputDirect = 0;
+
+static err_t prvPostedInput( PacketBuffer_t * pxPbuf,
+                             NetInterface_t * pxNetif )
+{
+    err_t xError = ethernet_input( pxPbuf, pxNetif );
+
+    ulInputDone++;
+
+    return xError;
+}
+
+#endif /* MX_LWIP_DIRECT_INPUT == 1 */
+
+err_t xMxNetifInput( PacketBuffer_t * pxPbuf,
+                     NetInterface_t * pxNetif )
+{
+    err_t xError;
+
+#if ( MX_LWIP_DIRECT_INPUT == 1 )
+    if( ( ulInputPosted == ulInputDone ) &&
+        ( sys_mutex_trylock( &lock_tcpip_core ) == pdTRUE ) )
+    {
+        /* ethernet_input consumes the pbuf */
+        xError = ethernet_input( pxPbuf, pxNetif );
+        ulInputDirect++;
+        UNLOCK_TCPIP_CORE();
+    }
+    else
+    {
+        ulInputPosted++;
+        xError = tcpip_inpkt( pxPbuf, pxNetif, prvPostedInput );
+
+        if( xError != ERR_OK )
+        {
+            ulInputPosted--;
+        }
+    }
+#else
+    xError = tcpip_input( pxPbuf, pxNetif );
+#endif /* MX_LWIP_DIRECT_INPUT == 1 */
+
+    return xError;
+}
+
+uint32_t ulMxNetifDirectInputs( void )
+{
+#if ( MX_LWIP_DIRECT_INPUT == 1 )
+    return ulInputDirect;
+#else
+    return 0;
+#endif
+}
+
 BaseType_t prvxLinkInput( NetInterface_t * pxNetif,
                           PacketBuffer_t * pxPbufIn )
 {
@@ -220,8 +698,14 @@ BaseType_t prvxLinkInput( NetInterface_t * pxNetif,
             /* intentional fall through */
             case ETHTYPE_IPV6:
             case ETHTYPE_ARP:
+                TRACE_MARK( TRACE_MARK_LWIP_INPUT, pxPbufIn->tot_len );
 
-                if( pxNetif->input( pxPbufIn, pxNetif ) != ERR_OK )
+                if( xImpairInput( pxNetif, pxPbufIn ) == pdTRUE )
+                {
+                    /* Dropped or held back by the link impairment, which owns the frame now */
+                    xReturn = pdTRUE;
+                }
+                else if( pxNetif->input( pxPbufIn, pxNetif ) != ERR_OK )
                 {
                     xReturn = pdFALSE;
                 }
@@ -275,3 +759,183 @@ err_t prvInitNetInterface( NetInterface_t * pxNetif )
 
     return ERR_OK;
 }
+
+#if MX_DHCP_LEASE_PERSIST == 1
+
+#define MX_DHCP_LEASE_MAGIC    0x4C534531 /* "LSE1" */
+
+/* DHCP lease as stored in the CS_NET_DHCP_LEASE kvstore entry */
+typedef struct
+{
+    uint32_t ulMagic;
+    uint8_t ucHwAddr[ ETHARP_HWADDR_LEN ];   /* Interface the lease was issued to */
+    uint8_t ucGwHwAddr[ ETHARP_HWADDR_LEN ]; /* All zeros if the gateway was not resolved */
+    uint32_t ulAddr;
+    uint32_t ulNetmask;
+    uint32_t ulGateway;
+    uint32_t ulDnsServer[ DNS_MAX_SERVERS ];
+    uint32_t ulLeaseTime;                    /* Seconds */
+} MxDhcpLease_t;
+
+static MxDhcpLease_t xRestoredLease = { 0 };
+
+static BaseType_t xLeaseHasGwHwAddr( const MxDhcpLease_t * pxLease )
+{
+    static const uint8_t ucZeroAddr[ ETHARP_HWADDR_LEN ] = { 0 };
+
+    return( memcmp( pxLease->ucGwHwAddr, ucZeroAddr, ETHARP_HWADDR_LEN ) != 0 );
+}
+
+/* Called in the tcpip thread once the seeded gateway entry should be learned through ARP again */
+static void vRemoveSeededArpEntry( void * pvArg )
+{
+    ip4_addr_t xGateway;
+
+    ( void ) pvArg;
+
+    ip4_addr_set_u32( &xGateway, xRestoredLease.ulGateway );
+    ( void ) etharp_remove_static_entry( &xGateway );
+}
+
+void vDhcpLeaseRestore( NetInterface_t * pxNetif )
+{
+    MxDhcpLease_t xLease = { 0 };
+    size_t xLength = KVStore_getBlob( CS_NET_DHCP_LEASE, &xLease, sizeof( MxDhcpLease_t ) );
+
+    if( ( xLength == sizeof( MxDhcpLease_t ) ) &&
+        ( xLease.ulMagic == MX_DHCP_LEASE_MAGIC ) &&
+        ( xLease.ulAddr != 0 ) &&
+        ( memcmp( xLease.ucHwAddr, pxNetif->hwaddr, ETHARP_HWADDR_LEN ) == 0 ) )
+    {
+        LOCK_TCPIP_CORE();
+        {
+            /* dhcp_start stays in the INIT state while the link is down */
+            if( dhcp_start( pxNetif ) == ERR_OK )
+            {
+                struct dhcp * pxDhcp = netif_dhcp_data( pxNetif );
+
+                ip4_addr_set_u32( &( pxDhcp->offered_ip_addr ), xLease.ulAddr );
+                ip4_addr_set_u32( &( pxDhcp->offered_sn_mask ), xLease.ulNetmask );
+                ip4_addr_set_u32( &( pxDhcp->offered_gw_addr ), xLease.ulGateway );
+                pxDhcp->offered_t0_lease = xLease.ulLeaseTime;
+
+                /*
+                 * On link up, lwIP's dhcp_network_changed() sends a DHCPREQUEST for the
+                 * offered address (INIT-REBOOT) instead of starting with a DHCPDISCOVER.
+                 * A NAK or a lack of response falls back to discovery.
+                 */
+                pxDhcp->state = DHCP_STATE_REBOOTING;
+
+                for( uint32_t i = 0; i < DNS_MAX_SERVERS; i++ )
+                {
+                    if( xLease.ulDnsServer[ i ] != 0 )
+                    {
+                        ip_addr_t xDnsServer;
+
+                        ip_addr_set_ip4_u32( &xDnsServer, xLease.ulDnsServer[ i ] );
+                        dns_setserver( i, &xDnsServer );
+                    }
+                }
+
+                xRestoredLease = xLease;
+            }
+        }
+        UNLOCK_TCPIP_CORE();
+
+        if( xRestoredLease.ulMagic == MX_DHCP_LEASE_MAGIC )
+        {
+            ip_addr_t xAddr;
+
+            ip_addr_set_ip4_u32( &xAddr, xLease.ulAddr );
+            vLogAddress( "Stored lease:", xAddr );
+        }
+    }
+}
+
+void vDhcpLeaseBound( NetInterface_t * pxNetif )
+{
+    LOCK_TCPIP_CORE();
+
+    /* Seed the gateway ARP entry only when the restored lease was confirmed unchanged */
+    if( ( xRestoredLease.ulMagic == MX_DHCP_LEASE_MAGIC ) &&
+        ( xLeaseHasGwHwAddr( &xRestoredLease ) == pdTRUE ) &&
+        ( ip4_addr_get_u32( netif_ip4_addr( pxNetif ) ) == xRestoredLease.ulAddr ) &&
+        ( ip4_addr_get_u32( netif_ip4_gw( pxNetif ) ) == xRestoredLease.ulGateway ) )
+    {
+        ip4_addr_t xGateway;
+
+        ip4_addr_set_u32( &xGateway, xRestoredLease.ulGateway );
+
+        if( etharp_add_static_entry( &xGateway, ( struct eth_addr * ) xRestoredLease.ucGwHwAddr ) == ERR_OK )
+        {
+            sys_timeout( MX_DHCP_LEASE_ARP_SEED_MS, vRemoveSeededArpEntry, NULL );
+        }
+    }
+
+    /* Only seed once per boot */
+    xRestoredLease.ulMagic = 0;
+
+    UNLOCK_TCPIP_CORE();
+}
+
+BaseType_t xDhcpLeaseSave( NetInterface_t * pxNetif )
+{
+    MxDhcpLease_t xLease = { 0 };
+    MxDhcpLease_t xStoredLease = { 0 };
+    BaseType_t xValid = pdFALSE;
+    BaseType_t xComplete = pdFALSE;
+
+    LOCK_TCPIP_CORE();
+
+    struct dhcp * pxDhcp = netif_dhcp_data( pxNetif );
+
+    if( ( pxDhcp != NULL ) &&
+        ( dhcp_supplied_address( pxNetif ) ) )
+    {
+        struct eth_addr * pxGwHwAddr = NULL;
+        const ip4_addr_t * pxGwAddr = NULL;
+
+        xLease.ulMagic = MX_DHCP_LEASE_MAGIC;
+        ( void ) memcpy( xLease.ucHwAddr, pxNetif->hwaddr, ETHARP_HWADDR_LEN );
+        xLease.ulAddr = ip4_addr_get_u32( netif_ip4_addr( pxNetif ) );
+        xLease.ulNetmask = ip4_addr_get_u32( netif_ip4_netmask( pxNetif ) );
+        xLease.ulGateway = ip4_addr_get_u32( netif_ip4_gw( pxNetif ) );
+        xLease.ulLeaseTime = pxDhcp->offered_t0_lease;
+
+        for( uint32_t i = 0; i < DNS_MAX_SERVERS; i++ )
+        {
+            xLease.ulDnsServer[ i ] = ip4_addr_get_u32( ip_2_ip4( dns_getserver( i ) ) );
+        }
+
+        if( etharp_find_addr( pxNetif, netif_ip4_gw( pxNetif ), &pxGwHwAddr, &pxGwAddr ) >= 0 )
+        {
+            ( void ) memcpy( xLease.ucGwHwAddr, pxGwHwAddr, ETHARP_HWADDR_LEN );
+            xComplete = pdTRUE;
+        }
+
+        xValid = pdTRUE;
+    }
+
+    UNLOCK_TCPIP_CORE();
+
+    /* Only write to flash when the lease (or the gateway hardware address) changed */
+    if( ( xValid == pdTRUE ) &&
+        ( ( KVStore_getBlob( CS_NET_DHCP_LEASE, &xStoredLease, sizeof( MxDhcpLease_t ) ) != sizeof( MxDhcpLease_t ) ) ||
+          ( memcmp( &xLease, &xStoredLease, sizeof( MxDhcpLease_t ) ) != 0 ) ) )
+    {
+        if( ( KVStore_setBlob( CS_NET_DHCP_LEASE, sizeof( MxDhcpLease_t ), &xLease ) == pdTRUE ) &&
+            ( KVStore_xCommitChanges() == pdTRUE ) )
+        {
+            LogInfo( "Saved DHCP lease." );
+        }
+        else
+        {
+            LogError( "Failed to save DHCP lease." );
+            xComplete = pdFALSE;
+        }
+    }
+
+    return xComplete;
+}
+
+#endif /* MX_DHCP_LEASE_PERSIST == 1 */
@@ -46,6 +46,7 @@ typedef struct eth_addr   MacAddress_t;
 #define PBUF_ALLOC_RX( len )    pbuf_alloc( PBUF_RAW, len, PBUF_POOL )
 #define PBUF_ALLOC_TX( len )    pbuf_alloc( PBUF_RAW, len, PBUF_RAM )
 #define PBUF_FREE( pbuf )       pbuf_free( pbuf )
+#define PBUF_SHRINK( pbuf, len )    pbuf_realloc( pbuf, len )
 
 /* helper functions */
 static inline void vLogAddress( const char * pucLabel,
@@ -100,14 +101,14 @@ static inline void vStartDhcp( NetInterface_t * pxNetif )
 
 static inline void vStopDhcp( NetInterface_t * pxNetif )
 {
-    /* Start DHCP if necessary */
+    /* Stop DHCP if necessary */
     struct dhcp * pxDHCP = netif_dhcp_data( pxNetif );
 
     if( ( pxDHCP != NULL ) &&
         ( pxDHCP->state != DHCP_STATE_OFF ) )
     {
         LogInfo( "Stopping DHCP." );
-        err_t xLwipError = netifapi_dhcp_start( pxNetif );
+        err_t xLwipError = netifapi_dhcp_stop( pxNetif );
 
         if( xLwipError != ERR_OK )
         {
@@ -166,10 +167,44 @@ static inline void vSetLinkDown( NetInterface_t * pxNetif )
     }
 }
 
+/*
+ * Persist the DHCP lease in the kvstore so that the next boot can confirm it with
+ * a single DHCPREQUEST (INIT-REBOOT) rather than a full discovery, and seed the
+ * gateway ARP entry for MX_DHCP_LEASE_ARP_SEED_MS once the lease is confirmed.
+ */
+#ifndef MX_DHCP_LEASE_PERSIST
+#define MX_DHCP_LEASE_PERSIST         1
+#endif
+
+#ifndef MX_DHCP_LEASE_ARP_SEED_MS
+#define MX_DHCP_LEASE_ARP_SEED_MS     ( 10 * 1000 )
+#endif
+
+#if MX_DHCP_LEASE_PERSIST == 1
+void vDhcpLeaseRestore( NetInterface_t * pxNetif );
+void vDhcpLeaseBound( NetInterface_t * pxNetif );
+/* Returns pdTRUE once the stored lease holds the gateway hardware address */
+BaseType_t xDhcpLeaseSave( NetInterface_t * pxNetif );
+#else
+#define vDhcpLeaseRestore( pxNetif )
+#define vDhcpLeaseBound( pxNetif )
+#define xDhcpLeaseSave( pxNetif )    ( pdTRUE )
+#endif
+
 err_t prvxLinkOutput( NetInterface_t * pxNetif,
                       PacketBuffer_t * pxPbuf );
 BaseType_t prvxLinkInput( NetInterface_t * pxNetif,
                           PacketBuffer_t * pxPbufIn );
 err_t prvInitNetInterface( NetInterface_t * pxNetif );
 
+/*
+ * @brief netif input function, passes frames to lwIP directly from the calling task
+ * when MX_LWIP_DIRECT_INPUT is enabled and through tcpip_thread otherwise.
+ */
+err_t xMxNetifInput( PacketBuffer_t * pxPbuf,
+                     NetInterface_t * pxNetif );
+
+/* Frames xMxNetifInput has passed to lwIP without going through tcpip_thread */
+uint32_t ulMxNetifDirectInputs( void );
+
 #endif /* _MXFREE_LWIP_ */
@@ -27,11 +27,13 @@
 
 #include "logging_levels.h"
 #define LOG_LEVEL    LOG_ERROR
+#define LOG_MODULE    LOG_MODULE_NET
 #include "logging.h"
 
 /* Standard includes */
 #include <stdint.h>
 #include <limits.h>
+#include <string.h>
 
 #include "mx_netconn.h"
 #include "mx_lwip.h"
@@ -42,12 +44,19 @@
 #include "event_groups.h"
 #include "kvstore.h"
 #include "hw_defs.h"
+#include "heap_classes.h"
+#include "boot_times.h"
+#include "static_alloc.h"
+#include "net_stats.h"
+#include "net_iperf.h"
+#include "net_sntp.h"
+#include "power_stats.h"
 
 /* lwip includes */
 #include "lwip/tcpip.h"
 #include "lwip/netifapi.h"
+#include "lwip/dhcp.h"
 #include "lwip/prot/dhcp.h"
-#include "lwip/apps/lwiperf.h"
 
 #include "sys_evt.h"
 
@@ -56,9 +65,25 @@
 #define MACADDR_RETRY_WAIT_TIME_TICKS    pdMS_TO_TICKS( 10 * 1000 )
 
 static TaskHandle_t xNetTaskHandle = NULL;
+static volatile uint32_t ulActiveClients = 0;
 static MxDataplaneCtx_t xDataPlaneCtx;
 static ControlPlaneCtx_t xControlPlaneCtx;
 
+/* ulRxDirectFrames is counted by mx_lwip.c and cleared by recording its value */
+static uint32_t ulRxDirectFramesBase = 0;
+
+/* Registered with net_set_link_lost_callback */
+static NetLinkLostCallback_t pxLinkLostCallback = NULL;
+static void * pvLinkLostCallbackCtx = NULL;
+
+/* Lock-free rings between lwIP / the control plane router and the dataplane thread */
+static MxRing_t xDataPlaneSendRing;
+static MxRing_t xDataPlanePrioSendRing;
+static MxRing_t xControlPlaneResponseRing;
+static void * pvDataPlaneSendSlots[ MX_RING_SLOTS( DATA_PLANE_QUEUE_LEN ) ];
+static void * pvDataPlanePrioSendSlots[ MX_RING_SLOTS( DATA_PLANE_PRIO_QUEUE_LEN ) ];
+static void * pvControlPlaneResponseSlots[ MX_RING_SLOTS( CONTROL_PLANE_RESP_LEN ) ];
+
 #if LOG_LEVEL == LOG_DEBUG
 
 /*
@@ -213,6 +238,81 @@ static BaseType_t xWaitForMxStatus( MxNetConnectCtx_t * pxCtx,
     return( pxCtx->xStatus >= xTargetStatus );
 }
 
+BaseType_t net_get_dataplane_stats( MxDataplaneStats_t * pxStats )
+{
+    BaseType_t xReturn = pdFALSE;
+
+    if( ( pxStats != NULL ) &&
+        ( xDataPlaneCtx.xDataPlaneTaskHandle != NULL ) )
+    {
+        taskENTER_CRITICAL();
+        {
+            ( void ) memcpy( pxStats, &( xDataPlaneCtx.xStats ), sizeof( MxDataplaneStats_t ) );
+        }
+        taskEXIT_CRITICAL();
+
+        pxStats->ulCtrlQueueDepth = uxQueueMessagesWaiting( xDataPlaneCtx.xControlPlaneSendQueue );
+        pxStats->ulDataQueueDepth = ulMxRingCount( xDataPlaneCtx.pxDataPlaneSendRing );
+        pxStats->ulPrioQueueDepth = ulMxRingCount( xDataPlaneCtx.pxDataPlanePrioSendRing );
+        pxStats->ulRxDirectFrames = ulMxNetifDirectInputs() - ulRxDirectFramesBase;
+
+        xReturn = pdTRUE;
+    }
+
+    return xReturn;
+}
+
+void net_clear_dataplane_stats( void )
+{
+    taskENTER_CRITICAL();
+    {
+        ( void ) memset( &( xDataPlaneCtx.xStats ), 0, sizeof( MxDataplaneStats_t ) );
+    }
+    taskEXIT_CRITICAL();
+
+    ulRxDirectFramesBase = ulMxNetifDirectInputs();
+}
+
+void net_set_link_lost_callback( NetLinkLostCallback_t pxCallback,
+                                 void * pvCtx )
+{
+    taskENTER_CRITICAL();
+    {
+        pxLinkLostCallback = pxCallback;
+        pvLinkLostCallbackCtx = pvCtx;
+    }
+    taskEXIT_CRITICAL();
+}
+
+/*
+ * Tell the client registered with net_set_link_lost_callback that the connections made
+ * from ulLinkAddr are gone.
+ */
+static void vSignalLinkLost( MxNetConnectCtx_t * pxCtx,
+                             const char * pcReason )
+{
+    NetLinkLostCallback_t pxCallback;
+    void * pvCtx;
+
+    pxCtx->xLinkLostPending = pdFALSE;
+
+    taskENTER_CRITICAL();
+    {
+        pxCallback = pxLinkLostCallback;
+        pvCtx = pvLinkLostCallbackCtx;
+    }
+    taskEXIT_CRITICAL();
+
+    if( ( pxCtx->ulLinkAddr != 0 ) &&
+        ( pxCallback != NULL ) )
+    {
+        LogInfo( "Connections lost: %s.", pcReason );
+        pxCallback( pvCtx );
+    }
+
+    pxCtx->ulLinkAddr = 0;
+}
+
 BaseType_t net_request_reconnect( void )
 {
     BaseType_t xReturn = pdFALSE;
@@ -230,6 +330,147 @@ BaseType_t net_request_reconnect( void )
     return xReturn;
 }
 
+/*
+ * Update the client mask and wake up net_main when power save has to be turned on or off.
+ */
+static void vSetActiveClients( uint32_t ulSet,
+                               uint32_t ulClear )
+{
+    uint32_t ulPrevious;
+    uint32_t ulCurrent;
+
+    taskENTER_CRITICAL();
+    {
+        ulPrevious = ulActiveClients;
+        ulCurrent = ( ulPrevious | ulSet ) & ~ulClear;
+        ulActiveClients = ulCurrent;
+    }
+    taskEXIT_CRITICAL();
+
+    if( ( ( ulPrevious == 0 ) != ( ulCurrent == 0 ) ) &&
+        ( xNetTaskHandle != NULL ) )
+    {
+        ( void ) xTaskNotifyIndexed( xNetTaskHandle,
+                                     NET_EVT_IDX,
+                                     ASYNC_REQUEST_POWER_SAVE_BIT,
+                                     eSetBits );
+    }
+}
+
+void net_request_active( uint32_t ulClient )
+{
+    vSetActiveClients( ulClient, 0 );
+}
+
+void net_release_active( uint32_t ulClient )
+{
+    vSetActiveClients( 0, ulClient );
+}
+
+/*
+ * Turn the module power save mode on once the link is up with an address and no
+ * client needs throughput, and off otherwise.
+ */
+static void vUpdatePowerSave( MxNetConnectCtx_t * pxCtx )
+{
+#if MX_POWER_SAVE_ENABLED == 1
+    if( ( pxCtx->xStatus < MX_STATUS_STA_UP ) ||
+        ( pxCtx->xNetif.ip_addr.addr == 0 ) )
+    {
+        /* The module is set up again once the link is back */
+        pxCtx->xPowerSaveValid = pdFALSE;
+    }
+    else
+    {
+        BaseType_t xPowerSave = ( ulActiveClients == 0 ) ? pdTRUE : pdFALSE;
+
+        if( ( pxCtx->xPowerSaveValid == pdFALSE ) ||
+            ( pxCtx->xPowerSave != xPowerSave ) )
+        {
+            if( mx_SetPowerSave( xPowerSave, MX_DEFAULT_TIMEOUT_TICK ) == IPC_SUCCESS )
+            {
+                LogInfo( "Wifi power save %s.", ( xPowerSave == pdTRUE ) ? "on" : "off" );
+                pxCtx->xPowerSave = xPowerSave;
+                pxCtx->xPowerSaveValid = pdTRUE;
+            }
+            else
+            {
+                LogWarn( "Failed to turn wifi power save %s.", ( xPowerSave == pdTRUE ) ? "on" : "off" );
+                pxCtx->xPowerSaveValid = pdFALSE;
+            }
+        }
+    }
+#else
+    ( void ) pxCtx;
+#endif /* MX_POWER_SAVE_ENABLED == 1 */
+}
+
+#if POWER_STATS_ENABLED == 1
+
+/*
+ * State of the wifi module as seen by the power statistics.
+ */
+static PowerRadioState_t xGetRadioState( const MxNetConnectCtx_t * pxCtx )
+{
+    PowerRadioState_t xState = POWER_RADIO_ACTIVE;
+
+    if( pxCtx->xStatus < MX_STATUS_STA_UP )
+    {
+        xState = POWER_RADIO_DOWN;
+    }
+    else if( ( pxCtx->xPowerSaveValid == pdTRUE ) &&
+             ( pxCtx->xPowerSave == pdTRUE ) )
+    {
+        xState = POWER_RADIO_PS;
+    }
+    else
+    {
+        /* Associated, power save off or not set up yet */
+    }
+
+    return xState;
+}
+
+#endif /* POWER_STATS_ENABLED == 1 */
+
+/*
+ * Time net_main waits for an event before retrying: a connection attempt, the
+ * DHCP lease save waiting for the gateway hardware address or a failed power
+ * save change. Once all of them are done the task only wakes for events.
+ */
+static TickType_t xNetRetryTicks( const MxNetConnectCtx_t * pxCtx )
+{
+    TickType_t xTicks = portMAX_DELAY;
+
+    if( ( pxCtx->xStatus < MX_STATUS_STA_UP ) ||
+        ( pxCtx->xNetif.ip_addr.addr == 0 ) ||
+        ( pxCtx->xLeaseSaved == pdFALSE ) )
+    {
+        xTicks = pdMS_TO_TICKS( MX_NET_RETRY_MS );
+    }
+
+#if MX_POWER_SAVE_ENABLED == 1
+    if( pxCtx->xPowerSaveValid == pdFALSE )
+    {
+        xTicks = pdMS_TO_TICKS( MX_NET_RETRY_MS );
+    }
+#endif /* MX_POWER_SAVE_ENABLED == 1 */
+
+    if( pxCtx->xLinkLostPending == pdTRUE )
+    {
+        TickType_t xElapsed = xTaskGetTickCount() - pxCtx->xLinkDownTick;
+        TickType_t xGrace = pdMS_TO_TICKS( MX_LINK_LOST_GRACE_MS );
+        TickType_t xRemaining = ( xElapsed < xGrace ) ? ( xGrace - xElapsed ) : 0;
+
+        if( xRemaining < xTicks )
+        {
+            xTicks = xRemaining;
+        }
+    }
+
+    return xTicks;
+}
+
 /*
  * Handles network interface state change notifications from the control plane.
  */
@@ -269,39 +510,6 @@ static void vLwipReadyCallback( void * pvCtx )
 static char pcSSID[ MX_SSID_BUF_LEN ] = { 0 };
 static char pcPSK[ MX_PSK_BUF_LEN ] = { 0 };
 
-static BaseType_t xConnectToAP( MxNetConnectCtx_t * pxCtx )
-{
-    IPCError_t xErr = IPC_SUCCESS;
-
-
-    if( ( pxCtx->xStatus == MX_STATUS_NONE ) ||
-        ( pxCtx->xStatus == MX_STATUS_STA_DOWN ) )
-    {
-        xErr |= mx_SetBypassMode( pdTRUE,
-                                  pdMS_TO_TICKS( MX_DEFAULT_TIMEOUT_MS ) );
-
-        ( void ) KVStore_getString( CS_WIFI_SSID, pcSSID, MX_SSID_BUF_LEN );
-        ( void ) KVStore_getString( CS_WIFI_CREDENTIAL, pcPSK, MX_PSK_BUF_LEN );
-
-        xErr = mx_Connect( pcSSID, pcPSK, MX_TIMEOUT_CONNECT );
-
-        /* Clear sensitive data */
-        memset( pcSSID, 0, MX_SSID_BUF_LEN );
-        memset( pcPSK, 0, MX_SSID_BUF_LEN );
-
-        if( xErr != IPC_SUCCESS )
-        {
-            LogError( "Failed to connect to access point." );
-        }
-        else
-        {
-            ( void ) xWaitForMxStatus( pxCtx, MX_STATUS_STA_UP, MX_TIMEOUT_CONNECT );
-        }
-    }
-
-    return( pxCtx->xStatus >= MX_STATUS_STA_UP );
-}
-
 static void vInitializeWifiModule( MxNetConnectCtx_t * pxCtx )
 {
     IPCError_t xErr = IPC_ERROR_INTERNAL;
@@ -347,20 +555,230 @@ static void vInitializeWifiModule( MxNetConnectCtx_t * pxCtx )
     }
 }
 
+#if MX_AP_HINT_PERSIST == 1
+
+#define MX_AP_HINT_MAGIC    0x41504831 /* "APH1" */
+
+/* Access point of the last association as stored in the CS_NET_WIFI_AP kvstore entry */
+typedef struct
+{
+    uint32_t ulMagic;
+    uint32_t ulSsidHash; /* The hint only applies to the network it was learned on */
+    MxApInfo_t xApInfo;
+} MxApHint_t;
+
+/* FNV-1a hash of the SSID */
+static uint32_t ulHashSsid( const char * pcSsid )
+{
+    uint32_t ulHash = 0x811C9DC5;
+
+    for( uint32_t i = 0; ( i < MX_SSID_BUF_LEN ) && ( pcSsid[ i ] != '\0' ); i++ )
+    {
+        ulHash = ( ulHash ^ ( uint8_t ) pcSsid[ i ] ) * 0x01000193;
+    }
+
+    return ulHash;
+}
+
+static BaseType_t xApHintLoad( MxApInfo_t * pxApInfo,
+                               uint32_t ulSsidHash )
+{
+    MxApHint_t xHint = { 0 };
+    BaseType_t xFound = pdFALSE;
+
+    if( ( KVStore_getBlob( CS_NET_WIFI_AP, &xHint, sizeof( MxApHint_t ) ) == sizeof( MxApHint_t ) ) &&
+        ( xHint.ulMagic == MX_AP_HINT_MAGIC ) &&
+        ( xHint.ulSsidHash == ulSsidHash ) )
+    {
+        ( void ) memcpy( pxApInfo, &( xHint.xApInfo ), sizeof( MxApInfo_t ) );
+        xFound = pdTRUE;
+    }
+
+    return xFound;
+}
+
+/* Store the access point to use for the next connection, or with a NULL pxApInfo invalidate the stored one */
+static void vApHintSave( const MxApInfo_t * pxApInfo,
+                         uint32_t ulSsidHash )
+{
+    MxApHint_t xHint = { 0 };
+    MxApHint_t xStoredHint = { 0 };
+    size_t xStoredLength = KVStore_getBlob( CS_NET_WIFI_AP, &xStoredHint, sizeof( MxApHint_t ) );
+
+    if( pxApInfo != NULL )
+    {
+        xHint.ulMagic = MX_AP_HINT_MAGIC;
+        xHint.ulSsidHash = ulSsidHash;
+        ( void ) memcpy( &( xHint.xApInfo ), pxApInfo, sizeof( MxApInfo_t ) );
+    }
+
+    /* Only write to flash when the access point changed */
+    if( ( ( xStoredLength == sizeof( MxApHint_t ) ) && ( memcmp( &xHint, &xStoredHint, sizeof( MxApHint_t ) ) != 0 ) ) ||
+        ( ( xStoredLength != sizeof( MxApHint_t ) ) && ( pxApInfo != NULL ) ) )
+    {
+        if( ( KVStore_setBlob( CS_NET_WIFI_AP, sizeof( MxApHint_t ), &xHint ) == pdTRUE ) &&
+            ( KVStore_xCommitChanges() == pdTRUE ) )
+        {
+            LogInfo( "Saved access point hint." );
+        }
+        else
+        {
+            LogError( "Failed to save access point hint." );
+        }
+    }
+}
+
+#endif /* MX_AP_HINT_PERSIST == 1 */
+
+static BaseType_t xConnectToAP( MxNetConnectCtx_t * pxCtx )
+{
+    IPCError_t xErr = IPC_SUCCESS;
+
+
+    if( ( pxCtx->xStatus == MX_STATUS_NONE ) ||
+        ( pxCtx->xStatus == MX_STATUS_STA_DOWN ) )
+    {
+        xErr |= mx_SetBypassMode( pdTRUE,
+                                  pdMS_TO_TICKS( MX_DEFAULT_TIMEOUT_MS ) );
+
+        KVStoreItem_t xWifiConfig[] =
+        {
+            KV_ITEM( CS_WIFI_SSID,       pcSSID ),
+            KV_ITEM( CS_WIFI_CREDENTIAL, pcPSK  ),
+        };
+
+        ( void ) KVStore_xGetItems( xWifiConfig, sizeof( xWifiConfig ) / sizeof( xWifiConfig[ 0 ] ) );
+
+#if MX_AP_HINT_PERSIST == 1
+        const uint32_t ulSsidHash = ulHashSsid( pcSSID );
+
+        /* First connection of this boot: start from the access point used by the previous one */
+        if( ( pxCtx->xApInfoValid == pdFALSE ) &&
+            ( pxCtx->xApHintLoaded == pdFALSE ) )
+        {
+            pxCtx->xApHintLoaded = pdTRUE;
+            pxCtx->xApInfoValid = xApHintLoad( &( pxCtx->xApInfo ), ulSsidHash );
+        }
+#endif /* MX_AP_HINT_PERSIST == 1 */
+
+        /* Fast path: re-associate with the last known access point without scanning */
+        if( pxCtx->xApInfoValid == pdTRUE )
+        {
+            LogInfo( "Reconnecting to last known access point on channel %d.", pxCtx->xApInfo.ucChannel );
+
+            xErr = mx_ConnectToBssid( pcSSID, pcPSK, &( pxCtx->xApInfo ), MX_FAST_RECONNECT_TIMEOUT );
+
+            if( xErr == IPC_SUCCESS )
+            {
+                ( void ) xWaitForMxStatus( pxCtx, MX_STATUS_STA_UP, MX_FAST_RECONNECT_TIMEOUT );
+            }
+
+            if( pxCtx->xStatus < MX_STATUS_STA_UP )
+            {
+                LogWarn( "Fast reconnect failed, falling back to a full scan." );
+                pxCtx->xApInfoValid = pdFALSE;
+
+#if MX_AP_HINT_PERSIST == 1
+                /* Do not spend MX_FAST_RECONNECT_TIMEOUT on it again after a reboot */
+                vApHintSave( NULL, ulSsidHash );
+#endif /* MX_AP_HINT_PERSIST == 1 */
+            }
+        }
+
+        if( pxCtx->xStatus < MX_STATUS_STA_UP )
+        {
+            xErr = mx_Connect( pcSSID, pcPSK, MX_TIMEOUT_CONNECT );
+
+            if( xErr != IPC_SUCCESS )
+            {
+                LogError( "Failed to connect to access point." );
+            }
+            else
+            {
+                ( void ) xWaitForMxStatus( pxCtx, MX_STATUS_STA_UP, MX_TIMEOUT_CONNECT );
+            }
+        }
+
+        /* Clear sensitive data */
+        memset( pcSSID, 0, MX_SSID_BUF_LEN );
+        memset( pcPSK, 0, MX_PSK_BUF_LEN );
+
+        if( pxCtx->xStatus >= MX_STATUS_STA_UP )
+        {
+            vBootTimeMark( BOOT_STAGE_WIFI_ASSOC );
+
+            pxCtx->ulConnectFailures = 0;
+
+            /* A new association starts with the module default power save setting */
+            pxCtx->xPowerSaveValid = pdFALSE;
+
+            /* Remember the access point for the next reconnect */
+            if( pxCtx->xApInfoValid == pdFALSE )
+            {
+                pxCtx->xApInfoValid = ( mx_GetApInfo( &( pxCtx->xApInfo ), MX_DEFAULT_TIMEOUT_TICK ) == IPC_SUCCESS );
+
+#if MX_AP_HINT_PERSIST == 1
+                if( pxCtx->xApInfoValid == pdTRUE )
+                {
+                    vApHintSave( &( pxCtx->xApInfo ), ulSsidHash );
+                }
+#endif /* MX_AP_HINT_PERSIST == 1 */
+            }
+        }
+        else
+        {
+            pxCtx->ulConnectFailures++;
+        }
+    }
+
+    return( pxCtx->xStatus >= MX_STATUS_STA_UP );
+}
+
+/*
+ * @brief Last resort recovery: drop the DHCP lease and hard reset the wifi module.
+ */
+static void vResetWifiModule( MxNetConnectCtx_t * pxCtx )
+{
+    LogWarn( "%d consecutive connection attempts failed. Resetting wifi module.", pxCtx->ulConnectFailures );
+
+    vStopDhcp( &( pxCtx->xNetif ) );
+    vClearAddress( &( pxCtx->xNetif ) );
+
+    pxCtx->xApInfoValid = pdFALSE;
+    pxCtx->ulConnectFailures = 0;
+    pxCtx->xPowerSaveValid = pdFALSE;
+
+    vDataplaneRequestReset( &xDataPlaneCtx );
+
+    pxCtx->xStatusPrevious = pxCtx->xStatus;
+    pxCtx->xStatus = MX_STATUS_NONE;
+
+    /* Wait for the module to come back up */
+    vInitializeWifiModule( pxCtx );
+}
+
 static void vInitializeContexts( MxNetConnectCtx_t * pxCtx )
 {
-    MessageBufferHandle_t xControlPlaneResponseBuff;
     QueueHandle_t xControlPlaneSendQueue;
-    QueueHandle_t xDataPlaneSendQueue;
 
-    /* Construct queues */
-    xDataPlaneSendQueue = xQueueCreate( DATA_PLANE_QUEUE_LEN, sizeof( PacketBuffer_t * ) );
-    configASSERT( xDataPlaneSendQueue != NULL );
+    /* Construct rings. Each consumer registers itself when its thread starts. */
+    vMxRingInit( &xDataPlaneSendRing,
+                 pvDataPlaneSendSlots,
+                 MX_RING_SLOTS( DATA_PLANE_QUEUE_LEN ),
+                 DATA_WAITING_IDX );
+
+    vMxRingInit( &xDataPlanePrioSendRing,
+                 pvDataPlanePrioSendSlots,
+                 MX_RING_SLOTS( DATA_PLANE_PRIO_QUEUE_LEN ),
+                 DATA_WAITING_IDX );
 
-    xControlPlaneResponseBuff = xMessageBufferCreate( CONTROL_PLANE_BUFFER_SZ );
-    configASSERT( xControlPlaneResponseBuff != NULL );
+    vMxRingInit( &xControlPlaneResponseRing,
+                 pvControlPlaneResponseSlots,
+                 MX_RING_SLOTS( CONTROL_PLANE_RESP_LEN ),
+                 CONTROL_RESP_WAITING_IDX );
 
-    xControlPlaneSendQueue = xQueueCreate( CONTROL_PLANE_QUEUE_LEN, sizeof( PacketBuffer_t * ) );
+    /* Construct queues. The control plane send queue has multiple producers. */
+    xControlPlaneSendQueue = xQueueCreateStaticStorage( CONTROL_PLANE_QUEUE_LEN, sizeof( PacketBuffer_t * ) );
     configASSERT( xControlPlaneSendQueue != NULL );
 
 
@@ -370,8 +788,17 @@ static void vInitializeContexts( MxNetConnectCtx_t * pxCtx )
     ( void ) memset( &( pxCtx->pcFirmwareRevision ), 0, MX_FIRMWARE_REVISION_SIZE );
     ( void ) memset( &( pxCtx->xMacAddress ), 0, sizeof( MacAddress_t ) );
 
-    pxCtx->xDataPlaneSendQueue = xDataPlaneSendQueue;
-    pxCtx->pulTxPacketsWaiting = &( xDataPlaneCtx.ulTxPacketsWaiting );
+    pxCtx->pxDataPlaneSendRing = &xDataPlaneSendRing;
+    pxCtx->pxDataPlanePrioSendRing = &xDataPlanePrioSendRing;
+    pxCtx->xApInfoValid = pdFALSE;
+    pxCtx->ulConnectFailures = 0;
+    pxCtx->xPowerSave = pdFALSE;
+    pxCtx->xApHintLoaded = pdFALSE;
+    pxCtx->xPowerSaveValid = pdFALSE;
+    pxCtx->xLeaseSaved = pdFALSE;
+    pxCtx->ulLinkAddr = 0;
+    pxCtx->xLinkLostPending = pdFALSE;
+    pxCtx->xLinkDownTick = 0;
     pxCtx->xNetTaskHandle = xTaskGetCurrentTaskHandle();
 
     /* Construct dataplane context */
@@ -389,14 +816,17 @@ static void vInitializeContexts( MxNetConnectCtx_t * pxCtx )
 
     /* Set queue handles */
     xDataPlaneCtx.xControlPlaneSendQueue = xControlPlaneSendQueue;
-    xDataPlaneCtx.xControlPlaneResponseBuff = xControlPlaneResponseBuff;
-    xDataPlaneCtx.xDataPlaneSendQueue = xDataPlaneSendQueue;
+    xDataPlaneCtx.pxControlPlaneResponseRing = &xControlPlaneResponseRing;
+    xDataPlaneCtx.pxDataPlaneSendRing = &xDataPlaneSendRing;
+    xDataPlaneCtx.pxDataPlanePrioSendRing = &xDataPlanePrioSendRing;
+    xDataPlaneCtx.ulTxPrioCredit = MX_TX_PRIO_WEIGHT;
+    xDataPlaneCtx.xResetRequested = pdFALSE;
     xDataPlaneCtx.pxNetif = &( pxCtx->xNetif );
 
     /* Construct controlplane context */
     xControlPlaneCtx.pxEventCallbackCtx = pxCtx;
     xControlPlaneCtx.xEventCallback = vMxStatusNotify;
-    xControlPlaneCtx.xControlPlaneResponseBuff = xControlPlaneResponseBuff;
+    xControlPlaneCtx.pxControlPlaneResponseRing = &xControlPlaneResponseRing;
     xControlPlaneCtx.xDataPlaneTaskHandle = NULL;
     xControlPlaneCtx.xControlPlaneSendQueue = xControlPlaneSendQueue;
     xControlPlaneCtx.pulTxPacketsWaiting = &( xDataPlaneCtx.ulTxPacketsWaiting );
@@ -418,6 +848,8 @@ void net_main( void * pvParameters )
     /* Set static task handle var for callbacks */
     xNetTaskHandle = xTaskGetCurrentTaskHandle();
 
+    ( void ) xHeapTagSet( HEAP_TAG_LWIP );
+
     vInitializeContexts( &xCtx );
 
     /* Initialize lwip */
@@ -429,24 +861,24 @@ void net_main( void * pvParameters )
                                    portMAX_DELAY );
 
     /* Start dataplane thread (does hw reset on initialization) */
-    xResult = xTaskCreate( &vDataplaneThread,
-                           "MxData",
-                           4096,
-                           &xDataPlaneCtx,
-                           25,
-                           &xDataPlaneCtx.xDataPlaneTaskHandle );
+    xResult = xTaskCreateStaticStack( &vDataplaneThread,
+                                      "MxData",
+                                      TASK_STACK_MXDATA,
+                                      &xDataPlaneCtx,
+                                      MX_DATAPLANE_TASK_PRIO,
+                                      &xDataPlaneCtx.xDataPlaneTaskHandle );
 
     configASSERT( xResult == pdTRUE );
     xControlPlaneCtx.xDataPlaneTaskHandle = xDataPlaneCtx.xDataPlaneTaskHandle;
     xCtx.xDataPlaneTaskHandle = xDataPlaneCtx.xDataPlaneTaskHandle;
 
     /* Start control plane thread */
-    xResult = xTaskCreate( &prvControlPlaneRouter,
-                           "MxCtrl",
-                           4096,
-                           &xControlPlaneCtx,
-                           24,
-                           NULL );
+    xResult = xTaskCreateStaticStack( &prvControlPlaneRouter,
+                                      "MxCtrl",
+                                      TASK_STACK_MXCTRL,
+                                      &xControlPlaneCtx,
+                                      MX_CTRLPLANE_TASK_PRIO,
+                                      NULL );
 
     configASSERT( xResult == pdTRUE );
 
@@ -461,10 +893,23 @@ void net_main( void * pvParameters )
                                      NULL, NULL, NULL,
                                      &xCtx,
                                      &prvInitNetInterface,
-                                     tcpip_input );
+                                     &xMxNetifInput );
 
     configASSERT( xLwipError == ERR_OK );
 
+    vNetStatsInit();
+
+    /* The module reset and lwip init overlap the filesystem mount. Everything
+     * from here on uses the KVStore (DHCP lease, wifi credentials) */
+    ( void ) xEventGroupWaitBits( xSystemEvents,
+                                  EVT_MASK_FS_READY,
+                                  pdFALSE,
+                                  pdTRUE,
+                                  portMAX_DELAY );
+
+    /* Prime DHCP with the lease from the previous boot, if any */
+    vDhcpLeaseRestore( pxNetif );
+
     netifapi_netif_set_default( pxNetif );
 
     netifapi_netif_set_up( pxNetif );
@@ -485,18 +930,22 @@ void net_main( void * pvParameters )
         if( ( xCtx.xStatus != MX_STATUS_STA_UP ) &&
             ( xCtx.xStatus != MX_STATUS_STA_GOT_IP ) )
         {
-            xConnectToAP( &xCtx );
+            if( ( xConnectToAP( &xCtx ) == pdFALSE ) &&
+                ( xCtx.ulConnectFailures >= MX_RECONNECT_RESET_THRESHOLD ) )
+            {
+                vResetWifiModule( &xCtx );
+            }
         }
 
         /*
-         * Wait for any event or timeout after 30 seconds
+         * Wait for any event, with a timeout only while something is left to retry
          */
         uint32_t ulNotificationValue = 0x0;
         xResult = xTaskNotifyWaitIndexed( NET_EVT_IDX,
                                           0x0,
                                           0xFFFFFFFF,
                                           &ulNotificationValue,
-                                          pdMS_TO_TICKS( 30 * 1000 ) );
+                                          xNetRetryTicks( &xCtx ) );
 
         if( ulNotificationValue != 0 )
         {
@@ -516,10 +965,31 @@ void net_main( void * pvParameters )
                 vLogAddress( "Gateway:", pxNetif->gw );
                 vLogAddress( "Netmask:", pxNetif->netmask );
 
-                lwiperf_start_tcp_server_default( NULL, NULL );
-                LogSys( "Started Iperf server" );
-
-                ( void ) xEventGroupSetBits( xSystemEvents, EVT_MASK_NET_CONNECTED );
+                if( pxNetif->ip_addr.addr != xCtx.ulLinkAddr )
+                {
+                    vSignalLinkLost( &xCtx, ( pxNetif->ip_addr.addr != 0 ) ? "address changed" : "address lost" );
+                }
+
+                if( pxNetif->ip_addr.addr != 0 )
+                {
+                    xCtx.ulLinkAddr = pxNetif->ip_addr.addr;
+                    vDhcpLeaseBound( pxNetif );
+                    xCtx.xLeaseSaved = xDhcpLeaseSave( pxNetif );
+
+                    vNetIperfServerStart();
+
+#if NET_SNTP_ENABLED == 1
+                    vNetSntpRequest();
+#endif
+
+                    vBootTimeMark( BOOT_STAGE_DHCP );
+                    ( void ) xEventGroupSetBits( xSystemEvents, EVT_MASK_NET_CONNECTED );
+                }
+                else
+                {
+                    xCtx.xLeaseSaved = pdFALSE;
+                    ( void ) xEventGroupClearBits( xSystemEvents, EVT_MASK_NET_CONNECTED );
+                }
             }
 
             if( ulNotificationValue & NET_LWIP_IFUP_BIT )
@@ -533,8 +1003,32 @@ void net_main( void * pvParameters )
             {
                 LogInfo( "Link UP event." );
 
+                /* Back within the grace period, connections on the kept address may still work */
+                xCtx.xLinkLostPending = pdFALSE;
+
                 vSetAdminUp( pxNetif );
-                vStartDhcp( pxNetif );
+
+                /*
+                 * A lease kept across the link outage is confirmed by lwIP with a
+                 * DHCP REQUEST (INIT-REBOOT) when the link comes up, so the address
+                 * can be used right away. A NAK clears it and triggers an IP change.
+                 */
+                if( dhcp_supplied_address( pxNetif ) )
+                {
+                    LogSys( "Reusing DHCP lease." );
+                    xCtx.ulLinkAddr = pxNetif->ip_addr.addr;
+                    vBootTimeMark( BOOT_STAGE_DHCP );
+
+#if NET_SNTP_ENABLED == 1
+                    vNetSntpRequest();
+#endif
+                    ( void ) xEventGroupSetBits( xSystemEvents, EVT_MASK_NET_CONNECTED );
+                }
+                else
+                {
+                    vStartDhcp( pxNetif );
+                }
+
                 LogSys( "Network Link Up." );
             }
             else if( ulNotificationValue & NET_LWIP_IFDOWN_BIT )
@@ -544,25 +1038,58 @@ void net_main( void * pvParameters )
                 vStopDhcp( pxNetif );
                 vClearAddress( pxNetif );
                 ( void ) xEventGroupClearBits( xSystemEvents, EVT_MASK_NET_CONNECTED );
+                vSignalLinkLost( &xCtx, "interface down" );
             }
             else if( ( ulNotificationValue & NET_LWIP_LINK_DOWN_BIT ) &&
                      ( ( ucNetifFlags & NETIF_FLAG_LINK_UP ) == 0 ) )
             {
+                /*
+                 * Keep the address and DHCP lease so that they can be reused once the
+                 * link is back. They are only dropped if the module has to be reset.
+                 */
                 vSetAdminDown( pxNetif );
-                vStopDhcp( pxNetif );
-                vClearAddress( pxNetif );
                 LogSys( "Network Link Down." );
                 ( void ) xEventGroupClearBits( xSystemEvents, EVT_MASK_NET_CONNECTED );
+
+                if( xCtx.xLinkLostPending == pdFALSE )
+                {
+                    xCtx.xLinkLostPending = pdTRUE;
+                    xCtx.xLinkDownTick = xTaskGetTickCount();
+                }
             }
 
             /* Reconnect requested by configStore or cli process */
             if( ulNotificationValue & ASYNC_REQUEST_RECONNECT_BIT )
             {
                 ( void ) xEventGroupClearBits( xSystemEvents, EVT_MASK_NET_CONNECTED );
+                vSignalLinkLost( &xCtx, "reconnect requested" );
                 ( void ) mx_SetBypassMode( pdFALSE, pdMS_TO_TICKS( 1000 ) );
                 ( void ) mx_Disconnect( pdMS_TO_TICKS( 1000 ) );
+
+                /* Credentials may have changed, so do not reuse the cached access point */
+                xCtx.xApInfoValid = pdFALSE;
                 xConnectToAP( &xCtx );
             }
         }
+        else if( ( pxNetif->ip_addr.addr != 0 ) &&
+                 ( xCtx.xLeaseSaved == pdFALSE ) )
+        {
+            /* Idle: pick up the gateway hardware address once ARP has resolved it */
+            xCtx.xLeaseSaved = xDhcpLeaseSave( pxNetif );
+        }
+        else
+        {
+            /* Nothing to do */
+        }
+
+        if( ( xCtx.xLinkLostPending == pdTRUE ) &&
+            ( ( xTaskGetTickCount() - xCtx.xLinkDownTick ) >= pdMS_TO_TICKS( MX_LINK_LOST_GRACE_MS ) ) )
+        {
+            vSignalLinkLost( &xCtx, "link down" );
+        }
+
+        /* Follows link changes and ASYNC_REQUEST_POWER_SAVE_BIT, retries after a failure */
+        vUpdatePowerSave( &xCtx );
+        vPowerStatsSetRadioState( xGetRadioState( &xCtx ) );
     }
 }
@@ -30,7 +30,111 @@
 
 #include "FreeRTOS.h"
 
+typedef struct
+{
+    uint32_t ulTransactions;    /* Number of CS-framed SPI transactions */
+    uint32_t ulTxFrames;        /* Frames sent to the module */
+    uint32_t ulRxFrames;        /* Frames received from the module */
+    uint32_t ulTxBytes;         /* Payload bytes sent to the module */
+    uint32_t ulRxBytes;         /* Payload bytes received from the module */
+    uint32_t ulErrors;          /* Transactions which failed after the module signaled ready */
+    uint32_t ulFlowTimeouts;    /* Transactions abandoned while waiting for the flow pin */
+    uint32_t ulHeaderErrors;    /* SPI headers which failed len / lenx validation */
+    uint32_t ulSpiClockDivisor; /* Current SPI clock divisor when the clock ramp is enabled */
+    uint32_t ulSpiClockChanges; /* Number of SPI clock changes made by the clock ramp */
+    uint32_t ulBursts;          /* Wakeups which exchanged at least one frame */
+    uint32_t ulMaxBurstLen;     /* Largest number of transactions in a single burst */
+    uint32_t ulRxPbufMiss;      /* RX pbufs allocated on the fly because none were pre-armed */
+    uint32_t ulPollHits;        /* Wakeups satisfied by busy-polling rather than an interrupt */
+    uint32_t ulTxPrioFrames;    /* Frames taken from the latency-critical data plane queue */
+    uint32_t ulRxDirectFrames;  /* RX frames processed by lwIP in the dataplane thread rather than tcpip_thread */
+    uint64_t ullXferCycles;     /* Total CPU cycles spent with CS asserted */
+    uint32_t ulMaxXferCycles;   /* Longest single transaction in CPU cycles */
+    uint32_t ulCtrlQueueDepth;  /* Control plane TX queue depth at the time of the snapshot */
+    uint32_t ulDataQueueDepth;  /* Bulk data plane TX queue depth at the time of the snapshot */
+    uint32_t ulPrioQueueDepth;  /* Latency-critical data plane TX queue depth at the time of the snapshot */
+} MxDataplaneStats_t;
+
 void net_main( void * pvParameters );
 BaseType_t net_request_reconnect( void );
 
+/* Clients that may keep the wifi module out of power save, one bit each */
+#define NET_ACTIVE_CLIENT_OTA           ( 1UL << 0 )
+#define NET_ACTIVE_CLIENT_LOG_UPLOAD    ( 1UL << 1 )
+#define NET_ACTIVE_CLIENT_OUTBOX        ( 1UL << 2 )
+
+/*
+ * @brief Keep the wifi module out of power save until net_release_active is called for ulClient.
+ * Used around bulk transfers, which would otherwise be paced by the DTIM interval of the access point.
+ */
+void net_request_active( uint32_t ulClient );
+void net_release_active( uint32_t ulClient );
+
+/*
+ * @brief Take a consistent snapshot of the MX dataplane counters.
+ * @return pdFALSE if the dataplane has not been started.
+ */
+BaseType_t net_get_dataplane_stats( MxDataplaneStats_t * pxStats );
+
+/*
+ * @brief Reset the MX dataplane counters to zero.
+ */
+void net_clear_dataplane_stats( void );
+
+/*
+ * Link impairment for benchmarks of the stack on lossy networks: drops, delays, reorders
+ * or corrupts frames and injects SPI header errors at the given rates. Compiled in with
+ * MX_NET_IMPAIR_ENABLED. Rates are in 1/1000 of frames or transactions.
+ */
+#ifndef MX_NET_IMPAIR_ENABLED
+#define MX_NET_IMPAIR_ENABLED    0
+#endif
+
+typedef struct
+{
+    uint32_t ulRxDropPermille;   /* Received frames dropped */
+    uint32_t ulTxDropPermille;   /* Frames dropped instead of being sent */
+    uint32_t ulCorruptPermille;  /* Received frames with one bit flipped after the ethernet header */
+    uint32_t ulReorderPermille;  /* Received frames held back so that later frames overtake them */
+    uint32_t ulDelayMs;          /* Delay added to every received frame */
+    uint32_t ulJitterMs;         /* Random extra delay of up to ulJitterMs per received frame */
+    uint32_t ulSpiErrorPermille; /* SPI RX headers handled as if they failed validation */
+} NetImpairConfig_t;
+
+typedef struct
+{
+    uint32_t ulRxDropped;
+    uint32_t ulTxDropped;
+    uint32_t ulCorrupted;
+    uint32_t ulReordered;
+    uint32_t ulDelayed;
+    uint32_t ulHoldFull;  /* Frames passed on undelayed because all hold slots were in use */
+    uint32_t ulSpiErrors;
+} NetImpairStats_t;
+
+/*
+ * @brief Set the link impairment and reset its counters. A NULL or all zero
+ * configuration turns it off.
+ * @return pdFALSE if the impairment layer is not compiled in.
+ */
+BaseType_t net_set_impairment( const NetImpairConfig_t * pxConfig );
+
+/*
+ * @brief Get the current link impairment and its counters.
+ * @return pdFALSE if the impairment layer is not compiled in.
+ */
+BaseType_t net_get_impairment( NetImpairConfig_t * pxConfig,
+                               NetImpairStats_t * pxStats );
+
+typedef void ( * NetLinkLostCallback_t )( void * pvCtx );
+
+/*
+ * @brief Register a callback invoked when connections over the interface can no longer work:
+ * address lost or changed, interface taken down, reconnect requested, or the link down for
+ * longer than MX_LINK_LOST_GRACE_MS. Lets a client drop its connection right away rather than
+ * wait for a TCP timeout. The callback runs in the net_main task and must not block.
+ */
+void net_set_link_lost_callback( NetLinkLostCallback_t pxCallback,
+                                 void * pvCtx );
+
 #endif /* MX_NETCONN_H */
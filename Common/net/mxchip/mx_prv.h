@@ -32,11 +32,12 @@ extern "C"
 /* *INDENT-ON* */
 
 /* Private definitions to be shared between mx driver files */
-#include "message_buffer.h"
 #include "iot_gpio_stm32_prv.h"
 #include "task.h"
 #include "mx_ipc.h"
 #include "semphr.h"
+#include "mx_netconn.h"
+#include "mx_ring.h"
 
 #define LWIP_STACK
 
@@ -49,6 +50,8 @@ extern "C"
 #define DATA_WAITING_CONTROL             0x10
 #define DATA_WAITING_DATA                0x8
 
+#define CONTROL_RESP_WAITING_IDX         4
+
 #define NET_EVT_IDX                      0x1
 #define NET_LWIP_READY_BIT               0x1
 #define NET_LWIP_IP_CHANGE_BIT           0x2
@@ -58,9 +61,13 @@ extern "C"
 #define NET_LWIP_LINK_DOWN_BIT           0x20
 #define MX_STATUS_UPDATE_BIT             0x40
 #define ASYNC_REQUEST_RECONNECT_BIT      0x80
+#define ASYNC_REQUEST_POWER_SAVE_BIT     0x100
 
 /* Constants */
-#define NUM_IPC_REQUEST_CTX              1
+/* Number of IPC requests which may be outstanding at once, including asynchronous requests */
+#ifndef NUM_IPC_REQUEST_CTX
+#define NUM_IPC_REQUEST_CTX              4
+#endif
 #define MX_DEFAULT_TIMEOUT_MS            100
 #define MX_DEFAULT_TIMEOUT_TICK          pdMS_TO_TICKS( MX_DEFAULT_TIMEOUT_MS )
 #define MX_TIMEOUT_CONNECT               pdMS_TO_TICKS( 120 * 1000 )
@@ -76,9 +83,200 @@ extern "C"
 #define MX_SPI_EVENT_TIMEOUT             pdMS_TO_TICKS( 10000 )
 #define MX_SPI_FLOW_TIMEOUT              pdMS_TO_TICKS( 10 )
 
+/*
+ * Tiered reconnect: first re-associate with the last known BSSID / channel for up to
+ * MX_FAST_RECONNECT_TIMEOUT, then fall back to a full scan and connect. After
+ * MX_RECONNECT_RESET_THRESHOLD consecutive failed attempts, the module is hard reset
+ * and the DHCP lease is dropped.
+ */
+#ifndef MX_FAST_RECONNECT_TIMEOUT
+#define MX_FAST_RECONNECT_TIMEOUT        pdMS_TO_TICKS( 10 * 1000 )
+#endif
+
+/*
+ * Set to 1 to keep the last access point in the CS_NET_WIFI_AP kvstore entry, so that
+ * the first connection after a reboot or power cycle also takes the fast path.
+ */
+#ifndef MX_AP_HINT_PERSIST
+#define MX_AP_HINT_PERSIST               1
+#endif
+
+#ifndef MX_RECONNECT_RESET_THRESHOLD
+#define MX_RECONNECT_RESET_THRESHOLD     3
+#endif
+
+/* Interval between retries of net_main while not connected or not fully set up */
+#ifndef MX_NET_RETRY_MS
+#define MX_NET_RETRY_MS                  ( 30 * 1000 )
+#endif
+
+/*
+ * Time the link may stay down before the net_set_link_lost_callback client is told
+ * that its connections are gone. Shorter outages, e.g. roaming, are ridden out on
+ * the kept address and lease.
+ */
+#ifndef MX_LINK_LOST_GRACE_MS
+#define MX_LINK_LOST_GRACE_MS            ( 3 * 1000 )
+#endif
+
+/*
+ * Module power save: while the link is idle the radio sleeps and only wakes up for
+ * the DTIM beacons of the access point, which costs up to one DTIM interval of
+ * downlink latency. It is turned off while a client of net_request_active needs
+ * throughput (OTA download, log or outbox upload) and while the link is being set up.
+ */
+#ifndef MX_POWER_SAVE_ENABLED
+#define MX_POWER_SAVE_ENABLED            1
+#endif
+
+/*
+ * Task priorities of the network stack, highest first:
+ *   MxData  MX_DATAPLANE_TASK_PRIO (26)    SPI transfers, and with MX_LWIP_DIRECT_INPUT the lwIP
+ *                                          input path (ethernet_input, tcp_input, ACKs) for RX frames.
+ *   lwIP    TCPIP_THREAD_PRIO (25)         lwIP timers, netconn / netifapi messages and RX frames
+ *                                          queued while another task held the core lock.
+ *   MxCtrl  MX_CTRLPLANE_TASK_PRIO (24)    IPC responses and module events.
+ *   Tmr Svc configTIMER_TASK_PRIORITY (24)
+ *   MxNet   23 (app_main.c)                Connection management, DHCP lease handling.
+ *
+ * The dataplane thread must run above tcpip_thread: a task sending with the core lock
+ * held waits in prvxLinkOutput for the dataplane thread to drain a full TX ring.
+ */
+#ifndef MX_DATAPLANE_TASK_PRIO
+#define MX_DATAPLANE_TASK_PRIO           26
+#endif
+
+#ifndef MX_CTRLPLANE_TASK_PRIO
+#define MX_CTRLPLANE_TASK_PRIO           24
+#endif
+
+/*
+ * Direct input: the dataplane thread passes received frames to lwIP itself while holding
+ * the core lock, rather than posting each one to tcpip_thread and switching to it.
+ * The dataplane thread never blocks on the core lock. When it is held by another task,
+ * the frame is posted to tcpip_thread, and later frames follow the same way until
+ * tcpip_thread has processed it so that frames are never reordered.
+ */
+#ifndef MX_LWIP_DIRECT_INPUT
+#define MX_LWIP_DIRECT_INPUT             1
+#endif
+
 #define CONTROL_PLANE_QUEUE_LEN          10
 #define DATA_PLANE_QUEUE_LEN             10
-#define CONTROL_PLANE_BUFFER_SZ          ( 25 * sizeof( void * ) + sizeof( size_t ) )
+#define DATA_PLANE_PRIO_QUEUE_LEN        4
+#define CONTROL_PLANE_RESP_LEN           12
+
+/* Maximum number of back to back SPI transactions per dataplane wakeup */
+#define MX_DATAPLANE_BURST_MAX           ( CONTROL_PLANE_QUEUE_LEN + DATA_PLANE_QUEUE_LEN + DATA_PLANE_PRIO_QUEUE_LEN )
+
+/*
+ * Data plane TX classes. Frames classified as latency-critical by prvxLinkOutput
+ * are placed on a separate queue which is served MX_TX_PRIO_WEIGHT times for each
+ * frame taken from the bulk queue when both have data waiting.
+ *
+ * A frame is latency-critical when it is an ARP frame, an IPv4 frame with a DSCP
+ * value of at least MX_TX_PRIO_DSCP_MIN (set per socket with the IP_TOS option),
+ * or any IPv4 frame of at most MX_TX_PRIO_FRAME_LEN bytes (TCP ACKs, MQTT PINGREQ).
+ */
+#ifndef MX_TX_PRIO_WEIGHT
+#define MX_TX_PRIO_WEIGHT                4
+#endif
+
+#ifndef MX_TX_PRIO_DSCP_MIN
+#define MX_TX_PRIO_DSCP_MIN              40 /* CS5 */
+#endif
+
+#ifndef MX_TX_PRIO_FRAME_LEN
+#define MX_TX_PRIO_FRAME_LEN             128
+#endif
+
+/* Number of MX_RX_BUFF_SZ pbufs kept allocated ahead of time for incoming frames */
+#define MX_RX_PBUF_READY_LEN             ( PBUF_POOL_SIZE / 8 )
+
+/*
+ * Adaptive polling: once a burst of at least MX_DATAPLANE_POLL_BURST_THRESHOLD
+ * frames is seen, the dataplane thread busy-polls the notify pin and TX queues
+ * for up to MX_DATAPLANE_POLL_SPIN_COUNT iterations before blocking, for
+ * MX_DATAPLANE_POLL_HOLD_MS after the last such burst.
+ * Set MX_DATAPLANE_POLL_SPIN_COUNT to 0 to always block on the notify interrupt.
+ */
+#ifndef MX_DATAPLANE_POLL_SPIN_COUNT
+#define MX_DATAPLANE_POLL_SPIN_COUNT        2000
+#endif
+
+#ifndef MX_DATAPLANE_POLL_BURST_THRESHOLD
+#define MX_DATAPLANE_POLL_BURST_THRESHOLD    2
+#endif
+
+#ifndef MX_DATAPLANE_POLL_HOLD_MS
+#define MX_DATAPLANE_POLL_HOLD_MS            50
+#endif
+
+/* Only while traffic is hot; otherwise the task blocks until notified */
+#define MX_DATAPLANE_HOT_WAIT_TICKS          1
+
+/*
+ * SPI clock ramp: when enabled, the dataplane starts at the prescaler configured in
+ * hw_spi_init and steps the SPI clock up by one level after MX_SPI_CLOCK_RAMP_UP_COUNT
+ * consecutive valid headers, up to MX_SPI_CLOCK_RAMP_MIN_PRESCALER. After
+ * MX_SPI_CLOCK_RAMP_DOWN_ERRORS header errors less than MX_SPI_CLOCK_RAMP_ERROR_WINDOW_MS
+ * apart it steps back down and does not probe the failing level again.
+ */
+#ifndef MX_SPI_CLOCK_RAMP
+#define MX_SPI_CLOCK_RAMP                    0
+#endif
+
+#ifndef MX_SPI_CLOCK_RAMP_MIN_PRESCALER
+#define MX_SPI_CLOCK_RAMP_MIN_PRESCALER      SPI_BAUDRATEPRESCALER_4
+#endif
+
+#ifndef MX_SPI_CLOCK_RAMP_UP_COUNT
+#define MX_SPI_CLOCK_RAMP_UP_COUNT           1000
+#endif
+
+#ifndef MX_SPI_CLOCK_RAMP_DOWN_ERRORS
+#define MX_SPI_CLOCK_RAMP_DOWN_ERRORS        3
+#endif
+
+#ifndef MX_SPI_CLOCK_RAMP_ERROR_WINDOW_MS
+#define MX_SPI_CLOCK_RAMP_ERROR_WINDOW_MS    1000
+#endif
+
+/*
+ * Link impairment (MX_NET_IMPAIR_ENABLED, see net_set_impairment): delayed and reordered
+ * RX frames wait in one of MX_IMPAIR_HOLD_SLOTS slots. A reordered frame is held
+ * MX_IMPAIR_REORDER_MS longer than the others.
+ */
+#ifndef MX_IMPAIR_HOLD_SLOTS
+#define MX_IMPAIR_HOLD_SLOTS                 16
+#endif
+
+#ifndef MX_IMPAIR_REORDER_MS
+#define MX_IMPAIR_REORDER_MS                 20
+#endif
+
+#if ( MX_DATAPLANE_TASK_PRIO <= TCPIP_THREAD_PRIO ) || ( MX_DATAPLANE_TASK_PRIO >= configMAX_PRIORITIES )
+#error "MX_DATAPLANE_TASK_PRIO must be above TCPIP_THREAD_PRIO and below configMAX_PRIORITIES"
+#endif
+
+#if ( MX_LWIP_DIRECT_INPUT == 1 ) && ( LWIP_TCPIP_CORE_LOCKING == 0 )
+#error "MX_LWIP_DIRECT_INPUT requires LWIP_TCPIP_CORE_LOCKING"
+#endif
+
+#if ( MX_RX_PBUF_READY_LEN < 1 ) || ( MX_RX_PBUF_READY_LEN >= PBUF_POOL_SIZE )
+#error "MX_RX_PBUF_READY_LEN must be at least 1 and less than PBUF_POOL_SIZE"
+#endif
+
+
+typedef struct
+{
+    uint32_t ulLevel;        /* Current index into the prescaler ladder */
+    uint32_t ulNextLevel;    /* Level to switch to once the current transaction completes */
+    uint32_t ulCeiling;      /* Fastest level considered reliable */
+    uint32_t ulGoodHeaders;  /* Consecutive valid headers at the current level */
+    uint32_t ulRecentErrors; /* Header errors in the current error window */
+    TickType_t xLastErrorTick;
+} MxSpiClockCtx_t;
 
 typedef struct
 {
@@ -88,18 +286,28 @@ typedef struct
     const IotMappedPin_t * gpio_notify;
     SPI_HandleTypeDef * pxSpiHandle;
     TaskHandle_t xDataPlaneTaskHandle;
-    volatile uint32_t ulTxPacketsWaiting;
+    volatile uint32_t ulTxPacketsWaiting; /* Control plane messages waiting in xControlPlaneSendQueue */
     volatile uint32_t ulLastRequestId;
     NetInterface_t * pxNetif;
-    MessageBufferHandle_t xControlPlaneResponseBuff;
-    QueueHandle_t xDataPlaneSendQueue;
+    MxRing_t * pxControlPlaneResponseRing;
+    MxRing_t * pxDataPlaneSendRing;
+    MxRing_t * pxDataPlanePrioSendRing;
     QueueHandle_t xControlPlaneSendQueue;
+    uint32_t ulTxPrioCredit;
+    volatile BaseType_t xResetRequested;
+    uint8_t * volatile pucChainTxBuffer;
+    uint8_t * volatile pucChainRxBuffer;
+    volatile uint16_t usChainLen;
+    MxSpiClockCtx_t xSpiClock;
+    MxDataplaneStats_t xStats;
+    PacketBuffer_t * pxRxPbufReady[ MX_RX_PBUF_READY_LEN ];
+    uint32_t ulRxPbufReadyCount;
 } MxDataplaneCtx_t;
 
 typedef struct
 {
     QueueHandle_t xControlPlaneSendQueue;
-    MessageBufferHandle_t xControlPlaneResponseBuff; /* Message buffer for IPC message responses */
+    MxRing_t * pxControlPlaneResponseRing; /* IPC message responses from the dataplane thread */
     TaskHandle_t xDataPlaneTaskHandle;
     MxEventCallback_t xEventCallback;
     void * pxEventCallbackCtx;
@@ -113,8 +321,18 @@ typedef struct
     NetInterface_t xNetif;
     volatile MxStatus_t xStatus;
     volatile MxStatus_t xStatusPrevious;
-    QueueHandle_t xDataPlaneSendQueue;
-    volatile uint32_t * pulTxPacketsWaiting;
+    MxRing_t * pxDataPlaneSendRing;
+    MxRing_t * pxDataPlanePrioSendRing;
+    MxApInfo_t xApInfo;          /* Access point of the last successful connection */
+    BaseType_t xApInfoValid;
+    BaseType_t xApHintLoaded;    /* The stored access point was looked up for this boot */
+    uint32_t ulConnectFailures; /* Consecutive failed connection attempts */
+    BaseType_t xPowerSave;       /* Power save mode last set on the module */
+    BaseType_t xPowerSaveValid;  /* pdFALSE until xPowerSave has been set for the current association */
+    BaseType_t xLeaseSaved;      /* The stored DHCP lease matches the current address and gateway */
+    uint32_t ulLinkAddr;         /* Address connections were made from, 0 if none */
+    BaseType_t xLinkLostPending; /* Link down since xLinkDownTick, client not told yet */
+    TickType_t xLinkDownTick;
     TaskHandle_t xNetTaskHandle;
     TaskHandle_t xDataPlaneTaskHandle;
 } MxNetConnectCtx_t;
@@ -135,9 +353,9 @@ typedef enum
     IPC_WIFI_SOFTAP_START, /* Not used by this implementation */
     IPC_WIFI_SOFTAP_STOP,  /* Not used by this implementation */
     IPC_WIFI_GET_IP,       /* Not used by this implementation */
-    IPC_WIFI_GET_LINKINFO, /* Not used by this implementation */
-    IPC_WIFI_PS_ON,        /* Not used by this implementation */
-    IPC_WIFI_PS_OFF,       /* Not used by this implementation */
+    IPC_WIFI_GET_LINKINFO,
+    IPC_WIFI_PS_ON,
+    IPC_WIFI_PS_OFF,
     IPC_WIFI_PING,         /* Not used by this implementation */
     IPC_WIFI_BYPASS_SET,
     IPC_WIFI_BYPASS_GET,
@@ -213,6 +431,19 @@ struct IPCResponseStatus
 
 typedef struct IPCResponseStatus IPCResponseWifiDisconnect_t;
 
+/* IPC_WIFI_GET_LINKINFO */
+typedef struct IPCResponseWifiGetLinkInfo
+{
+    int32_t lStatus;
+    int32_t lIsConnected;
+    int32_t lRssi;
+    char cSSID[ MX_SSID_BUF_LEN ];
+    uint8_t ucBssid[ MX_BSSID_LEN ];
+    char cKey[ MX_PSK_BUF_LEN ];
+    int32_t lChannel;
+    uint32_t ulSecurity; /* MxWifiSecurity_t */
+} IPCResponseWifiGetLinkInfo_t;
+
 /* IPC_WIFI_BYPASS_SET */
 
 typedef struct IPCRequestWifiBypassSet
@@ -235,6 +466,7 @@ typedef union
     IPCResponseWifiGetMac_t xResponseWifiGetMac;
     IPCRequestWifiConnect_t xRequestWifiConnect;
     IPCResponseWifiDisconnect_t xRequestWifiDisconnect;
+    IPCResponseWifiGetLinkInfo_t xResponseWifiGetLinkInfo;
     IPCRequestWifiBypassSet_t xRequestWifiBypassSet;
     IPCRequestWifiBypassGet_t xRequestWifiBypassGet;
     IPCEventStatus_t xEventStatus;
@@ -310,6 +542,14 @@ BaseType_t prvxLinkInput( NetInterface_t * pxNetif,
 void prvControlPlaneRouter( void * pvParameters );
 uint32_t prvGetNextRequestID( void );
 void vDataplaneThread( void * pvParameters );
+void vDataplaneRequestReset( MxDataplaneCtx_t * pxCtx );
+
+#if ( MX_NET_IMPAIR_ENABLED == 1 )
+/* Returns pdTRUE when the SPI RX header of the current transaction should be treated as corrupted */
+BaseType_t xMxImpairSpiError( void );
+#else
+#define xMxImpairSpiError()    ( pdFALSE )
+#endif
 
 /* *INDENT-OFF* */
 #ifdef __cplusplus
@@ -0,0 +1,196 @@
+/*
+ * FreeRTOS STM32 Reference Integration
+ *
+ * Copyright (C) 2021 Amazon.com, Inc. or its affiliates.  All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ * https://www.FreeRTOS.org
+ * https://github.com/FreeRTOS
+ *
+ */
+
+#ifndef _MX_RING_
+#define _MX_RING_
+
+/*
+ * Lock-free single producer / single consumer pointer ring.
+ *
+ * Only the producer writes ulHead and only the consumer writes ulTail, so neither
+ * side needs a critical section. One slot is always left unused to tell a full ring
+ * from an empty one, so the slot array must hold MX_RING_SLOTS( capacity ) entries.
+ *
+ * The consumer task is woken through its notification at uxNotifyIndex only when
+ * the ring goes from empty to non-empty. The consumer must therefore retry
+ * xMxRingPop / xMxRingPeek before blocking on that notification.
+ *
+ * A "single producer" may be several tasks as long as pushes are serialized by a
+ * lock, e.g. the lwIP core lock.
+ */
+
+#include "FreeRTOS.h"
+#include "task.h"
+#include "stm32u5xx.h"
+
+#define MX_RING_SLOTS( capacity )    ( ( capacity ) + 1 )
+
+typedef struct
+{
+    volatile uint32_t ulHead;            /* Next slot to be written, written by the producer only */
+    volatile uint32_t ulTail;            /* Next slot to be read, written by the consumer only */
+    uint32_t ulSlots;                    /* Length of ppvSlots */
+    void * volatile * ppvSlots;
+    TaskHandle_t volatile xConsumerTask; /* Task to notify on empty to non-empty transitions */
+    UBaseType_t uxNotifyIndex;
+} MxRing_t;
+
+static inline uint32_t ulMxRingNext( const MxRing_t * pxRing,
+                                     uint32_t ulIndex )
+{
+    ulIndex++;
+
+    if( ulIndex >= pxRing->ulSlots )
+    {
+        ulIndex = 0;
+    }
+
+    return ulIndex;
+}
+
+static inline void vMxRingInit( MxRing_t * pxRing,
+                                void ** ppvSlots,
+                                uint32_t ulSlots,
+                                UBaseType_t uxNotifyIndex )
+{
+    configASSERT( pxRing != NULL );
+    configASSERT( ppvSlots != NULL );
+    configASSERT( ulSlots > 1 );
+    configASSERT( uxNotifyIndex < configTASK_NOTIFICATION_ARRAY_ENTRIES );
+
+    pxRing->ulHead = 0;
+    pxRing->ulTail = 0;
+    pxRing->ulSlots = ulSlots;
+    pxRing->ppvSlots = ppvSlots;
+    pxRing->xConsumerTask = NULL;
+    pxRing->uxNotifyIndex = uxNotifyIndex;
+}
+
+/*
+ * @brief Register the calling task as the consumer of the given ring.
+ * Called by the consumer before it first reads from the ring.
+ */
+static inline void vMxRingSetConsumer( MxRing_t * pxRing )
+{
+    pxRing->xConsumerTask = xTaskGetCurrentTaskHandle();
+
+    /* Make the handle visible to the producer before the consumer looks at ulHead */
+    __DMB();
+}
+
+/*
+ * @brief Add an item to the ring without blocking.
+ * @return pdTRUE on success, pdFALSE if the ring is full.
+ */
+static inline BaseType_t xMxRingPush( MxRing_t * pxRing,
+                                      void * pvItem )
+{
+    BaseType_t xResult = pdFALSE;
+    uint32_t ulHead = pxRing->ulHead;
+    uint32_t ulNextHead = ulMxRingNext( pxRing, ulHead );
+
+    if( ulNextHead != pxRing->ulTail )
+    {
+        pxRing->ppvSlots[ ulHead ] = pvItem;
+
+        /* Publish the slot contents before the new head */
+        __DMB();
+        pxRing->ulHead = ulNextHead;
+
+        /* Order the head update against reading the consumer's progress */
+        __DMB();
+
+        /* The consumer had caught up with the old head, so it may be waiting */
+        if( ( pxRing->ulTail == ulHead ) &&
+            ( pxRing->xConsumerTask != NULL ) )
+        {
+            ( void ) xTaskNotifyGiveIndexed( pxRing->xConsumerTask, pxRing->uxNotifyIndex );
+        }
+
+        xResult = pdTRUE;
+    }
+
+    return xResult;
+}
+
+/*
+ * @brief Read the oldest item in the ring without removing it. Consumer only.
+ * @return pdTRUE if an item was written to *ppvItem, pdFALSE if the ring is empty.
+ */
+static inline BaseType_t xMxRingPeek( MxRing_t * pxRing,
+                                      void ** ppvItem )
+{
+    BaseType_t xResult = pdFALSE;
+    uint32_t ulTail = pxRing->ulTail;
+
+    if( ulTail != pxRing->ulHead )
+    {
+        /* Read the slot only after observing the head that published it */
+        __DMB();
+        *ppvItem = pxRing->ppvSlots[ ulTail ];
+        xResult = pdTRUE;
+    }
+
+    return xResult;
+}
+
+/*
+ * @brief Remove the oldest item from the ring. Consumer only.
+ * @return pdTRUE if an item was written to *ppvItem, pdFALSE if the ring is empty.
+ */
+static inline BaseType_t xMxRingPop( MxRing_t * pxRing,
+                                     void ** ppvItem )
+{
+    BaseType_t xResult = xMxRingPeek( pxRing, ppvItem );
+
+    if( xResult == pdTRUE )
+    {
+        /* Finish reading the slot before handing it back to the producer */
+        __DMB();
+        pxRing->ulTail = ulMxRingNext( pxRing, pxRing->ulTail );
+
+        /* Order the tail update against the consumer's next look at ulHead */
+        __DMB();
+    }
+
+    return xResult;
+}
+
+static inline BaseType_t xMxRingIsEmpty( const MxRing_t * pxRing )
+{
+    return( pxRing->ulHead == pxRing->ulTail );
+}
+
+static inline uint32_t ulMxRingCount( const MxRing_t * pxRing )
+{
+    uint32_t ulHead = pxRing->ulHead;
+    uint32_t ulTail = pxRing->ulTail;
+
+    return( ( ulHead >= ulTail ) ? ( ulHead - ulTail ) : ( pxRing->ulSlots - ulTail + ulHead ) );
+}
+
+#endif /* _MX_RING_ */
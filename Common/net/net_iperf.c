@@ -0,0 +1,853 @@
+/*
+ * FreeRTOS STM32 Reference Integration
+ *
+ * Copyright (c) 2022 Amazon.com, Inc. or its affiliates. All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+/**
+ * @file net_iperf.c
+ * @brief iperf2 compatible throughput tests over lwIP, optionally through TLS.
+ */
+#include "logging_levels.h"
+
+#define LOG_LEVEL    LOG_INFO
+#define LOG_MODULE    LOG_MODULE_NET
+
+#include "logging.h"
+
+#include "net_iperf.h"
+
+#include <string.h>
+
+/* FreeRTOS includes. */
+#include "FreeRTOS.h"
+#include "task.h"
+
+/* lwIP includes. */
+#include "lwip/tcpip.h"
+#include "lwip/stats.h"
+#include "lwip/sockets.h"
+#include "lwip/netdb.h"
+#include "lwip/apps/lwiperf.h"
+
+#include "mbedtls_transport.h"
+#include "tls_transport_config.h"
+#include "PkiObject.h"
+#include "time_base.h"
+#include "dvfs.h"
+
+#if !TCP_STATS
+#error "net_iperf needs LWIP_STATS with TCP_STATS"
+#endif
+
+/* iperf2 marks datagrams carrying a server report with this flag */
+#define IPERF_HEADER_VERSION1         0x80000000UL
+
+/* Attempts to deliver the final datagram of a UDP test, as iperf2 does */
+#define IPERF_UDP_FIN_RETRIES         10
+#define IPERF_UDP_FIN_TIMEOUT_MS      250
+
+/* Socket timeouts are in ms with LWIP_SO_SNDRCVTIMEO_NONSTANDARD */
+#define IPERF_RECV_TIMEOUT_MS         1000
+#define IPERF_SEND_TIMEOUT_MS         5000
+
+/* CPU load samples kept while waiting for the lwiperf server, one per second */
+#define IPERF_CPU_SAMPLES             32
+
+/* Datagram header since iperf 2.0.13, id2 holds the upper bits of 64 bit sequence numbers */
+typedef struct IperfUdpHdr
+{
+    int32_t lId;
+    uint32_t ulSec;
+    uint32_t ulUsec;
+    int32_t lId2;
+} IperfUdpHdr_t;
+
+/* Older iperf2 versions send 12 byte headers, without lId2 */
+#define IPERF_UDP_HDR_LEN_V1          12
+
+typedef struct IperfServerHdr
+{
+    int32_t lFlags;
+    int32_t lTotalLen1;
+    int32_t lTotalLen2;
+    int32_t lStopSec;
+    int32_t lStopUsec;
+    int32_t lErrorCnt;
+    int32_t lOutOfOrderCnt;
+    int32_t lDatagrams;
+    int32_t lJitterSec;
+    int32_t lJitterUsec;
+} IperfServerHdr_t;
+
+#define IPERF_UDP_MIN_LEN             ( sizeof( IperfUdpHdr_t ) + sizeof( IperfServerHdr_t ) )
+#define IPERF_UDP_MAX_LEN             1472
+
+typedef struct CpuSample
+{
+    uint32_t ulIdle;
+    uint32_t ulTotal;
+} CpuSample_t;
+
+/* Owned by the tcpip thread, lwiperf callbacks run there */
+static void * pvServerSession = NULL;
+
+/* Result of the last lwiperf test, handed to xServerWaiter, guarded by the core lock */
+static TaskHandle_t xServerWaiter = NULL;
+static NetIperfResult_t xServerResult;
+static BaseType_t xServerResultOk = pdFALSE;
+
+/*-----------------------------------------------------------*/
+
+static void prvCpuSample( CpuSample_t * pxSample )
+{
+    static TaskHandle_t xIdleTask = NULL;
+    TaskStatus_t xStatus = { 0 };
+
+    if( xIdleTask == NULL )
+    {
+        xIdleTask = xTaskGetHandle( configIDLE_TASK_NAME );
+    }
+
+    if( xIdleTask != NULL )
+    {
+        vTaskGetInfo( xIdleTask, &xStatus, pdFALSE, eReady );
+    }
+
+    pxSample->ulIdle = ( uint32_t ) xStatus.ulRunTimeCounter;
+    pxSample->ulTotal = ( uint32_t ) portGET_RUN_TIME_COUNTER_VALUE();
+}
+
+/*-----------------------------------------------------------*/
+
+static uint32_t prvCpuPermille( const CpuSample_t * pxStart,
+                                const CpuSample_t * pxEnd )
+{
+    uint32_t ulTotal = pxEnd->ulTotal - pxStart->ulTotal;
+    uint32_t ulIdle = pxEnd->ulIdle - pxStart->ulIdle;
+    uint32_t ulPermille = 0;
+
+    if( ( ulTotal > 0 ) && ( ulIdle < ulTotal ) )
+    {
+        ulPermille = 1000U - ( uint32_t ) ( ( ( uint64_t ) ulIdle * 1000U ) / ulTotal );
+    }
+
+    return ulPermille;
+}
+
+/*-----------------------------------------------------------*/
+
+static uint32_t prvTcpRexmit( void )
+{
+    uint32_t ulRexmit;
+
+    LOCK_TCPIP_CORE();
+    ulRexmit = lwip_stats.tcp.rexmit;
+    UNLOCK_TCPIP_CORE();
+
+    return ulRexmit;
+}
+
+/*-----------------------------------------------------------*/
+
+static void prvSetRate( NetIperfResult_t * pxResult )
+{
+    if( pxResult->ulMs > 0 )
+    {
+        /* bits per ms are kbit/s */
+        pxResult->ulKbps = ( uint32_t ) ( ( pxResult->ullBytes * 8U ) / pxResult->ulMs );
+    }
+}
+
+/*-----------------------------------------------------------*/
+
+/* Runs in the tcpip thread */
+static void prvLwiperfReport( void * pvArg,
+                              enum lwiperf_report_type xReportType,
+                              const ip_addr_t * pxLocalAddr,
+                              u16_t usLocalPort,
+                              const ip_addr_t * pxRemoteAddr,
+                              u16_t usRemotePort,
+                              u32_t ulBytes,
+                              u32_t ulMs,
+                              u32_t ulKbps )
+{
+    char cAddr[ IPADDR_STRLEN_MAX ] = { 0 };
+
+    ( void ) pvArg;
+    ( void ) pxLocalAddr;
+    ( void ) usLocalPort;
+
+    ( void ) ipaddr_ntoa_r( pxRemoteAddr, cAddr, sizeof( cAddr ) );
+
+    if( xReportType == LWIPERF_TCP_DONE_SERVER )
+    {
+        LogInfo( "iperf test from %s:%u: %lu bytes in %lu ms, %lu kbit/s.",
+                 cAddr, usRemotePort, ( unsigned long ) ulBytes,
+                 ( unsigned long ) ulMs, ( unsigned long ) ulKbps );
+    }
+    else
+    {
+        LogWarn( "iperf test from %s:%u aborted, reason: %d, %lu bytes in %lu ms.",
+                 cAddr, usRemotePort, xReportType, ( unsigned long ) ulBytes, ( unsigned long ) ulMs );
+    }
+
+    if( xServerWaiter != NULL )
+    {
+        ( void ) memset( &xServerResult, 0, sizeof( xServerResult ) );
+        xServerResult.ullBytes = ulBytes;
+        xServerResult.ulMs = ulMs;
+        xServerResult.ulKbps = ulKbps;
+        xServerResultOk = ( xReportType == LWIPERF_TCP_DONE_SERVER ) ? pdTRUE : pdFALSE;
+
+        ( void ) xTaskNotifyGiveIndexed( xServerWaiter, NET_IPERF_NOTIFY_IDX );
+    }
+}
+
+/*-----------------------------------------------------------*/
+
+void vNetIperfServerStart( void )
+{
+    LOCK_TCPIP_CORE();
+
+    if( pvServerSession == NULL )
+    {
+        pvServerSession = lwiperf_start_tcp_server( IP_ADDR_ANY, NET_IPERF_PORT, prvLwiperfReport, NULL );
+
+        if( pvServerSession == NULL )
+        {
+            LogError( "Failed to start the iperf server." );
+        }
+        else
+        {
+            LogSys( "Started Iperf server" );
+        }
+    }
+
+    UNLOCK_TCPIP_CORE();
+}
+
+/*-----------------------------------------------------------*/
+
+/*
+ * lwiperf only reports at the end of a test. The CPU load is sampled each
+ * second while waiting so that the load over the test itself can be given.
+ */
+static BaseType_t prvTcpServer( const NetIperfParams_t * pxParams,
+                                NetIperfResult_t * pxResult )
+{
+    static CpuSample_t xSamples[ IPERF_CPU_SAMPLES ];
+    BaseType_t xSuccess = pdFALSE;
+    BaseType_t xReported = pdFALSE;
+    uint32_t ulSeconds = 0;
+    uint32_t ulRexmitStart = prvTcpRexmit();
+    CpuSample_t xEnd;
+
+    if( pxParams->usPort != NET_IPERF_PORT )
+    {
+        LogError( "The iperf server only listens on port %u.", NET_IPERF_PORT );
+    }
+    else
+    {
+        vNetIperfServerStart();
+
+        prvCpuSample( &( xSamples[ 0 ] ) );
+
+        LOCK_TCPIP_CORE();
+        xServerWaiter = xTaskGetCurrentTaskHandle();
+        UNLOCK_TCPIP_CORE();
+
+        ( void ) xTaskNotifyStateClearIndexed( NULL, NET_IPERF_NOTIFY_IDX );
+
+        while( ( xReported == pdFALSE ) &&
+               ( ( ulSeconds * 1000U ) < pxParams->ulDurationMs ) )
+        {
+            if( ulTaskNotifyTakeIndexed( NET_IPERF_NOTIFY_IDX, pdTRUE, pdMS_TO_TICKS( 1000 ) ) > 0 )
+            {
+                xReported = pdTRUE;
+            }
+            else
+            {
+                ulSeconds++;
+                prvCpuSample( &( xSamples[ ulSeconds % IPERF_CPU_SAMPLES ] ) );
+            }
+        }
+
+        LOCK_TCPIP_CORE();
+        xServerWaiter = NULL;
+        *pxResult = xServerResult;
+        xSuccess = ( xReported == pdTRUE ) ? xServerResultOk : pdFALSE;
+        UNLOCK_TCPIP_CORE();
+    }
+
+    if( xSuccess == pdTRUE )
+    {
+        uint32_t ulTestSeconds = ( pxResult->ulMs + 999U ) / 1000U;
+        uint32_t ulFirst = ( ulSeconds > ulTestSeconds ) ? ( ulSeconds - ulTestSeconds ) : 0;
+
+        /* Fall back to the oldest sample still held */
+        if( ( ulSeconds - ulFirst ) >= IPERF_CPU_SAMPLES )
+        {
+            ulFirst = ulSeconds - ( IPERF_CPU_SAMPLES - 1 );
+        }
+
+        prvCpuSample( &xEnd );
+        pxResult->ulCpuPermille = prvCpuPermille( &( xSamples[ ulFirst % IPERF_CPU_SAMPLES ] ), &xEnd );
+        pxResult->ulRexmit = prvTcpRexmit() - ulRexmitStart;
+    }
+    else if( xReported == pdFALSE )
+    {
+        LogWarn( "No iperf client connected within %lu ms.", ( unsigned long ) pxParams->ulDurationMs );
+    }
+
+    return xSuccess;
+}
+
+/*-----------------------------------------------------------*/
+
+static int prvConnectSocket( const NetIperfParams_t * pxParams,
+                             int lType )
+{
+    const struct addrinfo xHints =
+    {
+        .ai_family   = AF_INET,
+        .ai_socktype = lType,
+    };
+    struct addrinfo * pxAddrInfo = NULL;
+    int lSock = -1;
+
+    if( ( lwip_getaddrinfo( pxParams->pcHost, NULL, &xHints, &pxAddrInfo ) != 0 ) ||
+        ( pxAddrInfo == NULL ) )
+    {
+        LogError( "Failed to resolve %s.", pxParams->pcHost );
+    }
+    else
+    {
+        struct sockaddr_in * pxAddr = ( struct sockaddr_in * ) pxAddrInfo->ai_addr;
+        const uint32_t ulSendTimeoutMs = IPERF_SEND_TIMEOUT_MS;
+
+        pxAddr->sin_port = lwip_htons( pxParams->usPort );
+
+        lSock = lwip_socket( AF_INET, lType, 0 );
+
+        if( lSock < 0 )
+        {
+            LogError( "Failed to allocate a socket." );
+        }
+        else if( lwip_connect( lSock, pxAddrInfo->ai_addr, pxAddrInfo->ai_addrlen ) != 0 )
+        {
+            LogError( "Failed to connect to %s:%u.", pxParams->pcHost, pxParams->usPort );
+            ( void ) lwip_close( lSock );
+            lSock = -1;
+        }
+        else
+        {
+            ( void ) lwip_setsockopt( lSock, SOL_SOCKET, SO_SNDTIMEO, &ulSendTimeoutMs, sizeof( ulSendTimeoutMs ) );
+        }
+
+        lwip_freeaddrinfo( pxAddrInfo );
+    }
+
+    return lSock;
+}
+
+/*-----------------------------------------------------------*/
+
+static NetworkContext_t * prvConnectTls( const NetIperfParams_t * pxParams )
+{
+    NetworkContext_t * pxNetworkContext = mbedtls_transport_allocate();
+    PkiObject_t xRootCa[ 1 ] = { xPkiObjectFromLabel( TLS_ROOT_CA_CERT_LABEL ) };
+    TlsTransportStatus_t xStatus = TLS_TRANSPORT_INSUFFICIENT_MEMORY;
+
+    if( pxNetworkContext != NULL )
+    {
+        xStatus = mbedtls_transport_configure( pxNetworkContext, NULL, NULL, NULL, xRootCa, 1 );
+    }
+
+    if( xStatus == TLS_TRANSPORT_SUCCESS )
+    {
+        xStatus = mbedtls_transport_connect( pxNetworkContext, pxParams->pcHost, pxParams->usPort,
+                                             IPERF_RECV_TIMEOUT_MS, IPERF_SEND_TIMEOUT_MS );
+    }
+
+    if( xStatus != TLS_TRANSPORT_SUCCESS )
+    {
+        LogError( "Failed to connect to %s:%u over TLS, error = %d.", pxParams->pcHost, pxParams->usPort, xStatus );
+
+        if( pxNetworkContext != NULL )
+        {
+            mbedtls_transport_free( pxNetworkContext );
+            pxNetworkContext = NULL;
+        }
+    }
+
+    return pxNetworkContext;
+}
+
+/*-----------------------------------------------------------*/
+
+/*
+ * The stream starts with zeroes, which iperf2 servers read as a client header
+ * without options, so the server only receives.
+ */
+static BaseType_t prvStreamClient( const NetIperfParams_t * pxParams,
+                                   NetIperfResult_t * pxResult )
+{
+    BaseType_t xSuccess = pdFALSE;
+    NetworkContext_t * pxNetworkContext = NULL;
+    int lSock = -1;
+    uint8_t * pucBuffer = pvPortMalloc( pxParams->uxLen );
+
+    if( pucBuffer == NULL )
+    {
+        LogError( "Failed to allocate the iperf buffer." );
+    }
+    else if( pxParams->xProto == NET_IPERF_TLS )
+    {
+        pxNetworkContext = prvConnectTls( pxParams );
+        xSuccess = ( pxNetworkContext != NULL ) ? pdTRUE : pdFALSE;
+    }
+    else
+    {
+        lSock = prvConnectSocket( pxParams, SOCK_STREAM );
+        xSuccess = ( lSock >= 0 ) ? pdTRUE : pdFALSE;
+    }
+
+    if( xSuccess == pdTRUE )
+    {
+        uint32_t ulRexmitStart = prvTcpRexmit();
+        uint64_t ullStartUs;
+        uint64_t ullElapsedUs = 0;
+        CpuSample_t xStart;
+        CpuSample_t xEnd;
+
+        ( void ) memset( pucBuffer, 0, pxParams->uxLen );
+
+        prvCpuSample( &xStart );
+        ullStartUs = ullTimeBaseGetUs();
+
+        while( ( xSuccess == pdTRUE ) &&
+               ( ullElapsedUs < ( ( uint64_t ) pxParams->ulDurationMs * 1000U ) ) )
+        {
+            int32_t lSent;
+
+            if( pxNetworkContext != NULL )
+            {
+                lSent = mbedtls_transport_send( pxNetworkContext, pucBuffer, pxParams->uxLen );
+            }
+            else
+            {
+                lSent = lwip_send( lSock, pucBuffer, pxParams->uxLen, 0 );
+            }
+
+            if( lSent > 0 )
+            {
+                pxResult->ullBytes += ( uint32_t ) lSent;
+            }
+            else
+            {
+                LogError( "iperf send failed after %lu bytes, error = %ld.",
+                          ( unsigned long ) pxResult->ullBytes, ( long ) lSent );
+                xSuccess = pdFALSE;
+            }
+
+            ullElapsedUs = ullTimeBaseGetUs() - ullStartUs;
+        }
+
+        prvCpuSample( &xEnd );
+
+        pxResult->ulMs = ( uint32_t ) ( ullElapsedUs / 1000U );
+        pxResult->ulCpuPermille = prvCpuPermille( &xStart, &xEnd );
+        pxResult->ulRexmit = prvTcpRexmit() - ulRexmitStart;
+        prvSetRate( pxResult );
+    }
+
+    if( pxNetworkContext != NULL )
+    {
+        mbedtls_transport_disconnect( pxNetworkContext );
+        mbedtls_transport_free( pxNetworkContext );
+    }
+
+    if( lSock >= 0 )
+    {
+        ( void ) lwip_close( lSock );
+    }
+
+    if( pucBuffer != NULL )
+    {
+        vPortFree( pucBuffer );
+    }
+
+    return xSuccess;
+}
+
+/*-----------------------------------------------------------*/
+
+static void prvParseServerHdr( const IperfServerHdr_t * pxHdr,
+                               NetIperfResult_t * pxResult )
+{
+    pxResult->xUdpReport = pdTRUE;
+    pxResult->ulDatagrams = lwip_ntohl( pxHdr->lDatagrams );
+    pxResult->ulLost = lwip_ntohl( pxHdr->lErrorCnt );
+    pxResult->ulOutOfOrder = lwip_ntohl( pxHdr->lOutOfOrderCnt );
+    pxResult->ulJitterUs = ( lwip_ntohl( pxHdr->lJitterSec ) * 1000000U ) + lwip_ntohl( pxHdr->lJitterUsec );
+}
+
+/*-----------------------------------------------------------*/
+
+/* Sends negative sequence numbers until the server answers with its report */
+static void prvUdpClientFinish( int lSock,
+                                uint8_t * pucBuffer,
+                                size_t uxLen,
+                                int32_t lLastId,
+                                NetIperfResult_t * pxResult )
+{
+    IperfUdpHdr_t * pxHdr = ( IperfUdpHdr_t * ) pucBuffer;
+    const uint32_t ulTimeoutMs = IPERF_UDP_FIN_TIMEOUT_MS;
+
+    ( void ) lwip_setsockopt( lSock, SOL_SOCKET, SO_RCVTIMEO, &ulTimeoutMs, sizeof( ulTimeoutMs ) );
+
+    for( uint32_t i = 0; ( i < IPERF_UDP_FIN_RETRIES ) && ( pxResult->xUdpReport == pdFALSE ); i++ )
+    {
+        int lLen;
+
+        pxHdr->lId = lwip_htonl( -lLastId );
+        ( void ) lwip_send( lSock, pucBuffer, uxLen, 0 );
+
+        lLen = lwip_recv( lSock, pucBuffer, uxLen, 0 );
+
+        if( lLen >= ( int ) IPERF_UDP_MIN_LEN )
+        {
+            const IperfServerHdr_t * pxReport = ( const IperfServerHdr_t * ) &( pucBuffer[ sizeof( IperfUdpHdr_t ) ] );
+            const IperfServerHdr_t * pxReportV1 = ( const IperfServerHdr_t * ) &( pucBuffer[ IPERF_UDP_HDR_LEN_V1 ] );
+
+            if( ( lwip_ntohl( pxReport->lFlags ) & IPERF_HEADER_VERSION1 ) != 0 )
+            {
+                prvParseServerHdr( pxReport, pxResult );
+            }
+            else if( ( lwip_ntohl( pxReportV1->lFlags ) & IPERF_HEADER_VERSION1 ) != 0 )
+            {
+                prvParseServerHdr( pxReportV1, pxResult );
+            }
+        }
+    }
+
+    if( pxResult->xUdpReport == pdFALSE )
+    {
+        LogWarn( "No report from the iperf server, the datagram loss is unknown." );
+    }
+}
+
+/*-----------------------------------------------------------*/
+
+static BaseType_t prvUdpClient( const NetIperfParams_t * pxParams,
+                                NetIperfResult_t * pxResult )
+{
+    BaseType_t xSuccess = pdFALSE;
+    uint8_t * pucBuffer = pvPortMalloc( pxParams->uxLen );
+    int lSock = -1;
+
+    if( pucBuffer == NULL )
+    {
+        LogError( "Failed to allocate the iperf buffer." );
+    }
+    else
+    {
+        lSock = prvConnectSocket( pxParams, SOCK_DGRAM );
+        xSuccess = ( lSock >= 0 ) ? pdTRUE : pdFALSE;
+    }
+
+    if( xSuccess == pdTRUE )
+    {
+        IperfUdpHdr_t * pxHdr = ( IperfUdpHdr_t * ) pucBuffer;
+        uint32_t ulRexmitStart = prvTcpRexmit();
+        uint64_t ullStartUs;
+        uint64_t ullElapsedUs = 0;
+        int32_t lId = 0;
+        CpuSample_t xStart;
+        CpuSample_t xEnd;
+
+        ( void ) memset( pucBuffer, 0, pxParams->uxLen );
+
+        prvCpuSample( &xStart );
+        ullStartUs = ullTimeBaseGetUs();
+
+        while( ullElapsedUs < ( ( uint64_t ) pxParams->ulDurationMs * 1000U ) )
+        {
+            /* Bits per ms are kbit/s */
+            uint64_t ullDueUs = ( pxResult->ullBytes * 8U * 1000U ) / pxParams->ulRateKbps;
+            uint64_t ullNowUs = ullTimeBaseGetUs();
+
+            if( ullDueUs > ( ullNowUs - ullStartUs + 1000U ) )
+            {
+                vTaskDelay( pdMS_TO_TICKS( ( ullDueUs - ( ullNowUs - ullStartUs ) ) / 1000U ) );
+                ullNowUs = ullTimeBaseGetUs();
+            }
+
+            pxHdr->lId = lwip_htonl( lId );
+            pxHdr->ulSec = lwip_htonl( ( uint32_t ) ( ullNowUs / 1000000U ) );
+            pxHdr->ulUsec = lwip_htonl( ( uint32_t ) ( ullNowUs % 1000000U ) );
+
+            /* Datagrams dropped for a lack of buffers count as lost, as on a congested link */
+            if( lwip_send( lSock, pucBuffer, pxParams->uxLen, 0 ) > 0 )
+            {
+                pxResult->ullBytes += pxParams->uxLen;
+            }
+
+            lId++;
+            ullElapsedUs = ullTimeBaseGetUs() - ullStartUs;
+        }
+
+        prvCpuSample( &xEnd );
+
+        pxResult->ulMs = ( uint32_t ) ( ullElapsedUs / 1000U );
+        pxResult->ulCpuPermille = prvCpuPermille( &xStart, &xEnd );
+        pxResult->ulRexmit = prvTcpRexmit() - ulRexmitStart;
+        prvSetRate( pxResult );
+
+        prvUdpClientFinish( lSock, pucBuffer, pxParams->uxLen, lId, pxResult );
+    }
+
+    if( lSock >= 0 )
+    {
+        ( void ) lwip_close( lSock );
+    }
+
+    if( pucBuffer != NULL )
+    {
+        vPortFree( pucBuffer );
+    }
+
+    return xSuccess;
+}
+
+/*-----------------------------------------------------------*/
+
+/* Counts loss and reordering from the sequence numbers and the jitter as in RFC 1889 */
+static BaseType_t prvUdpServer( const NetIperfParams_t * pxParams,
+                                NetIperfResult_t * pxResult )
+{
+    BaseType_t xSuccess = pdFALSE;
+    BaseType_t xDone = pdFALSE;
+    uint8_t * pucBuffer = pvPortMalloc( IPERF_UDP_MAX_LEN );
+    int lSock = lwip_socket( AF_INET, SOCK_DGRAM, 0 );
+    struct sockaddr_in xAddr = { 0 };
+
+    xAddr.sin_len = sizeof( xAddr );
+    xAddr.sin_family = AF_INET;
+    xAddr.sin_port = lwip_htons( pxParams->usPort );
+    xAddr.sin_addr.s_addr = lwip_htonl( INADDR_ANY );
+
+    if( ( pucBuffer == NULL ) || ( lSock < 0 ) )
+    {
+        LogError( "Failed to allocate the iperf buffer or socket." );
+    }
+    else if( lwip_bind( lSock, ( struct sockaddr * ) &xAddr, sizeof( xAddr ) ) != 0 )
+    {
+        LogError( "Failed to bind UDP port %u.", pxParams->usPort );
+    }
+    else
+    {
+        const uint32_t ulTimeoutMs = IPERF_RECV_TIMEOUT_MS;
+        struct sockaddr_in xPeer = { 0 };
+        socklen_t xPeerLen = sizeof( xPeer );
+        TickType_t xWaitStart = xTaskGetTickCount();
+        uint64_t ullStartUs = 0;
+        uint64_t ullLastUs = 0;
+        int64_t llLastTransitUs = 0;
+        uint64_t ullJitterUs16 = 0;
+        int32_t lNextId = 0;
+        uint32_t ulRexmitStart = prvTcpRexmit();
+        CpuSample_t xStart = { 0 };
+        CpuSample_t xEnd;
+
+        ( void ) lwip_setsockopt( lSock, SOL_SOCKET, SO_RCVTIMEO, &ulTimeoutMs, sizeof( ulTimeoutMs ) );
+
+        while( ( xDone == pdFALSE ) &&
+               ( ( pxResult->ulDatagrams > 0 ) ||
+                 ( pdTICKS_TO_MS( xTaskGetTickCount() - xWaitStart ) < pxParams->ulDurationMs ) ) )
+        {
+            int lLen = lwip_recvfrom( lSock, pucBuffer, IPERF_UDP_MAX_LEN, 0, ( struct sockaddr * ) &xPeer, &xPeerLen );
+            uint64_t ullNowUs = ullTimeBaseGetUs();
+            const IperfUdpHdr_t * pxHdr = ( const IperfUdpHdr_t * ) pucBuffer;
+            int32_t lId = ( lLen >= IPERF_UDP_HDR_LEN_V1 ) ? ( int32_t ) lwip_ntohl( pxHdr->lId ) : 0;
+
+            if( lLen < IPERF_UDP_HDR_LEN_V1 )
+            {
+                /* A stalled sender ends the test as well */
+                xDone = ( ( lLen < 0 ) && ( pxResult->ulDatagrams > 0 ) ) ? pdTRUE : pdFALSE;
+            }
+            else if( lId < 0 )
+            {
+                xDone = pdTRUE;
+            }
+            else
+            {
+                int64_t llTransitUs = ( int64_t ) ullNowUs -
+                                      ( ( ( int64_t ) lwip_ntohl( pxHdr->ulSec ) * 1000000 ) + lwip_ntohl( pxHdr->ulUsec ) );
+
+                if( pxResult->ulDatagrams == 0 )
+                {
+                    prvCpuSample( &xStart );
+                    ullStartUs = ullNowUs;
+                }
+                else
+                {
+                    int64_t llDelta = llTransitUs - llLastTransitUs;
+                    uint64_t ullDelta = ( uint64_t ) ( ( llDelta < 0 ) ? -llDelta : llDelta );
+
+                    /* J += ( |D| - J ) / 16, kept scaled by 16 */
+                    ullJitterUs16 = ullJitterUs16 + ullDelta - ( ullJitterUs16 / 16U );
+                }
+
+                llLastTransitUs = llTransitUs;
+
+                if( lId >= lNextId )
+                {
+                    pxResult->ulLost += ( uint32_t ) ( lId - lNextId );
+                    lNextId = lId + 1;
+                }
+                else
+                {
+                    pxResult->ulOutOfOrder++;
+
+                    if( pxResult->ulLost > 0 )
+                    {
+                        pxResult->ulLost--;
+                    }
+                }
+
+                pxResult->ulDatagrams++;
+                pxResult->ullBytes += ( uint32_t ) lLen;
+                ullLastUs = ullNowUs;
+            }
+        }
+
+        if( pxResult->ulDatagrams > 0 )
+        {
+            prvCpuSample( &xEnd );
+
+            pxResult->xUdpReport = pdTRUE;
+            pxResult->ulJitterUs = ( uint32_t ) ( ullJitterUs16 / 16U );
+            pxResult->ulMs = ( uint32_t ) ( ( ullLastUs - ullStartUs ) / 1000U );
+            pxResult->ulCpuPermille = prvCpuPermille( &xStart, &xEnd );
+            pxResult->ulRexmit = prvTcpRexmit() - ulRexmitStart;
+            prvSetRate( pxResult );
+            xSuccess = pdTRUE;
+        }
+        else
+        {
+            LogWarn( "No iperf client sent within %lu ms.", ( unsigned long ) pxParams->ulDurationMs );
+        }
+
+        /* Answer the final datagram with the report, the client prints it */
+        if( ( xSuccess == pdTRUE ) && ( xDone == pdTRUE ) )
+        {
+            IperfServerHdr_t * pxReport = ( IperfServerHdr_t * ) &( pucBuffer[ sizeof( IperfUdpHdr_t ) ] );
+            uint64_t ullDurationUs = ullLastUs - ullStartUs;
+
+            ( void ) memset( pxReport, 0, sizeof( IperfServerHdr_t ) );
+            pxReport->lFlags = ( int32_t ) lwip_htonl( IPERF_HEADER_VERSION1 );
+            pxReport->lTotalLen1 = ( int32_t ) lwip_htonl( ( uint32_t ) ( pxResult->ullBytes >> 32 ) );
+            pxReport->lTotalLen2 = ( int32_t ) lwip_htonl( ( uint32_t ) pxResult->ullBytes );
+            pxReport->lStopSec = ( int32_t ) lwip_htonl( ( uint32_t ) ( ullDurationUs / 1000000U ) );
+            pxReport->lStopUsec = ( int32_t ) lwip_htonl( ( uint32_t ) ( ullDurationUs % 1000000U ) );
+            pxReport->lErrorCnt = ( int32_t ) lwip_htonl( pxResult->ulLost );
+            pxReport->lOutOfOrderCnt = ( int32_t ) lwip_htonl( pxResult->ulOutOfOrder );
+            pxReport->lDatagrams = ( int32_t ) lwip_htonl( ( uint32_t ) lNextId );
+            pxReport->lJitterSec = ( int32_t ) lwip_htonl( pxResult->ulJitterUs / 1000000U );
+            pxReport->lJitterUsec = ( int32_t ) lwip_htonl( pxResult->ulJitterUs % 1000000U );
+
+            ( void ) lwip_sendto( lSock, pucBuffer, IPERF_UDP_MIN_LEN, 0, ( struct sockaddr * ) &xPeer, xPeerLen );
+        }
+    }
+
+    if( lSock >= 0 )
+    {
+        ( void ) lwip_close( lSock );
+    }
+
+    if( pucBuffer != NULL )
+    {
+        vPortFree( pucBuffer );
+    }
+
+    return xSuccess;
+}
+
+/*-----------------------------------------------------------*/
+
+BaseType_t xNetIperfRun( const NetIperfParams_t * pxParams,
+                         NetIperfResult_t * pxResult )
+{
+    BaseType_t xSuccess = pdFALSE;
+
+    configASSERT( pxParams != NULL );
+    configASSERT( pxResult != NULL );
+
+    ( void ) memset( pxResult, 0, sizeof( NetIperfResult_t ) );
+
+    /* Throughput is compared with the full speed level */
+    vDvfsRequest( DVFS_CLIENT_CLI );
+
+    if( ( pxParams->xProto == NET_IPERF_UDP ) &&
+        ( ( pxParams->uxLen < IPERF_UDP_MIN_LEN ) || ( pxParams->uxLen > IPERF_UDP_MAX_LEN ) ) )
+    {
+        LogError( "The datagram length must be between %u and %u bytes.",
+                  ( unsigned int ) IPERF_UDP_MIN_LEN, IPERF_UDP_MAX_LEN );
+    }
+    else if( ( pxParams->xProto == NET_IPERF_UDP ) && ( pxParams->ulRateKbps == 0 ) )
+    {
+        LogError( "The UDP send rate must not be 0." );
+    }
+    else if( ( pxParams->uxLen == 0 ) || ( pxParams->ulDurationMs == 0 ) )
+    {
+        LogError( "The length and duration must not be 0." );
+    }
+    else if( pxParams->pcHost == NULL )
+    {
+        switch( pxParams->xProto )
+        {
+            case NET_IPERF_TCP:
+                xSuccess = prvTcpServer( pxParams, pxResult );
+                break;
+
+            case NET_IPERF_UDP:
+                xSuccess = prvUdpServer( pxParams, pxResult );
+                break;
+
+            default:
+                LogError( "TLS tests are only supported as a client." );
+                break;
+        }
+    }
+    else if( pxParams->xProto == NET_IPERF_UDP )
+    {
+        xSuccess = prvUdpClient( pxParams, pxResult );
+    }
+    else
+    {
+        xSuccess = prvStreamClient( pxParams, pxResult );
+    }
+
+    vDvfsRelease( DVFS_CLIENT_CLI );
+
+    return xSuccess;
+}
@@ -0,0 +1,473 @@
+/*
+ * FreeRTOS STM32 Reference Integration
+ *
+ * Copyright (c) 2022 Amazon.com, Inc. or its affiliates. All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+/**
+ * @file net_sntp.c
+ * @brief SNTPv4 client (RFC 4330) run as a work queue job over the lwIP raw API.
+ */
+#include "logging_levels.h"
+
+#define LOG_LEVEL    LOG_INFO
+#define LOG_MODULE    LOG_MODULE_NET
+
+#include "logging.h"
+
+#include "net_sntp.h"
+
+#if NET_SNTP_ENABLED == 1
+
+#include <string.h>
+
+/* FreeRTOS includes. */
+#include "FreeRTOS.h"
+#include "task.h"
+#include "event_groups.h"
+
+/* lwIP includes. */
+#include "lwip/tcpip.h"
+#include "lwip/dns.h"
+#include "lwip/udp.h"
+#include "lwip/pbuf.h"
+
+#include "sys_evt.h"
+#include "kvstore.h"
+#include "time_base.h"
+#include "work_queue.h"
+
+#define SNTP_PORT                  123U
+#define SNTP_MSG_LEN               48U
+
+/* Offsets into the message */
+#define SNTP_OFFSET_FLAGS          0U
+#define SNTP_OFFSET_STRATUM        1U
+#define SNTP_OFFSET_RECEIVE        32U
+#define SNTP_OFFSET_TRANSMIT       40U
+#define SNTP_OFFSET_ORIGINATE      24U
+
+/* Leap indicator 0, version 4, mode 3 (client) */
+#define SNTP_FLAGS_CLIENT          0x23U
+#define SNTP_LI_ALARM              0xC0U
+#define SNTP_MODE_MASK             0x07U
+#define SNTP_MODE_SERVER           4U
+
+/* Seconds from 1900-01-01 to 1970-01-01 */
+#define SNTP_UNIX_OFFSET_S         2208988800ULL
+
+typedef enum
+{
+    SNTP_STATE_IDLE = 0,
+    SNTP_STATE_RESOLVING,
+    SNTP_STATE_WAITING
+} SntpState_t;
+
+/* The reply fields needed once the job runs again */
+typedef struct
+{
+    uint64_t ullReceiveMs;   /* Server receive time, ms since 1970 */
+    uint64_t ullTransmitMs;  /* Server transmit time, ms since 1970 */
+    uint64_t ullArrivalUs;   /* ullTimeBaseGetUs when the reply arrived */
+} SntpReply_t;
+
+static WorkJob_t xSntpJob;
+
+/* Accessed with the lwIP core lock held, by the job and by the callbacks in the tcpip thread */
+static SntpState_t xState = SNTP_STATE_IDLE;
+static struct udp_pcb * pxPcb = NULL;
+static ip_addr_t xServerAddr;
+static BaseType_t xAddrResolved = pdFALSE;
+static uint64_t ullRequestUs = 0;
+static BaseType_t xReplyReady = pdFALSE;
+static SntpReply_t xReply;
+
+/* Only accessed by the job */
+static TickType_t xStateTick = 0;
+static uint32_t ulRetryMs = NET_SNTP_RETRY_MIN_MS;
+
+/* Tick count of the last accepted reply, guarded by a critical section */
+static BaseType_t xSynced = pdFALSE;
+static TickType_t xSyncedTick = 0;
+
+/*-----------------------------------------------------------*/
+
+static uint32_t prvGetBe32( const uint8_t * pucData )
+{
+    return ( ( uint32_t ) pucData[ 0 ] << 24 ) | ( ( uint32_t ) pucData[ 1 ] << 16 ) |
+           ( ( uint32_t ) pucData[ 2 ] << 8 ) | ( uint32_t ) pucData[ 3 ];
+}
+
+/*-----------------------------------------------------------*/
+
+static void prvPutBe32( uint8_t * pucData,
+                        uint32_t ulValue )
+{
+    pucData[ 0 ] = ( uint8_t ) ( ulValue >> 24 );
+    pucData[ 1 ] = ( uint8_t ) ( ulValue >> 16 );
+    pucData[ 2 ] = ( uint8_t ) ( ulValue >> 8 );
+    pucData[ 3 ] = ( uint8_t ) ulValue;
+}
+
+/*-----------------------------------------------------------*/
+
+/* NTP timestamp to ms since 1970, 0 for the unset timestamp */
+static uint64_t prvNtpToUnixMs( const uint8_t * pucData )
+{
+    uint64_t ullSecs = prvGetBe32( pucData );
+    uint32_t ulFraction = prvGetBe32( &( pucData[ 4 ] ) );
+    uint64_t ullUnixMs = 0;
+
+    if( ( ullSecs != 0 ) || ( ulFraction != 0 ) )
+    {
+        /* RFC 4330 section 3: with the top bit clear, the time is in era 1 from 2036 */
+        if( ( ullSecs & 0x80000000ULL ) == 0 )
+        {
+            ullSecs += ( 1ULL << 32 );
+        }
+
+        ullUnixMs = ( ( ullSecs - SNTP_UNIX_OFFSET_S ) * 1000U ) +
+                    ( ( ( uint64_t ) ulFraction * 1000U ) >> 32 );
+    }
+
+    return ullUnixMs;
+}
+
+/*-----------------------------------------------------------*/
+
+/* Runs in the tcpip thread */
+static void prvRecvCallback( void * pvArg,
+                             struct udp_pcb * pxUdpPcb,
+                             struct pbuf * pxPbuf,
+                             const ip_addr_t * pxAddr,
+                             u16_t usPort )
+{
+    uint8_t ucMsg[ SNTP_MSG_LEN ];
+    uint64_t ullArrivalUs = ullTimeBaseGetUs();
+
+    ( void ) pvArg;
+    ( void ) pxUdpPcb;
+
+    if( ( xState == SNTP_STATE_WAITING ) &&
+        ( xReplyReady == pdFALSE ) &&
+        ( usPort == SNTP_PORT ) &&
+        ip_addr_cmp( pxAddr, &xServerAddr ) &&
+        ( pbuf_copy_partial( pxPbuf, ucMsg, SNTP_MSG_LEN, 0 ) == SNTP_MSG_LEN ) )
+    {
+        uint8_t ucFlags = ucMsg[ SNTP_OFFSET_FLAGS ];
+        uint8_t ucStratum = ucMsg[ SNTP_OFFSET_STRATUM ];
+
+        /* The server echoes the transmit time of the request, which is only known to this client */
+        if( ( ( ucFlags & SNTP_MODE_MASK ) == SNTP_MODE_SERVER ) &&
+            ( ( ucFlags & SNTP_LI_ALARM ) != SNTP_LI_ALARM ) &&
+            ( ucStratum > 0U ) && ( ucStratum < 16U ) &&
+            ( prvGetBe32( &( ucMsg[ SNTP_OFFSET_ORIGINATE ] ) ) == ( uint32_t ) ( ullRequestUs >> 32 ) ) &&
+            ( prvGetBe32( &( ucMsg[ SNTP_OFFSET_ORIGINATE + 4U ] ) ) == ( uint32_t ) ullRequestUs ) )
+        {
+            xReply.ullReceiveMs = prvNtpToUnixMs( &( ucMsg[ SNTP_OFFSET_RECEIVE ] ) );
+            xReply.ullTransmitMs = prvNtpToUnixMs( &( ucMsg[ SNTP_OFFSET_TRANSMIT ] ) );
+            xReply.ullArrivalUs = ullArrivalUs;
+            xReplyReady = pdTRUE;
+
+            vWorkJobSchedule( &xSntpJob, 0 );
+        }
+        else
+        {
+            LogDebug( "Ignoring SNTP reply, flags: 0x%02x, stratum: %u.", ucFlags, ucStratum );
+        }
+    }
+
+    pbuf_free( pxPbuf );
+}
+
+/*-----------------------------------------------------------*/
+
+/* Runs in the tcpip thread */
+static void prvDnsFoundCallback( const char * pcName,
+                                 const ip_addr_t * pxAddr,
+                                 void * pvArg )
+{
+    ( void ) pcName;
+    ( void ) pvArg;
+
+    /* A lookup that timed out may still complete */
+    if( ( xState == SNTP_STATE_RESOLVING ) &&
+        ( pxAddr != NULL ) )
+    {
+        ip_addr_copy( xServerAddr, *pxAddr );
+        xAddrResolved = pdTRUE;
+
+        vWorkJobSchedule( &xSntpJob, 0 );
+    }
+}
+
+/*-----------------------------------------------------------*/
+
+/* Must be called with the lwIP core lock held */
+static BaseType_t prvSendRequest( void )
+{
+    BaseType_t xResult = pdFALSE;
+    struct pbuf * pxPbuf = pbuf_alloc( PBUF_TRANSPORT, SNTP_MSG_LEN, PBUF_RAM );
+
+    if( pxPbuf != NULL )
+    {
+        uint8_t * pucMsg = ( uint8_t * ) pxPbuf->payload;
+
+        /*
+         * The transmit time is only used to match the reply, so the monotonic time
+         * is sent instead of a wall clock time that may be wrong.
+         */
+        ullRequestUs = ullTimeBaseGetUs();
+        xReplyReady = pdFALSE;
+
+        ( void ) memset( pucMsg, 0, SNTP_MSG_LEN );
+        pucMsg[ SNTP_OFFSET_FLAGS ] = SNTP_FLAGS_CLIENT;
+        prvPutBe32( &( pucMsg[ SNTP_OFFSET_TRANSMIT ] ), ( uint32_t ) ( ullRequestUs >> 32 ) );
+        prvPutBe32( &( pucMsg[ SNTP_OFFSET_TRANSMIT + 4U ] ), ( uint32_t ) ullRequestUs );
+
+        xResult = ( udp_sendto( pxPcb, pxPbuf, &xServerAddr, SNTP_PORT ) == ERR_OK ) ? pdTRUE : pdFALSE;
+
+        pbuf_free( pxPbuf );
+    }
+
+    return xResult;
+}
+
+/*-----------------------------------------------------------*/
+
+static void prvApplyReply( const SntpReply_t * pxReply )
+{
+    uint64_t ullRoundTripUs = pxReply->ullArrivalUs - ullRequestUs;
+    uint64_t ullServerMs = pxReply->ullTransmitMs - pxReply->ullReceiveMs;
+    uint64_t ullUnixMs = pxReply->ullTransmitMs;
+    uint64_t ullLocalMs = 0;
+    uint64_t ullNowUs = 0;
+    uint32_t ulHwm = KVStore_getUInt32( CS_TIME_HWM_S_1970, NULL );
+    TimeBaseSource_t xPrevSource;
+
+    /* Add half the network delay, the time spent in the server aside */
+    if( ( ullServerMs * 1000U ) < ullRoundTripUs )
+    {
+        ullUnixMs += ( ( ullRoundTripUs - ( ullServerMs * 1000U ) ) / 2000U );
+    }
+
+    if( ( ullUnixMs / 1000U ) < ulHwm )
+    {
+        LogWarn( "SNTP time %lu s is before the high-water mark %lu s, ignored.",
+                 ( unsigned long ) ( ullUnixMs / 1000U ), ( unsigned long ) ulHwm );
+    }
+    else
+    {
+        /* Account for the time between the arrival of the reply and this job */
+        ullNowUs = ullTimeBaseGetUs();
+        ullUnixMs += ( ullNowUs - pxReply->ullArrivalUs ) / 1000U;
+
+        xPrevSource = xTimeBaseToUnixMs( ullNowUs, &ullLocalMs );
+
+        vTimeBaseSetUnixMs( ullUnixMs );
+
+        if( xPrevSource != TIME_BASE_SRC_NONE )
+        {
+            LogInfo( "Clock corrected by %ld ms, round trip %lu ms, previous source: %d.",
+                     ( long ) ( ( int64_t ) ullUnixMs - ( int64_t ) ullLocalMs ),
+                     ( unsigned long ) ( ullRoundTripUs / 1000U ), xPrevSource );
+        }
+
+        taskENTER_CRITICAL();
+        {
+            xSynced = pdTRUE;
+            xSyncedTick = xTaskGetTickCount();
+        }
+        taskEXIT_CRITICAL();
+    }
+}
+
+/*-----------------------------------------------------------*/
+
+static void prvSntpJob( void * pvCtx )
+{
+    BaseType_t xFailed = pdFALSE;
+    BaseType_t xHaveReply = pdFALSE;
+    SntpReply_t xLocalReply = { 0 };
+    TickType_t xNow = xTaskGetTickCount();
+    TickType_t xTimeout = pdMS_TO_TICKS( NET_SNTP_TIMEOUT_MS );
+    err_t xError;
+
+    ( void ) pvCtx;
+
+    LOCK_TCPIP_CORE();
+
+    switch( xState )
+    {
+        case SNTP_STATE_IDLE:
+
+            if( ( xEventGroupGetBits( xSystemEvents ) & EVT_MASK_NET_CONNECTED ) == 0 )
+            {
+                /* vNetSntpRequest schedules the job again once an address is bound */
+                break;
+            }
+
+            if( pxPcb == NULL )
+            {
+                pxPcb = udp_new_ip_type( IPADDR_TYPE_V4 );
+
+                if( pxPcb == NULL )
+                {
+                    LogError( "Failed to allocate the SNTP socket." );
+                    xFailed = pdTRUE;
+                    break;
+                }
+
+                udp_recv( pxPcb, prvRecvCallback, NULL );
+            }
+
+            xAddrResolved = pdFALSE;
+            xState = SNTP_STATE_RESOLVING;
+            xStateTick = xNow;
+
+            xError = dns_gethostbyname( NET_SNTP_SERVER, &xServerAddr, prvDnsFoundCallback, NULL );
+
+            if( xError == ERR_OK )
+            {
+                xAddrResolved = pdTRUE;
+            }
+            else if( xError != ERR_INPROGRESS )
+            {
+                LogWarn( "Failed to look up %s: %d.", NET_SNTP_SERVER, xError );
+                xFailed = pdTRUE;
+                break;
+            }
+            else
+            {
+                vWorkJobSchedule( &xSntpJob, NET_SNTP_TIMEOUT_MS );
+                break;
+            }
+
+        /* Intentional fall through, the address is known */
+        case SNTP_STATE_RESOLVING:
+
+            if( xAddrResolved == pdTRUE )
+            {
+                if( prvSendRequest() == pdTRUE )
+                {
+                    xState = SNTP_STATE_WAITING;
+                    xStateTick = xNow;
+                    vWorkJobSchedule( &xSntpJob, NET_SNTP_TIMEOUT_MS );
+                }
+                else
+                {
+                    LogWarn( "Failed to send the SNTP request." );
+                    xFailed = pdTRUE;
+                }
+            }
+            else if( ( xNow - xStateTick ) >= xTimeout )
+            {
+                LogWarn( "Timed out looking up %s.", NET_SNTP_SERVER );
+                xFailed = pdTRUE;
+            }
+            else
+            {
+                vWorkJobSchedule( &xSntpJob, pdTICKS_TO_MS( xTimeout - ( xNow - xStateTick ) ) );
+            }
+
+            break;
+
+        case SNTP_STATE_WAITING:
+
+            if( xReplyReady == pdTRUE )
+            {
+                xLocalReply = xReply;
+                xReplyReady = pdFALSE;
+                xHaveReply = pdTRUE;
+                xState = SNTP_STATE_IDLE;
+            }
+            else if( ( xNow - xStateTick ) >= xTimeout )
+            {
+                LogWarn( "No reply from %s.", NET_SNTP_SERVER );
+                xFailed = pdTRUE;
+            }
+            else
+            {
+                vWorkJobSchedule( &xSntpJob, pdTICKS_TO_MS( xTimeout - ( xNow - xStateTick ) ) );
+            }
+
+            break;
+
+        default:
+            configASSERT( 0 );
+            break;
+    }
+
+    if( xFailed == pdTRUE )
+    {
+        xState = SNTP_STATE_IDLE;
+    }
+
+    UNLOCK_TCPIP_CORE();
+
+    if( xHaveReply == pdTRUE )
+    {
+        /* Outside of the core lock, this may write the high-water mark to flash */
+        prvApplyReply( &xLocalReply );
+        ulRetryMs = NET_SNTP_RETRY_MIN_MS;
+
+        vWorkJobSchedule( &xSntpJob, NET_SNTP_RESYNC_MS );
+    }
+    else if( xFailed == pdTRUE )
+    {
+        LogInfo( "Retrying SNTP in %lu s.", ( unsigned long ) ( ulRetryMs / 1000U ) );
+        vWorkJobSchedule( &xSntpJob, ulRetryMs );
+
+        ulRetryMs = ( ulRetryMs >= ( NET_SNTP_RETRY_MAX_MS / 2U ) ) ? NET_SNTP_RETRY_MAX_MS : ( ulRetryMs * 2U );
+    }
+    else
+    {
+        /* Waiting for the DNS lookup, the reply or the network */
+    }
+}
+
+/*-----------------------------------------------------------*/
+
+void vNetSntpInit( void )
+{
+    vWorkJobInit( &xSntpJob, "SNTP", prvSntpJob, NULL );
+}
+
+/*-----------------------------------------------------------*/
+
+void vNetSntpRequest( void )
+{
+    BaseType_t xRecent;
+
+    taskENTER_CRITICAL();
+    {
+        xRecent = ( ( xSynced == pdTRUE ) &&
+                    ( ( xTaskGetTickCount() - xSyncedTick ) < pdMS_TO_TICKS( NET_SNTP_RESYNC_MS ) ) );
+    }
+    taskEXIT_CRITICAL();
+
+    /* A query in progress is not restarted, the job only sends one when idle */
+    if( xRecent == pdFALSE )
+    {
+        vWorkJobSchedule( &xSntpJob, 0 );
+    }
+}
+
+#endif /* NET_SNTP_ENABLED == 1 */
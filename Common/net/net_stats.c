@@ -0,0 +1,261 @@
+/*
+ * FreeRTOS STM32 Reference Integration
+ *
+ * Copyright (c) 2022 Amazon.com, Inc. or its affiliates. All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+/**
+ * @file net_stats.c
+ * @brief lwIP memory pool, mailbox and TCP counters with exhaustion alarms.
+ */
+#include "logging_levels.h"
+
+#define LOG_LEVEL    LOG_INFO
+#define LOG_MODULE    LOG_MODULE_NET
+
+#include "logging.h"
+
+#include "net_stats.h"
+
+#include <string.h>
+
+/* FreeRTOS includes. */
+#include "FreeRTOS.h"
+
+/* lwIP includes. */
+#include "lwip/tcpip.h"
+#include "lwip/stats.h"
+#include "lwip/timeouts.h"
+#include "lwip/priv/tcp_priv.h"
+
+#if !MEM_STATS || !MEMP_STATS || !TCP_STATS
+#error "net_stats needs LWIP_STATS with MEM_STATS, MEMP_STATS and TCP_STATS"
+#endif
+
+#define NET_STATS_HEAP_IDX    MEMP_MAX
+
+/* Pool descriptions, in memp_t order */
+static const char * const pcPoolNames[ MEMP_MAX ] =
+{
+#define LWIP_MEMPOOL( name, num, size, desc )    desc,
+#include "lwip/priv/memp_std.h"
+};
+
+/* Monitor state of each pool and of the heap at NET_STATS_HEAP_IDX, guarded by SYS_ARCH_PROTECT */
+static STAT_COUNTER xLastErr[ MEMP_MAX + 1 ] = { 0 };
+static BaseType_t xExhausted[ MEMP_MAX + 1 ] = { 0 };
+static uint32_t ulExhaustedAlarms = 0;
+
+/* Only accessed with the core lock held */
+static uint32_t ulTcpOoseqMax = 0;
+
+/*-----------------------------------------------------------*/
+
+/* Must be called with the core lock held */
+static uint32_t prvCountOoseq( void )
+{
+    uint32_t ulSegs = 0;
+
+#if TCP_QUEUE_OOSEQ
+    for( struct tcp_pcb * pxPcb = tcp_active_pcbs; pxPcb != NULL; pxPcb = pxPcb->next )
+    {
+        for( struct tcp_seg * pxSeg = pxPcb->ooseq; pxSeg != NULL; pxSeg = pxSeg->next )
+        {
+            ulSegs++;
+        }
+    }
+#endif /* TCP_QUEUE_OOSEQ */
+
+    return ulSegs;
+}
+
+/*-----------------------------------------------------------*/
+
+/*
+ * A pool is exhausted when all of its elements are in use or an allocation
+ * failed since the previous sample. Returns pdTRUE when it just became so.
+ */
+static BaseType_t prvCheckPool( const struct stats_mem * pxMem,
+                                uint32_t ulIdx )
+{
+    BaseType_t xAlarm = pdFALSE;
+    BaseType_t xNowExhausted = pdFALSE;
+
+    xNowExhausted = ( ( pxMem->used >= pxMem->avail ) ||
+                      ( pxMem->err != xLastErr[ ulIdx ] ) ) ? pdTRUE : pdFALSE;
+
+    if( ( xNowExhausted == pdTRUE ) &&
+        ( xExhausted[ ulIdx ] == pdFALSE ) )
+    {
+        ulExhaustedAlarms++;
+        xAlarm = pdTRUE;
+    }
+
+    xLastErr[ ulIdx ] = pxMem->err;
+    xExhausted[ ulIdx ] = xNowExhausted;
+
+    return xAlarm;
+}
+
+/*-----------------------------------------------------------*/
+
+static void prvLogAlarm( const char * pcName,
+                         const struct stats_mem * pxMem )
+{
+    LogWarn( "lwIP %s exhausted: %lu of %lu in use, %lu failed allocations.",
+             pcName,
+             ( unsigned long ) pxMem->used,
+             ( unsigned long ) pxMem->avail,
+             ( unsigned long ) pxMem->err );
+}
+
+/*-----------------------------------------------------------*/
+
+/* Runs in the tcpip thread every NET_STATS_MONITOR_MS */
+static void prvMonitorTimeout( void * pvArg )
+{
+    uint32_t ulOoseq = 0;
+    BaseType_t xHeapAlarm = pdFALSE;
+    BaseType_t xPoolAlarm[ MEMP_MAX ] = { 0 };
+
+    SYS_ARCH_DECL_PROTECT( xLevel );
+
+    ( void ) pvArg;
+
+    SYS_ARCH_PROTECT( xLevel );
+
+    xHeapAlarm = prvCheckPool( &( lwip_stats.mem ), NET_STATS_HEAP_IDX );
+
+    for( uint32_t i = 0; i < MEMP_MAX; i++ )
+    {
+        xPoolAlarm[ i ] = prvCheckPool( lwip_stats.memp[ i ], i );
+    }
+
+    SYS_ARCH_UNPROTECT( xLevel );
+
+    /* Logged outside of the critical section */
+    if( xHeapAlarm == pdTRUE )
+    {
+        prvLogAlarm( "heap", &( lwip_stats.mem ) );
+    }
+
+    for( uint32_t i = 0; i < MEMP_MAX; i++ )
+    {
+        if( xPoolAlarm[ i ] == pdTRUE )
+        {
+            prvLogAlarm( pcPoolNames[ i ], lwip_stats.memp[ i ] );
+        }
+    }
+
+    ulOoseq = prvCountOoseq();
+
+    if( ulOoseq > ulTcpOoseqMax )
+    {
+        ulTcpOoseqMax = ulOoseq;
+    }
+
+    sys_timeout( NET_STATS_MONITOR_MS, prvMonitorTimeout, NULL );
+}
+
+/*-----------------------------------------------------------*/
+
+void vNetStatsInit( void )
+{
+    LOCK_TCPIP_CORE();
+    sys_timeout( NET_STATS_MONITOR_MS, prvMonitorTimeout, NULL );
+    UNLOCK_TCPIP_CORE();
+}
+
+/*-----------------------------------------------------------*/
+
+static void prvCopyPool( NetPoolStats_t * pxPool,
+                         const char * pcName,
+                         struct stats_mem * pxMem,
+                         uint32_t ulIdx,
+                         BaseType_t xClear )
+{
+    pxPool->pcName = pcName;
+    pxPool->ulAvail = ( uint32_t ) pxMem->avail;
+    pxPool->ulUsed = ( uint32_t ) pxMem->used;
+    pxPool->ulMax = ( uint32_t ) pxMem->max;
+    pxPool->ulErr = ( uint32_t ) pxMem->err;
+    pxPool->xExhausted = xExhausted[ ulIdx ];
+
+    if( xClear == pdTRUE )
+    {
+        pxMem->max = pxMem->used;
+        pxMem->err = 0;
+        xLastErr[ ulIdx ] = 0;
+    }
+}
+
+/*-----------------------------------------------------------*/
+
+void vNetStatsGet( NetStats_t * pxStats,
+                   BaseType_t xClear )
+{
+    SysArchMboxStats_t xMboxStats = { 0 };
+
+    SYS_ARCH_DECL_PROTECT( xLevel );
+
+    configASSERT( pxStats != NULL );
+
+    ( void ) memset( pxStats, 0, sizeof( NetStats_t ) );
+
+    LOCK_TCPIP_CORE();
+
+    SYS_ARCH_PROTECT( xLevel );
+
+    prvCopyPool( &( pxStats->xHeap ), "heap", &( lwip_stats.mem ), NET_STATS_HEAP_IDX, xClear );
+
+    for( uint32_t i = 0; i < MEMP_MAX; i++ )
+    {
+        prvCopyPool( &( pxStats->xPools[ i ] ), pcPoolNames[ i ], lwip_stats.memp[ i ], i, xClear );
+    }
+
+    pxStats->ulExhaustedAlarms = ulExhaustedAlarms;
+
+    SYS_ARCH_UNPROTECT( xLevel );
+
+    pxStats->ulTcpXmit = lwip_stats.tcp.xmit;
+    pxStats->ulTcpRexmit = lwip_stats.tcp.rexmit;
+    pxStats->ulTcpDrop = lwip_stats.tcp.drop;
+    pxStats->ulTcpMemErr = lwip_stats.tcp.memerr;
+    pxStats->ulTcpOoseq = prvCountOoseq();
+    pxStats->ulTcpOoseqMax = ulTcpOoseqMax;
+
+    if( pxStats->ulTcpOoseq > pxStats->ulTcpOoseqMax )
+    {
+        pxStats->ulTcpOoseqMax = pxStats->ulTcpOoseq;
+    }
+
+    if( xClear == pdTRUE )
+    {
+        ( void ) memset( &( lwip_stats.tcp ), 0, sizeof( lwip_stats.tcp ) );
+        ulTcpOoseqMax = 0;
+    }
+
+    UNLOCK_TCPIP_CORE();
+
+    sys_arch_mbox_get_stats( &xMboxStats, xClear );
+    pxStats->ulMboxFull = xMboxStats.ulFull;
+    pxStats->ulMboxMaxDepth = xMboxStats.ulMaxDepth;
+    pxStats->ulTcpipMboxMaxDepth = xMboxStats.ulTcpipMaxDepth;
+}
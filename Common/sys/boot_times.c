@@ -0,0 +1,156 @@
+/*
+ * FreeRTOS STM32 Reference Integration
+ *
+ * Copyright (c) 2022 Amazon.com, Inc. or its affiliates. All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#include "logging_levels.h"
+
+#define LOG_LEVEL     LOG_INFO
+#define LOG_MODULE    LOG_MODULE_SYS
+
+#include "logging.h"
+
+#include <stdio.h>
+#include <string.h>
+
+#include "FreeRTOS.h"
+
+#include "hw_defs.h"
+#include "ram_sections.h"
+#include "boot_times.h"
+
+#define BOOT_TIMES_MAGIC    ( 0x544F4F42UL ) /* "BOOT" */
+
+/* Written from reset on, survives a warm reset */
+static BootTimes_t xBootTimes RAM_RETAINED;
+
+/* Record of the boot before this one, copied at reset */
+static BootTimes_t xPreviousBootTimes = { 0 };
+
+static const char * const pcBootStageNames[ BOOT_STAGE_MAX ] =
+{
+    "hw_init",
+    "vectors",
+    "scheduler",
+    "fs_mount",
+    "kvstore",
+    "wifi_assoc",
+    "dhcp",
+    "dns",
+    "tls",
+    "mqtt_connack",
+};
+
+/*-----------------------------------------------------------*/
+
+void vBootTimesInit( uint32_t ulResetSource )
+{
+    uint32_t ulBootCount = 1;
+
+    if( xBootTimes.ulMagic == BOOT_TIMES_MAGIC )
+    {
+        xPreviousBootTimes = xBootTimes;
+        ulBootCount = xBootTimes.ulBootCount + 1;
+    }
+
+    xBootTimes.ulMagic = BOOT_TIMES_MAGIC;
+    xBootTimes.ulBootCount = ulBootCount;
+    xBootTimes.ulResetSource = ulResetSource;
+
+    for( uint32_t i = 0; i < BOOT_STAGE_MAX; i++ )
+    {
+        xBootTimes.ulStageMs[ i ] = BOOT_TIME_NONE;
+    }
+}
+
+/*-----------------------------------------------------------*/
+
+static void prvLogBootTimes( void )
+{
+    char cLine[ 160 ];
+    size_t uxLen = 0;
+
+    for( uint32_t i = 0; ( i < BOOT_STAGE_MAX ) && ( uxLen < sizeof( cLine ) ); i++ )
+    {
+        int lLen;
+
+        if( xBootTimes.ulStageMs[ i ] == BOOT_TIME_NONE )
+        {
+            lLen = snprintf( &( cLine[ uxLen ] ), sizeof( cLine ) - uxLen, " %s=-", pcBootStageNames[ i ] );
+        }
+        else
+        {
+            lLen = snprintf( &( cLine[ uxLen ] ), sizeof( cLine ) - uxLen, " %s=%lu",
+                             pcBootStageNames[ i ], ( unsigned long ) xBootTimes.ulStageMs[ i ] );
+        }
+
+        uxLen += ( lLen > 0 ) ? ( size_t ) lLen : 0;
+    }
+
+    LogSys( "Boot %lu times (ms):%s", ( unsigned long ) xBootTimes.ulBootCount, cLine );
+}
+
+/*-----------------------------------------------------------*/
+
+void vBootTimeMark( BootStage_t xStage )
+{
+    configASSERT( xStage < BOOT_STAGE_MAX );
+
+    if( ( xStage < BOOT_STAGE_MAX ) &&
+        ( xBootTimes.ulStageMs[ xStage ] == BOOT_TIME_NONE ) )
+    {
+        /* The HAL tick counts ms from HAL_Init, early in hw_init, and keeps running with the scheduler */
+        xBootTimes.ulStageMs[ xStage ] = HAL_GetTick();
+
+        if( xStage == BOOT_STAGE_MQTT_CONNACK )
+        {
+            prvLogBootTimes();
+        }
+    }
+}
+
+/*-----------------------------------------------------------*/
+
+const BootTimes_t * pxBootTimesGet( BaseType_t xPrevious )
+{
+    const BootTimes_t * pxTimes = &xBootTimes;
+
+    if( xPrevious == pdTRUE )
+    {
+        pxTimes = ( xPreviousBootTimes.ulMagic == BOOT_TIMES_MAGIC ) ? &xPreviousBootTimes : NULL;
+    }
+
+    return pxTimes;
+}
+
+/*-----------------------------------------------------------*/
+
+const char * pcBootStageName( BootStage_t xStage )
+{
+    const char * pcName = "unknown";
+
+    if( xStage < BOOT_STAGE_MAX )
+    {
+        pcName = pcBootStageNames[ xStage ];
+    }
+
+    return pcName;
+}
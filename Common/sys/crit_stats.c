@@ -0,0 +1,269 @@
+/*
+ * FreeRTOS STM32 Reference Integration
+ *
+ * Copyright (c) 2022 Amazon.com, Inc. or its affiliates. All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+/**
+ * @file crit_stats.c
+ * @brief Link time wrappers timing the interrupt masked and scheduler suspended sections.
+ *
+ * See crit_stats.h. The statistics of the interrupt masked sections are
+ * updated before BASEPRI is lowered and those of the scheduler suspended
+ * sections before the scheduler is resumed, so neither needs a lock of its own.
+ */
+
+#include "FreeRTOS.h"
+#include "task.h"
+
+#include "stm32u5xx.h"
+
+#include "crit_stats.h"
+#include "ram_sections.h"
+
+#include <string.h>
+
+#if CRIT_STATS_ENABLED == 1
+
+uint32_t __real_ulSetInterruptMask( void );
+void __real_vClearInterruptMask( uint32_t ulMask );
+void __real_vPortEnterCritical( void );
+void __real_vTaskSuspendAll( void );
+BaseType_t __real_xTaskResumeAll( void );
+
+uint32_t __wrap_ulSetInterruptMask( void );
+void __wrap_vClearInterruptMask( uint32_t ulMask );
+void __wrap_vPortEnterCritical( void );
+void __wrap_vTaskSuspendAll( void );
+BaseType_t __wrap_xTaskResumeAll( void );
+
+static CritStats_t xStats[ CRIT_STATS_KIND_MAX ] = { 0 };
+
+/* Outermost interrupt masked section */
+static BaseType_t xMaskActive = pdFALSE;
+static uint32_t ulMaskStart = 0;
+static const void * pvMaskSite = NULL;
+
+/* Outermost scheduler suspension made outside of tasks.c */
+static UBaseType_t uxSuspendNesting = 0;
+static uint32_t ulSuspendStart = 0;
+static const void * pvSuspendSite = NULL;
+
+/*-----------------------------------------------------------*/
+
+/* Called with interrupts masked or the scheduler suspended, depending on the kind */
+RAM_FUNC static void prvRecord( CritStats_t * pxStats,
+                                uint32_t ulCycles,
+                                const void * pvSite )
+{
+    uint32_t ulCyclesPerUs = SystemCoreClock / 1000000UL;
+    uint32_t ulUs = ( ulCyclesPerUs > 0 ) ? ( ulCycles / ulCyclesPerUs ) : 0;
+    uint32_t ulBucket = 0;
+
+    pxStats->ulCount++;
+    pxStats->ullTotalCycles += ulCycles;
+
+    if( ulCycles > pxStats->ulMaxCycles )
+    {
+        pxStats->ulMaxCycles = ulCycles;
+        pxStats->pvMaxSite = pvSite;
+    }
+
+    if( ulUs > 0 )
+    {
+        ulBucket = 32U - ( uint32_t ) __builtin_clz( ulUs );
+
+        if( ulBucket >= CRIT_STATS_HIST_BUCKETS )
+        {
+            ulBucket = CRIT_STATS_HIST_BUCKETS - 1U;
+        }
+    }
+
+    pxStats->pulHist[ ulBucket ]++;
+
+    if( ulUs >= CRIT_STATS_SITE_MIN_US )
+    {
+        CritStatsSite_t * pxVictim = &( pxStats->xSites[ 0 ] );
+        CritStatsSite_t * pxSite = NULL;
+
+        for( size_t i = 0; ( i < CRIT_STATS_SITES ) && ( pxSite == NULL ); i++ )
+        {
+            if( pxStats->xSites[ i ].pvSite == pvSite )
+            {
+                pxSite = &( pxStats->xSites[ i ] );
+            }
+            else if( pxStats->xSites[ i ].ulMaxCycles < pxVictim->ulMaxCycles )
+            {
+                pxVictim = &( pxStats->xSites[ i ] );
+            }
+        }
+
+        /* A new site only displaces the one with the shortest maximum */
+        if( ( pxSite == NULL ) &&
+            ( ( pxVictim->pvSite == NULL ) || ( ulCycles > pxVictim->ulMaxCycles ) ) )
+        {
+            pxSite = pxVictim;
+            pxSite->pvSite = pvSite;
+            pxSite->ulCount = 0;
+            pxSite->ulMaxCycles = 0;
+        }
+
+        if( pxSite != NULL )
+        {
+            pxSite->ulCount++;
+
+            if( ulCycles > pxSite->ulMaxCycles )
+            {
+                pxSite->ulMaxCycles = ulCycles;
+            }
+        }
+    }
+}
+
+/*-----------------------------------------------------------*/
+
+RAM_FUNC uint32_t __wrap_ulSetInterruptMask( void )
+{
+    uint32_t ulPrevious = __real_ulSetInterruptMask();
+
+    if( ulPrevious == 0 )
+    {
+        xMaskActive = pdTRUE;
+        pvMaskSite = __builtin_return_address( 0 );
+        ulMaskStart = DWT->CYCCNT;
+    }
+
+    return ulPrevious;
+}
+
+/*-----------------------------------------------------------*/
+
+RAM_FUNC void __wrap_vClearInterruptMask( uint32_t ulMask )
+{
+    if( ( ulMask == 0 ) &&
+        ( xMaskActive == pdTRUE ) )
+    {
+        prvRecord( &( xStats[ CRIT_STATS_IRQ_MASKED ] ), DWT->CYCCNT - ulMaskStart, pvMaskSite );
+        xMaskActive = pdFALSE;
+    }
+
+    __real_vClearInterruptMask( ulMask );
+}
+
+/*-----------------------------------------------------------*/
+
+/* Charges the section to the caller of taskENTER_CRITICAL rather than to port.c */
+void __wrap_vPortEnterCritical( void )
+{
+    BaseType_t xOutermost = ( xMaskActive == pdFALSE ) ? pdTRUE : pdFALSE;
+
+    __real_vPortEnterCritical();
+
+    if( xOutermost == pdTRUE )
+    {
+        pvMaskSite = __builtin_return_address( 0 );
+    }
+}
+
+/*-----------------------------------------------------------*/
+
+void __wrap_vTaskSuspendAll( void )
+{
+    __real_vTaskSuspendAll();
+
+    /* No other task can run from here on, and interrupts do not suspend the scheduler */
+    uxSuspendNesting++;
+
+    if( uxSuspendNesting == 1 )
+    {
+        pvSuspendSite = __builtin_return_address( 0 );
+        ulSuspendStart = DWT->CYCCNT;
+    }
+}
+
+/*-----------------------------------------------------------*/
+
+BaseType_t __wrap_xTaskResumeAll( void )
+{
+    /* Recorded before the resume, which may switch to another task */
+    if( uxSuspendNesting == 1 )
+    {
+        prvRecord( &( xStats[ CRIT_STATS_SCHED_SUSPENDED ] ), DWT->CYCCNT - ulSuspendStart, pvSuspendSite );
+    }
+
+    if( uxSuspendNesting > 0 )
+    {
+        uxSuspendNesting--;
+    }
+
+    return __real_xTaskResumeAll();
+}
+
+/*-----------------------------------------------------------*/
+
+void vCritStatsInit( void )
+{
+    CoreDebug->DEMCR |= CoreDebug_DEMCR_TRCENA_Msk;
+    DWT->CTRL |= DWT_CTRL_CYCCNTENA_Msk;
+}
+
+/*-----------------------------------------------------------*/
+
+void vCritStatsGet( CritStatsKind_t xKind,
+                    CritStats_t * pxStats )
+{
+    UBaseType_t uxSavedInterruptStatus;
+
+    configASSERT( xKind < CRIT_STATS_KIND_MAX );
+    configASSERT( pxStats != NULL );
+
+    /* Also excludes the scheduler suspended sections, which are only recorded by tasks */
+    uxSavedInterruptStatus = portSET_INTERRUPT_MASK_FROM_ISR();
+
+    ( void ) memcpy( pxStats, &( xStats[ xKind ] ), sizeof( CritStats_t ) );
+
+    portCLEAR_INTERRUPT_MASK_FROM_ISR( uxSavedInterruptStatus );
+}
+
+/*-----------------------------------------------------------*/
+
+void vCritStatsReset( void )
+{
+    UBaseType_t uxSavedInterruptStatus = portSET_INTERRUPT_MASK_FROM_ISR();
+
+    ( void ) memset( xStats, 0, sizeof( xStats ) );
+
+    portCLEAR_INTERRUPT_MASK_FROM_ISR( uxSavedInterruptStatus );
+}
+
+/*-----------------------------------------------------------*/
+
+const char * pcCritStatsKindName( CritStatsKind_t xKind )
+{
+    static const char * const pcNames[ CRIT_STATS_KIND_MAX ] =
+    {
+        "irq masked",
+        "sched suspended"
+    };
+
+    return ( xKind < CRIT_STATS_KIND_MAX ) ? pcNames[ xKind ] : "invalid";
+}
+
+#endif /* CRIT_STATS_ENABLED == 1 */
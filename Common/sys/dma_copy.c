@@ -0,0 +1,405 @@
+/*
+ * FreeRTOS STM32 Reference Integration
+ *
+ * Copyright (c) 2022 Amazon.com, Inc. or its affiliates. All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+/**
+ * @file dma_copy.c
+ * @brief Memory to memory copies on GPDMA1 channel 8, see dma_copy.h.
+ *
+ * The channel serves one copy at a time. pxActiveCopy is claimed by the
+ * task starting a copy and released by the transfer complete or error
+ * interrupt, or by xDmaCopyWait when the copy times out.
+ */
+
+#include "FreeRTOS.h"
+#include "task.h"
+
+#include "stm32u5xx.h"
+
+#include "dma_copy.h"
+#include "hw_cache.h"
+#include "low_power.h"
+#include "mem_ops.h"
+
+#include <string.h>
+
+/* memcpy may itself forward long copies to pvDmaCopy */
+#if MEM_OPS_ENABLED == 1
+#define DMA_COPY_CPU( pvDst, pvSrc, uxLen )    ( void ) pvMemOpsCopyCpu( ( pvDst ), ( pvSrc ), ( uxLen ) )
+#else
+#define DMA_COPY_CPU( pvDst, pvSrc, uxLen )    ( void ) memcpy( ( pvDst ), ( pvSrc ), ( uxLen ) )
+#endif
+
+static DmaCopyStats_t xStats = { 0 };
+
+#if DMA_COPY_ENABLED == 1
+
+/* The block size is a 16 bit count of bytes, kept a multiple of the word width */
+#define DMA_COPY_MAX_BLOCK_LEN    0xFFFCU
+
+/* 2 MiB of internal flash on the STM32U585 */
+#define DMA_COPY_FLASH_END        ( FLASH_BASE_NS + 0x200000UL )
+
+static DMA_HandleTypeDef xHndlCopyDma =
+{
+    .Instance                  = GPDMA1_Channel8,
+    .Init                      =
+    {
+        .Request               = DMA_REQUEST_SW,
+        .BlkHWRequest          = DMA_BREQ_SINGLE_BURST,
+        .Direction             = DMA_MEMORY_TO_MEMORY,
+        .SrcInc                = DMA_SINC_INCREMENTED,
+        .DestInc               = DMA_DINC_INCREMENTED,
+        .SrcDataWidth          = DMA_SRC_DATAWIDTH_WORD,
+        .DestDataWidth         = DMA_DEST_DATAWIDTH_WORD,
+        .Priority              = DMA_LOW_PRIORITY_LOW_WEIGHT,
+        .SrcBurstLength        = 1,
+        .DestBurstLength       = 1,
+        .TransferAllocatedPort = DMA_SRC_ALLOCATED_PORT0 | DMA_DEST_ALLOCATED_PORT1,
+        .TransferEventMode     = DMA_TCEM_BLOCK_TRANSFER,
+        .Mode                  = DMA_NORMAL,
+    },
+};
+
+static DmaCopy_t * volatile pxActiveCopy = NULL;
+
+/*-----------------------------------------------------------*/
+
+static inline BaseType_t xInRange( uintptr_t uxAddr,
+                                   size_t uxLen,
+                                   uintptr_t uxStart,
+                                   uintptr_t uxEnd )
+{
+    return ( ( uxAddr >= uxStart ) && ( uxAddr < uxEnd ) && ( uxLen <= ( uxEnd - uxAddr ) ) ) ? pdTRUE : pdFALSE;
+}
+
+/* SRAM1 to SRAM3 and SRAM4, which are never cached */
+static inline BaseType_t xIsInternalSram( const void * pvAddr,
+                                          size_t uxLen )
+{
+    return ( ( xInRange( ( uintptr_t ) pvAddr, uxLen, SRAM1_BASE_NS, SRAM3_BASE_NS + SRAM3_SIZE ) == pdTRUE ) ||
+             ( xInRange( ( uintptr_t ) pvAddr, uxLen, SRAM4_BASE_NS, SRAM4_BASE_NS + SRAM4_SIZE ) == pdTRUE ) ) ? pdTRUE : pdFALSE;
+}
+
+/* Internal flash, SRAM, or the memory mapped OCTOSPI and FMC regions */
+static inline BaseType_t xIsReadableMemory( const void * pvAddr,
+                                            size_t uxLen )
+{
+    return ( ( xIsInternalSram( pvAddr, uxLen ) == pdTRUE ) ||
+             ( xInRange( ( uintptr_t ) pvAddr, uxLen, FLASH_BASE_NS, DMA_COPY_FLASH_END ) == pdTRUE ) ||
+             ( xInRange( ( uintptr_t ) pvAddr, uxLen, HW_CACHE_REGION_START, HW_CACHE_REGION_END ) == pdTRUE ) ) ? pdTRUE : pdFALSE;
+}
+
+/* Only a task may block on the transfer */
+static BaseType_t prvCopyQualifies( const uint8_t * pucDst,
+                                    const uint8_t * pucSrc,
+                                    size_t uxLen )
+{
+    return ( ( ( ( ( uintptr_t ) pucDst ^ ( uintptr_t ) pucSrc ) & 0x3U ) == 0U ) &&
+             ( xIsInternalSram( pucDst, uxLen ) == pdTRUE ) &&
+             ( xIsReadableMemory( pucSrc, uxLen ) == pdTRUE ) &&
+             ( __get_IPSR() == 0U ) &&
+             ( __get_PRIMASK() == 0U ) &&
+             ( __get_BASEPRI() == 0U ) &&
+             ( xTaskGetSchedulerState() == taskSCHEDULER_RUNNING ) ) ? pdTRUE : pdFALSE;
+}
+
+/*-----------------------------------------------------------*/
+
+static inline size_t uxBlockLen( const DmaCopy_t * pxCopy )
+{
+    return ( pxCopy->uxRemaining < DMA_COPY_MAX_BLOCK_LEN ) ? pxCopy->uxRemaining : DMA_COPY_MAX_BLOCK_LEN;
+}
+
+static HAL_StatusTypeDef prvStartBlock( DmaCopy_t * pxCopy )
+{
+    return HAL_DMA_Start_IT( &xHndlCopyDma,
+                             ( uint32_t ) pxCopy->pucSrc,
+                             ( uint32_t ) pxCopy->pucDst,
+                             ( uint32_t ) uxBlockLen( pxCopy ) );
+}
+
+/* Called from the channel interrupt, hands the copy back to its task */
+static void prvCopyDone( DmaCopy_t * pxCopy,
+                         BaseType_t xFailed )
+{
+    BaseType_t xHigherPriorityTaskWoken = pdFALSE;
+
+    pxCopy->xFailed = xFailed;
+    pxCopy->xPending = pdFALSE;
+    pxActiveCopy = NULL;
+
+    vLowPowerStopAllow( LOW_POWER_CLIENT_DMA_COPY );
+
+    vTaskNotifyGiveIndexedFromISR( pxCopy->xTask, DMA_COPY_NOTIFY_IDX, &xHigherPriorityTaskWoken );
+    portYIELD_FROM_ISR( xHigherPriorityTaskWoken );
+}
+
+static void prvBlockCpltCallback( DMA_HandleTypeDef * pxHndl )
+{
+    DmaCopy_t * pxCopy = pxActiveCopy;
+    size_t uxBlock;
+
+    ( void ) pxHndl;
+
+    if( pxCopy != NULL )
+    {
+        uxBlock = uxBlockLen( pxCopy );
+
+        pxCopy->pucDst += uxBlock;
+        pxCopy->pucSrc += uxBlock;
+        pxCopy->uxRemaining -= uxBlock;
+
+        if( pxCopy->uxRemaining == 0U )
+        {
+            prvCopyDone( pxCopy, pdFALSE );
+        }
+        else if( prvStartBlock( pxCopy ) != HAL_OK )
+        {
+            prvCopyDone( pxCopy, pdTRUE );
+        }
+        else
+        {
+            /* Next block in progress */
+        }
+    }
+}
+
+static void prvBlockErrorCallback( DMA_HandleTypeDef * pxHndl )
+{
+    ( void ) pxHndl;
+
+    if( pxActiveCopy != NULL )
+    {
+        prvCopyDone( pxActiveCopy, pdTRUE );
+    }
+}
+
+void GPDMA1_Channel8_IRQHandler( void )
+{
+    TRACE_ISR_ENTER();
+    HAL_DMA_IRQHandler( &xHndlCopyDma );
+    TRACE_ISR_EXIT();
+}
+
+/*-----------------------------------------------------------*/
+
+void vDmaCopyInit( void )
+{
+    HAL_StatusTypeDef xHalRslt;
+
+    __HAL_RCC_GPDMA1_CLK_ENABLE();
+
+    xHalRslt = HAL_DMA_Init( &xHndlCopyDma );
+
+    if( xHalRslt == HAL_OK )
+    {
+        xHalRslt = HAL_DMA_ConfigChannelAttributes( &xHndlCopyDma, DMA_CHANNEL_NPRIV );
+    }
+
+    if( xHalRslt == HAL_OK )
+    {
+        xHndlCopyDma.XferCpltCallback = prvBlockCpltCallback;
+        xHndlCopyDma.XferErrorCallback = prvBlockErrorCallback;
+
+        HAL_NVIC_SetPriority( GPDMA1_Channel8_IRQn, 5, 0 );
+        HAL_NVIC_EnableIRQ( GPDMA1_Channel8_IRQn );
+    }
+
+    configASSERT( xHalRslt == HAL_OK );
+}
+
+#endif /* DMA_COPY_ENABLED == 1 */
+
+/*-----------------------------------------------------------*/
+
+BaseType_t xDmaCopyStart( DmaCopy_t * pxCopy,
+                          void * pvDst,
+                          const void * pvSrc,
+                          size_t uxLen )
+{
+    BaseType_t xStarted = pdFALSE;
+
+    configASSERT( pxCopy != NULL );
+
+    pxCopy->uxRemaining = 0;
+    pxCopy->xTask = NULL;
+    pxCopy->xPending = pdFALSE;
+    pxCopy->xFailed = pdFALSE;
+
+#if DMA_COPY_ENABLED == 1
+    if( uxLen >= DMA_COPY_MIN_LEN )
+    {
+        uint8_t * pucDst = ( uint8_t * ) pvDst;
+        const uint8_t * pucSrc = ( const uint8_t * ) pvSrc;
+
+        if( prvCopyQualifies( pucDst, pucSrc, uxLen ) == pdTRUE )
+        {
+            taskENTER_CRITICAL();
+
+            if( pxActiveCopy == NULL )
+            {
+                pxActiveCopy = pxCopy;
+                xStarted = pdTRUE;
+            }
+
+            taskEXIT_CRITICAL();
+
+            if( xStarted == pdFALSE )
+            {
+                xStats.ulBusy++;
+            }
+        }
+
+        if( xStarted == pdTRUE )
+        {
+            /* The channel moves the words, the CPU the bytes around them */
+            size_t uxHead = ( 4U - ( ( uintptr_t ) pucDst & 0x3U ) ) & 0x3U;
+            size_t uxBody = ( uxLen - uxHead ) & ~( ( size_t ) 0x3U );
+            size_t uxTail = uxLen - uxHead - uxBody;
+
+            pxCopy->pucDst = &( pucDst[ uxHead ] );
+            pxCopy->pucSrc = &( pucSrc[ uxHead ] );
+            pxCopy->uxRemaining = uxBody;
+            pxCopy->xTask = xTaskGetCurrentTaskHandle();
+            pxCopy->xPending = pdTRUE;
+
+            /* Left over by a copy that completed as it timed out */
+            ( void ) ulTaskNotifyTakeIndexed( DMA_COPY_NOTIFY_IDX, pdTRUE, 0 );
+
+            vLowPowerStopInhibit( LOW_POWER_CLIENT_DMA_COPY );
+
+            /* Write back what the CPU may have left in the cache of an external source */
+            ( void ) xCacheCleanRange( pxCopy->pucSrc, uxBody );
+
+            if( prvStartBlock( pxCopy ) == HAL_OK )
+            {
+                DMA_COPY_CPU( pucDst, pucSrc, uxHead );
+                DMA_COPY_CPU( &( pucDst[ uxHead + uxBody ] ), &( pucSrc[ uxHead + uxBody ] ), uxTail );
+            }
+            else
+            {
+                vLowPowerStopAllow( LOW_POWER_CLIENT_DMA_COPY );
+
+                pxCopy->xTask = NULL;
+                pxCopy->xPending = pdFALSE;
+                pxCopy->uxRemaining = 0;
+                pxActiveCopy = NULL;
+
+                xStats.ulAborted++;
+                xStarted = pdFALSE;
+            }
+        }
+
+        if( xStarted == pdFALSE )
+        {
+            xStats.ulCpuCopies++;
+        }
+    }
+#endif /* DMA_COPY_ENABLED == 1 */
+
+    if( xStarted == pdFALSE )
+    {
+        DMA_COPY_CPU( pvDst, pvSrc, uxLen );
+    }
+
+    return xStarted;
+}
+
+/*-----------------------------------------------------------*/
+
+BaseType_t xDmaCopyWait( DmaCopy_t * pxCopy )
+{
+    BaseType_t xResult = pdFALSE;
+
+    configASSERT( pxCopy != NULL );
+
+#if DMA_COPY_ENABLED == 1
+    if( pxCopy->xTask != NULL )
+    {
+        configASSERT( pxCopy->xTask == xTaskGetCurrentTaskHandle() );
+
+        if( ulTaskNotifyTakeIndexed( DMA_COPY_NOTIFY_IDX, pdTRUE, pdMS_TO_TICKS( DMA_COPY_TIMEOUT_MS ) ) == 0 )
+        {
+            /* Keep the interrupt from completing the copy while it is taken back */
+            HAL_NVIC_DisableIRQ( GPDMA1_Channel8_IRQn );
+
+            if( pxCopy->xPending == pdTRUE )
+            {
+                ( void ) HAL_DMA_Abort( &xHndlCopyDma );
+
+                pxCopy->xFailed = pdTRUE;
+                pxCopy->xPending = pdFALSE;
+                pxActiveCopy = NULL;
+
+                vLowPowerStopAllow( LOW_POWER_CLIENT_DMA_COPY );
+            }
+
+            HAL_NVIC_EnableIRQ( GPDMA1_Channel8_IRQn );
+        }
+
+        if( pxCopy->xFailed == pdTRUE )
+        {
+            /* Restart from the beginning of the block that was in progress */
+            DMA_COPY_CPU( pxCopy->pucDst, pxCopy->pucSrc, pxCopy->uxRemaining );
+            xStats.ulAborted++;
+        }
+        else
+        {
+            xStats.ulDmaCopies++;
+            xResult = pdTRUE;
+        }
+
+        pxCopy->uxRemaining = 0;
+        pxCopy->xTask = NULL;
+    }
+#endif /* DMA_COPY_ENABLED == 1 */
+
+    return xResult;
+}
+
+/*-----------------------------------------------------------*/
+
+void * pvDmaCopy( void * pvDst,
+                  const void * pvSrc,
+                  size_t uxLen )
+{
+    DmaCopy_t xCopy;
+
+    if( xDmaCopyStart( &xCopy, pvDst, pvSrc, uxLen ) == pdTRUE )
+    {
+        ( void ) xDmaCopyWait( &xCopy );
+    }
+
+    return pvDst;
+}
+
+/*-----------------------------------------------------------*/
+
+void vDmaCopyGetStats( DmaCopyStats_t * pxStats )
+{
+    configASSERT( pxStats != NULL );
+
+    taskENTER_CRITICAL();
+    *pxStats = xStats;
+    taskEXIT_CRITICAL();
+}
@@ -0,0 +1,306 @@
+/*
+ * FreeRTOS STM32 Reference Integration
+ *
+ * Copyright (c) 2022 Amazon.com, Inc. or its affiliates. All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#include "logging_levels.h"
+
+#define LOG_LEVEL     LOG_INFO
+#define LOG_MODULE    LOG_MODULE_SYS
+
+#include "logging.h"
+
+#include "FreeRTOS.h"
+#include "task.h"
+#include "timers.h"
+
+#include "hw_defs.h"
+#include "dvfs.h"
+
+#if DVFS_ENABLED == 1
+
+/* TIM5 counts at 1 MHz at both levels */
+#define DVFS_TIM5_HZ    ( 1000000U )
+
+static volatile uint32_t ulRequests = 0;
+static volatile DvfsLevel_t xLevel = DVFS_LEVEL_HIGH;
+static TimerHandle_t xLowTimer = NULL;
+static TickType_t xLevelSince = 0;
+static DvfsStats_t xStats = { 0 };
+
+/*-----------------------------------------------------------*/
+
+/* Keep the TIM5 run time counter at 1 MHz after a PCLK1 change, without losing its count */
+static void prvTim5Rescale( void )
+{
+    if( pxHndlTim5 != NULL )
+    {
+        uint32_t ulCount = pxHndlTim5->Instance->CNT;
+
+        pxHndlTim5->Init.Prescaler = ( HAL_RCC_GetPCLK1Freq() / DVFS_TIM5_HZ ) - 1U;
+        pxHndlTim5->Instance->PSC = pxHndlTim5->Init.Prescaler;
+
+        /* The prescaler is preloaded, load it now rather than on the next 32 bit wrap */
+        pxHndlTim5->Instance->EGR = TIM_EGR_UG;
+        pxHndlTim5->Instance->CNT = ulCount;
+    }
+}
+
+/*-----------------------------------------------------------*/
+
+/* Range 1, then the PLL, then SYSCLK from the PLL. PRE: interrupts disabled */
+static void prvSetHigh( void )
+{
+    HAL_StatusTypeDef xResult = HAL_OK;
+
+    /* Same PLL configuration as SystemClock_Config, from MSIS at 48 MHz */
+    RCC_OscInitTypeDef xRccOscInit =
+    {
+        .OscillatorType = RCC_OSCILLATORTYPE_NONE,
+        .PLL.PLLState   = RCC_PLL_ON,
+        .PLL.PLLSource  = RCC_PLLSOURCE_MSI,
+        .PLL.PLLMBOOST  = RCC_PLLMBOOST_DIV4,
+        .PLL.PLLM       = 3,
+        .PLL.PLLN       = 10,
+        .PLL.PLLP       = 2,
+        .PLL.PLLQ       = 2,
+        .PLL.PLLR       = 1,
+        .PLL.PLLRGE     = RCC_PLLVCIRANGE_1,
+        .PLL.PLLFRACN   = 0,
+    };
+
+    const RCC_ClkInitTypeDef xRccClkInit =
+    {
+        .ClockType     = RCC_CLOCKTYPE_SYSCLK | RCC_CLOCKTYPE_HCLK,
+        .SYSCLKSource  = RCC_SYSCLKSOURCE_PLLCLK,
+        .AHBCLKDivider = RCC_SYSCLK_DIV1,
+    };
+
+    xResult = HAL_PWREx_ControlVoltageScaling( PWR_REGULATOR_VOLTAGE_SCALE1 );
+    configASSERT( xResult == HAL_OK );
+
+    if( __HAL_RCC_GET_SYSCLK_SOURCE() != RCC_SYSCLKSOURCE_STATUS_PLLCLK )
+    {
+        xResult = HAL_RCC_OscConfig( &xRccOscInit );
+        configASSERT( xResult == HAL_OK );
+    }
+
+    /* Raises the flash latency before the frequency */
+    xResult = HAL_RCC_ClockConfig( &xRccClkInit, FLASH_LATENCY_4 );
+    configASSERT( xResult == HAL_OK );
+}
+
+/*-----------------------------------------------------------*/
+
+/* SYSCLK from MSIS, then the PLL off, then range 3. PRE: interrupts disabled */
+static void prvSetLow( void )
+{
+    HAL_StatusTypeDef xResult = HAL_OK;
+
+    RCC_OscInitTypeDef xRccOscInit =
+    {
+        .OscillatorType = RCC_OSCILLATORTYPE_NONE,
+        .PLL.PLLState   = RCC_PLL_OFF,
+    };
+
+    const RCC_ClkInitTypeDef xRccClkInit =
+    {
+        .ClockType     = RCC_CLOCKTYPE_SYSCLK | RCC_CLOCKTYPE_HCLK,
+        .SYSCLKSource  = RCC_SYSCLKSOURCE_MSI,
+        .AHBCLKDivider = RCC_SYSCLK_DIV1,
+    };
+
+    /* 48 MHz needs 3 wait states in range 3, lowered after the frequency */
+    xResult = HAL_RCC_ClockConfig( &xRccClkInit, FLASH_LATENCY_3 );
+    configASSERT( xResult == HAL_OK );
+
+    xResult = HAL_RCC_OscConfig( &xRccOscInit );
+    configASSERT( xResult == HAL_OK );
+
+    /* The EPOD booster is only needed for the PLL and is not allowed in range 3 */
+    CLEAR_BIT( PWR->VOSR, PWR_VOSR_BOOSTEN );
+
+    xResult = HAL_PWREx_ControlVoltageScaling( PWR_REGULATOR_VOLTAGE_SCALE3 );
+    configASSERT( xResult == HAL_OK );
+}
+
+/*-----------------------------------------------------------*/
+
+/* Apply xNewLevel to the clock tree and the clocks derived from it. PRE: interrupts disabled */
+static void prvApplyLevel( DvfsLevel_t xNewLevel )
+{
+    /* USART1 runs from HSI16, which is stopped in Stop 2 */
+    if( __HAL_RCC_GET_FLAG( RCC_FLAG_HSIRDY ) == 0U )
+    {
+        __HAL_RCC_HSI_ENABLE();
+
+        while( __HAL_RCC_GET_FLAG( RCC_FLAG_HSIRDY ) == 0U )
+        {
+        }
+    }
+
+    if( xNewLevel == DVFS_LEVEL_HIGH )
+    {
+        prvSetHigh();
+    }
+    else
+    {
+        prvSetLow();
+    }
+
+    /* HAL_RCC_ClockConfig has updated SystemCoreClock and the SysTick reload */
+    prvTim5Rescale();
+}
+
+/*-----------------------------------------------------------*/
+
+/* Switch to xNewLevel and account for the time spent at the previous one. PRE: in a critical section */
+static void prvChangeLevel( DvfsLevel_t xNewLevel )
+{
+    TickType_t xNow = xTaskGetTickCount();
+
+    if( xLevel == DVFS_LEVEL_HIGH )
+    {
+        xStats.ulHighMs += ( xNow - xLevelSince );
+    }
+    else
+    {
+        xStats.ulLowMs += ( xNow - xLevelSince );
+    }
+
+    xLevelSince = xNow;
+
+    prvApplyLevel( xNewLevel );
+
+    xLevel = xNewLevel;
+    xStats.ulTransitions++;
+}
+
+/*-----------------------------------------------------------*/
+
+static void prvLowTimerCallback( TimerHandle_t xTimer )
+{
+    ( void ) xTimer;
+
+    taskENTER_CRITICAL();
+
+    if( ( ulRequests == 0 ) &&
+        ( xLevel == DVFS_LEVEL_HIGH ) )
+    {
+        prvChangeLevel( DVFS_LEVEL_LOW );
+    }
+
+    taskEXIT_CRITICAL();
+}
+
+/*-----------------------------------------------------------*/
+
+void vDvfsInit( void )
+{
+    xLowTimer = xTimerCreate( "dvfs", pdMS_TO_TICKS( DVFS_LOW_DELAY_MS ), pdFALSE, NULL, prvLowTimerCallback );
+    configASSERT( xLowTimer != NULL );
+
+    xLevelSince = xTaskGetTickCount();
+
+    /* Drop to the low power level unless a client is already holding a request */
+    if( xLowTimer != NULL )
+    {
+        ( void ) xTimerStart( xLowTimer, portMAX_DELAY );
+    }
+}
+
+/*-----------------------------------------------------------*/
+
+void vDvfsRequest( uint32_t ulClient )
+{
+    taskENTER_CRITICAL();
+
+    ulRequests |= ulClient;
+
+    if( xLevel != DVFS_LEVEL_HIGH )
+    {
+        prvChangeLevel( DVFS_LEVEL_HIGH );
+    }
+
+    taskEXIT_CRITICAL();
+}
+
+/*-----------------------------------------------------------*/
+
+void vDvfsRelease( uint32_t ulClient )
+{
+    BaseType_t xIdle = pdFALSE;
+
+    taskENTER_CRITICAL();
+
+    if( ( ulRequests & ulClient ) != 0 )
+    {
+        ulRequests &= ~ulClient;
+        xIdle = ( ulRequests == 0 ) ? pdTRUE : pdFALSE;
+    }
+
+    taskEXIT_CRITICAL();
+
+    /* The timer callback checks the requests again, a new request in the meantime wins */
+    if( ( xIdle == pdTRUE ) &&
+        ( xLowTimer != NULL ) )
+    {
+        ( void ) xTimerReset( xLowTimer, 0 );
+    }
+}
+
+/*-----------------------------------------------------------*/
+
+void vDvfsRestoreClock( void )
+{
+    /* The core wakes up from Stop 2 running from MSIS at 48 MHz, in the voltage range it entered with */
+    prvApplyLevel( xLevel );
+}
+
+/*-----------------------------------------------------------*/
+
+void vDvfsGetStats( DvfsStats_t * pxStats )
+{
+    TickType_t xNow;
+
+    configASSERT( pxStats != NULL );
+
+    taskENTER_CRITICAL();
+
+    xNow = xTaskGetTickCount();
+
+    *pxStats = xStats;
+    pxStats->xLevel = xLevel;
+    pxStats->ulRequests = ulRequests;
+
+    if( xLevel == DVFS_LEVEL_HIGH )
+    {
+        pxStats->ulHighMs += ( xNow - xLevelSince );
+    }
+    else
+    {
+        pxStats->ulLowMs += ( xNow - xLevelSince );
+    }
+
+    taskEXIT_CRITICAL();
+}
+
+#endif /* DVFS_ENABLED == 1 */
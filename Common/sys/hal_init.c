@@ -31,6 +31,12 @@
 #include "task.h"
 #include "b_u585i_iot02a_bus.h"
 #include "b_u585i_iot02a_errno.h"
+#include "low_power.h"
+
+/* Direct mapped mode draws less power, ICACHE_2WAYS gives a better hit rate on large code */
+#ifndef HW_ICACHE_ASSOCIATIVITY
+#define HW_ICACHE_ASSOCIATIVITY    ICACHE_1WAY
+#endif
 
 /* Global peripheral handles */
 RTC_HandleTypeDef * pxHndlRtc = NULL;
@@ -39,6 +45,8 @@ UART_HandleTypeDef * pxHndlUart1 = NULL;
 DCACHE_HandleTypeDef * pxHndlDCache = NULL;
 DMA_HandleTypeDef * pxHndlGpdmaCh4 = NULL;
 DMA_HandleTypeDef * pxHndlGpdmaCh5 = NULL;
+DMA_HandleTypeDef * pxHndlGpdmaCh6 = NULL;
+I2C_HandleTypeDef * pxHndlI2c2 = NULL;
 #ifndef TFM_PSA_API
 RNG_HandleTypeDef * pxHndlRng = NULL;
 #endif /* ! defined( TFM_PSA_API ) */
@@ -66,6 +74,9 @@ void hw_init( void )
 {
     __HAL_RCC_SYSCFG_CLK_ENABLE();
 
+    /* SRAM4 may hold the .sram4 section, which is not initialized by the startup code */
+    __HAL_RCC_SRAM4_CLK_ENABLE();
+
     /*
      * Initializes flash interface and systick timer.
      * Note: HAL_Init calls HAL_MspInit.
@@ -90,7 +101,7 @@ void hw_init( void )
     hw_gpio_init();
 
     hw_gpdma_init();
-/*    hw_rtc_init(); */
+    hw_rtc_init();
     hw_spi_init();
 
 #ifndef TFM_PSA_API
@@ -105,6 +116,13 @@ void hw_init( void )
     hw_tim5_init();
 
     hw_watchdog_init();
+
+    vLowPowerInit();
+}
+
+void hw_clock_restore( void )
+{
+    SystemClock_Config();
 }
 
 static void SystemClock_Config( void )
@@ -116,8 +134,10 @@ static void SystemClock_Config( void )
 
     RCC_OscInitTypeDef xRccOscInit =
     {
-        .OscillatorType      = RCC_OSCILLATORTYPE_HSI48 | RCC_OSCILLATORTYPE_LSI | RCC_OSCILLATORTYPE_MSI,
+        .OscillatorType      = RCC_OSCILLATORTYPE_HSI48 | RCC_OSCILLATORTYPE_HSI | RCC_OSCILLATORTYPE_LSI | RCC_OSCILLATORTYPE_MSI,
         .HSI48State          = RCC_HSI48_ON,
+        .HSIState            = RCC_HSI_ON,
+        .HSICalibrationValue = RCC_HSICALIBRATION_DEFAULT,
         .LSIState            = RCC_LSI_ON,
         .MSIState            = RCC_MSI_ON,
         .MSICalibrationValue = RCC_MSICALIBRATION_DEFAULT,
@@ -166,6 +186,9 @@ static void hw_gpdma_init( void )
 
     HAL_NVIC_SetPriority( GPDMA1_Channel5_IRQn, 5, 0 );
     HAL_NVIC_EnableIRQ( GPDMA1_Channel5_IRQn );
+
+    HAL_NVIC_SetPriority( GPDMA1_Channel6_IRQn, 5, 0 );
+    HAL_NVIC_EnableIRQ( GPDMA1_Channel6_IRQn );
 }
 
 static void hw_cache_init( void )
@@ -176,7 +199,7 @@ static void hw_cache_init( void )
     ( void ) HAL_ICACHE_Disable();
 
     /* initialize ICACHE (makes flash access faster) */
-    xResult = HAL_ICACHE_ConfigAssociativityMode( ICACHE_1WAY );
+    xResult = HAL_ICACHE_ConfigAssociativityMode( HW_ICACHE_ASSOCIATIVITY );
 
     configASSERT( xResult == HAL_OK );
 
@@ -252,6 +275,7 @@ static void hw_rtc_init( void )
     {
         .Instance            = RTC,
         .Init.HourFormat     = RTC_HOURFORMAT_24,
+        /* 1 Hz calendar from the 32768 Hz LSE */
         .Init.AsynchPrediv   = 127,
         .Init.SynchPrediv    = 255,
         .Init.OutPut         = RTC_OUTPUT_DISABLE,
@@ -626,7 +650,7 @@ static void hw_tim5_init( void )
     static TIM_HandleTypeDef xTim5Handle =
     {
         .Instance       = TIM5,
-        .Init.Prescaler = 4096, /* 160 MHz / 4096 = 39KHz */
+        .Init.Prescaler = 159, /* 160 MHz / ( 159 + 1 ) = 1 MHz, run time stats and latencies in us */
         .Init.Period    = 0xFFFFFFFF,
     };
 
@@ -682,12 +706,62 @@ void HAL_MspInit( void )
     HAL_PWREx_DisableUCPDDeadBattery();
 }
 
+void HAL_RTC_MspInit( RTC_HandleTypeDef * pxHndlRtc )
+{
+    HAL_StatusTypeDef xResult = HAL_OK;
+
+    ( void ) pxHndlRtc;
+
+    HAL_PWR_EnableBkUpAccess();
+
+    /*
+     * The LSE and the RTC clock selection are in the backup domain, which keeps
+     * them and the calendar across a reset. Selecting another RTC clock resets
+     * the backup domain, so this is only done when the LSE is not selected yet,
+     * which also limits the wait for the LSE to start to a cold boot.
+     */
+    if( __HAL_RCC_GET_RTC_SOURCE() != RCC_RTCCLKSOURCE_LSE )
+    {
+        RCC_OscInitTypeDef xRccOscInit =
+        {
+            .OscillatorType = RCC_OSCILLATORTYPE_LSE,
+            .LSEState       = RCC_LSE_ON,
+            .PLL.PLLState   = RCC_PLL_NONE,
+        };
+
+        RCC_PeriphCLKInitTypeDef xRccPeriphClkInit =
+        {
+            .PeriphClockSelection = RCC_PERIPHCLK_RTC,
+            .RTCClockSelection    = RCC_RTCCLKSOURCE_LSE,
+        };
+
+        xResult = HAL_RCC_OscConfig( &xRccOscInit );
+        configASSERT( xResult == HAL_OK );
+
+        xResult = HAL_RCCEx_PeriphCLKConfig( &xRccPeriphClkInit );
+        configASSERT( xResult == HAL_OK );
+    }
+
+    __HAL_RCC_RTC_ENABLE();
+    __HAL_RCC_RTCAPB_CLK_ENABLE();
+}
+
 void HAL_I2C_MspDeInit( I2C_HandleTypeDef * pxHndlI2c )
 {
     configASSERT( pxHndlI2c != NULL );
 
     if( pxHndlI2c->Instance == I2C2 )
     {
+        HAL_NVIC_DisableIRQ( I2C2_EV_IRQn );
+        HAL_NVIC_DisableIRQ( I2C2_ER_IRQn );
+        pxHndlI2c2 = NULL;
+
+        if( pxHndlI2c->hdmarx != NULL )
+        {
+            pxHndlGpdmaCh6 = NULL;
+            ( void ) HAL_DMA_DeInit( pxHndlI2c->hdmarx );
+        }
+
         __HAL_RCC_I2C2_CLK_DISABLE();
         HAL_GPIO_DeInit( GPIOH, GPIO_PIN_4 | GPIO_PIN_5 );
     }
@@ -726,6 +800,54 @@ void HAL_I2C_MspInit( I2C_HandleTypeDef * pxHndlI2c )
             /* Peripheral clock enable */
             __HAL_RCC_I2C2_CLK_ENABLE();
         }
+
+        /* Receive DMA, used by the Common IO I2C driver for burst reads of the motion sensor FIFO */
+        static DMA_HandleTypeDef xHndlGpdmaCh6 =
+        {
+            .Instance                  = GPDMA1_Channel6,
+            .Init                      =
+            {
+                .Request               = GPDMA1_REQUEST_I2C2_RX,
+                .BlkHWRequest          = DMA_BREQ_SINGLE_BURST,
+                .Direction             = DMA_PERIPH_TO_MEMORY,
+                .SrcInc                = DMA_SINC_FIXED,
+                .DestInc               = DMA_DINC_INCREMENTED,
+                .SrcDataWidth          = DMA_SRC_DATAWIDTH_BYTE,
+                .DestDataWidth         = DMA_DEST_DATAWIDTH_BYTE,
+                .Priority              = DMA_LOW_PRIORITY_LOW_WEIGHT,
+                .SrcBurstLength        = 1,
+                .DestBurstLength       = 1,
+                .TransferAllocatedPort = DMA_SRC_ALLOCATED_PORT0 | DMA_DEST_ALLOCATED_PORT1,
+                .TransferEventMode     = DMA_TCEM_BLOCK_TRANSFER,
+                .Mode                  = DMA_NORMAL,
+            },
+        };
+
+        if( xResult == HAL_OK )
+        {
+            xResult = HAL_DMA_Init( &xHndlGpdmaCh6 );
+            configASSERT( xResult == HAL_OK );
+        }
+
+        if( xResult == HAL_OK )
+        {
+            __HAL_LINKDMA( pxHndlI2c, hdmarx, xHndlGpdmaCh6 );
+
+            xResult = HAL_DMA_ConfigChannelAttributes( &xHndlGpdmaCh6, DMA_CHANNEL_NPRIV );
+            configASSERT( xResult == HAL_OK );
+        }
+
+        if( xResult == HAL_OK )
+        {
+            pxHndlGpdmaCh6 = &xHndlGpdmaCh6;
+            pxHndlI2c2 = pxHndlI2c;
+
+            /* Polled transfers do not enable any I2C interrupt sources */
+            HAL_NVIC_SetPriority( I2C2_EV_IRQn, 5, 0 );
+            HAL_NVIC_EnableIRQ( I2C2_EV_IRQn );
+            HAL_NVIC_SetPriority( I2C2_ER_IRQn, 5, 0 );
+            HAL_NVIC_EnableIRQ( I2C2_ER_IRQn );
+        }
     }
 }
 
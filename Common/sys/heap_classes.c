@@ -0,0 +1,525 @@
+/*
+ * FreeRTOS STM32 Reference Integration
+ *
+ * Copyright (c) 2022 Amazon.com, Inc. or its affiliates. All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+/**
+ * @file heap_classes.c
+ * @brief Size class front end of the heap_4 allocator.
+ *
+ * heap_4 is compiled into this file under other names and remains the backing
+ * store. Every block, cached or not, keeps its heap_4 header, so
+ * malloc_usable_size and xPortGetFreeHeapSize keep working. With
+ * HEAP_ACCOUNTING, a BlockPrefix_t sits between the header and the memory
+ * returned to the caller.
+ */
+
+/* heap_4 provides pvHeap4Malloc and vHeap4Free */
+#define pvPortMalloc    pvHeap4Malloc
+#define pvPortCalloc    pvHeap4Calloc
+#define vPortFree       vHeap4Free
+#include "../portable/MemMang/heap_4.c"
+#undef pvPortMalloc
+#undef pvPortCalloc
+#undef vPortFree
+
+#include <malloc.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "heap_classes.h"
+#include "ram_sections.h"
+
+/* Free blocks kept per class */
+#ifndef HEAP_CLASS_CACHE_MAX
+#define HEAP_CLASS_CACHE_MAX          16U
+#endif
+
+/* Free bytes kept over all classes */
+#ifndef HEAP_CLASS_CACHE_MAX_BYTES
+#define HEAP_CLASS_CACHE_MAX_BYTES    ( 8U * 1024U )
+#endif
+
+/* Thread local storage pointer holding the HeapTag_t of a task */
+#ifndef HEAP_TAG_TLS_INDEX
+#define HEAP_TAG_TLS_INDEX            2
+#endif
+
+#if ( HEAP_ACCOUNTING == 1 ) && ( HEAP_TAG_TLS_INDEX >= configNUM_THREAD_LOCAL_STORAGE_POINTERS )
+#error "HEAP_TAG_TLS_INDEX must be less than configNUM_THREAD_LOCAL_STORAGE_POINTERS"
+#endif
+
+#define HEAP_CLASS_MAX_LEN            256U
+#define HEAP_CLASS_UNIT               8U
+
+/* heap_4 does not split a block when less than this would remain (heapMINIMUM_BLOCK_SIZE) */
+#define HEAP_CLASS_SLACK              16U
+
+typedef struct FreeBlock
+{
+    struct FreeBlock * pxNext;
+} FreeBlock_t;
+
+#if HEAP_ACCOUNTING == 1
+typedef struct BlockPrefix
+{
+    uint32_t ulLen; /* Requested length */
+    uint8_t ucTag;
+    uint8_t ucReserved[ 3 ];
+} BlockPrefix_t;
+#endif /* HEAP_ACCOUNTING == 1 */
+
+/* Backing store of heap_4, in the SRAM bank reserved for CPU data */
+uint8_t ucHeap[ configTOTAL_HEAP_SIZE ] RAM_CPU_DATA;
+
+static const size_t uxClassLen[ HEAP_CLASS_COUNT ] =
+{
+    16U, 24U, 32U, 48U, 64U, 96U, 128U, 192U, 256U
+};
+
+/* Smallest class holding a request of n units of HEAP_CLASS_UNIT bytes */
+static const uint8_t ucClassOfUnits[ ( HEAP_CLASS_MAX_LEN / HEAP_CLASS_UNIT ) + 1U ] =
+{
+    0, 0, 0, 1, 2, 3, 3, 4, 4,
+    5, 5, 5, 5, 6, 6, 6, 6,
+    7, 7, 7, 7, 7, 7, 7, 7,
+    8, 8, 8, 8, 8, 8, 8, 8
+};
+
+static FreeBlock_t * pxFreeList[ HEAP_CLASS_COUNT ] = { NULL };
+static size_t uxCached[ HEAP_CLASS_COUNT ] = { 0 };
+static uint32_t ulHits[ HEAP_CLASS_COUNT ] = { 0 };
+static uint32_t ulMisses[ HEAP_CLASS_COUNT ] = { 0 };
+static size_t uxCachedBytes = 0;
+static uint32_t ulFlushes = 0;
+static uint32_t ulAllocFailures = 0;
+static size_t uxLastFailedLen = 0;
+
+#if HEAP_ACCOUNTING == 1
+static HeapTagStats_t xTagStats = { 0 };
+#endif /* HEAP_ACCOUNTING == 1 */
+
+static const char * const pcTagNames[ HEAP_TAG_COUNT ] =
+{
+    "other",
+    "tls",
+    "lwip",
+    "kvstore",
+    "ota",
+    "mqtt"
+};
+
+void * pvPortMalloc( size_t xWantedSize );
+void * pvPortCalloc( size_t xNum,
+                     size_t xSize );
+void vPortFree( void * pv );
+
+/*-----------------------------------------------------------*/
+
+/* Usable length of a heap_4 block, including the prefix */
+static inline size_t uxBlockLen( void * pvBlock )
+{
+    return malloc_usable_size( ( uint8_t * ) pvBlock + HEAP_BLOCK_PREFIX_LEN ) + HEAP_BLOCK_PREFIX_LEN;
+}
+
+/*-----------------------------------------------------------*/
+
+/* Largest class a block of uxLen usable bytes can serve without wasting more than the heap_4 slack */
+static size_t uxClassOfBlock( size_t uxLen )
+{
+    size_t uxClass = HEAP_CLASS_COUNT;
+
+    for( size_t uxIdx = HEAP_CLASS_COUNT; uxIdx > 0; uxIdx-- )
+    {
+        if( uxLen >= uxClassLen[ uxIdx - 1U ] )
+        {
+            if( ( uxLen - uxClassLen[ uxIdx - 1U ] ) < HEAP_CLASS_SLACK )
+            {
+                uxClass = uxIdx - 1U;
+            }
+
+            break;
+        }
+    }
+
+    return uxClass;
+}
+
+/*-----------------------------------------------------------*/
+
+static void * pvClassMalloc( size_t xWantedSize )
+{
+    void * pvBlock = NULL;
+
+    if( ( xWantedSize > 0 ) &&
+        ( xWantedSize <= HEAP_CLASS_MAX_LEN ) )
+    {
+        size_t uxClass = ucClassOfUnits[ ( xWantedSize + HEAP_CLASS_UNIT - 1U ) / HEAP_CLASS_UNIT ];
+        FreeBlock_t * pxBlock = NULL;
+
+        taskENTER_CRITICAL();
+
+        pxBlock = pxFreeList[ uxClass ];
+
+        if( pxBlock != NULL )
+        {
+            pxFreeList[ uxClass ] = pxBlock->pxNext;
+            uxCached[ uxClass ]--;
+            uxCachedBytes -= uxBlockLen( pxBlock );
+            ulHits[ uxClass ]++;
+        }
+        else
+        {
+            ulMisses[ uxClass ]++;
+        }
+
+        taskEXIT_CRITICAL();
+
+        pvBlock = pxBlock;
+
+        /* Allocate the full class so the block can be cached when freed */
+        xWantedSize = uxClassLen[ uxClass ];
+    }
+
+    if( pvBlock == NULL )
+    {
+        pvBlock = pvHeap4Malloc( xWantedSize );
+
+        if( ( pvBlock == NULL ) &&
+            ( uxCachedBytes > 0 ) )
+        {
+            vHeapClassFlush();
+            pvBlock = pvHeap4Malloc( xWantedSize );
+        }
+
+        if( ( pvBlock == NULL ) &&
+            ( xWantedSize > 0 ) )
+        {
+            taskENTER_CRITICAL();
+            ulAllocFailures++;
+            uxLastFailedLen = xWantedSize;
+            taskEXIT_CRITICAL();
+        }
+    }
+
+    return pvBlock;
+}
+
+/*-----------------------------------------------------------*/
+
+static void vClassFree( void * pv )
+{
+    BaseType_t xCached = pdFALSE;
+
+    if( pv != NULL )
+    {
+        size_t uxLen = uxBlockLen( pv );
+        size_t uxClass = uxClassOfBlock( uxLen );
+
+        if( uxClass < HEAP_CLASS_COUNT )
+        {
+            taskENTER_CRITICAL();
+
+            if( ( uxCached[ uxClass ] < HEAP_CLASS_CACHE_MAX ) &&
+                ( ( uxCachedBytes + uxLen ) <= HEAP_CLASS_CACHE_MAX_BYTES ) )
+            {
+                ( ( FreeBlock_t * ) pv )->pxNext = pxFreeList[ uxClass ];
+                pxFreeList[ uxClass ] = ( FreeBlock_t * ) pv;
+                uxCached[ uxClass ]++;
+                uxCachedBytes += uxLen;
+                xCached = pdTRUE;
+            }
+
+            taskEXIT_CRITICAL();
+        }
+    }
+
+    if( xCached == pdFALSE )
+    {
+        vHeap4Free( pv );
+    }
+}
+
+/*-----------------------------------------------------------*/
+
+/* Tag of the calling task, HEAP_TAG_OTHER before the scheduler starts */
+static HeapTag_t xCurrentTag( void )
+{
+    HeapTag_t xTag = HEAP_TAG_OTHER;
+
+#if HEAP_ACCOUNTING == 1
+    if( xTaskGetSchedulerState() != taskSCHEDULER_NOT_STARTED )
+    {
+        xTag = ( HeapTag_t ) ( uintptr_t ) pvTaskGetThreadLocalStoragePointer( NULL, HEAP_TAG_TLS_INDEX );
+    }
+#endif /* HEAP_ACCOUNTING == 1 */
+
+    return xTag;
+}
+
+/*-----------------------------------------------------------*/
+
+void * pvHeapMallocTagged( size_t xWantedSize,
+                           HeapTag_t xTag )
+{
+    void * pvBlock = NULL;
+
+    configASSERT( xTag < HEAP_TAG_COUNT );
+
+#if HEAP_ACCOUNTING == 1
+    BlockPrefix_t * pxPrefix = NULL;
+
+    if( ( xWantedSize > 0 ) &&
+        ( xWantedSize <= ( UINT32_MAX - HEAP_BLOCK_PREFIX_LEN ) ) )
+    {
+        pxPrefix = pvClassMalloc( xWantedSize + HEAP_BLOCK_PREFIX_LEN );
+    }
+
+    if( pxPrefix != NULL )
+    {
+        pxPrefix->ulLen = ( uint32_t ) xWantedSize;
+        pxPrefix->ucTag = ( uint8_t ) xTag;
+
+        taskENTER_CRITICAL();
+
+        xTagStats.uxCurrentBytes[ xTag ] += xWantedSize;
+        xTagStats.ulAllocs[ xTag ]++;
+
+        if( xTagStats.uxCurrentBytes[ xTag ] > xTagStats.uxPeakBytes[ xTag ] )
+        {
+            xTagStats.uxPeakBytes[ xTag ] = xTagStats.uxCurrentBytes[ xTag ];
+        }
+
+        taskEXIT_CRITICAL();
+
+        pvBlock = &( pxPrefix[ 1 ] );
+    }
+#else
+    pvBlock = pvClassMalloc( xWantedSize );
+#endif /* HEAP_ACCOUNTING == 1 */
+
+    return pvBlock;
+}
+
+/*-----------------------------------------------------------*/
+
+void * pvPortMalloc( size_t xWantedSize )
+{
+    return pvHeapMallocTagged( xWantedSize, xCurrentTag() );
+}
+
+/*-----------------------------------------------------------*/
+
+void * pvPortCalloc( size_t xNum,
+                     size_t xSize )
+{
+    void * pvBlock = NULL;
+
+    if( ( xSize == 0 ) ||
+        ( xNum <= ( SIZE_MAX / xSize ) ) )
+    {
+        pvBlock = pvPortMalloc( xNum * xSize );
+    }
+
+    if( pvBlock != NULL )
+    {
+        ( void ) memset( pvBlock, 0, xNum * xSize );
+    }
+
+    return pvBlock;
+}
+
+/*-----------------------------------------------------------*/
+
+void vPortFree( void * pv )
+{
+#if HEAP_ACCOUNTING == 1
+    if( pv != NULL )
+    {
+        BlockPrefix_t * pxPrefix = &( ( ( BlockPrefix_t * ) pv )[ -1 ] );
+        HeapTag_t xTag = ( HeapTag_t ) pxPrefix->ucTag;
+
+        configASSERT( xTag < HEAP_TAG_COUNT );
+
+        taskENTER_CRITICAL();
+
+        xTagStats.uxCurrentBytes[ xTag ] -= pxPrefix->ulLen;
+        xTagStats.ulFrees[ xTag ]++;
+
+        taskEXIT_CRITICAL();
+
+        pv = pxPrefix;
+    }
+#endif /* HEAP_ACCOUNTING == 1 */
+
+    vClassFree( pv );
+}
+
+/*-----------------------------------------------------------*/
+
+HeapTag_t xHeapTagSet( HeapTag_t xTag )
+{
+    HeapTag_t xPrevious = xCurrentTag();
+
+    configASSERT( xTag < HEAP_TAG_COUNT );
+
+#if HEAP_ACCOUNTING == 1
+    if( xTaskGetSchedulerState() != taskSCHEDULER_NOT_STARTED )
+    {
+        vTaskSetThreadLocalStoragePointer( NULL, HEAP_TAG_TLS_INDEX, ( void * ) ( uintptr_t ) xTag );
+    }
+#endif /* HEAP_ACCOUNTING == 1 */
+
+    return xPrevious;
+}
+
+/*-----------------------------------------------------------*/
+
+void vHeapTagSetTask( TaskHandle_t xTask,
+                      HeapTag_t xTag )
+{
+    configASSERT( xTag < HEAP_TAG_COUNT );
+
+#if HEAP_ACCOUNTING == 1
+    if( xTask != NULL )
+    {
+        vTaskSetThreadLocalStoragePointer( xTask, HEAP_TAG_TLS_INDEX, ( void * ) ( uintptr_t ) xTag );
+    }
+#else
+    ( void ) xTask;
+#endif /* HEAP_ACCOUNTING == 1 */
+}
+
+/*-----------------------------------------------------------*/
+
+BaseType_t xHeapTagGetStats( HeapTagStats_t * pxStats )
+{
+    BaseType_t xEnabled = pdFALSE;
+
+    configASSERT( pxStats != NULL );
+
+#if HEAP_ACCOUNTING == 1
+    taskENTER_CRITICAL();
+    *pxStats = xTagStats;
+    taskEXIT_CRITICAL();
+
+    xEnabled = pdTRUE;
+#else
+    ( void ) memset( pxStats, 0, sizeof( HeapTagStats_t ) );
+#endif /* HEAP_ACCOUNTING == 1 */
+
+    return xEnabled;
+}
+
+/*-----------------------------------------------------------*/
+
+const char * pcHeapTagName( HeapTag_t xTag )
+{
+    return ( xTag < HEAP_TAG_COUNT ) ? pcTagNames[ xTag ] : "invalid";
+}
+
+/*-----------------------------------------------------------*/
+
+void vHeapClassFlush( void )
+{
+    for( size_t uxClass = 0; uxClass < HEAP_CLASS_COUNT; uxClass++ )
+    {
+        FreeBlock_t * pxBlock = NULL;
+
+        taskENTER_CRITICAL();
+
+        pxBlock = pxFreeList[ uxClass ];
+        pxFreeList[ uxClass ] = NULL;
+        uxCached[ uxClass ] = 0;
+
+        taskEXIT_CRITICAL();
+
+        while( pxBlock != NULL )
+        {
+            FreeBlock_t * pxNext = pxBlock->pxNext;
+            size_t uxLen = uxBlockLen( pxBlock );
+
+            vHeap4Free( pxBlock );
+
+            taskENTER_CRITICAL();
+            uxCachedBytes -= uxLen;
+            taskEXIT_CRITICAL();
+
+            pxBlock = pxNext;
+        }
+    }
+
+    taskENTER_CRITICAL();
+    ulFlushes++;
+    taskEXIT_CRITICAL();
+}
+
+/*-----------------------------------------------------------*/
+
+void vHeapClassGetStats( HeapClassStats_t * pxStats )
+{
+    configASSERT( pxStats != NULL );
+
+    taskENTER_CRITICAL();
+
+    for( size_t uxClass = 0; uxClass < HEAP_CLASS_COUNT; uxClass++ )
+    {
+        pxStats->uxBlockLen[ uxClass ] = uxClassLen[ uxClass ];
+        pxStats->uxCached[ uxClass ] = uxCached[ uxClass ];
+        pxStats->ulHits[ uxClass ] = ulHits[ uxClass ];
+        pxStats->ulMisses[ uxClass ] = ulMisses[ uxClass ];
+    }
+
+    pxStats->uxCachedBytes = uxCachedBytes;
+    pxStats->ulFlushes = ulFlushes;
+
+    taskEXIT_CRITICAL();
+}
+
+/*-----------------------------------------------------------*/
+
+void vHeapGetFragStats( HeapFragStats_t * pxStats )
+{
+    HeapStats_t xHeapStats = { 0 };
+
+    configASSERT( pxStats != NULL );
+
+    vPortGetHeapStats( &xHeapStats );
+
+    pxStats->uxFreeBytes = xHeapStats.xAvailableHeapSpaceInBytes;
+    pxStats->uxLargestFreeBlock = xHeapStats.xSizeOfLargestFreeBlockInBytes;
+    pxStats->uxSmallestFreeBlock = xHeapStats.xSizeOfSmallestFreeBlockInBytes;
+    pxStats->uxFreeBlocks = xHeapStats.xNumberOfFreeBlocks;
+    pxStats->uxMinEverFreeBytes = xHeapStats.xMinimumEverFreeBytesRemaining;
+
+    taskENTER_CRITICAL();
+    pxStats->uxCachedBytes = uxCachedBytes;
+    pxStats->ulAllocFailures = ulAllocFailures;
+    pxStats->uxLastFailedLen = uxLastFailedLen;
+    taskEXIT_CRITICAL();
+
+    pxStats->ulFragPermille = 0;
+
+    if( pxStats->uxFreeBytes > 0 )
+    {
+        pxStats->ulFragPermille = ( uint32_t ) ( 1000U - ( uint32_t ) ( ( ( uint64_t ) pxStats->uxLargestFreeBlock * 1000U ) / pxStats->uxFreeBytes ) );
+    }
+}
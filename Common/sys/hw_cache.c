@@ -0,0 +1,105 @@
+/*
+ * FreeRTOS STM32 Reference Integration
+ *
+ * Copyright (c) 2022 Amazon.com, Inc. or its affiliates. All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#include "logging_levels.h"
+#define LOG_LEVEL    LOG_ERROR
+#define LOG_MODULE    LOG_MODULE_SYS
+#include "logging.h"
+
+#include "FreeRTOS.h"
+#include "hw_defs.h"
+#include "hw_cache.h"
+
+/*-----------------------------------------------------------*/
+
+BaseType_t xCacheRangeIsCached( const void * pvBuffer,
+                                size_t uxLen )
+{
+    uint32_t ulStart = ( uint32_t ) pvBuffer;
+
+    return( ( pxHndlDCache != NULL ) &&
+            ( uxLen > 0 ) &&
+            ( ulStart < HW_CACHE_REGION_END ) &&
+            ( ( ulStart + uxLen ) > HW_CACHE_REGION_START ) );
+}
+
+/*-----------------------------------------------------------*/
+
+BaseType_t xCacheCleanRange( const void * pvBuffer,
+                             size_t uxLen )
+{
+    HAL_StatusTypeDef xHalStatus = HAL_OK;
+
+    if( xCacheRangeIsCached( pvBuffer, uxLen ) )
+    {
+        uint32_t ulStart = HW_CACHE_ALIGN_DOWN( pvBuffer );
+        uint32_t ulEnd = HW_CACHE_ALIGN_UP( ( uint32_t ) pvBuffer + uxLen );
+
+        xHalStatus = HAL_DCACHE_CleanByAddr( pxHndlDCache, ( uint32_t * ) ulStart, ulEnd - ulStart );
+    }
+
+    return( xHalStatus == HAL_OK );
+}
+
+/*-----------------------------------------------------------*/
+
+BaseType_t xCacheInvalidateRange( void * pvBuffer,
+                                  size_t uxLen )
+{
+    HAL_StatusTypeDef xHalStatus = HAL_OK;
+
+    if( !xCacheRangeIsCached( pvBuffer, uxLen ) )
+    {
+        xHalStatus = HAL_OK;
+    }
+    else if( !xCacheRangeIsAligned( pvBuffer, uxLen ) )
+    {
+        LogError( "Refusing to invalidate unaligned range 0x%08lx, length: %lu.",
+                  ( uint32_t ) pvBuffer, ( uint32_t ) uxLen );
+        xHalStatus = HAL_ERROR;
+    }
+    else
+    {
+        xHalStatus = HAL_DCACHE_InvalidateByAddr( pxHndlDCache, ( uint32_t * ) pvBuffer, uxLen );
+    }
+
+    return( xHalStatus == HAL_OK );
+}
+
+/*-----------------------------------------------------------*/
+
+BaseType_t xCacheCleanInvalidateRange( void * pvBuffer,
+                                       size_t uxLen )
+{
+    HAL_StatusTypeDef xHalStatus = HAL_OK;
+
+    if( xCacheRangeIsCached( pvBuffer, uxLen ) )
+    {
+        uint32_t ulStart = HW_CACHE_ALIGN_DOWN( pvBuffer );
+        uint32_t ulEnd = HW_CACHE_ALIGN_UP( ( uint32_t ) pvBuffer + uxLen );
+
+        xHalStatus = HAL_DCACHE_CleanInvalidByAddr( pxHndlDCache, ( uint32_t * ) ulStart, ulEnd - ulStart );
+    }
+
+    return( xHalStatus == HAL_OK );
+}
@@ -28,9 +28,33 @@
 #include "FreeRTOS.h"
 #include "task.h"
 #include "hw_defs.h"
+#include "ram_sections.h"
 
-static GPIOInterruptCallback_t volatile xGpioCallbacks[ 16 ] = { NULL };
-static void * volatile xGpioCallbackContext[ 16 ] = { NULL };
+#ifndef GPIO_EXTI_DEFER_TASK_PRIORITY
+#define GPIO_EXTI_DEFER_TASK_PRIORITY    40
+#endif
+
+#ifndef GPIO_EXTI_DEFER_TASK_STACK
+#define GPIO_EXTI_DEFER_TASK_STACK       512
+#endif
+
+#define GPIO_EXTI_NUM_LINES              16
+
+/* Dispatch table indexed by EXTI line */
+typedef struct GpioExtiLine
+{
+    GPIOInterruptCallback_t volatile xCallback;
+    void * volatile pvContext;
+    volatile BaseType_t xDeferred;
+    volatile uint32_t ulEdges;
+    volatile uint32_t ulCoalesced;
+} GpioExtiLine_t;
+
+static GpioExtiLine_t xExtiLines[ GPIO_EXTI_NUM_LINES ] = { 0 };
+
+/* Lines with a deferred callback waiting for xExtiDeferTask */
+static volatile uint32_t ulExtiDeferPending = 0;
+static TaskHandle_t xExtiDeferTask = NULL;
 
 void NMI_Handler( void )
 {
@@ -132,31 +156,117 @@ void DebugMon_Handler( void )
     __NOP();
 }
 
+/*
+ * Acknowledge an EXTI line and dispatch its callback, in place of HAL_GPIO_EXTI_IRQHandler
+ * and HAL_GPIO_EXTI_Rising_Callback. Only rising edges are dispatched, falling edges are
+ * cleared.
+ */
+static inline void prvExtiIrq( uint32_t ulLine )
+{
+    uint32_t ulMask = ( 1UL << ulLine );
+    GpioExtiLine_t * pxLine = &( xExtiLines[ ulLine ] );
+
+    EXTI->FPR1 = ulMask;
+
+    if( ( EXTI->RPR1 & ulMask ) != 0 )
+    {
+        EXTI->RPR1 = ulMask;
+
+        pxLine->ulEdges++;
+
+        if( pxLine->xCallback == NULL )
+        {
+            /* Nothing registered */
+        }
+        else if( pxLine->xDeferred == pdFALSE )
+        {
+            pxLine->xCallback( pxLine->pvContext );
+        }
+        else if( ( ulExtiDeferPending & ulMask ) != 0 )
+        {
+            /* The task has not run the callback for the previous edge yet */
+            pxLine->ulCoalesced++;
+        }
+        else
+        {
+            BaseType_t xHigherPriorityTaskWoken = pdFALSE;
+
+            ulExtiDeferPending |= ulMask;
+
+            vTaskNotifyGiveFromISR( xExtiDeferTask, &xHigherPriorityTaskWoken );
+            portYIELD_FROM_ISR( xHigherPriorityTaskWoken );
+        }
+    }
+}
+
 /* STM32U5xx Peripheral Interrupt Handlers */
-void EXTI14_IRQHandler( void )
+RAM_FUNC void EXTI11_IRQHandler( void )
 {
-    HAL_GPIO_EXTI_IRQHandler( GPIO_PIN_14 );
+    TRACE_ISR_ENTER();
+    prvExtiIrq( 11 );
+    TRACE_ISR_EXIT();
 }
 
-void EXTI15_IRQHandler( void )
+RAM_FUNC void EXTI14_IRQHandler( void )
 {
-    HAL_GPIO_EXTI_IRQHandler( GPIO_PIN_15 );
+    TRACE_ISR_ENTER();
+    prvExtiIrq( 14 );
+    TRACE_ISR_EXIT();
 }
 
-void GPDMA1_Channel4_IRQHandler( void )
+RAM_FUNC void EXTI15_IRQHandler( void )
 {
+    TRACE_ISR_ENTER();
+    prvExtiIrq( 15 );
+    TRACE_ISR_EXIT();
+}
+
+RAM_FUNC void GPDMA1_Channel4_IRQHandler( void )
+{
+    TRACE_ISR_ENTER();
+
     if( pxHndlGpdmaCh4 != NULL )
     {
         HAL_DMA_IRQHandler( pxHndlGpdmaCh4 );
     }
+
+    TRACE_ISR_EXIT();
 }
 
-void GPDMA1_Channel5_IRQHandler( void )
+RAM_FUNC void GPDMA1_Channel5_IRQHandler( void )
 {
+    TRACE_ISR_ENTER();
+
     if( pxHndlGpdmaCh5 != NULL )
     {
         HAL_DMA_IRQHandler( pxHndlGpdmaCh5 );
     }
+
+    TRACE_ISR_EXIT();
+}
+
+void GPDMA1_Channel6_IRQHandler( void )
+{
+    if( pxHndlGpdmaCh6 != NULL )
+    {
+        HAL_DMA_IRQHandler( pxHndlGpdmaCh6 );
+    }
+}
+
+void I2C2_EV_IRQHandler( void )
+{
+    if( pxHndlI2c2 != NULL )
+    {
+        HAL_I2C_EV_IRQHandler( pxHndlI2c2 );
+    }
+}
+
+void I2C2_ER_IRQHandler( void )
+{
+    if( pxHndlI2c2 != NULL )
+    {
+        HAL_I2C_ER_IRQHandler( pxHndlI2c2 );
+    }
 }
 
 /* Handle TIM6 interrupt for STM32 HAL time base. */
@@ -165,17 +275,21 @@ void TIM6_IRQHandler( void )
 /*    HAL_TIM_IRQHandler(&htim6); */
 }
 
-void SPI2_IRQHandler( void )
+RAM_FUNC void SPI2_IRQHandler( void )
 {
+    TRACE_ISR_ENTER();
+
     if( pxHndlSpi2 )
     {
         HAL_SPI_IRQHandler( pxHndlSpi2 );
     }
+
+    TRACE_ISR_EXIT();
 }
 
 extern void SysTick_Handler( void );
 
-void _SysTick_Handler( void )
+RAM_FUNC void _SysTick_Handler( void )
 {
     /* Clear overflow flag */
     SysTick->CTRL;
@@ -196,8 +310,56 @@ void HAL_TIM_PeriodElapsedCallback( TIM_HandleTypeDef * htim )
 /*	} */
 }
 
+/* Runs the deferred callbacks of the lines pending since its last wake up */
+static void vExtiDeferTask( void * pvParameters )
+{
+    ( void ) pvParameters;
+
+    for( ; ; )
+    {
+        uint32_t ulPending;
+
+        ( void ) ulTaskNotifyTake( pdTRUE, portMAX_DELAY );
+
+        taskENTER_CRITICAL();
+        ulPending = ulExtiDeferPending;
+        ulExtiDeferPending = 0;
+        taskEXIT_CRITICAL();
+
+        while( ulPending != 0 )
+        {
+            uint32_t ulLine = POSITION_VAL( ulPending );
+            GPIOInterruptCallback_t xCallback = xExtiLines[ ulLine ].xCallback;
+
+            ulPending &= ~( 1UL << ulLine );
+
+            if( xCallback != NULL )
+            {
+                xCallback( xExtiLines[ ulLine ].pvContext );
+            }
+        }
+    }
+}
+
+static void prvExtiRegister( uint16_t usGpioPinMask,
+                             GPIOInterruptCallback_t pvCallback,
+                             void * pvContext,
+                             BaseType_t xDeferred )
+{
+    uint32_t ulIndex = POSITION_VAL( usGpioPinMask );
+
+    configASSERT( ulIndex < GPIO_EXTI_NUM_LINES );
+
+    taskENTER_CRITICAL();
+    xExtiLines[ ulIndex ].xCallback = pvCallback;
+    xExtiLines[ ulIndex ].pvContext = pvContext;
+    xExtiLines[ ulIndex ].xDeferred = xDeferred;
+    taskEXIT_CRITICAL();
+}
+
 /*
  * @brief Register a callback function for a given gpio.
+ * The callback runs in the EXTI interrupt, on every rising edge.
  * @param usGpioPinMask The target gpio pin's bitmask
  * @param pvCallback Callback function pointer
  * @param pvContext User provided context pointer
@@ -205,17 +367,52 @@ void HAL_TIM_PeriodElapsedCallback( TIM_HandleTypeDef * htim )
 void GPIO_EXTI_Register_Callback( uint16_t usGpioPinMask,
                                   GPIOInterruptCallback_t pvCallback,
                                   void * pvContext )
+{
+    prvExtiRegister( usGpioPinMask, pvCallback, pvContext, pdFALSE );
+}
+
+/*
+ * @brief Register a callback function for a given gpio, run by a task.
+ * Edges arriving before the task has run the callback for the previous one are coalesced.
+ * @param usGpioPinMask The target gpio pin's bitmask
+ * @param pvCallback Callback function pointer
+ * @param pvContext User provided context pointer
+ */
+void GPIO_EXTI_Register_Deferred_Callback( uint16_t usGpioPinMask,
+                                           GPIOInterruptCallback_t pvCallback,
+                                           void * pvContext )
+{
+    /* Registrations are made by the init code of the drivers, from task context */
+    if( xExtiDeferTask == NULL )
+    {
+        BaseType_t xResult = xTaskCreate( vExtiDeferTask, "extiDefer", GPIO_EXTI_DEFER_TASK_STACK,
+                                          NULL, GPIO_EXTI_DEFER_TASK_PRIORITY, &xExtiDeferTask );
+
+        configASSERT( xResult == pdPASS );
+    }
+
+    prvExtiRegister( usGpioPinMask, pvCallback, pvContext, pdTRUE );
+}
+
+/*
+ * @brief Get the edge counters of a gpio.
+ * @param usGpioPinMask The target gpio pin's bitmask
+ * @param pxStats Filled with the counters
+ */
+void GPIO_EXTI_Get_Stats( uint16_t usGpioPinMask,
+                          GPIOInterruptStats_t * pxStats )
 {
     uint32_t ulIndex = POSITION_VAL( usGpioPinMask );
 
-    configASSERT( ulIndex < 16 );
+    configASSERT( ulIndex < GPIO_EXTI_NUM_LINES );
+    configASSERT( pxStats != NULL );
 
-    xGpioCallbacks[ ulIndex ] = pvCallback;
-    xGpioCallbackContext[ ulIndex ] = pvContext;
+    pxStats->ulEdges = xExtiLines[ ulIndex ].ulEdges;
+    pxStats->ulCoalesced = xExtiLines[ ulIndex ].ulCoalesced;
 }
 
 /**
- * @brief  EXTI line rising detection callback.
+ * @brief  EXTI line falling detection callback.
  * @param  GPIO_Pin: Specifies the port pin connected to corresponding EXTI line.
  * @retval None
  */
@@ -225,7 +422,7 @@ void HAL_GPIO_EXTI_Falling_Callback( uint16_t usGpioPinMask )
 }
 
 /**
- * @brief  EXTI line rising detection callback.
+ * @brief  EXTI line rising detection callback, for lines still handled by HAL_GPIO_EXTI_IRQHandler.
  * @param  GPIO_Pin: Specifies the port pin connected to corresponding EXTI line.
  * @retval None
  */
@@ -233,8 +430,8 @@ void HAL_GPIO_EXTI_Rising_Callback( uint16_t usGpioPinMask )
 {
     uint32_t ulIndex = POSITION_VAL( usGpioPinMask );
 
-    if( xGpioCallbacks[ ulIndex ] != NULL )
+    if( xExtiLines[ ulIndex ].xCallback != NULL )
     {
-        ( *( xGpioCallbacks[ ulIndex ] ) )( xGpioCallbackContext[ ulIndex ] );
+        ( *( xExtiLines[ ulIndex ].xCallback ) )( xExtiLines[ ulIndex ].pvContext );
     }
 }
@@ -0,0 +1,376 @@
+/*
+ * FreeRTOS STM32 Reference Integration
+ *
+ * Copyright (c) 2022 Amazon.com, Inc. or its affiliates. All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#include "logging_levels.h"
+
+#define LOG_LEVEL     LOG_INFO
+#define LOG_MODULE    LOG_MODULE_SYS
+
+#include "logging.h"
+
+#include "FreeRTOS.h"
+#include "task.h"
+
+#include "hw_defs.h"
+#include "low_power.h"
+#include "dvfs.h"
+
+#if LOW_POWER_ENABLED == 1
+
+/* LPTIM1 counts LSE / 4: 122 us resolution, wraps after 8 s */
+#define LOW_POWER_LPTIM_HZ           ( LSE_VALUE / 4U )
+#define LOW_POWER_LPTIM_MASK         ( 0xFFFFU )
+
+#if ( ( LOW_POWER_MAX_SLEEP_MS * LOW_POWER_LPTIM_HZ ) / 1000U ) >= LOW_POWER_LPTIM_MASK
+#error "LOW_POWER_MAX_SLEEP_MS exceeds the LPTIM1 range"
+#endif
+
+/* The console RX pin, PA10, as a wake source from Stop 2 */
+#define LOW_POWER_CONSOLE_RX_LINE    ( 1UL << 10 )
+
+static volatile uint32_t ulStopInhibit = 0;
+static volatile TickType_t xConsoleActiveAt = 0;
+static BaseType_t xLptimRunning = pdFALSE;
+static LowPowerStats_t xStats = { 0 };
+
+/*-----------------------------------------------------------*/
+
+void vLowPowerInit( void )
+{
+    /* The LSE takes up to a second to start. Tickless idle begins once it is ready. */
+    HAL_PWR_EnableBkUpAccess();
+    __HAL_RCC_LSE_CONFIG( RCC_LSE_ON );
+
+    /* Nothing here enters Standby, but a supervisor cutting the power may have */
+    if( ( PWR->SR & PWR_SR_SBF ) != 0 )
+    {
+        xStats.ulStandbyWakes = 1;
+        PWR->SR = PWR_SR_CSSF;
+    }
+
+    /* Route PA10 to EXTI line 10, falling edge on a start bit. Unmasked only while in Stop 2. */
+    EXTI->EXTICR[ 2 ] &= ~( EXTI_EXTICR3_EXTI10 );
+    EXTI->FTSR1 |= LOW_POWER_CONSOLE_RX_LINE;
+    EXTI->IMR1 &= ~LOW_POWER_CONSOLE_RX_LINE;
+
+    HAL_NVIC_SetPriority( EXTI10_IRQn, 5, 0 );
+    HAL_NVIC_EnableIRQ( EXTI10_IRQn );
+
+    /* Keep the debug connection alive in Stop 2 when a debugger is attached */
+    if( ( CoreDebug->DHCSR & CoreDebug_DHCSR_C_DEBUGEN_Msk ) != 0 )
+    {
+        HAL_DBGMCU_EnableDBGStopMode();
+    }
+}
+
+/*-----------------------------------------------------------*/
+
+/* Start LPTIM1 free running once the LSE is ready. PRE: interrupts disabled */
+static BaseType_t prvLptimStart( void )
+{
+    if( ( xLptimRunning == pdFALSE ) &&
+        ( ( RCC->BDCR & RCC_BDCR_LSERDY ) != 0 ) )
+    {
+        __HAL_RCC_LPTIM1_CONFIG( RCC_LPTIM1CLKSOURCE_LSE );
+        __HAL_RCC_LPTIM1_CLK_ENABLE();
+        __HAL_RCC_LPTIM1_CLKAM_ENABLE();
+
+        LPTIM1->CFGR = LPTIM_CFGR_PRESC_1;
+        LPTIM1->CCMR1 = LPTIM_CCMR1_CC1E;
+        LPTIM1->CR = LPTIM_CR_ENABLE;
+
+        /* Registers written while enabled take a couple of LPTIM clock cycles to apply */
+        LPTIM1->DIER = LPTIM_DIER_CC1IE;
+
+        while( ( LPTIM1->ISR & LPTIM_ISR_DIEROK ) == 0 )
+        {
+        }
+
+        LPTIM1->ICR = LPTIM_ICR_DIEROKCF;
+        LPTIM1->ARR = LOW_POWER_LPTIM_MASK;
+
+        while( ( LPTIM1->ISR & LPTIM_ISR_ARROK ) == 0 )
+        {
+        }
+
+        LPTIM1->ICR = LPTIM_ICR_ARROKCF;
+        LPTIM1->CR |= LPTIM_CR_CNTSTRT;
+
+        HAL_NVIC_SetPriority( LPTIM1_IRQn, 5, 0 );
+        HAL_NVIC_EnableIRQ( LPTIM1_IRQn );
+
+        xLptimRunning = pdTRUE;
+    }
+
+    return xLptimRunning;
+}
+
+/*-----------------------------------------------------------*/
+
+/* The counter runs from another clock, read it until two reads agree */
+static uint32_t prvLptimRead( void )
+{
+    uint32_t ulCount;
+
+    do
+    {
+        ulCount = LPTIM1->CNT;
+    } while( ulCount != LPTIM1->CNT );
+
+    return ulCount;
+}
+
+/*-----------------------------------------------------------*/
+
+static void prvLptimSetWake( uint32_t ulCount )
+{
+    LPTIM1->CCR1 = ulCount & LOW_POWER_LPTIM_MASK;
+
+    while( ( LPTIM1->ISR & LPTIM_ISR_CMP1OK ) == 0 )
+    {
+    }
+
+    LPTIM1->ICR = LPTIM_ICR_CMP1OKCF | LPTIM_ICR_CC1CF;
+}
+
+/*-----------------------------------------------------------*/
+
+void LPTIM1_IRQHandler( void )
+{
+    /* Only used to wake the core, the time slept is read from the counter */
+    LPTIM1->ICR = LPTIM_ICR_CC1CF;
+}
+
+void EXTI10_IRQHandler( void )
+{
+    EXTI->FPR1 = LOW_POWER_CONSOLE_RX_LINE;
+}
+
+/*-----------------------------------------------------------*/
+
+void vLowPowerStopInhibit( uint32_t ulClient )
+{
+    UBaseType_t uxSavedInterruptStatus = taskENTER_CRITICAL_FROM_ISR();
+
+    ulStopInhibit |= ulClient;
+
+    taskEXIT_CRITICAL_FROM_ISR( uxSavedInterruptStatus );
+}
+
+void vLowPowerStopAllow( uint32_t ulClient )
+{
+    UBaseType_t uxSavedInterruptStatus = taskENTER_CRITICAL_FROM_ISR();
+
+    ulStopInhibit &= ~ulClient;
+
+    taskEXIT_CRITICAL_FROM_ISR( uxSavedInterruptStatus );
+}
+
+void vLowPowerConsoleActivity( void )
+{
+    xConsoleActiveAt = xTaskGetTickCountFromISR();
+}
+
+/*-----------------------------------------------------------*/
+
+void vLowPowerGetStats( LowPowerStats_t * pxStats )
+{
+    configASSERT( pxStats != NULL );
+
+    taskENTER_CRITICAL();
+    *pxStats = xStats;
+    taskEXIT_CRITICAL();
+}
+
+/*-----------------------------------------------------------*/
+
+/* PRE: interrupts disabled */
+static BaseType_t prvStopAllowed( uint32_t ulSleepTicks )
+{
+    BaseType_t xAllowed = pdTRUE;
+
+    if( ( ulSleepTicks < pdMS_TO_TICKS( LOW_POWER_STOP_MIN_MS ) ) ||
+        ( ulStopInhibit != 0 ) ||
+        ( ( xTaskGetTickCount() - xConsoleActiveAt ) < pdMS_TO_TICKS( LOW_POWER_CONSOLE_AWAKE_MS ) ) )
+    {
+        xAllowed = pdFALSE;
+    }
+
+    /* The console transmit shift register must be empty, USART1 stops in Stop 2 */
+    if( ( USART1->ISR & USART_ISR_TC ) == 0 )
+    {
+        xAllowed = pdFALSE;
+    }
+
+    /* GPDMA1 stops in Stop 2, so no transfer may be in flight */
+    for( uint32_t i = 0; ( i < 16 ) && ( xAllowed == pdTRUE ); i++ )
+    {
+        const DMA_Channel_TypeDef * pxChannel =
+            ( const DMA_Channel_TypeDef * ) ( GPDMA1_Channel0_BASE + ( i * ( GPDMA1_Channel1_BASE - GPDMA1_Channel0_BASE ) ) );
+
+        if( ( pxChannel->CCR & DMA_CCR_EN ) != 0 )
+        {
+            xAllowed = pdFALSE;
+        }
+    }
+
+    return xAllowed;
+}
+
+/*-----------------------------------------------------------*/
+
+/* Enter Stop 2 and restore the system clock on wake. PRE: interrupts disabled */
+static void prvEnterStop2( void )
+{
+    EXTI->FPR1 = LOW_POWER_CONSOLE_RX_LINE;
+    EXTI->IMR1 |= LOW_POWER_CONSOLE_RX_LINE;
+
+    HAL_PWREx_EnterSTOP2Mode( PWR_STOPENTRY_WFI );
+
+    /* The core wakes up running from MSI with the PLL off */
+    vDvfsRestoreClock();
+
+    EXTI->IMR1 &= ~LOW_POWER_CONSOLE_RX_LINE;
+
+    if( ( EXTI->FPR1 & LOW_POWER_CONSOLE_RX_LINE ) != 0 )
+    {
+        EXTI->FPR1 = LOW_POWER_CONSOLE_RX_LINE;
+        NVIC_ClearPendingIRQ( EXTI10_IRQn );
+        vLowPowerConsoleActivity();
+    }
+}
+
+/*-----------------------------------------------------------*/
+
+/*
+ * Times are kept in units of 1 / ( configTICK_RATE_HZ * LOW_POWER_LPTIM_HZ ) s,
+ * so that one tick is LOW_POWER_LPTIM_HZ units and one LPTIM count is
+ * configTICK_RATE_HZ units, and the part of a tick already elapsed when SysTick
+ * is stopped is carried over to the tick that follows the sleep.
+ */
+void vLowPowerSuppressTicksAndSleep( uint32_t ulExpectedIdleTicks )
+{
+    uint32_t ulSleepTicks = ulExpectedIdleTicks;
+
+    if( ulSleepTicks > pdMS_TO_TICKS( LOW_POWER_MAX_SLEEP_MS ) )
+    {
+        ulSleepTicks = pdMS_TO_TICKS( LOW_POWER_MAX_SLEEP_MS );
+    }
+
+    __disable_irq();
+    __DSB();
+    __ISB();
+
+    if( ( prvLptimStart() == pdTRUE ) &&
+        ( eTaskConfirmSleepModeStatus() != eAbortSleep ) )
+    {
+        const uint32_t ulSysTickLoad = SysTick->LOAD;
+        uint32_t ulStart;
+        uint32_t ulPartial;
+
+        SysTick->CTRL &= ~SysTick_CTRL_ENABLE_Msk;
+
+        if( ( SCB->ICSR & SCB_ICSR_PENDSTSET_Msk ) != 0 )
+        {
+            /* A tick is already pending, let the kernel process it first */
+            SysTick->CTRL |= SysTick_CTRL_ENABLE_Msk;
+        }
+        else
+        {
+            BaseType_t xStop = prvStopAllowed( ulSleepTicks );
+            uint32_t ulWakeCounts;
+            uint32_t ulUnits;
+            uint32_t ulTicks;
+            uint32_t ulReload;
+
+            ulStart = prvLptimRead();
+            ulPartial = ( ( ulSysTickLoad - SysTick->VAL ) * LOW_POWER_LPTIM_HZ ) / ( ulSysTickLoad + 1 );
+
+            /* Rounded down, so the wake never comes after the expected tick */
+            ulWakeCounts = ( ( ulSleepTicks * LOW_POWER_LPTIM_HZ ) - ulPartial ) / configTICK_RATE_HZ;
+
+            if( ulWakeCounts == 0 )
+            {
+                ulWakeCounts = 1;
+            }
+
+            prvLptimSetWake( ulStart + ulWakeCounts );
+
+            if( xStop == pdTRUE )
+            {
+                prvEnterStop2();
+            }
+            else
+            {
+                __DSB();
+                __WFI();
+                __ISB();
+            }
+
+            ulUnits = ( ( ( prvLptimRead() - ulStart ) & LOW_POWER_LPTIM_MASK ) * configTICK_RATE_HZ ) + ulPartial;
+            ulTicks = ulUnits / LOW_POWER_LPTIM_HZ;
+            ulUnits = ulUnits % LOW_POWER_LPTIM_HZ;
+
+            /* Waking up from Stop 2 may take the count past the expected tick */
+            if( ulTicks > ulSleepTicks )
+            {
+                ulTicks = ulSleepTicks;
+                ulUnits = 0;
+            }
+
+            /* Restart SysTick for the rest of the current tick, then at the normal period */
+            ulReload = ( ( LOW_POWER_LPTIM_HZ - ulUnits ) * ( ulSysTickLoad + 1 ) ) / LOW_POWER_LPTIM_HZ;
+
+            if( ulReload < 2 )
+            {
+                ulReload = 2;
+            }
+
+            SysTick->CTRL &= ~SysTick_CTRL_ENABLE_Msk;
+            SCB->ICSR = SCB_ICSR_PENDSTCLR_Msk;
+            SysTick->LOAD = ulReload - 1;
+            SysTick->VAL = 0;
+            SysTick->CTRL |= SysTick_CTRL_ENABLE_Msk;
+            SysTick->LOAD = ulSysTickLoad;
+
+            /* The HAL tick runs from SysTick at the same rate as the kernel tick */
+            uwTick += ulTicks;
+            vTaskStepTick( ulTicks );
+
+            if( xStop == pdTRUE )
+            {
+                xStats.ulStopCount++;
+                xStats.ulStopMs += ulTicks;
+            }
+            else
+            {
+                xStats.ulSleepCount++;
+                xStats.ulSleepMs += ulTicks;
+            }
+        }
+    }
+
+    __enable_irq();
+}
+
+#endif /* LOW_POWER_ENABLED == 1 */
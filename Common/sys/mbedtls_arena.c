@@ -0,0 +1,425 @@
+/*
+ * FreeRTOS STM32 Reference Integration
+ *
+ * Copyright (c) 2022 Amazon.com, Inc. or its affiliates. All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+/**
+ * @file mbedtls_arena.c
+ * @brief Per connection memory arenas for mbedtls allocations.
+ */
+
+#include "logging_levels.h"
+#define LOG_LEVEL    LOG_ERROR
+#define LOG_MODULE    LOG_MODULE_SYS
+#include "logging.h"
+
+#include <string.h>
+
+#include "FreeRTOS.h"
+#include "task.h"
+
+#include "mbedtls_arena.h"
+#include "mbedtls_freertos_port.h"
+
+/* Thread local storage pointer holding the arena selected for a task. Index 0 belongs to lwIP. */
+#ifndef MBEDTLS_ARENA_TLS_INDEX
+#define MBEDTLS_ARENA_TLS_INDEX      1
+#endif
+
+/* Maximum number of arenas in existence at the same time */
+#ifndef MBEDTLS_ARENA_MAX
+#define MBEDTLS_ARENA_MAX            4
+#endif
+
+/* Number of blocks in each of the 32, 64, 128 and 256 byte pools */
+#ifndef MBEDTLS_ARENA_POOL_BLOCKS
+#define MBEDTLS_ARENA_POOL_BLOCKS    16
+#endif
+
+#if MBEDTLS_ARENA_TLS_INDEX >= configNUM_THREAD_LOCAL_STORAGE_POINTERS
+#error "MBEDTLS_ARENA_TLS_INDEX must be less than configNUM_THREAD_LOCAL_STORAGE_POINTERS"
+#endif
+
+#if ( MBEDTLS_ARENA_POOL_BLOCKS < 1 ) || ( MBEDTLS_ARENA_POOL_BLOCKS > 32 )
+#error "MBEDTLS_ARENA_POOL_BLOCKS must be between 1 and 32"
+#endif
+
+#define ARENA_ALIGN              8U
+#define ARENA_ROUND_UP( x )    ( ( ( x ) + ( ARENA_ALIGN - 1U ) ) & ~( ( size_t ) ARENA_ALIGN - 1U ) )
+
+#define ARENA_NUM_CLASSES        4U
+#define ARENA_POOL_LEN           ( ( 32U + 64U + 128U + 256U ) * MBEDTLS_ARENA_POOL_BLOCKS )
+
+#if MBEDTLS_ARENA_POOL_BLOCKS == 32
+#define ARENA_POOL_ALL_FREE      0xFFFFFFFFUL
+#else
+#define ARENA_POOL_ALL_FREE      ( ( 1UL << MBEDTLS_ARENA_POOL_BLOCKS ) - 1UL )
+#endif
+
+/* Precedes every allocation from the bump region */
+typedef struct BumpHeader
+{
+    size_t uxLen;
+    size_t uxReserved;
+} BumpHeader_t;
+
+struct MbedtlsArena
+{
+    uint8_t * pucPool[ ARENA_NUM_CLASSES ];
+    uint32_t ulPoolFree[ ARENA_NUM_CLASSES ]; /* Bit n is set while block n is free */
+    size_t uxPoolBlocksUsed;
+
+    uint8_t * pucBumpStart;
+    uint8_t * pucBumpNext;
+    uint8_t * pucBumpEnd;
+    size_t uxBumpLive; /* Allocations from the bump region not freed yet */
+    size_t uxBumpHighWater;
+
+    uint32_t ulFallbacks;
+    BaseType_t xDeletePending;
+};
+
+static const size_t uxClassLen[ ARENA_NUM_CLASSES ] = { 32U, 64U, 128U, 256U };
+
+/* Every arena that may still own allocations, used to find the owner of a freed block */
+static MbedtlsArena_t * pxArenas[ MBEDTLS_ARENA_MAX ] = { NULL };
+
+/*-----------------------------------------------------------*/
+
+/* Must be called from a critical section */
+static BaseType_t xArenaIsIdle( const MbedtlsArena_t * pxArena )
+{
+    return ( ( pxArena->uxPoolBlocksUsed == 0 ) &&
+             ( pxArena->uxBumpLive == 0 ) ) ? pdTRUE : pdFALSE;
+}
+
+/*-----------------------------------------------------------*/
+
+/* Must be called from a critical section */
+static void vArenaUnregister( const MbedtlsArena_t * pxArena )
+{
+    for( size_t uxIdx = 0; uxIdx < MBEDTLS_ARENA_MAX; uxIdx++ )
+    {
+        if( pxArenas[ uxIdx ] == pxArena )
+        {
+            pxArenas[ uxIdx ] = NULL;
+        }
+    }
+}
+
+/*-----------------------------------------------------------*/
+
+MbedtlsArena_t * pxMbedtlsArenaCreate( size_t uxLen )
+{
+    MbedtlsArena_t * pxArena = NULL;
+    size_t uxHeaderLen = ARENA_ROUND_UP( sizeof( MbedtlsArena_t ) );
+    BaseType_t xRegistered = pdFALSE;
+
+    uxLen = ARENA_ROUND_UP( uxLen );
+
+    if( uxLen <= ARENA_POOL_LEN )
+    {
+        LogError( "Arena length %lu does not exceed the %lu bytes of pools.",
+                  uxLen, ARENA_POOL_LEN );
+    }
+    else
+    {
+        pxArena = ( MbedtlsArena_t * ) pvPortMalloc( uxHeaderLen + uxLen );
+    }
+
+    if( pxArena != NULL )
+    {
+        uint8_t * pucNext = ( ( uint8_t * ) pxArena ) + uxHeaderLen;
+
+        ( void ) memset( pxArena, 0, uxHeaderLen + uxLen );
+
+        for( size_t uxClass = 0; uxClass < ARENA_NUM_CLASSES; uxClass++ )
+        {
+            pxArena->pucPool[ uxClass ] = pucNext;
+            pxArena->ulPoolFree[ uxClass ] = ARENA_POOL_ALL_FREE;
+            pucNext += uxClassLen[ uxClass ] * MBEDTLS_ARENA_POOL_BLOCKS;
+        }
+
+        pxArena->pucBumpStart = pucNext;
+        pxArena->pucBumpNext = pucNext;
+        pxArena->pucBumpEnd = ( ( uint8_t * ) pxArena ) + uxHeaderLen + uxLen;
+
+        taskENTER_CRITICAL();
+
+        for( size_t uxIdx = 0; uxIdx < MBEDTLS_ARENA_MAX; uxIdx++ )
+        {
+            if( pxArenas[ uxIdx ] == NULL )
+            {
+                pxArenas[ uxIdx ] = pxArena;
+                xRegistered = pdTRUE;
+                break;
+            }
+        }
+
+        taskEXIT_CRITICAL();
+
+        if( xRegistered == pdFALSE )
+        {
+            LogError( "All %d arenas are in use.", MBEDTLS_ARENA_MAX );
+            vPortFree( pxArena );
+            pxArena = NULL;
+        }
+    }
+
+    return pxArena;
+}
+
+/*-----------------------------------------------------------*/
+
+void vMbedtlsArenaDelete( MbedtlsArena_t * pxArena )
+{
+    BaseType_t xFreeNow = pdFALSE;
+
+    if( pxArena != NULL )
+    {
+        if( pvTaskGetThreadLocalStoragePointer( NULL, MBEDTLS_ARENA_TLS_INDEX ) == pxArena )
+        {
+            vTaskSetThreadLocalStoragePointer( NULL, MBEDTLS_ARENA_TLS_INDEX, NULL );
+        }
+
+        taskENTER_CRITICAL();
+
+        if( xArenaIsIdle( pxArena ) == pdTRUE )
+        {
+            vArenaUnregister( pxArena );
+            xFreeNow = pdTRUE;
+        }
+        else
+        {
+            /* Released by the last xMbedtlsArenaFree */
+            pxArena->xDeletePending = pdTRUE;
+        }
+
+        taskEXIT_CRITICAL();
+    }
+
+    if( xFreeNow == pdTRUE )
+    {
+        vPortFree( pxArena );
+    }
+}
+
+/*-----------------------------------------------------------*/
+
+MbedtlsArena_t * pxMbedtlsArenaSelect( MbedtlsArena_t * pxArena )
+{
+    MbedtlsArena_t * pxPrevious = pvTaskGetThreadLocalStoragePointer( NULL, MBEDTLS_ARENA_TLS_INDEX );
+
+    vTaskSetThreadLocalStoragePointer( NULL, MBEDTLS_ARENA_TLS_INDEX, pxArena );
+
+    return pxPrevious;
+}
+
+/*-----------------------------------------------------------*/
+
+void * pvMbedtlsArenaCalloc( size_t uxLen )
+{
+    MbedtlsArena_t * pxArena = NULL;
+    void * pvBlock = NULL;
+
+    if( xTaskGetSchedulerState() != taskSCHEDULER_NOT_STARTED )
+    {
+        pxArena = pvTaskGetThreadLocalStoragePointer( NULL, MBEDTLS_ARENA_TLS_INDEX );
+    }
+
+    if( ( pxArena != NULL ) &&
+        ( uxLen > 0 ) )
+    {
+        taskENTER_CRITICAL();
+
+        if( pxArena->xDeletePending == pdFALSE )
+        {
+            /* The smallest pool with a free block that fits */
+            for( size_t uxClass = 0; ( pvBlock == NULL ) && ( uxClass < ARENA_NUM_CLASSES ); uxClass++ )
+            {
+                if( ( uxLen <= uxClassLen[ uxClass ] ) &&
+                    ( pxArena->ulPoolFree[ uxClass ] != 0 ) )
+                {
+                    uint32_t ulBlock = ( uint32_t ) __builtin_ctz( pxArena->ulPoolFree[ uxClass ] );
+
+                    pxArena->ulPoolFree[ uxClass ] &= ~( 1UL << ulBlock );
+                    pxArena->uxPoolBlocksUsed++;
+                    pvBlock = pxArena->pucPool[ uxClass ] + ( ulBlock * uxClassLen[ uxClass ] );
+                }
+            }
+
+            if( pvBlock == NULL )
+            {
+                size_t uxBlockLen = ARENA_ROUND_UP( uxLen );
+
+                if( ( uxBlockLen >= uxLen ) &&
+                    ( ( size_t ) ( pxArena->pucBumpEnd - pxArena->pucBumpNext ) >= ( sizeof( BumpHeader_t ) + uxBlockLen ) ) )
+                {
+                    BumpHeader_t * pxHeader = ( BumpHeader_t * ) pxArena->pucBumpNext;
+                    size_t uxUsed = 0;
+
+                    pxHeader->uxLen = uxBlockLen;
+                    pvBlock = &( pxHeader[ 1 ] );
+
+                    pxArena->pucBumpNext += sizeof( BumpHeader_t ) + uxBlockLen;
+                    pxArena->uxBumpLive++;
+
+                    uxUsed = ( size_t ) ( pxArena->pucBumpNext - pxArena->pucBumpStart );
+
+                    if( uxUsed > pxArena->uxBumpHighWater )
+                    {
+                        pxArena->uxBumpHighWater = uxUsed;
+                    }
+                }
+            }
+
+            if( pvBlock == NULL )
+            {
+                pxArena->ulFallbacks++;
+            }
+        }
+
+        taskEXIT_CRITICAL();
+    }
+
+    if( pvBlock != NULL )
+    {
+        ( void ) memset( pvBlock, 0, uxLen );
+    }
+
+    return pvBlock;
+}
+
+/*-----------------------------------------------------------*/
+
+BaseType_t xMbedtlsArenaFree( void * pv )
+{
+    MbedtlsArena_t * pxArena = NULL;
+    uint8_t * pucBlock = ( uint8_t * ) pv;
+    BaseType_t xFreeArena = pdFALSE;
+
+    if( pucBlock != NULL )
+    {
+        taskENTER_CRITICAL();
+
+        for( size_t uxIdx = 0; uxIdx < MBEDTLS_ARENA_MAX; uxIdx++ )
+        {
+            if( ( pxArenas[ uxIdx ] != NULL ) &&
+                ( pucBlock >= pxArenas[ uxIdx ]->pucPool[ 0 ] ) &&
+                ( pucBlock < pxArenas[ uxIdx ]->pucBumpEnd ) )
+            {
+                pxArena = pxArenas[ uxIdx ];
+                break;
+            }
+        }
+
+        taskEXIT_CRITICAL();
+    }
+
+    if( ( pxArena != NULL ) &&
+        ( pucBlock < pxArena->pucBumpStart ) )
+    {
+        size_t uxClass = ARENA_NUM_CLASSES - 1U;
+
+        while( pucBlock < pxArena->pucPool[ uxClass ] )
+        {
+            uxClass--;
+        }
+
+        uint32_t ulBlock = ( uint32_t ) ( ( size_t ) ( pucBlock - pxArena->pucPool[ uxClass ] ) / uxClassLen[ uxClass ] );
+
+        /* The block is still allocated, so the arena stays valid until it is released */
+        mbedtls_platform_wipe( pucBlock, uxClassLen[ uxClass ] );
+
+        taskENTER_CRITICAL();
+
+        configASSERT( ( pxArena->ulPoolFree[ uxClass ] & ( 1UL << ulBlock ) ) == 0 );
+
+        pxArena->ulPoolFree[ uxClass ] |= ( 1UL << ulBlock );
+        pxArena->uxPoolBlocksUsed--;
+
+        if( ( pxArena->xDeletePending == pdTRUE ) &&
+            ( xArenaIsIdle( pxArena ) == pdTRUE ) )
+        {
+            vArenaUnregister( pxArena );
+            xFreeArena = pdTRUE;
+        }
+
+        taskEXIT_CRITICAL();
+    }
+    else if( pxArena != NULL )
+    {
+        BumpHeader_t * pxHeader = &( ( ( BumpHeader_t * ) pucBlock )[ -1 ] );
+
+        mbedtls_platform_wipe( pucBlock, pxHeader->uxLen );
+
+        taskENTER_CRITICAL();
+
+        configASSERT( pxArena->uxBumpLive > 0 );
+
+        pxArena->uxBumpLive--;
+
+        /* Everything allocated since the region was last empty is gone */
+        if( pxArena->uxBumpLive == 0 )
+        {
+            pxArena->pucBumpNext = pxArena->pucBumpStart;
+        }
+
+        if( ( pxArena->xDeletePending == pdTRUE ) &&
+            ( xArenaIsIdle( pxArena ) == pdTRUE ) )
+        {
+            vArenaUnregister( pxArena );
+            xFreeArena = pdTRUE;
+        }
+
+        taskEXIT_CRITICAL();
+    }
+    else
+    {
+        /* Empty */
+    }
+
+    if( xFreeArena == pdTRUE )
+    {
+        vPortFree( pxArena );
+    }
+
+    return ( pxArena != NULL ) ? pdTRUE : pdFALSE;
+}
+
+/*-----------------------------------------------------------*/
+
+void vMbedtlsArenaGetStats( const MbedtlsArena_t * pxArena,
+                            MbedtlsArenaStats_t * pxStats )
+{
+    configASSERT( pxArena != NULL );
+    configASSERT( pxStats != NULL );
+
+    taskENTER_CRITICAL();
+
+    pxStats->uxLen = ( size_t ) ( pxArena->pucBumpEnd - pxArena->pucPool[ 0 ] );
+    pxStats->uxPoolBlocksUsed = pxArena->uxPoolBlocksUsed;
+    pxStats->uxBumpUsed = ( size_t ) ( pxArena->pucBumpNext - pxArena->pucBumpStart );
+    pxStats->uxBumpHighWater = pxArena->uxBumpHighWater;
+    pxStats->ulFallbacks = pxArena->ulFallbacks;
+
+    taskEXIT_CRITICAL();
+}
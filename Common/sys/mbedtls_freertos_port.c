@@ -41,6 +41,56 @@
 #include "mbedtls/entropy.h"
 
 #include "mbedtls_freertos_port.h"
+#include "mbedtls_arena.h"
+#include "heap_classes.h"
+
+/*
+ * Freed blocks up to this length are wiped. mbedtls zeroizes its larger secret
+ * bearing allocations itself before freeing them (record buffers, handshake
+ * parameters, transforms and sessions), and the remaining large blocks hold
+ * public data such as parsed certificates. Set to SIZE_MAX to wipe every block.
+ */
+#ifndef MBEDTLS_PLATFORM_WIPE_MAX_LEN
+#define MBEDTLS_PLATFORM_WIPE_MAX_LEN    1024U
+#endif
+
+/*-----------------------------------------------------------*/
+
+void mbedtls_platform_wipe( void * pvBuffer,
+                            size_t uxLen )
+{
+    volatile uint32_t * pulWord = ( volatile uint32_t * ) pvBuffer;
+    volatile uint8_t * pucByte = NULL;
+
+    configASSERT( ( ( uintptr_t ) pvBuffer & ( sizeof( uint32_t ) - 1U ) ) == 0 );
+
+    /* Volatile stores are not elided by the compiler, unlike a memset before free */
+    while( uxLen >= ( 4U * sizeof( uint32_t ) ) )
+    {
+        pulWord[ 0 ] = 0;
+        pulWord[ 1 ] = 0;
+        pulWord[ 2 ] = 0;
+        pulWord[ 3 ] = 0;
+        pulWord += 4;
+        uxLen -= 4U * sizeof( uint32_t );
+    }
+
+    while( uxLen >= sizeof( uint32_t ) )
+    {
+        *pulWord = 0;
+        pulWord++;
+        uxLen -= sizeof( uint32_t );
+    }
+
+    pucByte = ( volatile uint8_t * ) pulWord;
+
+    while( uxLen > 0 )
+    {
+        *pucByte = 0;
+        pucByte++;
+        uxLen--;
+    }
+}
 
 /*-----------------------------------------------------------*/
 
@@ -64,11 +114,17 @@ void * mbedtls_platform_calloc( size_t nmemb,
         /* Overflow check. */
         if( ( totalSize / size ) == nmemb )
         {
-            pBuffer = pvPortMalloc( totalSize );
+            /* Served from the arena of the calling task, if one is selected */
+            pBuffer = pvMbedtlsArenaCalloc( totalSize );
 
-            if( pBuffer != NULL )
+            if( pBuffer == NULL )
             {
-                explicit_bzero( pBuffer, totalSize );
+                pBuffer = pvHeapMallocTagged( totalSize, HEAP_TAG_TLS );
+
+                if( pBuffer != NULL )
+                {
+                    mbedtls_platform_wipe( pBuffer, totalSize );
+                }
             }
         }
     }
@@ -85,11 +141,21 @@ void * mbedtls_platform_calloc( size_t nmemb,
  */
 void mbedtls_platform_free( void * ptr )
 {
-    size_t xBlockLen = malloc_usable_size( ptr );
+    size_t xBlockLen = 0;
+
+    /* Arena blocks are zeroized and released by the arena */
+    if( xMbedtlsArenaFree( ptr ) == pdFALSE )
+    {
+        xBlockLen = malloc_usable_size( ptr );
+    }
 
     if( xBlockLen > 0 )
     {
-        explicit_bzero( ptr, xBlockLen );
+        if( xBlockLen <= MBEDTLS_PLATFORM_WIPE_MAX_LEN )
+        {
+            mbedtls_platform_wipe( ptr, xBlockLen );
+        }
+
         vPortFree( ptr );
     }
 }
@@ -0,0 +1,261 @@
+/*
+ * FreeRTOS STM32 Reference Integration
+ *
+ * Copyright (c) 2022 Amazon.com, Inc. or its affiliates. All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+/**
+ * @file mem_ops.c
+ * @brief Link time replacements of memcpy, memset and memcmp, see mem_ops.h.
+ *
+ * The loops must not be turned back into calls of the functions they
+ * implement, hence the no-tree-loop-distribute-patterns attribute.
+ */
+
+#include "FreeRTOS.h"
+
+#include "stm32u5xx.h"
+
+#include "mem_ops.h"
+
+#if MEM_OPS_ENABLED == 1
+
+#if MEM_OPS_DMA_ENABLED == 1
+#include "dma_copy.h"
+#endif
+
+#define MEM_OPS_NO_LIBCALL    __attribute__( ( optimize( "no-tree-loop-distribute-patterns" ) ) )
+
+/* Below this length the alignment prologue costs more than it saves */
+#define MEM_OPS_SMALL_LEN     16U
+
+#define MEM_OPS_IS_ALIGNED( x )    ( ( ( uintptr_t ) ( x ) & 0x3U ) == 0U )
+
+/*-----------------------------------------------------------*/
+
+MEM_OPS_NO_LIBCALL void * pvMemOpsCopyCpu( void * pvDst,
+                                           const void * pvSrc,
+                                           size_t uxLen )
+{
+    uint8_t * pucDst = ( uint8_t * ) pvDst;
+    const uint8_t * pucSrc = ( const uint8_t * ) pvSrc;
+
+    if( uxLen >= MEM_OPS_SMALL_LEN )
+    {
+        while( !MEM_OPS_IS_ALIGNED( pucDst ) )
+        {
+            *pucDst++ = *pucSrc++;
+            uxLen--;
+        }
+
+        uint32_t * pulDst = ( uint32_t * ) pucDst;
+
+        if( MEM_OPS_IS_ALIGNED( pucSrc ) )
+        {
+            const uint32_t * pulSrc = ( const uint32_t * ) pucSrc;
+
+            /* Eight registers per iteration, which the compiler turns into LDM and STM */
+            while( uxLen >= 32U )
+            {
+                uint32_t ul0 = pulSrc[ 0 ];
+                uint32_t ul1 = pulSrc[ 1 ];
+                uint32_t ul2 = pulSrc[ 2 ];
+                uint32_t ul3 = pulSrc[ 3 ];
+                uint32_t ul4 = pulSrc[ 4 ];
+                uint32_t ul5 = pulSrc[ 5 ];
+                uint32_t ul6 = pulSrc[ 6 ];
+                uint32_t ul7 = pulSrc[ 7 ];
+
+                pulDst[ 0 ] = ul0;
+                pulDst[ 1 ] = ul1;
+                pulDst[ 2 ] = ul2;
+                pulDst[ 3 ] = ul3;
+                pulDst[ 4 ] = ul4;
+                pulDst[ 5 ] = ul5;
+                pulDst[ 6 ] = ul6;
+                pulDst[ 7 ] = ul7;
+
+                pulSrc += 8;
+                pulDst += 8;
+                uxLen -= 32U;
+            }
+
+            while( uxLen >= 4U )
+            {
+                *pulDst++ = *pulSrc++;
+                uxLen -= 4U;
+            }
+
+            pucSrc = ( const uint8_t * ) pulSrc;
+        }
+        else
+        {
+            /* The M33 handles unaligned single loads in hardware, at one extra cycle at most */
+            while( uxLen >= 16U )
+            {
+                uint32_t ul0 = __UNALIGNED_UINT32_READ( pucSrc );
+                uint32_t ul1 = __UNALIGNED_UINT32_READ( pucSrc + 4 );
+                uint32_t ul2 = __UNALIGNED_UINT32_READ( pucSrc + 8 );
+                uint32_t ul3 = __UNALIGNED_UINT32_READ( pucSrc + 12 );
+
+                pulDst[ 0 ] = ul0;
+                pulDst[ 1 ] = ul1;
+                pulDst[ 2 ] = ul2;
+                pulDst[ 3 ] = ul3;
+
+                pucSrc += 16;
+                pulDst += 4;
+                uxLen -= 16U;
+            }
+
+            while( uxLen >= 4U )
+            {
+                *pulDst++ = __UNALIGNED_UINT32_READ( pucSrc );
+                pucSrc += 4;
+                uxLen -= 4U;
+            }
+        }
+
+        pucDst = ( uint8_t * ) pulDst;
+    }
+
+    while( uxLen > 0U )
+    {
+        *pucDst++ = *pucSrc++;
+        uxLen--;
+    }
+
+    return pvDst;
+}
+
+/*-----------------------------------------------------------*/
+
+MEM_OPS_NO_LIBCALL void * __wrap_memset( void * pvDst,
+                                         int lValue,
+                                         size_t uxLen )
+{
+    uint8_t * pucDst = ( uint8_t * ) pvDst;
+    uint8_t ucValue = ( uint8_t ) lValue;
+
+    if( uxLen >= MEM_OPS_SMALL_LEN )
+    {
+        uint32_t ulValue = ucValue * 0x01010101UL;
+
+        while( !MEM_OPS_IS_ALIGNED( pucDst ) )
+        {
+            *pucDst++ = ucValue;
+            uxLen--;
+        }
+
+        uint32_t * pulDst = ( uint32_t * ) pucDst;
+
+        while( uxLen >= 32U )
+        {
+            pulDst[ 0 ] = ulValue;
+            pulDst[ 1 ] = ulValue;
+            pulDst[ 2 ] = ulValue;
+            pulDst[ 3 ] = ulValue;
+            pulDst[ 4 ] = ulValue;
+            pulDst[ 5 ] = ulValue;
+            pulDst[ 6 ] = ulValue;
+            pulDst[ 7 ] = ulValue;
+
+            pulDst += 8;
+            uxLen -= 32U;
+        }
+
+        while( uxLen >= 4U )
+        {
+            *pulDst++ = ulValue;
+            uxLen -= 4U;
+        }
+
+        pucDst = ( uint8_t * ) pulDst;
+    }
+
+    while( uxLen > 0U )
+    {
+        *pucDst++ = ucValue;
+        uxLen--;
+    }
+
+    return pvDst;
+}
+
+/*-----------------------------------------------------------*/
+
+MEM_OPS_NO_LIBCALL int __wrap_memcmp( const void * pvBuf1,
+                                      const void * pvBuf2,
+                                      size_t uxLen )
+{
+    const uint8_t * pucBuf1 = ( const uint8_t * ) pvBuf1;
+    const uint8_t * pucBuf2 = ( const uint8_t * ) pvBuf2;
+    int lResult = 0;
+
+    if( uxLen >= MEM_OPS_SMALL_LEN )
+    {
+        while( !MEM_OPS_IS_ALIGNED( pucBuf1 ) && ( *pucBuf1 == *pucBuf2 ) )
+        {
+            pucBuf1++;
+            pucBuf2++;
+            uxLen--;
+        }
+
+        /* Stops at the first word that differs, which the byte loop below resolves */
+        if( MEM_OPS_IS_ALIGNED( pucBuf1 ) )
+        {
+            while( ( uxLen >= 4U ) &&
+                   ( *( const uint32_t * ) pucBuf1 == __UNALIGNED_UINT32_READ( pucBuf2 ) ) )
+            {
+                pucBuf1 += 4;
+                pucBuf2 += 4;
+                uxLen -= 4U;
+            }
+        }
+    }
+
+    while( ( uxLen > 0U ) && ( lResult == 0 ) )
+    {
+        lResult = ( int ) *pucBuf1++ - ( int ) *pucBuf2++;
+        uxLen--;
+    }
+
+    return lResult;
+}
+
+/*-----------------------------------------------------------*/
+
+/*-----------------------------------------------------------*/
+
+void * __wrap_memcpy( void * pvDst,
+                      const void * pvSrc,
+                      size_t uxLen )
+{
+#if MEM_OPS_DMA_ENABLED == 1
+    if( uxLen >= MEM_OPS_DMA_MIN_LEN )
+    {
+        return pvDmaCopy( pvDst, pvSrc, uxLen );
+    }
+#endif
+
+    return pvMemOpsCopyCpu( pvDst, pvSrc, uxLen );
+}
+
+#endif /* MEM_OPS_ENABLED == 1 */
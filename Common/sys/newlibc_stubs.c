@@ -30,6 +30,8 @@
 #include <malloc.h>
 #include <string.h>
 
+#include "heap_classes.h"
+
 /* copied from heap_4.c */
 typedef struct A_BLOCK_LINK
 {
@@ -82,12 +84,13 @@ size_t malloc_usable_size( void * pvPtr )
 
     if( pvPtr != NULL )
     {
-        configASSERT( ( uintptr_t ) pvPtr > xHeapStructSize );
-        puc = ( uint8_t * ) pvPtr - xHeapStructSize;
+        configASSERT( ( uintptr_t ) pvPtr > ( xHeapStructSize + HEAP_BLOCK_PREFIX_LEN ) );
+        puc = ( uint8_t * ) pvPtr - HEAP_BLOCK_PREFIX_LEN - xHeapStructSize;
 
         pxLink = ( void * ) puc;
 
-        xLen = ( SIZE_MASK & pxLink->xBlockSize ) - xHeapStructSize;
+        /* Exclude the heap_4 header and the accounting prefix of heap_classes.c */
+        xLen = ( SIZE_MASK & pxLink->xBlockSize ) - xHeapStructSize - HEAP_BLOCK_PREFIX_LEN;
         configASSERT( xLen >= 0 );
     }
 
@@ -0,0 +1,256 @@
+/*
+ * FreeRTOS STM32 Reference Integration
+ *
+ * Copyright (c) 2022 Amazon.com, Inc. or its affiliates. All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#include "logging_levels.h"
+
+#define LOG_LEVEL     LOG_INFO
+#define LOG_MODULE    LOG_MODULE_SYS
+
+#include "logging.h"
+
+#include <string.h>
+
+#include "FreeRTOS.h"
+#include "task.h"
+
+#include "power_stats.h"
+#include "low_power.h"
+#include "dvfs.h"
+
+#if POWER_STATS_ENABLED == 1
+
+/* Window of the operations of one kind in flight, guarded by critical sections */
+typedef struct PowerOpWindow
+{
+    uint32_t ulInFlight;
+    TickType_t xStartTick;
+    uint32_t ulStartWakes;
+    uint64_t ullStartEnergyUj;
+} PowerOpWindow_t;
+
+static PowerRadioState_t xRadioState = POWER_RADIO_DOWN;
+static TickType_t xRadioSince = 0;
+static uint32_t pulRadioMs[ POWER_RADIO_COUNT ] = { 0 };
+
+static PowerOpWindow_t pxOpWindows[ POWER_OP_COUNT ] = { 0 };
+static PowerOpStats_t pxOpStats[ POWER_OP_COUNT ] = { 0 };
+
+static const char * const pcStateNames[ POWER_STATE_COUNT ] = { "run", "sleep", "stop 2", "standby" };
+static const char * const pcRadioNames[ POWER_RADIO_COUNT ] = { "down", "active", "power save" };
+static const char * const pcOpNames[ POWER_OP_COUNT ] = { "publish", "ota" };
+
+/*-----------------------------------------------------------*/
+
+const char * pcPowerStatsStateName( PowerState_t xState )
+{
+    return ( xState < POWER_STATE_COUNT ) ? pcStateNames[ xState ] : "invalid";
+}
+
+const char * pcPowerStatsRadioName( PowerRadioState_t xState )
+{
+    return ( xState < POWER_RADIO_COUNT ) ? pcRadioNames[ xState ] : "invalid";
+}
+
+const char * pcPowerStatsOpName( PowerOp_t xOp )
+{
+    return ( xOp < POWER_OP_COUNT ) ? pcOpNames[ xOp ] : "invalid";
+}
+
+/*-----------------------------------------------------------*/
+
+static uint64_t prvEnergyUj( const PowerStats_t * pxStats )
+{
+    /* Charge in uA * ms, times mV gives pJ */
+    uint64_t ullCharge = 0;
+    uint32_t ulRunLowMs = pxStats->pulStateMs[ POWER_STATE_RUN ] - pxStats->ulRunHighMs;
+
+    ullCharge += ( uint64_t ) pxStats->ulRunHighMs * POWER_RUN_HIGH_UA;
+    ullCharge += ( uint64_t ) ulRunLowMs * POWER_RUN_LOW_UA;
+    ullCharge += ( uint64_t ) pxStats->pulStateMs[ POWER_STATE_SLEEP ] * POWER_SLEEP_UA;
+    ullCharge += ( uint64_t ) pxStats->pulStateMs[ POWER_STATE_STOP2 ] * POWER_STOP2_UA;
+    ullCharge += ( uint64_t ) pxStats->pulStateMs[ POWER_STATE_STANDBY ] * POWER_STANDBY_UA;
+    ullCharge += ( uint64_t ) pxStats->pulRadioMs[ POWER_RADIO_DOWN ] * POWER_RADIO_DOWN_UA;
+    ullCharge += ( uint64_t ) pxStats->pulRadioMs[ POWER_RADIO_ACTIVE ] * POWER_RADIO_ACTIVE_UA;
+    ullCharge += ( uint64_t ) pxStats->pulRadioMs[ POWER_RADIO_PS ] * POWER_RADIO_PS_UA;
+
+    return ( ullCharge * POWER_SUPPLY_MV ) / 1000000ULL;
+}
+
+/*-----------------------------------------------------------*/
+
+/* Residency and energy since boot, without the operations. PRE: in a critical section */
+static void prvSample( PowerStats_t * pxStats )
+{
+    TickType_t xNow = xTaskGetTickCount();
+    uint32_t ulUptimeMs = pdTICKS_TO_MS( xNow );
+    uint32_t ulIdleMs = 0;
+
+    ( void ) memset( pxStats, 0, sizeof( PowerStats_t ) );
+
+#if LOW_POWER_ENABLED == 1
+    {
+        LowPowerStats_t xLowPower;
+
+        vLowPowerGetStats( &xLowPower );
+
+        pxStats->pulStateMs[ POWER_STATE_SLEEP ] = xLowPower.ulSleepMs;
+        pxStats->pulStateMs[ POWER_STATE_STOP2 ] = xLowPower.ulStopMs;
+        pxStats->ulWakes = xLowPower.ulSleepCount + xLowPower.ulStopCount;
+        pxStats->ulStandbyWakes = xLowPower.ulStandbyWakes;
+        ulIdleMs = xLowPower.ulSleepMs + xLowPower.ulStopMs;
+    }
+#endif /* LOW_POWER_ENABLED == 1 */
+
+    pxStats->pulStateMs[ POWER_STATE_RUN ] = ( ulUptimeMs > ulIdleMs ) ? ( ulUptimeMs - ulIdleMs ) : 0;
+    pxStats->ulRunHighMs = pxStats->pulStateMs[ POWER_STATE_RUN ];
+
+#if DVFS_ENABLED == 1
+    {
+        DvfsStats_t xDvfs;
+        uint32_t ulLevelMs;
+
+        vDvfsGetStats( &xDvfs );
+        ulLevelMs = xDvfs.ulHighMs + xDvfs.ulLowMs;
+
+        /* The DVFS times include the time asleep, assume it was spread evenly over both levels */
+        if( ulLevelMs > 0 )
+        {
+            pxStats->ulRunHighMs = ( uint32_t ) ( ( ( uint64_t ) pxStats->ulRunHighMs * xDvfs.ulHighMs ) / ulLevelMs );
+        }
+    }
+#endif /* DVFS_ENABLED == 1 */
+
+    for( uint32_t i = 0; i < POWER_RADIO_COUNT; i++ )
+    {
+        pxStats->pulRadioMs[ i ] = pulRadioMs[ i ];
+    }
+
+    pxStats->pulRadioMs[ xRadioState ] += pdTICKS_TO_MS( xNow - xRadioSince );
+
+    pxStats->ullEnergyUj = prvEnergyUj( pxStats );
+}
+
+/*-----------------------------------------------------------*/
+
+void vPowerStatsGet( PowerStats_t * pxStats )
+{
+    configASSERT( pxStats != NULL );
+
+    taskENTER_CRITICAL();
+    {
+        prvSample( pxStats );
+
+        for( uint32_t i = 0; i < POWER_OP_COUNT; i++ )
+        {
+            pxStats->pxOps[ i ] = pxOpStats[ i ];
+
+            /* Include the part of a window still open */
+            if( pxOpWindows[ i ].ulInFlight > 0 )
+            {
+                pxStats->pxOps[ i ].ulActiveMs += pdTICKS_TO_MS( xTaskGetTickCount() - pxOpWindows[ i ].xStartTick );
+                pxStats->pxOps[ i ].ulWakes += pxStats->ulWakes - pxOpWindows[ i ].ulStartWakes;
+                pxStats->pxOps[ i ].ullEnergyUj += pxStats->ullEnergyUj - pxOpWindows[ i ].ullStartEnergyUj;
+            }
+        }
+    }
+    taskEXIT_CRITICAL();
+}
+
+/*-----------------------------------------------------------*/
+
+void vPowerStatsSetRadioState( PowerRadioState_t xState )
+{
+    configASSERT( xState < POWER_RADIO_COUNT );
+
+    taskENTER_CRITICAL();
+    {
+        if( xState != xRadioState )
+        {
+            TickType_t xNow = xTaskGetTickCount();
+
+            pulRadioMs[ xRadioState ] += pdTICKS_TO_MS( xNow - xRadioSince );
+            xRadioState = xState;
+            xRadioSince = xNow;
+        }
+    }
+    taskEXIT_CRITICAL();
+}
+
+/*-----------------------------------------------------------*/
+
+void vPowerStatsOpStart( PowerOp_t xOp )
+{
+    PowerStats_t xNow;
+
+    configASSERT( xOp < POWER_OP_COUNT );
+
+    taskENTER_CRITICAL();
+    {
+        PowerOpWindow_t * pxWindow = &( pxOpWindows[ xOp ] );
+
+        if( pxWindow->ulInFlight == 0 )
+        {
+            prvSample( &xNow );
+
+            pxWindow->xStartTick = xTaskGetTickCount();
+            pxWindow->ulStartWakes = xNow.ulWakes;
+            pxWindow->ullStartEnergyUj = xNow.ullEnergyUj;
+        }
+
+        pxWindow->ulInFlight++;
+    }
+    taskEXIT_CRITICAL();
+}
+
+/*-----------------------------------------------------------*/
+
+void vPowerStatsOpEnd( PowerOp_t xOp )
+{
+    PowerStats_t xNow;
+
+    configASSERT( xOp < POWER_OP_COUNT );
+
+    taskENTER_CRITICAL();
+    {
+        PowerOpWindow_t * pxWindow = &( pxOpWindows[ xOp ] );
+
+        /* Ignore an end without a start, e.g. an OTA abort before the file was opened */
+        if( pxWindow->ulInFlight > 0 )
+        {
+            pxOpStats[ xOp ].ulCount++;
+            pxWindow->ulInFlight--;
+
+            if( pxWindow->ulInFlight == 0 )
+            {
+                prvSample( &xNow );
+
+                pxOpStats[ xOp ].ulActiveMs += pdTICKS_TO_MS( xTaskGetTickCount() - pxWindow->xStartTick );
+                pxOpStats[ xOp ].ulWakes += xNow.ulWakes - pxWindow->ulStartWakes;
+                pxOpStats[ xOp ].ullEnergyUj += xNow.ullEnergyUj - pxWindow->ullStartEnergyUj;
+            }
+        }
+    }
+    taskEXIT_CRITICAL();
+}
+
+#endif /* POWER_STATS_ENABLED == 1 */
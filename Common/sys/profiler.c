@@ -0,0 +1,133 @@
+/*
+ * FreeRTOS STM32 Reference Integration
+ *
+ * Copyright (c) 2022 Amazon.com, Inc. or its affiliates. All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#include "FreeRTOS.h"
+#include "profiler.h"
+
+#include <string.h>
+
+#if PROFILER_ENABLED == 1
+
+/* Probes in order of first use, newest last */
+static ProfProbe_t * pxProbeHead = NULL;
+static ProfProbe_t * pxProbeTail = NULL;
+
+/*-----------------------------------------------------------*/
+
+void vProfRecord( ProfProbe_t * pxProbe,
+                  uint32_t ulCycles )
+{
+    UBaseType_t uxSavedInterruptStatus;
+    BaseType_t xValid = pdTRUE;
+
+    configASSERT( pxProbe != NULL );
+
+    uxSavedInterruptStatus = portSET_INTERRUPT_MASK_FROM_ISR();
+
+    if( pxProbe->ulRegistered == 0 )
+    {
+        pxProbe->ulRegistered = 1;
+        pxProbe->pxNext = NULL;
+
+        if( pxProbeTail == NULL )
+        {
+            pxProbeHead = pxProbe;
+        }
+        else
+        {
+            pxProbeTail->pxNext = pxProbe;
+        }
+
+        pxProbeTail = pxProbe;
+
+        /* The first duration is meaningless if the counter was stopped */
+        if( ( DWT->CTRL & DWT_CTRL_CYCCNTENA_Msk ) == 0 )
+        {
+            CoreDebug->DEMCR |= CoreDebug_DEMCR_TRCENA_Msk;
+            DWT->CYCCNT = 0;
+            DWT->CTRL |= DWT_CTRL_CYCCNTENA_Msk;
+            xValid = pdFALSE;
+        }
+    }
+
+    if( xValid == pdTRUE )
+    {
+        pxProbe->ulCount++;
+        pxProbe->ullSumCycles += ulCycles;
+
+        if( ulCycles < pxProbe->ulMinCycles )
+        {
+            pxProbe->ulMinCycles = ulCycles;
+        }
+
+        if( ulCycles > pxProbe->ulMaxCycles )
+        {
+            pxProbe->ulMaxCycles = ulCycles;
+        }
+    }
+
+    portCLEAR_INTERRUPT_MASK_FROM_ISR( uxSavedInterruptStatus );
+}
+
+/*-----------------------------------------------------------*/
+
+void vProfReset( void )
+{
+    UBaseType_t uxSavedInterruptStatus = portSET_INTERRUPT_MASK_FROM_ISR();
+
+    for( ProfProbe_t * pxProbe = pxProbeHead; pxProbe != NULL; pxProbe = pxProbe->pxNext )
+    {
+        pxProbe->ulCount = 0;
+        pxProbe->ulMinCycles = UINT32_MAX;
+        pxProbe->ulMaxCycles = 0;
+        pxProbe->ullSumCycles = 0;
+    }
+
+    portCLEAR_INTERRUPT_MASK_FROM_ISR( uxSavedInterruptStatus );
+}
+
+/*-----------------------------------------------------------*/
+
+const ProfProbe_t * pxProfNext( const ProfProbe_t * pxPrev,
+                                ProfProbe_t * pxCopy )
+{
+    const ProfProbe_t * pxProbe;
+    UBaseType_t uxSavedInterruptStatus;
+
+    configASSERT( pxCopy != NULL );
+
+    uxSavedInterruptStatus = portSET_INTERRUPT_MASK_FROM_ISR();
+
+    pxProbe = ( pxPrev == NULL ) ? pxProbeHead : pxPrev->pxNext;
+
+    if( pxProbe != NULL )
+    {
+        ( void ) memcpy( pxCopy, pxProbe, sizeof( ProfProbe_t ) );
+    }
+
+    portCLEAR_INTERRUPT_MASK_FROM_ISR( uxSavedInterruptStatus );
+
+    return pxProbe;
+}
+
+#endif /* PROFILER_ENABLED == 1 */
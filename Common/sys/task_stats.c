@@ -0,0 +1,181 @@
+/*
+ * FreeRTOS STM32 Reference Integration
+ *
+ * Copyright (c) 2022 Amazon.com, Inc. or its affiliates. All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#include "FreeRTOS.h"
+#include "task.h"
+
+#include "hw_defs.h"
+#include "task_stats.h"
+
+#include <string.h>
+
+typedef struct TaskLatency
+{
+    uint32_t ulTaskNumber;
+    uint32_t ulPending;     /* Waiting to run since ulReadyAt */
+    uint32_t ulReadyAt;     /* Run time counter when the task was moved to the ready list */
+    uint32_t ulMax;
+    uint32_t ulIntervalMax;
+} TaskLatency_t;
+
+#if TASK_STATS_LATENCY_ENABLED == 1
+static TaskLatency_t xLatency[ TASK_STATS_MAX_TASKS ] = { 0 };
+#endif
+
+/*-----------------------------------------------------------*/
+
+uint32_t ulTaskStatsCounterHz( void )
+{
+    uint32_t ulHz = 0;
+
+    if( pxHndlTim5 != NULL )
+    {
+        /* APB1 is not divided, so TIM5 runs from PCLK1 */
+        ulHz = HAL_RCC_GetPCLK1Freq() / ( pxHndlTim5->Init.Prescaler + 1U );
+    }
+
+    return ulHz;
+}
+
+/*-----------------------------------------------------------*/
+
+/* Reads the stack bounds from the task control block, which tasks.c keeps private */
+uint32_t ulTaskStatsStackDepth( TaskHandle_t xTask )
+{
+    struct tskTaskControlBlockRedef
+    {
+        volatile StackType_t * pxDontCare0;
+
+#if ( portUSING_MPU_WRAPPERS == 1 )
+        xMPU_SETTINGS xDontCare1;
+#endif
+        ListItem_t xDontCare2;
+        ListItem_t xDontCare3;
+        UBaseType_t uxDontCare4;
+        StackType_t * pxStack;
+        char pcDontCare5[ configMAX_TASK_NAME_LEN ];
+
+#if ( ( portSTACK_GROWTH > 0 ) || ( configRECORD_STACK_HIGH_ADDRESS == 1 ) )
+        StackType_t * pxEndOfStack;
+#endif
+    };
+    struct tskTaskControlBlockRedef * pxTCB = ( struct tskTaskControlBlockRedef * ) xTask;
+
+    return( ( ( ( uintptr_t ) pxTCB->pxEndOfStack - ( uintptr_t ) pxTCB->pxStack ) / sizeof( StackType_t ) ) + 2 );
+}
+
+/*-----------------------------------------------------------*/
+
+#if TASK_STATS_LATENCY_ENABLED == 1
+
+/* Both hooks are called by the kernel with interrupts masked up to the syscall limit */
+void vTaskStatsReady( uint32_t ulTaskNumber )
+{
+    TaskLatency_t * pxEntry = &( xLatency[ ulTaskNumber % TASK_STATS_MAX_TASKS ] );
+
+    if( pxEntry->ulTaskNumber != ulTaskNumber )
+    {
+        /* New task, or an older one sharing the slot */
+        ( void ) memset( pxEntry, 0, sizeof( TaskLatency_t ) );
+        pxEntry->ulTaskNumber = ulTaskNumber;
+    }
+
+    /* Keep the earliest time if the task is readied again before it runs */
+    if( pxEntry->ulPending == 0 )
+    {
+        pxEntry->ulReadyAt = portGET_RUN_TIME_COUNTER_VALUE();
+        pxEntry->ulPending = 1;
+    }
+}
+
+/*-----------------------------------------------------------*/
+
+void vTaskStatsSwitchedIn( uint32_t ulTaskNumber )
+{
+    TaskLatency_t * pxEntry = &( xLatency[ ulTaskNumber % TASK_STATS_MAX_TASKS ] );
+
+    if( ( pxEntry->ulTaskNumber == ulTaskNumber ) &&
+        ( pxEntry->ulPending != 0 ) )
+    {
+        uint32_t ulDelay = portGET_RUN_TIME_COUNTER_VALUE() - pxEntry->ulReadyAt;
+
+        if( ulDelay > pxEntry->ulMax )
+        {
+            pxEntry->ulMax = ulDelay;
+        }
+
+        if( ulDelay > pxEntry->ulIntervalMax )
+        {
+            pxEntry->ulIntervalMax = ulDelay;
+        }
+
+        pxEntry->ulPending = 0;
+    }
+}
+
+/*-----------------------------------------------------------*/
+
+void vTaskStatsResetInterval( void )
+{
+    taskENTER_CRITICAL();
+    {
+        for( uint32_t i = 0; i < TASK_STATS_MAX_TASKS; i++ )
+        {
+            xLatency[ i ].ulIntervalMax = 0;
+        }
+    }
+    taskEXIT_CRITICAL();
+}
+
+/*-----------------------------------------------------------*/
+
+void vTaskStatsGetLatency( uint32_t ulTaskNumber,
+                           uint32_t * pulMax,
+                           uint32_t * pulIntervalMax )
+{
+    const TaskLatency_t * pxEntry = &( xLatency[ ulTaskNumber % TASK_STATS_MAX_TASKS ] );
+    uint32_t ulMax = 0;
+    uint32_t ulIntervalMax = 0;
+
+    taskENTER_CRITICAL();
+    {
+        if( pxEntry->ulTaskNumber == ulTaskNumber )
+        {
+            ulMax = pxEntry->ulMax;
+            ulIntervalMax = pxEntry->ulIntervalMax;
+        }
+    }
+    taskEXIT_CRITICAL();
+
+    if( pulMax != NULL )
+    {
+        *pulMax = ulMax;
+    }
+
+    if( pulIntervalMax != NULL )
+    {
+        *pulIntervalMax = ulIntervalMax;
+    }
+}
+
+#endif /* TASK_STATS_LATENCY_ENABLED == 1 */
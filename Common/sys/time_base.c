@@ -0,0 +1,330 @@
+/*
+ * FreeRTOS STM32 Reference Integration
+ * Copyright (C) 2022 Amazon.com, Inc. or its affiliates.  All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ *
+ * https://www.FreeRTOS.org
+ * https://github.com/FreeRTOS
+ *
+ */
+
+#include "logging_levels.h"
+/* define LOG_LEVEL here if you want to modify the logging level from the default */
+
+#define LOG_LEVEL    LOG_INFO
+#define LOG_MODULE    LOG_MODULE_SYS
+
+#include "logging.h"
+
+/* Standard includes. */
+#include <stdio.h>
+
+/* Kernel includes. */
+#include "FreeRTOS.h"
+#include "task.h"
+#include "timers.h"
+
+#include "hw_defs.h"
+#include "kvstore.h"
+
+#include "time_base.h"
+
+/* The high-water mark is only rewritten once it is this far behind, to limit flash wear */
+#define TIME_BASE_HWM_MIN_STEP_S    ( 24UL * 60UL * 60UL )
+
+/* RTC dates before this are treated as not set, e.g. after the backup domain lost power */
+#define TIME_BASE_RTC_MIN_YEAR      2022U
+
+/* TIM5 ticks accumulated in past wrap arounds plus the last observed counter value */
+static uint64_t ullTimWraps = 0;
+static uint32_t ulTimLastCount = 0;
+static uint32_t ulTimFreqHz = 0;
+
+/* Wall clock time in ms at ullTimeBaseGetUs() == 0 */
+static uint64_t ullUnixMsAtBoot = 0;
+static TimeBaseSource_t xSource = TIME_BASE_SRC_NONE;
+
+static TimerHandle_t xWrapTimer = NULL;
+
+/*-----------------------------------------------------------*/
+
+/* Days since 1970-01-01 of a proleptic Gregorian date */
+static uint32_t prvDaysFromCivil( uint32_t ulYear,
+                                  uint32_t ulMonth,
+                                  uint32_t ulDay )
+{
+    uint32_t ulEra;
+    uint32_t ulYoe;
+    uint32_t ulDoy;
+
+    ulYear -= ( ulMonth <= 2 ) ? 1 : 0;
+    ulEra = ulYear / 400;
+    ulYoe = ulYear - ulEra * 400;
+    ulDoy = ( 153 * ( ulMonth > 2 ? ulMonth - 3 : ulMonth + 9 ) + 2 ) / 5 + ulDay - 1;
+
+    return ( ulEra * 146097 ) + ( ulYoe * 365 ) + ( ulYoe / 4 ) - ( ulYoe / 100 ) + ulDoy - 719468;
+}
+
+/*-----------------------------------------------------------*/
+
+static void prvCivilFromDays( uint32_t ulDays,
+                              uint32_t * pulYear,
+                              uint32_t * pulMonth,
+                              uint32_t * pulDay )
+{
+    uint32_t ulZ = ulDays + 719468;
+    uint32_t ulEra = ulZ / 146097;
+    uint32_t ulDoe = ulZ - ulEra * 146097;
+    uint32_t ulYoe = ( ulDoe - ulDoe / 1460 + ulDoe / 36524 - ulDoe / 146096 ) / 365;
+    uint32_t ulDoy = ulDoe - ( 365 * ulYoe + ulYoe / 4 - ulYoe / 100 );
+    uint32_t ulMp = ( 5 * ulDoy + 2 ) / 153;
+
+    *pulDay = ulDoy - ( 153 * ulMp + 2 ) / 5 + 1;
+    *pulMonth = ( ulMp < 10 ) ? ulMp + 3 : ulMp - 9;
+    *pulYear = ulYoe + ulEra * 400 + ( ( *pulMonth <= 2 ) ? 1 : 0 );
+}
+
+/*-----------------------------------------------------------*/
+
+static BaseType_t prvReadRtcMs( uint64_t * pullUnixMs )
+{
+    BaseType_t xResult = pdFALSE;
+    RTC_TimeTypeDef xTime = { 0 };
+    RTC_DateTypeDef xDate = { 0 };
+
+    /* The date must be read after the time to unlock the shadow registers */
+    if( ( pxHndlRtc != NULL ) &&
+        ( HAL_RTC_GetTime( pxHndlRtc, &xTime, RTC_FORMAT_BIN ) == HAL_OK ) &&
+        ( HAL_RTC_GetDate( pxHndlRtc, &xDate, RTC_FORMAT_BIN ) == HAL_OK ) &&
+        ( ( 2000U + xDate.Year ) >= TIME_BASE_RTC_MIN_YEAR ) )
+    {
+        uint32_t ulDays = prvDaysFromCivil( 2000U + xDate.Year, xDate.Month, xDate.Date );
+        uint32_t ulSecs = ( xTime.Hours * 3600U ) + ( xTime.Minutes * 60U ) + xTime.Seconds;
+        uint32_t ulMs = ( ( xTime.SecondFraction - xTime.SubSeconds ) * 1000U ) / ( xTime.SecondFraction + 1U );
+
+        *pullUnixMs = ( ( ( uint64_t ) ulDays * 86400U ) + ulSecs ) * 1000U + ulMs;
+        xResult = pdTRUE;
+    }
+
+    return xResult;
+}
+
+/*-----------------------------------------------------------*/
+
+static void prvWriteRtc( uint64_t ullUnixMs )
+{
+    uint32_t ulSecs = ( uint32_t ) ( ullUnixMs / 1000U );
+    uint32_t ulYear, ulMonth, ulDay;
+    RTC_TimeTypeDef xTime = { 0 };
+    RTC_DateTypeDef xDate = { 0 };
+
+    prvCivilFromDays( ulSecs / 86400U, &ulYear, &ulMonth, &ulDay );
+
+    xTime.Hours = ( ulSecs % 86400U ) / 3600U;
+    xTime.Minutes = ( ulSecs % 3600U ) / 60U;
+    xTime.Seconds = ulSecs % 60U;
+    xTime.DayLightSaving = RTC_DAYLIGHTSAVING_NONE;
+    xTime.StoreOperation = RTC_STOREOPERATION_RESET;
+
+    xDate.Year = ( uint8_t ) ( ulYear - 2000U );
+    xDate.Month = ( uint8_t ) ulMonth;
+    xDate.Date = ( uint8_t ) ulDay;
+
+    /* 1970-01-01 was a Thursday, RTC weekdays run from Monday = 1 to Sunday = 7 */
+    xDate.WeekDay = ( uint8_t ) ( ( ( ( ulSecs / 86400U ) + 3U ) % 7U ) + 1U );
+
+    if( ( pxHndlRtc == NULL ) ||
+        ( HAL_RTC_SetTime( pxHndlRtc, &xTime, RTC_FORMAT_BIN ) != HAL_OK ) ||
+        ( HAL_RTC_SetDate( pxHndlRtc, &xDate, RTC_FORMAT_BIN ) != HAL_OK ) )
+    {
+        LogError( "Failed to set the RTC." );
+    }
+}
+
+/*-----------------------------------------------------------*/
+
+static void prvWrapTimerCallback( TimerHandle_t xTimer )
+{
+    ( void ) xTimer;
+
+    /* Sampling the counter is enough to account for a wrap around */
+    ( void ) ullTimeBaseGetUs();
+}
+
+/*-----------------------------------------------------------*/
+
+uint64_t ullTimeBaseGetUs( void )
+{
+    uint64_t ullTicks;
+
+    if( ulTimFreqHz == 0 )
+    {
+        ullTicks = 0;
+    }
+    else
+    {
+        taskENTER_CRITICAL();
+        {
+            uint32_t ulCount = timer_get_count( pxHndlTim5 );
+
+            if( ulCount < ulTimLastCount )
+            {
+                ullTimWraps += ( 1ULL << 32 );
+            }
+
+            ulTimLastCount = ulCount;
+            ullTicks = ullTimWraps + ulCount;
+        }
+        taskEXIT_CRITICAL();
+
+        /* Split to keep the multiplication from overflowing */
+        ullTicks = ( ( ullTicks / ulTimFreqHz ) * 1000000ULL ) +
+                   ( ( ( ullTicks % ulTimFreqHz ) * 1000000ULL ) / ulTimFreqHz );
+    }
+
+    return ullTicks;
+}
+
+/*-----------------------------------------------------------*/
+
+TimeBaseSource_t xTimeBaseToUnixMs( uint64_t ullMonotonicUs,
+                                    uint64_t * pullUnixMs )
+{
+    TimeBaseSource_t xResult;
+    uint64_t ullOffsetMs;
+
+    configASSERT( pullUnixMs != NULL );
+
+    taskENTER_CRITICAL();
+    {
+        xResult = xSource;
+        ullOffsetMs = ullUnixMsAtBoot;
+    }
+    taskEXIT_CRITICAL();
+
+    if( xResult != TIME_BASE_SRC_NONE )
+    {
+        *pullUnixMs = ullOffsetMs + ( ullMonotonicUs / 1000U );
+    }
+
+    return xResult;
+}
+
+/*-----------------------------------------------------------*/
+
+size_t uxTimeBaseFormatUnix( uint64_t ullMonotonicUs,
+                             char * pcBuffer,
+                             size_t uxBufferLen )
+{
+    uint64_t ullUnixMs = 0;
+    size_t uxLen = 0;
+
+    configASSERT( pcBuffer != NULL );
+
+    if( xTimeBaseToUnixMs( ullMonotonicUs, &ullUnixMs ) != TIME_BASE_SRC_NONE )
+    {
+        /* Formatted in two parts since printf may lack 64 bit support */
+        int lLen = snprintf( pcBuffer, uxBufferLen, "%lu.%03lu",
+                             ( unsigned long ) ( ullUnixMs / 1000U ),
+                             ( unsigned long ) ( ullUnixMs % 1000U ) );
+
+        if( ( lLen > 0 ) && ( ( size_t ) lLen < uxBufferLen ) )
+        {
+            uxLen = ( size_t ) lLen;
+        }
+    }
+
+    return uxLen;
+}
+
+/*-----------------------------------------------------------*/
+
+void vTimeBaseSetUnixMs( uint64_t ullUnixMs )
+{
+    uint64_t ullNowUs = ullTimeBaseGetUs();
+    uint32_t ulHwm = KVStore_getUInt32( CS_TIME_HWM_S_1970, NULL );
+    uint32_t ulSecs = ( uint32_t ) ( ullUnixMs / 1000U );
+
+    taskENTER_CRITICAL();
+    {
+        ullUnixMsAtBoot = ullUnixMs - ( ullNowUs / 1000U );
+        xSource = TIME_BASE_SRC_SYNCED;
+    }
+    taskEXIT_CRITICAL();
+
+    prvWriteRtc( ullUnixMs );
+
+    if( ulSecs >= ( ulHwm + TIME_BASE_HWM_MIN_STEP_S ) )
+    {
+        if( ( KVStore_setUInt32( CS_TIME_HWM_S_1970, ulSecs ) != pdTRUE ) ||
+            ( KVStore_xCommitChanges() != pdTRUE ) )
+        {
+            LogWarn( "Failed to update the time high-water mark." );
+        }
+    }
+
+    LogInfo( "Wall clock time set to %lu s.", ulSecs );
+}
+
+/*-----------------------------------------------------------*/
+
+void vTimeBaseInit( void )
+{
+    uint64_t ullUnixMs = 0;
+    uint32_t ulHwm;
+
+    configASSERT( pxHndlTim5 != NULL );
+
+    /* APB1 is not divided, so TIM5 runs from PCLK1 */
+    ulTimFreqHz = HAL_RCC_GetPCLK1Freq() / ( pxHndlTim5->Init.Prescaler + 1U );
+    ulTimLastCount = timer_get_count( pxHndlTim5 );
+
+    if( xWrapTimer == NULL )
+    {
+        xWrapTimer = xTimerCreate( "TimeWrap", pdMS_TO_TICKS( TIME_BASE_WRAP_CHECK_MS ),
+                                   pdTRUE, NULL, prvWrapTimerCallback );
+        configASSERT( xWrapTimer != NULL );
+        ( void ) xTimerStart( xWrapTimer, 0 );
+    }
+
+    ulHwm = KVStore_getUInt32( CS_TIME_HWM_S_1970, NULL );
+
+    if( ( prvReadRtcMs( &ullUnixMs ) == pdTRUE ) &&
+        ( ( ullUnixMs / 1000U ) >= ulHwm ) )
+    {
+        xSource = TIME_BASE_SRC_RTC;
+    }
+    else if( ulHwm > 0 )
+    {
+        ullUnixMs = ( uint64_t ) ulHwm * 1000U;
+        xSource = TIME_BASE_SRC_HWM;
+    }
+    else
+    {
+        xSource = TIME_BASE_SRC_NONE;
+    }
+
+    if( xSource != TIME_BASE_SRC_NONE )
+    {
+        ullUnixMsAtBoot = ullUnixMs - ( ullTimeBaseGetUs() / 1000U );
+    }
+
+    LogInfo( "Time base at %lu Hz, wall clock source: %d.", ulTimFreqHz, xSource );
+}
@@ -0,0 +1,189 @@
+/*
+ * FreeRTOS STM32 Reference Integration
+ *
+ * Copyright (c) 2022 Amazon.com, Inc. or its affiliates. All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#include "FreeRTOS.h"
+#include "trace_recorder.h"
+
+#include <string.h>
+
+#include "ram_sections.h"
+
+#if TRACE_RECORDER_ENABLED == 1
+
+#if ( ( TRACE_RECORDER_EVENTS & ( TRACE_RECORDER_EVENTS - 1U ) ) != 0 )
+#error "TRACE_RECORDER_EVENTS must be a power of two"
+#endif
+
+#define TRACE_RECORDER_MAGIC    ( 0x52435254UL ) /* "TRCR" */
+
+static TraceEvent_t xTraceEvents[ TRACE_RECORDER_EVENTS ] RAM_CPU_DATA;
+
+TraceRecorder_t xTraceRecorder =
+{
+    .ulMagic        = 0,
+    .ulEventLen     = sizeof( TraceEvent_t ),
+    .ulEventCount   = TRACE_RECORDER_EVENTS,
+    .ulHead         = 0,
+    .ulEnabled      = 0,
+    .ulStopWhenFull = 0,
+    .ulCpuHz        = 0,
+    .pxEvents       = xTraceEvents
+};
+
+/* Updated on every switch, also while not recording, so that the first events get the right context */
+static volatile uint32_t ulCurrentTask = 0;
+
+static uint32_t ulTaskNumbers[ TRACE_RECORDER_TASKS ] = { 0 };
+static char cTaskNames[ TRACE_RECORDER_TASKS ][ TRACE_RECORDER_NAME_LEN ] = { 0 };
+
+/*-----------------------------------------------------------*/
+
+/* Called from the kernel with the scheduler lock held and from interrupts of any priority up to the syscall limit */
+static void prvTraceAppend( uint8_t ucType,
+                            uint32_t ulArg,
+                            uint32_t ulContext )
+{
+    UBaseType_t uxSavedInterruptStatus = portSET_INTERRUPT_MASK_FROM_ISR();
+    uint32_t ulHead = xTraceRecorder.ulHead;
+
+    if( ( xTraceRecorder.ulStopWhenFull != 0 ) && ( ulHead >= TRACE_RECORDER_EVENTS ) )
+    {
+        xTraceRecorder.ulEnabled = 0;
+    }
+    else
+    {
+        TraceEvent_t * pxEvent = &( xTraceEvents[ ulHead & ( TRACE_RECORDER_EVENTS - 1U ) ] );
+
+        pxEvent->ulTimestamp = DWT->CYCCNT;
+        pxEvent->ulArg = ulArg;
+        pxEvent->usContext = ( uint16_t ) ulContext;
+        pxEvent->ucType = ucType;
+        pxEvent->ucReserved = 0;
+
+        xTraceRecorder.ulHead = ulHead + 1;
+    }
+
+    portCLEAR_INTERRUPT_MASK_FROM_ISR( uxSavedInterruptStatus );
+}
+
+void vTraceRecord( uint8_t ucType,
+                   uint32_t ulArg )
+{
+    if( xTraceRecorder.ulEnabled != 0 )
+    {
+        uint32_t ulIpsr = __get_IPSR();
+
+        prvTraceAppend( ucType, ulArg, ( ulIpsr != 0 ) ? ( TRACE_CTX_ISR | ulIpsr ) : ulCurrentTask );
+    }
+}
+
+/* Switches happen in PendSV, but belong to the task switched in or out */
+void vTraceTaskSwitch( uint8_t ucType,
+                       uint32_t ulTaskNumber )
+{
+    if( ucType == TRACE_EVT_TASK_IN )
+    {
+        ulCurrentTask = ulTaskNumber;
+    }
+
+    if( xTraceRecorder.ulEnabled != 0 )
+    {
+        prvTraceAppend( ucType, ulTaskNumber, ulTaskNumber );
+    }
+}
+
+void vTraceTaskCreate( uint32_t ulTaskNumber,
+                       const char * pcName )
+{
+    uint32_t ulSlot = ulTaskNumber % TRACE_RECORDER_TASKS;
+
+    ulTaskNumbers[ ulSlot ] = ulTaskNumber;
+    ( void ) strncpy( cTaskNames[ ulSlot ], pcName, TRACE_RECORDER_NAME_LEN - 1 );
+    cTaskNames[ ulSlot ][ TRACE_RECORDER_NAME_LEN - 1 ] = '\0';
+
+    vTraceRecord( TRACE_EVT_TASK_CREATE, ulTaskNumber );
+}
+
+void vTraceIsrEnter( void )
+{
+    if( xTraceRecorder.ulEnabled != 0 )
+    {
+        uint32_t ulIpsr = __get_IPSR();
+
+        prvTraceAppend( TRACE_EVT_ISR_ENTER, ulIpsr, TRACE_CTX_ISR | ulIpsr );
+    }
+}
+
+void vTraceIsrExit( void )
+{
+    if( xTraceRecorder.ulEnabled != 0 )
+    {
+        uint32_t ulIpsr = __get_IPSR();
+
+        prvTraceAppend( TRACE_EVT_ISR_EXIT, ulIpsr, TRACE_CTX_ISR | ulIpsr );
+    }
+}
+
+/*-----------------------------------------------------------*/
+
+void vTraceStart( uint32_t ulStopWhenFull )
+{
+    UBaseType_t uxSavedInterruptStatus;
+
+    CoreDebug->DEMCR |= CoreDebug_DEMCR_TRCENA_Msk;
+    DWT->CTRL |= DWT_CTRL_CYCCNTENA_Msk;
+
+    uxSavedInterruptStatus = portSET_INTERRUPT_MASK_FROM_ISR();
+
+    xTraceRecorder.ulEnabled = 0;
+    xTraceRecorder.ulHead = 0;
+    xTraceRecorder.ulStopWhenFull = ulStopWhenFull;
+    xTraceRecorder.ulCpuHz = SystemCoreClock;
+    xTraceRecorder.ulMagic = TRACE_RECORDER_MAGIC;
+    xTraceRecorder.ulEnabled = 1;
+
+    /* Open the slice of the task calling vTraceStart */
+    prvTraceAppend( TRACE_EVT_TASK_IN, ulCurrentTask, ulCurrentTask );
+
+    portCLEAR_INTERRUPT_MASK_FROM_ISR( uxSavedInterruptStatus );
+}
+
+void vTraceStop( void )
+{
+    xTraceRecorder.ulEnabled = 0;
+}
+
+const char * pcTraceTaskName( uint32_t ulTaskNumber )
+{
+    uint32_t ulSlot = ulTaskNumber % TRACE_RECORDER_TASKS;
+    const char * pcName = NULL;
+
+    if( ( ulTaskNumber != 0 ) && ( ulTaskNumbers[ ulSlot ] == ulTaskNumber ) )
+    {
+        pcName = cTaskNames[ ulSlot ];
+    }
+
+    return pcName;
+}
+
+#endif /* TRACE_RECORDER_ENABLED == 1 */
@@ -0,0 +1,265 @@
+/*
+ * FreeRTOS STM32 Reference Integration
+ *
+ * Copyright (c) 2022 Amazon.com, Inc. or its affiliates. All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+/**
+ * @file warm_state.c
+ * @brief CRC protected records kept in retained RAM across a warm reset.
+ */
+
+#include "logging_levels.h"
+
+#define LOG_LEVEL     LOG_INFO
+#define LOG_MODULE    LOG_MODULE_SYS
+
+#include "logging.h"
+
+#include <string.h>
+
+#include "FreeRTOS.h"
+#include "task.h"
+
+#include "ram_sections.h"
+#include "warm_state.h"
+
+#if WARM_STATE_ENABLED == 1
+
+#define WARM_STATE_MAGIC    ( 0x4D524157UL ) /* "WARM" */
+
+typedef struct
+{
+    uint32_t ulMagic;  /* WARM_STATE_MAGIC plus the record number, 0 if invalid */
+    uint32_t ulLength;
+    uint32_t ulCrc;    /* Over the length and the contents */
+} WarmStateHeader_t;
+
+/* Never initialized by the startup code, validated by vWarmStateInit */
+static struct
+{
+    WarmStateHeader_t xHeaders[ WARM_STATE_MAX ];
+    uint32_t ulKvStore[ ( WARM_STATE_KVSTORE_LEN + 3U ) / 4U ];
+    uint32_t ulTlsSession[ ( WARM_STATE_TLS_SESSION_LEN + 3U ) / 4U ];
+} xWarmState RAM_RETAINED;
+
+/* Records found intact at boot, handed out until they are rewritten */
+static BaseType_t xRestored[ WARM_STATE_MAX ] = { 0 };
+
+/*-----------------------------------------------------------*/
+
+/* Same result as zlib.crc32( data, ulCrc ), so that calls can be chained */
+static uint32_t prvCrc32( uint32_t ulCrc,
+                          const uint8_t * pucData,
+                          size_t uxLen )
+{
+    static const uint32_t ulNibbleTable[ 16 ] =
+    {
+        0x00000000, 0x1DB71064, 0x3B6E20C8, 0x26D930AC,
+        0x76DC4190, 0x6B6B51F4, 0x4DB26158, 0x5005713C,
+        0xEDB88320, 0xF00F9344, 0xD6D6A3E8, 0xCB61B38C,
+        0x9B64C2B0, 0x86D3D2D4, 0xA00AE278, 0xBDBDF21C
+    };
+
+    ulCrc = ~ulCrc;
+
+    for( size_t uxIdx = 0; uxIdx < uxLen; uxIdx++ )
+    {
+        ulCrc ^= pucData[ uxIdx ];
+        ulCrc = ( ulCrc >> 4 ) ^ ulNibbleTable[ ulCrc & 0xFU ];
+        ulCrc = ( ulCrc >> 4 ) ^ ulNibbleTable[ ulCrc & 0xFU ];
+    }
+
+    return ~ulCrc;
+}
+
+/*-----------------------------------------------------------*/
+
+static uint8_t * prvGetBuffer( WarmStateRecord_t xRecord,
+                               size_t * puxCapacity )
+{
+    uint8_t * pucBuffer = NULL;
+
+    switch( xRecord )
+    {
+        case WARM_STATE_KVSTORE:
+            pucBuffer = ( uint8_t * ) xWarmState.ulKvStore;
+            *puxCapacity = WARM_STATE_KVSTORE_LEN;
+            break;
+
+        case WARM_STATE_TLS_SESSION:
+            pucBuffer = ( uint8_t * ) xWarmState.ulTlsSession;
+            *puxCapacity = WARM_STATE_TLS_SESSION_LEN;
+            break;
+
+        default:
+            configASSERT( 0 );
+            *puxCapacity = 0;
+            break;
+    }
+
+    return pucBuffer;
+}
+
+/*-----------------------------------------------------------*/
+
+static uint32_t prvRecordCrc( WarmStateRecord_t xRecord,
+                              uint32_t ulLength )
+{
+    size_t uxCapacity = 0;
+    const uint8_t * pucBuffer = prvGetBuffer( xRecord, &uxCapacity );
+    uint32_t ulCrc = prvCrc32( 0, ( const uint8_t * ) &ulLength, sizeof( ulLength ) );
+
+    return prvCrc32( ulCrc, pucBuffer, ulLength );
+}
+
+/*-----------------------------------------------------------*/
+
+/* Runs before the logging is up, the users of each record report what they restored */
+void vWarmStateInit( BaseType_t xWarmReset )
+{
+    for( uint32_t ulIdx = 0; ulIdx < WARM_STATE_MAX; ulIdx++ )
+    {
+        WarmStateHeader_t * pxHeader = &( xWarmState.xHeaders[ ulIdx ] );
+        size_t uxCapacity = 0;
+
+        ( void ) prvGetBuffer( ( WarmStateRecord_t ) ulIdx, &uxCapacity );
+
+        xRestored[ ulIdx ] = pdFALSE;
+
+        if( ( xWarmReset == pdTRUE ) &&
+            ( pxHeader->ulMagic == ( WARM_STATE_MAGIC + ulIdx ) ) &&
+            ( pxHeader->ulLength > 0 ) &&
+            ( pxHeader->ulLength <= uxCapacity ) &&
+            ( pxHeader->ulCrc == prvRecordCrc( ( WarmStateRecord_t ) ulIdx, pxHeader->ulLength ) ) )
+        {
+            xRestored[ ulIdx ] = pdTRUE;
+        }
+        else
+        {
+            pxHeader->ulMagic = 0;
+        }
+    }
+}
+
+/*-----------------------------------------------------------*/
+
+const void * pvWarmStateGet( WarmStateRecord_t xRecord,
+                             size_t * puxLength )
+{
+    const void * pvRecord = NULL;
+
+    configASSERT( xRecord < WARM_STATE_MAX );
+    configASSERT( puxLength != NULL );
+
+    *puxLength = 0;
+
+    if( ( xRecord < WARM_STATE_MAX ) &&
+        ( xRestored[ xRecord ] == pdTRUE ) )
+    {
+        size_t uxCapacity = 0;
+
+        pvRecord = prvGetBuffer( xRecord, &uxCapacity );
+        *puxLength = xWarmState.xHeaders[ xRecord ].ulLength;
+    }
+
+    return pvRecord;
+}
+
+/*-----------------------------------------------------------*/
+
+void * pvWarmStateBegin( WarmStateRecord_t xRecord,
+                         size_t * puxCapacity )
+{
+    configASSERT( xRecord < WARM_STATE_MAX );
+    configASSERT( puxCapacity != NULL );
+
+    vWarmStateClear( xRecord );
+
+    return prvGetBuffer( xRecord, puxCapacity );
+}
+
+/*-----------------------------------------------------------*/
+
+void vWarmStateCommit( WarmStateRecord_t xRecord,
+                       size_t uxLength )
+{
+    size_t uxCapacity = 0;
+
+    configASSERT( xRecord < WARM_STATE_MAX );
+
+    ( void ) prvGetBuffer( xRecord, &uxCapacity );
+
+    if( ( uxLength > 0 ) &&
+        ( uxLength <= uxCapacity ) )
+    {
+        WarmStateHeader_t * pxHeader = &( xWarmState.xHeaders[ xRecord ] );
+
+        pxHeader->ulLength = ( uint32_t ) uxLength;
+        pxHeader->ulCrc = prvRecordCrc( xRecord, ( uint32_t ) uxLength );
+
+        /* The magic goes last, the record only counts once it is complete */
+        portMEMORY_BARRIER();
+        pxHeader->ulMagic = WARM_STATE_MAGIC + ( uint32_t ) xRecord;
+    }
+}
+
+/*-----------------------------------------------------------*/
+
+BaseType_t xWarmStateSet( WarmStateRecord_t xRecord,
+                          const void * pvData,
+                          size_t uxLength )
+{
+    size_t uxCapacity = 0;
+    uint8_t * pucBuffer = pvWarmStateBegin( xRecord, &uxCapacity );
+    BaseType_t xResult = pdFALSE;
+
+    configASSERT( pvData != NULL );
+
+    if( ( uxLength > 0 ) &&
+        ( uxLength <= uxCapacity ) )
+    {
+        ( void ) memcpy( pucBuffer, pvData, uxLength );
+        vWarmStateCommit( xRecord, uxLength );
+        xResult = pdTRUE;
+    }
+    else
+    {
+        LogDebug( "Warm state record %d of %lu bytes does not fit.", xRecord, ( unsigned long ) uxLength );
+    }
+
+    return xResult;
+}
+
+/*-----------------------------------------------------------*/
+
+void vWarmStateClear( WarmStateRecord_t xRecord )
+{
+    configASSERT( xRecord < WARM_STATE_MAX );
+
+    if( xRecord < WARM_STATE_MAX )
+    {
+        xWarmState.xHeaders[ xRecord ].ulMagic = 0;
+        portMEMORY_BARRIER();
+
+        xRestored[ xRecord ] = pdFALSE;
+    }
+}
+
+#endif /* WARM_STATE_ENABLED == 1 */
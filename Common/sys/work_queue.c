@@ -0,0 +1,255 @@
+/*
+ * FreeRTOS STM32 Reference Integration
+ *
+ * Copyright (c) 2022 Amazon.com, Inc. or its affiliates. All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+/**
+ * @file work_queue.c
+ * @brief Periodic and one-shot jobs run by a single shared worker task, see work_queue.h.
+ *
+ * Jobs are linked in pxJobList the first time they are scheduled and never
+ * unlinked, a stopped job only clears xScheduled. The list is short, the
+ * worker scans all of it for the earliest due job in a critical section.
+ */
+
+#include "logging_levels.h"
+
+#define LOG_LEVEL     LOG_INFO
+#define LOG_MODULE    LOG_MODULE_SYS
+
+#include "logging.h"
+
+#include "FreeRTOS.h"
+#include "task.h"
+
+#include "static_alloc.h"
+#include "work_queue.h"
+
+static WorkJob_t * pxJobList = NULL;
+static TaskHandle_t xWorkerTask = NULL;
+
+/*-----------------------------------------------------------*/
+
+/* Wrap safe "xNow is at or past xDue" */
+static inline BaseType_t prvIsDue( TickType_t xNow,
+                                   TickType_t xDue )
+{
+    return( ( TickType_t ) ( xNow - xDue ) < ( portMAX_DELAY / 2 ) ) ? pdTRUE : pdFALSE;
+}
+
+/*-----------------------------------------------------------*/
+
+/*
+ * Returns the earliest job due by xNow plus the slack, with its next due time
+ * already set, or NULL and the ticks until the next job is due.
+ */
+static WorkJob_t * prvTakeDueJob( TickType_t xNow,
+                                  TickType_t * pxTicksToWait )
+{
+    WorkJob_t * pxDueJob = NULL;
+    TickType_t xHorizon = xNow + pdMS_TO_TICKS( WORK_QUEUE_SLACK_MS );
+
+    *pxTicksToWait = portMAX_DELAY;
+
+    taskENTER_CRITICAL();
+
+    for( WorkJob_t * pxJob = pxJobList; pxJob != NULL; pxJob = pxJob->pxNext )
+    {
+        if( pxJob->xScheduled != pdTRUE )
+        {
+            continue;
+        }
+
+        if( prvIsDue( xHorizon, pxJob->xDue ) == pdTRUE )
+        {
+            if( ( pxDueJob == NULL ) ||
+                ( prvIsDue( pxDueJob->xDue, pxJob->xDue ) == pdTRUE ) )
+            {
+                pxDueJob = pxJob;
+            }
+        }
+        else if( ( TickType_t ) ( pxJob->xDue - xNow ) < *pxTicksToWait )
+        {
+            *pxTicksToWait = pxJob->xDue - xNow;
+        }
+    }
+
+    if( pxDueJob == NULL )
+    {
+        /* Nothing to do */
+    }
+    else if( pxDueJob->xPeriod == 0 )
+    {
+        pxDueJob->xScheduled = pdFALSE;
+    }
+    else
+    {
+        pxDueJob->xDue += pxDueJob->xPeriod;
+
+        /* Skip the runs that were missed rather than running them back to back */
+        if( prvIsDue( xNow, pxDueJob->xDue ) == pdTRUE )
+        {
+            pxDueJob->xDue = xNow + pxDueJob->xPeriod;
+        }
+    }
+
+    taskEXIT_CRITICAL();
+
+    return pxDueJob;
+}
+
+/*-----------------------------------------------------------*/
+
+static void prvWorkerTask( void * pvParameters )
+{
+    ( void ) pvParameters;
+
+    for( ; ; )
+    {
+        TickType_t xTicksToWait = portMAX_DELAY;
+        TickType_t xStart = xTaskGetTickCount();
+        WorkJob_t * pxJob = prvTakeDueJob( xStart, &xTicksToWait );
+
+        if( pxJob == NULL )
+        {
+            /* Also woken up when a job is scheduled */
+            ( void ) ulTaskNotifyTake( pdTRUE, xTicksToWait );
+        }
+        else
+        {
+            TickType_t xRunTicks;
+
+            pxJob->pxFunction( pxJob->pvCtx );
+
+            xRunTicks = xTaskGetTickCount() - xStart;
+            pxJob->ulRuns++;
+
+            if( xRunTicks > pxJob->xMaxRunTicks )
+            {
+                pxJob->xMaxRunTicks = xRunTicks;
+            }
+
+            if( xRunTicks > pdMS_TO_TICKS( WORK_QUEUE_SLOW_JOB_MS ) )
+            {
+                LogWarn( "Job %s ran for %lu ms.", pxJob->pcName,
+                         ( unsigned long ) ( xRunTicks * portTICK_PERIOD_MS ) );
+            }
+        }
+    }
+}
+
+/*-----------------------------------------------------------*/
+
+static void prvSchedule( WorkJob_t * pxJob,
+                         uint32_t ulDelayMs,
+                         uint32_t ulPeriodMs )
+{
+    configASSERT( pxJob != NULL );
+    configASSERT( pxJob->pxFunction != NULL );
+
+    taskENTER_CRITICAL();
+
+    if( pxJob->xListed != pdTRUE )
+    {
+        pxJob->pxNext = pxJobList;
+        pxJobList = pxJob;
+        pxJob->xListed = pdTRUE;
+    }
+
+    pxJob->xDue = xTaskGetTickCount() + pdMS_TO_TICKS( ulDelayMs );
+    pxJob->xPeriod = pdMS_TO_TICKS( ulPeriodMs );
+    pxJob->xScheduled = pdTRUE;
+
+    taskEXIT_CRITICAL();
+
+    /* The worker rescans the list after each job anyway */
+    if( ( xWorkerTask != NULL ) &&
+        ( xWorkerTask != xTaskGetCurrentTaskHandle() ) )
+    {
+        ( void ) xTaskNotifyGive( xWorkerTask );
+    }
+}
+
+/*-----------------------------------------------------------*/
+
+void vWorkJobInit( WorkJob_t * pxJob,
+                   const char * pcName,
+                   WorkFunction_t pxFunction,
+                   void * pvCtx )
+{
+    configASSERT( pxJob != NULL );
+    configASSERT( pxFunction != NULL );
+    configASSERT( pxJob->xListed != pdTRUE );
+
+    pxJob->pcName = pcName;
+    pxJob->pxFunction = pxFunction;
+    pxJob->pvCtx = pvCtx;
+    pxJob->xPeriod = 0;
+    pxJob->xDue = 0;
+    pxJob->xScheduled = pdFALSE;
+    pxJob->xListed = pdFALSE;
+    pxJob->pxNext = NULL;
+    pxJob->ulRuns = 0;
+    pxJob->xMaxRunTicks = 0;
+}
+
+/*-----------------------------------------------------------*/
+
+void vWorkJobSchedule( WorkJob_t * pxJob,
+                       uint32_t ulDelayMs )
+{
+    prvSchedule( pxJob, ulDelayMs, 0 );
+}
+
+/*-----------------------------------------------------------*/
+
+void vWorkJobSchedulePeriodic( WorkJob_t * pxJob,
+                               uint32_t ulDelayMs,
+                               uint32_t ulPeriodMs )
+{
+    configASSERT( ulPeriodMs > 0 );
+
+    prvSchedule( pxJob, ulDelayMs, ulPeriodMs );
+}
+
+/*-----------------------------------------------------------*/
+
+void vWorkJobCancel( WorkJob_t * pxJob )
+{
+    configASSERT( pxJob != NULL );
+
+    taskENTER_CRITICAL();
+    pxJob->xScheduled = pdFALSE;
+    taskEXIT_CRITICAL();
+}
+
+/*-----------------------------------------------------------*/
+
+void vWorkQueueInit( void )
+{
+    BaseType_t xResult;
+
+    configASSERT( xWorkerTask == NULL );
+
+    xResult = xTaskCreateStaticStack( prvWorkerTask, "Worker", TASK_STACK_WORKER, NULL,
+                                      WORK_QUEUE_TASK_PRIORITY, &xWorkerTask );
+    configASSERT( xResult == pdTRUE );
+}
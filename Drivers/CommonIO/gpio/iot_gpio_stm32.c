@@ -329,26 +329,15 @@ static void prvConfigFromPinState( IotGpioDescriptor_t * pxDescriptor )
  */
 static void prvPinEventHandler( uint16_t xPin_STM )
 {
-//    IotGpioHandle_t pxGpio = NULL;
-//    IotMappedPin_t * pxMappedPin = NULL;
-//
-//    for( int i = 0; i < IOT_COMMON_IO_GPIO_NUMBER_OF_PINS; i++ )
-//    {
-//        if( pxGpioMap[ pxGpioDesc[ i ].lGpioNumber ].xPinMask == xPin_STM )
-//        {
-//            pxGpio = &pxGpioDesc[ i ];
-//            pxMappedPin = &pxGpioMap[ pxGpioDesc[ i ].lGpioNumber ];
-//            break;
-//        }
-//    }
-//
-//    if( ( pxGpio != NULL ) && ( pxGpio->xUserCallback != NULL ) && ( pxGpio->xConfig.xInterruptMode != eGpioInterruptNone ) )
-//    {
-//        pxGpio->xUserCallback( (uint8_t)HAL_GPIO_ReadPin( pxMappedPin->xPort, pxMappedPin->xPinMask ), pxGpio->pvUserContext );
-//    }
+    /* Pins sharing an EXTI line are exclusive, so the line identifies the descriptor */
+    IotGpioDescriptor_t * pxGpio = interrupt_to_gpio_map[ POSITION_VAL( xPin_STM ) ];
 
+    if( ( pxGpio != NULL ) && ( pxGpio->xUserCallback != NULL ) && ( pxGpio->xConfig.xInterruptMode != eGpioInterruptNone ) )
+    {
+        IotMappedPin_t * pxMappedPin = &pxGpioMap[ pxGpio->lGpioNumber ];
 
-    // This implementation is horribly broken.
+        pxGpio->xUserCallback( ( uint8_t ) HAL_GPIO_ReadPin( pxMappedPin->xPort, pxMappedPin->xPinMask ), pxGpio->pvUserContext );
+    }
 }
 
 static void prvEnablePortClock( IotGpioHandle_t const pxGpio )
@@ -401,12 +390,17 @@ static void prvEnablePinInterrupt( IotGpioHandle_t const pxGpio )
 {
 	IotMappedPin_t * pxMappedPin = &pxGpioMap[ pxGpio->lGpioNumber ];
 
-	assert( PIN_VALUE( pxMappedPin->xPinMask ) < 16 );
+	assert( POSITION_VAL( pxMappedPin->xPinMask ) < 16 );
+
+	uint32_t ulLine = POSITION_VAL( pxMappedPin->xPinMask );
 
-	IRQn_Type xIRQn = EXTI0_IRQn + PIN_VALUE( pxMappedPin->xPinMask );
+	/* EXTI0_IRQn to EXTI15_IRQn are consecutive */
+	IRQn_Type xIRQn = ( IRQn_Type ) ( EXTI0_IRQn + ulLine );
 
 	assert( xIRQn >= EXTI0_IRQn );
-	assert( xIRQn >= EXTI15_IRQn );
+	assert( xIRQn <= EXTI15_IRQn );
+
+	interrupt_to_gpio_map[ ulLine ] = pxGpio;
 
 	HAL_NVIC_SetPriority(xIRQn, IOT_GPIO_INTERRUPT_PRIORITY, 0);
 	HAL_NVIC_EnableIRQ(xIRQn);
@@ -414,43 +408,15 @@ static void prvEnablePinInterrupt( IotGpioHandle_t const pxGpio )
 
 static void prvDisablePinInterrupt( IotGpioHandle_t const pxGpio )
 {
-    /* Skip this because interrupts are shared between pins with the same id */
-//	IotMappedPin_t * pxMappedPin = &pxGpioMap[ pxGpio->lGpioNumber ];
-//	switch( pxMappedPin->xPinMask )
-//	{
-//		case GPIO_PIN_0:
-//		    HAL_NVIC_DisableIRQ(EXTI0_IRQn);
-//		case GPIO_PIN_1:
-//		    HAL_NVIC_DisableIRQ(EXTI1_IRQn);
-//		case GPIO_PIN_2:
-//		    HAL_NVIC_DisableIRQ(EXTI2_IRQn);
-//		case GPIO_PIN_3:
-//		    HAL_NVIC_DisableIRQ(EXTI3_IRQn);
-//		case GPIO_PIN_4:
-//		    HAL_NVIC_DisableIRQ(EXTI4_IRQn);
-//		case GPIO_PIN_5:
-//		    HAL_NVIC_DisableIRQ(EXTI5_IRQn);
-//		case GPIO_PIN_6:
-//		    HAL_NVIC_DisableIRQ(EXTI6_IRQn);
-//		case GPIO_PIN_7:
-//		    HAL_NVIC_DisableIRQ(EXTI7_IRQn);
-//		case GPIO_PIN_8:
-//		    HAL_NVIC_DisableIRQ(EXTI8_IRQn);
-//		case GPIO_PIN_9:
-//		    HAL_NVIC_DisableIRQ(EXTI9_IRQn);
-//		case GPIO_PIN_10:
-//		    HAL_NVIC_DisableIRQ(EXTI10_IRQn);
-//		case GPIO_PIN_11:
-//		    HAL_NVIC_DisableIRQ(EXTI11_IRQn);
-//		case GPIO_PIN_12:
-//		    HAL_NVIC_DisableIRQ(EXTI12_IRQn);
-//		case GPIO_PIN_13:
-//		    HAL_NVIC_DisableIRQ(EXTI13_IRQn);
-//		case GPIO_PIN_14:
-//		    HAL_NVIC_DisableIRQ(EXTI14_IRQn);
-//		case GPIO_PIN_15:
-//		    HAL_NVIC_DisableIRQ(EXTI15_IRQn);
-//	}
+	IotMappedPin_t * pxMappedPin = &pxGpioMap[ pxGpio->lGpioNumber ];
+	uint32_t ulLine = POSITION_VAL( pxMappedPin->xPinMask );
+
+	/* Lines are shared between pins with the same number, only release the one owned by pxGpio */
+	if( interrupt_to_gpio_map[ ulLine ] == pxGpio )
+	{
+		HAL_NVIC_DisableIRQ( ( IRQn_Type ) ( EXTI0_IRQn + ulLine ) );
+		interrupt_to_gpio_map[ ulLine ] = NULL;
+	}
 }
 
 /*
@@ -643,7 +609,7 @@ int32_t iot_gpio_close( IotGpioHandle_t const pxGpio )
     	IotMappedPin_t * pxMappedPin = &pxGpioMap[ pxGpio->lGpioNumber ];
 
         pxGpio->ucState = IOT_GPIO_CLOSED;
-//        prvDisablePinInterrupt( pxGpio );
+        prvDisablePinInterrupt( pxGpio );
 //        HAL_GPIO_DeInit( pxMappedPin->xPort, pxMappedPin->xPinMask );
         pxGpio->xUserCallback = NULL;
         pxGpio->pvUserContext = NULL;
@@ -699,7 +665,6 @@ int32_t iot_gpio_ioctl( IotGpioHandle_t const pxGpio,
             case eSetGpioInterrupt:
                 memcpy( &xNewConfig.xInterruptMode, pvBuffer, sizeof( xNewConfig.xInterruptMode ) );
                 lReturnCode = prvConfigurePin( pxGpio, &xNewConfig );
-                /* TODO: Add to interrupt_to_gpio_map */
                 break;
 
             case eGetGpioInterrupt:
@@ -0,0 +1,829 @@
+/*
+ * FreeRTOS Common IO V0.1.3
+ * Copyright (C) 2022 Amazon.com, Inc. or its affiliates.  All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ * http://aws.amazon.com/freertos
+ * http://www.FreeRTOS.org
+ */
+
+/**
+ * @file iot_i2c_stm32u5.c
+ * @brief HAL i2c implementation on STM32U5 Discovery Board
+ *
+ * I2C2 is shared with the board support package, which initializes it and uses it
+ * for polled register accesses of the environmental sensors. This driver runs
+ * interrupt and DMA driven transfers on the same HAL handle and only starts them
+ * while the handle is idle.
+ */
+
+/* ST Board includes. */
+#include "stm32u5xx_hal.h"
+#include "stm32u5xx_hal_i2c.h"
+#include "stm32u5xx_hal_i2c_ex.h"
+#include "hw_defs.h"
+
+/* Main includes. */
+#include "iot_i2c.h"
+
+/* FreeRTOS includes. */
+#include "FreeRTOS.h"
+#include "task.h"
+#include "semphr.h"
+
+#define IOT_I2C_CLOSED                 ( ( uint8_t ) 0 )
+#define IOT_I2C_OPENED                 ( ( uint8_t ) 1 )
+#define IOT_I2C_DEFAULT_TIMEOUT_MS     ( ( uint32_t ) 100UL )
+
+/* Shorter asynchronous transfers use interrupts, for which the setup is cheaper than for DMA */
+#ifndef IOT_I2C_DMA_MIN_BYTES
+#define IOT_I2C_DMA_MIN_BYTES          8
+#endif
+
+/* Priority of the transmit DMA interrupt, same as the I2C2 and receive DMA interrupts set up in hal_init.c */
+#ifndef IOT_I2C_IRQ_PRIORITY
+#define IOT_I2C_IRQ_PRIORITY           5
+#endif
+
+/*
+ * I2C_TIMINGR values for a 160 MHz PCLK1 kernel clock with the analog filter enabled,
+ * assuming rise times of 300 ns (SM, FM) and 120 ns (FM+) for the on-board pull-ups.
+ * The resulting SCL low and high periods keep a margin over the minimum tLOW / tHIGH
+ * of the I2C specification: 4.8 / 4.35 us, 1.33 / 0.8 us and 0.5 / 0.3 us respectively.
+ */
+#ifndef IOT_I2C_TIMING_STANDARD_MODE
+#define IOT_I2C_TIMING_STANDARD_MODE   0x7042565FUL
+#endif
+
+#ifndef IOT_I2C_TIMING_FAST_MODE
+#define IOT_I2C_TIMING_FAST_MODE       0x30421F34UL
+#endif
+
+#ifndef IOT_I2C_TIMING_FAST_MODE_PLUS
+#define IOT_I2C_TIMING_FAST_MODE_PLUS  0x10401727UL
+#endif
+
+typedef enum
+{
+    eI2CXferRead,
+    eI2CXferWrite,
+    eI2CXferMemRead,
+    eI2CXferMemWrite,
+} I2CXferType_t;
+
+typedef struct IotI2CDescriptor
+{
+    I2C_HandleTypeDef * pxI2c;                     /* ST Handle, owned by the BSP */
+    DMA_HandleTypeDef * pxDmaTx;                   /* Transmit DMA, the receive DMA is set up by the MSP init */
+    IRQn_Type eDmaTxIrqNum;
+    IotI2CConfig_t xConfig;                        /* Master Configuration */
+    IotI2CCallback_t xI2CCallback;                 /* Callback function */
+    void * pvUserContext;                          /* User context passed in callback */
+    uint16_t usSlaveAddr;                          /* 7 bit slave address */
+    uint8_t ucSlaveAddrSet;
+    uint8_t sOpened;
+    volatile uint8_t ucBusy;                       /* A transfer of this driver is in progress */
+    volatile uint8_t ucSync;                       /* The transfer in progress is waited for by a task */
+    volatile IotI2COperationStatus_t xLastStatus;
+    uint16_t usXferBytes;
+    uint16_t usTxBytes;
+    uint16_t usRxBytes;
+    SemaphoreHandle_t xSemphr;
+    StaticSemaphore_t xSemphrBuffer;
+} IotI2CDescriptor_t;
+/*-----------------------------------------------------------*/
+
+static DMA_HandleTypeDef xI2c2DmaTx =
+{
+    .Instance                  = GPDMA1_Channel13,
+    .Init                      =
+    {
+        .Request               = GPDMA1_REQUEST_I2C2_TX,
+        .BlkHWRequest          = DMA_BREQ_SINGLE_BURST,
+        .Direction             = DMA_MEMORY_TO_PERIPH,
+        .SrcInc                = DMA_SINC_INCREMENTED,
+        .DestInc               = DMA_DINC_FIXED,
+        .SrcDataWidth          = DMA_SRC_DATAWIDTH_BYTE,
+        .DestDataWidth         = DMA_DEST_DATAWIDTH_BYTE,
+        .Priority              = DMA_LOW_PRIORITY_LOW_WEIGHT,
+        .SrcBurstLength        = 1,
+        .DestBurstLength       = 1,
+        .TransferAllocatedPort = DMA_SRC_ALLOCATED_PORT0 | DMA_DEST_ALLOCATED_PORT1,
+        .TransferEventMode     = DMA_TCEM_BLOCK_TRANSFER,
+        .Mode                  = DMA_NORMAL,
+    },
+};
+
+static IotI2CDescriptor_t xI2c2 =
+{
+    .pxI2c          = NULL,
+    .pxDmaTx        = &xI2c2DmaTx,
+    .eDmaTxIrqNum   = GPDMA1_Channel13_IRQn,
+    .xConfig        =
+    {
+        .ulMasterTimeout = IOT_I2C_DEFAULT_TIMEOUT_MS,
+        .ulBusFreq       = BUS_I2C2_FREQUENCY,
+    },
+    .xI2CCallback   = NULL,
+    .pvUserContext  = NULL,
+    .ucSlaveAddrSet = 0,
+    .sOpened        = IOT_I2C_CLOSED,
+    .xSemphr        = NULL,
+};
+
+/* Instance 0 would be I2C1, which is not routed on this board */
+static IotI2CHandle_t const pxI2cs[] = { NULL, &xI2c2 };
+/*-----------------------------------------------------------*/
+
+static IotI2CHandle_t prvGetHandle( I2C_HandleTypeDef * hi2c )
+{
+    IotI2CHandle_t xHandle = NULL;
+
+    for( size_t i = 0; i < sizeof( pxI2cs ) / sizeof( IotI2CHandle_t ); i++ )
+    {
+        if( ( pxI2cs[ i ] != NULL ) &&
+            ( pxI2cs[ i ]->sOpened == IOT_I2C_OPENED ) &&
+            ( pxI2cs[ i ]->pxI2c == hi2c ) )
+        {
+            xHandle = pxI2cs[ i ];
+        }
+    }
+
+    return xHandle;
+}
+/*-----------------------------------------------------------*/
+
+static HAL_StatusTypeDef prvInitDma( IotI2CHandle_t const pxI2CPeripheral )
+{
+    HAL_StatusTypeDef xResult;
+
+    __HAL_RCC_GPDMA1_CLK_ENABLE();
+
+    xResult = HAL_DMA_Init( pxI2CPeripheral->pxDmaTx );
+
+    if( xResult == HAL_OK )
+    {
+        xResult = HAL_DMA_ConfigChannelAttributes( pxI2CPeripheral->pxDmaTx, DMA_CHANNEL_NPRIV );
+    }
+
+    if( xResult == HAL_OK )
+    {
+        __HAL_LINKDMA( pxI2CPeripheral->pxI2c, hdmatx, *( pxI2CPeripheral->pxDmaTx ) );
+
+        HAL_NVIC_SetPriority( pxI2CPeripheral->eDmaTxIrqNum, IOT_I2C_IRQ_PRIORITY, 0 );
+        HAL_NVIC_EnableIRQ( pxI2CPeripheral->eDmaTxIrqNum );
+    }
+
+    return xResult;
+}
+/*-----------------------------------------------------------*/
+
+static void prvDeInitDma( IotI2CHandle_t const pxI2CPeripheral )
+{
+    HAL_NVIC_DisableIRQ( pxI2CPeripheral->eDmaTxIrqNum );
+
+    ( void ) HAL_DMA_DeInit( pxI2CPeripheral->pxDmaTx );
+
+    pxI2CPeripheral->pxI2c->hdmatx = NULL;
+}
+/*-----------------------------------------------------------*/
+
+static uint32_t prvTimingForFreq( uint32_t ulBusFreq )
+{
+    uint32_t ulTiming;
+
+    switch( ulBusFreq )
+    {
+        case IOT_I2C_STANDARD_MODE_BPS:
+            ulTiming = IOT_I2C_TIMING_STANDARD_MODE;
+            break;
+
+        case IOT_I2C_FAST_MODE_BPS:
+            ulTiming = IOT_I2C_TIMING_FAST_MODE;
+            break;
+
+        case IOT_I2C_FAST_MODE_PLUS_BPS:
+            ulTiming = IOT_I2C_TIMING_FAST_MODE_PLUS;
+            break;
+
+        default:
+            ulTiming = 0;
+            break;
+    }
+
+    return ulTiming;
+}
+/*-----------------------------------------------------------*/
+
+/* Called with the scheduler suspended and the handle idle */
+static int32_t prvSetBusFreq( IotI2CHandle_t const pxI2CPeripheral,
+                              uint32_t ulBusFreq )
+{
+    I2C_HandleTypeDef * pxI2c = pxI2CPeripheral->pxI2c;
+    uint32_t ulFastModePlus = ( ulBusFreq == IOT_I2C_FAST_MODE_PLUS_BPS ) ?
+                              I2C_FASTMODEPLUS_ENABLE : I2C_FASTMODEPLUS_DISABLE;
+    int32_t lError = IOT_I2C_SUCCESS;
+
+    /* TIMINGR is only writable while the peripheral is disabled */
+    __HAL_I2C_DISABLE( pxI2c );
+    pxI2c->Init.Timing = prvTimingForFreq( ulBusFreq );
+    pxI2c->Instance->TIMINGR = pxI2c->Init.Timing;
+    __HAL_I2C_ENABLE( pxI2c );
+
+    /* Also switches the SCL / SDA drivers to the 20 mA of fast mode plus */
+    if( HAL_I2CEx_ConfigFastModePlus( pxI2c, ulFastModePlus ) != HAL_OK )
+    {
+        lError = IOT_I2C_INVALID_VALUE;
+    }
+    else
+    {
+        pxI2CPeripheral->xConfig.ulBusFreq = ulBusFreq;
+    }
+
+    return lError;
+}
+/*-----------------------------------------------------------*/
+
+/*
+ * The BSP serializes its own transfers with a mutex that is not exported, and its
+ * polled transfers leave the HAL handle busy for their whole duration. Transfers
+ * are therefore only started while the handle is idle, with the scheduler suspended
+ * so that no BSP transfer can start in between.
+ */
+static int32_t prvStartTransfer( IotI2CHandle_t const pxI2CPeripheral,
+                                 I2CXferType_t xType,
+                                 uint8_t ucRegister,
+                                 uint8_t * const pucBuffer,
+                                 size_t xBytes )
+{
+    I2C_HandleTypeDef * pxI2c = pxI2CPeripheral->pxI2c;
+    uint16_t usAddr = ( uint16_t ) ( pxI2CPeripheral->usSlaveAddr << 1 );
+    uint16_t usBytes = ( uint16_t ) xBytes;
+    uint8_t ucIsRead = ( ( xType == eI2CXferRead ) || ( xType == eI2CXferMemRead ) ) ? 1 : 0;
+    DMA_HandleTypeDef * pxDma = ( ucIsRead == 1 ) ? pxI2c->hdmarx : pxI2c->hdmatx;
+    uint8_t ucUseDma = ( ( pxDma != NULL ) && ( xBytes >= IOT_I2C_DMA_MIN_BYTES ) ) ? 1 : 0;
+    HAL_StatusTypeDef xResult = HAL_BUSY;
+    int32_t lError = IOT_I2C_SUCCESS;
+
+    if( ( pucBuffer == NULL ) || ( xBytes == 0 ) || ( xBytes > UINT16_MAX ) )
+    {
+        lError = IOT_I2C_INVALID_VALUE;
+    }
+    else if( pxI2CPeripheral->ucSlaveAddrSet == 0 )
+    {
+        lError = IOT_I2C_SLAVE_ADDRESS_NOT_SET;
+    }
+    else
+    {
+        vTaskSuspendAll();
+        {
+            if( ( pxI2CPeripheral->ucBusy == 0 ) &&
+                ( HAL_I2C_GetState( pxI2c ) == HAL_I2C_STATE_READY ) )
+            {
+                pxI2CPeripheral->ucBusy = 1;
+                pxI2CPeripheral->usXferBytes = usBytes;
+
+                switch( xType )
+                {
+                    case eI2CXferRead:
+                        xResult = ( ucUseDma == 1 ) ?
+                                  HAL_I2C_Master_Receive_DMA( pxI2c, usAddr, pucBuffer, usBytes ) :
+                                  HAL_I2C_Master_Receive_IT( pxI2c, usAddr, pucBuffer, usBytes );
+                        break;
+
+                    case eI2CXferWrite:
+                        xResult = ( ucUseDma == 1 ) ?
+                                  HAL_I2C_Master_Transmit_DMA( pxI2c, usAddr, pucBuffer, usBytes ) :
+                                  HAL_I2C_Master_Transmit_IT( pxI2c, usAddr, pucBuffer, usBytes );
+                        break;
+
+                    case eI2CXferMemRead:
+                        xResult = ( ucUseDma == 1 ) ?
+                                  HAL_I2C_Mem_Read_DMA( pxI2c, usAddr, ucRegister, I2C_MEMADD_SIZE_8BIT, pucBuffer, usBytes ) :
+                                  HAL_I2C_Mem_Read_IT( pxI2c, usAddr, ucRegister, I2C_MEMADD_SIZE_8BIT, pucBuffer, usBytes );
+                        break;
+
+                    case eI2CXferMemWrite:
+                        xResult = ( ucUseDma == 1 ) ?
+                                  HAL_I2C_Mem_Write_DMA( pxI2c, usAddr, ucRegister, I2C_MEMADD_SIZE_8BIT, pucBuffer, usBytes ) :
+                                  HAL_I2C_Mem_Write_IT( pxI2c, usAddr, ucRegister, I2C_MEMADD_SIZE_8BIT, pucBuffer, usBytes );
+                        break;
+
+                    default:
+                        xResult = HAL_ERROR;
+                        break;
+                }
+
+                if( xResult != HAL_OK )
+                {
+                    pxI2CPeripheral->ucBusy = 0;
+                }
+            }
+        }
+        ( void ) xTaskResumeAll();
+
+        if( xResult == HAL_BUSY )
+        {
+            lError = IOT_I2C_BUSY;
+        }
+        else if( xResult != HAL_OK )
+        {
+            lError = ( ucIsRead == 1 ) ? IOT_I2C_READ_FAILED : IOT_I2C_WRITE_FAILED;
+        }
+    }
+
+    return lError;
+}
+/*-----------------------------------------------------------*/
+
+static int32_t prvTransferSync( IotI2CHandle_t const pxI2CPeripheral,
+                                I2CXferType_t xType,
+                                uint8_t ucRegister,
+                                uint8_t * const pucBuffer,
+                                size_t xBytes )
+{
+    int32_t lError = IOT_I2C_SUCCESS;
+
+    if( ( pxI2CPeripheral == NULL ) || ( pxI2CPeripheral->sOpened == IOT_I2C_CLOSED ) )
+    {
+        lError = IOT_I2C_INVALID_VALUE;
+    }
+    else
+    {
+        /* Drop a completion left over from a transfer that timed out */
+        ( void ) xSemaphoreTake( pxI2CPeripheral->xSemphr, 0 );
+
+        pxI2CPeripheral->ucSync = 1;
+
+        lError = prvStartTransfer( pxI2CPeripheral, xType, ucRegister, pucBuffer, xBytes );
+
+        if( lError != IOT_I2C_SUCCESS )
+        {
+            pxI2CPeripheral->ucSync = 0;
+        }
+        else if( xSemaphoreTake( pxI2CPeripheral->xSemphr,
+                                 pdMS_TO_TICKS( pxI2CPeripheral->xConfig.ulMasterTimeout ) ) == pdFALSE )
+        {
+            pxI2CPeripheral->ucSync = 0;
+            ( void ) HAL_I2C_Master_Abort_IT( pxI2CPeripheral->pxI2c, ( uint16_t ) ( pxI2CPeripheral->usSlaveAddr << 1 ) );
+            lError = IOT_I2C_BUS_TIMEOUT;
+        }
+        else
+        {
+            switch( pxI2CPeripheral->xLastStatus )
+            {
+                case eI2CCompleted:
+                    lError = IOT_I2C_SUCCESS;
+                    break;
+
+                case eI2CNackFromSlave:
+                    lError = IOT_I2C_NACK;
+                    break;
+
+                case eI2CMasterTimeout:
+                    lError = IOT_I2C_BUS_TIMEOUT;
+                    break;
+
+                default:
+                    lError = ( ( xType == eI2CXferRead ) || ( xType == eI2CXferMemRead ) ) ?
+                             IOT_I2C_READ_FAILED : IOT_I2C_WRITE_FAILED;
+                    break;
+            }
+        }
+    }
+
+    return lError;
+}
+/*-----------------------------------------------------------*/
+
+static int32_t prvTransferAsync( IotI2CHandle_t const pxI2CPeripheral,
+                                 I2CXferType_t xType,
+                                 uint8_t ucRegister,
+                                 uint8_t * const pucBuffer,
+                                 size_t xBytes )
+{
+    int32_t lError;
+
+    if( ( pxI2CPeripheral == NULL ) || ( pxI2CPeripheral->sOpened == IOT_I2C_CLOSED ) )
+    {
+        lError = IOT_I2C_INVALID_VALUE;
+    }
+    else
+    {
+        pxI2CPeripheral->ucSync = 0;
+
+        lError = prvStartTransfer( pxI2CPeripheral, xType, ucRegister, pucBuffer, xBytes );
+    }
+
+    return lError;
+}
+/*-----------------------------------------------------------*/
+
+static void prvHandleCompletion( I2C_HandleTypeDef * hi2c,
+                                 IotI2COperationStatus_t xStatus,
+                                 uint8_t ucIsRead )
+{
+    IotI2CHandle_t xHandle = prvGetHandle( hi2c );
+    BaseType_t xHigherPriorityTaskWoken = pdFALSE;
+
+    /* Completions of BSP transfers and of aborted transfers end up here as well */
+    if( ( xHandle != NULL ) && ( xHandle->ucBusy == 1 ) )
+    {
+        uint16_t usBytes = ( xStatus == eI2CCompleted ) ? xHandle->usXferBytes : 0;
+
+        if( ucIsRead == 1 )
+        {
+            xHandle->usRxBytes = usBytes;
+        }
+        else
+        {
+            xHandle->usTxBytes = usBytes;
+        }
+
+        xHandle->xLastStatus = xStatus;
+        xHandle->ucBusy = 0;
+
+        if( xHandle->ucSync == 1 )
+        {
+            xHandle->ucSync = 0;
+            ( void ) xSemaphoreGiveFromISR( xHandle->xSemphr, &xHigherPriorityTaskWoken );
+        }
+        else if( xHandle->xI2CCallback != NULL )
+        {
+            xHandle->xI2CCallback( xStatus, xHandle->pvUserContext );
+        }
+    }
+
+    portYIELD_FROM_ISR( xHigherPriorityTaskWoken );
+}
+/*-----------------------------------------------------------*/
+
+static IotI2COperationStatus_t prvErrorToStatus( uint32_t ulHalError )
+{
+    IotI2COperationStatus_t xStatus;
+
+    if( ( ulHalError & HAL_I2C_ERROR_AF ) != 0 )
+    {
+        xStatus = eI2CNackFromSlave;
+    }
+    else if( ( ulHalError & HAL_I2C_ERROR_ARLO ) != 0 )
+    {
+        xStatus = eI2CBusLost;
+    }
+    else if( ( ulHalError & HAL_I2C_ERROR_TIMEOUT ) != 0 )
+    {
+        xStatus = eI2CMasterTimeout;
+    }
+    else
+    {
+        xStatus = eI2CDriverFailed;
+    }
+
+    return xStatus;
+}
+
+/*--------------------API Implementation---------------------*/
+
+IotI2CHandle_t iot_i2c_open( int32_t lI2CInstance )
+{
+    IotI2CHandle_t xHandle = NULL;
+
+    if( ( lI2CInstance >= 0 ) && ( lI2CInstance < sizeof( pxI2cs ) / sizeof( IotI2CHandle_t ) ) )
+    {
+        xHandle = pxI2cs[ lI2CInstance ];
+    }
+
+    if( ( xHandle == NULL ) || ( xHandle->sOpened == IOT_I2C_OPENED ) )
+    {
+        xHandle = NULL;
+    }
+    else if( pxHndlI2c2 == NULL )
+    {
+        /* BSP_I2C2_Init has not run yet */
+        xHandle = NULL;
+    }
+    else
+    {
+        xHandle->pxI2c = pxHndlI2c2;
+
+        if( xHandle->xSemphr == NULL )
+        {
+            xHandle->xSemphr = xSemaphoreCreateBinaryStatic( &( xHandle->xSemphrBuffer ) );
+        }
+
+        if( prvInitDma( xHandle ) != HAL_OK )
+        {
+            xHandle = NULL;
+        }
+        else
+        {
+            xHandle->ucBusy = 0;
+            xHandle->ucSync = 0;
+            xHandle->ucSlaveAddrSet = 0;
+            xHandle->usTxBytes = 0;
+            xHandle->usRxBytes = 0;
+            xHandle->sOpened = IOT_I2C_OPENED;
+        }
+    }
+
+    return xHandle;
+}
+/*-----------------------------------------------------------*/
+
+void iot_i2c_set_callback( IotI2CHandle_t const pxI2CPeripheral,
+                           IotI2CCallback_t xCallback,
+                           void * pvUserContext )
+{
+    if( pxI2CPeripheral != NULL )
+    {
+        pxI2CPeripheral->xI2CCallback = xCallback;
+        pxI2CPeripheral->pvUserContext = pvUserContext;
+    }
+}
+/*-----------------------------------------------------------*/
+
+int32_t iot_i2c_read_sync( IotI2CHandle_t const pxI2CPeripheral,
+                           uint8_t * const pucBuffer,
+                           size_t xBytes )
+{
+    return prvTransferSync( pxI2CPeripheral, eI2CXferRead, 0, pucBuffer, xBytes );
+}
+/*-----------------------------------------------------------*/
+
+int32_t iot_i2c_write_sync( IotI2CHandle_t const pxI2CPeripheral,
+                            uint8_t * const pucBuffer,
+                            size_t xBytes )
+{
+    return prvTransferSync( pxI2CPeripheral, eI2CXferWrite, 0, pucBuffer, xBytes );
+}
+/*-----------------------------------------------------------*/
+
+int32_t iot_i2c_read_async( IotI2CHandle_t const pxI2CPeripheral,
+                            uint8_t * const pucBuffer,
+                            size_t xBytes )
+{
+    return prvTransferAsync( pxI2CPeripheral, eI2CXferRead, 0, pucBuffer, xBytes );
+}
+/*-----------------------------------------------------------*/
+
+int32_t iot_i2c_write_async( IotI2CHandle_t const pxI2CPeripheral,
+                             uint8_t * const pucBuffer,
+                             size_t xBytes )
+{
+    return prvTransferAsync( pxI2CPeripheral, eI2CXferWrite, 0, pucBuffer, xBytes );
+}
+/*-----------------------------------------------------------*/
+
+int32_t iot_i2c_mem_read_async( IotI2CHandle_t const pxI2CPeripheral,
+                                uint8_t ucRegister,
+                                uint8_t * const pucBuffer,
+                                size_t xBytes )
+{
+    return prvTransferAsync( pxI2CPeripheral, eI2CXferMemRead, ucRegister, pucBuffer, xBytes );
+}
+/*-----------------------------------------------------------*/
+
+int32_t iot_i2c_mem_read_sync( IotI2CHandle_t const pxI2CPeripheral,
+                               uint8_t ucRegister,
+                               uint8_t * const pucBuffer,
+                               size_t xBytes )
+{
+    return prvTransferSync( pxI2CPeripheral, eI2CXferMemRead, ucRegister, pucBuffer, xBytes );
+}
+/*-----------------------------------------------------------*/
+
+int32_t iot_i2c_mem_write_sync( IotI2CHandle_t const pxI2CPeripheral,
+                                uint8_t ucRegister,
+                                uint8_t * const pucBuffer,
+                                size_t xBytes )
+{
+    return prvTransferSync( pxI2CPeripheral, eI2CXferMemWrite, ucRegister, pucBuffer, xBytes );
+}
+/*-----------------------------------------------------------*/
+
+int32_t iot_i2c_ioctl( IotI2CHandle_t const pxI2CPeripheral,
+                       IotI2CIoctlRequest_t xI2CRequest,
+                       void * const pvBuffer )
+{
+    int32_t lError = IOT_I2C_SUCCESS;
+
+    if( ( pxI2CPeripheral == NULL ) || ( pxI2CPeripheral->sOpened == IOT_I2C_CLOSED ) )
+    {
+        lError = IOT_I2C_INVALID_VALUE;
+    }
+    else if( ( pvBuffer == NULL ) &&
+             ( xI2CRequest != eI2CSendNoStopFlag ) &&
+             ( xI2CRequest != eI2CBusReset ) )
+    {
+        lError = IOT_I2C_INVALID_VALUE;
+    }
+    else
+    {
+        switch( xI2CRequest )
+        {
+            case eI2CSetSlaveAddr:
+               {
+                   uint16_t usAddr = *( ( uint16_t * ) pvBuffer );
+
+                   if( usAddr > 0x7FU )
+                   {
+                       lError = IOT_I2C_INVALID_VALUE;
+                   }
+                   else
+                   {
+                       pxI2CPeripheral->usSlaveAddr = usAddr;
+                       pxI2CPeripheral->ucSlaveAddrSet = 1;
+                   }
+
+                   break;
+               }
+
+            case eI2CSetMasterConfig:
+               {
+                   IotI2CConfig_t * pxConfig = ( IotI2CConfig_t * ) pvBuffer;
+
+                   if( prvTimingForFreq( pxConfig->ulBusFreq ) == 0 )
+                   {
+                       lError = IOT_I2C_INVALID_VALUE;
+                   }
+                   else
+                   {
+                       if( pxConfig->ulBusFreq != pxI2CPeripheral->xConfig.ulBusFreq )
+                       {
+                           vTaskSuspendAll();
+                           {
+                               if( ( pxI2CPeripheral->ucBusy == 1 ) ||
+                                   ( HAL_I2C_GetState( pxI2CPeripheral->pxI2c ) != HAL_I2C_STATE_READY ) )
+                               {
+                                   lError = IOT_I2C_BUSY;
+                               }
+                               else
+                               {
+                                   lError = prvSetBusFreq( pxI2CPeripheral, pxConfig->ulBusFreq );
+                               }
+                           }
+                           ( void ) xTaskResumeAll();
+                       }
+
+                       if( lError == IOT_I2C_SUCCESS )
+                       {
+                           pxI2CPeripheral->xConfig.ulMasterTimeout = pxConfig->ulMasterTimeout;
+                       }
+                   }
+
+                   break;
+               }
+
+            case eI2CGetMasterConfig:
+                *( ( IotI2CConfig_t * ) pvBuffer ) = pxI2CPeripheral->xConfig;
+                break;
+
+            case eI2CGetBusState:
+                *( ( IotI2CBusStatus_t * ) pvBuffer ) =
+                    ( ( pxI2CPeripheral->ucBusy == 1 ) ||
+                      ( HAL_I2C_GetState( pxI2CPeripheral->pxI2c ) != HAL_I2C_STATE_READY ) ) ? eI2cBusBusy : eI2CBusIdle;
+                break;
+
+            case eI2CGetTxNoOfbytes:
+                *( ( uint16_t * ) pvBuffer ) = pxI2CPeripheral->usTxBytes;
+                break;
+
+            case eI2CGetRxNoOfbytes:
+                *( ( uint16_t * ) pvBuffer ) = pxI2CPeripheral->usRxBytes;
+                break;
+
+            case eI2CSendNoStopFlag:
+            case eI2CBusReset:
+            default:
+                lError = IOT_I2C_FUNCTION_NOT_SUPPORTED;
+                break;
+        }
+    }
+
+    return lError;
+}
+/*-----------------------------------------------------------*/
+
+int32_t iot_i2c_cancel( IotI2CHandle_t const pxI2CPeripheral )
+{
+    int32_t lError = IOT_I2C_SUCCESS;
+
+    if( ( pxI2CPeripheral == NULL ) || ( pxI2CPeripheral->sOpened == IOT_I2C_CLOSED ) )
+    {
+        lError = IOT_I2C_INVALID_VALUE;
+    }
+    else if( pxI2CPeripheral->ucBusy == 0 )
+    {
+        lError = IOT_I2C_NOTHING_TO_CANCEL;
+    }
+    else if( HAL_I2C_Master_Abort_IT( pxI2CPeripheral->pxI2c,
+                                      ( uint16_t ) ( pxI2CPeripheral->usSlaveAddr << 1 ) ) != HAL_OK )
+    {
+        /* The transfer completed meanwhile */
+        lError = IOT_I2C_NOTHING_TO_CANCEL;
+    }
+
+    return lError;
+}
+/*-----------------------------------------------------------*/
+
+int32_t iot_i2c_close( IotI2CHandle_t const pxI2CPeripheral )
+{
+    int32_t lError = IOT_I2C_SUCCESS;
+
+    if( ( pxI2CPeripheral == NULL ) || ( pxI2CPeripheral->sOpened == IOT_I2C_CLOSED ) )
+    {
+        lError = IOT_I2C_INVALID_VALUE;
+    }
+    else
+    {
+        ( void ) iot_i2c_cancel( pxI2CPeripheral );
+
+        /* Leave the bus as the BSP configured it */
+        if( pxI2CPeripheral->xConfig.ulBusFreq != BUS_I2C2_FREQUENCY )
+        {
+            vTaskSuspendAll();
+            {
+                if( HAL_I2C_GetState( pxI2CPeripheral->pxI2c ) == HAL_I2C_STATE_READY )
+                {
+                    ( void ) prvSetBusFreq( pxI2CPeripheral, BUS_I2C2_FREQUENCY );
+                }
+            }
+            ( void ) xTaskResumeAll();
+        }
+
+        prvDeInitDma( pxI2CPeripheral );
+
+        pxI2CPeripheral->xI2CCallback = NULL;
+        pxI2CPeripheral->pvUserContext = NULL;
+        pxI2CPeripheral->sOpened = IOT_I2C_CLOSED;
+    }
+
+    return lError;
+}
+/*-----------------------------------------------------------*/
+
+void HAL_I2C_MasterTxCpltCallback( I2C_HandleTypeDef * hi2c )
+{
+    prvHandleCompletion( hi2c, eI2CCompleted, 0 );
+}
+/*-----------------------------------------------------------*/
+
+void HAL_I2C_MasterRxCpltCallback( I2C_HandleTypeDef * hi2c )
+{
+    prvHandleCompletion( hi2c, eI2CCompleted, 1 );
+}
+/*-----------------------------------------------------------*/
+
+void HAL_I2C_MemTxCpltCallback( I2C_HandleTypeDef * hi2c )
+{
+    prvHandleCompletion( hi2c, eI2CCompleted, 0 );
+}
+/*-----------------------------------------------------------*/
+
+void HAL_I2C_MemRxCpltCallback( I2C_HandleTypeDef * hi2c )
+{
+    prvHandleCompletion( hi2c, eI2CCompleted, 1 );
+}
+/*-----------------------------------------------------------*/
+
+void HAL_I2C_ErrorCallback( I2C_HandleTypeDef * hi2c )
+{
+    prvHandleCompletion( hi2c, prvErrorToStatus( HAL_I2C_GetError( hi2c ) ), 0 );
+}
+/*-----------------------------------------------------------*/
+
+/* Ends transfers cancelled or timed out by this driver, without a callback */
+void HAL_I2C_AbortCpltCallback( I2C_HandleTypeDef * hi2c )
+{
+    IotI2CHandle_t xHandle = prvGetHandle( hi2c );
+
+    if( xHandle != NULL )
+    {
+        xHandle->xLastStatus = eI2CDriverFailed;
+        xHandle->ucSync = 0;
+        xHandle->ucBusy = 0;
+    }
+}
+/*-----------------------------------------------------------*/
+
+void GPDMA1_Channel13_IRQHandler( void )
+{
+    HAL_DMA_IRQHandler( &xI2c2DmaTx );
+}
@@ -0,0 +1,313 @@
+/*
+ * FreeRTOS Common IO V0.1.3
+ * Copyright (C) 2020 Amazon.com, Inc. or its affiliates.  All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ * http://aws.amazon.com/freertos
+ * http://www.FreeRTOS.org
+ */
+
+/**
+ * @file iot_i2c.h
+ * @brief File for the APIs of I2C called by application layer.
+ */
+#ifndef _IOT_I2C_H_
+#define _IOT_I2C_H_
+
+/* Standard includes. */
+#include <stdint.h>
+#include <stddef.h>
+
+/**
+ * @defgroup iot_i2c I2C Abstraction APIs.
+ * @{
+ */
+
+/**
+ * @brief The return codes for the methods in I2C.
+ */
+#define IOT_I2C_SUCCESS                   ( 0 ) /*!< I2C operation completed successfully. */
+#define IOT_I2C_INVALID_VALUE             ( 1 ) /*!< At least one parameter is invalid. */
+#define IOT_I2C_BUSY                      ( 2 ) /*!< I2C bus is busy at current time. */
+#define IOT_I2C_WRITE_FAILED              ( 3 ) /*!< I2C driver returns error when performing write operation. */
+#define IOT_I2C_READ_FAILED               ( 4 ) /*!< I2C driver returns error when performing read operation. */
+#define IOT_I2C_NACK                      ( 5 ) /*!< Unexpected NACK is caught. */
+#define IOT_I2C_BUS_TIMEOUT               ( 6 ) /*!< I2C operation not completed within specified timeout. */
+#define IOT_I2C_NOTHING_TO_CANCEL         ( 7 ) /*!< No ongoing operation when cancel operation is performed. */
+#define IOT_I2C_FUNCTION_NOT_SUPPORTED    ( 8 ) /*!< I2C operation is not supported. */
+#define IOT_I2C_SLAVE_ADDRESS_NOT_SET     ( 9 ) /*!< Slave address is not set before calling Read/Write operation. */
+
+/**
+ * @brief Bus frequencies accepted in IotI2CConfig_t::ulBusFreq.
+ */
+#define IOT_I2C_STANDARD_MODE_BPS         ( 100000 )  /*!< Standard mode bits per second. */
+#define IOT_I2C_FAST_MODE_BPS             ( 400000 )  /*!< Fast mode bits per second. */
+#define IOT_I2C_FAST_MODE_PLUS_BPS        ( 1000000 ) /*!< Fast mode plus bits per second. */
+
+/**
+ * @brief I2C Bus status
+ */
+typedef enum
+{
+    eI2CBusIdle = 0,         /*!< I2C bus is idle. */
+    eI2cBusBusy = IOT_I2C_BUSY, /*!< I2C bus is busy. */
+} IotI2CBusStatus_t;
+
+/**
+ * @brief I2C operation status.
+ */
+typedef enum
+{
+    eI2CCompleted = IOT_I2C_SUCCESS,  /*!< I2C operation completed successfully. */
+    eI2CDriverFailed,                 /*!< I2C driver returns error during last operation. */
+    eI2CNackFromSlave,                /*!< Unexpected NACK is caught. */
+    eI2CMasterTimeout,                /*!< I2C operation not completed within specified timeout. */
+    eI2CBusLost,                      /*!< Arbitration was lost. */
+} IotI2COperationStatus_t;
+
+/**
+ * @brief I2C bus configuration.
+ */
+typedef struct IotI2CConfig
+{
+    uint32_t ulMasterTimeout; /*!< Master timeout value in msec, used by the synchronous functions. */
+    uint32_t ulBusFreq;       /*!< Bus frequency/baud rate, one of the IOT_I2C_*_BPS values. */
+} IotI2CConfig_t;
+
+/**
+ * @brief Ioctl request types.
+ */
+typedef enum
+{
+    eI2CSendNoStopFlag,  /*!< Not supported, use iot_i2c_mem_read_async() for register reads. */
+    eI2CSetSlaveAddr,    /*!< Sets the 7 bit slave address with a uint16_t. */
+    eI2CSetMasterConfig, /*!< Sets the bus configuration with a IotI2CConfig_t. */
+    eI2CGetMasterConfig, /*!< Gets the bus configuration in a IotI2CConfig_t. */
+    eI2CGetBusState,     /*!< Gets the bus state in a IotI2CBusStatus_t. */
+    eI2CBusReset,        /*!< Not supported. */
+    eI2CGetTxNoOfbytes,  /*!< Gets the number of bytes sent in the last write in a uint16_t. */
+    eI2CGetRxNoOfbytes,  /*!< Gets the number of bytes received in the last read in a uint16_t. */
+} IotI2CIoctlRequest_t;
+
+/**
+ * @brief I2C descriptor type defined in the source file.
+ */
+struct IotI2CDescriptor;
+
+/**
+ * @brief IotI2CHandle_t type is the I2C handle returned by calling iot_i2c_open()
+ *        this is initialized in open and returned to caller. Caller must pass this pointer
+ *        to the rest of the APIs.
+ */
+typedef struct IotI2CDescriptor * IotI2CHandle_t;
+
+/**
+ * @brief The callback function for completion of I2C operation.
+ *
+ * @param[out] xOpStatus    I2C asynchronous operation status.
+ * @param[in] pvUserContext User Context passed when setting the callback.
+ */
+typedef void ( * IotI2CCallback_t )( IotI2COperationStatus_t xOpStatus,
+                                     void * pvUserContext );
+
+/**
+ * @brief Initiates and reserves an I2C instance as master.
+ *
+ * The bus itself is initialized by the board support code, which keeps using it for
+ * polled transfers. Transfers of this driver start only while the bus is idle.
+ *
+ * @param[in] lI2CInstance The instance of I2C to initialize, 1 for I2C2.
+ *
+ * @return
+ * - The handle, on success
+ * - NULL, if the instance is invalid, already open or its bus is not initialized
+ */
+IotI2CHandle_t iot_i2c_open( int32_t lI2CInstance );
+
+/**
+ * @brief Sets the application callback to be called on completion of an operation.
+ *
+ * The callback is invoked from the interrupt, when an asynchronous operation completes
+ * either successfully or with an error.
+ *
+ * @param[in] pxI2CPeripheral The I2C peripheral handle returned in open() call.
+ * @param[in] xCallback The callback function to be called on completion of transaction.
+ * @param[in] pvUserContext The user context to be passed back when callback is called.
+ */
+void iot_i2c_set_callback( IotI2CHandle_t const pxI2CPeripheral,
+                           IotI2CCallback_t xCallback,
+                           void * pvUserContext );
+
+/**
+ * @brief Starts the I2C master read operation in synchronous mode.
+ *
+ * The calling task blocks on a semaphore, without the CPU polling the bus.
+ *
+ * @param[in] pxI2CPeripheral The I2C peripheral handle returned in open() call.
+ * @param[out] pucBuffer The receive buffer to read the data into.
+ * @param[in] xBytes The number of bytes to read.
+ *
+ * @return
+ * - IOT_I2C_SUCCESS, on success
+ * - IOT_I2C_INVALID_VALUE, if a parameter is invalid
+ * - IOT_I2C_SLAVE_ADDRESS_NOT_SET, if the slave address is not set
+ * - IOT_I2C_BUSY, if the bus is busy
+ * - IOT_I2C_NACK, if the slave did not acknowledge
+ * - IOT_I2C_BUS_TIMEOUT, if the transfer did not complete within ulMasterTimeout
+ * - IOT_I2C_READ_FAILED, on any other driver error
+ */
+int32_t iot_i2c_read_sync( IotI2CHandle_t const pxI2CPeripheral,
+                           uint8_t * const pucBuffer,
+                           size_t xBytes );
+
+/**
+ * @brief Starts the I2C master write operation in synchronous mode.
+ *
+ * @param[in] pxI2CPeripheral The I2C peripheral handle returned in open() call.
+ * @param[in] pucBuffer The transmit buffer containing the data to be written.
+ * @param[in] xBytes The number of bytes to write.
+ *
+ * @return The same values as iot_i2c_read_sync(), with IOT_I2C_WRITE_FAILED for other errors.
+ */
+int32_t iot_i2c_write_sync( IotI2CHandle_t const pxI2CPeripheral,
+                            uint8_t * const pucBuffer,
+                            size_t xBytes );
+
+/**
+ * @brief Starts the I2C master read operation in asynchronous mode.
+ *
+ * Transfers of at least IOT_I2C_DMA_MIN_BYTES run on DMA. The callback reports the completion.
+ *
+ * @param[in] pxI2CPeripheral The I2C peripheral handle returned in open() call.
+ * @param[out] pucBuffer The receive buffer to read the data into.
+ * @param[in] xBytes The number of bytes to read.
+ *
+ * @return
+ * - IOT_I2C_SUCCESS, on success
+ * - IOT_I2C_INVALID_VALUE, if a parameter is invalid
+ * - IOT_I2C_SLAVE_ADDRESS_NOT_SET, if the slave address is not set
+ * - IOT_I2C_BUSY, if the bus is busy
+ * - IOT_I2C_READ_FAILED, if the transfer could not be started
+ */
+int32_t iot_i2c_read_async( IotI2CHandle_t const pxI2CPeripheral,
+                            uint8_t * const pucBuffer,
+                            size_t xBytes );
+
+/**
+ * @brief Starts the I2C master write operation in asynchronous mode.
+ *
+ * @param[in] pxI2CPeripheral The I2C peripheral handle returned in open() call.
+ * @param[in] pucBuffer The transmit buffer containing the data to be written.
+ * @param[in] xBytes The number of bytes to write.
+ *
+ * @return The same values as iot_i2c_read_async(), with IOT_I2C_WRITE_FAILED if the transfer could not be started.
+ */
+int32_t iot_i2c_write_async( IotI2CHandle_t const pxI2CPeripheral,
+                             uint8_t * const pucBuffer,
+                             size_t xBytes );
+
+/**
+ * @brief Reads xBytes consecutive registers starting at ucRegister, in asynchronous mode.
+ *
+ * The register address is written and the data read back with a repeated start, as a single
+ * operation. This is the burst read of the sensors with auto incremented register addresses.
+ *
+ * @param[in] pxI2CPeripheral The I2C peripheral handle returned in open() call.
+ * @param[in] ucRegister The first register to read.
+ * @param[out] pucBuffer The receive buffer to read the data into.
+ * @param[in] xBytes The number of bytes to read.
+ *
+ * @return The same values as iot_i2c_read_async().
+ */
+int32_t iot_i2c_mem_read_async( IotI2CHandle_t const pxI2CPeripheral,
+                                uint8_t ucRegister,
+                                uint8_t * const pucBuffer,
+                                size_t xBytes );
+
+/**
+ * @brief Reads xBytes consecutive registers starting at ucRegister, in synchronous mode.
+ *
+ * @return The same values as iot_i2c_read_sync().
+ */
+int32_t iot_i2c_mem_read_sync( IotI2CHandle_t const pxI2CPeripheral,
+                               uint8_t ucRegister,
+                               uint8_t * const pucBuffer,
+                               size_t xBytes );
+
+/**
+ * @brief Writes xBytes consecutive registers starting at ucRegister, in synchronous mode.
+ *
+ * @return The same values as iot_i2c_write_sync().
+ */
+int32_t iot_i2c_mem_write_sync( IotI2CHandle_t const pxI2CPeripheral,
+                                uint8_t ucRegister,
+                                uint8_t * const pucBuffer,
+                                size_t xBytes );
+
+/**
+ * @brief Configures the I2C instance, see IotI2CIoctlRequest_t.
+ *
+ * eI2CSetMasterConfig changes the bus frequency of every device on the bus. Fast mode plus
+ * must only be selected when all of them support it.
+ *
+ * @param[in] pxI2CPeripheral The I2C peripheral handle returned in open() call.
+ * @param[in] xI2CRequest The request.
+ * @param[in,out] pvBuffer The value of the request.
+ *
+ * @return
+ * - IOT_I2C_SUCCESS, on success
+ * - IOT_I2C_INVALID_VALUE, if a parameter is invalid
+ * - IOT_I2C_BUSY, if the bus configuration is changed while a transfer is in progress
+ * - IOT_I2C_FUNCTION_NOT_SUPPORTED, for eI2CSendNoStopFlag and eI2CBusReset
+ */
+int32_t iot_i2c_ioctl( IotI2CHandle_t const pxI2CPeripheral,
+                       IotI2CIoctlRequest_t xI2CRequest,
+                       void * const pvBuffer );
+
+/**
+ * @brief Stops the ongoing operation and releases the I2C instance.
+ *
+ * The bus stays initialized for the board support code.
+ *
+ * @param[in] pxI2CPeripheral The I2C peripheral handle returned in open() call.
+ *
+ * @return
+ * - IOT_I2C_SUCCESS, on success
+ * - IOT_I2C_INVALID_VALUE, if pxI2CPeripheral is NULL or not open
+ */
+int32_t iot_i2c_close( IotI2CHandle_t const pxI2CPeripheral );
+
+/**
+ * @brief Aborts the current asynchronous operation of this handle.
+ *
+ * @param[in] pxI2CPeripheral The I2C peripheral handle returned in open() call.
+ *
+ * @return
+ * - IOT_I2C_SUCCESS, on success
+ * - IOT_I2C_INVALID_VALUE, if pxI2CPeripheral is NULL or not open
+ * - IOT_I2C_NOTHING_TO_CANCEL, if there is no operation in progress
+ */
+int32_t iot_i2c_cancel( IotI2CHandle_t const pxI2CPeripheral );
+
+/**
+ * @}
+ */
+/* end of group iot_i2c */
+
+#endif /* _IOT_I2C_H_ */
@@ -127,6 +127,22 @@ typedef struct IotSPIDescriptor * IotSPIHandle_t;
 typedef void (* IotSPICallback_t) ( IotSPITransactionStatus_t xStatus,
                                     void * pvSPIparam );
 
+/**
+ * @brief An asynchronous transfer queued with iot_spi_queue_transaction().
+ *
+ * The storage and the buffers belong to the caller and must stay valid until the
+ * callback of the transaction has run.
+ */
+typedef struct IotSPITransaction
+{
+    uint8_t * pucTxBuffer;               /* Data to transmit, NULL for a read */
+    uint8_t * pucRxBuffer;               /* Buffer for received data, NULL for a write */
+    size_t xBytes;                       /* Number of bytes to transfer */
+    IotSPICallback_t xCallback;          /* Called from the interrupt on completion, may be NULL */
+    void * pvUserContext;                /* Passed to xCallback */
+    struct IotSPITransaction * pxNext;   /* Used by the driver */
+} IotSPITransaction_t;
+
 /**
  * @brief Initializes SPI peripheral with default configuration.
  *
@@ -400,6 +416,32 @@ int32_t iot_spi_transfer_async( IotSPIHandle_t const pxSPIPeripheral,
  *     - pxSPIPeripheral is NULL
  *     - pxSPIPeripheral is not opened yet
  */
+/**
+ * @brief Queue an asynchronous transfer behind the ones already queued.
+ *
+ * Queued transactions are started back to back from the completion interrupt of the
+ * previous one, without waiting for a task to run. The callback of each transaction is
+ * invoked instead of the one set with iot_spi_set_callback(), so it can toggle the chip
+ * select of its slave. While the queue is not empty, the other read, write and transfer
+ * functions return IOT_SPI_BUS_BUSY.
+ *
+ * iot_spi_cancel() and iot_spi_close() drop the queue without invoking the callbacks.
+ *
+ * @param[in] pxSPIPeripheral The SPI peripheral handle returned in open() call.
+ * @param[in] pxTransaction The transaction to queue.
+ *
+ * @return
+ * - IOT_SPI_SUCCESS, on success
+ * - IOT_SPI_INVALID_VALUE, if
+ *     - pxSPIPeripheral is NULL
+ *     - pxSPIPeripheral is not opened yet
+ *     - pxTransaction is NULL, has no buffer or xBytes is 0
+ * - IOT_SPI_TRANSFER_ERROR, if the transaction could not be started.
+ * - IOT_SPI_BUS_BUSY, if a transfer outside of the queue is in progress.
+ */
+int32_t iot_spi_queue_transaction( IotSPIHandle_t const pxSPIPeripheral,
+                                   IotSPITransaction_t * pxTransaction );
+
 int32_t iot_spi_close( IotSPIHandle_t const pxSPIPeripheral );
 
 /**
@@ -118,7 +118,8 @@ typedef enum
     eUartSetConfig,  /** Sets the UART configuration according to @IotUARTConfig_t. */
     eUartGetConfig,  /** Gets the UART configuration according to @IotUARTConfig_t. */
     eGetTxNoOfbytes, /** Get the number of bytes sent in write operation. */
-    eGetRxNoOfbytes  /** Get the number of bytes received in read operation. */
+    eGetRxNoOfbytes,   /** Get the number of bytes received in read operation. */
+    eGetRxDroppedBytes /** Get the number of bytes the receive stream dropped because it was full. */
 } IotUARTIoctlRequest_t;
 
 /**
@@ -371,6 +372,74 @@ int32_t iot_uart_ioctl( IotUARTHandle_t const pxUartPeripheral,
                         IotUARTIoctlRequest_t xUartRequest,
                         void * const pvBuffer );
 
+/**
+ * @brief Starts receiving continuously into a stream buffer.
+ *
+ * The UART writes to pucDmaBuffer with a circular DMA transfer. On every half transfer,
+ * wrap around and idle line event, the interrupt moves the new bytes to a stream buffer
+ * of xStreamLen bytes, from which iot_uart_rx_stream_read() returns them. Callers do not
+ * need to know message lengths, and there is no interrupt per byte.
+ *
+ * The callback set with iot_uart_set_callback() is invoked with eUartReadCompleted,
+ * from the interrupt, each time data is moved to the stream.
+ *
+ * While the stream is running, iot_uart_read_sync() and iot_uart_read_async() return IOT_UART_BUSY
+ * and iot_uart_cancel() only cancels a write.
+ *
+ * @note pucDmaBuffer must stay valid until iot_uart_rx_stream_stop(). It must hold the data
+ * received during the interrupt latency, i.e. about two half transfers at the baud rate.
+ *
+ * @param[in] pxUartPeripheral The peripheral handle returned in the open() call.
+ * @param[in] pucDmaBuffer The buffer written by the DMA.
+ * @param[in] xDmaBufferLen Length of pucDmaBuffer, 2 to 65535 bytes.
+ * @param[in] xStreamLen Length of the stream buffer.
+ *
+ * @return
+ * - IOT_UART_SUCCESS, on success
+ * - IOT_UART_INVALID_VALUE, if a parameter is invalid or pxUartPeripheral is not opened yet
+ * - IOT_UART_FUNCTION_NOT_SUPPORTED, if the port has no DMA channel
+ * - IOT_UART_BUSY, if a read or a stream is in progress
+ * - IOT_UART_READ_FAILED, if out of memory or the reception could not be started
+ */
+int32_t iot_uart_rx_stream_start( IotUARTHandle_t const pxUartPeripheral,
+                                  uint8_t * const pucDmaBuffer,
+                                  size_t xDmaBufferLen,
+                                  size_t xStreamLen );
+
+/**
+ * @brief Reads up to xBytes from the receive stream.
+ *
+ * Returns as soon as at least one byte is available or ulTimeoutMs expires.
+ *
+ * @param[in] pxUartPeripheral The peripheral handle returned in the open() call.
+ * @param[out] pvBuffer The buffer to store the received data.
+ * @param[in] xBytes The size of pvBuffer.
+ * @param[out] pxBytesRead The number of bytes read, 0 on timeout.
+ * @param[in] ulTimeoutMs The time to wait for data, UINT32_MAX to wait forever.
+ *
+ * @return
+ * - IOT_UART_SUCCESS, on success or timeout
+ * - IOT_UART_INVALID_VALUE, if a parameter is invalid
+ * - IOT_UART_READ_FAILED, if the stream is not started
+ */
+int32_t iot_uart_rx_stream_read( IotUARTHandle_t const pxUartPeripheral,
+                                 uint8_t * const pvBuffer,
+                                 size_t xBytes,
+                                 size_t * pxBytesRead,
+                                 uint32_t ulTimeoutMs );
+
+/**
+ * @brief Stops the receive stream and frees its stream buffer.
+ *
+ * No task may be blocked in iot_uart_rx_stream_read() when this is called.
+ *
+ * @return
+ * - IOT_UART_SUCCESS, on success
+ * - IOT_UART_INVALID_VALUE, if pxUartPeripheral is NULL or has no stream running
+ * - IOT_UART_BUSY, if the reception could not be aborted
+ */
+int32_t iot_uart_rx_stream_stop( IotUARTHandle_t const pxUartPeripheral );
+
 /**
  * @brief Aborts the operation on the UART port if any underlying driver allows
  * cancellation of the operation.
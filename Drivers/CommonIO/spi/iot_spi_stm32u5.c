@@ -41,10 +41,31 @@
 #define IOT_SPI_CLOSED              ( ( uint8_t ) 0 )
 #define IOT_SPI_OPENED              ( ( uint8_t ) 1 )
 
+/* Set to 1 to run asynchronous transfers of SPI1 and SPI3 on GPDMA1 channels 8 to 11.
+ * SPI2 belongs to the wifi module driver, which sets up its own DMA channels. */
+#ifndef IOT_SPI_USE_DMA
+#define IOT_SPI_USE_DMA             1
+#endif
+
+/* Shorter asynchronous transfers use interrupts, for which the setup is cheaper than for DMA */
+#ifndef IOT_SPI_DMA_MIN_BYTES
+#define IOT_SPI_DMA_MIN_BYTES       16
+#endif
+
+/* Priority of the SPI and DMA interrupts. Must not be above configMAX_SYSCALL_INTERRUPT_PRIORITY
+ * so that completion callbacks can use the FreeRTOS FromISR API. */
+#ifndef IOT_SPI_IRQ_PRIORITY
+#define IOT_SPI_IRQ_PRIORITY        5
+#endif
+
 typedef struct STM32_SPI_HalContext
 {
     SPI_HandleTypeDef * pxSpi;
     IRQn_Type eIrqNum;
+    DMA_HandleTypeDef * pxDmaTx; /* NULL if the instance has no DMA channels */
+    DMA_HandleTypeDef * pxDmaRx;
+    IRQn_Type eDmaTxIrqNum;
+    IRQn_Type eDmaRxIrqNum;
 } STM32_SPI_HalContext_t;
 
 typedef struct IotSPIDescriptor
@@ -54,6 +75,8 @@ typedef struct IotSPIDescriptor
     IotSPICallback_t xSpiCallback;               /* Callback function */
     void * pvUserContext;                        /* User context passed in callback */
     uint8_t sOpened;                             /* Bit flags to track different states. */
+    IotSPITransaction_t * volatile pxActive;     /* Queued transaction in progress, NULL if none */
+    IotSPITransaction_t * pxQueueTail;           /* Last queued transaction, valid while pxActive is set */
 } IotSPIDescriptor_t;
 /*-----------------------------------------------------------*/
 
@@ -135,19 +158,81 @@ static SPI_HandleTypeDef xSpiHandleMap[] =
     }
 };
 
+#if IOT_SPI_USE_DMA == 1
+
+#define IOT_SPI_DMA_RX_INIT( xRequest )                            \
+    {                                                              \
+        .Request               = ( xRequest ),                     \
+        .BlkHWRequest          = DMA_BREQ_SINGLE_BURST,            \
+        .Direction             = DMA_PERIPH_TO_MEMORY,             \
+        .SrcInc                = DMA_SINC_FIXED,                   \
+        .DestInc               = DMA_DINC_INCREMENTED,             \
+        .SrcDataWidth          = DMA_SRC_DATAWIDTH_BYTE,           \
+        .DestDataWidth         = DMA_DEST_DATAWIDTH_BYTE,          \
+        .Priority              = DMA_LOW_PRIORITY_HIGH_WEIGHT,     \
+        .SrcBurstLength        = 1,                                \
+        .DestBurstLength       = 1,                                \
+        .TransferAllocatedPort = DMA_SRC_ALLOCATED_PORT0 |         \
+                                 DMA_DEST_ALLOCATED_PORT1,         \
+        .TransferEventMode     = DMA_TCEM_BLOCK_TRANSFER,          \
+        .Mode                  = DMA_NORMAL,                       \
+    }
+
+#define IOT_SPI_DMA_TX_INIT( xRequest )                            \
+    {                                                              \
+        .Request               = ( xRequest ),                     \
+        .BlkHWRequest          = DMA_BREQ_SINGLE_BURST,            \
+        .Direction             = DMA_MEMORY_TO_PERIPH,             \
+        .SrcInc                = DMA_SINC_INCREMENTED,             \
+        .DestInc               = DMA_DINC_FIXED,                   \
+        .SrcDataWidth          = DMA_SRC_DATAWIDTH_BYTE,           \
+        .DestDataWidth         = DMA_DEST_DATAWIDTH_BYTE,          \
+        .Priority              = DMA_LOW_PRIORITY_HIGH_WEIGHT,     \
+        .SrcBurstLength        = 1,                                \
+        .DestBurstLength       = 1,                                \
+        .TransferAllocatedPort = DMA_SRC_ALLOCATED_PORT0 |         \
+                                 DMA_DEST_ALLOCATED_PORT1,         \
+        .TransferEventMode     = DMA_TCEM_BLOCK_TRANSFER,          \
+        .Mode                  = DMA_NORMAL,                       \
+    }
+
+static DMA_HandleTypeDef xDmaHandleMap[] =
+{
+    { .Instance = GPDMA1_Channel8, .Init = IOT_SPI_DMA_RX_INIT( GPDMA1_REQUEST_SPI1_RX ) },
+    { .Instance = GPDMA1_Channel9, .Init = IOT_SPI_DMA_TX_INIT( GPDMA1_REQUEST_SPI1_TX ) },
+    { .Instance = GPDMA1_Channel10, .Init = IOT_SPI_DMA_RX_INIT( GPDMA1_REQUEST_SPI3_RX ) },
+    { .Instance = GPDMA1_Channel11, .Init = IOT_SPI_DMA_TX_INIT( GPDMA1_REQUEST_SPI3_TX ) },
+};
+
+#endif /* IOT_SPI_USE_DMA == 1 */
+
 static const STM32_SPI_HalContext_t xSpiContexts[] =
 {
     {
         .pxSpi = &xSpiHandleMap[ 0 ],
         .eIrqNum = SPI1_IRQn,
+#if IOT_SPI_USE_DMA == 1
+        .pxDmaTx = &xDmaHandleMap[ 1 ],
+        .pxDmaRx = &xDmaHandleMap[ 0 ],
+        .eDmaTxIrqNum = GPDMA1_Channel9_IRQn,
+        .eDmaRxIrqNum = GPDMA1_Channel8_IRQn,
+#endif /* IOT_SPI_USE_DMA == 1 */
     },
     {
         .pxSpi = &xSpiHandleMap[ 1 ],
         .eIrqNum = SPI2_IRQn,
+        .pxDmaTx = NULL,
+        .pxDmaRx = NULL,
     },
     {
         .pxSpi = &xSpiHandleMap[ 2 ],
         .eIrqNum = SPI3_IRQn,
+#if IOT_SPI_USE_DMA == 1
+        .pxDmaTx = &xDmaHandleMap[ 3 ],
+        .pxDmaRx = &xDmaHandleMap[ 2 ],
+        .eDmaTxIrqNum = GPDMA1_Channel11_IRQn,
+        .eDmaRxIrqNum = GPDMA1_Channel10_IRQn,
+#endif /* IOT_SPI_USE_DMA == 1 */
     }
 };
 /*-----------------------------------------------------------*/
@@ -165,6 +250,8 @@ static IotSPIDescriptor_t xSpi1 =
     .xSpiCallback     = NULL,
     .pvUserContext    = NULL,
     .sOpened          = IOT_SPI_CLOSED,
+    .pxActive         = NULL,
+    .pxQueueTail      = NULL,
 };
 
 static IotSPIDescriptor_t xSpi2 =
@@ -180,6 +267,8 @@ static IotSPIDescriptor_t xSpi2 =
     .xSpiCallback     = NULL,
     .pvUserContext    = NULL,
     .sOpened          = IOT_SPI_CLOSED,
+    .pxActive         = NULL,
+    .pxQueueTail      = NULL,
 };
 
 static IotSPIDescriptor_t xSpi3 =
@@ -195,11 +284,186 @@ static IotSPIDescriptor_t xSpi3 =
     .xSpiCallback     = NULL,
     .pvUserContext    = NULL,
     .sOpened          = IOT_SPI_CLOSED,
+    .pxActive         = NULL,
+    .pxQueueTail      = NULL,
 };
 /*-----------------------------------------------------------*/
 
 static IotSPIHandle_t const pxSpis[] = { &xSpi1, &xSpi2, &xSpi3 };
 
+/*-----------------------------------------------------------*/
+
+static IotSPIHandle_t prvGetHandle( SPI_HandleTypeDef * hspi )
+{
+    IotSPIHandle_t xHandle = NULL;
+
+    for( size_t i = 0; i < sizeof( pxSpis ) / sizeof( IotSPIHandle_t ); i++ )
+    {
+        if( pxSpis[ i ]->pxSpiContext->pxSpi == hspi )
+        {
+            xHandle = pxSpis[ i ];
+        }
+    }
+
+    return xHandle;
+}
+/*-----------------------------------------------------------*/
+
+static HAL_StatusTypeDef prvInitDma( STM32_SPI_HalContext_t const * pxContext )
+{
+    HAL_StatusTypeDef xResult = HAL_OK;
+    SPI_HandleTypeDef * pxSpi = pxContext->pxSpi;
+
+    if( pxContext->pxDmaTx != NULL )
+    {
+        __HAL_RCC_GPDMA1_CLK_ENABLE();
+
+        xResult = HAL_DMA_Init( pxContext->pxDmaTx );
+
+        if( xResult == HAL_OK )
+        {
+            xResult = HAL_DMA_ConfigChannelAttributes( pxContext->pxDmaTx, DMA_CHANNEL_NPRIV );
+        }
+
+        if( xResult == HAL_OK )
+        {
+            xResult = HAL_DMA_Init( pxContext->pxDmaRx );
+        }
+
+        if( xResult == HAL_OK )
+        {
+            xResult = HAL_DMA_ConfigChannelAttributes( pxContext->pxDmaRx, DMA_CHANNEL_NPRIV );
+        }
+
+        if( xResult == HAL_OK )
+        {
+            __HAL_LINKDMA( pxSpi, hdmatx, *( pxContext->pxDmaTx ) );
+            __HAL_LINKDMA( pxSpi, hdmarx, *( pxContext->pxDmaRx ) );
+
+            HAL_NVIC_SetPriority( pxContext->eDmaTxIrqNum, IOT_SPI_IRQ_PRIORITY, 0 );
+            HAL_NVIC_EnableIRQ( pxContext->eDmaTxIrqNum );
+            HAL_NVIC_SetPriority( pxContext->eDmaRxIrqNum, IOT_SPI_IRQ_PRIORITY, 0 );
+            HAL_NVIC_EnableIRQ( pxContext->eDmaRxIrqNum );
+        }
+    }
+
+    return xResult;
+}
+/*-----------------------------------------------------------*/
+
+static void prvDeInitDma( STM32_SPI_HalContext_t const * pxContext )
+{
+    if( pxContext->pxDmaTx != NULL )
+    {
+        HAL_NVIC_DisableIRQ( pxContext->eDmaTxIrqNum );
+        HAL_NVIC_DisableIRQ( pxContext->eDmaRxIrqNum );
+
+        ( void ) HAL_DMA_DeInit( pxContext->pxDmaTx );
+        ( void ) HAL_DMA_DeInit( pxContext->pxDmaRx );
+
+        pxContext->pxSpi->hdmatx = NULL;
+        pxContext->pxSpi->hdmarx = NULL;
+    }
+}
+/*-----------------------------------------------------------*/
+
+static void prvEnableIrq( IotSPIHandle_t const pxSPIPeripheral )
+{
+    IRQn_Type eIrqNum = pxSPIPeripheral->pxSpiContext->eIrqNum;
+
+    HAL_NVIC_SetPriority( eIrqNum, IOT_SPI_IRQ_PRIORITY, 0 );
+    HAL_NVIC_EnableIRQ( eIrqNum );
+}
+/*-----------------------------------------------------------*/
+
+/*
+ * Start an asynchronous transfer, on DMA when the instance has channels and the
+ * transfer is long enough. pucTxBuffer or pucRxBuffer is NULL for a read or a write.
+ */
+static int32_t prvStartTransfer( IotSPIHandle_t const pxSPIPeripheral,
+                                 uint8_t * const pucTxBuffer,
+                                 uint8_t * const pucRxBuffer,
+                                 size_t xBytes )
+{
+    SPI_HandleTypeDef * pxSpi = pxSPIPeripheral->pxSpiContext->pxSpi;
+    uint8_t ucUseDma = ( ( pxSpi->hdmatx != NULL ) && ( xBytes >= IOT_SPI_DMA_MIN_BYTES ) ) ? 1 : 0;
+    HAL_StatusTypeDef xResult = HAL_ERROR;
+
+    if( ( pucTxBuffer != NULL ) && ( pucRxBuffer != NULL ) )
+    {
+        xResult = ( ucUseDma == 1 ) ?
+                  HAL_SPI_TransmitReceive_DMA( pxSpi, pucTxBuffer, pucRxBuffer, ( uint16_t ) xBytes ) :
+                  HAL_SPI_TransmitReceive_IT( pxSpi, pucTxBuffer, pucRxBuffer, ( uint16_t ) xBytes );
+    }
+    else if( pucTxBuffer != NULL )
+    {
+        xResult = ( ucUseDma == 1 ) ?
+                  HAL_SPI_Transmit_DMA( pxSpi, pucTxBuffer, ( uint16_t ) xBytes ) :
+                  HAL_SPI_Transmit_IT( pxSpi, pucTxBuffer, ( uint16_t ) xBytes );
+    }
+    else
+    {
+        xResult = ( ucUseDma == 1 ) ?
+                  HAL_SPI_Receive_DMA( pxSpi, pucRxBuffer, ( uint16_t ) xBytes ) :
+                  HAL_SPI_Receive_IT( pxSpi, pucRxBuffer, ( uint16_t ) xBytes );
+    }
+
+    return ( xResult == HAL_OK ) ? IOT_SPI_SUCCESS : IOT_SPI_TRANSFER_ERROR;
+}
+/*-----------------------------------------------------------*/
+
+/*
+ * Called from the completion interrupt of a queued transaction. Runs its callback,
+ * then starts the next queued transaction straight away.
+ */
+static void prvCompleteTransaction( IotSPIHandle_t const pxSPIPeripheral,
+                                    IotSPITransactionStatus_t xStatus )
+{
+    IotSPITransaction_t * pxDone = pxSPIPeripheral->pxActive;
+
+    while( pxDone != NULL )
+    {
+        IotSPITransaction_t * pxNext = pxDone->pxNext;
+
+        pxSPIPeripheral->pxActive = pxNext;
+
+        if( pxDone->xCallback != NULL )
+        {
+            pxDone->xCallback( xStatus, pxDone->pvUserContext );
+        }
+
+        pxDone = NULL;
+
+        if( ( pxNext != NULL ) &&
+            ( prvStartTransfer( pxSPIPeripheral, pxNext->pucTxBuffer, pxNext->pucRxBuffer, pxNext->xBytes ) != IOT_SPI_SUCCESS ) )
+        {
+            /* Fail this one and move on to the next */
+            pxDone = pxNext;
+            xStatus = eSPITransferError;
+        }
+    }
+}
+/*-----------------------------------------------------------*/
+
+static void prvHandleCompletion( SPI_HandleTypeDef * hspi,
+                                 IotSPITransactionStatus_t xStatus )
+{
+    IotSPIHandle_t xHandle = prvGetHandle( hspi );
+
+    if( xHandle == NULL )
+    {
+        /* Not an instance of this driver */
+    }
+    else if( xHandle->pxActive != NULL )
+    {
+        prvCompleteTransaction( xHandle, xStatus );
+    }
+    else if( xHandle->xSpiCallback != NULL )
+    {
+        xHandle->xSpiCallback( xStatus, xHandle->pvUserContext );
+    }
+}
+
 /*--------------------API Implementation---------------------*/
 
 IotSPIHandle_t iot_spi_open( int32_t lSpiInstance )
@@ -216,9 +480,15 @@ IotSPIHandle_t iot_spi_open( int32_t lSpiInstance )
             {
                 xHandle = NULL;
             }
+            else if( prvInitDma( xHandle->pxSpiContext ) != HAL_OK )
+            {
+                ( void ) HAL_SPI_DeInit( xHandle->pxSpiContext->pxSpi );
+                xHandle = NULL;
+            }
             else
             {
                 xHandle->sOpened = IOT_SPI_OPENED;
+                xHandle->pxActive = NULL;
 
                 xHandle->xConfig.ulFreq = ( SystemCoreClock >> 1 ); /* Default prescaler is 2 and freq = clock / prescaler */
             }
@@ -375,7 +645,8 @@ int32_t iot_spi_read_sync( IotSPIHandle_t const pxSPIPeripheral,
     {
         SPI_HandleTypeDef * pxSpi = pxSPIPeripheral->pxSpiContext->pxSpi;
 
-        if( HAL_SPI_GetState( pxSpi ) == HAL_SPI_STATE_BUSY_RX )
+        if( ( HAL_SPI_GetState( pxSpi ) == HAL_SPI_STATE_BUSY_RX ) ||
+            ( pxSPIPeripheral->pxActive != NULL ) )
         {
             lError = IOT_SPI_BUS_BUSY;
         }
@@ -408,19 +679,16 @@ int32_t iot_spi_read_async( IotSPIHandle_t const pxSPIPeripheral,
     {
         SPI_HandleTypeDef * pxSpi = pxSPIPeripheral->pxSpiContext->pxSpi;
 
-        if( HAL_SPI_GetState( pxSpi ) == HAL_SPI_STATE_BUSY_RX )
+        if( ( HAL_SPI_GetState( pxSpi ) == HAL_SPI_STATE_BUSY_RX ) ||
+            ( pxSPIPeripheral->pxActive != NULL ) )
         {
             lError = IOT_SPI_BUS_BUSY;
         }
         else
         {
-            HAL_NVIC_SetPriority( ( IRQn_Type ) ( ( STM32_SPI_HalContext_t * ) pxSPIPeripheral->pxSpiContext )->eIrqNum, 1, 0 );
-            HAL_NVIC_EnableIRQ( ( IRQn_Type ) ( ( STM32_SPI_HalContext_t * ) pxSPIPeripheral->pxSpiContext )->eIrqNum );
+            prvEnableIrq( pxSPIPeripheral );
 
-            if( HAL_SPI_Receive_IT( pxSpi, pvBuffer, ( uint16_t ) xBytes ) != HAL_OK )
-            {
-                lError = IOT_SPI_TRANSFER_ERROR;
-            }
+            lError = prvStartTransfer( pxSPIPeripheral, NULL, pvBuffer, xBytes );
         }
     }
 
@@ -447,7 +715,8 @@ int32_t iot_spi_write_sync( IotSPIHandle_t const pxSPIPeripheral,
     {
         SPI_HandleTypeDef * pxSpi = pxSPIPeripheral->pxSpiContext->pxSpi;
 
-        if( HAL_SPI_GetState( pxSpi ) == HAL_SPI_STATE_BUSY_TX )
+        if( ( HAL_SPI_GetState( pxSpi ) == HAL_SPI_STATE_BUSY_TX ) ||
+            ( pxSPIPeripheral->pxActive != NULL ) )
         {
             lError = IOT_SPI_BUS_BUSY;
         }
@@ -480,19 +749,16 @@ int32_t iot_spi_write_async( IotSPIHandle_t const pxSPIPeripheral,
     {
         SPI_HandleTypeDef * pxSpi = pxSPIPeripheral->pxSpiContext->pxSpi;
 
-        if( HAL_SPI_GetState( pxSpi ) == HAL_SPI_STATE_BUSY_TX )
+        if( ( HAL_SPI_GetState( pxSpi ) == HAL_SPI_STATE_BUSY_TX ) ||
+            ( pxSPIPeripheral->pxActive != NULL ) )
         {
             lError = IOT_SPI_BUS_BUSY;
         }
         else
         {
-            HAL_NVIC_SetPriority( ( IRQn_Type ) ( ( STM32_SPI_HalContext_t * ) pxSPIPeripheral->pxSpiContext )->eIrqNum, 1, 0 );
-            HAL_NVIC_EnableIRQ( ( IRQn_Type ) ( ( STM32_SPI_HalContext_t * ) pxSPIPeripheral->pxSpiContext )->eIrqNum );
+            prvEnableIrq( pxSPIPeripheral );
 
-            if( HAL_SPI_Transmit_IT( pxSpi, pvBuffer, ( uint16_t ) xBytes ) != HAL_OK )
-            {
-                lError = IOT_SPI_TRANSFER_ERROR;
-            }
+            lError = prvStartTransfer( pxSPIPeripheral, pvBuffer, NULL, xBytes );
         }
     }
 
@@ -520,7 +786,8 @@ int32_t iot_spi_transfer_sync( IotSPIHandle_t const pxSPIPeripheral,
     {
         SPI_HandleTypeDef * pxSpi = pxSPIPeripheral->pxSpiContext->pxSpi;
 
-        if( HAL_SPI_GetState( pxSpi ) == HAL_SPI_STATE_BUSY_TX_RX )
+        if( ( HAL_SPI_GetState( pxSpi ) == HAL_SPI_STATE_BUSY_TX_RX ) ||
+            ( pxSPIPeripheral->pxActive != NULL ) )
         {
             lError = IOT_SPI_BUS_BUSY;
         }
@@ -554,20 +821,66 @@ int32_t iot_spi_transfer_async( IotSPIHandle_t const pxSPIPeripheral,
     {
         SPI_HandleTypeDef * pxSpi = pxSPIPeripheral->pxSpiContext->pxSpi;
 
-        if( HAL_SPI_GetState( pxSpi ) == HAL_SPI_STATE_BUSY_TX_RX )
+        if( ( HAL_SPI_GetState( pxSpi ) == HAL_SPI_STATE_BUSY_TX_RX ) ||
+            ( pxSPIPeripheral->pxActive != NULL ) )
         {
             lError = IOT_SPI_BUS_BUSY;
         }
         else
         {
-            HAL_NVIC_SetPriority( ( IRQn_Type ) ( ( STM32_SPI_HalContext_t * ) pxSPIPeripheral->pxSpiContext )->eIrqNum, 1, 0 );
-            HAL_NVIC_EnableIRQ( ( IRQn_Type ) ( ( STM32_SPI_HalContext_t * ) pxSPIPeripheral->pxSpiContext )->eIrqNum );
+            prvEnableIrq( pxSPIPeripheral );
+
+            lError = prvStartTransfer( pxSPIPeripheral, pvTxBuffer, pvRxBuffer, xBytes );
+        }
+    }
+
+    return lError;
+}
+/*-----------------------------------------------------------*/
+
+int32_t iot_spi_queue_transaction( IotSPIHandle_t const pxSPIPeripheral,
+                                   IotSPITransaction_t * pxTransaction )
+{
+    int32_t lError = IOT_SPI_INVALID_VALUE;
 
-            if( HAL_SPI_TransmitReceive_IT( pxSpi, pvTxBuffer, pvRxBuffer, ( uint16_t ) xBytes ) != HAL_OK )
+    if( ( pxSPIPeripheral != NULL ) && ( pxSPIPeripheral->sOpened == IOT_SPI_OPENED ) &&
+        ( pxTransaction != NULL ) && ( pxTransaction->xBytes > 0 ) &&
+        ( ( pxTransaction->pucTxBuffer != NULL ) || ( pxTransaction->pucRxBuffer != NULL ) ) )
+    {
+        uint32_t ulPrimask = __get_PRIMASK();
+
+        pxTransaction->pxNext = NULL;
+
+        /* The completion interrupt updates the queue too */
+        __disable_irq();
+
+        if( pxSPIPeripheral->pxActive != NULL )
+        {
+            pxSPIPeripheral->pxQueueTail->pxNext = pxTransaction;
+            pxSPIPeripheral->pxQueueTail = pxTransaction;
+            lError = IOT_SPI_SUCCESS;
+        }
+        else if( HAL_SPI_GetState( pxSPIPeripheral->pxSpiContext->pxSpi ) != HAL_SPI_STATE_READY )
+        {
+            lError = IOT_SPI_BUS_BUSY;
+        }
+        else
+        {
+            prvEnableIrq( pxSPIPeripheral );
+
+            pxSPIPeripheral->pxActive = pxTransaction;
+            pxSPIPeripheral->pxQueueTail = pxTransaction;
+
+            lError = prvStartTransfer( pxSPIPeripheral, pxTransaction->pucTxBuffer,
+                                       pxTransaction->pucRxBuffer, pxTransaction->xBytes );
+
+            if( lError != IOT_SPI_SUCCESS )
             {
-                lError = IOT_SPI_TRANSFER_ERROR;
+                pxSPIPeripheral->pxActive = NULL;
             }
         }
+
+        __set_PRIMASK( ulPrimask );
     }
 
     return lError;
@@ -592,6 +905,11 @@ int32_t iot_spi_close( IotSPIHandle_t const pxSPIPeripheral )
         }
         else
         {
+            /* Queued transactions are dropped without their callback */
+            pxSPIPeripheral->pxActive = NULL;
+
+            prvDeInitDma( pxSPIPeripheral->pxSpiContext );
+
             /* HAL_SPI_DeInit returns OK as long as input is not NULL. */
             HAL_SPI_DeInit( pxSpi );
             pxSPIPeripheral->sOpened = IOT_SPI_CLOSED;
@@ -614,9 +932,15 @@ int32_t iot_spi_cancel( IotSPIHandle_t const pxSPIPeripheral )
         {
             lError = IOT_SPI_NOTHING_TO_CANCEL;
         }
-        else if( HAL_SPI_Abort( pxSpi ) == HAL_OK )
+        else
         {
-            lError = IOT_SPI_SUCCESS;
+            /* Queued transactions are dropped without their callback */
+            pxSPIPeripheral->pxActive = NULL;
+
+            if( HAL_SPI_Abort( pxSpi ) == HAL_OK )
+            {
+                lError = IOT_SPI_SUCCESS;
+            }
         }
     }
 
@@ -626,69 +950,25 @@ int32_t iot_spi_cancel( IotSPIHandle_t const pxSPIPeripheral )
 
 void HAL_SPI_TxRxCpltCallback( SPI_HandleTypeDef * hspi )
 {
-    if( hspi->Instance == SPI1 )
-    {
-        xSpi1.xSpiCallback( eSPISuccess, xSpi1.pvUserContext );
-    }
-    else if( hspi->Instance == SPI2 )
-    {
-        xSpi2.xSpiCallback( eSPISuccess, xSpi2.pvUserContext );
-    }
-    else if( hspi->Instance == SPI3 )
-    {
-        xSpi3.xSpiCallback( eSPISuccess, xSpi3.pvUserContext );
-    }
+    prvHandleCompletion( hspi, eSPISuccess );
 }
 /*-----------------------------------------------------------*/
 
 void HAL_SPI_TxCpltCallback( SPI_HandleTypeDef * hspi )
 {
-    if( hspi->Instance == SPI1 )
-    {
-        xSpi1.xSpiCallback( eSPISuccess, xSpi1.pvUserContext );
-    }
-    else if( hspi->Instance == SPI2 )
-    {
-        xSpi2.xSpiCallback( eSPISuccess, xSpi2.pvUserContext );
-    }
-    else if( hspi->Instance == SPI3 )
-    {
-        xSpi3.xSpiCallback( eSPISuccess, xSpi3.pvUserContext );
-    }
+    prvHandleCompletion( hspi, eSPISuccess );
 }
 /*-----------------------------------------------------------*/
 
 void HAL_SPI_RxCpltCallback( SPI_HandleTypeDef * hspi )
 {
-    if( hspi->Instance == SPI1 )
-    {
-        xSpi1.xSpiCallback( eSPISuccess, xSpi1.pvUserContext );
-    }
-    else if( hspi->Instance == SPI2 )
-    {
-        xSpi2.xSpiCallback( eSPISuccess, xSpi2.pvUserContext );
-    }
-    else if( hspi->Instance == SPI3 )
-    {
-        xSpi3.xSpiCallback( eSPISuccess, xSpi3.pvUserContext );
-    }
+    prvHandleCompletion( hspi, eSPISuccess );
 }
 /*-----------------------------------------------------------*/
 
 void HAL_SPI_ErrorCallback( SPI_HandleTypeDef * hspi )
 {
-    if( hspi->Instance == SPI1 )
-    {
-        xSpi1.xSpiCallback( eSPITransferError, xSpi1.pvUserContext );
-    }
-    else if( hspi->Instance == SPI2 )
-    {
-        xSpi2.xSpiCallback( eSPITransferError, xSpi2.pvUserContext );
-    }
-    else if( hspi->Instance == SPI3 )
-    {
-        xSpi3.xSpiCallback( eSPITransferError, xSpi3.pvUserContext );
-    }
+    prvHandleCompletion( hspi, eSPITransferError );
 }
 /*-----------------------------------------------------------*/
 
@@ -709,3 +989,31 @@ void SPI3_IRQHandler( void )
     HAL_SPI_IRQHandler( xSpi3.pxSpiContext->pxSpi );
 }
 /*-----------------------------------------------------------*/
+
+#if IOT_SPI_USE_DMA == 1
+
+void GPDMA1_Channel8_IRQHandler( void )
+{
+    HAL_DMA_IRQHandler( &xDmaHandleMap[ 0 ] );
+}
+/*-----------------------------------------------------------*/
+
+void GPDMA1_Channel9_IRQHandler( void )
+{
+    HAL_DMA_IRQHandler( &xDmaHandleMap[ 1 ] );
+}
+/*-----------------------------------------------------------*/
+
+void GPDMA1_Channel10_IRQHandler( void )
+{
+    HAL_DMA_IRQHandler( &xDmaHandleMap[ 2 ] );
+}
+/*-----------------------------------------------------------*/
+
+void GPDMA1_Channel11_IRQHandler( void )
+{
+    HAL_DMA_IRQHandler( &xDmaHandleMap[ 3 ] );
+}
+/*-----------------------------------------------------------*/
+
+#endif /* IOT_SPI_USE_DMA == 1 */
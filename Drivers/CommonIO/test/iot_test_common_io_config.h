@@ -69,4 +69,28 @@ static const uint32_t spiIotSpitBitOrder[ SPI_TEST_SET ] = { eSPIMSBFirst };
 static const uint32_t spiIotFrequency[ SPI_TEST_SET ] = { 500000 };
 static const uint32_t spiIotDummyValue[ SPI_TEST_SET ] = { 0 };
 
+/*------------------------Benchmarks------------------------*/
+
+/* Enables the throughput and latency benchmarks of the SPI and UART groups.
+ * Results are printed as one line per measurement, see vTestIotBenchmarkReport().
+ * SPI benchmarks do not need a loopback, the received data is not checked.
+ */
+#ifndef IOT_TEST_COMMON_IO_BENCHMARK
+    #define IOT_TEST_COMMON_IO_BENCHMARK    0
+#endif
+
+/* Transfers averaged per measurement */
+#define IOT_TEST_COMMON_IO_BENCHMARK_ITERATIONS    16
+
+/* Transfer sizes, on both sides of the drivers' DMA thresholds (16 bytes for SPI) */
+#define BENCHMARK_SIZE_SET                         4
+static const uint16_t benchmarkTransferSizes[ BENCHMARK_SIZE_SET ] = { 4, 32, 256, 1024 };
+
+/* Clock rates, the SPI ones are rounded down by the driver to a prescaler of the kernel clock */
+#define SPI_BENCHMARK_FREQ_SET                     3
+static const uint32_t spiBenchmarkFrequency[ SPI_BENCHMARK_FREQ_SET ] = { 1000000, 10000000, 40000000 };
+
+#define UART_BENCHMARK_BAUD_SET                    3
+static const uint32_t uartBenchmarkBaudrate[ UART_BENCHMARK_BAUD_SET ] = { 115200, 921600, 2000000 };
+
 #endif /* ifndef _TEST_IOT_CONFIG_H_ */
@@ -23,8 +23,16 @@
  * http://www.FreeRTOS.org
  */
 
+#include <stdio.h>
+#include <string.h>
+
 #include "iot_test_common_io_internal.h"
 
+#if defined( IOT_TEST_COMMON_IO_BENCHMARK ) && ( IOT_TEST_COMMON_IO_BENCHMARK == 1 )
+    #include "unity.h"
+    #include "stm32u5xx.h"
+#endif
+
 #if defined( IOT_TEST_COMMON_IO_UART_SUPPORTED ) && ( IOT_TEST_COMMON_IO_UART_SUPPORTED >= 1 )
 /* UART */
     void SET_TEST_IOT_UART_CONFIG( int testSet )
@@ -45,3 +53,46 @@
     }
 
 #endif /* if defined( IOT_TEST_COMMON_IO_SPI_SUPPORTED ) && ( IOT_TEST_COMMON_IO_SPI_SUPPORTED >= 1 ) */
+
+#if defined( IOT_TEST_COMMON_IO_BENCHMARK ) && ( IOT_TEST_COMMON_IO_BENCHMARK == 1 )
+/* Benchmarks */
+    void vTestIotBenchmarkInit( void )
+    {
+        CoreDebug->DEMCR |= CoreDebug_DEMCR_TRCENA_Msk;
+        DWT->CYCCNT = 0;
+        DWT->CTRL |= DWT_CTRL_CYCCNTENA_Msk;
+    }
+
+    uint32_t ulTestIotBenchmarkCycles( void )
+    {
+        return DWT->CYCCNT;
+    }
+
+    void vTestIotBenchmarkReport( const char * pcDriver,
+                                  const char * pcMetric,
+                                  const char * pcMode,
+                                  uint32_t ulClockHz,
+                                  size_t xBytes,
+                                  uint32_t ulIterations,
+                                  uint32_t ulTotalCycles )
+    {
+        char cLine[ 128 ];
+        uint32_t ulCycles = ulTotalCycles / ulIterations;
+        uint64_t ullNs = ( ( uint64_t ) ulCycles * 1000000000ULL ) / SystemCoreClock;
+        uint64_t ullBytesPerSec = 0;
+
+        if( ( strcmp( pcMetric, "throughput" ) == 0 ) && ( ulCycles > 0 ) )
+        {
+            ullBytesPerSec = ( ( uint64_t ) xBytes * SystemCoreClock ) / ulCycles;
+        }
+
+        ( void ) snprintf( cLine, sizeof( cLine ), "BENCH,%s,%s,%s,%lu,%lu,%lu,%lu,%lu,%lu",
+                           pcDriver, pcMetric, pcMode,
+                           ( unsigned long ) ulClockHz, ( unsigned long ) xBytes,
+                           ( unsigned long ) ulIterations, ( unsigned long ) ulCycles,
+                           ( unsigned long ) ullNs, ( unsigned long ) ullBytesPerSec );
+
+        UnityPrint( cLine );
+        UNITY_PRINT_EOL();
+    }
+#endif /* if defined( IOT_TEST_COMMON_IO_BENCHMARK ) && ( IOT_TEST_COMMON_IO_BENCHMARK == 1 ) */
@@ -85,3 +85,48 @@
 #else /* if defined( IOT_TEST_COMMON_IO_SPI_SUPPORTED ) && ( IOT_TEST_COMMON_IO_SPI_SUPPORTED >= 1 ) */
     #define IOT_TEST_COMMON_IO_SPI_SUPPORTED    0
 #endif /* if defined( IOT_TEST_COMMON_IO_SPI_SUPPORTED ) && ( IOT_TEST_COMMON_IO_SPI_SUPPORTED >= 1 ) */
+
+/* Benchmarks */
+#if defined( IOT_TEST_COMMON_IO_BENCHMARK ) && ( IOT_TEST_COMMON_IO_BENCHMARK == 1 )
+
+/**
+ * Start the DWT cycle counter used to time the benchmarks.
+ *
+ * @return None
+ */
+    void vTestIotBenchmarkInit( void );
+
+/**
+ * Read the DWT cycle counter, safe to call from interrupts.
+ *
+ * @return Core clock cycles since vTestIotBenchmarkInit, wrapping at 32 bits
+ */
+    uint32_t ulTestIotBenchmarkCycles( void );
+
+/**
+ * Print one measurement as a single line:
+ *
+ * BENCH,<driver>,<metric>,<mode>,<clock_hz>,<bytes>,<iterations>,<cycles>,<ns>,<bytes_per_s>
+ *
+ * where cycles and ns are the average per iteration and bytes_per_s is 0 for
+ * latency metrics. The fields are fixed so that results of two runs can be diffed.
+ *
+ * @param: pcDriver: "spi" or "uart"
+ * @param: pcMetric: "throughput", "setup" or "latency"
+ * @param: pcMode: "sync" or "async"
+ * @param: ulClockHz: bus frequency or baud rate
+ * @param: xBytes: bytes per transfer
+ * @param: ulIterations: number of transfers measured
+ * @param: ulTotalCycles: cycles of all iterations together
+ * @return None
+ */
+    void vTestIotBenchmarkReport( const char * pcDriver,
+                                  const char * pcMetric,
+                                  const char * pcMode,
+                                  uint32_t ulClockHz,
+                                  size_t xBytes,
+                                  uint32_t ulIterations,
+                                  uint32_t ulTotalCycles );
+#else
+    #define IOT_TEST_COMMON_IO_BENCHMARK    0
+#endif /* if defined( IOT_TEST_COMMON_IO_BENCHMARK ) && ( IOT_TEST_COMMON_IO_BENCHMARK == 1 ) */
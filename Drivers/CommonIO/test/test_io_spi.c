@@ -76,6 +76,21 @@ static void prvAppendToMessage( size_t * pOffset,
 /* Output message _cMsg. */
 static void prvOutputMessage();
 
+#if ( IOT_TEST_COMMON_IO_BENCHMARK == 1 )
+    #define testIotSPI_BENCHMARK_MAX_SIZE    ( 1024 )
+
+    static uint8_t ucBenchmarkTxBuf[ testIotSPI_BENCHMARK_MAX_SIZE ];
+    static uint8_t ucBenchmarkRxBuf[ testIotSPI_BENCHMARK_MAX_SIZE ];
+
+/* Cycle count taken in the completion callback of the last asynchronous transfer */
+    static volatile uint32_t ulBenchmarkCallbackCycles = 0;
+
+    static void prvSpiBenchmarkCallback( IotSPITransactionStatus_t xStatus,
+                                         void * pvUserContext );
+    static void prvSpiBenchmarkSetFreq( IotSPIHandle_t xSPIHandle,
+                                        uint32_t ulFreq );
+#endif
+
 /**
  * @brief Application/POSIX defined callback for asynchronous operations
  * This callback function releases a semaphore every time it is called.
@@ -156,6 +171,12 @@ TEST_GROUP_RUNNER( TEST_IOT_SPI )
     RUN_TEST_CASE( TEST_IOT_SPI, AFQP_IotSPI_TransferSyncFuzzing );
     RUN_TEST_CASE( TEST_IOT_SPI, AFQP_IotSPI_TransferAsyncFuzzing );
     RUN_TEST_CASE( TEST_IOT_SPI, AFQP_IotSPI_CancelFuzzing );
+
+    #if ( IOT_TEST_COMMON_IO_BENCHMARK == 1 )
+        RUN_TEST_CASE( TEST_IOT_SPI, IotSPI_Benchmark_Throughput );
+        RUN_TEST_CASE( TEST_IOT_SPI, IotSPI_Benchmark_Setup );
+        RUN_TEST_CASE( TEST_IOT_SPI, IotSPI_Benchmark_Latency );
+    #endif
 }
 
 
@@ -1702,6 +1723,200 @@ TEST( TEST_IOT_SPI, IotSPI_LoopBack_TransferAsync )
     TEST_ASSERT_EQUAL( IOT_SPI_SUCCESS, lRetVal );
 }
 
+#if ( IOT_TEST_COMMON_IO_BENCHMARK == 1 )
+
+/*-----------------------------------------------------------*/
+
+/**
+ * @brief Sustained throughput of back to back transfers, for every configured
+ * frequency and transfer size, with the sync and async APIs. Async transfers
+ * below the driver's DMA threshold run on interrupts.
+ */
+    TEST( TEST_IOT_SPI, IotSPI_Benchmark_Throughput )
+    {
+        IotSPIHandle_t xSPIHandle;
+        int32_t lRetVal;
+        uint32_t ulStart;
+
+        vTestIotBenchmarkInit();
+
+        xSPIHandle = iot_spi_open( ultestIotSpiInstance );
+        TEST_ASSERT_NOT_EQUAL( NULL, xSPIHandle );
+
+        if( TEST_PROTECT() )
+        {
+            iot_spi_set_callback( xSPIHandle, prvSpiBenchmarkCallback, NULL );
+
+            for( size_t i = 0; i < SPI_BENCHMARK_FREQ_SET; i++ )
+            {
+                prvSpiBenchmarkSetFreq( xSPIHandle, spiBenchmarkFrequency[ i ] );
+
+                for( size_t j = 0; j < BENCHMARK_SIZE_SET; j++ )
+                {
+                    size_t xBytes = benchmarkTransferSizes[ j ];
+
+                    ulStart = ulTestIotBenchmarkCycles();
+
+                    for( uint32_t k = 0; k < IOT_TEST_COMMON_IO_BENCHMARK_ITERATIONS; k++ )
+                    {
+                        lRetVal = iot_spi_transfer_sync( xSPIHandle, ucBenchmarkTxBuf, ucBenchmarkRxBuf, xBytes );
+                        TEST_ASSERT_EQUAL( IOT_SPI_SUCCESS, lRetVal );
+                    }
+
+                    vTestIotBenchmarkReport( "spi", "throughput", "sync", spiBenchmarkFrequency[ i ], xBytes,
+                                             IOT_TEST_COMMON_IO_BENCHMARK_ITERATIONS,
+                                             ulTestIotBenchmarkCycles() - ulStart );
+
+                    ulStart = ulTestIotBenchmarkCycles();
+
+                    for( uint32_t k = 0; k < IOT_TEST_COMMON_IO_BENCHMARK_ITERATIONS; k++ )
+                    {
+                        lRetVal = iot_spi_transfer_async( xSPIHandle, ucBenchmarkTxBuf, ucBenchmarkRxBuf, xBytes );
+                        TEST_ASSERT_EQUAL( IOT_SPI_SUCCESS, lRetVal );
+                        TEST_ASSERT( pdPASS == xSemaphoreTake( xtestIotSPISemaphore, testIotSPI_DEFAULT_SEMAPHORE_DELAY ) );
+                    }
+
+                    vTestIotBenchmarkReport( "spi", "throughput", "async", spiBenchmarkFrequency[ i ], xBytes,
+                                             IOT_TEST_COMMON_IO_BENCHMARK_ITERATIONS,
+                                             ulTestIotBenchmarkCycles() - ulStart );
+                }
+            }
+        }
+
+        lRetVal = iot_spi_close( xSPIHandle );
+        TEST_ASSERT_EQUAL( IOT_SPI_SUCCESS, lRetVal );
+    }
+
+/*-----------------------------------------------------------*/
+
+/**
+ * @brief Time spent in iot_spi_transfer_async() before it returns, i.e. the cost
+ * of starting an interrupt or DMA transfer, at the fastest configured frequency.
+ */
+    TEST( TEST_IOT_SPI, IotSPI_Benchmark_Setup )
+    {
+        IotSPIHandle_t xSPIHandle;
+        int32_t lRetVal;
+        uint32_t ulStart;
+        uint32_t ulTotal;
+        uint32_t ulFreq = spiBenchmarkFrequency[ SPI_BENCHMARK_FREQ_SET - 1 ];
+
+        vTestIotBenchmarkInit();
+
+        xSPIHandle = iot_spi_open( ultestIotSpiInstance );
+        TEST_ASSERT_NOT_EQUAL( NULL, xSPIHandle );
+
+        if( TEST_PROTECT() )
+        {
+            iot_spi_set_callback( xSPIHandle, prvSpiBenchmarkCallback, NULL );
+            prvSpiBenchmarkSetFreq( xSPIHandle, ulFreq );
+
+            for( size_t j = 0; j < BENCHMARK_SIZE_SET; j++ )
+            {
+                size_t xBytes = benchmarkTransferSizes[ j ];
+
+                ulTotal = 0;
+
+                for( uint32_t k = 0; k < IOT_TEST_COMMON_IO_BENCHMARK_ITERATIONS; k++ )
+                {
+                    ulStart = ulTestIotBenchmarkCycles();
+                    lRetVal = iot_spi_transfer_async( xSPIHandle, ucBenchmarkTxBuf, ucBenchmarkRxBuf, xBytes );
+                    ulTotal += ulTestIotBenchmarkCycles() - ulStart;
+
+                    TEST_ASSERT_EQUAL( IOT_SPI_SUCCESS, lRetVal );
+                    TEST_ASSERT( pdPASS == xSemaphoreTake( xtestIotSPISemaphore, testIotSPI_DEFAULT_SEMAPHORE_DELAY ) );
+                }
+
+                vTestIotBenchmarkReport( "spi", "setup", "async", ulFreq, xBytes,
+                                         IOT_TEST_COMMON_IO_BENCHMARK_ITERATIONS, ulTotal );
+            }
+        }
+
+        lRetVal = iot_spi_close( xSPIHandle );
+        TEST_ASSERT_EQUAL( IOT_SPI_SUCCESS, lRetVal );
+    }
+
+/*-----------------------------------------------------------*/
+
+/**
+ * @brief Time from the completion callback, which runs in the SPI or DMA
+ * interrupt, until the waiting task runs again.
+ */
+    TEST( TEST_IOT_SPI, IotSPI_Benchmark_Latency )
+    {
+        IotSPIHandle_t xSPIHandle;
+        int32_t lRetVal;
+        uint32_t ulTotal;
+        uint32_t ulFreq = spiBenchmarkFrequency[ SPI_BENCHMARK_FREQ_SET - 1 ];
+
+        vTestIotBenchmarkInit();
+
+        xSPIHandle = iot_spi_open( ultestIotSpiInstance );
+        TEST_ASSERT_NOT_EQUAL( NULL, xSPIHandle );
+
+        if( TEST_PROTECT() )
+        {
+            iot_spi_set_callback( xSPIHandle, prvSpiBenchmarkCallback, NULL );
+            prvSpiBenchmarkSetFreq( xSPIHandle, ulFreq );
+
+            for( size_t j = 0; j < BENCHMARK_SIZE_SET; j++ )
+            {
+                size_t xBytes = benchmarkTransferSizes[ j ];
+
+                ulTotal = 0;
+
+                for( uint32_t k = 0; k < IOT_TEST_COMMON_IO_BENCHMARK_ITERATIONS; k++ )
+                {
+                    lRetVal = iot_spi_transfer_async( xSPIHandle, ucBenchmarkTxBuf, ucBenchmarkRxBuf, xBytes );
+                    TEST_ASSERT_EQUAL( IOT_SPI_SUCCESS, lRetVal );
+                    TEST_ASSERT( pdPASS == xSemaphoreTake( xtestIotSPISemaphore, testIotSPI_DEFAULT_SEMAPHORE_DELAY ) );
+
+                    ulTotal += ulTestIotBenchmarkCycles() - ulBenchmarkCallbackCycles;
+                }
+
+                vTestIotBenchmarkReport( "spi", "latency", "async", ulFreq, xBytes,
+                                         IOT_TEST_COMMON_IO_BENCHMARK_ITERATIONS, ulTotal );
+            }
+        }
+
+        lRetVal = iot_spi_close( xSPIHandle );
+        TEST_ASSERT_EQUAL( IOT_SPI_SUCCESS, lRetVal );
+    }
+
+/*-----------------------------------------------------------*/
+
+    static void prvSpiBenchmarkCallback( IotSPITransactionStatus_t xStatus,
+                                         void * pvUserContext )
+    {
+        BaseType_t xHigherPriorityTaskWoken = pdFALSE;
+
+        ( void ) xStatus;
+        ( void ) pvUserContext;
+
+        ulBenchmarkCallbackCycles = ulTestIotBenchmarkCycles();
+
+        xSemaphoreGiveFromISR( xtestIotSPISemaphore, &xHigherPriorityTaskWoken );
+        portYIELD_FROM_ISR( xHigherPriorityTaskWoken );
+    }
+
+/*-----------------------------------------------------------*/
+
+    static void prvSpiBenchmarkSetFreq( IotSPIHandle_t xSPIHandle,
+                                        uint32_t ulFreq )
+    {
+        IotSPIMasterConfig_t xConfig;
+
+        TEST_ASSERT_EQUAL( IOT_SPI_SUCCESS, iot_spi_ioctl( xSPIHandle, eSPIGetMasterConfig, &xConfig ) );
+
+        xConfig.ulFreq = ulFreq;
+        xConfig.eMode = xtestIotSPIDefaultConfigMode;
+        xConfig.eSetBitOrder = xtestIotSPIDefaultconfigBitOrder;
+
+        TEST_ASSERT_EQUAL( IOT_SPI_SUCCESS, iot_spi_ioctl( xSPIHandle, eSPISetMasterConfig, &xConfig ) );
+    }
+
+#endif /* if ( IOT_TEST_COMMON_IO_BENCHMARK == 1 ) */
+
 /*-----------------------------------------------------------*/
 
 static void prvAppendToMessage( size_t * pOffset,
@@ -120,6 +120,52 @@ static void prvReadWriteCallback( IotUARTOperationStatus_t xOpStatus,
 
 /*-----------------------------------------------------------*/
 
+#if ( IOT_TEST_COMMON_IO_BENCHMARK == 1 )
+    #define testIotUART_BENCHMARK_MAX_SIZE    ( 1024 )
+
+/* Time to send xBytes of 10 bit frames at ulBaud, plus a margin */
+    #define testIotUART_BENCHMARK_TIMEOUT( xBytes, ulBaud ) \
+    pdMS_TO_TICKS( ( ( ( xBytes ) * 10000UL ) / ( ulBaud ) ) + 100UL )
+
+    static uint8_t ucBenchmarkBuffer[ testIotUART_BENCHMARK_MAX_SIZE ];
+
+/* Cycle count taken in the completion callback of the last asynchronous write */
+    static volatile uint32_t ulBenchmarkCallbackCycles = 0;
+
+/**
+ * @brief Callback of the benchmarks, records when the write completed.
+ */
+    static void prvBenchmarkCallback( IotUARTOperationStatus_t xOpStatus,
+                                      void * pvParams )
+    {
+        BaseType_t xHigherPriorityTaskWoken = pdFALSE;
+
+        ( void ) pvParams;
+
+        if( xOpStatus == eUartWriteCompleted )
+        {
+            ulBenchmarkCallbackCycles = ulTestIotBenchmarkCycles();
+            xSemaphoreGiveFromISR( xWriteCompleteSemaphore, &xHigherPriorityTaskWoken );
+        }
+
+        portYIELD_FROM_ISR( xHigherPriorityTaskWoken );
+    }
+
+    static void prvBenchmarkSetBaudrate( IotUARTHandle_t xUartHandle,
+                                         uint32_t ulBaudrate )
+    {
+        IotUARTConfig_t xConfig;
+
+        TEST_ASSERT_EQUAL( IOT_UART_SUCCESS, iot_uart_ioctl( xUartHandle, eUartGetConfig, &xConfig ) );
+
+        xConfig.ulBaudrate = ulBaudrate;
+
+        TEST_ASSERT_EQUAL( IOT_UART_SUCCESS, iot_uart_ioctl( xUartHandle, eUartSetConfig, &xConfig ) );
+    }
+#endif /* if ( IOT_TEST_COMMON_IO_BENCHMARK == 1 ) */
+
+/*-----------------------------------------------------------*/
+
 /* Define Test Group. */
 TEST_GROUP( TEST_IOT_UART );
 
@@ -165,6 +211,12 @@ TEST_GROUP_RUNNER( TEST_IOT_UART )
     RUN_TEST_CASE( TEST_IOT_UART, AFQP_IotUARTWriteAsyncReadAsyncLoopbackTest );
     RUN_TEST_CASE( TEST_IOT_UART, AFQP_IotUARTIoctlGetSet );
     RUN_TEST_CASE( TEST_IOT_UART, AFQP_IotUARTOpenCloseCancelFuzzing );
+
+    #if ( IOT_TEST_COMMON_IO_BENCHMARK == 1 )
+        RUN_TEST_CASE( TEST_IOT_UART, IotUARTBenchmarkThroughput );
+        RUN_TEST_CASE( TEST_IOT_UART, IotUARTBenchmarkSetup );
+        RUN_TEST_CASE( TEST_IOT_UART, IotUARTBenchmarkLatency );
+    #endif
 }
 /*-----------------------------------------------------------*/
 /*-----------------------------------------------------------*/
@@ -810,3 +862,173 @@ TEST( TEST_IOT_UART, AFQP_IotUARTOpenCloseCancelFuzzing )
     TEST_ASSERT_EQUAL( IOT_UART_INVALID_VALUE, lClose );
 }
 /*-----------------------------------------------------------*/
+
+#if ( IOT_TEST_COMMON_IO_BENCHMARK == 1 )
+
+/**
+ * Sustained write throughput for every configured baud rate and transfer size,
+ * with the sync and async APIs. Only TX is needed, no loopback or external device.
+ */
+    TEST( TEST_IOT_UART, IotUARTBenchmarkThroughput )
+    {
+        IotUARTHandle_t xUartHandle;
+        int32_t lWrite, lClose;
+        uint32_t ulStart;
+
+        vTestIotBenchmarkInit();
+        memset( ucBenchmarkBuffer, 'U', sizeof( ucBenchmarkBuffer ) );
+
+        xUartHandle = iot_uart_open( uctestIotUartPort );
+        TEST_ASSERT_NOT_EQUAL( NULL, xUartHandle );
+
+        if( TEST_PROTECT() )
+        {
+            iot_uart_set_callback( xUartHandle, prvBenchmarkCallback, NULL );
+
+            for( size_t i = 0; i < UART_BENCHMARK_BAUD_SET; i++ )
+            {
+                uint32_t ulBaud = uartBenchmarkBaudrate[ i ];
+
+                prvBenchmarkSetBaudrate( xUartHandle, ulBaud );
+
+                for( size_t j = 0; j < BENCHMARK_SIZE_SET; j++ )
+                {
+                    size_t xBytes = benchmarkTransferSizes[ j ];
+
+                    ulStart = ulTestIotBenchmarkCycles();
+
+                    for( uint32_t k = 0; k < IOT_TEST_COMMON_IO_BENCHMARK_ITERATIONS; k++ )
+                    {
+                        lWrite = iot_uart_write_sync( xUartHandle, ucBenchmarkBuffer, xBytes );
+                        TEST_ASSERT_EQUAL( IOT_UART_SUCCESS, lWrite );
+                    }
+
+                    vTestIotBenchmarkReport( "uart", "throughput", "sync", ulBaud, xBytes,
+                                             IOT_TEST_COMMON_IO_BENCHMARK_ITERATIONS,
+                                             ulTestIotBenchmarkCycles() - ulStart );
+
+                    ( void ) xSemaphoreTake( xWriteCompleteSemaphore, 0 );
+                    ulStart = ulTestIotBenchmarkCycles();
+
+                    for( uint32_t k = 0; k < IOT_TEST_COMMON_IO_BENCHMARK_ITERATIONS; k++ )
+                    {
+                        lWrite = iot_uart_write_async( xUartHandle, ucBenchmarkBuffer, xBytes );
+                        TEST_ASSERT_EQUAL( IOT_UART_SUCCESS, lWrite );
+                        TEST_ASSERT_EQUAL( pdTRUE, xSemaphoreTake( xWriteCompleteSemaphore,
+                                                                   testIotUART_BENCHMARK_TIMEOUT( xBytes, ulBaud ) ) );
+                    }
+
+                    vTestIotBenchmarkReport( "uart", "throughput", "async", ulBaud, xBytes,
+                                             IOT_TEST_COMMON_IO_BENCHMARK_ITERATIONS,
+                                             ulTestIotBenchmarkCycles() - ulStart );
+                }
+            }
+
+            prvBenchmarkSetBaudrate( xUartHandle, testIotUART_TEST_BAUD_RATE_DEFAULT );
+        }
+
+        lClose = iot_uart_close( xUartHandle );
+        TEST_ASSERT_EQUAL( IOT_UART_SUCCESS, lClose );
+    }
+/*-----------------------------------------------------------*/
+
+/**
+ * Time spent in iot_uart_write_async() before it returns, at the fastest configured baud rate.
+ */
+    TEST( TEST_IOT_UART, IotUARTBenchmarkSetup )
+    {
+        IotUARTHandle_t xUartHandle;
+        int32_t lWrite, lClose;
+        uint32_t ulStart, ulTotal;
+        uint32_t ulBaud = uartBenchmarkBaudrate[ UART_BENCHMARK_BAUD_SET - 1 ];
+
+        vTestIotBenchmarkInit();
+
+        xUartHandle = iot_uart_open( uctestIotUartPort );
+        TEST_ASSERT_NOT_EQUAL( NULL, xUartHandle );
+
+        if( TEST_PROTECT() )
+        {
+            iot_uart_set_callback( xUartHandle, prvBenchmarkCallback, NULL );
+            prvBenchmarkSetBaudrate( xUartHandle, ulBaud );
+            ( void ) xSemaphoreTake( xWriteCompleteSemaphore, 0 );
+
+            for( size_t j = 0; j < BENCHMARK_SIZE_SET; j++ )
+            {
+                size_t xBytes = benchmarkTransferSizes[ j ];
+
+                ulTotal = 0;
+
+                for( uint32_t k = 0; k < IOT_TEST_COMMON_IO_BENCHMARK_ITERATIONS; k++ )
+                {
+                    ulStart = ulTestIotBenchmarkCycles();
+                    lWrite = iot_uart_write_async( xUartHandle, ucBenchmarkBuffer, xBytes );
+                    ulTotal += ulTestIotBenchmarkCycles() - ulStart;
+
+                    TEST_ASSERT_EQUAL( IOT_UART_SUCCESS, lWrite );
+                    TEST_ASSERT_EQUAL( pdTRUE, xSemaphoreTake( xWriteCompleteSemaphore,
+                                                               testIotUART_BENCHMARK_TIMEOUT( xBytes, ulBaud ) ) );
+                }
+
+                vTestIotBenchmarkReport( "uart", "setup", "async", ulBaud, xBytes,
+                                         IOT_TEST_COMMON_IO_BENCHMARK_ITERATIONS, ulTotal );
+            }
+
+            prvBenchmarkSetBaudrate( xUartHandle, testIotUART_TEST_BAUD_RATE_DEFAULT );
+        }
+
+        lClose = iot_uart_close( xUartHandle );
+        TEST_ASSERT_EQUAL( IOT_UART_SUCCESS, lClose );
+    }
+/*-----------------------------------------------------------*/
+
+/**
+ * Time from the write completion callback, which runs in the UART or DMA
+ * interrupt, until the waiting task runs again.
+ */
+    TEST( TEST_IOT_UART, IotUARTBenchmarkLatency )
+    {
+        IotUARTHandle_t xUartHandle;
+        int32_t lWrite, lClose;
+        uint32_t ulTotal;
+        uint32_t ulBaud = uartBenchmarkBaudrate[ UART_BENCHMARK_BAUD_SET - 1 ];
+
+        vTestIotBenchmarkInit();
+
+        xUartHandle = iot_uart_open( uctestIotUartPort );
+        TEST_ASSERT_NOT_EQUAL( NULL, xUartHandle );
+
+        if( TEST_PROTECT() )
+        {
+            iot_uart_set_callback( xUartHandle, prvBenchmarkCallback, NULL );
+            prvBenchmarkSetBaudrate( xUartHandle, ulBaud );
+            ( void ) xSemaphoreTake( xWriteCompleteSemaphore, 0 );
+
+            for( size_t j = 0; j < BENCHMARK_SIZE_SET; j++ )
+            {
+                size_t xBytes = benchmarkTransferSizes[ j ];
+
+                ulTotal = 0;
+
+                for( uint32_t k = 0; k < IOT_TEST_COMMON_IO_BENCHMARK_ITERATIONS; k++ )
+                {
+                    lWrite = iot_uart_write_async( xUartHandle, ucBenchmarkBuffer, xBytes );
+                    TEST_ASSERT_EQUAL( IOT_UART_SUCCESS, lWrite );
+                    TEST_ASSERT_EQUAL( pdTRUE, xSemaphoreTake( xWriteCompleteSemaphore,
+                                                               testIotUART_BENCHMARK_TIMEOUT( xBytes, ulBaud ) ) );
+
+                    ulTotal += ulTestIotBenchmarkCycles() - ulBenchmarkCallbackCycles;
+                }
+
+                vTestIotBenchmarkReport( "uart", "latency", "async", ulBaud, xBytes,
+                                         IOT_TEST_COMMON_IO_BENCHMARK_ITERATIONS, ulTotal );
+            }
+
+            prvBenchmarkSetBaudrate( xUartHandle, testIotUART_TEST_BAUD_RATE_DEFAULT );
+        }
+
+        lClose = iot_uart_close( xUartHandle );
+        TEST_ASSERT_EQUAL( IOT_UART_SUCCESS, lClose );
+    }
+/*-----------------------------------------------------------*/
+#endif /* if ( IOT_TEST_COMMON_IO_BENCHMARK == 1 ) */
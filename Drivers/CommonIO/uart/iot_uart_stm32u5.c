@@ -39,6 +39,7 @@
 /* FreeRTOS includes. */
 #include "FreeRTOS.h"
 #include "semphr.h"
+#include "stream_buffer.h"
 
 /**
  * @brief STM UART Descriptor.
@@ -53,6 +54,17 @@ typedef struct IotUARTDescriptor
     SemaphoreHandle_t xSemphr;
     StaticSemaphore_t xSemphrBuffer;
     uint8_t sOpened;
+    DMA_HandleTypeDef * pxDmaTx;      /**< NULL if the port has no DMA channels. */
+    DMA_HandleTypeDef * pxDmaRx;      /**< Circular linked list channel for the receive stream. */
+    DMA_QListTypeDef * pxDmaRxQueue;
+    DMA_NodeTypeDef * pxDmaRxNode;
+    IRQn_Type eDmaTxIrqNum;
+    IRQn_Type eDmaRxIrqNum;
+    StreamBufferHandle_t xRxStream;   /**< Receive stream, NULL when not started. */
+    uint8_t * pucRxRing;              /**< Circular DMA target of the receive stream. */
+    size_t xRxRingLen;
+    size_t xRxRingPos;                /**< Offset in pucRxRing of the next byte to move to xRxStream. */
+    volatile uint32_t ulRxDropped;    /**< Bytes lost because xRxStream was full. */
 } IotUARTDescriptor_t;
 
 
@@ -63,6 +75,12 @@ typedef struct IotUARTDescriptor
 #define IOT_UART_CLOSED              ( ( uint8_t ) 0 )
 #define IOT_UART_OPENED              ( ( uint8_t ) 1 )
 
+/* Priority of the UART and DMA interrupts. Must not be above configMAX_SYSCALL_INTERRUPT_PRIORITY
+ * as the completion callbacks use the FreeRTOS FromISR API. */
+#ifndef IOT_UART_IRQ_PRIORITY
+#define IOT_UART_IRQ_PRIORITY        5
+#endif
+
 /**
  * @brief Statically initialized map of STM UART Handle for all 5 ports.
  *
@@ -191,6 +209,47 @@ static UART_HandleTypeDef xUartHandleMap[] =
     },
 };
 
+/*
+ * DMA channels of USART1. These are the channels of the console driver in Common/cli,
+ * which drives USART1 directly when this driver is not linked.
+ */
+static DMA_HandleTypeDef xUart0DmaTx =
+{
+    .Instance                  = GPDMA1_Channel3,
+    .Init                      =
+    {
+        .Request               = GPDMA1_REQUEST_USART1_TX,
+        .BlkHWRequest          = DMA_BREQ_SINGLE_BURST,
+        .Direction             = DMA_MEMORY_TO_PERIPH,
+        .SrcInc                = DMA_SINC_INCREMENTED,
+        .DestInc               = DMA_DINC_FIXED,
+        .SrcDataWidth          = DMA_SRC_DATAWIDTH_BYTE,
+        .DestDataWidth         = DMA_DEST_DATAWIDTH_BYTE,
+        .Priority              = DMA_LOW_PRIORITY_LOW_WEIGHT,
+        .SrcBurstLength        = 1,
+        .DestBurstLength       = 1,
+        .TransferAllocatedPort = DMA_SRC_ALLOCATED_PORT0 | DMA_DEST_ALLOCATED_PORT1,
+        .TransferEventMode     = DMA_TCEM_BLOCK_TRANSFER,
+        .Mode                  = DMA_NORMAL,
+    },
+};
+
+static DMA_HandleTypeDef xUart0DmaRx =
+{
+    .Instance                  = GPDMA1_Channel12,
+    .InitLinkedList            =
+    {
+        .Priority              = DMA_LOW_PRIORITY_HIGH_WEIGHT,
+        .LinkStepMode          = DMA_LSM_FULL_EXECUTION,
+        .LinkAllocatedPort     = DMA_LINK_ALLOCATED_PORT0,
+        .TransferEventMode     = DMA_TCEM_BLOCK_TRANSFER,
+        .LinkedListMode        = DMA_LINKEDLIST_CIRCULAR,
+    },
+};
+
+static DMA_QListTypeDef xUart0DmaRxQueue;
+static DMA_NodeTypeDef xUart0DmaRxNode;
+
 static IotUARTDescriptor_t xUart0 =
 {
     .pvUserCallbackContext = NULL,
@@ -199,6 +258,13 @@ static IotUARTDescriptor_t xUart0 =
     .xUartCallback         = NULL,
     .xSemphr               = NULL,
     .sOpened               = IOT_UART_CLOSED,
+    .pxDmaTx               = &xUart0DmaTx,
+    .pxDmaRx               = &xUart0DmaRx,
+    .pxDmaRxQueue          = &xUart0DmaRxQueue,
+    .pxDmaRxNode           = &xUart0DmaRxNode,
+    .eDmaTxIrqNum          = GPDMA1_Channel3_IRQn,
+    .eDmaRxIrqNum          = GPDMA1_Channel12_IRQn,
+    .xRxStream             = NULL,
 };
 
 static IotUARTDescriptor_t xUart1 =
@@ -243,6 +309,151 @@ static IotUARTDescriptor_t xUart4 =
 
 static IotUARTHandle_t const pxUarts[] = { &xUart0, &xUart1, &xUart2, &xUart3, &xUart4 };
 
+/*-----------------------------------------------------------*/
+
+static HAL_StatusTypeDef prvInitDma( IotUARTHandle_t const pxUartPeripheral )
+{
+    HAL_StatusTypeDef xResult = HAL_OK;
+    DMA_NodeConfTypeDef xNodeConf = { 0 };
+
+    if( pxUartPeripheral->pxDmaTx != NULL )
+    {
+        __HAL_RCC_GPDMA1_CLK_ENABLE();
+
+        xResult = HAL_DMA_Init( pxUartPeripheral->pxDmaTx );
+
+        if( xResult == HAL_OK )
+        {
+            xResult = HAL_DMA_ConfigChannelAttributes( pxUartPeripheral->pxDmaTx, DMA_CHANNEL_NPRIV );
+        }
+
+        /* A single node list looping on itself. The UART driver sets its addresses and length
+         * when the reception starts. */
+        if( xResult == HAL_OK )
+        {
+            xNodeConf.NodeType = DMA_GPDMA_LINEAR_NODE;
+            xNodeConf.Init.Request = ( pxUartPeripheral->pxHuart->Instance == USART1 ) ? GPDMA1_REQUEST_USART1_RX : 0;
+            xNodeConf.Init.BlkHWRequest = DMA_BREQ_SINGLE_BURST;
+            xNodeConf.Init.Direction = DMA_PERIPH_TO_MEMORY;
+            xNodeConf.Init.SrcInc = DMA_SINC_FIXED;
+            xNodeConf.Init.DestInc = DMA_DINC_INCREMENTED;
+            xNodeConf.Init.SrcDataWidth = DMA_SRC_DATAWIDTH_BYTE;
+            xNodeConf.Init.DestDataWidth = DMA_DEST_DATAWIDTH_BYTE;
+            xNodeConf.Init.SrcBurstLength = 1;
+            xNodeConf.Init.DestBurstLength = 1;
+            xNodeConf.Init.TransferAllocatedPort = DMA_SRC_ALLOCATED_PORT0 | DMA_DEST_ALLOCATED_PORT1;
+            xNodeConf.Init.TransferEventMode = DMA_TCEM_BLOCK_TRANSFER;
+            xNodeConf.Init.Mode = DMA_NORMAL;
+            xNodeConf.TriggerConfig.TriggerPolarity = DMA_TRIG_POLARITY_MASKED;
+            xNodeConf.DataHandlingConfig.DataExchange = DMA_EXCHANGE_NONE;
+            xNodeConf.DataHandlingConfig.DataAlignment = DMA_DATA_RIGHTALIGN_ZEROPADDED;
+
+            xResult = HAL_DMAEx_List_BuildNode( &xNodeConf, pxUartPeripheral->pxDmaRxNode );
+        }
+
+        if( xResult == HAL_OK )
+        {
+            xResult = HAL_DMAEx_List_InsertNode( pxUartPeripheral->pxDmaRxQueue, NULL, pxUartPeripheral->pxDmaRxNode );
+        }
+
+        if( xResult == HAL_OK )
+        {
+            xResult = HAL_DMAEx_List_SetCircularMode( pxUartPeripheral->pxDmaRxQueue );
+        }
+
+        if( xResult == HAL_OK )
+        {
+            xResult = HAL_DMAEx_List_Init( pxUartPeripheral->pxDmaRx );
+        }
+
+        if( xResult == HAL_OK )
+        {
+            xResult = HAL_DMAEx_List_LinkQ( pxUartPeripheral->pxDmaRx, pxUartPeripheral->pxDmaRxQueue );
+        }
+
+        if( xResult == HAL_OK )
+        {
+            xResult = HAL_DMA_ConfigChannelAttributes( pxUartPeripheral->pxDmaRx, DMA_CHANNEL_NPRIV );
+        }
+
+        if( xResult == HAL_OK )
+        {
+            __HAL_LINKDMA( pxUartPeripheral->pxHuart, hdmatx, *( pxUartPeripheral->pxDmaTx ) );
+            __HAL_LINKDMA( pxUartPeripheral->pxHuart, hdmarx, *( pxUartPeripheral->pxDmaRx ) );
+
+            HAL_NVIC_SetPriority( pxUartPeripheral->eDmaTxIrqNum, IOT_UART_IRQ_PRIORITY, 0 );
+            HAL_NVIC_EnableIRQ( pxUartPeripheral->eDmaTxIrqNum );
+            HAL_NVIC_SetPriority( pxUartPeripheral->eDmaRxIrqNum, IOT_UART_IRQ_PRIORITY, 0 );
+            HAL_NVIC_EnableIRQ( pxUartPeripheral->eDmaRxIrqNum );
+        }
+    }
+
+    return xResult;
+}
+/*-----------------------------------------------------------*/
+
+static void prvDeInitDma( IotUARTHandle_t const pxUartPeripheral )
+{
+    if( pxUartPeripheral->pxDmaTx != NULL )
+    {
+        HAL_NVIC_DisableIRQ( pxUartPeripheral->eDmaTxIrqNum );
+        HAL_NVIC_DisableIRQ( pxUartPeripheral->eDmaRxIrqNum );
+
+        ( void ) HAL_DMA_DeInit( pxUartPeripheral->pxDmaTx );
+        ( void ) HAL_DMAEx_List_DeInit( pxUartPeripheral->pxDmaRx );
+        ( void ) HAL_DMAEx_List_ResetQ( pxUartPeripheral->pxDmaRxQueue );
+
+        pxUartPeripheral->pxHuart->hdmatx = NULL;
+        pxUartPeripheral->pxHuart->hdmarx = NULL;
+    }
+}
+/*-----------------------------------------------------------*/
+
+static void prvEnableIrq( IotUARTHandle_t const pxUartPeripheral )
+{
+    HAL_NVIC_SetPriority( pxUartPeripheral->eIrqNum, IOT_UART_IRQ_PRIORITY, 0 );
+    HAL_NVIC_EnableIRQ( pxUartPeripheral->eIrqNum );
+}
+/*-----------------------------------------------------------*/
+
+static HAL_StatusTypeDef prvStartRxStream( IotUARTHandle_t const pxUartPeripheral )
+{
+    HAL_StatusTypeDef xResult;
+
+    pxUartPeripheral->xRxRingPos = 0;
+
+    xResult = HAL_UARTEx_ReceiveToIdle_DMA( pxUartPeripheral->pxHuart,
+                                            pxUartPeripheral->pucRxRing,
+                                            ( uint16_t ) pxUartPeripheral->xRxRingLen );
+
+    return xResult;
+}
+/*-----------------------------------------------------------*/
+
+/* Move the bytes the DMA wrote to the ring since the last event to the receive stream. */
+static void prvRxStreamPush( IotUARTHandle_t const pxUartPeripheral,
+                             size_t xRingPos,
+                             BaseType_t * pxHigherPriorityTaskWoken )
+{
+    size_t xPos = pxUartPeripheral->xRxRingPos;
+
+    while( xPos != xRingPos )
+    {
+        size_t xEnd = ( xRingPos > xPos ) ? xRingPos : pxUartPeripheral->xRxRingLen;
+        size_t xLen = xEnd - xPos;
+        size_t xSent = xStreamBufferSendFromISR( pxUartPeripheral->xRxStream,
+                                                 &( pxUartPeripheral->pucRxRing[ xPos ] ),
+                                                 xLen,
+                                                 pxHigherPriorityTaskWoken );
+
+        pxUartPeripheral->ulRxDropped += ( uint32_t ) ( xLen - xSent );
+
+        xPos = ( xEnd == pxUartPeripheral->xRxRingLen ) ? 0 : xEnd;
+    }
+
+    pxUartPeripheral->xRxRingPos = xPos;
+}
+
 IotUARTHandle_t iot_uart_open( int32_t lUartInstance )
 {
     IotUARTHandle_t xHandle = NULL;
@@ -269,14 +480,19 @@ IotUARTHandle_t iot_uart_open( int32_t lUartInstance )
             }
 
             /* Note, as opposed to previous SDKs, this BSP_COM_Init no longer initializes the UART */
-            if( HAL_UART_Init( pxUarts[ lUartInstance ]->pxHuart ) == HAL_OK )
+            if( HAL_UART_Init( pxUarts[ lUartInstance ]->pxHuart ) != HAL_OK )
             {
-                xHandle->sOpened = IOT_UART_OPENED;
+                xHandle = NULL;
             }
-            else
+            else if( prvInitDma( xHandle ) != HAL_OK )
             {
+                ( void ) HAL_UART_DeInit( xHandle->pxHuart );
                 xHandle = NULL;
             }
+            else
+            {
+                xHandle->sOpened = IOT_UART_OPENED;
+            }
         }
         else
         {
@@ -312,14 +528,14 @@ int32_t iot_uart_read_async( IotUARTHandle_t const pxUartPeripheral,
     }
     else
     {
-        if( HAL_UART_GetState( pxUartPeripheral->pxHuart ) == HAL_UART_STATE_BUSY_RX )
+        if( ( HAL_UART_GetState( pxUartPeripheral->pxHuart ) == HAL_UART_STATE_BUSY_RX ) ||
+            ( pxUartPeripheral->xRxStream != NULL ) )
         {
             lError = IOT_UART_BUSY;
         }
         else
         {
-            HAL_NVIC_SetPriority( pxUartPeripheral->eIrqNum, 1, 0 );
-            HAL_NVIC_EnableIRQ( pxUartPeripheral->eIrqNum );
+            prvEnableIrq( pxUartPeripheral );
 
             if( HAL_UART_Receive_IT( pxUartPeripheral->pxHuart, pvBuffer, ( uint16_t ) xBytes ) != HAL_OK )
             {
@@ -350,10 +566,20 @@ int32_t iot_uart_write_async( IotUARTHandle_t const pxUartPeripheral,
         }
         else
         {
-            HAL_NVIC_SetPriority( pxUartPeripheral->eIrqNum, 1, 0 );
-            HAL_NVIC_EnableIRQ( pxUartPeripheral->eIrqNum );
+            HAL_StatusTypeDef xResult;
+
+            prvEnableIrq( pxUartPeripheral );
+
+            if( pxUartPeripheral->pxHuart->hdmatx != NULL )
+            {
+                xResult = HAL_UART_Transmit_DMA( pxUartPeripheral->pxHuart, pvBuffer, ( uint16_t ) xBytes );
+            }
+            else
+            {
+                xResult = HAL_UART_Transmit_IT( pxUartPeripheral->pxHuart, pvBuffer, ( uint16_t ) xBytes );
+            }
 
-            if( HAL_UART_Transmit_IT( pxUartPeripheral->pxHuart, pvBuffer, ( uint16_t ) xBytes ) != HAL_OK )
+            if( xResult != HAL_OK )
             {
                 lError = IOT_UART_WRITE_FAILED;
             }
@@ -392,7 +618,21 @@ int32_t iot_uart_write_sync( IotUARTHandle_t const pxUartPeripheral,
     int32_t lError = IOT_UART_SUCCESS;
     HAL_StatusTypeDef status = HAL_OK;
 
-    if( ( pvBuffer == NULL ) || ( xBytes == 0 ) || ( pxUartPeripheral == NULL ) || ( pxUartPeripheral->sOpened == IOT_UART_CLOSED ) )
+    if( ( pxUartPeripheral != NULL ) && ( pxUartPeripheral->pxHuart->hdmatx != NULL ) )
+    {
+        /* Wait for the DMA transfer rather than polling each byte */
+        ( void ) xSemaphoreTake( pxUartPeripheral->xSemphr, 0 );
+
+        lError = iot_uart_write_async( pxUartPeripheral, pvBuffer, xBytes );
+
+        if( ( lError == IOT_UART_SUCCESS ) &&
+            ( xSemaphoreTake( pxUartPeripheral->xSemphr, pdMS_TO_TICKS( IOT_UART_BLOCKING_TIMEOUT ) ) == pdFALSE ) )
+        {
+            ( void ) HAL_UART_AbortTransmit( pxUartPeripheral->pxHuart );
+            lError = IOT_UART_WRITE_FAILED;
+        }
+    }
+    else if( ( pvBuffer == NULL ) || ( xBytes == 0 ) || ( pxUartPeripheral == NULL ) || ( pxUartPeripheral->sOpened == IOT_UART_CLOSED ) )
     {
         lError = IOT_UART_INVALID_VALUE;
     }
@@ -427,7 +667,12 @@ int32_t iot_uart_close( IotUARTHandle_t const pxUartPeripheral )
     }
     else
     {
-        if( HAL_UART_Abort( pxUartPeripheral->pxHuart ) != HAL_OK )
+        if( ( pxUartPeripheral->xRxStream != NULL ) &&
+            ( iot_uart_rx_stream_stop( pxUartPeripheral ) != IOT_UART_SUCCESS ) )
+        {
+            lError = IOT_UART_BUSY;
+        }
+        else if( HAL_UART_Abort( pxUartPeripheral->pxHuart ) != HAL_OK )
         {
             lError = IOT_UART_BUSY;
         }
@@ -437,6 +682,7 @@ int32_t iot_uart_close( IotUARTHandle_t const pxUartPeripheral )
         }
         else
         {
+            prvDeInitDma( pxUartPeripheral );
             vSemaphoreDelete( pxUartPeripheral->xSemphr );
             lError = IOT_UART_SUCCESS;
             pxUartPeripheral->sOpened = IOT_UART_CLOSED;
@@ -506,6 +752,13 @@ int32_t iot_uart_ioctl( IotUARTHandle_t const pxUartPeripheral,
 
                 break;
 
+            case eGetRxDroppedBytes:
+
+                *( int32_t * ) pvBuffer = ( int32_t ) pxUartPeripheral->ulRxDropped;
+                lError = IOT_UART_SUCCESS;
+
+                break;
+
             default:
                 break;
         }
@@ -515,6 +768,109 @@ int32_t iot_uart_ioctl( IotUARTHandle_t const pxUartPeripheral,
 }
 /*-----------------------------------------------------------*/
 
+int32_t iot_uart_rx_stream_start( IotUARTHandle_t const pxUartPeripheral,
+                                  uint8_t * const pucDmaBuffer,
+                                  size_t xDmaBufferLen,
+                                  size_t xStreamLen )
+{
+    int32_t lError = IOT_UART_SUCCESS;
+
+    if( ( pxUartPeripheral == NULL ) || ( pxUartPeripheral->sOpened == IOT_UART_CLOSED ) ||
+        ( pucDmaBuffer == NULL ) || ( xDmaBufferLen < 2 ) || ( xDmaBufferLen > UINT16_MAX ) ||
+        ( xStreamLen == 0 ) )
+    {
+        lError = IOT_UART_INVALID_VALUE;
+    }
+    else if( pxUartPeripheral->pxHuart->hdmarx == NULL )
+    {
+        lError = IOT_UART_FUNCTION_NOT_SUPPORTED;
+    }
+    else if( ( pxUartPeripheral->xRxStream != NULL ) ||
+             ( HAL_UART_GetState( pxUartPeripheral->pxHuart ) == HAL_UART_STATE_BUSY_RX ) )
+    {
+        lError = IOT_UART_BUSY;
+    }
+    else
+    {
+        StreamBufferHandle_t xStream = xStreamBufferCreate( xStreamLen, 1 );
+
+        if( xStream == NULL )
+        {
+            lError = IOT_UART_READ_FAILED;
+        }
+        else
+        {
+            pxUartPeripheral->pucRxRing = pucDmaBuffer;
+            pxUartPeripheral->xRxRingLen = xDmaBufferLen;
+            pxUartPeripheral->ulRxDropped = 0;
+            pxUartPeripheral->xRxStream = xStream;
+
+            prvEnableIrq( pxUartPeripheral );
+
+            if( prvStartRxStream( pxUartPeripheral ) != HAL_OK )
+            {
+                pxUartPeripheral->xRxStream = NULL;
+                vStreamBufferDelete( xStream );
+                lError = IOT_UART_READ_FAILED;
+            }
+        }
+    }
+
+    return lError;
+}
+/*-----------------------------------------------------------*/
+
+int32_t iot_uart_rx_stream_read( IotUARTHandle_t const pxUartPeripheral,
+                                 uint8_t * const pvBuffer,
+                                 size_t xBytes,
+                                 size_t * pxBytesRead,
+                                 uint32_t ulTimeoutMs )
+{
+    int32_t lError = IOT_UART_SUCCESS;
+
+    if( ( pxUartPeripheral == NULL ) || ( pvBuffer == NULL ) || ( xBytes == 0 ) || ( pxBytesRead == NULL ) )
+    {
+        lError = IOT_UART_INVALID_VALUE;
+    }
+    else if( pxUartPeripheral->xRxStream == NULL )
+    {
+        lError = IOT_UART_READ_FAILED;
+    }
+    else
+    {
+        TickType_t xTicks = ( ulTimeoutMs == UINT32_MAX ) ? portMAX_DELAY : pdMS_TO_TICKS( ulTimeoutMs );
+
+        *pxBytesRead = xStreamBufferReceive( pxUartPeripheral->xRxStream, pvBuffer, xBytes, xTicks );
+    }
+
+    return lError;
+}
+/*-----------------------------------------------------------*/
+
+int32_t iot_uart_rx_stream_stop( IotUARTHandle_t const pxUartPeripheral )
+{
+    int32_t lError = IOT_UART_SUCCESS;
+
+    if( ( pxUartPeripheral == NULL ) || ( pxUartPeripheral->xRxStream == NULL ) )
+    {
+        lError = IOT_UART_INVALID_VALUE;
+    }
+    else if( HAL_UART_AbortReceive( pxUartPeripheral->pxHuart ) != HAL_OK )
+    {
+        lError = IOT_UART_BUSY;
+    }
+    else
+    {
+        StreamBufferHandle_t xStream = pxUartPeripheral->xRxStream;
+
+        pxUartPeripheral->xRxStream = NULL;
+        vStreamBufferDelete( xStream );
+    }
+
+    return lError;
+}
+/*-----------------------------------------------------------*/
+
 int32_t iot_uart_cancel( IotUARTHandle_t const pxUartPeripheral )
 {
     int32_t lError = IOT_UART_INVALID_VALUE;
@@ -525,6 +881,18 @@ int32_t iot_uart_cancel( IotUARTHandle_t const pxUartPeripheral )
         {
             lError = IOT_UART_NOTHING_TO_CANCEL;
         }
+        else if( pxUartPeripheral->xRxStream != NULL )
+        {
+            /* The receive stream is stopped with iot_uart_rx_stream_stop() */
+            if( pxUartPeripheral->pxHuart->gState == HAL_UART_STATE_READY )
+            {
+                lError = IOT_UART_NOTHING_TO_CANCEL;
+            }
+            else if( HAL_UART_AbortTransmit( pxUartPeripheral->pxHuart ) == HAL_OK )
+            {
+                lError = IOT_UART_SUCCESS;
+            }
+        }
         else if( HAL_UART_Abort( pxUartPeripheral->pxHuart ) == HAL_OK )
         {
             lError = IOT_UART_SUCCESS;
@@ -564,6 +932,13 @@ void HAL_UART_ErrorCallback( UART_HandleTypeDef * huart )
                 __HAL_UART_CLEAR_FEFLAG( huart );
             }
 
+            /* The HAL stops a DMA reception on error, keep the stream running */
+            if( ( pxUarts[ i ]->xRxStream != NULL ) &&
+                ( huart->RxState == HAL_UART_STATE_READY ) )
+            {
+                ( void ) prvStartRxStream( pxUarts[ i ] );
+            }
+
             xSemaphoreGiveFromISR( pxUarts[ i ]->xSemphr, &higherPriorityTaskWoken );
             portYIELD_FROM_ISR( higherPriorityTaskWoken );
             break;
@@ -594,6 +969,32 @@ void HAL_UART_RxCpltCallback( UART_HandleTypeDef * huart )
 }
 /*-----------------------------------------------------------*/
 
+void HAL_UARTEx_RxEventCallback( UART_HandleTypeDef * huart,
+                                 uint16_t usSize )
+{
+    BaseType_t higherPriorityTaskWoken = pdFALSE;
+    uint32_t i = 0;
+
+    for( ; i < sizeof( xUartHandleMap ) / sizeof( UART_HandleTypeDef ); i++ )
+    {
+        if( ( huart->Instance == xUartHandleMap[ i ].Instance ) &&
+            ( pxUarts[ i ]->xRxStream != NULL ) )
+        {
+            /* usSize is the fill level of the ring, at half transfer, wrap around or idle line */
+            prvRxStreamPush( pxUarts[ i ], ( usSize >= pxUarts[ i ]->xRxRingLen ) ? 0 : usSize, &higherPriorityTaskWoken );
+
+            if( pxUarts[ i ]->xUartCallback != NULL )
+            {
+                pxUarts[ i ]->xUartCallback( eUartReadCompleted, pxUarts[ i ]->pvUserCallbackContext );
+            }
+
+            portYIELD_FROM_ISR( higherPriorityTaskWoken );
+            break;
+        }
+    }
+}
+/*-----------------------------------------------------------*/
+
 void HAL_UART_TxCpltCallback( UART_HandleTypeDef * huart )
 {
     BaseType_t higherPriorityTaskWoken = pdFALSE;
@@ -646,3 +1047,15 @@ void UART5_IRQHandler( void )
     HAL_UART_IRQHandler( pxUarts[ 4 ]->pxHuart );
 }
 /*-----------------------------------------------------------*/
+
+void GPDMA1_Channel3_IRQHandler( void )
+{
+    HAL_DMA_IRQHandler( &xUart0DmaTx );
+}
+/*-----------------------------------------------------------*/
+
+void GPDMA1_Channel12_IRQHandler( void )
+{
+    HAL_DMA_IRQHandler( &xUart0DmaRx );
+}
+/*-----------------------------------------------------------*/
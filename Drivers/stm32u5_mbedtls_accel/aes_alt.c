@@ -34,6 +34,7 @@
 #include <string.h>
 #include "mbedtls/platform.h"
 #include "mbedtls/platform_util.h"
+#include "cryp_stm32.h"
 
 /* Parameter validation macros based on platform_util.h */
 #define AES_VALIDATE_RET( cond )    \
@@ -44,6 +45,7 @@
 /* Private typedef -----------------------------------------------------------*/
 /* Private define ------------------------------------------------------------*/
 #define ST_AES_TIMEOUT     0xFFU   /* 255 ms timeout for the crypto processor */
+#define ST_AES_MAX_CHUNK   0xFFF0U /* largest HAL request, multiple of 16 bytes */
 #define ST_AES_NO_ALGO     0xFFFFU /* any algo is programmed */
 
 /* Private macro -------------------------------------------------------------*/
@@ -71,6 +73,9 @@ static int aes_set_key(mbedtls_aes_context *ctx,
                        const unsigned char *key,
                        unsigned int keybits)
 {
+    int ret;
+    HAL_StatusTypeDef hal_ret;
+
     AES_VALIDATE_RET( ctx != NULL );
 
     switch (keybits) {
@@ -115,6 +120,7 @@ static int aes_set_key(mbedtls_aes_context *ctx,
     ctx->hcryp_aes.Init.DataType = CRYP_BYTE_SWAP;
     ctx->hcryp_aes.Init.DataWidthUnit = CRYP_DATAWIDTHUNIT_BYTE;
     ctx->hcryp_aes.Init.pKey = ctx->aes_key;
+    ctx->hcryp_aes.Init.Algorithm = CRYP_AES_ECB;
 
 #if  defined(HW_CRYPTO_DPA_AES)
     if ( 0 == keybits )
@@ -129,10 +135,9 @@ static int aes_set_key(mbedtls_aes_context *ctx,
     }
 #endif
 
-    /* Initializes the CRYP peripheral */
-    if (HAL_CRYP_DeInit(&ctx->hcryp_aes) != HAL_OK) {
-        return (MBEDTLS_ERR_PLATFORM_HW_ACCEL_FAILED);
-    }
+    ret = cryp_lock();
+    if (ret != 0)
+        return (ret);
 
 #if  defined(HW_CRYPTO_DPA_AES)
     /* Enable SAES clock */
@@ -142,16 +147,81 @@ static int aes_set_key(mbedtls_aes_context *ctx,
     __HAL_RCC_AES_CLK_ENABLE();
 #endif
 
-    if (HAL_CRYP_Init(&ctx->hcryp_aes) != HAL_OK) {
-        return (MBEDTLS_ERR_PLATFORM_HW_ACCEL_FAILED);
+    /* Initializes the CRYP peripheral on first use of the handle, the key */
+    /* itself is loaded by every operation                                 */
+    if (ctx->hcryp_aes.State == HAL_CRYP_STATE_RESET)
+        hal_ret = HAL_CRYP_Init(&ctx->hcryp_aes);
+    else
+        hal_ret = HAL_CRYP_SetConfig(&ctx->hcryp_aes, &ctx->hcryp_aes.Init);
+
+    if (hal_ret == HAL_OK) {
+        cryp_owner = &ctx->hcryp_aes;
+    } else {
+        cryp_owner = NULL;
+        ret = MBEDTLS_ERR_PLATFORM_HW_ACCEL_FAILED;
     }
 
-    /* allow multi-instance of CRYP use: save context for CRYP HW module CR */
-    ctx->ctx_save_cr = ctx->hcryp_aes.Instance->CR;
+    if (cryp_unlock() != 0)
+        ret = MBEDTLS_ERR_THREADING_MUTEX_ERROR;
+
+    return (ret);
+}
+
+/*
+ * Load the configuration of ctx for algo in the CRYP peripheral, unless it
+ * is still loaded from the previous operation. Called with the CRYP locked.
+ */
+static int aes_select(mbedtls_aes_context *ctx, uint32_t algo)
+{
+    if ((cryp_owner != &ctx->hcryp_aes) ||
+        (ctx->hcryp_aes.Init.Algorithm != algo))
+    {
+        ctx->hcryp_aes.Init.Algorithm = algo;
+
+        if (HAL_CRYP_SetConfig(&ctx->hcryp_aes, &ctx->hcryp_aes.Init) != HAL_OK) {
+            cryp_owner = NULL;
+            return (MBEDTLS_ERR_PLATFORM_HW_ACCEL_FAILED);
+        }
+
+        cryp_owner = &ctx->hcryp_aes;
+    }
 
     return (0);
 }
 
+/*
+ * Single block ECB operation, takes the CRYP for the duration of the block
+ */
+static int aes_ecb_process(mbedtls_aes_context *ctx,
+                           int mode,
+                           const unsigned char input[16],
+                           unsigned char output[16])
+{
+    int ret;
+    HAL_StatusTypeDef hal_ret;
+
+    ret = cryp_lock();
+    if (ret != 0)
+        return (ret);
+
+    ret = aes_select(ctx, CRYP_AES_ECB);
+
+    if (ret == 0) {
+        if (mode == MBEDTLS_AES_DECRYPT)
+            hal_ret = HAL_CRYP_Decrypt(&ctx->hcryp_aes, (uint32_t *)input, 16, (uint32_t *)output, ST_AES_TIMEOUT);
+        else
+            hal_ret = HAL_CRYP_Encrypt(&ctx->hcryp_aes, (uint32_t *)input, 16, (uint32_t *)output, ST_AES_TIMEOUT);
+
+        if (hal_ret != HAL_OK)
+            ret = MBEDTLS_ERR_PLATFORM_HW_ACCEL_FAILED;
+    }
+
+    if (cryp_unlock() != 0)
+        ret = MBEDTLS_ERR_THREADING_MUTEX_ERROR;
+
+    return (ret);
+}
+
 /* Implementation that should never be optimized out by the compiler */
 static void mbedtls_zeroize(void *v, size_t n)
 {
@@ -177,6 +247,13 @@ void mbedtls_aes_free(mbedtls_aes_context *ctx)
         return;
     }
 
+    /* A new context at the same address must not inherit the Hw configuration */
+    if (cryp_lock() == 0) {
+        if (cryp_owner == &ctx->hcryp_aes)
+            cryp_owner = NULL;
+        (void) cryp_unlock();
+    }
+
     mbedtls_zeroize(ctx, sizeof(mbedtls_aes_context));
 }
 
@@ -302,63 +379,19 @@ int mbedtls_aes_crypt_ecb(mbedtls_aes_context *ctx,
                           const unsigned char input[16],
                           unsigned char output[16])
 {
-    int ret;
-
     AES_VALIDATE_RET( ctx != NULL );
     AES_VALIDATE_RET( input != NULL );
     AES_VALIDATE_RET( output != NULL );
     AES_VALIDATE_RET( mode == MBEDTLS_AES_ENCRYPT ||
                       mode == MBEDTLS_AES_DECRYPT );
 
-    /* allow multi-instance of CRYP use: restore context for CRYP hw module */
-    ctx->hcryp_aes.Instance->CR = ctx->ctx_save_cr;
-
-    /* Set the Algo if not configured till now */
-    if (CRYP_AES_ECB != ctx->hcryp_aes.Init.Algorithm)
-    {
-        ctx->hcryp_aes.Init.Algorithm  = CRYP_AES_ECB;
-
-        /* Configure the CRYP  */
-        if (HAL_CRYP_SetConfig(&ctx->hcryp_aes, &ctx->hcryp_aes.Init) != HAL_OK)
-            return MBEDTLS_ERR_PLATFORM_HW_ACCEL_FAILED;
-    }
-
-    if (mode == MBEDTLS_AES_DECRYPT) { /* AES decryption */
-        ret = mbedtls_internal_aes_decrypt(ctx, input, output);
-        if( ret != 0 )
-            return (ret);
-    } else { /* AES encryption */
-        ret = mbedtls_internal_aes_encrypt(ctx, input, output);
-        if( ret != 0 )
-            return (ret);
-    }
-    /* allow multi-instance of CRYP use: save context for CRYP HW module CR */
-    ctx->ctx_save_cr = ctx->hcryp_aes.Instance->CR;
-
-    return (0);
+    return (aes_ecb_process(ctx, mode, input, output));
 }
 
 #if defined(MBEDTLS_CIPHER_MODE_CBC)
 /*
  * AES-CBC buffer encryption/decryption
  */
-static int st_cbc_restore_context(mbedtls_aes_context *ctx)
-{
-    /* allow multi-instance of CRYP use: restore context for CRYP hw module */
-    ctx->hcryp_aes.Instance->CR = ctx->ctx_save_cr;
-
-    /* Re-initialize AES processor with proper parameters
-       and (re-)apply key and IV for multi context usecases */
-    if (HAL_CRYP_DeInit(&ctx->hcryp_aes) != HAL_OK) {
-        return (MBEDTLS_ERR_PLATFORM_HW_ACCEL_FAILED);
-    }
-
-    if (HAL_CRYP_Init(&ctx->hcryp_aes) != HAL_OK) {
-        return (MBEDTLS_ERR_PLATFORM_HW_ACCEL_FAILED);
-    }
-    return (0);
-}
-
 int mbedtls_aes_crypt_cbc(mbedtls_aes_context *ctx,
                           int mode,
                           size_t length,
@@ -366,7 +399,11 @@ int mbedtls_aes_crypt_cbc(mbedtls_aes_context *ctx,
                           const unsigned char *input,
                           unsigned char *output)
 {
-    __ALIGN_BEGIN static uint32_t iv_32B[4] __ALIGN_END;
+    __ALIGN_BEGIN uint32_t iv_32B[4] __ALIGN_END;
+    unsigned char next_iv[16];
+    HAL_StatusTypeDef hal_ret;
+    size_t done;
+    size_t chunk = 0;
     int ret = 0;
 
     AES_VALIDATE_RET( ctx != NULL );
@@ -380,54 +417,54 @@ int mbedtls_aes_crypt_cbc(mbedtls_aes_context *ctx,
         return (MBEDTLS_ERR_AES_INVALID_INPUT_LENGTH);
     }
 
-    ret = st_cbc_restore_context(ctx);
+    if (length == 0) {
+        return (0);
+    }
+
+    ret = cryp_lock();
     if (ret != 0)
         return (ret);
 
-    /* Set the Algo if not configured till now */
-    if (CRYP_AES_CBC != ctx->hcryp_aes.Init.Algorithm)
-    {
-        ctx->hcryp_aes.Init.Algorithm  = CRYP_AES_CBC;
-    }
-
-    /* Set IV with invert endianness */
-    SWAP_B8_TO_B32(iv_32B[0],iv,0);
-    SWAP_B8_TO_B32(iv_32B[1],iv,4);
-    SWAP_B8_TO_B32(iv_32B[2],iv,8);
-    SWAP_B8_TO_B32(iv_32B[3],iv,12);
+    ret = aes_select(ctx, CRYP_AES_CBC);
 
+    /* The IV is loaded by each operation as KeyIVConfigSkip is left to */
+    /* CRYP_KEYIVCONFIG_ALWAYS, pInitVect only needs to be valid here  */
     ctx->hcryp_aes.Init.pInitVect = iv_32B;
 
-    /* reconfigure the CRYP */
-    if (HAL_CRYP_SetConfig(&ctx->hcryp_aes, &ctx->hcryp_aes.Init) != HAL_OK) {
-        return (MBEDTLS_ERR_PLATFORM_HW_ACCEL_FAILED);
-    }
+    /* The HAL takes a 16 bit size, chain larger buffers over several calls */
+    for (done = 0; (ret == 0) && (done < length); done += chunk) {
+        chunk = length - done;
+        if (chunk > ST_AES_MAX_CHUNK)
+            chunk = ST_AES_MAX_CHUNK;
 
-    if (mode == MBEDTLS_AES_DECRYPT) {
-        if (HAL_CRYP_Decrypt(&ctx->hcryp_aes, (uint32_t *)input, length, (uint32_t *)output, ST_AES_TIMEOUT) != HAL_OK) {
-            return (MBEDTLS_ERR_PLATFORM_HW_ACCEL_FAILED);
-        }
+        /* Set IV with invert endianness */
+        SWAP_B8_TO_B32(iv_32B[0],iv,0);
+        SWAP_B8_TO_B32(iv_32B[1],iv,4);
+        SWAP_B8_TO_B32(iv_32B[2],iv,8);
+        SWAP_B8_TO_B32(iv_32B[3],iv,12);
 
-        /* Get IV vector for the next call */
-        SWAP_B32_TO_B8(ctx->hcryp_aes.Instance->IVR3,iv,0);
-        SWAP_B32_TO_B8(ctx->hcryp_aes.Instance->IVR2,iv,4);
-        SWAP_B32_TO_B8(ctx->hcryp_aes.Instance->IVR1,iv,8);
-        SWAP_B32_TO_B8(ctx->hcryp_aes.Instance->IVR0,iv,12);
-
-    } else {
-        if (HAL_CRYP_Encrypt(&ctx->hcryp_aes, (uint32_t *)input, length, (uint32_t *)output, ST_AES_TIMEOUT) != HAL_OK) {
-            return (MBEDTLS_ERR_PLATFORM_HW_ACCEL_FAILED);
+        /* The last ciphertext block is the IV of the next block, keep it */
+        /* before an in-place decryption overwrites it                    */
+        if (mode == MBEDTLS_AES_DECRYPT) {
+            memcpy(next_iv, input + done + chunk - 16, 16);
+            hal_ret = HAL_CRYP_Decrypt(&ctx->hcryp_aes, (uint32_t *)(input + done), (uint16_t)chunk, (uint32_t *)(output + done), ST_AES_TIMEOUT);
+        } else {
+            hal_ret = HAL_CRYP_Encrypt(&ctx->hcryp_aes, (uint32_t *)(input + done), (uint16_t)chunk, (uint32_t *)(output + done), ST_AES_TIMEOUT);
+            memcpy(next_iv, output + done + chunk - 16, 16);
         }
 
-        /* current output is the IV vector for the next call */
-        memcpy(iv, output, 16);
+        if (hal_ret != HAL_OK)
+            ret = MBEDTLS_ERR_PLATFORM_HW_ACCEL_FAILED;
+        else
+            memcpy(iv, next_iv, 16);
     }
 
-    /* Save the internal IV vector for multi context purpose */
-    ctx->ctx_save_cr = ctx->hcryp_aes.Instance->CR; // save here before overwritten
-    ctx->hcryp_aes.Instance->CR &= ~AES_CR_EN;
+    ctx->hcryp_aes.Init.pInitVect = NULL;
 
-    return (0);
+    if (cryp_unlock() != 0)
+        ret = MBEDTLS_ERR_THREADING_MUTEX_ERROR;
+
+    return (ret);
 }
 #endif /* MBEDTLS_CIPHER_MODE_CBC */
 
@@ -795,38 +832,14 @@ int mbedtls_internal_aes_encrypt(mbedtls_aes_context *ctx,
                                  const unsigned char input[16],
                                  unsigned char output[16])
 {
-
-    if (HAL_CRYP_Encrypt(&ctx->hcryp_aes, (uint32_t *)input, 16, (uint32_t *)output, ST_AES_TIMEOUT) != HAL_OK) {
-        return (MBEDTLS_ERR_PLATFORM_HW_ACCEL_FAILED);
-    }
-    return (0);
-
+    return (aes_ecb_process(ctx, MBEDTLS_AES_ENCRYPT, input, output));
 }
 
 int mbedtls_internal_aes_decrypt(mbedtls_aes_context *ctx,
                                  const unsigned char input[16],
                                  unsigned char output[16])
 {
-    if (HAL_CRYP_Decrypt(&ctx->hcryp_aes, (uint32_t *)input, 16, (uint32_t *)output, ST_AES_TIMEOUT) != HAL_OK) {
-        return MBEDTLS_ERR_PLATFORM_HW_ACCEL_FAILED;
-    }
-    return (0);
-}
-
-#if !defined(MBEDTLS_DEPRECATED_REMOVED)
-void mbedtls_aes_encrypt(mbedtls_aes_context *ctx,
-                         const unsigned char input[16],
-                         unsigned char output[16])
-{
-    mbedtls_internal_aes_encrypt(ctx, input, output);
-}
-
-void mbedtls_aes_decrypt(mbedtls_aes_context *ctx,
-                         const unsigned char input[16],
-                         unsigned char output[16])
-{
-    mbedtls_internal_aes_decrypt(ctx, input, output);
+    return (aes_ecb_process(ctx, MBEDTLS_AES_DECRYPT, input, output));
 }
-#endif /* MBEDTLS_DEPRECATED_REMOVED */
 #endif /* MBEDTLS_AES_ALT */
 #endif /* MBEDTLS_AES_C */
@@ -55,7 +55,6 @@ extern "C" {
 typedef struct {
     uint32_t aes_key[8];           /* Decryption key */
     CRYP_HandleTypeDef hcryp_aes;  /* HW driver handle */
-    uint32_t ctx_save_cr;          /* Saved HW context for multi-instance */
 }
 mbedtls_aes_context;
 
@@ -19,29 +19,276 @@
  */
 
 /* Includes ------------------------------------------------------------------*/
-#if !defined(MBEDTLS_CONFIG_FILE)
-#include "config.h"
-#else
-#include MBEDTLS_CONFIG_FILE
-#endif
+#include "mbedtls/build_info.h"
 
 #if defined(MBEDTLS_AES_ALT) || defined(MBEDTLS_CCM_ALT) || defined(MBEDTLS_GCM_ALT)
 
 #include "cryp_stm32.h"
 
+#if (ST_CRYP_DMA_ENABLE == 1)
+#include "FreeRTOS.h"
+#include "task.h"
+#endif /* ST_CRYP_DMA_ENABLE */
+
 
 /* Variables -----------------------------------------------------------------*/
 /* Mutex protection because of one Crypt Hw instance is shared over several   */
 /* mode of operations (AES, GCM, CCM implementations may be enabled together) */
+/* and contexts. It is created on first use and never freed.                  */
 #if defined(MBEDTLS_THREADING_C)
-mbedtls_threading_mutex_t cryp_mutex;
-unsigned char cryp_mutex_started = 0;
+static mbedtls_threading_mutex_t cryp_mutex;
+static volatile unsigned char cryp_mutex_started = 0;
 #endif /* MBEDTLS_THREADING_C */
 
-unsigned int cryp_context_count = 0;
+/* Handle whose configuration is currently loaded in the Crypt Hw */
+CRYP_HandleTypeDef *cryp_owner = NULL;
+
+#if (ST_CRYP_DMA_ENABLE == 1)
+/* External memories cached by DCACHE1, the DMA would bypass the cache */
+#define CRYP_DCACHE_REGION_START  (0x60000000UL)
+#define CRYP_DCACHE_REGION_END    (0xA0000000UL)
+
+/* The AES consumes and produces words, the DMA packs and unpacks the     */
+/* bytes so that the TLS record buffers do not need to be word aligned    */
+static DMA_HandleTypeDef cryp_dma_in =
+{
+    .Instance                  = GPDMA1_Channel0,
+    .Init                      =
+    {
+        .Request               = GPDMA1_REQUEST_AES_IN,
+        .BlkHWRequest          = DMA_BREQ_SINGLE_BURST,
+        .Direction             = DMA_MEMORY_TO_PERIPH,
+        .SrcInc                = DMA_SINC_INCREMENTED,
+        .DestInc               = DMA_DINC_FIXED,
+        .SrcDataWidth          = DMA_SRC_DATAWIDTH_BYTE,
+        .DestDataWidth         = DMA_DEST_DATAWIDTH_WORD,
+        .Priority              = DMA_LOW_PRIORITY_HIGH_WEIGHT,
+        .SrcBurstLength        = 1,
+        .DestBurstLength       = 1,
+        .TransferAllocatedPort = DMA_SRC_ALLOCATED_PORT0 | DMA_DEST_ALLOCATED_PORT1,
+        .TransferEventMode     = DMA_TCEM_BLOCK_TRANSFER,
+        .Mode                  = DMA_NORMAL,
+    },
+};
+
+static DMA_HandleTypeDef cryp_dma_out =
+{
+    .Instance                  = GPDMA1_Channel1,
+    .Init                      =
+    {
+        .Request               = GPDMA1_REQUEST_AES_OUT,
+        .BlkHWRequest          = DMA_BREQ_SINGLE_BURST,
+        .Direction             = DMA_PERIPH_TO_MEMORY,
+        .SrcInc                = DMA_SINC_FIXED,
+        .DestInc               = DMA_DINC_INCREMENTED,
+        .SrcDataWidth          = DMA_SRC_DATAWIDTH_WORD,
+        .DestDataWidth         = DMA_DEST_DATAWIDTH_BYTE,
+        .Priority              = DMA_LOW_PRIORITY_HIGH_WEIGHT,
+        .SrcBurstLength        = 1,
+        .DestBurstLength       = 1,
+        .TransferAllocatedPort = DMA_SRC_ALLOCATED_PORT1 | DMA_DEST_ALLOCATED_PORT0,
+        .TransferEventMode     = DMA_TCEM_BLOCK_TRANSFER,
+        .Mode                  = DMA_NORMAL,
+    },
+};
+
+/* 0: not initialized yet, 1: ready, -1: initialization failed, poll      */
+static volatile int cryp_dma_state = 0;
+
+/* Task waiting for the end of the current DMA request */
+static TaskHandle_t volatile cryp_dma_task = NULL;
+
+/* Result of the current DMA request, written by the HAL callbacks */
+static volatile HAL_StatusTypeDef cryp_dma_result = HAL_OK;
+#endif /* ST_CRYP_DMA_ENABLE */
 
 /* Functions -----------------------------------------------------------------*/
 
+/* Take exclusive use of the Crypt Hw */
+int cryp_lock(void)
+{
+#if defined(MBEDTLS_THREADING_C)
+    if (!cryp_mutex_started)
+    {
+        __disable_irq();
+        /* mutex cannot be initialized twice */
+        if (!cryp_mutex_started)
+        {
+            mbedtls_mutex_init(&cryp_mutex);
+            cryp_mutex_started = 1;
+        }
+        __enable_irq();
+    }
+
+    if (mbedtls_mutex_lock(&cryp_mutex) != 0)
+        return (MBEDTLS_ERR_THREADING_MUTEX_ERROR);
+#endif /* MBEDTLS_THREADING_C */
+
+    return (0);
+}
+
+/* Release the Crypt Hw taken by cryp_lock */
+int cryp_unlock(void)
+{
+#if defined(MBEDTLS_THREADING_C)
+    if (mbedtls_mutex_unlock(&cryp_mutex) != 0)
+        return (MBEDTLS_ERR_THREADING_MUTEX_ERROR);
+#endif /* MBEDTLS_THREADING_C */
+
+    return (0);
+}
+
+#if (ST_CRYP_DMA_ENABLE == 1)
+static void cryp_dma_in_irq_handler(void)
+{
+    HAL_DMA_IRQHandler(&cryp_dma_in);
+}
+
+static void cryp_dma_out_irq_handler(void)
+{
+    HAL_DMA_IRQHandler(&cryp_dma_out);
+}
+
+/* Set up both channels once, called with the Crypt Hw locked */
+static int cryp_dma_init(void)
+{
+    DMA_DataHandlingConfTypeDef handling = { 0 };
+    HAL_StatusTypeDef hal_ret;
+
+    __HAL_RCC_GPDMA1_CLK_ENABLE();
+
+    hal_ret = HAL_DMA_Init(&cryp_dma_in);
+
+    if (hal_ret == HAL_OK)
+        hal_ret = HAL_DMA_Init(&cryp_dma_out);
+
+    if (hal_ret == HAL_OK) {
+        handling.DataExchange = DMA_EXCHANGE_NONE;
+        handling.DataAlignment = DMA_DATA_PACK;
+        hal_ret = HAL_DMAEx_ConfigDataHandling(&cryp_dma_in, &handling);
+    }
+
+    if (hal_ret == HAL_OK) {
+        handling.DataAlignment = DMA_DATA_UNPACK;
+        hal_ret = HAL_DMAEx_ConfigDataHandling(&cryp_dma_out, &handling);
+    }
+
+    if (hal_ret == HAL_OK)
+        hal_ret = HAL_DMA_ConfigChannelAttributes(&cryp_dma_in, DMA_CHANNEL_NPRIV);
+
+    if (hal_ret == HAL_OK)
+        hal_ret = HAL_DMA_ConfigChannelAttributes(&cryp_dma_out, DMA_CHANNEL_NPRIV);
+
+    if (hal_ret == HAL_OK) {
+        NVIC_SetVector(GPDMA1_Channel0_IRQn, (uint32_t) cryp_dma_in_irq_handler);
+        HAL_NVIC_SetPriority(GPDMA1_Channel0_IRQn, 5, 0);
+        HAL_NVIC_EnableIRQ(GPDMA1_Channel0_IRQn);
+
+        NVIC_SetVector(GPDMA1_Channel1_IRQn, (uint32_t) cryp_dma_out_irq_handler);
+        HAL_NVIC_SetPriority(GPDMA1_Channel1_IRQn, 5, 0);
+        HAL_NVIC_EnableIRQ(GPDMA1_Channel1_IRQn);
+    }
+
+    return (hal_ret == HAL_OK) ? 1 : -1;
+}
+
+static int cryp_dma_cached(const void *buf, size_t length)
+{
+    uint32_t start = (uint32_t) buf;
+
+    return (start < CRYP_DCACHE_REGION_END) &&
+           ((start + length) > CRYP_DCACHE_REGION_START);
+}
+
+int cryp_dma_usable(const unsigned char *input, unsigned char *output,
+                    size_t length)
+{
+    if ((cryp_dma_state < 0) || (length < ST_CRYP_DMA_MIN_LEN))
+        return (0);
+
+    if ((xTaskGetSchedulerState() != taskSCHEDULER_RUNNING) ||
+        (xPortIsInsideInterrupt() != pdFALSE))
+        return (0);
+
+    return !cryp_dma_cached(input, length) && !cryp_dma_cached(output, length);
+}
+
+static void cryp_dma_complete(HAL_StatusTypeDef result)
+{
+    BaseType_t higher_priority_task_woken = pdFALSE;
+
+    cryp_dma_result = result;
+
+    if (cryp_dma_task != NULL) {
+        vTaskNotifyGiveIndexedFromISR(cryp_dma_task, ST_CRYP_DMA_NOTIFY_IDX,
+                                      &higher_priority_task_woken);
+        portYIELD_FROM_ISR(higher_priority_task_woken);
+    }
+}
+
+void HAL_CRYP_OutCpltCallback(CRYP_HandleTypeDef *hcryp)
+{
+    (void) hcryp;
+    cryp_dma_complete(HAL_OK);
+}
+
+void HAL_CRYP_ErrorCallback(CRYP_HandleTypeDef *hcryp)
+{
+    (void) hcryp;
+    cryp_dma_complete(HAL_ERROR);
+}
+
+HAL_StatusTypeDef cryp_dma_process(CRYP_HandleTypeDef *hcryp,
+                                   int encrypt,
+                                   const unsigned char *input,
+                                   uint16_t size,
+                                   unsigned char *output,
+                                   uint32_t timeout)
+{
+    HAL_StatusTypeDef hal_ret;
+
+    if (cryp_dma_state == 0)
+        cryp_dma_state = cryp_dma_init();
+
+    if (cryp_dma_state < 0)
+        return (HAL_ERROR);
+
+    /* The channels follow the handle that currently owns the Crypt Hw */
+    __HAL_LINKDMA(hcryp, hdmain, cryp_dma_in);
+    __HAL_LINKDMA(hcryp, hdmaout, cryp_dma_out);
+
+    cryp_dma_task = xTaskGetCurrentTaskHandle();
+    cryp_dma_result = HAL_ERROR;
+    (void) xTaskNotifyStateClearIndexed(NULL, ST_CRYP_DMA_NOTIFY_IDX);
+    (void) ulTaskNotifyValueClearIndexed(NULL, ST_CRYP_DMA_NOTIFY_IDX, 0xFFFFFFFFUL);
+
+    if (encrypt)
+        hal_ret = HAL_CRYP_Encrypt_DMA(hcryp, (uint32_t *)input, size, (uint32_t *)output);
+    else
+        hal_ret = HAL_CRYP_Decrypt_DMA(hcryp, (uint32_t *)input, size, (uint32_t *)output);
+
+    if (hal_ret == HAL_OK) {
+        if (ulTaskNotifyTakeIndexed(ST_CRYP_DMA_NOTIFY_IDX, pdTRUE,
+                                    pdMS_TO_TICKS(timeout)) == 0) {
+            /* Stop both channels and leave the handle usable, the caller */
+            /* drops the ownership so the next user reconfigures the Hw   */
+            (void) HAL_DMA_Abort(&cryp_dma_in);
+            (void) HAL_DMA_Abort(&cryp_dma_out);
+            __HAL_CRYP_DISABLE(hcryp);
+            hcryp->State = HAL_CRYP_STATE_READY;
+            __HAL_UNLOCK(hcryp);
+            hal_ret = HAL_TIMEOUT;
+        } else {
+            hal_ret = cryp_dma_result;
+        }
+    }
+
+    cryp_dma_task = NULL;
+
+    return (hal_ret);
+}
+#endif /* ST_CRYP_DMA_ENABLE */
+
 /* Implementation that should never be optimized out by the compiler */
 void cryp_zeroize(void *v, size_t n)
 {
@@ -62,6 +309,9 @@ void cryp_zeroize(void *v, size_t n)
   */
 void HAL_CRYP_MspInit(CRYP_HandleTypeDef *hcryp)
 {
+  /* The reset below drops the configuration of the current owner */
+  cryp_owner = NULL;
+
 #if defined (AES)
   /* Enable CRYP clock */
   __HAL_RCC_AES_CLK_ENABLE();
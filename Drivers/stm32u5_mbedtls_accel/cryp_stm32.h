@@ -28,6 +28,7 @@
 /* Includes ------------------------------------------------------------------*/
 /* include the appropriate header file */
 #include "stm32u5xx_hal.h"
+#include "mbedtls/error.h"
 
 #if defined(MBEDTLS_THREADING_C)
 #include "mbedtls/threading.h"
@@ -68,17 +69,54 @@ do {                                                    \
 #define USE_AES_KEY192			0
 #endif /* USE_AES_KEY192 */
 
-/* variables -----------------------------------------------------------------*/
-#if defined(MBEDTLS_THREADING_C)
-extern mbedtls_threading_mutex_t cryp_mutex;
-extern unsigned char cryp_mutex_started;
-#endif /* MBEDTLS_THREADING_C */
+/* Stream large requests to the AES with GPDMA1 channels 0 and 1 while the   */
+/* calling task sleeps. Set to 0 to always poll the peripheral.              */
+#ifndef ST_CRYP_DMA_ENABLE
+#define ST_CRYP_DMA_ENABLE      1
+#endif
 
-extern unsigned int cryp_context_count;
+/* Shorter requests are polled, the DMA setup would cost more than it saves  */
+#ifndef ST_CRYP_DMA_MIN_LEN
+#define ST_CRYP_DMA_MIN_LEN     256U
+#endif
+
+/* Index of the task notification used to signal the DMA completion         */
+#ifndef ST_CRYP_DMA_NOTIFY_IDX
+#define ST_CRYP_DMA_NOTIFY_IDX  7
+#endif
+
+/* variables -----------------------------------------------------------------*/
+/* Handle whose configuration is currently loaded in the Crypt Hw. A context  */
+/* must reconfigure the Hw before use when it is not the owner. Only accessed */
+/* between cryp_lock and cryp_unlock.                                         */
+extern CRYP_HandleTypeDef *cryp_owner;
 
 /* functions prototypes ------------------------------------------------------*/
 extern void cryp_zeroize(void *v, size_t n);
 
+/* Serialize the use of the Crypt Hw between tasks. Return 0 or               */
+/* MBEDTLS_ERR_THREADING_MUTEX_ERROR. The lock is not recursive.              */
+extern int cryp_lock(void);
+extern int cryp_unlock(void);
+
+#if (ST_CRYP_DMA_ENABLE == 1)
+/* Return 1 if a request on these buffers can be handed to the DMA: it is at */
+/* least ST_CRYP_DMA_MIN_LEN bytes, made from a task and the buffers are not */
+/* cached by DCACHE1.                                                        */
+extern int cryp_dma_usable(const unsigned char *input, unsigned char *output,
+                           size_t length);
+
+/* Same as HAL_CRYP_Encrypt / HAL_CRYP_Decrypt, but the calling task blocks  */
+/* until the DMA has written the last output byte. Called with the Crypt Hw */
+/* locked.                                                                   */
+extern HAL_StatusTypeDef cryp_dma_process(CRYP_HandleTypeDef *hcryp,
+                                          int encrypt,
+                                          const unsigned char *input,
+                                          uint16_t size,
+                                          unsigned char *output,
+                                          uint32_t timeout);
+#endif /* ST_CRYP_DMA_ENABLE */
+
 #ifdef __cplusplus
 }
 #endif
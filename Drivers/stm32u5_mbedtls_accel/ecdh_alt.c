@@ -0,0 +1,172 @@
+/*
+ *  Elliptic curve Diffie-Hellman key generation and shared secret functions
+ *
+ *  Copyright (C) 2006-2015, ARM Limited, All Rights Reserved
+ *  Copyright (C) 2019, STMicroelectronics, All Rights Reserved
+ *  SPDX-License-Identifier: Apache-2.0
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License"); you may
+ *  not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *  http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS, WITHOUT
+ *  WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *
+ *  This file implements ST ECDH HW services based on mbed TLS API
+ */
+
+/* Includes ------------------------------------------------------------------*/
+/* The software fallback reads the coordinates of the result, like ecdh.c */
+#define MBEDTLS_ALLOW_PRIVATE_ACCESS
+
+#include "mbedtls/ecdh.h"
+
+#if defined(MBEDTLS_ECDH_C)
+
+#if defined(MBEDTLS_ECDH_GEN_PUBLIC_ALT) || defined(MBEDTLS_ECDH_COMPUTE_SHARED_ALT)
+#include "mbedtls/platform_util.h"
+#include "pka_stm32.h"
+
+#include <string.h>
+
+/* Private typedef -----------------------------------------------------------*/
+/* Private define ------------------------------------------------------------*/
+#define ST_ECDH_PT_LEN( curve )    ( ( 2U * ( curve )->modulus_size ) + 1U )
+
+/* Private macro -------------------------------------------------------------*/
+/* Parameter validation macros based on platform_util.h */
+#define ECDH_VALIDATE_RET( cond )    \
+    MBEDTLS_INTERNAL_VALIDATE_RET( cond, MBEDTLS_ERR_ECP_BAD_INPUT_DATA )
+
+/* Private variables ---------------------------------------------------------*/
+/* Private function prototypes -----------------------------------------------*/
+/* Private functions ---------------------------------------------------------*/
+
+/* Release the PKA Hw, keeping the first error */
+static int ecdh_unlock( int ret )
+{
+    if( ( pka_unlock() != 0 ) && ( ret == 0 ) )
+        ret = MBEDTLS_ERR_THREADING_MUTEX_ERROR;
+
+    return( ret );
+}
+#endif /* MBEDTLS_ECDH_GEN_PUBLIC_ALT || MBEDTLS_ECDH_COMPUTE_SHARED_ALT */
+
+#if defined(MBEDTLS_ECDH_GEN_PUBLIC_ALT)
+/*
+ * Generate public key Q = d G (restartable version not supported)
+ */
+int mbedtls_ecdh_gen_public( mbedtls_ecp_group *grp, mbedtls_mpi *d, mbedtls_ecp_point *Q,
+                             int (*f_rng)(void *, unsigned char *, size_t),
+                             void *p_rng )
+{
+    int ret = 0;
+    const pka_curve *curve;
+    uint8_t G_binary[( 2U * ST_PKA_MAX_MODULUS_SIZE ) + 1U];
+    uint8_t Q_binary[( 2U * ST_PKA_MAX_MODULUS_SIZE ) + 1U];
+
+    ECDH_VALIDATE_RET( grp   != NULL );
+    ECDH_VALIDATE_RET( d     != NULL );
+    ECDH_VALIDATE_RET( Q     != NULL );
+    ECDH_VALIDATE_RET( f_rng != NULL );
+
+    if( ( ret = pka_lock() ) != 0 )
+        return( ret );
+
+    curve = pka_curve_get( grp );
+
+    if( curve == NULL )
+    {
+        ret = ecdh_unlock( 0 );
+        if( ret == 0 )
+            ret = mbedtls_ecp_gen_keypair( grp, d, Q, f_rng, p_rng );
+
+        return( ret );
+    }
+
+    /* d in range 1..n-1 */
+    MBEDTLS_MPI_CHK( mbedtls_ecp_gen_privkey( grp, d, f_rng, p_rng ) );
+
+    G_binary[0] = 0x04U;
+    memcpy( G_binary + 1U, curve->gx, curve->modulus_size );
+    memcpy( G_binary + curve->modulus_size + 1U, curve->gy, curve->modulus_size );
+
+    MBEDTLS_MPI_CHK( pka_ecc_mul( curve, d, G_binary, Q_binary ) );
+    MBEDTLS_MPI_CHK( mbedtls_ecp_point_read_binary( grp, Q, Q_binary, ST_ECDH_PT_LEN( curve ) ) );
+
+cleanup:
+    return( ecdh_unlock( ret ) );
+}
+#endif /* MBEDTLS_ECDH_GEN_PUBLIC_ALT */
+
+#if defined(MBEDTLS_ECDH_COMPUTE_SHARED_ALT)
+/*
+ * Compute shared secret (SEC1 3.3.1), the peer key is validated first
+ */
+int mbedtls_ecdh_compute_shared( mbedtls_ecp_group *grp, mbedtls_mpi *z,
+                                 const mbedtls_ecp_point *Q, const mbedtls_mpi *d,
+                                 int (*f_rng)(void *, unsigned char *, size_t),
+                                 void *p_rng )
+{
+    int ret = 0;
+    const pka_curve *curve;
+    uint8_t Q_binary[( 2U * ST_PKA_MAX_MODULUS_SIZE ) + 1U];
+    uint8_t P_binary[( 2U * ST_PKA_MAX_MODULUS_SIZE ) + 1U];
+    mbedtls_ecp_point P;
+
+    ECDH_VALIDATE_RET( grp != NULL );
+    ECDH_VALIDATE_RET( Q   != NULL );
+    ECDH_VALIDATE_RET( d   != NULL );
+    ECDH_VALIDATE_RET( z   != NULL );
+
+    if( ( ret = mbedtls_ecp_check_privkey( grp, d ) ) != 0 )
+        return( ret );
+
+    if( ( ret = pka_lock() ) != 0 )
+        return( ret );
+
+    curve = pka_curve_get( grp );
+
+    if( curve == NULL )
+    {
+        ret = ecdh_unlock( 0 );
+        if( ret != 0 )
+            return( ret );
+
+        /* Same steps as the mbed TLS implementation */
+        mbedtls_ecp_point_init( &P );
+
+        ret = mbedtls_ecp_mul( grp, &P, d, Q, f_rng, p_rng );
+
+        if( ( ret == 0 ) && mbedtls_ecp_is_zero( &P ) )
+            ret = MBEDTLS_ERR_ECP_BAD_INPUT_DATA;
+
+        if( ret == 0 )
+            ret = mbedtls_mpi_copy( z, &P.X );
+
+        mbedtls_ecp_point_free( &P );
+
+        return( ret );
+    }
+
+    /* Reject peer keys that are not on the curve (invalid curve attacks) */
+    MBEDTLS_MPI_CHK( pka_point_check( grp, curve, Q, Q_binary ) );
+
+    MBEDTLS_MPI_CHK( pka_ecc_mul( curve, d, Q_binary, P_binary ) );
+
+    /* z is the X coordinate of d Q */
+    MBEDTLS_MPI_CHK( mbedtls_mpi_read_binary( z, P_binary + 1U, curve->modulus_size ) );
+
+cleanup:
+    mbedtls_platform_zeroize( P_binary, sizeof( P_binary ) );
+
+    return( ecdh_unlock( ret ) );
+}
+#endif /* MBEDTLS_ECDH_COMPUTE_SHARED_ALT */
+
+#endif /* MBEDTLS_ECDH_C */
@@ -28,9 +28,12 @@
 #include "mbedtls/platform_util.h"
 #include "stm32u5xx_hal.h"
 
+#include "pka_stm32.h"
+
+#include <string.h>
+
 /* Private typedef -----------------------------------------------------------*/
 /* Private define ------------------------------------------------------------*/
-#define ST_ECDSA_TIMEOUT     (5000U)
 
 /* Private macro -------------------------------------------------------------*/
 /* Parameter validation macros based on platform_util.h */
@@ -61,7 +64,7 @@ int mbedtls_ecdsa_sign( mbedtls_ecp_group *grp, mbedtls_mpi *r, mbedtls_mpi *s,
     uint8_t *k_binary = NULL;
 
     mbedtls_mpi k;
-    PKA_HandleTypeDef hpka = {0};
+    PKA_HandleTypeDef *hpka = NULL;
     PKA_ECDSASignInTypeDef ECDSA_SignIn = {0};
     PKA_ECDSASignOutTypeDef ECDSA_SignOut;
 
@@ -113,17 +116,12 @@ int mbedtls_ecdsa_sign( mbedtls_ecp_group *grp, mbedtls_mpi *r, mbedtls_mpi *s,
 
     ECDSA_SignIn.integer = k_binary;
 
-    /* Enable HW peripheral clock */
-    __HAL_RCC_PKA_CLK_ENABLE();
-
-    /* Initialize HW peripheral */
-    hpka.Instance = PKA;
-    MBEDTLS_MPI_CHK((HAL_PKA_Init(&hpka) != HAL_OK) ? MBEDTLS_ERR_PLATFORM_HW_ACCEL_FAILED : 0);
-
-    HAL_PKA_RAMReset(&hpka);
+    /* Take the PKA Hw, shared by the ECDSA, ECDH, ECP and RSA services, */
+    /* and initialize it                                                 */
+    MBEDTLS_MPI_CHK( pka_acquire( &hpka ) );
 
     /* Launch the signature */
-    MBEDTLS_MPI_CHK((HAL_PKA_ECDSASign(&hpka, &ECDSA_SignIn, ST_ECDSA_TIMEOUT) != HAL_OK) ? MBEDTLS_ERR_PLATFORM_HW_ACCEL_FAILED : 0);
+    MBEDTLS_MPI_CHK((pka_run( hpka, PKA_OP_ECDSA_SIGN, &ECDSA_SignIn ) != HAL_OK) ? MBEDTLS_ERR_PLATFORM_HW_ACCEL_FAILED : 0);
 
     /* Allocate memory space for signature */
     ECDSA_SignOut.RSign = mbedtls_calloc(grp->st_order_size, sizeof( uint8_t ));
@@ -133,7 +131,7 @@ int mbedtls_ecdsa_sign( mbedtls_ecp_group *grp, mbedtls_mpi *r, mbedtls_mpi *s,
     MBEDTLS_MPI_CHK((ECDSA_SignOut.SSign == NULL) ? MBEDTLS_ERR_ECP_ALLOC_FAILED : 0);
 
     /* Get the signature into allocated space */
-    HAL_PKA_ECDSASign_GetResult(&hpka, &ECDSA_SignOut, NULL);
+    HAL_PKA_ECDSASign_GetResult(hpka, &ECDSA_SignOut, NULL);
 
     /* Convert the signature into mpi format */
     MBEDTLS_MPI_CHK( mbedtls_mpi_read_binary( r, ECDSA_SignOut.RSign, grp->st_order_size ) );
@@ -141,11 +139,9 @@ int mbedtls_ecdsa_sign( mbedtls_ecp_group *grp, mbedtls_mpi *r, mbedtls_mpi *s,
     MBEDTLS_MPI_CHK( mbedtls_mpi_read_binary( s, ECDSA_SignOut.SSign, grp->st_order_size ) );
 
 cleanup:
-    /* De-initialize HW peripheral */
-    HAL_PKA_DeInit(&hpka);
-
-    /* Disable HW peripheral clock */
-    __HAL_RCC_PKA_CLK_DISABLE();
+    /* De-initialize and release the PKA Hw */
+    if( hpka != NULL )
+        ret = pka_release( ret );
 
     /* Free memory */
     mbedtls_mpi_free( &k );
@@ -181,10 +177,67 @@ cleanup:
 
 #if defined(MBEDTLS_ECDSA_VERIFY_ALT)
 
-#if !defined(MBEDTLS_ECP_ALT)
-#error "MBEDTLS_ECP_ALT must be defined, if MBEDTLS_ECDSA_VERIFY_ALT is"
-#endif
+/*
+ * Verify ECDSA signature of hashed message (SEC1 4.1.4 step 3 onwards) in
+ * software, for the curves the PKA services do not cover
+ */
+static int ecdsa_verify_sw( mbedtls_ecp_group *grp,
+                            const unsigned char *buf, size_t blen,
+                            const mbedtls_ecp_point *Q,
+                            const mbedtls_mpi *r,
+                            const mbedtls_mpi *s )
+{
+    int ret = 0;
+    size_t n_size = ( grp->nbits + 7 ) / 8;
+    size_t use_size = ( blen > n_size ) ? n_size : blen;
+    size_t olen;
+    unsigned char R_binary[MBEDTLS_ECP_MAX_PT_LEN];
+    mbedtls_mpi e, s_inv, u1, u2, x;
+    mbedtls_ecp_point R;
+
+    mbedtls_mpi_init( &e ); mbedtls_mpi_init( &s_inv );
+    mbedtls_mpi_init( &u1 ); mbedtls_mpi_init( &u2 );
+    mbedtls_mpi_init( &x ); mbedtls_ecp_point_init( &R );
+
+    /* Derive e from the leftmost bits of the hash (SEC1 4.1.3 step 5) */
+    MBEDTLS_MPI_CHK( mbedtls_mpi_read_binary( &e, buf, use_size ) );
+    if( use_size * 8 > grp->nbits )
+        MBEDTLS_MPI_CHK( mbedtls_mpi_shift_r( &e, use_size * 8 - grp->nbits ) );
+    if( mbedtls_mpi_cmp_mpi( &e, &grp->N ) >= 0 )
+        MBEDTLS_MPI_CHK( mbedtls_mpi_sub_mpi( &e, &e, &grp->N ) );
+
+    /* u1 = e / s mod n, u2 = r / s mod n */
+    MBEDTLS_MPI_CHK( mbedtls_mpi_inv_mod( &s_inv, s, &grp->N ) );
+    MBEDTLS_MPI_CHK( mbedtls_mpi_mul_mpi( &u1, &e, &s_inv ) );
+    MBEDTLS_MPI_CHK( mbedtls_mpi_mod_mpi( &u1, &u1, &grp->N ) );
+    MBEDTLS_MPI_CHK( mbedtls_mpi_mul_mpi( &u2, r, &s_inv ) );
+    MBEDTLS_MPI_CHK( mbedtls_mpi_mod_mpi( &u2, &u2, &grp->N ) );
+
+    /* R = u1 G + u2 Q */
+    MBEDTLS_MPI_CHK( mbedtls_ecp_muladd( grp, &R, &u1, &grp->G, &u2, Q ) );
+
+    if( mbedtls_ecp_is_zero( &R ) )
+    {
+        ret = MBEDTLS_ERR_ECP_VERIFY_FAILED;
+        goto cleanup;
+    }
+
+    /* Check that R.X mod n == r */
+    MBEDTLS_MPI_CHK( mbedtls_ecp_point_write_binary( grp, &R, MBEDTLS_ECP_PF_UNCOMPRESSED,
+                                                     &olen, R_binary, sizeof( R_binary ) ) );
+    MBEDTLS_MPI_CHK( mbedtls_mpi_read_binary( &x, R_binary + 1U, ( olen - 1U ) / 2U ) );
+    MBEDTLS_MPI_CHK( mbedtls_mpi_mod_mpi( &x, &x, &grp->N ) );
+
+    if( mbedtls_mpi_cmp_mpi( &x, r ) != 0 )
+        ret = MBEDTLS_ERR_ECP_VERIFY_FAILED;
+
+cleanup:
+    mbedtls_mpi_free( &e ); mbedtls_mpi_free( &s_inv );
+    mbedtls_mpi_free( &u1 ); mbedtls_mpi_free( &u2 );
+    mbedtls_mpi_free( &x ); mbedtls_ecp_point_free( &R );
 
+    return ret;
+}
 
 /*
  * Verify ECDSA signature of hashed message
@@ -196,11 +249,14 @@ int mbedtls_ecdsa_verify( mbedtls_ecp_group *grp,
                           const mbedtls_mpi *s)
 {
     int ret = 0;
-    size_t olen;
-    uint8_t *Q_binary;
-    uint8_t *r_binary = NULL;
-    uint8_t *s_binary = NULL;
-    PKA_HandleTypeDef hpka = {0};
+    int unlock_ret;
+    size_t use_size;
+    const pka_curve *curve;
+    uint8_t Q_binary[( 2U * ST_PKA_MAX_MODULUS_SIZE ) + 1U];
+    uint8_t e_binary[ST_PKA_MAX_MODULUS_SIZE];
+    uint8_t r_binary[ST_PKA_MAX_MODULUS_SIZE];
+    uint8_t s_binary[ST_PKA_MAX_MODULUS_SIZE];
+    PKA_HandleTypeDef *hpka;
     PKA_ECDSAVerifInTypeDef ECDSA_VerifyIn;
 
     /* Check parameters */
@@ -211,7 +267,7 @@ int mbedtls_ecdsa_verify( mbedtls_ecp_group *grp,
     ECDSA_VALIDATE_RET( buf != NULL || blen == 0 );
 
     /* Fail cleanly on curves such as Curve25519 that can't be used for ECDSA */
-    if( grp->G.Y.p == NULL )
+    if( mbedtls_ecp_get_type( grp ) != MBEDTLS_ECP_TYPE_SHORT_WEIERSTRASS )
         return( MBEDTLS_ERR_ECP_BAD_INPUT_DATA );
 
     /* Make sure r and s are in range 1..n-1 */
@@ -219,81 +275,70 @@ int mbedtls_ecdsa_verify( mbedtls_ecp_group *grp,
         mbedtls_mpi_cmp_int( s, 1 ) < 0 || mbedtls_mpi_cmp_mpi( s, &grp->N ) >= 0 )
         return( MBEDTLS_ERR_ECP_VERIFY_FAILED );
 
-    /* Set HW peripheral Input parameter: curve coefs */
-    ECDSA_VerifyIn.primeOrderSize = grp->st_order_size;
-    ECDSA_VerifyIn.modulusSize    = grp->st_modulus_size;
-    ECDSA_VerifyIn.modulus        = grp->st_p;
-    ECDSA_VerifyIn.coefSign       = grp->st_a_sign;
-    ECDSA_VerifyIn.coef           = grp->st_a_abs;
-    ECDSA_VerifyIn.basePointX     = grp->st_gx;
-    ECDSA_VerifyIn.basePointY     = grp->st_gy;
-    ECDSA_VerifyIn.primeOrder     = grp->st_n;
-
-    /* Set HW peripheral input parameter: hash content buffer that was signed */
-    ECDSA_VerifyIn.hash = buf;
+    if( ( ret = pka_lock() ) != 0 )
+        return( ret );
 
-    /* Set HW peripheral input parameter: public key */
-    Q_binary = mbedtls_calloc( ( 2U * grp->st_modulus_size ) + 1U, sizeof( uint8_t ) );
-    MBEDTLS_MPI_CHK((Q_binary == NULL) ? MBEDTLS_ERR_ECP_ALLOC_FAILED : 0);
+    curve = pka_curve_get( grp );
 
-    MBEDTLS_MPI_CHK( mbedtls_ecp_point_write_binary( grp, Q, MBEDTLS_ECP_PF_UNCOMPRESSED, &olen, Q_binary, ( 2U * grp->st_modulus_size ) + 1U ) );
+    if( curve == NULL )
+    {
+        /* Not a PKA curve: release the Hw before the long software run */
+        if( pka_unlock() != 0 )
+            return( MBEDTLS_ERR_THREADING_MUTEX_ERROR );
 
-    ECDSA_VerifyIn.pPubKeyCurvePtX = Q_binary + 1U;
-    ECDSA_VerifyIn.pPubKeyCurvePtY = Q_binary + grp->st_modulus_size + 1U;
+        return( ecdsa_verify_sw( grp, buf, blen, Q, r, s ) );
+    }
 
-    /* Set HW peripheral input parameter: signature to be verified */
-    r_binary = mbedtls_calloc(grp->st_order_size, sizeof( uint8_t ));
-    MBEDTLS_MPI_CHK((r_binary == NULL) ? MBEDTLS_ERR_ECP_ALLOC_FAILED : 0);
+    /* The point check rejects public keys outside the curve before they   */
+    /* are used (invalid curve attacks) and writes Q for the verification  */
+    MBEDTLS_MPI_CHK( pka_point_check( grp, curve, Q, Q_binary ) );
+
+    /* Set HW peripheral Input parameter: curve coefs */
+    ECDSA_VerifyIn.primeOrderSize = curve->order_size;
+    ECDSA_VerifyIn.modulusSize    = curve->modulus_size;
+    ECDSA_VerifyIn.modulus        = curve->p;
+    ECDSA_VerifyIn.coefSign       = curve->a_sign;
+    ECDSA_VerifyIn.coef           = curve->a_abs;
+    ECDSA_VerifyIn.basePointX     = curve->gx;
+    ECDSA_VerifyIn.basePointY     = curve->gy;
+    ECDSA_VerifyIn.primeOrder     = curve->n;
+
+    /* Set HW peripheral input parameter: hash content buffer that was     */
+    /* signed. The Hw reads primeOrderSize bytes, keep the leftmost bytes  */
+    /* of a longer hash and left pad a shorter one (the order of P-256 and */
+    /* P-384 is a whole number of bytes).                                  */
+    use_size = ( blen > curve->order_size ) ? curve->order_size : blen;
+    memset( e_binary, 0, curve->order_size );
+    memcpy( e_binary + curve->order_size - use_size, buf, use_size );
+    ECDSA_VerifyIn.hash = e_binary;
 
-    s_binary = mbedtls_calloc(grp->st_order_size, sizeof( uint8_t ));
-    MBEDTLS_MPI_CHK((s_binary == NULL) ? MBEDTLS_ERR_ECP_ALLOC_FAILED : 0);
+    /* Set HW peripheral input parameter: public key */
+    ECDSA_VerifyIn.pPubKeyCurvePtX = Q_binary + 1U;
+    ECDSA_VerifyIn.pPubKeyCurvePtY = Q_binary + curve->modulus_size + 1U;
 
-    MBEDTLS_MPI_CHK( mbedtls_mpi_write_binary( r, r_binary, grp->st_order_size ) );
+    /* Set HW peripheral input parameter: signature to be verified */
+    MBEDTLS_MPI_CHK( mbedtls_mpi_write_binary( r, r_binary, curve->order_size ) );
     ECDSA_VerifyIn.RSign = r_binary;
 
-    MBEDTLS_MPI_CHK( mbedtls_mpi_write_binary( s, s_binary, grp->st_order_size ) );
+    MBEDTLS_MPI_CHK( mbedtls_mpi_write_binary( s, s_binary, curve->order_size ) );
     ECDSA_VerifyIn.SSign = s_binary;
 
-    /* Enable HW peripheral clock */
-    __HAL_RCC_PKA_CLK_ENABLE();
-
-    /* Initialize HW peripheral */
-    hpka.Instance = PKA;
-    MBEDTLS_MPI_CHK((HAL_PKA_Init(&hpka) != HAL_OK) ? MBEDTLS_ERR_PLATFORM_HW_ACCEL_FAILED : 0);
-
-    HAL_PKA_RAMReset(&hpka);
+    hpka = pka_begin();
+    MBEDTLS_MPI_CHK((hpka == NULL) ? MBEDTLS_ERR_PLATFORM_HW_ACCEL_FAILED : 0);
 
     /* Launch the signature verification */
-    MBEDTLS_MPI_CHK((HAL_PKA_ECDSAVerif(&hpka, &ECDSA_VerifyIn, ST_ECDSA_TIMEOUT) != HAL_OK) ? MBEDTLS_ERR_PLATFORM_HW_ACCEL_FAILED : 0);
-
+    if( pka_run( hpka, PKA_OP_ECDSA_VERIF, &ECDSA_VerifyIn ) != HAL_OK )
+        ret = MBEDTLS_ERR_PLATFORM_HW_ACCEL_FAILED;
     /* Check the result */
-    MBEDTLS_MPI_CHK((HAL_PKA_ECDSAVerif_IsValidSignature(&hpka) != 1U) ? MBEDTLS_ERR_ECP_VERIFY_FAILED : 0);
+    else if( HAL_PKA_ECDSAVerif_IsValidSignature( hpka ) != 1U )
+        ret = MBEDTLS_ERR_ECP_VERIFY_FAILED;
 
-cleanup:
-    /* De-initialize HW peripheral */
-    HAL_PKA_DeInit(&hpka);
-
-    /* Disable HW peripheral clock */
-    __HAL_RCC_PKA_CLK_DISABLE();
-
-    /* Free memory */
-    if (Q_binary != NULL)
-    {
-        mbedtls_platform_zeroize(Q_binary, ( 2U * grp->st_modulus_size ) + 1U );
-        mbedtls_free(Q_binary);
-    }
+    pka_end();
 
-    if (r_binary != NULL)
-    {
-        mbedtls_platform_zeroize(r_binary, grp->st_order_size);
-        mbedtls_free(r_binary);
-    }
-
-    if (s_binary != NULL)
-    {
-        mbedtls_platform_zeroize(s_binary, grp->st_order_size);
-        mbedtls_free(s_binary);
-    }
+cleanup:
+    unlock_ret = pka_unlock();
+    if( ( ret == 0 ) && ( unlock_ret != 0 ) )
+        ret = MBEDTLS_ERR_THREADING_MUTEX_ERROR;
 
     return ret;
 }
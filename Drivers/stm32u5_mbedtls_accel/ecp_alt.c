@@ -106,8 +106,7 @@
 
 #include "mbedtls/ecp_internal.h"
 #include "stm32u5xx_hal.h"
-
-#define ST_ECP_TIMEOUT     (5000U)
+#include "pka_stm32.h"
 
 #if ( defined(__ARMCC_VERSION) || defined(_MSC_VER) ) \
     && !defined(inline) && !defined(__cplusplus)
@@ -1427,7 +1426,7 @@ static int ecp_mul_comb( mbedtls_ecp_group *grp, mbedtls_ecp_point *R,
     uint8_t *P_binary;
     uint8_t *m_binary = NULL;
     uint8_t *R_binary = NULL;
-    PKA_HandleTypeDef hpka = {0};
+    PKA_HandleTypeDef *hpka = NULL;
     PKA_ECCMulInTypeDef ECC_MulIn = {0};
     PKA_ECCMulOutTypeDef ECC_MulOut;
 
@@ -1457,18 +1456,12 @@ static int ecp_mul_comb( mbedtls_ecp_group *grp, mbedtls_ecp_point *R,
     MBEDTLS_MPI_CHK( mbedtls_mpi_write_binary( m, m_binary, scalarMulSize ) );
     ECC_MulIn.scalarMul = m_binary;
 
-    /* Enable HW peripheral clock */
-    __HAL_RCC_PKA_CLK_ENABLE();
-
-    /* Initialize HW peripheral */
-    hpka.Instance = PKA;
-    MBEDTLS_MPI_CHK((HAL_PKA_Init(&hpka) != HAL_OK) ? MBEDTLS_ERR_PLATFORM_HW_ACCEL_FAILED : 0);
-
-    /* Reset PKA RAM */
-    HAL_PKA_RAMReset(&hpka);
+    /* Take the PKA Hw, shared by the ECDSA, ECDH, ECP and RSA services, */
+    /* and initialize it                                                 */
+    MBEDTLS_MPI_CHK( pka_acquire( &hpka ) );
 
     /* Launch the scalar multiplication */
-    MBEDTLS_MPI_CHK((HAL_PKA_ECCMul(&hpka, &ECC_MulIn, ST_ECP_TIMEOUT) != HAL_OK) ? MBEDTLS_ERR_PLATFORM_HW_ACCEL_FAILED : 0);
+    MBEDTLS_MPI_CHK((pka_run( hpka, PKA_OP_ECC_MUL, &ECC_MulIn ) != HAL_OK) ? MBEDTLS_ERR_PLATFORM_HW_ACCEL_FAILED : 0);
 
     /* Allocate memory space for scalar multiplication result */
     R_binary = mbedtls_calloc(2U * grp->st_modulus_size + 1U, sizeof( uint8_t ));
@@ -1478,18 +1471,16 @@ static int ecp_mul_comb( mbedtls_ecp_group *grp, mbedtls_ecp_point *R,
     ECC_MulOut.ptY = R_binary + grp->st_modulus_size + 1U;
 
     /* Get the scalar multiplication result */
-    HAL_PKA_ECCMul_GetResult(&hpka, &ECC_MulOut);
+    HAL_PKA_ECCMul_GetResult(hpka, &ECC_MulOut);
 
     /* Convert the scalar multiplication result into ecp point format */
     R_binary[0] = 0x04U;
     MBEDTLS_MPI_CHK( mbedtls_ecp_point_read_binary( grp, R, R_binary, 2U * grp->st_modulus_size + 1U) );
 
 cleanup:
-    /* De-initialize HW peripheral */
-    HAL_PKA_DeInit(&hpka);
-
-    /* Disable HW peripheral clock */
-    __HAL_RCC_PKA_CLK_DISABLE();
+    /* De-initialize and release the PKA Hw */
+    if( hpka != NULL )
+        ret = pka_release( ret );
 
     /* Free memory */
     if (P_binary != NULL)
@@ -1804,7 +1795,7 @@ static int ecp_check_pubkey_sw( const mbedtls_ecp_group *grp, const mbedtls_ecp_
     int ret = 0;
     size_t olen;
     uint8_t *pt_binary;
-    PKA_HandleTypeDef hpka = {0};
+    PKA_HandleTypeDef *hpka = NULL;
     PKA_PointCheckInTypeDef ECC_PointCheck = {0};
 
     /* pt coordinates must be normalized for our checks */
@@ -1831,29 +1822,21 @@ static int ecp_check_pubkey_sw( const mbedtls_ecp_group *grp, const mbedtls_ecp_
     ECC_PointCheck.pointX = pt_binary + 1U;
     ECC_PointCheck.pointY = pt_binary + grp->st_modulus_size + 1U;
 
-    /* Enable HW peripheral clock */
-    __HAL_RCC_PKA_CLK_ENABLE();
-
-    /* Initialize HW peripheral */
-    hpka.Instance = PKA;
-    MBEDTLS_MPI_CHK((HAL_PKA_Init(&hpka) != HAL_OK) ? MBEDTLS_ERR_PLATFORM_HW_ACCEL_FAILED : 0);
-
-    /* Reset PKA RAM */
-    HAL_PKA_RAMReset(&hpka);
+    /* Take the PKA Hw, shared by the ECDSA, ECDH, ECP and RSA services, */
+    /* and initialize it                                                 */
+    MBEDTLS_MPI_CHK( pka_acquire( &hpka ) );
 
     /* Launch the point check */
-    MBEDTLS_MPI_CHK((HAL_PKA_PointCheck(&hpka, &ECC_PointCheck, ST_ECP_TIMEOUT) != HAL_OK) ? MBEDTLS_ERR_PLATFORM_HW_ACCEL_FAILED : 0);
+    MBEDTLS_MPI_CHK((pka_run( hpka, PKA_OP_POINT_CHECK, &ECC_PointCheck ) != HAL_OK) ? MBEDTLS_ERR_PLATFORM_HW_ACCEL_FAILED : 0);
 
     /* Get the result of the point check */
-    if( HAL_PKA_PointCheck_IsOnCurve(&hpka) != 1U)
+    if( HAL_PKA_PointCheck_IsOnCurve(hpka) != 1U)
         ret = MBEDTLS_ERR_ECP_INVALID_KEY;
 
 cleanup:
-    /* De-initialize HW peripheral */
-    HAL_PKA_DeInit(&hpka);
-
-    /* Disable HW peripheral clock */
-    __HAL_RCC_PKA_CLK_DISABLE();
+    /* De-initialize and release the PKA Hw */
+    if( hpka != NULL )
+        ret = pka_release( ret );
 
     /* Free memory */
     if (pt_binary != NULL)
@@ -39,6 +39,7 @@
 /* Private typedef -----------------------------------------------------------*/
 /* Private define ------------------------------------------------------------*/
 #define IV_LENGTH        12U   /* implementations restrict support to 96 bits */
+#define ST_GCM_MAX_CHUNK 0xFFF0U /* largest HAL request, multiple of 16 bytes */
 
 #if !defined(STM32_AAD_ANY_LENGTH_SUPPORT)
 #define AAD_WORD_ALIGN   4U   /* implementations may restrict AAD support on  */
@@ -51,23 +52,92 @@
 /* Private functions ---------------------------------------------------------*/
 
 /*
- * Initialize a context
+ * Release the CRYP if it is held by ctx
  */
-void mbedtls_gcm_init( mbedtls_gcm_context *ctx )
+static int gcm_release( mbedtls_gcm_context *ctx )
 {
-    GCM_VALIDATE( ctx != NULL );
+    int ret = 0;
+
+    if ( ctx->locked )
+    {
+        ctx->locked = 0;
+        ret = cryp_unlock();
+    }
+
+    return( ret );
+}
 
-    __disable_irq();
-#if defined(MBEDTLS_THREADING_C)
-    /* mutex cannot be initialized twice */
-if ( !cryp_mutex_started )
+/*
+ * Take the CRYP and load the IV and additional data of the operation
+ * started by mbedtls_gcm_starts(). The Hw runs the init and header phases
+ * with the first payload block.
+ */
+static int gcm_begin( mbedtls_gcm_context *ctx )
 {
-    mbedtls_mutex_init( &cryp_mutex );
-    cryp_mutex_started = 1;
+    int ret;
+
+    ret = cryp_lock();
+    if( ret != 0 )
+        return( ret );
+
+    ctx->locked = 1;
+
+    ctx->hcryp_gcm.Init.pInitVect = ctx->iv;
+
+    if ( ctx->add_len > 0 )
+    {
+        ctx->hcryp_gcm.Init.Header = ctx->add;
+#if defined(STM32_AAD_ANY_LENGTH_SUPPORT)
+        /* header buffer in byte length */
+        ctx->hcryp_gcm.Init.HeaderSize = (uint32_t)ctx->add_len;
+#else
+        /* header buffer in word length */
+        ctx->hcryp_gcm.Init.HeaderSize = (uint32_t)(ctx->add_len/AAD_WORD_ALIGN);
+#endif
+    }
+    else
+    {
+        ctx->hcryp_gcm.Init.Header = NULL;
+        ctx->hcryp_gcm.Init.HeaderSize = 0;
+    }
+
+#if defined(STM32_AAD_ANY_LENGTH_SUPPORT)
+    /* Additional Authentication Data in bytes unit */
+    ctx->hcryp_gcm.Init.HeaderWidthUnit = CRYP_HEADERWIDTHUNIT_BYTE;
+#endif
+
+    /* Do not Allow IV reconfiguration at every gcm update */
+    ctx->hcryp_gcm.Init.KeyIVConfigSkip = CRYP_KEYIVCONFIG_ONCE;
+
+    /* The HAL reads the IV and header from hcryp_gcm.Init when the message */
+    /* starts, so the configuration is only reprogrammed when another       */
+    /* context used the CRYP since this one                                */
+    if ( cryp_owner != &ctx->hcryp_gcm )
+    {
+        if ( HAL_CRYP_SetConfig( &ctx->hcryp_gcm, &ctx->hcryp_gcm.Init ) != HAL_OK )
+        {
+            cryp_owner = NULL;
+            (void) gcm_release( ctx );
+            return( MBEDTLS_ERR_PLATFORM_HW_ACCEL_FAILED );
+        }
+
+        cryp_owner = &ctx->hcryp_gcm;
+    }
+
+    /* New message: the first request loads the key and IV, then runs the */
+    /* init and header phases                                              */
+    ctx->hcryp_gcm.KeyIVConfig = 0U;
+    ctx->hcryp_gcm.Phase = CRYP_PHASE_READY;
+
+    return( 0 );
 }
-#endif /* MBEDTLS_THREADING_C */
-    cryp_context_count++;
-    __enable_irq();
+
+/*
+ * Initialize a context
+ */
+void mbedtls_gcm_init( mbedtls_gcm_context *ctx )
+{
+    GCM_VALIDATE( ctx != NULL );
 
     cryp_zeroize( (void*)ctx, sizeof(mbedtls_gcm_context) );
 }
@@ -79,16 +149,13 @@ int mbedtls_gcm_setkey( mbedtls_gcm_context *ctx,
 {
     unsigned int i;
     int ret = 0;
+    HAL_StatusTypeDef hal_ret;
 
     GCM_VALIDATE_RET( ctx != NULL );
     GCM_VALIDATE_RET( key != NULL );
 
-    /* Protect context access                                  */
-    /* (it may occur at a same time in a threaded environment) */
-#if defined(MBEDTLS_THREADING_C)
-    if( mbedtls_mutex_lock( &cryp_mutex ) != 0 )
-        return( MBEDTLS_ERR_THREADING_MUTEX_ERROR );
-#endif /* MBEDTLS_THREADING_C */
+    if( cipher != MBEDTLS_CIPHER_ID_AES )
+        return( MBEDTLS_ERR_GCM_BAD_INPUT );
 
     switch (keybits)
     {
@@ -101,8 +168,7 @@ int mbedtls_gcm_setkey( mbedtls_gcm_context *ctx,
             ctx->hcryp_gcm.Init.KeySize = CRYP_KEYSIZE_192B;
             break;
 #else
-            ret = MBEDTLS_ERR_PLATFORM_FEATURE_UNSUPPORTED;
-            goto exit;
+            return( MBEDTLS_ERR_PLATFORM_FEATURE_UNSUPPORTED );
 #endif /* USE_AES_KEY192 */
 
         case 256:
@@ -110,10 +176,20 @@ int mbedtls_gcm_setkey( mbedtls_gcm_context *ctx,
             break;
 
         default :
-            ret = MBEDTLS_ERR_GCM_BAD_INPUT;
-            goto exit;
+            return( MBEDTLS_ERR_GCM_BAD_INPUT );
     }
 
+    /* An unfinished operation is abandoned */
+    ret = gcm_release( ctx );
+    if( ret != 0 )
+        return( ret );
+
+    /* Protect context access                                  */
+    /* (it may occur at a same time in a threaded environment) */
+    ret = cryp_lock();
+    if( ret != 0 )
+        return( ret );
+
     /* Format and fill AES key  */
     for( i=0; i < (keybits/32); i++ )
         GET_UINT32_BE( ctx->gcm_key[i], key, 4*i );
@@ -134,46 +210,43 @@ int mbedtls_gcm_setkey( mbedtls_gcm_context *ctx,
     ctx->hcryp_gcm.Init.DataWidthUnit = CRYP_DATAWIDTHUNIT_BYTE;
     ctx->hcryp_gcm.Init.pKey = ctx->gcm_key;
 
-    if ( HAL_CRYP_Init( &ctx->hcryp_gcm ) != HAL_OK )
+    if ( ctx->hcryp_gcm.State == HAL_CRYP_STATE_RESET )
+        hal_ret = HAL_CRYP_Init( &ctx->hcryp_gcm );
+    else
+        hal_ret = HAL_CRYP_SetConfig( &ctx->hcryp_gcm, &ctx->hcryp_gcm.Init );
+
+    if ( hal_ret == HAL_OK )
+    {
+        cryp_owner = &ctx->hcryp_gcm;
+    }
+    else
     {
+        cryp_owner = NULL;
         ret = MBEDTLS_ERR_PLATFORM_HW_ACCEL_FAILED;
-        goto exit;
     }
 
-    /* allow multi-context of CRYP : save context */
-    ctx->ctx_save_cr = ctx->hcryp_gcm.Instance->CR;
-
-exit :
     /* Free context access */
-#if defined(MBEDTLS_THREADING_C)
-    if( mbedtls_mutex_unlock( &cryp_mutex ) != 0 )
+    if( cryp_unlock() != 0 )
         ret = MBEDTLS_ERR_THREADING_MUTEX_ERROR;
-#endif /* MBEDTLS_THREADING_C */
 
     return( ret );
 }
 
 int mbedtls_gcm_starts( mbedtls_gcm_context *ctx,
-                int mode,
-                const unsigned char *iv,
-                size_t iv_len,
-                const unsigned char *add,
-                size_t add_len )
+                        int mode,
+                        const unsigned char *iv,
+                        size_t iv_len )
 {
-    int ret = 0;
+    int ret;
     unsigned int i;
-   __ALIGN_BEGIN static uint32_t iv_32B[4] __ALIGN_END;
 
     GCM_VALIDATE_RET( ctx != NULL );
-    GCM_VALIDATE_RET( mode != MBEDTLS_GCM_ENCRYPT || mode != MBEDTLS_GCM_DECRYPT );
+    GCM_VALIDATE_RET( mode == MBEDTLS_GCM_ENCRYPT || mode == MBEDTLS_GCM_DECRYPT );
     GCM_VALIDATE_RET( iv != NULL );
-    GCM_VALIDATE_RET( add_len == 0 || add != NULL );
 
-    /* IV and AD are limited to 2^64 bits, so 2^61 bytes */
+    /* IV is limited to 2^64 bits, so 2^61 bytes */
     /* IV is not allowed to be zero length */
-    if( iv_len == 0 ||
-      ( (uint64_t) iv_len  ) >> 61 != 0 ||
-      ( (uint64_t) add_len ) >> 61 != 0 )
+    if( iv_len == 0 || ( (uint64_t) iv_len ) >> 61 != 0 )
     {
         return( MBEDTLS_ERR_GCM_BAD_INPUT );
     }
@@ -184,206 +257,222 @@ int mbedtls_gcm_starts( mbedtls_gcm_context *ctx,
         return( MBEDTLS_ERR_PLATFORM_FEATURE_UNSUPPORTED );
     }
 
-#if !defined(STM32_AAD_ANY_LENGTH_SUPPORT)
-    /* implementation restrict support to a buffer multiple of 32 bits */
-    if ((add_len % AAD_WORD_ALIGN) != 0U)
-    {
-        return( MBEDTLS_ERR_PLATFORM_FEATURE_UNSUPPORTED );
-    }
-#endif
-
-    /* Protect context access                                  */
-    /* (it may occur at a same time in a threaded environment) */
-#if defined(MBEDTLS_THREADING_C)
-    if( mbedtls_mutex_lock( &cryp_mutex ) != 0 )
-        return( MBEDTLS_ERR_THREADING_MUTEX_ERROR );
-#endif /* MBEDTLS_THREADING_C */
-
-    if ( HAL_CRYP_Init( &ctx->hcryp_gcm ) != HAL_OK )
-    {
-        ret = MBEDTLS_ERR_PLATFORM_HW_ACCEL_FAILED;
-        goto exit;
-    }
-
-    /* allow multi-context of CRYP use: restore context */
-    ctx->hcryp_gcm.Instance->CR = ctx->ctx_save_cr;
+    /* An unfinished operation is abandoned */
+    ret = gcm_release( ctx );
+    if( ret != 0 )
+        return( ret );
 
     ctx->mode = mode;
     ctx->len = 0;
+    ctx->add_len = 0;
+    ctx->partial = 0;
 
     /* Set IV with invert endianness */
     for( i=0; i < 3; i++ )
-        GET_UINT32_BE( iv_32B[i], iv, 4*i );
+        GET_UINT32_BE( ctx->iv[i], iv, 4*i );
 
     /* According to NIST specification, the counter value is 0x2 when
        processing the first block of payload */
-    iv_32B[3] = 0x00000002;
+    ctx->iv[3] = 0x00000002;
 
-    ctx->hcryp_gcm.Init.pInitVect = iv_32B;
+    return( 0 );
+}
 
-    if ( add_len > 0 )
-    {
-        ctx->hcryp_gcm.Init.Header = (uint32_t *)add;
-#if defined(STM32_AAD_ANY_LENGTH_SUPPORT)
-        /* header buffer in byte length */
-        ctx->hcryp_gcm.Init.HeaderSize = (uint32_t)add_len;
-#else
-        /* header buffer in word length */
-        ctx->hcryp_gcm.Init.HeaderSize = (uint32_t)(add_len/AAD_WORD_ALIGN);
-#endif
-    }
-    else
-    {
-      ctx->hcryp_gcm.Init.Header = NULL;
-      ctx->hcryp_gcm.Init.HeaderSize = 0;
-    }
+int mbedtls_gcm_update_ad( mbedtls_gcm_context *ctx,
+                           const unsigned char *add,
+                           size_t add_len )
+{
+    GCM_VALIDATE_RET( ctx != NULL );
+    GCM_VALIDATE_RET( add_len == 0 || add != NULL );
 
-#if defined(STM32_AAD_ANY_LENGTH_SUPPORT)
-    /* Additional Authentication Data in bytes unit */
-    ctx->hcryp_gcm.Init.HeaderWidthUnit = CRYP_HEADERWIDTHUNIT_BYTE;
-#endif
+    /* Additional data must all be given before the payload */
+    if( ctx->locked )
+        return( MBEDTLS_ERR_GCM_BAD_INPUT );
 
-    /* Do not Allow IV reconfiguration at every gcm update */
-    ctx->hcryp_gcm.Init.KeyIVConfigSkip = CRYP_KEYIVCONFIG_ONCE;
+    if( add_len > ( ST_GCM_ADD_MAX_LEN - ctx->add_len ) )
+        return( MBEDTLS_ERR_PLATFORM_FEATURE_UNSUPPORTED );
 
-    /* reconfigure the CRYP */
-    if ( HAL_CRYP_SetConfig( &ctx->hcryp_gcm, &ctx->hcryp_gcm.Init ) != HAL_OK )
+#if !defined(STM32_AAD_ANY_LENGTH_SUPPORT)
+    /* implementation restrict support to a buffer multiple of 32 bits */
+    if( ( ( ctx->add_len + add_len ) % AAD_WORD_ALIGN ) != 0U )
+        return( MBEDTLS_ERR_PLATFORM_FEATURE_UNSUPPORTED );
+#endif
+
+    if( add_len > 0 )
     {
-        ret = MBEDTLS_ERR_PLATFORM_HW_ACCEL_FAILED;
-        goto exit;
+        memcpy( (unsigned char *)ctx->add + ctx->add_len, add, add_len );
+        ctx->add_len += add_len;
     }
 
-    /* allow multi-context of CRYP : save context */
-    ctx->ctx_save_cr = ctx->hcryp_gcm.Instance->CR;
-
-exit:
-    /* Free context access */
-#if defined(MBEDTLS_THREADING_C)
-    if( mbedtls_mutex_unlock( &cryp_mutex ) != 0 )
-        ret = MBEDTLS_ERR_THREADING_MUTEX_ERROR;
-#endif /* MBEDTLS_THREADING_C */
-
-    return( ret );
+    return( 0 );
 }
 
 int mbedtls_gcm_update( mbedtls_gcm_context *ctx,
-                size_t length,
-                const unsigned char *input,
-                unsigned char *output )
+                        const unsigned char *input, size_t input_length,
+                        unsigned char *output, size_t output_size,
+                        size_t *output_length )
 {
     int ret = 0;
+    HAL_StatusTypeDef hal_ret;
+    size_t done;
+    size_t chunk;
 
     GCM_VALIDATE_RET( ctx != NULL );
-    GCM_VALIDATE_RET( length == 0 || input != NULL );
-    GCM_VALIDATE_RET( length == 0 || output != NULL );
+    GCM_VALIDATE_RET( input_length == 0 || input != NULL );
+    GCM_VALIDATE_RET( input_length == 0 || output != NULL );
+    GCM_VALIDATE_RET( output_length != NULL );
+
+    *output_length = 0;
 
-    if( output > input && (size_t) ( output - input ) < length )
+    if( output_size < input_length )
+        return( MBEDTLS_ERR_GCM_BUFFER_TOO_SMALL );
+
+    if( output > input && (size_t) ( output - input ) < input_length )
         return( MBEDTLS_ERR_GCM_BAD_INPUT );
 
     /* Total length is restricted to 2^39 - 256 bits, ie 2^36 - 2^5 bytes
      * Also check for possible overflow */
-    if( ( (ctx->len + length) < ctx->len ) ||
-        ( (uint64_t)(ctx->len + length) > 0xFFFFFFFE0ull ) )
+    if( ( (ctx->len + input_length) < ctx->len ) ||
+        ( (uint64_t)(ctx->len + input_length) > 0xFFFFFFFE0ull ) )
     {
         return( MBEDTLS_ERR_GCM_BAD_INPUT );
     }
 
-    /* Protect context access                                  */
-    /* (it may occur at a same time in a threaded environment) */
-#if defined(MBEDTLS_THREADING_C)
-    if( mbedtls_mutex_lock( &cryp_mutex ) != 0 )
-        return( MBEDTLS_ERR_THREADING_MUTEX_ERROR );
-#endif /* MBEDTLS_THREADING_C */
+    if( input_length == 0 )
+        return( 0 );
 
-    /* allow multi-context of CRYP use: restore context */
-    ctx->hcryp_gcm.Instance->CR = ctx->ctx_save_cr;
-
-    ctx->len += length;
+    /* The Hw pads a partial block and moves on, so only the last update */
+    /* of an operation may end within a block                            */
+    if( ctx->partial )
+        return( MBEDTLS_ERR_PLATFORM_FEATURE_UNSUPPORTED );
 
-    if( ctx->mode == MBEDTLS_GCM_DECRYPT )
+    if( !ctx->locked )
     {
-         if ( HAL_CRYP_Decrypt( &ctx->hcryp_gcm,
-                               (uint32_t *)input,
-                               length,
-                               (uint32_t *)output,
-                               ST_CRYP_TIMEOUT ) != HAL_OK )
-         {
-            ret = MBEDTLS_ERR_PLATFORM_HW_ACCEL_FAILED;
-            goto exit;
-         }
+        ret = gcm_begin( ctx );
+        if( ret != 0 )
+            return( ret );
     }
-    else
+
+    /* The HAL takes a 16 bit size, feed larger inputs in whole blocks. */
+    /* Large requests are streamed by the DMA while the task sleeps.    */
+    for( done = 0, hal_ret = HAL_OK;
+         ( hal_ret == HAL_OK ) && ( done < input_length );
+         done += chunk )
     {
-         if ( HAL_CRYP_Encrypt( &ctx->hcryp_gcm,
-                               (uint32_t *)input,
-                               length,
-                               (uint32_t *)output,
-                               ST_CRYP_TIMEOUT ) != HAL_OK )
-         {
-            ret = MBEDTLS_ERR_PLATFORM_HW_ACCEL_FAILED;
-            goto exit;
-         }
+        chunk = input_length - done;
+        if( chunk > ST_GCM_MAX_CHUNK )
+            chunk = ST_GCM_MAX_CHUNK;
+
+#if (ST_CRYP_DMA_ENABLE == 1)
+        if( cryp_dma_usable( input + done, output + done, chunk ) )
+        {
+            /* Whole blocks only, a trailing partial block is polled */
+            chunk -= chunk % 16U;
+            hal_ret = cryp_dma_process( &ctx->hcryp_gcm,
+                                        ctx->mode != MBEDTLS_GCM_DECRYPT,
+                                        input + done,
+                                        (uint16_t)chunk,
+                                        output + done,
+                                        ST_CRYP_TIMEOUT );
+        }
+        else
+#endif /* ST_CRYP_DMA_ENABLE */
+        if( ctx->mode == MBEDTLS_GCM_DECRYPT )
+        {
+            hal_ret = HAL_CRYP_Decrypt( &ctx->hcryp_gcm,
+                                        (uint32_t *)( input + done ),
+                                        (uint16_t)chunk,
+                                        (uint32_t *)( output + done ),
+                                        ST_CRYP_TIMEOUT );
+        }
+        else
+        {
+            hal_ret = HAL_CRYP_Encrypt( &ctx->hcryp_gcm,
+                                        (uint32_t *)( input + done ),
+                                        (uint16_t)chunk,
+                                        (uint32_t *)( output + done ),
+                                        ST_CRYP_TIMEOUT );
+        }
     }
 
-    /* allow multi-context of CRYP : save context */
-    ctx->ctx_save_cr = ctx->hcryp_gcm.Instance->CR;
+    if( hal_ret != HAL_OK )
+    {
+        cryp_owner = NULL;
+        (void) gcm_release( ctx );
+        return( MBEDTLS_ERR_PLATFORM_HW_ACCEL_FAILED );
+    }
 
-exit:
-    /* Free context access */
-#if defined(MBEDTLS_THREADING_C)
-    if( mbedtls_mutex_unlock( &cryp_mutex ) != 0 )
-        ret = MBEDTLS_ERR_THREADING_MUTEX_ERROR;
-#endif /* MBEDTLS_THREADING_C */
+    ctx->len += input_length;
+    ctx->partial = ( ( input_length % 16U ) != 0U );
+    *output_length = input_length;
 
-    return( ret );
+    return( 0 );
 }
 
 int mbedtls_gcm_finish( mbedtls_gcm_context *ctx,
-                unsigned char *tag,
-                size_t tag_len )
+                        unsigned char *output, size_t output_size,
+                        size_t *output_length,
+                        unsigned char *tag, size_t tag_len )
 {
     int ret = 0;
     __ALIGN_BEGIN uint8_t mac[16]      __ALIGN_END; /* temporary mac         */
 
     GCM_VALIDATE_RET( ctx != NULL );
     GCM_VALIDATE_RET( tag != NULL );
+    GCM_VALIDATE_RET( output_length != NULL );
+
+    /* No data is held back by update, so there is no output here */
+    (void) output;
+    (void) output_size;
+    *output_length = 0;
 
     if( tag_len > 16 || tag_len < 4 )
         return( MBEDTLS_ERR_GCM_BAD_INPUT );
 
-    /* Protect context access                                  */
-    /* (it may occur at a same time in a threaded environment) */
-#if defined(MBEDTLS_THREADING_C)
-    if( mbedtls_mutex_lock( &cryp_mutex ) != 0 )
-        return( MBEDTLS_ERR_THREADING_MUTEX_ERROR );
-#endif /* MBEDTLS_THREADING_C */
-
-    /* allow multi-context of CRYP use: restore context */
-    ctx->hcryp_gcm.Instance->CR = ctx->ctx_save_cr;
+    if( !ctx->locked )
+    {
+        ret = gcm_begin( ctx );
+        if( ret != 0 )
+            return( ret );
+
+        /* No payload: run the init and header phases, the tag sequence */
+        /* requires them to be done                                     */
+        if ( HAL_CRYP_Encrypt( &ctx->hcryp_gcm,
+                               (uint32_t *)mac,
+                               0,
+                               (uint32_t *)mac,
+                               ST_CRYP_TIMEOUT ) != HAL_OK )
+        {
+            ret = MBEDTLS_ERR_PLATFORM_HW_ACCEL_FAILED;
+        }
+    }
 
     /* Tag has a variable length */
     memset(mac, 0, sizeof(mac));
 
     /* Generate the authentication TAG */
-    if ( HAL_CRYPEx_AESGCM_GenerateAuthTAG( &ctx->hcryp_gcm,
-                                           (uint32_t *)mac,
-                                           ST_CRYP_TIMEOUT )!= HAL_OK )
+    if ( ( ret == 0 ) &&
+         ( HAL_CRYPEx_AESGCM_GenerateAuthTAG( &ctx->hcryp_gcm,
+                                              (uint32_t *)mac,
+                                              ST_CRYP_TIMEOUT ) != HAL_OK ) )
     {
         ret = MBEDTLS_ERR_PLATFORM_HW_ACCEL_FAILED;
-        goto exit;
     }
 
-    memcpy( tag, mac, tag_len );
+    if( ret == 0 )
+    {
+        memcpy( tag, mac, tag_len );
+    }
+    else
+    {
+        cryp_owner = NULL;
+    }
 
-    /* allow multi-context of CRYP : save context */
-    ctx->ctx_save_cr = ctx->hcryp_gcm.Instance->CR;
+    mbedtls_platform_zeroize( mac, sizeof( mac ) );
 
-exit:
     /* Free context access */
-#if defined(MBEDTLS_THREADING_C)
-    if( mbedtls_mutex_unlock( &cryp_mutex ) != 0 )
+    if( gcm_release( ctx ) != 0 )
         ret = MBEDTLS_ERR_THREADING_MUTEX_ERROR;
-#endif /* MBEDTLS_THREADING_C */
 
     return( ret );
 }
@@ -401,6 +490,7 @@ int mbedtls_gcm_crypt_and_tag( mbedtls_gcm_context *ctx,
                        unsigned char *tag )
 {
     int ret;
+    size_t olen;
 
     GCM_VALIDATE_RET( ctx != NULL );
     GCM_VALIDATE_RET( iv != NULL );
@@ -409,13 +499,17 @@ int mbedtls_gcm_crypt_and_tag( mbedtls_gcm_context *ctx,
     GCM_VALIDATE_RET( length == 0 || output != NULL );
     GCM_VALIDATE_RET( tag != NULL );
 
-    if( ( ret = mbedtls_gcm_starts( ctx, mode, iv, iv_len, add, add_len ) ) != 0 )
+    if( ( ret = mbedtls_gcm_starts( ctx, mode, iv, iv_len ) ) != 0 )
+        return( ret );
+
+    if( ( ret = mbedtls_gcm_update_ad( ctx, add, add_len ) ) != 0 )
         return( ret );
 
-    if( ( ret = mbedtls_gcm_update( ctx, length, input, output ) ) != 0 )
+    if( ( ret = mbedtls_gcm_update( ctx, input, length,
+                                    output, length, &olen ) ) != 0 )
         return( ret );
 
-    if( ( ret = mbedtls_gcm_finish( ctx, tag, tag_len ) ) != 0 )
+    if( ( ret = mbedtls_gcm_finish( ctx, NULL, 0, &olen, tag, tag_len ) ) != 0 )
         return( ret );
 
     return( 0 );
@@ -469,22 +563,15 @@ void mbedtls_gcm_free( mbedtls_gcm_context *ctx )
     if( ctx == NULL )
         return;
 
-    __disable_irq();
-    if ( cryp_context_count > 0 )
-        cryp_context_count--;
+    (void) gcm_release( ctx );
 
-#if defined(MBEDTLS_THREADING_C)
-    if ( cryp_mutex_started )
+    /* A new context at the same address must not inherit the Hw configuration */
+    if( cryp_lock() == 0 )
     {
-        mbedtls_mutex_free( &cryp_mutex );
-        cryp_mutex_started = 0;
+        if( cryp_owner == &ctx->hcryp_gcm )
+            cryp_owner = NULL;
+        (void) cryp_unlock();
     }
-#endif /* MBEDTLS_THREADING_C */
-    __enable_irq();
-
-    /* Shut down CRYP on last context */
-    if ( cryp_context_count == 0 )
-        HAL_CRYP_DeInit( &ctx->hcryp_gcm );
 
     cryp_zeroize( (void*)ctx, sizeof(mbedtls_gcm_context) );
 }
@@ -43,10 +43,22 @@
 extern "C" {
 #endif
 
+/* Exported constants --------------------------------------------------------*/
+/* Longest Additional Authentication Data accepted. The data is given to the  */
+/* Hw along with the first payload block, so it is kept in the context.       */
+/* TLS uses 13 bytes (TLS 1.2) or 5 bytes (TLS 1.3).                          */
+#ifndef ST_GCM_ADD_MAX_LEN
+#define ST_GCM_ADD_MAX_LEN    32U
+#endif
+
 /* Exported types ------------------------------------------------------------*/
 /**
- * \brief          AES context structure
+ * \brief          GCM context structure
  *
+ *                 The CRYP is held by a context from its first payload (or
+ *                 tag) computation until mbedtls_gcm_finish(), as the Hw
+ *                 keeps the GHASH state in between. A task must therefore
+ *                 not interleave the operations of two GCM contexts.
  */
 typedef struct mbedtls_gcm_context
 {
@@ -54,15 +66,18 @@ typedef struct mbedtls_gcm_context
     uint32_t gcm_key[8];
 
     CRYP_HandleTypeDef hcryp_gcm;      /* HW driver handle                    */
-    uint32_t ctx_save_cr;              /* save context for multi-context  */
+    uint32_t iv[4];                    /* Initial counter block               */
+    uint32_t add[ST_GCM_ADD_MAX_LEN/4];/* Additional Authentication Data      */
+    size_t add_len;                    /* Length of add in bytes              */
     uint64_t len;                      /* total length of the encrypted data. */
     int mode;                          /* The operation to perform:
                                                #MBEDTLS_GCM_ENCRYPT or
                                                #MBEDTLS_GCM_DECRYPT.          */
+    unsigned char locked;              /* The CRYP is held by this context    */
+    unsigned char partial;             /* Last update ended within a block    */
 }
 mbedtls_gcm_context;
 
-/* Exported constants --------------------------------------------------------*/
 /* Uncomment if ADD (Additional Authentication Data) may have not a length    */
 /* over a multiple of 32 bits  (Hw implementation dependance)                 */
 #define STM32_AAD_ANY_LENGTH_SUPPORT
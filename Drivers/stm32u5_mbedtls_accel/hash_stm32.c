@@ -19,28 +19,274 @@
  */
 
 /* Includes ------------------------------------------------------------------*/
-#if !defined(MBEDTLS_CONFIG_FILE)
-#include "config.h"
-#else
-#include MBEDTLS_CONFIG_FILE
-#endif
+#include "mbedtls/build_info.h"
 
 #if defined(MBEDTLS_SHA1_ALT) || defined(MBEDTLS_SHA256_ALT) || defined(MBEDTLS_MD5_ALT)
 
 #include "hash_stm32.h"
 
+#if (ST_HASH_DMA_ENABLE == 1)
+#include "FreeRTOS.h"
+#include "task.h"
+#endif /* ST_HASH_DMA_ENABLE */
+
 /* Variables -----------------------------------------------------------------*/
 /* Mutex protection because of one Hash Hw instance is shared over several   */
 /* algorithms (SHA-1, SHA-256, MD5 implementations may be enabled together)  */
+/* and contexts. It is created on first use and never freed.                 */
 #if defined(MBEDTLS_THREADING_C)
-mbedtls_threading_mutex_t hash_mutex;
-unsigned char hash_mutex_started = 0;
+static mbedtls_threading_mutex_t hash_mutex;
+static volatile unsigned char hash_mutex_started = 0;
 #endif /* MBEDTLS_THREADING_C */
 
-unsigned int hash_context_count = 0;
+/* Context whose state is loaded in the Hash Hw, and where to save it */
+static HASH_HandleTypeDef *hash_owner = NULL;
+static uint8_t *hash_owner_regs = NULL;
+
+#if (ST_HASH_DMA_ENABLE == 1)
+/* External memories cached by DCACHE1, the DMA would bypass the cache */
+#define HASH_DCACHE_REGION_START  (0x60000000UL)
+#define HASH_DCACHE_REGION_END    (0xA0000000UL)
+
+/* Largest DMA block, a multiple of the 64 bytes hash block */
+#define HASH_DMA_MAX_CHUNK        (0xFFC0UL)
+
+/* The DMA packs the input bytes into words so buffers may be unaligned */
+static DMA_HandleTypeDef hash_dma_in =
+{
+    .Instance                  = GPDMA1_Channel2,
+    .Init                      =
+    {
+        .Request               = GPDMA1_REQUEST_HASH_IN,
+        .BlkHWRequest          = DMA_BREQ_SINGLE_BURST,
+        .Direction             = DMA_MEMORY_TO_PERIPH,
+        .SrcInc                = DMA_SINC_INCREMENTED,
+        .DestInc               = DMA_DINC_FIXED,
+        .SrcDataWidth          = DMA_SRC_DATAWIDTH_BYTE,
+        .DestDataWidth         = DMA_DEST_DATAWIDTH_WORD,
+        .Priority              = DMA_LOW_PRIORITY_HIGH_WEIGHT,
+        .SrcBurstLength        = 1,
+        .DestBurstLength       = 1,
+        .TransferAllocatedPort = DMA_SRC_ALLOCATED_PORT0 | DMA_DEST_ALLOCATED_PORT1,
+        .TransferEventMode     = DMA_TCEM_BLOCK_TRANSFER,
+        .Mode                  = DMA_NORMAL,
+    },
+};
+
+/* 0: not initialized yet, 1: ready, -1: initialization failed */
+static volatile int hash_dma_state = 0;
+
+/* Task waiting for the end of the current DMA request */
+static TaskHandle_t volatile hash_dma_task = NULL;
+
+/* Result of the current DMA request, written by the HAL callbacks */
+static volatile HAL_StatusTypeDef hash_dma_result = HAL_OK;
+#endif /* ST_HASH_DMA_ENABLE */
 
 /* Functions -----------------------------------------------------------------*/
 
+/* Take exclusive use of the Hash Hw */
+int hash_lock(void)
+{
+#if defined(MBEDTLS_THREADING_C)
+    if (!hash_mutex_started)
+    {
+        __disable_irq();
+        /* mutex cannot be initialized twice */
+        if (!hash_mutex_started)
+        {
+            mbedtls_mutex_init(&hash_mutex);
+            hash_mutex_started = 1;
+        }
+        __enable_irq();
+    }
+
+    if (mbedtls_mutex_lock(&hash_mutex) != 0)
+        return (MBEDTLS_ERR_THREADING_MUTEX_ERROR);
+#endif /* MBEDTLS_THREADING_C */
+
+    return (0);
+}
+
+/* Release the Hash Hw taken by hash_lock */
+int hash_unlock(void)
+{
+#if defined(MBEDTLS_THREADING_C)
+    if (mbedtls_mutex_unlock(&hash_mutex) != 0)
+        return (MBEDTLS_ERR_THREADING_MUTEX_ERROR);
+#endif /* MBEDTLS_THREADING_C */
+
+    return (0);
+}
+
+void hash_select(HASH_HandleTypeDef *hhash, uint8_t *save_regs, int restore)
+{
+    if (hash_owner == hhash)
+        return;
+
+    if (hash_owner != NULL)
+        HAL_HASH_ContextSaving(hash_owner, hash_owner_regs);
+
+    if (restore)
+        HAL_HASH_ContextRestoring(hhash, save_regs);
+
+    hash_owner = hhash;
+    hash_owner_regs = save_regs;
+}
+
+void hash_forget(HASH_HandleTypeDef *hhash)
+{
+    if (hash_owner == hhash) {
+        hash_owner = NULL;
+        hash_owner_regs = NULL;
+    }
+}
+
+void hash_save_if_loaded(HASH_HandleTypeDef *hhash, uint8_t *save_regs)
+{
+    if (hash_owner == hhash)
+        HAL_HASH_ContextSaving(hhash, save_regs);
+}
+
+#if (ST_HASH_DMA_ENABLE == 1)
+static void hash_dma_irq_handler(void)
+{
+    HAL_DMA_IRQHandler(&hash_dma_in);
+}
+
+static int hash_dma_init(void)
+{
+    DMA_DataHandlingConfTypeDef handling = { 0 };
+    HAL_StatusTypeDef hal_ret;
+
+    __HAL_RCC_GPDMA1_CLK_ENABLE();
+
+    hal_ret = HAL_DMA_Init(&hash_dma_in);
+
+    if (hal_ret == HAL_OK) {
+        handling.DataExchange = DMA_EXCHANGE_NONE;
+        handling.DataAlignment = DMA_DATA_PACK;
+        hal_ret = HAL_DMAEx_ConfigDataHandling(&hash_dma_in, &handling);
+    }
+
+    if (hal_ret == HAL_OK)
+        hal_ret = HAL_DMA_ConfigChannelAttributes(&hash_dma_in, DMA_CHANNEL_NPRIV);
+
+    if (hal_ret == HAL_OK) {
+        NVIC_SetVector(GPDMA1_Channel2_IRQn, (uint32_t) hash_dma_irq_handler);
+        HAL_NVIC_SetPriority(GPDMA1_Channel2_IRQn, 5, 0);
+        HAL_NVIC_EnableIRQ(GPDMA1_Channel2_IRQn);
+    }
+
+    return (hal_ret == HAL_OK) ? 1 : -1;
+}
+
+int hash_dma_usable(const unsigned char *input, size_t length)
+{
+    uint32_t start = (uint32_t) input;
+
+    if ((hash_dma_state < 0) || (length < ST_HASH_DMA_MIN_LEN))
+        return (0);
+
+    if ((xTaskGetSchedulerState() != taskSCHEDULER_RUNNING) ||
+        (xPortIsInsideInterrupt() != pdFALSE))
+        return (0);
+
+    return (start >= HASH_DCACHE_REGION_END) ||
+           ((start + length) <= HASH_DCACHE_REGION_START);
+}
+
+static void hash_dma_complete(HAL_StatusTypeDef result)
+{
+    BaseType_t higher_priority_task_woken = pdFALSE;
+
+    hash_dma_result = result;
+
+    if (hash_dma_task != NULL) {
+        vTaskNotifyGiveIndexedFromISR(hash_dma_task, ST_HASH_DMA_NOTIFY_IDX,
+                                      &higher_priority_task_woken);
+        portYIELD_FROM_ISR(higher_priority_task_woken);
+    }
+}
+
+void HAL_HASH_InCpltCallback(HASH_HandleTypeDef *hhash)
+{
+    (void) hhash;
+    hash_dma_complete(HAL_OK);
+}
+
+void HAL_HASH_ErrorCallback(HASH_HandleTypeDef *hhash)
+{
+    (void) hhash;
+    hash_dma_complete(HAL_ERROR);
+}
+
+HAL_StatusTypeDef hash_dma_accumulate(HASH_HandleTypeDef *hhash,
+                                      hash_dma_start_t start,
+                                      const unsigned char *input,
+                                      size_t length)
+{
+    HAL_StatusTypeDef hal_ret = HAL_OK;
+    size_t chunk;
+
+    if (hash_dma_state == 0)
+        hash_dma_state = hash_dma_init();
+
+    if (hash_dma_state < 0)
+        return (HAL_ERROR);
+
+    __HAL_LINKDMA(hhash, hdmain, hash_dma_in);
+
+    /* Multiple DMA transfers: the digest is not computed at the end of */
+    /* each one, the last bytes are written by HAL_HASH*_Accmlt_End      */
+    __HAL_HASH_SET_MDMAT();
+
+    hash_dma_task = xTaskGetCurrentTaskHandle();
+
+    while ((hal_ret == HAL_OK) && (length > 0)) {
+        chunk = (length > HASH_DMA_MAX_CHUNK) ? HASH_DMA_MAX_CHUNK : length;
+
+        hash_dma_result = HAL_ERROR;
+        (void) xTaskNotifyStateClearIndexed(NULL, ST_HASH_DMA_NOTIFY_IDX);
+        (void) ulTaskNotifyValueClearIndexed(NULL, ST_HASH_DMA_NOTIFY_IDX, 0xFFFFFFFFUL);
+
+        hal_ret = start(hhash, (uint8_t *)input, chunk);
+
+        if (hal_ret == HAL_OK) {
+            if (ulTaskNotifyTakeIndexed(ST_HASH_DMA_NOTIFY_IDX, pdTRUE,
+                                        pdMS_TO_TICKS(ST_HASH_TIMEOUT)) == 0) {
+                (void) HAL_DMA_Abort(&hash_dma_in);
+                CLEAR_BIT(HASH->CR, HASH_CR_DMAE);
+                hhash->State = HAL_HASH_STATE_READY;
+                __HAL_UNLOCK(hhash);
+                hal_ret = HAL_TIMEOUT;
+            } else {
+                hal_ret = hash_dma_result;
+            }
+        }
+
+        input += chunk;
+        length -= chunk;
+    }
+
+    /* The Hw may still be digesting the last block, its context must */
+    /* only be saved once it is idle                                   */
+    while (READ_BIT(HASH->SR, HASH_SR_BUSY) != 0U) {
+    }
+
+    __HAL_HASH_RESET_MDMAT();
+
+    hash_dma_task = NULL;
+
+    if (hal_ret != HAL_OK) {
+        /* The Hw state is unknown, start from scratch on next use */
+        hash_forget(hhash);
+    }
+
+    return (hal_ret);
+}
+#endif /* ST_HASH_DMA_ENABLE */
+
 /* Implementation that should never be optimized out by the compiler */
 void hash_zeroize( void *v, size_t n )
 {
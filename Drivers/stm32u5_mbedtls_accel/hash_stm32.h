@@ -28,6 +28,7 @@
 /* Includes ------------------------------------------------------------------*/
 /* include the appropriate header file */
 #include "stm32u5xx_hal.h"
+#include "mbedtls/error.h"
 
 #if defined(MBEDTLS_THREADING_C)
 #include "mbedtls/threading.h"
@@ -38,17 +39,66 @@
 #define ST_HASH_TIMEOUT ((uint32_t) 1000)  /* TO in ms for the hash processor */
 
 /* defines -------------------------------------------------------------------*/
-/* variables -----------------------------------------------------------------*/
-#if defined(MBEDTLS_THREADING_C)
-extern mbedtls_threading_mutex_t hash_mutex;
-extern unsigned char hash_mutex_started;
-#endif /* MBEDTLS_THREADING_C */
+/* Feed large updates to the HASH with GPDMA1 channel 2 while the calling    */
+/* task sleeps. Set to 0 to always write the input with the CPU.             */
+#ifndef ST_HASH_DMA_ENABLE
+#define ST_HASH_DMA_ENABLE      1
+#endif
+
+/* Shorter runs of blocks are written by the CPU                             */
+#ifndef ST_HASH_DMA_MIN_LEN
+#define ST_HASH_DMA_MIN_LEN     1024U
+#endif
 
-extern unsigned int hash_context_count;
+/* Index of the task notification used to signal the DMA completion         */
+#ifndef ST_HASH_DMA_NOTIFY_IDX
+#define ST_HASH_DMA_NOTIFY_IDX  6
+#endif
 
+/* variables -----------------------------------------------------------------*/
 /* functions prototypes ------------------------------------------------------*/
 extern void hash_zeroize(void *v, size_t n);
 
+/* Serialize the use of the Hash Hw between tasks. Return 0 or               */
+/* MBEDTLS_ERR_THREADING_MUTEX_ERROR. The lock is not recursive.             */
+extern int hash_lock(void);
+extern int hash_unlock(void);
+
+/* The Hw keeps the state of the last context that used it. It is only      */
+/* saved to that context's ctx_save_regs when another context takes the Hw, */
+/* so a single active context never pays for the save / restore. All the    */
+/* functions below are called with the Hash Hw locked.                      */
+
+/* Make the Hw hold the state of hhash. restore is 0 when the context has   */
+/* just been started and has no state to restore yet.                       */
+extern void hash_select(HASH_HandleTypeDef *hhash, uint8_t *save_regs,
+                        int restore);
+
+/* hhash no longer needs its Hw state (digest read or context freed). Must  */
+/* be called before the context memory is released.                         */
+extern void hash_forget(HASH_HandleTypeDef *hhash);
+
+/* Copy the state of hhash into save_regs when the Hw holds it (clone)      */
+extern void hash_save_if_loaded(HASH_HandleTypeDef *hhash, uint8_t *save_regs);
+
+#if (ST_HASH_DMA_ENABLE == 1)
+/* HAL_HASH*_Start_DMA of the algorithm of the context                      */
+typedef HAL_StatusTypeDef (*hash_dma_start_t)(HASH_HandleTypeDef *hhash,
+                                              uint8_t *pInBuffer,
+                                              uint32_t Size);
+
+/* Return 1 if length bytes at input can be fed by the DMA: enough data,    */
+/* called from a task and not in a memory cached by DCACHE1.                */
+extern int hash_dma_usable(const unsigned char *input, size_t length);
+
+/* Accumulate length bytes, a multiple of the block size, with the DMA. The */
+/* Hw must hold the state of hhash.                                          */
+extern HAL_StatusTypeDef hash_dma_accumulate(HASH_HandleTypeDef *hhash,
+                                             hash_dma_start_t start,
+                                             const unsigned char *input,
+                                             size_t length);
+#endif /* ST_HASH_DMA_ENABLE */
+
 #ifdef __cplusplus
 }
 #endif
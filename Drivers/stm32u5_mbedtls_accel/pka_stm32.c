@@ -0,0 +1,436 @@
+/*
+ *  Copyright (C) 2006-2015, ARM Limited, All Rights Reserved
+ *  Copyright (C) 2019-2020 STMicroelectronics, All Rights Reserved
+ *  SPDX-License-Identifier: Apache-2.0
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License"); you may
+ *  not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *  http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS, WITHOUT
+ *  WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *
+ *  This file implements ST shared PKA services based on API from mbed TLS
+ */
+
+/* Includes ------------------------------------------------------------------*/
+#include "mbedtls/build_info.h"
+
+#if defined(MBEDTLS_ECDSA_VERIFY_ALT) || defined(MBEDTLS_ECDH_GEN_PUBLIC_ALT) || \
+    defined(MBEDTLS_ECDH_COMPUTE_SHARED_ALT) || defined(MBEDTLS_ECDSA_SIGN_ALT) || \
+    defined(MBEDTLS_ECP_ALT) || defined(MBEDTLS_RSA_ALT)
+
+#include "pka_stm32.h"
+#include "mbedtls/platform_util.h"
+
+#include <string.h>
+
+#if (ST_PKA_IT_ENABLE == 1)
+#include "FreeRTOS.h"
+#include "task.h"
+#endif /* ST_PKA_IT_ENABLE */
+
+/* Variables -----------------------------------------------------------------*/
+/* Mutex protection because of one PKA Hw instance is shared over ECDSA, ECDH */
+/* ECP and RSA and all the TLS contexts. It is created on first use and never */
+/* freed.                                                                     */
+#if defined(MBEDTLS_THREADING_C)
+static mbedtls_threading_mutex_t pka_mutex;
+static volatile unsigned char pka_mutex_started = 0;
+#endif /* MBEDTLS_THREADING_C */
+
+static PKA_HandleTypeDef pka_handle;
+
+/* Parameters of the last curve used, a TLS session uses a single curve */
+static pka_curve pka_curve_cache;
+
+#if (ST_PKA_IT_ENABLE == 1)
+/* The PKA interrupt vector is installed on first use */
+static int pka_it_ready = 0;
+
+/* Task waiting for the end of the current operation */
+static TaskHandle_t volatile pka_task = NULL;
+
+/* Result of the current operation, written by the HAL callbacks */
+static volatile HAL_StatusTypeDef pka_result = HAL_OK;
+#endif /* ST_PKA_IT_ENABLE */
+
+/* Functions -----------------------------------------------------------------*/
+
+/* Take exclusive use of the PKA Hw */
+int pka_lock(void)
+{
+#if defined(MBEDTLS_THREADING_C)
+    if (!pka_mutex_started)
+    {
+        __disable_irq();
+        /* mutex cannot be initialized twice */
+        if (!pka_mutex_started)
+        {
+            mbedtls_mutex_init(&pka_mutex);
+            pka_mutex_started = 1;
+        }
+        __enable_irq();
+    }
+
+    if (mbedtls_mutex_lock(&pka_mutex) != 0)
+        return (MBEDTLS_ERR_THREADING_MUTEX_ERROR);
+#endif /* MBEDTLS_THREADING_C */
+
+    return (0);
+}
+
+/* Release the PKA Hw taken by pka_lock */
+int pka_unlock(void)
+{
+#if defined(MBEDTLS_THREADING_C)
+    if (mbedtls_mutex_unlock(&pka_mutex) != 0)
+        return (MBEDTLS_ERR_THREADING_MUTEX_ERROR);
+#endif /* MBEDTLS_THREADING_C */
+
+    return (0);
+}
+
+#if defined(MBEDTLS_ECP_C)
+const pka_curve *pka_curve_get(const mbedtls_ecp_group *grp)
+{
+    pka_curve *curve = &pka_curve_cache;
+    size_t olen;
+    uint8_t G_binary[(2U * ST_PKA_MAX_MODULUS_SIZE) + 1U];
+    int ret = 0;
+
+    if ((grp->id != MBEDTLS_ECP_DP_SECP256R1) &&
+        (grp->id != MBEDTLS_ECP_DP_SECP384R1))
+        return (NULL);
+
+    if (curve->id == grp->id)
+        return (curve);
+
+    curve->id = MBEDTLS_ECP_DP_NONE;
+    curve->modulus_size = mbedtls_mpi_size(&grp->P);
+    curve->order_size = mbedtls_mpi_size(&grp->N);
+
+    if ((curve->modulus_size > ST_PKA_MAX_MODULUS_SIZE) ||
+        (curve->order_size > ST_PKA_MAX_MODULUS_SIZE))
+        return (NULL);
+
+    MBEDTLS_MPI_CHK(mbedtls_mpi_write_binary(&grp->P, curve->p, curve->modulus_size));
+    MBEDTLS_MPI_CHK(mbedtls_mpi_write_binary(&grp->B, curve->b, curve->modulus_size));
+    MBEDTLS_MPI_CHK(mbedtls_mpi_write_binary(&grp->N, curve->n, curve->order_size));
+
+    /* mbed TLS leaves A unset when it is -3, as for the NIST curves */
+    if (mbedtls_mpi_cmp_int(&grp->A, 0) == 0) {
+        curve->a_sign = 1U;
+        memset(curve->a_abs, 0, curve->modulus_size);
+        curve->a_abs[curve->modulus_size - 1U] = 3U;
+    } else {
+        curve->a_sign = 0U;
+        MBEDTLS_MPI_CHK(mbedtls_mpi_write_binary(&grp->A, curve->a_abs, curve->modulus_size));
+    }
+
+    MBEDTLS_MPI_CHK(mbedtls_ecp_point_write_binary(grp, &grp->G, MBEDTLS_ECP_PF_UNCOMPRESSED,
+                                                   &olen, G_binary, sizeof(G_binary)));
+    memcpy(curve->gx, G_binary + 1U, curve->modulus_size);
+    memcpy(curve->gy, G_binary + curve->modulus_size + 1U, curve->modulus_size);
+
+    curve->id = grp->id;
+
+cleanup:
+    return (ret == 0) ? curve : NULL;
+}
+#endif /* MBEDTLS_ECP_C */
+
+#if (ST_PKA_IT_ENABLE == 1)
+static void pka_irq_handler(void)
+{
+    HAL_PKA_IRQHandler(&pka_handle);
+}
+
+static void pka_complete(HAL_StatusTypeDef result)
+{
+    BaseType_t higher_priority_task_woken = pdFALSE;
+
+    pka_result = result;
+
+    if (pka_task != NULL) {
+        vTaskNotifyGiveIndexedFromISR(pka_task, ST_PKA_NOTIFY_IDX,
+                                      &higher_priority_task_woken);
+        portYIELD_FROM_ISR(higher_priority_task_woken);
+    }
+}
+
+void HAL_PKA_OperationCpltCallback(PKA_HandleTypeDef *hpka)
+{
+    (void) hpka;
+    pka_complete(HAL_OK);
+}
+
+void HAL_PKA_ErrorCallback(PKA_HandleTypeDef *hpka)
+{
+    (void) hpka;
+    pka_complete(HAL_ERROR);
+}
+#endif /* ST_PKA_IT_ENABLE */
+
+PKA_HandleTypeDef *pka_begin(void)
+{
+    /* Enable HW peripheral clock */
+    __HAL_RCC_PKA_CLK_ENABLE();
+
+    /* Initialize HW peripheral */
+    pka_handle.Instance = PKA;
+
+    if (HAL_PKA_Init(&pka_handle) != HAL_OK) {
+        pka_end();
+        return (NULL);
+    }
+
+    /* Reset PKA RAM */
+    HAL_PKA_RAMReset(&pka_handle);
+
+#if (ST_PKA_IT_ENABLE == 1)
+    if (!pka_it_ready) {
+        NVIC_SetVector(PKA_IRQn, (uint32_t) pka_irq_handler);
+        HAL_NVIC_SetPriority(PKA_IRQn, 5, 0);
+        HAL_NVIC_EnableIRQ(PKA_IRQn);
+        pka_it_ready = 1;
+    }
+#endif /* ST_PKA_IT_ENABLE */
+
+    return (&pka_handle);
+}
+
+void pka_end(void)
+{
+    /* De-initialize HW peripheral */
+    HAL_PKA_DeInit(&pka_handle);
+
+    /* Disable HW peripheral clock */
+    __HAL_RCC_PKA_CLK_DISABLE();
+}
+
+int pka_acquire(PKA_HandleTypeDef **hpka)
+{
+    int ret;
+
+    *hpka = NULL;
+
+    ret = pka_lock();
+    if (ret != 0)
+        return (ret);
+
+    *hpka = pka_begin();
+    if (*hpka == NULL) {
+        (void) pka_unlock();
+        return (MBEDTLS_ERR_PLATFORM_HW_ACCEL_FAILED);
+    }
+
+    return (0);
+}
+
+int pka_release(int ret)
+{
+    pka_end();
+
+    if ((pka_unlock() != 0) && (ret == 0))
+        ret = MBEDTLS_ERR_THREADING_MUTEX_ERROR;
+
+    return (ret);
+}
+
+static HAL_StatusTypeDef pka_start_polled(PKA_HandleTypeDef *hpka, pka_op op,
+                                          void *in)
+{
+    switch (op) {
+    case PKA_OP_ECDSA_VERIF:
+        return HAL_PKA_ECDSAVerif(hpka, (PKA_ECDSAVerifInTypeDef *) in, ST_PKA_TIMEOUT);
+    case PKA_OP_ECDSA_SIGN:
+        return HAL_PKA_ECDSASign(hpka, (PKA_ECDSASignInTypeDef *) in, ST_PKA_TIMEOUT);
+    case PKA_OP_POINT_CHECK:
+        return HAL_PKA_PointCheck(hpka, (PKA_PointCheckInTypeDef *) in, ST_PKA_TIMEOUT);
+    case PKA_OP_ECC_MUL:
+        return HAL_PKA_ECCMul(hpka, (PKA_ECCMulInTypeDef *) in, ST_PKA_TIMEOUT);
+    case PKA_OP_MUL:
+        return HAL_PKA_Mul(hpka, (PKA_MulInTypeDef *) in, ST_PKA_TIMEOUT);
+    case PKA_OP_MODEXP:
+        return HAL_PKA_ModExp(hpka, (PKA_ModExpInTypeDef *) in, ST_PKA_TIMEOUT);
+    case PKA_OP_RSA_CRT_EXP:
+        return HAL_PKA_RSACRTExp(hpka, (PKA_RSACRTExpInTypeDef *) in, ST_PKA_TIMEOUT);
+    default:
+        return HAL_ERROR;
+    }
+}
+
+#if (ST_PKA_IT_ENABLE == 1)
+static HAL_StatusTypeDef pka_start_it(PKA_HandleTypeDef *hpka, pka_op op,
+                                      void *in)
+{
+    switch (op) {
+    case PKA_OP_ECDSA_VERIF:
+        return HAL_PKA_ECDSAVerif_IT(hpka, (PKA_ECDSAVerifInTypeDef *) in);
+    case PKA_OP_ECDSA_SIGN:
+        return HAL_PKA_ECDSASign_IT(hpka, (PKA_ECDSASignInTypeDef *) in);
+    case PKA_OP_POINT_CHECK:
+        return HAL_PKA_PointCheck_IT(hpka, (PKA_PointCheckInTypeDef *) in);
+    case PKA_OP_ECC_MUL:
+        return HAL_PKA_ECCMul_IT(hpka, (PKA_ECCMulInTypeDef *) in);
+    case PKA_OP_MUL:
+        return HAL_PKA_Mul_IT(hpka, (PKA_MulInTypeDef *) in);
+    case PKA_OP_MODEXP:
+        return HAL_PKA_ModExp_IT(hpka, (PKA_ModExpInTypeDef *) in);
+    case PKA_OP_RSA_CRT_EXP:
+        return HAL_PKA_RSACRTExp_IT(hpka, (PKA_RSACRTExpInTypeDef *) in);
+    default:
+        return HAL_ERROR;
+    }
+}
+#endif /* ST_PKA_IT_ENABLE */
+
+HAL_StatusTypeDef pka_run(PKA_HandleTypeDef *hpka, pka_op op, void *in)
+{
+    HAL_StatusTypeDef hal_ret;
+
+#if (ST_PKA_IT_ENABLE == 1)
+    if ((xTaskGetSchedulerState() == taskSCHEDULER_RUNNING) &&
+        (xPortIsInsideInterrupt() == pdFALSE)) {
+        pka_task = xTaskGetCurrentTaskHandle();
+        pka_result = HAL_ERROR;
+        (void) xTaskNotifyStateClearIndexed(NULL, ST_PKA_NOTIFY_IDX);
+        (void) ulTaskNotifyValueClearIndexed(NULL, ST_PKA_NOTIFY_IDX, 0xFFFFFFFFUL);
+
+        hal_ret = pka_start_it(hpka, op, in);
+
+        if (hal_ret == HAL_OK) {
+            if (ulTaskNotifyTakeIndexed(ST_PKA_NOTIFY_IDX, pdTRUE,
+                                        pdMS_TO_TICKS(ST_PKA_TIMEOUT)) == 0) {
+                (void) HAL_PKA_Abort(hpka);
+                hal_ret = HAL_TIMEOUT;
+            } else {
+                hal_ret = pka_result;
+            }
+        }
+
+        pka_task = NULL;
+
+        return (hal_ret);
+    }
+#endif /* ST_PKA_IT_ENABLE */
+
+    hal_ret = pka_start_polled(hpka, op, in);
+
+    return (hal_ret);
+}
+
+#if defined(MBEDTLS_ECP_C)
+int pka_point_check(const mbedtls_ecp_group *grp,
+                    const pka_curve *curve,
+                    const mbedtls_ecp_point *pt,
+                    uint8_t *pt_binary)
+{
+    int ret = 0;
+    size_t olen;
+    size_t size = curve->modulus_size;
+    PKA_HandleTypeDef *hpka;
+    PKA_PointCheckInTypeDef ECC_PointCheck = {0};
+
+    /* The point at infinity is written as a single byte */
+    MBEDTLS_MPI_CHK(mbedtls_ecp_point_write_binary(grp, pt, MBEDTLS_ECP_PF_UNCOMPRESSED,
+                                                   &olen, pt_binary, (2U * size) + 1U));
+    if (olen != (2U * size) + 1U)
+        return (MBEDTLS_ERR_ECP_INVALID_KEY);
+
+    /* Coordinates must be reduced (SEC1 3.2.2.1), compared as big endian */
+    if ((memcmp(pt_binary + 1U, curve->p, size) >= 0) ||
+        (memcmp(pt_binary + size + 1U, curve->p, size) >= 0))
+        return (MBEDTLS_ERR_ECP_INVALID_KEY);
+
+    /* Set HW peripheral Input parameter: curve coefs */
+    ECC_PointCheck.modulusSize = size;
+    ECC_PointCheck.modulus     = curve->p;
+    ECC_PointCheck.coefSign    = curve->a_sign;
+    ECC_PointCheck.coefA       = curve->a_abs;
+    ECC_PointCheck.coefB       = curve->b;
+
+    /* Set HW peripheral input parameter: coordinates of point to check */
+    ECC_PointCheck.pointX = pt_binary + 1U;
+    ECC_PointCheck.pointY = pt_binary + size + 1U;
+
+    hpka = pka_begin();
+    if (hpka == NULL)
+        return (MBEDTLS_ERR_PLATFORM_HW_ACCEL_FAILED);
+
+    /* Launch the point check */
+    MBEDTLS_MPI_CHK((pka_run(hpka, PKA_OP_POINT_CHECK, &ECC_PointCheck) != HAL_OK) ? MBEDTLS_ERR_PLATFORM_HW_ACCEL_FAILED : 0);
+
+    /* Get the result of the point check */
+    if (HAL_PKA_PointCheck_IsOnCurve(hpka) != 1U)
+        ret = MBEDTLS_ERR_ECP_INVALID_KEY;
+
+cleanup:
+    pka_end();
+
+    return (ret);
+}
+
+int pka_ecc_mul(const pka_curve *curve, const mbedtls_mpi *m,
+                const uint8_t *P_binary, uint8_t *R_binary)
+{
+    int ret = 0;
+    size_t size = curve->modulus_size;
+    uint8_t m_binary[ST_PKA_MAX_MODULUS_SIZE];
+    PKA_HandleTypeDef *hpka;
+    PKA_ECCMulInTypeDef ECC_MulIn = {0};
+    PKA_ECCMulOutTypeDef ECC_MulOut;
+
+    /* The scalar is always passed on the size of the order, so that the    */
+    /* duration does not depend on the number of leading zero bytes of a    */
+    /* private key                                                          */
+    MBEDTLS_MPI_CHK(mbedtls_mpi_write_binary(m, m_binary, curve->order_size));
+    ECC_MulIn.scalarMulSize = curve->order_size;
+    ECC_MulIn.scalarMul     = m_binary;
+
+    /* Set HW peripheral Input parameter: curve coefs */
+    ECC_MulIn.modulusSize = size;
+    ECC_MulIn.coefSign    = curve->a_sign;
+    ECC_MulIn.coefA       = curve->a_abs;
+    ECC_MulIn.coefB       = curve->b;
+    ECC_MulIn.modulus     = curve->p;
+    ECC_MulIn.primeOrder  = curve->n;
+
+    /* Set HW peripheral input parameter: coordinates of P point */
+    ECC_MulIn.pointX = P_binary + 1U;
+    ECC_MulIn.pointY = P_binary + size + 1U;
+
+    hpka = pka_begin();
+    if (hpka == NULL) {
+        ret = MBEDTLS_ERR_PLATFORM_HW_ACCEL_FAILED;
+        goto cleanup;
+    }
+
+    /* Launch the scalar multiplication */
+    if (pka_run(hpka, PKA_OP_ECC_MUL, &ECC_MulIn) == HAL_OK) {
+        /* Get the scalar multiplication result */
+        ECC_MulOut.ptX = R_binary + 1U;
+        ECC_MulOut.ptY = R_binary + size + 1U;
+        HAL_PKA_ECCMul_GetResult(hpka, &ECC_MulOut);
+        R_binary[0] = 0x04U;
+    } else {
+        ret = MBEDTLS_ERR_PLATFORM_HW_ACCEL_FAILED;
+    }
+
+    pka_end();
+
+cleanup:
+    mbedtls_platform_zeroize(m_binary, sizeof(m_binary));
+
+    return (ret);
+}
+
+#endif /* MBEDTLS_ECP_C */
+
+#endif /* MBEDTLS_ECDSA_xxx_ALT or MBEDTLS_ECDH_xxx_ALT or MBEDTLS_ECP_ALT or MBEDTLS_RSA_ALT */
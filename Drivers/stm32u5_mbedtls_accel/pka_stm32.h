@@ -0,0 +1,143 @@
+/**
+  ******************************************************************************
+  * @brief   Header file of mbed TLS HW public key accelerator (PKA) services.
+  ******************************************************************************
+  * @attention
+  *
+  *  Copyright (C) 2006-2015, ARM Limited, All Rights Reserved
+  *  Copyright (C) 2019-2020 STMicroelectronics, All Rights Reserved
+  *
+  * This software component is licensed by ST under Apache 2.0 license,
+  * the "License"; You may not use this file except in compliance with the
+  * License. You may obtain a copy of the License at:
+  * https://opensource.org/licenses/Apache-2.0
+  *
+  ******************************************************************************
+  */
+
+/* Define to prevent recursive inclusion -------------------------------------*/
+#ifndef __PKA_H
+#define __PKA_H
+
+#if defined(MBEDTLS_ECDSA_VERIFY_ALT) || defined(MBEDTLS_ECDH_GEN_PUBLIC_ALT) || \
+    defined(MBEDTLS_ECDH_COMPUTE_SHARED_ALT) || defined(MBEDTLS_ECDSA_SIGN_ALT) || \
+    defined(MBEDTLS_ECP_ALT) || defined(MBEDTLS_RSA_ALT)
+
+#ifdef __cplusplus
+ extern "C" {
+#endif
+
+/* Includes ------------------------------------------------------------------*/
+/* include the appropriate header file */
+#include "stm32u5xx_hal.h"
+#include "mbedtls/error.h"
+#include "mbedtls/ecp.h"
+
+#if defined(MBEDTLS_THREADING_C)
+#include "mbedtls/threading.h"
+#endif
+
+/* macros --------------------------------------------------------------------*/
+/* constants -----------------------------------------------------------------*/
+#define ST_PKA_TIMEOUT    5000U  /* timeout (in ms) for one PKA operation     */
+
+/* Largest modulus handled by the Hw services, in bytes (P-384)              */
+#define ST_PKA_MAX_MODULUS_SIZE  48U
+
+/* defines -------------------------------------------------------------------*/
+/* The calling task sleeps until the PKA raises its end of operation         */
+/* interrupt. Set to 0 to always poll the peripheral.                        */
+#ifndef ST_PKA_IT_ENABLE
+#define ST_PKA_IT_ENABLE        1
+#endif
+
+/* Index of the task notification used to signal the end of operation       */
+#ifndef ST_PKA_NOTIFY_IDX
+#define ST_PKA_NOTIFY_IDX       5
+#endif
+
+/* typedef -------------------------------------------------------------------*/
+/* Domain parameters of a curve in the big endian layout of the PKA RAM      */
+typedef struct
+{
+    mbedtls_ecp_group_id id;
+    uint32_t modulus_size;       /*!< Number of bytes in prime modulus */
+    uint32_t order_size;         /*!< Number of bytes in prime order   */
+    uint32_t a_sign;             /*!< Sign of A coef                   */
+    uint8_t p[ST_PKA_MAX_MODULUS_SIZE];
+    uint8_t a_abs[ST_PKA_MAX_MODULUS_SIZE];
+    uint8_t b[ST_PKA_MAX_MODULUS_SIZE];
+    uint8_t gx[ST_PKA_MAX_MODULUS_SIZE];
+    uint8_t gy[ST_PKA_MAX_MODULUS_SIZE];
+    uint8_t n[ST_PKA_MAX_MODULUS_SIZE];
+}
+pka_curve;
+
+/* Operations run by pka_run */
+typedef enum
+{
+    PKA_OP_ECDSA_VERIF,          /*!< in is a PKA_ECDSAVerifInTypeDef  */
+    PKA_OP_ECDSA_SIGN,           /*!< in is a PKA_ECDSASignInTypeDef   */
+    PKA_OP_POINT_CHECK,          /*!< in is a PKA_PointCheckInTypeDef  */
+    PKA_OP_ECC_MUL,              /*!< in is a PKA_ECCMulInTypeDef      */
+    PKA_OP_MUL,                  /*!< in is a PKA_MulInTypeDef         */
+    PKA_OP_MODEXP,               /*!< in is a PKA_ModExpInTypeDef      */
+    PKA_OP_RSA_CRT_EXP           /*!< in is a PKA_RSACRTExpInTypeDef   */
+}
+pka_op;
+
+/* functions prototypes ------------------------------------------------------*/
+/* Serialize the use of the PKA Hw between tasks. Return 0 or                */
+/* MBEDTLS_ERR_THREADING_MUTEX_ERROR. The lock is not recursive.             */
+extern int pka_lock(void);
+extern int pka_unlock(void);
+
+#if defined(MBEDTLS_ECP_C)
+/* Return the parameters of grp, or NULL when the Hw services do not cover  */
+/* the curve (only NIST P-256 and P-384) and the caller must fall back to   */
+/* software. Called with the PKA Hw locked, the result is valid until       */
+/* pka_unlock.                                                              */
+extern const pka_curve *pka_curve_get(const mbedtls_ecp_group *grp);
+#endif /* MBEDTLS_ECP_C */
+
+/* Power up the Hw and clear its RAM. Return the handle or NULL on error.   */
+extern PKA_HandleTypeDef *pka_begin(void);
+
+/* Power down the Hw after the results have been read */
+extern void pka_end(void);
+
+/* pka_lock followed by pka_begin, for a single operation. Return 0 and    */
+/* the handle in *hpka, or an error and NULL when there is nothing to      */
+/* release.                                                                */
+extern int pka_acquire(PKA_HandleTypeDef **hpka);
+
+/* pka_end followed by pka_unlock. Return ret, or                          */
+/* MBEDTLS_ERR_THREADING_MUTEX_ERROR when ret is 0 and the unlock failed.  */
+extern int pka_release(int ret);
+
+/* Run one operation. The calling task blocks on ST_PKA_NOTIFY_IDX until    */
+/* the end of operation interrupt. Before the scheduler runs, or from an    */
+/* interrupt, the Hw is polled instead.                                     */
+extern HAL_StatusTypeDef pka_run(PKA_HandleTypeDef *hpka, pka_op op, void *in);
+
+#if defined(MBEDTLS_ECP_C)
+/* Write pt as an uncompressed point (0x04 || X || Y) and check that it is  */
+/* a valid public key of the curve. Return 0,                               */
+/* MBEDTLS_ERR_ECP_INVALID_KEY or MBEDTLS_ERR_PLATFORM_HW_ACCEL_FAILED.     */
+extern int pka_point_check(const mbedtls_ecp_group *grp,
+                           const pka_curve *curve,
+                           const mbedtls_ecp_point *pt,
+                           uint8_t *pt_binary);
+
+/* R_binary = m * P_binary, both uncompressed points of                     */
+/* 2 * modulus_size + 1 bytes. m must be in range 1..n-1.                   */
+extern int pka_ecc_mul(const pka_curve *curve, const mbedtls_mpi *m,
+                       const uint8_t *P_binary, uint8_t *R_binary);
+#endif /* MBEDTLS_ECP_C */
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* MBEDTLS_ECDSA_xxx_ALT or MBEDTLS_ECDH_xxx_ALT or MBEDTLS_ECP_ALT or MBEDTLS_RSA_ALT */
+#endif /*__PKA_H */
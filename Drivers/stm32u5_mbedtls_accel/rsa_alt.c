@@ -75,6 +75,8 @@
 
 #if defined(MBEDTLS_RSA_ALT)
 
+#include "pka_stm32.h"
+
 /* Parameter validation macros */
 #define RSA_VALIDATE_RET( cond )                                       \
     MBEDTLS_INTERNAL_VALIDATE_RET( cond, MBEDTLS_ERR_RSA_BAD_INPUT_DATA )
@@ -83,7 +85,6 @@
 
 /* Private typedef -----------------------------------------------------------*/
 /* Private define ------------------------------------------------------------*/
-#define ST_PKA_TIMEOUT 5000      /* 5s timeout for the Public key accelerator */
 
 /* Private macro -------------------------------------------------------------*/
 /*
@@ -120,7 +121,7 @@ static int rsa_pka_arithmetic_mul( const unsigned char *A,
     RSA_VALIDATE_RET( AxB != NULL );
 
     int ret = 0;
-    PKA_HandleTypeDef hpka = {0};
+    PKA_HandleTypeDef *hpka = NULL;
     PKA_MulInTypeDef in = {0};
     uint32_t *input_A = NULL;
     uint32_t *input_B = NULL;
@@ -147,26 +148,18 @@ static int rsa_pka_arithmetic_mul( const unsigned char *A,
     in.pOp1 = input_A;
     in.pOp2 = input_B;
 
-    /* Enable HW peripheral clock */
-    __HAL_RCC_PKA_CLK_ENABLE();
-
-    /* Initialize HW peripheral */
-    hpka.Instance = PKA;
-    MBEDTLS_MPI_CHK( ( HAL_PKA_Init( &hpka ) != HAL_OK ) ? MBEDTLS_ERR_PLATFORM_HW_ACCEL_FAILED : 0 );
-
-    /* Reset PKA RAM */
-    HAL_PKA_RAMReset(&hpka);
+    /* Take the PKA Hw, shared by the ECDSA, ECDH, ECP and RSA services, */
+    /* and initialize it                                                 */
+    MBEDTLS_MPI_CHK( pka_acquire( &hpka ) );
 
-    MBEDTLS_MPI_CHK( ( HAL_PKA_Mul(&hpka, &in, ST_PKA_TIMEOUT) != HAL_OK ) ? MBEDTLS_ERR_PLATFORM_HW_ACCEL_FAILED : 0 );
+    MBEDTLS_MPI_CHK( ( pka_run( hpka, PKA_OP_MUL, &in ) != HAL_OK ) ? MBEDTLS_ERR_PLATFORM_HW_ACCEL_FAILED : 0 );
 
-    HAL_PKA_Arithmetic_GetResult( &hpka, (uint32_t *)AxB );
+    HAL_PKA_Arithmetic_GetResult( hpka, (uint32_t *)AxB );
 
 cleanup:
-    /* De-initialize HW peripheral */
-    HAL_PKA_DeInit( &hpka );
-
-    /* Disable HW peripheral clock */
-    __HAL_RCC_PKA_CLK_DISABLE();
+    /* De-initialize and release the PKA Hw */
+    if( hpka != NULL )
+        ret = pka_release( ret );
 
     if (input_A != NULL)
     {
@@ -266,7 +259,7 @@ static int rsa_pka_modexp( mbedtls_rsa_context *ctx,
     int ret = 0;
     size_t nlen;
     size_t elen;
-    PKA_HandleTypeDef hpka = {0};
+    PKA_HandleTypeDef *hpka = NULL;
     PKA_ModExpInTypeDef in = {0};
     uint8_t *e_binary = NULL;
     uint8_t *n_binary = NULL;
@@ -302,28 +295,20 @@ static int rsa_pka_modexp( mbedtls_rsa_context *ctx,
     in.pExp    = e_binary;       /* Exponent */
     in.pMod    = n_binary;       /* modulus */
 
-    /* Enable HW peripheral clock */
-    __HAL_RCC_PKA_CLK_ENABLE();
-
-    /* Initialize HW peripheral */
-    hpka.Instance = PKA;
-    MBEDTLS_MPI_CHK( ( HAL_PKA_Init( &hpka ) != HAL_OK ) ? MBEDTLS_ERR_PLATFORM_HW_ACCEL_FAILED : 0 );
-
-    /* Reset PKA RAM */
-    HAL_PKA_RAMReset(&hpka);
+    /* Take the PKA Hw, shared by the ECDSA, ECDH, ECP and RSA services, */
+    /* and initialize it                                                 */
+    MBEDTLS_MPI_CHK( pka_acquire( &hpka ) );
 
     /* output = input ^ e_binary mod n */
-    MBEDTLS_MPI_CHK( ( HAL_PKA_ModExp( &hpka, &in, ST_PKA_TIMEOUT ) != HAL_OK ) ? MBEDTLS_ERR_PLATFORM_HW_ACCEL_FAILED : 0 );
+    MBEDTLS_MPI_CHK( ( pka_run( hpka, PKA_OP_MODEXP, &in ) != HAL_OK ) ? MBEDTLS_ERR_PLATFORM_HW_ACCEL_FAILED : 0 );
 
-    HAL_PKA_ModExp_GetResult( &hpka, (uint8_t *)output );
+    HAL_PKA_ModExp_GetResult( hpka, (uint8_t *)output );
 
 cleanup:
 
-    /* De-initialize HW peripheral */
-    HAL_PKA_DeInit( &hpka );
-
-    /* Disable HW peripheral clock */
-    __HAL_RCC_PKA_CLK_DISABLE();
+    /* De-initialize and release the PKA Hw */
+    if( hpka != NULL )
+        ret = pka_release( ret );
 
     if (e_binary != NULL)
     {
@@ -374,7 +359,7 @@ static int rsa_crt_pka_modexp( const mbedtls_mpi *dp,
            plen,
            qlen,
            qplen;
-    PKA_HandleTypeDef hpka = {0};
+    PKA_HandleTypeDef *hpka = NULL;
     PKA_RSACRTExpInTypeDef in = {0};
     uint8_t *dp_binary = NULL;
     uint8_t *dq_binary = NULL;
@@ -415,27 +400,19 @@ static int rsa_crt_pka_modexp( const mbedtls_mpi *dp,
     in.pPrimeQ = q_binary;
     in.popA    = input;
 
-    /* Enable HW peripheral clock */
-    __HAL_RCC_PKA_CLK_ENABLE();
-
-    /* Initialize HW peripheral */
-    hpka.Instance = PKA;
-    MBEDTLS_MPI_CHK( ( HAL_PKA_Init( &hpka ) != HAL_OK ) ? MBEDTLS_ERR_PLATFORM_HW_ACCEL_FAILED : 0 );
+    /* Take the PKA Hw, shared by the ECDSA, ECDH, ECP and RSA services, */
+    /* and initialize it                                                 */
+    MBEDTLS_MPI_CHK( pka_acquire( &hpka ) );
 
-    /* Reset PKA RAM */
-    HAL_PKA_RAMReset(&hpka);
+    MBEDTLS_MPI_CHK( ( pka_run( hpka, PKA_OP_RSA_CRT_EXP, &in ) != HAL_OK ) ? MBEDTLS_ERR_PLATFORM_HW_ACCEL_FAILED : 0 );
 
-    MBEDTLS_MPI_CHK( ( HAL_PKA_RSACRTExp( &hpka, &in, ST_PKA_TIMEOUT ) != HAL_OK ) ? MBEDTLS_ERR_PLATFORM_HW_ACCEL_FAILED : 0 );
-
-    HAL_PKA_RSACRTExp_GetResult( &hpka, (uint8_t *)output );
+    HAL_PKA_RSACRTExp_GetResult( hpka, (uint8_t *)output );
 
 cleanup:
 
-    /* De-initialize HW peripheral */
-    HAL_PKA_DeInit( &hpka );
-
-    /* Disable HW peripheral clock */
-    __HAL_RCC_PKA_CLK_DISABLE();
+    /* De-initialize and release the PKA Hw */
+    if( hpka != NULL )
+        ret = pka_release( ret );
 
     if (dp_binary != NULL)
     {
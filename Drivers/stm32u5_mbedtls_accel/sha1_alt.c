@@ -33,6 +33,7 @@
 #include <string.h>
 #include "mbedtls/platform.h"
 #include "mbedtls/platform_util.h"
+#include "hash_stm32.h"
 
 
 /* Private typedef -----------------------------------------------------------*/
@@ -74,134 +75,235 @@ void mbedtls_sha1_free(mbedtls_sha1_context *ctx)
     {
         return;
     }
+
+    if (hash_lock() == 0)
+    {
+        hash_forget(&ctx->hhash);
+        (void) hash_unlock();
+    }
+
     mbedtls_zeroize(ctx, sizeof(mbedtls_sha1_context));
 }
 
 void mbedtls_sha1_clone(mbedtls_sha1_context *dst,
-                          const mbedtls_sha1_context *src)
+                        const mbedtls_sha1_context *src)
 {
     SHA1_VALIDATE( dst != NULL );
     SHA1_VALIDATE( src != NULL );
 
+    if (hash_lock() != 0)
+    {
+        return;
+    }
+
+    /* The Hw may hold the state of the former dst or of src */
+    hash_forget(&dst->hhash);
     *dst = *src;
+    hash_save_if_loaded((HASH_HandleTypeDef *)&src->hhash, dst->ctx_save_regs);
+
+    (void) hash_unlock();
+}
+
+/* Feed len bytes to the Hw, which must be locked with this context selected */
+static int sha1_accumulate(mbedtls_sha1_context *ctx, const uint8_t *data, size_t len)
+{
+    if (HAL_HASH_SHA1_Accmlt(&ctx->hhash, (uint8_t *)data, len) != HAL_OK)
+    {
+        return MBEDTLS_ERR_PLATFORM_HW_ACCEL_FAILED;
+    }
+
+    return 0;
+}
+
+/* Process input that completes at least the buffered block, the Hw must be */
+/* locked with this context selected                                         */
+static int sha1_update_locked(mbedtls_sha1_context *ctx, const unsigned char *input, size_t ilen)
+{
+    int ret;
+    size_t currentlen = ilen;
+    size_t fill = ST_SHA1_BLOCK_SIZE + ctx->first - ctx->sbuf_len;
+
+    /* fill context buffer until ST_SHA1_BLOCK_SIZE bytes, and process it */
+    memcpy(ctx->sbuf + ctx->sbuf_len, input, fill);
+    currentlen -= fill;
+
+    ret = sha1_accumulate(ctx, ctx->sbuf, ST_SHA1_BLOCK_SIZE + ctx->first);
+
+    /* Process following input data with size multiple of ST_SHA1_BLOCK_SIZE bytes */
+    if ((ret == 0) && (currentlen >= ST_SHA1_BLOCK_SIZE))
+    {
+        size_t bulk = (currentlen / ST_SHA1_BLOCK_SIZE) * ST_SHA1_BLOCK_SIZE;
+
+#if (ST_HASH_DMA_ENABLE == 1)
+        if (hash_dma_usable(input + fill, bulk))
+        {
+            ret = hash_dma_accumulate(&ctx->hhash, HAL_HASH_SHA1_Start_DMA, input + fill, bulk);
+            if (ret != HAL_OK)
+            {
+                ret = MBEDTLS_ERR_PLATFORM_HW_ACCEL_FAILED;
+            }
+        }
+        else
+#endif /* ST_HASH_DMA_ENABLE */
+        {
+            ret = sha1_accumulate(ctx, input + fill, bulk);
+        }
+    }
+
+    if (ret == 0)
+    {
+        /* following blocks on 16 words */
+        ctx->first = 0;
+
+        /* Store only the remaining input data up to (ST_SHA1_BLOCK_SIZE - 1) bytes */
+        ctx->sbuf_len = currentlen % ST_SHA1_BLOCK_SIZE;
+        if (ctx->sbuf_len != 0)
+        {
+            memcpy(ctx->sbuf, input + ilen - ctx->sbuf_len, ctx->sbuf_len);
+        }
+    }
+
+    return ret;
 }
 
-int mbedtls_sha1_starts_ret(mbedtls_sha1_context *ctx)
+int mbedtls_sha1_starts(mbedtls_sha1_context *ctx)
 {
+    int ret;
+
     SHA1_VALIDATE_RET( ctx != NULL );
 
+    ret = hash_lock();
+    if (ret != 0)
+    {
+        return ret;
+    }
+
+    /* The Hw digest is reset by the first accumulation */
+    hash_select(&ctx->hhash, ctx->ctx_save_regs, 0);
+
     /* HASH Configuration */
     if (HAL_HASH_DeInit(&ctx->hhash) != HAL_OK)
     {
-        return MBEDTLS_ERR_PLATFORM_HW_ACCEL_FAILED;
+        ret = MBEDTLS_ERR_PLATFORM_HW_ACCEL_FAILED;
     }
-    ctx->hhash.Init.DataType = HASH_DATATYPE_8B;
-    if (HAL_HASH_Init(&ctx->hhash) != HAL_OK)
+    else
     {
-        return MBEDTLS_ERR_PLATFORM_HW_ACCEL_FAILED;
+        ctx->hhash.Init.DataType = HASH_DATATYPE_8B;
+        if (HAL_HASH_Init(&ctx->hhash) != HAL_OK)
+        {
+            ret = MBEDTLS_ERR_PLATFORM_HW_ACCEL_FAILED;
+        }
     }
 
-    /* first block on 17 words */
-    ctx->first = ST_SHA1_EXTRA_BYTES;
+    if (ret == 0)
+    {
+        /* first block on 17 words */
+        ctx->first = ST_SHA1_EXTRA_BYTES;
 
-    ctx->sbuf_len = 0;
+        ctx->sbuf_len = 0;
+    }
 
-    /* save hw context */
-    HAL_HASH_ContextSaving(&ctx->hhash, ctx->ctx_save_regs);
+    if (hash_unlock() != 0)
+    {
+        ret = MBEDTLS_ERR_THREADING_MUTEX_ERROR;
+    }
 
-    return 0;
+    return ret;
 }
 
 int mbedtls_internal_sha1_process( mbedtls_sha1_context *ctx, const unsigned char data[ST_SHA1_BLOCK_SIZE] )
 {
+    int ret;
+
     SHA1_VALIDATE_RET( ctx != NULL );
     SHA1_VALIDATE_RET( (const unsigned char *)data != NULL );
 
-    /* restore hw context */
-    HAL_HASH_ContextRestoring(&ctx->hhash, ctx->ctx_save_regs);
-
-    if (HAL_HASH_SHA1_Accmlt(&ctx->hhash, (uint8_t *) data, ST_SHA1_BLOCK_SIZE) != 0)
+    ret = hash_lock();
+    if (ret != 0)
     {
-        return MBEDTLS_ERR_PLATFORM_HW_ACCEL_FAILED;
+        return ret;
     }
 
-    /* save hw context */
-    HAL_HASH_ContextSaving(&ctx->hhash, ctx->ctx_save_regs);
+    /* load hw context, unless this context was the last one to use it */
+    hash_select(&ctx->hhash, ctx->ctx_save_regs, 1);
 
-    return 0;
+    ret = sha1_accumulate(ctx, data, ST_SHA1_BLOCK_SIZE);
+
+    if (hash_unlock() != 0)
+    {
+        ret = MBEDTLS_ERR_THREADING_MUTEX_ERROR;
+    }
+
+    return ret;
 }
 
-int mbedtls_sha1_update_ret(mbedtls_sha1_context *ctx, const unsigned char *input, size_t ilen)
+int mbedtls_sha1_update(mbedtls_sha1_context *ctx, const unsigned char *input, size_t ilen)
 {
-    size_t currentlen = ilen;
+    int ret;
 
     SHA1_VALIDATE_RET( ctx != NULL );
     SHA1_VALIDATE_RET( ilen == 0 || input != NULL );
 
-    /* restore hw context */
-    HAL_HASH_ContextRestoring(&ctx->hhash, ctx->ctx_save_regs);
-
-    if (currentlen < (ST_SHA1_BLOCK_SIZE + ctx->first - ctx->sbuf_len))
+    if (ilen < (ST_SHA1_BLOCK_SIZE + ctx->first - ctx->sbuf_len))
     {
-        /* only store input data in context buffer */
-        memcpy(ctx->sbuf + ctx->sbuf_len, input, currentlen);
-        ctx->sbuf_len += currentlen;
+        /* only store input data in context buffer, the Hw is not needed */
+        memcpy(ctx->sbuf + ctx->sbuf_len, input, ilen);
+        ctx->sbuf_len += ilen;
+        return 0;
     }
-    else
+
+    ret = hash_lock();
+    if (ret != 0)
     {
-        /* fill context buffer until ST_SHA1_BLOCK_SIZE bytes, and process it */
-        memcpy(ctx->sbuf + ctx->sbuf_len, input, (ST_SHA1_BLOCK_SIZE + ctx->first - ctx->sbuf_len));
-        currentlen -= (ST_SHA1_BLOCK_SIZE + ctx->first - ctx->sbuf_len);
+        return ret;
+    }
 
-        if (HAL_HASH_SHA1_Accmlt(&ctx->hhash, (uint8_t *)(ctx->sbuf), ST_SHA1_BLOCK_SIZE + ctx->first) != 0)
-        {
-            return MBEDTLS_ERR_PLATFORM_HW_ACCEL_FAILED;
-        }
+    /* load hw context, unless this context was the last one to use it */
+    hash_select(&ctx->hhash, ctx->ctx_save_regs, 1);
 
-        /* Process following input data with size multiple of ST_SHA1_BLOCK_SIZE bytes */
-        size_t iter = currentlen / ST_SHA1_BLOCK_SIZE;
-        if (iter != 0)
-        {
-            if (HAL_HASH_SHA1_Accmlt(&ctx->hhash, (uint8_t *)(input + ST_SHA1_BLOCK_SIZE + ctx->first - ctx->sbuf_len), (iter * ST_SHA1_BLOCK_SIZE)) != 0)
-            {
-                return MBEDTLS_ERR_PLATFORM_HW_ACCEL_FAILED;
-            }
-        }
+    ret = sha1_update_locked(ctx, input, ilen);
 
-        /* following blocks on 16 words */
-        ctx->first = 0;
-
-        /* Store only the remaining input data up to (ST_SHA1_BLOCK_SIZE - 1) bytes */
-        ctx->sbuf_len = currentlen % ST_SHA1_BLOCK_SIZE;
-        if (ctx->sbuf_len != 0)
-        {
-            memcpy(ctx->sbuf, input + ilen - ctx->sbuf_len, ctx->sbuf_len);
-        }
+    if (hash_unlock() != 0)
+    {
+        ret = MBEDTLS_ERR_THREADING_MUTEX_ERROR;
     }
 
-    /* save hw context */
-    HAL_HASH_ContextSaving(&ctx->hhash, ctx->ctx_save_regs);
-
-    return 0;
+    return ret;
 }
 
-int mbedtls_sha1_finish_ret(mbedtls_sha1_context *ctx, unsigned char output[32])
+int mbedtls_sha1_finish(mbedtls_sha1_context *ctx, unsigned char output[20])
 {
+    int ret;
+
     SHA1_VALIDATE_RET( ctx != NULL );
     SHA1_VALIDATE_RET( (unsigned char *)output != NULL );
 
-    /* restore hw context */
-    HAL_HASH_ContextRestoring(&ctx->hhash, ctx->ctx_save_regs);
+    ret = hash_lock();
+    if (ret != 0)
+    {
+        return ret;
+    }
+
+    /* load hw context, unless this context was the last one to use it */
+    hash_select(&ctx->hhash, ctx->ctx_save_regs, 1);
 
     /* Last accumulation for pending bytes in sbuf_len, then trig processing and get digest */
-    if (HAL_HASH_SHA1_Accmlt_End(&ctx->hhash, ctx->sbuf, ctx->sbuf_len, output, ST_SHA1_TIMEOUT) != 0)
+    if (HAL_HASH_SHA1_Accmlt_End(&ctx->hhash, ctx->sbuf, ctx->sbuf_len, output, ST_SHA1_TIMEOUT) != HAL_OK)
     {
-        return MBEDTLS_ERR_PLATFORM_HW_ACCEL_FAILED;
+        ret = MBEDTLS_ERR_PLATFORM_HW_ACCEL_FAILED;
     }
 
     ctx->sbuf_len = 0;
 
-    return 0;
+    /* The digest is out, the hw context is of no further use */
+    hash_forget(&ctx->hhash);
+
+    if (hash_unlock() != 0)
+    {
+        ret = MBEDTLS_ERR_THREADING_MUTEX_ERROR;
+    }
+
+    return ret;
 }
 
 #endif /* MBEDTLS_SHA1_ALT*/
@@ -33,6 +33,7 @@
 #include <string.h>
 #include "mbedtls/platform.h"
 #include "mbedtls/platform_util.h"
+#include "hash_stm32.h"
 
 
 /* Private typedef -----------------------------------------------------------*/
@@ -74,6 +75,13 @@ void mbedtls_sha256_free(mbedtls_sha256_context *ctx)
     {
         return;
     }
+
+    if (hash_lock() == 0)
+    {
+        hash_forget(&ctx->hhash);
+        (void) hash_unlock();
+    }
+
     mbedtls_zeroize(ctx, sizeof(mbedtls_sha256_context));
 }
 
@@ -83,174 +91,244 @@ void mbedtls_sha256_clone(mbedtls_sha256_context *dst,
     SHA256_VALIDATE( dst != NULL );
     SHA256_VALIDATE( src != NULL );
 
+    if (hash_lock() != 0)
+    {
+        return;
+    }
+
+    /* The Hw may hold the state of the former dst or of src */
+    hash_forget(&dst->hhash);
     *dst = *src;
+    hash_save_if_loaded((HASH_HandleTypeDef *)&src->hhash, dst->ctx_save_regs);
+
+    (void) hash_unlock();
+}
+
+/* Feed len bytes to the Hw, which must be locked with this context selected */
+static int sha256_accumulate(mbedtls_sha256_context *ctx, const uint8_t *data, size_t len)
+{
+    if (ctx->is224 == 0)
+    {
+        if (HAL_HASHEx_SHA256_Accmlt(&ctx->hhash, (uint8_t *)data, len) != HAL_OK)
+        {
+            return MBEDTLS_ERR_PLATFORM_HW_ACCEL_FAILED;
+        }
+    }
+    else
+    {
+        if (HAL_HASHEx_SHA224_Accmlt(&ctx->hhash, (uint8_t *)data, len) != HAL_OK)
+        {
+            return MBEDTLS_ERR_PLATFORM_HW_ACCEL_FAILED;
+        }
+    }
+
+    return 0;
+}
+
+/* Process input that completes at least the buffered block, the Hw must be */
+/* locked with this context selected                                         */
+static int sha256_update_locked(mbedtls_sha256_context *ctx, const unsigned char *input, size_t ilen)
+{
+    int ret;
+    size_t currentlen = ilen;
+    size_t fill = ST_SHA256_BLOCK_SIZE + ctx->first - ctx->sbuf_len;
+
+    /* fill context buffer until ST_SHA256_BLOCK_SIZE bytes, and process it */
+    memcpy(ctx->sbuf + ctx->sbuf_len, input, fill);
+    currentlen -= fill;
+
+    ret = sha256_accumulate(ctx, ctx->sbuf, ST_SHA256_BLOCK_SIZE + ctx->first);
+
+    /* Process following input data with size multiple of ST_SHA256_BLOCK_SIZE bytes */
+    if ((ret == 0) && (currentlen >= ST_SHA256_BLOCK_SIZE))
+    {
+        size_t bulk = (currentlen / ST_SHA256_BLOCK_SIZE) * ST_SHA256_BLOCK_SIZE;
+
+#if (ST_HASH_DMA_ENABLE == 1)
+        if (hash_dma_usable(input + fill, bulk))
+        {
+            ret = hash_dma_accumulate(&ctx->hhash,
+                                      (ctx->is224 == 0) ? HAL_HASHEx_SHA256_Start_DMA : HAL_HASHEx_SHA224_Start_DMA,
+                                      input + fill, bulk);
+            if (ret != HAL_OK)
+            {
+                ret = MBEDTLS_ERR_PLATFORM_HW_ACCEL_FAILED;
+            }
+        }
+        else
+#endif /* ST_HASH_DMA_ENABLE */
+        {
+            ret = sha256_accumulate(ctx, input + fill, bulk);
+        }
+    }
+
+    if (ret == 0)
+    {
+        /* following blocks on 16 words */
+        ctx->first = 0;
+
+        /* Store only the remaining input data up to (ST_SHA256_BLOCK_SIZE - 1) bytes */
+        ctx->sbuf_len = currentlen % ST_SHA256_BLOCK_SIZE;
+        if (ctx->sbuf_len != 0)
+        {
+            memcpy(ctx->sbuf, input + ilen - ctx->sbuf_len, ctx->sbuf_len);
+        }
+    }
+
+    return ret;
 }
 
-int mbedtls_sha256_starts_ret(mbedtls_sha256_context *ctx, int is224)
+int mbedtls_sha256_starts(mbedtls_sha256_context *ctx, int is224)
 {
+    int ret;
+
     SHA256_VALIDATE_RET( ctx != NULL );
     SHA256_VALIDATE_RET( is224 == 0 || is224 == 1 );
 
+    ret = hash_lock();
+    if (ret != 0)
+    {
+        return ret;
+    }
+
+    /* The Hw digest is reset by the first accumulation */
+    hash_select(&ctx->hhash, ctx->ctx_save_regs, 0);
+
     /* HASH Configuration */
     if (HAL_HASH_DeInit(&ctx->hhash) != HAL_OK)
     {
-        return MBEDTLS_ERR_PLATFORM_HW_ACCEL_FAILED;
+        ret = MBEDTLS_ERR_PLATFORM_HW_ACCEL_FAILED;
     }
-    ctx->hhash.Init.DataType = HASH_DATATYPE_8B;
-    if (HAL_HASH_Init(&ctx->hhash) != HAL_OK)
+    else
     {
-        return MBEDTLS_ERR_PLATFORM_HW_ACCEL_FAILED;
+        ctx->hhash.Init.DataType = HASH_DATATYPE_8B;
+        if (HAL_HASH_Init(&ctx->hhash) != HAL_OK)
+        {
+            ret = MBEDTLS_ERR_PLATFORM_HW_ACCEL_FAILED;
+        }
     }
 
-    ctx->is224 = is224;
+    if (ret == 0)
+    {
+        ctx->is224 = is224;
 
-    /* first block on 17 words */
-    ctx->first = ST_SHA256_EXTRA_BYTES;
+        /* first block on 17 words */
+        ctx->first = ST_SHA256_EXTRA_BYTES;
 
-    ctx->sbuf_len = 0;
+        ctx->sbuf_len = 0;
+    }
 
-#ifdef ST_HW_CONTEXT_SAVING
-    /* save hw context */
-    HAL_HASH_ContextSaving(&ctx->hhash, ctx->ctx_save_regs);
-#endif /* ST_HW_CONTEXT_SAVING */
+    if (hash_unlock() != 0)
+    {
+        ret = MBEDTLS_ERR_THREADING_MUTEX_ERROR;
+    }
 
-    return 0;
+    return ret;
 }
 
 int mbedtls_internal_sha256_process( mbedtls_sha256_context *ctx, const unsigned char data[ST_SHA256_BLOCK_SIZE] )
 {
+    int ret;
+
     SHA256_VALIDATE_RET( ctx != NULL );
     SHA256_VALIDATE_RET( (const unsigned char *)data != NULL );
 
-#ifdef ST_HW_CONTEXT_SAVING
-    /* restore hw context */
-    HAL_HASH_ContextRestoring(&ctx->hhash, ctx->ctx_save_regs);
-#endif /* ST_HW_CONTEXT_SAVING */
-
-    if (ctx->is224 == 0) {
-        if (HAL_HASHEx_SHA256_Accmlt(&ctx->hhash, (uint8_t *) data, ST_SHA256_BLOCK_SIZE) != 0) {
-            return MBEDTLS_ERR_PLATFORM_HW_ACCEL_FAILED;
-        }
-    } else {
-        if (HAL_HASHEx_SHA224_Accmlt(&ctx->hhash, (uint8_t *) data, ST_SHA256_BLOCK_SIZE) != 0) {
-            return MBEDTLS_ERR_PLATFORM_HW_ACCEL_FAILED;
-        }
+    ret = hash_lock();
+    if (ret != 0)
+    {
+        return ret;
     }
 
-#ifdef ST_HW_CONTEXT_SAVING
-    /* save hw context */
-    HAL_HASH_ContextSaving(&ctx->hhash, ctx->ctx_save_regs);
-#endif /* ST_HW_CONTEXT_SAVING */
+    /* load hw context, unless this context was the last one to use it */
+    hash_select(&ctx->hhash, ctx->ctx_save_regs, 1);
 
-    return 0;
+    ret = sha256_accumulate(ctx, data, ST_SHA256_BLOCK_SIZE);
+
+    if (hash_unlock() != 0)
+    {
+        ret = MBEDTLS_ERR_THREADING_MUTEX_ERROR;
+    }
+
+    return ret;
 }
 
-int mbedtls_sha256_update_ret(mbedtls_sha256_context *ctx, const unsigned char *input, size_t ilen)
+int mbedtls_sha256_update(mbedtls_sha256_context *ctx, const unsigned char *input, size_t ilen)
 {
-    size_t currentlen = ilen;
+    int ret;
 
     SHA256_VALIDATE_RET( ctx != NULL );
     SHA256_VALIDATE_RET( ilen == 0 || input != NULL );
 
-#ifdef ST_HW_CONTEXT_SAVING
-    /* restore hw context */
-    HAL_HASH_ContextRestoring(&ctx->hhash, ctx->ctx_save_regs);
-#endif /* ST_HW_CONTEXT_SAVING */
-
-    if (currentlen < (ST_SHA256_BLOCK_SIZE + ctx->first - ctx->sbuf_len))
+    if (ilen < (ST_SHA256_BLOCK_SIZE + ctx->first - ctx->sbuf_len))
     {
-        /* only store input data in context buffer */
-        memcpy(ctx->sbuf + ctx->sbuf_len, input, currentlen);
-        ctx->sbuf_len += currentlen;
+        /* only store input data in context buffer, the Hw is not needed */
+        memcpy(ctx->sbuf + ctx->sbuf_len, input, ilen);
+        ctx->sbuf_len += ilen;
+        return 0;
     }
-    else
-    {
-        /* fill context buffer until ST_SHA256_BLOCK_SIZE bytes, and process it */
-        memcpy(ctx->sbuf + ctx->sbuf_len, input, (ST_SHA256_BLOCK_SIZE + ctx->first - ctx->sbuf_len));
-        currentlen -= (ST_SHA256_BLOCK_SIZE + ctx->first - ctx->sbuf_len);
 
-        if (ctx->is224 == 0)
-        {
-            if (HAL_HASHEx_SHA256_Accmlt(&ctx->hhash, (uint8_t *)(ctx->sbuf), ST_SHA256_BLOCK_SIZE + ctx->first) != 0)
-            {
-                return MBEDTLS_ERR_PLATFORM_HW_ACCEL_FAILED;
-            }
-        }
-        else
-        {
-            if (HAL_HASHEx_SHA224_Accmlt(&ctx->hhash, (uint8_t *)(ctx->sbuf), ST_SHA256_BLOCK_SIZE + ctx->first) != 0)
-            {
-                return MBEDTLS_ERR_PLATFORM_HW_ACCEL_FAILED;
-            }
-        }
+    ret = hash_lock();
+    if (ret != 0)
+    {
+        return ret;
+    }
 
-        /* Process following input data with size multiple of ST_SHA256_BLOCK_SIZE bytes */
-        size_t iter = currentlen / ST_SHA256_BLOCK_SIZE;
-        if (iter != 0)
-        {
-            if (ctx->is224 == 0)
-            {
-                if (HAL_HASHEx_SHA256_Accmlt(&ctx->hhash, (uint8_t *)(input + ST_SHA256_BLOCK_SIZE + ctx->first - ctx->sbuf_len), (iter * ST_SHA256_BLOCK_SIZE)) != 0)
-                {
-                    return MBEDTLS_ERR_PLATFORM_HW_ACCEL_FAILED;
-                }
-            }
-            else
-            {
-                if (HAL_HASHEx_SHA224_Accmlt(&ctx->hhash, (uint8_t *)(input + ST_SHA256_BLOCK_SIZE + ctx->first - ctx->sbuf_len), (iter * ST_SHA256_BLOCK_SIZE)) != 0)
-                {
-                    return MBEDTLS_ERR_PLATFORM_HW_ACCEL_FAILED;
-                }
-            }
-        }
+    /* load hw context, unless this context was the last one to use it */
+    hash_select(&ctx->hhash, ctx->ctx_save_regs, 1);
 
-        /* following blocks on 16 words */
-        ctx->first = 0;
+    ret = sha256_update_locked(ctx, input, ilen);
 
-        /* Store only the remaining input data up to (ST_SHA256_BLOCK_SIZE - 1) bytes */
-        ctx->sbuf_len = currentlen % ST_SHA256_BLOCK_SIZE;
-        if (ctx->sbuf_len != 0)
-        {
-            memcpy(ctx->sbuf, input + ilen - ctx->sbuf_len, ctx->sbuf_len);
-        }
+    if (hash_unlock() != 0)
+    {
+        ret = MBEDTLS_ERR_THREADING_MUTEX_ERROR;
     }
 
-#ifdef ST_HW_CONTEXT_SAVING
-    /* save hw context */
-    HAL_HASH_ContextSaving(&ctx->hhash, ctx->ctx_save_regs);
-#endif /* ST_HW_CONTEXT_SAVING */
-    return 0;
+    return ret;
 }
 
-int mbedtls_sha256_finish_ret(mbedtls_sha256_context *ctx, unsigned char output[32])
+int mbedtls_sha256_finish(mbedtls_sha256_context *ctx, unsigned char *output)
 {
+    int ret;
+
     SHA256_VALIDATE_RET( ctx != NULL );
     SHA256_VALIDATE_RET( (unsigned char *)output != NULL );
 
-#ifdef ST_HW_CONTEXT_SAVING
-    /* restore hw context */
-    HAL_HASH_ContextRestoring(&ctx->hhash, ctx->ctx_save_regs);
-#endif /* ST_HW_CONTEXT_SAVING */
+    ret = hash_lock();
+    if (ret != 0)
+    {
+        return ret;
+    }
+
+    /* load hw context, unless this context was the last one to use it */
+    hash_select(&ctx->hhash, ctx->ctx_save_regs, 1);
 
     /* Last accumulation for pending bytes in sbuf_len, then trig processing and get digest */
     if (ctx->is224 == 0)
     {
-        if (HAL_HASHEx_SHA256_Accmlt_End(&ctx->hhash, ctx->sbuf, ctx->sbuf_len, output, ST_SHA256_TIMEOUT) != 0)
+        if (HAL_HASHEx_SHA256_Accmlt_End(&ctx->hhash, ctx->sbuf, ctx->sbuf_len, output, ST_SHA256_TIMEOUT) != HAL_OK)
         {
-            return MBEDTLS_ERR_PLATFORM_HW_ACCEL_FAILED;
+            ret = MBEDTLS_ERR_PLATFORM_HW_ACCEL_FAILED;
         }
     }
     else
     {
-        if (HAL_HASHEx_SHA224_Accmlt_End(&ctx->hhash, ctx->sbuf, ctx->sbuf_len, output, ST_SHA256_TIMEOUT) != 0)
+        if (HAL_HASHEx_SHA224_Accmlt_End(&ctx->hhash, ctx->sbuf, ctx->sbuf_len, output, ST_SHA256_TIMEOUT) != HAL_OK)
         {
-            return MBEDTLS_ERR_PLATFORM_HW_ACCEL_FAILED;
+            ret = MBEDTLS_ERR_PLATFORM_HW_ACCEL_FAILED;
         }
     }
 
     ctx->sbuf_len = 0;
 
-    return 0;
+    /* The digest is out, the hw context is of no further use */
+    hash_forget(&ctx->hhash);
+
+    if (hash_unlock() != 0)
+    {
+        ret = MBEDTLS_ERR_THREADING_MUTEX_ERROR;
+    }
+
+    return ret;
 }
 
 #endif /* MBEDTLS_SHA256_ALT*/
@@ -44,6 +44,10 @@
 #define LOG_LEVEL    LOG_ERROR
 #endif
 
+#ifndef LOG_MODULE
+#define LOG_MODULE    LOG_MODULE_PKCS11
+#endif
+
 #include "logging.h"
 
 /************ End of logging configuration ****************/
@@ -101,6 +105,15 @@
  */
 #define pkcs11configPAL_DESTROY_SUPPORTED                  1
 
+/**
+ * @brief Largest non-private object whose contents the littlefs PAL keeps in RAM.
+ *
+ * The PAL always caches which objects exist. Certificates and public keys up to
+ * this size are also served from RAM until they are saved or destroyed again.
+ * Set to 0 to only cache object existence.
+ */
+#define pkcs11configPAL_CACHE_MAX_OBJECT_SIZE              2048UL
+
 /**
  * @brief Set to 1 if OTA image verification via PKCS #11 module is supported.
  *
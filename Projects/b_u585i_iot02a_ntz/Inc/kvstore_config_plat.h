@@ -36,7 +36,13 @@
 
 #define KV_STORE_NVIMPL_ARM_PSA     0
 
-#define KVSTORE_KEY_MAX_LEN         16
+#define KVSTORE_KEY_MAX_LEN         24
 #define KVSTORE_VAL_MAX_LEN         256
 
+/* Define KV_STORE_WRITE_BACK_ENABLE to 1 to batch committed changes into a single journal file */
+#define KV_STORE_WRITE_BACK_ENABLE  1
+
+/* Time a committed change may stay in ram before it is flushed to non-volatile storage */
+#define KV_STORE_FLUSH_DELAY_MS     5000
+
 #endif /* _KVSTORE_CONFIG_PLAT_H */
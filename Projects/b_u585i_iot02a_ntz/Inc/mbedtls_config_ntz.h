@@ -314,7 +314,8 @@ void mbedtls_platform_free( void * ptr );
 /*#define MBEDTLS_ARIA_ALT */
 /*#define MBEDTLS_CAMELLIA_ALT */
 /*#define MBEDTLS_CCM_ALT */
-/*#define MBEDTLS_CHACHA20_ALT */
+/* Word oriented ChaCha20 in Common/crypto/chacha20_alt.c */
+#define MBEDTLS_CHACHA20_ALT
 /*#define MBEDTLS_CHACHAPOLY_ALT */
 /*#define MBEDTLS_CMAC_ALT */
 /*#define MBEDTLS_DES_ALT */
@@ -330,6 +331,80 @@ void mbedtls_platform_free( void * ptr );
 /*#define MBEDTLS_SHA256_ALT */
 /*#define MBEDTLS_SHA512_ALT */
 
+/*
+ * STM32U5 AES and HASH peripheral drivers in Drivers/stm32u5_mbedtls_accel.
+ * Set an option to 0 to use the software implementation of that primitive.
+ * The drivers serialize access to each peripheral, so any number of TLS
+ * contexts may use them from different tasks.
+ *
+ * The GCM driver only supports 12 byte IVs, at most ST_GCM_ADD_MAX_LEN bytes
+ * of additional data and 128 or 256 bit keys, which covers the TLS cipher
+ * suites. A GCM operation holds the AES peripheral from its first block until
+ * mbedtls_gcm_finish(), so a task must not interleave two GCM operations.
+ * GCM records of ST_CRYP_DMA_MIN_LEN bytes or more are streamed by GPDMA1
+ * channels 0 and 1 while the calling task blocks, see ST_CRYP_DMA_ENABLE.
+ *
+ * The PKA verifies ECDSA signatures, validates peer public keys and computes
+ * the ECDHE key pair and shared secret on P-256 and P-384. The calling task
+ * sleeps until the end of operation interrupt, see ST_PKA_IT_ENABLE. Other
+ * curves and ECDSA signing stay in software. The full PKA based ECP and RSA
+ * alternates are not enabled: they target the mbedtls 2.x internals.
+ *
+ * Software ECDSA signing (the device key, through corePKCS11) multiplies the
+ * generator with the fixed-base comb tables of ecp_curves.c, which are const
+ * data read directly from flash, see STM32U5_MBEDTLS_ECP_FIXED_POINT. Set it
+ * to 0 to save that flash: every sign then builds the table in RAM, because
+ * corePKCS11 parses the key, and so loads the group, for each signature.
+ */
+#ifndef STM32U5_MBEDTLS_HW_AES
+#define STM32U5_MBEDTLS_HW_AES       1
+#endif
+
+#ifndef STM32U5_MBEDTLS_HW_GCM
+#define STM32U5_MBEDTLS_HW_GCM       1
+#endif
+
+#ifndef STM32U5_MBEDTLS_HW_SHA256
+#define STM32U5_MBEDTLS_HW_SHA256    1
+#endif
+
+#ifndef STM32U5_MBEDTLS_HW_SHA1
+#define STM32U5_MBEDTLS_HW_SHA1      1
+#endif
+
+#ifndef STM32U5_MBEDTLS_HW_MD5
+#define STM32U5_MBEDTLS_HW_MD5       1
+#endif
+
+#ifndef STM32U5_MBEDTLS_HW_PKA
+#define STM32U5_MBEDTLS_HW_PKA       1
+#endif
+
+#ifndef STM32U5_MBEDTLS_ECP_FIXED_POINT
+#define STM32U5_MBEDTLS_ECP_FIXED_POINT    1
+#endif
+
+#if STM32U5_MBEDTLS_HW_AES
+#define MBEDTLS_AES_ALT
+#endif
+
+#if STM32U5_MBEDTLS_HW_GCM
+#define MBEDTLS_GCM_ALT
+#endif
+
+/* Covers SHA-224 as well */
+#if STM32U5_MBEDTLS_HW_SHA256
+#define MBEDTLS_SHA256_ALT
+#endif
+
+#if STM32U5_MBEDTLS_HW_SHA1
+#define MBEDTLS_SHA1_ALT
+#endif
+
+#if STM32U5_MBEDTLS_HW_MD5
+#define MBEDTLS_MD5_ALT
+#endif
+
 /*
  * When replacing the elliptic curve module, pleace consider, that it is
  * implemented with two .c files:
@@ -396,6 +471,12 @@ void mbedtls_platform_free( void * ptr );
 /*#define MBEDTLS_ECDSA_SIGN_ALT */
 /*#define MBEDTLS_ECDSA_GENKEY_ALT */
 
+#if STM32U5_MBEDTLS_HW_PKA
+#define MBEDTLS_ECDH_GEN_PUBLIC_ALT
+#define MBEDTLS_ECDH_COMPUTE_SHARED_ALT
+#define MBEDTLS_ECDSA_VERIFY_ALT
+#endif
+
 /**
  * \def MBEDTLS_ECP_INTERNAL_ALT
  *
@@ -1247,8 +1328,11 @@ void mbedtls_platform_free( void * ptr );
  * \def MBEDTLS_SELF_TEST
  *
  * Enable the checkup functions (*_self_test).
+ *
+ * Used by the cryptotest CLI command to check the hardware accelerated
+ * primitives. Only the self tests it references are linked.
  */
-/*#define MBEDTLS_SELF_TEST */
+#define MBEDTLS_SELF_TEST
 
 /**
  * \def MBEDTLS_SHA256_SMALLER
@@ -3040,7 +3124,7 @@ void mbedtls_platform_free( void * ptr );
 
 /* ECP options */
 /*#define MBEDTLS_ECP_WINDOW_SIZE            4 / **< Maximum window size used * / */
-/*#define MBEDTLS_ECP_FIXED_POINT_OPTIM      1 / **< Enable fixed-point speed-up * / */
+#define MBEDTLS_ECP_FIXED_POINT_OPTIM      STM32U5_MBEDTLS_ECP_FIXED_POINT /**< Enable fixed-point speed-up */
 
 /* Entropy options */
 /*#define MBEDTLS_ENTROPY_MAX_SOURCES                20 / **< Maximum number of sources supported * / */
@@ -3180,8 +3264,12 @@ void mbedtls_platform_free( void * ptr );
  * certificate data which is sent during the handshake.
  *
  * Uncomment to set the maximum plaintext size of the outgoing I/O buffer.
+ *
+ * The client certificate is the largest handshake message this device sends,
+ * and application data is written in records of at most 4096 bytes (the
+ * maximum fragment length requested by the TLS transport).
  */
-/*#define MBEDTLS_SSL_OUT_CONTENT_LEN             16384 */
+#define MBEDTLS_SSL_OUT_CONTENT_LEN    4096
 
 /** \def MBEDTLS_SSL_DTLS_MAX_BUFFERING
  *
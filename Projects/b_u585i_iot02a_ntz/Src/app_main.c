@@ -37,16 +37,34 @@
 #include "stm32u5xx.h"
 #include "kvstore.h"
 #include "hw_defs.h"
+#include "time_base.h"
+#include "net_sntp.h"
+#include "boot_times.h"
+#include "warm_state.h"
+#include "crit_stats.h"
+#include "dma_copy.h"
+#include "dvfs.h"
+#include "ram_sections.h"
+#include "static_alloc.h"
+#include "work_queue.h"
 #include <string.h>
 
 #include "lfs.h"
 #include "fs/lfs_port.h"
+#include "fs/prov_image.h"
 #include "stm32u5xx_ll_rng.h"
 
 #include "test_execution_config.h"
 
 #include "cli/cli.h"
 
+#include "mqtt_outbox.h"
+
+#if defined( LOGGING_OUTPUT_FLASH )
+#include "fs/log_store.h"
+#include "log_upload.h"
+#endif
+
 /* Definition for Qualification Test */
 #if ( DEVICE_ADVISOR_TEST_ENABLED == 1 ) || ( MQTT_TEST_ENABLED == 1 ) || ( TRANSPORT_INTERFACE_TEST_ENABLED == 1 ) || \
     ( OTA_PAL_TEST_ENABLED == 1 ) || ( OTA_E2E_TEST_ENABLED == 1 ) || ( CORE_PKCS11_TEST_ENABLED == 1 )
@@ -168,27 +186,32 @@ static void vRelocateVectorTable( void )
 }
 
 
-static void vHeartbeatTask( void * pvParameters )
+static WorkJob_t xHeartbeatJob = { 0 };
+
+static void prvHeartbeatJob( void * pvCtx )
 {
-    ( void ) pvParameters;
+    ( void ) pvCtx;
+
+    HAL_GPIO_TogglePin( LED_GREEN_GPIO_Port, LED_GREEN_Pin );
+}
 
+static void vHeartbeatStart( void )
+{
     HAL_GPIO_WritePin( LED_GREEN_GPIO_Port, LED_GREEN_Pin, GPIO_PIN_RESET );
     HAL_GPIO_WritePin( LED_RED_GPIO_Port, LED_RED_Pin, GPIO_PIN_SET );
 
-    while( 1 )
-    {
-        vTaskDelay( pdMS_TO_TICKS( 1000 ) );
-        HAL_GPIO_TogglePin( LED_GREEN_GPIO_Port, LED_GREEN_Pin );
-    }
+    vWorkJobInit( &xHeartbeatJob, "Heartbeat", prvHeartbeatJob, NULL );
+    vWorkJobSchedulePeriodic( &xHeartbeatJob, 1000, 1000 );
 }
 
 extern void net_main( void * pvParameters );
 extern void vMQTTAgentTask( void * );
 extern void vMotionSensorsPublish( void * );
-extern void vEnvironmentSensorPublishTask( void * );
+extern void vEnvironmentSensorPublishStart( void );
+extern void vSensorHubInit( void );
 extern void vShadowDeviceTask( void * );
 extern void vOTAUpdateTask( void * pvParam );
-extern void vDefenderAgentTask( void * );
+extern void vDefenderAgentStart( void );
 #if DEMO_QUALIFICATION_TEST
 extern void run_qualification_main( void * );
 #endif /* DEMO_QUALIFICATION_TEST */
@@ -202,7 +225,17 @@ void vInitTask( void * pvArgs )
 
     ( void ) pvArgs;
 
-    xResult = xTaskCreate( Task_CLI, "cli", 2048, NULL, 10, NULL );
+    vBootTimeMark( BOOT_STAGE_SCHEDULER );
+
+    /* Drops the core clock once no client has needed full speed for DVFS_LOW_DELAY_MS */
+    vDvfsInit();
+
+    xResult = xTaskCreateStaticStack( Task_CLI, "cli", TASK_STACK_CLI, NULL, 10, NULL );
+    configASSERT( xResult == pdTRUE );
+
+    /* Start the wifi module reset and lwip init right away, they take much longer
+     * than the filesystem mount. net_main waits for EVT_MASK_FS_READY before connecting. */
+    xResult = xTaskCreateStaticStack( &net_main, "MxNet", TASK_STACK_MXNET, NULL, 23, NULL );
     configASSERT( xResult == pdTRUE );
 
     xMountStatus = fs_init();
@@ -217,46 +250,85 @@ void vInitTask( void * pvArgs )
 
         LogInfo( "File System mounted." );
 
-        otaPal_EarlyInit();
+        vBootTimeMark( BOOT_STAGE_FS_MOUNT );
 
-        ( void ) xEventGroupSetBits( xSystemEvents, EVT_MASK_FS_READY );
+        otaPal_EarlyInit();
 
         KVStore_init();
+
+        /* Provisioning image flashed by stm32u5_tool.sh flash_prov, applied on first boot only */
+        ( void ) xProvImageApply( pxGetDefaultFsCtx()->cfg );
+
+        {
+            char cLogLevels[ 128 ];
+
+            if( KVStore_getString( CS_LOG_LEVELS, cLogLevels, sizeof( cLogLevels ) ) > 0 )
+            {
+                if( lLoggingSetLevels( cLogLevels ) != 1 )
+                {
+                    LogError( "Invalid log_levels setting: %s", cLogLevels );
+                }
+            }
+        }
+
+        xResult = xTaskCreateStaticStack( vLfsPortPreEraseTask, "LfsErase", TASK_STACK_LFSERASE, pxGetDefaultFsCtx(), tskIDLE_PRIORITY, NULL );
+        configASSERT( xResult == pdTRUE );
+
+#if defined( LOGGING_OUTPUT_FLASH )
+        /* Writes the lines queued since boot, so start it before the flash gets busy */
+        ( void ) xLogStoreInit( pxGetDefaultFsCtx()->cfg );
+#endif
     }
     else
     {
         LogError( "Failed to mount filesystem." );
     }
 
+    /* Set even if the mount failed so that waiters carry on with the KVStore defaults */
+    vBootTimeMark( BOOT_STAGE_KVSTORE );
     ( void ) xEventGroupSetBits( xSystemEvents, EVT_MASK_FS_READY );
 
-    xResult = xTaskCreate( vHeartbeatTask, "Heartbeat", 128, NULL, tskIDLE_PRIORITY, NULL );
-    configASSERT( xResult == pdTRUE );
+    vTimeBaseInit();
 
-    xResult = xTaskCreate( &net_main, "MxNet", 1024, NULL, 23, NULL );
-    configASSERT( xResult == pdTRUE );
+    vWorkQueueInit();
+
+#if NET_SNTP_ENABLED == 1
+    vNetSntpInit();
+#endif
+
+    vHeartbeatStart();
 
 #if DEMO_QUALIFICATION_TEST
     xResult = xTaskCreate( run_qualification_main, "QualTest", 4096, NULL, 10, NULL );
     configASSERT( xResult == pdTRUE );
 #else
-    xResult = xTaskCreate( vMQTTAgentTask, "MQTTAgent", 2048, NULL, 10, NULL );
+    xResult = xTaskCreateStaticStack( vMQTTAgentTask, "MQTTAgent", TASK_STACK_MQTTAGENT, NULL, 10, NULL );
     configASSERT( xResult == pdTRUE );
 
-    xResult = xTaskCreate( vOTAUpdateTask, "OTAUpdate", 4096, NULL, tskIDLE_PRIORITY + 1, NULL );
+    xResult = xTaskCreateStaticStack( vOTAUpdateTask, "OTAUpdate", TASK_STACK_OTAUPDATE, NULL, tskIDLE_PRIORITY + 1, NULL );
     configASSERT( xResult == pdTRUE );
 
-    xResult = xTaskCreate( vEnvironmentSensorPublishTask, "EnvSense", 1024, NULL, 6, NULL );
+    vSensorHubInit();
+
+    vEnvironmentSensorPublishStart();
+
+    xResult = xTaskCreateStaticStack( vMotionSensorsPublish, "MotionS", TASK_STACK_MOTIONS, NULL, 5, NULL );
     configASSERT( xResult == pdTRUE );
 
-    xResult = xTaskCreate( vMotionSensorsPublish, "MotionS", 2048, NULL, 5, NULL );
+    xResult = xTaskCreateStaticStack( vShadowDeviceTask, "ShadowDevice", TASK_STACK_SHADOWDEVICE, NULL, 5, NULL );
     configASSERT( xResult == pdTRUE );
 
-    xResult = xTaskCreate( vShadowDeviceTask, "ShadowDevice", 1024, NULL, 5, NULL );
+    vDefenderAgentStart();
+
+#if MQTT_OUTBOX_ENABLED == 1
+    xResult = xTaskCreateStaticStack( vMqttOutboxTask, "MQTTOutbox", TASK_STACK_MQTTOUTBOX, NULL, 5, NULL );
     configASSERT( xResult == pdTRUE );
+#endif /* MQTT_OUTBOX_ENABLED == 1 */
 
-    xResult = xTaskCreate( vDefenderAgentTask, "AWSDefender", 2048, NULL, 5, NULL );
+#if defined( LOGGING_OUTPUT_FLASH )
+    xResult = xTaskCreateStaticStack( vLogUploadTask, "LogUpload", TASK_STACK_LOGUPLOAD, NULL, tskIDLE_PRIORITY + 1, NULL );
     configASSERT( xResult == pdTRUE );
+#endif
 #endif /* DEMO_QUALIFICATION_TEST */
 
     while( 1 )
@@ -321,21 +393,36 @@ int main( void )
 {
     ulCsrFlags = RCC->CSR;
 
+    vBootTimesInit( ulCsrFlags );
+
+    /* SRAM3 holds its contents through a software or watchdog reset, but not through a brownout */
+    vWarmStateInit( ( ( ( ulCsrFlags & ( RCC_CSR_SFTRSTF_Msk | RCC_CSR_IWDGRSTF_Msk | RCC_CSR_WWDGRSTF_Msk ) ) != 0 ) &&
+                      ( ( ulCsrFlags & RCC_CSR_BORRSTF_Msk ) == 0 ) ) ? pdTRUE : pdFALSE );
+
     __HAL_RCC_CLEAR_RESET_FLAGS();
 
     hw_init();
 
+    vCritStatsInit();
+
+    vDmaCopyInit();
+
+    vBootTimeMark( BOOT_STAGE_HW_INIT );
+
     vRelocateVectorTable();
 
+    vBootTimeMark( BOOT_STAGE_VECTOR_TABLE );
+
     vLoggingInit();
 
     vDetermineResetSource();
 
     LogInfo( "HW Init Complete." );
 
-    xSystemEvents = xEventGroupCreate();
+    xSystemEvents = xEventGroupCreateStaticStorage();
+    configASSERT( xSystemEvents != NULL );
 
-    xTaskCreate( vInitTask, "Init", 1024, NULL, 8, NULL );
+    ( void ) xTaskCreateStaticStack( vInitTask, "Init", TASK_STACK_INIT, NULL, 8, NULL );
 
     /* Start scheduler */
     vTaskStartScheduler();
@@ -369,7 +456,7 @@ void vApplicationGetIdleTaskMemory( StaticTask_t ** ppxIdleTaskTCBBuffer,
      * function then they must be declared static - otherwise they will be allocated on
      * the stack and so not exists after this function exits. */
     static StaticTask_t xIdleTaskTCB;
-    static StackType_t uxIdleTaskStack[ configMINIMAL_STACK_SIZE ];
+    static StackType_t uxIdleTaskStack[ configMINIMAL_STACK_SIZE ] RAM_CPU_DATA;
 
     /* Pass out a pointer to the StaticTask_t structure in which the Idle task's
      * state will be stored. */
@@ -396,7 +483,7 @@ void vApplicationGetTimerTaskMemory( StaticTask_t ** ppxTimerTaskTCBBuffer,
      * function then they must be declared static - otherwise they will be allocated on
      * the stack and so not exists after this function exits. */
     static StaticTask_t xTimerTaskTCB;
-    static StackType_t uxTimerTaskStack[ configTIMER_TASK_STACK_DEPTH ];
+    static StackType_t uxTimerTaskStack[ configTIMER_TASK_STACK_DEPTH ] RAM_CPU_DATA;
 
     /* Pass out a pointer to the StaticTask_t structure in which the Timer
      * task's state will be stored. */
@@ -464,6 +551,9 @@ void vDoSystemReset( void )
 
     if( xTaskGetSchedulerState() == taskSCHEDULER_RUNNING )
     {
+        /* Store committed configuration changes that are still waiting for a background flush */
+        ( void ) KVStore_xFlush();
+
         vTaskSuspendAll();
     }
 
@@ -31,6 +31,7 @@
 
 #include "FreeRTOS.h"
 #include "atomic.h"
+#include "semphr.h"
 
 /* PKCS 11 includes. */
 #include "core_pkcs11_config.h"
@@ -44,10 +45,76 @@
 #include "lfs.h"
 #include "fs/lfs_port.h"
 
+#include <string.h>
+
 /*-----------------------------------------------------------*/
 
+#ifndef pkcs11configPAL_CACHE_MAX_OBJECT_SIZE
+#define pkcs11configPAL_CACHE_MAX_OBJECT_SIZE    2048UL
+#endif
+
+#define PAL_CACHE_NUM_ENTRIES                    ( ( size_t ) eAwsCaCertificate + 1 )
+
+typedef enum PalCacheState
+{
+    eCacheUnknown = 0, /* Not looked up since boot or the last save / destroy. */
+    eCacheAbsent,      /* No file exists for this handle. */
+    eCachePresent,     /* The file exists. */
+} PalCacheState_t;
+
+typedef struct PalCacheEntry
+{
+    PalCacheState_t xState;
+    CK_BYTE_PTR pucData; /* Contents of a non-private object, or NULL. */
+    CK_ULONG ulDataSize;
+} PalCacheEntry_t;
+
 static lfs_t * pLfsCtx = NULL;
 
+/* Indexed by object handle. Entries are only accessed with xCacheMutex held. */
+static PalCacheEntry_t xObjectCache[ PAL_CACHE_NUM_ENTRIES ] = { 0 };
+static SemaphoreHandle_t xCacheMutex = NULL;
+static StaticSemaphore_t xCacheMutexStatic;
+
+/*-----------------------------------------------------------*/
+
+static PalCacheEntry_t * prvCacheLock( CK_OBJECT_HANDLE xHandle )
+{
+    PalCacheEntry_t * pxEntry = NULL;
+
+    if( ( xHandle != ( CK_OBJECT_HANDLE ) eInvalidHandle ) &&
+        ( xHandle < PAL_CACHE_NUM_ENTRIES ) &&
+        ( xCacheMutex != NULL ) &&
+        ( xSemaphoreTake( xCacheMutex, portMAX_DELAY ) == pdTRUE ) )
+    {
+        pxEntry = &( xObjectCache[ xHandle ] );
+    }
+
+    return pxEntry;
+}
+
+/*-----------------------------------------------------------*/
+
+static void prvCacheUnlock( void )
+{
+    ( void ) xSemaphoreGive( xCacheMutex );
+}
+
+/*-----------------------------------------------------------*/
+
+/* Forget everything known about an object. Called with xCacheMutex held. */
+static void prvCacheInvalidate( PalCacheEntry_t * pxEntry )
+{
+    if( pxEntry->pucData != NULL )
+    {
+        vPortFree( pxEntry->pucData );
+    }
+
+    pxEntry->pucData = NULL;
+    pxEntry->ulDataSize = 0;
+    pxEntry->xState = eCacheUnknown;
+}
+
 /*-----------------------------------------------------------*/
 
 /**
@@ -196,6 +263,12 @@ static CK_RV prvReadData( const char * pcFileName,
 CK_RV PKCS11_PAL_Initialize( void )
 {
     pLfsCtx = pxGetDefaultFsCtx();
+
+    if( xCacheMutex == NULL )
+    {
+        xCacheMutex = xSemaphoreCreateMutexStatic( &xCacheMutexStatic );
+    }
+
     return CKR_OK;
 }
 
@@ -209,6 +282,7 @@ CK_OBJECT_HANDLE PKCS11_PAL_SaveObject( CK_ATTRIBUTE_PTR pxLabel,
     lfs_ssize_t lBytesWritten;
     const char * pcFileName = NULL;
     CK_OBJECT_HANDLE xHandle = ( CK_OBJECT_HANDLE ) eInvalidHandle;
+    PalCacheEntry_t * pxEntry = NULL;
 
     if( ( pxLabel != NULL ) && ( pucData != NULL ) )
     {
@@ -224,6 +298,14 @@ CK_OBJECT_HANDLE PKCS11_PAL_SaveObject( CK_ATTRIBUTE_PTR pxLabel,
 
     if( pcFileName != NULL )
     {
+        /* Held until the write completes so no reader caches the old contents. */
+        pxEntry = prvCacheLock( xHandle );
+
+        if( pxEntry != NULL )
+        {
+            prvCacheInvalidate( pxEntry );
+        }
+
         /* Overwrite the file every time it is saved. */
         lResult = lfs_file_open( pLfsCtx, &xFile, pcFileName, LFS_O_WRONLY | LFS_O_CREAT | LFS_O_TRUNC );
 
@@ -259,6 +341,11 @@ CK_OBJECT_HANDLE PKCS11_PAL_SaveObject( CK_ATTRIBUTE_PTR pxLabel,
 
             ( void ) lfs_file_close( pLfsCtx, &xFile );
         }
+
+        if( pxEntry != NULL )
+        {
+            prvCacheUnlock();
+        }
     }
     else
     {
@@ -285,10 +372,39 @@ CK_OBJECT_HANDLE PKCS11_PAL_FindObject( CK_BYTE_PTR pxLabel,
                                          &pcFileName,
                                          &xHandle );
 
-        if( ( pcFileName == NULL ) || ( CKR_OK != prvFileExists( pcFileName ) ) )
+        if( pcFileName == NULL )
         {
             xHandle = ( CK_OBJECT_HANDLE ) eInvalidHandle;
         }
+        else
+        {
+            PalCacheEntry_t * pxEntry = prvCacheLock( xHandle );
+            CK_RV xExists = CKR_OK;
+
+            if( ( pxEntry != NULL ) && ( pxEntry->xState != eCacheUnknown ) )
+            {
+                xExists = ( pxEntry->xState == eCachePresent ) ? CKR_OK : CKR_OBJECT_HANDLE_INVALID;
+            }
+            else
+            {
+                xExists = prvFileExists( pcFileName );
+
+                if( pxEntry != NULL )
+                {
+                    pxEntry->xState = ( xExists == CKR_OK ) ? eCachePresent : eCacheAbsent;
+                }
+            }
+
+            if( pxEntry != NULL )
+            {
+                prvCacheUnlock();
+            }
+
+            if( xExists != CKR_OK )
+            {
+                xHandle = ( CK_OBJECT_HANDLE ) eInvalidHandle;
+            }
+        }
     }
     else
     {
@@ -320,7 +436,60 @@ CK_RV PKCS11_PAL_GetObjectValue( CK_OBJECT_HANDLE xHandle,
 
     if( xReturn == CKR_OK )
     {
-        xReturn = prvReadData( pcFileName, ppucData, pulDataSize );
+        PalCacheEntry_t * pxEntry = prvCacheLock( xHandle );
+
+        if( ( pxEntry != NULL ) && ( pxEntry->pucData != NULL ) )
+        {
+            /* The caller releases the value with PKCS11_PAL_GetObjectValueCleanup,
+             * so hand out a copy of the cached contents. */
+            *ppucData = pvPortMalloc( pxEntry->ulDataSize );
+
+            if( *ppucData == NULL )
+            {
+                *pulDataSize = 0;
+                xReturn = CKR_HOST_MEMORY;
+            }
+            else
+            {
+                ( void ) memcpy( *ppucData, pxEntry->pucData, pxEntry->ulDataSize );
+                *pulDataSize = pxEntry->ulDataSize;
+            }
+        }
+        else if( ( pxEntry != NULL ) && ( pxEntry->xState == eCacheAbsent ) )
+        {
+            *ppucData = NULL;
+            *pulDataSize = 0;
+            xReturn = CKR_FUNCTION_FAILED;
+        }
+        else
+        {
+            xReturn = prvReadData( pcFileName, ppucData, pulDataSize );
+
+            if( pxEntry != NULL )
+            {
+                pxEntry->xState = ( xReturn == CKR_OK ) ? eCachePresent : pxEntry->xState;
+            }
+
+            /* Keep a copy of certificates and public keys, never of secrets. */
+            if( ( pxEntry != NULL ) &&
+                ( xReturn == CKR_OK ) &&
+                ( *pIsPrivate == CK_FALSE ) &&
+                ( *pulDataSize <= pkcs11configPAL_CACHE_MAX_OBJECT_SIZE ) )
+            {
+                pxEntry->pucData = pvPortMalloc( *pulDataSize );
+
+                if( pxEntry->pucData != NULL )
+                {
+                    ( void ) memcpy( pxEntry->pucData, *ppucData, *pulDataSize );
+                    pxEntry->ulDataSize = *pulDataSize;
+                }
+            }
+        }
+
+        if( pxEntry != NULL )
+        {
+            prvCacheUnlock();
+        }
     }
 
     return xReturn;
@@ -347,12 +516,24 @@ CK_RV PKCS11_PAL_DestroyObject( CK_OBJECT_HANDLE xHandle )
     const char * pcFileName = NULL;
     CK_BBOOL xIsPrivate = CK_TRUE;
     CK_RV xResult = CKR_OBJECT_HANDLE_INVALID;
+    PalCacheEntry_t * pxEntry = NULL;
     int ret = 0;
 
     xResult = PAL_UTILS_HandleToFilename( xHandle,
                                           &pcFileName,
                                           &xIsPrivate );
 
+    if( xResult == CKR_OK )
+    {
+        /* Held until the file is removed so no reader caches the old contents. */
+        pxEntry = prvCacheLock( xHandle );
+
+        if( pxEntry != NULL )
+        {
+            prvCacheInvalidate( pxEntry );
+        }
+    }
+
     if( ( xResult == CKR_OK ) &&
         ( prvFileExists( pcFileName ) == CKR_OK ) )
     {
@@ -364,6 +545,11 @@ CK_RV PKCS11_PAL_DestroyObject( CK_OBJECT_HANDLE xHandle )
         }
     }
 
+    if( pxEntry != NULL )
+    {
+        prvCacheUnlock();
+    }
+
     return xResult;
 }
 
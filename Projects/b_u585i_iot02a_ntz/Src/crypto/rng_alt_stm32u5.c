@@ -33,10 +33,20 @@
 
 #define MBEDTLS_ENTROPY_TIMEOUT_MS    100
 
+/*
+ * Number of 32 bit words of entropy kept ready for mbedtls_hardware_poll.
+ * The pool is refilled one word per RNG interrupt, without waking any task,
+ * so that a handshake copies its random draws from memory.
+ */
+#ifndef RNG_POOL_WORDS
+#define RNG_POOL_WORDS                64
+#endif
+
 /*
  * include the correct headerfile depending on the STM32 family */
 
 #include "stm32u5xx_hal.h"
+#include "periph_stats.h"
 #include <string.h>
 
 extern RNG_HandleTypeDef * pxHndlRng;
@@ -44,11 +54,60 @@ static SemaphoreHandle_t xRngMutex = NULL;
 
 static volatile TaskHandle_t xRngTaskToNotify = NULL;
 
+/*
+ * Single producer (the RNG interrupt) / single consumer (the task holding
+ * xRngMutex) ring of random words. One slot is left unused to tell a full
+ * pool from an empty one.
+ */
+#define RNG_POOL_SLOTS                ( RNG_POOL_WORDS + 1 )
+
+static uint32_t ulRngPool[ RNG_POOL_SLOTS ];
+static volatile uint32_t ulRngPoolHead = 0; /* Written by the interrupt only */
+static volatile uint32_t ulRngPoolTail = 0; /* Written by the consumer only */
+
+/* pdTRUE while an interrupt driven generation is outstanding */
+static volatile BaseType_t xRngFillRunning = pdFALSE;
+
+/* Set by the interrupt when the RNG reported a seed or clock error */
+static volatile BaseType_t xRngFault = pdFALSE;
+
+/* Number of words the waiting consumer needs before it is woken */
+static volatile uint32_t ulRngWordsWanted = 0;
+
+static inline uint32_t ulRngPoolCount( void )
+{
+    uint32_t ulHead = ulRngPoolHead;
+    uint32_t ulTail = ulRngPoolTail;
+
+    return( ( ulHead >= ulTail ) ? ( ulHead - ulTail ) : ( RNG_POOL_SLOTS - ulTail + ulHead ) );
+}
+
 static void vRngIrqHandler( void )
 {
     HAL_RNG_IRQHandler( pxHndlRng );
 }
 
+/*
+ * Start an interrupt driven generation unless one is outstanding or the
+ * pool is full. Called from a task.
+ */
+static void vRngFillStart( void )
+{
+    taskENTER_CRITICAL();
+
+    if( ( xRngFillRunning == pdFALSE ) &&
+        ( xRngFault == pdFALSE ) &&
+        ( ulRngPoolCount() < RNG_POOL_WORDS ) )
+    {
+        if( HAL_RNG_GenerateRandomNumber_IT( pxHndlRng ) == HAL_OK )
+        {
+            xRngFillRunning = pdTRUE;
+        }
+    }
+
+    taskEXIT_CRITICAL();
+}
+
 static void vRngInit( void )
 {
     taskENTER_CRITICAL();
@@ -58,21 +117,24 @@ static void vRngInit( void )
     {
         xRngMutex = xSemaphoreCreateMutex();
         NVIC_SetVector( RNG_IRQn, ( uint32_t ) &vRngIrqHandler );
-        NVIC_SetPriority( RNG_IRQn, 1 );
+
+        /* The callbacks use the FreeRTOS FromISR API */
+        NVIC_SetPriority( RNG_IRQn, configLIBRARY_MAX_SYSCALL_INTERRUPT_PRIORITY );
         NVIC_EnableIRQ( RNG_IRQn );
     }
 
     taskEXIT_CRITICAL();
+
+    if( xRngMutex != NULL )
+    {
+        vRngFillStart();
+    }
 }
 
-void HAL_RNG_ReadyDataCallback( RNG_HandleTypeDef * hrng,
-                                uint32_t random32bit )
+static void vRngNotifyFromISR( void )
 {
     BaseType_t xHigherPriorityTaskWoken = pdFALSE;
 
-    ( void ) random32bit;
-    ( void ) hrng;
-
     if( xRngTaskToNotify )
     {
         vTaskNotifyGiveFromISR( xRngTaskToNotify, &xHigherPriorityTaskWoken );
@@ -80,17 +142,116 @@ void HAL_RNG_ReadyDataCallback( RNG_HandleTypeDef * hrng,
     }
 }
 
+void HAL_RNG_ReadyDataCallback( RNG_HandleTypeDef * hrng,
+                                uint32_t random32bit )
+{
+    uint32_t ulHead = ulRngPoolHead;
+    uint32_t ulNextHead = ( ulHead + 1 ) % RNG_POOL_SLOTS;
+
+    xRngFillRunning = pdFALSE;
+
+    if( ( xRngFault == pdFALSE ) &&
+        ( ulNextHead != ulRngPoolTail ) )
+    {
+        ulRngPool[ ulHead ] = random32bit;
+
+        /* Publish the word before the new head */
+        __DMB();
+        ulRngPoolHead = ulNextHead;
+
+        /* Keep generating until the pool is full */
+        if( ulRngPoolCount() < RNG_POOL_WORDS )
+        {
+            if( HAL_RNG_GenerateRandomNumber_IT( hrng ) == HAL_OK )
+            {
+                xRngFillRunning = pdTRUE;
+            }
+        }
+    }
+
+    if( ( xRngFillRunning == pdFALSE ) ||
+        ( ulRngPoolCount() >= ulRngWordsWanted ) )
+    {
+        vRngNotifyFromISR();
+    }
+}
+
 void HAL_RNG_ErrorCallback( RNG_HandleTypeDef * hrng )
 {
-    BaseType_t xHigherPriorityTaskWoken = pdFALSE;
+    xPeriphErrStats.ulRngSeed += ( ( hrng->ErrorCode & HAL_RNG_ERROR_SEED ) != 0 ) ? 1 : 0;
+    xPeriphErrStats.ulRngClock += ( ( hrng->ErrorCode & HAL_RNG_ERROR_CLOCK ) != 0 ) ? 1 : 0;
 
-    ( void ) hrng;
+    /* The consumer recovers the peripheral and discards the pool */
+    xRngFault = pdTRUE;
+    xRngFillRunning = pdFALSE;
 
-    if( xRngTaskToNotify )
+    vRngNotifyFromISR();
+}
+
+/*
+ * Handle a seed or clock error reported by the RNG health tests. The words
+ * in the pool are discarded since the entropy source is no longer trusted.
+ * Called with xRngMutex held.
+ */
+static void vRngRecover( void )
+{
+    if( __HAL_RNG_GET_FLAG( pxHndlRng, RNG_FLAG_SECS ) )
     {
-        vTaskNotifyGiveFromISR( xRngTaskToNotify, &xHigherPriorityTaskWoken );
-        portYIELD_FROM_ISR( xHigherPriorityTaskWoken );
+        RNG_RecoverSeedError( pxHndlRng );
+    }
+    else
+    {
+        __HAL_RCC_RNG_CLK_DISABLE();
+        __HAL_RCC_RNG_CLK_ENABLE();
+        __HAL_RCC_RNG_FORCE_RESET();
+        __HAL_RCC_RNG_RELEASE_RESET();
     }
+
+    taskENTER_CRITICAL();
+
+    ulRngPoolTail = ulRngPoolHead;
+    xRngFault = pdFALSE;
+
+    taskEXIT_CRITICAL();
+}
+
+/*
+ * Copy up to uxBufferLen bytes out of the pool. A word is never split
+ * between two requests, the unused bytes of the last word are dropped.
+ * Called with xRngMutex held.
+ */
+static size_t uxRngPoolRead( unsigned char * pucOutputBuffer,
+                             size_t uxBufferLen )
+{
+    size_t uxBytesWritten = 0;
+    uint32_t ulTail = ulRngPoolTail;
+    uint32_t ulHead = ulRngPoolHead;
+
+    /* Read the words only after observing the head that published them */
+    __DMB();
+
+    while( ( uxBytesWritten < uxBufferLen ) &&
+           ( ulTail != ulHead ) )
+    {
+        size_t uxCopyLen = uxBufferLen - uxBytesWritten;
+
+        if( uxCopyLen > sizeof( uint32_t ) )
+        {
+            uxCopyLen = sizeof( uint32_t );
+        }
+
+        ( void ) memcpy( &( pucOutputBuffer[ uxBytesWritten ] ), &( ulRngPool[ ulTail ] ), uxCopyLen );
+        ulRngPool[ ulTail ] = 0;
+
+        uxBytesWritten += uxCopyLen;
+        ulTail = ( ulTail + 1 ) % RNG_POOL_SLOTS;
+    }
+
+    /* Finish reading the slots before handing them back to the interrupt */
+    __DMB();
+    ulRngPoolTail = ulTail;
+
+    return uxBytesWritten;
 }
 
 int mbedtls_hardware_poll( void * pvCtx,
@@ -123,68 +284,54 @@ int mbedtls_hardware_poll( void * pvCtx,
     else if( xSemaphoreTake( xRngMutex, xTicksToWait ) )
     {
         size_t uxBytesWritten = 0;
-        size_t uxBytesRemaining = uxBufferLen;
+        BaseType_t xTimedOut = pdFALSE;
 
         xRngTaskToNotify = xTaskGetCurrentTaskHandle();
 
-        while( uxBytesRemaining > 0 &&
-               xTaskCheckForTimeOut( &xTimeOut, &xTicksToWait ) == pdFALSE )
+        while( ( uxBytesWritten < uxBufferLen ) &&
+               ( lError == 0 ) &&
+               ( xTimedOut == pdFALSE ) )
         {
-            HAL_StatusTypeDef xResult = HAL_RNG_GenerateRandomNumber_IT( pxHndlRng );
-
-            if( xResult != HAL_OK )
+            if( xRngFault == pdTRUE )
             {
-                lError = MBEDTLS_ERR_ENTROPY_SOURCE_FAILED;
+                vRngRecover();
             }
-            else if( ulTaskNotifyTake( pdTRUE, xTicksToWait ) > 0 )
+
+            uxBytesWritten += uxRngPoolRead( &( pucOutputBuffer[ uxBytesWritten ] ),
+                                             uxBufferLen - uxBytesWritten );
+
+            if( uxBytesWritten < uxBufferLen )
             {
-                /* Check for error state */
-                if( __HAL_RNG_GET_FLAG( pxHndlRng, RNG_FLAG_SECS | RNG_FLAG_CECS ) )
+                size_t uxWordsWanted = ( uxBufferLen - uxBytesWritten + sizeof( uint32_t ) - 1 ) / sizeof( uint32_t );
+
+                ulRngWordsWanted = ( uxWordsWanted < RNG_POOL_WORDS ) ? uxWordsWanted : RNG_POOL_WORDS;
+
+                /* A stale notification only causes an early look at the pool */
+                vRngFillStart();
+
+                if( ( xRngFillRunning == pdFALSE ) &&
+                    ( xRngFault == pdFALSE ) &&
+                    ( ulRngPoolCount() == 0 ) )
                 {
-                    if( __HAL_RNG_GET_FLAG( pxHndlRng, RNG_FLAG_SECS ) )
-                    {
-                        RNG_RecoverSeedError( pxHndlRng );
-                    }
-                    else
-                    {
-                        __HAL_RCC_RNG_CLK_DISABLE();
-                        __HAL_RCC_RNG_CLK_ENABLE();
-                        __HAL_RCC_RNG_FORCE_RESET();
-                        __HAL_RCC_RNG_RELEASE_RESET();
-                    }
+                    /* The generation could not be started */
+                    lError = MBEDTLS_ERR_ENTROPY_SOURCE_FAILED;
                 }
-                else
+                else if( ( xTaskCheckForTimeOut( &xTimeOut, &xTicksToWait ) == pdTRUE ) ||
+                         ( ( ulRngPoolCount() < ulRngWordsWanted ) &&
+                           ( xRngFault == pdFALSE ) &&
+                           ( ulTaskNotifyTake( pdTRUE, xTicksToWait ) == 0 ) ) )
                 {
-                    uint32_t ulRandomValue = HAL_RNG_ReadLastRandomNumber( pxHndlRng );
-
-                    if( uxBytesRemaining > sizeof( uint32_t ) )
-                    {
-                        ( void ) memcpy( &( pucOutputBuffer[ uxBytesWritten ] ), &ulRandomValue, sizeof( uint32_t ) );
-
-                        uxBytesWritten += sizeof( uint32_t );
-                        uxBytesRemaining -= sizeof( uint32_t );
-                    }
-                    else if( uxBytesRemaining > 0 )
-                    {
-                        ( void ) memcpy( &( pucOutputBuffer[ uxBytesWritten ] ), &ulRandomValue, uxBytesRemaining );
-
-                        uxBytesWritten = uxBufferLen;
-                        uxBytesRemaining = 0;
-                    }
-                    else
-                    {
-                        uxBytesRemaining = 0;
-                    }
+                    xTimedOut = pdTRUE;
                 }
             }
-            else
-            {
-                uxBytesRemaining = 0;
-                break;
-            }
         }
 
         xRngTaskToNotify = NULL;
+        ulRngWordsWanted = 0;
+
+        /* Top the pool up in the background for the next request */
+        vRngFillStart();
+
         ( void ) xSemaphoreGive( xRngMutex );
         *puxBytesWritten = uxBytesWritten;
     }
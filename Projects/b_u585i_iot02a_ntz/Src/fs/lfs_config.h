@@ -49,6 +49,10 @@ extern "C"
 #define LOG_LEVEL    LOG_ERROR
 #endif
 
+#ifndef LOG_MODULE
+#define LOG_MODULE    LOG_MODULE_FS
+#endif
+
 
 #include "logging.h"
 
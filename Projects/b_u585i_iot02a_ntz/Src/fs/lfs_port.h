@@ -28,6 +28,53 @@
 #include "lfs.h"
 #include "lfs_util.h"
 
+/*
+ * littlefs tuning profiles for the OSPI partition.
+ * SMALL_RAM keeps about 1 KiB of caches, THROUGHPUT caches a whole 4 KiB sector
+ * per buffer so that sequential reads and writes need the fewest flash operations.
+ */
+#define LFS_PORT_PROFILE_SMALL_RAM       0
+#define LFS_PORT_PROFILE_BALANCED        1
+#define LFS_PORT_PROFILE_THROUGHPUT      2
+
+#ifndef LFS_PORT_OSPI_PROFILE
+#define LFS_PORT_OSPI_PROFILE            LFS_PORT_PROFILE_THROUGHPUT
+#endif
+
+#if LFS_PORT_OSPI_PROFILE == LFS_PORT_PROFILE_SMALL_RAM
+#define LFS_PORT_OSPI_DEFAULT_CACHE      512
+#define LFS_PORT_OSPI_DEFAULT_LOOKAHEAD  32
+#elif LFS_PORT_OSPI_PROFILE == LFS_PORT_PROFILE_BALANCED
+#define LFS_PORT_OSPI_DEFAULT_CACHE      1024
+#define LFS_PORT_OSPI_DEFAULT_LOOKAHEAD  128
+#elif LFS_PORT_OSPI_PROFILE == LFS_PORT_PROFILE_THROUGHPUT
+#define LFS_PORT_OSPI_DEFAULT_CACHE      4096
+#define LFS_PORT_OSPI_DEFAULT_LOOKAHEAD  256
+#else
+#error "Unknown LFS_PORT_OSPI_PROFILE"
+#endif
+
+/* Size of each read / program cache, also the buffer size of every open file.
+ * Must be a multiple of the 256 byte program size and divide the 4 KiB block size. */
+#ifndef LFS_PORT_OSPI_CACHE_SIZE
+#define LFS_PORT_OSPI_CACHE_SIZE         LFS_PORT_OSPI_DEFAULT_CACHE
+#endif
+
+/* Bytes of lookahead bitmap, each byte tracks 8 blocks */
+#ifndef LFS_PORT_OSPI_LOOKAHEAD_SIZE
+#define LFS_PORT_OSPI_LOOKAHEAD_SIZE     LFS_PORT_OSPI_DEFAULT_LOOKAHEAD
+#endif
+
+/* Erase cycles before metadata is moved to another block, -1 disables wear leveling */
+#ifndef LFS_PORT_OSPI_BLOCK_CYCLES
+#define LFS_PORT_OSPI_BLOCK_CYCLES       500
+#endif
+
+/* Set to 1 to use statically allocated read, program and lookahead buffers */
+#ifndef LFS_PORT_OSPI_STATIC_BUFFERS
+#define LFS_PORT_OSPI_STATIC_BUFFERS     0
+#endif
+
 #ifdef LFS_NO_MALLOC
 const struct lfs_config * pxInitializeOSPIFlashFsStatic( TickType_t xBlockTime );
 const struct lfs_config * pxInitializeInternalFlashFsStatic( TickType_t xBlockTime );
@@ -36,5 +83,30 @@ const struct lfs_config * pxInitializeOSPIFlashFs( TickType_t xBlockTime );
 const struct lfs_config * pxInitializeInternalFlashFs( TickType_t xBlockTime );
 #endif
 
+/* Block device operation counters of the OSPI partition since boot */
+typedef struct
+{
+    uint32_t ulReads;
+    uint32_t ulReadBytes;
+    uint32_t ulProgs;
+    uint32_t ulProgBytes;
+    uint32_t ulErases;            /* Sector erases done for littlefs */
+    uint32_t ulErasesSkipped;     /* littlefs erases satisfied by a pre-erased block */
+    uint32_t ulBackgroundErases;  /* Erases issued by vLfsPortPreEraseTask */
+} LfsPortStats_t;
+
+void vLfsPortOspiGetStats( LfsPortStats_t * pxStats );
+
+/* Erase count of each OSPI block since boot, indexed by littlefs block number */
+const uint16_t * pusLfsPortOspiEraseCounts( size_t * pxBlockCount );
+
+/* Zero-copy access to file data stored in the internal flash filesystem */
+const void * pvLfsPortInternalFlashReadPtr( lfs_t * pxLfs,
+                                            lfs_file_t * pxFile,
+                                            lfs_size_t * pxLength );
+
+/* Background eraser for the OSPI partition, takes the mounted lfs_t as parameter */
+void vLfsPortPreEraseTask( void * pvParameters );
+
 /* Provided outside of the lfs port */
 lfs_t * pxGetDefaultFsCtx( void );
@@ -32,12 +32,17 @@
 
 #include "lfs_util.h"
 #include "lfs.h"
+#include "lfs_port.h"
 #include "lfs_port_prv.h"
 
 #include "stm32u585xx.h"
 #include "stm32u5xx.h"
 #include "stm32u5xx_hal_flash.h"
 #include "stm32u5xx_hal_flash_ex.h"
+#include "stm32u5xx_hal_icache.h"
+
+#include "profiler.h"
+#include "dma_copy.h"
 
 /* Uses all pages of Bank 2
  *
@@ -49,6 +54,12 @@
 #define LFS_CONFIG_LOOKAHEAD_SIZE    16
 #define LFS_CONFIG_CACHE_SIZE        16
 
+/* Smallest unit of programming and size of a burst program operation */
+#define LFS_CONFIG_QUADWORD_SZ       ( 4 * sizeof( uint32_t ) )
+#define LFS_CONFIG_BURST_SZ          ( 8 * LFS_CONFIG_QUADWORD_SZ )
+
+PROF_PROBE( xProfProg, "lfs_prog" );
+
 #ifdef LFS_NO_MALLOC
 static uint8_t __ALIGN_BEGIN ucReadBuffer[ CONFIG_SIZE_CACHE_BUFFER ] __ALIGN_END = { 0 };
 static uint8_t __ALIGN_BEGIN ucProgBuffer[ CONFIG_SIZE_CACHE_BUFFER ] __ALIGN_END = { 0 };
@@ -58,20 +69,19 @@ static struct LfsPortCtx xLfsCtx = { 0 };
 static StaticSemaphore_t xMutexStatic;
 #endif
 
+/*
+ * The internal flash is memory mapped, reads do not need the flash interface unlocked.
+ * Cache fills of DMA_COPY_MIN_LEN bytes or more are moved by the DMA channel.
+ */
 static int lfs_port_read( const struct lfs_config * c,
                           lfs_block_t block,
                           lfs_off_t off,
                           void * buffer,
                           lfs_size_t size )
 {
-    HAL_FLASH_Unlock();
-    __HAL_FLASH_CLEAR_FLAG( FLASH_FLAG_ALL_ERRORS );
-
     uint32_t src_address = CONFIG_LFS_FLASH_BASE + block * c->block_size + off;
 
-    ( void ) memcpy( buffer, ( void * ) src_address, size );
-
-    HAL_FLASH_Lock();
+    ( void ) pvDmaCopy( buffer, ( const void * ) src_address, size );
 
     return 0;
 }
@@ -83,34 +93,46 @@ static int lfs_port_prog( const struct lfs_config * c,
                           lfs_size_t size )
 {
     HAL_StatusTypeDef xHAL_Status = HAL_OK;
-    uint32_t n_rows = size / c->prog_size;
-    uint32_t dest_address = 0;
-    uint32_t src_address = 0;
-    uint32_t block_base_addr = CONFIG_LFS_FLASH_BASE + block * c->block_size;
+    uint32_t dest_address = CONFIG_LFS_FLASH_BASE + block * c->block_size + off;
+    uint32_t src_address = ( uint32_t ) buffer;
+    uint32_t end_address = dest_address + size;
 
     struct LfsPortCtx * pxCtx = ( struct LfsPortCtx * ) c->context;
 
     configASSERT( xQueueGetMutexHolder( pxCtx->xMutex ) == xTaskGetCurrentTaskHandle() );
+    configASSERT( ( size % LFS_CONFIG_QUADWORD_SZ ) == 0 );
+
+    PROF_BEGIN( xProfProg );
 
     HAL_FLASH_Unlock();
     __HAL_FLASH_CLEAR_FLAG( FLASH_FLAG_ALL_ERRORS );
 
-    for( uint32_t i_row = 0; i_row < n_rows; i_row++ )
+    while( ( xHAL_Status == HAL_OK ) && ( dest_address < end_address ) )
     {
-        dest_address = block_base_addr + off + i_row * 4 * sizeof( uint32_t );
-        src_address = ( uint32_t ) buffer + i_row * 4 * sizeof( uint32_t );
-        xHAL_Status = HAL_FLASH_Program( FLASH_TYPEPROGRAM_QUADWORD, dest_address, src_address );
-
-        if( xHAL_Status != HAL_OK )
+        /* Burst program 8 quad-words at a time where the destination allows it */
+        if( ( ( dest_address % LFS_CONFIG_BURST_SZ ) == 0 ) &&
+            ( ( end_address - dest_address ) >= LFS_CONFIG_BURST_SZ ) )
         {
-            HAL_FLASH_Lock();
-            return -1;
+            xHAL_Status = HAL_FLASH_Program( FLASH_TYPEPROGRAM_BURST, dest_address, src_address );
+            dest_address += LFS_CONFIG_BURST_SZ;
+            src_address += LFS_CONFIG_BURST_SZ;
+        }
+        else
+        {
+            xHAL_Status = HAL_FLASH_Program( FLASH_TYPEPROGRAM_QUADWORD, dest_address, src_address );
+            dest_address += LFS_CONFIG_QUADWORD_SZ;
+            src_address += LFS_CONFIG_QUADWORD_SZ;
         }
     }
 
     HAL_FLASH_Lock();
 
-    return 0;
+    /* Drop lines of the modified page that ICACHE may hold from earlier reads */
+    ( void ) HAL_ICACHE_Invalidate();
+
+    PROF_END( xProfProg );
+
+    return xHAL_Status == HAL_OK ? 0 : -1;
 }
 
 static int lfs_port_erase( const struct lfs_config * c,
@@ -133,6 +155,8 @@ static int lfs_port_erase( const struct lfs_config * c,
 
     HAL_FLASH_Lock();
 
+    ( void ) HAL_ICACHE_Invalidate();
+
     return xHAL_Status == HAL_OK ? 0 : -1;
 }
 
@@ -154,11 +178,11 @@ static void vPopulateConfig( struct lfs_config * pxCfg,
 
 #ifdef LFS_THREADSAFE
     pxCfg->lock = &lfs_port_lock;
-    pxCfg->lock = &lfs_port_unlock;
+    pxCfg->unlock = &lfs_port_unlock;
 #endif
 
     pxCfg->read_size = 1;
-    pxCfg->prog_size = 16;
+    pxCfg->prog_size = LFS_CONFIG_QUADWORD_SZ;
     pxCfg->block_size = FLASH_PAGE_SIZE;
 
     pxCfg->block_count = FLASH_PAGE_NB;
@@ -184,6 +208,45 @@ static void vPopulateConfig( struct lfs_config * pxCfg,
     pxCfg->metadata_max = 0;
 }
 
+/*
+ * Return a pointer to the file data that follows the current read position.
+ * The data up to the end of the current block is contiguous in flash and can be
+ * used in place. Advance over it with lfs_file_seek. Returns NULL when the next
+ * byte is not in flash yet or lies in another block, use lfs_file_read then.
+ */
+const void * pvLfsPortInternalFlashReadPtr( lfs_t * pxLfs,
+                                            lfs_file_t * pxFile,
+                                            lfs_size_t * pxLength )
+{
+    const void * pvData = NULL;
+    const struct lfs_config * pxCfg = pxLfs->cfg;
+
+    configASSERT( pxLength != NULL );
+
+    *pxLength = 0;
+
+    if( pxCfg->read != lfs_port_read )
+    {
+        /* Not a filesystem on the internal flash */
+    }
+    else if( ( pxFile->flags & ( LFS_F_READING | LFS_F_WRITING | LFS_F_INLINE ) ) != LFS_F_READING )
+    {
+        /* Data is inline in a metadata pair, buffered, or no block has been read yet */
+    }
+    else if( ( pxFile->off >= pxCfg->block_size ) ||
+             ( pxFile->pos >= pxFile->ctz.size ) )
+    {
+        /* Current block or file is exhausted */
+    }
+    else
+    {
+        *pxLength = lfs_min( pxCfg->block_size - pxFile->off, pxFile->ctz.size - pxFile->pos );
+        pvData = ( const void * ) ( CONFIG_LFS_FLASH_BASE + pxFile->block * pxCfg->block_size + pxFile->off );
+    }
+
+    return pvData;
+}
+
 #ifdef LFS_NO_MALLOC
 
 /*
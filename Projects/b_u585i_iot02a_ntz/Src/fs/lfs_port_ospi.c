@@ -27,29 +27,137 @@
 
 #include "logging_levels.h"
 #define LOG_LEVEL    LOG_ERROR
+#define LOG_MODULE    LOG_MODULE_FS
 #include "logging.h"
 
 #include "FreeRTOS.h"
 #include "semphr.h"
+#include "task.h"
+
+#include <string.h>
 
 #include "lfs_util.h"
 #include "lfs.h"
+#include "lfs_port.h"
 #include "lfs_port_prv.h"
 #include "ospi_nor_mx25lmxxx45g.h"
+#include "profiler.h"
 
 /*
  * LittleFS port for the external NOR flash connected to the STM32U5 octo-spi interface
  */
 
+#if defined( LFS_NO_MALLOC ) || ( LFS_PORT_OSPI_STATIC_BUFFERS == 1 )
+
+/* Place the littlefs caches in a dedicated region, e.g. ".sram4", by defining LFS_PORT_OSPI_BUFFER_SECTION */
+#ifdef LFS_PORT_OSPI_BUFFER_SECTION
+#define LFS_PORT_OSPI_BUFFER_ATTR    __attribute__( ( section( LFS_PORT_OSPI_BUFFER_SECTION ), aligned( 4 ) ) )
+#else
+#define LFS_PORT_OSPI_BUFFER_ATTR    __attribute__( ( aligned( 4 ) ) )
+#endif
+
+static uint8_t ucReadBuffer[ LFS_PORT_OSPI_CACHE_SIZE ] LFS_PORT_OSPI_BUFFER_ATTR;
+static uint8_t ucProgBuffer[ LFS_PORT_OSPI_CACHE_SIZE ] LFS_PORT_OSPI_BUFFER_ATTR;
+static uint8_t ucLookAheadBuffer[ LFS_PORT_OSPI_LOOKAHEAD_SIZE ] LFS_PORT_OSPI_BUFFER_ATTR;
+#endif
+
 #ifdef LFS_NO_MALLOC
-static uint8_t __ALIGN_BEGIN ucReadBuffer[ CONFIG_SIZE_CACHE_BUFFER ] __ALIGN_END = { 0 };
-static uint8_t __ALIGN_BEGIN ucProgBuffer[ CONFIG_SIZE_CACHE_BUFFER ] __ALIGN_END = { 0 };
-static uint8_t __ALIGN_BEGIN ucLookAheadBuffer[ CONFIG_SIZE_LOOKAHEAD_BUFFER ] __ALIGN_END = { 0 };
 static struct lfs_config xLfsCfg = { 0 };
 static struct LfsPortCtx xLfsCtx = { 0 };
 static StaticSemaphore_t xMutexStatic;
 #endif
 
+/* Operation counters since boot, reported by the fsbench command */
+static LfsPortStats_t xPortStats = { 0 };
+
+PROF_PROBE( xProfProg, "lfs_prog" );
+
+/* Sector erases per block since boot */
+static uint16_t usEraseCounts[ MX25LM_NUM_SECTOR_USABLE ] = { 0 };
+
+static inline void vCountErase( lfs_block_t block )
+{
+    if( ( block < MX25LM_NUM_SECTOR_USABLE ) &&
+        ( usEraseCounts[ block ] < UINT16_MAX ) )
+    {
+        usEraseCounts[ block ]++;
+    }
+}
+
+/*
+ * Free blocks are erased ahead of time by vLfsPortPreEraseTask so that
+ * lfs_port_erase can return immediately when littlefs allocates them.
+ */
+#ifndef LFS_PORT_PREERASE_ENABLE
+#define LFS_PORT_PREERASE_ENABLE       1
+#endif
+
+/* Number of erased blocks to keep in reserve */
+#ifndef LFS_PORT_PREERASE_BLOCKS
+#define LFS_PORT_PREERASE_BLOCKS       16
+#endif
+
+/* Time between checks of the erased block reserve */
+#ifndef LFS_PORT_PREERASE_PERIOD_MS
+#define LFS_PORT_PREERASE_PERIOD_MS    ( 10 * 1000 )
+#endif
+
+#if LFS_PORT_PREERASE_ENABLE
+
+#define LFS_PORT_BITMAP_WORDS          ( ( MX25LM_NUM_SECTOR_USABLE + 31 ) / 32 )
+
+/* Blocks erased by the background task and not programmed since */
+static uint32_t ulErasedMap[ LFS_PORT_BITMAP_WORDS ] = { 0 };
+
+/* Blocks programmed or erased by littlefs since the last traversal started */
+static uint32_t ulTouchedMap[ LFS_PORT_BITMAP_WORDS ] = { 0 };
+
+/* Blocks referenced by the filesystem at the last traversal */
+static uint32_t ulInUseMap[ LFS_PORT_BITMAP_WORDS ] = { 0 };
+
+static uint32_t ulErasedCount = 0;
+
+/* The littlefs allocator moves forward from the last allocated block */
+static lfs_block_t xLastProgBlock = 0;
+
+static inline BaseType_t xBitmapTest( const uint32_t * pulMap,
+                                      lfs_block_t block )
+{
+    return( ( pulMap[ block / 32 ] & ( 1UL << ( block % 32 ) ) ) != 0 );
+}
+
+static inline void vBitmapSet( uint32_t * pulMap,
+                               lfs_block_t block )
+{
+    pulMap[ block / 32 ] |= ( 1UL << ( block % 32 ) );
+}
+
+static inline void vBitmapClear( uint32_t * pulMap,
+                                 lfs_block_t block )
+{
+    pulMap[ block / 32 ] &= ~( 1UL << ( block % 32 ) );
+}
+
+/*
+ * Record that littlefs is about to modify a block. Called with the lfs lock held.
+ * @return pdTRUE if the block had been erased in the background and not used since.
+ */
+static BaseType_t xClaimBlock( lfs_block_t block )
+{
+    BaseType_t xWasErased = xBitmapTest( ulErasedMap, block );
+
+    if( xWasErased == pdTRUE )
+    {
+        vBitmapClear( ulErasedMap, block );
+        ulErasedCount--;
+    }
+
+    vBitmapSet( ulTouchedMap, block );
+
+    return xWasErased;
+}
+#endif /* LFS_PORT_PREERASE_ENABLE */
+
 
 /* Forward declarations */
 static int lfs_port_read( const struct lfs_config * c,
@@ -74,8 +182,8 @@ static int lfs_port_sync( const struct lfs_config * c );
 static void vPopulateConfig( struct lfs_config * pxCfg,
                              struct LfsPortCtx * pxCtx )
 {
-    /* Read size is one word */
-    pxCfg->read_size = 1;
+    /* Reads in DTR mode must be aligned to two bytes */
+    pxCfg->read_size = 2;
     pxCfg->prog_size = 256;
 
     /* Number of erasable blocks */
@@ -94,11 +202,11 @@ static void vPopulateConfig( struct lfs_config * pxCfg,
     pxCfg->unlock = &lfs_port_unlock;
 #endif
     /* controls wear leveling */
-    pxCfg->block_cycles = 500;
-    pxCfg->cache_size = 4096;
-    pxCfg->lookahead_size = 256;
+    pxCfg->block_cycles = LFS_PORT_OSPI_BLOCK_CYCLES;
+    pxCfg->cache_size = LFS_PORT_OSPI_CACHE_SIZE;
+    pxCfg->lookahead_size = LFS_PORT_OSPI_LOOKAHEAD_SIZE;
 
-#ifdef LFS_NO_MALLOC
+#if defined( LFS_NO_MALLOC ) || ( LFS_PORT_OSPI_STATIC_BUFFERS == 1 )
     pxCfg->read_buffer = ucReadBuffer;
     pxCfg->prog_buffer = ucProgBuffer;
     pxCfg->lookahead_buffer = ucLookAheadBuffer;
@@ -162,7 +270,7 @@ const struct lfs_config * pxInitializeOSPIFlashFs( TickType_t xBlockTime )
 
     vPopulateConfig( pxCfg, pxCtx );
 
-    BaseType_t xSuccess = ospi_Init( &( pxCtx->xOSPIHandle ) );
+    BaseType_t xSuccess = ospi_Init( &( pxCtx->xOSPIHandle ), MX25LM_DTR_ENABLE );
 
     configASSERT( xSuccess == pdTRUE );
 
@@ -198,6 +306,9 @@ static int lfs_port_read( const struct lfs_config * c,
 
     uint32_t ulReadAddr = OPI_START_ADDRESS + ( block * c->block_size ) + off;
 
+    xPortStats.ulReads++;
+    xPortStats.ulReadBytes += size;
+
     if( ospi_ReadAddr( &( pxCtx->xOSPIHandle ),
                        ulReadAddr,
                        pvBuffer,
@@ -231,29 +342,35 @@ static int lfs_port_prog( const struct lfs_config * pxCfg,
 
     configASSERT( ( size % MX25LM_PROGRAM_FIFO_LEN ) == 0 );
 
+#if LFS_PORT_PREERASE_ENABLE
+    ( void ) xClaimBlock( block );
+    xLastProgBlock = block;
+#endif
+
     /* Determine the 4-byte write address */
     uint32_t ulStartAddr = OPI_START_ADDRESS + ( block * pxCfg->block_size ) + off;
 
-    uint32_t ulLastAddr = ulStartAddr + size - MX25LM_PROGRAM_FIFO_LEN;
+    LogDebug( "Programming Start Addr: 0x%010lX, size: %lu, block: %lu, offset: %lu",
+              ulStartAddr, size, block, off );
 
-    LogDebug( "Programming Start Addr: 0x%010lX, End Addr: 0x%010lX, size: %lu, block: %lu, offset: %lu, rv: %ld",
-              ulStartAddr, ulLastAddr, size, block, off, lReturnValue );
+    xPortStats.ulProgs++;
+    xPortStats.ulProgBytes += size;
 
-    for( uint32_t ulWriteAddr = ulStartAddr; ulWriteAddr <= ulLastAddr; ulWriteAddr += MX25LM_PROGRAM_FIFO_LEN )
-    {
-        LogDebug( "Writing block at addr: 0x%010lX, len: %lu", ulWriteAddr, MX25LM_PROGRAM_FIFO_LEN );
+    /* Each page is sent as soon as the previous one has been programmed. The last one
+     * completes in the background and is waited for by the next flash operation. */
+    PROF_BEGIN( xProfProg );
 
-        if( ospi_WriteAddr( &( pxCtx->xOSPIHandle ),
-                            ulWriteAddr,
-                            &( ( ( uint8_t * ) pvBuffer )[ ulWriteAddr - ulStartAddr ] ),
-                            MX25LM_PROGRAM_FIFO_LEN,
-                            pdMS_TO_TICKS( MX25LM_WRITE_TIMEOUT_MS ) ) != pdTRUE )
-        {
-            lReturnValue = -1;
-            break;
-        }
+    if( ospi_WritePages( &( pxCtx->xOSPIHandle ),
+                         ulStartAddr,
+                         pvBuffer,
+                         size,
+                         pdMS_TO_TICKS( MX25LM_WRITE_TIMEOUT_MS ) ) != pdTRUE )
+    {
+        lReturnValue = -1;
     }
 
+    PROF_END( xProfProg );
+
     return lReturnValue;
 }
 
@@ -269,13 +386,26 @@ static int lfs_port_erase( const struct lfs_config * pxCfg,
     /* Determine the 4-byte erase address */
     uint32_t ulEraseAddr = OPI_START_ADDRESS + ( block * pxCfg->block_size );
 
-    LogDebug( "Starting erase operation addr: 0x%010lX ", ulEraseAddr );
-
-    if( ospi_EraseSector( &( pxCtx->xOSPIHandle ),
-                          ulEraseAddr,
-                          pdMS_TO_TICKS( MX25LM_ERASE_TIMEOUT_MS ) ) != pdTRUE )
+#if LFS_PORT_PREERASE_ENABLE
+    if( xClaimBlock( block ) == pdTRUE )
     {
-        lReturnValue = -1;
+        LogDebug( "Block at addr: 0x%010lX was erased in the background.", ulEraseAddr );
+        xPortStats.ulErasesSkipped++;
+    }
+    else
+#endif
+    {
+        LogDebug( "Starting erase operation addr: 0x%010lX ", ulEraseAddr );
+
+        xPortStats.ulErases++;
+        vCountErase( block );
+
+        if( ospi_EraseSector( &( pxCtx->xOSPIHandle ),
+                              ulEraseAddr,
+                              pdMS_TO_TICKS( MX25LM_ERASE_TIMEOUT_MS ) ) != pdTRUE )
+        {
+            lReturnValue = -1;
+        }
     }
 
     LogDebug( "Erase operation completed. Address: 0x%010lX Return Value: %ld", ulEraseAddr, lReturnValue );
@@ -285,5 +415,147 @@ static int lfs_port_erase( const struct lfs_config * pxCfg,
 
 static int lfs_port_sync( const struct lfs_config * c )
 {
+    configASSERT( c != NULL );
+
+    int32_t lReturnValue = 0;
+    struct LfsPortCtx * pxCtx = ( struct LfsPortCtx * ) c->context;
+
+    if( ospi_Sync( &( pxCtx->xOSPIHandle ),
+                   pdMS_TO_TICKS( MX25LM_WRITE_TIMEOUT_MS ) ) != pdTRUE )
+    {
+        lReturnValue = -1;
+    }
+
+    return lReturnValue;
+}
+
+#if LFS_PORT_PREERASE_ENABLE
+
+static int lfs_port_mark_in_use( void * pvData,
+                                 lfs_block_t block )
+{
+    ( void ) pvData;
+
+    if( block < MX25LM_NUM_SECTOR_USABLE )
+    {
+        vBitmapSet( ulInUseMap, block );
+    }
+
     return 0;
 }
+
+/*
+ * Erase free blocks following the most recently programmed one until the reserve is full.
+ * The flash is locked for one erase at a time so that foreground operations wait at most
+ * one sector erase. A block that littlefs touched after the traversal started may have
+ * been allocated since and is left alone.
+ */
+static void vPreEraseFreeBlocks( const struct lfs_config * pxCfg )
+{
+    struct LfsPortCtx * pxCtx = ( struct LfsPortCtx * ) pxCfg->context;
+    lfs_block_t block = xLastProgBlock;
+
+    for( lfs_block_t ulChecked = 0;
+         ( ulChecked < pxCfg->block_count ) && ( ulErasedCount < LFS_PORT_PREERASE_BLOCKS );
+         ulChecked++ )
+    {
+        block = ( block + 1 ) % pxCfg->block_count;
+
+        if( ( xBitmapTest( ulInUseMap, block ) == pdFALSE ) &&
+            ( xSemaphoreTake( pxCtx->xMutex, pxCtx->xBlockTime ) == pdTRUE ) )
+        {
+            if( ( xBitmapTest( ulTouchedMap, block ) == pdFALSE ) &&
+                ( xBitmapTest( ulErasedMap, block ) == pdFALSE ) )
+            {
+                uint32_t ulEraseAddr = OPI_START_ADDRESS + ( block * pxCfg->block_size );
+
+                xPortStats.ulBackgroundErases++;
+                vCountErase( block );
+
+                if( ospi_EraseSector( &( pxCtx->xOSPIHandle ),
+                                      ulEraseAddr,
+                                      pdMS_TO_TICKS( MX25LM_ERASE_TIMEOUT_MS ) ) == pdTRUE )
+                {
+                    vBitmapSet( ulErasedMap, block );
+                    ulErasedCount++;
+                }
+                else
+                {
+                    LogError( "Background erase of block %lu failed.", block );
+                }
+            }
+
+            ( void ) xSemaphoreGive( pxCtx->xMutex );
+        }
+    }
+}
+
+/*
+ * Low priority task keeping a reserve of erased free blocks.
+ * @param pvParameters Pointer to the mounted lfs_t instance
+ */
+void vLfsPortPreEraseTask( void * pvParameters )
+{
+    lfs_t * pxLfs = ( lfs_t * ) pvParameters;
+    const struct lfs_config * pxCfg = NULL;
+    struct LfsPortCtx * pxCtx = NULL;
+
+    configASSERT( pxLfs != NULL );
+
+    pxCfg = pxLfs->cfg;
+    pxCtx = ( struct LfsPortCtx * ) pxCfg->context;
+
+    configASSERT( pxCfg->block_count <= MX25LM_NUM_SECTOR_USABLE );
+
+    while( 1 )
+    {
+        vTaskDelay( pdMS_TO_TICKS( LFS_PORT_PREERASE_PERIOD_MS ) );
+
+        if( ulErasedCount >= LFS_PORT_PREERASE_BLOCKS )
+        {
+            /* Reserve is full */
+        }
+        else if( xSemaphoreTake( pxCtx->xMutex, pxCtx->xBlockTime ) != pdTRUE )
+        {
+            LogWarn( "Timed out waiting for the flash, skipping pre-erase." );
+        }
+        else
+        {
+            /* Anything littlefs touches from here on is either seen by the traversal or marked */
+            ( void ) memset( ulTouchedMap, 0, sizeof( ulTouchedMap ) );
+            ( void ) memset( ulInUseMap, 0, sizeof( ulInUseMap ) );
+
+            ( void ) xSemaphoreGive( pxCtx->xMutex );
+
+            /* Takes the lfs lock itself */
+            if( lfs_fs_traverse( pxLfs, lfs_port_mark_in_use, NULL ) == LFS_ERR_OK )
+            {
+                vPreEraseFreeBlocks( pxCfg );
+            }
+            else
+            {
+                LogError( "Failed to traverse the filesystem." );
+            }
+        }
+    }
+}
+
+#endif /* LFS_PORT_PREERASE_ENABLE */
+
+void vLfsPortOspiGetStats( LfsPortStats_t * pxStats )
+{
+    configASSERT( pxStats != NULL );
+
+    taskENTER_CRITICAL();
+    *pxStats = xPortStats;
+    taskEXIT_CRITICAL();
+}
+
+const uint16_t * pusLfsPortOspiEraseCounts( size_t * pxBlockCount )
+{
+    configASSERT( pxBlockCount != NULL );
+
+    *pxBlockCount = MX25LM_NUM_SECTOR_USABLE;
+
+    return usEraseCounts;
+}
@@ -27,6 +27,9 @@
 
 #include "FreeRTOS.h"
 #include "semphr.h"
+#include "task.h"
+
+#include "stm32u5xx.h"
 
 #include "lfs_util.h"
 #include "lfs.h"
@@ -52,6 +55,105 @@ int lfs_port_unlock( const struct lfs_config * c )
     return ( int ) ( xReturnVal == pdTRUE ? 0 : -1 );
 }
 
+/* Set to 0 to compute the littlefs CRC in software */
+#ifndef LFS_PORT_HW_CRC
+#define LFS_PORT_HW_CRC    1
+#endif
+
+#if LFS_PORT_HW_CRC
+
+static SemaphoreHandle_t xCrcMutex = NULL;
+
+/*
+ * littlefs uses the reflected CRC-32 (0xEDB88320) without a final xor and continues
+ * from the crc passed in. The CRC unit computes the same CRC with the non-reflected
+ * polynomial 0x04C11DB7 when the input is bit reversed by byte and the output is
+ * bit reversed, starting from the bit reversed running value.
+ */
+static uint32_t lfs_crc_hw( uint32_t crc,
+                            const void * buffer,
+                            size_t size )
+{
+    const uint8_t * pucData = ( const uint8_t * ) buffer;
+
+    CRC->POL = 0x04C11DB7;
+    CRC->CR = CRC_CR_REV_IN_0 | CRC_CR_REV_OUT;
+    CRC->INIT = __RBIT( crc );
+    CRC->CR |= CRC_CR_RESET;
+
+    while( ( size > 0 ) && ( ( ( uint32_t ) pucData & 0x3 ) != 0 ) )
+    {
+        *( ( volatile uint8_t * ) &( CRC->DR ) ) = *pucData;
+        pucData++;
+        size--;
+    }
+
+    /* The unit consumes the first written byte of a word from its most significant end */
+    while( size >= sizeof( uint32_t ) )
+    {
+        CRC->DR = __REV( *( ( const uint32_t * ) pucData ) );
+        pucData += sizeof( uint32_t );
+        size -= sizeof( uint32_t );
+    }
+
+    while( size > 0 )
+    {
+        *( ( volatile uint8_t * ) &( CRC->DR ) ) = *pucData;
+        pucData++;
+        size--;
+    }
+
+    return CRC->DR;
+}
+
+/*
+ * Route lfs_crc through the CRC unit. The unit is shared by every littlefs
+ * instance, so access is serialized by a mutex once the scheduler is running.
+ */
+uint32_t lfs_crc( uint32_t crc,
+                  const void * buffer,
+                  size_t size )
+{
+    static StaticSemaphore_t xCrcMutexStatic;
+    BaseType_t xLocked = pdFALSE;
+
+    if( xTaskGetSchedulerState() == taskSCHEDULER_RUNNING )
+    {
+        if( xCrcMutex == NULL )
+        {
+            taskENTER_CRITICAL();
+
+            if( xCrcMutex == NULL )
+            {
+                xCrcMutex = xSemaphoreCreateMutexStatic( &xCrcMutexStatic );
+            }
+
+            taskEXIT_CRITICAL();
+        }
+
+        xLocked = xSemaphoreTake( xCrcMutex, portMAX_DELAY );
+    }
+
+    if( ( RCC->AHB1ENR & RCC_AHB1ENR_CRCEN ) == 0 )
+    {
+        SET_BIT( RCC->AHB1ENR, RCC_AHB1ENR_CRCEN );
+
+        /* Delay after an RCC peripheral clock enabling */
+        ( void ) READ_BIT( RCC->AHB1ENR, RCC_AHB1ENR_CRCEN );
+    }
+
+    crc = lfs_crc_hw( crc, buffer, size );
+
+    if( xLocked == pdTRUE )
+    {
+        ( void ) xSemaphoreGive( xCrcMutex );
+    }
+
+    return crc;
+}
+
+#else /* LFS_PORT_HW_CRC */
+
 /* The following function lfs_crc is derived from lfs_util.c and
  * is available under the following terms:
  * Copyright (c) 2017, Arm Limited. All rights reserved.
@@ -79,3 +181,5 @@ uint32_t lfs_crc( uint32_t crc,
 
     return crc;
 }
+
+#endif /* LFS_PORT_HW_CRC */
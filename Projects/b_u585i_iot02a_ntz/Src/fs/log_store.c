@@ -0,0 +1,1124 @@
+/*
+ * FreeRTOS STM32 Reference Integration
+ *
+ * Copyright (c) 2022 Amazon.com, Inc. or its affiliates. All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#define LOG_MODULE    LOG_MODULE_FS
+#include "logging.h"
+
+#include "FreeRTOS.h"
+#include "task.h"
+#include "semphr.h"
+#include "message_buffer.h"
+
+#include <string.h>
+
+#include "lfs.h"
+#include "lfs_port_prv.h"
+#include "ospi_nor_mx25lmxxx45g.h"
+#include "log_store.h"
+#include "ram_sections.h"
+
+/* Bytes of log lines queued for the writer task */
+#ifndef LOG_STORE_QUEUE_LEN
+#define LOG_STORE_QUEUE_LEN           ( 4096U )
+#endif
+
+#ifndef LOG_STORE_TASK_PRIORITY
+#define LOG_STORE_TASK_PRIORITY       ( tskIDLE_PRIORITY + 1 )
+#endif
+
+#ifndef LOG_STORE_TASK_STACK_DEPTH
+#define LOG_STORE_TASK_STACK_DEPTH    ( 512U )
+#endif
+
+#define LOG_STORE_SECTOR_MAGIC        ( 0x53474F4CUL ) /* "LOGS" */
+#define LOG_STORE_PAGE_MAGIC          ( 0x50474F4CUL ) /* "LOGP" */
+#define LOG_STORE_HEADER_LEN          ( 8U )
+
+#define LOG_STORE_RECORD_END          ( 0xFFFFU )
+#define LOG_STORE_RECORD_PAD          ( 0x0000U )
+
+#define LOG_STORE_MAX_LITERALS        ( 128U )
+#define LOG_STORE_MAX_MATCH           ( 127U + LOG_STORE_MIN_MATCH )
+#define LOG_STORE_HASH_LEN            ( 256U )
+#define LOG_STORE_HASH_EMPTY          ( 0xFFFFFFFFUL )
+
+#define LOG_STORE_LINE_MAX            ( dlMAX_LOG_LINE_LENGTH )
+
+/* Length field plus the tokens of a line that does not compress at all */
+#define LOG_STORE_RECORD_MAX          ( 2U + LOG_STORE_LINE_MAX + ( ( LOG_STORE_LINE_MAX + LOG_STORE_MAX_LITERALS - 1U ) / LOG_STORE_MAX_LITERALS ) )
+
+#define LOG_STORE_WINDOW_MASK         ( LOG_STORE_WINDOW_LEN - 1U )
+
+#if ( ( LOG_STORE_FLASH_ADDR + ( LOG_STORE_NUM_SECTORS * LOG_STORE_SECTOR_LEN ) ) > MX25LM_MEM_SZ_BYTES )
+#error "The log store does not fit into the OSPI flash"
+#endif
+
+#if ( ( LOG_STORE_HEADER_LEN + LOG_STORE_RECORD_MAX ) > LOG_STORE_SECTOR_LEN )
+#error "LOG_STORE_SECTOR_LEN must hold the longest record"
+#endif
+
+#if ( ( LOG_STORE_WINDOW_LEN & LOG_STORE_WINDOW_MASK ) != 0 ) || ( LOG_STORE_WINDOW_LEN > 0xFFFFU )
+#error "LOG_STORE_WINDOW_LEN must be a power of two that fits the 16 bit match offset"
+#endif
+
+/* Page being filled, kept across resets in SRAM4, which is not cleared at startup */
+typedef struct LogStorePage
+{
+    uint32_t ulMagic;
+    uint32_t ulSector;
+    uint32_t ulSeq;
+    uint32_t ulPageOffset; /* Offset of the page in its sector, LOG_STORE_SECTOR_LEN once the sector is full */
+    uint32_t ulFill;       /* Bytes of ucData in use */
+    uint32_t ulCheck;
+    uint8_t ucData[ LOG_STORE_PAGE_LEN ];
+} LogStorePage_t;
+
+/* Compression state of the sector being written */
+typedef struct LogStoreWriter
+{
+    uint32_t ulSector;
+    uint32_t ulSeq;
+    uint32_t ulTextPos; /* Bytes of text stored in the sector */
+    uint8_t ucWindow[ LOG_STORE_WINDOW_LEN ];
+    uint32_t ulHash[ LOG_STORE_HASH_LEN ];
+} LogStoreWriter_t;
+
+static LogStorePage_t xPage RAM_DMA_BUFFER;
+static LogStoreWriter_t xWriter = { 0 };
+
+static const struct lfs_config * pxLfsCfg = NULL;
+static SemaphoreHandle_t xStoreMutex = NULL;
+static TaskHandle_t xStoreTask = NULL;
+
+static MessageBufferHandle_t xStoreMBuf = NULL;
+static StaticMessageBuffer_t xStoreMBufStruct;
+static uint8_t ucStoreMBufStorage[ LOG_STORE_QUEUE_LEN + 1 ];
+
+/* Used by the writer task, and by vLogStoreDyingGasp once nothing else runs */
+static uint8_t ucLine[ LOG_STORE_LINE_MAX ];
+static uint8_t ucRecord[ LOG_STORE_RECORD_MAX ];
+
+static LogStoreStats_t xStats = { 0 };
+
+/*-----------------------------------------------------------*/
+
+static inline uint32_t prvSectorAddr( uint32_t ulSector )
+{
+    return LOG_STORE_FLASH_ADDR + ( ulSector * LOG_STORE_SECTOR_LEN );
+}
+
+static inline OSPI_HandleTypeDef * prvOspi( void )
+{
+    return &( ( ( struct LfsPortCtx * ) pxLfsCfg->context )->xOSPIHandle );
+}
+
+/* The flash is shared with littlefs, so every access holds its lock */
+static BaseType_t prvFlashRead( uint32_t ulAddr,
+                                void * pvBuffer,
+                                uint32_t ulLen )
+{
+    BaseType_t xResult = pdFALSE;
+
+    if( lfs_port_lock( pxLfsCfg ) == 0 )
+    {
+        xResult = ospi_ReadAddr( prvOspi(), ulAddr, pvBuffer, ulLen, pdMS_TO_TICKS( MX25LM_READ_TIMEOUT_MS ) );
+        ( void ) lfs_port_unlock( pxLfsCfg );
+    }
+
+    return xResult;
+}
+
+static BaseType_t prvFlashProgramPage( uint32_t ulAddr,
+                                       const void * pvPage )
+{
+    BaseType_t xResult = pdFALSE;
+
+    if( lfs_port_lock( pxLfsCfg ) == 0 )
+    {
+        xResult = ospi_WritePages( prvOspi(), ulAddr, pvPage, LOG_STORE_PAGE_LEN, pdMS_TO_TICKS( MX25LM_WRITE_TIMEOUT_MS ) );
+
+        /* Readers must not see the page while it is being programmed */
+        if( xResult == pdTRUE )
+        {
+            xResult = ospi_Sync( prvOspi(), pdMS_TO_TICKS( MX25LM_WRITE_TIMEOUT_MS ) );
+        }
+
+        ( void ) lfs_port_unlock( pxLfsCfg );
+    }
+
+    xStats.ulPagesWritten++;
+
+    return xResult;
+}
+
+static BaseType_t prvFlashEraseSector( uint32_t ulSector )
+{
+    BaseType_t xResult = pdFALSE;
+
+    if( lfs_port_lock( pxLfsCfg ) == 0 )
+    {
+        xResult = ospi_EraseSector( prvOspi(), prvSectorAddr( ulSector ), pdMS_TO_TICKS( MX25LM_ERASE_TIMEOUT_MS ) );
+        ( void ) lfs_port_unlock( pxLfsCfg );
+    }
+
+    xStats.ulSectorsErased++;
+
+    return xResult;
+}
+
+/*-----------------------------------------------------------*/
+
+/* FNV-1a, cheap enough to update after every line and needs no lock or peripheral */
+static uint32_t prvPageCheck( void )
+{
+    uint32_t ulHash = 2166136261UL;
+    const uint32_t ulFields[] = { xPage.ulSector, xPage.ulSeq, xPage.ulPageOffset, xPage.ulFill };
+    const uint8_t * pucFields = ( const uint8_t * ) ulFields;
+
+    for( size_t uxIdx = 0; uxIdx < sizeof( ulFields ); uxIdx++ )
+    {
+        ulHash = ( ulHash ^ pucFields[ uxIdx ] ) * 16777619UL;
+    }
+
+    for( uint32_t ulIdx = 0; ( ulIdx < xPage.ulFill ) && ( ulIdx < LOG_STORE_PAGE_LEN ); ulIdx++ )
+    {
+        ulHash = ( ulHash ^ xPage.ucData[ ulIdx ] ) * 16777619UL;
+    }
+
+    return ulHash;
+}
+
+static inline void prvPageSeal( void )
+{
+    xPage.ulCheck = prvPageCheck();
+}
+
+static BaseType_t prvPageIsValid( void )
+{
+    return( ( xPage.ulMagic == LOG_STORE_PAGE_MAGIC ) &&
+            ( xPage.ulSector < LOG_STORE_NUM_SECTORS ) &&
+            ( xPage.ulPageOffset < LOG_STORE_SECTOR_LEN ) &&
+            ( ( xPage.ulPageOffset % LOG_STORE_PAGE_LEN ) == 0 ) &&
+            ( xPage.ulFill <= LOG_STORE_PAGE_LEN ) &&
+            ( xPage.ulCheck == prvPageCheck() ) );
+}
+
+/* Start filling the page at ulPageOffset of the writer's sector */
+static void prvPageStart( uint32_t ulPageOffset )
+{
+    xPage.ulMagic = 0;
+    xPage.ulSector = xWriter.ulSector;
+    xPage.ulSeq = xWriter.ulSeq;
+    xPage.ulFill = 0;
+
+    if( ulPageOffset < LOG_STORE_SECTOR_LEN )
+    {
+        xPage.ulPageOffset = ulPageOffset;
+        ( void ) memset( xPage.ucData, 0xFF, LOG_STORE_PAGE_LEN );
+
+        if( ulPageOffset == 0 )
+        {
+            const uint32_t ulHeader[ 2 ] = { LOG_STORE_SECTOR_MAGIC, xWriter.ulSeq };
+
+            ( void ) memcpy( xPage.ucData, ulHeader, LOG_STORE_HEADER_LEN );
+            xPage.ulFill = LOG_STORE_HEADER_LEN;
+        }
+
+        prvPageSeal();
+        xPage.ulMagic = LOG_STORE_PAGE_MAGIC;
+    }
+    else
+    {
+        /* The sector is full, the next line starts a new one */
+        xPage.ulPageOffset = LOG_STORE_SECTOR_LEN;
+    }
+}
+
+/* Program the page and continue with the next one */
+static BaseType_t prvPageProgram( void )
+{
+    BaseType_t xResult = prvFlashProgramPage( prvSectorAddr( xPage.ulSector ) + xPage.ulPageOffset, xPage.ucData );
+
+    if( xResult != pdTRUE )
+    {
+        LogError( "Failed to program log page at sector %lu offset %lu.", xPage.ulSector, xPage.ulPageOffset );
+    }
+
+    prvPageStart( xPage.ulPageOffset + LOG_STORE_PAGE_LEN );
+
+    return xResult;
+}
+
+/* Mark the rest of the page as unused so that records may follow on the next page */
+static void prvPagePad( void )
+{
+    if( ( LOG_STORE_PAGE_LEN - xPage.ulFill ) >= 2 )
+    {
+        xPage.ucData[ xPage.ulFill++ ] = ( uint8_t ) ( LOG_STORE_RECORD_PAD & 0xFF );
+        xPage.ucData[ xPage.ulFill++ ] = ( uint8_t ) ( LOG_STORE_RECORD_PAD >> 8 );
+    }
+}
+
+static inline BaseType_t prvPageHasRecords( void )
+{
+    return( ( xPage.ulMagic == LOG_STORE_PAGE_MAGIC ) &&
+            ( xPage.ulFill > ( ( xPage.ulPageOffset == 0 ) ? LOG_STORE_HEADER_LEN : 0 ) ) );
+}
+
+/*-----------------------------------------------------------*/
+
+static void prvWriterReset( uint32_t ulSector,
+                            uint32_t ulSeq )
+{
+    xWriter.ulSector = ulSector;
+    xWriter.ulSeq = ulSeq;
+    xWriter.ulTextPos = 0;
+
+    for( uint32_t ulIdx = 0; ulIdx < LOG_STORE_HASH_LEN; ulIdx++ )
+    {
+        xWriter.ulHash[ ulIdx ] = LOG_STORE_HASH_EMPTY;
+    }
+}
+
+/* Program what is left of the current sector and erase the oldest one to continue in */
+static void prvNextSector( void )
+{
+    uint32_t ulSector = ( xWriter.ulSector + 1 ) % LOG_STORE_NUM_SECTORS;
+
+    if( prvPageHasRecords() == pdTRUE )
+    {
+        /* The erased bytes following the last record end the sector */
+        ( void ) prvPageProgram();
+    }
+
+    if( prvFlashEraseSector( ulSector ) != pdTRUE )
+    {
+        LogError( "Failed to erase log sector %lu.", ulSector );
+    }
+
+    prvWriterReset( ulSector, xWriter.ulSeq + 1 );
+    prvPageStart( 0 );
+}
+
+static inline uint32_t prvHash( const uint8_t * pucData )
+{
+    uint32_t ulWord = ( uint32_t ) pucData[ 0 ] |
+                      ( ( uint32_t ) pucData[ 1 ] << 8 ) |
+                      ( ( uint32_t ) pucData[ 2 ] << 16 ) |
+                      ( ( uint32_t ) pucData[ 3 ] << 24 );
+
+    return ( uint32_t ) ( ulWord * 2654435761UL ) >> 24;
+}
+
+/* Byte at a text position of the sector, either still in the window or part of the line being encoded */
+static inline uint8_t prvTextAt( const uint8_t * pucLine,
+                                 uint32_t ulPos )
+{
+    return ( ulPos < xWriter.ulTextPos ) ? xWriter.ucWindow[ ulPos & LOG_STORE_WINDOW_MASK ] :
+           pucLine[ ulPos - xWriter.ulTextPos ];
+}
+
+static size_t prvEmitLiterals( uint8_t * pucOut,
+                               const uint8_t * pucLiterals,
+                               size_t uxLen )
+{
+    size_t uxOut = 0;
+
+    while( uxLen > 0 )
+    {
+        size_t uxRun = ( uxLen > LOG_STORE_MAX_LITERALS ) ? LOG_STORE_MAX_LITERALS : uxLen;
+
+        pucOut[ uxOut++ ] = ( uint8_t ) ( uxRun - 1 );
+        ( void ) memcpy( &( pucOut[ uxOut ] ), pucLiterals, uxRun );
+
+        uxOut += uxRun;
+        pucLiterals += uxRun;
+        uxLen -= uxRun;
+    }
+
+    return uxOut;
+}
+
+/*
+ * Greedy LZ77 against the last LOG_STORE_WINDOW_LEN bytes of text in the sector.
+ * Every match is verified, so hash entries of text that was never stored only cost ratio.
+ */
+static size_t prvEncodeLine( const uint8_t * pucLine,
+                             size_t uxLen,
+                             uint8_t * pucOut )
+{
+    size_t uxOut = 0;
+    size_t uxIdx = 0;
+    size_t uxLiteralStart = 0;
+
+    while( ( uxIdx + LOG_STORE_MIN_MATCH ) <= uxLen )
+    {
+        uint32_t ulPos = xWriter.ulTextPos + uxIdx;
+        uint32_t ulHash = prvHash( &( pucLine[ uxIdx ] ) );
+        uint32_t ulCandidate = xWriter.ulHash[ ulHash ];
+        size_t uxMatch = 0;
+
+        xWriter.ulHash[ ulHash ] = ulPos;
+
+        if( ( ulCandidate != LOG_STORE_HASH_EMPTY ) &&
+            ( ulCandidate < ulPos ) &&
+            ( ( ulPos - ulCandidate ) <= LOG_STORE_WINDOW_LEN ) )
+        {
+            while( ( ( uxIdx + uxMatch ) < uxLen ) &&
+                   ( uxMatch < LOG_STORE_MAX_MATCH ) &&
+                   ( prvTextAt( pucLine, ulCandidate + uxMatch ) == pucLine[ uxIdx + uxMatch ] ) )
+            {
+                uxMatch++;
+            }
+        }
+
+        if( uxMatch >= LOG_STORE_MIN_MATCH )
+        {
+            uint32_t ulOffset = ulPos - ulCandidate;
+
+            uxOut += prvEmitLiterals( &( pucOut[ uxOut ] ), &( pucLine[ uxLiteralStart ] ), uxIdx - uxLiteralStart );
+
+            pucOut[ uxOut++ ] = ( uint8_t ) ( 0x80U | ( uxMatch - LOG_STORE_MIN_MATCH ) );
+            pucOut[ uxOut++ ] = ( uint8_t ) ( ulOffset & 0xFF );
+            pucOut[ uxOut++ ] = ( uint8_t ) ( ulOffset >> 8 );
+
+            uxIdx += uxMatch;
+            uxLiteralStart = uxIdx;
+        }
+        else
+        {
+            uxIdx++;
+        }
+    }
+
+    uxOut += prvEmitLiterals( &( pucOut[ uxOut ] ), &( pucLine[ uxLiteralStart ] ), uxLen - uxLiteralStart );
+
+    return uxOut;
+}
+
+/* Copy bytes to the page, programming it whenever it is full if xProgram is set */
+static void prvStageBytes( const uint8_t * pucData,
+                           size_t uxLen,
+                           BaseType_t xProgram )
+{
+    while( uxLen > 0 )
+    {
+        size_t uxChunk = LOG_STORE_PAGE_LEN - xPage.ulFill;
+
+        if( uxChunk > uxLen )
+        {
+            uxChunk = uxLen;
+        }
+
+        ( void ) memcpy( &( xPage.ucData[ xPage.ulFill ] ), pucData, uxChunk );
+        xPage.ulFill += uxChunk;
+        pucData += uxChunk;
+        uxLen -= uxChunk;
+
+        if( ( xPage.ulFill == LOG_STORE_PAGE_LEN ) && ( xProgram == pdTRUE ) )
+        {
+            ( void ) prvPageProgram();
+            configASSERT( ( uxLen == 0 ) || ( xPage.ulMagic == LOG_STORE_PAGE_MAGIC ) );
+        }
+    }
+}
+
+/*
+ * Compress a line and append it to the ring.
+ * Without xProgram, the line is only stored if it fits into the page in RAM.
+ * PRE: xStoreMutex held, or called from vLogStoreDyingGasp.
+ */
+static BaseType_t prvAppendLine( const uint8_t * pucLine,
+                                 size_t uxLen,
+                                 BaseType_t xProgram )
+{
+    BaseType_t xStored = pdFALSE;
+    size_t uxRecord = 0;
+    uint32_t ulSkip = 0;
+
+    if( uxLen > LOG_STORE_LINE_MAX )
+    {
+        uxLen = LOG_STORE_LINE_MAX;
+    }
+
+    for( uint32_t ulTry = 0; ( ulTry < 2 ) && ( xStored == pdFALSE ); ulTry++ )
+    {
+        uint32_t ulOffset = xPage.ulPageOffset + xPage.ulFill;
+
+        if( xPage.ulPageOffset < LOG_STORE_SECTOR_LEN )
+        {
+            /* A record never starts on the last byte of a page */
+            ulSkip = ( ( ulOffset % LOG_STORE_PAGE_LEN ) == ( LOG_STORE_PAGE_LEN - 1 ) ) ? 1 : 0;
+
+            uxRecord = 2 + prvEncodeLine( pucLine, uxLen, &( ucRecord[ 2 ] ) );
+        }
+
+        if( ( xPage.ulPageOffset < LOG_STORE_SECTOR_LEN ) &&
+            ( ( ulOffset + ulSkip + uxRecord ) <= LOG_STORE_SECTOR_LEN ) &&
+            ( ( xProgram == pdTRUE ) || ( ( xPage.ulFill + ulSkip + uxRecord ) <= LOG_STORE_PAGE_LEN ) ) )
+        {
+            xStored = pdTRUE;
+        }
+        else if( ( xProgram == pdTRUE ) && ( ulTry == 0 ) )
+        {
+            prvNextSector();
+        }
+        else
+        {
+            break;
+        }
+    }
+
+    if( xStored == pdTRUE )
+    {
+        const uint8_t ucErased = 0xFF;
+
+        ucRecord[ 0 ] = ( uint8_t ) ( ( uxRecord - 2 ) & 0xFF );
+        ucRecord[ 1 ] = ( uint8_t ) ( ( uxRecord - 2 ) >> 8 );
+
+        if( ulSkip != 0 )
+        {
+            prvStageBytes( &ucErased, 1, xProgram );
+        }
+
+        prvStageBytes( ucRecord, uxRecord, xProgram );
+
+        for( size_t uxIdx = 0; uxIdx < uxLen; uxIdx++ )
+        {
+            xWriter.ucWindow[ ( xWriter.ulTextPos + uxIdx ) & LOG_STORE_WINDOW_MASK ] = pucLine[ uxIdx ];
+        }
+
+        xWriter.ulTextPos += uxLen;
+
+        if( xPage.ulMagic == LOG_STORE_PAGE_MAGIC )
+        {
+            prvPageSeal();
+        }
+
+        xStats.ulLines++;
+        xStats.ulTextBytes += uxLen;
+        xStats.ulStoredBytes += uxRecord;
+    }
+
+    return xStored;
+}
+
+/*-----------------------------------------------------------*/
+
+/* Load the page at the cursor offset, unless the sector was reused since the cursor reached it */
+static BaseType_t prvCursorLoadPage( LogStoreCursor_t * pxCursor )
+{
+    uint32_t ulPageOffset = pxCursor->ulOffset & ~( LOG_STORE_PAGE_LEN - 1U );
+    uint32_t ulHeader[ 2 ] = { 0 };
+    BaseType_t xResult = pdTRUE;
+
+    if( ( pxCursor->xPageValid == pdFALSE ) || ( pxCursor->ulPageOffset != ulPageOffset ) )
+    {
+        BaseType_t xStaged = pdFALSE;
+
+        pxCursor->xPageValid = pdFALSE;
+        pxCursor->ulPageOffset = ulPageOffset;
+
+        /* The page being filled is only in RAM, records are staged whole so a copy never ends mid record */
+        if( xStoreMutex != NULL )
+        {
+            ( void ) xSemaphoreTake( xStoreMutex, portMAX_DELAY );
+
+            if( ( xPage.ulMagic == LOG_STORE_PAGE_MAGIC ) &&
+                ( xPage.ulSector == pxCursor->ulSector ) &&
+                ( xPage.ulSeq == pxCursor->ulSeq ) &&
+                ( xPage.ulPageOffset == ulPageOffset ) )
+            {
+                ( void ) memcpy( pxCursor->ucPage, xPage.ucData, LOG_STORE_PAGE_LEN );
+                xStaged = pdTRUE;
+            }
+
+            ( void ) xSemaphoreGive( xStoreMutex );
+        }
+
+        if( xStaged == pdFALSE )
+        {
+            xResult = prvFlashRead( prvSectorAddr( pxCursor->ulSector ) + ulPageOffset, pxCursor->ucPage, LOG_STORE_PAGE_LEN );
+        }
+
+        if( xResult == pdTRUE )
+        {
+            if( ulPageOffset == 0 )
+            {
+                ( void ) memcpy( ulHeader, pxCursor->ucPage, LOG_STORE_HEADER_LEN );
+            }
+            else
+            {
+                xResult = prvFlashRead( prvSectorAddr( pxCursor->ulSector ), ulHeader, LOG_STORE_HEADER_LEN );
+            }
+        }
+
+        if( ( xResult == pdTRUE ) &&
+            ( ulHeader[ 0 ] == LOG_STORE_SECTOR_MAGIC ) &&
+            ( ulHeader[ 1 ] == pxCursor->ulSeq ) )
+        {
+            pxCursor->xPageValid = pdTRUE;
+        }
+        else
+        {
+            xResult = pdFALSE;
+        }
+    }
+
+    return xResult;
+}
+
+static BaseType_t prvCursorReadByte( LogStoreCursor_t * pxCursor,
+                                     uint8_t * pucByte )
+{
+    BaseType_t xResult = pdFALSE;
+
+    if( ( pxCursor->ulOffset < LOG_STORE_SECTOR_LEN ) &&
+        ( prvCursorLoadPage( pxCursor ) == pdTRUE ) )
+    {
+        *pucByte = pxCursor->ucPage[ pxCursor->ulOffset & ( LOG_STORE_PAGE_LEN - 1U ) ];
+        pxCursor->ulOffset++;
+        xResult = pdTRUE;
+    }
+
+    return xResult;
+}
+
+static inline void prvCursorPutText( LogStoreCursor_t * pxCursor,
+                                     uint8_t ucByte,
+                                     char * pcBuffer,
+                                     size_t uxBufferLen,
+                                     size_t * puxLen )
+{
+    pxCursor->ucWindow[ pxCursor->ulTextPos & LOG_STORE_WINDOW_MASK ] = ucByte;
+    pxCursor->ulTextPos++;
+
+    if( ( *puxLen + 1 ) < uxBufferLen )
+    {
+        pcBuffer[ ( *puxLen )++ ] = ( char ) ucByte;
+    }
+}
+
+/* Expand the tokens of one record */
+static BaseType_t prvCursorDecode( LogStoreCursor_t * pxCursor,
+                                   uint32_t ulRecordLen,
+                                   char * pcBuffer,
+                                   size_t uxBufferLen,
+                                   size_t * puxLen )
+{
+    BaseType_t xResult = pdTRUE;
+    uint32_t ulEnd = pxCursor->ulOffset + ulRecordLen;
+    uint8_t ucToken = 0;
+
+    while( ( xResult == pdTRUE ) && ( pxCursor->ulOffset < ulEnd ) )
+    {
+        xResult = prvCursorReadByte( pxCursor, &ucToken );
+
+        if( ( xResult == pdTRUE ) && ( ucToken < 0x80U ) )
+        {
+            uint32_t ulRun = ( uint32_t ) ucToken + 1;
+            uint8_t ucByte = 0;
+
+            xResult = ( ( pxCursor->ulOffset + ulRun ) <= ulEnd ) ? pdTRUE : pdFALSE;
+
+            for( uint32_t ulIdx = 0; ( xResult == pdTRUE ) && ( ulIdx < ulRun ); ulIdx++ )
+            {
+                xResult = prvCursorReadByte( pxCursor, &ucByte );
+                prvCursorPutText( pxCursor, ucByte, pcBuffer, uxBufferLen, puxLen );
+            }
+        }
+        else if( xResult == pdTRUE )
+        {
+            uint32_t ulMatch = ( uint32_t ) ( ucToken & 0x7FU ) + LOG_STORE_MIN_MATCH;
+            uint8_t ucOffset[ 2 ] = { 0 };
+            uint32_t ulOffset = 0;
+
+            xResult = ( ( pxCursor->ulOffset + 2 ) <= ulEnd ) ? pdTRUE : pdFALSE;
+
+            if( xResult == pdTRUE )
+            {
+                xResult = prvCursorReadByte( pxCursor, &( ucOffset[ 0 ] ) );
+            }
+
+            if( xResult == pdTRUE )
+            {
+                xResult = prvCursorReadByte( pxCursor, &( ucOffset[ 1 ] ) );
+            }
+
+            ulOffset = ( uint32_t ) ucOffset[ 0 ] | ( ( uint32_t ) ucOffset[ 1 ] << 8 );
+
+            if( ( ulOffset == 0 ) ||
+                ( ulOffset > LOG_STORE_WINDOW_LEN ) ||
+                ( ulOffset > pxCursor->ulTextPos ) )
+            {
+                xResult = pdFALSE;
+            }
+
+            for( uint32_t ulIdx = 0; ( xResult == pdTRUE ) && ( ulIdx < ulMatch ); ulIdx++ )
+            {
+                uint8_t ucByte = pxCursor->ucWindow[ ( pxCursor->ulTextPos - ulOffset ) & LOG_STORE_WINDOW_MASK ];
+
+                prvCursorPutText( pxCursor, ucByte, pcBuffer, uxBufferLen, puxLen );
+            }
+        }
+        else
+        {
+            /* Read failed */
+        }
+    }
+
+    return xResult;
+}
+
+/*
+ * Read the next record of the cursor's sector.
+ * At the end of the sector, the cursor offset is left at the end of the last record.
+ */
+static BaseType_t prvCursorNextRecord( LogStoreCursor_t * pxCursor,
+                                       char * pcBuffer,
+                                       size_t uxBufferLen,
+                                       size_t * puxLen )
+{
+    BaseType_t xRecord = pdFALSE;
+    BaseType_t xEnd = pdFALSE;
+
+    *puxLen = 0;
+
+    while( ( xRecord == pdFALSE ) && ( xEnd == pdFALSE ) )
+    {
+        uint32_t ulStart = pxCursor->ulOffset;
+        uint8_t ucLen[ 2 ] = { 0 };
+        uint32_t ulRecordLen = 0;
+
+        if( ( ulStart % LOG_STORE_PAGE_LEN ) == ( LOG_STORE_PAGE_LEN - 1 ) )
+        {
+            ulStart++;
+            pxCursor->ulOffset = ulStart;
+        }
+
+        if( ( ( ulStart + 2 ) > LOG_STORE_SECTOR_LEN ) ||
+            ( prvCursorReadByte( pxCursor, &( ucLen[ 0 ] ) ) != pdTRUE ) ||
+            ( prvCursorReadByte( pxCursor, &( ucLen[ 1 ] ) ) != pdTRUE ) )
+        {
+            pxCursor->ulOffset = ulStart;
+            xEnd = pdTRUE;
+        }
+        else
+        {
+            ulRecordLen = ( uint32_t ) ucLen[ 0 ] | ( ( uint32_t ) ucLen[ 1 ] << 8 );
+
+            if( ulRecordLen == LOG_STORE_RECORD_END )
+            {
+                pxCursor->ulOffset = ulStart;
+                xEnd = pdTRUE;
+            }
+            else if( ulRecordLen == LOG_STORE_RECORD_PAD )
+            {
+                pxCursor->ulOffset = ( pxCursor->ulOffset + LOG_STORE_PAGE_LEN - 1 ) & ~( LOG_STORE_PAGE_LEN - 1U );
+            }
+            else if( ( ( pxCursor->ulOffset + ulRecordLen ) <= LOG_STORE_SECTOR_LEN ) &&
+                     ( prvCursorDecode( pxCursor, ulRecordLen, pcBuffer, uxBufferLen, puxLen ) == pdTRUE ) )
+            {
+                xRecord = pdTRUE;
+            }
+            else
+            {
+                /* Corrupt record, nothing more can be appended to this sector either */
+                pxCursor->ulOffset = LOG_STORE_SECTOR_LEN;
+                xEnd = pdTRUE;
+            }
+        }
+    }
+
+    if( uxBufferLen > 0 )
+    {
+        pcBuffer[ *puxLen ] = '\0';
+    }
+
+    return xRecord;
+}
+
+static void prvCursorStartSector( LogStoreCursor_t * pxCursor,
+                                  uint32_t ulSector,
+                                  uint32_t ulSeq )
+{
+    pxCursor->ulSector = ulSector;
+    pxCursor->ulSeq = ulSeq;
+    pxCursor->ulOffset = LOG_STORE_HEADER_LEN;
+    pxCursor->ulTextPos = 0;
+    pxCursor->xPageValid = pdFALSE;
+}
+
+/* Find the oldest and the newest sector holding a header */
+static BaseType_t prvFindSectors( uint32_t * pulOldest,
+                                  uint32_t * pulOldestSeq,
+                                  uint32_t * pulNewest,
+                                  uint32_t * pulNewestSeq )
+{
+    BaseType_t xFound = pdFALSE;
+
+    for( uint32_t ulSector = 0; ulSector < LOG_STORE_NUM_SECTORS; ulSector++ )
+    {
+        uint32_t ulHeader[ 2 ] = { 0 };
+
+        if( ( prvFlashRead( prvSectorAddr( ulSector ), ulHeader, LOG_STORE_HEADER_LEN ) == pdTRUE ) &&
+            ( ulHeader[ 0 ] == LOG_STORE_SECTOR_MAGIC ) &&
+            ( ulHeader[ 1 ] != 0xFFFFFFFFUL ) )
+        {
+            if( ( xFound == pdFALSE ) || ( ulHeader[ 1 ] < *pulOldestSeq ) )
+            {
+                *pulOldest = ulSector;
+                *pulOldestSeq = ulHeader[ 1 ];
+            }
+
+            if( ( xFound == pdFALSE ) || ( ulHeader[ 1 ] > *pulNewestSeq ) )
+            {
+                *pulNewest = ulSector;
+                *pulNewestSeq = ulHeader[ 1 ];
+            }
+
+            xFound = pdTRUE;
+        }
+    }
+
+    return xFound;
+}
+
+/*-----------------------------------------------------------*/
+
+/* Program the page that was being filled when the device was reset */
+static BaseType_t prvRecoverPage( void )
+{
+    BaseType_t xRecovered = pdFALSE;
+
+    if( ( prvPageIsValid() == pdTRUE ) && ( prvPageHasRecords() == pdTRUE ) )
+    {
+        uint32_t ulSectorAddr = prvSectorAddr( xPage.ulSector );
+        uint32_t ulHeader[ 2 ] = { 0 };
+        BaseType_t xErased = prvFlashRead( ulSectorAddr + xPage.ulPageOffset, ucRecord, LOG_STORE_PAGE_LEN );
+
+        for( uint32_t ulIdx = 0; ( xErased == pdTRUE ) && ( ulIdx < LOG_STORE_PAGE_LEN ); ulIdx++ )
+        {
+            xErased = ( ucRecord[ ulIdx ] == 0xFF ) ? pdTRUE : pdFALSE;
+        }
+
+        /* A page in the middle of a sector only belongs to it if the sector was not reused since */
+        if( ( xErased == pdTRUE ) && ( xPage.ulPageOffset != 0 ) )
+        {
+            xErased = prvFlashRead( ulSectorAddr, ulHeader, LOG_STORE_HEADER_LEN );
+
+            if( ( ulHeader[ 0 ] != LOG_STORE_SECTOR_MAGIC ) || ( ulHeader[ 1 ] != xPage.ulSeq ) )
+            {
+                xErased = pdFALSE;
+            }
+        }
+
+        if( xErased == pdTRUE )
+        {
+            prvPagePad();
+            xRecovered = prvFlashProgramPage( ulSectorAddr + xPage.ulPageOffset, xPage.ucData );
+        }
+    }
+
+    xPage.ulMagic = 0;
+
+    return xRecovered;
+}
+
+/* Continue after the last record of the newest sector, or start the ring */
+static BaseType_t prvResume( void )
+{
+    uint32_t ulOldest = 0;
+    uint32_t ulOldestSeq = 0;
+    uint32_t ulNewest = 0;
+    uint32_t ulNewestSeq = 0;
+    BaseType_t xResult = pdTRUE;
+
+    if( prvFindSectors( &ulOldest, &ulOldestSeq, &ulNewest, &ulNewestSeq ) == pdFALSE )
+    {
+        prvWriterReset( 0, 1 );
+
+        if( prvFlashEraseSector( 0 ) != pdTRUE )
+        {
+            LogError( "Failed to erase log sector 0." );
+        }
+
+        prvPageStart( 0 );
+    }
+    else
+    {
+        LogStoreCursor_t * pxCursor = pvPortMalloc( sizeof( LogStoreCursor_t ) );
+        char cText = '\0';
+        size_t uxLen = 0;
+
+        if( pxCursor == NULL )
+        {
+            xResult = pdFALSE;
+        }
+        else
+        {
+            prvCursorStartSector( pxCursor, ulNewest, ulNewestSeq );
+
+            while( prvCursorNextRecord( pxCursor, &cText, 1, &uxLen ) == pdTRUE )
+            {
+            }
+
+            prvWriterReset( ulNewest, ulNewestSeq );
+
+            ( void ) memcpy( xWriter.ucWindow, pxCursor->ucWindow, LOG_STORE_WINDOW_LEN );
+            xWriter.ulTextPos = pxCursor->ulTextPos;
+
+            /* Pages are only programmed once, so appending continues on an unused page */
+            if( ( pxCursor->ulOffset % LOG_STORE_PAGE_LEN ) == 0 )
+            {
+                prvPageStart( pxCursor->ulOffset );
+            }
+            else
+            {
+                prvPageStart( LOG_STORE_SECTOR_LEN );
+            }
+
+            vPortFree( pxCursor );
+        }
+    }
+
+    return xResult;
+}
+
+/*-----------------------------------------------------------*/
+
+static void prvLogStoreTask( void * pvParameters )
+{
+    ( void ) pvParameters;
+
+    for( ; ; )
+    {
+        size_t uxLen = xMessageBufferReceive( xStoreMBuf, ucLine, sizeof( ucLine ), portMAX_DELAY );
+
+        if( uxLen > 0 )
+        {
+            ( void ) xSemaphoreTake( xStoreMutex, portMAX_DELAY );
+
+            if( prvAppendLine( ucLine, uxLen, pdTRUE ) != pdTRUE )
+            {
+                xStats.ulDropped++;
+            }
+
+            ( void ) xSemaphoreGive( xStoreMutex );
+        }
+    }
+}
+
+BaseType_t xLogStoreInit( const struct lfs_config * pxCfg )
+{
+    BaseType_t xResult = pdFALSE;
+
+    configASSERT( pxCfg != NULL );
+    configASSERT( xStoreTask == NULL );
+
+    pxLfsCfg = pxCfg;
+
+    xStats.xRecovered = prvRecoverPage();
+
+    xStoreMutex = xSemaphoreCreateMutex();
+
+    if( xStoreMutex != NULL )
+    {
+        xResult = prvResume();
+    }
+
+    if( xResult == pdTRUE )
+    {
+        xResult = xTaskCreate( prvLogStoreTask, "LogStore", LOG_STORE_TASK_STACK_DEPTH, NULL, LOG_STORE_TASK_PRIORITY, &xStoreTask );
+    }
+
+    if( xResult == pdTRUE )
+    {
+        LogInfo( "Log store at sector %lu, sequence %lu%s.", xWriter.ulSector, xWriter.ulSeq,
+                 ( xStats.xRecovered == pdTRUE ) ? ", saved the lines logged before the last reset" : "" );
+    }
+    else
+    {
+        LogError( "Failed to start the log store." );
+    }
+
+    return xResult;
+}
+
+/*-----------------------------------------------------------*/
+
+void vLogStoreWriteLine( const char * pcLine,
+                         size_t uxLen )
+{
+    BaseType_t xHigherPriorityTaskWoken = pdFALSE;
+    UBaseType_t uxSavedInterruptStatus = taskENTER_CRITICAL_FROM_ISR();
+
+    /* Lines logged before xLogStoreInit are queued until the writer starts */
+    if( xStoreMBuf == NULL )
+    {
+        xStoreMBuf = xMessageBufferCreateStatic( sizeof( ucStoreMBufStorage ), ucStoreMBufStorage, &xStoreMBufStruct );
+    }
+
+    if( uxLen > LOG_STORE_LINE_MAX )
+    {
+        uxLen = LOG_STORE_LINE_MAX;
+    }
+
+    if( ( uxLen > 0 ) &&
+        ( xMessageBufferSendFromISR( xStoreMBuf, pcLine, uxLen, &xHigherPriorityTaskWoken ) == 0 ) )
+    {
+        xStats.ulDropped++;
+    }
+
+    taskEXIT_CRITICAL_FROM_ISR( uxSavedInterruptStatus );
+
+    if( xPortIsInsideInterrupt() == pdTRUE )
+    {
+        portYIELD_FROM_ISR( xHigherPriorityTaskWoken );
+    }
+}
+
+void vLogStoreDyingGasp( void )
+{
+    if( ( xStoreTask != NULL ) && ( xStoreMBuf != NULL ) )
+    {
+        size_t uxLen = 0;
+
+        do
+        {
+            uxLen = xMessageBufferReceiveFromISR( xStoreMBuf, ucLine, sizeof( ucLine ), NULL );
+        }
+        while( ( uxLen > 0 ) && ( prvAppendLine( ucLine, uxLen, pdFALSE ) == pdTRUE ) );
+    }
+}
+
+/*-----------------------------------------------------------*/
+
+BaseType_t xLogStoreFlush( void )
+{
+    BaseType_t xResult = pdFALSE;
+
+    if( xStoreTask != NULL )
+    {
+        ( void ) xSemaphoreTake( xStoreMutex, portMAX_DELAY );
+
+        xResult = pdTRUE;
+
+        if( prvPageHasRecords() == pdTRUE )
+        {
+            prvPagePad();
+            xResult = prvPageProgram();
+        }
+
+        ( void ) xSemaphoreGive( xStoreMutex );
+    }
+
+    return xResult;
+}
+
+BaseType_t xLogStoreErase( void )
+{
+    BaseType_t xResult = pdFALSE;
+
+    if( xStoreTask != NULL )
+    {
+        ( void ) xSemaphoreTake( xStoreMutex, portMAX_DELAY );
+
+        xResult = pdTRUE;
+
+        for( uint32_t ulSector = 0; ulSector < LOG_STORE_NUM_SECTORS; ulSector++ )
+        {
+            if( prvFlashEraseSector( ulSector ) != pdTRUE )
+            {
+                xResult = pdFALSE;
+            }
+        }
+
+        prvWriterReset( 0, xWriter.ulSeq + 1 );
+        prvPageStart( 0 );
+
+        ( void ) xSemaphoreGive( xStoreMutex );
+    }
+
+    return xResult;
+}
+
+void vLogStoreGetStats( LogStoreStats_t * pxStats )
+{
+    configASSERT( pxStats != NULL );
+
+    *pxStats = xStats;
+    pxStats->ulSector = xWriter.ulSector;
+    pxStats->ulSeq = xWriter.ulSeq;
+}
+
+/*-----------------------------------------------------------*/
+
+BaseType_t xLogStoreCursorInit( LogStoreCursor_t * pxCursor )
+{
+    BaseType_t xResult = pdFALSE;
+    uint32_t ulOldest = 0;
+    uint32_t ulOldestSeq = 0;
+    uint32_t ulNewest = 0;
+    uint32_t ulNewestSeq = 0;
+
+    configASSERT( pxCursor != NULL );
+
+    if( ( pxLfsCfg != NULL ) &&
+        ( prvFindSectors( &ulOldest, &ulOldestSeq, &ulNewest, &ulNewestSeq ) == pdTRUE ) )
+    {
+        uint32_t ulSectors = ulNewestSeq - ulOldestSeq + 1;
+
+        prvCursorStartSector( pxCursor, ulOldest, ulOldestSeq );
+        pxCursor->ulSectorsLeft = ( ulSectors > LOG_STORE_NUM_SECTORS ) ? ( LOG_STORE_NUM_SECTORS - 1 ) : ( ulSectors - 1 );
+        xResult = pdTRUE;
+    }
+
+    return xResult;
+}
+
+BaseType_t xLogStoreReadLine( LogStoreCursor_t * pxCursor,
+                              char * pcBuffer,
+                              size_t uxBufferLen,
+                              size_t * puxLen )
+{
+    BaseType_t xResult = pdFALSE;
+
+    configASSERT( pxCursor != NULL );
+    configASSERT( pcBuffer != NULL );
+    configASSERT( uxBufferLen > 0 );
+    configASSERT( puxLen != NULL );
+
+    xResult = prvCursorNextRecord( pxCursor, pcBuffer, uxBufferLen, puxLen );
+
+    /* Sectors are written in sequence, so the next one follows in ring order */
+    while( ( xResult == pdFALSE ) && ( pxCursor->ulSectorsLeft > 0 ) )
+    {
+        pxCursor->ulSectorsLeft--;
+        prvCursorStartSector( pxCursor, ( pxCursor->ulSector + 1 ) % LOG_STORE_NUM_SECTORS, pxCursor->ulSeq + 1 );
+
+        xResult = prvCursorNextRecord( pxCursor, pcBuffer, uxBufferLen, puxLen );
+    }
+
+    return xResult;
+}
@@ -0,0 +1,158 @@
+/*
+ * FreeRTOS STM32 Reference Integration
+ *
+ * Copyright (c) 2022 Amazon.com, Inc. or its affiliates. All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+/**
+ * @file log_store.h
+ * @brief Persistent log ring in a dedicated region of the OSPI NOR flash.
+ *
+ * Log lines are queued by the logger, compressed by a low priority task and
+ * appended to a ring of flash sectors located after the littlefs partition.
+ * Each sector starts with a header holding a sequence number, followed by
+ * records of a 16 bit length and the compressed line, all little endian:
+ *
+ *   sector:  uint32 magic, uint32 sequence, records
+ *   record:  uint16 length, tokens
+ *   tokens:  0x00 - 0x7F: ( token + 1 ) literal bytes follow
+ *            0x80 - 0xFF: copy ( token - 0x80 + LOG_STORE_MIN_MATCH ) bytes
+ *                         from uint16 offset bytes back in the sector's text
+ *
+ * A record length of 0xFFFF marks the end of a sector, 0 skips to the next
+ * page. Records never start on the last byte of a page.
+ *
+ * Flash is only programmed a whole page at a time. The page being filled is
+ * kept in RAM that is not cleared on reset and programmed on the next boot,
+ * so the lines logged shortly before a crash or watchdog reset are kept.
+ */
+
+#ifndef LOG_STORE_H_
+#define LOG_STORE_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "FreeRTOS.h"
+
+#include "lfs.h"
+#include "ospi_nor_mx25lmxxx45g.h"
+
+/* Sectors in the log ring, the oldest one is erased when the ring is full */
+#ifndef LOG_STORE_NUM_SECTORS
+#define LOG_STORE_NUM_SECTORS    ( 64U )
+#endif
+
+/* The ring directly follows the littlefs partition */
+#define LOG_STORE_FLASH_ADDR     ( OPI_START_ADDRESS + MX25LM_MEM_SZ_USABLE )
+#define LOG_STORE_SECTOR_LEN     ( MX25LM_SECTOR_SZ )
+#define LOG_STORE_PAGE_LEN       ( MX25LM_PROGRAM_FIFO_LEN )
+
+/* Bytes of text that matches may refer back to, a power of two */
+#define LOG_STORE_WINDOW_LEN     ( 1024U )
+#define LOG_STORE_MIN_MATCH      ( 4U )
+
+typedef struct LogStoreStats
+{
+    uint32_t ulLines;         /* Lines stored since boot */
+    uint32_t ulDropped;       /* Lines lost because the queue was full or flash failed */
+    uint32_t ulTextBytes;     /* Bytes of the stored lines */
+    uint32_t ulStoredBytes;   /* Bytes of the records holding them */
+    uint32_t ulPagesWritten;  /* Pages programmed since boot */
+    uint32_t ulSectorsErased; /* Sectors erased since boot */
+    uint32_t ulSector;        /* Sector being written */
+    uint32_t ulSeq;           /* Sequence number of that sector */
+    BaseType_t xRecovered;    /* The page being written at the last reset was saved */
+} LogStoreStats_t;
+
+/* Position of a reader in the log ring */
+typedef struct LogStoreCursor
+{
+    uint32_t ulSector;
+    uint32_t ulSeq;
+    uint32_t ulSectorsLeft;
+    uint32_t ulOffset;
+    uint32_t ulTextPos;
+    uint32_t ulPageOffset;
+    BaseType_t xPageValid;
+    uint8_t ucPage[ LOG_STORE_PAGE_LEN ];
+    uint8_t ucWindow[ LOG_STORE_WINDOW_LEN ];
+} LogStoreCursor_t;
+
+/**
+ * @brief Recover the page saved at the last reset and start the writer task.
+ *
+ * @param[in] pxCfg littlefs configuration of the OSPI partition, its lock
+ * serializes access to the flash.
+ *
+ * @return pdTRUE if the store is running.
+ */
+BaseType_t xLogStoreInit( const struct lfs_config * pxCfg );
+
+/**
+ * @brief Queue a log line for the store. Callable from any context.
+ *
+ * Lines logged before xLogStoreInit are kept until the store starts. Lines
+ * are dropped while the queue is full.
+ */
+void vLogStoreWriteLine( const char * pcLine,
+                         size_t uxLen );
+
+/**
+ * @brief Stage the lines still queued without programming the flash.
+ *
+ * PRE: called from vDyingGasp with the scheduler suspended.
+ */
+void vLogStoreDyingGasp( void );
+
+/**
+ * @brief Program the page being filled so that readers see every stored line.
+ *
+ * The rest of the page is left unused.
+ */
+BaseType_t xLogStoreFlush( void );
+
+/**
+ * @brief Erase every sector of the ring.
+ */
+BaseType_t xLogStoreErase( void );
+
+void vLogStoreGetStats( LogStoreStats_t * pxStats );
+
+/**
+ * @brief Position pxCursor at the oldest stored line.
+ *
+ * @return pdFALSE if the store is not running or holds no lines.
+ */
+BaseType_t xLogStoreCursorInit( LogStoreCursor_t * pxCursor );
+
+/**
+ * @brief Read the next line, truncated to uxBufferLen - 1 bytes and terminated.
+ *
+ * @param[out] puxLen Length of the line written to pcBuffer.
+ *
+ * @return pdTRUE if a line was read, pdFALSE at the end of the stored lines.
+ */
+BaseType_t xLogStoreReadLine( LogStoreCursor_t * pxCursor,
+                              char * pcBuffer,
+                              size_t uxBufferLen,
+                              size_t * puxLen );
+
+#endif /* LOG_STORE_H_ */
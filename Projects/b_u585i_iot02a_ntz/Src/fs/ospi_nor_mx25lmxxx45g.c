@@ -28,15 +28,84 @@
 
 #include "logging_levels.h"
 #define LOG_LEVEL    LOG_DEBUG
+#define LOG_MODULE    LOG_MODULE_FS
 #include "logging.h"
 #include "FreeRTOS.h"
 #include "task.h"
 
+#include "hw_defs.h"
+#include "hw_cache.h"
+#include "low_power.h"
+#include "dvfs.h"
+#include "periph_stats.h"
+#include "dma_copy.h"
+#include <string.h>
+
 #include "ospi_nor_mx25lmxxx45g.h"
 
 static TaskHandle_t xTaskHandle = NULL;
 static OSPI_HandleTypeDef * s_pxOSPI = NULL;
 
+/* pdTRUE once the flash has been switched to 8 line DTR (DOPI) mode */
+static BaseType_t xDtrMode = pdFALSE;
+
+/* pdTRUE while no program or erase operation can still be in progress */
+static BaseType_t xFlashIdle = pdFALSE;
+
+#if MX25LM_MMAP_ENABLE
+/* pdTRUE while the controller is in memory-mapped mode and cannot issue commands */
+static BaseType_t xMemoryMapped = pdFALSE;
+#endif
+
+#if MX25LM_DMA_ENABLE
+
+/* The direction is updated by HAL_OSPI_Receive_DMA / HAL_OSPI_Transmit_DMA */
+static DMA_HandleTypeDef xHndlOspiDma =
+{
+    .Instance                  = GPDMA1_Channel7,
+    .Init                      =
+    {
+        .Request               = GPDMA1_REQUEST_OCTOSPI2,
+        .BlkHWRequest          = DMA_BREQ_SINGLE_BURST,
+        .Direction             = DMA_PERIPH_TO_MEMORY,
+        .SrcInc                = DMA_SINC_FIXED,
+        .DestInc               = DMA_DINC_INCREMENTED,
+        .SrcDataWidth          = DMA_SRC_DATAWIDTH_BYTE,
+        .DestDataWidth         = DMA_DEST_DATAWIDTH_BYTE,
+        .Priority              = DMA_LOW_PRIORITY_HIGH_WEIGHT,
+        .SrcBurstLength        = 1,
+        .DestBurstLength       = 1,
+        .TransferAllocatedPort = DMA_SRC_ALLOCATED_PORT0 | DMA_DEST_ALLOCATED_PORT1,
+        .TransferEventMode     = DMA_TCEM_BLOCK_TRANSFER,
+        .Mode                  = DMA_NORMAL,
+    },
+};
+
+/* pdTRUE once xHndlOspiDma has been initialized and linked to the OSPI handle */
+static BaseType_t xDmaReady = pdFALSE;
+#endif /* MX25LM_DMA_ENABLE */
+
+/*
+ * Set the transfer rate of each phase of an OPI command to that of the current mode.
+ */
+static inline void ospi_OPI_SetRate( OSPI_RegularCmdTypeDef * pxCmd )
+{
+    if( xDtrMode == pdTRUE )
+    {
+        pxCmd->InstructionDtrMode = HAL_OSPI_INSTRUCTION_DTR_ENABLE;
+
+        if( pxCmd->AddressMode != HAL_OSPI_ADDRESS_NONE )
+        {
+            pxCmd->AddressDtrMode = HAL_OSPI_ADDRESS_DTR_ENABLE;
+        }
+
+        if( pxCmd->DataMode != HAL_OSPI_DATA_NONE )
+        {
+            pxCmd->DataDtrMode = HAL_OSPI_DATA_DTR_ENABLE;
+        }
+    }
+}
+
 static inline void ospi_HandleCallback( OSPI_HandleTypeDef * pxOSPI,
                                         HAL_OSPI_CallbackIDTypeDef xCallbackId )
 {
@@ -76,6 +145,9 @@ static void ospi_TimeoutCallback( OSPI_HandleTypeDef * pxOSPI )
 
 static void ospi_ErrorCallback( OSPI_HandleTypeDef * pxOSPI )
 {
+    xPeriphErrStats.ulOspiErrors++;
+    xPeriphErrStats.ulOspiLastCode = pxOSPI->ErrorCode;
+
     ospi_HandleCallback( pxOSPI, HAL_OSPI_ERROR_CB_ID );
 }
 
@@ -97,6 +169,9 @@ static BaseType_t ospi_WaitForCallback( HAL_OSPI_CallbackIDTypeDef xCallbackID,
 
     vTaskSetTimeOutState( &xTimeOut );
 
+    /* The OCTOSPI status polling stops in Stop 2 */
+    vLowPowerStopInhibit( LOW_POWER_CLIENT_OSPI );
+
     while( ulNotifyValue != xCallbackID )
     {
         ( void ) xTaskNotifyWaitIndexed( 1, 0x0, 0xFFFFFFFF, &ulNotifyValue, xRemainingTicks );
@@ -108,13 +183,17 @@ static BaseType_t ospi_WaitForCallback( HAL_OSPI_CallbackIDTypeDef xCallbackID,
         }
     }
 
+    vLowPowerStopAllow( LOW_POWER_CLIENT_OSPI );
+
     return( ulNotifyValue == xCallbackID );
 }
 
 void OCTOSPI2_IRQHandler( void )
 {
+    TRACE_ISR_ENTER();
     configASSERT( s_pxOSPI != NULL );
     HAL_OSPI_IRQHandler( s_pxOSPI );
+    TRACE_ISR_EXIT();
 }
 
 static void ospi_IRQHandler( void )
@@ -123,11 +202,26 @@ static void ospi_IRQHandler( void )
     HAL_OSPI_IRQHandler( s_pxOSPI );
 }
 
+#if MX25LM_DMA_ENABLE
+static void ospi_DmaIRQHandler( void )
+{
+    HAL_DMA_IRQHandler( &xHndlOspiDma );
+}
+#endif
+
 /* Initialize static variables for the current operation */
 static inline void ospi_OpInit( OSPI_HandleTypeDef * pxOSPI )
 {
     s_pxOSPI = pxOSPI;
     xTaskHandle = xTaskGetCurrentTaskHandle();
+
+    /* The OSPI clock and the delay block are set up for SYSCLK at full speed */
+    vDvfsRequest( DVFS_CLIENT_OSPI );
+}
+
+static inline void ospi_OpDone( void )
+{
+    vDvfsRelease( DVFS_CLIENT_OSPI );
 }
 
 static void ospi_MspInitCallback( OSPI_HandleTypeDef * pxOSPI )
@@ -195,6 +289,32 @@ static void ospi_MspInitCallback( OSPI_HandleTypeDef * pxOSPI )
     /* OCTOSPI2 interrupt Init */
     HAL_NVIC_SetPriority( OCTOSPI2_IRQn, 5, 0 );
     HAL_NVIC_EnableIRQ( OCTOSPI2_IRQn );
+
+#if MX25LM_DMA_ENABLE
+    __HAL_RCC_GPDMA1_CLK_ENABLE();
+
+    xHalStatus = HAL_DMA_Init( &xHndlOspiDma );
+
+    if( xHalStatus == HAL_OK )
+    {
+        xHalStatus = HAL_DMA_ConfigChannelAttributes( &xHndlOspiDma, DMA_CHANNEL_NPRIV );
+    }
+
+    if( xHalStatus == HAL_OK )
+    {
+        __HAL_LINKDMA( pxOSPI, hdma, xHndlOspiDma );
+
+        NVIC_SetVector( GPDMA1_Channel7_IRQn, ( uint32_t ) ospi_DmaIRQHandler );
+        HAL_NVIC_SetPriority( GPDMA1_Channel7_IRQn, 5, 0 );
+        HAL_NVIC_EnableIRQ( GPDMA1_Channel7_IRQn );
+
+        xDmaReady = pdTRUE;
+    }
+    else
+    {
+        LogError( "Error while configuring GPDMA for OSPI2, falling back to interrupt driven transfers." );
+    }
+#endif /* MX25LM_DMA_ENABLE */
 }
 
 static void ospi_MspDeInitCallback( OSPI_HandleTypeDef * pxOSPI )
@@ -225,6 +345,15 @@ static void ospi_MspDeInitCallback( OSPI_HandleTypeDef * pxOSPI )
 
     /* OCTOSPI2 interrupt DeInit */
     HAL_NVIC_DisableIRQ( OCTOSPI2_IRQn );
+
+#if MX25LM_DMA_ENABLE
+    if( xDmaReady == pdTRUE )
+    {
+        HAL_NVIC_DisableIRQ( GPDMA1_Channel7_IRQn );
+        ( void ) HAL_DMA_DeInit( &xHndlOspiDma );
+        xDmaReady = pdFALSE;
+    }
+#endif
 }
 
 static BaseType_t ospi_InitDriver( OSPI_HandleTypeDef * pxOSPI )
@@ -356,7 +485,7 @@ static BaseType_t ospi_cmd_OPI_WREN( OSPI_HandleTypeDef * pxOSPI,
         .FlashId            = HAL_OSPI_FLASH_ID_1,
 
         .Instruction        = MX25LM_OPI_WREN,
-        .InstructionMode    = HAL_OSPI_INSTRUCTION_8_LINES, /* 8 line STR mode */
+        .InstructionMode    = HAL_OSPI_INSTRUCTION_8_LINES, /* 8 line mode */
         .InstructionSize    = HAL_OSPI_INSTRUCTION_16_BITS, /* 2 byte instructions */
         .InstructionDtrMode = HAL_OSPI_INSTRUCTION_DTR_DISABLE,
 
@@ -371,6 +500,8 @@ static BaseType_t ospi_cmd_OPI_WREN( OSPI_HandleTypeDef * pxOSPI,
         .SIOOMode           = HAL_OSPI_SIOO_INST_EVERY_CMD,
     };
 
+    ospi_OPI_SetRate( &xCmd );
+
     /* Clear notification state */
     ( void ) xTaskNotifyStateClearIndexed( NULL, 1 );
 
@@ -393,6 +524,7 @@ static BaseType_t ospi_cmd_OPI_WREN( OSPI_HandleTypeDef * pxOSPI,
 static BaseType_t ospi_OPI_WaitForStatus( OSPI_HandleTypeDef * pxOSPI,
                                           uint32_t ulMask,
                                           uint32_t ulMatch,
+                                          uint32_t ulInterval,
                                           TickType_t xTimeout )
 {
     HAL_StatusTypeDef xHalStatus = HAL_OK;
@@ -405,7 +537,7 @@ static BaseType_t ospi_OPI_WaitForStatus( OSPI_HandleTypeDef * pxOSPI,
         .FlashId            = HAL_OSPI_FLASH_ID_1,
 
         .Instruction        = MX25LM_OPI_RDSR,
-        .InstructionMode    = HAL_OSPI_INSTRUCTION_8_LINES, /* 8 line STR mode */
+        .InstructionMode    = HAL_OSPI_INSTRUCTION_8_LINES, /* 8 line mode */
         .InstructionSize    = HAL_OSPI_INSTRUCTION_16_BITS, /* 2 byte instructions */
         .InstructionDtrMode = HAL_OSPI_INSTRUCTION_DTR_DISABLE,
 
@@ -420,11 +552,21 @@ static BaseType_t ospi_OPI_WaitForStatus( OSPI_HandleTypeDef * pxOSPI,
         .DataDtrMode        = HAL_OSPI_DATA_DTR_DISABLE,
         .NbData             = 1,                            /* RDSR reg is 1 byte of data */
 
-        .DummyCycles        = 4,                            /* PM2357 R1.1 pg 23, Note 5 => 4 dummy cycles */
+        .DummyCycles        = MX25LM_REG_STR_DUMMY_CYCLES,  /* PM2357 R1.1 pg 23, Note 5 => 4 dummy cycles */
         .DQSMode            = HAL_OSPI_DQS_DISABLE,
         .SIOOMode           = HAL_OSPI_SIOO_INST_EVERY_CMD,
     };
 
+    if( xDtrMode == pdTRUE )
+    {
+        /* The register is output twice, once per clock edge */
+        xCmd.NbData = 2;
+        xCmd.DummyCycles = MX25LM_REG_DTR_DUMMY_CYCLES;
+        xCmd.DQSMode = HAL_OSPI_DQS_ENABLE;
+    }
+
+    ospi_OPI_SetRate( &xCmd );
+
     /* Send command */
     xHalStatus = HAL_OSPI_Command( pxOSPI, &xCmd, xTimeout );
 
@@ -432,7 +574,7 @@ static BaseType_t ospi_OPI_WaitForStatus( OSPI_HandleTypeDef * pxOSPI,
     {
         .MatchMode     = HAL_OSPI_MATCH_MODE_AND,
         .AutomaticStop = HAL_OSPI_AUTOMATIC_STOP_ENABLE,
-        .Interval      = 0x10,
+        .Interval      = ulInterval,
         .Match         = ulMatch,
         .Mask          = ulMask,
     };
@@ -461,6 +603,37 @@ static BaseType_t ospi_OPI_WaitForStatus( OSPI_HandleTypeDef * pxOSPI,
     {
         ( void ) ospi_AbortTransaction( pxOSPI, xTimeout );
     }
+    else if( ( ( ulMask & MX25LM_REG_SR_WIP ) != 0 ) &&
+             ( ( ulMatch & MX25LM_REG_SR_WIP ) == 0 ) )
+    {
+        xFlashIdle = pdTRUE;
+    }
+    else
+    {
+        /* Flash state unchanged */
+    }
+
+    return xSuccess;
+}
+
+/*
+ * Wait for the flash to finish any pending program or erase operation.
+ * Erases and single page writes wait for completion before returning, so the
+ * status register only needs to be read after ospi_WritePages or a failure.
+ */
+static BaseType_t ospi_OPI_WaitForIdle( OSPI_HandleTypeDef * pxOSPI,
+                                        TickType_t xTimeout )
+{
+    BaseType_t xSuccess = pdTRUE;
+
+    if( xFlashIdle != pdTRUE )
+    {
+        xSuccess = ospi_OPI_WaitForStatus( pxOSPI,
+                                           MX25LM_REG_SR_WIP,
+                                           0x0,
+                                           MX25LM_PP_POLL_INTERVAL_CYCLES,
+                                           xTimeout );
+    }
 
     return xSuccess;
 }
@@ -504,7 +677,7 @@ static BaseType_t ospi_SPI_WaitForStatus( OSPI_HandleTypeDef * pxOSPI,
     {
         .MatchMode     = HAL_OSPI_MATCH_MODE_AND,
         .AutomaticStop = HAL_OSPI_AUTOMATIC_STOP_ENABLE,
-        .Interval      = 0x10,
+        .Interval      = MX25LM_POLL_INTERVAL_CYCLES,
         .Match         = ulMatch,
         .Mask          = ulMask,
     };
@@ -581,10 +754,12 @@ static BaseType_t ospi_cmd_SPI_WREN( OSPI_HandleTypeDef * pxOSPI,
 
 
 /*
- * Switch flash from 1 bit SPI mode to 8 bit STR mode (single bit per clock)
+ * Switch flash from 1 bit SPI mode to 8 bit STR (MX25LM_REG_CR2_0_SOPI, single transfer per clock)
+ * or DTR (MX25LM_REG_CR2_0_DOPI, one transfer per clock edge) mode.
  */
-static BaseType_t ospi_cmd_SPI_8BitSTRMode( OSPI_HandleTypeDef * pxOSPI,
-                                            TickType_t xTimeout )
+static BaseType_t ospi_cmd_SPI_8BitMode( OSPI_HandleTypeDef * pxOSPI,
+                                         uint8_t ucCR2Value,
+                                         TickType_t xTimeout )
 {
     HAL_StatusTypeDef xHalStatus = HAL_OK;
 
@@ -605,7 +780,7 @@ static BaseType_t ospi_cmd_SPI_8BitSTRMode( OSPI_HandleTypeDef * pxOSPI,
 
         .AlternateBytesMode    = HAL_OSPI_ALTERNATE_BYTES_1_LINE,
         .AlternateBytesSize    = HAL_OSPI_ALTERNATE_BYTES_8_BITS,
-        .AlternateBytes        = MX25LM_REG_CR2_0_SOPI,
+        .AlternateBytes        = ucCR2Value,
         .AlternateBytesDtrMode = HAL_OSPI_ALTERNATE_BYTES_DTR_DISABLE,
 
         .DataMode              = HAL_OSPI_DATA_NONE,
@@ -633,26 +808,69 @@ static BaseType_t ospi_cmd_SPI_8BitSTRMode( OSPI_HandleTypeDef * pxOSPI,
 
 
 /*
- * @Brief Initialize octospi flash controller and related peripherals
+ * Reset the flash from OPI mode (in the current transfer rate) back to 1 line SPI mode.
  */
-BaseType_t ospi_Init( OSPI_HandleTypeDef * pxOSPI )
+static BaseType_t ospi_cmd_OPI_Reset( OSPI_HandleTypeDef * pxOSPI,
+                                      TickType_t xTimeout )
 {
-    BaseType_t xSuccess = pdTRUE;
+    HAL_StatusTypeDef xHalStatus = HAL_OK;
+    const uint16_t usCommands[] = { MX25LM_OPI_RSTEN, MX25LM_OPI_RST };
 
-    ospi_OpInit( pxOSPI );
+    for( uint32_t i = 0; ( i < 2 ) && ( xHalStatus == HAL_OK ); i++ )
+    {
+        OSPI_RegularCmdTypeDef xCmd =
+        {
+            .OperationType      = HAL_OSPI_OPTYPE_COMMON_CFG,
+            .FlashId            = HAL_OSPI_FLASH_ID_1,
 
-    xSuccess = ospi_InitDriver( pxOSPI );
+            .Instruction        = usCommands[ i ],
+            .InstructionMode    = HAL_OSPI_INSTRUCTION_8_LINES,
+            .InstructionSize    = HAL_OSPI_INSTRUCTION_16_BITS,
+            .InstructionDtrMode = HAL_OSPI_INSTRUCTION_DTR_DISABLE,
 
-    if( xSuccess != pdTRUE )
-    {
-        LogError( "Failed to initialize ospi driver." );
-    }
-    else
-    {
-        /* Set Write enable bit */
-        xSuccess = ospi_cmd_SPI_WREN( pxOSPI, MX25LM_DEFAULT_TIMEOUT_MS );
+            .AddressMode        = HAL_OSPI_ADDRESS_NONE,
+
+            .AlternateBytesMode = HAL_OSPI_ALTERNATE_BYTES_NONE,
+
+            .DataMode           = HAL_OSPI_DATA_NONE,
+
+            .DummyCycles        = 0,
+            .DQSMode            = HAL_OSPI_DQS_DISABLE,
+            .SIOOMode           = HAL_OSPI_SIOO_INST_EVERY_CMD,
+        };
+
+        ospi_OPI_SetRate( &xCmd );
+
+        ( void ) xTaskNotifyStateClearIndexed( NULL, 1 );
+
+        xHalStatus = HAL_OSPI_Command_IT( pxOSPI, &xCmd );
+
+        if( ( xHalStatus == HAL_OK ) &&
+            ( ospi_WaitForCallback( HAL_OSPI_CMD_CPLT_CB_ID, xTimeout ) != pdTRUE ) )
+        {
+            xHalStatus = -1;
+        }
     }
 
+    /* Wait out the reset recovery time */
+    vTaskDelay( pdMS_TO_TICKS( 2 ) );
+
+    return( xHalStatus == HAL_OK );
+}
+
+/*
+ * Switch the flash from 1 line SPI mode to 8 line STR or DTR mode.
+ */
+static BaseType_t ospi_EnterOPIMode( OSPI_HandleTypeDef * pxOSPI,
+                                     BaseType_t xUseDtr )
+{
+    BaseType_t xSuccess = pdTRUE;
+
+    xDtrMode = pdFALSE;
+
+    /* Set Write enable bit */
+    xSuccess = ospi_cmd_SPI_WREN( pxOSPI, MX25LM_DEFAULT_TIMEOUT_MS );
+
     if( xSuccess != pdTRUE )
     {
         LogError( "Failed to send WREN command." );
@@ -672,101 +890,338 @@ BaseType_t ospi_Init( OSPI_HandleTypeDef * pxOSPI )
     else
     {
         /* Enter 8 bit data mode */
-        xSuccess = ospi_cmd_SPI_8BitSTRMode( pxOSPI, MX25LM_DEFAULT_TIMEOUT_MS );
+        xSuccess = ospi_cmd_SPI_8BitMode( pxOSPI,
+                                          ( xUseDtr == pdTRUE ) ? MX25LM_REG_CR2_0_DOPI : MX25LM_REG_CR2_0_SOPI,
+                                          MX25LM_DEFAULT_TIMEOUT_MS );
     }
 
     if( xSuccess != pdTRUE )
     {
-        LogError( "Failed to set data mode to 8Bit STR." );
+        LogError( "Failed to set data mode to 8Bit %s.", ( xUseDtr == pdTRUE ) ? "DTR" : "STR" );
     }
     else
     {
+        xDtrMode = xUseDtr;
+
         /* Wait for WEL and WIP bits to clear */
         xSuccess = ospi_OPI_WaitForStatus( pxOSPI,
                                            MX25LM_REG_SR_WIP | MX25LM_REG_SR_WEL,
                                            0x0,
+                                           MX25LM_POLL_INTERVAL_CYCLES,
                                            MX25LM_DEFAULT_TIMEOUT_MS );
     }
 
     return xSuccess;
 }
 
-BaseType_t ospi_ReadAddr( OSPI_HandleTypeDef * pxOSPI,
-                          uint32_t ulAddr,
-                          void * pxBuffer,
-                          uint32_t ulBufferLen,
-                          TickType_t xTimeout )
+/*
+ * @Brief Initialize octospi flash controller and related peripherals
+ * @param[in] xUseDtr Try 8 line DTR mode first, falling back to STR mode if the flash does not respond.
+ */
+BaseType_t ospi_Init( OSPI_HandleTypeDef * pxOSPI,
+                      BaseType_t xUseDtr )
 {
-    HAL_StatusTypeDef xHalStatus = HAL_OK;
     BaseType_t xSuccess = pdTRUE;
 
     ospi_OpInit( pxOSPI );
 
-    if( pxOSPI == NULL )
+    /* Nothing is known about the state of the flash yet */
+    xFlashIdle = pdFALSE;
+
+    xSuccess = ospi_InitDriver( pxOSPI );
+
+    if( xSuccess != pdTRUE )
     {
-        xSuccess = pdFALSE;
-        LogError( "pxOSPI is NULL." );
+        LogError( "Failed to initialize ospi driver." );
+    }
+    else
+    {
+        xSuccess = ospi_EnterOPIMode( pxOSPI, xUseDtr );
     }
 
-    if( ulAddr >= MX25LM_MEM_SZ_BYTES )
+    if( ( xSuccess != pdTRUE ) &&
+        ( xUseDtr == pdTRUE ) )
     {
-        xSuccess = pdFALSE;
-        LogError( "Address is out of range." );
+        LogWarn( "Flash did not respond in 8Bit DTR mode, falling back to STR mode." );
+
+        /* The flash may already be in DTR mode, return it to SPI mode */
+        if( xDtrMode == pdTRUE )
+        {
+            ( void ) ospi_cmd_OPI_Reset( pxOSPI, MX25LM_DEFAULT_TIMEOUT_MS );
+        }
+
+        xSuccess = ospi_EnterOPIMode( pxOSPI, pdFALSE );
     }
 
-    if( pxBuffer == NULL )
+    if( xSuccess == pdTRUE )
     {
-        xSuccess = pdFALSE;
-        LogError( "pxBuffer is NULL." );
+        LogInfo( "OSPI flash is in 8Bit %s mode.", ( xDtrMode == pdTRUE ) ? "DTR" : "STR" );
     }
 
-    if( ulBufferLen == 0 )
+    ospi_OpDone();
+
+    return xSuccess;
+}
+
+/*
+ * @Brief Returns pdTRUE when the flash operates in 8 line DTR mode, which requires
+ * reads and writes of an even number of bytes at an even address.
+ */
+BaseType_t ospi_IsDtrMode( void )
+{
+    return xDtrMode;
+}
+
+/*
+ * Fill in an 8READ (STR) or 8DTRD (DTR) command.
+ */
+static void ospi_OPI_ReadCmdInit( OSPI_RegularCmdTypeDef * pxCmd,
+                                  uint32_t ulOperationType,
+                                  uint32_t ulAddr,
+                                  uint32_t ulLength )
+{
+    OSPI_RegularCmdTypeDef xCmd =
     {
-        xSuccess = pdFALSE;
-        LogError( "ulBufferLen is 0." );
+        .OperationType      = ulOperationType,
+        .FlashId            = HAL_OSPI_FLASH_ID_1,
+
+        .Instruction        = MX25LM_OPI_8READ,
+        .InstructionMode    = HAL_OSPI_INSTRUCTION_8_LINES, /* 8 line mode */
+        .InstructionSize    = HAL_OSPI_INSTRUCTION_16_BITS, /* 2 byte instructions */
+        .InstructionDtrMode = HAL_OSPI_INSTRUCTION_DTR_DISABLE,
+
+        .Address            = ulAddr,
+        .AddressMode        = HAL_OSPI_ADDRESS_8_LINES,
+        .AddressSize        = HAL_OSPI_ADDRESS_32_BITS,
+        .AddressDtrMode     = HAL_OSPI_DATA_DTR_DISABLE,
+
+        .AlternateBytesMode = HAL_OSPI_ALTERNATE_BYTES_NONE,
+
+        .DataMode           = HAL_OSPI_DATA_8_LINES,
+        .DataDtrMode        = HAL_OSPI_DATA_DTR_DISABLE,
+        .NbData             = ulLength,
+
+        .DummyCycles        = MX25LM_8READ_DUMMY_CYCLES,
+        .DQSMode            = HAL_OSPI_DQS_DISABLE,
+        .SIOOMode           = HAL_OSPI_SIOO_INST_EVERY_CMD,
+    };
+
+    if( xDtrMode == pdTRUE )
+    {
+        /* Data is sampled on the DQS strobe driven by the flash */
+        xCmd.Instruction = MX25LM_OPI_8DTRD;
+        xCmd.DummyCycles = MX25LM_8DTRD_DUMMY_CYCLES;
+        xCmd.DQSMode = HAL_OSPI_DQS_ENABLE;
     }
 
-    /*TODO is there a limit to the number of bytes read? */
+    ospi_OPI_SetRate( &xCmd );
 
-    /* Wait for idle condition (WIP bit should be 0) */
-    xSuccess = ospi_OPI_WaitForStatus( pxOSPI,
-                                       MX25LM_REG_SR_WIP,
-                                       0x0,
-                                       MX25LM_DEFAULT_TIMEOUT_MS );
+    *pxCmd = xCmd;
+}
 
-    if( xSuccess != pdTRUE )
+#if MX25LM_MMAP_ENABLE
+
+/*
+ * Map the flash at MX25LM_MMAP_BASE so that reads become plain memory accesses.
+ * Program and erase operations leave memory-mapped mode, it is re-entered by the next read.
+ */
+static BaseType_t ospi_EnterMemoryMapped( OSPI_HandleTypeDef * pxOSPI )
+{
+    BaseType_t xSuccess = pdTRUE;
+
+    if( xMemoryMapped == pdFALSE )
     {
-        ospi_AbortTransaction( pxOSPI, MX25LM_DEFAULT_TIMEOUT_MS );
-        LogError( "Timed out while waiting for OSPI IDLE condition." );
+        OSPI_RegularCmdTypeDef xCmd = { 0 };
+
+        OSPI_MemoryMappedTypeDef xMemMappedCfg =
+        {
+            /* Release chip select when idle so that the flash can enter standby */
+            .TimeOutActivation = HAL_OSPI_TIMEOUT_COUNTER_ENABLE,
+            .TimeOutPeriod     = MX25LM_MMAP_TIMEOUT_CYCLES,
+        };
+
+        /* The mapping is only read from, writes always use indirect mode */
+        ospi_OPI_ReadCmdInit( &xCmd, HAL_OSPI_OPTYPE_READ_CFG, 0, 0 );
+
+        xSuccess = ospi_OPI_WaitForIdle( pxOSPI, MX25LM_DEFAULT_TIMEOUT_MS );
+
+        if( ( xSuccess == pdTRUE ) &&
+            ( HAL_OSPI_Command( pxOSPI, &xCmd, MX25LM_DEFAULT_TIMEOUT_MS ) != HAL_OK ) )
+        {
+            xSuccess = pdFALSE;
+        }
+
+        if( ( xSuccess == pdTRUE ) &&
+            ( HAL_OSPI_MemoryMapped( pxOSPI, &xMemMappedCfg ) != HAL_OK ) )
+        {
+            xSuccess = pdFALSE;
+        }
+
+        if( xSuccess == pdTRUE )
+        {
+            xMemoryMapped = pdTRUE;
+        }
+        else
+        {
+            LogError( "Failed to enter memory-mapped mode." );
+        }
     }
-    else
+
+    return xSuccess;
+}
+
+/*
+ * Return to indirect mode before issuing a command to the flash.
+ */
+static void ospi_ExitMemoryMapped( OSPI_HandleTypeDef * pxOSPI )
+{
+    if( xMemoryMapped == pdTRUE )
     {
-        /* Setup an 8READ transaction */
-        OSPI_RegularCmdTypeDef xCmd =
+        if( HAL_OSPI_Abort( pxOSPI ) != HAL_OK )
         {
-            .OperationType      = HAL_OSPI_OPTYPE_COMMON_CFG,
-            .FlashId            = HAL_OSPI_FLASH_ID_1,
+            LogError( "Failed to leave memory-mapped mode." );
+        }
 
-            .Instruction        = MX25LM_OPI_8READ,
-            .InstructionMode    = HAL_OSPI_INSTRUCTION_8_LINES, /* 8 line STR mode */
-            .InstructionSize    = HAL_OSPI_INSTRUCTION_16_BITS, /* 2 byte instructions */
-            .InstructionDtrMode = HAL_OSPI_INSTRUCTION_DTR_DISABLE,
+        xMemoryMapped = pdFALSE;
+    }
+}
 
-            .Address            = ulAddr,
-            .AddressMode        = HAL_OSPI_ADDRESS_8_LINES,
-            .AddressSize        = HAL_OSPI_ADDRESS_32_BITS,
-            .AddressDtrMode     = HAL_OSPI_DATA_DTR_DISABLE,
+/*
+ * Drop stale copies of a modified flash range from the data cache.
+ */
+static void ospi_InvalidateMapped( uint32_t ulAddr,
+                                   uint32_t ulLength )
+{
+    /* The mapped region is never written by the CPU, so no line is dirty */
+    ( void ) xCacheCleanInvalidateRange( ( void * ) ( MX25LM_MMAP_BASE + ulAddr ), ulLength );
+}
 
-            .AlternateBytesMode = HAL_OSPI_ALTERNATE_BYTES_NONE,
+#endif /* MX25LM_MMAP_ENABLE */
 
-            .DataMode           = HAL_OSPI_DATA_8_LINES,
-            .DataDtrMode        = HAL_OSPI_DATA_DTR_DISABLE,
-            .NbData             = ulBufferLen,
+#if MX25LM_DMA_ENABLE
 
-            .DummyCycles        = MX25LM_8READ_DUMMY_CYCLES,
-            .DQSMode            = HAL_OSPI_DQS_DISABLE,
-            .SIOOMode           = HAL_OSPI_SIOO_INST_EVERY_CMD,
-        };
+/*
+ * Decide whether a transfer should use GPDMA and do the required cache maintenance.
+ * DCACHE1 only caches the external memory regions, so buffers in internal SRAM
+ * need no maintenance. Cached buffers that do not cover whole cache lines are
+ * left to the interrupt driven path since invalidating them would discard
+ * neighbouring data.
+ */
+static BaseType_t ospi_DmaPrepare( const void * pvBuffer,
+                                   uint32_t ulLength,
+                                   BaseType_t xIsReceive )
+{
+    BaseType_t xUseDma = pdFALSE;
+
+    if( ( xDmaReady != pdTRUE ) ||
+        ( ulLength < MX25LM_DMA_THRESHOLD_BYTES ) )
+    {
+        xUseDma = pdFALSE;
+    }
+    else if( xCacheRangeIsCached( pvBuffer, ulLength ) == pdFALSE )
+    {
+        xUseDma = pdTRUE;
+    }
+    else if( xCacheRangeIsAligned( pvBuffer, ulLength ) == pdFALSE )
+    {
+        xUseDma = pdFALSE;
+    }
+    else if( xIsReceive == pdTRUE )
+    {
+        xUseDma = xCacheInvalidateRange( ( void * ) pvBuffer, ulLength );
+    }
+    else
+    {
+        xUseDma = xCacheCleanRange( pvBuffer, ulLength );
+    }
+
+    return xUseDma;
+}
+
+#endif /* MX25LM_DMA_ENABLE */
+
+/*
+ * Start receiving the data phase of the current command.
+ * Completion is signalled through HAL_OSPI_RX_CPLT_CB_ID either way.
+ */
+static HAL_StatusTypeDef ospi_StartReceive( OSPI_HandleTypeDef * pxOSPI,
+                                            void * pvBuffer,
+                                            uint32_t ulLength )
+{
+    HAL_StatusTypeDef xHalStatus;
+
+#if MX25LM_DMA_ENABLE
+    if( ospi_DmaPrepare( pvBuffer, ulLength, pdTRUE ) == pdTRUE )
+    {
+        xHalStatus = HAL_OSPI_Receive_DMA( pxOSPI, pvBuffer );
+    }
+    else
+#endif
+    {
+        ( void ) ulLength;
+        xHalStatus = HAL_OSPI_Receive_IT( pxOSPI, pvBuffer );
+    }
+
+    return xHalStatus;
+}
+
+/*
+ * Start transmitting the data phase of the current command.
+ * Completion is signalled through HAL_OSPI_TX_CPLT_CB_ID either way.
+ */
+static HAL_StatusTypeDef ospi_StartTransmit( OSPI_HandleTypeDef * pxOSPI,
+                                             const void * pvBuffer,
+                                             uint32_t ulLength )
+{
+    HAL_StatusTypeDef xHalStatus;
+
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wdiscarded-qualifiers"
+#if MX25LM_DMA_ENABLE
+    if( ospi_DmaPrepare( pvBuffer, ulLength, pdFALSE ) == pdTRUE )
+    {
+        xHalStatus = HAL_OSPI_Transmit_DMA( pxOSPI, pvBuffer );
+    }
+    else
+#endif
+    {
+        ( void ) ulLength;
+        xHalStatus = HAL_OSPI_Transmit_IT( pxOSPI, pvBuffer );
+    }
+#pragma GCC diagnostic pop
+
+    return xHalStatus;
+}
+
+static BaseType_t ospi_ReadIndirect( OSPI_HandleTypeDef * pxOSPI,
+                                     uint32_t ulAddr,
+                                     void * pxBuffer,
+                                     uint32_t ulBufferLen,
+                                     TickType_t xTimeout )
+{
+    HAL_StatusTypeDef xHalStatus = HAL_OK;
+    BaseType_t xSuccess = pdTRUE;
+
+    /* DTR transfers move two bytes per clock */
+    if( ( xDtrMode == pdTRUE ) &&
+        ( ( ( ulAddr | ulBufferLen ) & 0x1 ) != 0 ) )
+    {
+        xSuccess = pdFALSE;
+        LogError( "Unaligned read of %lu bytes at 0x%08lx in DTR mode.", ulBufferLen, ulAddr );
+    }
+    /* Wait for idle condition (WIP bit should be 0) */
+    else if( ospi_OPI_WaitForIdle( pxOSPI, MX25LM_DEFAULT_TIMEOUT_MS ) != pdTRUE )
+    {
+        xSuccess = pdFALSE;
+        ospi_AbortTransaction( pxOSPI, MX25LM_DEFAULT_TIMEOUT_MS );
+        LogError( "Timed out while waiting for OSPI IDLE condition." );
+    }
+    else
+    {
+        /* Setup an 8READ transaction */
+        OSPI_RegularCmdTypeDef xCmd = { 0 };
+
+        ospi_OPI_ReadCmdInit( &xCmd, HAL_OSPI_OPTYPE_COMMON_CFG, ulAddr, ulBufferLen );
 
         /* Clear notification state */
         ( void ) xTaskNotifyStateClearIndexed( NULL, 1 );
@@ -787,7 +1242,7 @@ BaseType_t ospi_ReadAddr( OSPI_HandleTypeDef * pxOSPI,
         /* Clear notification state */
         ( void ) xTaskNotifyStateClearIndexed( NULL, 1 );
 
-        xHalStatus = HAL_OSPI_Receive_IT( pxOSPI, pxBuffer );
+        xHalStatus = ospi_StartReceive( pxOSPI, pxBuffer, ulBufferLen );
 
         /* Wait for receive op to complete */
         if( xHalStatus == HAL_OK )
@@ -799,16 +1254,12 @@ BaseType_t ospi_ReadAddr( OSPI_HandleTypeDef * pxOSPI,
     return( xSuccess );
 }
 
-/*
- * @Brief write up to 256 bytes to the given address.
- */
-BaseType_t ospi_WriteAddr( OSPI_HandleTypeDef * pxOSPI,
-                           uint32_t ulAddr,
-                           const void * pxBuffer,
-                           uint32_t ulBufferLen,
-                           TickType_t xTimeout )
+BaseType_t ospi_ReadAddr( OSPI_HandleTypeDef * pxOSPI,
+                          uint32_t ulAddr,
+                          void * pxBuffer,
+                          uint32_t ulBufferLen,
+                          TickType_t xTimeout )
 {
-    HAL_StatusTypeDef xHalStatus = HAL_OK;
     BaseType_t xSuccess = pdTRUE;
 
     ospi_OpInit( pxOSPI );
@@ -816,28 +1267,67 @@ BaseType_t ospi_WriteAddr( OSPI_HandleTypeDef * pxOSPI,
     if( pxOSPI == NULL )
     {
         xSuccess = pdFALSE;
+        LogError( "pxOSPI is NULL." );
     }
 
-    if( ( ulBufferLen > 256 ) ||
-        ( ulBufferLen == 0 ) )
+    if( ( ulAddr >= MX25LM_MEM_SZ_BYTES ) ||
+        ( ulBufferLen > ( MX25LM_MEM_SZ_BYTES - ulAddr ) ) )
     {
         xSuccess = pdFALSE;
+        LogError( "Address is out of range." );
     }
 
     if( pxBuffer == NULL )
     {
         xSuccess = pdFALSE;
+        LogError( "pxBuffer is NULL." );
     }
 
-    if( xSuccess == pdTRUE )
+    if( ulBufferLen == 0 )
     {
-        /* Wait for idle condition (WIP bit should be 0) */
-        xSuccess = ospi_OPI_WaitForStatus( pxOSPI,
-                                           MX25LM_REG_SR_WIP,
-                                           0x0,
-                                           xTimeout );
+        xSuccess = pdFALSE;
+        LogError( "ulBufferLen is 0." );
+    }
+
+    if( xSuccess != pdTRUE )
+    {
+        /* Invalid parameters */
     }
 
+#if MX25LM_MMAP_ENABLE
+    else if( ospi_EnterMemoryMapped( pxOSPI ) == pdTRUE )
+    {
+        /* littlefs cache fills, long enough for the DMA channel to read the window */
+        ( void ) pvDmaCopy( pxBuffer, ( const void * ) ( MX25LM_MMAP_BASE + ulAddr ), ulBufferLen );
+    }
+#endif
+    else
+    {
+        /*TODO is there a limit to the number of bytes read? */
+        xSuccess = ospi_ReadIndirect( pxOSPI, ulAddr, pxBuffer, ulBufferLen, xTimeout );
+    }
+
+    ospi_OpDone();
+
+    return( xSuccess );
+}
+
+/*
+ * Start programming one page and return once its data has been sent.
+ * The flash is still busy with the program operation on return.
+ */
+static BaseType_t ospi_ProgramPage( OSPI_HandleTypeDef * pxOSPI,
+                                    uint32_t ulAddr,
+                                    const void * pxBuffer,
+                                    uint32_t ulBufferLen,
+                                    TickType_t xTimeout )
+{
+    HAL_StatusTypeDef xHalStatus = HAL_OK;
+    BaseType_t xSuccess = pdTRUE;
+
+    /* Wait for idle condition (WIP bit should be 0) */
+    xSuccess = ospi_OPI_WaitForIdle( pxOSPI, xTimeout );
+
     if( xSuccess == pdTRUE )
     {
         /* Enable write */
@@ -850,6 +1340,7 @@ BaseType_t ospi_WriteAddr( OSPI_HandleTypeDef * pxOSPI,
         xSuccess = ospi_OPI_WaitForStatus( pxOSPI,
                                            MX25LM_REG_SR_WEL | MX25LM_REG_SR_WIP,
                                            MX25LM_REG_SR_WEL,
+                                           MX25LM_POLL_INTERVAL_CYCLES,
                                            xTimeout );
     }
 
@@ -862,7 +1353,7 @@ BaseType_t ospi_WriteAddr( OSPI_HandleTypeDef * pxOSPI,
             .FlashId            = HAL_OSPI_FLASH_ID_1,
 
             .Instruction        = MX25LM_OPI_PP,
-            .InstructionMode    = HAL_OSPI_INSTRUCTION_8_LINES, /* 8 line STR mode */
+            .InstructionMode    = HAL_OSPI_INSTRUCTION_8_LINES, /* 8 line mode */
             .InstructionSize    = HAL_OSPI_INSTRUCTION_16_BITS, /* 2 byte instructions */
             .InstructionDtrMode = HAL_OSPI_INSTRUCTION_DTR_DISABLE,
 
@@ -882,6 +1373,11 @@ BaseType_t ospi_WriteAddr( OSPI_HandleTypeDef * pxOSPI,
             .SIOOMode           = HAL_OSPI_SIOO_INST_EVERY_CMD,
         };
 
+        ospi_OPI_SetRate( &xCmd );
+
+        /* The flash is busy from the end of the data phase until the program completes */
+        xFlashIdle = pdFALSE;
+
         /* Send command */
         xHalStatus = HAL_OSPI_Command( pxOSPI, &xCmd, xTimeout );
     }
@@ -895,10 +1391,7 @@ BaseType_t ospi_WriteAddr( OSPI_HandleTypeDef * pxOSPI,
     }
     else
     {
-#pragma GCC diagnostic push
-#pragma GCC diagnostic ignored "-Wdiscarded-qualifiers"
-        xHalStatus = HAL_OSPI_Transmit_IT( pxOSPI, pxBuffer );
-#pragma GCC diagnostic pop
+        xHalStatus = ospi_StartTransmit( pxOSPI, pxBuffer, ulBufferLen );
     }
 
     if( xHalStatus != HAL_OK )
@@ -910,17 +1403,168 @@ BaseType_t ospi_WriteAddr( OSPI_HandleTypeDef * pxOSPI,
         xSuccess = ospi_WaitForCallback( HAL_OSPI_TX_CPLT_CB_ID, xTimeout );
     }
 
+    return xSuccess;
+}
+
+/*
+ * @Brief write up to 256 bytes to the given address.
+ */
+BaseType_t ospi_WriteAddr( OSPI_HandleTypeDef * pxOSPI,
+                           uint32_t ulAddr,
+                           const void * pxBuffer,
+                           uint32_t ulBufferLen,
+                           TickType_t xTimeout )
+{
+    BaseType_t xSuccess = pdTRUE;
+
+    ospi_OpInit( pxOSPI );
+
+    if( pxOSPI == NULL )
+    {
+        xSuccess = pdFALSE;
+    }
+
+    if( ( ulBufferLen > 256 ) ||
+        ( ulBufferLen == 0 ) )
+    {
+        xSuccess = pdFALSE;
+    }
+
+    /* DTR page program requires an even start address and length */
+    if( ( xDtrMode == pdTRUE ) &&
+        ( ( ( ulAddr | ulBufferLen ) & 0x1 ) != 0 ) )
+    {
+        xSuccess = pdFALSE;
+        LogError( "Unaligned write of %lu bytes at 0x%08lx in DTR mode.", ulBufferLen, ulAddr );
+    }
+
+    if( pxBuffer == NULL )
+    {
+        xSuccess = pdFALSE;
+    }
+
+#if MX25LM_MMAP_ENABLE
     if( xSuccess == pdTRUE )
     {
-        vTaskDelay( 1 );
+        ospi_ExitMemoryMapped( pxOSPI );
+    }
+#endif
 
+    if( xSuccess == pdTRUE )
+    {
+        xSuccess = ospi_ProgramPage( pxOSPI, ulAddr, pxBuffer, ulBufferLen, xTimeout );
+    }
+
+    if( xSuccess == pdTRUE )
+    {
         /* Wait for idle condition (WIP bit should be 0) */
         xSuccess = ospi_OPI_WaitForStatus( pxOSPI,
                                            MX25LM_REG_SR_WIP | MX25LM_REG_SR_WEL,
                                            0x0,
+                                           MX25LM_PP_POLL_INTERVAL_CYCLES,
                                            xTimeout );
     }
 
+#if MX25LM_MMAP_ENABLE
+    if( xSuccess == pdTRUE )
+    {
+        ospi_InvalidateMapped( ulAddr, ulBufferLen );
+    }
+#endif
+
+    ospi_OpDone();
+
+    return xSuccess;
+}
+
+BaseType_t ospi_WritePages( OSPI_HandleTypeDef * pxOSPI,
+                            uint32_t ulAddr,
+                            const void * pxBuffer,
+                            uint32_t ulBufferLen,
+                            TickType_t xTimeout )
+{
+    BaseType_t xSuccess = pdTRUE;
+
+    ospi_OpInit( pxOSPI );
+
+    if( pxOSPI == NULL )
+    {
+        xSuccess = pdFALSE;
+    }
+
+    if( ( ulBufferLen == 0 ) ||
+        ( ( ulBufferLen % MX25LM_PROGRAM_FIFO_LEN ) != 0 ) ||
+        ( ( ulAddr % MX25LM_PROGRAM_FIFO_LEN ) != 0 ) )
+    {
+        xSuccess = pdFALSE;
+        LogError( "Write of %lu bytes at 0x%08lx is not page aligned.", ulBufferLen, ulAddr );
+    }
+
+    if( ( ulAddr >= MX25LM_MEM_SZ_BYTES ) ||
+        ( ulBufferLen > ( MX25LM_MEM_SZ_BYTES - ulAddr ) ) )
+    {
+        xSuccess = pdFALSE;
+        LogError( "Address is out of range." );
+    }
+
+    if( pxBuffer == NULL )
+    {
+        xSuccess = pdFALSE;
+    }
+
+#if MX25LM_MMAP_ENABLE
+    if( xSuccess == pdTRUE )
+    {
+        ospi_ExitMemoryMapped( pxOSPI );
+    }
+#endif
+
+    for( uint32_t ulOffset = 0; ( xSuccess == pdTRUE ) && ( ulOffset < ulBufferLen ); ulOffset += MX25LM_PROGRAM_FIFO_LEN )
+    {
+        /* Waits for the previous page to finish programming before sending this one */
+        xSuccess = ospi_ProgramPage( pxOSPI,
+                                     ulAddr + ulOffset,
+                                     &( ( ( const uint8_t * ) pxBuffer )[ ulOffset ] ),
+                                     MX25LM_PROGRAM_FIFO_LEN,
+                                     xTimeout );
+    }
+
+#if MX25LM_MMAP_ENABLE
+    if( xSuccess == pdTRUE )
+    {
+        /* Cache lines are only refilled by a mapped read, which waits for the program to complete */
+        ospi_InvalidateMapped( ulAddr, ulBufferLen );
+    }
+#endif
+
+    ospi_OpDone();
+
+    return xSuccess;
+}
+
+BaseType_t ospi_Sync( OSPI_HandleTypeDef * pxOSPI,
+                      TickType_t xTimeout )
+{
+    BaseType_t xSuccess = pdTRUE;
+
+    ospi_OpInit( pxOSPI );
+
+    if( pxOSPI == NULL )
+    {
+        xSuccess = pdFALSE;
+    }
+    else if( ospi_OPI_WaitForIdle( pxOSPI, xTimeout ) != pdTRUE )
+    {
+        xSuccess = pdFALSE;
+        LogError( "Timed out while waiting for the flash to finish programming." );
+    }
+    else
+    {
+        /* Empty */
+    }
+
+    ospi_OpDone();
+
     return xSuccess;
 }
 
@@ -944,13 +1588,17 @@ BaseType_t ospi_EraseSector( OSPI_HandleTypeDef * pxOSPI,
         xSuccess = pdFALSE;
     }
 
+#if MX25LM_MMAP_ENABLE
+    if( xSuccess == pdTRUE )
+    {
+        ospi_ExitMemoryMapped( pxOSPI );
+    }
+#endif
+
     if( xSuccess == pdTRUE )
     {
         /* Wait for idle condition (WIP bit should be 0) */
-        xSuccess = ospi_OPI_WaitForStatus( pxOSPI,
-                                           MX25LM_REG_SR_WIP,
-                                           0x0,
-                                           xTimeout );
+        xSuccess = ospi_OPI_WaitForIdle( pxOSPI, xTimeout );
     }
 
     if( xSuccess == pdTRUE )
@@ -965,6 +1613,7 @@ BaseType_t ospi_EraseSector( OSPI_HandleTypeDef * pxOSPI,
         xSuccess = ospi_OPI_WaitForStatus( pxOSPI,
                                            MX25LM_REG_SR_WEL,
                                            MX25LM_REG_SR_WEL,
+                                           MX25LM_POLL_INTERVAL_CYCLES,
                                            xTimeout );
     }
 
@@ -977,7 +1626,7 @@ BaseType_t ospi_EraseSector( OSPI_HandleTypeDef * pxOSPI,
             .FlashId            = HAL_OSPI_FLASH_ID_1,
 
             .Instruction        = MX25LM_OPI_SE,
-            .InstructionMode    = HAL_OSPI_INSTRUCTION_8_LINES, /* 8 line STR mode */
+            .InstructionMode    = HAL_OSPI_INSTRUCTION_8_LINES, /* 8 line mode */
             .InstructionSize    = HAL_OSPI_INSTRUCTION_16_BITS, /* 2 byte instructions */
             .InstructionDtrMode = HAL_OSPI_INSTRUCTION_DTR_DISABLE,
 
@@ -997,9 +1646,13 @@ BaseType_t ospi_EraseSector( OSPI_HandleTypeDef * pxOSPI,
             .SIOOMode           = HAL_OSPI_SIOO_INST_EVERY_CMD,
         };
 
+        ospi_OPI_SetRate( &xCmd );
+
         /* Clear notification state */
         ( void ) xTaskNotifyStateClearIndexed( NULL, 1 );
 
+        xFlashIdle = pdFALSE;
+
         /* Send command */
         xHalStatus = HAL_OSPI_Command_IT( pxOSPI, &xCmd );
     }
@@ -1015,13 +1668,22 @@ BaseType_t ospi_EraseSector( OSPI_HandleTypeDef * pxOSPI,
 
     if( xSuccess == pdTRUE )
     {
-        vTaskDelay( 1 );
         /* Wait for idle condition (WIP bit should be 0) */
         xSuccess = ospi_OPI_WaitForStatus( pxOSPI,
                                            MX25LM_REG_SR_WEL | MX25LM_REG_SR_WIP,
                                            0x0,
+                                           MX25LM_SE_POLL_INTERVAL_CYCLES,
                                            xTimeout );
     }
 
+#if MX25LM_MMAP_ENABLE
+    if( xSuccess == pdTRUE )
+    {
+        ospi_InvalidateMapped( ulAddr & ~( MX25LM_SECTOR_SZ - 1 ), MX25LM_SECTOR_SZ );
+    }
+#endif
+
+    ospi_OpDone();
+
     return( xSuccess );
 }
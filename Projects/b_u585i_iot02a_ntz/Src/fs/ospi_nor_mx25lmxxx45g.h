@@ -51,6 +51,44 @@
 
 
 #define MX25LM_8READ_DUMMY_CYCLES    ( 20 )
+#define MX25LM_8DTRD_DUMMY_CYCLES    ( 20 )
+
+/* Clock cycles between two status register reads while auto-polling.
+ * Program and erase polls are spaced out to match their typical duration so
+ * that the bus is not kept busy for the whole operation. */
+#define MX25LM_POLL_INTERVAL_CYCLES      ( 0x10 )
+#define MX25LM_PP_POLL_INTERVAL_CYCLES   ( 0x400 )
+#define MX25LM_SE_POLL_INTERVAL_CYCLES   ( 0xFFFF )
+
+/* Dummy cycles of register reads in OPI mode */
+#define MX25LM_REG_STR_DUMMY_CYCLES  ( 4 )
+#define MX25LM_REG_DTR_DUMMY_CYCLES  ( 5 )
+
+/* Set to 0 to keep the flash in 8 line STR mode rather than trying DTR (DOPI) mode first */
+#ifndef MX25LM_DTR_ENABLE
+#define MX25LM_DTR_ENABLE            1
+#endif
+
+/* Set to 0 to read through indirect mode transfers rather than the memory-mapped window */
+#ifndef MX25LM_MMAP_ENABLE
+#define MX25LM_MMAP_ENABLE           1
+#endif
+
+/* Start of the OCTOSPI2 memory-mapped window */
+#define MX25LM_MMAP_BASE             ( OCTOSPI2_BASE )
+
+/* Idle clock cycles before chip select is released in memory-mapped mode */
+#define MX25LM_MMAP_TIMEOUT_CYCLES   ( 0x20 )
+
+/* Set to 0 to move all indirect mode data through the FIFO threshold interrupt */
+#ifndef MX25LM_DMA_ENABLE
+#define MX25LM_DMA_ENABLE            1
+#endif
+
+/* Transfers of at least this many bytes use GPDMA, shorter ones are not worth the setup */
+#ifndef MX25LM_DMA_THRESHOLD_BYTES
+#define MX25LM_DMA_THRESHOLD_BYTES   ( 64 )
+#endif
 
 /* SPI mode command codes */
 #define MX25LM_SPI_WREN              ( 0x06 )
@@ -69,6 +107,9 @@
 #define MX25LM_OPI_RDSR              ( 0x05FA )
 #define MX25LM_OPI_WREN              ( 0x06F9 )
 #define MX25LM_OPI_8READ             ( 0xEC13 )
+#define MX25LM_OPI_8DTRD             ( 0xEE11 ) /* Octa DTR read, STR and DTR commands share the same opcodes otherwise */
+#define MX25LM_OPI_RSTEN             ( 0x6699 ) /* Reset enable */
+#define MX25LM_OPI_RST               ( 0x9966 ) /* Reset memory, returns the flash to 1 line SPI mode */
 #define MX25LM_OPI_PP                ( 0x12ED ) /* Page Program, starting address must be 0 in DTR OPI mode */
 #define MX25LM_PROGRAM_FIFO_LEN      ( 256 )
 #define MX25LM_OPI_SE                ( 0x21DE ) /* Sector Erase */
@@ -78,7 +119,10 @@
 #define MX25LM_READ_TIMEOUT_MS       ( 10 * 1000 )
 
 
-BaseType_t ospi_Init( OSPI_HandleTypeDef * pxOSPI );
+BaseType_t ospi_Init( OSPI_HandleTypeDef * pxOSPI,
+                      BaseType_t xUseDtr );
+
+BaseType_t ospi_IsDtrMode( void );
 
 BaseType_t ospi_WriteAddr( OSPI_HandleTypeDef * pxOSPI,
                            uint32_t ulAddr,
@@ -86,6 +130,20 @@ BaseType_t ospi_WriteAddr( OSPI_HandleTypeDef * pxOSPI,
                            uint32_t ulBufferLen,
                            TickType_t xTimeout );
 
+/*
+ * Program a run of whole pages. Returns once the last page has been sent,
+ * while the flash may still be programming it. Use ospi_Sync to wait for it.
+ */
+BaseType_t ospi_WritePages( OSPI_HandleTypeDef * pxOSPI,
+                            uint32_t ulAddr,
+                            const void * pxBuffer,
+                            uint32_t ulBufferLen,
+                            TickType_t xTimeout );
+
+/* Wait for any program operation started by ospi_WritePages to complete */
+BaseType_t ospi_Sync( OSPI_HandleTypeDef * pxOSPI,
+                      TickType_t xTimeout );
+
 BaseType_t ospi_EraseSector( OSPI_HandleTypeDef * pxOSPI,
                              uint32_t ulAddr,
                              TickType_t xTimeout );
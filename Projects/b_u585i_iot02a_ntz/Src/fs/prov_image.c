@@ -0,0 +1,532 @@
+/*
+ * FreeRTOS STM32 Reference Integration
+ *
+ * Copyright (c) 2022 Amazon.com, Inc. or its affiliates. All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#include "logging_levels.h"
+#define LOG_LEVEL    LOG_INFO
+#define LOG_MODULE    LOG_MODULE_SYS
+#include "logging.h"
+
+#include "FreeRTOS.h"
+
+#include <string.h>
+#include <stdlib.h>
+
+#include "kvstore.h"
+#include "PkiObject.h"
+
+#include "mbedtls/sha256.h"
+#include "mbedtls/x509_crt.h"
+#include "mbedtls/pk.h"
+#include "mbedtls/entropy.h"
+#include "mbedtls/platform_util.h"
+
+#include "lfs.h"
+#include "lfs_port_prv.h"
+#include "ospi_nor_mx25lmxxx45g.h"
+#include "prov_image.h"
+
+#define PROV_IMAGE_HEADER_LEN      ( 44U )
+#define PROV_RECORD_HEADER_LEN     ( 4U )
+#define PROV_IMAGE_CHUNK_LEN       ( 256U )
+
+#if ( ( PROV_IMAGE_FLASH_ADDR + PROV_IMAGE_MAX_LEN ) > OPI_START_ADDRESS )
+#error "The provisioning image must not overlap the littlefs partition"
+#endif
+
+#if ( ( PROV_IMAGE_MAX_LEN % MX25LM_SECTOR_SZ ) != 0 )
+#error "PROV_IMAGE_MAX_LEN must be a multiple of the flash sector size"
+#endif
+
+typedef struct ProvImageHeader
+{
+    uint32_t ulMagic;
+    uint16_t usVersion;
+    uint16_t usRecords;
+    uint32_t ulPayloadLen;
+    uint8_t ucSha256[ 32 ];
+} ProvImageHeader_t;
+
+static const struct lfs_config * pxLfsCfg = NULL;
+
+/*-----------------------------------------------------------*/
+
+static inline OSPI_HandleTypeDef * prvOspi( void )
+{
+    return &( ( ( struct LfsPortCtx * ) pxLfsCfg->context )->xOSPIHandle );
+}
+
+/* The flash is shared with littlefs, so every access holds its lock */
+static BaseType_t prvFlashRead( uint32_t ulAddr,
+                                void * pvBuffer,
+                                uint32_t ulLen )
+{
+    BaseType_t xResult = pdFALSE;
+
+    if( lfs_port_lock( pxLfsCfg ) == 0 )
+    {
+        xResult = ospi_ReadAddr( prvOspi(), ulAddr, pvBuffer, ulLen, pdMS_TO_TICKS( MX25LM_READ_TIMEOUT_MS ) );
+        ( void ) lfs_port_unlock( pxLfsCfg );
+    }
+
+    return xResult;
+}
+
+static BaseType_t prvFlashErase( uint32_t ulLen )
+{
+    BaseType_t xResult = pdTRUE;
+
+    for( uint32_t ulAddr = PROV_IMAGE_FLASH_ADDR;
+         ( ulAddr < ( PROV_IMAGE_FLASH_ADDR + ulLen ) ) && ( xResult == pdTRUE );
+         ulAddr += MX25LM_SECTOR_SZ )
+    {
+        xResult = pdFALSE;
+
+        if( lfs_port_lock( pxLfsCfg ) == 0 )
+        {
+            xResult = ospi_EraseSector( prvOspi(), ulAddr, pdMS_TO_TICKS( MX25LM_ERASE_TIMEOUT_MS ) );
+            ( void ) lfs_port_unlock( pxLfsCfg );
+        }
+    }
+
+    return xResult;
+}
+
+/*-----------------------------------------------------------*/
+
+static inline uint16_t prvGetU16( const uint8_t * pucBuf )
+{
+    return ( uint16_t ) ( pucBuf[ 0 ] | ( pucBuf[ 1 ] << 8 ) );
+}
+
+static inline uint32_t prvGetU32( const uint8_t * pucBuf )
+{
+    return ( ( uint32_t ) pucBuf[ 0 ] ) |
+           ( ( uint32_t ) pucBuf[ 1 ] << 8 ) |
+           ( ( uint32_t ) pucBuf[ 2 ] << 16 ) |
+           ( ( uint32_t ) pucBuf[ 3 ] << 24 );
+}
+
+static BaseType_t prvReadHeader( ProvImageHeader_t * pxHeader )
+{
+    uint8_t ucBuf[ PROV_IMAGE_HEADER_LEN ];
+    BaseType_t xResult = prvFlashRead( PROV_IMAGE_FLASH_ADDR, ucBuf, sizeof( ucBuf ) );
+
+    if( xResult == pdTRUE )
+    {
+        pxHeader->ulMagic = prvGetU32( &( ucBuf[ 0 ] ) );
+        pxHeader->usVersion = prvGetU16( &( ucBuf[ 4 ] ) );
+        pxHeader->usRecords = prvGetU16( &( ucBuf[ 6 ] ) );
+        pxHeader->ulPayloadLen = prvGetU32( &( ucBuf[ 8 ] ) );
+        ( void ) memcpy( pxHeader->ucSha256, &( ucBuf[ 12 ] ), sizeof( pxHeader->ucSha256 ) );
+    }
+
+    return xResult;
+}
+
+static BaseType_t prvCheckPayload( const ProvImageHeader_t * pxHeader )
+{
+    uint8_t ucChunk[ PROV_IMAGE_CHUNK_LEN ];
+    uint8_t ucDigest[ 32 ];
+    mbedtls_sha256_context xShaCtx;
+    BaseType_t xResult = pdTRUE;
+    uint32_t ulOffset = 0;
+
+    mbedtls_sha256_init( &xShaCtx );
+
+    if( mbedtls_sha256_starts( &xShaCtx, 0 ) != 0 )
+    {
+        xResult = pdFALSE;
+    }
+
+    while( ( xResult == pdTRUE ) && ( ulOffset < pxHeader->ulPayloadLen ) )
+    {
+        uint32_t ulLen = pxHeader->ulPayloadLen - ulOffset;
+
+        if( ulLen > sizeof( ucChunk ) )
+        {
+            ulLen = sizeof( ucChunk );
+        }
+
+        xResult = prvFlashRead( PROV_IMAGE_FLASH_ADDR + PROV_IMAGE_HEADER_LEN + ulOffset, ucChunk, ulLen );
+
+        if( ( xResult == pdTRUE ) &&
+            ( mbedtls_sha256_update( &xShaCtx, ucChunk, ulLen ) != 0 ) )
+        {
+            xResult = pdFALSE;
+        }
+
+        ulOffset += ulLen;
+    }
+
+    if( ( xResult == pdTRUE ) &&
+        ( mbedtls_sha256_finish( &xShaCtx, ucDigest ) != 0 ) )
+    {
+        xResult = pdFALSE;
+    }
+
+    if( ( xResult == pdTRUE ) &&
+        ( memcmp( ucDigest, pxHeader->ucSha256, sizeof( ucDigest ) ) != 0 ) )
+    {
+        LogError( "Provisioning image checksum mismatch." );
+        xResult = pdFALSE;
+    }
+
+    mbedtls_sha256_free( &xShaCtx );
+
+    return xResult;
+}
+
+/*-----------------------------------------------------------*/
+
+/* Parse pcValue according to the type of the key, as "conf set" does */
+static BaseType_t prvApplyKv( const char * pcKey,
+                              const char * pcValue,
+                              size_t uxValueLen )
+{
+    KVStoreKey_t xKey = kvStringToKey( pcKey );
+    BaseType_t xResult = pdFALSE;
+    char * pcEndPtr = NULL;
+
+    switch( KVStore_getType( xKey ) )
+    {
+        case KV_TYPE_BASE_T:
+            {
+                BaseType_t xValue = strtol( pcValue, &pcEndPtr, 10 );
+
+                if( ( pcEndPtr != pcValue ) && ( *pcEndPtr == '\0' ) )
+                {
+                    xResult = KVStore_setBase( xKey, xValue );
+                }
+
+                break;
+            }
+
+        case KV_TYPE_INT32:
+            {
+                int32_t lValue = strtol( pcValue, &pcEndPtr, 10 );
+
+                if( ( pcEndPtr != pcValue ) && ( *pcEndPtr == '\0' ) )
+                {
+                    xResult = KVStore_setInt32( xKey, lValue );
+                }
+
+                break;
+            }
+
+        case KV_TYPE_UBASE_T:
+            {
+                UBaseType_t uxValue = strtoul( pcValue, &pcEndPtr, 10 );
+
+                if( ( pcEndPtr != pcValue ) && ( *pcEndPtr == '\0' ) )
+                {
+                    xResult = KVStore_setUBase( xKey, uxValue );
+                }
+
+                break;
+            }
+
+        case KV_TYPE_UINT32:
+            {
+                uint32_t ulValue = strtoul( pcValue, &pcEndPtr, 10 );
+
+                if( ( pcEndPtr != pcValue ) && ( *pcEndPtr == '\0' ) )
+                {
+                    xResult = KVStore_setUInt32( xKey, ulValue );
+                }
+
+                break;
+            }
+
+        case KV_TYPE_STRING:
+
+            /* Log levels take effect immediately, and are only stored if valid */
+            if( ( xKey != CS_LOG_LEVELS ) ||
+                ( lLoggingSetLevels( pcValue ) == 1 ) )
+            {
+                xResult = KVStore_setString( xKey, pcValue );
+            }
+
+            break;
+
+        case KV_TYPE_BLOB:
+            xResult = KVStore_setBlob( xKey, uxValueLen, pcValue );
+            break;
+
+        case KV_TYPE_NONE:
+        default:
+            break;
+    }
+
+    if( xResult != pdTRUE )
+    {
+        LogError( "Failed to set %s from the provisioning image.", pcKey );
+    }
+
+    return xResult;
+}
+
+/* mbedtls only parses PEM when the length includes the null terminator */
+static inline size_t prvParseLen( const uint8_t * pucData,
+                                  size_t uxDataLen )
+{
+    return( ( strstr( ( const char * ) pucData, "-----BEGIN" ) != NULL ) ? uxDataLen + 1 : uxDataLen );
+}
+
+static BaseType_t prvApplyCert( const char * pcLabel,
+                                const uint8_t * pucData,
+                                size_t uxDataLen )
+{
+    mbedtls_x509_crt xCert;
+    PkiStatus_t xStatus = PKI_ERR_OBJ_PARSING_FAILED;
+
+    mbedtls_x509_crt_init( &xCert );
+
+    if( mbedtls_x509_crt_parse( &xCert, pucData, prvParseLen( pucData, uxDataLen ) ) == 0 )
+    {
+        xStatus = xPkiWriteCertificate( pcLabel, &xCert );
+    }
+
+    mbedtls_x509_crt_free( &xCert );
+
+    if( xStatus != PKI_SUCCESS )
+    {
+        LogError( "Failed to store certificate %s from the provisioning image: %d.", pcLabel, xStatus );
+    }
+
+    return( xStatus == PKI_SUCCESS ? pdTRUE : pdFALSE );
+}
+
+static BaseType_t prvApplyKey( const char * pcLabel,
+                               const uint8_t * pucData,
+                               size_t uxDataLen,
+                               BaseType_t xPrivate )
+{
+    mbedtls_pk_context xPkCtx;
+    mbedtls_entropy_context xEntropyCtx;
+    PkiStatus_t xStatus = PKI_ERR_OBJ_PARSING_FAILED;
+    int lError;
+
+    mbedtls_pk_init( &xPkCtx );
+    mbedtls_entropy_init( &xEntropyCtx );
+
+    if( xPrivate == pdTRUE )
+    {
+        lError = mbedtls_pk_parse_key( &xPkCtx, pucData, prvParseLen( pucData, uxDataLen ),
+                                       NULL, 0, mbedtls_entropy_func, &xEntropyCtx );
+    }
+    else
+    {
+        lError = mbedtls_pk_parse_public_key( &xPkCtx, pucData, prvParseLen( pucData, uxDataLen ) );
+    }
+
+    if( lError == 0 )
+    {
+        if( xPrivate == pdTRUE )
+        {
+            xStatus = xPkiWritePrvKey( pcLabel, &xPkCtx );
+        }
+        else
+        {
+            xStatus = xPkiWritePubKey( pcLabel, pucData, uxDataLen, &xPkCtx );
+        }
+    }
+
+    mbedtls_pk_free( &xPkCtx );
+    mbedtls_entropy_free( &xEntropyCtx );
+
+    if( xStatus != PKI_SUCCESS )
+    {
+        LogError( "Failed to store key %s from the provisioning image: %d.", pcLabel, xStatus );
+    }
+
+    return( xStatus == PKI_SUCCESS ? pdTRUE : pdFALSE );
+}
+
+/*-----------------------------------------------------------*/
+
+static BaseType_t prvApplyRecords( const ProvImageHeader_t * pxHeader )
+{
+    BaseType_t xResult = pdTRUE;
+    uint32_t ulOffset = 0;
+    char cName[ UINT8_MAX + 1 ];
+
+    for( uint32_t ulIdx = 0; ( ulIdx < pxHeader->usRecords ) && ( xResult == pdTRUE ); ulIdx++ )
+    {
+        uint8_t ucRecHeader[ PROV_RECORD_HEADER_LEN ];
+        uint8_t * pucData = NULL;
+        uint32_t ulAddr = PROV_IMAGE_FLASH_ADDR + PROV_IMAGE_HEADER_LEN + ulOffset;
+        uint8_t ucType = 0;
+        uint32_t ulNameLen = 0;
+        uint32_t ulDataLen = 0;
+
+        if( ( ulOffset + PROV_RECORD_HEADER_LEN ) > pxHeader->ulPayloadLen )
+        {
+            xResult = pdFALSE;
+        }
+        else
+        {
+            xResult = prvFlashRead( ulAddr, ucRecHeader, sizeof( ucRecHeader ) );
+        }
+
+        if( xResult == pdTRUE )
+        {
+            ucType = ucRecHeader[ 0 ];
+            ulNameLen = ucRecHeader[ 1 ];
+            ulDataLen = prvGetU16( &( ucRecHeader[ 2 ] ) );
+
+            if( ( ulNameLen == 0 ) ||
+                ( ( ulOffset + PROV_RECORD_HEADER_LEN + ulNameLen + ulDataLen ) > pxHeader->ulPayloadLen ) )
+            {
+                LogError( "Malformed record %lu in the provisioning image.", ulIdx );
+                xResult = pdFALSE;
+            }
+        }
+
+        if( xResult == pdTRUE )
+        {
+            pucData = pvPortMalloc( ulDataLen + 1 );
+            xResult = ( pucData != NULL ) ? pdTRUE : pdFALSE;
+        }
+
+        if( xResult == pdTRUE )
+        {
+            xResult = prvFlashRead( ulAddr + PROV_RECORD_HEADER_LEN, cName, ulNameLen );
+        }
+
+        if( ( xResult == pdTRUE ) && ( ulDataLen > 0 ) )
+        {
+            xResult = prvFlashRead( ulAddr + PROV_RECORD_HEADER_LEN + ulNameLen, pucData, ulDataLen );
+        }
+
+        if( xResult == pdTRUE )
+        {
+            cName[ ulNameLen ] = '\0';
+            pucData[ ulDataLen ] = '\0';
+
+            switch( ucType )
+            {
+                case PROV_REC_KV:
+                    xResult = prvApplyKv( cName, ( const char * ) pucData, ulDataLen );
+                    break;
+
+                case PROV_REC_CERT:
+                    xResult = prvApplyCert( cName, pucData, ulDataLen );
+                    break;
+
+                case PROV_REC_PRIVATE_KEY:
+                    xResult = prvApplyKey( cName, pucData, ulDataLen, pdTRUE );
+                    break;
+
+                case PROV_REC_PUBLIC_KEY:
+                    xResult = prvApplyKey( cName, pucData, ulDataLen, pdFALSE );
+                    break;
+
+                default:
+                    LogError( "Unknown record type %u in the provisioning image.", ucType );
+                    xResult = pdFALSE;
+                    break;
+            }
+        }
+
+        if( pucData != NULL )
+        {
+            mbedtls_platform_zeroize( pucData, ulDataLen + 1 );
+            vPortFree( pucData );
+        }
+
+        /* Records are padded to a multiple of 4 bytes */
+        ulOffset += ( PROV_RECORD_HEADER_LEN + ulNameLen + ulDataLen + 3U ) & ~3U;
+    }
+
+    return xResult;
+}
+
+/*-----------------------------------------------------------*/
+
+BaseType_t xProvImageApply( const struct lfs_config * pxCfg )
+{
+    ProvImageHeader_t xHeader = { 0 };
+    BaseType_t xResult;
+
+    configASSERT( pxCfg != NULL );
+
+    pxLfsCfg = pxCfg;
+
+    xResult = prvReadHeader( &xHeader );
+
+    /* Erased flash, nothing to provision */
+    if( ( xResult == pdTRUE ) &&
+        ( xHeader.ulMagic != PROV_IMAGE_MAGIC ) )
+    {
+        if( xHeader.ulMagic != 0xFFFFFFFFUL )
+        {
+            LogWarn( "Ignoring unrecognized data at the provisioning image address." );
+        }
+
+        xResult = pdFALSE;
+    }
+
+    if( ( xResult == pdTRUE ) &&
+        ( ( xHeader.usVersion != PROV_IMAGE_VERSION ) ||
+          ( xHeader.ulPayloadLen > ( PROV_IMAGE_MAX_LEN - PROV_IMAGE_HEADER_LEN ) ) ) )
+    {
+        LogError( "Unsupported provisioning image, version: %u, length: %lu.",
+                  xHeader.usVersion, xHeader.ulPayloadLen );
+        xResult = pdFALSE;
+    }
+
+    if( xResult == pdTRUE )
+    {
+        xResult = prvCheckPayload( &xHeader );
+    }
+
+    if( xResult == pdTRUE )
+    {
+        LogInfo( "Applying provisioning image with %u records.", xHeader.usRecords );
+
+        xResult = prvApplyRecords( &xHeader );
+    }
+
+    /* The image is only erased once its contents are stored, so an interrupted
+     * ingest is repeated on the next boot */
+    if( xResult == pdTRUE )
+    {
+        xResult = KVStore_xFlush();
+    }
+
+    if( xResult == pdTRUE )
+    {
+        xResult = prvFlashErase( PROV_IMAGE_HEADER_LEN + xHeader.ulPayloadLen );
+
+        if( xResult == pdTRUE )
+        {
+            LogInfo( "Provisioning image applied and erased." );
+        }
+        else
+        {
+            LogError( "Failed to erase the provisioning image." );
+        }
+    }
+
+    return xResult;
+}
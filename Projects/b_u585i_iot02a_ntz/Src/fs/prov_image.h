@@ -0,0 +1,80 @@
+/*
+ * FreeRTOS STM32 Reference Integration
+ *
+ * Copyright (c) 2022 Amazon.com, Inc. or its affiliates. All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+/**
+ * @file prov_image.h
+ * @brief Provisioning image written to the OSPI NOR flash by the host.
+ *
+ * tools/provision.py --image builds an image holding the runtime configuration,
+ * certificates and keys of a device, which stm32u5_tool.sh flash_prov programs
+ * together with the firmware. The image sits in the otherwise unused space
+ * before the littlefs partition. All fields are little endian:
+ *
+ *   header:  uint32 magic "PROV", uint16 version, uint16 number of records,
+ *            uint32 payload length, uint8[ 32 ] SHA-256 of the payload
+ *   record:  uint8 type, uint8 name length, uint16 data length, name, data,
+ *            zero padding to a multiple of 4 bytes
+ *
+ * The name of a PROV_REC_KV record is a kvstore key and its data the value as
+ * text, parsed as for "conf set". The name of the other records is a PKI label
+ * and their data a PEM or DER object.
+ *
+ * On boot the image is checked, applied, and erased once everything it holds
+ * has been stored.
+ */
+
+#ifndef PROV_IMAGE_H_
+#define PROV_IMAGE_H_
+
+#include <stdint.h>
+
+#include "FreeRTOS.h"
+
+#include "lfs.h"
+#include "ospi_nor_mx25lmxxx45g.h"
+
+#define PROV_IMAGE_FLASH_ADDR    ( 0U )
+
+#ifndef PROV_IMAGE_MAX_LEN
+#define PROV_IMAGE_MAX_LEN       ( 64U * 1024U )
+#endif
+
+#define PROV_IMAGE_MAGIC         ( 0x564F5250UL ) /* "PROV" */
+#define PROV_IMAGE_VERSION       ( 1U )
+
+typedef enum ProvRecordType
+{
+    PROV_REC_KV = 1,          /* kvstore value */
+    PROV_REC_CERT = 2,        /* X509 certificate */
+    PROV_REC_PRIVATE_KEY = 3, /* EC private key */
+    PROV_REC_PUBLIC_KEY = 4   /* EC public key */
+} ProvRecordType_t;
+
+/*
+ * Apply and erase the provisioning image, if there is one.
+ * Call once the filesystem is mounted and the kvstore initialized.
+ * Returns pdTRUE if an image was found and applied.
+ */
+BaseType_t xProvImageApply( const struct lfs_config * pxCfg );
+
+#endif /* PROV_IMAGE_H_ */
@@ -0,0 +1,346 @@
+/*
+ * FreeRTOS STM32 Reference Integration
+ * Copyright (C) 2022 Amazon.com, Inc. or its affiliates.  All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ *
+ * https://www.FreeRTOS.org
+ * https://github.com/FreeRTOS
+ *
+ */
+
+/**
+ * @file ota_pal_delta.c
+ * @brief Streaming decoder for delta (differential) OTA images.
+ */
+
+#include "logging_levels.h"
+#define LOG_LEVEL    LOG_INFO
+#define LOG_MODULE    LOG_MODULE_OTA
+#include "logging.h"
+
+#include <string.h>
+
+#include "FreeRTOS.h"
+
+#include "mbedtls/md.h"
+#include "mbedtls_error_utils.h"
+
+#include "ota_pal_delta.h"
+
+static inline uint32_t ulReadLe32( const uint8_t * pucData )
+{
+    return ( ( uint32_t ) pucData[ 0 ] ) |
+           ( ( uint32_t ) pucData[ 1 ] << 8 ) |
+           ( ( uint32_t ) pucData[ 2 ] << 16 ) |
+           ( ( uint32_t ) pucData[ 3 ] << 24 );
+}
+
+void vOtaDeltaInit( OtaDeltaDecoder_t * pxDecoder,
+                    const uint8_t * pucSource,
+                    uint32_t ulSourceMaxSize,
+                    uint32_t ulTargetMaxSize,
+                    OtaDeltaWriteCallback_t xWriteCallback,
+                    void * pvCtx )
+{
+    configASSERT( pxDecoder != NULL );
+    configASSERT( pucSource != NULL );
+    configASSERT( xWriteCallback != NULL );
+
+    ( void ) memset( pxDecoder, 0, sizeof( OtaDeltaDecoder_t ) );
+
+    pxDecoder->xState = OtaDeltaStateHeader;
+    pxDecoder->pucSource = pucSource;
+    pxDecoder->ulSourceMaxSize = ulSourceMaxSize;
+    pxDecoder->ulTargetMaxSize = ulTargetMaxSize;
+    pxDecoder->xWriteCallback = xWriteCallback;
+    pxDecoder->pvCtx = pvCtx;
+}
+
+static BaseType_t prvFlushOutput( OtaDeltaDecoder_t * pxDecoder )
+{
+    BaseType_t xResult = pdTRUE;
+
+    if( pxDecoder->ulOutputFill > 0 )
+    {
+        xResult = pxDecoder->xWriteCallback( pxDecoder->pvCtx,
+                                             pxDecoder->ulTargetPos - pxDecoder->ulOutputFill,
+                                             pxDecoder->pucOutput,
+                                             pxDecoder->ulOutputFill );
+        pxDecoder->ulOutputFill = 0;
+    }
+
+    return xResult;
+}
+
+static BaseType_t prvCheckSourceHash( const OtaDeltaDecoder_t * pxDecoder,
+                                      const uint8_t * pucExpectedHash )
+{
+    BaseType_t xResult = pdFALSE;
+    unsigned char pucHash[ MBEDTLS_MD_MAX_SIZE ];
+    const mbedtls_md_info_t * pxMdInfo = mbedtls_md_info_from_type( MBEDTLS_MD_SHA256 );
+    int lRslt = -1;
+
+    if( pxMdInfo != NULL )
+    {
+        lRslt = mbedtls_md( pxMdInfo, pxDecoder->pucSource, pxDecoder->ulSourceSize, pucHash );
+    }
+
+    MBEDTLS_MSG_IF_ERROR( lRslt, "Failed to hash the source image of the delta." );
+
+    if( ( lRslt == 0 ) &&
+        ( memcmp( pucHash, pucExpectedHash, OTA_DELTA_SOURCE_HASH_LEN ) == 0 ) )
+    {
+        xResult = pdTRUE;
+    }
+
+    return xResult;
+}
+
+static BaseType_t prvParseHeader( OtaDeltaDecoder_t * pxDecoder )
+{
+    BaseType_t xResult = pdFALSE;
+    const uint8_t * pucField = pxDecoder->pucField;
+
+    pxDecoder->ulTargetSize = ulReadLe32( &( pucField[ 4 ] ) );
+    pxDecoder->ulSourceSize = ulReadLe32( &( pucField[ 8 ] ) );
+
+    if( ulReadLe32( pucField ) != OTA_DELTA_MAGIC )
+    {
+        LogError( "Not a delta image." );
+    }
+    else if( ( pxDecoder->ulTargetSize == 0 ) ||
+             ( pxDecoder->ulTargetSize > pxDecoder->ulTargetMaxSize ) )
+    {
+        LogError( "Delta target size %lu exceeds the %lu bytes available.",
+                  pxDecoder->ulTargetSize, pxDecoder->ulTargetMaxSize );
+    }
+    else if( pxDecoder->ulSourceSize > pxDecoder->ulSourceMaxSize )
+    {
+        LogError( "Delta source size %lu exceeds the active bank.", pxDecoder->ulSourceSize );
+    }
+    else if( prvCheckSourceHash( pxDecoder, &( pucField[ 12 ] ) ) != pdTRUE )
+    {
+        LogError( "Delta image was not made for the running firmware." );
+    }
+    else
+    {
+        LogInfo( "Rebuilding a %lu byte image from a delta.", pxDecoder->ulTargetSize );
+        xResult = pdTRUE;
+    }
+
+    return xResult;
+}
+
+static BaseType_t prvParseControl( OtaDeltaDecoder_t * pxDecoder )
+{
+    BaseType_t xResult = pdFALSE;
+    uint32_t ulTargetLeft = pxDecoder->ulTargetSize - pxDecoder->ulTargetPos;
+
+    pxDecoder->ulCopyLeft = ulReadLe32( &( pxDecoder->pucField[ 0 ] ) );
+    pxDecoder->ulExtraLeft = ulReadLe32( &( pxDecoder->pucField[ 4 ] ) );
+    pxDecoder->lSeek = ( int32_t ) ulReadLe32( &( pxDecoder->pucField[ 8 ] ) );
+
+    if( ( pxDecoder->ulCopyLeft > ulTargetLeft ) ||
+        ( pxDecoder->ulExtraLeft > ( ulTargetLeft - pxDecoder->ulCopyLeft ) ) )
+    {
+        LogError( "Delta record overruns the target image." );
+    }
+    else if( pxDecoder->ulCopyLeft > ( pxDecoder->ulSourceSize - pxDecoder->ulSourcePos ) )
+    {
+        LogError( "Delta record overruns the source image." );
+    }
+    else
+    {
+        xResult = pdTRUE;
+    }
+
+    return xResult;
+}
+
+/* Append the source bytes of a record to the rebuilt image */
+static BaseType_t prvCopySource( OtaDeltaDecoder_t * pxDecoder )
+{
+    BaseType_t xResult = pdTRUE;
+
+    while( ( xResult == pdTRUE ) && ( pxDecoder->ulCopyLeft > 0 ) )
+    {
+        uint32_t ulChunk = OTA_DELTA_OUTPUT_BUFFER_LEN - pxDecoder->ulOutputFill;
+
+        ulChunk = ( ulChunk < pxDecoder->ulCopyLeft ) ? ulChunk : pxDecoder->ulCopyLeft;
+
+        ( void ) memcpy( &( pxDecoder->pucOutput[ pxDecoder->ulOutputFill ] ),
+                         &( pxDecoder->pucSource[ pxDecoder->ulSourcePos ] ), ulChunk );
+
+        pxDecoder->ulSourcePos += ulChunk;
+        pxDecoder->ulCopyLeft -= ulChunk;
+        pxDecoder->ulOutputFill += ulChunk;
+        pxDecoder->ulTargetPos += ulChunk;
+
+        if( pxDecoder->ulOutputFill == OTA_DELTA_OUTPUT_BUFFER_LEN )
+        {
+            xResult = prvFlushOutput( pxDecoder );
+        }
+    }
+
+    return xResult;
+}
+
+/* Move the source position once a record is complete */
+static BaseType_t prvEndRecord( OtaDeltaDecoder_t * pxDecoder )
+{
+    BaseType_t xResult = pdFALSE;
+    int64_t llSourcePos = ( int64_t ) pxDecoder->ulSourcePos + pxDecoder->lSeek;
+
+    if( ( llSourcePos < 0 ) ||
+        ( llSourcePos > ( int64_t ) pxDecoder->ulSourceSize ) )
+    {
+        LogError( "Delta record seeks outside of the source image." );
+    }
+    else
+    {
+        pxDecoder->ulSourcePos = ( uint32_t ) llSourcePos;
+        pxDecoder->xState = ( pxDecoder->ulTargetPos == pxDecoder->ulTargetSize ) ?
+                            OtaDeltaStateDone : OtaDeltaStateControl;
+        xResult = pdTRUE;
+    }
+
+    return xResult;
+}
+
+BaseType_t xOtaDeltaFeed( OtaDeltaDecoder_t * pxDecoder,
+                          const uint8_t * pucPatch,
+                          uint32_t ulLength )
+{
+    configASSERT( pxDecoder != NULL );
+    configASSERT( ( pucPatch != NULL ) || ( ulLength == 0 ) );
+
+    while( ( ulLength > 0 ) && ( pxDecoder->xState != OtaDeltaStateError ) )
+    {
+        BaseType_t xResult = pdTRUE;
+        uint32_t ulChunk = 0;
+
+        switch( pxDecoder->xState )
+        {
+            case OtaDeltaStateHeader:
+            case OtaDeltaStateControl:
+               {
+                   uint32_t ulFieldLen = ( pxDecoder->xState == OtaDeltaStateHeader ) ?
+                                         OTA_DELTA_HEADER_LEN : OTA_DELTA_CONTROL_LEN;
+
+                   ulChunk = ulFieldLen - pxDecoder->ulFieldFill;
+                   ulChunk = ( ulChunk < ulLength ) ? ulChunk : ulLength;
+
+                   ( void ) memcpy( &( pxDecoder->pucField[ pxDecoder->ulFieldFill ] ), pucPatch, ulChunk );
+                   pxDecoder->ulFieldFill += ulChunk;
+
+                   if( pxDecoder->ulFieldFill == ulFieldLen )
+                   {
+                       pxDecoder->ulFieldFill = 0;
+
+                       if( pxDecoder->xState == OtaDeltaStateHeader )
+                       {
+                           xResult = prvParseHeader( pxDecoder );
+                           pxDecoder->xState = OtaDeltaStateControl;
+                       }
+                       else
+                       {
+                           xResult = prvParseControl( pxDecoder );
+                           pxDecoder->xState = OtaDeltaStateExtra;
+
+                           if( xResult == pdTRUE )
+                           {
+                               xResult = prvCopySource( pxDecoder );
+                           }
+                       }
+                   }
+
+                   break;
+               }
+
+            case OtaDeltaStateExtra:
+                ulChunk = OTA_DELTA_OUTPUT_BUFFER_LEN - pxDecoder->ulOutputFill;
+                ulChunk = ( ulChunk < ulLength ) ? ulChunk : ulLength;
+                ulChunk = ( ulChunk < pxDecoder->ulExtraLeft ) ? ulChunk : pxDecoder->ulExtraLeft;
+
+                ( void ) memcpy( &( pxDecoder->pucOutput[ pxDecoder->ulOutputFill ] ), pucPatch, ulChunk );
+
+                pxDecoder->ulExtraLeft -= ulChunk;
+                pxDecoder->ulOutputFill += ulChunk;
+                pxDecoder->ulTargetPos += ulChunk;
+
+                if( pxDecoder->ulOutputFill == OTA_DELTA_OUTPUT_BUFFER_LEN )
+                {
+                    xResult = prvFlushOutput( pxDecoder );
+                }
+
+                break;
+
+            case OtaDeltaStateDone:
+            default:
+                LogError( "Unexpected data after the end of the delta image." );
+                xResult = pdFALSE;
+                break;
+        }
+
+        /* The record ends with its extra bytes, which may be none at all */
+        if( ( xResult == pdTRUE ) &&
+            ( pxDecoder->xState == OtaDeltaStateExtra ) &&
+            ( pxDecoder->ulExtraLeft == 0 ) )
+        {
+            xResult = prvEndRecord( pxDecoder );
+        }
+
+        if( xResult != pdTRUE )
+        {
+            pxDecoder->xState = OtaDeltaStateError;
+        }
+
+        pucPatch += ulChunk;
+        ulLength -= ulChunk;
+    }
+
+    return( ( pxDecoder->xState != OtaDeltaStateError ) ? pdTRUE : pdFALSE );
+}
+
+BaseType_t xOtaDeltaFinish( OtaDeltaDecoder_t * pxDecoder,
+                            uint32_t * pulTargetSize )
+{
+    BaseType_t xResult = pdFALSE;
+
+    configASSERT( pxDecoder != NULL );
+    configASSERT( pulTargetSize != NULL );
+
+    if( pxDecoder->xState != OtaDeltaStateDone )
+    {
+        LogError( "Delta image is incomplete, %lu of %lu bytes rebuilt.",
+                  pxDecoder->ulTargetPos, pxDecoder->ulTargetSize );
+    }
+    else if( prvFlushOutput( pxDecoder ) != pdTRUE )
+    {
+        LogError( "Failed to write the end of the rebuilt image." );
+    }
+    else
+    {
+        *pulTargetSize = pxDecoder->ulTargetSize;
+        xResult = pdTRUE;
+    }
+
+    return xResult;
+}
@@ -0,0 +1,127 @@
+/*
+ * FreeRTOS STM32 Reference Integration
+ * Copyright (C) 2022 Amazon.com, Inc. or its affiliates.  All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ *
+ * https://www.FreeRTOS.org
+ * https://github.com/FreeRTOS
+ *
+ */
+
+/**
+ * @file ota_pal_delta.h
+ * @brief Streaming decoder for delta (differential) OTA images.
+ *
+ * A delta image rebuilds the new firmware from the running one. It starts with a
+ * header followed by copy / insert records, all little endian:
+ *
+ *   header:  uint32 magic, uint32 target size, uint32 source size,
+ *            uint8 SHA-256 of the source image[ 32 ]
+ *   record:  uint32 copy length, uint32 extra length, int32 source seek,
+ *            extra bytes
+ *
+ * Each record copies bytes from the current source position, appends the extra
+ * bytes carried in the delta and then moves the source position by the seek
+ * value. Unlike bsdiff there is no diff stream to compress, as the OTA transfer
+ * is not compressed. tools/ota_delta.py creates images in this format.
+ */
+
+#ifndef _OTA_PAL_DELTA_H
+#define _OTA_PAL_DELTA_H
+
+#include "FreeRTOS.h"
+
+#define OTA_DELTA_MAGIC                 ( 0x544C4544UL ) /* "DELT" */
+#define OTA_DELTA_SOURCE_HASH_LEN       ( 32U )
+#define OTA_DELTA_HEADER_LEN            ( 12U + OTA_DELTA_SOURCE_HASH_LEN )
+#define OTA_DELTA_CONTROL_LEN           ( 12U )
+
+/* Decoded bytes handed to the write callback at once, a multiple of the flash burst size */
+#ifndef OTA_DELTA_OUTPUT_BUFFER_LEN
+#define OTA_DELTA_OUTPUT_BUFFER_LEN     ( 1024U )
+#endif
+
+typedef enum
+{
+    OtaDeltaStateHeader = 0,
+    OtaDeltaStateControl,
+    OtaDeltaStateExtra,
+    OtaDeltaStateDone,
+    OtaDeltaStateError
+} OtaDeltaState_t;
+
+/*
+ * Called with consecutive runs of the rebuilt image. ulLength is
+ * OTA_DELTA_OUTPUT_BUFFER_LEN for every run but the last.
+ */
+typedef BaseType_t ( * OtaDeltaWriteCallback_t )( void * pvCtx,
+                                                  uint32_t ulOffset,
+                                                  uint8_t * pucData,
+                                                  uint32_t ulLength );
+
+typedef struct
+{
+    OtaDeltaState_t xState;
+    const uint8_t * pucSource;
+    uint32_t ulSourceMaxSize;
+    uint32_t ulTargetMaxSize;
+    uint32_t ulSourceSize;
+    uint32_t ulTargetSize;
+    uint32_t ulSourcePos;
+    uint32_t ulTargetPos;  /* Bytes decoded, including those still in pucOutput */
+    uint32_t ulCopyLeft;
+    uint32_t ulExtraLeft;
+    int32_t lSeek;
+    uint32_t ulFieldFill;  /* Bytes of the header or control record received so far */
+    uint8_t pucField[ OTA_DELTA_HEADER_LEN ];
+    uint32_t ulOutputFill;
+    uint8_t pucOutput[ OTA_DELTA_OUTPUT_BUFFER_LEN ];
+    OtaDeltaWriteCallback_t xWriteCallback;
+    void * pvCtx;
+} OtaDeltaDecoder_t;
+
+/*
+ * @brief Prepare pxDecoder to rebuild an image of at most ulTargetMaxSize bytes
+ * from the ulSourceMaxSize bytes at pucSource.
+ */
+void vOtaDeltaInit( OtaDeltaDecoder_t * pxDecoder,
+                    const uint8_t * pucSource,
+                    uint32_t ulSourceMaxSize,
+                    uint32_t ulTargetMaxSize,
+                    OtaDeltaWriteCallback_t xWriteCallback,
+                    void * pvCtx );
+
+/*
+ * @brief Decode the next ulLength bytes of the delta image.
+ * @return pdFALSE if the delta image is malformed, does not apply to the source
+ * or the write callback failed.
+ */
+BaseType_t xOtaDeltaFeed( OtaDeltaDecoder_t * pxDecoder,
+                          const uint8_t * pucPatch,
+                          uint32_t ulLength );
+
+/*
+ * @brief Write out the remaining decoded bytes once the whole delta image was fed.
+ * @return pdTRUE and the size of the rebuilt image if it is complete.
+ */
+BaseType_t xOtaDeltaFinish( OtaDeltaDecoder_t * pxDecoder,
+                            uint32_t * pulTargetSize );
+
+#endif /* _OTA_PAL_DELTA_H */
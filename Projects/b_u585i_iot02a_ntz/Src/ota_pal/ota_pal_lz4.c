@@ -0,0 +1,363 @@
+/*
+ * FreeRTOS STM32 Reference Integration
+ * Copyright (C) 2022 Amazon.com, Inc. or its affiliates.  All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ *
+ * https://www.FreeRTOS.org
+ * https://github.com/FreeRTOS
+ *
+ */
+
+/**
+ * @file ota_pal_lz4.c
+ * @brief Streaming decoder for LZ4 compressed OTA images.
+ */
+
+#include "logging_levels.h"
+#define LOG_LEVEL    LOG_INFO
+#define LOG_MODULE    LOG_MODULE_OTA
+#include "logging.h"
+
+#include <string.h>
+
+#include "FreeRTOS.h"
+
+#include "ota_pal_lz4.h"
+
+void vOtaLz4Init( OtaLz4Decoder_t * pxDecoder,
+                  const uint8_t * pucTarget,
+                  uint32_t ulTargetMaxSize,
+                  OtaLz4WriteCallback_t xWriteCallback,
+                  void * pvCtx )
+{
+    configASSERT( pxDecoder != NULL );
+    configASSERT( pucTarget != NULL );
+    configASSERT( xWriteCallback != NULL );
+
+    ( void ) memset( pxDecoder, 0, sizeof( OtaLz4Decoder_t ) );
+
+    pxDecoder->xState = OtaLz4StateHeader;
+    pxDecoder->pucTarget = pucTarget;
+    pxDecoder->ulTargetMaxSize = ulTargetMaxSize;
+    pxDecoder->xWriteCallback = xWriteCallback;
+    pxDecoder->pvCtx = pvCtx;
+}
+
+static BaseType_t prvFlushOutput( OtaLz4Decoder_t * pxDecoder )
+{
+    BaseType_t xResult = pdTRUE;
+
+    if( pxDecoder->ulOutputFill > 0 )
+    {
+        xResult = pxDecoder->xWriteCallback( pxDecoder->pvCtx,
+                                             pxDecoder->ulTargetPos - pxDecoder->ulOutputFill,
+                                             pxDecoder->pucOutput,
+                                             pxDecoder->ulOutputFill );
+        pxDecoder->ulOutputFill = 0;
+    }
+
+    return xResult;
+}
+
+static BaseType_t prvParseHeader( OtaLz4Decoder_t * pxDecoder )
+{
+    BaseType_t xResult = pdFALSE;
+    const uint8_t * pucField = pxDecoder->pucField;
+    uint32_t ulMagic = ( ( uint32_t ) pucField[ 0 ] ) |
+                       ( ( uint32_t ) pucField[ 1 ] << 8 ) |
+                       ( ( uint32_t ) pucField[ 2 ] << 16 ) |
+                       ( ( uint32_t ) pucField[ 3 ] << 24 );
+
+    pxDecoder->ulTargetSize = ( ( uint32_t ) pucField[ 4 ] ) |
+                              ( ( uint32_t ) pucField[ 5 ] << 8 ) |
+                              ( ( uint32_t ) pucField[ 6 ] << 16 ) |
+                              ( ( uint32_t ) pucField[ 7 ] << 24 );
+
+    if( ulMagic != OTA_LZ4_MAGIC )
+    {
+        LogError( "Not an LZ4 compressed image." );
+    }
+    else if( ( pxDecoder->ulTargetSize == 0 ) ||
+             ( pxDecoder->ulTargetSize > pxDecoder->ulTargetMaxSize ) )
+    {
+        LogError( "Decompressed size %lu exceeds the %lu bytes available.",
+                  pxDecoder->ulTargetSize, pxDecoder->ulTargetMaxSize );
+    }
+    else
+    {
+        LogInfo( "Decompressing a %lu byte image.", pxDecoder->ulTargetSize );
+        xResult = pdTRUE;
+    }
+
+    return xResult;
+}
+
+static BaseType_t prvPutByte( OtaLz4Decoder_t * pxDecoder,
+                              uint8_t ucByte )
+{
+    BaseType_t xResult = pdTRUE;
+
+    pxDecoder->pucOutput[ pxDecoder->ulOutputFill ] = ucByte;
+    pxDecoder->ulOutputFill++;
+    pxDecoder->ulTargetPos++;
+
+    if( pxDecoder->ulOutputFill == OTA_LZ4_OUTPUT_BUFFER_LEN )
+    {
+        xResult = prvFlushOutput( pxDecoder );
+    }
+
+    return xResult;
+}
+
+/* Copy ulMatchLength bytes from ulOffset bytes back, from flash or the output buffer */
+static BaseType_t prvCopyMatch( OtaLz4Decoder_t * pxDecoder )
+{
+    BaseType_t xResult = pdFALSE;
+
+    if( ( pxDecoder->ulOffset == 0 ) ||
+        ( pxDecoder->ulOffset > pxDecoder->ulTargetPos ) )
+    {
+        LogError( "LZ4 match offset %lu is outside of the image.", pxDecoder->ulOffset );
+    }
+    else if( pxDecoder->ulMatchLength > ( pxDecoder->ulTargetSize - pxDecoder->ulTargetPos ) )
+    {
+        LogError( "LZ4 match overruns the image." );
+    }
+    else
+    {
+        xResult = pdTRUE;
+
+        while( ( xResult == pdTRUE ) && ( pxDecoder->ulMatchLength > 0 ) )
+        {
+            uint32_t ulFrom = pxDecoder->ulTargetPos - pxDecoder->ulOffset;
+            uint32_t ulBuffered = pxDecoder->ulTargetPos - pxDecoder->ulOutputFill;
+            uint8_t ucByte;
+
+            if( ulFrom >= ulBuffered )
+            {
+                ucByte = pxDecoder->pucOutput[ ulFrom - ulBuffered ];
+            }
+            else
+            {
+                ucByte = pxDecoder->pucTarget[ ulFrom ];
+            }
+
+            xResult = prvPutByte( pxDecoder, ucByte );
+            pxDecoder->ulMatchLength--;
+        }
+    }
+
+    pxDecoder->xState = OtaLz4StateToken;
+
+    return xResult;
+}
+
+/* The literals of a sequence are complete, the last sequence of the block has no match */
+static void prvEndLiterals( OtaLz4Decoder_t * pxDecoder )
+{
+    pxDecoder->xState = ( pxDecoder->ulTargetPos == pxDecoder->ulTargetSize ) ?
+                        OtaLz4StateDone : OtaLz4StateOffset;
+}
+
+static BaseType_t prvStartLiterals( OtaLz4Decoder_t * pxDecoder )
+{
+    BaseType_t xResult = pdTRUE;
+
+    if( pxDecoder->ulLiteralLeft > ( pxDecoder->ulTargetSize - pxDecoder->ulTargetPos ) )
+    {
+        LogError( "LZ4 literals overrun the image." );
+        xResult = pdFALSE;
+    }
+    else if( pxDecoder->ulLiteralLeft == 0 )
+    {
+        prvEndLiterals( pxDecoder );
+    }
+    else
+    {
+        pxDecoder->xState = OtaLz4StateLiterals;
+    }
+
+    return xResult;
+}
+
+BaseType_t xOtaLz4Feed( OtaLz4Decoder_t * pxDecoder,
+                        const uint8_t * pucData,
+                        uint32_t ulLength )
+{
+    configASSERT( pxDecoder != NULL );
+    configASSERT( ( pucData != NULL ) || ( ulLength == 0 ) );
+
+    while( ( ulLength > 0 ) && ( pxDecoder->xState != OtaLz4StateError ) )
+    {
+        BaseType_t xResult = pdTRUE;
+        uint32_t ulChunk = 1;
+        uint8_t ucByte = *pucData;
+
+        switch( pxDecoder->xState )
+        {
+            case OtaLz4StateHeader:
+                pxDecoder->pucField[ pxDecoder->ulFieldFill ] = ucByte;
+                pxDecoder->ulFieldFill++;
+
+                if( pxDecoder->ulFieldFill == OTA_LZ4_HEADER_LEN )
+                {
+                    pxDecoder->ulFieldFill = 0;
+                    xResult = prvParseHeader( pxDecoder );
+                    pxDecoder->xState = OtaLz4StateToken;
+                }
+
+                break;
+
+            case OtaLz4StateToken:
+                pxDecoder->ulLiteralLeft = ( uint32_t ) ( ucByte >> 4 );
+                pxDecoder->ulMatchLength = ( uint32_t ) ( ucByte & 0x0F );
+
+                if( pxDecoder->ulLiteralLeft == 0x0F )
+                {
+                    pxDecoder->xState = OtaLz4StateLiteralLength;
+                }
+                else
+                {
+                    xResult = prvStartLiterals( pxDecoder );
+                }
+
+                break;
+
+            case OtaLz4StateLiteralLength:
+                pxDecoder->ulLiteralLeft += ucByte;
+
+                if( pxDecoder->ulLiteralLeft > pxDecoder->ulTargetSize )
+                {
+                    LogError( "LZ4 literals overrun the image." );
+                    xResult = pdFALSE;
+                }
+                else if( ucByte != 0xFF )
+                {
+                    xResult = prvStartLiterals( pxDecoder );
+                }
+
+                break;
+
+            case OtaLz4StateLiterals:
+                ulChunk = OTA_LZ4_OUTPUT_BUFFER_LEN - pxDecoder->ulOutputFill;
+                ulChunk = ( ulChunk < ulLength ) ? ulChunk : ulLength;
+                ulChunk = ( ulChunk < pxDecoder->ulLiteralLeft ) ? ulChunk : pxDecoder->ulLiteralLeft;
+
+                ( void ) memcpy( &( pxDecoder->pucOutput[ pxDecoder->ulOutputFill ] ), pucData, ulChunk );
+
+                pxDecoder->ulLiteralLeft -= ulChunk;
+                pxDecoder->ulOutputFill += ulChunk;
+                pxDecoder->ulTargetPos += ulChunk;
+
+                if( pxDecoder->ulOutputFill == OTA_LZ4_OUTPUT_BUFFER_LEN )
+                {
+                    xResult = prvFlushOutput( pxDecoder );
+                }
+
+                if( ( xResult == pdTRUE ) && ( pxDecoder->ulLiteralLeft == 0 ) )
+                {
+                    prvEndLiterals( pxDecoder );
+                }
+
+                break;
+
+            case OtaLz4StateOffset:
+                pxDecoder->ulOffset |= ( ( uint32_t ) ucByte << ( 8 * pxDecoder->ulFieldFill ) );
+                pxDecoder->ulFieldFill++;
+
+                if( pxDecoder->ulFieldFill == 2 )
+                {
+                    pxDecoder->ulFieldFill = 0;
+
+                    if( pxDecoder->ulMatchLength == 0x0F )
+                    {
+                        pxDecoder->xState = OtaLz4StateMatchLength;
+                    }
+                    else
+                    {
+                        pxDecoder->ulMatchLength += OTA_LZ4_MIN_MATCH;
+                        xResult = prvCopyMatch( pxDecoder );
+                        pxDecoder->ulOffset = 0;
+                    }
+                }
+
+                break;
+
+            case OtaLz4StateMatchLength:
+                pxDecoder->ulMatchLength += ucByte;
+
+                if( pxDecoder->ulMatchLength > pxDecoder->ulTargetSize )
+                {
+                    LogError( "LZ4 match overruns the image." );
+                    xResult = pdFALSE;
+                }
+                else if( ucByte != 0xFF )
+                {
+                    pxDecoder->ulMatchLength += OTA_LZ4_MIN_MATCH;
+                    xResult = prvCopyMatch( pxDecoder );
+                    pxDecoder->ulOffset = 0;
+                }
+
+                break;
+
+            case OtaLz4StateDone:
+            default:
+                LogError( "Unexpected data after the end of the compressed image." );
+                xResult = pdFALSE;
+                break;
+        }
+
+        if( xResult != pdTRUE )
+        {
+            pxDecoder->xState = OtaLz4StateError;
+        }
+
+        pucData += ulChunk;
+        ulLength -= ulChunk;
+    }
+
+    return( ( pxDecoder->xState != OtaLz4StateError ) ? pdTRUE : pdFALSE );
+}
+
+BaseType_t xOtaLz4Finish( OtaLz4Decoder_t * pxDecoder,
+                          uint32_t * pulTargetSize )
+{
+    BaseType_t xResult = pdFALSE;
+
+    configASSERT( pxDecoder != NULL );
+    configASSERT( pulTargetSize != NULL );
+
+    if( pxDecoder->xState != OtaLz4StateDone )
+    {
+        LogError( "Compressed image is incomplete, %lu of %lu bytes decompressed.",
+                  pxDecoder->ulTargetPos, pxDecoder->ulTargetSize );
+    }
+    else if( prvFlushOutput( pxDecoder ) != pdTRUE )
+    {
+        LogError( "Failed to write the end of the decompressed image." );
+    }
+    else
+    {
+        *pulTargetSize = pxDecoder->ulTargetSize;
+        xResult = pdTRUE;
+    }
+
+    return xResult;
+}
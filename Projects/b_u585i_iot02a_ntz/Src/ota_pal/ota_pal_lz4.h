@@ -0,0 +1,122 @@
+/*
+ * FreeRTOS STM32 Reference Integration
+ * Copyright (C) 2022 Amazon.com, Inc. or its affiliates.  All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ *
+ * https://www.FreeRTOS.org
+ * https://github.com/FreeRTOS
+ *
+ */
+
+/**
+ * @file ota_pal_lz4.h
+ * @brief Streaming decoder for LZ4 compressed OTA images.
+ *
+ * A compressed image is a header followed by a single LZ4 block holding the
+ * whole firmware image, all little endian:
+ *
+ *   header:  uint32 magic, uint32 image size
+ *   block:   LZ4 sequences, see the LZ4 block format description
+ *
+ * Matches refer back at most 64 KB into the image. Those bytes are read back
+ * from flash, so the decompression window costs no RAM beyond the output
+ * buffer. tools/ota_lz4.py creates images in this format.
+ */
+
+#ifndef _OTA_PAL_LZ4_H
+#define _OTA_PAL_LZ4_H
+
+#include "FreeRTOS.h"
+
+#define OTA_LZ4_MAGIC                 ( 0x55345A4CUL ) /* "LZ4U" */
+#define OTA_LZ4_HEADER_LEN            ( 8U )
+#define OTA_LZ4_MIN_MATCH             ( 4U )
+
+/* Decoded bytes handed to the write callback at once, a multiple of the flash burst size */
+#ifndef OTA_LZ4_OUTPUT_BUFFER_LEN
+#define OTA_LZ4_OUTPUT_BUFFER_LEN     ( 1024U )
+#endif
+
+typedef enum
+{
+    OtaLz4StateHeader = 0,
+    OtaLz4StateToken,
+    OtaLz4StateLiteralLength,
+    OtaLz4StateLiterals,
+    OtaLz4StateOffset,
+    OtaLz4StateMatchLength,
+    OtaLz4StateDone,
+    OtaLz4StateError
+} OtaLz4State_t;
+
+/*
+ * Called with consecutive runs of the decompressed image. ulLength is
+ * OTA_LZ4_OUTPUT_BUFFER_LEN for every run but the last. Once the callback
+ * returns, the run must be readable at pucTarget + ulOffset.
+ */
+typedef BaseType_t ( * OtaLz4WriteCallback_t )( void * pvCtx,
+                                                uint32_t ulOffset,
+                                                uint8_t * pucData,
+                                                uint32_t ulLength );
+
+typedef struct
+{
+    OtaLz4State_t xState;
+    const uint8_t * pucTarget; /* Where the written image can be read back */
+    uint32_t ulTargetMaxSize;
+    uint32_t ulTargetSize;
+    uint32_t ulTargetPos;      /* Bytes decoded, including those still in pucOutput */
+    uint32_t ulLiteralLeft;
+    uint32_t ulMatchLength;
+    uint32_t ulOffset;
+    uint32_t ulFieldFill;      /* Bytes of the header or match offset received so far */
+    uint8_t pucField[ OTA_LZ4_HEADER_LEN ];
+    uint32_t ulOutputFill;
+    uint8_t pucOutput[ OTA_LZ4_OUTPUT_BUFFER_LEN ];
+    OtaLz4WriteCallback_t xWriteCallback;
+    void * pvCtx;
+} OtaLz4Decoder_t;
+
+/*
+ * @brief Prepare pxDecoder to decompress an image of at most ulTargetMaxSize
+ * bytes which is written out to pucTarget.
+ */
+void vOtaLz4Init( OtaLz4Decoder_t * pxDecoder,
+                  const uint8_t * pucTarget,
+                  uint32_t ulTargetMaxSize,
+                  OtaLz4WriteCallback_t xWriteCallback,
+                  void * pvCtx );
+
+/*
+ * @brief Decompress the next ulLength bytes of the compressed image.
+ * @return pdFALSE if the compressed image is malformed or the write callback failed.
+ */
+BaseType_t xOtaLz4Feed( OtaLz4Decoder_t * pxDecoder,
+                        const uint8_t * pucData,
+                        uint32_t ulLength );
+
+/*
+ * @brief Write out the remaining decoded bytes once the whole compressed image was fed.
+ * @return pdTRUE and the size of the decompressed image if it is complete.
+ */
+BaseType_t xOtaLz4Finish( OtaLz4Decoder_t * pxDecoder,
+                          uint32_t * pulTargetSize );
+
+#endif /* _OTA_PAL_LZ4_H */
@@ -27,6 +27,7 @@
 
 #include "logging_levels.h"
 #define LOG_LEVEL    LOG_INFO
+#define LOG_MODULE    LOG_MODULE_OTA
 #include "logging.h"
 
 #include <string.h>
@@ -47,16 +48,37 @@
 
 #include "PkiObject.h"
 
-#define FLASH_START_INACTIVE_BANK    ( ( uint32_t ) ( FLASH_BASE + FLASH_BANK_SIZE ) )
+#include "ota_pal_delta.h"
+#include "ota_pal_lz4.h"
+
+#include "profiler.h"
+#include "dvfs.h"
+#include "power_stats.h"
+#include "net/mxchip/mx_netconn.h"
 
-#define NUM_QUAD_WORDS( length )         ( length >> 4UL )
+#define FLASH_START_INACTIVE_BANK    ( ( uint32_t ) ( FLASH_BASE + FLASH_BANK_SIZE ) )
 
-#define NUM_REMAINING_BYTES( length )    ( length & 0x0F )
+/* Burst programming writes 8 quad-words to a 128 byte aligned address */
+#define FLASH_BURST_SIZE           ( 8UL * 16UL )
 
 #define IMAGE_CONTEXT_FILE_NAME    "/ota/image_state"
+#define RESUME_STATE_FILE_NAME     "/ota/resume_state"
+
+#define OTA_IMAGE_FILE_NAME        "b_u585i_iot02a_ntz.bin"
+#define OTA_DELTA_FILE_NAME        "b_u585i_iot02a_ntz.delta"
+#define OTA_LZ4_FILE_NAME          "b_u585i_iot02a_ntz.lz4"
 
 #define OTA_IMAGE_MIN_SIZE         ( 16 )
 
+/* Granularity at which written blocks are tracked for the running image hash */
+#define OTA_HASH_BLOCK_SIZE        ( otaconfigFILE_BLOCK_SIZE )
+#define OTA_HASH_MAX_BLOCKS        ( FLASH_BANK_SIZE / OTA_HASH_BLOCK_SIZE )
+
+/* Number of blocks written between two saves of the download resume state */
+#define OTA_RESUME_SAVE_BLOCKS     ( 32U )
+#define OTA_RESUME_STATE_VERSION   ( 1U )
+#define OTA_BLOCKS_PER_PAGE        ( FLASH_PAGE_SIZE / OTA_HASH_BLOCK_SIZE )
+
 
 typedef enum
 {
@@ -94,6 +116,13 @@ typedef struct
     uint32_t ulFileTargetBank;
 } OtaPalNvContext_t;
 
+typedef enum
+{
+    OTA_PAL_IMAGE_RAW = 0, /* The file is the firmware image */
+    OTA_PAL_IMAGE_DELTA,   /* The file is a delta applied to the active bank */
+    OTA_PAL_IMAGE_LZ4      /* The file is an LZ4 compressed firmware image */
+} OtaPalImageFormat_t;
+
 typedef struct
 {
     uint32_t ulTargetBank;
@@ -101,9 +130,41 @@ typedef struct
     uint32_t ulBaseAddress;
     uint32_t ulImageSize;
     OtaPalState_t xPalState;
+    uint32_t pulErasedPages[ ( FLASH_PAGE_NB + 31 ) / 32 ]; /* Target bank pages erased for the open file */
+    OtaPalImageFormat_t xImageFormat;
+    uint32_t ulFileOffset;                                  /* Offset in the target bank the file is written to */
 } OtaPalContext_t;
 
 
+/*
+ * SHA-256 of the contiguous prefix of the image that has been written so far.
+ * Blocks written out of order are marked in pulWrittenBlocks and hashed once
+ * the prefix reaches them, so only a short tail is left to hash at close.
+ */
+typedef struct
+{
+    mbedtls_md_context_t xMdCtx;
+    BaseType_t xActive;    /* pdFALSE if the whole image has to be hashed at close */
+    uint32_t ulHashedLength;
+    uint32_t pulWrittenBlocks[ ( OTA_HASH_MAX_BLOCKS + 31 ) / 32 ];
+} OtaPalImageHash_t;
+
+/*
+ * A delta or compressed file is stored at the end of the target bank as it
+ * arrives and fed to its decoder in order, which writes the firmware image to
+ * the start of the bank.
+ */
+typedef struct
+{
+    union
+    {
+        OtaDeltaDecoder_t xDelta;
+        OtaLz4Decoder_t xLz4;
+    } u;
+    uint32_t ulFedLength;
+    uint32_t pulWrittenBlocks[ ( OTA_HASH_MAX_BLOCKS + 31 ) / 32 ];
+} OtaPalDecoder_t;
+
 const char OTA_JsonFileSignatureKey[] = "sig-sha256-ecdsa";
 
 static OtaPalContext_t xPalContext =
@@ -117,12 +178,57 @@ static OtaPalContext_t xPalContext =
 
 static uint32_t ulBankAtBootup = 0;
 
+static OtaPalImageHash_t xImageHash = { 0 };
+
+static OtaPalDecoder_t xDecoder = { 0 };
+
+/*
+ * Saved to RESUME_STATE_FILE_NAME while a raw image is downloaded, so that a
+ * download interrupted by a reset continues with the blocks that are missing.
+ * Only pages whose blocks have all been written are recorded. Any other page is
+ * erased again after the reset, which also discards a block that was being
+ * programmed when the reset occurred.
+ */
+typedef struct
+{
+    uint32_t ulVersion;
+    uint32_t ulFileSize;
+    uint32_t ulTargetBank;
+    uint8_t pucJobDigest[ 32 ];    /* SHA-256 of the image signature from the job document */
+    uint32_t ulPrefixLength;       /* Length of the written prefix covered by pucPrefixDigest */
+    uint8_t pucPrefixDigest[ 32 ];
+    uint32_t pulErasedPages[ ( FLASH_PAGE_NB + 31 ) / 32 ];
+    uint32_t pulWrittenBlocks[ ( OTA_HASH_MAX_BLOCKS + 31 ) / 32 ];
+} OtaPalResumeState_t;
+
+typedef struct
+{
+    OtaPalResumeState_t xState;
+    BaseType_t xEnabled;
+    uint32_t ulBlocksSinceSave;
+    uint32_t pulWrittenBlocks[ ( OTA_HASH_MAX_BLOCKS + 31 ) / 32 ]; /* Blocks written since the file was created */
+    uint32_t pulResumedBlocks[ ( OTA_HASH_MAX_BLOCKS + 31 ) / 32 ]; /* Blocks found in flash at resume */
+} OtaPalResume_t;
+
+static OtaPalResume_t xResume = { 0 };
+
+PROF_PROBE( xProfWriteBlock, "ota_write_block" );
+
 /* Static function forward declarations */
 
 /* Load/Save/Delete */
 static BaseType_t prvInitializePalContext( OtaPalContext_t * pxContext );
 static BaseType_t prvWritePalNvContext( OtaPalContext_t * pxContext );
 static BaseType_t prvDeletePalNvContext( void );
+
+/* Download resume state */
+static void prvResumeStart( OtaPalContext_t * pxContext,
+                            OtaFileContext_t * pxFileContext );
+static BaseType_t prvResumeIsWritten( uint32_t ulOffset );
+static void prvResumeOnWrite( OtaPalContext_t * pxContext,
+                              uint32_t ulOffset,
+                              uint32_t ulLength );
+static void prvResumeStop( void );
 static OtaPalContext_t * prvGetImageContext( void );
 
 /* Active / Inactive bank helpers */
@@ -142,6 +248,9 @@ static HAL_StatusTypeDef prvWriteToFlash( uint32_t destination,
                                           uint32_t length );
 
 static BaseType_t prvEraseBank( uint32_t bankNumber );
+static BaseType_t prvErasePagesForWrite( OtaPalContext_t * pxContext,
+                                         uint32_t ulOffset,
+                                         uint32_t ulLength );
 
 /* Verify signature */
 static OtaPalStatus_t prvValidateSignature( const char * pcPubKeyLabel,
@@ -156,6 +265,27 @@ static BaseType_t xCalculateImageHash( const unsigned char * pucImageAddress,
                                        size_t uxHashBufferLength,
                                        size_t * puxHashLength );
 
+/* Running image hash */
+static void prvImageHashStart( void );
+static void prvImageHashUpdate( const OtaPalContext_t * pxContext,
+                                uint32_t ulOffset,
+                                uint32_t ulLength );
+static BaseType_t prvImageHashFinish( const OtaPalContext_t * pxContext,
+                                      unsigned char * pucHashBuffer,
+                                      size_t uxHashBufferLength,
+                                      size_t * puxHashLength );
+static void prvImageHashAppend( const OtaPalContext_t * pxContext,
+                                uint32_t ulOffset,
+                                uint32_t ulLength );
+static void prvImageHashFree( void );
+
+/* Delta and compressed images */
+static void prvDecoderStart( OtaPalContext_t * pxContext );
+static BaseType_t prvDecoderUpdate( OtaPalContext_t * pxContext,
+                                    uint32_t ulOffset,
+                                    uint32_t ulLength );
+static BaseType_t prvDecoderFinish( OtaPalContext_t * pxContext );
+
 const char * otaImageStateToString( OtaImageState_t xState )
 {
     const char * pcStateString;
@@ -382,6 +512,81 @@ static BaseType_t prvDeletePalNvContext( void )
 }
 
 
+static BaseType_t prvWriteResumeState( void )
+{
+    BaseType_t xResult = pdFALSE;
+    lfs_t * pxLfsCtx = pxGetDefaultFsCtx();
+
+    if( pxLfsCtx == NULL )
+    {
+        LogError( "File system not ready." );
+    }
+    else
+    {
+        lfs_ssize_t xLfsErr = LFS_ERR_CORRUPT;
+        lfs_file_t xFile = { 0 };
+
+        xLfsErr = lfs_file_open( pxLfsCtx, &xFile, RESUME_STATE_FILE_NAME, ( LFS_O_WRONLY | LFS_O_CREAT | LFS_O_TRUNC ) );
+
+        if( xLfsErr == LFS_ERR_OK )
+        {
+            xLfsErr = lfs_file_write( pxLfsCtx, &xFile, &( xResume.xState ), sizeof( OtaPalResumeState_t ) );
+
+            if( xLfsErr == sizeof( OtaPalResumeState_t ) )
+            {
+                xResult = pdTRUE;
+            }
+            else
+            {
+                LogError( "Failed to save OTA resume state to file %s, error = %d.", RESUME_STATE_FILE_NAME, xLfsErr );
+            }
+
+            ( void ) lfs_file_close( pxLfsCtx, &xFile );
+        }
+        else
+        {
+            LogError( "Failed to open file %s to save OTA resume state, error = %d.", RESUME_STATE_FILE_NAME, xLfsErr );
+        }
+    }
+
+    return xResult;
+}
+
+static BaseType_t prvReadResumeState( OtaPalResumeState_t * pxState )
+{
+    BaseType_t xResult = pdFALSE;
+    lfs_t * pxLfsCtx = pxGetDefaultFsCtx();
+
+    if( pxLfsCtx != NULL )
+    {
+        lfs_file_t xFile = { 0 };
+
+        if( lfs_file_open( pxLfsCtx, &xFile, RESUME_STATE_FILE_NAME, LFS_O_RDONLY ) == LFS_ERR_OK )
+        {
+            if( lfs_file_read( pxLfsCtx, &xFile, pxState, sizeof( OtaPalResumeState_t ) ) == sizeof( OtaPalResumeState_t ) )
+            {
+                xResult = pdTRUE;
+            }
+
+            ( void ) lfs_file_close( pxLfsCtx, &xFile );
+        }
+    }
+
+    return xResult;
+}
+
+static void prvDeleteResumeState( void )
+{
+    lfs_t * pxLfsCtx = pxGetDefaultFsCtx();
+    struct lfs_info xFileInfo = { 0 };
+
+    if( ( pxLfsCtx != NULL ) &&
+        ( lfs_stat( pxLfsCtx, RESUME_STATE_FILE_NAME, &xFileInfo ) == LFS_ERR_OK ) )
+    {
+        ( void ) lfs_remove( pxLfsCtx, RESUME_STATE_FILE_NAME );
+    }
+}
+
 static OtaPalContext_t * prvGetImageContext( void )
 {
     OtaPalContext_t * pxCtx = NULL;
@@ -576,70 +781,65 @@ static uint32_t prvGetInactiveBank( void )
 }
 
 
+static HAL_StatusTypeDef prvProgramAndVerify( uint32_t ulTypeProgram,
+                                              uint32_t destination,
+                                              const uint32_t * pulData,
+                                              uint32_t ulLength )
+{
+    HAL_StatusTypeDef status = HAL_FLASH_Program( ulTypeProgram, destination, ( uint32_t ) pulData );
+
+    /* Check the written value */
+    if( ( status == HAL_OK ) &&
+        ( memcmp( ( void * ) destination, pulData, ulLength ) != 0 ) )
+    {
+        /* Flash content doesn't match SRAM content */
+        status = HAL_ERROR;
+    }
+
+    return status;
+}
+
 static HAL_StatusTypeDef prvWriteToFlash( uint32_t destination,
                                           uint8_t * pSource,
                                           uint32_t ulLength )
 {
     HAL_StatusTypeDef status = HAL_OK;
-    uint32_t i = 0U;
-    uint8_t quadWord[ 16 ] = { 0 };
-    uint32_t numQuadWords = NUM_QUAD_WORDS( ulLength );
-    uint32_t remainingBytes = NUM_REMAINING_BYTES( ulLength );
+
+    /* Staging buffer, HAL_FLASH_Program reads the source a word at a time */
+    static uint32_t pulStaging[ FLASH_BURST_SIZE / sizeof( uint32_t ) ];
 
     /* Unlock the Flash to enable the flash control register access *************/
     HAL_FLASH_Unlock();
 
-    for( i = 0U; i < numQuadWords; i++ )
+    while( ( status == HAL_OK ) && ( ulLength > 0 ) )
     {
         /* Pet the watchdog */
         vPetWatchdog();
 
         /* Device voltage range supposed to be [2.7V to 3.6V], the operation will
-         * be done by word */
-
-        memcpy( quadWord, pSource, 16UL );
-        status = HAL_FLASH_Program( FLASH_TYPEPROGRAM_QUADWORD, destination, ( uint32_t ) quadWord );
-
-        if( status == HAL_OK )
+         * be done by burst of 8 quad-words where aligned and by quad-word otherwise */
+        if( ( ( destination % FLASH_BURST_SIZE ) == 0 ) &&
+            ( ulLength >= FLASH_BURST_SIZE ) )
         {
-            /* Check the written value */
-            if( memcmp( ( void * ) destination, quadWord, 16UL ) != 0 )
-            {
-                /* Flash content doesn't match SRAM content */
-                status = HAL_ERROR;
-            }
-        }
+            memcpy( pulStaging, pSource, FLASH_BURST_SIZE );
+            status = prvProgramAndVerify( FLASH_TYPEPROGRAM_BURST, destination, pulStaging, FLASH_BURST_SIZE );
 
-        if( status == HAL_OK )
-        {
-            /* Increment FLASH destination address and the source address. */
-            destination += 16UL;
-            pSource += 16UL;
+            destination += FLASH_BURST_SIZE;
+            pSource += FLASH_BURST_SIZE;
+            ulLength -= FLASH_BURST_SIZE;
         }
         else
         {
-            break;
-        }
-    }
-
-    if( status == HAL_OK )
-    {
-        if( remainingBytes > 0 )
-        {
-            memcpy( quadWord, pSource, remainingBytes );
-            memset( ( quadWord + remainingBytes ), 0xFF, ( 16UL - remainingBytes ) );
+            uint32_t ulChunk = ( ulLength < 16UL ) ? ulLength : 16UL;
 
-            status = HAL_FLASH_Program( FLASH_TYPEPROGRAM_QUADWORD, destination, ( uint32_t ) quadWord );
+            /* Pad the last quad-word with the erased value */
+            memcpy( pulStaging, pSource, ulChunk );
+            memset( ( ( uint8_t * ) pulStaging + ulChunk ), 0xFF, ( 16UL - ulChunk ) );
+            status = prvProgramAndVerify( FLASH_TYPEPROGRAM_QUADWORD, destination, pulStaging, 16UL );
 
-            if( status == HAL_OK )
-            {
-                /* Check the written value */
-                if( memcmp( ( void * ) destination, quadWord, 16UL ) != 0 )
-                {
-                    /* Flash content doesn't match SRAM content */
-                    status = HAL_ERROR;
-                }
-            }
+            destination += 16UL;
+            pSource += ulChunk;
+            ulLength -= ulChunk;
         }
     }
 
@@ -685,6 +885,77 @@ static BaseType_t prvEraseBank( uint32_t bankNumber )
     return xResult;
 }
 
+static BaseType_t prvErasePage( uint32_t ulBank,
+                                uint32_t ulPage )
+{
+    BaseType_t xResult = pdTRUE;
+
+    configASSERT( ulBank != prvGetActiveBank() );
+
+    if( HAL_FLASH_Unlock() == HAL_OK )
+    {
+        uint32_t pageError = 0U;
+        FLASH_EraseInitTypeDef pEraseInit;
+
+        pEraseInit.Banks = ulBank;
+        pEraseInit.NbPages = 1U;
+        pEraseInit.Page = ulPage;
+        pEraseInit.TypeErase = FLASH_TYPEERASE_PAGES;
+
+        if( HAL_FLASHEx_Erase( &pEraseInit, &pageError ) != HAL_OK )
+        {
+            LogError( "Failed to erase flash page %u, errorCode = %u.", ulPage, HAL_FLASH_GetError() );
+            xResult = pdFALSE;
+        }
+
+        ( void ) HAL_FLASH_Lock();
+    }
+    else
+    {
+        LogError( "Failed to unlock flash for erase, errorCode = %u.", HAL_FLASH_GetError() );
+        xResult = pdFALSE;
+    }
+
+    return xResult;
+}
+
+/*
+ * Erase the pages of the target bank under [ ulOffset, ulOffset + ulLength ) that
+ * have not been erased since the file was created. Pages are erased as the image
+ * reaches them, so only the pages the image occupies are ever erased.
+ */
+static BaseType_t prvErasePagesForWrite( OtaPalContext_t * pxContext,
+                                         uint32_t ulOffset,
+                                         uint32_t ulLength )
+{
+    BaseType_t xResult = pdTRUE;
+
+    if( ulLength > 0 )
+    {
+        uint32_t ulPage = ulOffset / FLASH_PAGE_SIZE;
+        uint32_t ulLastPage = ( ulOffset + ulLength - 1 ) / FLASH_PAGE_SIZE;
+
+        for( ; ( ulPage <= ulLastPage ) && ( xResult == pdTRUE ); ulPage++ )
+        {
+            uint32_t ulMask = ( 1UL << ( ulPage % 32 ) );
+
+            if( ( pxContext->pulErasedPages[ ulPage / 32 ] & ulMask ) == 0 )
+            {
+                vPetWatchdog();
+
+                xResult = prvErasePage( pxContext->ulTargetBank, ulPage );
+
+                if( xResult == pdTRUE )
+                {
+                    pxContext->pulErasedPages[ ulPage / 32 ] |= ulMask;
+                }
+            }
+        }
+    }
+
+    return xResult;
+}
+
 static BaseType_t xCalculateImageHash( const unsigned char * pucImageAddress,
                                        const size_t uxImageLength,
                                        unsigned char * pucHashBuffer,
@@ -737,6 +1008,542 @@ static BaseType_t xCalculateImageHash( const unsigned char * pucImageAddress,
     return xResult;
 }
 
+static void prvImageHashFree( void )
+{
+    mbedtls_md_free( &( xImageHash.xMdCtx ) );
+    xImageHash.xActive = pdFALSE;
+}
+
+static void prvImageHashStart( void )
+{
+    const mbedtls_md_info_t * pxMdInfo = mbedtls_md_info_from_type( MBEDTLS_MD_SHA256 );
+    int lRslt = -1;
+
+    prvImageHashFree();
+
+    ( void ) memset( xImageHash.pulWrittenBlocks, 0, sizeof( xImageHash.pulWrittenBlocks ) );
+    xImageHash.ulHashedLength = 0;
+
+    mbedtls_md_init( &( xImageHash.xMdCtx ) );
+
+    if( pxMdInfo != NULL )
+    {
+        lRslt = mbedtls_md_setup( &( xImageHash.xMdCtx ), pxMdInfo, 0 );
+    }
+
+    if( lRslt == 0 )
+    {
+        lRslt = mbedtls_md_starts( &( xImageHash.xMdCtx ) );
+    }
+
+    MBEDTLS_MSG_IF_ERROR( lRslt, "Failed to start the image hash, hashing at close instead." );
+
+    xImageHash.xActive = ( lRslt == 0 ) ? pdTRUE : pdFALSE;
+}
+
+static void prvImageHashUpdate( const OtaPalContext_t * pxContext,
+                                uint32_t ulOffset,
+                                uint32_t ulLength )
+{
+    uint32_t ulBlock = ulOffset / OTA_HASH_BLOCK_SIZE;
+    int lRslt = 0;
+
+    /* Only whole blocks, or the tail of the image, can be tracked in the bitmap */
+    if( xImageHash.xActive == pdFALSE )
+    {
+        LogDebug( "Image hash is computed at close." );
+    }
+    else if( ( ( ulOffset % OTA_HASH_BLOCK_SIZE ) != 0 ) ||
+             ( ( ulLength != OTA_HASH_BLOCK_SIZE ) &&
+               ( ( ulOffset + ulLength ) != pxContext->ulImageSize ) ) )
+    {
+        LogWarn( "Unaligned block at offset %lu, hashing at close instead.", ulOffset );
+        prvImageHashFree();
+    }
+    else
+    {
+        xImageHash.pulWrittenBlocks[ ulBlock / 32 ] |= ( 1UL << ( ulBlock % 32 ) );
+
+        /* Advance the prefix over this block and any that arrived ahead of it */
+        while( ( lRslt == 0 ) &&
+               ( xImageHash.ulHashedLength < pxContext->ulImageSize ) )
+        {
+            uint32_t ulNext = xImageHash.ulHashedLength / OTA_HASH_BLOCK_SIZE;
+            uint32_t ulHashLength = pxContext->ulImageSize - xImageHash.ulHashedLength;
+
+            if( ( xImageHash.pulWrittenBlocks[ ulNext / 32 ] & ( 1UL << ( ulNext % 32 ) ) ) == 0 )
+            {
+                break;
+            }
+
+            if( ulHashLength > OTA_HASH_BLOCK_SIZE )
+            {
+                ulHashLength = OTA_HASH_BLOCK_SIZE;
+            }
+
+            /* Hash what is in flash, which is what will be booted */
+            lRslt = mbedtls_md_update( &( xImageHash.xMdCtx ),
+                                       ( const unsigned char * ) ( pxContext->ulBaseAddress + xImageHash.ulHashedLength ),
+                                       ulHashLength );
+
+            xImageHash.ulHashedLength += ulHashLength;
+        }
+
+        if( lRslt != 0 )
+        {
+            MBEDTLS_MSG_IF_ERROR( lRslt, "Failed to update the image hash, hashing at close instead." );
+            prvImageHashFree();
+        }
+    }
+}
+
+/* Hash image data that is written in order, as a delta is rebuilt */
+static void prvImageHashAppend( const OtaPalContext_t * pxContext,
+                                uint32_t ulOffset,
+                                uint32_t ulLength )
+{
+    int lRslt = 0;
+
+    if( xImageHash.xActive == pdFALSE )
+    {
+        LogDebug( "Image hash is computed at close." );
+    }
+    else if( ulOffset != xImageHash.ulHashedLength )
+    {
+        LogWarn( "Image data at offset %lu written out of order, hashing at close instead.", ulOffset );
+        prvImageHashFree();
+    }
+    else
+    {
+        lRslt = mbedtls_md_update( &( xImageHash.xMdCtx ),
+                                   ( const unsigned char * ) ( pxContext->ulBaseAddress + ulOffset ),
+                                   ulLength );
+
+        xImageHash.ulHashedLength += ulLength;
+
+        if( lRslt != 0 )
+        {
+            MBEDTLS_MSG_IF_ERROR( lRslt, "Failed to update the image hash, hashing at close instead." );
+            prvImageHashFree();
+        }
+    }
+}
+
+static BaseType_t prvImageHashFinish( const OtaPalContext_t * pxContext,
+                                      unsigned char * pucHashBuffer,
+                                      size_t uxHashBufferLength,
+                                      size_t * puxHashLength )
+{
+    BaseType_t xResult = pdFALSE;
+    int lRslt = 0;
+
+    if( xImageHash.xActive == pdFALSE )
+    {
+        xResult = xCalculateImageHash( ( unsigned char * ) ( pxContext->ulBaseAddress ),
+                                       ( size_t ) pxContext->ulImageSize,
+                                       pucHashBuffer, uxHashBufferLength, puxHashLength );
+    }
+    else if( mbedtls_md_get_size( mbedtls_md_info_from_type( MBEDTLS_MD_SHA256 ) ) > uxHashBufferLength )
+    {
+        LogError( "Hash buffer is too small." );
+    }
+    else
+    {
+        /* Whatever did not join the prefix while downloading, normally nothing */
+        if( xImageHash.ulHashedLength < pxContext->ulImageSize )
+        {
+            LogDebug( "Hashing the last %lu bytes of the image.",
+                      pxContext->ulImageSize - xImageHash.ulHashedLength );
+
+            lRslt = mbedtls_md_update( &( xImageHash.xMdCtx ),
+                                       ( const unsigned char * ) ( pxContext->ulBaseAddress + xImageHash.ulHashedLength ),
+                                       pxContext->ulImageSize - xImageHash.ulHashedLength );
+        }
+
+        if( lRslt == 0 )
+        {
+            lRslt = mbedtls_md_finish( &( xImageHash.xMdCtx ), pucHashBuffer );
+        }
+
+        MBEDTLS_MSG_IF_ERROR( lRslt, "Failed to compute hash of the staged firmware image." );
+
+        if( lRslt == 0 )
+        {
+            *puxHashLength = mbedtls_md_get_size( mbedtls_md_info_from_type( MBEDTLS_MD_SHA256 ) );
+            xResult = pdTRUE;
+        }
+    }
+
+    prvImageHashFree();
+
+    return xResult;
+}
+
+/* Digest of the prefix hashed so far, without finishing the running hash */
+static uint32_t prvImageHashPeek( unsigned char * pucDigest )
+{
+    uint32_t ulLength = 0;
+    mbedtls_md_context_t xMdCtx;
+    int lRslt = -1;
+
+    mbedtls_md_init( &xMdCtx );
+
+    if( ( xImageHash.xActive == pdTRUE ) &&
+        ( xImageHash.ulHashedLength > 0 ) )
+    {
+        lRslt = mbedtls_md_setup( &xMdCtx, mbedtls_md_info_from_type( MBEDTLS_MD_SHA256 ), 0 );
+
+        if( lRslt == 0 )
+        {
+            lRslt = mbedtls_md_clone( &xMdCtx, &( xImageHash.xMdCtx ) );
+        }
+
+        if( lRslt == 0 )
+        {
+            lRslt = mbedtls_md_finish( &xMdCtx, pucDigest );
+        }
+    }
+
+    if( lRslt == 0 )
+    {
+        ulLength = xImageHash.ulHashedLength;
+    }
+
+    mbedtls_md_free( &xMdCtx );
+
+    return ulLength;
+}
+
+static BaseType_t prvResumeStateMatches( const OtaPalResumeState_t * pxSaved )
+{
+    BaseType_t xResult = pdFALSE;
+
+    if( ( pxSaved->ulVersion != OTA_RESUME_STATE_VERSION ) ||
+        ( pxSaved->ulFileSize != xResume.xState.ulFileSize ) ||
+        ( pxSaved->ulTargetBank != xResume.xState.ulTargetBank ) ||
+        ( memcmp( pxSaved->pucJobDigest, xResume.xState.pucJobDigest, sizeof( pxSaved->pucJobDigest ) ) != 0 ) )
+    {
+        LogInfo( "Saved OTA download state is for another image." );
+    }
+    else if( pxSaved->ulPrefixLength > pxSaved->ulFileSize )
+    {
+        LogWarn( "Saved OTA download state is invalid." );
+    }
+    else if( pxSaved->ulPrefixLength == 0 )
+    {
+        xResult = pdTRUE;
+    }
+    else
+    {
+        unsigned char pucDigest[ MBEDTLS_MD_MAX_SIZE ];
+        size_t uxDigestLength = 0;
+
+        /* Check that what was written before the reset is still in flash */
+        if( ( xCalculateImageHash( ( const unsigned char * ) FLASH_START_INACTIVE_BANK, pxSaved->ulPrefixLength,
+                                   pucDigest, sizeof( pucDigest ), &uxDigestLength ) == pdTRUE ) &&
+            ( memcmp( pucDigest, pxSaved->pucPrefixDigest, sizeof( pxSaved->pucPrefixDigest ) ) == 0 ) )
+        {
+            xResult = pdTRUE;
+        }
+        else
+        {
+            LogWarn( "Partially downloaded image does not match its saved digest." );
+        }
+    }
+
+    return xResult;
+}
+
+static void prvResumeStart( OtaPalContext_t * pxContext,
+                            OtaFileContext_t * pxFileContext )
+{
+    OtaPalResumeState_t xSaved = { 0 };
+    int lRslt = -1;
+
+    ( void ) memset( &xResume, 0, sizeof( xResume ) );
+
+    xResume.xState.ulVersion = OTA_RESUME_STATE_VERSION;
+    xResume.xState.ulFileSize = pxContext->ulImageSize;
+    xResume.xState.ulTargetBank = pxContext->ulTargetBank;
+
+    /* The signature identifies the image, the job may be delivered again after a reset */
+    if( ( pxContext->xImageFormat == OTA_PAL_IMAGE_RAW ) &&
+        ( pxFileContext->pSignature != NULL ) )
+    {
+        lRslt = mbedtls_md( mbedtls_md_info_from_type( MBEDTLS_MD_SHA256 ),
+                            pxFileContext->pSignature->data, pxFileContext->pSignature->size,
+                            xResume.xState.pucJobDigest );
+    }
+
+    if( lRslt != 0 )
+    {
+        /* Delta and compressed images are decoded in order and are not resumed */
+        prvDeleteResumeState();
+    }
+    else if( ( prvReadResumeState( &xSaved ) == pdTRUE ) &&
+             ( prvResumeStateMatches( &xSaved ) == pdTRUE ) )
+    {
+        uint32_t ulNumBlocks = ( pxContext->ulImageSize + OTA_HASH_BLOCK_SIZE - 1 ) / OTA_HASH_BLOCK_SIZE;
+        uint32_t ulResumed = 0;
+        uint32_t ulBlock;
+
+        ( void ) memcpy( pxContext->pulErasedPages, xSaved.pulErasedPages, sizeof( pxContext->pulErasedPages ) );
+        ( void ) memcpy( xResume.pulWrittenBlocks, xSaved.pulWrittenBlocks, sizeof( xResume.pulWrittenBlocks ) );
+        ( void ) memcpy( xResume.pulResumedBlocks, xSaved.pulWrittenBlocks, sizeof( xResume.pulResumedBlocks ) );
+
+        for( ulBlock = 0; ulBlock < ulNumBlocks; ulBlock++ )
+        {
+            uint32_t ulOffset = ulBlock * OTA_HASH_BLOCK_SIZE;
+            uint32_t ulMask = ( 1UL << ( ulBlock % 32 ) );
+
+            if( ( xSaved.pulWrittenBlocks[ ulBlock / 32 ] & ulMask ) != 0 )
+            {
+                uint32_t ulLength = pxContext->ulImageSize - ulOffset;
+
+                ulLength = ( ulLength < OTA_HASH_BLOCK_SIZE ) ? ulLength : OTA_HASH_BLOCK_SIZE;
+                prvImageHashUpdate( pxContext, ulOffset, ulLength );
+
+                /* Leave one block to download so that the agent still closes the file */
+                if( ( ( ulResumed + 1 ) < ulNumBlocks ) &&
+                    ( ( ulBlock / 8 ) < pxFileContext->blockBitmapMaxSize ) &&
+                    ( ( pxFileContext->pRxBlockBitmap[ ulBlock / 8 ] & ( 1U << ( ulBlock % 8 ) ) ) != 0 ) )
+                {
+                    pxFileContext->pRxBlockBitmap[ ulBlock / 8 ] &= ( uint8_t ) ~( 1U << ( ulBlock % 8 ) );
+                    pxFileContext->blocksRemaining--;
+                    ulResumed++;
+                }
+            }
+        }
+
+        LogSys( "Resuming OTA download, %lu of %lu blocks already written.", ulResumed, ulNumBlocks );
+        xResume.xEnabled = pdTRUE;
+    }
+    else
+    {
+        prvDeleteResumeState();
+        xResume.xEnabled = pdTRUE;
+    }
+}
+
+/* Blocks found in flash at resume may be delivered again, they are not rewritten */
+static BaseType_t prvResumeIsWritten( uint32_t ulOffset )
+{
+    uint32_t ulBlock = ulOffset / OTA_HASH_BLOCK_SIZE;
+
+    return( ( xResume.xEnabled == pdTRUE ) &&
+            ( ( ulOffset % OTA_HASH_BLOCK_SIZE ) == 0 ) &&
+            ( ( xResume.pulResumedBlocks[ ulBlock / 32 ] & ( 1UL << ( ulBlock % 32 ) ) ) != 0 ) );
+}
+
+/* Record the pages of the target bank whose blocks have all been written */
+static void prvResumeSnapshot( const OtaPalContext_t * pxContext )
+{
+    uint32_t ulNumBlocks = ( pxContext->ulImageSize + OTA_HASH_BLOCK_SIZE - 1 ) / OTA_HASH_BLOCK_SIZE;
+    uint32_t ulNumPages = ( pxContext->ulImageSize + FLASH_PAGE_SIZE - 1 ) / FLASH_PAGE_SIZE;
+    uint32_t ulPage;
+
+    ( void ) memset( xResume.xState.pulErasedPages, 0, sizeof( xResume.xState.pulErasedPages ) );
+    ( void ) memset( xResume.xState.pulWrittenBlocks, 0, sizeof( xResume.xState.pulWrittenBlocks ) );
+
+    for( ulPage = 0; ulPage < ulNumPages; ulPage++ )
+    {
+        uint32_t ulFirst = ulPage * OTA_BLOCKS_PER_PAGE;
+        uint32_t ulEnd = ( ( ulFirst + OTA_BLOCKS_PER_PAGE ) < ulNumBlocks ) ? ( ulFirst + OTA_BLOCKS_PER_PAGE ) : ulNumBlocks;
+        uint32_t ulBlock = ulFirst;
+
+        while( ( ulBlock < ulEnd ) &&
+               ( ( xResume.pulWrittenBlocks[ ulBlock / 32 ] & ( 1UL << ( ulBlock % 32 ) ) ) != 0 ) )
+        {
+            ulBlock++;
+        }
+
+        if( ulBlock == ulEnd )
+        {
+            xResume.xState.pulErasedPages[ ulPage / 32 ] |= ( 1UL << ( ulPage % 32 ) );
+
+            for( ulBlock = ulFirst; ulBlock < ulEnd; ulBlock++ )
+            {
+                xResume.xState.pulWrittenBlocks[ ulBlock / 32 ] |= ( 1UL << ( ulBlock % 32 ) );
+            }
+        }
+    }
+
+    xResume.xState.ulPrefixLength = prvImageHashPeek( xResume.xState.pucPrefixDigest );
+}
+
+static void prvResumeOnWrite( OtaPalContext_t * pxContext,
+                              uint32_t ulOffset,
+                              uint32_t ulLength )
+{
+    uint32_t ulBlock = ulOffset / OTA_HASH_BLOCK_SIZE;
+
+    if( ( xResume.xEnabled == pdTRUE ) &&
+        ( ( ulOffset % OTA_HASH_BLOCK_SIZE ) == 0 ) &&
+        ( ( ulLength == OTA_HASH_BLOCK_SIZE ) ||
+          ( ( ulOffset + ulLength ) == pxContext->ulImageSize ) ) )
+    {
+        xResume.pulWrittenBlocks[ ulBlock / 32 ] |= ( 1UL << ( ulBlock % 32 ) );
+        xResume.ulBlocksSinceSave++;
+
+        if( xResume.ulBlocksSinceSave >= OTA_RESUME_SAVE_BLOCKS )
+        {
+            prvResumeSnapshot( pxContext );
+            ( void ) prvWriteResumeState();
+            xResume.ulBlocksSinceSave = 0;
+        }
+    }
+}
+
+static void prvResumeStop( void )
+{
+    if( xResume.xEnabled == pdTRUE )
+    {
+        prvDeleteResumeState();
+    }
+
+    xResume.xEnabled = pdFALSE;
+}
+
+/* Write a run of the decoded image to the start of the target bank */
+static BaseType_t prvDecoderWriteOutput( void * pvCtx,
+                                         uint32_t ulOffset,
+                                         uint8_t * pucData,
+                                         uint32_t ulLength )
+{
+    BaseType_t xResult = pdFALSE;
+    OtaPalContext_t * pxContext = ( OtaPalContext_t * ) pvCtx;
+
+    if( prvErasePagesForWrite( pxContext, ulOffset, ulLength ) != pdTRUE )
+    {
+        LogError( "Failed to erase the flash under offset %u.", ulOffset );
+    }
+    else if( prvWriteToFlash( ( pxContext->ulBaseAddress + ulOffset ), pucData, ulLength ) != HAL_OK )
+    {
+        LogError( "Failed to write the decoded image at offset %u.", ulOffset );
+    }
+    else
+    {
+        prvImageHashAppend( pxContext, ulOffset, ulLength );
+        xResult = pdTRUE;
+    }
+
+    return xResult;
+}
+
+static void prvDecoderStart( OtaPalContext_t * pxContext )
+{
+    ( void ) memset( xDecoder.pulWrittenBlocks, 0, sizeof( xDecoder.pulWrittenBlocks ) );
+    xDecoder.ulFedLength = 0;
+
+    if( pxContext->xImageFormat == OTA_PAL_IMAGE_DELTA )
+    {
+        /* The running image is mapped at FLASH_BASE, whichever bank it is in */
+        vOtaDeltaInit( &( xDecoder.u.xDelta ),
+                       ( const uint8_t * ) FLASH_BASE, FLASH_BANK_SIZE,
+                       pxContext->ulFileOffset,
+                       prvDecoderWriteOutput, pxContext );
+    }
+    else
+    {
+        /* Matches are read back from the image already written to the target bank */
+        vOtaLz4Init( &( xDecoder.u.xLz4 ),
+                     ( const uint8_t * ) pxContext->ulBaseAddress,
+                     pxContext->ulFileOffset,
+                     prvDecoderWriteOutput, pxContext );
+    }
+}
+
+/* Feed the decoder the stored part of the file from ulFedLength up to ulEnd */
+static BaseType_t prvDecoderFeedStored( OtaPalContext_t * pxContext,
+                                        uint32_t ulEnd )
+{
+    BaseType_t xResult = pdTRUE;
+
+    if( ulEnd > xDecoder.ulFedLength )
+    {
+        const uint8_t * pucData = ( const uint8_t * ) ( pxContext->ulBaseAddress + pxContext->ulFileOffset + xDecoder.ulFedLength );
+
+        if( pxContext->xImageFormat == OTA_PAL_IMAGE_DELTA )
+        {
+            xResult = xOtaDeltaFeed( &( xDecoder.u.xDelta ), pucData, ulEnd - xDecoder.ulFedLength );
+        }
+        else
+        {
+            xResult = xOtaLz4Feed( &( xDecoder.u.xLz4 ), pucData, ulEnd - xDecoder.ulFedLength );
+        }
+
+        xDecoder.ulFedLength = ulEnd;
+    }
+
+    return xResult;
+}
+
+static BaseType_t prvDecoderUpdate( OtaPalContext_t * pxContext,
+                                    uint32_t ulOffset,
+                                    uint32_t ulLength )
+{
+    BaseType_t xResult = pdTRUE;
+    uint32_t ulBlock = ulOffset / OTA_HASH_BLOCK_SIZE;
+    uint32_t ulEnd = xDecoder.ulFedLength;
+
+    /* Unaligned blocks are not tracked and are decoded at close */
+    if( ( ( ulOffset % OTA_HASH_BLOCK_SIZE ) == 0 ) &&
+        ( ( ulLength == OTA_HASH_BLOCK_SIZE ) ||
+          ( ( ulOffset + ulLength ) == pxContext->ulImageSize ) ) )
+    {
+        xDecoder.pulWrittenBlocks[ ulBlock / 32 ] |= ( 1UL << ( ulBlock % 32 ) );
+
+        /* Extend the in order prefix over this block and any that arrived ahead of it */
+        while( ulEnd < pxContext->ulImageSize )
+        {
+            uint32_t ulNext = ulEnd / OTA_HASH_BLOCK_SIZE;
+
+            if( ( xDecoder.pulWrittenBlocks[ ulNext / 32 ] & ( 1UL << ( ulNext % 32 ) ) ) == 0 )
+            {
+                break;
+            }
+
+            ulEnd += OTA_HASH_BLOCK_SIZE;
+
+            if( ulEnd > pxContext->ulImageSize )
+            {
+                ulEnd = pxContext->ulImageSize;
+            }
+        }
+
+        xResult = prvDecoderFeedStored( pxContext, ulEnd );
+    }
+
+    return xResult;
+}
+
+static BaseType_t prvDecoderFinish( OtaPalContext_t * pxContext )
+{
+    BaseType_t xResult = prvDecoderFeedStored( pxContext, pxContext->ulImageSize );
+    uint32_t ulTargetSize = 0;
+
+    if( xResult != pdTRUE )
+    {
+        LogError( "Failed to decode the end of the file." );
+    }
+    else if( pxContext->xImageFormat == OTA_PAL_IMAGE_DELTA )
+    {
+        xResult = xOtaDeltaFinish( &( xDecoder.u.xDelta ), &ulTargetSize );
+    }
+    else
+    {
+        xResult = xOtaLz4Finish( &( xDecoder.u.xLz4 ), &ulTargetSize );
+    }
+
+    if( xResult == pdTRUE )
+    {
+        /* From here on the image is the decoded one */
+        pxContext->ulImageSize = ulTargetSize;
+    }
+
+    return xResult;
+}
+
 static OtaPalStatus_t prvValidateSignature( const char * pcPubKeyLabel,
                                             const unsigned char * pucSignature,
                                             const size_t uxSignatureLength,
@@ -806,7 +1613,9 @@ OtaPalStatus_t otaPal_CreateFileForRx( OtaFileContext_t * const pxFileContext )
     {
         uxOtaStatus = OTA_PAL_COMBINE_ERR( OtaPalRxFileTooLarge, 0 );
     }
-    else if( strncmp( "b_u585i_iot02a_ntz.bin", ( char * ) pxFileContext->pFilePath, pxFileContext->filePathMaxSize ) != 0 )
+    else if( ( strncmp( OTA_IMAGE_FILE_NAME, ( char * ) pxFileContext->pFilePath, pxFileContext->filePathMaxSize ) != 0 ) &&
+             ( strncmp( OTA_DELTA_FILE_NAME, ( char * ) pxFileContext->pFilePath, pxFileContext->filePathMaxSize ) != 0 ) &&
+             ( strncmp( OTA_LZ4_FILE_NAME, ( char * ) pxFileContext->pFilePath, pxFileContext->filePathMaxSize ) != 0 ) )
     {
         uxOtaStatus = OTA_PAL_COMBINE_ERR( OtaPalRxFileCreateFailed, 0 );
     }
@@ -836,20 +1645,48 @@ OtaPalStatus_t otaPal_CreateFileForRx( OtaFileContext_t * const pxFileContext )
             }
         }
 
-        if( ( OTA_PAL_MAIN_ERR( uxOtaStatus ) == OtaPalSuccess ) &&
-            ( prvEraseBank( ulTargetBank ) != pdTRUE ) )
-        {
-            uxOtaStatus = OTA_PAL_COMBINE_ERR( OtaPalRxFileCreateFailed, 0 );
-        }
-
         if( OTA_PAL_MAIN_ERR( uxOtaStatus ) == OtaPalSuccess )
         {
+            /* Pages are erased by otaPal_WriteBlock as the image reaches them */
+            ( void ) memset( pxContext->pulErasedPages, 0, sizeof( pxContext->pulErasedPages ) );
+
             pxContext->ulTargetBank = ulTargetBank;
             pxContext->ulPendingBank = prvGetActiveBank();
             pxContext->ulBaseAddress = FLASH_START_INACTIVE_BANK;
             pxContext->ulImageSize = pxFileContext->fileSize;
+            pxContext->xImageFormat = OTA_PAL_IMAGE_RAW;
+            pxContext->ulFileOffset = 0;
             pxContext->xPalState = OTA_PAL_FILE_OPEN;
             pxFileContext->pFile = pxContext;
+
+            /* Hashing, decompression and flash programming of the blocks run at full speed until the file is closed */
+            vDvfsRequest( DVFS_CLIENT_OTA );
+
+            /* Keep the radio awake for the block download */
+            net_request_active( NET_ACTIVE_CLIENT_OTA );
+            vPowerStatsOpStart( POWER_OP_OTA );
+            prvImageHashStart();
+
+            if( strncmp( OTA_DELTA_FILE_NAME, ( char * ) pxFileContext->pFilePath, pxFileContext->filePathMaxSize ) == 0 )
+            {
+                pxContext->xImageFormat = OTA_PAL_IMAGE_DELTA;
+            }
+            else if( strncmp( OTA_LZ4_FILE_NAME, ( char * ) pxFileContext->pFilePath, pxFileContext->filePathMaxSize ) == 0 )
+            {
+                pxContext->xImageFormat = OTA_PAL_IMAGE_LZ4;
+            }
+
+            if( pxContext->xImageFormat != OTA_PAL_IMAGE_RAW )
+            {
+                /* Keep the file in the last pages of the bank, clear of the decoded image */
+                pxContext->ulFileOffset = FLASH_BANK_SIZE -
+                                          ( ( ( pxFileContext->fileSize + FLASH_PAGE_SIZE - 1 ) / FLASH_PAGE_SIZE ) * FLASH_PAGE_SIZE );
+                prvDecoderStart( pxContext );
+                LogInfo( "Receiving a %lu byte %s image.", pxFileContext->fileSize,
+                         ( pxContext->xImageFormat == OTA_PAL_IMAGE_DELTA ) ? "delta" : "compressed" );
+            }
+
+            prvResumeStart( pxContext, pxFileContext );
         }
 
         if( OTA_PAL_MAIN_ERR( uxOtaStatus ) == OtaPalSuccess )
@@ -872,6 +1709,8 @@ int16_t otaPal_WriteBlock( OtaFileContext_t * const pxFileContext,
     int16_t sBytesWritten = -1;
     OtaPalContext_t * pxContext = prvGetImageContext();
 
+    PROF_BEGIN( xProfWriteBlock );
+
     configASSERT( pxContext->ulTargetBank != prvGetActiveBank() );
 
     configASSERT( blockSize < INT16_MAX );
@@ -897,10 +1736,44 @@ int16_t otaPal_WriteBlock( OtaFileContext_t * const pxFileContext,
     {
         LogError( "pData is NULL." );
     }
-    else if( prvWriteToFlash( ( pxContext->ulBaseAddress + offset ), pData, blockSize ) == HAL_OK )
+    else if( ( pxContext->xImageFormat == OTA_PAL_IMAGE_RAW ) &&
+             ( prvResumeIsWritten( offset ) == pdTRUE ) )
+    {
+        /* Already written before a reset, the flash cannot be programmed twice */
+        if( memcmp( ( void * ) ( pxContext->ulBaseAddress + offset ), pData, blockSize ) == 0 )
+        {
+            sBytesWritten = ( int16_t ) blockSize;
+        }
+        else
+        {
+            LogError( "Block at offset %u differs from the one written before the reset.", offset );
+            prvResumeStop();
+        }
+    }
+    else if( prvErasePagesForWrite( pxContext, ( pxContext->ulFileOffset + offset ), blockSize ) != pdTRUE )
+    {
+        LogError( "Failed to erase the flash under offset %u.", offset );
+    }
+    else if( prvWriteToFlash( ( pxContext->ulBaseAddress + pxContext->ulFileOffset + offset ), pData, blockSize ) != HAL_OK )
+    {
+        LogError( "Failed to write the block at offset %u.", offset );
+    }
+    else if( pxContext->xImageFormat == OTA_PAL_IMAGE_RAW )
+    {
+        sBytesWritten = ( int16_t ) blockSize;
+        prvImageHashUpdate( pxContext, offset, blockSize );
+        prvResumeOnWrite( pxContext, offset, blockSize );
+    }
+    else if( prvDecoderUpdate( pxContext, offset, blockSize ) == pdTRUE )
     {
         sBytesWritten = ( int16_t ) blockSize;
     }
+    else
+    {
+        LogError( "Failed to decode the block at offset %u.", offset );
+    }
+
+    PROF_END( xProfWriteBlock );
 
     return sBytesWritten;
 }
@@ -922,9 +1795,16 @@ OtaPalStatus_t otaPal_CloseFile( OtaFileContext_t * const pxFileContext )
         unsigned char pucHashBuffer[ MBEDTLS_MD_MAX_SIZE ];
         size_t uxHashLength = 0;
 
-        if( xCalculateImageHash( ( unsigned char * ) ( pxContext->ulBaseAddress ),
-                                 ( size_t ) pxContext->ulImageSize,
-                                 pucHashBuffer, MBEDTLS_MD_MAX_SIZE, &uxHashLength ) != pdTRUE )
+        /* The download is complete, whatever the outcome it is not resumed */
+        prvResumeStop();
+
+        if( ( pxContext->xImageFormat != OTA_PAL_IMAGE_RAW ) &&
+            ( prvDecoderFinish( pxContext ) != pdTRUE ) )
+        {
+            uxOtaStatus = OTA_PAL_COMBINE_ERR( OtaPalFileClose, 0 );
+            prvImageHashFree();
+        }
+        else if( prvImageHashFinish( pxContext, pucHashBuffer, MBEDTLS_MD_MAX_SIZE, &uxHashLength ) != pdTRUE )
         {
             uxOtaStatus = OTA_PAL_COMBINE_ERR( OtaPalFileClose, 0 );
         }
@@ -956,6 +1836,10 @@ OtaPalStatus_t otaPal_CloseFile( OtaFileContext_t * const pxFileContext )
         uxOtaStatus = OTA_PAL_COMBINE_ERR( OtaPalFileClose, 0 );
     }
 
+    vDvfsRelease( DVFS_CLIENT_OTA );
+    net_release_active( NET_ACTIVE_CLIENT_OTA );
+    vPowerStatsOpEnd( POWER_OP_OTA );
+
     return uxOtaStatus;
 }
 
@@ -964,6 +1848,12 @@ OtaPalStatus_t otaPal_Abort( OtaFileContext_t * const pxFileContext )
 {
     OtaPalStatus_t palStatus = otaPal_SetPlatformImageState( pxFileContext, OtaImageStateAborted );
 
+    prvImageHashFree();
+    prvResumeStop();
+    vDvfsRelease( DVFS_CLIENT_OTA );
+    net_release_active( NET_ACTIVE_CLIENT_OTA );
+    vPowerStatsOpEnd( POWER_OP_OTA );
+
     pxFileContext->pFile = NULL;
 
     return palStatus;
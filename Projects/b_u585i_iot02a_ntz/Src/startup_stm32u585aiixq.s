@@ -45,6 +45,12 @@ defined in linker script */
 .word	_sbss
 /* end address for the .bss section. defined in linker script */
 .word	_ebss
+/* start address for the initialization values of the .ramfunc section. defined in linker script */
+.word	_siramfunc
+/* start address for the .ramfunc section. defined in linker script */
+.word	_sramfunc
+/* end address for the .ramfunc section. defined in linker script */
+.word	_eramfunc
 
 .equ  BootRAM,        0xF1E0F85F
 /**
@@ -78,6 +84,23 @@ LoopCopyDataInit:
 	adds	r2, r0, r1
 	cmp	r2, r3
 	bcc	CopyDataInit
+
+/* Copy the functions executed from SRAM */
+  movs	r1, #0
+  b	LoopCopyRamFunc
+
+CopyRamFunc:
+	ldr	r3, =_siramfunc
+	ldr	r3, [r3, r1]
+	str	r3, [r0, r1]
+	adds	r1, r1, #4
+
+LoopCopyRamFunc:
+	ldr	r0, =_sramfunc
+	ldr	r3, =_eramfunc
+	adds	r2, r0, r1
+	cmp	r2, r3
+	bcc	CopyRamFunc
 	ldr	r2, =_sbss
 	b	LoopFillZerobss
 /* Zero fill the bss segment. */
@@ -36,7 +36,13 @@
 
 #define KV_STORE_NVIMPL_ARM_PSA     1
 
-#define KVSTORE_KEY_MAX_LEN         16
+/* Define KV_STORE_WRITE_BACK_ENABLE to 1 to store all values together in a few ITS objects */
+#define KV_STORE_WRITE_BACK_ENABLE  1
+
+/* Delay between a commit and the write to ITS, changes committed within it are stored together */
+#define KV_STORE_FLUSH_DELAY_MS     5000
+
+#define KVSTORE_KEY_MAX_LEN         24
 #define KVSTORE_VAL_MAX_LEN         256
 
 #endif /* _KVSTORE_CONFIG_PLAT_H */
@@ -314,7 +314,8 @@ void mbedtls_platform_free( void * ptr );
 /*#define MBEDTLS_ARIA_ALT */
 /*#define MBEDTLS_CAMELLIA_ALT */
 /*#define MBEDTLS_CCM_ALT */
-/*#define MBEDTLS_CHACHA20_ALT */
+/* Word oriented ChaCha20 in Common/crypto/chacha20_alt.c */
+#define MBEDTLS_CHACHA20_ALT
 /*#define MBEDTLS_CHACHAPOLY_ALT */
 /*#define MBEDTLS_CMAC_ALT */
 /*#define MBEDTLS_DES_ALT */
@@ -3180,8 +3181,12 @@ void mbedtls_platform_free( void * ptr );
  * certificate data which is sent during the handshake.
  *
  * Uncomment to set the maximum plaintext size of the outgoing I/O buffer.
+ *
+ * The client certificate is the largest handshake message this device sends,
+ * and application data is written in records of at most 4096 bytes (the
+ * maximum fragment length requested by the TLS transport).
  */
-/*#define MBEDTLS_SSL_OUT_CONTENT_LEN             16384 */
+#define MBEDTLS_SSL_OUT_CONTENT_LEN    4096
 
 /** \def MBEDTLS_SSL_DTLS_MAX_BUFFERING
  *
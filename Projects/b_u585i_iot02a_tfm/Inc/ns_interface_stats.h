@@ -0,0 +1,84 @@
+/*
+ * FreeRTOS STM32 Reference Integration
+ *
+ * Copyright (c) 2022 Amazon.com, Inc. or its affiliates. All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+/**
+ * @file ns_interface_stats.h
+ * @brief Contention statistics of the lock around the secure calls.
+ *
+ * The secure side serves one non-secure request at a time, so
+ * tfm_ns_interface_dispatch keeps every veneer call behind a single mutex.
+ * Waiters are queued by priority and the holder inherits the priority of
+ * the highest waiter, so a long operation of a low priority task delays a
+ * higher priority caller by at most the remainder of that operation. These
+ * statistics show how long that is and which tasks pay for it.
+ */
+
+#ifndef NS_INTERFACE_STATS_H_
+#define NS_INTERFACE_STATS_H_
+
+#include <stdint.h>
+
+#include "FreeRTOS.h"
+
+/* Calling tasks tracked individually, later ones are only counted in the totals */
+#ifndef NS_INTF_STATS_CLIENTS
+#define NS_INTF_STATS_CLIENTS    10
+#endif
+
+typedef struct NsIntfClientStats
+{
+    char pcName[ configMAX_TASK_NAME_LEN ];
+    UBaseType_t uxPriority;  /* Base priority at the last call */
+    uint32_t ulCalls;
+    uint32_t ulContended;    /* Calls which found the lock taken */
+    uint64_t ullWaitUs;
+    uint32_t ulMaxWaitUs;
+    uint32_t ulMaxHoldUs;
+} NsIntfClientStats_t;
+
+typedef struct NsIntfStats
+{
+    uint32_t ulCalls;
+    uint32_t ulContended;
+    uint32_t ulInversions;   /* Contended calls which raised the priority of the holder */
+    uint64_t ullWaitUs;
+    uint32_t ulMaxWaitUs;
+    uint64_t ullHoldUs;
+    uint32_t ulMaxHoldUs;
+    const void * pvMaxHoldFn; /* Veneer of the longest call */
+    char pcMaxHoldTask[ configMAX_TASK_NAME_LEN ];
+    char pcMaxWaitTask[ configMAX_TASK_NAME_LEN ];
+    uint32_t ulUntracked;    /* Calls from tasks beyond NS_INTF_STATS_CLIENTS */
+    NsIntfClientStats_t xClients[ NS_INTF_STATS_CLIENTS ];
+} NsIntfStats_t;
+
+/*
+ * Copy the statistics since boot or the last reset. Takes the lock, so must
+ * be called from a task.
+ */
+void vNsIntfGetStats( NsIntfStats_t * pxStats );
+
+/* Clear the statistics, takes the lock */
+void vNsIntfResetStats( void );
+
+#endif /* NS_INTERFACE_STATS_H_ */
@@ -38,6 +38,10 @@
 #include "stm32u5xx.h"
 #include "kvstore.h"
 #include "hw_defs.h"
+#include "time_base.h"
+#include "net_sntp.h"
+#include "boot_times.h"
+#include "work_queue.h"
 #include "psa/crypto.h"
 #include <string.h>
 
@@ -66,6 +70,7 @@ typedef void ( * VectorTable_t )( void );
 static VectorTable_t pulVectorTableSRAM[ VECTOR_TABLE_SIZE ] __attribute__( ( aligned( VECTOR_TABLE_ALIGN_CM33 ) ) );
 
 extern int32_t ns_interface_lock_init( void );
+extern void vEntropyPoolInit( void );
 
 /* Relocate vector table to ram for runtime interrupt registration */
 static void vRelocateVectorTable( void )
@@ -93,27 +98,32 @@ static void vRelocateVectorTable( void )
 }
 
 
-static void vHeartbeatTask( void * pvParameters )
+static WorkJob_t xHeartbeatJob = { 0 };
+
+static void prvHeartbeatJob( void * pvCtx )
 {
-    ( void ) pvParameters;
+    ( void ) pvCtx;
+
+    HAL_GPIO_TogglePin( LED_GREEN_GPIO_Port, LED_GREEN_Pin );
+}
 
+static void vHeartbeatStart( void )
+{
     HAL_GPIO_WritePin( LED_GREEN_GPIO_Port, LED_GREEN_Pin, GPIO_PIN_RESET );
     HAL_GPIO_WritePin( LED_RED_GPIO_Port, LED_RED_Pin, GPIO_PIN_SET );
 
-    while( 1 )
-    {
-        vTaskDelay( pdMS_TO_TICKS( 1000 ) );
-        HAL_GPIO_TogglePin( LED_GREEN_GPIO_Port, LED_GREEN_Pin );
-    }
+    vWorkJobInit( &xHeartbeatJob, "Heartbeat", prvHeartbeatJob, NULL );
+    vWorkJobSchedulePeriodic( &xHeartbeatJob, 1000, 1000 );
 }
 
 extern void net_main( void * pvParameters );
 extern void vMQTTAgentTask( void * );
 extern void vMotionSensorsPublish( void * );
-extern void vEnvironmentSensorPublishTask( void * );
+extern void vEnvironmentSensorPublishStart( void );
+extern void vSensorHubInit( void );
 extern void vShadowDeviceTask( void * );
 extern void vOTAUpdateTask( void * pvParam );
-extern void vDefenderAgentTask( void * );
+extern void vDefenderAgentStart( void );
 #if DEMO_QUALIFICATION_TEST
 extern void run_qualification_main( void * );
 #endif /* DEMO_QUALIFICATION_TEST */
@@ -122,17 +132,42 @@ void vInitTask( void * pvArgs )
 {
     BaseType_t xResult;
 
+    vBootTimeMark( BOOT_STAGE_SCHEDULER );
+
     /* Initialize PSA crypto api */
     psa_crypto_init();
 
+    vEntropyPoolInit();
+
     xResult = xTaskCreate( Task_CLI, "cli", 2048, NULL, 10, NULL );
 
     ( void ) xEventGroupSetBits( xSystemEvents, EVT_MASK_FS_READY );
 
     KVStore_init();
 
-    xResult = xTaskCreate( vHeartbeatTask, "Heartbeat", 128, NULL, tskIDLE_PRIORITY, NULL );
-    configASSERT( xResult == pdTRUE );
+    vBootTimeMark( BOOT_STAGE_KVSTORE );
+
+    {
+        char cLogLevels[ 128 ];
+
+        if( KVStore_getString( CS_LOG_LEVELS, cLogLevels, sizeof( cLogLevels ) ) > 0 )
+        {
+            if( lLoggingSetLevels( cLogLevels ) != 1 )
+            {
+                LogError( "Invalid log_levels setting: %s", cLogLevels );
+            }
+        }
+    }
+
+    vTimeBaseInit();
+
+    vWorkQueueInit();
+
+#if NET_SNTP_ENABLED == 1
+    vNetSntpInit();
+#endif
+
+    vHeartbeatStart();
 
     xResult = xTaskCreate( &net_main, "MxNet", 1024, NULL, 23, NULL );
     configASSERT( xResult == pdTRUE );
@@ -147,8 +182,9 @@ void vInitTask( void * pvArgs )
     xResult = xTaskCreate( vOTAUpdateTask, "OTAUpdate", 2048, NULL, tskIDLE_PRIORITY + 3, NULL );
     configASSERT( xResult == pdTRUE );
 
-    xResult = xTaskCreate( vEnvironmentSensorPublishTask, "EnvSense", 1024, NULL, tskIDLE_PRIORITY + 2, NULL );
-    configASSERT( xResult == pdTRUE );
+    vSensorHubInit();
+
+    vEnvironmentSensorPublishStart();
 
     xResult = xTaskCreate( vMotionSensorsPublish, "MotionS", 1024, NULL, tskIDLE_PRIORITY + 2, NULL );
     configASSERT( xResult == pdTRUE );
@@ -156,8 +192,7 @@ void vInitTask( void * pvArgs )
     xResult = xTaskCreate( vShadowDeviceTask, "ShadowDevice", 1024, NULL, tskIDLE_PRIORITY + 1, NULL );
     configASSERT( xResult == pdTRUE );
 
-    xResult = xTaskCreate( vDefenderAgentTask, "AWSDefender", 2048, NULL, tskIDLE_PRIORITY + 1, NULL );
-    configASSERT( xResult == pdTRUE );
+    vDefenderAgentStart();
 #endif /* DEMO_QUALIFICATION_TEST */
 
     while( 1 )
@@ -168,10 +203,17 @@ void vInitTask( void * pvArgs )
 
 int main( void )
 {
+    /* The reset flags are read by the secure image */
+    vBootTimesInit( 0 );
+
     hw_init();
 
+    vBootTimeMark( BOOT_STAGE_HW_INIT );
+
     vRelocateVectorTable();
 
+    vBootTimeMark( BOOT_STAGE_VECTOR_TABLE );
+
     vLoggingInit();
 
     LogInfo( "HW Init Complete." );
@@ -21,8 +21,128 @@
  */
 
 
+
+#include <string.h>
+
+#include "FreeRTOS.h"
+#include "task.h"
+
+#include "logging_levels.h"
+#define LOG_LEVEL     LOG_ERROR
+#define LOG_MODULE    LOG_MODULE_TLS
+#include "logging.h"
+
 #include "entropy_poll.h"
+#include "mbedtls/platform_util.h"
 #include "psa/crypto.h"
+#include "task_stacks.h"
+#include "static_alloc.h"
+
+/*
+ * Bytes of secure random output kept ready for mbedtls_hardware_poll, so that
+ * seeding a DRBG during a handshake copies from memory instead of making a
+ * secure call behind the NS interface lock. Each byte is handed out once
+ * and wiped as it is taken, and no byte is ever returned a second time, so
+ * every poll still gets fresh output of the secure DRBG as mbedtls expects.
+ * When the pool runs short the remainder is requested directly and a
+ * failure of the secure call is returned as such.
+ */
+#ifndef ENTROPY_POOL_LEN
+#define ENTROPY_POOL_LEN              512
+#endif
+
+/* The refill task tops the pool up once it falls below this level */
+#ifndef ENTROPY_POOL_LOW_WATER
+#define ENTROPY_POOL_LOW_WATER        ( ENTROPY_POOL_LEN / 2 )
+#endif
+
+#ifndef ENTROPY_POOL_TASK_PRIORITY
+#define ENTROPY_POOL_TASK_PRIORITY    ( tskIDLE_PRIORITY + 1 )
+#endif
+
+/* Valid bytes are ucPool[ 0 ] to ucPool[ uxPoolLen - 1 ], taken from the end */
+static uint8_t ucPool[ ENTROPY_POOL_LEN ];
+static size_t uxPoolLen = 0;
+
+/* Written by the refill task only, outside of the critical section */
+static uint8_t ucBatch[ ENTROPY_POOL_LEN ];
+
+static TaskHandle_t xRefillTask = NULL;
+
+/*-----------------------------------------------------------*/
+
+static size_t prvPoolTake( unsigned char * pucOutput,
+                           size_t uxLen )
+{
+    size_t uxTaken;
+
+    taskENTER_CRITICAL();
+    {
+        uxTaken = ( uxLen < uxPoolLen ) ? uxLen : uxPoolLen;
+        uxPoolLen -= uxTaken;
+
+        ( void ) memcpy( pucOutput, &( ucPool[ uxPoolLen ] ), uxTaken );
+        mbedtls_platform_zeroize( &( ucPool[ uxPoolLen ] ), uxTaken );
+    }
+    taskEXIT_CRITICAL();
+
+    return uxTaken;
+}
+
+/*-----------------------------------------------------------*/
+
+static void prvPoolRefillTask( void * pvParameters )
+{
+    ( void ) pvParameters;
+
+    for( ; ; )
+    {
+        size_t uxSpace = ENTROPY_POOL_LEN - uxPoolLen;
+
+        if( uxSpace > ( ENTROPY_POOL_LEN - ENTROPY_POOL_LOW_WATER ) )
+        {
+            /* Only one secure call per refill */
+            psa_status_t xStatus = psa_generate_random( ucBatch, uxSpace );
+
+            if( xStatus == PSA_SUCCESS )
+            {
+                taskENTER_CRITICAL();
+                {
+                    /* Consumers may have taken more in the meantime */
+                    size_t uxCopy = ENTROPY_POOL_LEN - uxPoolLen;
+
+                    uxCopy = ( uxCopy < uxSpace ) ? uxCopy : uxSpace;
+                    ( void ) memcpy( &( ucPool[ uxPoolLen ] ), ucBatch, uxCopy );
+                    uxPoolLen += uxCopy;
+                }
+                taskEXIT_CRITICAL();
+            }
+            else
+            {
+                LogError( "psa_generate_random failed: %ld", ( long ) xStatus );
+            }
+
+            mbedtls_platform_zeroize( ucBatch, uxSpace );
+        }
+
+        ( void ) ulTaskNotifyTake( pdTRUE, portMAX_DELAY );
+    }
+}
+
+/*-----------------------------------------------------------*/
+
+void vEntropyPoolInit( void )
+{
+    BaseType_t xResult;
+
+    configASSERT( xRefillTask == NULL );
+
+    xResult = xTaskCreateStaticStack( prvPoolRefillTask, "EntropyFill", TASK_STACK_ENTROPYFILL,
+                                      NULL, ENTROPY_POOL_TASK_PRIORITY, &xRefillTask );
+    configASSERT( xResult == pdPASS );
+}
+
+/*-----------------------------------------------------------*/
 
 int mbedtls_hardware_poll( void * data,
                            unsigned char * output,
@@ -30,7 +150,19 @@ int mbedtls_hardware_poll( void * data,
                            size_t * olen )
 {
     ( void ) data;
-    int lReturn = psa_generate_random( output, len );
+    int lReturn = PSA_SUCCESS;
+    size_t uxTaken = prvPoolTake( output, len );
+
+    if( uxTaken < len )
+    {
+        lReturn = psa_generate_random( &( output[ uxTaken ] ), len - uxTaken );
+    }
+
+    if( ( xRefillTask != NULL ) &&
+        ( uxPoolLen < ENTROPY_POOL_LOW_WATER ) )
+    {
+        ( void ) xTaskNotifyGive( xRefillTask );
+    }
 
     if( lReturn == PSA_SUCCESS )
     {
@@ -38,6 +170,7 @@ int mbedtls_hardware_poll( void * data,
     }
     else
     {
+        mbedtls_platform_zeroize( output, len );
         *olen = 0;
     }
 
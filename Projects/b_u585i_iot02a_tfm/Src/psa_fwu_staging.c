@@ -0,0 +1,205 @@
+/*
+ * FreeRTOS STM32 Reference Integration
+ * Copyright (C) 2022 Amazon.com, Inc. or its affiliates.  All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+/*
+ * Write-combining layer in front of the PSA Firmware Update client API.
+ *
+ * The OTA PAL calls psa_fwu_write() once per OTA block. Every call is a
+ * non-secure to secure transition made under the TF-M NS interface lock, so
+ * contiguous blocks are accumulated here and handed to the secure side in
+ * chunks of PSA_FWU_STAGING_SIZE bytes instead.
+ *
+ * The PAL symbols are redirected to this file with the linker options
+ * -Wl,--wrap=psa_fwu_write,--wrap=psa_fwu_install,--wrap=psa_fwu_abort,--wrap=psa_fwu_query
+ * Any pending data is written before an install or query and dropped on abort.
+ */
+
+#include "logging_levels.h"
+#define LOG_LEVEL    LOG_INFO
+#define LOG_MODULE    LOG_MODULE_OTA
+#include "logging.h"
+
+#include "FreeRTOS.h"
+
+#include <stdint.h>
+#include <string.h>
+
+#include "psa/update.h"
+
+/*
+ * Size of a secure write. A multiple of the 8 KB flash page keeps every
+ * chunk page aligned on the secure side, matching its erase granularity.
+ */
+#ifndef PSA_FWU_STAGING_SIZE
+#define PSA_FWU_STAGING_SIZE    ( 8U * 1024U )
+#endif
+
+psa_status_t __real_psa_fwu_write( psa_image_id_t image_id,
+                                   size_t block_offset,
+                                   const void * block,
+                                   size_t block_size );
+
+psa_status_t __real_psa_fwu_install( psa_image_id_t image_id,
+                                     psa_image_id_t * dependency_uuid,
+                                     psa_image_version_t * dependency_version );
+
+psa_status_t __real_psa_fwu_abort( psa_image_id_t image_id );
+
+psa_status_t __real_psa_fwu_query( psa_image_id_t image_id,
+                                   psa_image_info_t * info );
+
+typedef struct
+{
+    psa_image_id_t xImageId;
+    size_t uxOffset; /* Image offset of pucData[ 0 ] */
+    size_t uxLength; /* Number of bytes pending in pucData */
+    uint8_t pucData[ PSA_FWU_STAGING_SIZE ];
+} FwuStaging_t;
+
+static FwuStaging_t xStaging = { 0 };
+
+/*-----------------------------------------------------------*/
+
+static psa_status_t prvStagingFlush( void )
+{
+    psa_status_t xStatus = PSA_SUCCESS;
+
+    if( xStaging.uxLength > 0 )
+    {
+        xStatus = __real_psa_fwu_write( xStaging.xImageId,
+                                        xStaging.uxOffset,
+                                        xStaging.pucData,
+                                        xStaging.uxLength );
+
+        if( xStatus != PSA_SUCCESS )
+        {
+            LogError( "psa_fwu_write of %u bytes at offset %u failed: %ld",
+                      ( unsigned int ) xStaging.uxLength,
+                      ( unsigned int ) xStaging.uxOffset,
+                      ( long ) xStatus );
+        }
+
+        xStaging.uxLength = 0;
+    }
+
+    return xStatus;
+}
+
+/*-----------------------------------------------------------*/
+
+psa_status_t __wrap_psa_fwu_write( psa_image_id_t image_id,
+                                   size_t block_offset,
+                                   const void * block,
+                                   size_t block_size )
+{
+    psa_status_t xStatus = PSA_SUCCESS;
+    const uint8_t * pucBlock = ( const uint8_t * ) block;
+
+    /* Only a write that continues the staged run can be merged into it */
+    if( ( xStaging.uxLength > 0 ) &&
+        ( ( xStaging.xImageId != image_id ) ||
+          ( xStaging.uxOffset + xStaging.uxLength != block_offset ) ) )
+    {
+        xStatus = prvStagingFlush();
+    }
+
+    if( xStaging.uxLength == 0 )
+    {
+        xStaging.xImageId = image_id;
+        xStaging.uxOffset = block_offset;
+    }
+
+    while( ( xStatus == PSA_SUCCESS ) &&
+           ( block_size > 0 ) )
+    {
+        size_t uxCopy = PSA_FWU_STAGING_SIZE - xStaging.uxLength;
+
+        if( uxCopy > block_size )
+        {
+            uxCopy = block_size;
+        }
+
+        ( void ) memcpy( &( xStaging.pucData[ xStaging.uxLength ] ), pucBlock, uxCopy );
+        xStaging.uxLength += uxCopy;
+        pucBlock += uxCopy;
+        block_size -= uxCopy;
+
+        if( xStaging.uxLength == PSA_FWU_STAGING_SIZE )
+        {
+            size_t uxNextOffset = xStaging.uxOffset + xStaging.uxLength;
+
+            xStatus = prvStagingFlush();
+            xStaging.uxOffset = uxNextOffset;
+        }
+    }
+
+    return xStatus;
+}
+
+/*-----------------------------------------------------------*/
+
+psa_status_t __wrap_psa_fwu_install( psa_image_id_t image_id,
+                                     psa_image_id_t * dependency_uuid,
+                                     psa_image_version_t * dependency_version )
+{
+    psa_status_t xStatus = prvStagingFlush();
+
+    if( xStatus == PSA_SUCCESS )
+    {
+        xStatus = __real_psa_fwu_install( image_id, dependency_uuid, dependency_version );
+    }
+
+    return xStatus;
+}
+
+/*-----------------------------------------------------------*/
+
+psa_status_t __wrap_psa_fwu_query( psa_image_id_t image_id,
+                                   psa_image_info_t * info )
+{
+    psa_status_t xStatus = PSA_SUCCESS;
+
+    if( ( xStaging.uxLength > 0 ) &&
+        ( xStaging.xImageId == image_id ) )
+    {
+        xStatus = prvStagingFlush();
+    }
+
+    if( xStatus == PSA_SUCCESS )
+    {
+        xStatus = __real_psa_fwu_query( image_id, info );
+    }
+
+    return xStatus;
+}
+
+/*-----------------------------------------------------------*/
+
+psa_status_t __wrap_psa_fwu_abort( psa_image_id_t image_id )
+{
+    if( xStaging.xImageId == image_id )
+    {
+        xStaging.uxLength = 0;
+    }
+
+    return __real_psa_fwu_abort( image_id );
+}
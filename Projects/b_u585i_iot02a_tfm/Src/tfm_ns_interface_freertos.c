@@ -27,8 +27,12 @@
 
 #include "FreeRTOS.h"
 #include "semphr.h"
+#include "task.h"
 #include <stdint.h>
+#include <string.h>
 #include "tfm_ns_interface.h"
+#include "ns_interface_stats.h"
+#include "time_base.h"
 
 #if ( configSUPPORT_STATIC_ALLOCATION == 1 && configSUPPORT_DYNAMIC_ALLOCATION == 0 )
 
@@ -41,6 +45,13 @@ static StaticSemaphore_t xNsIntfMutexBuffer = { 0 };
 
 static SemaphoreHandle_t xNsIntfMutex = NULL;
 
+/* Only written while holding xNsIntfMutex */
+static NsIntfStats_t xNsIntfStats = { 0 };
+static TaskHandle_t xClientHandles[ NS_INTF_STATS_CLIENTS ] = { 0 };
+
+/* Priority of the current holder, read without the lock by contending callers */
+static volatile UBaseType_t uxHolderPriority = 0;
+
 int32_t ns_interface_lock_init( void )
 {
     int32_t lReturn = -1;
@@ -59,6 +70,115 @@ int32_t ns_interface_lock_init( void )
     return lReturn;
 }
 
+/*-----------------------------------------------------------*/
+
+static inline uint32_t prvClampUs( uint64_t ullUs )
+{
+    return ( ullUs > UINT32_MAX ) ? UINT32_MAX : ( uint32_t ) ullUs;
+}
+
+/*-----------------------------------------------------------*/
+
+/* Called with xNsIntfMutex held */
+static NsIntfClientStats_t * prvGetClient( TaskHandle_t xTask )
+{
+    NsIntfClientStats_t * pxClient = NULL;
+
+    for( size_t i = 0; ( i < NS_INTF_STATS_CLIENTS ) && ( pxClient == NULL ); i++ )
+    {
+        if( xClientHandles[ i ] == xTask )
+        {
+            pxClient = &( xNsIntfStats.xClients[ i ] );
+        }
+        else if( xClientHandles[ i ] == NULL )
+        {
+            xClientHandles[ i ] = xTask;
+            pxClient = &( xNsIntfStats.xClients[ i ] );
+            ( void ) strncpy( pxClient->pcName, pcTaskGetName( xTask ), configMAX_TASK_NAME_LEN - 1 );
+        }
+    }
+
+    return pxClient;
+}
+
+/*-----------------------------------------------------------*/
+
+/* Called with xNsIntfMutex held once fn has returned */
+static void prvRecordCall( veneer_fn fn,
+                           TaskHandle_t xTask,
+                           UBaseType_t uxPriority,
+                           BaseType_t xContended,
+                           BaseType_t xInversion,
+                           uint32_t ulWaitUs,
+                           uint32_t ulHoldUs )
+{
+    NsIntfStats_t * pxStats = &xNsIntfStats;
+    NsIntfClientStats_t * pxClient = NULL;
+
+    pxStats->ulCalls++;
+    pxStats->ullHoldUs += ulHoldUs;
+
+    if( xContended == pdTRUE )
+    {
+        pxStats->ulContended++;
+        pxStats->ullWaitUs += ulWaitUs;
+    }
+
+    if( xInversion == pdTRUE )
+    {
+        pxStats->ulInversions++;
+    }
+
+    if( xTask != NULL )
+    {
+        pxClient = prvGetClient( xTask );
+    }
+
+    if( pxClient == NULL )
+    {
+        pxStats->ulUntracked++;
+    }
+    else
+    {
+        pxClient->uxPriority = uxPriority;
+        pxClient->ulCalls++;
+
+        if( xContended == pdTRUE )
+        {
+            pxClient->ulContended++;
+            pxClient->ullWaitUs += ulWaitUs;
+        }
+
+        if( ulWaitUs > pxClient->ulMaxWaitUs )
+        {
+            pxClient->ulMaxWaitUs = ulWaitUs;
+        }
+
+        if( ulHoldUs > pxClient->ulMaxHoldUs )
+        {
+            pxClient->ulMaxHoldUs = ulHoldUs;
+        }
+    }
+
+    if( ulWaitUs > pxStats->ulMaxWaitUs )
+    {
+        pxStats->ulMaxWaitUs = ulWaitUs;
+        ( void ) strncpy( pxStats->pcMaxWaitTask,
+                          ( xTask != NULL ) ? pcTaskGetName( xTask ) : "",
+                          configMAX_TASK_NAME_LEN - 1 );
+    }
+
+    if( ulHoldUs > pxStats->ulMaxHoldUs )
+    {
+        pxStats->ulMaxHoldUs = ulHoldUs;
+        pxStats->pvMaxHoldFn = ( const void * ) fn;
+        ( void ) strncpy( pxStats->pcMaxHoldTask,
+                          ( xTask != NULL ) ? pcTaskGetName( xTask ) : "",
+                          configMAX_TASK_NAME_LEN - 1 );
+    }
+}
+
+/*-----------------------------------------------------------*/
 
 int32_t tfm_ns_interface_dispatch( veneer_fn fn,
                                    uint32_t arg0,
@@ -67,15 +187,81 @@ int32_t tfm_ns_interface_dispatch( veneer_fn fn,
                                    uint32_t arg3 )
 {
     int32_t lResult = -1;
+    TaskHandle_t xTask = NULL;
+    UBaseType_t uxPriority = 0;
+    BaseType_t xContended = pdFALSE;
+    BaseType_t xInversion = pdFALSE;
+    BaseType_t xLocked;
+    uint64_t ullStartUs;
+    uint64_t ullLockedUs;
 
     configASSERT( xNsIntfMutex != NULL );
 
-    if( xSemaphoreTake( xNsIntfMutex, portMAX_DELAY ) == pdTRUE )
+    if( xTaskGetSchedulerState() != taskSCHEDULER_NOT_STARTED )
+    {
+        xTask = xTaskGetCurrentTaskHandle();
+        uxPriority = uxTaskPriorityGet( NULL );
+    }
+
+    ullStartUs = ullTimeBaseGetUs();
+
+    /*
+     * The mutex queues waiters by priority and lends the priority of the
+     * highest one to the holder, which then finishes its secure call ahead of
+     * the medium priority tasks.
+     */
+    xLocked = xSemaphoreTake( xNsIntfMutex, 0 );
+
+    if( xLocked != pdTRUE )
     {
+        xContended = pdTRUE;
+        xInversion = ( uxHolderPriority < uxPriority ) ? pdTRUE : pdFALSE;
+        xLocked = xSemaphoreTake( xNsIntfMutex, portMAX_DELAY );
+    }
+
+    if( xLocked == pdTRUE )
+    {
+        uxHolderPriority = uxPriority;
+        ullLockedUs = ullTimeBaseGetUs();
+
         lResult = fn( arg0, arg1, arg2, arg3 );
 
+        prvRecordCall( fn, xTask, uxPriority, xContended, xInversion,
+                       prvClampUs( ullLockedUs - ullStartUs ),
+                       prvClampUs( ullTimeBaseGetUs() - ullLockedUs ) );
+
         xSemaphoreGive( xNsIntfMutex );
     }
 
     return lResult;
 }
+
+/*-----------------------------------------------------------*/
+
+void vNsIntfGetStats( NsIntfStats_t * pxStats )
+{
+    configASSERT( pxStats != NULL );
+    configASSERT( xNsIntfMutex != NULL );
+
+    if( xSemaphoreTake( xNsIntfMutex, portMAX_DELAY ) == pdTRUE )
+    {
+        *pxStats = xNsIntfStats;
+
+        xSemaphoreGive( xNsIntfMutex );
+    }
+}
+
+/*-----------------------------------------------------------*/
+
+void vNsIntfResetStats( void )
+{
+    configASSERT( xNsIntfMutex != NULL );
+
+    if( xSemaphoreTake( xNsIntfMutex, portMAX_DELAY ) == pdTRUE )
+    {
+        ( void ) memset( &xNsIntfStats, 0, sizeof( xNsIntfStats ) );
+        ( void ) memset( xClientHandles, 0, sizeof( xClientHandles ) );
+
+        xSemaphoreGive( xNsIntfMutex );
+    }
+}
@@ -67,6 +67,17 @@ SPE_SECURITY_COUNTER ?= 1
 NSPE_SECURITY_COUNTER ?= 1
 NUM_PROCESSORS = 8
 
+###############################################################################
+# Secure side crypto
+###############################################################################
+# ON builds the TF-M crypto partition with the STM32U5 AES, HASH and PKA
+# drivers, OFF with the mbedtls software implementation only. The crypto
+# peripherals are secure, so the non-secure mbedtls cannot use them here.
+TFM_CRYPTO_HW_ACCEL ?= ON
+
+# Changing the setting regenerates the TF-M build directory
+TFM_CRYPTO_HW_ACCEL_STAMP = ${BUILD_PATH}/.tfm_crypto_hw_accel_${TFM_CRYPTO_HW_ACCEL}
+
 ###############################################################################
 # Default / phony targets
 ###############################################################################
@@ -94,6 +105,7 @@ info:
 	@echo "TFM_SRC_PATH:     ${TFM_SRC_PATH}"
 	@echo "MBEDTLS_SRC_PATH: ${MBEDTLS_SRC_PATH}"
 	@echo "MCUBOOT_SRC_PATH: ${MCUBOOT_SRC_PATH}"
+	@echo "TFM_CRYPTO_HW_ACCEL: ${TFM_CRYPTO_HW_ACCEL}"
 	@echo "SHELLFLAGS:       ${.SHELLFLAGS}"
 	@echo "CFLAGS:           ${CFLAGS}"
 	@echo "LDFLAGS:          ${LDFLAGS}"
@@ -148,7 +160,11 @@ spe_patch_libs_distclean :
 ###############################################################################
 
 # Use cmake to generate the Makefile file
-${TFM_BUILD_PATH}/.ready : ${MBEDTLS_PATCH_FLAGS} ${MCUBOOT_PATCH_FLAGS}
+${TFM_CRYPTO_HW_ACCEL_STAMP} :
+	rm -f ${BUILD_PATH}/.tfm_crypto_hw_accel_*
+	touch $@
+
+${TFM_BUILD_PATH}/.ready : ${MBEDTLS_PATCH_FLAGS} ${MCUBOOT_PATCH_FLAGS} ${TFM_CRYPTO_HW_ACCEL_STAMP}
 	@echo Calling cmake for artifact: $@ due to prereq: $?
 	${RM} -rf ${TFM_BUILD_PATH}
 	mkdir -p ${TFM_BUILD_PATH}
@@ -169,6 +185,7 @@ ${TFM_BUILD_PATH}/.ready : ${MBEDTLS_PATCH_FLAGS} ${MCUBOOT_PATCH_FLAGS}
 		-DPython_FIND_VIRTUALENV=FIRST \
 		-DCMAKE_MAKE_PROGRAM=${MAKE} \
 		-DTFM_PARTITION_FIRMWARE_UPDATE=ON \
+		-DCRYPTO_HW_ACCELERATOR=${TFM_CRYPTO_HW_ACCEL} \
 		-DMCUBOOT_DATA_SHARING=ON \
 		-G"Unix Makefiles" \
 		-DCONFIG_TFM_FP=hard \
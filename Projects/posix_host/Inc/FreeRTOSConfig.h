@@ -0,0 +1,127 @@
+/*
+ * FreeRTOS STM32 Reference Integration
+ *
+ * Copyright (c) 2022 Amazon.com, Inc. or its affiliates. All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+/*
+ * Kernel configuration of the host build, see Projects/posix_host/README.md.
+ * Mirrors Common/config/FreeRTOSConfig.h where the POSIX port allows it, so
+ * that the application modules see the same kernel features as on target.
+ */
+
+#ifndef FREERTOS_CONFIG_H
+#define FREERTOS_CONFIG_H
+
+#include <stdint.h>
+#include <stdlib.h>
+
+#include "logging.h"
+
+/* Host stand-in for the CMSIS intrinsics used by the portable modules */
+#include "stm32u5xx.h"
+
+/* Features of the target which have no host equivalent */
+#define MQTT_AGENT_STATS_ENABLED                   0 /* DWT cycle counter */
+#define POWER_STATS_ENABLED                        0
+#define TASK_STATS_LATENCY_ENABLED                 0
+#define PROFILER_ENABLED                           0
+
+/* Each stack word is 8 bytes on a 64 bit host and pthreads want at least 16 KiB */
+#define TASK_STACK_MQTTAGENT                       4096
+#define TASK_STACK_INIT                            4096
+
+#define configUSE_PREEMPTION                       1
+#define configSUPPORT_STATIC_ALLOCATION            1
+#define configSUPPORT_DYNAMIC_ALLOCATION           1
+#define configUSE_IDLE_HOOK                        0
+#define configUSE_TICK_HOOK                        0
+#define configUSE_MALLOC_FAILED_HOOK               1
+#define configCPU_CLOCK_HZ                         ( ( unsigned long ) 1000000000 )
+#define configTICK_RATE_HZ                         ( ( TickType_t ) 1000 )
+#define configMAX_PRIORITIES                       ( 56 )
+#define configMINIMAL_STACK_SIZE                   ( ( uint16_t ) 4096 )
+#define configTOTAL_HEAP_SIZE                      ( ( size_t ) 300 * 1024 ) /* Unused, see heap_host.c */
+#define configMAX_TASK_NAME_LEN                    ( 32 )
+#define configUSE_TRACE_FACILITY                   1
+#define configUSE_16_BIT_TICKS                     0
+#define configUSE_MUTEXES                          1
+#define configQUEUE_REGISTRY_SIZE                  8
+#define configUSE_RECURSIVE_MUTEXES                1
+#define configUSE_COUNTING_SEMAPHORES              1
+#define configENABLE_BACKWARD_COMPATIBILITY        0
+#define configNUM_THREAD_LOCAL_STORAGE_POINTERS    5
+#define configUSE_PORT_OPTIMISED_TASK_SELECTION    0
+#define configCHECK_FOR_STACK_OVERFLOW             0 /* Task stacks are pthread stacks, use valgrind or ASan */
+#define configRECORD_STACK_HIGH_ADDRESS            1
+#define configMESSAGE_BUFFER_LENGTH_TYPE           size_t
+#define configGENERATE_RUN_TIME_STATS              0
+#define configUSE_CO_ROUTINES                      0
+#define configMAX_CO_ROUTINE_PRIORITIES            ( 2 )
+
+#define configUSE_TIMERS                           1
+#define configTIMER_TASK_PRIORITY                  ( 24 )
+#define configTIMER_QUEUE_LENGTH                   10
+#define configTIMER_TASK_STACK_DEPTH               configMINIMAL_STACK_SIZE
+
+/* Same layout as on target, index 8 is reserved for the lwIP mailboxes there */
+#define configTASK_NOTIFICATION_ARRAY_ENTRIES      9
+
+#define INCLUDE_vTaskPrioritySet                   1
+#define INCLUDE_uxTaskPriorityGet                  1
+#define INCLUDE_vTaskDelete                        1
+#define INCLUDE_vTaskCleanUpResources              1
+#define INCLUDE_vTaskSuspend                       1
+#define INCLUDE_vTaskDelayUntil                    1
+#define INCLUDE_xTaskAbortDelay                    1
+#define INCLUDE_vTaskDelay                         1
+#define INCLUDE_xTaskGetSchedulerState             1
+#define INCLUDE_xTaskResumeFromISR                 0
+#define INCLUDE_xTaskGetHandle                     1
+
+#define INCLUDE_xTimerPendFunctionCall             1
+#define INCLUDE_xQueueGetMutexHolder               1
+#define INCLUDE_uxTaskGetStackHighWaterMark        1
+#define INCLUDE_xTaskGetCurrentTaskHandle          1
+#define INCLUDE_eTaskGetState                      1
+
+#define configASSERT( x )                     \
+    do {                                      \
+        if( ( x ) == 0 ) {                    \
+            LogAssert( "Assertion failed." ); \
+            vDyingGasp();                     \
+            abort();                          \
+        }                                     \
+    } while( 0 )
+
+#define configASSERT_CONTINUE( x )                      \
+    do {                                                \
+        if( ( x ) == 0 ) {                              \
+            LogAssert( "Non-fatal assertion failed." ); \
+        }                                               \
+    } while( 0 )
+
+/* TRACE_MARK is used by the MQTT agent, the recorder itself needs the DWT */
+#include "trace_recorder.h"
+
+/* A context switch clears the exclusive monitor, as an exception entry does on target */
+#define traceTASK_SWITCHED_IN()    vHostClearExclusive()
+
+#endif /* FREERTOS_CONFIG_H */
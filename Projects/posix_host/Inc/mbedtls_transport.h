@@ -0,0 +1,125 @@
+/*
+ * FreeRTOS STM32 Reference Integration
+ *
+ * Copyright (c) 2022 Amazon.com, Inc. or its affiliates. All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+/**
+ * @file mbedtls_transport.h
+ * @brief Host replacement of Common/include/mbedtls_transport.h.
+ *
+ * Provides the part of the transport API used by the MQTT agent over a plain
+ * TCP socket, so that the agent can be run against a local broker such as
+ * mosquitto. The credentials passed to mbedtls_transport_configure are ignored.
+ * Status codes keep the values of the target header.
+ */
+
+#ifndef _MBEDTLS_TRANSPORT_H
+#define _MBEDTLS_TRANSPORT_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "FreeRTOS.h"
+#include "transport_interface.h"
+
+#define TLS_KEY_PRV_LABEL         "tls_key_priv"
+#define TLS_KEY_PUB_LABEL         "tls_key_pub"
+#define TLS_CERT_LABEL            "tls_cert"
+#define TLS_ROOT_CA_CERT_LABEL    "root_ca_cert"
+
+typedef enum TlsTransportStatus
+{
+    TLS_TRANSPORT_SUCCESS = 0,
+    TLS_TRANSPORT_UNKNOWN_ERROR = -1,
+    TLS_TRANSPORT_INVALID_PARAMETER = -2,
+    TLS_TRANSPORT_INSUFFICIENT_MEMORY = -3,
+    TLS_TRANSPORT_INVALID_CREDENTIALS = -4,
+    TLS_TRANSPORT_HANDSHAKE_FAILED = -5,
+    TLS_TRANSPORT_INTERNAL_ERROR = -6,
+    TLS_TRANSPORT_CONNECT_FAILURE = -7,
+    TLS_TRANSPORT_PKI_OBJECT_NOT_FOUND = -0x8000011,
+    TLS_TRANSPORT_PKI_OBJECT_PARSE_FAIL = -0x8000012,
+    TLS_TRANSPORT_DNS_FAILED = -10,
+    TLS_TRANSPORT_INSUFFICIENT_SOCKETS = -11,
+    TLS_TRANSPORT_INVALID_HOSTNAME = -12,
+    TLS_TRANSPORT_CLIENT_CERT_INVALID = -13,
+    TLS_TRANSPORT_NO_VALID_CA_CERT = -14,
+    TLS_TRANSPORT_CLIENT_KEY_INVALID = -15,
+} TlsTransportStatus_t;
+
+typedef void ( * GenericCallback_t )( void * );
+
+/* Credentials are not used by the socket transport, only the label is kept */
+typedef struct PkiObject
+{
+    const char * pcLabel;
+} PkiObject_t;
+
+PkiObject_t xPkiObjectFromLabel( const char * pcLabel );
+
+NetworkContext_t * mbedtls_transport_allocate( void );
+
+void mbedtls_transport_free( NetworkContext_t * pxNetworkContext );
+
+TlsTransportStatus_t mbedtls_transport_configure( NetworkContext_t * pxNetworkContext,
+                                                  const char ** ppcAlpnProtos,
+                                                  const PkiObject_t * pxPrivateKey,
+                                                  const PkiObject_t * pxClientCert,
+                                                  const PkiObject_t * pxRootCaCerts,
+                                                  const size_t uxNumRootCA );
+
+/**
+ * @brief Make pending and later receives fail, without closing the socket.
+ */
+void mbedtls_transport_abort( NetworkContext_t * pxNetworkContext );
+
+/**
+ * @brief Call pxCallback from the socket poll task whenever data can be read.
+ */
+int32_t mbedtls_transport_setrecvcallback( NetworkContext_t * pxNetworkContext,
+                                           GenericCallback_t pxCallback,
+                                           void * pvCtx );
+
+TlsTransportStatus_t mbedtls_transport_connect( NetworkContext_t * pxNetworkContext,
+                                                const char * pcHostName,
+                                                uint16_t usPort,
+                                                uint32_t ulRecvTimeoutMs,
+                                                uint32_t ulSendTimeoutMs );
+
+void mbedtls_transport_disconnect( NetworkContext_t * pxNetworkContext );
+
+/**
+ * @brief Non blocking receive.
+ * @return Bytes read, 0 if no data is available, or a negative value once the connection failed.
+ */
+int32_t mbedtls_transport_recv( NetworkContext_t * pxNetworkContext,
+                                void * pBuffer,
+                                size_t bytesToRecv );
+
+int32_t mbedtls_transport_send( NetworkContext_t * pxNetworkContext,
+                                const void * pBuffer,
+                                size_t uxBytesToSend );
+
+int32_t mbedtls_transport_writev( NetworkContext_t * pxNetworkContext,
+                                  TransportOutVector_t * pxIoVec,
+                                  size_t uxIoVecCount );
+
+#endif /* _MBEDTLS_TRANSPORT_H */
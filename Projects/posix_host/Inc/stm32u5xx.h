@@ -0,0 +1,90 @@
+/*
+ * FreeRTOS STM32 Reference Integration
+ *
+ * Copyright (c) 2022 Amazon.com, Inc. or its affiliates. All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+/**
+ * @file stm32u5xx.h
+ * @brief Host stand-in for the CMSIS definitions used by the portable modules.
+ *
+ * Only the exclusive access and barrier intrinsics are provided, for the
+ * lock-free command pool. The reservation is dropped whenever another task is switched in, which
+ * is what an exception entry does to the monitor on target, and the store is
+ * made with the tick signal blocked so that the check and the write cannot be
+ * separated by a context switch.
+ */
+
+#ifndef HOST_STM32U5XX_H
+#define HOST_STM32U5XX_H
+
+#include <signal.h>
+#include <stdint.h>
+#include <pthread.h>
+
+/* Address reserved by the last __LDREXW, 0 when the monitor is open */
+extern volatile uintptr_t uxHostExclusiveAddr;
+
+static inline void vHostClearExclusive( void )
+{
+    uxHostExclusiveAddr = 0;
+}
+
+static inline uint32_t __LDREXW( volatile uint32_t * pulAddr )
+{
+    uxHostExclusiveAddr = ( uintptr_t ) pulAddr;
+
+    return *pulAddr;
+}
+
+static inline uint32_t __STREXW( uint32_t ulValue,
+                                 volatile uint32_t * pulAddr )
+{
+    uint32_t ulFailed = 1;
+    sigset_t xAll;
+    sigset_t xPrevious;
+
+    ( void ) sigfillset( &xAll );
+    ( void ) pthread_sigmask( SIG_BLOCK, &xAll, &xPrevious );
+
+    if( uxHostExclusiveAddr == ( uintptr_t ) pulAddr )
+    {
+        *pulAddr = ulValue;
+        ulFailed = 0;
+    }
+
+    uxHostExclusiveAddr = 0;
+
+    ( void ) pthread_sigmask( SIG_SETMASK, &xPrevious, NULL );
+
+    return ulFailed;
+}
+
+static inline void __CLREX( void )
+{
+    vHostClearExclusive();
+}
+
+static inline void __DMB( void )
+{
+    __atomic_thread_fence( __ATOMIC_SEQ_CST );
+}
+
+#endif /* HOST_STM32U5XX_H */
@@ -0,0 +1,567 @@
+/*
+ * FreeRTOS STM32 Reference Integration
+ *
+ * Copyright (c) 2022 Amazon.com, Inc. or its affiliates. All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+/**
+ * @file bench.c
+ * @brief Benchmarks of the application layer run by the host build.
+ *
+ * Each measurement is written to stdout as "PERF,<test>,<value>,0,<unit>",
+ * the format of the on-target performance tests, with no budget. The numbers
+ * are host numbers: they rank alternatives and catch regressions in the
+ * algorithms, they do not predict the time taken on the Cortex-M33.
+ */
+
+#include "logging_levels.h"
+
+#define LOG_LEVEL     LOG_INFO
+#define LOG_MODULE    LOG_MODULE_APP
+
+#include "logging.h"
+
+/* Standard includes. */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "FreeRTOS.h"
+#include "task.h"
+
+#include "core_mqtt.h"
+#include "kvstore.h"
+#include "mqtt_agent_task.h"
+#include "mqtt_publish_async.h"
+#include "shadow_json.h"
+#include "static_alloc.h"
+#include "subscription_manager.h"
+#include "topic_trie.h"
+
+#include "bench.h"
+
+/* Topic filters registered for the dispatch suite, the same number of subscriptions as a busy device */
+#define BENCH_DISPATCH_FILTERS    32
+
+/* Publishes sent one at a time to measure the round trip through the broker */
+#define BENCH_MQTT_PINGS          200
+
+/* Time allowed for a publish to come back from the broker */
+#define BENCH_MQTT_TIMEOUT_MS     5000
+
+/* Same index as the other helpers waiting in an application task */
+#define BENCH_NOTIFY_IDX          2
+
+/*-----------------------------------------------------------*/
+
+static uint64_t prvNowNs( void )
+{
+    struct timespec xNow = { 0 };
+
+    ( void ) clock_gettime( CLOCK_MONOTONIC, &xNow );
+
+    return ( ( uint64_t ) xNow.tv_sec * 1000000000U ) + ( uint64_t ) xNow.tv_nsec;
+}
+
+/*-----------------------------------------------------------*/
+
+static void prvReport( const char * pcTest,
+                       uint64_t ullValue,
+                       const char * pcUnit )
+{
+    ( void ) printf( "PERF,%s,%lu,0,%s\n", pcTest, ( unsigned long ) ullValue, pcUnit );
+}
+
+/*-----------------------------------------------------------*/
+
+uint32_t ulBenchParseSuites( const char * pcSuites )
+{
+    static const struct
+    {
+        const char * pcName;
+        uint32_t ulMask;
+    } xSuites[] =
+    {
+        { "dispatch", BENCH_SUITE_DISPATCH },
+        { "kvstore",  BENCH_SUITE_KVSTORE  },
+        { "json",     BENCH_SUITE_JSON     },
+        { "mqtt",     BENCH_SUITE_MQTT     },
+        { "all",      BENCH_SUITE_ALL      },
+    };
+    uint32_t ulMask = 0;
+    BaseType_t xValid = pdTRUE;
+
+    while( ( xValid == pdTRUE ) && ( *pcSuites != '\0' ) )
+    {
+        size_t uxLen = strcspn( pcSuites, "," );
+
+        xValid = pdFALSE;
+
+        for( size_t i = 0; i < ( sizeof( xSuites ) / sizeof( xSuites[ 0 ] ) ); i++ )
+        {
+            if( ( strlen( xSuites[ i ].pcName ) == uxLen ) &&
+                ( strncmp( xSuites[ i ].pcName, pcSuites, uxLen ) == 0 ) )
+            {
+                ulMask |= xSuites[ i ].ulMask;
+                xValid = pdTRUE;
+            }
+        }
+
+        pcSuites += ( pcSuites[ uxLen ] == ',' ) ? uxLen + 1 : uxLen;
+    }
+
+    return ( xValid == pdTRUE ) ? ulMask : 0;
+}
+
+/*------------------------- dispatch ------------------------*/
+
+static void prvCountMatch( void * pvValue,
+                           void * pvCtx )
+{
+    ( void ) pvValue;
+    ( *( size_t * ) pvCtx )++;
+}
+
+/*-----------------------------------------------------------*/
+
+/* Topic trie of mqtt_agent_task.c against the linear MQTT_MatchTopic scan it replaced */
+static BaseType_t prvBenchDispatch( uint32_t ulIterations )
+{
+    static char cFilters[ BENCH_DISPATCH_FILTERS ][ 48 ];
+    static const char * const pcTopics[] =
+    {
+        "$aws/things/bench/shadow/update/delta",
+        "$aws/things/bench/jobs/notify-next",
+        "bench/sensor/16/env",
+        "unsubscribed/topic/name",
+    };
+    const size_t uxNumTopics = sizeof( pcTopics ) / sizeof( pcTopics[ 0 ] );
+    TopicTrieNode_t * pxRoot = NULL;
+    BaseType_t xSuccess = pdTRUE;
+    size_t uxTrieMatches = 0;
+    size_t uxLinearMatches = 0;
+    uint64_t ullStart;
+    uint64_t ullTrieNs;
+    uint64_t ullLinearNs;
+
+    for( size_t i = 0; ( i < BENCH_DISPATCH_FILTERS ) && ( xSuccess == pdTRUE ); i++ )
+    {
+        switch( i % 4 )
+        {
+            case 0:
+                ( void ) snprintf( cFilters[ i ], sizeof( cFilters[ i ] ), "bench/sensor/%u/env", ( unsigned int ) i );
+                break;
+
+            case 1:
+                ( void ) snprintf( cFilters[ i ], sizeof( cFilters[ i ] ), "bench/sensor/+/cmd%u", ( unsigned int ) i );
+                break;
+
+            case 2:
+                ( void ) snprintf( cFilters[ i ], sizeof( cFilters[ i ] ), "$aws/things/bench/shadow/%u/#", ( unsigned int ) i );
+                break;
+
+            default:
+                ( void ) snprintf( cFilters[ i ], sizeof( cFilters[ i ] ), "$aws/things/bench/jobs/%u", ( unsigned int ) i );
+                break;
+        }
+
+        xSuccess = xTopicTrieInsert( &pxRoot, cFilters[ i ], ( uint16_t ) strlen( cFilters[ i ] ), cFilters[ i ] );
+    }
+
+    /* Subscriptions that match the topics above */
+    if( xSuccess == pdTRUE )
+    {
+        xSuccess = xTopicTrieInsert( &pxRoot, "$aws/things/bench/shadow/update/#", 33, NULL );
+    }
+
+    if( xSuccess == pdTRUE )
+    {
+        xSuccess = xTopicTrieInsert( &pxRoot, "$aws/things/bench/jobs/+", 24, NULL );
+    }
+
+    if( xSuccess == pdTRUE )
+    {
+        ullStart = prvNowNs();
+
+        for( uint32_t ulIter = 0; ulIter < ulIterations; ulIter++ )
+        {
+            const char * pcTopic = pcTopics[ ulIter % uxNumTopics ];
+
+            ( void ) uxTopicTrieMatch( pxRoot, pcTopic, ( uint16_t ) strlen( pcTopic ), prvCountMatch, &uxTrieMatches );
+        }
+
+        ullTrieNs = prvNowNs() - ullStart;
+        ullStart = prvNowNs();
+
+        for( uint32_t ulIter = 0; ulIter < ulIterations; ulIter++ )
+        {
+            const char * pcTopic = pcTopics[ ulIter % uxNumTopics ];
+            const char * pcExtra[] = { "$aws/things/bench/shadow/update/#", "$aws/things/bench/jobs/+" };
+
+            for( size_t i = 0; i < ( BENCH_DISPATCH_FILTERS + 2 ); i++ )
+            {
+                const char * pcFilter = ( i < BENCH_DISPATCH_FILTERS ) ? cFilters[ i ] : pcExtra[ i - BENCH_DISPATCH_FILTERS ];
+                bool xMatch = false;
+
+                if( ( MQTT_MatchTopic( pcTopic, ( uint16_t ) strlen( pcTopic ),
+                                       pcFilter, ( uint16_t ) strlen( pcFilter ), &xMatch ) == MQTTSuccess ) &&
+                    ( xMatch == true ) )
+                {
+                    uxLinearMatches++;
+                }
+            }
+        }
+
+        ullLinearNs = prvNowNs() - ullStart;
+
+        if( uxTrieMatches != uxLinearMatches )
+        {
+            LogError( "The trie found %lu matches, the linear scan %lu.",
+                      ( unsigned long ) uxTrieMatches, ( unsigned long ) uxLinearMatches );
+            xSuccess = pdFALSE;
+        }
+
+        prvReport( "host.dispatch_trie", ullTrieNs / ulIterations, "ns" );
+        prvReport( "host.dispatch_linear", ullLinearNs / ulIterations, "ns" );
+    }
+
+    vTopicTrieFree( pxRoot );
+
+    return xSuccess;
+}
+
+/*-------------------------- kvstore ------------------------*/
+
+static BaseType_t prvBenchKvstore( uint32_t ulIterations )
+{
+    BaseType_t xSuccess = pdTRUE;
+    char cThingName[ 64 ];
+    uint64_t ullStart;
+
+    ullStart = prvNowNs();
+
+    for( uint32_t ulIter = 0; ulIter < ulIterations; ulIter++ )
+    {
+        ( void ) KVStore_getString( CS_CORE_THING_NAME, cThingName, sizeof( cThingName ) );
+    }
+
+    prvReport( "host.kvstore_get_string", ( prvNowNs() - ullStart ) / ulIterations, "ns" );
+
+    {
+        uint32_t ulPort = 0;
+        KVStoreItem_t xItems[] =
+        {
+            KV_ITEM( CS_CORE_THING_NAME,    cThingName ),
+            KV_ITEM( CS_CORE_MQTT_PORT,     ulPort     ),
+        };
+
+        ullStart = prvNowNs();
+
+        for( uint32_t ulIter = 0; ulIter < ulIterations; ulIter++ )
+        {
+            ( void ) KVStore_xGetItems( xItems, sizeof( xItems ) / sizeof( xItems[ 0 ] ) );
+        }
+
+        prvReport( "host.kvstore_get_items", ( prvNowNs() - ullStart ) / ulIterations, "ns" );
+    }
+
+    ullStart = prvNowNs();
+
+    for( uint32_t ulIter = 0; ( ulIter < ulIterations ) && ( xSuccess == pdTRUE ); ulIter++ )
+    {
+        xSuccess = KVStore_setUInt32( CS_CORE_MQTT_PORT, 1883 + ( ulIter & 1 ) );
+    }
+
+    prvReport( "host.kvstore_set_uint32", ( prvNowNs() - ullStart ) / ulIterations, "ns" );
+
+    /* Each commit writes the file of the changed key to the littlefs image */
+    if( xSuccess == pdTRUE )
+    {
+        const uint32_t ulCommits = ( ulIterations < 100 ) ? ulIterations : 100;
+
+        ullStart = prvNowNs();
+
+        for( uint32_t ulIter = 0; ( ulIter < ulCommits ) && ( xSuccess == pdTRUE ); ulIter++ )
+        {
+            xSuccess = KVStore_setUInt32( CS_CORE_MQTT_PORT, 1883 + ( ulIter & 1 ) );
+
+            if( xSuccess == pdTRUE )
+            {
+                xSuccess = KVStore_xCommitChanges();
+            }
+        }
+
+        prvReport( "host.kvstore_commit", ( prvNowNs() - ullStart ) / ( ulCommits * 1000U ), "us" );
+    }
+
+    if( xSuccess == pdFALSE )
+    {
+        LogError( "Failed to write to the kvstore." );
+    }
+
+    return xSuccess;
+}
+
+/*--------------------------- json --------------------------*/
+
+static BaseType_t prvBenchJson( uint32_t ulIterations )
+{
+    static const char cDelta[] =
+        "{\"version\":412,\"timestamp\":1700000000,\"state\":{\"powerOn\":1,"
+        "\"telemetryPeriodMs\":5000,\"ledMode\":\"blink\",\"thresholds\":{\"tempC\":40,\"humidity\":80}},"
+        "\"metadata\":{\"powerOn\":{\"timestamp\":1700000000},\"telemetryPeriodMs\":{\"timestamp\":1700000000}},"
+        "\"clientToken\":\"1234\"}";
+    ShadowJsonField_t xFields[] =
+    {
+        { .pcPath = "version"                  },
+        { .pcPath = "state.powerOn"            },
+        { .pcPath = "state.telemetryPeriodMs"  },
+        { .pcPath = "state.thresholds.tempC"   },
+    };
+    const size_t uxNumFields = sizeof( xFields ) / sizeof( xFields[ 0 ] );
+    BaseType_t xSuccess = pdTRUE;
+    char cReport[ 256 ];
+    uint64_t ullStart;
+
+    ullStart = prvNowNs();
+
+    for( uint32_t ulIter = 0; ( ulIter < ulIterations ) && ( xSuccess == pdTRUE ); ulIter++ )
+    {
+        if( ( xShadowJsonExtract( cDelta, sizeof( cDelta ) - 1, xFields, uxNumFields ) != JSONSuccess ) ||
+            ( xFields[ uxNumFields - 1 ].pcValue == NULL ) )
+        {
+            xSuccess = pdFALSE;
+        }
+    }
+
+    prvReport( "host.json_extract", ( prvNowNs() - ullStart ) / ulIterations, "ns" );
+
+    ullStart = prvNowNs();
+
+    for( uint32_t ulIter = 0; ( ulIter < ulIterations ) && ( xSuccess == pdTRUE ); ulIter++ )
+    {
+        ShadowReportBuilder_t xBuilder;
+
+        vShadowReportBegin( &xBuilder, cReport, sizeof( cReport ) );
+        vShadowReportAddUInt( &xBuilder, "powerOn", 1 );
+        vShadowReportAddUInt( &xBuilder, "telemetryPeriodMs", 5000 );
+        vShadowReportAddUInt( &xBuilder, "uptimeS", ulIter );
+        vShadowReportAddUInt( &xBuilder, "freeHeap", 123456 );
+
+        if( uxShadowReportEnd( &xBuilder, ulIter ) == 0 )
+        {
+            xSuccess = pdFALSE;
+        }
+    }
+
+    prvReport( "host.json_report", ( prvNowNs() - ullStart ) / ulIterations, "ns" );
+
+    if( xSuccess == pdFALSE )
+    {
+        LogError( "Failed to parse or build a shadow document." );
+    }
+
+    return xSuccess;
+}
+
+/*--------------------------- mqtt --------------------------*/
+
+typedef struct BenchMqttCtx
+{
+    TaskHandle_t xWaitingTask;
+    uint32_t ulReceived;
+    uint32_t ulLatencyCount;
+    uint32_t pulLatencyUs[ BENCH_MQTT_PINGS ];
+} BenchMqttCtx_t;
+
+/*-----------------------------------------------------------*/
+
+/* Runs in the MQTT agent task, the payload is the time the publish was queued */
+static void prvLoopbackCallback( void * pvCtx,
+                                 MQTTPublishInfo_t * pxPublishInfo )
+{
+    BenchMqttCtx_t * pxCtx = ( BenchMqttCtx_t * ) pvCtx;
+    uint64_t ullSentNs = 0;
+
+    if( pxPublishInfo->payloadLength == sizeof( ullSentNs ) )
+    {
+        ( void ) memcpy( &ullSentNs, pxPublishInfo->pPayload, sizeof( ullSentNs ) );
+
+        if( pxCtx->ulLatencyCount < BENCH_MQTT_PINGS )
+        {
+            pxCtx->pulLatencyUs[ pxCtx->ulLatencyCount ] = ( uint32_t ) ( ( prvNowNs() - ullSentNs ) / 1000U );
+            pxCtx->ulLatencyCount++;
+        }
+    }
+
+    pxCtx->ulReceived++;
+    ( void ) xTaskNotifyGiveIndexed( pxCtx->xWaitingTask, BENCH_NOTIFY_IDX );
+}
+
+/*-----------------------------------------------------------*/
+
+static int prvCompareU32( const void * pvA,
+                          const void * pvB )
+{
+    uint32_t ulA = *( const uint32_t * ) pvA;
+    uint32_t ulB = *( const uint32_t * ) pvB;
+
+    return ( ulA > ulB ) - ( ulA < ulB );
+}
+
+/*-----------------------------------------------------------*/
+
+static BaseType_t prvPublishNow( MQTTAgentHandle_t xHandle,
+                                 const char * pcTopic )
+{
+    uint64_t ullNowNs = prvNowNs();
+
+    return ( MqttAgent_PublishQoS0( xHandle, pcTopic, &ullNowNs, sizeof( ullNowNs ),
+                                    BENCH_MQTT_TIMEOUT_MS ) == MQTTSuccess ) ? pdTRUE : pdFALSE;
+}
+
+/*-----------------------------------------------------------*/
+
+/* QoS0 loopback through the broker: round trip latency, then the rate of a burst */
+static BaseType_t prvBenchMqtt( const BenchConfig_t * pxConfig )
+{
+    static BenchMqttCtx_t xCtx = { 0 };
+    static char cTopic[ 96 ];
+    char cThingName[ 64 ] = { 0 };
+    MQTTAgentHandle_t xHandle = NULL;
+    BaseType_t xSuccess;
+    uint64_t ullStart;
+
+    xSuccess = KVStore_setString( CS_CORE_MQTT_ENDPOINT, pxConfig->pcBrokerHost );
+
+    if( xSuccess == pdTRUE )
+    {
+        xSuccess = KVStore_setUInt32( CS_CORE_MQTT_PORT, pxConfig->usBrokerPort );
+    }
+
+    if( xSuccess == pdTRUE )
+    {
+        xSuccess = xTaskCreateStaticStack( vMQTTAgentTask, "MQTTAgent", TASK_STACK_MQTTAGENT, NULL, 10, NULL );
+    }
+
+    if( xSuccess == pdTRUE )
+    {
+        vSleepUntilMQTTAgentConnected();
+        xHandle = xGetMqttAgentHandle();
+
+        ( void ) KVStore_getString( CS_CORE_THING_NAME, cThingName, sizeof( cThingName ) );
+        ( void ) snprintf( cTopic, sizeof( cTopic ), "bench/%s/loopback", cThingName );
+
+        xCtx.xWaitingTask = xTaskGetCurrentTaskHandle();
+
+        xSuccess = ( MqttAgent_SubscribeSync( xHandle, cTopic, MQTTQoS0, prvLoopbackCallback, &xCtx ) == MQTTSuccess ) ? pdTRUE : pdFALSE;
+    }
+
+    for( uint32_t ulPing = 0; ( ulPing < BENCH_MQTT_PINGS ) && ( xSuccess == pdTRUE ); ulPing++ )
+    {
+        xSuccess = prvPublishNow( xHandle, cTopic );
+
+        if( ( xSuccess == pdTRUE ) &&
+            ( ulTaskNotifyTakeIndexed( BENCH_NOTIFY_IDX, pdTRUE, pdMS_TO_TICKS( BENCH_MQTT_TIMEOUT_MS ) ) == 0 ) )
+        {
+            LogError( "No loopback publish within %u ms.", BENCH_MQTT_TIMEOUT_MS );
+            xSuccess = pdFALSE;
+        }
+    }
+
+    if( xSuccess == pdTRUE )
+    {
+        qsort( xCtx.pulLatencyUs, xCtx.ulLatencyCount, sizeof( uint32_t ), prvCompareU32 );
+
+        prvReport( "host.mqtt_rtt_p50", xCtx.pulLatencyUs[ xCtx.ulLatencyCount / 2 ], "us" );
+        prvReport( "host.mqtt_rtt_p99", xCtx.pulLatencyUs[ ( xCtx.ulLatencyCount * 99 ) / 100 ], "us" );
+        prvReport( "host.mqtt_rtt_max", xCtx.pulLatencyUs[ xCtx.ulLatencyCount - 1 ], "us" );
+
+        /* The burst is bounded by the publish pool and the agent queue, as on target */
+        xCtx.ulReceived = 0;
+        ullStart = prvNowNs();
+
+        for( uint32_t ulIter = 0; ( ulIter < pxConfig->ulIterations ) && ( xSuccess == pdTRUE ); ulIter++ )
+        {
+            xSuccess = prvPublishNow( xHandle, cTopic );
+        }
+
+        while( ( xSuccess == pdTRUE ) &&
+               ( xCtx.ulReceived < pxConfig->ulIterations ) )
+        {
+            if( ulTaskNotifyTakeIndexed( BENCH_NOTIFY_IDX, pdTRUE, pdMS_TO_TICKS( BENCH_MQTT_TIMEOUT_MS ) ) == 0 )
+            {
+                LogError( "Received %lu of %lu publishes.",
+                          ( unsigned long ) xCtx.ulReceived, ( unsigned long ) pxConfig->ulIterations );
+                xSuccess = pdFALSE;
+            }
+        }
+
+        if( xSuccess == pdTRUE )
+        {
+            uint64_t ullElapsedNs = prvNowNs() - ullStart;
+
+            prvReport( "host.mqtt_loopback_rate",
+                       ( ( uint64_t ) pxConfig->ulIterations * 1000000000U ) / ( ullElapsedNs + 1U ), "msg/s" );
+        }
+    }
+
+    return xSuccess;
+}
+
+/*-----------------------------------------------------------*/
+
+BaseType_t xBenchRun( const BenchConfig_t * pxConfig )
+{
+    BaseType_t xSuccess = pdTRUE;
+
+    configASSERT( pxConfig != NULL );
+    configASSERT( pxConfig->ulIterations > 0 );
+
+    if( ( pxConfig->ulSuites & BENCH_SUITE_DISPATCH ) != 0 )
+    {
+        xSuccess &= prvBenchDispatch( pxConfig->ulIterations );
+    }
+
+    if( ( pxConfig->ulSuites & BENCH_SUITE_KVSTORE ) != 0 )
+    {
+        xSuccess &= prvBenchKvstore( pxConfig->ulIterations );
+    }
+
+    if( ( pxConfig->ulSuites & BENCH_SUITE_JSON ) != 0 )
+    {
+        xSuccess &= prvBenchJson( pxConfig->ulIterations );
+    }
+
+    if( ( pxConfig->ulSuites & BENCH_SUITE_MQTT ) != 0 )
+    {
+        if( pxConfig->pcBrokerHost != NULL )
+        {
+            xSuccess &= prvBenchMqtt( pxConfig );
+        }
+        else
+        {
+            LogInfo( "No broker given, skipping the mqtt suite." );
+        }
+    }
+
+    return xSuccess;
+}
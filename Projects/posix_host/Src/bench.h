@@ -0,0 +1,64 @@
+/*
+ * FreeRTOS STM32 Reference Integration
+ *
+ * Copyright (c) 2022 Amazon.com, Inc. or its affiliates. All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+/**
+ * @file bench.h
+ * @brief Benchmarks of the application layer run by the host build.
+ */
+
+#ifndef HOST_BENCH_H
+#define HOST_BENCH_H
+
+#include <stdint.h>
+
+#include "FreeRTOS.h"
+
+#define BENCH_SUITE_DISPATCH    ( 1UL << 0 )
+#define BENCH_SUITE_KVSTORE     ( 1UL << 1 )
+#define BENCH_SUITE_JSON        ( 1UL << 2 )
+#define BENCH_SUITE_MQTT        ( 1UL << 3 ) /* Only run with a broker */
+#define BENCH_SUITE_ALL         ( 0xFUL )
+
+typedef struct BenchConfig
+{
+    const char * pcBrokerHost; /* NULL to skip the mqtt suite */
+    uint16_t usBrokerPort;
+    uint32_t ulIterations;
+    uint32_t ulSuites;
+} BenchConfig_t;
+
+/**
+ * @brief Parse a comma separated list of suite names.
+ *
+ * @return The BENCH_SUITE_* mask, 0 if a name is unknown.
+ */
+uint32_t ulBenchParseSuites( const char * pcSuites );
+
+/**
+ * @brief Run the selected suites, writing one PERF line per measurement to stdout.
+ *
+ * @return pdTRUE if every suite completed.
+ */
+BaseType_t xBenchRun( const BenchConfig_t * pxConfig );
+
+#endif /* HOST_BENCH_H */
@@ -0,0 +1,65 @@
+/*
+ * FreeRTOS STM32 Reference Integration
+ *
+ * Copyright (c) 2022 Amazon.com, Inc. or its affiliates. All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+/**
+ * @file lfs_port.h
+ * @brief littlefs on a regular file, standing in for the OSPI partition in the host build.
+ */
+
+#ifndef FS_LFS_PORT_H_
+#define FS_LFS_PORT_H_
+
+#include "FreeRTOS.h"
+
+#include "lfs.h"
+#include "lfs_util.h"
+
+/* Same geometry as the OSPI partition */
+#ifndef LFS_PORT_FILE_BLOCK_SIZE
+#define LFS_PORT_FILE_BLOCK_SIZE      4096
+#endif
+
+#ifndef LFS_PORT_FILE_BLOCK_COUNT
+#define LFS_PORT_FILE_BLOCK_COUNT     1024
+#endif
+
+#ifndef LFS_PORT_FILE_CACHE_SIZE
+#define LFS_PORT_FILE_CACHE_SIZE      4096
+#endif
+
+#ifndef LFS_PORT_FILE_BLOCK_CYCLES
+#define LFS_PORT_FILE_BLOCK_CYCLES    500
+#endif
+
+/**
+ * @brief Open or create the image file at pcPath and return a littlefs configuration for it.
+ *
+ * @return NULL if the file could not be opened or resized.
+ */
+const struct lfs_config * pxInitializeFileFs( const char * pcPath,
+                                              TickType_t xBlockTime );
+
+/* Provided outside of the lfs port */
+lfs_t * pxGetDefaultFsCtx( void );
+
+#endif /* FS_LFS_PORT_H_ */
@@ -0,0 +1,246 @@
+/*
+ * FreeRTOS STM32 Reference Integration
+ *
+ * Copyright (c) 2022 Amazon.com, Inc. or its affiliates. All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+/**
+ * @file lfs_port_file.c
+ * @brief littlefs block device backed by an image file.
+ *
+ * Erased blocks read back as 0xFF, as on NOR flash, so an image survives
+ * between runs and the kvstore keeps its contents like on the target.
+ */
+
+#include "logging_levels.h"
+
+#define LOG_LEVEL     LOG_INFO
+#define LOG_MODULE    LOG_MODULE_FS
+
+#include "logging.h"
+
+/* Standard includes. */
+#include <errno.h>
+#include <fcntl.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "FreeRTOS.h"
+#include "semphr.h"
+
+#include "fs/lfs_port.h"
+
+struct LfsPortCtx
+{
+    SemaphoreHandle_t xMutex;
+    TickType_t xBlockTime;
+    int lFd;
+};
+
+static struct LfsPortCtx xFileCtx = { .lFd = -1 };
+static struct lfs_config xFileCfg = { 0 };
+
+static uint8_t ucEraseBuffer[ LFS_PORT_FILE_BLOCK_SIZE ];
+
+/*-----------------------------------------------------------*/
+
+static int lfs_port_lock( const struct lfs_config * c )
+{
+    struct LfsPortCtx * pxCtx = ( struct LfsPortCtx * ) c->context;
+    BaseType_t xReturnVal;
+
+    xReturnVal = xSemaphoreTake( pxCtx->xMutex, pxCtx->xBlockTime );
+
+    return ( int ) ( xReturnVal == pdTRUE ? 0 : -1 );
+}
+
+/*-----------------------------------------------------------*/
+
+static int lfs_port_unlock( const struct lfs_config * c )
+{
+    struct LfsPortCtx * pxCtx = ( struct LfsPortCtx * ) c->context;
+    BaseType_t xReturnVal;
+
+    xReturnVal = xSemaphoreGive( pxCtx->xMutex );
+
+    return ( int ) ( xReturnVal == pdTRUE ? 0 : -1 );
+}
+
+/*-----------------------------------------------------------*/
+
+/* pread and pwrite are restarted when interrupted by the tick signal of the POSIX port */
+static int prvFileIo( int lFd,
+                      void * pvBuffer,
+                      size_t uxSize,
+                      off_t xOffset,
+                      BaseType_t xWrite )
+{
+    int lError = LFS_ERR_OK;
+    size_t uxDone = 0;
+
+    while( ( uxDone < uxSize ) && ( lError == LFS_ERR_OK ) )
+    {
+        ssize_t xResult;
+
+        if( xWrite == pdTRUE )
+        {
+            xResult = pwrite( lFd, ( uint8_t * ) pvBuffer + uxDone, uxSize - uxDone, xOffset + uxDone );
+        }
+        else
+        {
+            xResult = pread( lFd, ( uint8_t * ) pvBuffer + uxDone, uxSize - uxDone, xOffset + uxDone );
+        }
+
+        if( xResult > 0 )
+        {
+            uxDone += ( size_t ) xResult;
+        }
+        else if( ( xResult < 0 ) && ( errno == EINTR ) )
+        {
+            /* Retry */
+        }
+        else
+        {
+            LogError( "File I/O error at offset %ld: %d.", ( long ) ( xOffset + uxDone ), errno );
+            lError = LFS_ERR_IO;
+        }
+    }
+
+    return lError;
+}
+
+/*-----------------------------------------------------------*/
+
+static int lfs_port_file_read( const struct lfs_config * c,
+                               lfs_block_t block,
+                               lfs_off_t off,
+                               void * buffer,
+                               lfs_size_t size )
+{
+    struct LfsPortCtx * pxCtx = ( struct LfsPortCtx * ) c->context;
+
+    return prvFileIo( pxCtx->lFd, buffer, size, ( off_t ) block * c->block_size + off, pdFALSE );
+}
+
+/*-----------------------------------------------------------*/
+
+static int lfs_port_file_prog( const struct lfs_config * c,
+                               lfs_block_t block,
+                               lfs_off_t off,
+                               const void * buffer,
+                               lfs_size_t size )
+{
+    struct LfsPortCtx * pxCtx = ( struct LfsPortCtx * ) c->context;
+
+    return prvFileIo( pxCtx->lFd, ( void * ) buffer, size, ( off_t ) block * c->block_size + off, pdTRUE );
+}
+
+/*-----------------------------------------------------------*/
+
+static int lfs_port_file_erase( const struct lfs_config * c,
+                                lfs_block_t block )
+{
+    struct LfsPortCtx * pxCtx = ( struct LfsPortCtx * ) c->context;
+
+    return prvFileIo( pxCtx->lFd, ucEraseBuffer, c->block_size, ( off_t ) block * c->block_size, pdTRUE );
+}
+
+/*-----------------------------------------------------------*/
+
+static int lfs_port_file_sync( const struct lfs_config * c )
+{
+    ( void ) c;
+
+    /* Nothing to flush, the image does not need to survive a host crash */
+    return LFS_ERR_OK;
+}
+
+/*-----------------------------------------------------------*/
+
+const struct lfs_config * pxInitializeFileFs( const char * pcPath,
+                                              TickType_t xBlockTime )
+{
+    const struct lfs_config * pxCfg = NULL;
+    const off_t xImageLen = ( off_t ) LFS_PORT_FILE_BLOCK_SIZE * LFS_PORT_FILE_BLOCK_COUNT;
+    struct stat xStat = { 0 };
+
+    configASSERT( pcPath != NULL );
+    configASSERT( xFileCtx.lFd < 0 );
+
+    ( void ) memset( ucEraseBuffer, 0xFF, sizeof( ucEraseBuffer ) );
+
+    xFileCtx.xBlockTime = xBlockTime;
+    xFileCtx.xMutex = xSemaphoreCreateMutex();
+    xFileCtx.lFd = open( pcPath, O_RDWR | O_CREAT, 0644 );
+
+    if( ( xFileCtx.xMutex == NULL ) ||
+        ( xFileCtx.lFd < 0 ) ||
+        ( fstat( xFileCtx.lFd, &xStat ) != 0 ) )
+    {
+        LogError( "Failed to open the filesystem image %s.", pcPath );
+    }
+    else if( xStat.st_size != xImageLen )
+    {
+        /* A new or resized image starts fully erased */
+        BaseType_t xSuccess = ( ftruncate( xFileCtx.lFd, 0 ) == 0 ) ? pdTRUE : pdFALSE;
+
+        for( lfs_block_t xBlock = 0; ( xBlock < LFS_PORT_FILE_BLOCK_COUNT ) && ( xSuccess == pdTRUE ); xBlock++ )
+        {
+            xSuccess = ( prvFileIo( xFileCtx.lFd, ucEraseBuffer, LFS_PORT_FILE_BLOCK_SIZE,
+                                    ( off_t ) xBlock * LFS_PORT_FILE_BLOCK_SIZE, pdTRUE ) == LFS_ERR_OK ) ? pdTRUE : pdFALSE;
+        }
+
+        if( xSuccess == pdTRUE )
+        {
+            LogInfo( "Created an erased filesystem image %s.", pcPath );
+            pxCfg = &xFileCfg;
+        }
+    }
+    else
+    {
+        pxCfg = &xFileCfg;
+    }
+
+    if( pxCfg != NULL )
+    {
+        xFileCfg.context = &xFileCtx;
+        xFileCfg.read = lfs_port_file_read;
+        xFileCfg.prog = lfs_port_file_prog;
+        xFileCfg.erase = lfs_port_file_erase;
+        xFileCfg.sync = lfs_port_file_sync;
+        xFileCfg.lock = lfs_port_lock;
+        xFileCfg.unlock = lfs_port_unlock;
+        xFileCfg.read_size = 1;
+        xFileCfg.prog_size = 1;
+        xFileCfg.block_size = LFS_PORT_FILE_BLOCK_SIZE;
+        xFileCfg.block_count = LFS_PORT_FILE_BLOCK_COUNT;
+        xFileCfg.block_cycles = LFS_PORT_FILE_BLOCK_CYCLES;
+        xFileCfg.cache_size = LFS_PORT_FILE_CACHE_SIZE;
+        xFileCfg.lookahead_size = 32;
+    }
+    else if( xFileCtx.lFd >= 0 )
+    {
+        ( void ) close( xFileCtx.lFd );
+        xFileCtx.lFd = -1;
+    }
+
+    return pxCfg;
+}
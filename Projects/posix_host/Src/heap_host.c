@@ -0,0 +1,286 @@
+/*
+ * FreeRTOS STM32 Reference Integration
+ *
+ * Copyright (c) 2022 Amazon.com, Inc. or its affiliates. All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+/**
+ * @file heap_host.c
+ * @brief pvPortMalloc on the C library allocator, with the heap_classes.h tag accounting.
+ *
+ * heap_classes.c carves blocks out of the static heap_4 array, where valgrind
+ * and the address sanitizer cannot see them. Here every block comes from
+ * malloc, so leaks and overruns are reported per allocation. The tags are
+ * kept so that the benchmarks can report the peak heap use per subsystem.
+ * There are no size classes, the class statistics stay at zero.
+ */
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "FreeRTOS.h"
+#include "task.h"
+
+#include "heap_classes.h"
+
+#ifndef HEAP_TAG_TLS_INDEX
+#define HEAP_TAG_TLS_INDEX    2
+#endif
+
+/* Keeps the payload aligned as malloc would */
+typedef union BlockPrefix
+{
+    struct
+    {
+        size_t uxLen;
+        HeapTag_t xTag;
+    } x;
+    max_align_t xAlign;
+} BlockPrefix_t;
+
+static HeapTagStats_t xTagStats = { 0 };
+static uint32_t ulAllocFailures = 0;
+static size_t uxLastFailedLen = 0;
+
+/*-----------------------------------------------------------*/
+
+static HeapTag_t xCurrentTag( void )
+{
+    HeapTag_t xTag = HEAP_TAG_OTHER;
+
+    if( xTaskGetSchedulerState() != taskSCHEDULER_NOT_STARTED )
+    {
+        xTag = ( HeapTag_t ) ( uintptr_t ) pvTaskGetThreadLocalStoragePointer( NULL, HEAP_TAG_TLS_INDEX );
+    }
+
+    return xTag;
+}
+
+/*-----------------------------------------------------------*/
+
+void * pvHeapMallocTagged( size_t xWantedSize,
+                           HeapTag_t xTag )
+{
+    BlockPrefix_t * pxPrefix = NULL;
+    void * pvBlock = NULL;
+
+    configASSERT( xTag < HEAP_TAG_COUNT );
+
+    /* The POSIX port runs one task thread at a time, as long as none is switched in meanwhile */
+    vTaskSuspendAll();
+    {
+        if( ( xWantedSize > 0 ) &&
+            ( xWantedSize <= ( SIZE_MAX - sizeof( BlockPrefix_t ) ) ) )
+        {
+            pxPrefix = malloc( xWantedSize + sizeof( BlockPrefix_t ) );
+        }
+
+        if( pxPrefix != NULL )
+        {
+            pxPrefix->x.uxLen = xWantedSize;
+            pxPrefix->x.xTag = xTag;
+
+            xTagStats.uxCurrentBytes[ xTag ] += xWantedSize;
+            xTagStats.ulAllocs[ xTag ]++;
+
+            if( xTagStats.uxCurrentBytes[ xTag ] > xTagStats.uxPeakBytes[ xTag ] )
+            {
+                xTagStats.uxPeakBytes[ xTag ] = xTagStats.uxCurrentBytes[ xTag ];
+            }
+
+            pvBlock = &( pxPrefix[ 1 ] );
+        }
+        else
+        {
+            ulAllocFailures++;
+            uxLastFailedLen = xWantedSize;
+        }
+    }
+    ( void ) xTaskResumeAll();
+
+#if ( configUSE_MALLOC_FAILED_HOOK == 1 )
+    if( pvBlock == NULL )
+    {
+        extern void vApplicationMallocFailedHook( void );
+
+        vApplicationMallocFailedHook();
+    }
+#endif
+
+    return pvBlock;
+}
+
+/*-----------------------------------------------------------*/
+
+void * pvPortMalloc( size_t xWantedSize )
+{
+    return pvHeapMallocTagged( xWantedSize, xCurrentTag() );
+}
+
+/*-----------------------------------------------------------*/
+
+void * pvPortCalloc( size_t xNum,
+                     size_t xSize )
+{
+    void * pvBlock = NULL;
+
+    if( ( xSize == 0 ) ||
+        ( xNum <= ( SIZE_MAX / xSize ) ) )
+    {
+        pvBlock = pvPortMalloc( xNum * xSize );
+    }
+
+    if( pvBlock != NULL )
+    {
+        ( void ) memset( pvBlock, 0, xNum * xSize );
+    }
+
+    return pvBlock;
+}
+
+/*-----------------------------------------------------------*/
+
+void vPortFree( void * pv )
+{
+    if( pv != NULL )
+    {
+        BlockPrefix_t * pxPrefix = &( ( ( BlockPrefix_t * ) pv )[ -1 ] );
+        HeapTag_t xTag = pxPrefix->x.xTag;
+
+        configASSERT( xTag < HEAP_TAG_COUNT );
+
+        vTaskSuspendAll();
+        {
+            xTagStats.uxCurrentBytes[ xTag ] -= pxPrefix->x.uxLen;
+            xTagStats.ulFrees[ xTag ]++;
+
+            free( pxPrefix );
+        }
+        ( void ) xTaskResumeAll();
+    }
+}
+
+/*-----------------------------------------------------------*/
+
+size_t xPortGetFreeHeapSize( void )
+{
+    /* Not bounded on the host */
+    return SIZE_MAX;
+}
+
+/*-----------------------------------------------------------*/
+
+size_t xPortGetMinimumEverFreeHeapSize( void )
+{
+    return SIZE_MAX;
+}
+
+/*-----------------------------------------------------------*/
+
+HeapTag_t xHeapTagSet( HeapTag_t xTag )
+{
+    HeapTag_t xPrevious = xCurrentTag();
+
+    configASSERT( xTag < HEAP_TAG_COUNT );
+
+    if( xTaskGetSchedulerState() != taskSCHEDULER_NOT_STARTED )
+    {
+        vTaskSetThreadLocalStoragePointer( NULL, HEAP_TAG_TLS_INDEX, ( void * ) ( uintptr_t ) xTag );
+    }
+
+    return xPrevious;
+}
+
+/*-----------------------------------------------------------*/
+
+void vHeapTagSetTask( TaskHandle_t xTask,
+                      HeapTag_t xTag )
+{
+    configASSERT( xTag < HEAP_TAG_COUNT );
+
+    if( xTask != NULL )
+    {
+        vTaskSetThreadLocalStoragePointer( xTask, HEAP_TAG_TLS_INDEX, ( void * ) ( uintptr_t ) xTag );
+    }
+}
+
+/*-----------------------------------------------------------*/
+
+BaseType_t xHeapTagGetStats( HeapTagStats_t * pxStats )
+{
+    configASSERT( pxStats != NULL );
+
+    vTaskSuspendAll();
+    {
+        *pxStats = xTagStats;
+    }
+    ( void ) xTaskResumeAll();
+
+    return pdTRUE;
+}
+
+/*-----------------------------------------------------------*/
+
+const char * pcHeapTagName( HeapTag_t xTag )
+{
+    static const char * const pcTagNames[ HEAP_TAG_COUNT ] =
+    {
+        "other",
+        "tls",
+        "lwip",
+        "kvstore",
+        "ota",
+        "mqtt"
+    };
+
+    return ( xTag < HEAP_TAG_COUNT ) ? pcTagNames[ xTag ] : "invalid";
+}
+
+/*-----------------------------------------------------------*/
+
+void vHeapGetFragStats( HeapFragStats_t * pxStats )
+{
+    configASSERT( pxStats != NULL );
+
+    ( void ) memset( pxStats, 0, sizeof( HeapFragStats_t ) );
+
+    vTaskSuspendAll();
+    {
+        pxStats->ulAllocFailures = ulAllocFailures;
+        pxStats->uxLastFailedLen = uxLastFailedLen;
+    }
+    ( void ) xTaskResumeAll();
+}
+
+/*-----------------------------------------------------------*/
+
+void vHeapClassGetStats( HeapClassStats_t * pxStats )
+{
+    configASSERT( pxStats != NULL );
+
+    ( void ) memset( pxStats, 0, sizeof( HeapClassStats_t ) );
+}
+
+/*-----------------------------------------------------------*/
+
+void vHeapClassFlush( void )
+{
+}
@@ -0,0 +1,242 @@
+/*
+ * FreeRTOS STM32 Reference Integration
+ *
+ * Copyright (c) 2022 Amazon.com, Inc. or its affiliates. All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+/**
+ * @file host_sys.c
+ * @brief Host versions of the logging, time base, boot time and random number services.
+ *
+ * Log lines have the same layout as on the target console and go to stderr,
+ * so that the PERF lines written to stdout by bench.c can be piped into
+ * tools/perf_regress.py unchanged.
+ */
+
+#include "logging_levels.h"
+
+#define LOG_LEVEL     LOG_INFO
+#define LOG_MODULE    LOG_MODULE_SYS
+
+#include "logging.h"
+
+/* Standard includes. */
+#include <stdarg.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+#include "FreeRTOS.h"
+#include "task.h"
+
+#include "boot_times.h"
+#include "time_base.h"
+
+volatile uint8_t ucLogModuleLevel[ LOG_MODULE_MAX ] =
+{
+    [ 0 ... ( LOG_MODULE_MAX - 1 ) ] = LOG_WARN
+};
+
+volatile uintptr_t uxHostExclusiveAddr = 0;
+
+static uint64_t ullBootUs = 0;
+static BootTimes_t xBootTimes = { 0 };
+
+/*-----------------------------------------------------------*/
+
+void vLoggingPrintf( const char * const pcLogLevel,
+                     const char * const pcFunctionName,
+                     const unsigned long ulLineNumber,
+                     const char * const pcFormat,
+                     ... )
+{
+    const char * pcTaskName = "None";
+    BaseType_t xSchedulerRunning = ( xTaskGetSchedulerState() == taskSCHEDULER_RUNNING ) ? pdTRUE : pdFALSE;
+    va_list args;
+
+    if( xTaskGetSchedulerState() != taskSCHEDULER_NOT_STARTED )
+    {
+        pcTaskName = pcTaskGetName( NULL );
+    }
+
+    /* Keeps a context switch from interleaving two lines */
+    if( xSchedulerRunning == pdTRUE )
+    {
+        vTaskSuspendAll();
+    }
+
+    ( void ) fprintf( stderr, "<%-3.3s> %8lu [%-10.10s] ",
+                      pcLogLevel,
+                      ( ( unsigned long ) xTaskGetTickCount() / portTICK_PERIOD_MS ) & 0xFFFFFF,
+                      pcTaskName );
+
+    va_start( args, pcFormat );
+    ( void ) vfprintf( stderr, pcFormat, args );
+    va_end( args );
+
+    ( void ) fprintf( stderr, " (%s:%lu)\n", pcFunctionName, ulLineNumber );
+
+    if( xSchedulerRunning == pdTRUE )
+    {
+        ( void ) xTaskResumeAll();
+    }
+}
+
+/*-----------------------------------------------------------*/
+
+void vDyingGasp( void )
+{
+    ( void ) fflush( stdout );
+    ( void ) fflush( stderr );
+}
+
+/*-----------------------------------------------------------*/
+
+void vHostSetLogLevel( uint8_t ucLevel )
+{
+    for( size_t uxModule = 0; uxModule < LOG_MODULE_MAX; uxModule++ )
+    {
+        ucLogModuleLevel[ uxModule ] = ucLevel;
+    }
+}
+
+/*-----------------------------------------------------------*/
+
+static uint64_t prvClockUs( clockid_t xClock )
+{
+    struct timespec xNow = { 0 };
+
+    ( void ) clock_gettime( xClock, &xNow );
+
+    return ( ( uint64_t ) xNow.tv_sec * 1000000U ) + ( ( uint64_t ) xNow.tv_nsec / 1000U );
+}
+
+/*-----------------------------------------------------------*/
+
+void vTimeBaseInit( void )
+{
+    ullBootUs = prvClockUs( CLOCK_MONOTONIC );
+}
+
+/*-----------------------------------------------------------*/
+
+uint64_t ullTimeBaseGetUs( void )
+{
+    return prvClockUs( CLOCK_MONOTONIC ) - ullBootUs;
+}
+
+/*-----------------------------------------------------------*/
+
+TimeBaseSource_t xTimeBaseToUnixMs( uint64_t ullMonotonicUs,
+                                    uint64_t * pullUnixMs )
+{
+    /* The host clock is taken to be synchronized, the offset is read on each call */
+    uint64_t ullOffsetUs = prvClockUs( CLOCK_REALTIME ) - ullTimeBaseGetUs();
+
+    configASSERT( pullUnixMs != NULL );
+
+    *pullUnixMs = ( ullOffsetUs + ullMonotonicUs ) / 1000U;
+
+    return TIME_BASE_SRC_SYNCED;
+}
+
+/*-----------------------------------------------------------*/
+
+size_t uxTimeBaseFormatUnix( uint64_t ullMonotonicUs,
+                             char * pcBuffer,
+                             size_t uxBufferLen )
+{
+    uint64_t ullUnixMs = 0;
+    size_t uxLen = 0;
+
+    configASSERT( pcBuffer != NULL );
+
+    if( xTimeBaseToUnixMs( ullMonotonicUs, &ullUnixMs ) != TIME_BASE_SRC_NONE )
+    {
+        int lLen = snprintf( pcBuffer, uxBufferLen, "%lu.%03lu",
+                             ( unsigned long ) ( ullUnixMs / 1000U ),
+                             ( unsigned long ) ( ullUnixMs % 1000U ) );
+
+        if( ( lLen > 0 ) && ( ( size_t ) lLen < uxBufferLen ) )
+        {
+            uxLen = ( size_t ) lLen;
+        }
+    }
+
+    return uxLen;
+}
+
+/*-----------------------------------------------------------*/
+
+void vTimeBaseSetUnixMs( uint64_t ullUnixMs )
+{
+    /* The host clock is not changed */
+    ( void ) ullUnixMs;
+}
+
+/*-----------------------------------------------------------*/
+
+void vBootTimesInit( uint32_t ulResetSource )
+{
+    xBootTimes.ulBootCount = 1;
+    xBootTimes.ulResetSource = ulResetSource;
+
+    for( size_t uxStage = 0; uxStage < BOOT_STAGE_MAX; uxStage++ )
+    {
+        xBootTimes.ulStageMs[ uxStage ] = BOOT_TIME_NONE;
+    }
+}
+
+/*-----------------------------------------------------------*/
+
+void vBootTimeMark( BootStage_t xStage )
+{
+    if( ( xStage < BOOT_STAGE_MAX ) &&
+        ( xBootTimes.ulStageMs[ xStage ] == BOOT_TIME_NONE ) )
+    {
+        xBootTimes.ulStageMs[ xStage ] = ( uint32_t ) ( ullTimeBaseGetUs() / 1000U );
+    }
+}
+
+/*-----------------------------------------------------------*/
+
+const BootTimes_t * pxBootTimesGet( BaseType_t xPrevious )
+{
+    return ( xPrevious == pdFALSE ) ? &xBootTimes : NULL;
+}
+
+/*-----------------------------------------------------------*/
+
+UBaseType_t uxRand( void )
+{
+    static uint32_t ulState = 0;
+
+    if( ulState == 0 )
+    {
+        ulState = ( uint32_t ) prvClockUs( CLOCK_REALTIME ) | 1U;
+    }
+
+    /* xorshift32, only used for jitter */
+    ulState ^= ulState << 13;
+    ulState ^= ulState >> 17;
+    ulState ^= ulState << 5;
+
+    return ( UBaseType_t ) ulState;
+}
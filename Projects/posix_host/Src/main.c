@@ -0,0 +1,304 @@
+/*
+ * FreeRTOS STM32 Reference Integration
+ *
+ * Copyright (c) 2022 Amazon.com, Inc. or its affiliates. All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+/**
+ * @file main.c
+ * @brief Entry point of the host build, see README.md.
+ *
+ * Usage: stm32u5_host [-b host[:port]] [-f image] [-n iterations] [-s suites] [-v level]
+ */
+
+#include "logging_levels.h"
+
+#define LOG_LEVEL     LOG_INFO
+#define LOG_MODULE    LOG_MODULE_APP
+
+#include "logging.h"
+
+/* Standard includes. */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "FreeRTOS.h"
+#include "task.h"
+#include "event_groups.h"
+
+#include "boot_times.h"
+#include "kvstore.h"
+#include "static_alloc.h"
+#include "sys_evt.h"
+#include "time_base.h"
+
+#include "fs/lfs_port.h"
+
+#include "bench.h"
+
+#ifndef HOST_FS_IMAGE_DFLT
+#define HOST_FS_IMAGE_DFLT    "stm32u5_host_fs.bin"
+#endif
+
+EventGroupHandle_t xSystemEvents = NULL;
+
+static lfs_t * pxLfsCtx = NULL;
+static const char * pcFsImage = HOST_FS_IMAGE_DFLT;
+static BenchConfig_t xBenchConfig =
+{
+    .pcBrokerHost = NULL,
+    .usBrokerPort = 1883,
+    .ulIterations = 10000,
+    .ulSuites = BENCH_SUITE_ALL,
+};
+
+extern void vHostSetLogLevel( uint8_t ucLevel );
+
+/*-----------------------------------------------------------*/
+
+lfs_t * pxGetDefaultFsCtx( void )
+{
+    configASSERT( pxLfsCtx != NULL );
+
+    return pxLfsCtx;
+}
+
+/*-----------------------------------------------------------*/
+
+/* Same sequence as fs_init of the target: mount, format on the first run, create the directories */
+static int prvFsInit( void )
+{
+    static lfs_t xLfsCtx = { 0 };
+    struct lfs_info xDirInfo = { 0 };
+    const struct lfs_config * pxCfg = pxInitializeFileFs( pcFsImage, pdMS_TO_TICKS( 30 * 1000 ) );
+    int err = LFS_ERR_IO;
+
+    if( pxCfg != NULL )
+    {
+        err = lfs_mount( &xLfsCtx, pxCfg );
+
+        if( err != LFS_ERR_OK )
+        {
+            LogInfo( "Formatting %s.", pcFsImage );
+            err = lfs_format( &xLfsCtx, pxCfg );
+
+            if( err == LFS_ERR_OK )
+            {
+                err = lfs_mount( &xLfsCtx, pxCfg );
+            }
+        }
+    }
+
+    if( err == LFS_ERR_OK )
+    {
+        if( lfs_stat( &xLfsCtx, "/cfg", &xDirInfo ) == LFS_ERR_NOENT )
+        {
+            err = lfs_mkdir( &xLfsCtx, "/cfg" );
+        }
+
+        if( ( err == LFS_ERR_OK ) &&
+            ( lfs_stat( &xLfsCtx, "/ota", &xDirInfo ) == LFS_ERR_NOENT ) )
+        {
+            err = lfs_mkdir( &xLfsCtx, "/ota" );
+        }
+    }
+
+    if( err == LFS_ERR_OK )
+    {
+        pxLfsCtx = &xLfsCtx;
+    }
+    else
+    {
+        LogError( "Failed to initialize the filesystem image %s: %d.", pcFsImage, err );
+    }
+
+    return err;
+}
+
+/*-----------------------------------------------------------*/
+
+static void prvInitTask( void * pvParameters )
+{
+    int lExitCode = EXIT_FAILURE;
+
+    ( void ) pvParameters;
+
+    vBootTimeMark( BOOT_STAGE_SCHEDULER );
+
+    if( prvFsInit() == LFS_ERR_OK )
+    {
+        vBootTimeMark( BOOT_STAGE_FS_MOUNT );
+
+        KVStore_init();
+        vBootTimeMark( BOOT_STAGE_KVSTORE );
+
+        /* The host network is up before the scheduler starts */
+        ( void ) xEventGroupSetBits( xSystemEvents, EVT_MASK_FS_READY | EVT_MASK_NET_INIT | EVT_MASK_NET_CONNECTED );
+
+        lExitCode = ( xBenchRun( &xBenchConfig ) == pdTRUE ) ? EXIT_SUCCESS : EXIT_FAILURE;
+    }
+
+    vDyingGasp();
+
+    /* vTaskEndScheduler is not reliable on the POSIX port with tasks still blocked */
+    exit( lExitCode );
+}
+
+/*-----------------------------------------------------------*/
+
+static void prvUsage( const char * pcProgram )
+{
+    ( void ) fprintf( stderr,
+                      "Usage: %s [-b host[:port]] [-f image] [-n iterations] [-s suites] [-v level]\n"
+                      "  -b  MQTT broker without TLS, enables the mqtt suite\n"
+                      "  -f  filesystem image, default %s\n"
+                      "  -n  iterations per measurement, default %lu\n"
+                      "  -s  comma separated suites: dispatch,kvstore,json,mqtt\n"
+                      "  -v  log level 0 - 4, default 2\n",
+                      pcProgram, HOST_FS_IMAGE_DFLT, ( unsigned long ) xBenchConfig.ulIterations );
+}
+
+/*-----------------------------------------------------------*/
+
+static BaseType_t prvParseArgs( int argc,
+                                char ** argv )
+{
+    BaseType_t xSuccess = pdTRUE;
+    char * pcColon = NULL;
+    int lOpt;
+
+    while( ( xSuccess == pdTRUE ) &&
+           ( ( lOpt = getopt( argc, argv, "b:f:n:s:v:h" ) ) != -1 ) )
+    {
+        switch( lOpt )
+        {
+            case 'b':
+                pcColon = strrchr( optarg, ':' );
+
+                if( pcColon != NULL )
+                {
+                    *pcColon = '\0';
+                    xBenchConfig.usBrokerPort = ( uint16_t ) strtoul( pcColon + 1, NULL, 10 );
+                }
+
+                xBenchConfig.pcBrokerHost = optarg;
+                break;
+
+            case 'f':
+                pcFsImage = optarg;
+                break;
+
+            case 'n':
+                xBenchConfig.ulIterations = ( uint32_t ) strtoul( optarg, NULL, 10 );
+                xSuccess = ( xBenchConfig.ulIterations > 0 ) ? pdTRUE : pdFALSE;
+                break;
+
+            case 's':
+                xBenchConfig.ulSuites = ulBenchParseSuites( optarg );
+                xSuccess = ( xBenchConfig.ulSuites != 0 ) ? pdTRUE : pdFALSE;
+                break;
+
+            case 'v':
+                vHostSetLogLevel( ( uint8_t ) strtoul( optarg, NULL, 10 ) );
+                break;
+
+            default:
+                xSuccess = pdFALSE;
+                break;
+        }
+    }
+
+    if( xSuccess == pdFALSE )
+    {
+        prvUsage( argv[ 0 ] );
+    }
+
+    return xSuccess;
+}
+
+/*-----------------------------------------------------------*/
+
+int main( int argc,
+          char ** argv )
+{
+    BaseType_t xResult;
+
+    vBootTimesInit( 0 );
+    vTimeBaseInit();
+
+    if( prvParseArgs( argc, argv ) == pdFALSE )
+    {
+        return EXIT_FAILURE;
+    }
+
+    /* Keeps PERF lines in order with the log lines when both go to a terminal */
+    ( void ) setvbuf( stdout, NULL, _IOLBF, 0 );
+
+    xSystemEvents = xEventGroupCreateStaticStorage();
+    configASSERT( xSystemEvents != NULL );
+
+    xResult = xTaskCreateStaticStack( prvInitTask, "Init", TASK_STACK_INIT, NULL, 8, NULL );
+    configASSERT( xResult == pdTRUE );
+
+    vTaskStartScheduler();
+
+    LogError( "The scheduler returned." );
+
+    return EXIT_FAILURE;
+}
+
+/*-----------------------------------------------------------*/
+
+void vApplicationGetIdleTaskMemory( StaticTask_t ** ppxIdleTaskTCBBuffer,
+                                    StackType_t ** ppxIdleTaskStackBuffer,
+                                    uint32_t * pulIdleTaskStackSize )
+{
+    static StaticTask_t xIdleTaskTCB;
+    static StackType_t uxIdleTaskStack[ configMINIMAL_STACK_SIZE ];
+
+    *ppxIdleTaskTCBBuffer = &xIdleTaskTCB;
+    *ppxIdleTaskStackBuffer = uxIdleTaskStack;
+    *pulIdleTaskStackSize = configMINIMAL_STACK_SIZE;
+}
+
+/*-----------------------------------------------------------*/
+
+void vApplicationGetTimerTaskMemory( StaticTask_t ** ppxTimerTaskTCBBuffer,
+                                     StackType_t ** ppxTimerTaskStackBuffer,
+                                     uint32_t * pulTimerTaskStackSize )
+{
+    static StaticTask_t xTimerTaskTCB;
+    static StackType_t uxTimerTaskStack[ configTIMER_TASK_STACK_DEPTH ];
+
+    *ppxTimerTaskTCBBuffer = &xTimerTaskTCB;
+    *ppxTimerTaskStackBuffer = uxTimerTaskStack;
+    *pulTimerTaskStackSize = configTIMER_TASK_STACK_DEPTH;
+}
+
+/*-----------------------------------------------------------*/
+
+void vApplicationMallocFailedHook( void )
+{
+    LogError( "Malloc failed" );
+    vDyingGasp();
+    abort();
+}
@@ -0,0 +1,492 @@
+/*
+ * FreeRTOS STM32 Reference Integration
+ *
+ * Copyright (c) 2022 Amazon.com, Inc. or its affiliates. All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+/**
+ * @file socket_transport.c
+ * @brief Plain TCP implementation of the mbedtls_transport API for the host build.
+ *
+ * Sockets are non-blocking, so that a task waiting for the network never
+ * holds the POSIX port's single running thread. A low priority poll task
+ * stands in for the socket event callback of the target network stack.
+ */
+
+#include "logging_levels.h"
+
+#define LOG_LEVEL     LOG_INFO
+#define LOG_MODULE    LOG_MODULE_NET
+
+#include "logging.h"
+
+/* Standard includes. */
+#include <errno.h>
+#include <fcntl.h>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <poll.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
+#include <unistd.h>
+
+/* Kernel includes. */
+#include "FreeRTOS.h"
+#include "task.h"
+
+#include "mbedtls_transport.h"
+#include "net/mxchip/mx_netconn.h"
+
+/* Time allowed for the TCP connection to be established */
+#ifndef SOCKET_CONNECT_TIMEOUT_MS
+#define SOCKET_CONNECT_TIMEOUT_MS    5000
+#endif
+
+/* Longest gap between two checks of the open sockets for received data */
+#ifndef SOCKET_POLL_PERIOD_MS
+#define SOCKET_POLL_PERIOD_MS        1
+#endif
+
+/* Vectors passed to a single sendmsg, the rest is left to the next call */
+#define SOCKET_IOV_MAX               16
+
+struct NetworkContext
+{
+    int lSock;
+    volatile BaseType_t xAborted;
+    GenericCallback_t pxRecvCallback;
+    void * pvRecvCtx;
+    struct NetworkContext * pxNext;
+};
+
+/* Contexts checked by the poll task */
+static NetworkContext_t * pxContextList = NULL;
+static TaskHandle_t xPollTask = NULL;
+
+/*-----------------------------------------------------------*/
+
+static void prvPollTask( void * pvParameters )
+{
+    ( void ) pvParameters;
+
+    for( ; ; )
+    {
+        vTaskSuspendAll();
+        {
+            for( NetworkContext_t * pxCtx = pxContextList; pxCtx != NULL; pxCtx = pxCtx->pxNext )
+            {
+                struct pollfd xPollFd = { .fd = pxCtx->lSock, .events = POLLIN };
+
+                if( ( pxCtx->lSock >= 0 ) &&
+                    ( pxCtx->pxRecvCallback != NULL ) &&
+                    ( poll( &xPollFd, 1, 0 ) > 0 ) )
+                {
+                    pxCtx->pxRecvCallback( pxCtx->pvRecvCtx );
+                }
+            }
+        }
+        ( void ) xTaskResumeAll();
+
+        vTaskDelay( pdMS_TO_TICKS( SOCKET_POLL_PERIOD_MS ) );
+    }
+}
+
+/*-----------------------------------------------------------*/
+
+PkiObject_t xPkiObjectFromLabel( const char * pcLabel )
+{
+    PkiObject_t xObject = { .pcLabel = pcLabel };
+
+    return xObject;
+}
+
+/*-----------------------------------------------------------*/
+
+NetworkContext_t * mbedtls_transport_allocate( void )
+{
+    NetworkContext_t * pxCtx = pvPortMalloc( sizeof( NetworkContext_t ) );
+
+    if( pxCtx != NULL )
+    {
+        ( void ) memset( pxCtx, 0, sizeof( NetworkContext_t ) );
+        pxCtx->lSock = -1;
+
+        if( ( xPollTask == NULL ) &&
+            ( xTaskCreate( prvPollTask, "SockPoll", configMINIMAL_STACK_SIZE, NULL,
+                           tskIDLE_PRIORITY + 1, &xPollTask ) != pdPASS ) )
+        {
+            LogError( "Failed to create the socket poll task." );
+            vPortFree( pxCtx );
+            pxCtx = NULL;
+        }
+    }
+
+    if( pxCtx != NULL )
+    {
+        taskENTER_CRITICAL();
+        {
+            pxCtx->pxNext = pxContextList;
+            pxContextList = pxCtx;
+        }
+        taskEXIT_CRITICAL();
+    }
+
+    return pxCtx;
+}
+
+/*-----------------------------------------------------------*/
+
+void mbedtls_transport_free( NetworkContext_t * pxNetworkContext )
+{
+    if( pxNetworkContext != NULL )
+    {
+        mbedtls_transport_disconnect( pxNetworkContext );
+
+        /* The poll task walks the list with the scheduler suspended */
+        vTaskSuspendAll();
+        {
+            NetworkContext_t ** ppxLink = &pxContextList;
+
+            while( ( *ppxLink != NULL ) && ( *ppxLink != pxNetworkContext ) )
+            {
+                ppxLink = &( ( *ppxLink )->pxNext );
+            }
+
+            if( *ppxLink != NULL )
+            {
+                *ppxLink = pxNetworkContext->pxNext;
+            }
+        }
+        ( void ) xTaskResumeAll();
+
+        vPortFree( pxNetworkContext );
+    }
+}
+
+/*-----------------------------------------------------------*/
+
+TlsTransportStatus_t mbedtls_transport_configure( NetworkContext_t * pxNetworkContext,
+                                                  const char ** ppcAlpnProtos,
+                                                  const PkiObject_t * pxPrivateKey,
+                                                  const PkiObject_t * pxClientCert,
+                                                  const PkiObject_t * pxRootCaCerts,
+                                                  const size_t uxNumRootCA )
+{
+    ( void ) ppcAlpnProtos;
+    ( void ) pxPrivateKey;
+    ( void ) pxClientCert;
+    ( void ) pxRootCaCerts;
+    ( void ) uxNumRootCA;
+
+    return ( pxNetworkContext != NULL ) ? TLS_TRANSPORT_SUCCESS : TLS_TRANSPORT_INVALID_PARAMETER;
+}
+
+/*-----------------------------------------------------------*/
+
+int32_t mbedtls_transport_setrecvcallback( NetworkContext_t * pxNetworkContext,
+                                           GenericCallback_t pxCallback,
+                                           void * pvCtx )
+{
+    int32_t lResult = TLS_TRANSPORT_INVALID_PARAMETER;
+
+    if( pxNetworkContext != NULL )
+    {
+        vTaskSuspendAll();
+        {
+            pxNetworkContext->pxRecvCallback = pxCallback;
+            pxNetworkContext->pvRecvCtx = pvCtx;
+        }
+        ( void ) xTaskResumeAll();
+
+        lResult = TLS_TRANSPORT_SUCCESS;
+    }
+
+    return lResult;
+}
+
+/*-----------------------------------------------------------*/
+
+/* Wait for a non-blocking connect to complete, sleeping between checks */
+static TlsTransportStatus_t prvWaitConnected( int lSock )
+{
+    TlsTransportStatus_t xStatus = TLS_TRANSPORT_CONNECT_FAILURE;
+    TickType_t xStart = xTaskGetTickCount();
+    BaseType_t xDone = pdFALSE;
+
+    while( xDone == pdFALSE )
+    {
+        struct pollfd xPollFd = { .fd = lSock, .events = POLLOUT };
+        int lSockErr = 0;
+        socklen_t xLen = sizeof( lSockErr );
+
+        if( poll( &xPollFd, 1, 0 ) > 0 )
+        {
+            if( ( getsockopt( lSock, SOL_SOCKET, SO_ERROR, &lSockErr, &xLen ) == 0 ) &&
+                ( lSockErr == 0 ) )
+            {
+                xStatus = TLS_TRANSPORT_SUCCESS;
+            }
+
+            xDone = pdTRUE;
+        }
+        else if( ( xTaskGetTickCount() - xStart ) > pdMS_TO_TICKS( SOCKET_CONNECT_TIMEOUT_MS ) )
+        {
+            xDone = pdTRUE;
+        }
+        else
+        {
+            vTaskDelay( pdMS_TO_TICKS( SOCKET_POLL_PERIOD_MS ) );
+        }
+    }
+
+    return xStatus;
+}
+
+/*-----------------------------------------------------------*/
+
+TlsTransportStatus_t mbedtls_transport_connect( NetworkContext_t * pxNetworkContext,
+                                                const char * pcHostName,
+                                                uint16_t usPort,
+                                                uint32_t ulRecvTimeoutMs,
+                                                uint32_t ulSendTimeoutMs )
+{
+    TlsTransportStatus_t xStatus = TLS_TRANSPORT_SUCCESS;
+    struct addrinfo xHints = { 0 };
+    struct addrinfo * pxAddrInfo = NULL;
+    char pcPort[ 6 ] = { 0 };
+    int lSock = -1;
+
+    ( void ) ulRecvTimeoutMs;
+    ( void ) ulSendTimeoutMs;
+
+    if( ( pxNetworkContext == NULL ) ||
+        ( pcHostName == NULL ) )
+    {
+        xStatus = TLS_TRANSPORT_INVALID_PARAMETER;
+    }
+    else
+    {
+        xHints.ai_family = AF_UNSPEC;
+        xHints.ai_socktype = SOCK_STREAM;
+        ( void ) snprintf( pcPort, sizeof( pcPort ), "%u", ( unsigned int ) usPort );
+
+        if( ( getaddrinfo( pcHostName, pcPort, &xHints, &pxAddrInfo ) != 0 ) ||
+            ( pxAddrInfo == NULL ) )
+        {
+            LogError( "Failed to resolve %s.", pcHostName );
+            xStatus = TLS_TRANSPORT_DNS_FAILED;
+        }
+    }
+
+    if( xStatus == TLS_TRANSPORT_SUCCESS )
+    {
+        lSock = socket( pxAddrInfo->ai_family, pxAddrInfo->ai_socktype | SOCK_NONBLOCK, pxAddrInfo->ai_protocol );
+
+        if( lSock < 0 )
+        {
+            xStatus = TLS_TRANSPORT_INSUFFICIENT_SOCKETS;
+        }
+        else if( ( connect( lSock, pxAddrInfo->ai_addr, pxAddrInfo->ai_addrlen ) != 0 ) &&
+                 ( errno != EINPROGRESS ) )
+        {
+            xStatus = TLS_TRANSPORT_CONNECT_FAILURE;
+        }
+        else
+        {
+            xStatus = prvWaitConnected( lSock );
+        }
+    }
+
+    if( pxAddrInfo != NULL )
+    {
+        freeaddrinfo( pxAddrInfo );
+    }
+
+    if( xStatus == TLS_TRANSPORT_SUCCESS )
+    {
+        int lOne = 1;
+
+        /* As lwIP is configured on target, small MQTT packets are not delayed */
+        ( void ) setsockopt( lSock, IPPROTO_TCP, TCP_NODELAY, &lOne, sizeof( lOne ) );
+
+        pxNetworkContext->xAborted = pdFALSE;
+        pxNetworkContext->lSock = lSock;
+
+        LogInfo( "Connected to %s:%u.", pcHostName, ( unsigned int ) usPort );
+    }
+    else
+    {
+        LogError( "Failed to connect to %s:%u.", pcHostName, ( unsigned int ) usPort );
+
+        if( lSock >= 0 )
+        {
+            ( void ) close( lSock );
+        }
+    }
+
+    return xStatus;
+}
+
+/*-----------------------------------------------------------*/
+
+void mbedtls_transport_abort( NetworkContext_t * pxNetworkContext )
+{
+    if( pxNetworkContext != NULL )
+    {
+        pxNetworkContext->xAborted = pdTRUE;
+
+        if( pxNetworkContext->lSock >= 0 )
+        {
+            ( void ) shutdown( pxNetworkContext->lSock, SHUT_RDWR );
+        }
+    }
+}
+
+/*-----------------------------------------------------------*/
+
+void mbedtls_transport_disconnect( NetworkContext_t * pxNetworkContext )
+{
+    if( ( pxNetworkContext != NULL ) &&
+        ( pxNetworkContext->lSock >= 0 ) )
+    {
+        int lSock = pxNetworkContext->lSock;
+
+        /* Keeps the poll task from polling a descriptor number which may be reused */
+        vTaskSuspendAll();
+        {
+            pxNetworkContext->lSock = -1;
+        }
+        ( void ) xTaskResumeAll();
+
+        ( void ) close( lSock );
+        pxNetworkContext->xAborted = pdFALSE;
+    }
+}
+
+/*-----------------------------------------------------------*/
+
+/* Map the result of a non-blocking socket call to the transport interface convention */
+static int32_t prvSocketResult( ssize_t xResult )
+{
+    int32_t lResult = -1;
+
+    if( xResult >= 0 )
+    {
+        lResult = ( int32_t ) xResult;
+    }
+    else if( ( errno == EAGAIN ) ||
+             ( errno == EWOULDBLOCK ) ||
+             ( errno == EINTR ) )
+    {
+        /* EINTR is common here, the POSIX port signals the running thread on every tick */
+        lResult = 0;
+    }
+    else
+    {
+        LogDebug( "Socket error %d.", errno );
+    }
+
+    return lResult;
+}
+
+/*-----------------------------------------------------------*/
+
+int32_t mbedtls_transport_recv( NetworkContext_t * pxNetworkContext,
+                                void * pBuffer,
+                                size_t bytesToRecv )
+{
+    int32_t lResult = -1;
+
+    if( ( pxNetworkContext != NULL ) &&
+        ( pxNetworkContext->lSock >= 0 ) &&
+        ( pxNetworkContext->xAborted == pdFALSE ) )
+    {
+        ssize_t xReceived = recv( pxNetworkContext->lSock, pBuffer, bytesToRecv, MSG_DONTWAIT );
+
+        /* 0 means the peer closed the connection, not that no data is available */
+        lResult = ( xReceived == 0 ) ? -1 : prvSocketResult( xReceived );
+    }
+
+    return lResult;
+}
+
+/*-----------------------------------------------------------*/
+
+int32_t mbedtls_transport_send( NetworkContext_t * pxNetworkContext,
+                                const void * pBuffer,
+                                size_t uxBytesToSend )
+{
+    int32_t lResult = -1;
+
+    if( ( pxNetworkContext != NULL ) &&
+        ( pxNetworkContext->lSock >= 0 ) &&
+        ( pxNetworkContext->xAborted == pdFALSE ) )
+    {
+        lResult = prvSocketResult( send( pxNetworkContext->lSock, pBuffer, uxBytesToSend,
+                                         MSG_DONTWAIT | MSG_NOSIGNAL ) );
+    }
+
+    return lResult;
+}
+
+/*-----------------------------------------------------------*/
+
+int32_t mbedtls_transport_writev( NetworkContext_t * pxNetworkContext,
+                                  TransportOutVector_t * pxIoVec,
+                                  size_t uxIoVecCount )
+{
+    int32_t lResult = -1;
+
+    if( ( pxNetworkContext != NULL ) &&
+        ( pxNetworkContext->lSock >= 0 ) &&
+        ( pxNetworkContext->xAborted == pdFALSE ) &&
+        ( pxIoVec != NULL ) )
+    {
+        struct iovec pxIov[ SOCKET_IOV_MAX ];
+        struct msghdr xMsg = { 0 };
+        size_t uxCount = ( uxIoVecCount < SOCKET_IOV_MAX ) ? uxIoVecCount : SOCKET_IOV_MAX;
+
+        for( size_t i = 0; i < uxCount; i++ )
+        {
+            pxIov[ i ].iov_base = ( void * ) pxIoVec[ i ].iov_base;
+            pxIov[ i ].iov_len = pxIoVec[ i ].iov_len;
+        }
+
+        xMsg.msg_iov = pxIov;
+        xMsg.msg_iovlen = uxCount;
+
+        lResult = prvSocketResult( sendmsg( pxNetworkContext->lSock, &xMsg, MSG_DONTWAIT | MSG_NOSIGNAL ) );
+    }
+
+    return lResult;
+}
+
+/*-----------------------------------------------------------*/
+
+void net_set_link_lost_callback( NetLinkLostCallback_t pxCallback,
+                                 void * pvCtx )
+{
+    /* The host network does not go down */
+    ( void ) pxCallback;
+    ( void ) pvCtx;
+}
@@ -0,0 +1,180 @@
+#!/usr/bin/env python3
+#  FreeRTOS STM32 Reference Integration
+#
+#  Copyright (C) 2022 Amazon.com, Inc. or its affiliates.  All Rights Reserved.
+#
+#  Permission is hereby granted, free of charge, to any person obtaining a copy of
+#  this software and associated documentation files (the "Software"), to deal in
+#  the Software without restriction, including without limitation the rights to
+#  use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+#  the Software, and to permit persons to whom the Software is furnished to do so,
+#  subject to the following conditions:
+#
+#  The above copyright notice and this permission notice shall be included in all
+#  copies or substantial portions of the Software.
+#
+#  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+#  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+#  FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+#  COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+#  IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+#  CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+#
+#  https://www.FreeRTOS.org
+#  https://github.com/FreeRTOS
+#
+
+
+"""Compare cryptobench results of the NTZ and TF-M builds.
+
+Capture the console output of "cryptobench all" on three images:
+
+  ntz      b_u585i_iot02a_ntz, mbedtls with the STM32U5 accelerators
+  tfm-sw   b_u585i_iot02a_tfm built with make TFM_CRYPTO_HW_ACCEL=OFF
+  tfm-hw   b_u585i_iot02a_tfm built with the default TFM_CRYPTO_HW_ACCEL=ON
+
+The "psa" rows of the TF-M logs are the secure side calls, which include the
+cost of the NS to S transition and of the TF-M crypto service. They are put
+side by side with the NTZ row of the same test. The ratio columns are the
+speedup of the secure accelerators and the remaining cost of running the
+operation in the secure world. Typical use:
+
+  % python tools/cryptobench_compare.py ntz.log tfm_sw.log tfm_hw.log
+  % python tools/cryptobench_compare.py --max-overhead 1.5 ntz.log tfm_sw.log tfm_hw.log
+"""
+
+import argparse
+import logging
+import re
+import sys
+
+logger = logging.getLogger()
+
+RESULT_RE = re.compile(
+    r"^(\S+)\s+(\S+)\s+n=(\d+)\s+avg=\s*(\d+) us\s+max=\s*(\d+) us(?:\s+(\d+) KiB/s)?"
+)
+
+# Preferred implementation of the NTZ rows when a test was run more than once
+NTZ_IMPL_ORDER = ("hw", "opt", "sw")
+
+
+def load_results(path):
+    """Return {(test, impl): avg_us} for the result lines of a log."""
+    results = {}
+
+    with open(path, "r", errors="replace") as stream:
+        for line in stream:
+            match = RESULT_RE.search(line.strip())
+            if match is None:
+                continue
+
+            results[(match.group(1), match.group(2))] = int(match.group(4))
+
+    logger.debug("%s: %d results", path, len(results))
+    return results
+
+
+def ntz_result(results, test):
+    """Return (impl, avg_us) of the fastest implementation built into the NTZ image."""
+    for impl in NTZ_IMPL_ORDER:
+        if (test, impl) in results:
+            return impl, results[(test, impl)]
+
+    return None, None
+
+
+def ratio(num, den):
+    if num is None or den is None or den == 0:
+        return None
+
+    return float(num) / float(den)
+
+
+def fmt_us(value):
+    return "-" if value is None else str(value)
+
+
+def fmt_ratio(value):
+    return "-" if value is None else "{:.2f}".format(value)
+
+
+def compare(ntz, tfm_sw, tfm_hw):
+    tests = sorted({test for (test, impl) in tfm_hw if impl == "psa"} |
+                   {test for (test, impl) in tfm_sw if impl == "psa"})
+    rows = []
+
+    for test in tests:
+        impl, ntz_us = ntz_result(ntz, test)
+        sw_us = tfm_sw.get((test, "psa"))
+        hw_us = tfm_hw.get((test, "psa"))
+
+        rows.append({
+            "test": test,
+            "ntz_impl": impl,
+            "ntz_us": ntz_us,
+            "tfm_sw_us": sw_us,
+            "tfm_hw_us": hw_us,
+            "speedup": ratio(sw_us, hw_us),
+            "overhead": ratio(hw_us, ntz_us),
+        })
+
+    return rows
+
+
+def print_rows(rows):
+    fmt = "{:<20} {:>12} {:>12} {:>12} {:>9} {:>9}"
+
+    print(fmt.format("test", "ntz us", "tfm-sw us", "tfm-hw us", "hw gain", "S / NTZ"))
+
+    for row in rows:
+        ntz = fmt_us(row["ntz_us"])
+        if row["ntz_impl"] is not None:
+            ntz = "{} {}".format(row["ntz_impl"], ntz)
+
+        print(
+            fmt.format(
+                row["test"], ntz, fmt_us(row["tfm_sw_us"]), fmt_us(row["tfm_hw_us"]),
+                fmt_ratio(row["speedup"]), fmt_ratio(row["overhead"])
+            )
+        )
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    parser.add_argument("ntz", help="cryptobench output of the NTZ image")
+    parser.add_argument("tfm_sw", help="cryptobench output of the TF-M image without secure accelerators")
+    parser.add_argument("tfm_hw", help="cryptobench output of the TF-M image with secure accelerators")
+    parser.add_argument(
+        "--max-overhead",
+        type=float,
+        help="Fail when a secure call with accelerators is this many times slower than NTZ",
+    )
+    parser.add_argument("-v", "--verbose", action="store_true", help="Enable debug logging")
+    args = parser.parse_args()
+
+    logging.basicConfig(level=logging.DEBUG if args.verbose else logging.INFO)
+
+    rows = compare(load_results(args.ntz), load_results(args.tfm_sw), load_results(args.tfm_hw))
+
+    if not rows:
+        logger.error("No psa results found in the TF-M logs.")
+        return 1
+
+    print_rows(rows)
+
+    result = 0
+
+    if args.max_overhead is not None:
+        for row in rows:
+            if row["overhead"] is not None and row["overhead"] > args.max_overhead:
+                logger.error(
+                    "%s: secure call takes %.2f times the NTZ time, over %.2f",
+                    row["test"], row["overhead"], args.max_overhead
+                )
+                result = 1
+
+    return result
+
+
+if __name__ == "__main__":
+    sys.exit(main())
@@ -0,0 +1,471 @@
+#!/usr/bin/env python3
+#  FreeRTOS STM32 Reference Integration
+#
+#  Copyright (C) 2022 Amazon.com, Inc. or its affiliates.  All Rights Reserved.
+#
+#  Permission is hereby granted, free of charge, to any person obtaining a copy of
+#  this software and associated documentation files (the "Software"), to deal in
+#  the Software without restriction, including without limitation the rights to
+#  use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+#  the Software, and to permit persons to whom the Software is furnished to do so,
+#  subject to the following conditions:
+#
+#  The above copyright notice and this permission notice shall be included in all
+#  copies or substantial portions of the Software.
+#
+#  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+#  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+#  FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+#  COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+#  IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+#  CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+#
+#  https://www.FreeRTOS.org
+#  https://github.com/FreeRTOS
+#
+
+"""Build a factory image for the b_u585i_iot02a_ntz project.
+
+The output directory receives a preformatted and prepopulated littlefs image
+with the geometry of lfs_port_ospi.c or lfs_port_internal_nor.c, a combined
+Intel HEX file holding the firmware, the filesystem and an optional
+provisioning image from provision.py --image, and flash_factory.sh, which
+programs all of it with STM32_Programmer_CLI.
+
+A board flashed this way mounts its filesystem on the first boot instead of
+formatting it in fs_init, and starts from a known kvstore and OTA state.
+"""
+
+import json
+import os
+import re
+import stat
+import struct
+from argparse import ArgumentParser
+
+try:
+    from littlefs import LittleFS
+except ImportError:
+    LittleFS = None
+
+SCRIPT_DIR = os.path.dirname(os.path.abspath(__file__))
+KVSTORE_CONFIG_H = os.path.join(
+    SCRIPT_DIR, os.pardir, "Common", "config", "kvstore_config.h"
+)
+
+INTERNAL_FLASH_ADDR = 0x08000000
+OSPI_FLASH_ADDR = 0x70000000
+
+# Memory mapped address of the provisioning image, see tools/stm32u5_tool.sh
+PROV_IMAGE_ADDR = OSPI_FLASH_ADDR
+PROV_IMAGE_MAX_LEN = 64 * 1024
+
+EXT_LOADER_NAME = "MX25LM51245G_STM32U585I-IOT02A.stldr"
+
+# Must match vPopulateConfig() in the littlefs port of each target
+FS_GEOMETRY = {
+    # Common/fs/lfs_port_ospi.c, at OPI_START_ADDRESS of the NOR flash
+    "ospi": {
+        "address": OSPI_FLASH_ADDR + 10 * 64 * 1024,
+        "read_size": 2,
+        "prog_size": 256,
+        "block_size": 4096,
+        "block_count": 1014,
+        "cache_size": 4096,
+        "lookahead_size": 256,
+        "block_cycles": 500,
+    },
+    # Common/fs/lfs_port_internal_nor.c, in the second internal flash bank
+    "internal_nor": {
+        "address": INTERNAL_FLASH_ADDR + 1024 * 1024,
+        "read_size": 1,
+        "prog_size": 16,
+        "block_size": 8192,
+        "block_count": 128,
+        "cache_size": 16,
+        "lookahead_size": 16,
+        "block_cycles": 500,
+    },
+}
+
+# KVStoreValueType_t in Common/kvstore/kvstore.h
+KV_TYPES = {
+    "KV_TYPE_BASE_T": 1,
+    "KV_TYPE_UBASE_T": 2,
+    "KV_TYPE_INT32": 3,
+    "KV_TYPE_UINT32": 4,
+    "KV_TYPE_STRING": 5,
+    "KV_TYPE_BLOB": 6,
+}
+
+KVSTORE_PREFIX = "/cfg/"
+KVSTORE_VAL_MAX_LEN = 256
+
+# OtaPalState_t in Projects/b_u585i_iot02a_ntz/Src/ota_pal/ota_pal_stm32u5_ntz.c
+OTA_PAL_STATES = {
+    "ready": 1,
+    "accepted": 8,
+}
+OTA_IMAGE_STATE_FILE = "/ota/image_state"
+
+
+def read_kv_types(path=KVSTORE_CONFIG_H):
+    """Return a dict of kvstore key name to KVStoreValueType_t value."""
+    with open(path, "r") as f:
+        text = f.read()
+
+    def macro_body(name):
+        match = re.search(
+            r"#define\s+{}\s*\\\n(.*?)(?<!\\)\n".format(name), text, re.DOTALL
+        )
+        if not match:
+            raise ValueError("{} not found in {}".format(name, path))
+        return match.group(1)
+
+    keys = re.findall(r'"(\w+)"', macro_body("KV_STORE_STRINGS"))
+    types = re.findall(r"KV_DFLT\(\s*(KV_TYPE_\w+)", macro_body("KV_STORE_DEFAULTS"))
+
+    if len(keys) != len(types):
+        raise ValueError("KV_STORE_STRINGS and KV_STORE_DEFAULTS do not match")
+
+    return {key: KV_TYPES[kv_type] for key, kv_type in zip(keys, types)}
+
+
+def encode_kv(kv_type, value):
+    """Encode a value as stored by Common/kvstore/kvstore_nv_littlefs.c."""
+    if kv_type == KV_TYPES["KV_TYPE_STRING"]:
+        data = bytes(value, "utf-8") + b"\0"
+    elif kv_type == KV_TYPES["KV_TYPE_BLOB"]:
+        data = bytes.fromhex(value)
+    elif kv_type in (KV_TYPES["KV_TYPE_BASE_T"], KV_TYPES["KV_TYPE_INT32"]):
+        data = struct.pack("<i", int(value, 0))
+    else:
+        data = struct.pack("<I", int(value, 0))
+
+    if len(data) > KVSTORE_VAL_MAX_LEN:
+        raise ValueError("Value of {} bytes is too long".format(len(data)))
+
+    # KVStoreTLVHeader_t
+    return struct.pack("<iI", kv_type, len(data)) + data
+
+
+def build_fs(geometry, config, kv_types, ota_state, files, disk_version=None):
+    """Return a littlefs image with the given contents, trimmed of erased blocks."""
+    params = {k: v for k, v in geometry.items() if k != "address"}
+    if disk_version is not None:
+        params["disk_version"] = disk_version
+
+    fs = LittleFS(mount=False, **params)
+    fs.format()
+    fs.mount()
+
+    fs.mkdir("/cfg")
+    fs.mkdir("/ota")
+
+    for key, value in config.items():
+        if key not in kv_types:
+            raise ValueError("Unknown kvstore key: {}".format(key))
+
+        with fs.open(KVSTORE_PREFIX + key, "wb") as f:
+            f.write(encode_kv(kv_types[key], value))
+
+    if ota_state:
+        # OtaPalNvContext_t: xPalState, ulFileTargetBank
+        with fs.open(OTA_IMAGE_STATE_FILE, "wb") as f:
+            f.write(struct.pack("<iI", OTA_PAL_STATES[ota_state], 0))
+
+    for src, dest in files:
+        with open(src, "rb") as f:
+            data = f.read()
+        with fs.open(dest, "wb") as f:
+            f.write(data)
+
+    fs.unmount()
+
+    # The littlefs ports erase each block before programming it, so blocks that
+    # were never written do not need to be programmed.
+    image = bytes(fs.context.buffer)
+    block_size = geometry["block_size"]
+    erased = b"\xff" * block_size
+    length = len(image)
+    while length > 0 and image[length - block_size : length] == erased:
+        length -= block_size
+
+    return image[:length]
+
+
+def ihex_record(rec_type, address, data=b""):
+    rec = struct.pack(">BHB", len(data), address, rec_type) + data
+    return ":{}{:02X}\n".format(rec.hex().upper(), -sum(rec) & 0xFF)
+
+
+def read_ihex(path):
+    """Return a list of (address, data) segments from an Intel HEX file."""
+    segments = []
+    base = 0
+    with open(path, "r") as f:
+        for line in f:
+            line = line.strip()
+            if not line.startswith(":"):
+                continue
+
+            rec = bytes.fromhex(line[1:])
+            if sum(rec) & 0xFF:
+                raise ValueError("Bad checksum in {}: {}".format(path, line))
+
+            length, address, rec_type = struct.unpack(">BHB", rec[:4])
+            data = rec[4 : 4 + length]
+
+            if rec_type == 0:
+                address += base
+                if segments and segments[-1][0] + len(segments[-1][1]) == address:
+                    segments[-1][1].extend(data)
+                else:
+                    segments.append((address, bytearray(data)))
+            elif rec_type == 1:
+                break
+            elif rec_type == 2:
+                base = struct.unpack(">H", data)[0] << 4
+            elif rec_type == 4:
+                base = struct.unpack(">H", data)[0] << 16
+
+    return segments
+
+
+def write_ihex(path, segments):
+    upper = None
+    with open(path, "w") as f:
+        for address, data in sorted(segments, key=lambda s: s[0]):
+            offset = 0
+            while offset < len(data):
+                addr = address + offset
+                if addr >> 16 != upper:
+                    upper = addr >> 16
+                    f.write(ihex_record(4, 0, struct.pack(">H", upper)))
+
+                # Records do not cross a 64K boundary
+                length = min(32, len(data) - offset, 0x10000 - (addr & 0xFFFF))
+                chunk = bytes(data[offset : offset + length])
+                f.write(ihex_record(0, addr & 0xFFFF, chunk))
+                offset += length
+        f.write(ihex_record(1, 0))
+
+
+FLASH_SCRIPT = """#!/bin/bash
+# Generated by tools/factory_image.py. Programs the factory image of the
+# b_u585i_iot02a_ntz project. Define STM32_PROGRAMMER_CLI and EXT_LOADER if
+# STM32_Programmer_CLI is not in your path.
+
+cd "$(dirname "$0")" || exit 1
+
+PROG_BIN="${{STM32_PROGRAMMER_CLI:-STM32_Programmer_CLI}}"
+{ext_loader_lookup}
+# Run STM32_Programmer_CLI and remove color codes.
+prog_cli()
+{{
+    echo "${{PROG_BIN}}" --quietMode -c port=SWD "$@"
+    "${{PROG_BIN}}" --quietMode -c port=SWD "$@" | sed 's/\\x1b\\[[0-9;]*m//g'
+}}
+
+echo "Setting NSBOOTADD0={nsbootadd0} SWAP_BANK=0."
+prog_cli speed=fast mode=UR -ob NSBOOTADD0={nsbootadd0} SWAP_BANK=0 || {{
+    echo "Error: Failed to set the option bytes."
+    exit 1
+}}
+
+sleep 1
+
+echo "Writing factory image."
+prog_cli speed=fast mode=UR {ext_loader_arg}-d "{hex_name}" -v || {{
+    echo "Error: Failed to program {hex_name}."
+    exit 1
+}}
+
+echo "Performing hard reset."
+prog_cli -hardRst || {{
+    echo "Error: Failed to perform hard reset."
+    exit 1
+}}
+
+echo && echo "Operation Completed." && echo
+"""
+
+EXT_LOADER_LOOKUP = """
+if [ -z "${{EXT_LOADER}}" ]; then
+    PROG_BIN_DIR=$(dirname "$(command -v "${{PROG_BIN}}")")
+    EXT_LOADER=$(find "${{PROG_BIN_DIR}}" -name "{ext_loader}" -type f | head -n 1)
+fi
+
+if [ -z "${{EXT_LOADER}}" ] || [ ! -e "${{EXT_LOADER}}" ]; then
+    echo "Error: Failed to locate the {ext_loader} external loader."
+    echo "Please define EXT_LOADER with its path."
+    exit 1
+fi
+"""
+
+
+def write_flash_script(path, hex_name, firmware_addr, ext_loader):
+    """Write a script programming the option bytes and the combined hex file.
+
+    The external loader is only needed when the image covers the OSPI flash.
+    """
+    lookup = ""
+    loader_arg = ""
+    if ext_loader:
+        lookup = EXT_LOADER_LOOKUP.format(ext_loader=EXT_LOADER_NAME)
+        loader_arg = '-el "${EXT_LOADER}" '
+
+    with open(path, "w") as f:
+        f.write(
+            FLASH_SCRIPT.format(
+                ext_loader_lookup=lookup,
+                ext_loader_arg=loader_arg,
+                nsbootadd0="0x{:x}".format(firmware_addr >> 7),
+                hex_name=hex_name,
+            )
+        )
+    mode = os.stat(path).st_mode
+    os.chmod(path, mode | stat.S_IXUSR | stat.S_IXGRP | stat.S_IXOTH)
+
+
+def process_args():
+    argparser = ArgumentParser(description=__doc__.splitlines()[0])
+    argparser.add_argument(
+        "firmware", help="Firmware image, either an Intel HEX or a raw binary file."
+    )
+    argparser.add_argument(
+        "--firmware-addr",
+        type=lambda v: int(v, 0),
+        default=INTERNAL_FLASH_ADDR,
+        help="Load address of a raw binary firmware image.",
+    )
+    argparser.add_argument(
+        "--fs", choices=FS_GEOMETRY.keys(), default="ospi", help="Filesystem target."
+    )
+    argparser.add_argument(
+        "--conf",
+        action="append",
+        default=[],
+        metavar="KEY=VALUE",
+        help="Set a kvstore value, as with 'conf set'. Blobs are given in hex.",
+    )
+    argparser.add_argument(
+        "--conf-file", help="JSON file with an object of kvstore keys and values."
+    )
+    argparser.add_argument(
+        "--file",
+        action="append",
+        default=[],
+        metavar="SRC:DEST",
+        help="Copy a host file into the filesystem.",
+    )
+    argparser.add_argument(
+        "--ota-state",
+        choices=["none"] + list(OTA_PAL_STATES.keys()),
+        default="ready",
+        help="Initial OTA PAL state written to " + OTA_IMAGE_STATE_FILE + ".",
+    )
+    argparser.add_argument(
+        "--prov-image",
+        help="Provisioning image from provision.py --image, holding the credentials.",
+    )
+    argparser.add_argument(
+        "--disk-version",
+        type=lambda v: int(v, 0),
+        help="littlefs on-disk version to write, e.g. 0x00020000, to match the "
+        "littlefs release in the firmware.",
+    )
+    argparser.add_argument(
+        "-o", "--output", default="factory", help="Output directory."
+    )
+    return argparser.parse_args()
+
+
+def main():
+    args = process_args()
+
+    if LittleFS is None:
+        raise SystemExit(
+            "Error: the littlefs-python package is required, see tools/requirements.txt"
+        )
+
+    geometry = FS_GEOMETRY[args.fs]
+
+    config = {}
+    if args.conf_file:
+        with open(args.conf_file, "r") as f:
+            config.update({k: str(v) for k, v in json.load(f).items()})
+    for entry in args.conf:
+        key, sep, value = entry.partition("=")
+        if not sep:
+            raise SystemExit("Error: --conf expects KEY=VALUE, got: " + entry)
+        config[key] = value
+
+    files = []
+    for entry in args.file:
+        src, sep, dest = entry.rpartition(":")
+        if not sep or not dest.startswith("/"):
+            raise SystemExit("Error: --file expects SRC:/DEST, got: " + entry)
+        files.append((src, dest))
+
+    ota_state = None if args.ota_state == "none" else args.ota_state
+
+    fs_image = build_fs(
+        geometry, config, read_kv_types(), ota_state, files, args.disk_version
+    )
+
+    if args.firmware.lower().endswith(".hex"):
+        segments = read_ihex(args.firmware)
+    else:
+        with open(args.firmware, "rb") as f:
+            segments = [(args.firmware_addr, bytearray(f.read()))]
+
+    firmware_addr = min(address for address, _ in segments)
+
+    fs_start = geometry["address"]
+    fs_end = fs_start + geometry["block_size"] * geometry["block_count"]
+    for address, data in segments:
+        if address < fs_end and fs_start < address + len(data):
+            raise SystemExit(
+                "Error: the firmware overlaps the filesystem at 0x{:08x}".format(
+                    fs_start
+                )
+            )
+    segments.append((fs_start, bytearray(fs_image)))
+
+    if args.prov_image:
+        with open(args.prov_image, "rb") as f:
+            prov_image = f.read()
+        if len(prov_image) > PROV_IMAGE_MAX_LEN:
+            raise SystemExit("Error: the provisioning image is too large")
+        segments.append((PROV_IMAGE_ADDR, bytearray(prov_image)))
+
+    os.makedirs(args.output, exist_ok=True)
+
+    fs_name = os.path.join(args.output, "lfs_{}.bin".format(args.fs))
+    with open(fs_name, "wb") as f:
+        f.write(fs_image)
+
+    hex_name = "factory.hex"
+    write_ihex(os.path.join(args.output, hex_name), segments)
+    write_flash_script(
+        os.path.join(args.output, "flash_factory.sh"),
+        hex_name,
+        firmware_addr,
+        any(address >= OSPI_FLASH_ADDR for address, _ in segments),
+    )
+
+    print(
+        "Wrote {} ({} of {} bytes used) at 0x{:08x}".format(
+            fs_name,
+            len(fs_image),
+            geometry["block_size"] * geometry["block_count"],
+            fs_start,
+        )
+    )
+    print("Wrote {}".format(os.path.join(args.output, hex_name)))
+    print("Program with {}".format(os.path.join(args.output, "flash_factory.sh")))
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,183 @@
+#!/usr/bin/env python3
+#  FreeRTOS STM32 Reference Integration
+#
+#  Copyright (C) 2022 Amazon.com, Inc. or its affiliates.  All Rights Reserved.
+#
+#  Permission is hereby granted, free of charge, to any person obtaining a copy of
+#  this software and associated documentation files (the "Software"), to deal in
+#  the Software without restriction, including without limitation the rights to
+#  use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+#  the Software, and to permit persons to whom the Software is furnished to do so,
+#  subject to the following conditions:
+#
+#  The above copyright notice and this permission notice shall be included in all
+#  copies or substantial portions of the Software.
+#
+#  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+#  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+#  FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+#  COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+#  IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+#  CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+#
+#  https://www.FreeRTOS.org
+#  https://github.com/FreeRTOS
+#
+
+"""Create a delta OTA image for the b_u585i_iot02a_ntz project.
+
+The delta rebuilds the new firmware image from the one running on the device,
+see Projects/b_u585i_iot02a_ntz/Src/ota_pal/ota_pal_delta.h for the format.
+Upload it as b_u585i_iot02a_ntz.delta. The signature in the OTA job must be
+the one of the new firmware image, since that is what the device verifies.
+"""
+
+import hashlib
+import struct
+from argparse import ArgumentParser
+
+DELTA_MAGIC = 0x544C4544
+RECORD_LEN = 12
+
+# Shortest copy that saves more than the record it needs
+MIN_MATCH_LEN = 32
+INDEX_KEY_LEN = 16
+INDEX_STEP = 4
+MAX_CANDIDATES = 16
+
+
+def index_source(source):
+    index = dict()
+    for pos in range(0, len(source) - INDEX_KEY_LEN + 1, INDEX_STEP):
+        candidates = index.setdefault(source[pos : pos + INDEX_KEY_LEN], [])
+        if len(candidates) < MAX_CANDIDATES:
+            candidates.append(pos)
+    return index
+
+
+def match_length(source, src_pos, target, dst_pos):
+    length = 0
+    limit = min(len(source) - src_pos, len(target) - dst_pos)
+    while length < limit and source[src_pos + length] == target[dst_pos + length]:
+        length += 1
+    return length
+
+
+def find_copies(source, target):
+    """Return a list of ( target offset, source offset, length ) copies."""
+    index = index_source(source)
+    copies = []
+    dst_pos = 0
+
+    while dst_pos + INDEX_KEY_LEN <= len(target):
+        best_src = 0
+        best_len = 0
+        for src_pos in index.get(target[dst_pos : dst_pos + INDEX_KEY_LEN], []):
+            length = match_length(source, src_pos, target, dst_pos)
+            if length > best_len:
+                best_src, best_len = src_pos, length
+
+        if best_len < MIN_MATCH_LEN:
+            dst_pos += 1
+            continue
+
+        # Grow the copy backwards over bytes that would otherwise be extra bytes
+        copied_up_to = copies[-1][0] + copies[-1][2] if copies else 0
+        while (
+            dst_pos > copied_up_to
+            and best_src > 0
+            and source[best_src - 1] == target[dst_pos - 1]
+        ):
+            dst_pos -= 1
+            best_src -= 1
+            best_len += 1
+
+        copies.append((dst_pos, best_src, best_len))
+        dst_pos += best_len
+
+    return copies
+
+
+def make_records(source, target):
+    """Turn the copies into ( copy source, copy length, extra bytes ) records."""
+    # The first record starts at source offset 0 and only seeks to the first copy
+    records = [[0, 0, b""]]
+    dst_pos = 0
+
+    for copy_dst, copy_src, copy_len in find_copies(source, target):
+        records[-1][2] += target[dst_pos:copy_dst]
+        records.append([copy_src, copy_len, b""])
+        dst_pos = copy_dst + copy_len
+
+    records[-1][2] += target[dst_pos:]
+
+    return records
+
+
+def make_delta(source, target):
+    delta = bytearray(
+        struct.pack("<III", DELTA_MAGIC, len(target), len(source))
+        + hashlib.sha256(source).digest()
+    )
+
+    records = make_records(source, target)
+
+    for i, (copy_src, copy_len, extra) in enumerate(records):
+        next_src = records[i + 1][0] if (i + 1) < len(records) else copy_src + copy_len
+        seek = next_src - (copy_src + copy_len)
+        delta += struct.pack("<IIi", copy_len, len(extra), seek) + extra
+
+    return bytes(delta)
+
+
+def apply_delta(source, delta):
+    """Rebuild the target image, the same way the device does."""
+    magic, target_len, source_len = struct.unpack_from("<III", delta, 0)
+    assert magic == DELTA_MAGIC and source_len == len(source)
+    assert delta[12:44] == hashlib.sha256(source).digest()
+
+    target = bytearray()
+    offset = 44
+    src_pos = 0
+    while len(target) < target_len:
+        copy_len, extra_len, seek = struct.unpack_from("<IIi", delta, offset)
+        offset += RECORD_LEN
+        target += source[src_pos : src_pos + copy_len]
+        target += delta[offset : offset + extra_len]
+        offset += extra_len
+        src_pos += copy_len + seek
+
+    assert offset == len(delta)
+    return bytes(target)
+
+
+def main():
+    argparser = ArgumentParser(description=__doc__.splitlines()[0])
+    argparser.add_argument("source", help="Firmware image running on the device.")
+    argparser.add_argument("target", help="New firmware image.")
+    argparser.add_argument("output", help="Delta image to write.")
+    args = argparser.parse_args()
+
+    with open(args.source, "rb") as f:
+        source = f.read()
+
+    with open(args.target, "rb") as f:
+        target = f.read()
+
+    delta = make_delta(source, target)
+
+    if apply_delta(source, delta) != target:
+        raise RuntimeError("Delta image does not rebuild the target image.")
+
+    with open(args.output, "wb") as f:
+        f.write(delta)
+
+    print(
+        "Wrote {} byte delta for a {} byte image ({:.1f}%).".format(
+            len(delta), len(target), 100.0 * len(delta) / max(len(target), 1)
+        )
+    )
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,160 @@
+#!/usr/bin/env python3
+#  FreeRTOS STM32 Reference Integration
+#
+#  Copyright (C) 2022 Amazon.com, Inc. or its affiliates.  All Rights Reserved.
+#
+#  Permission is hereby granted, free of charge, to any person obtaining a copy of
+#  this software and associated documentation files (the "Software"), to deal in
+#  the Software without restriction, including without limitation the rights to
+#  use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+#  the Software, and to permit persons to whom the Software is furnished to do so,
+#  subject to the following conditions:
+#
+#  The above copyright notice and this permission notice shall be included in all
+#  copies or substantial portions of the Software.
+#
+#  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+#  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+#  FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+#  COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+#  IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+#  CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+#
+#  https://www.FreeRTOS.org
+#  https://github.com/FreeRTOS
+#
+
+"""Create an LZ4 compressed OTA image for the b_u585i_iot02a_ntz project.
+
+See Projects/b_u585i_iot02a_ntz/Src/ota_pal/ota_pal_lz4.h for the format.
+Upload it as b_u585i_iot02a_ntz.lz4. The signature in the OTA job must be the
+one of the uncompressed firmware image, since that is what the device verifies.
+"""
+
+import struct
+from argparse import ArgumentParser
+
+LZ4_MAGIC = 0x55345A4C
+MIN_MATCH = 4
+MAX_OFFSET = 0xFFFF
+
+# The LZ4 block format ends with at least 5 literals and no match starts in the
+# last 12 bytes
+LAST_LITERALS = 5
+MF_LIMIT = 12
+
+
+def write_length(out, length):
+    while length >= 0xFF:
+        out.append(0xFF)
+        length -= 0xFF
+    out.append(length)
+
+
+def write_sequence(out, literals, offset, match_len):
+    lit_len = len(literals)
+    token = (min(lit_len, 15) << 4) | (min(match_len - MIN_MATCH, 15) if offset else 0)
+    out.append(token)
+    if lit_len >= 15:
+        write_length(out, lit_len - 15)
+    out += literals
+    if offset:
+        out += struct.pack("<H", offset)
+        if match_len - MIN_MATCH >= 15:
+            write_length(out, match_len - MIN_MATCH - 15)
+
+
+def compress_block(data):
+    """Greedy LZ4 block compression with a table of the last position per 4 bytes."""
+    out = bytearray()
+    table = dict()
+    anchor = 0
+    pos = 0
+    match_limit = len(data) - MF_LIMIT
+
+    while pos < match_limit:
+        key = data[pos : pos + MIN_MATCH]
+        candidate = table.get(key)
+        table[key] = pos
+
+        if candidate is None or pos - candidate > MAX_OFFSET:
+            pos += 1
+            continue
+
+        length = MIN_MATCH
+        limit = len(data) - LAST_LITERALS - pos
+        while length < limit and data[candidate + length] == data[pos + length]:
+            length += 1
+
+        write_sequence(out, data[anchor:pos], pos - candidate, length)
+        pos += length
+        anchor = pos
+
+    write_sequence(out, data[anchor:], 0, 0)
+    return bytes(out)
+
+
+def decompress_block(block, size):
+    """Decompress the block, the same way the device does."""
+    out = bytearray()
+    pos = 0
+    while True:
+        token = block[pos]
+        pos += 1
+        lit_len = token >> 4
+        if lit_len == 15:
+            while True:
+                lit_len += block[pos]
+                pos += 1
+                if block[pos - 1] != 0xFF:
+                    break
+        out += block[pos : pos + lit_len]
+        pos += lit_len
+        if len(out) == size:
+            break
+        offset = struct.unpack_from("<H", block, pos)[0]
+        pos += 2
+        match_len = token & 0x0F
+        if match_len == 15:
+            while True:
+                match_len += block[pos]
+                pos += 1
+                if block[pos - 1] != 0xFF:
+                    break
+        for _ in range(match_len + MIN_MATCH):
+            out.append(out[-offset])
+    assert pos == len(block)
+    return bytes(out)
+
+
+def main():
+    argparser = ArgumentParser(description=__doc__.splitlines()[0])
+    argparser.add_argument("image", help="Firmware image to compress.")
+    argparser.add_argument("output", help="Compressed image to write.")
+    args = argparser.parse_args()
+
+    with open(args.image, "rb") as f:
+        image = f.read()
+
+    try:
+        import lz4.block
+
+        block = lz4.block.compress(image, mode="high_compression", store_size=False)
+    except ImportError:
+        block = compress_block(image)
+
+    if decompress_block(block, len(image)) != image:
+        raise RuntimeError("Compressed image does not decompress to the image.")
+
+    with open(args.output, "wb") as f:
+        f.write(struct.pack("<II", LZ4_MAGIC, len(image)) + block)
+
+    print(
+        "Wrote {} byte compressed image for a {} byte image ({:.1f}%).".format(
+            len(block) + 8, len(image), 100.0 * (len(block) + 8) / max(len(image), 1)
+        )
+    )
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,748 @@
+#!/usr/bin/env python3
+#  FreeRTOS STM32 Reference Integration
+#
+#  Copyright (C) 2022 Amazon.com, Inc. or its affiliates.  All Rights Reserved.
+#
+#  Permission is hereby granted, free of charge, to any person obtaining a copy of
+#  this software and associated documentation files (the "Software"), to deal in
+#  the Software without restriction, including without limitation the rights to
+#  use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+#  the Software, and to permit persons to whom the Software is furnished to do so,
+#  subject to the following conditions:
+#
+#  The above copyright notice and this permission notice shall be included in all
+#  copies or substantial portions of the Software.
+#
+#  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+#  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+#  FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+#  COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+#  IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+#  CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+#
+#  https://www.FreeRTOS.org
+#  https://github.com/FreeRTOS
+#
+
+"""Sample performance counters of a running target through the debug probe.
+
+The target is read over SWD with pyOCD in attach mode, so the core is never
+halted and nothing goes through the console. Each sample decodes:
+
+- dwt:    the DWT cycle, CPI, exception, sleep, LSU and fold counters, and the
+          probes of Common/sys/profiler.c when PROFILER_ENABLED is 1
+- tasks:  the FreeRTOS task lists, with the run time counter of each task
+- lwip:   the lwip_stats protocol and pool counters
+- heap:   the heap_4 free space and the heap_classes.c counters
+- periph: xPeriphErrStats from Common/include/periph_stats.h and the error
+          flags of the USART1, SPI2, OCTOSPI1 and RNG status registers
+
+Symbol addresses and structure layouts come from the DWARF information of the
+firmware ELF file, and register layouts from tools/svd/STM32U5xx.svd.
+
+The target keeps running while it is read, so a list may change while it is
+walked. Pointers outside of RAM end a walk, and a sample that looks torn is
+simply replaced by the next one.
+"""
+
+import json
+import os
+import struct
+import sys
+import time
+import xml.etree.ElementTree as ET
+from argparse import ArgumentParser
+
+from elftools.elf.elffile import ELFFile
+from elftools.elf.sections import SymbolTableSection
+
+SCRIPT_DIR = os.path.dirname(os.path.abspath(__file__))
+SVD_PATH = os.path.join(SCRIPT_DIR, "svd", "STM32U5xx.svd")
+
+# RAM, SRAM3 and SRAM4 of the non-TrustZone linker script
+RAM_REGIONS = ((0x20000000, 0x200C0000), (0x28000000, 0x28004000))
+FLASH_REGION = (0x08000000, 0x08200000)
+
+MAX_TASKS = 64
+MAX_PROBES = 64
+MAX_NAME_LEN = 32
+STACK_FILL_BYTE = 0xA5
+STACK_SCAN_CHUNK = 256
+
+# Armv8-M data watchpoint and trace unit, not described by the SVD
+DWT_BASE = 0xE0001000
+DWT_COUNTERS = (
+    # Name, offset, enable bit in DWT_CTRL, width
+    ("cyccnt", 0x04, 0, 32),
+    ("cpicnt", 0x08, 17, 8),
+    ("exccnt", 0x0C, 18, 8),
+    ("sleepcnt", 0x10, 19, 8),
+    ("lsucnt", 0x14, 20, 8),
+    ("foldcnt", 0x18, 21, 8),
+)
+
+# Error flags reported from the SVD, by peripheral and register
+PERIPH_FLAGS = (
+    ("USART1", "ISR", ("PE", "FE", "NE", "ORE")),
+    ("SPI2", "SPI_SR", ("UDR", "OVR", "CRCE", "TIFRE", "MODF")),
+    ("OCTOSPI1", "SR", ("TEF", "TOF")),
+    ("RNG", "SR", ("SEIS", "CEIS", "SECS", "CECS")),
+)
+
+GROUPS = ("dwt", "tasks", "lwip", "heap", "periph")
+
+HEAP_SYMBOLS = (
+    "heap_4.c:xFreeBytesRemaining",
+    "heap_4.c:xMinimumEverFreeBytesRemaining",
+    "heap_4.c:xNumberOfSuccessfulAllocations",
+    "heap_4.c:xNumberOfSuccessfulFrees",
+    "heap_classes.c:uxCachedBytes",
+    "heap_classes.c:ulHits",
+    "heap_classes.c:ulMisses",
+    "heap_classes.c:ulFlushes",
+    "heap_classes.c:ulAllocFailures",
+    "heap_classes.c:uxLastFailedLen",
+    "heap_classes.c:xTagStats",
+)
+
+DW_ATE_BOOLEAN = 0x02
+DW_ATE_FLOAT = 0x04
+DW_ATE_SIGNED = 0x05
+DW_ATE_SIGNED_CHAR = 0x06
+DW_OP_ADDR = 0x03
+DW_OP_PLUS_UCONST = 0x23
+
+
+def in_ram(address, length=1):
+    return any(lo <= address and address + length <= hi for lo, hi in RAM_REGIONS)
+
+
+def in_memory(address, length=1):
+    """Return True for RAM, or for the internal flash holding constant strings."""
+    lo, hi = FLASH_REGION
+    return in_ram(address, length) or (lo <= address and address + length <= hi)
+
+
+class CType:
+    """A C type decoded from DWARF, able to decode a value of itself."""
+
+    def __init__(self, kind, size, name=None):
+        self.kind = kind
+        self.size = size
+        self.name = name
+        self.signed = False
+        self.is_float = False
+        self.members = []
+        self.element = None
+        self.count = 0
+        self.enumerators = {}
+        self._target = None
+
+    @property
+    def target(self):
+        """Type pointed to, resolved on first use since types may be recursive."""
+        if callable(self._target):
+            self._target = self._target()
+        return self._target
+
+    def member(self, name):
+        for member_name, offset, ctype in self.members:
+            if member_name == name:
+                return offset, ctype
+        raise KeyError("{} has no member {}".format(self.name, name))
+
+    def decode(self, data, offset=0):
+        if self.kind in ("base", "enum", "pointer"):
+            raw = data[offset : offset + self.size]
+            if self.is_float:
+                value = struct.unpack("<f" if self.size == 4 else "<d", raw)[0]
+            else:
+                value = int.from_bytes(raw, "little", signed=self.signed)
+            return self.enumerators.get(value, value) if self.enumerators else value
+        elif self.kind == "struct":
+            return {
+                name: ctype.decode(data, offset + member_offset)
+                for name, member_offset, ctype in self.members
+                if ctype is not None
+            }
+        elif self.kind == "array":
+            values = [
+                self.element.decode(data, offset + i * self.element.size)
+                for i in range(self.count)
+            ]
+            if self.element.name in ("char", "unsigned char", "signed char"):
+                text = bytes(v & 0xFF for v in values)
+                return text.split(b"\0", 1)[0].decode("ascii", "replace")
+            return values
+        return None
+
+
+class Dwarf:
+    """Global variables and structure layouts of a firmware ELF file."""
+
+    def __init__(self, path):
+        self._file = open(path, "rb")
+        self._elf = ELFFile(self._file)
+        self._types = {}
+        self.variables = {}
+        self.structs = {}
+
+        if not self._elf.has_dwarf_info():
+            raise SystemExit("Error: {} has no debug information".format(path))
+
+        symbols = {}
+        for section in self._elf.iter_sections():
+            if isinstance(section, SymbolTableSection):
+                for sym in section.iter_symbols():
+                    if sym["st_info"]["type"] == "STT_OBJECT":
+                        symbols.setdefault(sym.name, sym["st_value"])
+
+        for cu in self._elf.get_dwarf_info().iter_CUs():
+            top = cu.get_top_DIE()
+            unit = os.path.basename(self._attr(top, "DW_AT_name", b"").decode())
+
+            for die in top.iter_children():
+                if die.tag == "DW_TAG_variable":
+                    self._add_variable(unit, die, symbols)
+                elif die.tag == "DW_TAG_structure_type":
+                    name = self._attr(die, "DW_AT_name")
+                    if name and "DW_AT_declaration" not in die.attributes:
+                        self.structs.setdefault(name.decode(), die)
+
+    @staticmethod
+    def _attr(die, name, default=None):
+        attr = die.attributes.get(name)
+        return attr.value if attr is not None else default
+
+    def _add_variable(self, unit, die, symbols):
+        spec = die
+        if "DW_AT_specification" in die.attributes:
+            spec = die.get_DIE_from_attribute("DW_AT_specification")
+
+        name = self._attr(spec, "DW_AT_name")
+        if name is None or "DW_AT_type" not in spec.attributes:
+            return
+        name = name.decode()
+
+        address = None
+        location = self._attr(die, "DW_AT_location")
+        if isinstance(location, list) and len(location) == 5:
+            if location[0] == DW_OP_ADDR:
+                address = int.from_bytes(bytes(location[1:]), "little")
+        if address is None and "DW_AT_declaration" not in die.attributes:
+            address = symbols.get(name)
+        if address is None:
+            return
+
+        entry = (address, spec.get_DIE_from_attribute("DW_AT_type"))
+        self.variables.setdefault(name, entry)
+        self.variables["{}:{}".format(unit, name)] = entry
+
+    def variable(self, name):
+        """Return the address and CType of a variable, or None if it is not present.
+
+        Static variables may be qualified with their unit, e.g. heap_4.c:xStart.
+        """
+        entry = self.variables.get(name)
+        if entry is None:
+            return None
+        return entry[0], self.type_of(entry[1])
+
+    def struct(self, name):
+        die = self.structs.get(name)
+        return self.type_of(die) if die is not None else None
+
+    def type_of(self, die):
+        ctype = self._types.get(die.offset)
+        if ctype is None:
+            ctype = self._parse(die)
+            self._types[die.offset] = ctype
+        return ctype
+
+    def _parse(self, die):
+        tag = die.tag
+        size = self._attr(die, "DW_AT_byte_size", 0)
+        name = self._attr(die, "DW_AT_name")
+        name = name.decode() if name else None
+
+        if tag in (
+            "DW_TAG_typedef",
+            "DW_TAG_const_type",
+            "DW_TAG_volatile_type",
+            "DW_TAG_restrict_type",
+            "DW_TAG_atomic_type",
+        ):
+            if "DW_AT_type" not in die.attributes:
+                return CType("void", 0)
+            return self.type_of(die.get_DIE_from_attribute("DW_AT_type"))
+
+        if tag == "DW_TAG_base_type":
+            ctype = CType("base", size, name)
+            encoding = self._attr(die, "DW_AT_encoding")
+            ctype.signed = encoding in (DW_ATE_SIGNED, DW_ATE_SIGNED_CHAR)
+            ctype.is_float = encoding == DW_ATE_FLOAT
+            return ctype
+
+        if tag == "DW_TAG_pointer_type":
+            ctype = CType("pointer", size or 4, name)
+            if "DW_AT_type" in die.attributes:
+                target = die.get_DIE_from_attribute("DW_AT_type")
+                ctype._target = lambda: self.type_of(target)
+            return ctype
+
+        if tag == "DW_TAG_enumeration_type":
+            ctype = CType("enum", size, name)
+            for child in die.iter_children():
+                if child.tag == "DW_TAG_enumerator":
+                    value = self._attr(child, "DW_AT_const_value")
+                    label = self._attr(child, "DW_AT_name").decode()
+                    ctype.enumerators[value] = label
+            return ctype
+
+        if tag in ("DW_TAG_structure_type", "DW_TAG_union_type"):
+            ctype = CType("struct", size, name)
+            # Register before the members, which may point back at this type
+            self._types[die.offset] = ctype
+            for child in die.iter_children():
+                # Bit fields are not decoded
+                if child.tag != "DW_TAG_member" or "DW_AT_bit_size" in child.attributes:
+                    continue
+                offset = self._attr(child, "DW_AT_data_member_location", 0)
+                if isinstance(offset, list):
+                    # Older DWARF: DW_OP_plus_uconst <uleb128>
+                    is_uconst = offset[0] == DW_OP_PLUS_UCONST
+                    offset = self._uleb(offset[1:]) if is_uconst else 0
+                member_name = self._attr(child, "DW_AT_name", b"").decode()
+                member_die = child.get_DIE_from_attribute("DW_AT_type")
+                member_type = self.type_of(member_die)
+                ctype.members.append((member_name, offset, member_type))
+            return ctype
+
+        if tag == "DW_TAG_array_type":
+            element = self.type_of(die.get_DIE_from_attribute("DW_AT_type"))
+            dims = []
+            for child in die.iter_children():
+                if child.tag == "DW_TAG_subrange_type":
+                    count = self._attr(child, "DW_AT_count")
+                    if count is None:
+                        upper = self._attr(child, "DW_AT_upper_bound")
+                        count = upper + 1 if isinstance(upper, int) else 0
+                    dims.append(count)
+            # Inner dimensions first, so that a[2][3] is two arrays of three
+            for count in reversed(dims or [0]):
+                array = CType("array", element.size * count)
+                array.element = element
+                array.count = count
+                element = array
+            return element
+
+        return CType("void", size, name)
+
+    @staticmethod
+    def _uleb(data):
+        value = 0
+        for shift, byte in enumerate(data):
+            value |= (byte & 0x7F) << (7 * shift)
+            if not byte & 0x80:
+                break
+        return value
+
+
+class Svd:
+    """Register and field layouts of the peripherals listed in PERIPH_FLAGS."""
+
+    def __init__(self, path=SVD_PATH):
+        root = ET.parse(path).getroot()
+        self._peripherals = {p.findtext("name"): p for p in root.iter("peripheral")}
+
+    def register(self, peripheral_name, register_name):
+        """Return the address and a dict of field name to (offset, width)."""
+        peripheral = self._peripherals[peripheral_name]
+        base = int(peripheral.findtext("baseAddress"), 0)
+
+        # Derived peripherals only carry their base address
+        while peripheral.find("registers") is None:
+            peripheral = self._peripherals[peripheral.get("derivedFrom")]
+
+        for register in peripheral.iter("register"):
+            name = register.findtext("name")
+            # Some registers have one description per mode, e.g. ISR_enabled
+            if name == register_name or name.startswith(register_name + "_"):
+                fields = {
+                    f.findtext("name"): (
+                        int(f.findtext("bitOffset"), 0),
+                        int(f.findtext("bitWidth"), 0),
+                    )
+                    for f in register.iter("field")
+                }
+                return base + int(register.findtext("addressOffset"), 0), fields
+
+        raise KeyError(
+            "{}.{} not found in the SVD".format(peripheral_name, register_name)
+        )
+
+
+class Target:
+    """Memory of a running target, read through pyOCD without halting it."""
+
+    def __init__(self, probe=None, target="cortex_m", frequency=None):
+        from pyocd.core.helpers import ConnectHelper
+
+        options = {"connect_mode": "attach"}
+        if frequency:
+            options["frequency"] = frequency
+
+        self._session = ConnectHelper.session_with_chosen_probe(
+            unique_id=probe, target_override=target, options=options
+        )
+        if self._session is None:
+            raise SystemExit("Error: no debug probe found")
+
+        self._session.open()
+        self._target = self._session.board.target
+
+    def close(self):
+        self._session.close()
+
+    def read(self, address, length):
+        return bytes(self._target.read_memory_block8(address, length))
+
+    def read32(self, address):
+        return self._target.read32(address)
+
+    def read_words(self, address, count):
+        """Word accesses, as required by the debug and peripheral registers."""
+        return self._target.read_memory_block32(address, count)
+
+    def read_value(self, address, ctype):
+        return ctype.decode(self.read(address, ctype.size))
+
+    def read_string(self, address, max_len=MAX_NAME_LEN):
+        if not in_memory(address, max_len):
+            return "?"
+        return self.read(address, max_len).split(b"\0", 1)[0].decode("ascii", "replace")
+
+
+def flatten(value, prefix):
+    """Return the integer leaves of a decoded value as a flat dict."""
+    leaves = {}
+    if isinstance(value, dict):
+        for name, member in value.items():
+            leaves.update(flatten(member, "{}.{}".format(prefix, name)))
+    elif isinstance(value, list):
+        for i, element in enumerate(value):
+            leaves.update(flatten(element, "{}[{}]".format(prefix, i)))
+    elif isinstance(value, (int, float)):
+        leaves[prefix] = value
+    return leaves
+
+
+class Sampler:
+    def __init__(self, target, dwarf, svd, scan_stacks=False):
+        self._target = target
+        self._dwarf = dwarf
+        self._svd = svd
+        self._scan_stacks = scan_stacks
+        self._flags = None
+
+    def dwt(self):
+        values = {}
+        words = self._target.read_words(DWT_BASE, 7)
+        ctrl = words[0]
+
+        for name, offset, enable_bit, width in DWT_COUNTERS:
+            if ctrl & (1 << enable_bit):
+                values["dwt." + name] = words[offset // 4] & ((1 << width) - 1)
+
+        probes = self._dwarf.variable("profiler.c:pxProbeHead")
+        if probes is not None:
+            address, ptr_type = probes
+            probe_type = ptr_type.target
+            probe = self._target.read32(address)
+            for _ in range(MAX_PROBES):
+                if not in_ram(probe, probe_type.size):
+                    break
+                fields = self._target.read_value(probe, probe_type)
+                prefix = "prof." + self._target.read_string(fields["pcName"])
+                values[prefix + ".count"] = fields["ulCount"]
+                values[prefix + ".max_cycles"] = fields["ulMaxCycles"]
+                values[prefix + ".sum_cycles"] = fields["ullSumCycles"]
+                probe = fields["pxNext"]
+
+        return values
+
+    def _walk_list(self, address, list_type):
+        """Return the owners of the items of a FreeRTOS List_t."""
+        end_offset, end_type = list_type.member("xListEnd")
+        item_type = end_type.member("pxNext")[1].target
+        end = address + end_offset
+
+        items = self._target.read_value(address, list_type)
+        item = items["xListEnd"]["pxNext"]
+        owners = []
+
+        for _ in range(min(items["uxNumberOfItems"], MAX_TASKS)):
+            if item == end or not in_ram(item, item_type.size):
+                break
+            fields = self._target.read_value(item, item_type)
+            owners.append(fields["pvOwner"])
+            item = fields["pxNext"]
+
+        return owners
+
+    def _stack_free(self, tcb):
+        """Bytes of the stack of a task that still hold the fill pattern."""
+        start = tcb["pxStack"]
+        end = tcb.get("pxEndOfStack", start)
+        free = 0
+        while start + free < end:
+            length = min(STACK_SCAN_CHUNK, end - (start + free))
+            chunk = self._target.read(start + free, length)
+            used = next(
+                (i for i, b in enumerate(chunk) if b != STACK_FILL_BYTE), None
+            )
+            if used is not None:
+                return free + used
+            free += length
+        return free
+
+    def tasks(self):
+        current = self._dwarf.variable("tasks.c:pxCurrentTCB")
+        if current is None:
+            return {}, []
+
+        address, ptr_type = current
+        tcb_type = ptr_type.target
+        current_tcb = self._target.read32(address)
+
+        states = []
+        ready = self._dwarf.variable("tasks.c:pxReadyTasksLists")
+        if ready is not None:
+            ready_addr, ready_type = ready
+            list_type = ready_type.element
+            for prio in range(ready_type.count):
+                states.append(("R", ready_addr + prio * list_type.size, list_type))
+        for name, state in (
+            ("xPendingReadyList", "R"),
+            ("xDelayedTaskList1", "B"),
+            ("xDelayedTaskList2", "B"),
+            ("xSuspendedTaskList", "S"),
+            ("xTasksWaitingTermination", "D"),
+        ):
+            var = self._dwarf.variable("tasks.c:" + name)
+            if var is not None:
+                states.append((state, var[0], var[1]))
+
+        total = self._dwarf.variable("tasks.c:ulTotalRunTime")
+        values = {}
+        if total is not None:
+            # An array of one per core in the recent kernels
+            run_time = self._target.read_value(*total)
+            if isinstance(run_time, list):
+                run_time = run_time[0]
+            values["tasks.total_run_time"] = run_time
+
+        rows = []
+        seen = set()
+        for state, list_addr, list_type in states:
+            for tcb_addr in self._walk_list(list_addr, list_type):
+                if tcb_addr in seen or not in_ram(tcb_addr, tcb_type.size):
+                    continue
+                seen.add(tcb_addr)
+
+                tcb = self._target.read_value(tcb_addr, tcb_type)
+                row = {
+                    "name": tcb["pcTaskName"],
+                    "state": "X" if tcb_addr == current_tcb else state,
+                    "prio": tcb["uxPriority"],
+                    "run_time": tcb.get("ulRunTimeCounter", 0),
+                }
+                if self._scan_stacks:
+                    row["stack_free"] = self._stack_free(tcb)
+                rows.append(row)
+
+        return values, rows
+
+    def lwip(self):
+        stats = self._dwarf.variable("lwip_stats")
+        if stats is None:
+            return {}
+
+        address, stats_type = stats
+        fields = self._target.read_value(address, stats_type)
+        values = {}
+
+        for name, value in fields.items():
+            if name == "memp":
+                # Pointers to the stats of each pool, named by the pool
+                memp_type = stats_type.member("memp")[1]
+                pool_type = memp_type.element.target
+                for pool in value:
+                    if not in_ram(pool, pool_type.size):
+                        continue
+                    pool_fields = self._target.read_value(pool, pool_type)
+                    pool_name = self._target.read_string(pool_fields.pop("name", 0))
+                    values.update(flatten(pool_fields, "lwip.memp." + pool_name))
+            else:
+                values.update(flatten(value, "lwip." + name))
+
+        return values
+
+    def heap(self):
+        values = {}
+        for name in HEAP_SYMBOLS:
+            var = self._dwarf.variable(name)
+            if var is not None:
+                short = name.split(":", 1)[1]
+                values.update(flatten(self._target.read_value(*var), "heap." + short))
+        return values
+
+    def periph(self):
+        values = {}
+        stats = self._dwarf.variable("xPeriphErrStats")
+        if stats is not None:
+            values.update(flatten(self._target.read_value(*stats), "periph"))
+
+        if self._flags is None:
+            self._flags = [
+                (peripheral, register, self._svd.register(peripheral, register), names)
+                for peripheral, register, names in PERIPH_FLAGS
+            ]
+
+        for peripheral, register, (address, fields), names in self._flags:
+            raw = self._target.read32(address)
+            for name in names:
+                offset, width = fields[name]
+                key = "periph.{}.{}.{}".format(peripheral, register, name)
+                values[key] = (raw >> offset) & ((1 << width) - 1)
+
+        return values
+
+
+def print_sample(elapsed, scalars, previous, rows, prev_rows, dt):
+    print("=== {:.1f} s ===".format(elapsed))
+
+    for name, value in scalars.items():
+        line = "{:<56} {:>14}".format(name, value)
+        if name in previous and value != previous[name] and dt > 0:
+            delta = value - previous[name]
+            if name.startswith("dwt."):
+                width = next(w for n, _, _, w in DWT_COUNTERS if "dwt." + n == name)
+                delta %= 1 << width
+            line += " {:>+14.1f}/s".format(delta / dt)
+        print(line)
+
+    if rows:
+        total = scalars.get("tasks.total_run_time")
+        prev_total = previous.get("tasks.total_run_time")
+        run_delta = (total - prev_total) & 0xFFFFFFFF if prev_total is not None else 0
+        prev_run = {r["name"]: r["run_time"] for r in prev_rows}
+
+        row_format = "{:<16} {:>5} {:>4} {:>7} {:>10}"
+        print(row_format.format("task", "state", "prio", "cpu %", "stack free"))
+        for row in sorted(rows, key=lambda r: -r["prio"]):
+            cpu = ""
+            if run_delta and row["name"] in prev_run:
+                ran = (row["run_time"] - prev_run[row["name"]]) & 0xFFFFFFFF
+                cpu = "{:.1f}".format(100.0 * ran / run_delta)
+            print(
+                row_format.format(
+                    row["name"],
+                    row["state"],
+                    row["prio"],
+                    cpu,
+                    row.get("stack_free", ""),
+                )
+            )
+    print()
+
+
+def process_args():
+    argparser = ArgumentParser(description=__doc__.splitlines()[0])
+    argparser.add_argument("elf", help="Firmware ELF file running on the target.")
+    argparser.add_argument(
+        "-g",
+        "--groups",
+        default=",".join(GROUPS),
+        help="Comma separated groups to sample: " + ", ".join(GROUPS) + ".",
+    )
+    argparser.add_argument(
+        "-i", "--interval", type=float, default=1.0, help="Seconds between samples."
+    )
+    argparser.add_argument(
+        "-n",
+        "--count",
+        type=int,
+        default=0,
+        help="Samples to take, 0 until interrupted.",
+    )
+    argparser.add_argument(
+        "--stacks",
+        action="store_true",
+        help="Scan each task stack for unused space, which reads much more memory.",
+    )
+    argparser.add_argument(
+        "--json", action="store_true", help="Print one JSON object per sample."
+    )
+    argparser.add_argument("--probe", help="Unique ID of the debug probe to use.")
+    argparser.add_argument(
+        "--target", default="cortex_m", help="pyOCD target type, e.g. stm32u585aiix."
+    )
+    argparser.add_argument("--frequency", type=int, help="SWD clock frequency in Hz.")
+    return argparser.parse_args()
+
+
+def main():
+    args = process_args()
+    groups = [g.strip() for g in args.groups.split(",") if g.strip()]
+
+    for group in groups:
+        if group not in GROUPS:
+            raise SystemExit("Error: unknown group: " + group)
+
+    dwarf = Dwarf(args.elf)
+    target = Target(args.probe, args.target, args.frequency)
+    sampler = Sampler(target, dwarf, Svd(), args.stacks)
+
+    previous = {}
+    prev_rows = []
+    prev_time = None
+    start = time.monotonic()
+    samples = 0
+
+    try:
+        while args.count == 0 or samples < args.count:
+            now = time.monotonic()
+            scalars = {}
+            rows = []
+
+            for group in groups:
+                result = getattr(sampler, group)()
+                if group == "tasks":
+                    values, rows = result
+                    scalars.update(values)
+                else:
+                    scalars.update(result)
+
+            if args.json:
+                sample = {"time": round(now - start, 3), "values": scalars}
+                sample["tasks"] = rows
+                print(json.dumps(sample))
+                sys.stdout.flush()
+            else:
+                dt = now - prev_time if prev_time is not None else 0
+                print_sample(now - start, scalars, previous, rows, prev_rows, dt)
+
+            previous, prev_rows, prev_time = scalars, rows, now
+            samples += 1
+
+            if args.count == 0 or samples < args.count:
+                time.sleep(max(0.0, args.interval - (time.monotonic() - now)))
+    except KeyboardInterrupt:
+        pass
+    finally:
+        target.close()
+
+
+if __name__ == "__main__":
+    main()
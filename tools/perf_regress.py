@@ -0,0 +1,447 @@
+#!/usr/bin/env python3
+#  FreeRTOS STM32 Reference Integration
+#
+#  Copyright (C) 2022 Amazon.com, Inc. or its affiliates.  All Rights Reserved.
+#
+#  Permission is hereby granted, free of charge, to any person obtaining a copy of
+#  this software and associated documentation files (the "Software"), to deal in
+#  the Software without restriction, including without limitation the rights to
+#  use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+#  the Software, and to permit persons to whom the Software is furnished to do so,
+#  subject to the following conditions:
+#
+#  The above copyright notice and this permission notice shall be included in all
+#  copies or substantial portions of the Software.
+#
+#  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+#  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+#  FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+#  COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+#  IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+#  CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+#
+#  https://www.FreeRTOS.org
+#  https://github.com/FreeRTOS
+#
+
+"""Collect performance numbers from a board and compare them with a baseline.
+
+The script optionally builds and flashes the b_u585i_iot02a_ntz project with
+the TestIntegration scripts, then drives the benchmarks of the CLI over the
+serial console and parses their output:
+
+  footprint    flash and RAM use, from the sections of the ELF file
+  boot         time to reach each boot stage, from the "boottime" command
+  perftest     the PERF lines of the on-target performance tests
+  cryptobench  latency and throughput of the crypto primitives
+  iperf        TCP throughput to an iperf2 server, with --iperf-host
+  mqttload     publish latency and rate through the MQTT agent
+
+Each metric knows whether lower or higher values are better. A metric
+regresses when it is worse than the baseline by more than its tolerance, in
+which case the script exits with status 1. Typical use with a board attached:
+
+  % python tools/perf_regress.py --build --flash --update-baseline
+  (change the firmware)
+  % python tools/perf_regress.py --build --flash
+
+Baselines are JSON files. Tolerances can be set per metric by adding a
+"tolerance_pct" to its entry in the baseline file.
+"""
+
+import argparse
+import json
+import logging
+import os
+import re
+import subprocess
+import sys
+from time import monotonic, sleep
+
+import serial
+import serial.tools.list_ports
+
+logger = logging.getLogger()
+
+SCRIPT_DIR = os.path.dirname(os.path.realpath(__file__))
+WORKSPACE_DIR = os.path.realpath(os.path.join(SCRIPT_DIR, ".."))
+PROJECT_DIR = os.path.join(WORKSPACE_DIR, "Projects", "b_u585i_iot02a_ntz")
+DEFAULT_ELF = os.path.join(PROJECT_DIR, "Debug", "b_u585i_iot02a_ntz.elf")
+DEFAULT_BASELINE = os.path.join(PROJECT_DIR, "perf_baseline.json")
+ALL_SUITES = ("footprint", "boot", "perftest", "cryptobench", "iperf", "mqttload")
+
+# Sections of STM32U585AIIXQ_FLASH.ld by memory. .data is loaded from flash into RAM.
+FLASH_SECTIONS = (
+    ".isr_vector",
+    ".text",
+    ".rodata",
+    ".ARM.extab",
+    ".ARM",
+    ".preinit_array",
+    ".init_array",
+    ".fini_array",
+    ".data",
+)
+RAM_SECTIONS = (".data", ".bss", ".sram3", ".sram4", "._user_heap_stack")
+
+PERF_RE = re.compile(r"PERF,([^,\s]+),(\d+),(\d+),([^,\s]+)")
+CRYPTO_RE = re.compile(
+    r"^\s*(\S+)\s+(\S+)\s+n=\s*\d+\s+avg=\s*(\d+) us\s+max=\s*(\d+) us(?:\s+(\d+) KiB/s)?"
+)
+BOOT_RE = re.compile(r"^(\w+)\s+(\d+|-)\s+(\d+|-)")
+IPERF_RE = re.compile(
+    r"\[(\w+) client\] .* (\d+) kbit/s, (\d+) retransmits, CPU (\d+)\.(\d) %"
+)
+MQTTLOAD_RE = re.compile(r"^\|\s*([a-z0-9 /()<=]+?)\s*\|\s*(\d+)\s*\|")
+MQTTLOAD_METRICS = {
+    "latency avg (us)": ("mqttload.latency_avg", "us", "lower"),
+    "latency p99 (ms) <=": ("mqttload.latency_p99", "ms", "lower"),
+    "latency max (us)": ("mqttload.latency_max", "us", "lower"),
+    "publishes / s": ("mqttload.rate", "msg/s", "higher"),
+    "agent queue full": ("mqttload.queue_full", "count", "lower"),
+    "no agent command": ("mqttload.no_command", "count", "lower"),
+}
+
+
+class Metric:
+    def __init__(self, value, unit, better):
+        self.value = value
+        self.unit = unit
+        self.better = better
+
+    def to_dict(self):
+        return {"value": self.value, "unit": self.unit, "better": self.better}
+
+
+class Console:
+    """Serial console of the CLI, modelled on the TargetDevice of provision.py."""
+
+    class ResponseTimeout(Exception):
+        """Raised when the prompt does not come back within the timeout"""
+
+        pass
+
+    def __init__(self, device, baud):
+        self.ser = serial.Serial(device, baud, timeout=0.1, rtscts=False)
+        self.ser.reset_input_buffer()
+        self.ser.reset_output_buffer()
+        self.log = []
+
+    def _readline(self):
+        line = self.ser.readline()
+        if len(line) > 0:
+            text = line.decode("utf-8", errors="replace").rstrip("\r\n")
+            logging.debug("RX: {}".format(text))
+            self.log.append(text)
+            return text
+        return None
+
+    def sync(self):
+        """Send Control+C (0x03) to clear the current line and wait for the prompt."""
+        self.ser.write(b"\x03")
+        self.ser.flush()
+        try:
+            self.read_until_prompt(timeout=2.0)
+        except Console.ResponseTimeout:
+            pass
+
+    def read_until_prompt(self, timeout):
+        lines = []
+        timeout_time = monotonic() + timeout
+
+        while monotonic() < timeout_time:
+            line = self._readline()
+            if line is None:
+                continue
+            if line.startswith("> "):
+                return lines
+            lines.append(line)
+
+        raise Console.ResponseTimeout()
+
+    def wait_for(self, regex, timeout):
+        """Return the first match of regex in the console output, or None."""
+        timeout_time = monotonic() + timeout
+
+        while monotonic() < timeout_time:
+            line = self._readline()
+            if line is not None:
+                match = regex.search(line)
+                if match:
+                    return match
+        return None
+
+    def run(self, cmd, timeout=10.0):
+        """Run a command and return the lines it printed, including log lines."""
+        logging.info("Running: {}".format(cmd))
+        self.ser.write(cmd.encode("ascii") + b"\r\n")
+        self.ser.flush()
+        return self.read_until_prompt(timeout)
+
+
+def find_serial_port(usbVendorId=0x0483, usbProductId=0x374E):
+    for port in serial.tools.list_ports.comports():
+        if port.vid == usbVendorId and port.pid == usbProductId:
+            return port.device
+    return None
+
+
+def run_script(name):
+    script = os.path.join(WORKSPACE_DIR, "TestIntegration", name)
+    logging.info("Running {}".format(script))
+    subprocess.run([script], check=True)
+
+
+def collect_footprint(elf, size_tool):
+    """Return the flash and RAM use of the image in bytes."""
+    output = subprocess.run(
+        [size_tool, "-A", elf], check=True, capture_output=True, text=True
+    ).stdout
+    sections = {}
+    for line in output.splitlines():
+        fields = line.split()
+        if len(fields) >= 2 and fields[1].isdigit():
+            sections[fields[0]] = int(fields[1])
+
+    return {
+        "footprint.flash": Metric(
+            sum(sections.get(name, 0) for name in FLASH_SECTIONS), "bytes", "lower"
+        ),
+        "footprint.ram": Metric(
+            sum(sections.get(name, 0) for name in RAM_SECTIONS), "bytes", "lower"
+        ),
+    }
+
+
+def collect_boot(console, timeout):
+    """Reset the board and read the boot stage times once MQTT is connected."""
+    metrics = {}
+
+    console.ser.write(b"reset\r\n")
+    console.ser.flush()
+
+    if console.wait_for(re.compile(r"Boot \d+ times \(ms\):"), timeout) is None:
+        logging.warning("No MQTT connection within {} s, boot times are partial.".format(timeout))
+
+    sleep(1.0)
+    console.sync()
+
+    for line in console.run("boottime"):
+        match = BOOT_RE.match(line)
+        if match and match.group(2) != "-":
+            metrics["boot." + match.group(1)] = Metric(int(match.group(2)), "ms", "lower")
+
+    return metrics
+
+
+def collect_perftest(console, timeout):
+    metrics = {}
+    for line in console.run("perftest", timeout=timeout):
+        match = PERF_RE.search(line)
+        if match:
+            unit = match.group(4)
+            better = "higher" if unit.endswith("/s") else "lower"
+            metrics["perftest." + match.group(1)] = Metric(int(match.group(2)), unit, better)
+    return metrics
+
+
+def collect_cryptobench(console, timeout):
+    metrics = {}
+    for line in console.run("cryptobench", timeout=timeout):
+        match = CRYPTO_RE.match(line)
+        if match:
+            name = "crypto.{}.{}".format(match.group(1), match.group(2))
+            metrics[name + ".avg"] = Metric(int(match.group(3)), "us", "lower")
+            if match.group(5) is not None:
+                metrics[name + ".rate"] = Metric(int(match.group(5)), "KiB/s", "higher")
+    return metrics
+
+
+def collect_iperf(console, host, timeout):
+    metrics = {}
+    for line in console.run("iperf -c {} -t 10".format(host), timeout=timeout):
+        match = IPERF_RE.search(line)
+        if match:
+            metrics["iperf.tcp.rate"] = Metric(int(match.group(2)), "kbit/s", "higher")
+            metrics["iperf.tcp.retransmits"] = Metric(int(match.group(3)), "count", "lower")
+            metrics["iperf.tcp.cpu"] = Metric(
+                int(match.group(4)) * 10 + int(match.group(5)), "permille", "lower"
+            )
+    return metrics
+
+
+def collect_mqttload(console, timeout):
+    metrics = {}
+    for line in console.run("mqttload -r 20 -n 2 -t 10", timeout=timeout):
+        match = MQTTLOAD_RE.match(line)
+        if match and match.group(1) in MQTTLOAD_METRICS:
+            name, unit, better = MQTTLOAD_METRICS[match.group(1)]
+            metrics[name] = Metric(int(match.group(2)), unit, better)
+    return metrics
+
+
+def compare(results, baseline, default_tolerance):
+    """Print a comparison table and return the names of the regressed metrics."""
+    regressions = []
+
+    print("{:<40} {:>12} {:>12} {:>8}  {}".format("Metric", "Baseline", "Result", "Change", "Status"))
+
+    for name in sorted(set(results) | set(baseline)):
+        base = baseline.get(name)
+        result = results.get(name)
+
+        if result is None:
+            print("{:<40} {:>12} {:>12} {:>8}  missing".format(name, base["value"], "-", "-"))
+            continue
+        if base is None:
+            print("{:<40} {:>12} {:>12} {:>8}  new".format(name, "-", result.value, "-"))
+            continue
+
+        tolerance = base.get("tolerance_pct", default_tolerance)
+        change = 0.0
+        if base["value"] != 0:
+            change = 100.0 * (result.value - base["value"]) / base["value"]
+
+        worse = change if result.better == "lower" else -change
+        status = "ok"
+        if worse > tolerance:
+            status = "REGRESSION"
+            regressions.append(name)
+        elif worse < -tolerance:
+            status = "improved"
+
+        print(
+            "{:<40} {:>12} {:>12} {:>+7.1f}%  {}".format(
+                name, base["value"], result.value, change, status
+            )
+        )
+
+    return regressions
+
+
+def process_args():
+    parser = argparse.ArgumentParser(
+        description=__doc__, formatter_class=argparse.RawDescriptionHelpFormatter
+    )
+    parser.add_argument("-v", "--verbose", action="store_true")
+    parser.add_argument("-d", "--device", type=str, help="Serial port of the board")
+    parser.add_argument("--baud", type=int, default=115200)
+    parser.add_argument("--build", action="store_true", help="Run TestIntegration/build.sh first")
+    parser.add_argument("--flash", action="store_true", help="Run TestIntegration/flash.sh first")
+    parser.add_argument("--elf", type=str, default=DEFAULT_ELF)
+    parser.add_argument("--size-tool", type=str, default="arm-none-eabi-size")
+    parser.add_argument(
+        "--suites",
+        type=str,
+        default="footprint,boot,perftest,cryptobench",
+        help="Comma separated list of: {}".format(", ".join(ALL_SUITES)),
+    )
+    parser.add_argument("--iperf-host", type=str, help="iperf2 server for the iperf suite")
+    parser.add_argument("--boot-timeout", type=float, default=90.0)
+    parser.add_argument("--cmd-timeout", type=float, default=600.0)
+    parser.add_argument("--baseline", type=str, default=DEFAULT_BASELINE)
+    parser.add_argument("--update-baseline", action="store_true", help="Store the results as the new baseline")
+    parser.add_argument("--tolerance", type=float, default=10.0, help="Default tolerance in percent")
+    parser.add_argument("--output", type=str, help="Write the results to a JSON file")
+    parser.add_argument("--log", type=str, help="Write the console output to a file")
+
+    return parser.parse_args()
+
+
+def main():
+    args = process_args()
+
+    if args.verbose:
+        logging.getLogger().setLevel(logging.DEBUG)
+
+    suites = [suite.strip() for suite in args.suites.split(",") if suite.strip()]
+    for suite in suites:
+        if suite not in ALL_SUITES:
+            logging.error("Unknown suite: {}".format(suite))
+            raise SystemExit(2)
+
+    if args.build:
+        run_script("build.sh")
+    if args.flash:
+        run_script("flash.sh")
+
+    results = {}
+
+    if "footprint" in suites:
+        results.update(collect_footprint(args.elf, args.size_tool))
+
+    console_suites = [suite for suite in suites if suite != "footprint"]
+    if console_suites:
+        devpath = args.device or find_serial_port()
+        if not devpath:
+            logging.error('The serial port could not be determined automatically. Please use the "--device" argument')
+            raise SystemExit(2)
+
+        console = Console(devpath, args.baud)
+        console.sync()
+
+        try:
+            if "boot" in suites:
+                results.update(collect_boot(console, args.boot_timeout))
+            if "perftest" in suites:
+                results.update(collect_perftest(console, args.cmd_timeout))
+            if "cryptobench" in suites:
+                results.update(collect_cryptobench(console, args.cmd_timeout))
+            if "iperf" in suites:
+                if args.iperf_host:
+                    results.update(collect_iperf(console, args.iperf_host, args.cmd_timeout))
+                else:
+                    logging.warning("Skipping the iperf suite, --iperf-host is not set.")
+            if "mqttload" in suites:
+                results.update(collect_mqttload(console, args.cmd_timeout))
+        except Console.ResponseTimeout:
+            logging.error("The board stopped responding.")
+            raise SystemExit(2)
+        finally:
+            if args.log:
+                with open(args.log, "w") as log_file:
+                    log_file.write("\n".join(console.log) + "\n")
+
+    result_dict = {name: metric.to_dict() for name, metric in results.items()}
+
+    if args.output:
+        with open(args.output, "w") as output_file:
+            json.dump({"metrics": result_dict}, output_file, indent=2, sort_keys=True)
+
+    if args.update_baseline:
+        # Keep the tolerances chosen for existing metrics
+        if os.path.exists(args.baseline):
+            with open(args.baseline) as baseline_file:
+                previous = json.load(baseline_file).get("metrics", {})
+            for name, entry in result_dict.items():
+                if "tolerance_pct" in previous.get(name, {}):
+                    entry["tolerance_pct"] = previous[name]["tolerance_pct"]
+
+        with open(args.baseline, "w") as baseline_file:
+            json.dump({"metrics": result_dict}, baseline_file, indent=2, sort_keys=True)
+        print("Stored {} metrics in {}".format(len(result_dict), args.baseline))
+        return 0
+
+    if not os.path.exists(args.baseline):
+        logging.error("No baseline at {}, run with --update-baseline first.".format(args.baseline))
+        return 2
+
+    with open(args.baseline) as baseline_file:
+        baseline = json.load(baseline_file).get("metrics", {})
+
+    regressions = compare(results, baseline, args.tolerance)
+
+    if regressions:
+        print("{} metrics regressed: {}".format(len(regressions), ", ".join(regressions)))
+        return 1
+
+    print("No regressions.")
+    return 0
+
+
+if __name__ == "__main__":
+    logging.basicConfig(
+        level=logging.INFO,
+        format="[ %(levelname)s ] %(message)s (%(filename)s:%(funcName)s)",
+    )
+    sys.exit(main())
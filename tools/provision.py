@@ -26,12 +26,18 @@
 #
 #
 import argparse
+import datetime
+import hashlib
 import io
 import json
 import logging
 import os
 import random
 import string
+import struct
+import threading
+import zlib
+from concurrent.futures import ThreadPoolExecutor
 from time import monotonic
 
 import boto3
@@ -39,6 +45,7 @@ import requests
 import serial
 import serial.tools.list_ports
 from cryptography import x509
+from cryptography.hazmat.primitives import hashes, serialization
 from cryptography.hazmat.primitives.asymmetric import ec, rsa
 from cryptography.hazmat.primitives.serialization import load_pem_public_key
 from cryptography.x509.oid import NameOID
@@ -324,6 +331,355 @@ class TargetDevice:
             self._staged_config[key_b] = value_b
 
 
+class BinaryTargetDevice(TargetDevice):
+    """TargetDevice that moves configuration, keys and certificates through the
+    framed binary protocol of the "prov binary" command at a higher baud rate,
+    instead of "conf set" lines and PEM text.
+
+    The frame layout must match Common/cli/cli_prov.c.
+    """
+
+    SOF = 0xA5
+    RESPONSE = 0x80
+
+    PING = 0x01
+    EXIT = 0x02
+    KV_SET = 0x10
+    KV_COMMIT = 0x11
+    KEY_GEN = 0x20
+    CSR_GEN = 0x21
+    CERT_GEN = 0x22
+    CERT_WRITE = 0x23
+    CERT_READ = 0x24
+
+    ST_OK = 0
+    ST_ERR_CRC = 1
+    _status_str = {
+        2: "bad length",
+        3: "unknown request",
+        4: "invalid argument",
+        5: "failed",
+        6: "out of memory",
+    }
+
+    _header = struct.Struct("<BBBBH")
+    _retries = 3
+
+    def __init__(self, device, baud, binary_baud=460800):
+        """Connect to a target device and switch it to the binary protocol"""
+        self._text_baud = baud
+        self._binary_baud = binary_baud
+        self._seq = 0
+        self._max_payload = 0
+        self._binary = False
+        super().__init__(device, baud)
+        self._enter()
+
+    def _enter(self):
+        self._send_cmd(b"prov binary", bytes(str(self._binary_baud), "ascii"))
+
+        timeoutTime = monotonic() + self._timeout
+        while True:
+            if monotonic() > timeoutTime:
+                raise TargetDevice.ResponseTimeout()
+
+            line = self.sio.readline()
+            logging.debug("RX: {} (_enter)".format(line))
+
+            if b"PROV BINARY" in line:
+                break
+            elif any(errStr in line for errStr in self._error_bstr):
+                raise TargetDevice.TargetError(line)
+
+        # The target switches once its answer has been sent, so the first
+        # pings may be lost.
+        self.ser.baudrate = self._binary_baud
+        self._binary = True
+
+        payload = self._request(self.PING, retries=10, timeout=0.5)
+        _, _, self._max_payload = struct.unpack("<BBH", payload)
+
+    def _exit(self):
+        if self._binary:
+            self._request(self.EXIT)
+            self.ser.baudrate = self._text_baud
+            self._binary = False
+            self._sync()
+
+    def _read_frame(self, timeout):
+        timeoutTime = monotonic() + timeout
+
+        def read(length):
+            data = b""
+            while len(data) < length:
+                if monotonic() > timeoutTime:
+                    raise TargetDevice.ResponseTimeout()
+                data += self.ser.read(length - len(data))
+            return data
+
+        while read(1)[0] != self.SOF:
+            pass
+
+        header = bytes([self.SOF]) + read(self._header.size - 1)
+        _, frame_type, seq, status, length = self._header.unpack(header)
+        payload = read(length)
+        (crc,) = struct.unpack("<I", read(4))
+
+        if crc != zlib.crc32(header + payload):
+            status = self.ST_ERR_CRC
+
+        return frame_type, seq, status, payload
+
+    def _request(self, frame_type, payload=b"", retries=_retries, timeout=10.0):
+        """Send a request and return the payload of its answer, retrying on
+        transmission errors."""
+        assert self._binary
+        assert len(payload) <= max(self._max_payload, 0xFFFF)
+
+        self._seq = (self._seq + 1) & 0xFF
+        frame = self._header.pack(self.SOF, frame_type, self._seq, 0, len(payload))
+        frame += payload
+        frame += struct.pack("<I", zlib.crc32(frame))
+
+        for attempt in range(retries):
+            logging.debug(
+                "TX: type 0x{:02x}, {} bytes (_request)".format(frame_type, len(payload))
+            )
+            self.ser.reset_input_buffer()
+            self.ser.write(frame)
+            self.ser.flush()
+
+            try:
+                rx_type, rx_seq, status, rx_payload = self._read_frame(timeout)
+            except TargetDevice.ResponseTimeout:
+                continue
+
+            if (
+                status == self.ST_ERR_CRC
+                or rx_seq != self._seq
+                or rx_type != (frame_type | self.RESPONSE)
+            ):
+                continue
+            elif status != self.ST_OK:
+                raise TargetDevice.TargetError(
+                    "Request 0x{:02x}: {}".format(
+                        frame_type, self._status_str.get(status, status)
+                    )
+                )
+
+            return rx_payload
+
+        raise TargetDevice.ResponseTimeout()
+
+    @staticmethod
+    def _label(label=None):
+        label = bytes(label or "", "ascii")
+        assert len(label) <= 0xFF
+        return bytes([len(label)]) + label
+
+    def reset(self):
+        self._exit()
+        super().reset()
+
+    def write_cert(self, cert, label=None):
+        """Write a certificate in pem format to the specified label."""
+        der = x509.load_pem_x509_certificate(cert).public_bytes(
+            serialization.Encoding.DER
+        )
+        self._request(self.CERT_WRITE, self._label(label) + der)
+
+    def generate_key(self, label=None):
+        """Returns a byte string containing the public key of a newly generated keypair on the target"""
+        der = self._request(self.KEY_GEN, self._label(label) + self._label())
+        return serialization.load_der_public_key(der).public_bytes(
+            encoding=serialization.Encoding.PEM,
+            format=serialization.PublicFormat.SubjectPublicKeyInfo,
+        )
+
+    def generate_csr(self):
+        """Return a byte string containing a newly generated certificate signing request from the target."""
+        der = self._request(self.CSR_GEN, self._label())
+        return x509.load_der_x509_csr(der).public_bytes(serialization.Encoding.PEM)
+
+    def generate_cert(self):
+        der = self._request(self.CERT_GEN, self._label() + self._label())
+        return x509.load_der_x509_certificate(der).public_bytes(
+            serialization.Encoding.PEM
+        )
+
+    def conf_commit(self):
+        records = []
+        for key, value in self._staged_config.items():
+            if self._running_config.get(key, None) != value:
+                records.append(
+                    struct.pack("<B", len(key)) + key + struct.pack("<H", len(value)) + value
+                )
+
+        if len(records) == 0:
+            return
+
+        # Send as many entries per frame as fit
+        frame = b""
+        for record in records + [None]:
+            if record is None or len(frame) + len(record) > self._max_payload:
+                if len(frame) > 0:
+                    self._request(self.KV_SET, frame)
+                frame = b""
+            if record is not None:
+                frame += record
+
+        self._request(self.KV_COMMIT)
+
+        self._running_config.update(self._staged_config)
+
+
+class ProvisioningImage:
+    """Stand in for TargetDevice that collects the configuration, certificates
+    and keys of a device into an image for stm32u5_tool.sh flash_prov.
+
+    The layout must match Projects/b_u585i_iot02a_ntz/Src/fs/prov_image.h.
+    Keys are generated on the host in this mode, so the private key exists
+    outside of the device until the image is flashed and erased.
+    """
+
+    MAGIC = 0x564F5250
+    VERSION = 1
+    MAX_LEN = 64 * 1024
+
+    REC_KV = 1
+    REC_CERT = 2
+    REC_PRIVATE_KEY = 3
+    REC_PUBLIC_KEY = 4
+
+    DEFAULT_PRV_KEY_LABEL = "tls_key_priv"
+    DEFAULT_PUB_KEY_LABEL = "tls_key_pub"
+    DEFAULT_CERT_LABEL = "tls_cert"
+
+    def __init__(self):
+        self._config = {}
+        self._objects = []
+        self._key = None
+
+    def reset(self):
+        pass
+
+    def conf_commit(self):
+        pass
+
+    def conf_get(self, key):
+        return self._config.get(key, None)
+
+    def conf_get_all(self):
+        return self._config.copy()
+
+    def conf_set(self, key, value):
+        self._config[key] = value
+
+    def _add_object(self, rec_type, label, data):
+        # Replace an earlier object with the same label
+        self._objects = [o for o in self._objects if o[1] != label]
+        self._objects.append((rec_type, label, data))
+
+    def write_cert(self, cert, label=None):
+        """Add a certificate in pem format with the specified label."""
+        self._add_object(self.REC_CERT, label or self.DEFAULT_CERT_LABEL, cert)
+
+    def generate_key(self, label=None):
+        """Returns a byte string containing the public key of a newly generated keypair"""
+        self._key = ec.generate_private_key(ec.SECP256R1())
+
+        prv_pem = self._key.private_bytes(
+            encoding=serialization.Encoding.PEM,
+            format=serialization.PrivateFormat.PKCS8,
+            encryption_algorithm=serialization.NoEncryption(),
+        )
+        pub_pem = self._key.public_key().public_bytes(
+            encoding=serialization.Encoding.PEM,
+            format=serialization.PublicFormat.SubjectPublicKeyInfo,
+        )
+
+        self._add_object(
+            self.REC_PRIVATE_KEY, label or self.DEFAULT_PRV_KEY_LABEL, prv_pem
+        )
+        self._add_object(self.REC_PUBLIC_KEY, self.DEFAULT_PUB_KEY_LABEL, pub_pem)
+
+        return pub_pem
+
+    def _subject(self):
+        return x509.Name(
+            [x509.NameAttribute(NameOID.COMMON_NAME, self.conf_get("thing_name"))]
+        )
+
+    def generate_csr(self):
+        """Return a byte string containing a certificate signing request for the generated key."""
+        assert self._key
+
+        csr = (
+            x509.CertificateSigningRequestBuilder()
+            .subject_name(self._subject())
+            .sign(self._key, hashes.SHA256())
+        )
+        return csr.public_bytes(serialization.Encoding.PEM)
+
+    def generate_cert(self):
+        """Return and add a self-signed certificate for the generated key."""
+        assert self._key
+
+        now = datetime.datetime.utcnow()
+        cert = (
+            x509.CertificateBuilder()
+            .subject_name(self._subject())
+            .issuer_name(self._subject())
+            .public_key(self._key.public_key())
+            .serial_number(x509.random_serial_number())
+            .not_valid_before(now - datetime.timedelta(days=1))
+            .not_valid_after(now + datetime.timedelta(days=365 * 10))
+            .sign(self._key, hashes.SHA256())
+        )
+        cert_pem = cert.public_bytes(serialization.Encoding.PEM)
+
+        self.write_cert(cert_pem)
+
+        return cert_pem
+
+    @staticmethod
+    def _record(rec_type, name, data):
+        name = bytes(name, "ascii")
+        assert 0 < len(name) <= 0xFF
+        assert len(data) <= 0xFFFF
+
+        rec = struct.pack("<BBH", rec_type, len(name), len(data)) + name + data
+        return rec + bytes(-len(rec) % 4)
+
+    def to_bytes(self):
+        records = [
+            self._record(self.REC_KV, key, bytes(value, "utf-8"))
+            for key, value in self._config.items()
+        ]
+        records += [self._record(*o) for o in self._objects]
+
+        payload = b"".join(records)
+        header = struct.pack(
+            "<IHHI", self.MAGIC, self.VERSION, len(records), len(payload)
+        )
+        image = header + hashlib.sha256(payload).digest() + payload
+
+        if len(image) > self.MAX_LEN:
+            raise ValueError(
+                "Provisioning image of {} bytes exceeds {} bytes".format(
+                    len(image), self.MAX_LEN
+                )
+            )
+
+        return image
+
+    def save(self, path):
+        # Also kept on the host, so restrict access to the private key
+        fd = os.open(path, os.O_WRONLY | os.O_CREAT | os.O_TRUNC, 0o600)
+        with os.fdopen(fd, "wb") as f:
+            f.write(self.to_bytes())
+
+
 class AwsHelper:
     session = None
     session_valid = False
@@ -332,8 +688,11 @@ class AwsHelper:
     userId = None
     account = None
     arn = None
+    policy_ready = False
 
     def __init__(self, args):
+        # Registrations of several boards may run at once
+        self._lock = threading.Lock()
 
         # Convert Namespace to dict
         args = vars(args)
@@ -397,6 +756,12 @@ class AwsHelper:
         return endpoint_address
 
     def create_policy(self):
+        with self._lock:
+            if not self.policy_ready:
+                self._create_policy()
+                self.policy_ready = True
+
+    def _create_policy(self):
         if not self.iot_client:
             self.iot_client = self.get_client("iot")
 
@@ -426,12 +791,13 @@ class AwsHelper:
 
     # Register a device with IoT core and return the certificate
     def register_thing_csr(self, thing_name, csr):
-        if not self.iot_client:
-            self.iot_client = self.get_client("iot")
+        with self._lock:
+            if not self.iot_client:
+                self.iot_client = self.get_client("iot")
 
         assert self.iot_client
 
-        self.thing = {}
+        thing = {}
 
         cli = self.iot_client
 
@@ -439,27 +805,27 @@ class AwsHelper:
             certificateSigningRequest=csr, setAsActive=True
         )
         logging.debug("CreateCertificateFromCsr response: {}".format(cert_response))
-        self.thing.update(cert_response)
+        thing.update(cert_response)
 
         create_thing_resp = cli.create_thing(thingName=thing_name)
         logging.debug("CreateThing response: {}".format(create_thing_resp))
-        self.thing.update(create_thing_resp)
+        thing.update(create_thing_resp)
 
         if not (
-            "certificateArn" in self.thing
-            and "thingName" in self.thing
-            and "certificatePem" in self.thing
+            "certificateArn" in thing
+            and "thingName" in thing
+            and "certificatePem" in thing
         ):
             logging.error("Error: Certificate creation failed.")
         else:
             print(
                 "Attaching thing: {} to principal: {}".format(
-                    self.thing["thingName"], self.thing["certificateArn"]
+                    thing["thingName"], thing["certificateArn"]
                 )
             )
             cli.attach_thing_principal(
-                thingName=self.thing["thingName"],
-                principal=self.thing["certificateArn"],
+                thingName=thing["thingName"],
+                principal=thing["certificateArn"],
             )
 
         # Check for / create Policy
@@ -468,23 +834,24 @@ class AwsHelper:
         # Attach the policy to the principal.
         print('Attaching the "AllowAllDev" policy to the device certificate.')
         self.iot_client.attach_policy(
-            policyName="AllowAllDev", target=self.thing["certificateArn"]
+            policyName="AllowAllDev", target=thing["certificateArn"]
         )
 
-        self.thing["certificatePem"] = bytes(
-            self.thing["certificatePem"].replace("\\n", "\n"), "ascii"
+        thing["certificatePem"] = bytes(
+            thing["certificatePem"].replace("\\n", "\n"), "ascii"
         )
 
-        return self.thing.copy()
+        return thing.copy()
 
     # Register a device with IoT core with a given certificate
     def register_thing_cert(self, thing_name, cert):
-        if not self.iot_client:
-            self.iot_client = self.get_client("iot")
+        with self._lock:
+            if not self.iot_client:
+                self.iot_client = self.get_client("iot")
 
         assert self.iot_client
 
-        self.thing = {}
+        thing = {}
 
         cli = self.iot_client
 
@@ -492,23 +859,23 @@ class AwsHelper:
             certificatePem=cert, status="ACTIVE"
         )
         logging.debug("RegisterCertificateWithoutCA response: {}".format(cert_response))
-        self.thing.update(cert_response)
+        thing.update(cert_response)
 
         create_thing_resp = cli.create_thing(thingName=thing_name)
         logging.debug("CreateThing response: {}".format(create_thing_resp))
-        self.thing.update(create_thing_resp)
+        thing.update(create_thing_resp)
 
-        if not ("certificateArn" in self.thing and "thingName" in self.thing):
+        if not ("certificateArn" in thing and "thingName" in thing):
             logging.error("Error: Certificate creation failed.")
         else:
             print(
                 "Attaching thing: {} to principal: {}".format(
-                    self.thing["thingName"], self.thing["certificateArn"]
+                    thing["thingName"], thing["certificateArn"]
                 )
             )
             cli.attach_thing_principal(
-                thingName=self.thing["thingName"],
-                principal=self.thing["certificateArn"],
+                thingName=thing["thingName"],
+                principal=thing["certificateArn"],
             )
 
         # Check for / create Policy
@@ -517,16 +884,15 @@ class AwsHelper:
         # Attach the policy to the principal.
         print('Attaching the "AllowAllDev" policy to the device certificate.')
         self.iot_client.attach_policy(
-            policyName="AllowAllDev", target=self.thing["certificateArn"]
+            policyName="AllowAllDev", target=thing["certificateArn"]
         )
 
-        return self.thing.copy()
+        return thing.copy()
 
 
-def find_serial_port(usbVendorId=0x0483, usbProductId=0x374E):
+def find_serial_ports(usbVendorId=0x0483, usbProductId=0x374E):
     ports = serial.tools.list_ports.comports()
     matches = []
-    device = None
 
     for port in ports:
         attrs = dir(port)
@@ -545,6 +911,13 @@ def find_serial_port(usbVendorId=0x0483, usbProductId=0x374E):
             )
             if port.vid == usbVendorId and port.pid == usbProductId:
                 matches.append(port.device)
+    return matches
+
+
+def find_serial_port(usbVendorId=0x0483, usbProductId=0x374E):
+    matches = find_serial_ports(usbVendorId, usbProductId)
+    device = None
+
     # default to an empty string if no match was found.
     if len(matches) > 0:
         device = matches[0]
@@ -777,8 +1150,9 @@ def get_amazon_rootca_certs():
     return AmazonTrustRootCAs
 
 
-def provision_pki(target, aws, cert_issuer):
-    thing_name = target.conf_get("thing_name")
+def prepare_pki(target, cert_issuer):
+    """Generate a key pair on the target and the CSR or certificate to register."""
+    request = {"thing_name": target.conf_get("thing_name")}
 
     # Generate a key
     print("Generating a new public/private key pair")
@@ -794,35 +1168,53 @@ def provision_pki(target, aws, cert_issuer):
         # Generate a csr (returned in byte-string form)
         csr = target.generate_csr()
 
-        if not validate_csr(csr, pub_key, thing_name):
+        if not validate_csr(csr, pub_key, request["thing_name"]):
             print("Error: CSR is invalid.")
             raise SystemExit
 
-        # aws api requires csr in utf-8 string form.
-        thing_data = aws.register_thing_csr(thing_name, csr.decode("utf-8"))
-
-        if "certificatePem" in thing_data:
-            target.write_cert(thing_data["certificatePem"])
-        else:
-            print("Error: No certificate returned from register_thing_csr call.")
-            raise SystemExit
+        request["csr"] = csr
     elif cert_issuer == "self":
         print("Generating a self-signed Certificate")
 
         # Generate a cert (returned in byte-string form)
         cert = target.generate_cert()
 
-        if not validate_certificate(cert, pub_key, thing_name):
+        if not validate_certificate(cert, pub_key, request["thing_name"]):
             print("Error: Certificate is invalid.")
             raise SystemExit
 
-        # aws api requires csr in utf-8 string form.
-        thing_data = aws.register_thing_cert(thing_name, cert.decode("utf-8"))
+        request["cert"] = cert
     else:
         print("Error: Unknown certificate issuer.")
         raise SystemExit
 
-    ca_certs = get_amazon_rootca_certs()
+    return request
+
+
+def register_pki(aws, request):
+    """Register the thing and the certificate or CSR from prepare_pki with AWS IoT."""
+    # aws api requires csr / cert in utf-8 string form.
+    if "csr" in request:
+        thing_data = aws.register_thing_csr(
+            request["thing_name"], request["csr"].decode("utf-8")
+        )
+
+        if "certificatePem" not in thing_data:
+            print("Error: No certificate returned from register_thing_csr call.")
+            raise SystemExit
+    else:
+        thing_data = aws.register_thing_cert(
+            request["thing_name"], request["cert"].decode("utf-8")
+        )
+
+    return thing_data
+
+
+def install_pki(target, request, thing_data, ca_certs):
+    """Write the certificate issued by AWS, if any, and the root CA to the target."""
+    if "csr" in request:
+        target.write_cert(thing_data["certificatePem"])
+
     if ca_certs:
         for cert in ca_certs:
             if cert["label"] == "SFSRootCAG2":
@@ -830,6 +1222,115 @@ def provision_pki(target, aws, cert_issuer):
                 target.write_cert(cert["pem"], label="root_ca_cert")
 
 
+def provision_pki(target, aws, cert_issuer):
+    request = prepare_pki(target, cert_issuer)
+    thing_data = register_pki(aws, request)
+    install_pki(target, request, thing_data, get_amazon_rootca_certs())
+
+
+def provision_boards(args, aws, boards):
+    """Provision several boards at once.
+
+    boards is a list of ( name, function returning a TargetDevice or
+    ProvisioningImage ) tuples. The serial exchanges of all boards run
+    concurrently. The cloud side is
+    looked up once (endpoint, policy, root CA) and the per board registrations
+    run in a bounded pool, so the total time is close to that of one board.
+    Returns a list with the outcome for each board.
+    """
+    results = [
+        {
+            "device": name,
+            "open": open_target,
+            "thing_name": None,
+            "status": "ok",
+            "error": None,
+        }
+        for name, open_target in boards
+    ]
+
+    endpoint = aws.get_endpoint()
+    aws.create_policy()
+    ca_certs = get_amazon_rootca_certs()
+
+    def run_stage(fn, workers):
+        pending = [r for r in results if r["status"] == "ok"]
+
+        def run_one(result):
+            start = monotonic()
+            try:
+                fn(result)
+            except (Exception, SystemExit) as e:
+                result["status"] = "failed"
+                result["error"] = "{}: {}".format(fn.__name__, repr(e))
+                logging.error("{}: {}".format(result["device"], result["error"]))
+            result["seconds"] = result.get("seconds", 0) + monotonic() - start
+
+        workers = max(1, min(workers, len(pending)))
+        with ThreadPoolExecutor(max_workers=workers) as pool:
+            list(pool.map(run_one, pending))
+
+    def setup(result):
+        target = result["open"]()
+        result["target"] = target
+
+        configure_target(args, target)
+        target.conf_set("mqtt_endpoint", endpoint)
+        target.conf_commit()
+
+        result["request"] = prepare_pki(target, args.cert_issuer)
+        result["thing_name"] = result["request"]["thing_name"]
+
+    def register(result):
+        result["thing_data"] = register_pki(aws, result["request"])
+        result["certificate_arn"] = result["thing_data"].get("certificateArn")
+
+    def install(result):
+        target = result["target"]
+        install_pki(target, result["request"], result["thing_data"], ca_certs)
+
+        if isinstance(target, ProvisioningImage):
+            target.save(result["device"])
+        else:
+            target.reset()
+
+    run_stage(setup, len(results))
+    run_stage(register, args.aws_concurrency)
+    run_stage(install, len(results))
+
+    for result in results:
+        for key in ("open", "target", "request", "thing_data"):
+            result.pop(key, None)
+
+    return results
+
+
+def print_report(results, path=None):
+    print("")
+    print(
+        "{:<24} {:<20} {:<8} {:>8}  {}".format(
+            "Device", "Thing", "Status", "Time", "Error"
+        )
+    )
+    for r in results:
+        print(
+            "{:<24} {:<20} {:<8} {:>7.1f}s  {}".format(
+                r["device"],
+                r["thing_name"] or "-",
+                r["status"],
+                r.get("seconds", 0),
+                r["error"] or "",
+            )
+        )
+
+    failed = len([r for r in results if r["status"] != "ok"])
+    print("{} of {} boards provisioned.".format(len(results) - failed, len(results)))
+
+    if path:
+        with open(path, "w") as f:
+            json.dump(results, f, indent=2)
+
+
 def process_args():
     parser = argparse.ArgumentParser(argument_default=argparse.SUPPRESS)
 
@@ -840,6 +1341,22 @@ def process_args():
     # Default to stlink vid/pid if only one is connected, otherwise error.
     parser.add_argument("-d", "--device", type=str)
 
+    # Provision every connected board at once
+    parser.add_argument("--all", action="store_true")
+    # With --image, write this many images named after the --image path
+    parser.add_argument("--count", type=int)
+    parser.add_argument("--aws-concurrency", type=int, default=4)
+    parser.add_argument("--report", type=str)
+
+    # Write a provisioning image for stm32u5_tool.sh flash_prov instead of
+    # configuring a connected target over its CLI.
+    parser.add_argument("--image", type=str)
+
+    # Use the framed binary protocol of the "prov binary" command at --baud
+    # instead of the text CLI.
+    parser.add_argument("--binary", action="store_true")
+    parser.add_argument("--baud", type=int, default=460800)
+
     # Wifi config
     parser.add_argument("--wifi-ssid", type=str)
     parser.add_argument("--wifi-credential", type=str)
@@ -870,6 +1387,13 @@ def process_args():
     return parser.parse_args()
 
 
+def open_target(args, devpath):
+    if "binary" in args:
+        return BinaryTargetDevice(devpath, 115200, args.baud)
+    else:
+        return TargetDevice(devpath, 115200)
+
+
 def configure_target(args, target):
     # Override current config with cli provided config
     if "wifi_ssid" in args:
@@ -899,21 +1423,63 @@ def main():
     if "verbose" in args:
         logging.getLogger().setLevel(logging.DEBUG)
 
-    devpath = find_serial_port()
-    if "device" in args:
-        devpath = args.device
+    if "image" in args and "count" in args:
+        base, ext = os.path.splitext(args.image)
+        boards = [
+            ("{}_{}{}".format(base, i, ext or ".bin"), ProvisioningImage)
+            for i in range(args.count)
+        ]
+    elif "all" in args:
+        boards = [
+            (devpath, lambda devpath=devpath: open_target(args, devpath))
+            for devpath in find_serial_ports()
+        ]
+    else:
+        boards = None
 
-    if not devpath or len(devpath) == 0:
-        logging.error(
-            'Target device path could not be determined automatically. Please call this script with the "device" argument'
-        )
-        raise SystemExit
+    if boards is not None:
+        if len(boards) == 0:
+            logging.error("No target devices were found.")
+            raise SystemExit
+
+        if len(boards) > 1 and ("thing_name" in args or "interactive" in args):
+            logging.error(
+                "The thing-name and interactive options apply to a single board only."
+            )
+            raise SystemExit
+
+        print("Targets: {}".format(", ".join(name for name, _ in boards)))
+
+        aws = AwsHelper(args=args)
+        if not aws.check_credentials():
+            print("The provided AWS account credentials are inalid.")
+            raise SystemExit
+
+        results = provision_boards(args, aws, boards)
+        print_report(results, args.report if "report" in args else None)
+
+        if any(r["status"] != "ok" for r in results):
+            raise SystemExit(1)
+        return
+
+    if "image" in args:
+        target = ProvisioningImage()
     else:
-        print("Target device path: {}".format(devpath))
+        devpath = find_serial_port()
+        if "device" in args:
+            devpath = args.device
+
+        if not devpath or len(devpath) == 0:
+            logging.error(
+                'Target device path could not be determined automatically. Please call this script with the "device" argument'
+            )
+            raise SystemExit
+        else:
+            print("Target device path: {}".format(devpath))
 
-    print("Connecting to target...")
+        print("Connecting to target...")
 
-    target = TargetDevice(devpath, 115200)
+        target = open_target(args, devpath)
 
     configure_target(args, target)
 
@@ -934,6 +1500,15 @@ def main():
 
     provision_pki(target, aws, args.cert_issuer)
 
+    if "image" in args:
+        target.save(args.image)
+        print(
+            "Provisioning image written to {}. Program it with: stm32u5_tool.sh flash_prov {}".format(
+                args.image, args.image
+            )
+        )
+        return
+
     print("Provisioning process complete. Resetting target device...")
     target.reset()
 
@@ -0,0 +1,189 @@
+#!/usr/bin/env python3
+#  FreeRTOS STM32 Reference Integration
+#
+#  Copyright (C) 2022 Amazon.com, Inc. or its affiliates.  All Rights Reserved.
+#
+#  Permission is hereby granted, free of charge, to any person obtaining a copy of
+#  this software and associated documentation files (the "Software"), to deal in
+#  the Software without restriction, including without limitation the rights to
+#  use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+#  the Software, and to permit persons to whom the Software is furnished to do so,
+#  subject to the following conditions:
+#
+#  The above copyright notice and this permission notice shall be included in all
+#  copies or substantial portions of the Software.
+#
+#  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+#  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+#  FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+#  COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+#  IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+#  CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+#
+#  https://www.FreeRTOS.org
+#  https://github.com/FreeRTOS
+#
+
+"""Report the functions that the b_u585i_iot02a_ntz build executes from SRAM.
+
+The .ramfunc section of STM32U585AIIXQ_FLASH.ld lists the input sections to
+place in SRAM1, grouped under a comment giving the reason. This script reads
+that list and the map file of a build. It prints the size and address of each
+placed section, grouped the same way, and flags names that matched nothing.
+The linker ignores those silently, e.g. after a function is renamed upstream.
+Misses are not flagged in a group whose reason ends with "if any".
+"""
+
+import fnmatch
+import os
+import re
+import sys
+from argparse import ArgumentParser
+
+SCRIPT_DIR = os.path.dirname(os.path.abspath(__file__))
+PROJECT_DIR = os.path.join(SCRIPT_DIR, os.pardir, "Projects", "b_u585i_iot02a_ntz")
+LINKER_SCRIPT = os.path.join(PROJECT_DIR, "STM32U585AIIXQ_FLASH.ld")
+OUTPUT_SECTION = ".ramfunc"
+
+PATTERN_RE = re.compile(r"^\s*(\*[\w.*-]*)\(([^)]+)\)")
+COMMENT_START_RE = re.compile(r"^\s*/\*(.*)")
+INPUT_SECTION_RE = re.compile(r"^ (\.\S+)(?:\s+(0x[0-9a-f]+)\s+(0x[0-9a-f]+)\s+(\S+))?$")
+ADDR_SIZE_FILE_RE = re.compile(r"^\s+(0x[0-9a-f]+)\s+(0x[0-9a-f]+)\s+(\S+)$")
+SYMBOL_RE = re.compile(r"^\s+0x[0-9a-f]+\s+([A-Za-z_]\w*)$")
+
+
+def read_patterns(path):
+    """Return the (reason, [(file pattern, section pattern)]) groups of the section."""
+    groups = []
+    in_section = False
+    reason = None
+    comment = None
+
+    with open(path, "r") as f:
+        for line in f:
+            if not in_section:
+                in_section = line.strip().startswith(OUTPUT_SECTION + " ")
+                continue
+            if line.strip().startswith("}"):
+                break
+
+            if comment is not None:
+                comment.append(line.strip().lstrip("*").strip())
+                if "*/" in line:
+                    reason = " ".join(comment).replace("*/", "").strip()
+                    comment = None
+                continue
+
+            match = PATTERN_RE.match(line)
+            if match:
+                if not groups or groups[-1][0] != reason:
+                    groups.append((reason, []))
+                for section in match.group(2).split():
+                    groups[-1][1].append((match.group(1), section))
+                continue
+
+            match = COMMENT_START_RE.match(line)
+            if match:
+                comment = [match.group(1).strip()]
+                if "*/" in line:
+                    reason = match.group(1).replace("*/", "").strip()
+                    comment = None
+
+    return groups
+
+
+def read_map(path):
+    """Return the placed input sections as [name, address, size, file, symbols]."""
+    sections = []
+    in_section = False
+    pending = None
+
+    with open(path, "r") as f:
+        for line in f:
+            line = line.rstrip("\n")
+            if not in_section:
+                in_section = line.startswith(OUTPUT_SECTION + " ")
+                continue
+            if line and not line.startswith(" "):
+                break
+
+            if pending is not None:
+                # Long section names continue on the next line
+                match = ADDR_SIZE_FILE_RE.match(line)
+                if match:
+                    address, size, obj = match.groups()
+                    sections.append([pending, int(address, 16), int(size, 16), obj, []])
+                pending = None
+                continue
+
+            match = INPUT_SECTION_RE.match(line)
+            if match:
+                name, address, size, obj = match.groups()
+                if address is None:
+                    pending = name
+                else:
+                    sections.append([name, int(address, 16), int(size, 16), obj, []])
+                continue
+
+            match = SYMBOL_RE.match(line)
+            if match and sections:
+                sections[-1][4].append(match.group(1))
+
+    return [s for s in sections if s[2] > 0]
+
+
+def main():
+    argparser = ArgumentParser(description=__doc__.splitlines()[0])
+    argparser.add_argument(
+        "map", help="Map file of the build, e.g. Debug/b_u585i_iot02a_ntz.map."
+    )
+    argparser.add_argument(
+        "--ld", default=LINKER_SCRIPT, help="Linker script of the build."
+    )
+    args = argparser.parse_args()
+
+    groups = read_patterns(args.ld)
+    sections = read_map(args.map)
+
+    if not sections:
+        raise SystemExit("Error: no {} section in {}".format(OUTPUT_SECTION, args.map))
+
+    missing = 0
+    placed = set()
+
+    for reason, patterns in groups:
+        reason = reason or "(no reason given)"
+        optional = reason.endswith("if any")
+        print(reason)
+        for file_pattern, section_pattern in patterns:
+            matched = [
+                s
+                for s in sections
+                if fnmatch.fnmatch(s[0], section_pattern)
+                and fnmatch.fnmatch(os.path.basename(s[3]), file_pattern)
+                and id(s) not in placed
+            ]
+            if not matched and not optional:
+                print("    {:<48} not placed".format(section_pattern))
+                missing += 1
+            for s in matched:
+                placed.add(id(s))
+                # The map only names global symbols
+                names = ", ".join(s[4]) if s[4] else "(static) " + s[0]
+                print(
+                    "    {:<48} 0x{:08x} {:>6} {}".format(
+                        names, s[1], s[2], os.path.basename(s[3])
+                    )
+                )
+        print()
+
+    total = sum(s[2] for s in sections)
+    print("{} bytes in {} sections".format(total, len(sections)))
+
+    if missing:
+        print("{} names matched nothing".format(missing))
+        sys.exit(1)
+
+
+if __name__ == "__main__":
+    main()
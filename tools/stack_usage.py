@@ -0,0 +1,212 @@
+#!/usr/bin/env python3
+#  FreeRTOS STM32 Reference Integration
+#
+#  Copyright (C) 2022 Amazon.com, Inc. or its affiliates.  All Rights Reserved.
+#
+#  Permission is hereby granted, free of charge, to any person obtaining a copy of
+#  this software and associated documentation files (the "Software"), to deal in
+#  the Software without restriction, including without limitation the rights to
+#  use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+#  the Software, and to permit persons to whom the Software is furnished to do so,
+#  subject to the following conditions:
+#
+#  The above copyright notice and this permission notice shall be included in all
+#  copies or substantial portions of the Software.
+#
+#  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+#  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+#  FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+#  COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+#  IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+#  CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+#
+#  https://www.FreeRTOS.org
+#  https://github.com/FreeRTOS
+#
+
+"""Estimate the worst case stack use of each task from the GCC stack usage output.
+
+The b_u585i_iot02a_ntz project is built with -fstack-usage and
+-fcallgraph-info=su, which leave a .su file with the frame size of each
+function and a .ci call graph next to every object file. This script walks the
+call graph from the entry function of each task and compares the deepest path
+with the stack depth the task is created with.
+
+Indirect calls (function pointers, e.g. the transport and CLI callbacks) and
+recursion cannot be followed and are listed, so the estimate is a lower bound
+for tasks that make them. Compare with "ps hints" on a device that has gone
+through its usual workload before shrinking a stack.
+"""
+
+import os
+import re
+import sys
+from argparse import ArgumentParser
+
+# Context saved on the task stack by the Cortex-M33 port with the FPU in use:
+# the extended exception frame and the registers pushed by PendSV.
+CONTEXT_BYTES = 26 * 4 + 26 * 4
+WORD_BYTES = 4
+INDIRECT_CALL = "__indirect_call"
+
+TASK_CREATE_RE = re.compile(
+    r"xTaskCreate(?:StaticStack)?\s*\(\s*&?\s*(\w+)\s*,\s*\"([^\"]+)\"\s*,\s*(\w+)"
+)
+DEFINE_RE = re.compile(r"^\s*#\s*define\s+(\w+)\s+\(?\s*(\d+)U?\s*\)?\s*$", re.MULTILINE)
+VCG_NODE_RE = re.compile(r"node:\s*\{\s*title:\s*\"([^\"]+)\"\s*label:\s*\"([^\"]*)\"")
+VCG_EDGE_RE = re.compile(r"edge:\s*\{\s*sourcename:\s*\"([^\"]+)\"\s*targetname:\s*\"([^\"]+)\"")
+LABEL_BYTES_RE = re.compile(r"(\d+) bytes \((\w+)")
+
+
+class Function:
+    def __init__(self, title, frame, qualifier):
+        self.title = title
+        self.frame = frame
+        self.qualifier = qualifier
+        self.callees = set()
+
+
+def find_files(root, extensions):
+    for dirpath, _, filenames in os.walk(root):
+        for filename in filenames:
+            if filename.endswith(extensions):
+                yield os.path.join(dirpath, filename)
+
+
+def load_call_graph(build_dir):
+    """Return the functions defined in the build, keyed by their call graph title.
+
+    GCC titles static functions "<unit>:<name>", so they do not clash across units.
+    """
+    functions = {}
+    edges = []
+
+    for path in find_files(build_dir, (".ci",)):
+        with open(path, encoding="utf-8", errors="replace") as ci_file:
+            text = ci_file.read()
+
+        for title, label in VCG_NODE_RE.findall(text):
+            match = LABEL_BYTES_RE.search(label)
+            if match is not None:
+                functions[title] = Function(title, int(match.group(1)), match.group(2))
+
+        # Nodes without a frame size are declared in this unit and defined elsewhere
+        edges.extend(VCG_EDGE_RE.findall(text))
+
+    for source, target in edges:
+        if source in functions:
+            functions[source].callees.add(target)
+
+    return functions
+
+
+def worst_path(functions, entry):
+    """Return the deepest stack use from entry in bytes, its call path and the problems found."""
+    memo = {}
+    issues = set()
+
+    def walk(function, active):
+        if function.title in memo:
+            return memo[function.title]
+
+        if function.qualifier != "static":
+            issues.add("{} has a {} frame".format(function.title, function.qualifier))
+
+        deepest = (0, [])
+        active.add(function.title)
+        for callee in sorted(function.callees):
+            target = functions.get(callee)
+            if callee == INDIRECT_CALL:
+                issues.add("{} makes indirect calls".format(function.title))
+            elif target is None:
+                issues.add("{} calls {}, no stack usage available".format(function.title, callee))
+            elif callee in active:
+                issues.add("{} recurses through {}".format(function.title, callee))
+            else:
+                depth, path = walk(target, active)
+                if depth > deepest[0]:
+                    deepest = (depth, path)
+        active.discard(function.title)
+
+        memo[function.title] = (function.frame + deepest[0], [function.title] + deepest[1])
+        return memo[function.title]
+
+    return walk(entry, set()) + (sorted(issues),)
+
+
+def find_tasks(source_dirs):
+    """Return (entry, task name, depth in words or None) for each task created in the sources."""
+    defines = {}
+    creates = []
+
+    for source_dir in source_dirs:
+        for path in find_files(source_dir, (".c", ".h")):
+            with open(path, encoding="utf-8", errors="replace") as source_file:
+                text = source_file.read()
+            for name, value in DEFINE_RE.findall(text):
+                defines.setdefault(name, int(value))
+            creates.extend(TASK_CREATE_RE.findall(text))
+
+    tasks = []
+    for entry, name, depth in creates:
+        words = int(depth) if depth.isdigit() else defines.get(depth)
+        tasks.append((entry, name, words))
+
+    return sorted(set(tasks), key=lambda task: task[1])
+
+
+def main():
+    argparser = ArgumentParser(description=__doc__.splitlines()[0])
+    argparser.add_argument("build_dir", help="Build output directory holding the .su and .ci files, e.g. Debug.")
+    argparser.add_argument(
+        "-s",
+        "--source",
+        action="append",
+        help="Source directory searched for the tasks, may be repeated. Defaults to Common and the ntz project.",
+    )
+    argparser.add_argument(
+        "--margin", type=int, default=25, help="Margin in percent added to the estimate for the suggestion, as TASK_STATS_STACK_MARGIN_PCT."
+    )
+    argparser.add_argument("-v", "--verbose", action="store_true", help="Print the deepest call path of each task.")
+    args = argparser.parse_args()
+
+    repo_dir = os.path.dirname(os.path.dirname(os.path.abspath(__file__)))
+    source_dirs = args.source or [
+        os.path.join(repo_dir, "Common"),
+        os.path.join(repo_dir, "Projects", "b_u585i_iot02a_ntz", "Src"),
+    ]
+
+    functions = load_call_graph(args.build_dir)
+    if not functions:
+        print("No call graph found in {}, build with -fstack-usage -fcallgraph-info=su.".format(args.build_dir))
+        return 1
+
+    print("{:<16} {:<32} {:>8} {:>8} {:>8}  {}".format("Task", "Entry", "Estimate", "Stack", "Suggest", "Notes"))
+
+    total_slack = 0
+    for entry, name, words in find_tasks(source_dirs):
+        function = functions.get(entry)
+        if function is None:
+            print("{:<16} {:<32} {:>8} {:>8} {:>8}  not in this build".format(name, entry, "-", words or "?", "-"))
+            continue
+
+        depth, path, issues = worst_path(functions, function)
+        needed_words = -(-(depth + CONTEXT_BYTES) // WORD_BYTES)
+        suggest = -(-(needed_words * (100 + args.margin) // 100) // 64) * 64
+        if words is not None and suggest < words:
+            total_slack += (words - suggest) * WORD_BYTES
+
+        notes = "; ".join(issues[:2]) + (" ..." if len(issues) > 2 else "")
+        print("{:<16} {:<32} {:>8} {:>8} {:>8}  {}".format(name, entry, needed_words, words or "?", suggest, notes))
+
+        if args.verbose:
+            print("    " + " > ".join(path))
+            for issue in issues:
+                print("    " + issue)
+
+    print("\nStacks and estimates in words. Stack beyond the suggestions: {} bytes.".format(total_slack))
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
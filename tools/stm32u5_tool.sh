@@ -63,6 +63,10 @@ fi
 NSBOOTADD0_DFLT=$(printf "0x%x" $((0x08000000>>7)))
 FP=0x7f
 
+# Memory mapped address of the OSPI NOR flash, where a provisioning image starts
+PROV_IMAGE_ADDR=0x70000000
+PROV_EXT_LOADER_NAME="MX25LM51245G_STM32U585I-IOT02A.stldr"
+
 check_ntz_vars() {
     echo "Project name:     ${PROJECT_NAME}"
     echo "Build path:       ${BUILD_PATH}"
@@ -255,6 +259,38 @@ case "$1" in
             exit 1
         }
         ;;
+    "flash_prov")
+        # Image written by tools/provision.py --image, applied by the ntz firmware on its next boot
+        PROV_IMAGE="${2:-${PROV_IMAGE}}"
+
+        if [ -z "${PROV_IMAGE}" ] || [ ! -e "${PROV_IMAGE}" ]; then
+            echo "Error: provisioning image does not exist: '${PROV_IMAGE}'"
+            echo "Usage: $0 flash_prov <image.bin>"
+            exit 1
+        fi
+
+        if [ -z "${PROV_EXT_LOADER}" ]; then
+            if [ -z "${PROG_BIN_DIR}" ]; then
+                PROG_BIN_DIR=$(dirname "$(command -v "${PROG_BIN}")")
+            fi
+            PROV_EXT_LOADER=$(find "${PROG_BIN_DIR}" -name "${PROV_EXT_LOADER_NAME}" -type f | head -n 1)
+        fi
+
+        if [ -z "${PROV_EXT_LOADER}" ] || [ ! -e "${PROV_EXT_LOADER}" ]; then
+            echo "Error: Failed to locate the ${PROV_EXT_LOADER_NAME} external loader."
+            echo "Please define PROV_EXT_LOADER with its path."
+            exit 1
+        fi
+
+        echo "Provisioning image: ${PROV_IMAGE}"
+        echo "External loader:    ${PROV_EXT_LOADER}"
+
+        echo "Writing provisioning image."
+        prog_cli mode=UR -el "${PROV_EXT_LOADER}" -d "${PROV_IMAGE}" "${PROV_IMAGE_ADDR}" -v || {
+            echo "Error: Failed to program ${PROV_IMAGE}."
+            exit 1
+        }
+        ;;
     *)
         echo "Error: No valid option was specified: '$1'"
         exit 1
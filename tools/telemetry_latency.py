@@ -0,0 +1,262 @@
+#!/usr/bin/env python3
+#  FreeRTOS STM32 Reference Integration
+#
+#  Copyright (C) 2022 Amazon.com, Inc. or its affiliates.  All Rights Reserved.
+#
+#  Permission is hereby granted, free of charge, to any person obtaining a copy of
+#  this software and associated documentation files (the "Software"), to deal in
+#  the Software without restriction, including without limitation the rights to
+#  use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+#  the Software, and to permit persons to whom the Software is furnished to do so,
+#  subject to the following conditions:
+#
+#  The above copyright notice and this permission notice shall be included in all
+#  copies or substantial portions of the Software.
+#
+#  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+#  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+#  FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+#  COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+#  IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+#  CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+#
+#  https://www.FreeRTOS.org
+#  https://github.com/FreeRTOS
+#
+
+
+"""Break the latency of traced sensor publishes down into stages.
+
+Builds with TELEMETRY_TRACE_ENABLED set add a "trace" object to the env and
+motion sensor payloads, see Common/app/telemetry_trace.h. Its stage times are
+in us since the sample was taken on the device:
+
+  read      the sample reached the publishing task
+  build     the payload was encoded
+  enqueue   the publish was handed to the MQTT agent
+  agent     the agent took it from its command queue (agent statistics builds)
+  tls       the TLS write returned
+  network   the broker received it, from the cloud arrival time
+
+The enqueue, agent and TLS stages of a payload are only known once it has been
+sent, so they arrive in the "prev" object of the next payload of the same
+topic. The network stage needs the wall clock time of the sample (t0_ms), so
+payloads sent before the device synchronized its clock only contribute to the
+on-device stages. It also includes the Wi-Fi transmit time, which the device
+cannot attribute to a single message.
+
+The input holds one JSON object per line, as stored by an IoT rule like
+
+  SELECT *, topic() AS topic, timestamp() AS cloud_ms FROM '+/env_sensor_data'
+
+Objects of the form {"topic": ..., "timestamp": ..., "payload": {...}} are
+read as well. Typical use:
+
+  % python tools/telemetry_latency.py messages.jsonl
+  % python tools/telemetry_latency.py --json summary.json messages.jsonl
+"""
+
+import argparse
+import json
+import logging
+import math
+import sys
+
+logger = logging.getLogger()
+
+STAGES = ("read", "build", "enqueue", "agent", "tls", "network", "total")
+
+# TimeBaseSource_t values for which t0_ms is comparable with the cloud clock
+SYNCED_SOURCES = (3,)
+
+
+def percentile(values, pct):
+    """Nearest rank percentile of an already sorted list."""
+    rank = max(1, int(math.ceil(pct / 100.0 * len(values))))
+    return values[rank - 1]
+
+
+def parse_message(line):
+    """Return (topic, payload, cloud_ms) for one input line, or None."""
+    try:
+        msg = json.loads(line)
+    except ValueError:
+        return None
+
+    if not isinstance(msg, dict):
+        return None
+
+    if isinstance(msg.get("payload"), dict):
+        payload = msg["payload"]
+        cloud_ms = msg.get("cloud_ms", msg.get("timestamp"))
+    else:
+        payload = msg
+        cloud_ms = msg.get("cloud_ms")
+
+    if "trace" not in payload:
+        return None
+
+    return msg.get("topic", ""), payload, cloud_ms
+
+
+def load_records(stream):
+    """Join the trace of each payload with the "prev" object that follows it."""
+    records = {}
+
+    for line in stream:
+        line = line.strip()
+        if not line:
+            continue
+
+        parsed = parse_message(line)
+        if parsed is None:
+            continue
+
+        topic, payload, cloud_ms = parsed
+        trace = payload["trace"]
+
+        rec = records.setdefault((topic, trace["id"]), {})
+        rec.update(
+            {
+                "t0_ms": trace.get("t0_ms"),
+                "src": trace.get("src", 0),
+                "read_us": trace.get("read_us"),
+                "build_us": trace.get("build_us"),
+                "cloud_ms": cloud_ms,
+            }
+        )
+
+        prev = trace.get("prev")
+        if prev is not None:
+            prev_rec = records.setdefault((topic, prev["id"]), {})
+            prev_rec.update(
+                {
+                    "queue_us": prev.get("queue_us"),
+                    "dequeue_us": prev.get("dequeue_us"),
+                    "sent_us": prev.get("sent_us"),
+                    "ok": prev.get("ok", 1),
+                }
+            )
+
+    return records
+
+
+def stage_times(rec):
+    """Return the duration of each known stage of a record in us."""
+    stages = {}
+
+    if rec.get("read_us") is not None:
+        stages["read"] = rec["read_us"]
+
+    if rec.get("build_us") is not None and rec.get("read_us") is not None:
+        stages["build"] = rec["build_us"] - rec["read_us"]
+
+    if rec.get("queue_us") is not None and rec.get("build_us") is not None:
+        stages["enqueue"] = rec["queue_us"] - rec["build_us"]
+
+    if rec.get("sent_us") is not None:
+        if rec.get("dequeue_us") is not None:
+            stages["agent"] = rec["dequeue_us"] - rec["queue_us"]
+            stages["tls"] = rec["sent_us"] - rec["dequeue_us"]
+        elif rec.get("queue_us") is not None:
+            # Without agent statistics the agent queue is part of the TLS stage
+            stages["tls"] = rec["sent_us"] - rec["queue_us"]
+
+    if (
+        rec.get("t0_ms") is not None
+        and rec.get("cloud_ms") is not None
+        and rec.get("src") in SYNCED_SOURCES
+    ):
+        total_us = (rec["cloud_ms"] - rec["t0_ms"]) * 1000
+        stages["total"] = total_us
+
+        if rec.get("sent_us") is not None:
+            stages["network"] = total_us - rec["sent_us"]
+
+    return stages
+
+
+def summarize(records):
+    """Collect the percentiles of each stage over all successful publishes."""
+    samples = {stage: [] for stage in STAGES}
+    failed = 0
+
+    for rec in records.values():
+        if rec.get("ok", 1) == 0:
+            failed += 1
+            continue
+
+        for stage, value in stage_times(rec).items():
+            samples[stage].append(value)
+
+    summary = {"records": len(records), "failed": failed, "stages": {}}
+
+    for stage in STAGES:
+        values = sorted(samples[stage])
+        if not values:
+            continue
+
+        summary["stages"][stage] = {
+            "count": len(values),
+            "p50_us": percentile(values, 50),
+            "p90_us": percentile(values, 90),
+            "p99_us": percentile(values, 99),
+            "max_us": values[-1],
+        }
+
+    return summary
+
+
+def print_summary(summary):
+    print("{} traced publishes, {} failed".format(summary["records"], summary["failed"]))
+    print(
+        "{:<10} {:>8} {:>12} {:>12} {:>12} {:>12}".format(
+            "stage", "count", "p50 us", "p90 us", "p99 us", "max us"
+        )
+    )
+
+    for stage in STAGES:
+        row = summary["stages"].get(stage)
+        if row is None:
+            continue
+
+        print(
+            "{:<10} {:>8} {:>12} {:>12} {:>12} {:>12}".format(
+                stage, row["count"], row["p50_us"], row["p90_us"], row["p99_us"], row["max_us"]
+            )
+        )
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    parser.add_argument(
+        "input", nargs="?", help="JSON lines file of received messages, stdin by default"
+    )
+    parser.add_argument("--json", help="Also write the summary to this JSON file")
+    parser.add_argument("-v", "--verbose", action="store_true", help="Enable debug logging")
+    args = parser.parse_args()
+
+    logging.basicConfig(level=logging.DEBUG if args.verbose else logging.INFO)
+
+    if args.input:
+        with open(args.input, "r") as stream:
+            records = load_records(stream)
+    else:
+        records = load_records(sys.stdin)
+
+    if not records:
+        logger.error("No traced payloads found.")
+        return 1
+
+    summary = summarize(records)
+    print_summary(summary)
+
+    if args.json:
+        with open(args.json, "w") as out:
+            json.dump(summary, out, indent=2)
+
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())